@@ -0,0 +1,94 @@
+/**
+ * buffer_pool_manager_bench.cpp
+ *
+ * FetchPage/UnpinPage throughput. Pages are picked uniformly at random from a
+ * working set of pool_size * 100 / hit_rate pages, so about hit_rate percent
+ * of the fetches find their page resident. Random page ids come from a fixed
+ * seed, every run fetches the same sequence.
+ */
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "buffer/buffer_pool_manager.h"
+
+namespace cmudb {
+
+#define BENCH_SEED 15445
+// page ids drawn per thread, reused in a loop
+#define BENCH_SEQUENCE 65536
+
+static BufferPoolManager *bpm;
+
+static void BM_FetchUnpin(benchmark::State &state) {
+  size_t pool_size = state.range(0);
+  size_t pages = pool_size * 100 / state.range(1);
+  if (state.thread_index() == 0) {
+    remove("bench.db");
+    bpm = new BufferPoolManager(pool_size, "bench.db", state.range(2));
+    page_id_t page_id;
+    for (size_t i = 0; i < pages; ++i) {
+      bpm->NewPage(page_id);
+      bpm->UnpinPage(page_id, true);
+    }
+    // the first pages now on disk
+    bpm->FlushAllPages();
+    bpm->ResetStats();
+  }
+
+  std::mt19937 random(BENCH_SEED + state.thread_index());
+  std::uniform_int_distribution<page_id_t> distribution(0, pages - 1);
+  std::vector<page_id_t> page_ids(BENCH_SEQUENCE);
+  for (auto &page_id : page_ids)
+    page_id = distribution(random);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    page_id_t page_id = page_ids[i++ % BENCH_SEQUENCE];
+    Page *page = bpm->FetchPage(page_id);
+    benchmark::DoNotOptimize(page);
+    if (page != nullptr)
+      bpm->UnpinPage(page_id, false);
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    BufferPoolStats stats = bpm->GetStats();
+    state.counters["hit_rate"] =
+        stats.fetches_ == 0 ? 0 : 100.0 * stats.hits_ / stats.fetches_;
+    delete bpm;
+    remove("bench.db");
+    remove("bench.meta");
+  }
+}
+
+// (pool size, hit rate in percent, partitions)
+BENCHMARK(BM_FetchUnpin)
+    ->ArgsProduct({{64, 1024, 16384}, {100, 90, 50}, {1}})
+    ->UseRealTime();
+BENCHMARK(BM_FetchUnpin)
+    ->Args({1024, 90, 1})
+    ->Args({1024, 90, 8})
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+static void BM_NewPage(benchmark::State &state) {
+  remove("bench.db");
+  bpm = new BufferPoolManager(state.range(0), "bench.db");
+  page_id_t page_id;
+  for (auto _ : state) {
+    Page *page = bpm->NewPage(page_id);
+    benchmark::DoNotOptimize(page);
+    bpm->UnpinPage(page_id, true);
+  }
+  state.SetItemsProcessed(state.iterations());
+  delete bpm;
+  remove("bench.db");
+  remove("bench.meta");
+}
+
+BENCHMARK(BM_NewPage)->Arg(64)->Arg(1024);
+
+} // namespace cmudb
@@ -0,0 +1,105 @@
+/**
+ * page_trace_replay.cpp
+ *
+ * Replays a page access trace of the buffer pool (BufferPoolManager::
+ * StartTrace, or SELECT vtable_page_trace('file') through the extension)
+ * against the LRU, CLOCK and LRU-K replacers at several pool sizes, and
+ * prints the fetch hit rate of each: the hit rate curve of the workload, to
+ * pick a policy and size the pool before deploying.
+ *
+ * Pool sizes double from 16 frames up to the pages the trace touches unless
+ * given. Pages pinned when the trace started are not known to it, a pool
+ * smaller than the pages pinned at once counts pin failures.
+ *
+ * Usage: page_trace_replay TRACE [--pool-sizes N,N,...] [--k N]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "buffer/clock_replacer.h"
+#include "buffer/lru_k_replacer.h"
+#include "buffer/lru_replacer.h"
+#include "buffer/page_trace.h"
+
+namespace cmudb {
+
+struct Options {
+  std::string trace_;
+  std::vector<size_t> pool_sizes_;
+  size_t k_ = 2;
+};
+
+static bool ParseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--pool-sizes") == 0 && i + 1 < argc) {
+      for (char *size = strtok(argv[++i], ","); size != nullptr;
+           size = strtok(nullptr, ","))
+        if (atol(size) > 0)
+          options.pool_sizes_.push_back(atol(size));
+    } else if (strcmp(argv[i], "--k") == 0 && i + 1 < argc) {
+      options.k_ = std::max(atol(argv[++i]), 1L);
+    } else if (argv[i][0] != '-' && options.trace_.empty()) {
+      options.trace_ = argv[i];
+    } else {
+      return false;
+    }
+  }
+  return !options.trace_.empty();
+}
+
+static int Run(const Options &options) {
+  std::vector<PageTraceRecord> records;
+  if (!PageTrace::Read(options.trace_, records)) {
+    fprintf(stderr, "%s is no page trace\n", options.trace_.c_str());
+    return 1;
+  }
+  std::unordered_set<page_id_t> pages;
+  for (const PageTraceRecord &record : records)
+    pages.insert(record.page_id_);
+  std::vector<size_t> pool_sizes = options.pool_sizes_;
+  if (pool_sizes.empty()) {
+    size_t size = 16;
+    for (; size < pages.size(); size *= 2)
+      pool_sizes.push_back(size);
+    pool_sizes.push_back(std::max<size_t>(pages.size(), 1));
+  }
+  printf("%s: %zu records, %zu pages\n", options.trace_.c_str(),
+         records.size(), pages.size());
+  printf("%10s %10s %10s %10s %12s\n", "pool_size", "lru", "clock",
+         ("lru_" + std::to_string(options.k_)).c_str(), "pin_failures");
+  for (size_t pool_size : pool_sizes) {
+    std::unique_ptr<Replacer<page_id_t>> replacers[] = {
+        std::unique_ptr<Replacer<page_id_t>>(new LRUReplacer<page_id_t>),
+        std::unique_ptr<Replacer<page_id_t>>(new ClockReplacer<page_id_t>),
+        std::unique_ptr<Replacer<page_id_t>>(
+            new LRUKReplacer<page_id_t>(options.k_))};
+    printf("%10zu", pool_size);
+    uint64_t pin_failures = 0;
+    for (auto &replacer : replacers) {
+      ReplaySummary summary = ReplayPageTrace(records, *replacer, pool_size);
+      printf(" %9.2f%%", summary.GetHitRate() * 100);
+      pin_failures = std::max(pin_failures, summary.pin_failures_);
+    }
+    printf(" %12llu\n", static_cast<unsigned long long>(pin_failures));
+  }
+  return 0;
+}
+
+} // namespace cmudb
+
+int main(int argc, char **argv) {
+  cmudb::Options options;
+  if (!cmudb::ParseOptions(argc, argv, options)) {
+    fprintf(stderr,
+            "usage: %s TRACE [--pool-sizes N,N,...] [--k N]\n", argv[0]);
+    return 2;
+  }
+  return cmudb::Run(options);
+}
@@ -0,0 +1,151 @@
+/**
+ * lock_manager_bench.cpp
+ *
+ * Lock and unlock throughput of tuple locks under contention: threads pick
+ * rids from a table of range(0) rids, fewer rids means more conflicts.
+ * Every lock is released right away, a thread holds one lock at a time.
+ * BM_LockDisjoint gives every thread rows of its own, threads only meet on
+ * the latches of the lock table partitions. BM_LockHotRows has transactions
+ * lock two of a few hot rows, under wait-die or deadlock detection, and
+ * counts the aborts per commit.
+ */
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "concurrency/lock_manager.h"
+
+namespace cmudb {
+
+#define BENCH_SEED 15445
+#define BENCH_SEQUENCE 65536
+
+static LockManager *lock_manager;
+
+static void LockUnlock(benchmark::State &state, bool exclusive) {
+  if (state.thread_index() == 0)
+    lock_manager = new LockManager(false);
+  std::mt19937 random(BENCH_SEED + state.thread_index());
+  std::uniform_int_distribution<int32_t> distribution(0, state.range(0) - 1);
+  std::vector<RID> rids;
+  for (int i = 0; i < BENCH_SEQUENCE; ++i)
+    rids.emplace_back(0, distribution(random));
+
+  // younger transactions die under wait-die, they retry with a new id
+  txn_id_t next_txn_id = state.thread_index();
+  size_t i = 0;
+  for (auto _ : state) {
+    const RID &rid = rids[i++ % BENCH_SEQUENCE];
+    Transaction txn(next_txn_id);
+    next_txn_id += state.threads();
+    bool locked = exclusive ? lock_manager->LockExclusive(&txn, rid)
+                            : lock_manager->LockShared(&txn, rid);
+    if (locked)
+      lock_manager->Unlock(&txn, rid);
+    benchmark::DoNotOptimize(locked);
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0)
+    delete lock_manager;
+}
+
+/*
+ * Transactions of range(0) exclusive locks on rows no other thread locks,
+ * released at commit
+ */
+static void BM_LockDisjoint(benchmark::State &state) {
+  if (state.thread_index() == 0)
+    lock_manager = new LockManager(true);
+  std::vector<RID> rids;
+  for (int i = 0; i < BENCH_SEQUENCE; ++i)
+    rids.emplace_back(state.thread_index(), i);
+
+  txn_id_t next_txn_id = state.thread_index();
+  size_t i = 0;
+  for (auto _ : state) {
+    Transaction txn(next_txn_id);
+    next_txn_id += state.threads();
+    for (int64_t j = 0; j < state.range(0); ++j)
+      lock_manager->LockExclusive(&txn, rids[i++ % BENCH_SEQUENCE]);
+    txn.SetState(TransactionState::COMMITTED);
+    // Unlock erases from the lock set
+    std::vector<RID> locked(txn.GetExclusiveLockSet()->begin(),
+                            txn.GetExclusiveLockSet()->end());
+    for (auto &rid : locked)
+      benchmark::DoNotOptimize(lock_manager->Unlock(&txn, rid));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  if (state.thread_index() == 0)
+    delete lock_manager;
+}
+
+/*
+ * Transactions of two exclusive locks on range(0) rows, in any order, held
+ * for a short while. Deadlock detection runs if range(1) is set. Aborted
+ * transactions retry with a new id
+ */
+static void BM_LockHotRows(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    lock_manager = new LockManager(true);
+    if (state.range(1) != 0)
+      lock_manager->StartDeadlockDetection(std::chrono::milliseconds(1));
+  }
+  std::mt19937 random(BENCH_SEED + state.thread_index());
+  std::uniform_int_distribution<int32_t> distribution(0, state.range(0) - 1);
+
+  txn_id_t next_txn_id = state.thread_index();
+  int64_t aborts = 0;
+  for (auto _ : state) {
+    int32_t first = distribution(random), second = distribution(random);
+    while (second == first)
+      second = distribution(random);
+    while (true) {
+      Transaction txn(next_txn_id);
+      next_txn_id += state.threads();
+      bool locked = lock_manager->LockExclusive(&txn, RID(0, first)) &&
+                    lock_manager->LockExclusive(&txn, RID(0, second));
+      if (locked)
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+      txn.SetState(locked ? TransactionState::COMMITTED
+                          : TransactionState::ABORTED);
+      lock_manager->UnlockAll(&txn);
+      if (locked)
+        break;
+      aborts++;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["aborts"] = benchmark::Counter(
+      static_cast<double>(aborts), benchmark::Counter::kAvgIterations);
+  if (state.thread_index() == 0)
+    delete lock_manager;
+}
+
+static void BM_LockShared(benchmark::State &state) {
+  LockUnlock(state, false);
+}
+
+static void BM_LockExclusive(benchmark::State &state) {
+  LockUnlock(state, true);
+}
+
+// number of distinct rids
+BENCHMARK(BM_LockShared)->Arg(1)->Arg(1024)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_LockExclusive)
+    ->Arg(1)
+    ->Arg(1024)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+// locks per transaction
+BENCHMARK(BM_LockDisjoint)->Arg(8)->ThreadRange(1, 16)->UseRealTime();
+// hot rows, deadlock detection
+BENCHMARK(BM_LockHotRows)
+    ->Args({4, 0})
+    ->Args({4, 1})
+    ->ThreadRange(2, 8)
+    ->UseRealTime();
+
+} // namespace cmudb
@@ -0,0 +1,124 @@
+/**
+ * b_plus_tree_bench.cpp
+ *
+ * B+ tree insert, point lookup and full scan on 8 byte keys, 1 to 64 threads
+ * sharing one tree. Keys are a fixed permutation, runs are repeatable.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "buffer/buffer_pool_manager.h"
+#include "index/b_plus_tree.h"
+#include "vtable/virtual_table.h"
+
+namespace cmudb {
+
+#define BENCH_SEED 15445
+#define BENCH_POOL_SIZE 4096
+// keys of the tree looked up and scanned
+#define BENCH_KEYS 100000
+
+typedef BPlusTree<GenericKey<8>, RID, GenericComparator<8>> BenchTree;
+
+static BufferPoolManager *bpm;
+static Schema *key_schema;
+static BenchTree *tree;
+
+static std::vector<int64_t> Permutation(size_t count, size_t seed) {
+  std::vector<int64_t> keys(count);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(seed));
+  return keys;
+}
+
+static void SetUp(size_t keys) {
+  remove("bench.db");
+  bpm = new BufferPoolManager(BENCH_POOL_SIZE, "bench.db");
+  key_schema = ParseCreateStatement("a bigint");
+  page_id_t header_page_id;
+  bpm->NewPage(header_page_id);
+  bpm->UnpinPage(header_page_id, true);
+  tree = new BenchTree("bench_index", bpm,
+                       GenericComparator<8>(key_schema));
+  GenericKey<8> index_key;
+  for (int64_t key : Permutation(keys, BENCH_SEED)) {
+    index_key.SetFromInteger(key);
+    tree->Insert(index_key, RID(key >> 32, key & 0xFFFFFFFF));
+  }
+}
+
+static void TearDown() {
+  delete tree;
+  delete key_schema;
+  delete bpm;
+  remove("bench.db");
+  remove("bench.meta");
+}
+
+static void BM_Insert(benchmark::State &state) {
+  if (state.thread_index() == 0)
+    SetUp(0);
+  // threads insert disjoint keys: key % threads is the thread index
+  std::vector<int64_t> keys = Permutation(BENCH_KEYS, BENCH_SEED);
+  int64_t threads = state.threads();
+  GenericKey<8> index_key;
+  size_t i = 0;
+  for (auto _ : state) {
+    int64_t key = (keys[i % BENCH_KEYS] + BENCH_KEYS * (i / BENCH_KEYS)) *
+                      threads +
+                  state.thread_index();
+    index_key.SetFromInteger(key);
+    benchmark::DoNotOptimize(tree->Insert(index_key, RID(key)));
+    ++i;
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0)
+    TearDown();
+}
+
+BENCHMARK(BM_Insert)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_GetValue(benchmark::State &state) {
+  if (state.thread_index() == 0)
+    SetUp(BENCH_KEYS);
+  std::vector<int64_t> keys =
+      Permutation(BENCH_KEYS, BENCH_SEED + 1 + state.thread_index());
+  GenericKey<8> index_key;
+  std::vector<RID> result;
+  size_t i = 0;
+  for (auto _ : state) {
+    index_key.SetFromInteger(keys[i++ % BENCH_KEYS]);
+    result.clear();
+    benchmark::DoNotOptimize(tree->GetValue(index_key, result));
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0)
+    TearDown();
+}
+
+BENCHMARK(BM_GetValue)->ThreadRange(1, 64)->UseRealTime();
+
+static void BM_Scan(benchmark::State &state) {
+  if (state.thread_index() == 0)
+    SetUp(BENCH_KEYS);
+  for (auto _ : state) {
+    size_t count = 0;
+    for (auto iterator = tree->Begin(); !iterator.isEnd(); ++iterator) {
+      benchmark::DoNotOptimize(*iterator);
+      ++count;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * BENCH_KEYS);
+  if (state.thread_index() == 0)
+    TearDown();
+}
+
+BENCHMARK(BM_Scan)->ThreadRange(1, 64)->UseRealTime();
+
+} // namespace cmudb
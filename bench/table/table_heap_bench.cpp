@@ -0,0 +1,292 @@
+/**
+ * table_heap_bench.cpp
+ *
+ * TableHeap insert and sequential scan of fixed size tuples, row at a time
+ * and by batch, serial or split over threads, inserts from several writers, on slotted and PAX pages, with
+ * and without the compressed page cache or zone maps. No lock manager, the
+ * cost is that of the heap and the buffer pool.
+ */
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "buffer/buffer_pool_manager.h"
+#include "table/parallel_scan.h"
+#include "table/table_heap.h"
+#include "vtable/virtual_table.h"
+
+namespace cmudb {
+
+#define BENCH_POOL_SIZE 1024
+// tuples of the scanned table
+#define BENCH_TUPLES 100000
+
+static Tuple MakeTuple(Schema *schema, int32_t key, size_t width) {
+  std::string text(width, 'x');
+  std::vector<Value> values{
+      Value(TypeId::INTEGER, key),
+      Value(TypeId::VARCHAR, text.c_str(), text.size() + 1, true)};
+  return Tuple(values, schema);
+}
+
+static void BM_Insert(benchmark::State &state) {
+  remove("bench.db");
+  BufferPoolManager bpm(BENCH_POOL_SIZE, "bench.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar");
+  Tuple tuple = MakeTuple(schema, 0, state.range(0));
+  Transaction transaction(0);
+  TableHeap *table = new TableHeap(&bpm, nullptr);
+  RID rid;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(table->InsertTuple(tuple, rid, &transaction));
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * tuple.GetLength());
+  delete table;
+  delete schema;
+  remove("bench.db");
+  remove("bench.meta");
+}
+
+// varchar width in byte
+BENCHMARK(BM_Insert)->Arg(16)->Arg(128)->Arg(1024);
+
+// range(0) writer threads, every one with its own transaction inserting
+// BENCH_TUPLES / range(0) tuples per iteration
+static void BM_ConcurrentInsert(benchmark::State &state) {
+  remove("bench.db");
+  BufferPoolManager bpm(4 * BENCH_POOL_SIZE, "bench.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar");
+  Tuple tuple = MakeTuple(schema, 0, 64);
+  size_t threads = state.range(0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    TableHeap *table = new TableHeap(&bpm, nullptr);
+    state.ResumeTiming();
+    std::vector<std::thread> writers;
+    for (size_t i = 0; i < threads; ++i)
+      writers.emplace_back([&, i] {
+        Transaction transaction(i);
+        RID rid;
+        for (size_t j = 0; j < BENCH_TUPLES / threads; ++j)
+          benchmark::DoNotOptimize(
+              table->InsertTuple(tuple, rid, &transaction));
+      });
+    for (auto &writer : writers)
+      writer.join();
+    state.PauseTiming();
+    delete table;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * BENCH_TUPLES);
+  delete schema;
+  remove("bench.db");
+  remove("bench.meta");
+}
+
+BENCHMARK(BM_ConcurrentInsert)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+static void BM_Scan(benchmark::State &state) {
+  remove("bench.db");
+  BufferPoolManager bpm(state.range(0), "bench.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar");
+  Transaction transaction(0);
+  TableHeap *table = new TableHeap(&bpm, nullptr);
+  RID rid;
+  for (int32_t i = 0; i < BENCH_TUPLES; ++i)
+    table->InsertTuple(MakeTuple(schema, i, 64), rid, &transaction);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    for (auto iterator = table->begin(&transaction);
+         iterator != table->end(); ++iterator)
+      sum += iterator->GetValue(schema, 0).GetAs<int32_t>();
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * BENCH_TUPLES);
+  delete table;
+  delete schema;
+  remove("bench.db");
+  remove("bench.meta");
+}
+
+// pool size, the table fits in the larger pool only
+BENCHMARK(BM_Scan)->Arg(64)->Arg(BENCH_POOL_SIZE);
+
+static void BM_BatchScan(benchmark::State &state) {
+  remove("bench.db");
+  BufferPoolManager bpm(state.range(0), "bench.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar");
+  Transaction transaction(0);
+  TableHeap *table = new TableHeap(&bpm, nullptr);
+  RID rid;
+  for (int32_t i = 0; i < BENCH_TUPLES; ++i)
+    table->InsertTuple(MakeTuple(schema, i, 64), rid, &transaction);
+  RowBatch batch(schema);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    TableBatchIterator iterator(table, &transaction);
+    while (iterator.Next(batch))
+      for (uint32_t i = 0; i < batch.GetSelectedCount(); i++)
+        sum += *reinterpret_cast<const int32_t *>(
+            batch.GetFixed(0, batch.GetSelected(i)));
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * BENCH_TUPLES);
+  delete table;
+  delete schema;
+  remove("bench.db");
+  remove("bench.meta");
+}
+
+BENCHMARK(BM_BatchScan)->Arg(64)->Arg(BENCH_POOL_SIZE);
+
+// one column of five decoded, range(0) 1 for PAX pages
+static void BM_ProjectedScan(benchmark::State &state) {
+  remove("bench.db");
+  // the whole table stays in the pool
+  BufferPoolManager bpm(4 * BENCH_POOL_SIZE, "bench.db");
+  Schema *schema =
+      ParseCreateStatement("a int, b bigint, c bigint, d bigint, e double");
+  Transaction transaction(0);
+  PaxLayout layout;
+  if (state.range(0) == 1)
+    layout = PaxLayout(schema);
+  TableHeap *table = new TableHeap(&bpm, nullptr, nullptr, INVALID_PAGE_ID,
+                                   INVALID_PAGE_ID, layout);
+  RID rid;
+  for (int32_t i = 0; i < BENCH_TUPLES; ++i) {
+    std::vector<Value> values{
+        Value(TypeId::INTEGER, i), Value(TypeId::BIGINT, (int64_t)i),
+        Value(TypeId::BIGINT, (int64_t)i), Value(TypeId::BIGINT, (int64_t)i),
+        Value(TypeId::DECIMAL, (double)i)};
+    table->InsertTuple(Tuple(values, schema), rid, &transaction);
+  }
+  RowBatch batch(schema);
+  batch.SetProjection(1);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    TableBatchIterator iterator(table, &transaction);
+    while (iterator.Next(batch))
+      for (uint32_t i = 0; i < batch.GetSelectedCount(); i++)
+        sum += *reinterpret_cast<const int32_t *>(
+            batch.GetFixed(0, batch.GetSelected(i)));
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * BENCH_TUPLES);
+  delete table;
+  delete schema;
+  remove("bench.db");
+  remove("bench.meta");
+}
+
+BENCHMARK(BM_ProjectedScan)->Arg(0)->Arg(1);
+
+// PAX table of runs and few distinct values ten times the pool, range(0)
+// bytes of the compressed page cache. Direct I/O, the OS caches nothing
+static void BM_CompressedScan(benchmark::State &state) {
+  remove("bench.db");
+  BufferPoolManager bpm(64, "bench.db", 1, ReplacerType::LRU, true);
+  if (state.range(0) > 0)
+    bpm.GetDiskManager()->EnablePageCache(state.range(0));
+  Schema *schema = ParseCreateStatement("a int, b bigint, c int");
+  Transaction transaction(0);
+  TableHeap *table = new TableHeap(&bpm, nullptr, nullptr, INVALID_PAGE_ID,
+                                   INVALID_PAGE_ID, PaxLayout(schema));
+  RID rid;
+  for (int32_t i = 0; i < 2 * BENCH_TUPLES; ++i) {
+    std::vector<Value> values{Value(TypeId::INTEGER, i / 1000),
+                              Value(TypeId::BIGINT, (int64_t)i),
+                              Value(TypeId::INTEGER, i % 7)};
+    table->InsertTuple(Tuple(values, schema), rid, &transaction);
+  }
+  RowBatch batch(schema);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    TableBatchIterator iterator(table, &transaction);
+    while (iterator.Next(batch))
+      for (uint32_t i = 0; i < batch.GetSelectedCount(); i++)
+        sum += *reinterpret_cast<const int32_t *>(
+            batch.GetFixed(2, batch.GetSelected(i)));
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * 2 * BENCH_TUPLES);
+  delete table;
+  delete schema;
+  remove("bench.db");
+  remove("bench.meta");
+}
+
+BENCHMARK(BM_CompressedScan)->Arg(0)->Arg(256 * PAGE_SIZE);
+
+// one percent of a time ordered table by a range, range(0) 1 with zone maps
+static void BM_RangeScan(benchmark::State &state) {
+  remove("bench.db");
+  BufferPoolManager bpm(BENCH_POOL_SIZE, "bench.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar");
+  Transaction transaction(0);
+  TableHeap *table = new TableHeap(&bpm, nullptr);
+  if (state.range(0) == 1)
+    table->EnableZoneMap(schema);
+  RID rid;
+  for (int32_t i = 0; i < BENCH_TUPLES; ++i)
+    table->InsertTuple(MakeTuple(schema, i, 64), rid, &transaction);
+  RowBatch batch(schema);
+  std::vector<BatchPredicate> predicates{
+      BatchPredicate(0, CompareType::GE, Value(TypeId::INTEGER, 50000)),
+      BatchPredicate(0, CompareType::LT,
+                     Value(TypeId::INTEGER, 50000 + BENCH_TUPLES / 100))};
+  batch.SetPredicates(predicates);
+  for (auto _ : state) {
+    int64_t count = 0;
+    TableBatchIterator iterator(table, &transaction);
+    while (iterator.Next(batch))
+      count += batch.GetSelectedCount();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * BENCH_TUPLES);
+  delete table;
+  delete schema;
+  remove("bench.db");
+  remove("bench.meta");
+}
+
+BENCHMARK(BM_RangeScan)->Arg(0)->Arg(1);
+
+// range(0) scan threads, every one summing its own batches
+static void BM_ParallelScan(benchmark::State &state) {
+  remove("bench.db");
+  BufferPoolManager bpm(BENCH_POOL_SIZE, "bench.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar");
+  Transaction transaction(0);
+  TableHeap *table = new TableHeap(&bpm, nullptr);
+  RID rid;
+  for (int32_t i = 0; i < BENCH_TUPLES; ++i)
+    table->InsertTuple(MakeTuple(schema, i, 64), rid, &transaction);
+  size_t threads = state.range(0);
+  std::vector<RowBatch *> batches;
+  for (size_t i = 0; i < threads; ++i)
+    batches.push_back(new RowBatch(schema));
+  for (auto _ : state) {
+    std::vector<int64_t> sums(threads, 0);
+    ParallelTableScan scan(table, &transaction, threads);
+    scan.Run(batches, [&](RowBatch &batch, size_t worker) {
+      for (uint32_t i = 0; i < batch.GetSelectedCount(); i++)
+        sums[worker] += *reinterpret_cast<const int32_t *>(
+            batch.GetFixed(0, batch.GetSelected(i)));
+    });
+    benchmark::DoNotOptimize(sums.data());
+  }
+  state.SetItemsProcessed(state.iterations() * BENCH_TUPLES);
+  for (auto batch : batches)
+    delete batch;
+  delete table;
+  delete schema;
+  remove("bench.db");
+  remove("bench.meta");
+}
+
+BENCHMARK(BM_ParallelScan)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+} // namespace cmudb
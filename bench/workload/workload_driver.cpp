@@ -0,0 +1,558 @@
+/**
+ * workload_driver.cpp
+ *
+ * End to end workloads through SQLite and the vtable extension: the YCSB core
+ * workloads A-F and a TPC-C subset (New-Order, Payment, Order-Status). Every
+ * operation runs prepared statements against virtual tables with indexes, so
+ * planner, VtabFilter/VtabColumn/VtabUpdate and the storage below are all
+ * measured. Throughput and p50/p99 latency are reported per operation.
+ *
+ * The extension does not keep one transaction across the statements of an SQL
+ * transaction yet, so transactions run their statements in autocommit mode
+ * and bulk loads write one table per SQL transaction.
+ *
+ * The extension keeps its data in vtable.db of the working directory, the
+ * driver starts from an empty one. Random choices come from --seed, a run
+ * is repeatable.
+ *
+ * Usage: workload_driver [--workload a|b|c|d|e|f|tpcc] [--records N]
+ *        [--operations N] [--seed N] [--pool-size N] [--extension PATH]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/latency_stats.h"
+#include "sqlite/sqlite3.h"
+
+namespace cmudb {
+
+// YCSB record: key plus YCSB_FIELDS fields of YCSB_FIELD_LENGTH bytes
+#define YCSB_FIELDS 10
+#define YCSB_FIELD_LENGTH 100
+#define YCSB_MAX_SCAN 100
+#define ZIPFIAN_THETA 0.99
+
+// TPC-C scale, reduced from the 3000 customers and 100000 items of the spec
+#define TPCC_DISTRICTS 10
+#define TPCC_CUSTOMERS 300
+#define TPCC_ITEMS 10000
+// order ids of one district, order lines of one order
+#define TPCC_MAX_ORDERS 1000000
+#define TPCC_MAX_LINES 16
+
+struct Options {
+  std::string workload_ = "a";
+  int64_t records_ = 10000;
+  int64_t operations_ = 100000;
+  uint32_t seed_ = 15445;
+  int64_t pool_size_ = 1024;
+  std::string extension_ = WORKLOAD_EXTENSION;
+};
+
+/*
+ * Zipfian over [0, n) as in YCSB (Gray et al., "Quickly generating
+ * billion-record synthetic databases"), item 0 is the most popular
+ */
+class ZipfianGenerator {
+public:
+  ZipfianGenerator(int64_t n, double theta = ZIPFIAN_THETA)
+      : n_(n), theta_(theta) {
+    double zeta2 = Zeta(2);
+    zetan_ = Zeta(n_);
+    alpha_ = 1.0 / (1.0 - theta_);
+    eta_ = (1 - std::pow(2.0 / n_, 1 - theta_)) / (1 - zeta2 / zetan_);
+  }
+
+  int64_t Next(std::mt19937_64 &random) {
+    double u = std::uniform_real_distribution<double>(0, 1)(random);
+    double uz = u * zetan_;
+    if (uz < 1.0)
+      return 0;
+    if (uz < 1.0 + std::pow(0.5, theta_))
+      return 1;
+    int64_t value = n_ * std::pow(eta_ * u - eta_ + 1, alpha_);
+    return std::min(value, n_ - 1);
+  }
+
+private:
+  double Zeta(int64_t n) {
+    double sum = 0;
+    for (int64_t i = 1; i <= n; ++i)
+      sum += 1 / std::pow(i, theta_);
+    return sum;
+  }
+
+  int64_t n_;
+  double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+};
+
+// popular items spread over the key space, as YCSB's scrambled zipfian
+static int64_t Scramble(int64_t value, int64_t n) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < 8; ++i) {
+    hash ^= (value >> (8 * i)) & 0xff;
+    hash *= 1099511628211ULL;
+  }
+  return hash % n;
+}
+
+class Driver {
+public:
+  Driver(const Options &options)
+      : options_(options), random_(options.seed_) {}
+
+  ~Driver() {
+    for (auto &statement : statements_)
+      sqlite3_finalize(statement.second);
+    if (db_ != nullptr)
+      sqlite3_close(db_);
+  }
+
+  bool Open() {
+    remove("workload.db");
+    remove("vtable.db");
+    remove("vtable.meta");
+    remove("vtable.log");
+    std::string uri = "file:workload.db?vtable_pool_size=" +
+                      std::to_string(options_.pool_size_);
+    if (sqlite3_open_v2(uri.c_str(), &db_,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                            SQLITE_OPEN_URI,
+                        nullptr) != SQLITE_OK)
+      return Fail("open");
+    sqlite3_enable_load_extension(db_, 1);
+    char *error = nullptr;
+    if (sqlite3_load_extension(db_, options_.extension_.c_str(), nullptr,
+                               &error) != SQLITE_OK) {
+      fprintf(stderr, "can't load %s: %s\n", options_.extension_.c_str(),
+              error != nullptr ? error : "");
+      sqlite3_free(error);
+      return false;
+    }
+    return true;
+  }
+
+  bool Run() {
+    const std::string &workload = options_.workload_;
+    if (workload == "tpcc")
+      return LoadTPCC() && RunTPCC();
+    if (workload.size() == 1 && workload[0] >= 'a' && workload[0] <= 'f')
+      return LoadYCSB() && RunYCSB(workload[0]);
+    fprintf(stderr, "unknown workload %s\n", workload.c_str());
+    return false;
+  }
+
+  void Report() {
+    double seconds = elapsed_.count() / 1e9;
+    uint64_t total = 0;
+    for (auto &operation : latencies_)
+      total += operation.second.GetCount();
+    printf("workload %s: %llu operations in %.2f s, %.0f ops/s\n",
+           options_.workload_.c_str(), static_cast<unsigned long long>(total),
+           seconds, seconds > 0 ? total / seconds : 0);
+    printf("%-14s %10s %10s %10s %10s\n", "operation", "count", "ops/s",
+           "p50 us", "p99 us");
+    for (auto &operation : latencies_) {
+      LatencyHistogram &histogram = operation.second;
+      printf("%-14s %10llu %10.0f %10.1f %10.1f\n", operation.first.c_str(),
+             static_cast<unsigned long long>(histogram.GetCount()),
+             seconds > 0 ? histogram.GetCount() / seconds : 0,
+             histogram.GetPercentile(0.5) / 1e3,
+             histogram.GetPercentile(0.99) / 1e3);
+    }
+  }
+
+private:
+  bool Fail(const std::string &what) {
+    fprintf(stderr, "%s: %s\n", what.c_str(), sqlite3_errmsg(db_));
+    return false;
+  }
+
+  bool Exec(const std::string &sql) {
+    char *error = nullptr;
+    if (sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &error) !=
+        SQLITE_OK) {
+      fprintf(stderr, "%s: %s\n", sql.c_str(), error != nullptr ? error : "");
+      sqlite3_free(error);
+      return false;
+    }
+    return true;
+  }
+
+  // statements are prepared once and reset after every use
+  sqlite3_stmt *Prepare(const std::string &sql) {
+    auto found = statements_.find(sql);
+    if (found != statements_.end())
+      return found->second;
+    sqlite3_stmt *statement = nullptr;
+    if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &statement, nullptr) !=
+        SQLITE_OK) {
+      Fail(sql);
+      exit(1);
+    }
+    statements_[sql] = statement;
+    return statement;
+  }
+
+  // bind integer arguments, step through every row, return the rows seen
+  int Step(const std::string &sql, const std::vector<int64_t> &arguments,
+           int64_t *first_column = nullptr) {
+    sqlite3_stmt *statement = Prepare(sql);
+    for (size_t i = 0; i < arguments.size(); ++i)
+      sqlite3_bind_int64(statement, i + 1, arguments[i]);
+    int rows = 0;
+    int rc;
+    while ((rc = sqlite3_step(statement)) == SQLITE_ROW) {
+      if (rows++ == 0 && first_column != nullptr)
+        *first_column = sqlite3_column_int64(statement, 0);
+    }
+    if (rc != SQLITE_DONE) {
+      Fail(sql);
+      exit(1);
+    }
+    sqlite3_reset(statement);
+    return rows;
+  }
+
+  int64_t Uniform(int64_t low, int64_t high) {
+    return std::uniform_int_distribution<int64_t>(low, high)(random_);
+  }
+
+  std::string RandomString(size_t length) {
+    std::string text(length, ' ');
+    for (auto &c : text)
+      c = 'a' + Uniform(0, 25);
+    return text;
+  }
+
+  // time one operation, the total run time only counts operations
+  template <typename F> void Measure(const std::string &operation, F body) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    latencies_[operation].Add(latency.count());
+    elapsed_ += latency;
+  }
+
+  /* YCSB */
+  bool LoadYCSB() {
+    std::string columns = "ycsb_key bigint";
+    for (int i = 0; i < YCSB_FIELDS; ++i)
+      columns += ", field" + std::to_string(i) + " varchar(" +
+                 std::to_string(YCSB_FIELD_LENGTH) + ")";
+    if (!Exec("CREATE VIRTUAL TABLE usertable USING vtable ('" + columns +
+              "', 'unique usertable_pk ycsb_key')"))
+      return false;
+    Exec("BEGIN");
+    for (int64_t key = 0; key < options_.records_; ++key)
+      InsertRecord(key);
+    Exec("COMMIT");
+    next_key_ = options_.records_;
+    return true;
+  }
+
+  void InsertRecord(int64_t key) {
+    std::string sql = "INSERT INTO usertable VALUES(?";
+    for (int i = 0; i < YCSB_FIELDS; ++i)
+      sql += ", ?";
+    sqlite3_stmt *statement = Prepare(sql + ")");
+    sqlite3_bind_int64(statement, 1, key);
+    for (int i = 0; i < YCSB_FIELDS; ++i) {
+      std::string field = RandomString(YCSB_FIELD_LENGTH);
+      sqlite3_bind_text(statement, i + 2, field.c_str(), field.size(),
+                        SQLITE_TRANSIENT);
+    }
+    if (sqlite3_step(statement) != SQLITE_DONE) {
+      Fail("insert");
+      exit(1);
+    }
+    sqlite3_reset(statement);
+  }
+
+  void UpdateRecord(int64_t key) {
+    sqlite3_stmt *statement =
+        Prepare("UPDATE usertable SET field0 = ? WHERE ycsb_key = ?");
+    std::string field = RandomString(YCSB_FIELD_LENGTH);
+    sqlite3_bind_text(statement, 1, field.c_str(), field.size(),
+                      SQLITE_TRANSIENT);
+    sqlite3_bind_int64(statement, 2, key);
+    if (sqlite3_step(statement) != SQLITE_DONE) {
+      Fail("update");
+      exit(1);
+    }
+    sqlite3_reset(statement);
+  }
+
+  void ReadRecord(int64_t key) {
+    Step("SELECT * FROM usertable WHERE ycsb_key = ?", {key});
+  }
+
+  /*
+   * Mixes of the YCSB core workloads:
+   * A 50% read 50% update, B 95% read 5% update, C read only,
+   * D 95% read of recent records 5% insert, E 95% short scan 5% insert,
+   * F 50% read 50% read-modify-write. Keys are scrambled zipfian, D reads
+   * the latest inserted keys the most.
+   */
+  bool RunYCSB(char workload) {
+    double read = 0, update = 0, insert = 0, scan = 0;
+    switch (workload) {
+    case 'a':
+      read = 0.5, update = 0.5;
+      break;
+    case 'b':
+      read = 0.95, update = 0.05;
+      break;
+    case 'c':
+      read = 1;
+      break;
+    case 'd':
+      read = 0.95, insert = 0.05;
+      break;
+    case 'e':
+      scan = 0.95, insert = 0.05;
+      break;
+    case 'f':
+      read = 0.5;
+      break;
+    }
+    ZipfianGenerator zipfian(options_.records_);
+    auto next_key = [&]() {
+      if (workload == 'd')
+        return std::max<int64_t>(0, next_key_ - 1 - zipfian.Next(random_));
+      return Scramble(zipfian.Next(random_), next_key_);
+    };
+    std::uniform_real_distribution<double> choice(0, 1);
+    for (int64_t i = 0; i < options_.operations_; ++i) {
+      double p = choice(random_);
+      if (p < read) {
+        int64_t key = next_key();
+        Measure("read", [&] { ReadRecord(key); });
+      } else if (p < read + update) {
+        int64_t key = next_key();
+        Measure("update", [&] { UpdateRecord(key); });
+      } else if (p < read + update + insert) {
+        Measure("insert", [&] { InsertRecord(next_key_++); });
+      } else if (p < read + update + insert + scan) {
+        int64_t key = next_key();
+        int64_t length = Uniform(1, YCSB_MAX_SCAN);
+        Measure("scan", [&] {
+          Step("SELECT * FROM usertable WHERE ycsb_key >= ? LIMIT ?",
+               {key, length});
+        });
+      } else {
+        int64_t key = next_key();
+        Measure("read-modify", [&] {
+          ReadRecord(key);
+          UpdateRecord(key);
+        });
+      }
+    }
+    return true;
+  }
+
+  /* TPC-C, composite keys are packed into one integer */
+  static int64_t DistrictKey(int64_t d) { return d; }
+  static int64_t CustomerKey(int64_t d, int64_t c) {
+    return d * TPCC_CUSTOMERS + c;
+  }
+  static int64_t OrderKey(int64_t d, int64_t o) {
+    return d * TPCC_MAX_ORDERS + o;
+  }
+  static int64_t OrderLineKey(int64_t order_key, int64_t line) {
+    return order_key * TPCC_MAX_LINES + line;
+  }
+
+  // one warehouse, --records is ignored
+  bool LoadTPCC() {
+    if (!Exec("CREATE VIRTUAL TABLE warehouse USING vtable "
+              "('w_id int, w_ytd bigint', 'unique warehouse_pk w_id')") ||
+        !Exec("CREATE VIRTUAL TABLE district USING vtable "
+              "('d_key int, d_next_o_id int, d_ytd bigint', "
+              "'unique district_pk d_key')") ||
+        !Exec("CREATE VIRTUAL TABLE customer USING vtable "
+              "('c_key bigint, c_balance bigint, c_payment_cnt int, "
+              "c_data varchar(250)', 'unique customer_pk c_key')") ||
+        !Exec("CREATE VIRTUAL TABLE item USING vtable "
+              "('i_id int, i_price int, i_name varchar(24)', "
+              "'unique item_pk i_id')") ||
+        !Exec("CREATE VIRTUAL TABLE stock USING vtable "
+              "('s_i_id int, s_quantity int, s_ytd int, s_order_cnt int', "
+              "'unique stock_pk s_i_id')") ||
+        !Exec("CREATE VIRTUAL TABLE orders USING vtable "
+              "('o_key bigint, o_c_id int, o_ol_cnt int', "
+              "'unique orders_pk o_key')") ||
+        !Exec("CREATE VIRTUAL TABLE new_order USING vtable "
+              "('no_key bigint', 'unique new_order_pk no_key')") ||
+        !Exec("CREATE VIRTUAL TABLE order_line USING vtable "
+              "('ol_key bigint, ol_i_id int, ol_quantity int, "
+              "ol_amount int', 'unique order_line_pk ol_key')"))
+      return false;
+
+    Step("INSERT INTO warehouse VALUES(0, 0)", {});
+    Exec("BEGIN");
+    for (int64_t i = 0; i < TPCC_ITEMS; ++i)
+      Step("INSERT INTO item VALUES(?, ?, 'item')", {i, Uniform(100, 10000)});
+    Exec("COMMIT");
+    Exec("BEGIN");
+    for (int64_t i = 0; i < TPCC_ITEMS; ++i)
+      Step("INSERT INTO stock VALUES(?, ?, 0, 0)", {i, Uniform(10, 100)});
+    Exec("COMMIT");
+    Exec("BEGIN");
+    for (int64_t d = 0; d < TPCC_DISTRICTS; ++d)
+      Step("INSERT INTO district VALUES(?, 0, 0)", {DistrictKey(d)});
+    Exec("COMMIT");
+    Exec("BEGIN");
+    for (int64_t d = 0; d < TPCC_DISTRICTS; ++d) {
+      for (int64_t c = 0; c < TPCC_CUSTOMERS; ++c) {
+        sqlite3_stmt *statement =
+            Prepare("INSERT INTO customer VALUES(?, 0, 0, ?)");
+        std::string data = RandomString(Uniform(100, 250));
+        sqlite3_bind_int64(statement, 1, CustomerKey(d, c));
+        sqlite3_bind_text(statement, 2, data.c_str(), data.size(),
+                          SQLITE_TRANSIENT);
+        if (sqlite3_step(statement) != SQLITE_DONE)
+          return Fail("customer");
+        sqlite3_reset(statement);
+      }
+    }
+    Exec("COMMIT");
+    return true;
+  }
+
+  void NewOrder() {
+    int64_t d = Uniform(0, TPCC_DISTRICTS - 1);
+    int64_t c = Uniform(0, TPCC_CUSTOMERS - 1);
+    int64_t lines = Uniform(5, 15);
+    Step("SELECT w_ytd FROM warehouse WHERE w_id = 0", {});
+    int64_t order_id = 0;
+    Step("SELECT d_next_o_id FROM district WHERE d_key = ?", {DistrictKey(d)},
+         &order_id);
+    Step("UPDATE district SET d_next_o_id = ? WHERE d_key = ?",
+         {order_id + 1, DistrictKey(d)});
+    Step("SELECT c_balance FROM customer WHERE c_key = ?",
+         {CustomerKey(d, c)});
+    int64_t order_key = OrderKey(d, order_id);
+    Step("INSERT INTO orders VALUES(?, ?, ?)", {order_key, c, lines});
+    Step("INSERT INTO new_order VALUES(?)", {order_key});
+    for (int64_t line = 0; line < lines; ++line) {
+      int64_t item = Uniform(0, TPCC_ITEMS - 1);
+      int64_t quantity = Uniform(1, 10);
+      int64_t price = 0;
+      Step("SELECT i_price FROM item WHERE i_id = ?", {item}, &price);
+      Step("UPDATE stock SET s_quantity = CASE WHEN s_quantity >= ? + 10 "
+           "THEN s_quantity - ? ELSE s_quantity - ? + 91 END, "
+           "s_ytd = s_ytd + ?, s_order_cnt = s_order_cnt + 1 "
+           "WHERE s_i_id = ?",
+           {quantity, quantity, quantity, quantity, item});
+      Step("INSERT INTO order_line VALUES(?, ?, ?, ?)",
+           {OrderLineKey(order_key, line), item, quantity, quantity * price});
+    }
+  }
+
+  void Payment() {
+    int64_t d = Uniform(0, TPCC_DISTRICTS - 1);
+    int64_t c = Uniform(0, TPCC_CUSTOMERS - 1);
+    int64_t amount = Uniform(100, 500000);
+    Step("UPDATE warehouse SET w_ytd = w_ytd + ? WHERE w_id = 0", {amount});
+    Step("UPDATE district SET d_ytd = d_ytd + ? WHERE d_key = ?",
+         {amount, DistrictKey(d)});
+    Step("UPDATE customer SET c_balance = c_balance - ?, "
+         "c_payment_cnt = c_payment_cnt + 1 WHERE c_key = ?",
+         {amount, CustomerKey(d, c)});
+  }
+
+  // the latest order of a district and its lines
+  void OrderStatus() {
+    int64_t d = Uniform(0, TPCC_DISTRICTS - 1);
+    int64_t next_order_id = 0;
+    Step("SELECT d_next_o_id FROM district WHERE d_key = ?", {DistrictKey(d)},
+         &next_order_id);
+    if (next_order_id > 0) {
+      int64_t order_key = OrderKey(d, next_order_id - 1);
+      int64_t customer = 0;
+      Step("SELECT o_c_id FROM orders WHERE o_key = ?", {order_key},
+           &customer);
+      Step("SELECT c_balance FROM customer WHERE c_key = ?",
+           {CustomerKey(d, customer)});
+      Step("SELECT * FROM order_line WHERE ol_key >= ? AND ol_key < ?",
+           {OrderLineKey(order_key, 0), OrderLineKey(order_key + 1, 0)});
+    }
+  }
+
+  // 45% New-Order, 43% Payment, 12% Order-Status
+  bool RunTPCC() {
+    for (int64_t i = 0; i < options_.operations_; ++i) {
+      int64_t p = Uniform(0, 99);
+      if (p < 45)
+        Measure("new-order", [&] { NewOrder(); });
+      else if (p < 88)
+        Measure("payment", [&] { Payment(); });
+      else
+        Measure("order-status", [&] { OrderStatus(); });
+    }
+    return true;
+  }
+
+  Options options_;
+  sqlite3 *db_ = nullptr;
+  std::mt19937_64 random_;
+  std::map<std::string, sqlite3_stmt *> statements_;
+  std::map<std::string, LatencyHistogram> latencies_;
+  std::chrono::nanoseconds elapsed_{0};
+  // next YCSB key to insert
+  int64_t next_key_ = 0;
+};
+
+} // namespace cmudb
+
+int main(int argc, char **argv) {
+  cmudb::Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string flag = argv[i];
+    std::string value = argv[i + 1];
+    if (flag == "--workload")
+      options.workload_ = value;
+    else if (flag == "--records")
+      options.records_ = std::atoll(value.c_str());
+    else if (flag == "--operations")
+      options.operations_ = std::atoll(value.c_str());
+    else if (flag == "--seed")
+      options.seed_ = std::atoll(value.c_str());
+    else if (flag == "--pool-size")
+      options.pool_size_ = std::atoll(value.c_str());
+    else if (flag == "--extension")
+      options.extension_ = value;
+    else {
+      fprintf(stderr, "unknown flag %s\n", flag.c_str());
+      return 1;
+    }
+  }
+  if (argc % 2 == 0) {
+    fprintf(stderr, "missing value of %s\n", argv[argc - 1]);
+    return 1;
+  }
+  if (options.records_ <= 0) {
+    fprintf(stderr, "--records must be positive\n");
+    return 1;
+  }
+
+  cmudb::Driver driver(options);
+  if (!driver.Open() || !driver.Run())
+    return 1;
+  driver.Report();
+  return 0;
+}
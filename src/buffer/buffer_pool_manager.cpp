@@ -1,36 +1,114 @@
 #include "buffer/buffer_pool_manager.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "common/epoch.h"
+#include "common/probes.h"
+
 namespace cmudb {
 
+// pending read-ahead requests beyond this are dropped
+#define PREFETCH_QUEUE_SIZE 64
+
+// reads of the warm up submitted at once
+#define WARM_BATCH_SIZE 64
+
+// pins held by the thread, see AdmissionConfig
+static thread_local size_t thread_pins = 0;
+
 /*
  * BufferPoolManager Constructor
- * WARNING: Do Not Edit This Function
+ * pool_size frames are spread over num_partitions partitions, partition i owns
+ * a consecutive range of pages_ and slice i of the frame arena
  */
 BufferPoolManager::BufferPoolManager(size_t pool_size,
-                                                 const std::string &db_file)
-    : pool_size_(pool_size), disk_manager_{db_file} {
+                                     const std::string &db_file,
+                                     size_t num_partitions,
+                                     ReplacerType replacer_type,
+                                     bool direct_io, bool numa_aware)
+    : pool_size_(pool_size), target_size_(pool_size), frames_(pool_size),
+      num_partitions_(num_partitions == 0 ? 1 : num_partitions),
+      replacer_type_(replacer_type),
+      disk_manager_{db_file, direct_io}, log_manager_(nullptr),
+      prefetch_inflight_(0),
+      stop_prefetch_(false), stop_cleaner_(false), cleaned_pages_(0),
+      cleaner_writes_(0) {
   // a consecutive memory space for buffer pool
   pages_ = new Page[pool_size_];
-  page_table_ = new ExtendibleHash<page_id_t, Page *>(100);
-  replacer_ = new LRUReplacer<Page *>;
-  free_list_ = new std::list<Page *>;
+  partitions_ = new BufferPoolPartition[num_partitions_];
+
+  std::vector<size_t> slice_pages;
+  for (size_t i = 0; i < num_partitions_; ++i)
+    slice_pages.push_back(pool_size_ / num_partitions_ +
+                          (i < pool_size_ % num_partitions_));
+  arena_ = new FrameArena(slice_pages);
+  int nodes = numa_aware ? FrameArena::GetNodeCount() : 1;
 
-  // put all the pages into free list
-  for (size_t i = 0; i < pool_size_; ++i) {
-    free_list_->push_back(&pages_[i]);
+  size_t offset = 0;
+  for (size_t i = 0; i < num_partitions_; ++i) {
+    BufferPoolPartition &partition = partitions_[i];
+    partition.pages_ = pages_ + offset;
+    partition.pool_size_ = slice_pages[i];
+    if (numa_aware && arena_->BindSlice(i, i % nodes))
+      partition.numa_node_ = i % nodes;
+    char *data = arena_->GetSlice(i);
+    for (size_t j = 0; j < partition.pool_size_; ++j)
+      partition.pages_[j].data_ = data + j * PAGE_SIZE;
+    partition.page_table_ = new ExtendibleHash<page_id_t, Page *>(BUCKET_SIZE);
+    if (replacer_type_ == ReplacerType::CLOCK)
+      partition.replacer_ = new ClockReplacer<Page *>;
+    else if (replacer_type_ == ReplacerType::LRU_K)
+      partition.replacer_ = new LRUKReplacer<Page *>;
+    else
+      partition.replacer_ = new LRUReplacer<Page *>;
+    partition.free_list_ = new std::list<Page *>;
+
+    // put all the pages into free list
+    for (size_t j = 0; j < partition.pool_size_; ++j) {
+      partition.free_list_->push_back(&partition.pages_[j]);
+    }
+    offset += partition.pool_size_;
   }
+  MemoryTracker::Charge(MemoryComponent::BUFFER_POOL, pool_size_ * PAGE_SIZE);
+  prefetch_thread_ = std::thread(&BufferPoolManager::PrefetchWorker, this);
 }
 
 /*
  * BufferPoolManager Deconstructor
- * WARNING: Do Not Edit This Function
  */
 BufferPoolManager::~BufferPoolManager() {
+  StopWarmRestart();
+  StopPageCleaner();
+  {
+    std::lock_guard<std::mutex> guard(prefetch_latch_);
+    stop_prefetch_ = true;
+  }
+  prefetch_cv_.notify_one();
+  prefetch_thread_.join();
   FlushAllPages();
+  StopTrace();
+  for (size_t i = 0; i < num_partitions_; ++i) {
+    delete partitions_[i].page_table_;
+    delete partitions_[i].replacer_;
+    delete partitions_[i].free_list_;
+  }
+  delete[] partitions_;
+  if (swizzle_tables_ != nullptr) {
+    for (size_t i = 0; i < pool_size_; ++i)
+      delete[] swizzle_tables_[i].load(std::memory_order_relaxed);
+    delete[] swizzle_tables_;
+  }
   delete[] pages_;
-  delete page_table_;
-  delete replacer_;
-  delete free_list_;
+  delete arena_;
+  MemoryTracker::Release(MemoryComponent::BUFFER_POOL, frames_ * PAGE_SIZE);
 }
 
 /**
@@ -43,8 +121,94 @@ BufferPoolManager::~BufferPoolManager() {
  * for the new page.
  * 4. Update page metadata, read page content from disk file and return page
  * pointer
+ * Only the partition owning page_id is latched. If the page is being read by
+ * the prefetcher, wait for it. A page failing its checksum is not returned.
+ * A caller waiting for a frame looks the page up again after the wait, it may
+ * have been read by another one meanwhile.
  */
-Page *BufferPoolManager::FetchPage(page_id_t page_id) { return nullptr; }
+Page *BufferPoolManager::FetchPage(page_id_t page_id) {
+  if (page_id == INVALID_PAGE_ID)
+    return nullptr;
+  Trace(PageTraceEvent::FETCH, page_id, false);
+  BufferPoolPartition &partition = GetPartition(page_id);
+  BufferPoolCounters &counters = partition.counters_;
+  std::unique_lock<std::mutex> guard = LatchPartition(partition);
+  counters.fetches_.fetch_add(1, std::memory_order_relaxed);
+  Page *page = nullptr;
+  char *mapped_data = nullptr;
+  std::chrono::steady_clock::time_point deadline;
+  while (true) {
+    if (partition.loading_.count(page_id) != 0) {
+      counters.pin_waits_.fetch_add(1, std::memory_order_relaxed);
+      partition.loaded_cv_.wait(
+          guard, [&] { return partition.loading_.count(page_id) == 0; });
+    }
+
+    if (partition.page_table_->Find(page_id, page)) {
+      counters.hits_.fetch_add(1, std::memory_order_relaxed);
+      CMUDB_PROBE1(page_hit, page_id);
+      if (page->pin_count_++ == 0)
+        partition.replacer_->Erase(page);
+      ++thread_pins;
+      return page;
+    }
+
+    if (disk_manager_.IsMapped()) {
+      // a read-only file has no page beyond its end
+      mapped_data = disk_manager_.GetMappedPage(page_id);
+      if (mapped_data == nullptr) {
+        counters.misses_.fetch_add(1, std::memory_order_relaxed);
+        CMUDB_PROBE1(page_miss, page_id);
+        counters.fetch_failures_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+    }
+    page = GetVictimPage(partition);
+    if (page != nullptr || !WaitForFrame(partition, guard, deadline))
+      break;
+  }
+
+  counters.misses_.fetch_add(1, std::memory_order_relaxed);
+  CMUDB_PROBE1(page_miss, page_id);
+  if (page == nullptr) {
+    counters.fetch_failures_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  partition.page_table_->Insert(page_id, page);
+  page->page_id_ = page_id;
+  page->pin_count_ = 1;
+  page->is_dirty_ = false;
+  page->lsn_ = INVALID_LSN;
+  page->rec_lsn_ = INVALID_LSN;
+  if (mapped_data != nullptr) {
+    page->data_ = mapped_data;
+    page->EndReplace();
+    ++thread_pins;
+    return page;
+  }
+  bool corrupt = false;
+  if (!disk_manager_.ReadPage(page_id, page->GetData(), &corrupt)) {
+    if (corrupt) {
+      // the frame goes back unused, the page is not to be trusted
+      partition.page_table_->Remove(page_id);
+      page->page_id_ = INVALID_PAGE_ID;
+      page->pin_count_ = 0;
+      page->ResetMemory();
+      page->EndReplace();
+      partition.free_list_->push_back(page);
+      ReleaseFrame(partition);
+      counters.corrupt_pages_.fetch_add(1, std::memory_order_relaxed);
+      counters.fetch_failures_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    // a page never written yet reads as zeros, not as the previous frame
+    // content
+    page->ResetMemory();
+  }
+  page->EndReplace();
+  ++thread_pins;
+  return page;
+}
 
 /*
  * Implementation of unpin page
@@ -53,7 +217,23 @@ Page *BufferPoolManager::FetchPage(page_id_t page_id) { return nullptr; }
  * is_dirty: set the dirty flag of this page
  */
 bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
-  return false;
+  Trace(PageTraceEvent::UNPIN, page_id, is_dirty);
+  BufferPoolPartition &partition = GetPartition(page_id);
+  std::unique_lock<std::mutex> guard = LatchPartition(partition);
+
+  Page *page = nullptr;
+  if (!partition.page_table_->Find(page_id, page) || page->pin_count_ <= 0)
+    return false;
+  // a mapped page is never written back
+  page->is_dirty_ = !disk_manager_.IsMapped() && (page->is_dirty_ || is_dirty);
+  if (--page->pin_count_ == 0) {
+    partition.replacer_->Insert(page);
+    ReleaseFrame(partition);
+  }
+  // the pin may have been taken by another thread
+  if (thread_pins > 0)
+    --thread_pins;
+  return true;
 }
 
 /*
@@ -62,12 +242,76 @@ bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
  * if page is not found in page table, return false
  * NOTE: make sure page_id != INVALID_PAGE_ID
  */
-bool BufferPoolManager::FlushPage(page_id_t page_id) { return false; }
+bool BufferPoolManager::FlushPage(page_id_t page_id) {
+  assert(page_id != INVALID_PAGE_ID);
+  BufferPoolPartition &partition = GetPartition(page_id);
+  std::unique_lock<std::mutex> guard = LatchPartition(partition);
+  partition.loaded_cv_.wait(
+      guard, [&] { return partition.loading_.count(page_id) == 0; });
+
+  Page *page = nullptr;
+  if (!partition.page_table_->Find(page_id, page))
+    return false;
+  if (disk_manager_.IsMapped())
+    return true;
+  lsn_t lsn = page->lsn_;
+  FlushLog(lsn);
+  disk_manager_.WritePage(page_id, page->GetData());
+  partition.counters_.writebacks_.fetch_add(1, std::memory_order_relaxed);
+  page->is_dirty_ = false;
+  MarkWritten(page, lsn);
+  return true;
+}
 
 /*
  * Used to flush all dirty pages in the buffer pool manager
+ * The writes of one partition are submitted together and waited for at once.
+ * Pages on their way to disk by page cleaner are waited for too.
  */
-void BufferPoolManager::FlushAllPages() {}
+void BufferPoolManager::FlushAllPages() {
+  for (size_t i = 0; i < num_partitions_; ++i) {
+    BufferPoolPartition &partition = partitions_[i];
+    std::unique_lock<std::mutex> guard(partition.latch_);
+    partition.loaded_cv_.wait(
+        guard, [&] { return partition.cleaner_inflight_ == 0; });
+    lsn_t max_lsn = INVALID_LSN;
+    for (size_t j = 0; j < partition.pool_size_; ++j) {
+      Page *page = &partition.pages_[j];
+      if (page->page_id_ != INVALID_PAGE_ID && page->is_dirty_)
+        max_lsn = std::max(max_lsn, page->GetLSN());
+    }
+    FlushLog(max_lsn);
+    size_t remaining = 0;
+    std::mutex remaining_latch;
+    std::condition_variable remaining_cv;
+    std::vector<std::pair<Page *, lsn_t>> written;
+    for (size_t j = 0; j < partition.pool_size_; ++j) {
+      Page *page = &partition.pages_[j];
+      if (page->page_id_ == INVALID_PAGE_ID || !page->is_dirty_)
+        continue;
+      written.emplace_back(page, page->lsn_);
+      {
+        std::lock_guard<std::mutex> remaining_guard(remaining_latch);
+        ++remaining;
+      }
+      disk_manager_.WritePageAsync(page->page_id_, page->GetData(),
+                                   [&](bool) {
+                                     std::lock_guard<std::mutex> remaining_guard(
+                                         remaining_latch);
+                                     --remaining;
+                                     remaining_cv.notify_one();
+                                   });
+      page->is_dirty_ = false;
+    }
+    disk_manager_.SubmitIO();
+    std::unique_lock<std::mutex> remaining_guard(remaining_latch);
+    remaining_cv.wait(remaining_guard, [&] { return remaining == 0; });
+    for (auto &page_lsn : written)
+      MarkWritten(page_lsn.first, page_lsn.second);
+    partition.counters_.writebacks_.fetch_add(written.size(),
+                                              std::memory_order_relaxed);
+  }
+}
 
 /**
  * User should call this method for deleting a page. This routine will call disk
@@ -78,7 +322,34 @@ void BufferPoolManager::FlushAllPages() {}
  * method to delete from disk file.
  * If the page is found within page table, but pin_count != 0, return false
  */
-bool BufferPoolManager::DeletePage(page_id_t page_id) { return false; }
+bool BufferPoolManager::DeletePage(page_id_t page_id) {
+  if (disk_manager_.IsMapped())
+    return false;
+  Trace(PageTraceEvent::DELETE, page_id, false);
+  BufferPoolPartition &partition = GetPartition(page_id);
+  std::unique_lock<std::mutex> guard = LatchPartition(partition);
+  partition.loaded_cv_.wait(
+      guard, [&] { return partition.loading_.count(page_id) == 0; });
+
+  Page *page = nullptr;
+  if (partition.page_table_->Find(page_id, page)) {
+    if (page->pin_count_ != 0)
+      return false;
+    partition.page_table_->Remove(page_id);
+    partition.replacer_->Erase(page);
+    Unswizzle(page);
+    page->page_id_ = INVALID_PAGE_ID;
+    page->is_dirty_ = false;
+    page->lsn_ = INVALID_LSN;
+    page->rec_lsn_ = INVALID_LSN;
+    page->ResetMemory();
+    page->EndReplace();
+    partition.free_list_->push_back(page);
+    ReleaseFrame(partition);
+  }
+  disk_manager_.DeallocatePage(page_id);
+  return true;
+}
 
 /**
  * User should call this method if needs to create a new page. This routine
@@ -87,7 +358,957 @@ bool BufferPoolManager::DeletePage(page_id_t page_id) { return false; }
  * free list or lru replacer(NOTE: always choose from free list first), update
  * new page's metadata, zero out memory and add corresponding entry into page
  * table.
- * return nullptr is all the pages in pool are pinned
+ * return nullptr is all the pages in pool are pinned, or the tablespace has
+ * no page left. The partition is decided by the allocated page id, if it has
+ * no frame left the page id is handed back to disk manager. In blocking mode
+ * the page id is kept while waiting for a frame.
+ */
+Page *BufferPoolManager::NewPage(page_id_t &page_id, int tablespace_id) {
+  if (disk_manager_.IsMapped())
+    return nullptr;
+  page_id_t new_page_id = disk_manager_.AllocatePage(tablespace_id);
+  if (new_page_id == INVALID_PAGE_ID)
+    return nullptr;
+  return InstallNewPage(new_page_id, page_id);
+}
+
+Page *BufferPoolManager::NewPage(page_id_t &page_id, PageExtent &extent) {
+  if (disk_manager_.IsMapped())
+    return nullptr;
+  page_id_t new_page_id = extent.AllocatePage();
+  if (new_page_id == INVALID_PAGE_ID)
+    return nullptr;
+  return InstallNewPage(new_page_id, page_id);
+}
+
+Page *BufferPoolManager::InstallNewPage(page_id_t new_page_id,
+                                        page_id_t &page_id) {
+  BufferPoolPartition &partition = GetPartition(new_page_id);
+  std::unique_lock<std::mutex> guard = LatchPartition(partition);
+  partition.loaded_cv_.wait(
+      guard, [&] { return partition.loading_.count(new_page_id) == 0; });
+
+  // a freed page read ahead or warmed up since is still in the pool, its
+  // frame is taken over
+  Page *page = nullptr;
+  if (partition.page_table_->Find(new_page_id, page) && page->pin_count_ == 0) {
+    partition.page_table_->Remove(new_page_id);
+    partition.replacer_->Erase(page);
+    Unswizzle(page);
+  } else {
+    page = nullptr;
+  }
+  std::chrono::steady_clock::time_point deadline;
+  while (page == nullptr && (page = GetVictimPage(partition)) == nullptr &&
+         WaitForFrame(partition, guard, deadline))
+    ;
+  if (page == nullptr) {
+    partition.counters_.new_page_failures_.fetch_add(
+        1, std::memory_order_relaxed);
+    disk_manager_.DeallocatePage(new_page_id);
+    return nullptr;
+  }
+  page_id = new_page_id;
+  Trace(PageTraceEvent::NEW, page_id, true);
+  partition.page_table_->Insert(page_id, page);
+  page->page_id_ = page_id;
+  page->pin_count_ = 1;
+  // a new page has no image on disk yet, write it back even if untouched
+  page->is_dirty_ = true;
+  page->lsn_ = INVALID_LSN;
+  page->rec_lsn_ = INVALID_LSN;
+  page->ResetMemory();
+  page->EndReplace();
+  ++thread_pins;
+  return page;
+}
+
+/*
+ * A miss is not counted, the caller reads the page ahead and fetches it again
+ */
+Page *BufferPoolManager::FetchPageIfResident(page_id_t page_id) {
+  if (page_id == INVALID_PAGE_ID)
+    return nullptr;
+  if (disk_manager_.IsMapped())
+    return FetchPage(page_id);
+  BufferPoolPartition &partition = GetPartition(page_id);
+  BufferPoolCounters &counters = partition.counters_;
+  std::unique_lock<std::mutex> guard = LatchPartition(partition);
+  Page *page = nullptr;
+  if (partition.loading_.count(page_id) != 0 ||
+      !partition.page_table_->Find(page_id, page))
+    return nullptr;
+  Trace(PageTraceEvent::FETCH, page_id, false);
+  counters.fetches_.fetch_add(1, std::memory_order_relaxed);
+  counters.hits_.fetch_add(1, std::memory_order_relaxed);
+  if (page->pin_count_++ == 0)
+    partition.replacer_->Erase(page);
+  ++thread_pins;
+  return page;
+}
+
+/*
+ * Queue a read-ahead request for the background thread. Requests are dropped
+ * when the queue is full, read-ahead is only a hint.
+ */
+void BufferPoolManager::PrefetchPage(page_id_t page_id, size_t depth,
+                                     NextPageIdFunc next_page_id) {
+  // a fetch from the mapping reads nothing into the pool, the OS reads ahead
+  if (page_id == INVALID_PAGE_ID || depth == 0 || disk_manager_.IsMapped())
+    return;
+  {
+    std::lock_guard<std::mutex> guard(prefetch_latch_);
+    if (prefetch_queue_.size() >= PREFETCH_QUEUE_SIZE)
+      return;
+    prefetch_queue_.push_back({page_id, depth, next_page_id, nullptr, false});
+  }
+  prefetch_cv_.notify_one();
+}
+
+/*
+ * At shutdown pending requests are dropped, reads in flight are still
+ * finished so no frame stays pinned
+ */
+void BufferPoolManager::PrefetchWorker() {
+  std::unique_lock<std::mutex> guard(prefetch_latch_);
+  while (true) {
+    prefetch_cv_.wait(guard, [this] {
+      return !prefetch_done_.empty() ||
+             (stop_prefetch_ ? prefetch_inflight_ == 0
+                             : !prefetch_queue_.empty());
+    });
+    if (stop_prefetch_ && prefetch_inflight_ == 0 && prefetch_done_.empty())
+      return;
+    std::deque<PrefetchRequest> done, requests;
+    done.swap(prefetch_done_);
+    prefetch_inflight_ -= done.size();
+    if (!stop_prefetch_)
+      requests.swap(prefetch_queue_);
+    bool follow_chain = !stop_prefetch_;
+    guard.unlock();
+
+    for (const PrefetchRequest &request : done)
+      FinishPrefetch(request, follow_chain);
+    for (const PrefetchRequest &request : requests)
+      StartPrefetch(request);
+    // one system call for the reads of every request
+    disk_manager_.SubmitIO();
+    guard.lock();
+  }
+}
+
+/*
+ * A resident page is only pinned long enough to follow the chain. For the
+ * first missing page a frame is reserved under the partition latch and its
+ * read is queued, the completion is handed back to prefetch thread. Pages go
+ * back to replacer as not referenced, so read-ahead does not make scanned
+ * pages look hot.
+ */
+void BufferPoolManager::StartPrefetch(PrefetchRequest request) {
+  while (request.depth_ > 0 && request.page_id_ != INVALID_PAGE_ID) {
+    BufferPoolPartition &partition = GetPartition(request.page_id_);
+    std::unique_lock<std::mutex> guard(partition.latch_);
+    if (partition.loading_.count(request.page_id_) != 0)
+      return;
+
+    Page *page = nullptr;
+    if (!partition.page_table_->Find(request.page_id_, page)) {
+      StartRead(partition, guard, request, false);
+      return;
+    }
+
+    if (request.next_page_id_ == nullptr)
+      return;
+    if (page->pin_count_++ == 0)
+      partition.replacer_->Erase(page);
+    guard.unlock();
+    page->RLatch();
+    page_id_t next_page_id = request.next_page_id_(page);
+    page->RUnlatch();
+    guard.lock();
+    if (--page->pin_count_ == 0) {
+      partition.replacer_->InsertPrefetched(page);
+      ReleaseFrame(partition);
+    }
+    request.page_id_ = next_page_id;
+    --request.depth_;
+  }
+}
+
+bool BufferPoolManager::StartRead(
+    BufferPoolPartition &partition, std::unique_lock<std::mutex> &guard,
+    PrefetchRequest request, bool free_only,
+    const std::function<void(bool success)> &read_done) {
+  Page *page = GetVictimPage(partition, free_only);
+  if (page == nullptr)
+    return false;
+  partition.page_table_->Insert(request.page_id_, page);
+  page->page_id_ = request.page_id_;
+  page->pin_count_ = 1;
+  page->is_dirty_ = false;
+  page->lsn_ = INVALID_LSN;
+  page->rec_lsn_ = INVALID_LSN;
+  partition.loading_.insert(request.page_id_);
+  guard.unlock();
+
+  request.page_ = page;
+  {
+    std::lock_guard<std::mutex> prefetch_guard(prefetch_latch_);
+    ++prefetch_inflight_;
+  }
+  disk_manager_.ReadPageAsync(
+      request.page_id_, page->GetData(),
+      [this, request, read_done](bool success) {
+        {
+          std::lock_guard<std::mutex> prefetch_guard(prefetch_latch_);
+          prefetch_done_.push_back(request);
+          prefetch_done_.back().success_ = success;
+          prefetch_cv_.notify_one();
+        }
+        if (read_done)
+          read_done(success);
+      });
+  return true;
+}
+
+/*
+ * A failed read (e.g. beyond end of file) gives the frame back to free list
+ */
+void BufferPoolManager::FinishPrefetch(const PrefetchRequest &request,
+                                       bool follow_chain) {
+  Page *page = request.page_;
+  page_id_t next_page_id = INVALID_PAGE_ID;
+  if (request.success_ && request.next_page_id_ != nullptr)
+    next_page_id = request.next_page_id_(page);
+
+  BufferPoolPartition &partition = GetPartition(request.page_id_);
+  {
+    std::lock_guard<std::mutex> guard(partition.latch_);
+    partition.loading_.erase(request.page_id_);
+    if (!request.success_ && page->pin_count_ == 1) {
+      partition.page_table_->Remove(request.page_id_);
+      page->page_id_ = INVALID_PAGE_ID;
+      page->pin_count_ = 0;
+      page->ResetMemory();
+      page->EndReplace();
+      partition.free_list_->push_back(page);
+      ReleaseFrame(partition);
+    } else {
+      // the frame was odd versioned since StartPrefetch took it
+      page->EndReplace();
+      if (--page->pin_count_ == 0) {
+        partition.replacer_->InsertPrefetched(page);
+        ReleaseFrame(partition);
+      }
+    }
+    partition.loaded_cv_.notify_all();
+  }
+
+  if (follow_chain && request.depth_ > 1)
+    StartPrefetch({next_page_id, request.depth_ - 1, request.next_page_id_,
+                   nullptr, false});
+}
+
+/*
+ * The frames keep their arena buffers unused, a miss repoints data_
+ */
+bool BufferPoolManager::EnableMmap() {
+  return swizzle_tables_ == nullptr && disk_manager_.EnableMmap();
+}
+
+/*
+ * Frames of a mapped file change their data pointer, they are never read
+ * unpinned
+ */
+bool BufferPoolManager::EnableSwizzling() {
+  if (disk_manager_.IsMapped())
+    return false;
+  if (swizzle_tables_ == nullptr) {
+    swizzle_tables_ = new std::atomic<std::atomic<Page *> *>[pool_size_];
+    for (size_t i = 0; i < pool_size_; ++i)
+      swizzle_tables_[i].store(nullptr, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+/*
+ * Two lookups swizzling the first child of a frame race on its table, the
+ * loser frees its own
+ */
+void BufferPoolManager::Swizzle(Page *parent, int slot, Page *child) {
+  if (slot < 0 || slot >= SWIZZLE_SLOTS)
+    return;
+  std::atomic<std::atomic<Page *> *> &entry = swizzle_tables_[parent - pages_];
+  std::atomic<Page *> *table = entry.load(std::memory_order_acquire);
+  if (table == nullptr) {
+    std::atomic<Page *> *created = new std::atomic<Page *>[SWIZZLE_SLOTS];
+    for (int i = 0; i < SWIZZLE_SLOTS; ++i)
+      created[i].store(nullptr, std::memory_order_relaxed);
+    if (entry.compare_exchange_strong(table, created,
+                                      std::memory_order_acq_rel))
+      table = created;
+    else
+      delete[] created;
+  }
+  table[slot].store(child, std::memory_order_relaxed);
+}
+
+void BufferPoolManager::EnterEpoch() { Epoch::Enter(); }
+
+void BufferPoolManager::ExitEpoch() { Epoch::Exit(); }
+
+/*
+ * Once the version is odd a reader entering finds the frame changed, only
+ * those inside from before are waited for. They never wait for the pool, so
+ * the partition latch is kept
+ */
+void BufferPoolManager::Unswizzle(Page *page) {
+  page->BeginReplace();
+  if (swizzle_tables_ == nullptr)
+    return;
+  Epoch::Synchronize();
+}
+
+bool BufferPoolManager::StartTrace(const std::string &file_name,
+                                   size_t capacity) {
+  PageTrace *trace = new PageTrace;
+  if (!trace->Open(file_name, capacity)) {
+    delete trace;
+    return false;
+  }
+  PageTrace *old_trace = trace_.exchange(trace);
+  if (old_trace != nullptr) {
+    Epoch::Synchronize();
+    delete old_trace;
+  }
+  return true;
+}
+
+uint64_t BufferPoolManager::StopTrace() {
+  PageTrace *trace = trace_.exchange(nullptr);
+  if (trace == nullptr)
+    return 0;
+  Epoch::Synchronize();
+  uint64_t count = trace->GetRecordCount();
+  delete trace;
+  return count;
+}
+
+void BufferPoolManager::RecordTrace(PageTraceEvent event, page_id_t page_id,
+                                    bool dirty) {
+  Epoch::Enter();
+  PageTrace *trace = trace_.load(std::memory_order_acquire);
+  if (trace != nullptr)
+    trace->Record(event, page_id, dirty);
+  Epoch::Exit();
+}
+
+/*
+ * One page id per line, written next to the old list and renamed over it.
+ * A page being read is not counted in, its pin is the reader's
+ */
+bool BufferPoolManager::DumpHotPages(const std::string &file_name) {
+  std::vector<std::vector<page_id_t>> page_ids(num_partitions_);
+  std::vector<Page *> hot_pages;
+  for (size_t i = 0; i < num_partitions_; ++i) {
+    BufferPoolPartition &partition = partitions_[i];
+    std::lock_guard<std::mutex> guard(partition.latch_);
+    for (size_t j = 0; j < partition.pool_size_; ++j) {
+      Page *page = &partition.pages_[j];
+      if (page->page_id_ != INVALID_PAGE_ID && page->pin_count_ > 0 &&
+          partition.loading_.count(page->page_id_) == 0)
+        page_ids[i].push_back(page->page_id_);
+    }
+    partition.replacer_->GetHotValues(hot_pages);
+    for (Page *page : hot_pages)
+      page_ids[i].push_back(page->page_id_);
+  }
+  std::string list;
+  for (size_t rank = 0;; ++rank) {
+    bool listed = false;
+    for (auto &partition_page_ids : page_ids)
+      if (rank < partition_page_ids.size()) {
+        list += std::to_string(partition_page_ids[rank]) + "\n";
+        listed = true;
+      }
+    if (!listed)
+      break;
+  }
+
+  std::string temp_name = file_name + ".tmp";
+  int list_fd = open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (list_fd < 0)
+    return false;
+  bool written = pwrite(list_fd, list.data(), list.size(), 0) ==
+                     static_cast<ssize_t>(list.size()) &&
+                 fdatasync(list_fd) == 0;
+  close(list_fd);
+  if (!written || rename(temp_name.c_str(), file_name.c_str()) != 0) {
+    remove(temp_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+void BufferPoolManager::StartWarmRestart(const std::string &file_name,
+                                         std::chrono::milliseconds interval) {
+  std::lock_guard<std::mutex> guard(warm_latch_);
+  warm_file_ = file_name;
+  warm_interval_ = interval;
+  if (!warm_thread_.joinable()) {
+    stop_warm_ = false;
+    warming_ = true;
+    warm_thread_ = std::thread(&BufferPoolManager::WarmWorker, this);
+  }
+}
+
+void BufferPoolManager::StopWarmRestart() {
+  {
+    std::lock_guard<std::mutex> guard(warm_latch_);
+    if (!warm_thread_.joinable())
+      return;
+    stop_warm_ = true;
+  }
+  warm_cv_.notify_one();
+  warm_thread_.join();
+}
+
+/*
+ * A list dumped before the warm up is done would leave out the pages it did
+ * not get to, the old one is kept until then
  */
-Page *BufferPoolManager::NewPage(page_id_t &page_id) { return nullptr; }
+void BufferPoolManager::WarmWorker() {
+  std::unique_lock<std::mutex> guard(warm_latch_);
+  std::string file_name = warm_file_;
+  guard.unlock();
+  std::vector<page_id_t> page_ids;
+  std::ifstream list(file_name);
+  for (page_id_t page_id; list >> page_id;)
+    page_ids.push_back(page_id);
+  WarmUp(page_ids);
+  warming_ = false;
+
+  guard.lock();
+  while (!stop_warm_) {
+    warm_cv_.wait_for(guard, warm_interval_, [this] { return stop_warm_; });
+    file_name = warm_file_;
+    guard.unlock();
+    DumpHotPages(file_name);
+    guard.lock();
+  }
+}
+
+/*
+ * A page resident or being read already is left as it is, as are the pages
+ * of a partition without a free frame. A page no longer in the file fails
+ * its read and gives its frame back. A batch is waited for before the next
+ * one, stopping does not wait for more
+ */
+void BufferPoolManager::WarmUp(std::vector<page_id_t> page_ids) {
+  // the mapping has every page at hand, the OS caches them
+  if (disk_manager_.IsMapped())
+    return;
+  page_ids.resize(std::min(page_ids.size(), GetFrameCount()));
+  size_t remaining = 0;
+  std::mutex remaining_latch;
+  std::condition_variable remaining_cv;
+  auto read_done = [&](bool success) {
+    if (success)
+      warmed_pages_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> remaining_guard(remaining_latch);
+    --remaining;
+    remaining_cv.notify_one();
+  };
+  for (size_t first = 0; first < page_ids.size(); first += WARM_BATCH_SIZE) {
+    {
+      std::lock_guard<std::mutex> guard(warm_latch_);
+      if (stop_warm_)
+        return;
+    }
+    auto begin = page_ids.begin() + first;
+    auto end = page_ids.begin() +
+               std::min<size_t>(first + WARM_BATCH_SIZE, page_ids.size());
+    std::sort(begin, end);
+    for (auto it = begin; it != end; ++it) {
+      BufferPoolPartition &partition = GetPartition(*it);
+      std::unique_lock<std::mutex> guard(partition.latch_);
+      Page *page = nullptr;
+      if (*it == INVALID_PAGE_ID || partition.loading_.count(*it) != 0 ||
+          partition.page_table_->Find(*it, page))
+        continue;
+      {
+        std::lock_guard<std::mutex> remaining_guard(remaining_latch);
+        ++remaining;
+      }
+      if (!StartRead(partition, guard, {*it, 1, nullptr, nullptr, false}, true,
+                     read_done)) {
+        std::lock_guard<std::mutex> remaining_guard(remaining_latch);
+        --remaining;
+      }
+    }
+    disk_manager_.SubmitIO();
+    std::unique_lock<std::mutex> remaining_guard(remaining_latch);
+    remaining_cv.wait(remaining_guard, [&] { return remaining == 0; });
+  }
+}
+
+/*
+ * A running cleaner picks up the new config with its next round
+ */
+void BufferPoolManager::StartPageCleaner(const PageCleanerConfig &config) {
+  std::lock_guard<std::mutex> guard(cleaner_latch_);
+  cleaner_config_ = config;
+  if (!cleaner_thread_.joinable()) {
+    stop_cleaner_ = false;
+    cleaner_thread_ = std::thread(&BufferPoolManager::CleanerWorker, this);
+  }
+}
+
+void BufferPoolManager::StopPageCleaner() {
+  {
+    std::lock_guard<std::mutex> guard(cleaner_latch_);
+    if (!cleaner_thread_.joinable())
+      return;
+    stop_cleaner_ = true;
+  }
+  cleaner_cv_.notify_one();
+  cleaner_thread_.join();
+}
+
+/*
+ * One round per interval, the page budget of a round is what the flush rate
+ * allows for one interval
+ */
+void BufferPoolManager::CleanerWorker() {
+  std::unique_lock<std::mutex> guard(cleaner_latch_);
+  while (!stop_cleaner_) {
+    PageCleanerConfig config = cleaner_config_;
+    guard.unlock();
+
+    size_t budget = SIZE_MAX;
+    if (config.max_pages_per_second_ > 0)
+      budget = std::max<size_t>(1, config.max_pages_per_second_ *
+                                       config.interval_.count() / 1000);
+    for (size_t i = 0; i < num_partitions_ && budget > 0; ++i)
+      budget -= CleanPartition(partitions_[i], budget, config);
+
+    guard.lock();
+    cleaner_cv_.wait_for(guard, config.interval_,
+                         [this] { return stop_cleaner_; });
+  }
+}
+
+/*
+ * Dirty unpinned pages are pinned, read latched and marked clean under the
+ * partition latch. Nobody holds the latch of an unpinned page, so this never
+ * blocks. Then runs of consecutive page ids are written with one request
+ * each, all submitted at once. A failed write marks the page dirty again.
+ */
+size_t BufferPoolManager::CleanPartition(BufferPoolPartition &partition,
+                                         size_t budget,
+                                         const PageCleanerConfig &config) {
+  std::vector<Page *> pages;
+  {
+    std::lock_guard<std::mutex> guard(partition.latch_);
+    size_t unpinned = 0;
+    size_t dirty = 0;
+    for (size_t i = 0; i < partition.pool_size_; ++i) {
+      Page *page = &partition.pages_[i];
+      if (page->page_id_ == INVALID_PAGE_ID || page->pin_count_ != 0 ||
+          partition.loading_.count(page->page_id_) != 0)
+        continue;
+      ++unpinned;
+      if (page->is_dirty_)
+        pages.push_back(page);
+    }
+    dirty = pages.size();
+    if (unpinned == 0)
+      return 0;
+    double dirty_fraction = static_cast<double>(dirty) / unpinned;
+    if (dirty_fraction > config.dirty_high_water_)
+      partition.cleaning_ = true;
+    size_t low_water = config.dirty_low_water_ * unpinned;
+    if (!partition.cleaning_ || dirty <= low_water) {
+      partition.cleaning_ = false;
+      return 0;
+    }
+
+    // lowest page ids first, they are the most likely to form runs
+    std::sort(pages.begin(), pages.end(), [](Page *a, Page *b) {
+      return a->page_id_ < b->page_id_;
+    });
+    // frames are pinned during the write, leave most of them to foreground
+    size_t max_pages = std::max<size_t>(1, partition.pool_size_ / 4);
+    pages.resize(std::min({dirty - low_water, budget, max_pages}));
+    partition.cleaner_inflight_ = pages.size();
+    for (Page *page : pages) {
+      ++page->pin_count_;
+      partition.replacer_->Erase(page);
+      page->RLatch();
+      page->is_dirty_ = false;
+    }
+  }
+
+  // page lsn can not move while read latched
+  lsn_t max_lsn = INVALID_LSN;
+  for (Page *page : pages)
+    max_lsn = std::max(max_lsn, page->GetLSN());
+  FlushLog(max_lsn);
+
+  // coalesce consecutive page ids
+  std::vector<bool> success(pages.size(), true);
+  size_t remaining = 0;
+  std::mutex remaining_latch;
+  std::condition_variable remaining_cv;
+  std::vector<const char *> pages_data;
+  for (size_t start = 0; start < pages.size();) {
+    size_t end = start + 1;
+    while (end < pages.size() && end - start < config.max_pages_per_write_ &&
+           pages[end]->page_id_ == pages[end - 1]->page_id_ + 1)
+      ++end;
+    pages_data.clear();
+    for (size_t i = start; i < end; ++i)
+      pages_data.push_back(pages[i]->GetData());
+    {
+      std::lock_guard<std::mutex> remaining_guard(remaining_latch);
+      ++remaining;
+    }
+    disk_manager_.WritePagesAsync(
+        pages[start]->page_id_, pages_data.data(), end - start,
+        [&, start, end](bool result) {
+          std::lock_guard<std::mutex> remaining_guard(remaining_latch);
+          for (size_t i = start; i < end; ++i)
+            success[i] = result;
+          --remaining;
+          remaining_cv.notify_one();
+        });
+    ++cleaner_writes_;
+    start = end;
+  }
+  disk_manager_.SubmitIO();
+  {
+    std::unique_lock<std::mutex> remaining_guard(remaining_latch);
+    remaining_cv.wait(remaining_guard, [&] { return remaining == 0; });
+  }
+
+  std::lock_guard<std::mutex> guard(partition.latch_);
+  for (size_t i = 0; i < pages.size(); ++i) {
+    Page *page = pages[i];
+    page->RUnlatch();
+    if (!success[i])
+      page->is_dirty_ = true;
+    else
+      MarkWritten(page, page->lsn_);
+    if (--page->pin_count_ == 0)
+      partition.replacer_->InsertPrefetched(page);
+  }
+  ReleaseFrame(partition);
+  partition.cleaner_inflight_ = 0;
+  partition.loaded_cv_.notify_all();
+  partition.counters_.writebacks_.fetch_add(
+      std::count(success.begin(), success.end(), true),
+      std::memory_order_relaxed);
+  cleaned_pages_ += pages.size();
+  return pages.size();
+}
+
+/*
+ * Sum of protected evictions over all partitions
+ */
+size_t BufferPoolManager::GetProtectedEvictionCount() {
+  if (replacer_type_ != ReplacerType::LRU_K)
+    return 0;
+  size_t count = 0;
+  for (size_t i = 0; i < num_partitions_; ++i) {
+    count += static_cast<LRUKReplacer<Page *> *>(partitions_[i].replacer_)
+                 ->GetProtectedCount();
+  }
+  return count;
+}
+
+/*
+ * Counters are read one by one without any latch, the sum is not an atomic
+ * snapshot of the pool
+ */
+BufferPoolStats BufferPoolManager::GetStats() {
+  BufferPoolStats stats;
+  for (size_t i = 0; i < num_partitions_; ++i) {
+    BufferPoolCounters &counters = partitions_[i].counters_;
+    stats.fetches_ += counters.fetches_.load(std::memory_order_relaxed);
+    stats.hits_ += counters.hits_.load(std::memory_order_relaxed);
+    stats.misses_ += counters.misses_.load(std::memory_order_relaxed);
+    stats.evictions_ += counters.evictions_.load(std::memory_order_relaxed);
+    stats.writebacks_ += counters.writebacks_.load(std::memory_order_relaxed);
+    stats.pin_waits_ += counters.pin_waits_.load(std::memory_order_relaxed);
+    stats.new_page_failures_ +=
+        counters.new_page_failures_.load(std::memory_order_relaxed);
+    stats.fetch_failures_ +=
+        counters.fetch_failures_.load(std::memory_order_relaxed);
+    stats.corrupt_pages_ +=
+        counters.corrupt_pages_.load(std::memory_order_relaxed);
+    stats.frame_waits_ += counters.frame_waits_.load(std::memory_order_relaxed);
+    stats.frame_wait_ns_ +=
+        counters.frame_wait_ns_.load(std::memory_order_relaxed);
+    stats.frame_wait_timeouts_ +=
+        counters.frame_wait_timeouts_.load(std::memory_order_relaxed);
+    stats.admission_rejects_ +=
+        counters.admission_rejects_.load(std::memory_order_relaxed);
+    stats.latch_waits_ += counters.latch_waits_.load(std::memory_order_relaxed);
+    stats.latch_wait_ns_ +=
+        counters.latch_wait_ns_.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void BufferPoolManager::ResetStats() {
+  for (size_t i = 0; i < num_partitions_; ++i) {
+    BufferPoolCounters &counters = partitions_[i].counters_;
+    counters.fetches_ = 0;
+    counters.hits_ = 0;
+    counters.misses_ = 0;
+    counters.evictions_ = 0;
+    counters.writebacks_ = 0;
+    counters.pin_waits_ = 0;
+    counters.new_page_failures_ = 0;
+    counters.fetch_failures_ = 0;
+    counters.corrupt_pages_ = 0;
+    counters.frame_waits_ = 0;
+    counters.frame_wait_ns_ = 0;
+    counters.frame_wait_timeouts_ = 0;
+    counters.admission_rejects_ = 0;
+    counters.latch_waits_ = 0;
+    counters.latch_wait_ns_ = 0;
+  }
+}
+
+/*
+ * Find a frame for a new page within the partition. Unless the pool was
+ * resized or a budget is exceeded, the partition is left as it is without
+ * reading the totals of the memory tracker
+ * Caller must hold partition latch.
+ * return nullptr if all the pages in the partition are pinned
+ * The frame is returned odd versioned, the caller fills it and ends the
+ * replacement (Page::EndReplace)
+ */
+Page *BufferPoolManager::GetVictimPage(BufferPoolPartition &partition,
+                                       bool free_only) {
+  if (!partition.parked_.empty() || MemoryTracker::IsOverBudget() ||
+      target_size_.load(std::memory_order_relaxed) != pool_size_)
+    FitPartition(partition, GetPartitionTarget(partition));
+  if (free_only && partition.free_list_->empty())
+    return nullptr;
+  return TakeFrame(partition);
+}
+
+/*
+ * A dirty victim is written back and removed from the page table
+ */
+Page *BufferPoolManager::TakeFrame(BufferPoolPartition &partition) {
+  Page *page = nullptr;
+  if (!partition.free_list_->empty()) {
+    page = partition.free_list_->front();
+    partition.free_list_->pop_front();
+    page->BeginReplace();
+    return page;
+  }
+  if (!partition.replacer_->Victim(page))
+    return nullptr;
+  assert(page->pin_count_ == 0);
+  Unswizzle(page);
+  partition.counters_.evictions_.fetch_add(1, std::memory_order_relaxed);
+  CMUDB_PROBE2(page_evict, page->page_id_, page->is_dirty_);
+  if (page->is_dirty_) {
+    FlushLog(page->lsn_);
+    disk_manager_.WritePage(page->page_id_, page->GetData());
+    partition.counters_.writebacks_.fetch_add(1, std::memory_order_relaxed);
+  }
+  partition.page_table_->Remove(page->page_id_);
+  return page;
+}
+
+/*
+ * What the other components use is theirs under a budget, the pool takes
+ * the rest. The share of a partition is in proportion to its frames
+ */
+size_t
+BufferPoolManager::GetPartitionTarget(const BufferPoolPartition &partition) {
+  size_t frames = target_size_.load(std::memory_order_relaxed);
+  size_t budget = MemoryTracker::GetBudget();
+  if (budget != 0) {
+    size_t usage = MemoryTracker::GetTotalUsage();
+    size_t own = std::min(GetFrameCount() * PAGE_SIZE, usage);
+    size_t others = usage - own;
+    frames = std::min(frames, budget > others ? (budget - others) / PAGE_SIZE
+                                              : static_cast<size_t>(0));
+  }
+  size_t share = frames * partition.pool_size_ / pool_size_;
+  return std::min(partition.pool_size_,
+                  std::max<size_t>(share, BUFFER_POOL_MIN_FRAMES));
+}
+
+/*
+ * A frame is parked empty and even versioned, a swizzled reference to it
+ * fails on its page id. Parked frames come back through the free list. The
+ * change is added to the totals of the memory tracker at once, the targets
+ * of the partitions are computed from them
+ */
+void BufferPoolManager::FitPartition(BufferPoolPartition &partition,
+                                     size_t target) {
+  size_t before = partition.pool_size_ - partition.parked_.size();
+  size_t frames = before;
+  for (; frames > target; --frames) {
+    Page *page = TakeFrame(partition);
+    if (page == nullptr)
+      break;
+    page->page_id_ = INVALID_PAGE_ID;
+    page->is_dirty_ = false;
+    page->lsn_ = INVALID_LSN;
+    page->rec_lsn_ = INVALID_LSN;
+    page->EndReplace();
+    // a mapped frame points into the file, there is nothing to give back
+    if (!disk_manager_.IsMapped())
+      arena_->Release(page->data_, PAGE_SIZE);
+    partition.parked_.push_back(page);
+  }
+  for (; frames < target && !partition.parked_.empty(); ++frames) {
+    partition.free_list_->push_back(partition.parked_.back());
+    partition.parked_.pop_back();
+    ReleaseFrame(partition);
+  }
+  if (frames == before)
+    return;
+  if (frames < before) {
+    frames_.fetch_sub(before - frames, std::memory_order_relaxed);
+    MemoryTracker::Release(MemoryComponent::BUFFER_POOL,
+                           (before - frames) * PAGE_SIZE);
+  } else {
+    frames_.fetch_add(frames - before, std::memory_order_relaxed);
+    MemoryTracker::Charge(MemoryComponent::BUFFER_POOL,
+                          (frames - before) * PAGE_SIZE);
+  }
+  MemoryTracker::Flush();
+}
+
+size_t BufferPoolManager::Resize(size_t pool_size) {
+  target_size_.store(std::min(pool_size, pool_size_),
+                     std::memory_order_relaxed);
+  for (size_t i = 0; i < num_partitions_; ++i) {
+    BufferPoolPartition &partition = partitions_[i];
+    std::unique_lock<std::mutex> guard = LatchPartition(partition);
+    FitPartition(partition, GetPartitionTarget(partition));
+  }
+  return GetFrameCount();
+}
+
+/*
+ * The waiter is woken by every frame unpinned or freed in the partition and
+ * returns once one may be had, another caller can still take it first. The
+ * wait of a call is bounded as a whole, not per wakeup
+ */
+bool BufferPoolManager::WaitForFrame(
+    BufferPoolPartition &partition, std::unique_lock<std::mutex> &guard,
+    std::chrono::steady_clock::time_point &deadline) {
+  BufferPoolCounters &counters = partition.counters_;
+  if (!admission_.blocking_ || disk_manager_.IsMapped())
+    return false;
+  if (partition.frame_waiters_ >= admission_.max_waiters_ ||
+      (admission_.pin_quota_ != 0 && thread_pins >= admission_.pin_quota_)) {
+    counters.admission_rejects_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  auto start = std::chrono::steady_clock::now();
+  if (deadline == std::chrono::steady_clock::time_point())
+    deadline = start + admission_.timeout_;
+  ++partition.frame_waiters_;
+  bool available = partition.frame_cv_.wait_until(guard, deadline, [&] {
+    return !partition.free_list_->empty() || partition.replacer_->Size() > 0;
+  });
+  --partition.frame_waiters_;
+  auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+  counters.frame_waits_.fetch_add(1, std::memory_order_relaxed);
+  counters.frame_wait_ns_.fetch_add(wait.count(), std::memory_order_relaxed);
+  if (!available)
+    counters.frame_wait_timeouts_.fetch_add(1, std::memory_order_relaxed);
+  return available;
+}
+
+size_t BufferPoolManager::GetThreadPinCount() { return thread_pins; }
+
+/*
+ * try_lock first, so an uncontended latch costs no clock reads
+ */
+std::unique_lock<std::mutex>
+BufferPoolManager::LatchPartition(BufferPoolPartition &partition) {
+  bool profiled = LatchStats::IsEnabled();
+  if (profiled)
+    LatchStats::RecordAcquire(LatchClass::BUFFER_POOL);
+  std::unique_lock<std::mutex> guard(partition.latch_, std::try_to_lock);
+  if (guard.owns_lock())
+    return guard;
+  auto start = std::chrono::steady_clock::now();
+  guard.lock();
+  auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+  if (profiled)
+    LatchStats::RecordWait(LatchClass::BUFFER_POOL, wait.count());
+  partition.counters_.latch_waits_.fetch_add(1, std::memory_order_relaxed);
+  partition.counters_.latch_wait_ns_.fetch_add(wait.count(),
+                                               std::memory_order_relaxed);
+  return guard;
+}
+
+/*
+ * Collect (page id, rec lsn) of frames holding changes that may not be on
+ * disk, for a checkpoint. Pages are not latched, rec lsn is set before a
+ * change is logged, so a change in progress is never missed. An unpinned clean
+ * frame can not be changed behind the partition latch, its rec lsn is dropped.
+ */
+void BufferPoolManager::GetDirtyPageTable(
+    std::vector<std::pair<page_id_t, lsn_t>> &dirty_pages) {
+  dirty_pages.clear();
+  for (size_t i = 0; i < num_partitions_; ++i) {
+    BufferPoolPartition &partition = partitions_[i];
+    std::lock_guard<std::mutex> guard(partition.latch_);
+    for (size_t j = 0; j < partition.pool_size_; ++j) {
+      Page *page = &partition.pages_[j];
+      if (page->page_id_ == INVALID_PAGE_ID)
+        continue;
+      if (page->pin_count_ == 0 && !page->is_dirty_) {
+        page->rec_lsn_ = INVALID_LSN;
+        continue;
+      }
+      lsn_t rec_lsn = page->rec_lsn_;
+      if (rec_lsn != INVALID_LSN)
+        dirty_pages.emplace_back(page->page_id_, rec_lsn);
+    }
+  }
+}
+
+/*
+ * The image of page with lsn written_lsn reached disk. Changes logged up to
+ * written_lsn are no longer needed for redo, later ones may be. rec lsn only
+ * moves forward here since a writer may have logged a change meanwhile.
+ */
+void BufferPoolManager::MarkWritten(Page *page, lsn_t written_lsn) {
+  if (written_lsn == INVALID_LSN)
+    return;
+  lsn_t rec_lsn = page->rec_lsn_;
+  while (rec_lsn != INVALID_LSN && rec_lsn <= written_lsn &&
+         !page->rec_lsn_.compare_exchange_weak(rec_lsn, written_lsn + 1))
+    ;
+}
+
+/*
+ * Write ahead rule, the log describing a change reaches disk before the page
+ * holding it. Returns at once when the log manager is not running or already
+ * flushed beyond lsn.
+ */
+void BufferPoolManager::FlushLog(lsn_t lsn) {
+  LogManager *log_manager = log_manager_;
+  if (lsn == INVALID_LSN || log_manager == nullptr ||
+      !log_manager->IsRunning() || lsn <= log_manager->GetPersistentLSN())
+    return;
+  log_manager->WaitUntilDurable(lsn);
+}
 } // namespace cmudb
@@ -0,0 +1,142 @@
+/**
+ * CLOCK implementation
+ */
+#include <algorithm>
+#include <cassert>
+
+#include "buffer/clock_replacer.h"
+#include "page/page.h"
+
+namespace cmudb {
+
+template <typename T>
+ClockReplacer<T>::ClockReplacer() : hand_(0), size_(0) {}
+
+template <typename T> ClockReplacer<T>::~ClockReplacer() {}
+
+/*
+ * Insert value into CLOCK, or record one more reference if it is already
+ * tracked. A known value only needs the shared latch.
+ */
+template <typename T> void ClockReplacer<T>::Insert(const T &value) {
+  {
+    std::shared_lock<std::shared_timed_mutex> guard(latch_);
+    auto it = index_.find(value);
+    if (it != index_.end()) {
+      Slot &slot = slots_[it->second];
+      uint32_t usage = slot.usage_count_.load(std::memory_order_relaxed);
+      while (usage < kMaxUsageCount &&
+             !slot.usage_count_.compare_exchange_weak(
+                 usage, usage + 1, std::memory_order_relaxed)) {
+      }
+      if (!slot.evictable_.exchange(true))
+        ++size_;
+      return;
+    }
+  }
+
+  std::unique_lock<std::shared_timed_mutex> guard(latch_);
+  auto it = index_.find(value);
+  if (it == index_.end()) {
+    // slots are never reclaimed, a value stays on the clock for good
+    it = index_.emplace(value, slots_.size()).first;
+    slots_.emplace_back(value);
+  }
+  Slot &slot = slots_[it->second];
+  if (slot.usage_count_.load() < kMaxUsageCount)
+    ++slot.usage_count_;
+  if (!slot.evictable_.exchange(true))
+    ++size_;
+}
+
+/*
+ * Make value evictable without bumping its usage count, a new value enters
+ * with usage count 0
+ */
+template <typename T> void ClockReplacer<T>::InsertPrefetched(const T &value) {
+  std::unique_lock<std::shared_timed_mutex> guard(latch_);
+  auto it = index_.find(value);
+  if (it == index_.end()) {
+    it = index_.emplace(value, slots_.size()).first;
+    slots_.emplace_back(value);
+  }
+  if (!slots_[it->second].evictable_.exchange(true))
+    ++size_;
+}
+
+/* Advance the clock hand until an evictable slot with usage count 0 is
+ * found, decrementing usage counts of evictable slots on the way. Put its
+ * value into argument "value" and return true. If no slot is evictable,
+ * return false
+ */
+template <typename T> bool ClockReplacer<T>::Victim(T &value) {
+  std::unique_lock<std::shared_timed_mutex> guard(latch_);
+  if (size_ == 0)
+    return false;
+  // terminates within (kMaxUsageCount + 1) rounds
+  while (true) {
+    Slot &slot = slots_[hand_];
+    hand_ = (hand_ + 1) % slots_.size();
+    if (!slot.evictable_)
+      continue;
+    if (slot.usage_count_ > 0) {
+      --slot.usage_count_;
+      continue;
+    }
+    slot.evictable_ = false;
+    --size_;
+    value = slot.value_;
+    return true;
+  }
+}
+
+/*
+ * Remove value from CLOCK. If removal is successful, return true, otherwise
+ * return false. The slot keeps its usage count, so a page that is pinned and
+ * unpinned again does not lose its history.
+ */
+template <typename T> bool ClockReplacer<T>::Erase(const T &value) {
+  std::shared_lock<std::shared_timed_mutex> guard(latch_);
+  auto it = index_.find(value);
+  if (it == index_.end())
+    return false;
+  if (!slots_[it->second].evictable_.exchange(false))
+    return false;
+  --size_;
+  return true;
+}
+
+template <typename T> size_t ClockReplacer<T>::Size() { return size_; }
+
+/*
+ * The hand takes a slot once it has passed it as many times as its usage
+ * count, the slot just behind the hand is the last of those with the same
+ * count
+ */
+template <typename T>
+void ClockReplacer<T>::GetHotValues(std::vector<T> &values) {
+  std::unique_lock<std::shared_timed_mutex> guard(latch_);
+  std::vector<std::pair<uint64_t, T>> order;
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    size_t position = (hand_ + i) % slots_.size();
+    const Slot &slot = slots_[position];
+    if (slot.evictable_)
+      order.emplace_back(slot.usage_count_ * slots_.size() + i, slot.value_);
+  }
+  std::sort(order.begin(), order.end(),
+            [](const std::pair<uint64_t, T> &a,
+               const std::pair<uint64_t, T> &b) { return a.first > b.first; });
+  values.clear();
+  for (auto &entry : order)
+    values.push_back(entry.second);
+}
+
+template class ClockReplacer<Page *>;
+// test only
+template class ClockReplacer<int>;
+#ifdef WIDE_PAGE_IDS
+// replays of page traces, page_id_t is int otherwise
+template class ClockReplacer<page_id_t>;
+#endif
+
+} // namespace cmudb
@@ -0,0 +1,120 @@
+/**
+ * frame_arena.cpp
+ */
+
+#include <cassert>
+#include <cctype>
+#include <cstdint>
+#include <dirent.h>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "buffer/frame_arena.h"
+#include "common/config.h"
+
+namespace cmudb {
+
+// mbind policy, see numaif.h, libnuma is not linked for one system call
+#define MPOL_PREFERRED_NODE 1
+
+static size_t RoundUp(size_t size) {
+  return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+FrameArena::FrameArena(const std::vector<size_t> &slice_pages)
+    : memory_(nullptr), size_(0), huge_tlb_(false) {
+  for (size_t pages : slice_pages)
+    size_ += RoundUp(pages * PAGE_SIZE);
+  if (size_ == 0) {
+    slices_.assign(slice_pages.size(), nullptr);
+    slice_sizes_.assign(slice_pages.size(), 0);
+    return;
+  }
+
+  void *memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  memory = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  huge_tlb_ = memory != MAP_FAILED;
+#endif
+  if (memory == MAP_FAILED) {
+    // no reserved huge pages, map aligned to 2 MB and ask for THP
+    size_t padded = size_ + HUGE_PAGE_SIZE;
+    memory = mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+      throw std::bad_alloc();
+    char *start = static_cast<char *>(memory);
+    char *aligned = reinterpret_cast<char *>(RoundUp(
+        reinterpret_cast<uintptr_t>(start)));
+    if (aligned != start)
+      munmap(start, aligned - start);
+    if (aligned + size_ != start + padded)
+      munmap(aligned + size_, start + padded - (aligned + size_));
+    memory = aligned;
+#ifdef MADV_HUGEPAGE
+    madvise(memory, size_, MADV_HUGEPAGE);
+#endif
+  }
+  memory_ = static_cast<char *>(memory);
+
+  char *slice = memory_;
+  for (size_t pages : slice_pages) {
+    slices_.push_back(slice);
+    slice_sizes_.push_back(RoundUp(pages * PAGE_SIZE));
+    slice += slice_sizes_.back();
+  }
+}
+
+FrameArena::~FrameArena() {
+  if (memory_ != nullptr)
+    munmap(memory_, size_);
+}
+
+/*
+ * Only memory not touched yet follows the policy, bind before the slice is
+ * used
+ */
+bool FrameArena::BindSlice(size_t i, int node) {
+  assert(i < slices_.size());
+  if (slice_sizes_[i] == 0 || node < 0 ||
+      node >= static_cast<int>(8 * sizeof(unsigned long)))
+    return true;
+#ifdef SYS_mbind
+  unsigned long node_mask = 1UL << node;
+  return syscall(SYS_mbind, slices_[i], slice_sizes_[i], MPOL_PREFERRED_NODE,
+                 &node_mask, 8 * sizeof(node_mask), 0) == 0;
+#else
+  return false;
+#endif
+}
+
+/*
+ * A transparent huge page the buffer is part of is split first
+ */
+bool FrameArena::Release(char *data, size_t size) {
+  if (huge_tlb_ || data < memory_ || data + size > memory_ + size_)
+    return false;
+  return madvise(data, size, MADV_DONTNEED) == 0;
+}
+
+int FrameArena::GetNodeCount() {
+  DIR *dir = opendir("/sys/devices/system/node");
+  if (dir == nullptr)
+    return 1;
+  int count = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    std::string name(entry->d_name);
+    if (name.compare(0, 4, "node") == 0 && name.size() > 4 &&
+        isdigit(name[4]))
+      count++;
+  }
+  closedir(dir);
+  return count == 0 ? 1 : count;
+}
+
+} // namespace cmudb
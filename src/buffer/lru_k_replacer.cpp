@@ -0,0 +1,124 @@
+/**
+ * LRU-K implementation
+ */
+#include <cassert>
+
+#include "buffer/lru_k_replacer.h"
+#include "page/page.h"
+
+namespace cmudb {
+
+template <typename T>
+LRUKReplacer<T>::LRUKReplacer(size_t k)
+    : k_(k == 0 ? 1 : k), current_timestamp_(0), protected_count_(0) {}
+
+template <typename T> LRUKReplacer<T>::~LRUKReplacer() {}
+
+/*
+ * Record a reference of value and make it evictable.
+ * Timestamps are unique, so front of history identifies the entry inside
+ * either queue.
+ */
+template <typename T> void LRUKReplacer<T>::Insert(const T &value) {
+  std::lock_guard<std::mutex> guard(latch_);
+  Entry &entry = entries_[value];
+  if (entry.evictable_)
+    GetQueue(entry).erase(entry.history_.front());
+  if (entry.prefetched_) {
+    entry.history_.clear();
+    entry.prefetched_ = false;
+  }
+  entry.history_.push_back(current_timestamp_++);
+  if (entry.history_.size() > k_)
+    entry.history_.pop_front();
+  entry.evictable_ = true;
+  GetQueue(entry).emplace(entry.history_.front(), value);
+}
+
+/*
+ * Make value evictable without recording a reference. A new value gets one
+ * placeholder timestamp so that it has a place in history queue.
+ */
+template <typename T> void LRUKReplacer<T>::InsertPrefetched(const T &value) {
+  std::lock_guard<std::mutex> guard(latch_);
+  Entry &entry = entries_[value];
+  if (entry.evictable_)
+    return;
+  if (entry.history_.empty()) {
+    entry.history_.push_back(current_timestamp_++);
+    entry.prefetched_ = true;
+  }
+  entry.evictable_ = true;
+  GetQueue(entry).emplace(entry.history_.front(), value);
+}
+
+/* If there is an evictable value, pick the one with largest backward
+ * K-distance, move it to argument "value", and return true. Its history is
+ * dropped since the frame is going to hold another page. Otherwise return
+ * false
+ */
+template <typename T> bool LRUKReplacer<T>::Victim(T &value) {
+  std::lock_guard<std::mutex> guard(latch_);
+  std::map<uint64_t, T> *queue = &history_queue_;
+  if (history_queue_.empty()) {
+    if (cache_queue_.empty())
+      return false;
+    queue = &cache_queue_;
+  } else if (!cache_queue_.empty()) {
+    ++protected_count_;
+  }
+  value = queue->begin()->second;
+  queue->erase(queue->begin());
+  entries_.erase(value);
+  return true;
+}
+
+/*
+ * Make value non-evictable, history is kept so that the next Insert carries
+ * on from it. If value was evictable return true, otherwise return false
+ */
+template <typename T> bool LRUKReplacer<T>::Erase(const T &value) {
+  std::lock_guard<std::mutex> guard(latch_);
+  auto it = entries_.find(value);
+  if (it == entries_.end() || !it->second.evictable_)
+    return false;
+  GetQueue(it->second).erase(it->second.history_.front());
+  it->second.evictable_ = false;
+  return true;
+}
+
+template <typename T> size_t LRUKReplacer<T>::Size() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return history_queue_.size() + cache_queue_.size();
+}
+
+template <typename T>
+void LRUKReplacer<T>::GetHotValues(std::vector<T> &values) {
+  std::lock_guard<std::mutex> guard(latch_);
+  values.clear();
+  for (auto it = cache_queue_.rbegin(); it != cache_queue_.rend(); ++it)
+    values.push_back(it->second);
+  for (auto it = history_queue_.rbegin(); it != history_queue_.rend(); ++it)
+    values.push_back(it->second);
+}
+
+template <typename T> size_t LRUKReplacer<T>::GetProtectedCount() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return protected_count_;
+}
+
+template <typename T>
+std::map<uint64_t, T> &LRUKReplacer<T>::GetQueue(const Entry &entry) {
+  assert(!entry.history_.empty());
+  return entry.history_.size() < k_ ? history_queue_ : cache_queue_;
+}
+
+template class LRUKReplacer<Page *>;
+// test only
+template class LRUKReplacer<int>;
+#ifdef WIDE_PAGE_IDS
+// replays of page traces, page_id_t is int otherwise
+template class LRUKReplacer<page_id_t>;
+#endif
+
+} // namespace cmudb
@@ -6,20 +6,33 @@
 
 namespace cmudb {
 
-template <typename T> LRUReplacer<T>::LRUReplacer() {}
+template <typename T> LRUReplacer<T>::LRUReplacer() : index_(BUCKET_SIZE) {}
 
 template <typename T> LRUReplacer<T>::~LRUReplacer() {}
 
 /*
  * Insert value into LRU
  */
-template <typename T> void LRUReplacer<T>::Insert(const T &value) {}
+template <typename T> void LRUReplacer<T>::Insert(const T &value) {
+  std::lock_guard<std::mutex> guard(latch_);
+  typename std::list<T>::iterator position;
+  if (index_.Find(value, position))
+    lru_list_.erase(position);
+  lru_list_.push_front(value);
+  index_.Insert(value, lru_list_.begin());
+}
 
 /* If LRU is non-empty, pop the head member from LRU to argument "value", and
  * return true. If LRU is empty, return false
  */
 template <typename T> bool LRUReplacer<T>::Victim(T &value) {
-  return false;
+  std::lock_guard<std::mutex> guard(latch_);
+  if (lru_list_.empty())
+    return false;
+  value = lru_list_.back();
+  lru_list_.pop_back();
+  index_.Remove(value);
+  return true;
 }
 
 /*
@@ -27,13 +40,32 @@ template <typename T> bool LRUReplacer<T>::Victim(T &value) {
  * return false
  */
 template <typename T> bool LRUReplacer<T>::Erase(const T &value) {
-  return false;
+  std::lock_guard<std::mutex> guard(latch_);
+  typename std::list<T>::iterator position;
+  if (!index_.Find(value, position))
+    return false;
+  lru_list_.erase(position);
+  index_.Remove(value);
+  return true;
+}
+
+template <typename T> size_t LRUReplacer<T>::Size() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return lru_list_.size();
 }
 
-template <typename T> size_t LRUReplacer<T>::Size() { return 0; }
+template <typename T>
+void LRUReplacer<T>::GetHotValues(std::vector<T> &values) {
+  std::lock_guard<std::mutex> guard(latch_);
+  values.assign(lru_list_.begin(), lru_list_.end());
+}
 
 template class LRUReplacer<Page *>;
 // test only
 template class LRUReplacer<int>;
+#ifdef WIDE_PAGE_IDS
+// replays of page traces, page_id_t is int otherwise
+template class LRUReplacer<page_id_t>;
+#endif
 
 } // namespace cmudb
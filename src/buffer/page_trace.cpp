@@ -0,0 +1,139 @@
+/**
+ * page_trace.cpp
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+
+#include "buffer/page_trace.h"
+
+namespace cmudb {
+
+PageTrace::~PageTrace() {
+  if (header_ != nullptr) {
+    msync(header_, size_, MS_SYNC);
+    munmap(header_, size_);
+  }
+}
+
+bool PageTrace::Open(const std::string &file_name, size_t capacity) {
+  if (header_ != nullptr || capacity == 0)
+    return false;
+  size_t size = sizeof(Header) + capacity * sizeof(PageTraceRecord);
+  int fd = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  void *data = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // the mapping keeps the file
+  close(fd);
+  if (data == MAP_FAILED)
+    return false;
+  header_ = static_cast<Header *>(data);
+  header_->magic_ = PAGE_TRACE_MAGIC;
+  header_->capacity_ = capacity;
+  header_->count_.store(0, std::memory_order_relaxed);
+  records_ = reinterpret_cast<PageTraceRecord *>(header_ + 1);
+  capacity_ = capacity;
+  size_ = size;
+  start_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+void PageTrace::Record(PageTraceEvent event, page_id_t page_id, bool dirty) {
+  uint64_t n = header_->count_.fetch_add(1, std::memory_order_relaxed);
+  PageTraceRecord &record = records_[n % capacity_];
+  record.time_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start_)
+                        .count();
+  record.page_id_ = page_id;
+  record.event_ = static_cast<uint8_t>(event);
+  record.dirty_ = dirty;
+  record.reserved_ = 0;
+}
+
+/*
+ * A ring that wrapped starts at the slot the next record would overwrite
+ */
+bool PageTrace::Read(const std::string &file_name,
+                     std::vector<PageTraceRecord> &records) {
+  std::ifstream file(file_name, std::ios::binary);
+  uint64_t header[4];
+  if (!file.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+      header[0] != PAGE_TRACE_MAGIC || header[1] == 0)
+    return false;
+  uint64_t capacity = header[1], count = header[2];
+  std::vector<PageTraceRecord> ring(std::min(count, capacity));
+  if (!file.read(reinterpret_cast<char *>(ring.data()),
+                 ring.size() * sizeof(PageTraceRecord)))
+    return false;
+  size_t first = count > capacity ? count % capacity : 0;
+  records.clear();
+  records.reserve(ring.size());
+  for (size_t i = 0; i < ring.size(); ++i)
+    records.push_back(ring[(first + i) % ring.size()]);
+  return true;
+}
+
+/*
+ * A page is resident with its pin count, in the replacer while unpinned. A
+ * miss takes a frame of a page the replacer gives up once the pool is full
+ */
+ReplaySummary ReplayPageTrace(const std::vector<PageTraceRecord> &records,
+                              Replacer<page_id_t> &replacer,
+                              size_t pool_size) {
+  ReplaySummary summary;
+  std::unordered_map<page_id_t, int> pins;
+  auto admit = [&](page_id_t page_id) {
+    if (pins.size() >= pool_size) {
+      page_id_t victim;
+      if (!replacer.Victim(victim)) {
+        ++summary.pin_failures_;
+        return;
+      }
+      pins.erase(victim);
+      ++summary.evictions_;
+    }
+    pins[page_id] = 1;
+  };
+  for (const PageTraceRecord &record : records) {
+    page_id_t page_id = record.page_id_;
+    auto it = pins.find(page_id);
+    switch (static_cast<PageTraceEvent>(record.event_)) {
+    case PageTraceEvent::FETCH:
+      ++summary.fetches_;
+      if (it == pins.end()) {
+        admit(page_id);
+      } else {
+        ++summary.hits_;
+        if (it->second++ == 0)
+          replacer.Erase(page_id);
+      }
+      break;
+    case PageTraceEvent::NEW:
+      ++summary.new_pages_;
+      if (it == pins.end())
+        admit(page_id);
+      break;
+    case PageTraceEvent::UNPIN:
+      if (it != pins.end() && it->second > 0 && --it->second == 0)
+        replacer.Insert(page_id);
+      break;
+    case PageTraceEvent::DELETE:
+      if (it != pins.end() && it->second == 0) {
+        replacer.Erase(page_id);
+        pins.erase(it);
+      }
+      break;
+    }
+  }
+  return summary;
+}
+
+} // namespace cmudb
@@ -0,0 +1,151 @@
+/**
+ * catalog.cpp
+ */
+
+#include <cassert>
+
+#include "catalog/catalog.h"
+#include "common/exception.h"
+#include "page/header_page.h"
+
+namespace cmudb {
+
+namespace {
+
+HeaderPage *FetchHeaderPage(BufferPoolManager *buffer_pool_manager,
+                            page_id_t page_id) {
+  auto page =
+      static_cast<HeaderPage *>(buffer_pool_manager->FetchPage(page_id));
+  if (page == nullptr)
+    throw Exception(EXCEPTION_TYPE_CATALOG, "all page are pinned");
+  return page;
+}
+
+} // namespace
+
+/*
+ * Walk the chain once, every record is remembered with its page
+ */
+Catalog::Catalog(BufferPoolManager *buffer_pool_manager)
+    : buffer_pool_manager_(buffer_pool_manager) {
+  page_id_t page_id = HEADER_PAGE_ID;
+  while (page_id != INVALID_PAGE_ID) {
+    HeaderPage *page = FetchHeaderPage(buffer_pool_manager_, page_id);
+    page->RLatch();
+    int record_count = page->GetRecordCount();
+    for (int i = 0; i < record_count; i++)
+      records_[page->GetName(i)] = {page->GetRootIdAt(i), page_ids_.size()};
+    page_ids_.push_back(page_id);
+    record_counts_.push_back(record_count);
+    page_id_t next_page_id = page->GetNextPageId();
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    page_id = next_page_id;
+  }
+}
+
+/*
+ * The first page with room takes the record, a new page is chained behind
+ * the last one if none has. The new page is on disk before the link to it
+ */
+bool Catalog::InsertRecord(const std::string &name, page_id_t root_id) {
+  std::lock_guard<std::mutex> guard(latch_);
+  if (records_.count(name) > 0)
+    return false;
+  size_t index = 0;
+  while (index < page_ids_.size() &&
+         record_counts_[index] >= HEADER_PAGE_MAX_RECORDS)
+    index++;
+  HeaderPage *page;
+  bool is_new_page = index == page_ids_.size();
+  if (is_new_page) {
+    page_id_t page_id;
+    page = static_cast<HeaderPage *>(buffer_pool_manager_->NewPage(page_id));
+    if (page == nullptr)
+      throw Exception(EXCEPTION_TYPE_CATALOG, "out of memory");
+    page->Init();
+    page_ids_.push_back(page_id);
+    record_counts_.push_back(0);
+  } else {
+    page = FetchHeaderPage(buffer_pool_manager_, page_ids_[index]);
+  }
+
+  page->WLatch();
+  bool inserted = page->InsertRecord(name, root_id);
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_ids_[index], true);
+  assert(inserted);
+  (void)inserted;
+  buffer_pool_manager_->FlushPage(page_ids_[index]);
+  if (is_new_page) {
+    page_id_t last_page_id = page_ids_[index - 1];
+    HeaderPage *last = FetchHeaderPage(buffer_pool_manager_, last_page_id);
+    last->WLatch();
+    last->SetNextPageId(page_ids_[index]);
+    last->WUnlatch();
+    buffer_pool_manager_->UnpinPage(last_page_id, true);
+    buffer_pool_manager_->FlushPage(last_page_id);
+  }
+  records_[name] = {root_id, index};
+  record_counts_[index]++;
+  return true;
+}
+
+bool Catalog::DeleteRecord(const std::string &name) {
+  std::lock_guard<std::mutex> guard(latch_);
+  auto it = records_.find(name);
+  if (it == records_.end())
+    return false;
+  size_t index = it->second.page_;
+  HeaderPage *page = FetchHeaderPage(buffer_pool_manager_, page_ids_[index]);
+  page->WLatch();
+  page->DeleteRecord(name);
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_ids_[index], true);
+  buffer_pool_manager_->FlushPage(page_ids_[index]);
+  records_.erase(it);
+  record_counts_[index]--;
+  return true;
+}
+
+bool Catalog::UpdateRecord(const std::string &name, page_id_t root_id) {
+  std::lock_guard<std::mutex> guard(latch_);
+  auto it = records_.find(name);
+  if (it == records_.end())
+    return false;
+  if (it->second.root_id_ == root_id)
+    return true;
+  size_t index = it->second.page_;
+  HeaderPage *page = FetchHeaderPage(buffer_pool_manager_, page_ids_[index]);
+  page->WLatch();
+  page->UpdateRecord(name, root_id);
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_ids_[index], true);
+  buffer_pool_manager_->FlushPage(page_ids_[index]);
+  it->second.root_id_ = root_id;
+  return true;
+}
+
+bool Catalog::GetRootId(const std::string &name, page_id_t &root_id) {
+  std::lock_guard<std::mutex> guard(latch_);
+  auto it = records_.find(name);
+  if (it == records_.end())
+    return false;
+  root_id = it->second.root_id_;
+  return true;
+}
+
+void Catalog::GetNames(const std::string &prefix,
+                       std::vector<std::string> &names) {
+  std::lock_guard<std::mutex> guard(latch_);
+  for (auto &record : records_)
+    if (record.first.compare(0, prefix.size(), prefix) == 0)
+      names.push_back(record.first);
+}
+
+size_t Catalog::GetRecordCount() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return records_.size();
+}
+
+} // namespace cmudb
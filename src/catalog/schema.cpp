@@ -24,6 +24,9 @@ Schema::Schema(const std::vector<Column> &columns) : tuple_is_inlined(true) {
     column.column_offset = column_offset;
     column_offset += column.GetFixedLength();
 
+    access_.push_back({static_cast<uint32_t>(column.GetOffset()),
+                       static_cast<uint32_t>(column.GetFixedLength()),
+                       column.GetType(), column.IsInlined()});
     // add column
     this->columns.push_back(std::move(column));
   }
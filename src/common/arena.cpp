@@ -0,0 +1,41 @@
+/**
+ * arena.cpp
+ */
+
+#include "common/arena.h"
+
+namespace cmudb {
+
+Arena::Arena(size_t chunk_size) : chunk_size_(chunk_size) {}
+
+Arena::~Arena() {
+  Reset();
+  for (auto chunk : chunks_)
+    delete[] chunk;
+}
+
+void Arena::Reset() {
+  for (auto block : blocks_)
+    delete[] block;
+  blocks_.clear();
+  current_ = 0;
+  cursor_ = chunks_.empty() ? nullptr : chunks_[0];
+  limit_ = chunks_.empty() ? nullptr : chunks_[0] + chunk_size_;
+}
+
+char *Arena::AllocateSlow(size_t size) {
+  if (size > chunk_size_ / 4) {
+    blocks_.push_back(new char[size]);
+    return blocks_.back();
+  }
+  // the first allocation, or the current chunk is full
+  if (cursor_ != nullptr)
+    current_++;
+  if (current_ == chunks_.size())
+    chunks_.push_back(new char[chunk_size_]);
+  cursor_ = chunks_[current_] + size;
+  limit_ = chunks_[current_] + chunk_size_;
+  return chunks_[current_];
+}
+
+} // namespace cmudb
@@ -0,0 +1,64 @@
+/**
+ * crc32c.cpp
+ */
+
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include "common/crc32c.h"
+
+namespace cmudb {
+
+#if !defined(__SSE4_2__) && !defined(__ARM_FEATURE_CRC32)
+// reflected polynomial 0x1edc6f41
+static const uint32_t CRC32C_POLY = 0x82f63b78;
+
+struct Crc32cTable {
+  Crc32cTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+      entries_[i] = crc;
+    }
+  }
+  uint32_t entries_[256];
+};
+#endif
+
+uint32_t Crc32c(const char *data, size_t size, uint32_t crc) {
+  crc = ~crc;
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+  uint64_t crc64 = crc;
+  for (; size >= 8; data += 8, size -= 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+#if defined(__SSE4_2__)
+    crc64 = _mm_crc32_u64(crc64, word);
+#else
+    crc64 = __crc32cd(static_cast<uint32_t>(crc64), word);
+#endif
+  }
+  crc = static_cast<uint32_t>(crc64);
+  for (; size > 0; data++, size--) {
+#if defined(__SSE4_2__)
+    crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*data));
+#else
+    crc = __crc32cb(crc, static_cast<uint8_t>(*data));
+#endif
+  }
+#else
+  static const Crc32cTable table;
+  for (; size > 0; data++, size--)
+    crc = table.entries_[(crc ^ static_cast<uint8_t>(*data)) & 0xff] ^
+          (crc >> 8);
+#endif
+  return ~crc;
+}
+
+} // namespace cmudb
@@ -0,0 +1,87 @@
+/**
+ * epoch.cpp
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/epoch.h"
+
+namespace cmudb {
+
+namespace {
+
+// a thread inside has its slot set to the global epoch it entered in, 0
+// outside
+struct EpochRegistry {
+  std::mutex latch_;
+  std::vector<std::atomic<uint64_t> *> slots_;
+  std::atomic<uint64_t> epoch_{1};
+};
+
+// never destroyed, threads may exit after static destruction began
+EpochRegistry *GetEpochRegistry() {
+  static EpochRegistry *registry = new EpochRegistry;
+  return registry;
+}
+
+// registers the slot of a thread on its first epoch
+struct EpochSlotHolder {
+  std::atomic<uint64_t> *slot_;
+
+  EpochSlotHolder() : slot_(new std::atomic<uint64_t>(0)) {
+    EpochRegistry *registry = GetEpochRegistry();
+    std::lock_guard<std::mutex> guard(registry->latch_);
+    registry->slots_.push_back(slot_);
+  }
+
+  ~EpochSlotHolder() {
+    EpochRegistry *registry = GetEpochRegistry();
+    {
+      std::lock_guard<std::mutex> guard(registry->latch_);
+      registry->slots_.erase(std::find(registry->slots_.begin(),
+                                       registry->slots_.end(), slot_));
+    }
+    delete slot_;
+  }
+};
+
+thread_local EpochSlotHolder epoch_slot;
+
+} // namespace
+
+/*
+ * The fence orders the slot before what the reader reads, against the
+ * unlink a writer makes before it looks at the slots
+ */
+void Epoch::Enter() {
+  epoch_slot.slot_->store(
+      GetEpochRegistry()->epoch_.load(std::memory_order_relaxed),
+      std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Epoch::Exit() { epoch_slot.slot_->store(0, std::memory_order_release); }
+
+/*
+ * A reader entering after the epoch is bumped does not find what was
+ * unlinked, only those inside from before are waited for: their slot holds
+ * an older epoch
+ */
+void Epoch::Synchronize() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  EpochRegistry *registry = GetEpochRegistry();
+  uint64_t epoch = registry->epoch_.fetch_add(1, std::memory_order_relaxed) + 1;
+  std::lock_guard<std::mutex> guard(registry->latch_);
+  for (std::atomic<uint64_t> *slot : registry->slots_) {
+    uint64_t entered;
+    while ((entered = slot->load(std::memory_order_acquire)) != 0 &&
+           entered < epoch)
+      std::this_thread::yield();
+  }
+}
+
+} // namespace cmudb
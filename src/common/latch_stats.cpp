@@ -0,0 +1,221 @@
+/**
+ * latch_stats.cpp
+ */
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "common/latch_stats.h"
+#include "common/logger.h"
+
+namespace cmudb {
+
+std::atomic<bool> LatchStats::enabled_{false};
+
+namespace {
+
+// counters of one thread, written by it alone
+struct ThreadLatches {
+  std::atomic<uint64_t> acquires_[LATCH_CLASSES];
+  std::atomic<uint64_t> waits_[LATCH_CLASSES];
+  std::atomic<uint64_t> wait_ns_[LATCH_CLASSES];
+  // contended page waits until the next sample
+  size_t countdown_ = 0;
+
+  ThreadLatches() { Clear(); }
+
+  void Clear() {
+    for (int i = 0; i < LATCH_CLASSES; ++i) {
+      acquires_[i].store(0, std::memory_order_relaxed);
+      waits_[i].store(0, std::memory_order_relaxed);
+      wait_ns_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void AddTo(int latch_class, LatchClassStats &stats) const {
+    stats.acquires_ += acquires_[latch_class].load(std::memory_order_relaxed);
+    stats.waits_ += waits_[latch_class].load(std::memory_order_relaxed);
+    stats.wait_ns_ += wait_ns_[latch_class].load(std::memory_order_relaxed);
+  }
+};
+
+inline void Bump(std::atomic<uint64_t> &counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+// live threads, what threads that exited recorded, and the sampled pages
+struct LatchRegistry {
+  std::mutex latch_;
+  std::vector<ThreadLatches *> threads_;
+  LatchClassStats retired_[LATCH_CLASSES];
+  std::atomic<size_t> sample_rate_{LATCH_SAMPLE_RATE};
+  // page id to estimated waits and wait time
+  std::mutex pages_latch_;
+  std::unordered_map<page_id_t, std::pair<uint64_t, uint64_t>> pages_;
+};
+
+// never destroyed, threads may exit after static destruction began
+LatchRegistry *GetRegistry() {
+  static LatchRegistry *registry = new LatchRegistry;
+  return registry;
+}
+
+// registers the counters of a thread on first use, hands them to the
+// registry when the thread exits
+struct ThreadLatchesHolder {
+  ThreadLatches *latches_;
+
+  ThreadLatchesHolder() : latches_(new ThreadLatches) {
+    LatchRegistry *registry = GetRegistry();
+    std::lock_guard<std::mutex> guard(registry->latch_);
+    registry->threads_.push_back(latches_);
+  }
+
+  ~ThreadLatchesHolder() {
+    LatchRegistry *registry = GetRegistry();
+    {
+      std::lock_guard<std::mutex> guard(registry->latch_);
+      for (int i = 0; i < LATCH_CLASSES; ++i)
+        latches_->AddTo(i, registry->retired_[i]);
+      registry->threads_.erase(std::find(registry->threads_.begin(),
+                                         registry->threads_.end(), latches_));
+    }
+    delete latches_;
+  }
+};
+
+thread_local ThreadLatchesHolder thread_latches;
+
+} // namespace
+
+void LatchStats::Enable(bool enabled, size_t sample_rate) {
+  if (enabled && !IsEnabled()) {
+    GetRegistry()->sample_rate_.store(std::max<size_t>(sample_rate, 1),
+                                      std::memory_order_relaxed);
+    Reset();
+  }
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void LatchStats::RecordAcquire(LatchClass latch_class) {
+  Bump(thread_latches.latches_->acquires_[static_cast<int>(latch_class)], 1);
+}
+
+/*
+ * The first wait of a thread is sampled, then every sample_rate-th, each
+ * sample stands for sample_rate waits of the page
+ */
+void LatchStats::RecordWait(LatchClass latch_class, uint64_t ns,
+                            page_id_t page_id) {
+  ThreadLatches *latches = thread_latches.latches_;
+  int i = static_cast<int>(latch_class);
+  Bump(latches->waits_[i], 1);
+  Bump(latches->wait_ns_[i], ns);
+  if (page_id == INVALID_PAGE_ID)
+    return;
+  if (latches->countdown_ > 0) {
+    --latches->countdown_;
+    return;
+  }
+  LatchRegistry *registry = GetRegistry();
+  size_t rate = registry->sample_rate_.load(std::memory_order_relaxed);
+  latches->countdown_ = rate - 1;
+  std::lock_guard<std::mutex> guard(registry->pages_latch_);
+  auto &page = registry->pages_[page_id];
+  page.first += rate;
+  page.second += ns * rate;
+}
+
+std::unique_lock<std::mutex> LatchStats::Lock(LatchClass latch_class,
+                                              std::mutex &mutex) {
+  RecordAcquire(latch_class);
+  std::unique_lock<std::mutex> guard(mutex, std::try_to_lock);
+  if (guard.owns_lock())
+    return guard;
+  auto start = std::chrono::steady_clock::now();
+  guard.lock();
+  RecordWait(latch_class,
+             std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now() - start)
+                 .count());
+  return guard;
+}
+
+LatchClassStats LatchStats::GetStats(LatchClass latch_class) {
+  int i = static_cast<int>(latch_class);
+  LatchRegistry *registry = GetRegistry();
+  std::lock_guard<std::mutex> guard(registry->latch_);
+  LatchClassStats stats = registry->retired_[i];
+  for (ThreadLatches *latches : registry->threads_)
+    latches->AddTo(i, stats);
+  return stats;
+}
+
+std::vector<HotPage> LatchStats::GetHotPages(size_t count) {
+  std::vector<HotPage> pages;
+  {
+    LatchRegistry *registry = GetRegistry();
+    std::lock_guard<std::mutex> guard(registry->pages_latch_);
+    pages.reserve(registry->pages_.size());
+    for (auto &page : registry->pages_)
+      pages.push_back({page.first, page.second.first, page.second.second});
+  }
+  count = std::min(count, pages.size());
+  std::partial_sort(pages.begin(), pages.begin() + count, pages.end(),
+                    [](const HotPage &left, const HotPage &right) {
+                      return left.wait_ns_ > right.wait_ns_;
+                    });
+  pages.resize(count);
+  return pages;
+}
+
+/*
+ * A thread recording meanwhile may lose the reset of a counter it is
+ * updating
+ */
+void LatchStats::Reset() {
+  LatchRegistry *registry = GetRegistry();
+  {
+    std::lock_guard<std::mutex> guard(registry->latch_);
+    for (int i = 0; i < LATCH_CLASSES; ++i)
+      registry->retired_[i] = LatchClassStats();
+    for (ThreadLatches *latches : registry->threads_)
+      latches->Clear();
+  }
+  std::lock_guard<std::mutex> guard(registry->pages_latch_);
+  registry->pages_.clear();
+}
+
+const char *LatchStats::GetName(LatchClass latch_class) {
+  switch (latch_class) {
+  case LatchClass::BUFFER_POOL:
+    return "buffer_pool";
+  case LatchClass::PAGE:
+    return "page";
+  case LatchClass::LOCK_MANAGER:
+    return "lock_manager";
+  default:
+    return "unknown";
+  }
+}
+
+void LatchStats::Log() {
+  for (int i = 0; i < LATCH_CLASSES; ++i) {
+    LatchClass latch_class = static_cast<LatchClass>(i);
+    LatchClassStats stats = GetStats(latch_class);
+    LOG_INFO("%s latch: acquires %llu waits %llu wait %lluns",
+             GetName(latch_class),
+             static_cast<unsigned long long>(stats.acquires_),
+             static_cast<unsigned long long>(stats.waits_),
+             static_cast<unsigned long long>(stats.wait_ns_));
+  }
+  for (const HotPage &page : GetHotPages(10)) {
+    LOG_INFO("page %lld: ~%llu waits ~%lluns",
+             static_cast<long long>(page.page_id_),
+             static_cast<unsigned long long>(page.waits_),
+             static_cast<unsigned long long>(page.wait_ns_));
+  }
+}
+
+} // namespace cmudb
@@ -0,0 +1,197 @@
+/**
+ * latency_stats.cpp
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "common/latency_stats.h"
+#include "common/logger.h"
+
+namespace cmudb {
+
+/*
+ * Bucket b >= 8 covers [(8 + b % 8) << e, (9 + b % 8) << e) with
+ * e = b / 8 - 1
+ */
+int LatencyHistogram::GetBucket(uint64_t ns) {
+  if (ns < LATENCY_SUB_BUCKETS)
+    return static_cast<int>(ns);
+  int exponent = 63 - __builtin_clzll(ns) - 3;
+  int sub_bucket = static_cast<int>(ns >> exponent) - LATENCY_SUB_BUCKETS;
+  return std::min((exponent + 1) * LATENCY_SUB_BUCKETS + sub_bucket,
+                  LATENCY_BUCKETS - 1);
+}
+
+uint64_t LatencyHistogram::GetBucketLimit(int bucket) {
+  if (bucket < LATENCY_SUB_BUCKETS)
+    return bucket;
+  int exponent = bucket / LATENCY_SUB_BUCKETS - 1;
+  uint64_t sub_bucket = bucket % LATENCY_SUB_BUCKETS;
+  return ((LATENCY_SUB_BUCKETS + sub_bucket + 1) << exponent) - 1;
+}
+
+void LatencyHistogram::Add(uint64_t ns, uint64_t count) {
+  buckets_[GetBucket(ns)] += count;
+  count_ += count;
+  sum_ += ns * count;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram &other) {
+  for (int i = 0; i < LATENCY_BUCKETS; ++i)
+    buckets_[i] += other.buckets_[i];
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double fraction) const {
+  if (count_ == 0)
+    return 0;
+  uint64_t rank = std::max<uint64_t>(1, fraction * count_ + 0.5);
+  uint64_t seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+    seen += buckets_[i];
+    if (seen >= rank)
+      return GetBucketLimit(i);
+  }
+  return GetBucketLimit(LATENCY_BUCKETS - 1);
+}
+
+namespace {
+
+// buckets of one thread, written by it alone
+struct ThreadLatencies {
+  std::atomic<uint64_t> buckets_[LATENCY_TYPES][LATENCY_BUCKETS];
+  std::atomic<uint64_t> sums_[LATENCY_TYPES];
+
+  ThreadLatencies() { Clear(); }
+
+  void Clear() {
+    for (int i = 0; i < LATENCY_TYPES; ++i) {
+      for (int j = 0; j < LATENCY_BUCKETS; ++j)
+        buckets_[i][j].store(0, std::memory_order_relaxed);
+      sums_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void AddTo(int type, LatencyHistogram &histogram) const {
+    for (int j = 0; j < LATENCY_BUCKETS; ++j) {
+      uint64_t count = buckets_[type][j].load(std::memory_order_relaxed);
+      histogram.buckets_[j] += count;
+      histogram.count_ += count;
+    }
+    histogram.sum_ += sums_[type].load(std::memory_order_relaxed);
+  }
+};
+
+// live threads, and what threads that exited recorded
+struct LatencyRegistry {
+  std::mutex latch_;
+  std::vector<ThreadLatencies *> threads_;
+  LatencyHistogram retired_[LATENCY_TYPES];
+};
+
+// never destroyed, threads may exit after static destruction began
+LatencyRegistry *GetRegistry() {
+  static LatencyRegistry *registry = new LatencyRegistry;
+  return registry;
+}
+
+// registers the buckets of a thread on first use, hands them to the
+// registry when the thread exits
+struct ThreadLatenciesHolder {
+  ThreadLatencies *latencies_;
+
+  ThreadLatenciesHolder() : latencies_(new ThreadLatencies) {
+    LatencyRegistry *registry = GetRegistry();
+    std::lock_guard<std::mutex> guard(registry->latch_);
+    registry->threads_.push_back(latencies_);
+  }
+
+  ~ThreadLatenciesHolder() {
+    LatencyRegistry *registry = GetRegistry();
+    {
+      std::lock_guard<std::mutex> guard(registry->latch_);
+      for (int i = 0; i < LATENCY_TYPES; ++i)
+        latencies_->AddTo(i, registry->retired_[i]);
+      registry->threads_.erase(std::find(registry->threads_.begin(),
+                                         registry->threads_.end(),
+                                         latencies_));
+    }
+    delete latencies_;
+  }
+};
+
+thread_local ThreadLatenciesHolder thread_latencies;
+
+} // namespace
+
+void LatencyStats::Record(LatencyType type, uint64_t ns) {
+  ThreadLatencies *latencies = thread_latencies.latencies_;
+  int i = static_cast<int>(type);
+  auto &bucket = latencies->buckets_[i][LatencyHistogram::GetBucket(ns)];
+  bucket.store(bucket.load(std::memory_order_relaxed) + 1,
+               std::memory_order_relaxed);
+  auto &sum = latencies->sums_[i];
+  sum.store(sum.load(std::memory_order_relaxed) + ns,
+            std::memory_order_relaxed);
+}
+
+LatencyHistogram LatencyStats::GetHistogram(LatencyType type) {
+  int i = static_cast<int>(type);
+  LatencyRegistry *registry = GetRegistry();
+  std::lock_guard<std::mutex> guard(registry->latch_);
+  LatencyHistogram histogram = registry->retired_[i];
+  for (ThreadLatencies *latencies : registry->threads_)
+    latencies->AddTo(i, histogram);
+  return histogram;
+}
+
+/*
+ * A thread recording meanwhile may lose the reset of a bucket it is updating
+ */
+void LatencyStats::Reset() {
+  LatencyRegistry *registry = GetRegistry();
+  std::lock_guard<std::mutex> guard(registry->latch_);
+  for (int i = 0; i < LATENCY_TYPES; ++i)
+    registry->retired_[i] = LatencyHistogram();
+  for (ThreadLatencies *latencies : registry->threads_)
+    latencies->Clear();
+}
+
+const char *LatencyStats::GetName(LatencyType type) {
+  switch (type) {
+  case LatencyType::DISK_READ:
+    return "disk_read";
+  case LatencyType::DISK_WRITE:
+    return "disk_write";
+  case LatencyType::BTREE_INSERT:
+    return "btree_insert";
+  case LatencyType::BTREE_GET_VALUE:
+    return "btree_get_value";
+  case LatencyType::BTREE_REMOVE:
+    return "btree_remove";
+  case LatencyType::LOCK_WAIT:
+    return "lock_wait";
+  default:
+    return "unknown";
+  }
+}
+
+void LatencyStats::Log() {
+  for (int i = 0; i < LATENCY_TYPES; ++i) {
+    LatencyType type = static_cast<LatencyType>(i);
+    LatencyHistogram histogram = GetHistogram(type);
+    LOG_INFO("%s: count %llu p50 %lluns p99 %lluns p999 %lluns max %lluns",
+             GetName(type),
+             static_cast<unsigned long long>(histogram.GetCount()),
+             static_cast<unsigned long long>(histogram.GetPercentile(0.5)),
+             static_cast<unsigned long long>(histogram.GetPercentile(0.99)),
+             static_cast<unsigned long long>(histogram.GetPercentile(0.999)),
+             static_cast<unsigned long long>(histogram.GetMax()));
+  }
+}
+
+} // namespace cmudb
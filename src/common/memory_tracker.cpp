@@ -0,0 +1,104 @@
+/**
+ * memory_tracker.cpp
+ */
+
+#include "common/memory_tracker.h"
+
+namespace cmudb {
+
+std::atomic<int64_t> MemoryTracker::usage_[MEMORY_COMPONENTS];
+std::atomic<size_t> MemoryTracker::budget_{0};
+std::atomic<bool> MemoryTracker::over_budget_{false};
+
+namespace {
+
+// bytes charged by one thread and not added to the totals yet, handed over
+// when the thread exits
+struct ThreadCharges {
+  int64_t pending_[MEMORY_COMPONENTS] = {};
+
+  ~ThreadCharges() { MemoryTracker::Flush(); }
+};
+
+thread_local ThreadCharges thread_charges;
+
+} // namespace
+
+void MemoryTracker::Charge(MemoryComponent component, size_t bytes) {
+  Add(component, static_cast<int64_t>(bytes));
+}
+
+void MemoryTracker::Release(MemoryComponent component, size_t bytes) {
+  Add(component, -static_cast<int64_t>(bytes));
+}
+
+void MemoryTracker::Add(MemoryComponent component, int64_t bytes) {
+  int64_t &pending = thread_charges.pending_[static_cast<int>(component)];
+  pending += bytes;
+  if (pending < MEMORY_CHARGE_BATCH && pending > -MEMORY_CHARGE_BATCH)
+    return;
+  usage_[static_cast<int>(component)].fetch_add(pending,
+                                                std::memory_order_relaxed);
+  pending = 0;
+  UpdateOverBudget();
+}
+
+void MemoryTracker::Flush() {
+  for (int i = 0; i < MEMORY_COMPONENTS; ++i) {
+    int64_t &pending = thread_charges.pending_[i];
+    if (pending != 0)
+      usage_[i].fetch_add(pending, std::memory_order_relaxed);
+    pending = 0;
+  }
+  UpdateOverBudget();
+}
+
+/*
+ * A component may release on one thread what it charged on another, its
+ * total can be below zero for a while
+ */
+size_t MemoryTracker::GetUsage(MemoryComponent component) {
+  int64_t usage =
+      usage_[static_cast<int>(component)].load(std::memory_order_relaxed);
+  return usage > 0 ? static_cast<size_t>(usage) : 0;
+}
+
+size_t MemoryTracker::GetTotalUsage() {
+  int64_t usage = 0;
+  for (int i = 0; i < MEMORY_COMPONENTS; ++i)
+    usage += usage_[i].load(std::memory_order_relaxed);
+  return usage > 0 ? static_cast<size_t>(usage) : 0;
+}
+
+void MemoryTracker::SetBudget(size_t bytes) {
+  budget_.store(bytes, std::memory_order_relaxed);
+  UpdateOverBudget();
+}
+
+void MemoryTracker::UpdateOverBudget() {
+  size_t budget = GetBudget();
+  bool over_budget = budget != 0 && GetTotalUsage() > budget;
+  if (over_budget != IsOverBudget())
+    over_budget_.store(over_budget, std::memory_order_relaxed);
+}
+
+const char *MemoryTracker::GetName(MemoryComponent component) {
+  switch (component) {
+  case MemoryComponent::BUFFER_POOL:
+    return "buffer_pool";
+  case MemoryComponent::PAGE_CACHE:
+    return "page_cache";
+  case MemoryComponent::LOCK_TABLE:
+    return "lock_table";
+  case MemoryComponent::TRANSACTION:
+    return "transaction";
+  case MemoryComponent::EXECUTION:
+    return "execution";
+  case MemoryComponent::CURSOR:
+    return "cursor";
+  default:
+    return "unknown";
+  }
+}
+
+} // namespace cmudb
@@ -0,0 +1,108 @@
+/**
+ * rwmutex.cpp
+ */
+
+#include <climits>
+#include <thread>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "common/rwmutex.h"
+
+namespace cmudb {
+
+// rounds a contended RWLatch is spun on before its waiter parks
+#define RWLATCH_SPINS 64
+
+static inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+/*
+ * A writer finding the latch held flags that it waits, so no new reader
+ * gets in, and takes the latch once the holders are gone. The flag is
+ * cleared by whichever writer gets the latch, the others set it again
+ */
+void RWLatch::WLockSlow() {
+  int spins = 0;
+  while (true) {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    if ((state & (writer_ | readers_)) == 0) {
+      if (state_.compare_exchange_weak(state,
+                                       (state | writer_) & ~writer_waiting_,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed))
+        return;
+      continue;
+    }
+    if ((state & writer_waiting_) == 0) {
+      state_.compare_exchange_weak(state, state | writer_waiting_,
+                                   std::memory_order_relaxed);
+      continue;
+    }
+    if (spins++ < RWLATCH_SPINS) {
+      CpuRelax();
+      continue;
+    }
+    if ((state & parked_) == 0 &&
+        !state_.compare_exchange_weak(state, state | parked_,
+                                      std::memory_order_relaxed))
+      continue;
+    Park(state | parked_);
+    spins = 0;
+  }
+}
+
+void RWLatch::RLockSlow() {
+  int spins = 0;
+  while (true) {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    if ((state & (writer_ | writer_waiting_)) == 0 &&
+        (state & readers_) != readers_) {
+      if (state_.compare_exchange_weak(state, state + 1,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed))
+        return;
+      continue;
+    }
+    if (spins++ < RWLATCH_SPINS) {
+      CpuRelax();
+      continue;
+    }
+    if ((state & parked_) == 0 &&
+        !state_.compare_exchange_weak(state, state | parked_,
+                                      std::memory_order_relaxed))
+      continue;
+    Park(state | parked_);
+    spins = 0;
+  }
+}
+
+/*
+ * The futex sleeps only while the word still is state, an unlock clears
+ * the parked flag before it wakes, so a wakeup is never missed. Without
+ * futexes the waiter just yields
+ */
+void RWLatch::Park(uint32_t state) {
+#if defined(__linux__) && defined(SYS_futex)
+  syscall(SYS_futex, reinterpret_cast<int *>(&state_), FUTEX_WAIT_PRIVATE,
+          static_cast<int>(state), nullptr, nullptr, 0);
+#else
+  (void)state;
+  std::this_thread::yield();
+#endif
+}
+
+void RWLatch::Wake() {
+#if defined(__linux__) && defined(SYS_futex)
+  syscall(SYS_futex, reinterpret_cast<int *>(&state_), FUTEX_WAKE_PRIVATE,
+          INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+} // namespace cmudb
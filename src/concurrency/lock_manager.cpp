@@ -2,24 +2,518 @@
  * lock_manager.cpp
  */
 
+#include <algorithm>
+#include <vector>
+
+#include "common/latency_stats.h"
+#include "common/probes.h"
 #include "concurrency/lock_manager.h"
 
 namespace cmudb {
 
-bool LockManager::LockShared(Transaction *txn, const RID &rid) {
-  return false;
+namespace {
+
+// compatible[held][requested], modes in LockMode order
+const bool compatible[5][5] = {{true, true, true, true, false},
+                               {true, true, false, false, false},
+                               {true, false, true, false, false},
+                               {true, false, false, false, false},
+                               {false, false, false, false, false}};
+
+// covers[held][requested]
+const bool covers[5][5] = {{true, false, false, false, false},
+                           {true, true, false, false, false},
+                           {true, false, true, false, false},
+                           {true, true, true, true, false},
+                           {true, true, true, true, true}};
+
+} // namespace
+
+bool LockManager::LockShared(Transaction *txn, const RID &rid,
+                             page_id_t table_id) {
+  return LockRow(txn, rid, table_id, LockMode::SHARED, false);
 }
 
-bool LockManager::LockExclusive(Transaction *txn, const RID &rid) {
-  return false;
+bool LockManager::LockExclusive(Transaction *txn, const RID &rid,
+                                page_id_t table_id) {
+  return LockRow(txn, rid, table_id, LockMode::EXCLUSIVE, false);
 }
 
-bool LockManager::LockUpgrade(Transaction *txn, const RID &rid) {
-  return false;
+bool LockManager::LockUpgrade(Transaction *txn, const RID &rid,
+                              page_id_t table_id) {
+  return LockRow(txn, rid, table_id, LockMode::EXCLUSIVE, true);
+}
+
+bool LockManager::TryLockExclusive(Transaction *txn, const RID &rid,
+                                   page_id_t table_id) {
+  return LockRow(txn, rid, table_id, LockMode::EXCLUSIVE, false, false);
+}
+
+bool LockManager::TryLockShared(Transaction *txn, const RID &rid,
+                                page_id_t table_id) {
+  return LockRow(txn, rid, table_id, LockMode::SHARED, false, false);
 }
 
+/*
+ * Under strict 2PL locks are only released once txn committed or aborted,
+ * an earlier unlock aborts it. Otherwise the first unlock ends its growing
+ * phase
+ */
 bool LockManager::Unlock(Transaction *txn, const RID &rid) {
+  if (strict_2PL_) {
+    if (txn->GetState() != TransactionState::COMMITTED &&
+        txn->GetState() != TransactionState::ABORTED) {
+      txn->SetState(TransactionState::ABORTED);
+      unlock_aborts_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  } else if (txn->GetState() == TransactionState::GROWING) {
+    txn->SetState(TransactionState::SHRINKING);
+  }
+  txn->GetSharedLockSet()->erase(rid);
+  txn->GetExclusiveLockSet()->erase(rid);
+  txn->GetGranuleLockSet()->erase(rid);
+
+  Partition &partition = GetPartition(rid);
+  std::unique_lock<std::mutex> guard = LatchPartition(partition);
+  return Release(partition, txn->GetTransactionId(), rid);
+}
+
+bool LockManager::LockTable(Transaction *txn, page_id_t table_id,
+                            LockMode mode) {
+  return LockGranule(txn, TableLockRid(table_id), table_id, mode);
+}
+
+bool LockManager::LockPage(Transaction *txn, page_id_t table_id,
+                           page_id_t page_id, LockMode mode) {
+  auto granules = txn->GetGranuleLockSet();
+  auto table = granules->find(TableLockRid(table_id));
+  if (table != granules->end() && Covers(table->second.mode_, mode))
+    return true;
+  LockMode intention =
+      mode == LockMode::INTENTION_SHARED || mode == LockMode::SHARED
+          ? LockMode::INTENTION_SHARED
+          : LockMode::INTENTION_EXCLUSIVE;
+  return LockGranule(txn, TableLockRid(table_id), table_id, intention) &&
+         LockGranule(txn, PageLockRid(page_id), table_id, mode);
+}
+
+void LockManager::UnlockAll(Transaction *txn) {
+  if (!strict_2PL_ && txn->GetState() == TransactionState::GROWING)
+    txn->SetState(TransactionState::SHRINKING);
+  std::vector<std::pair<size_t, RID>> rids;
+  for (auto &rid : *txn->GetSharedLockSet())
+    rids.emplace_back(GetPartitionIndex(rid), rid);
+  for (auto &rid : *txn->GetExclusiveLockSet())
+    rids.emplace_back(GetPartitionIndex(rid), rid);
+  for (auto &granule : *txn->GetGranuleLockSet())
+    rids.emplace_back(GetPartitionIndex(granule.first), granule.first);
+  txn->GetSharedLockSet()->clear();
+  txn->GetExclusiveLockSet()->clear();
+  txn->GetGranuleLockSet()->clear();
+
+  std::sort(rids.begin(), rids.end(),
+            [](const std::pair<size_t, RID> &left,
+               const std::pair<size_t, RID> &right) {
+              return left.first < right.first;
+            });
+  for (size_t i = 0; i < rids.size();) {
+    Partition &partition = partitions_[rids[i].first];
+    std::unique_lock<std::mutex> guard = LatchPartition(partition);
+    size_t index = rids[i].first;
+    for (; i < rids.size() && rids[i].first == index; i++)
+      Release(partition, txn->GetTransactionId(), rids[i].second);
+  }
+}
+
+bool LockManager::HoldsExclusive(Transaction *txn, const RID &rid) {
+  if (txn->GetExclusiveLockSet()->count(rid) != 0)
+    return true;
+  for (auto &granule : *txn->GetGranuleLockSet()) {
+    if (granule.second.mode_ != LockMode::EXCLUSIVE)
+      continue;
+    if (granule.first.GetSlotNum() == TABLE_LOCK_SLOT ||
+        granule.first == PageLockRid(rid.GetPageId()))
+      return true;
+  }
+  return false;
+}
+
+void LockManager::StartDeadlockDetection(std::chrono::milliseconds interval) {
+  std::lock_guard<std::mutex> guard(thread_latch_);
+  interval_ = interval;
+  detecting_ = true;
+  if (!detection_thread_.joinable()) {
+    stop_thread_ = false;
+    detection_thread_ = std::thread(&LockManager::DetectionWorker, this);
+  }
+}
+
+void LockManager::StopDeadlockDetection() {
+  {
+    std::lock_guard<std::mutex> guard(thread_latch_);
+    if (!detection_thread_.joinable())
+      return;
+    stop_thread_ = true;
+    detecting_ = false;
+  }
+  thread_cv_.notify_one();
+  detection_thread_.join();
+}
+
+/*
+ * A request waits for the incompatible requests of other transactions ahead
+ * of it, as IsGrantable has it. A transaction waits on one request at most.
+ * Victims leave the graph, their locks are held until they abort
+ */
+size_t LockManager::DetectDeadlocks() {
+  std::vector<std::unique_lock<std::mutex>> guards;
+  for (auto &partition : partitions_)
+    guards.emplace_back(partition.latch_);
+  WaitsForGraph graph;
+  std::unordered_map<txn_id_t, std::pair<RequestQueue *, Request *>> waiting;
+  for (auto &partition : partitions_) {
+    for (auto &entry : partition.queues_) {
+      auto &requests = entry.second.requests_;
+      for (auto request = requests.begin(); request != requests.end();
+           ++request) {
+        if (request->aborted_)
+          continue;
+        for (auto it = requests.begin(); it != request; ++it) {
+          if (it->txn_id_ != request->txn_id_ &&
+              !IsCompatible(it->mode_, request->mode_)) {
+            graph[request->txn_id_].push_back(it->txn_id_);
+            waiting[request->txn_id_] = {&entry.second, &*request};
+          }
+        }
+      }
+    }
+  }
+
+  size_t victims = 0;
+  while (true) {
+    std::unordered_map<txn_id_t, int> colors;
+    std::vector<txn_id_t> path;
+    txn_id_t victim = INVALID_TXN_ID;
+    for (auto &node : graph) {
+      if (colors[node.first] == 0 &&
+          FindCycle(graph, node.first, colors, path, victim))
+        break;
+    }
+    if (victim == INVALID_TXN_ID)
+      return victims;
+    auto &where = waiting[victim];
+    where.second->aborted_ = true;
+    where.first->cv_.notify_all();
+    graph.erase(victim);
+    victims++;
+  }
+}
+
+LockStats LockManager::GetStats() {
+  LockStats stats;
+  stats.wait_die_aborts_ = wait_die_aborts_.load(std::memory_order_relaxed);
+  stats.deadlock_aborts_ = deadlock_aborts_.load(std::memory_order_relaxed);
+  stats.state_aborts_ = state_aborts_.load(std::memory_order_relaxed);
+  stats.unlock_aborts_ = unlock_aborts_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void LockManager::ResetStats() {
+  wait_die_aborts_ = 0;
+  deadlock_aborts_ = 0;
+  state_aborts_ = 0;
+  unlock_aborts_ = 0;
+}
+
+size_t LockManager::GetLockedCount() {
+  size_t count = 0;
+  for (auto &partition : partitions_) {
+    std::lock_guard<std::mutex> guard(partition.latch_);
+    count += partition.queues_.size();
+  }
+  return count;
+}
+
+/*
+ * Locks held above the row are checked first, they cover it even once txn
+ * stopped growing, as when an abort rolls back rows of an escalated table
+ */
+bool LockManager::LockRow(Transaction *txn, const RID &rid,
+                          page_id_t table_id, LockMode mode, bool upgrade,
+                          bool wait) {
+  auto granules = txn->GetGranuleLockSet();
+  if (table_id != INVALID_PAGE_ID) {
+    auto table = granules->find(TableLockRid(table_id));
+    if (table != granules->end() && Covers(table->second.mode_, mode))
+      return true;
+    auto page = granules->find(PageLockRid(rid.GetPageId()));
+    if (page != granules->end() && Covers(page->second.mode_, mode))
+      return true;
+    LockMode intention = mode == LockMode::SHARED
+                             ? LockMode::INTENTION_SHARED
+                             : LockMode::INTENTION_EXCLUSIVE;
+    if (!LockGranule(txn, TableLockRid(table_id), table_id, intention) ||
+        !LockGranule(txn, PageLockRid(rid.GetPageId()), table_id, intention))
+      return false;
+  }
+  if (!Lock(txn, rid, mode, upgrade, wait))
+    return false;
+
+  if (upgrade)
+    txn->GetSharedLockSet()->erase(rid);
+  if (mode == LockMode::SHARED)
+    txn->GetSharedLockSet()->insert(rid);
+  else
+    txn->GetExclusiveLockSet()->insert(rid);
+  if (table_id != INVALID_PAGE_ID && !upgrade &&
+      ++granules->at(TableLockRid(table_id)).rows_ > escalation_threshold_)
+    Escalate(txn, table_id);
+  return true;
+}
+
+bool LockManager::LockGranule(Transaction *txn, const RID &lock_rid,
+                              page_id_t table_id, LockMode mode) {
+  auto granules = txn->GetGranuleLockSet();
+  auto granule = granules->find(lock_rid);
+  if (granule != granules->end() && Covers(granule->second.mode_, mode))
+    return true;
+  bool upgrade = granule != granules->end();
+  if (upgrade)
+    mode = Combine(granule->second.mode_, mode);
+  if (!Lock(txn, lock_rid, mode, upgrade))
+    return false;
+  if (upgrade)
+    granule->second.mode_ = mode;
+  else
+    granules->emplace(lock_rid, GranuleLock{mode, table_id, 0});
+  return true;
+}
+
+bool LockManager::Lock(Transaction *txn, const RID &rid, LockMode mode,
+                       bool upgrade, bool wait) {
+  if (txn->GetState() != TransactionState::GROWING) {
+    // no lock is taken after the first one is released
+    txn->SetState(TransactionState::ABORTED);
+    state_aborts_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  txn_id_t txn_id = txn->GetTransactionId();
+  Partition &partition = GetPartition(rid);
+  std::unique_lock<std::mutex> guard = LatchPartition(partition);
+  size_t queues = partition.queues_.size();
+  RequestQueue &queue = partition.queues_[rid];
+  if (partition.queues_.size() != queues)
+    MemoryTracker::Charge(MemoryComponent::LOCK_TABLE, QUEUE_BYTES);
+  if (wait && !detecting_ && !MayWait(queue, txn_id, mode)) {
+    // it dies, there is a conflicting request so the queue is not empty
+    txn->SetState(TransactionState::ABORTED);
+    wait_die_aborts_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  auto request =
+      queue.requests_.emplace(queue.requests_.end(), txn_id, mode, upgrade);
+  MemoryTracker::Charge(MemoryComponent::LOCK_TABLE, REQUEST_BYTES);
+  if (!IsGrantable(queue, request)) {
+    if (!wait) {
+      // txn already holds a lock here, the queue is kept
+      queue.requests_.erase(request);
+      MemoryTracker::Release(MemoryComponent::LOCK_TABLE, REQUEST_BYTES);
+      return false;
+    }
+    LATENCY_TIMER(LatencyType::LOCK_WAIT);
+    CMUDB_PROBE4(lock_wait_start, txn_id, rid.GetPageId(), rid.GetSlotNum(),
+                 static_cast<int>(mode));
+    queue.cv_.wait(guard, [&] {
+      return request->aborted_ || IsGrantable(queue, request);
+    });
+    CMUDB_PROBE4(lock_wait_done, txn_id, rid.GetPageId(), rid.GetSlotNum(),
+                 !request->aborted_);
+    if (request->aborted_) {
+      // a deadlock victim, the requests behind it may go on
+      queue.requests_.erase(request);
+      MemoryTracker::Release(MemoryComponent::LOCK_TABLE, REQUEST_BYTES);
+      queue.cv_.notify_all();
+      txn->SetState(TransactionState::ABORTED);
+      deadlock_aborts_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+
+  if (upgrade) {
+    // the weaker request ahead is replaced by the new one
+    for (auto it = queue.requests_.begin(); it != request; ++it) {
+      if (it->txn_id_ == txn_id) {
+        queue.requests_.erase(it);
+        MemoryTracker::Release(MemoryComponent::LOCK_TABLE, REQUEST_BYTES);
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * Tried once the table has more row locks than the threshold, without
+ * waiting so that it never aborts txn. The row and page locks of the table
+ * are covered by the table lock then and released early, txn holds every
+ * row it had locked all along
+ */
+void LockManager::Escalate(Transaction *txn, page_id_t table_id) {
+  RID table_rid = TableLockRid(table_id);
+  auto granules = txn->GetGranuleLockSet();
+  GranuleLock &table = granules->at(table_rid);
+  table.rows_ = 0;
+  LockMode mode = table.mode_ == LockMode::INTENTION_SHARED
+                      ? LockMode::SHARED
+                      : LockMode::EXCLUSIVE;
+  if (!Lock(txn, table_rid, mode, true, false))
+    return;
+  table.mode_ = mode;
+
+  std::vector<RID> covered;
+  std::unordered_set<page_id_t> pages;
+  for (auto &granule : *granules) {
+    if (granule.first.GetSlotNum() == PAGE_LOCK_SLOT &&
+        granule.second.table_id_ == table_id) {
+      covered.push_back(granule.first);
+      pages.insert(granule.first.GetPageId());
+    }
+  }
+  for (auto &page_rid : covered)
+    granules->erase(page_rid);
+  auto shared = txn->GetSharedLockSet();
+  for (auto rid = shared->begin(); rid != shared->end();) {
+    if (pages.count(rid->GetPageId()) != 0) {
+      covered.push_back(*rid);
+      rid = shared->erase(rid);
+    } else {
+      ++rid;
+    }
+  }
+  auto exclusive = txn->GetExclusiveLockSet();
+  for (auto rid = exclusive->begin(); rid != exclusive->end();) {
+    if (pages.count(rid->GetPageId()) != 0) {
+      covered.push_back(*rid);
+      rid = exclusive->erase(rid);
+    } else {
+      ++rid;
+    }
+  }
+  for (auto &rid : covered) {
+    Partition &partition = GetPartition(rid);
+    std::unique_lock<std::mutex> guard = LatchPartition(partition);
+    Release(partition, txn->GetTransactionId(), rid);
+  }
+}
+
+bool LockManager::Release(Partition &partition, txn_id_t txn_id,
+                          const RID &rid) {
+  auto queue = partition.queues_.find(rid);
+  if (queue == partition.queues_.end())
+    return false;
+  auto &requests = queue->second.requests_;
+  size_t found = 0;
+  for (auto request = requests.begin(); request != requests.end();) {
+    if (request->txn_id_ == txn_id) {
+      request = requests.erase(request);
+      ++found;
+    } else {
+      ++request;
+    }
+  }
+  MemoryTracker::Release(MemoryComponent::LOCK_TABLE, found * REQUEST_BYTES);
+  if (requests.empty()) {
+    partition.queues_.erase(queue);
+    MemoryTracker::Release(MemoryComponent::LOCK_TABLE, QUEUE_BYTES);
+  } else if (found > 0) {
+    queue->second.cv_.notify_all();
+  }
+  return found > 0;
+}
+
+/*
+ * An upgrade is ahead of every request but the weaker one of its own
+ * transaction
+ */
+bool LockManager::IsGrantable(const RequestQueue &queue,
+                              std::list<Request>::const_iterator request) {
+  for (auto it = queue.requests_.begin(); it != request; ++it) {
+    if (it->txn_id_ == request->txn_id_)
+      continue;
+    if (!IsCompatible(it->mode_, request->mode_))
+      return false;
+  }
+  return true;
+}
+
+/*
+ * A new request goes to the tail, every request in the queue is ahead of it
+ */
+bool LockManager::MayWait(const RequestQueue &queue, txn_id_t txn_id,
+                          LockMode mode) {
+  for (auto &request : queue.requests_) {
+    if (request.txn_id_ == txn_id)
+      continue;
+    if (!IsCompatible(request.mode_, mode) && request.txn_id_ < txn_id)
+      return false;
+  }
+  return true;
+}
+
+/*
+ * colors: 0 unvisited, 1 on path, 2 done with no cycle through it
+ */
+bool LockManager::FindCycle(const WaitsForGraph &graph, txn_id_t txn,
+                            std::unordered_map<txn_id_t, int> &colors,
+                            std::vector<txn_id_t> &path, txn_id_t &victim) {
+  colors[txn] = 1;
+  path.push_back(txn);
+  auto edges = graph.find(txn);
+  if (edges != graph.end()) {
+    for (auto next : edges->second) {
+      int color = colors[next];
+      if (color == 1) {
+        auto first = std::find(path.begin(), path.end(), next);
+        victim = *std::max_element(first, path.end());
+        return true;
+      }
+      if (color == 0 && FindCycle(graph, next, colors, path, victim))
+        return true;
+    }
+  }
+  colors[txn] = 2;
+  path.pop_back();
   return false;
 }
 
+void LockManager::DetectionWorker() {
+  std::unique_lock<std::mutex> guard(thread_latch_);
+  while (!stop_thread_) {
+    thread_cv_.wait_for(guard, interval_, [this] { return stop_thread_; });
+    if (stop_thread_)
+      break;
+    guard.unlock();
+    DetectDeadlocks();
+    guard.lock();
+  }
+}
+
+bool LockManager::IsCompatible(LockMode left, LockMode right) {
+  return compatible[static_cast<int>(left)][static_cast<int>(right)];
+}
+
+bool LockManager::Covers(LockMode held, LockMode mode) {
+  return covers[static_cast<int>(held)][static_cast<int>(mode)];
+}
+
+LockMode LockManager::Combine(LockMode held, LockMode mode) {
+  if (Covers(held, mode))
+    return held;
+  if (Covers(mode, held))
+    return mode;
+  // shared and intention exclusive
+  return LockMode::SHARED_INTENTION_EXCLUSIVE;
+}
+
 } // namespace cmudb
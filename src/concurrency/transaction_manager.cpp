@@ -2,42 +2,185 @@
  * transaction_manager.cpp
  *
  */
+#include "common/probes.h"
 #include "concurrency/transaction_manager.h"
+#include "index/index.h"
 #include "table/table_heap.h"
 
 namespace cmudb {
 
+Transaction *TransactionManager::NewTransaction(bool read_only) {
+  txn_id_t txn_id = next_txn_id_++;
+  {
+    std::lock_guard<std::mutex> guard(pool_latch_);
+    auto &pool = read_only ? free_read_only_txns_ : free_txns_;
+    if (!pool.empty()) {
+      Transaction *txn = pool.back();
+      pool.pop_back();
+      txn->Reset(txn_id);
+      return txn;
+    }
+  }
+  return new Transaction(txn_id, read_only);
+}
+
+void TransactionManager::Release(Transaction *txn) {
+  {
+    std::lock_guard<std::mutex> guard(pool_latch_);
+    auto &pool = txn->IsReadOnly() ? free_read_only_txns_ : free_txns_;
+    if (pool.size() < TXN_POOL_SIZE) {
+      pool.push_back(txn);
+      return;
+    }
+  }
+  delete txn;
+}
+
+Transaction *TransactionManager::Begin() {
+  Transaction *txn = NewTransaction();
+  txn->SetVersionStore(&version_store_);
+  if (IsLogging()) {
+    // a checkpoint appended after BEGIN sees txn in the table
+    std::lock_guard<std::mutex> guard(active_latch_);
+    lsn_t lsn = WriteLog(txn, LogRecordType::BEGIN);
+    active_txns_[txn->GetTransactionId()] = std::make_pair(txn, lsn);
+  }
+  return txn;
+}
+
+/*
+ * Nothing is logged for a snapshot and it is not in the active transaction
+ * table, it has nothing to redo or undo
+ */
+Transaction *TransactionManager::BeginSnapshot() {
+  Transaction *txn = NewTransaction(true);
+  txn->SetVersionStore(&version_store_);
+  std::lock_guard<std::mutex> guard(commit_latch_);
+  txn->SetSnapshot(last_commit_ts_);
+  snapshots_.insert(last_commit_ts_);
+  return txn;
+}
+
 void TransactionManager::Commit(Transaction *txn) {
+  CMUDB_PROBE1(txn_commit_start, txn->GetTransactionId());
   txn->SetState(TransactionState::COMMITTED);
+  if (txn->IsSnapshot()) {
+    EndSnapshot(txn);
+    CMUDB_PROBE1(txn_commit_done, txn->GetTransactionId());
+    return;
+  }
   // truly delete before commit
   auto write_set = txn->GetWriteSet();
+  std::vector<std::pair<page_id_t, RID>> records;
+  for (auto &item : *write_set)
+    records.emplace_back(item.table_->GetFirstPageId(), item.rid_);
+  // images whose values out of line may be left to nobody
+  std::vector<WriteRecord> retired;
   while (!write_set->empty()) {
     auto &item = write_set->back();
     auto table = item.table_;
     if (item.wtype_ == WType::DELETE) {
       // this also release the lock when holding the page latch
-      table->ApplyDelete(item.rid_, txn);
+      Tuple deleted;
+      table->ApplyDelete(item.rid_, txn, item.is_move_ ? nullptr : &deleted);
+      if (deleted.GetLength() != 0)
+        retired.emplace_back(item.rid_, WType::DELETE, deleted, table);
+    } else if (item.wtype_ == WType::UPDATE) {
+      retired.push_back(std::move(item));
     }
     write_set->pop_back();
   }
   write_set->clear();
 
-  std::unordered_set<RID> lock_set;
-  for (auto item : *txn->GetSharedLockSet())
-    lock_set.emplace(item);
-  for (auto item : *txn->GetExclusiveLockSet())
-    lock_set.emplace(item);
-  // release all the lock
-  for (auto locked_rid : lock_set) {
-    lock_manager_->Unlock(txn, locked_rid);
+  if (IsLogging()) {
+    // group commit, many committing transactions share one flush
+    lsn_t lsn = WriteLog(txn, LogRecordType::COMMIT);
+    log_manager_->WaitUntilDurable(lsn);
   }
+  for (auto &item : retired)
+    item.table_->RetireChains(item.tuple_, item.rid_, txn);
+  if (!records.empty()) {
+    std::lock_guard<std::mutex> guard(commit_latch_);
+    timestamp_t ts = last_commit_ts_ + 1;
+    StampVersions(txn, ts);
+    last_commit_ts_ = ts;
+  }
+  RemoveActive(txn);
+  ReleaseLocks(txn);
+  PruneVersions(records);
+  CMUDB_PROBE1(txn_commit_done, txn->GetTransactionId());
 }
 
 void TransactionManager::Abort(Transaction *txn) {
+  CMUDB_PROBE1(txn_abort_start, txn->GetTransactionId());
   txn->SetState(TransactionState::ABORTED);
+  if (txn->IsSnapshot()) {
+    EndSnapshot(txn);
+    CMUDB_PROBE1(txn_abort_done, txn->GetTransactionId());
+    return;
+  }
   // rollback before releasing lock
   auto write_set = txn->GetWriteSet();
-  while (!write_set->empty()) {
+  std::vector<std::pair<page_id_t, RID>> records;
+  for (auto &item : *write_set)
+    records.emplace_back(item.table_->GetFirstPageId(), item.rid_);
+  Undo(txn, Savepoint{0, 0});
+
+  // no need to wait, if the record is lost recovery undoes txn again
+  if (IsLogging())
+    WriteLog(txn, LogRecordType::ABORT);
+  StampVersions(txn, ABORTED_TIMESTAMP);
+  RemoveActive(txn);
+  ReleaseLocks(txn);
+  PruneVersions(records);
+  CMUDB_PROBE1(txn_abort_done, txn->GetTransactionId());
+}
+
+void TransactionManager::EndSnapshot(Transaction *txn) {
+  bool oldest;
+  {
+    std::lock_guard<std::mutex> guard(commit_latch_);
+    auto it = snapshots_.find(txn->GetReadTimestamp());
+    oldest = it == snapshots_.begin();
+    snapshots_.erase(it);
+  }
+  // the versions only it held on to go, now or with the next round
+  if (oldest && !collecting_)
+    Sweep(GetWatermark());
+}
+
+/*
+ * The versions of what is undone stay uncommitted until txn ends, they hold
+ * the image the rid is back to
+ */
+void TransactionManager::RollbackTo(Transaction *txn,
+                                    const Savepoint &savepoint) {
+  Undo(txn, savepoint);
+}
+
+void TransactionManager::Undo(Transaction *txn, const Savepoint &savepoint) {
+  auto index_write_set = txn->GetIndexWriteSet();
+  while (index_write_set->size() > savepoint.index_write_set_size_) {
+    auto &item = index_write_set->back();
+    if (item.wtype_ == WType::INSERT) {
+      // a unique index keeps the rid that had the key first, one building
+      // checks that as it applies the delete
+      std::vector<RID> rids;
+      if (item.index_->GetMetadata()->IsUnique() &&
+          !item.index_->IsBuilding())
+        item.index_->ScanKey(item.key_, rids, txn);
+      else
+        rids.push_back(item.rid_);
+      if (!rids.empty() && rids[0] == item.rid_)
+        item.index_->DeleteEntry(item.key_, item.rid_, txn);
+    } else if (item.wtype_ == WType::DELETE)
+      item.index_->InsertEntry(item.key_, item.rid_, txn);
+    index_write_set->pop_back();
+  }
+
+  auto write_set = txn->GetWriteSet();
+  while (write_set->size() > savepoint.write_set_size_) {
+    size_t size = write_set->size();
     auto &item = write_set->back();
     auto table = item.table_;
     if (item.wtype_ == WType::DELETE) {
@@ -46,23 +189,139 @@ void TransactionManager::Abort(Transaction *txn) {
     } else if (item.wtype_ == WType::INSERT) {
       LOG_DEBUG("rollback insert");
       // this also release the lock when holding the page latch
-      table->ApplyDelete(item.rid_, txn);
+      Tuple deleted;
+      table->ApplyDelete(item.rid_, txn, item.is_move_ ? nullptr : &deleted);
+      table->RetireChains(deleted, item.rid_, txn);
     } else if (item.wtype_ == WType::UPDATE) {
       LOG_DEBUG("rollback update");
-      table->UpdateTuple(item.tuple_, item.rid_, txn);
+      // a running txn records the update putting the image back, it goes
+      // with the record undone
+      table->RollbackUpdate(item.tuple_, item.rid_, txn);
     }
-    write_set->pop_back();
+    write_set->erase(write_set->begin() + (size - 1), write_set->end());
   }
-  write_set->clear();
+}
 
-  std::unordered_set<RID> lock_set;
-  for (auto item : *txn->GetSharedLockSet())
-    lock_set.emplace(item);
-  for (auto item : *txn->GetExclusiveLockSet())
-    lock_set.emplace(item);
-  // release all the lock
-  for (auto locked_rid : lock_set) {
-    lock_manager_->Unlock(txn, locked_rid);
+void TransactionManager::GetActiveTransactions(
+    std::vector<std::pair<txn_id_t, lsn_t>> &txns, lsn_t &min_first_lsn) {
+  txns.clear();
+  min_first_lsn = INVALID_LSN;
+  std::lock_guard<std::mutex> guard(active_latch_);
+  for (auto &entry : active_txns_) {
+    txns.emplace_back(entry.first, entry.second.first->GetPrevLSN());
+    if (min_first_lsn == INVALID_LSN || entry.second.second < min_first_lsn)
+      min_first_lsn = entry.second.second;
   }
 }
+
+void TransactionManager::RemoveActive(Transaction *txn) {
+  std::lock_guard<std::mutex> guard(active_latch_);
+  active_txns_.erase(txn->GetTransactionId());
+}
+
+lsn_t TransactionManager::WriteLog(Transaction *txn,
+                                   LogRecordType log_record_type) {
+  LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                       log_record_type);
+  lsn_t lsn = log_manager_->AppendLogRecord(log_record);
+  txn->SetPrevLSN(lsn);
+  return lsn;
+}
+
+void TransactionManager::StampVersions(Transaction *txn, timestamp_t ts) {
+  if (txn->GetCommitTimestamp() != nullptr)
+    txn->GetCommitTimestamp()->store(ts, std::memory_order_release);
+}
+
+timestamp_t TransactionManager::GetWatermark() {
+  std::lock_guard<std::mutex> guard(commit_latch_);
+  return snapshots_.empty() ? last_commit_ts_.load() : *snapshots_.begin();
+}
+
+void TransactionManager::PruneVersions(
+    const std::vector<std::pair<page_id_t, RID>> &records) {
+  if (records.empty())
+    return;
+  timestamp_t oldest_ts = GetWatermark();
+  size_t pruned = 0;
+  for (auto &record : records)
+    pruned += version_store_.Prune(record.first, record.second, oldest_ts);
+  gc_pruned_.fetch_add(pruned, std::memory_order_relaxed);
+}
+
+size_t TransactionManager::Sweep(timestamp_t watermark) {
+  size_t collected = version_store_.Collect(watermark);
+  gc_watermark_.store(watermark, std::memory_order_relaxed);
+  gc_runs_.fetch_add(1, std::memory_order_relaxed);
+  gc_collected_.fetch_add(collected, std::memory_order_relaxed);
+  return collected;
+}
+
+void TransactionManager::StartGarbageCollection(
+    std::chrono::milliseconds interval) {
+  std::lock_guard<std::mutex> guard(gc_latch_);
+  gc_interval_ = interval;
+  collecting_ = true;
+  if (!gc_thread_.joinable()) {
+    stop_gc_ = false;
+    gc_thread_ =
+        std::thread(&TransactionManager::GarbageCollectionWorker, this);
+  }
+}
+
+void TransactionManager::StopGarbageCollection() {
+  {
+    std::lock_guard<std::mutex> guard(gc_latch_);
+    if (!gc_thread_.joinable())
+      return;
+    stop_gc_ = true;
+    collecting_ = false;
+  }
+  gc_cv_.notify_one();
+  gc_thread_.join();
+  // what the last round left for an ended snapshot
+  Sweep(GetWatermark());
+}
+
+/*
+ * A version committed after the watermark of the last sweep is still
+ * needed while the watermark stays, and a commit already pruned what it
+ * wrote as far as the watermark allowed then
+ */
+size_t TransactionManager::CollectGarbage() {
+  timestamp_t watermark = GetWatermark();
+  if (watermark == gc_watermark_.load(std::memory_order_relaxed) &&
+      gc_runs_.load(std::memory_order_relaxed) != 0)
+    return 0;
+  return Sweep(watermark);
+}
+
+GCStats TransactionManager::GetGCStats() {
+  GCStats stats;
+  stats.runs_ = gc_runs_.load(std::memory_order_relaxed);
+  stats.collected_ = gc_collected_.load(std::memory_order_relaxed);
+  stats.pruned_ = gc_pruned_.load(std::memory_order_relaxed);
+  stats.watermark_ = gc_watermark_.load(std::memory_order_relaxed);
+  timestamp_t last = last_commit_ts_;
+  stats.lag_ = last > stats.watermark_ ? last - stats.watermark_ : 0;
+  stats.versions_ = version_store_.GetVersionCount();
+  return stats;
+}
+
+void TransactionManager::GarbageCollectionWorker() {
+  std::unique_lock<std::mutex> guard(gc_latch_);
+  while (!stop_gc_) {
+    gc_cv_.wait_for(guard, gc_interval_, [this] { return stop_gc_; });
+    if (stop_gc_)
+      break;
+    guard.unlock();
+    CollectGarbage();
+    guard.lock();
+  }
+}
+
+void TransactionManager::ReleaseLocks(Transaction *txn) {
+  if (lock_manager_ != nullptr)
+    lock_manager_->UnlockAll(txn);
+}
 } // namespace cmudb
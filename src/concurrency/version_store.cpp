@@ -0,0 +1,157 @@
+/**
+ * version_store.cpp
+ */
+
+#include "concurrency/version_store.h"
+
+namespace cmudb {
+
+void VersionStore::Push(page_id_t table_id, const RID &rid,
+                        const Tuple *before, Transaction *writer) {
+  PageKey key{table_id, rid.GetPageId()};
+  Partition &partition = GetPartition(key);
+  std::lock_guard<std::mutex> guard(partition.latch_);
+  auto &versions = partition.pages_[key][rid.GetSlotNum()];
+  // writers of a rid are serialized by its lock, a version of writer can
+  // only be the newest one
+  if (!versions.empty() &&
+      versions.back().writer_ == writer->GetTransactionId() &&
+      versions.back().commit_ts_ == writer->GetCommitTimestamp())
+    return;
+  versions.emplace_back(before, writer);
+}
+
+bool VersionStore::Read(page_id_t table_id, const RID &rid,
+                        timestamp_t read_ts, Tuple &tuple, bool &exists) {
+  PageKey key{table_id, rid.GetPageId()};
+  Partition &partition = GetPartition(key);
+  std::lock_guard<std::mutex> guard(partition.latch_);
+  auto page = partition.pages_.find(key);
+  if (page == partition.pages_.end())
+    return false;
+  auto slot = page->second.find(rid.GetSlotNum());
+  if (slot == page->second.end())
+    return false;
+  const Version *visible = nullptr;
+  auto &versions = slot->second;
+  for (auto version = versions.rbegin(); version != versions.rend();
+       ++version) {
+    if (version->commit_ts_->load(std::memory_order_acquire) <= read_ts)
+      break;
+    visible = &*version;
+  }
+  if (visible == nullptr)
+    return false;
+  exists = visible->exists_;
+  if (exists) {
+    tuple = visible->image_;
+    tuple.rid_ = rid;
+  }
+  return true;
+}
+
+bool VersionStore::HasVersions(page_id_t table_id, page_id_t page_id) {
+  PageKey key{table_id, page_id};
+  Partition &partition = GetPartition(key);
+  std::lock_guard<std::mutex> guard(partition.latch_);
+  return partition.pages_.count(key) != 0;
+}
+
+void VersionStore::GetChangedRids(page_id_t table_id, timestamp_t read_ts,
+                                  std::vector<RID> &rids) {
+  for (auto &partition : partitions_) {
+    std::lock_guard<std::mutex> guard(partition.latch_);
+    for (auto &page : partition.pages_) {
+      if (page.first.table_id_ != table_id)
+        continue;
+      for (auto &slot : page.second)
+        if (!slot.second.empty() &&
+            slot.second.back().commit_ts_->load(std::memory_order_acquire) >
+                read_ts)
+          rids.emplace_back(page.first.page_id_, slot.first);
+    }
+  }
+}
+
+size_t VersionStore::Prune(page_id_t table_id, const RID &rid,
+                           timestamp_t oldest_ts) {
+  PageKey key{table_id, rid.GetPageId()};
+  Partition &partition = GetPartition(key);
+  std::lock_guard<std::mutex> guard(partition.latch_);
+  auto page = partition.pages_.find(key);
+  if (page == partition.pages_.end())
+    return 0;
+  auto slot = page->second.find(rid.GetSlotNum());
+  if (slot == page->second.end())
+    return 0;
+  size_t pruned = PruneChain(slot->second, oldest_ts);
+  if (slot->second.empty())
+    page->second.erase(slot);
+  if (page->second.empty())
+    partition.pages_.erase(page);
+  return pruned;
+}
+
+size_t VersionStore::Collect(timestamp_t oldest_ts) {
+  size_t pruned = 0;
+  for (auto &partition : partitions_) {
+    std::lock_guard<std::mutex> guard(partition.latch_);
+    for (auto page = partition.pages_.begin();
+         page != partition.pages_.end();) {
+      for (auto slot = page->second.begin(); slot != page->second.end();) {
+        pruned += PruneChain(slot->second, oldest_ts);
+        if (slot->second.empty())
+          slot = page->second.erase(slot);
+        else
+          ++slot;
+      }
+      if (page->second.empty())
+        page = partition.pages_.erase(page);
+      else
+        ++page;
+    }
+  }
+  return pruned;
+}
+
+size_t VersionStore::GetVersionCount() {
+  size_t count = 0;
+  for (auto &partition : partitions_) {
+    std::lock_guard<std::mutex> guard(partition.latch_);
+    for (auto &page : partition.pages_)
+      for (auto &slot : page.second)
+        count += slot.second.size();
+  }
+  return count;
+}
+
+/*
+ * A reader walks from the newest version back to the first one committed
+ * at or before its read timestamp, the newest one committed at or before
+ * oldest_ts stops every reader and nothing from it on is needed. An aborted
+ * version holds what its writer's rollback put back in the page, the
+ * version ahead of it or the page has the same image
+ */
+size_t VersionStore::PruneChain(std::vector<Version> &versions,
+                                timestamp_t oldest_ts) {
+  size_t size = versions.size();
+  size_t keep = 0;
+  for (size_t i = versions.size(); i > 0; i--) {
+    if (versions[i - 1].commit_ts_->load(std::memory_order_acquire) <=
+        oldest_ts) {
+      keep = i;
+      break;
+    }
+  }
+  versions.erase(versions.begin(), versions.begin() + keep);
+  for (auto version = versions.begin(); version != versions.end();) {
+    if (version->commit_ts_->load(std::memory_order_acquire) ==
+        ABORTED_TIMESTAMP)
+      version = versions.erase(version);
+    else
+      ++version;
+  }
+  return size - versions.size();
+}
+
+} // namespace cmudb
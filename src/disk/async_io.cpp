@@ -0,0 +1,275 @@
+/**
+ * async_io.cpp
+ */
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common/logger.h"
+#include "disk/async_io.h"
+
+namespace cmudb {
+
+#ifdef __NR_io_uring_setup
+static int IOUringSetup(unsigned entries, struct io_uring_params *params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int IOUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                        unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+#endif
+
+AsyncIO::AsyncIO(int fd, unsigned queue_depth)
+    : fd_(fd), ring_fd_(-1), sq_ring_(nullptr), sq_ring_size_(0),
+      sqes_(nullptr), sqes_size_(0), cq_ring_(nullptr), cq_ring_size_(0),
+      pending_(0), inflight_(0) {
+  if (!SetupRing(queue_depth)) {
+    LOG_DEBUG("io_uring not available, use synchronous I/O");
+    TeardownRing();
+    return;
+  }
+  completion_thread_ = std::thread(&AsyncIO::Complete, this);
+}
+
+/*
+ * Wait for every request to complete, then wake completion thread with a nop
+ */
+AsyncIO::~AsyncIO() {
+  if (!IsRingEnabled())
+    return;
+  {
+    std::unique_lock<std::mutex> guard(latch_);
+    SubmitLocked();
+    completed_cv_.wait(guard, [this] { return inflight_ == 0; });
+    Enqueue(guard, IORING_OP_NOP, 0, nullptr, 0, nullptr);
+    SubmitLocked();
+  }
+  completion_thread_.join();
+  TeardownRing();
+}
+
+void AsyncIO::Read(off_t offset, char *data, size_t size,
+                   IOCallback callback) {
+  if (!IsRingEnabled()) {
+    ssize_t rc;
+    do {
+      rc = pread(fd_, data, size, offset);
+    } while (rc < 0 && errno == EINTR);
+    callback(rc < 0 ? -errno : rc);
+    return;
+  }
+  std::unique_lock<std::mutex> guard(latch_);
+  Enqueue(guard, IORING_OP_READ, offset, data, size,
+          new Request{callback, {}});
+}
+
+void AsyncIO::Write(off_t offset, const char *data, size_t size,
+                    IOCallback callback) {
+  if (!IsRingEnabled()) {
+    ssize_t rc;
+    do {
+      rc = pwrite(fd_, data, size, offset);
+    } while (rc < 0 && errno == EINTR);
+    callback(rc < 0 ? -errno : rc);
+    return;
+  }
+  std::unique_lock<std::mutex> guard(latch_);
+  Enqueue(guard, IORING_OP_WRITE, offset, data, size,
+          new Request{callback, {}});
+}
+
+void AsyncIO::Writev(off_t offset, const struct iovec *iov, int iov_count,
+                     IOCallback callback) {
+  if (!IsRingEnabled()) {
+    ssize_t rc;
+    do {
+      rc = pwritev(fd_, iov, iov_count, offset);
+    } while (rc < 0 && errno == EINTR);
+    callback(rc < 0 ? -errno : rc);
+    return;
+  }
+  Request *request =
+      new Request{callback, std::vector<struct iovec>(iov, iov + iov_count)};
+  std::unique_lock<std::mutex> guard(latch_);
+  Enqueue(guard, IORING_OP_WRITEV, offset, request->iov_.data(), iov_count,
+          request);
+}
+
+void AsyncIO::Submit() {
+  if (!IsRingEnabled())
+    return;
+  std::lock_guard<std::mutex> guard(latch_);
+  SubmitLocked();
+}
+
+/*
+ * Map both rings and the submission entries, see io_uring_setup(2)
+ */
+bool AsyncIO::SetupRing(unsigned queue_depth) {
+#ifdef __NR_io_uring_setup
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = IOUringSetup(queue_depth, &params);
+  if (ring_fd_ < 0)
+    return false;
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap)
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    return false;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      return false;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED) {
+    sqes_ = nullptr;
+    return false;
+  }
+
+  char *sq = static_cast<char *>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  sq_entries_ = params.sq_entries;
+  char *cq = static_cast<char *>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = cq + params.cq_off.cqes;
+  cq_entries_ = params.cq_entries;
+  return true;
+#else
+  (void)queue_depth;
+  return false;
+#endif
+}
+
+void AsyncIO::TeardownRing() {
+  if (sqes_ != nullptr)
+    munmap(sqes_, sqes_size_);
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_ != nullptr)
+    munmap(sq_ring_, sq_ring_size_);
+  if (ring_fd_ >= 0)
+    close(ring_fd_);
+  sqes_ = sq_ring_ = cq_ring_ = nullptr;
+  ring_fd_ = -1;
+}
+
+/*
+ * Put one entry into submission ring, submit early if the ring is full.
+ * guard holds latch_.
+ */
+void AsyncIO::Enqueue(std::unique_lock<std::mutex> &guard, uint8_t opcode,
+                      off_t offset, const void *addr, unsigned len,
+                      Request *request) {
+  // keep completion ring from overflowing, the nop at shutdown is exempt
+  if (request != nullptr) {
+    while (inflight_ >= cq_entries_) {
+      SubmitLocked();
+      completed_cv_.wait(guard);
+    }
+    ++inflight_;
+  }
+  unsigned tail = *sq_tail_;
+  if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+    SubmitLocked();
+    tail = *sq_tail_;
+  }
+  unsigned index = tail & *sq_mask_;
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(sqes_) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd_;
+  sqe->off = offset;
+  sqe->addr = reinterpret_cast<uint64_t>(addr);
+  sqe->len = len;
+  sqe->user_data = reinterpret_cast<uint64_t>(request);
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  ++pending_;
+}
+
+void AsyncIO::SubmitLocked() {
+#ifdef __NR_io_uring_setup
+  while (pending_ > 0) {
+    int rc = IOUringEnter(ring_fd_, pending_, 0, 0);
+    if (rc < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+        continue;
+      LOG_DEBUG("io_uring_enter failed");
+      return;
+    }
+    pending_ -= rc;
+  }
+#endif
+}
+
+/*
+ * Reap completion ring until shutdown, run callbacks outside of latch_
+ */
+void AsyncIO::Complete() {
+#ifdef __NR_io_uring_setup
+  while (true) {
+    int rc = IOUringEnter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+    if (rc < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      LOG_DEBUG("io_uring_enter failed");
+      return;
+    }
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    unsigned completed = 0;
+    bool stop = false;
+    for (; head != tail; ++head) {
+      struct io_uring_cqe *cqe =
+          static_cast<struct io_uring_cqe *>(cqes_) + (head & *cq_mask_);
+      Request *request = reinterpret_cast<Request *>(cqe->user_data);
+      if (request == nullptr) {
+        stop = true;
+        continue;
+      }
+      request->callback_(cqe->res);
+      delete request;
+      ++completed;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    if (completed > 0) {
+      std::lock_guard<std::mutex> guard(latch_);
+      inflight_ -= completed;
+      completed_cv_.notify_all();
+    }
+    if (stop)
+      return;
+  }
+#endif
+}
+
+} // namespace cmudb
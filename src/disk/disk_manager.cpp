@@ -1,96 +1,1179 @@
 /**
  * disk_manager.cpp
  */
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
+#include "common/crc32c.h"
+#include "common/exception.h"
+#include "common/latency_stats.h"
 #include "common/logger.h"
+#include "common/probes.h"
 #include "disk/disk_manager.h"
 
 namespace cmudb {
 
 /**
- * Constructor: open/create a single database file
+ * Constructor: open/create the database file and its tablespaces
  * @input db_file: database file name
+ * @input direct_io: bypass OS page cache, falls back to buffered I/O if the
+ * file system refuses O_DIRECT
  */
-DiskManager::DiskManager(const std::string &db_file)
-    : file_name_(db_file), next_page_id_(0) {
-  db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
-  // directory or file does not exist
-  if (!db_io_.is_open()) {
-    db_io_.clear();
-    // create a new file
-    db_io_.open(db_file, std::ios::binary | std::ios::trunc | std::ios::out);
-    db_io_.close();
-    // reopen with original mode
-    db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
+DiskManager::DiskManager(const std::string &db_file, bool direct_io)
+    : direct_io_(direct_io), page_cache_(nullptr), mapped_(false),
+      file_name_(db_file), log_fd_(-1), log_offset_(0) {
+  for (auto &space : tablespaces_)
+    space.store(nullptr);
+  std::string::size_type n = file_name_.rfind('.');
+  std::string base =
+      n == std::string::npos ? file_name_ : file_name_.substr(0, n);
+  log_name_ = base + ".log";
+  master_name_ = base + ".ckpt";
+  spaces_name_ = base + ".spaces";
+
+  tablespaces_[0] = OpenTablespace(db_file);
+  if (GetFileSize(*tablespaces_[0].load()) <= 0) {
+    // left over from an older database file of the same name
+    remove(spaces_name_.c_str());
+    return;
+  }
+  std::ifstream list(spaces_name_);
+  std::vector<std::string> files;
+  for (std::string file; std::getline(list, file);)
+    files.push_back(file);
+  try {
+    for (size_t i = 0; i < files.size() && i + 1 < MAX_TABLESPACES; i++)
+      if (!files[i].empty())
+        tablespaces_[i + 1] = OpenTablespace(files[i]);
+  } catch (Exception &) {
+    for (auto &space : tablespaces_)
+      if (space.load() != nullptr) {
+        CloseSideFile(space.load()->checksums_);
+        CloseSideFile(space.load()->changed_pages_);
+        delete space.load()->async_io_;
+        close(space.load()->fd_);
+        delete space.load();
+      }
+    throw;
+  }
+}
+
+/*
+ * A clean shutdown records the exact page counters, nothing leaks
+ */
+DiskManager::~DiskManager() {
+  {
+    std::lock_guard<std::mutex> guard(extents_latch_);
+    for (PageExtent *extent : extents_) {
+      if (extent->remaining_ > 0)
+        ReturnExtent(extent->next_page_id_, extent->remaining_);
+      extent->remaining_ = 0;
+      extent->disk_manager_ = nullptr;
+    }
+    extents_.clear();
+  }
+  for (auto &space : tablespaces_)
+    if (space.load() != nullptr)
+      CloseTablespace(space.load());
+  delete page_cache_;
+  if (log_fd_ >= 0)
+    close(log_fd_);
+}
+
+/*
+ * A tablespace that fails to open has no file descriptor, its pages can not
+ * be read or written. A file of another page size throws
+ */
+DiskManager::Tablespace *
+DiskManager::OpenTablespace(const std::string &file_name) {
+  std::unique_ptr<Tablespace> space(new Tablespace);
+  space->file_name_ = file_name;
+  int flags = O_RDWR | O_CREAT;
+#ifdef O_DIRECT
+  if (direct_io_)
+    space->fd_ = open(file_name.c_str(), flags | O_DIRECT, 0644);
+#endif
+  if (space->fd_ < 0) {
+    if (direct_io_) {
+      LOG_DEBUG("O_DIRECT not supported, use buffered I/O");
+    }
+    direct_io_ = false;
+    space->fd_ = open(file_name.c_str(), flags, 0644);
+  }
+  if (space->fd_ < 0)
+    throw Exception(EXCEPTION_TYPE_INVALID, "can not open " + file_name);
+  space->async_io_ = new AsyncIO(space->fd_);
+
+  space->superblock_name_ = GetSuperblockName(file_name);
+  bool has_superblock;
+  try {
+    has_superblock = ReadSuperblock(*space);
+  } catch (Exception &) {
+    delete space->async_io_;
+    close(space->fd_);
+    throw;
+  }
+  if (!has_superblock) {
+    // written before there was a superblock
+    space->next_page_id_ = GetFileSize(*space) / PAGE_SIZE;
+  }
+
+  // a new file has checksums, an older one keeps what it had
+  space->checksums_.name_ = GetSiblingName(file_name, ".sum");
+  space->changed_pages_.name_ = GetSiblingName(file_name, ".chg");
+  off_t file_size = GetFileSize(*space);
+  if (file_size <= 0) {
+    remove(space->checksums_.name_.c_str());
+    remove(space->changed_pages_.name_.c_str());
+  }
+  OpenSideFile(space->checksums_, SIDE_FILE_PAGES * sizeof(uint64_t),
+               file_size <= 0);
+  // without a bitmap nothing is known about what changed
+  bool has_changed_pages =
+      access(space->changed_pages_.name_.c_str(), F_OK) == 0;
+  if (OpenSideFile(space->changed_pages_, SIDE_FILE_PAGES / 8, true) &&
+      !has_changed_pages)
+    for (page_id_t page_number = 0; page_number < file_size / PAGE_SIZE;
+         page_number++)
+      MarkChanged(*space, page_number);
+  return space.release();
+}
+
+std::string DiskManager::GetSuperblockName(const std::string &file_name) {
+  return GetSiblingName(file_name, ".meta");
+}
+
+std::string DiskManager::GetSiblingName(const std::string &file_name,
+                                        const std::string &extension) {
+  std::string::size_type n = file_name.rfind('.');
+  return (n == std::string::npos ? file_name : file_name.substr(0, n)) +
+         extension;
+}
+
+void DiskManager::CloseTablespace(Tablespace *space) {
+  if (space->mapping_ != nullptr)
+    munmap(space->mapping_, space->mapped_pages_ * PAGE_SIZE);
+  if (!mapped_) {
+    std::lock_guard<std::mutex> guard(space->superblock_latch_);
+    if (space->next_page_id_ > 0 || !space->free_pages_.empty() ||
+        !space->spare_pages_.empty()) {
+      space->free_pages_.insert(space->free_pages_.end(),
+                                space->spare_pages_.begin(),
+                                space->spare_pages_.end());
+      space->spare_pages_.clear();
+      space->page_id_limit_ = space->next_page_id_;
+      WriteSuperblock(*space);
+    }
   }
+  // completes outstanding requests
+  delete space->async_io_;
+  CloseSideFile(space->checksums_);
+  CloseSideFile(space->changed_pages_);
+  close(space->fd_);
+  delete space;
 }
 
-DiskManager::~DiskManager() { db_io_.close(); }
+/*
+ * The list is written before the tablespace is used, a page id of it can
+ * not be on disk without it
+ */
+int DiskManager::AddTablespace(const std::string &file_name) {
+  std::lock_guard<std::mutex> guard(tablespaces_latch_);
+  int free_id = -1;
+  for (int i = 0; i < MAX_TABLESPACES; i++) {
+    Tablespace *space = tablespaces_[i].load();
+    if (space == nullptr) {
+      if (free_id < 0)
+        free_id = i;
+    } else if (space->file_name_ == file_name) {
+      return i;
+    }
+  }
+  if (mapped_)
+    throw Exception(EXCEPTION_TYPE_INVALID,
+                    "can not add a tablespace to a mapped database");
+  if (free_id < 0)
+    throw Exception(EXCEPTION_TYPE_OUT_OF_RANGE,
+                    "a database has at most " +
+                        std::to_string(MAX_TABLESPACES) + " tablespaces");
+  for (int i = 0; i < MAX_TABLESPACES; i++) {
+    Tablespace *other = tablespaces_[i].load();
+    if (other != nullptr &&
+        other->superblock_name_ == GetSuperblockName(file_name))
+      throw Exception(EXCEPTION_TYPE_INVALID,
+                      file_name + " shares its superblock with " +
+                          other->file_name_);
+  }
+  Tablespace *space = OpenTablespace(file_name);
+  tablespaces_[free_id] = space;
+  if (!WriteTablespaceList()) {
+    tablespaces_[free_id] = nullptr;
+    CloseTablespace(space);
+    throw Exception(EXCEPTION_TYPE_INVALID, "can not record " + file_name);
+  }
+  return free_id;
+}
+
+std::string DiskManager::GetTablespaceFile(int tablespace_id) {
+  if (tablespace_id < 0 || tablespace_id >= MAX_TABLESPACES)
+    return "";
+  Tablespace *space = tablespaces_[tablespace_id].load();
+  return space == nullptr ? "" : space->file_name_;
+}
+
+bool DiskManager::SetChecksums(int tablespace_id, bool enabled) {
+  if (tablespace_id < 0 || tablespace_id >= MAX_TABLESPACES)
+    return false;
+  std::lock_guard<std::mutex> guard(tablespaces_latch_);
+  Tablespace *space = tablespaces_[tablespace_id].load();
+  if (space == nullptr)
+    return false;
+  if (enabled)
+    return space->checksums_.words_ != nullptr ||
+           OpenSideFile(space->checksums_, SIDE_FILE_PAGES * sizeof(uint64_t),
+                        true);
+  CloseSideFile(space->checksums_);
+  remove(space->checksums_.name_.c_str());
+  return true;
+}
+
+bool DiskManager::HasChecksums(int tablespace_id) {
+  if (tablespace_id < 0 || tablespace_id >= MAX_TABLESPACES)
+    return false;
+  Tablespace *space = tablespaces_[tablespace_id].load();
+  return space != nullptr && space->checksums_.words_ != nullptr;
+}
+
+/*
+ * The mapping covers every page the tablespace can have, up to
+ * SIDE_FILE_PAGES, the file only the pages written so far: address space is
+ * cheap, a sparse file of that size would not be
+ */
+bool DiskManager::OpenSideFile(SideFile &file, size_t capacity, bool create) {
+  int flags = O_RDWR | (create ? O_CREAT : 0);
+  int fd = open(file.name_.c_str(), flags, 0644);
+  if (fd < 0)
+    return false;
+  struct stat stat_buf;
+  void *mapping = MAP_FAILED;
+  if (fstat(fd, &stat_buf) == 0)
+    mapping =
+        mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    LOG_DEBUG("can not map %s", file.name_.c_str());
+    close(fd);
+    return false;
+  }
+  file.fd_ = fd;
+  file.capacity_ = capacity;
+  file.size_ = stat_buf.st_size;
+  file.words_ = static_cast<std::atomic<uint64_t> *>(mapping);
+  return true;
+}
+
+void DiskManager::CloseSideFile(SideFile &file) {
+  if (file.words_ == nullptr)
+    return;
+  munmap(file.words_, file.capacity_);
+  close(file.fd_);
+  file.words_ = nullptr;
+  file.fd_ = -1;
+  file.size_ = 0;
+}
+
+bool DiskManager::GrowSideFile(SideFile &file, size_t end) {
+  if (end <= file.size_)
+    return true;
+  std::lock_guard<std::mutex> guard(file.latch_);
+  if (end <= file.size_)
+    return true;
+  size_t size = (end + SIDE_FILE_STEP - 1) / SIDE_FILE_STEP * SIDE_FILE_STEP;
+  if (ftruncate(file.fd_, size) != 0) {
+    LOG_DEBUG("I/O error while growing %s", file.name_.c_str());
+    return false;
+  }
+  file.size_ = size;
+  return true;
+}
+
+/*
+ * The latest checksum moves to the high half. Rewriting an unchanged page
+ * keeps both, a write that is lost then still leaves a page that matches
+ */
+void DiskManager::UpdateChecksum(Tablespace &space, page_id_t page_id,
+                                 const char *page_data) {
+  SideFile &checksums = space.checksums_;
+  size_t page_number = GetPageNumber(page_id);
+  if (checksums.words_ == nullptr || page_number >= SIDE_FILE_PAGES ||
+      !GrowSideFile(checksums, (page_number + 1) * sizeof(uint64_t)))
+    return;
+  uint32_t checksum = Crc32c(page_data, PAGE_SIZE);
+  std::atomic<uint64_t> &entry = checksums.words_[page_number];
+  uint64_t old_entry = entry.load(std::memory_order_relaxed);
+  uint32_t latest = static_cast<uint32_t>(old_entry);
+  if (latest != checksum)
+    entry.store(static_cast<uint64_t>(latest) << 32 | checksum,
+                std::memory_order_relaxed);
+}
+
+bool DiskManager::VerifyChecksum(Tablespace &space, page_id_t page_id,
+                                 const char *page_data) {
+  SideFile &checksums = space.checksums_;
+  size_t page_number = GetPageNumber(page_id);
+  if (checksums.words_ == nullptr ||
+      (page_number + 1) * sizeof(uint64_t) > checksums.size_)
+    return true;
+  uint64_t entry =
+      checksums.words_[page_number].load(std::memory_order_relaxed);
+  uint32_t latest = static_cast<uint32_t>(entry);
+  uint32_t previous = static_cast<uint32_t>(entry >> 32);
+  if (latest == 0)
+    return true;
+  uint32_t checksum = Crc32c(page_data, PAGE_SIZE);
+  return checksum == latest || (previous != 0 && checksum == previous);
+}
+
+void DiskManager::MarkChanged(Tablespace &space, page_id_t page_id) {
+  SideFile &changed_pages = space.changed_pages_;
+  size_t page_number = GetPageNumber(page_id);
+  if (changed_pages.words_ == nullptr || page_number >= SIDE_FILE_PAGES ||
+      !GrowSideFile(changed_pages, (page_number / 64 + 1) * sizeof(uint64_t)))
+    return;
+  changed_pages.words_[page_number / 64].fetch_or(1ULL << (page_number % 64),
+                                                  std::memory_order_relaxed);
+}
+
+/*
+ * Under log_latch_, no hole is being punched once a hold returns. The start
+ * is read with the latch held, a checkpoint can not move it in between
+ */
+off_t DiskManager::HoldLog(off_t offset) {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  if (offset < 0)
+    offset = ReadLogStart();
+  log_holds_.insert(offset);
+  return offset;
+}
+
+void DiskManager::ReleaseLog(off_t offset) {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  auto it = log_holds_.find(offset);
+  if (it != log_holds_.end())
+    log_holds_.erase(it);
+}
+
+/*
+ * A bit is cleared before its page is read: a write landing after the read
+ * sets it again. Writes set their bit when queued, for a crash, and again
+ * when done, for a write queued before the bit was cleared that lands after
+ * the read. A page that fails its checksum may have been read while it was
+ * written, it is read again a few times before the copy is given up on.
+ * Pages past SIDE_FILE_PAGES have no bit, they are always taken
+ */
+bool DiskManager::TakeChangedPages(int tablespace_id, bool all,
+                                   const PageCopyFunc &copy, size_t &count) {
+  count = 0;
+  if (tablespace_id < 0 || tablespace_id >= MAX_TABLESPACES)
+    return false;
+  Tablespace *space = tablespaces_[tablespace_id].load();
+  if (space == nullptr || space->changed_pages_.words_ == nullptr)
+    return false;
+  SideFile &changed_pages = space->changed_pages_;
+  size_t file_pages = std::max<off_t>(GetFileSize(*space), 0) / PAGE_SIZE;
+  size_t words = (std::min<size_t>(file_pages, SIDE_FILE_PAGES) + 63) / 64;
+  if (!all)
+    words = std::min(words, changed_pages.size_ / sizeof(uint64_t));
+  else if (!GrowSideFile(changed_pages, words * sizeof(uint64_t)))
+    return false;
+
+  void *memory = nullptr;
+  if (posix_memalign(&memory, PAGE_SIZE, PAGE_SIZE) != 0)
+    return false;
+  std::unique_ptr<char, decltype(&free)> buffer(static_cast<char *>(memory),
+                                                &free);
+  auto take = [&](size_t page_number) {
+    page_id_t page_id = MakePageId(tablespace_id, page_number);
+    off_t offset = static_cast<off_t>(page_number) * PAGE_SIZE;
+    bool valid = false;
+    for (int attempt = 0; attempt < BACKUP_READ_ATTEMPTS && !valid;
+         attempt++) {
+      if (attempt > 0)
+        std::this_thread::yield();
+      valid = pread(space->fd_, buffer.get(), PAGE_SIZE, offset) ==
+                  PAGE_SIZE &&
+              VerifyChecksum(*space, page_id, buffer.get());
+    }
+    if (!valid) {
+      LOG_WARN("page %lld fails its checksum",
+               static_cast<long long>(page_id));
+      ++checksum_failures_;
+      return false;
+    }
+    return copy(page_id, buffer.get());
+  };
+  for (size_t word = 0; word < words; word++) {
+    uint64_t bits = all ? ~0ULL
+                        : changed_pages.words_[word].load(
+                              std::memory_order_relaxed);
+    if (bits == 0)
+      continue;
+    changed_pages.words_[word].fetch_and(~bits, std::memory_order_relaxed);
+    for (; bits != 0; bits &= bits - 1) {
+      size_t page_number = word * 64 + __builtin_ctzll(bits);
+      if (page_number >= file_pages)
+        continue;
+      if (!take(page_number)) {
+        // the pages not passed yet stay changed
+        changed_pages.words_[word].fetch_or(bits, std::memory_order_relaxed);
+        for (size_t rest = word + 1; all && rest < words; rest++)
+          changed_pages.words_[rest].fetch_or(~0ULL,
+                                              std::memory_order_relaxed);
+        return false;
+      }
+      count++;
+    }
+  }
+  for (size_t page_number = SIDE_FILE_PAGES; page_number < file_pages;
+       page_number++) {
+    if (!take(page_number))
+      return false;
+    count++;
+  }
+  return true;
+}
+
+/*
+ * One file name per line, line i for tablespace i. Written next to the old
+ * list and renamed over it, like the superblock
+ */
+bool DiskManager::WriteTablespaceList() {
+  int last = 0;
+  for (int i = 1; i < MAX_TABLESPACES; i++)
+    if (tablespaces_[i].load() != nullptr)
+      last = i;
+  std::string list;
+  for (int i = 1; i <= last; i++) {
+    Tablespace *space = tablespaces_[i].load();
+    list += (space == nullptr ? "" : space->file_name_) + "\n";
+  }
+  std::string temp_name = spaces_name_ + ".tmp";
+  int list_fd = open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (list_fd < 0)
+    return false;
+  bool written = pwrite(list_fd, list.data(), list.size(), 0) ==
+                     static_cast<ssize_t>(list.size()) &&
+                 fdatasync(list_fd) == 0;
+  close(list_fd);
+  if (!written || rename(temp_name.c_str(), spaces_name_.c_str()) != 0) {
+    LOG_DEBUG("I/O error while writing tablespace list");
+    remove(temp_name.c_str());
+    return false;
+  }
+  return true;
+}
 
 /**
  * Write the contents of the specified page into disk file
  */
 void DiskManager::WritePage(page_id_t page_id, const char *page_data) {
-  size_t offset = page_id * PAGE_SIZE;
-  // set write cursor to offset
-  db_io_.seekp(offset);
-  db_io_.write(page_data, PAGE_SIZE);
-  // check for I/O error
-  if (db_io_.bad()) {
+  LATENCY_TIMER(LatencyType::DISK_WRITE);
+  std::promise<bool> done;
+  WritePageAsync(page_id, page_data,
+                 [&done](bool success) { done.set_value(success); });
+  SubmitIO();
+  done.get_future().wait();
+}
+
+/**
+ * Read the contents of the specified page into the given memory area
+ */
+bool DiskManager::ReadPage(page_id_t page_id, char *page_data, bool *corrupt) {
+  LATENCY_TIMER(LatencyType::DISK_READ);
+  std::promise<bool> done;
+  ReadPageAsync(
+      page_id, page_data, [&done](bool success) { done.set_value(success); },
+      corrupt);
+  SubmitIO();
+  return done.get_future().get();
+}
+
+void DiskManager::WritePageAsync(page_id_t page_id, const char *page_data,
+                                 DiskCallback callback) {
+  Tablespace *space = GetTablespace(page_id);
+  if (space == nullptr) {
     LOG_DEBUG("I/O error while writing");
+    callback(false);
     return;
   }
-  // needs to flush to keep disk file in sync
-  db_io_.flush();
+  off_t offset = static_cast<off_t>(GetPageNumber(page_id)) * PAGE_SIZE;
+  UpdateChecksum(*space, page_id, page_data);
+  // marked again once written, a backup may have read the page in between
+  MarkChanged(*space, page_id);
+  callback = [space, page_id, callback](bool success) {
+    MarkChanged(*space, page_id);
+    callback(success);
+  };
+  if (page_cache_ != nullptr)
+    page_cache_->Put(page_id, page_data);
+  char *bounce_buffer = AllocateBounceBuffer(page_data);
+  if (bounce_buffer != nullptr) {
+    memcpy(bounce_buffer, page_data, PAGE_SIZE);
+    page_data = bounce_buffer;
+  }
+  CMUDB_PROBE2(disk_write_start, page_id, 1);
+  space->async_io_->Write(offset, page_data, PAGE_SIZE,
+                          [page_id, bounce_buffer, callback](ssize_t result) {
+                            CMUDB_PROBE2(disk_write_done, page_id, result);
+                            free(bounce_buffer);
+                            // check for I/O error
+                            if (result != PAGE_SIZE) {
+                              LOG_DEBUG("I/O error while writing");
+                            }
+                            callback(result == PAGE_SIZE);
+                          });
 }
 
-/**
- * Read the contents of the specified page into the given memory area
+/*
+ * Gather write of consecutive pages, in direct mode the pages are copied
+ * into one aligned buffer instead. Pages running into the next tablespace
+ * are written by a second request, the callback runs once both are done
  */
-void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
-  int offset = page_id * PAGE_SIZE;
+void DiskManager::WritePagesAsync(page_id_t first_page_id,
+                                  const char *const *pages_data, size_t count,
+                                  DiskCallback callback) {
+  size_t room = TABLESPACE_PAGES - GetPageNumber(first_page_id);
+  if (count > room) {
+    struct Split {
+      std::mutex latch_;
+      int remaining_ = 2;
+      bool success_ = true;
+    };
+    auto split = std::make_shared<Split>();
+    DiskCallback done = [split, callback](bool success) {
+      std::unique_lock<std::mutex> guard(split->latch_);
+      split->success_ = split->success_ && success;
+      if (--split->remaining_ > 0)
+        return;
+      guard.unlock();
+      callback(split->success_);
+    };
+    WritePagesAsync(first_page_id, pages_data, room, done);
+    WritePagesAsync(first_page_id + room, pages_data + room, count - room,
+                    done);
+    return;
+  }
+  Tablespace *space = GetTablespace(first_page_id);
+  if (space == nullptr) {
+    LOG_DEBUG("I/O error while writing");
+    callback(false);
+    return;
+  }
+  off_t offset = static_cast<off_t>(GetPageNumber(first_page_id)) * PAGE_SIZE;
+  ssize_t size = count * PAGE_SIZE;
+  for (size_t i = 0; i < count; ++i) {
+    UpdateChecksum(*space, first_page_id + i, pages_data[i]);
+    MarkChanged(*space, first_page_id + i);
+  }
+  callback = [space, first_page_id, count, callback](bool success) {
+    for (size_t i = 0; i < count; ++i)
+      MarkChanged(*space, first_page_id + i);
+    callback(success);
+  };
+  if (page_cache_ != nullptr)
+    for (size_t i = 0; i < count; ++i)
+      page_cache_->Put(first_page_id + i, pages_data[i]);
+  CMUDB_PROBE2(disk_write_start, first_page_id, count);
+  if (direct_io_) {
+    void *memory = nullptr;
+    int rc = posix_memalign(&memory, PAGE_SIZE, size);
+    assert(rc == 0);
+    (void)rc;
+    char *buffer = static_cast<char *>(memory);
+    for (size_t i = 0; i < count; ++i)
+      memcpy(buffer + i * PAGE_SIZE, pages_data[i], PAGE_SIZE);
+    space->async_io_->Write(offset, buffer, size,
+                            [first_page_id, buffer, size,
+                             callback](ssize_t result) {
+                              CMUDB_PROBE2(disk_write_done, first_page_id,
+                                           result);
+                              free(buffer);
+                              if (result != size) {
+                                LOG_DEBUG("I/O error while writing");
+                              }
+                              callback(result == size);
+                            });
+    return;
+  }
+  std::vector<struct iovec> iov(count);
+  for (size_t i = 0; i < count; ++i) {
+    iov[i].iov_base = const_cast<char *>(pages_data[i]);
+    iov[i].iov_len = PAGE_SIZE;
+  }
+  space->async_io_->Writev(offset, iov.data(), count,
+                           [first_page_id, size, callback](ssize_t result) {
+                             CMUDB_PROBE2(disk_write_done, first_page_id,
+                                          result);
+                             if (result != size) {
+                               LOG_DEBUG("I/O error while writing");
+                             }
+                             callback(result == size);
+                           });
+}
+
+void DiskManager::ReadPageAsync(page_id_t page_id, char *page_data,
+                                DiskCallback callback, bool *corrupt) {
+  if (corrupt != nullptr)
+    *corrupt = false;
+  // a cached page is decoded right away, no request is queued
+  if (page_cache_ != nullptr && page_cache_->Get(page_id, page_data)) {
+    callback(true);
+    return;
+  }
+  Tablespace *space = GetTablespace(page_id);
+  off_t offset = static_cast<off_t>(GetPageNumber(page_id)) * PAGE_SIZE;
   // check if read beyond file length
-  if (offset >= GetFileSize()) {
+  if (space == nullptr || offset >= GetFileSize(*space)) {
     LOG_DEBUG("I/O error while reading");
-    // std::cerr << "I/O error while reading" << std::endl;
-  } else {
-    // set read cursor to offset
-    db_io_.seekp(offset);
-    db_io_.read(page_data, PAGE_SIZE);
-    // if file ends before reading PAGE_SIZE
-    int read_count = db_io_.gcount();
-    if (read_count < PAGE_SIZE) {
-      LOG_DEBUG("Read less than a page");
-      // std::cerr << "Read less than a page" << std::endl;
-      memset(page_data + read_count, 0, PAGE_SIZE - read_count);
+    callback(false);
+    return;
+  }
+  char *bounce_buffer = AllocateBounceBuffer(page_data);
+  char *buffer = bounce_buffer != nullptr ? bounce_buffer : page_data;
+  PageCache *page_cache = page_cache_;
+  CMUDB_PROBE1(disk_read_start, page_id);
+  space->async_io_->Read(
+      offset, buffer, PAGE_SIZE,
+      [this, space, bounce_buffer, buffer, page_data, page_cache, page_id,
+       callback, corrupt](ssize_t result) {
+        CMUDB_PROBE2(disk_read_done, page_id, result);
+        if (result < 0) {
+          LOG_DEBUG("I/O error while reading");
+          free(bounce_buffer);
+          callback(false);
+          return;
+        }
+        // if file ends before reading PAGE_SIZE
+        if (result < PAGE_SIZE) {
+          LOG_DEBUG("Read less than a page");
+          memset(buffer + result, 0, PAGE_SIZE - result);
+        }
+        if (bounce_buffer != nullptr) {
+          memcpy(page_data, bounce_buffer, PAGE_SIZE);
+          free(bounce_buffer);
+        }
+        if (!VerifyChecksum(*space, page_id, page_data)) {
+          LOG_WARN("page %lld fails its checksum",
+                 static_cast<long long>(page_id));
+          ++checksum_failures_;
+          if (corrupt != nullptr)
+            *corrupt = true;
+          callback(false);
+          return;
+        }
+        // a write since the read was queued left the newer copy
+        if (page_cache != nullptr)
+          page_cache->Put(page_id, page_data, false);
+        callback(true);
+      });
+}
+
+// the devices of the tablespaces work in parallel
+void DiskManager::SubmitIO() {
+  for (auto &space : tablespaces_)
+    if (space.load() != nullptr)
+      space.load()->async_io_->Submit();
+}
+
+/**
+ * Write the contents of the log into disk file
+ * Only return when sync is done, and only perform sequence write
+ */
+void DiskManager::WriteLog(const char *log_data, int size) {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  if (size <= 0 || !OpenLog())
+    return;
+  int written = 0;
+  while (written < size) {
+    ssize_t rc = pwrite(log_fd_, log_data + written, size - written,
+                        log_offset_ + written);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0) {
+      LOG_DEBUG("I/O error while writing log");
+      return;
     }
+    written += rc;
+  }
+  log_offset_ += written;
+  // needs to flush to keep disk file in sync
+  fdatasync(log_fd_);
+}
+
+/**
+ * Read the contents of the log into the given memory area
+ */
+size_t DiskManager::ReadLog(char *log_data, size_t size, off_t offset) {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  if (!OpenLog())
+    return 0;
+  size_t read_count = 0;
+  while (read_count < size) {
+    ssize_t rc = pread(log_fd_, log_data + read_count, size - read_count,
+                       offset + read_count);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0)
+      break;
+    read_count += rc;
   }
+  return read_count;
+}
+
+off_t DiskManager::GetLogFileSize() {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  if (!OpenLog())
+    return 0;
+  return log_offset_;
+}
+
+void DiskManager::TruncateLog(off_t size) {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  if (!OpenLog() || size >= log_offset_)
+    return;
+  if (ftruncate(log_fd_, size) != 0) {
+    LOG_DEBUG("I/O error while truncating log");
+    return;
+  }
+  log_offset_ = size;
+}
+
+/**
+ * Write the new start into the master record, then give the space before it
+ * back to the file system. Hole punching is only an optimization, the master
+ * record alone tells recovery where to begin.
+ */
+void DiskManager::SetLogStart(off_t offset) {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  if (!OpenLog() || offset <= 0 || offset > log_offset_)
+    return;
+  int master_fd = open(master_name_.c_str(), O_WRONLY | O_CREAT, 0644);
+  if (master_fd < 0) {
+    LOG_DEBUG("can not open master record");
+    return;
+  }
+  int64_t record = offset;
+  bool written =
+      pwrite(master_fd, &record, sizeof(record), 0) == sizeof(record) &&
+      fdatasync(master_fd) == 0;
+  close(master_fd);
+  if (!written) {
+    LOG_DEBUG("I/O error while writing master record");
+    return;
+  }
+#ifdef FALLOC_FL_PUNCH_HOLE
+  off_t end =
+      log_holds_.empty() ? offset : std::min(offset, *log_holds_.begin());
+  if (end > 0)
+    fallocate(log_fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, end);
+#endif
+}
+
+/**
+ * A start beyond the end of the log belongs to an older log file. Master
+ * records of 4 bytes were written before offsets had 64 bits
+ */
+off_t DiskManager::GetLogStart() {
+  std::lock_guard<std::mutex> guard(log_latch_);
+  return ReadLogStart();
+}
+
+off_t DiskManager::ReadLogStart() {
+  int master_fd = open(master_name_.c_str(), O_RDONLY);
+  if (master_fd < 0)
+    return 0;
+  char record[sizeof(int64_t)];
+  ssize_t rc = pread(master_fd, record, sizeof(record), 0);
+  close(master_fd);
+  off_t offset = 0;
+  if (rc == sizeof(int64_t)) {
+    int64_t start;
+    memcpy(&start, record, sizeof(start));
+    offset = start;
+  } else if (rc == sizeof(int32_t)) {
+    int32_t start;
+    memcpy(&start, record, sizeof(start));
+    offset = start;
+  }
+  if (!OpenLog() || offset < 0 || offset > log_offset_)
+    return 0;
+  return offset;
+}
+
+/**
+ * Caller must hold log_latch_
+ */
+bool DiskManager::OpenLog() {
+  if (log_fd_ >= 0)
+    return true;
+  log_fd_ = open(log_name_.c_str(), O_RDWR | O_CREAT, 0644);
+  if (log_fd_ < 0) {
+    LOG_DEBUG("can not open log file");
+    return false;
+  }
+  struct stat stat_buf;
+  log_offset_ = fstat(log_fd_, &stat_buf) == 0 ? stat_buf.st_size : 0;
+  return true;
 }
 
 /**
  * Allocate new page (operations like create index/table)
- * For now just keep an increasing counter
+ * Freed pages come first, then an increasing counter. The superblock is
+ * written once every PAGE_ID_EXTENT new page ids
+ */
+page_id_t DiskManager::AllocatePage(int tablespace_id) {
+  if (tablespace_id < 0 || tablespace_id >= MAX_TABLESPACES)
+    return INVALID_PAGE_ID;
+  Tablespace *space = tablespaces_[tablespace_id].load();
+  if (space == nullptr)
+    return INVALID_PAGE_ID;
+  page_id_t page_number = INVALID_PAGE_ID;
+  {
+    std::lock_guard<std::mutex> guard(space->superblock_latch_);
+    std::vector<page_id_t> &free_pages = space->free_pages_;
+    std::vector<page_id_t> &spare_pages = space->spare_pages_;
+    if (spare_pages.empty() && !free_pages.empty()) {
+      // off the file before any of them is handed out
+      size_t count = std::min<size_t>(FREE_PAGE_BATCH, free_pages.size());
+      spare_pages.assign(free_pages.end() - count, free_pages.end());
+      free_pages.resize(free_pages.size() - count);
+      if (!WriteSuperblock(*space)) {
+        free_pages.insert(free_pages.end(), spare_pages.begin(),
+                          spare_pages.end());
+        spare_pages.clear();
+      }
+    }
+    if (!spare_pages.empty()) {
+      page_number = spare_pages.back();
+      spare_pages.pop_back();
+    }
+    if (page_number == INVALID_PAGE_ID) {
+      if (space->next_page_id_ >= TABLESPACE_PAGES) {
+        LOG_DEBUG("tablespace %s is full", space->file_name_.c_str());
+        return INVALID_PAGE_ID;
+      }
+      page_number = space->next_page_id_++;
+      if (page_number >= space->page_id_limit_) {
+        space->page_id_limit_ = page_number + PAGE_ID_EXTENT;
+        WriteSuperblock(*space);
+      }
+      return MakePageId(tablespace_id, page_number);
+    }
+  }
+  // recovery must not take the old contents for a logged page
+  page_id_t page_id = MakePageId(tablespace_id, page_number);
+  std::vector<char> zeros(PAGE_SIZE, 0);
+  WritePage(page_id, zeros.data());
+  return page_id;
+}
+
+/*
+ * Pages past the end of the file need not be zeroed, they read as never
+ * written. The superblock is written once the counter passes its limit
+ */
+page_id_t DiskManager::AllocateExtent(int tablespace_id, int &count) {
+  if (tablespace_id < 0 || tablespace_id >= MAX_TABLESPACES)
+    return INVALID_PAGE_ID;
+  Tablespace *space = tablespaces_[tablespace_id].load();
+  if (space == nullptr)
+    return INVALID_PAGE_ID;
+  {
+    std::lock_guard<std::mutex> guard(space->superblock_latch_);
+    if (space->spare_pages_.empty() && space->free_pages_.empty()) {
+      if (space->next_page_id_ >= TABLESPACE_PAGES) {
+        LOG_DEBUG("tablespace %s is full", space->file_name_.c_str());
+        return INVALID_PAGE_ID;
+      }
+      count = static_cast<int>(std::min<page_id_t>(
+          count, TABLESPACE_PAGES - space->next_page_id_));
+      page_id_t page_number = space->next_page_id_;
+      space->next_page_id_ += count;
+      if (space->next_page_id_ > space->page_id_limit_) {
+        space->page_id_limit_ = space->next_page_id_ + PAGE_ID_EXTENT;
+        WriteSuperblock(*space);
+      }
+      return MakePageId(tablespace_id, page_number);
+    }
+  }
+  count = 1;
+  return AllocatePage(tablespace_id);
+}
+
+/*
+ * The counter is wound back if nothing was allocated after the extent,
+ * otherwise its pages are freed
+ */
+void DiskManager::ReturnExtent(page_id_t first_page_id, int count) {
+  Tablespace *space = GetTablespace(first_page_id);
+  if (space == nullptr || count <= 0)
+    return;
+  {
+    std::lock_guard<std::mutex> guard(space->superblock_latch_);
+    if (GetPageNumber(first_page_id) + count == space->next_page_id_) {
+      space->next_page_id_ = GetPageNumber(first_page_id);
+      return;
+    }
+  }
+  for (int i = 0; i < count; i++)
+    DeallocatePage(first_page_id + i);
+}
+
+PageExtent::PageExtent(DiskManager *disk_manager, int tablespace_id)
+    : disk_manager_(disk_manager), tablespace_id_(tablespace_id) {
+  std::lock_guard<std::mutex> guard(disk_manager_->extents_latch_);
+  disk_manager_->extents_.insert(this);
+}
+
+PageExtent::~PageExtent() {
+  std::lock_guard<std::mutex> guard(latch_);
+  if (disk_manager_ == nullptr)
+    return;
+  std::lock_guard<std::mutex> extents_guard(disk_manager_->extents_latch_);
+  disk_manager_->extents_.erase(this);
+  disk_manager_->ReturnExtent(next_page_id_, remaining_);
+}
+
+page_id_t PageExtent::AllocatePage() {
+  std::lock_guard<std::mutex> guard(latch_);
+  if (disk_manager_ == nullptr)
+    return INVALID_PAGE_ID;
+  if (remaining_ == 0) {
+    int count = EXTENT_PAGES;
+    next_page_id_ = disk_manager_->AllocateExtent(tablespace_id_, count);
+    if (next_page_id_ == INVALID_PAGE_ID)
+      return INVALID_PAGE_ID;
+    remaining_ = count;
+  }
+  remaining_--;
+  return next_page_id_++;
+}
+
+void DiskManager::EnablePageCache(size_t bytes) {
+  assert(page_cache_ == nullptr);
+  page_cache_ = new PageCache(bytes);
+}
+
+/*
+ * Readers see the pages of the files through the page cache of the OS, a
+ * page is only copied once it is changed in memory
  */
-page_id_t DiskManager::AllocatePage() { return next_page_id_++; }
+bool DiskManager::EnableMmap() {
+  assert(!mapped_);
+  std::lock_guard<std::mutex> guard(tablespaces_latch_);
+  if (!MapTablespace(tablespaces_[0].load()))
+    return false;
+  for (int i = 1; i < MAX_TABLESPACES; i++)
+    if (tablespaces_[i].load() != nullptr)
+      MapTablespace(tablespaces_[i].load());
+  mapped_ = true;
+  return true;
+}
+
+bool DiskManager::MapTablespace(Tablespace *space) {
+  size_t pages = std::max<off_t>(GetFileSize(*space), 0) / PAGE_SIZE;
+  if (pages == 0)
+    return false;
+  void *mapping = mmap(nullptr, pages * PAGE_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE, space->fd_, 0);
+  if (mapping == MAP_FAILED) {
+    LOG_DEBUG("mmap failed: %s", strerror(errno));
+    return false;
+  }
+  space->mapping_ = static_cast<char *>(mapping);
+  space->mapped_pages_ = pages;
+  return true;
+}
+
+char *DiskManager::GetMappedPage(page_id_t page_id) const {
+  Tablespace *space = GetTablespace(page_id);
+  if (space == nullptr)
+    return nullptr;
+  size_t page_number = GetPageNumber(page_id);
+  if (page_number >= space->mapped_pages_)
+    return nullptr;
+  return space->mapping_ + page_number * PAGE_SIZE;
+}
+
+void DiskManager::ReservePageIds(page_id_t max_page_id) {
+  Tablespace *space = GetTablespace(max_page_id);
+  if (space == nullptr)
+    return;
+  std::lock_guard<std::mutex> guard(space->superblock_latch_);
+  space->next_page_id_ =
+      std::max(space->next_page_id_, GetPageNumber(max_page_id) + 1);
+}
 
 /**
  * Deallocate page (operations like drop index/table)
- * Need bitmap in header page for tracking pages
+ * The page must not be in use any more, it is handed out again by
+ * AllocatePage. Once enough pages are freed a batch goes to the superblock
  */
-void DiskManager::DeallocatePage(__attribute__((unused)) page_id_t page_id) {
-  return;
+void DiskManager::DeallocatePage(page_id_t page_id) {
+  Tablespace *space = GetTablespace(page_id);
+  if (space == nullptr)
+    return;
+  if (page_cache_ != nullptr)
+    page_cache_->Erase(page_id);
+  std::lock_guard<std::mutex> guard(space->superblock_latch_);
+  std::vector<page_id_t> &free_pages = space->free_pages_;
+  std::vector<page_id_t> &spare_pages = space->spare_pages_;
+  spare_pages.push_back(GetPageNumber(page_id));
+  if (spare_pages.size() < 2 * FREE_PAGE_BATCH)
+    return;
+  free_pages.insert(free_pages.end(), spare_pages.end() - FREE_PAGE_BATCH,
+                    spare_pages.end());
+  spare_pages.resize(spare_pages.size() - FREE_PAGE_BATCH);
+  WriteSuperblock(*space);
+}
+
+/**
+ * Superblock format (size in byte, P is sizeof(page_id_t)):
+ *  ---------------------------------------------------------------------
+ * | Magic (4) | Version (4) | PageSize (4) | PageIdLimit (P) | Count (4) |
+ *  ---------------------------------------------------------------------
+ * followed by Count free page numbers of P bytes. False without a usable
+ * superblock, a damaged one is dropped and its free pages leak. A file of
+ * another page size or page id width can not be opened at all
+ */
+bool DiskManager::ReadSuperblock(Tablespace &space) {
+  if (GetFileSize(space) <= 0) {
+    // left over from an older file of the same name
+    remove(space.superblock_name_.c_str());
+    return false;
+  }
+  int superblock_fd = open(space.superblock_name_.c_str(), O_RDONLY);
+  if (superblock_fd < 0)
+    return false;
+  char header[SUPERBLOCK_HEADER_SIZE];
+  int32_t magic, version, page_size, count;
+  page_id_t page_id_limit;
+  struct stat stat_buf;
+  bool valid =
+      pread(superblock_fd, header, sizeof(header), 0) == sizeof(header) &&
+      fstat(superblock_fd, &stat_buf) == 0;
+  if (valid) {
+    memcpy(&magic, header, 4);
+    memcpy(&version, header + 4, 4);
+    memcpy(&page_size, header + 8, 4);
+    memcpy(&page_id_limit, header + 12, sizeof(page_id_t));
+    memcpy(&count, header + 12 + sizeof(page_id_t), 4);
+    if (magic == SUPERBLOCK_MAGIC && version != SUPERBLOCK_VERSION &&
+        (version == SUPERBLOCK_NARROW_VERSION ||
+         version == SUPERBLOCK_WIDE_VERSION)) {
+      close(superblock_fd);
+      throw Exception(EXCEPTION_TYPE_MISMATCH_TYPE,
+                      space.file_name_ + " has page ids of " +
+                          (version == SUPERBLOCK_WIDE_VERSION ? "64" : "32") +
+                          " bits, see WIDE_PAGE_IDS");
+    }
+    valid = magic == SUPERBLOCK_MAGIC && version == SUPERBLOCK_VERSION &&
+            count >= 0 &&
+            stat_buf.st_size ==
+                static_cast<off_t>(sizeof(header) + count * sizeof(page_id_t));
+  }
+  if (valid && page_size != PAGE_SIZE) {
+    close(superblock_fd);
+    throw Exception(EXCEPTION_TYPE_MISMATCH_TYPE,
+                    space.file_name_ + " has pages of " +
+                        std::to_string(page_size) + " bytes, not " +
+                        std::to_string(PAGE_SIZE));
+  }
+  if (valid) {
+    space.free_pages_.resize(count);
+    ssize_t size = count * sizeof(page_id_t);
+    valid = pread(superblock_fd, space.free_pages_.data(), size,
+                  sizeof(header)) == size;
+  }
+  close(superblock_fd);
+  if (!valid) {
+    LOG_DEBUG("superblock is damaged or of another version, dropped");
+    space.free_pages_.clear();
+    return false;
+  }
+  // after a crash the ids between the counter and the limit leak
+  space.next_page_id_ = space.page_id_limit_ = page_id_limit;
+  return true;
+}
+
+/**
+ * Written next to the old file and renamed over it, a crash leaves either
+ * the old or the new superblock. Caller holds the superblock latch of space
+ */
+bool DiskManager::WriteSuperblock(Tablespace &space) {
+  std::string temp_name = space.superblock_name_ + ".tmp";
+  int superblock_fd =
+      open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (superblock_fd < 0) {
+    LOG_DEBUG("can not open superblock");
+    return false;
+  }
+  int32_t fields[3] = {SUPERBLOCK_MAGIC, SUPERBLOCK_VERSION, PAGE_SIZE};
+  int32_t count = static_cast<int32_t>(space.free_pages_.size());
+  char header[SUPERBLOCK_HEADER_SIZE];
+  memcpy(header, fields, sizeof(fields));
+  memcpy(header + 12, &space.page_id_limit_, sizeof(page_id_t));
+  memcpy(header + 12 + sizeof(page_id_t), &count, 4);
+  ssize_t size = space.free_pages_.size() * sizeof(page_id_t);
+  bool written =
+      pwrite(superblock_fd, header, sizeof(header), 0) == sizeof(header) &&
+      pwrite(superblock_fd, space.free_pages_.data(), size, sizeof(header)) ==
+          size &&
+      fdatasync(superblock_fd) == 0;
+  close(superblock_fd);
+  if (!written ||
+      rename(temp_name.c_str(), space.superblock_name_.c_str()) != 0) {
+    LOG_DEBUG("I/O error while writing superblock");
+    remove(temp_name.c_str());
+    return false;
+  }
+  return true;
 }
 
 /**
  * Private helper function to get disk file size
  */
-int DiskManager::GetFileSize() {
+off_t DiskManager::GetFileSize(const Tablespace &space) {
   struct stat stat_buf;
-  int rc = stat(file_name_.c_str(), &stat_buf);
+  int rc = fstat(space.fd_, &stat_buf);
   return rc == 0 ? stat_buf.st_size : -1;
 }
 
+/**
+ * Direct I/O needs PAGE_SIZE aligned memory, return nullptr if page_data can
+ * be used as it is
+ */
+char *DiskManager::AllocateBounceBuffer(const char *page_data) {
+  if (!direct_io_ || reinterpret_cast<uintptr_t>(page_data) % PAGE_SIZE == 0)
+    return nullptr;
+  void *memory = nullptr;
+  int rc = posix_memalign(&memory, PAGE_SIZE, PAGE_SIZE);
+  assert(rc == 0);
+  (void)rc;
+  return static_cast<char *>(memory);
+}
+
 } // namespace cmudb
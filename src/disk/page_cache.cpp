@@ -0,0 +1,89 @@
+/**
+ * page_cache.cpp
+ */
+
+#include <vector>
+
+#include "common/memory_tracker.h"
+#include "disk/page_cache.h"
+#include "disk/page_codec.h"
+
+namespace cmudb {
+
+PageCache::PageCache(size_t capacity) : capacity_(capacity) {}
+
+PageCache::~PageCache() {
+  MemoryTracker::Release(MemoryComponent::PAGE_CACHE, size_);
+}
+
+/*
+ * Encoded before the latch is taken, only the bookkeeping is serialized
+ */
+void PageCache::Put(page_id_t page_id, const char *page_data, bool replace) {
+  char buffer[PAGE_CODEC_MAX_SIZE];
+  size_t size = PageCodec::Encode(page_data, buffer);
+  std::lock_guard<std::mutex> guard(latch_);
+  auto it = index_.find(page_id);
+  if (it != index_.end()) {
+    if (!replace)
+      return;
+    EraseLocked(it);
+  }
+  if (size > capacity_)
+    return;
+  lru_list_.push_front(Entry{page_id, std::string(buffer, size)});
+  index_[page_id] = lru_list_.begin();
+  size_ += size;
+  MemoryTracker::Charge(MemoryComponent::PAGE_CACHE, size);
+  while (size_ > capacity_)
+    EraseLocked(index_.find(lru_list_.back().page_id_));
+}
+
+/*
+ * Decoded outside the latch from a copy, a Put may replace the entry
+ */
+bool PageCache::Get(page_id_t page_id, char *page_data) {
+  std::string data;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    auto it = index_.find(page_id);
+    if (it == index_.end())
+      return false;
+    lru_list_.splice(lru_list_.begin(), lru_list_, it->second);
+    data = it->second->data_;
+    hits_++;
+  }
+  return PageCodec::Decode(data.data(), data.size(), page_data);
+}
+
+void PageCache::Erase(page_id_t page_id) {
+  std::lock_guard<std::mutex> guard(latch_);
+  auto it = index_.find(page_id);
+  if (it != index_.end())
+    EraseLocked(it);
+}
+
+size_t PageCache::GetSize() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return size_;
+}
+
+size_t PageCache::GetPageCount() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return index_.size();
+}
+
+size_t PageCache::GetHits() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return hits_;
+}
+
+void PageCache::EraseLocked(
+    std::unordered_map<page_id_t, std::list<Entry>::iterator>::iterator it) {
+  size_ -= it->second->data_.size();
+  MemoryTracker::Release(MemoryComponent::PAGE_CACHE, it->second->data_.size());
+  lru_list_.erase(it->second);
+  index_.erase(it);
+}
+
+} // namespace cmudb
@@ -0,0 +1,458 @@
+/**
+ * page_codec.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "disk/page_codec.h"
+#include "page/pax_layout.h"
+
+namespace cmudb {
+
+// LZ4 block format: a match is at least 4 bytes, the last 5 bytes are
+// literals and no match starts within the last 12 bytes
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12
+#define LZ_HASH_BITS 12
+
+// header fields of a PAX table page before the ones of pax_layout.h, see
+// table_page.h
+#define PAX_TUPLE_COUNT_OFFSET (TABLE_PAGE_HEADER_SIZE - 8)
+#define PAX_FORMAT_OFFSET (TABLE_PAGE_HEADER_SIZE - 4)
+#define PAX_FORMAT_ID 1
+
+namespace {
+
+inline uint32_t Read32(const char *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint64_t ReadValue(const char *p, uint32_t width) {
+  uint64_t value = 0;
+  memcpy(&value, p, width);
+  return value;
+}
+
+inline void WriteValue(char *p, uint64_t value, uint32_t width) {
+  memcpy(p, &value, width);
+}
+
+// bits is at most 64, dst is zeroed beforehand
+inline void PutBits(char *dst, size_t &position, uint64_t value,
+                    uint32_t bits) {
+  while (bits > 0) {
+    uint32_t shift = position % 8;
+    uint32_t n = std::min(8 - shift, bits);
+    dst[position / 8] |= static_cast<char>((value & ((1u << n) - 1)) << shift);
+    value >>= n;
+    position += n;
+    bits -= n;
+  }
+}
+
+inline uint64_t GetBits(const char *src, size_t &position, uint32_t bits) {
+  uint64_t value = 0;
+  uint32_t done = 0;
+  while (done < bits) {
+    uint32_t shift = position % 8;
+    uint32_t n = std::min(8 - shift, bits - done);
+    uint64_t byte = static_cast<uint8_t>(src[position / 8]) >> shift;
+    value |= (byte & ((1u << n) - 1)) << done;
+    position += n;
+    done += n;
+  }
+  return value;
+}
+
+inline uint32_t BitWidth(uint64_t value) {
+  return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+// length beyond a 4 bit field, as a run of 255 and the rest
+inline bool PutLength(char *dst, size_t &out, size_t capacity, size_t length) {
+  for (; length >= 255; length -= 255) {
+    if (out >= capacity)
+      return false;
+    dst[out++] = static_cast<char>(255);
+  }
+  if (out >= capacity)
+    return false;
+  dst[out++] = static_cast<char>(length);
+  return true;
+}
+
+inline bool GetLength(const char *src, size_t &in, size_t size,
+                      size_t &length) {
+  uint8_t byte;
+  do {
+    if (in >= size)
+      return false;
+    byte = static_cast<uint8_t>(src[in++]);
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// one sequence, match_length 0 for the last one without match
+bool PutSequence(const char *literals, size_t literal_length, size_t offset,
+                 size_t match_length, char *dst, size_t &out,
+                 size_t capacity) {
+  if (out >= capacity)
+    return false;
+  size_t token = out++;
+  size_t match_code = match_length == 0 ? 0 : match_length - LZ_MIN_MATCH;
+  dst[token] = static_cast<char>((std::min<size_t>(literal_length, 15) << 4) |
+                                 std::min<size_t>(match_code, 15));
+  if (literal_length >= 15 &&
+      !PutLength(dst, out, capacity, literal_length - 15))
+    return false;
+  if (out + literal_length > capacity)
+    return false;
+  memcpy(dst + out, literals, literal_length);
+  out += literal_length;
+  if (match_length == 0)
+    return true;
+  if (out + 2 > capacity)
+    return false;
+  dst[out++] = static_cast<char>(offset & 0xff);
+  dst[out++] = static_cast<char>(offset >> 8);
+  return match_code < 15 || PutLength(dst, out, capacity, match_code - 15);
+}
+
+/*
+ * Live minipages of a PAX page, sorted, apart and past the header. False if
+ * page is no PAX page, or one that can not be encoded by column
+ */
+bool ParsePax(const char *page, std::vector<uint32_t> &offsets,
+              std::vector<uint32_t> &widths, uint32_t &count) {
+  if (Read32(page + PAX_FORMAT_OFFSET) != PAX_FORMAT_ID)
+    return false;
+  uint32_t capacity = Read32(page + PAX_CAPACITY_OFFSET);
+  uint32_t columns = Read32(page + PAX_COLUMN_COUNT_OFFSET);
+  if (capacity > PAGE_SIZE || columns == 0 ||
+      columns > (PAGE_SIZE - PAX_COLUMNS_OFFSET) / 8)
+    return false;
+  count = std::min(Read32(page + PAX_TUPLE_COUNT_OFFSET), capacity);
+  uint64_t end = PAX_COLUMNS_OFFSET + 8 * columns;
+  for (uint32_t i = 0; i < columns; i++) {
+    uint32_t width = Read32(page + PAX_COLUMNS_OFFSET + 8 * i);
+    uint64_t offset = Read32(page + PAX_COLUMNS_OFFSET + 8 * i + 4);
+    if ((width != 1 && width != 2 && width != 4 && width != 8) ||
+        offset < end || offset + capacity * width > PAGE_SIZE)
+      return false;
+    offsets.push_back(offset);
+    widths.push_back(width);
+    end = offset + count * width;
+  }
+  return true;
+}
+
+} // namespace
+
+/*
+ * Greedy LZ4 with a hash table of 4 byte sequences, one pass
+ */
+size_t PageCodec::CompressLZ(const char *src, size_t size, char *dst,
+                             size_t capacity) {
+  std::vector<int32_t> table(1 << LZ_HASH_BITS, -1);
+  size_t in = 0, anchor = 0, out = 0;
+  while (in + LZ_MATCH_LIMIT <= size) {
+    uint32_t sequence = Read32(src + in);
+    uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+    int32_t candidate = table[hash];
+    table[hash] = in;
+    if (candidate < 0 || in - candidate > 0xffff ||
+        Read32(src + candidate) != sequence) {
+      in++;
+      continue;
+    }
+    size_t length = LZ_MIN_MATCH;
+    while (in + length < size - LZ_LAST_LITERALS &&
+           src[candidate + length] == src[in + length])
+      length++;
+    if (!PutSequence(src + anchor, in - anchor, in - candidate, length, dst,
+                     out, capacity))
+      return 0;
+    in += length;
+    anchor = in;
+  }
+  if (!PutSequence(src + anchor, size - anchor, 0, 0, dst, out, capacity))
+    return 0;
+  return out;
+}
+
+bool PageCodec::DecompressLZ(const char *src, size_t size, char *dst,
+                             size_t dst_size) {
+  size_t in = 0, out = 0;
+  while (in < size) {
+    uint8_t token = static_cast<uint8_t>(src[in++]);
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 && !GetLength(src, in, size, literal_length))
+      return false;
+    if (in + literal_length > size || out + literal_length > dst_size)
+      return false;
+    memcpy(dst + out, src + in, literal_length);
+    in += literal_length;
+    out += literal_length;
+    // the last sequence has no match
+    if (in == size)
+      return out == dst_size;
+    if (in + 2 > size)
+      return false;
+    size_t offset = static_cast<uint8_t>(src[in]) |
+                    static_cast<uint8_t>(src[in + 1]) << 8;
+    in += 2;
+    size_t match_length = token & 15;
+    if (match_length == 15 && !GetLength(src, in, size, match_length))
+      return false;
+    match_length += LZ_MIN_MATCH;
+    if (offset == 0 || offset > out || out + match_length > dst_size)
+      return false;
+    // byte by byte, a match may overlap what it copies
+    for (size_t i = 0; i < match_length; i++, out++)
+      dst[out] = dst[out - offset];
+  }
+  return false;
+}
+
+/*
+ * The size of every encoding is known from runs, range and distinct values
+ * beforehand, only the smallest one is written
+ */
+size_t PageCodec::EncodeColumn(const char *src, uint32_t width, uint32_t count,
+                               char *dst) {
+  std::vector<uint64_t> values(count);
+  size_t runs = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    values[i] = ReadValue(src + i * width, width);
+    if (i == 0 || values[i] != values[i - 1])
+      runs++;
+  }
+  std::vector<uint64_t> dictionary(values);
+  std::sort(dictionary.begin(), dictionary.end());
+  dictionary.erase(std::unique(dictionary.begin(), dictionary.end()),
+                   dictionary.end());
+
+  size_t raw_size = static_cast<size_t>(count) * width;
+  size_t rle_size = 2 + runs * (width + 2);
+  uint32_t for_bits = 0;
+  if (count > 0)
+    for_bits = BitWidth(dictionary.back() - dictionary.front());
+  size_t for_size = width + 1 + (count * static_cast<size_t>(for_bits) + 7) / 8;
+  uint32_t dict_bits = BitWidth(dictionary.size() - 1);
+  size_t dict_size = dictionary.size() > 256
+                         ? raw_size + 1
+                         : 1 + dictionary.size() * width +
+                               (count * static_cast<size_t>(dict_bits) + 7) / 8;
+
+  size_t best = std::min({raw_size, rle_size, for_size, dict_size});
+  size_t out = 1;
+  if (best == raw_size) {
+    dst[0] = static_cast<char>(ColumnEncoding::RAW);
+    memcpy(dst + out, src, raw_size);
+    return out + raw_size;
+  }
+  memset(dst + 1, 0, best);
+  if (best == rle_size) {
+    dst[0] = static_cast<char>(ColumnEncoding::RLE);
+    WriteValue(dst + out, runs, 2);
+    out += 2;
+    for (uint32_t i = 0; i < count;) {
+      uint32_t j = i + 1;
+      while (j < count && values[j] == values[i])
+        j++;
+      WriteValue(dst + out, values[i], width);
+      WriteValue(dst + out + width, j - i, 2);
+      out += width + 2;
+      i = j;
+    }
+    return out;
+  }
+  size_t position;
+  if (best == for_size) {
+    dst[0] = static_cast<char>(ColumnEncoding::FOR);
+    uint64_t base = dictionary.front();
+    WriteValue(dst + out, base, width);
+    dst[out + width] = static_cast<char>(for_bits);
+    out += width + 1;
+    position = out * 8;
+    for (auto value : values)
+      PutBits(dst, position, value - base, for_bits);
+    return for_size + 1;
+  }
+  dst[0] = static_cast<char>(ColumnEncoding::DICT);
+  dst[out++] = static_cast<char>(dictionary.size() - 1);
+  for (auto value : dictionary) {
+    WriteValue(dst + out, value, width);
+    out += width;
+  }
+  position = out * 8;
+  for (auto value : values) {
+    uint64_t code = std::lower_bound(dictionary.begin(), dictionary.end(),
+                                     value) -
+                    dictionary.begin();
+    PutBits(dst, position, code, dict_bits);
+  }
+  return dict_size + 1;
+}
+
+size_t PageCodec::DecodeColumn(const char *src, size_t size, uint32_t width,
+                               uint32_t count, char *dst) {
+  if (size < 1)
+    return 0;
+  size_t in = 1;
+  switch (static_cast<ColumnEncoding>(src[0])) {
+  case ColumnEncoding::RAW: {
+    size_t raw_size = static_cast<size_t>(count) * width;
+    if (in + raw_size > size)
+      return 0;
+    memcpy(dst, src + in, raw_size);
+    return in + raw_size;
+  }
+  case ColumnEncoding::RLE: {
+    if (in + 2 > size)
+      return 0;
+    size_t runs = ReadValue(src + in, 2);
+    in += 2;
+    if (in + runs * (width + 2) > size)
+      return 0;
+    uint32_t i = 0;
+    for (size_t run = 0; run < runs; run++) {
+      uint64_t value = ReadValue(src + in, width);
+      uint64_t length = ReadValue(src + in + width, 2);
+      in += width + 2;
+      if (i + length > count)
+        return 0;
+      for (; length > 0; length--, i++)
+        WriteValue(dst + i * width, value, width);
+    }
+    return i == count ? in : 0;
+  }
+  case ColumnEncoding::FOR: {
+    if (in + width + 1 > size)
+      return 0;
+    uint64_t base = ReadValue(src + in, width);
+    uint32_t bits = static_cast<uint8_t>(src[in + width]);
+    in += width + 1;
+    if (bits > 64 || in + (count * static_cast<size_t>(bits) + 7) / 8 > size)
+      return 0;
+    size_t position = in * 8;
+    for (uint32_t i = 0; i < count; i++)
+      WriteValue(dst + i * width, base + GetBits(src, position, bits), width);
+    return in + (count * static_cast<size_t>(bits) + 7) / 8;
+  }
+  case ColumnEncoding::DICT: {
+    if (in + 1 > size)
+      return 0;
+    size_t entries = static_cast<uint8_t>(src[in++]) + 1;
+    uint32_t bits = BitWidth(entries - 1);
+    const char *dictionary = src + in;
+    in += entries * width;
+    if (in + (count * static_cast<size_t>(bits) + 7) / 8 > size)
+      return 0;
+    size_t position = in * 8;
+    for (uint32_t i = 0; i < count; i++) {
+      uint64_t code = GetBits(src, position, bits);
+      if (code >= entries)
+        return 0;
+      memcpy(dst + i * width, dictionary + code * width, width);
+    }
+    return in + (count * static_cast<size_t>(bits) + 7) / 8;
+  }
+  }
+  return 0;
+}
+
+/*
+ * PAX encoding (size in byte):
+ *  ---------------------------------------------------------------------
+ * | Encoding (1) | LZ size (2) | LZ of page without live minipages | ...
+ *  ---------------------------------------------------------------------
+ *  -------------------------------------
+ * | Column_1 | ... | Column_n |
+ *  -------------------------------------
+ * The live entries are zeroed in the page before LZ, so that part costs next
+ * to nothing
+ */
+size_t PageCodec::Encode(const char *page, char *out) {
+  std::vector<uint32_t> offsets, widths;
+  uint32_t count = 0;
+  size_t size = 0;
+  if (ParsePax(page, offsets, widths, count)) {
+    std::vector<char> rest(page, page + PAGE_SIZE);
+    for (size_t i = 0; i < offsets.size(); i++)
+      memset(rest.data() + offsets[i], 0, count * widths[i]);
+    size_t lz_size = CompressLZ(rest.data(), PAGE_SIZE, out + 3, PAGE_SIZE - 3);
+    if (lz_size > 0) {
+      out[0] = static_cast<char>(PageEncoding::PAX);
+      WriteValue(out + 1, lz_size, 2);
+      std::vector<char> column(1 + count * sizeof(uint64_t));
+      size = 3 + lz_size;
+      for (size_t i = 0; i < offsets.size() && size > 0; i++) {
+        size_t column_size =
+            EncodeColumn(page + offsets[i], widths[i], count, column.data());
+        if (size + column_size > PAGE_SIZE) {
+          size = 0;
+          break;
+        }
+        memcpy(out + size, column.data(), column_size);
+        size += column_size;
+      }
+    }
+  }
+  if (size == 0) {
+    size = CompressLZ(page, PAGE_SIZE, out + 1, PAGE_SIZE - 1);
+    if (size > 0) {
+      out[0] = static_cast<char>(PageEncoding::LZ);
+      size++;
+    }
+  }
+  if (size == 0) {
+    out[0] = static_cast<char>(PageEncoding::RAW);
+    memcpy(out + 1, page, PAGE_SIZE);
+    size = PAGE_CODEC_MAX_SIZE;
+  }
+  return size;
+}
+
+bool PageCodec::Decode(const char *in, size_t size, char *page) {
+  if (size < 1)
+    return false;
+  switch (static_cast<PageEncoding>(in[0])) {
+  case PageEncoding::RAW:
+    if (size != PAGE_CODEC_MAX_SIZE)
+      return false;
+    memcpy(page, in + 1, PAGE_SIZE);
+    return true;
+  case PageEncoding::LZ:
+    return DecompressLZ(in + 1, size - 1, page, PAGE_SIZE);
+  case PageEncoding::PAX: {
+    if (size < 3)
+      return false;
+    size_t lz_size = ReadValue(in + 1, 2);
+    if (3 + lz_size > size || !DecompressLZ(in + 3, lz_size, page, PAGE_SIZE))
+      return false;
+    std::vector<uint32_t> offsets, widths;
+    uint32_t count;
+    if (!ParsePax(page, offsets, widths, count))
+      return false;
+    size_t position = 3 + lz_size;
+    for (size_t i = 0; i < offsets.size(); i++) {
+      size_t column_size = DecodeColumn(in + position, size - position,
+                                        widths[i], count, page + offsets[i]);
+      if (column_size == 0)
+        return false;
+      position += column_size;
+    }
+    return position == size;
+  }
+  }
+  return false;
+}
+
+} // namespace cmudb
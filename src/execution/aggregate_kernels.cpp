@@ -0,0 +1,256 @@
+/**
+ * aggregate_kernels.cpp
+ */
+
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "execution/aggregate_kernels.h"
+#include "type/limits.h"
+
+namespace cmudb {
+
+// values gathered at a time from the selected rows of a batch
+#define AGGREGATE_GATHER_SIZE 256
+
+void IntegerAggregate::Merge(const IntegerAggregate &other) {
+  count_ += other.count_;
+  sum_ += other.sum_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+void DecimalAggregate::Merge(const DecimalAggregate &other) {
+  count_ += other.count_;
+  sum_ += other.sum_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+template <typename T, typename Aggregate>
+static void AggregateScalar(const T *values, size_t count, T null,
+                            Aggregate &aggregate) {
+  for (size_t i = 0; i < count; ++i) {
+    T value = values[i];
+    if (value == null)
+      continue;
+    ++aggregate.count_;
+    aggregate.sum_ += value;
+    aggregate.min_ = std::min<decltype(aggregate.min_)>(aggregate.min_, value);
+    aggregate.max_ = std::max<decltype(aggregate.max_)>(aggregate.max_, value);
+  }
+}
+
+void AggregateValues(const int8_t *values, size_t count,
+                     IntegerAggregate &aggregate) {
+  AggregateScalar(values, count, PELOTON_INT8_NULL, aggregate);
+}
+
+void AggregateValues(const int16_t *values, size_t count,
+                     IntegerAggregate &aggregate) {
+  AggregateScalar(values, count, PELOTON_INT16_NULL, aggregate);
+}
+
+/*
+ * Values are widened to 64 bit lanes for the sum, a null is the least
+ * integer so it leaves the maximum as it is
+ */
+void AggregateValues(const int32_t *values, size_t count,
+                     IntegerAggregate &aggregate) {
+  size_t i = 0;
+#ifdef __AVX2__
+  if (count >= 8) {
+    const __m256i null = _mm256_set1_epi32(PELOTON_INT32_NULL);
+    const __m256i greatest = _mm256_set1_epi32(INT32_MAX);
+    __m256i sum_low = _mm256_setzero_si256();
+    __m256i sum_high = _mm256_setzero_si256();
+    __m256i min = greatest;
+    __m256i max = null;
+    int64_t nulls = 0;
+    for (; i + 8 <= count; i += 8) {
+      __m256i block =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+      __m256i is_null = _mm256_cmpeq_epi32(block, null);
+      nulls += __builtin_popcount(
+          _mm256_movemask_ps(_mm256_castsi256_ps(is_null)));
+      __m256i zeroed = _mm256_andnot_si256(is_null, block);
+      sum_low = _mm256_add_epi64(
+          sum_low, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(zeroed)));
+      sum_high = _mm256_add_epi64(
+          sum_high, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(zeroed, 1)));
+      min = _mm256_min_epi32(min, _mm256_blendv_epi8(block, greatest, is_null));
+      max = _mm256_max_epi32(max, block);
+    }
+    int64_t sums[8];
+    int32_t mins[8], maxs[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums), sum_low);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums + 4), sum_high);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(mins), min);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(maxs), max);
+    int64_t valid = static_cast<int64_t>(i) - nulls;
+    aggregate.count_ += valid;
+    for (int lane = 0; lane < 8; ++lane)
+      aggregate.sum_ += sums[lane];
+    if (valid > 0) {
+      aggregate.min_ =
+          std::min<int64_t>(aggregate.min_, *std::min_element(mins, mins + 8));
+      aggregate.max_ =
+          std::max<int64_t>(aggregate.max_, *std::max_element(maxs, maxs + 8));
+    }
+  }
+#endif
+  AggregateScalar(values + i, count - i, PELOTON_INT32_NULL, aggregate);
+}
+
+/*
+ * The lanes add up in 64 bit, a lane that overflows has the sum of the
+ * values it took again exactly, one at a time. AVX2 has no 64 bit minimum,
+ * it is a compare and a blend
+ */
+void AggregateValues(const int64_t *values, size_t count,
+                     IntegerAggregate &aggregate) {
+  size_t i = 0;
+#ifdef __AVX2__
+  if (count >= 4) {
+    const __m256i null = _mm256_set1_epi64x(PELOTON_INT64_NULL);
+    const __m256i greatest = _mm256_set1_epi64x(INT64_MAX);
+    __m256i sum = _mm256_setzero_si256();
+    __m256i overflow = _mm256_setzero_si256();
+    __m256i min = greatest;
+    __m256i max = null;
+    int64_t nulls = 0;
+    for (; i + 4 <= count; i += 4) {
+      __m256i block =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+      __m256i is_null = _mm256_cmpeq_epi64(block, null);
+      nulls += __builtin_popcount(
+          _mm256_movemask_pd(_mm256_castsi256_pd(is_null)));
+      __m256i zeroed = _mm256_andnot_si256(is_null, block);
+      __m256i next = _mm256_add_epi64(sum, zeroed);
+      // the sign of the sum differs from those of both addends
+      overflow = _mm256_or_si256(
+          overflow, _mm256_and_si256(_mm256_xor_si256(next, sum),
+                                     _mm256_xor_si256(next, zeroed)));
+      sum = next;
+      __m256i candidate = _mm256_blendv_epi8(block, greatest, is_null);
+      min = _mm256_blendv_epi8(min, candidate,
+                               _mm256_cmpgt_epi64(min, candidate));
+      max = _mm256_blendv_epi8(max, block, _mm256_cmpgt_epi64(block, max));
+    }
+    int64_t sums[4], mins[4], maxs[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums), sum);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(mins), min);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(maxs), max);
+    int64_t valid = static_cast<int64_t>(i) - nulls;
+    aggregate.count_ += valid;
+    if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)) != 0) {
+      for (size_t j = 0; j < i; ++j)
+        if (values[j] != PELOTON_INT64_NULL)
+          aggregate.sum_ += values[j];
+    } else {
+      for (int lane = 0; lane < 4; ++lane)
+        aggregate.sum_ += sums[lane];
+    }
+    if (valid > 0) {
+      aggregate.min_ = std::min(aggregate.min_, *std::min_element(mins, mins + 4));
+      aggregate.max_ = std::max(aggregate.max_, *std::max_element(maxs, maxs + 4));
+    }
+  }
+#endif
+  AggregateScalar(values + i, count - i, PELOTON_INT64_NULL, aggregate);
+}
+
+void AggregateValues(const double *values, size_t count,
+                     DecimalAggregate &aggregate) {
+  size_t i = 0;
+#ifdef __AVX2__
+  if (count >= 4) {
+    const __m256d null = _mm256_set1_pd(PELOTON_DECIMAL_NULL);
+    const __m256d infinity =
+        _mm256_set1_pd(std::numeric_limits<double>::infinity());
+    const __m256d negative_infinity =
+        _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+    __m256d sum = _mm256_setzero_pd();
+    __m256d min = infinity;
+    __m256d max = negative_infinity;
+    int64_t nulls = 0;
+    for (; i + 4 <= count; i += 4) {
+      __m256d block = _mm256_loadu_pd(values + i);
+      __m256d is_null = _mm256_cmp_pd(block, null, _CMP_EQ_OQ);
+      nulls += __builtin_popcount(_mm256_movemask_pd(is_null));
+      sum = _mm256_add_pd(sum, _mm256_andnot_pd(is_null, block));
+      min = _mm256_min_pd(min, _mm256_blendv_pd(block, infinity, is_null));
+      max = _mm256_max_pd(max,
+                          _mm256_blendv_pd(block, negative_infinity, is_null));
+    }
+    double sums[4], mins[4], maxs[4];
+    _mm256_storeu_pd(sums, sum);
+    _mm256_storeu_pd(mins, min);
+    _mm256_storeu_pd(maxs, max);
+    aggregate.count_ += static_cast<int64_t>(i) - nulls;
+    aggregate.sum_ += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    aggregate.min_ = std::min(aggregate.min_, *std::min_element(mins, mins + 4));
+    aggregate.max_ = std::max(aggregate.max_, *std::max_element(maxs, maxs + 4));
+  }
+#endif
+  AggregateScalar(values + i, count - i, PELOTON_DECIMAL_NULL, aggregate);
+}
+
+/*
+ * The selected rows are all of them unless a filter dropped some, the
+ * column array is then read as it is. Otherwise the selected values are
+ * gathered a block at a time
+ */
+template <typename T, typename Aggregate>
+static void AggregateColumn(const RowBatch &batch, int column,
+                            Aggregate &aggregate) {
+  uint32_t selected = batch.GetSelectedCount();
+  if (selected == 0)
+    return;
+  if (selected == batch.GetSize()) {
+    AggregateValues(reinterpret_cast<const T *>(batch.GetFixed(column, 0)),
+                    selected, aggregate);
+    return;
+  }
+  T gathered[AGGREGATE_GATHER_SIZE];
+  for (uint32_t i = 0; i < selected; i += AGGREGATE_GATHER_SIZE) {
+    uint32_t n = std::min<uint32_t>(selected - i, AGGREGATE_GATHER_SIZE);
+    for (uint32_t j = 0; j < n; ++j)
+      gathered[j] = *reinterpret_cast<const T *>(
+          batch.GetFixed(column, batch.GetSelected(i + j)));
+    AggregateValues(gathered, n, aggregate);
+  }
+}
+
+bool AggregateBatch(const RowBatch &batch, int column,
+                    IntegerAggregate &aggregate) {
+  switch (batch.GetSchema()->GetType(column)) {
+  case TypeId::TINYINT:
+    AggregateColumn<int8_t>(batch, column, aggregate);
+    return true;
+  case TypeId::SMALLINT:
+    AggregateColumn<int16_t>(batch, column, aggregate);
+    return true;
+  case TypeId::INTEGER:
+    AggregateColumn<int32_t>(batch, column, aggregate);
+    return true;
+  case TypeId::BIGINT:
+    AggregateColumn<int64_t>(batch, column, aggregate);
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool AggregateBatch(const RowBatch &batch, int column,
+                    DecimalAggregate &aggregate) {
+  if (batch.GetSchema()->GetType(column) != TypeId::DECIMAL)
+    return false;
+  AggregateColumn<double>(batch, column, aggregate);
+  return true;
+}
+
+} // namespace cmudb
@@ -0,0 +1,274 @@
+/**
+ * external_sort.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include "execution/external_sort.h"
+
+namespace cmudb {
+
+// big endian, so the bytes compare as the unsigned integer does
+static void AppendBigEndian(std::string &key, uint64_t bits) {
+  for (int shift = 56; shift >= 0; shift -= 8)
+    key.push_back(static_cast<char>((bits >> shift) & 0xff));
+}
+
+/*
+ * Integers have their sign bit flipped. Doubles have it flipped if they
+ * are positive and every bit flipped if negative, then their bits compare
+ * as unsigned integers in the order of the values
+ */
+void AppendSortKey(std::string &key, const Value &value, bool descending) {
+  size_t begin = key.size();
+  if (value.IsNull()) {
+    key.push_back(0);
+  } else {
+    key.push_back(1);
+    switch (value.GetTypeId()) {
+    case TypeId::BOOLEAN:
+    case TypeId::TINYINT:
+      AppendBigEndian(key, static_cast<uint64_t>(static_cast<int64_t>(
+                               value.GetAs<int8_t>())) ^
+                               (1ULL << 63));
+      break;
+    case TypeId::SMALLINT:
+      AppendBigEndian(key, static_cast<uint64_t>(static_cast<int64_t>(
+                               value.GetAs<int16_t>())) ^
+                               (1ULL << 63));
+      break;
+    case TypeId::INTEGER:
+      AppendBigEndian(key, static_cast<uint64_t>(static_cast<int64_t>(
+                               value.GetAs<int32_t>())) ^
+                               (1ULL << 63));
+      break;
+    case TypeId::BIGINT:
+    case TypeId::TIMESTAMP:
+      AppendBigEndian(key, static_cast<uint64_t>(value.GetAs<int64_t>()) ^
+                               (1ULL << 63));
+      break;
+    case TypeId::DECIMAL: {
+      double decimal = value.GetAs<double>();
+      // -0.0 sorts with 0.0
+      if (decimal == 0)
+        decimal = 0;
+      uint64_t bits;
+      memcpy(&bits, &decimal, sizeof(bits));
+      AppendBigEndian(key, (bits >> 63) != 0 ? ~bits : bits ^ (1ULL << 63));
+      break;
+    }
+    default: {
+      // varchars end with a zero byte, which sorts a prefix first
+      const char *data = value.GetData();
+      key.append(data, strnlen(data, value.GetLength()));
+      key.push_back(0);
+      break;
+    }
+    }
+  }
+  if (descending)
+    for (size_t i = begin; i < key.size(); i++)
+      key[i] = ~key[i];
+}
+
+ExternalSort::ExternalSort(BufferPoolManager *buffer_pool_manager,
+                           const Comparator &comparator, size_t memory_limit,
+                           size_t threads)
+    : buffer_pool_manager_(buffer_pool_manager), comparator_(comparator),
+      memory_limit_(memory_limit), threads_(std::max<size_t>(threads, 1)) {
+  // a reader pins a page of each run merged and the writer one more, the
+  // rest of the pool stays for the others
+  fan_in_ = std::max<size_t>(
+      2, std::min<size_t>(EXECUTION_MERGE_FAN_IN,
+                          buffer_pool_manager->GetPoolSize() / 4));
+}
+
+ExternalSort::~ExternalSort() {
+  MemoryTracker::Release(MemoryComponent::EXECUTION, charged_);
+}
+
+int ExternalSort::Compare(const char *lhs, const char *rhs) const {
+  uint32_t lhs_size = SpillKeySize(lhs), rhs_size = SpillKeySize(rhs);
+  lhs += SPILL_RECORD_HEADER_SIZE;
+  rhs += SPILL_RECORD_HEADER_SIZE;
+  if (comparator_)
+    return comparator_(lhs, lhs_size, rhs, rhs_size);
+  int result = memcmp(lhs, rhs, std::min(lhs_size, rhs_size));
+  if (result != 0)
+    return result;
+  return lhs_size < rhs_size ? -1 : lhs_size > rhs_size ? 1 : 0;
+}
+
+void ExternalSort::Add(const std::string &key, const char *payload,
+                       uint32_t size) {
+  offsets_.push_back(buffer_.size());
+  AppendSpillRecord(buffer_, key.data(), static_cast<uint32_t>(key.size()),
+                    payload, size);
+  size_t bytes = SPILL_RECORD_HEADER_SIZE + key.size() + size + sizeof(size_t);
+  MemoryTracker::Charge(MemoryComponent::EXECUTION, bytes);
+  charged_ += bytes;
+  if (buffer_.size() + offsets_.size() * sizeof(size_t) >
+      GetExecutionMemoryLimit(memory_limit_))
+    SpillRun();
+}
+
+/*
+ * Slices of EXECUTION_SORT_SLICE records at least are sorted side by side,
+ * then merged pairwise in place
+ */
+void ExternalSort::SortOffsets() {
+  auto less = [this](size_t lhs, size_t rhs) {
+    return Compare(buffer_.data() + lhs, buffer_.data() + rhs) < 0;
+  };
+  size_t slices = std::min(threads_, offsets_.size() / EXECUTION_SORT_SLICE);
+  if (slices <= 1) {
+    std::stable_sort(offsets_.begin(), offsets_.end(), less);
+    return;
+  }
+  std::vector<size_t> bounds;
+  for (size_t i = 0; i <= slices; i++)
+    bounds.push_back(offsets_.size() * i / slices);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < slices; i++)
+    workers.emplace_back([&, i]() {
+      std::stable_sort(offsets_.begin() + bounds[i],
+                       offsets_.begin() + bounds[i + 1], less);
+    });
+  for (auto &worker : workers)
+    worker.join();
+  for (size_t width = 1; width < slices; width *= 2)
+    for (size_t i = 0; i + width < slices; i += 2 * width)
+      std::inplace_merge(offsets_.begin() + bounds[i],
+                         offsets_.begin() + bounds[i + width],
+                         offsets_.begin() + bounds[std::min(i + 2 * width,
+                                                            slices)],
+                         less);
+}
+
+/*
+ * The records are copied in order to a buffer of a few pages at a time, the
+ * spill file fetches its last page once per append
+ */
+void ExternalSort::SpillRun() {
+  if (offsets_.empty())
+    return;
+  SortOffsets();
+  std::unique_ptr<SpillFile> run(new SpillFile(buffer_pool_manager_));
+  std::vector<char> sorted;
+  for (size_t offset : offsets_) {
+    const char *record = buffer_.data() + offset;
+    sorted.insert(sorted.end(), record, record + SpillRecordSize(record));
+    if (sorted.size() >= 4 * PAGE_SIZE) {
+      run->Append(sorted.data(), sorted.size());
+      sorted.clear();
+    }
+  }
+  run->Append(sorted.data(), sorted.size());
+  spilled_pages_ += run->GetPageCount();
+  run_count_++;
+  runs_.push_back(std::move(run));
+  std::vector<char>().swap(buffer_);
+  std::vector<size_t>().swap(offsets_);
+  MemoryTracker::Release(MemoryComponent::EXECUTION, charged_);
+  charged_ = 0;
+}
+
+std::unique_ptr<SpillFile> ExternalSort::MergeRuns(size_t begin, size_t end) {
+  std::vector<std::unique_ptr<SpillFile::Reader>> readers;
+  std::vector<size_t> heap;
+  // ties go to the earlier run, which has the records added first
+  auto greater = [&](size_t lhs, size_t rhs) {
+    int result = Compare(readers[lhs]->GetRecord(), readers[rhs]->GetRecord());
+    return result > 0 || (result == 0 && lhs > rhs);
+  };
+  for (size_t i = begin; i < end; i++) {
+    readers.emplace_back(new SpillFile::Reader(runs_[i].get()));
+    if (readers.back()->Next())
+      heap.push_back(readers.size() - 1);
+  }
+  std::make_heap(heap.begin(), heap.end(), greater);
+
+  std::unique_ptr<SpillFile> run(new SpillFile(buffer_pool_manager_));
+  std::vector<char> merged;
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), greater);
+    size_t least = heap.back();
+    const char *record = readers[least]->GetRecord();
+    merged.insert(merged.end(), record, record + SpillRecordSize(record));
+    if (merged.size() >= 4 * PAGE_SIZE) {
+      run->Append(merged.data(), merged.size());
+      merged.clear();
+    }
+    if (readers[least]->Next())
+      std::push_heap(heap.begin(), heap.end(), greater);
+    else
+      heap.pop_back();
+  }
+  run->Append(merged.data(), merged.size());
+  spilled_pages_ += run->GetPageCount();
+  run_count_++;
+  return run;
+}
+
+/*
+ * Consecutive runs are merged so that ties stay in the order of the input
+ */
+void ExternalSort::Sort() {
+  if (runs_.empty()) {
+    SortOffsets();
+    return;
+  }
+  SpillRun();
+  while (runs_.size() > fan_in_) {
+    std::vector<std::unique_ptr<SpillFile>> merged;
+    for (size_t begin = 0; begin < runs_.size(); begin += fan_in_) {
+      size_t end = std::min(begin + fan_in_, runs_.size());
+      merged.push_back(MergeRuns(begin, end));
+      // the pages of the merged runs are free again for the next merge
+      for (size_t i = begin; i < end; i++)
+        runs_[i].reset();
+    }
+    runs_.swap(merged);
+  }
+}
+
+bool ExternalSort::Next() {
+  if (runs_.empty()) {
+    if (started_)
+      next_offset_++;
+    started_ = true;
+    record_ = next_offset_ < offsets_.size()
+                  ? buffer_.data() + offsets_[next_offset_]
+                  : nullptr;
+    return record_ != nullptr;
+  }
+
+  auto greater = [this](size_t lhs, size_t rhs) {
+    int result =
+        Compare(readers_[lhs]->GetRecord(), readers_[rhs]->GetRecord());
+    return result > 0 || (result == 0 && lhs > rhs);
+  };
+  if (!started_) {
+    started_ = true;
+    for (auto &run : runs_) {
+      readers_.emplace_back(new SpillFile::Reader(run.get()));
+      if (readers_.back()->Next())
+        heap_.push_back(readers_.size() - 1);
+    }
+    std::make_heap(heap_.begin(), heap_.end(), greater);
+  } else if (!heap_.empty()) {
+    // the current record was the top, its run moves on
+    size_t current = heap_.front();
+    std::pop_heap(heap_.begin(), heap_.end(), greater);
+    if (readers_[current]->Next())
+      std::push_heap(heap_.begin(), heap_.end(), greater);
+    else
+      heap_.pop_back();
+  }
+  record_ = heap_.empty() ? nullptr : readers_[heap_.front()]->GetRecord();
+  return record_ != nullptr;
+}
+
+} // namespace cmudb
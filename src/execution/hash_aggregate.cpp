@@ -0,0 +1,48 @@
+/**
+ * hash_aggregate.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include "execution/hash_aggregate.h"
+
+namespace cmudb {
+
+HashAggregate::HashAggregate(BufferPoolManager *buffer_pool_manager,
+                             size_t memory_limit)
+    : input_(buffer_pool_manager, memory_limit) {}
+
+// a null value is a record without payload
+void HashAggregate::Add(const std::string &key, const double *value) {
+  input_.Add(key, reinterpret_cast<const char *>(value),
+             value == nullptr ? 0 : sizeof(double));
+}
+
+void HashAggregate::Run(
+    const std::function<void(const std::string &, const AggregateState &)>
+        &callback) {
+  std::unordered_map<std::string, AggregateState> groups;
+  for (size_t partition = 0; partition < input_.GetPartitionCount();
+       partition++) {
+    groups.clear();
+    input_.Scan(partition, [&](const std::string &key, const char *payload,
+                               uint32_t size) {
+      AggregateState &state = groups[key];
+      state.rows_++;
+      if (size == 0)
+        return;
+      double value;
+      memcpy(&value, payload, sizeof(value));
+      state.sum_ += value;
+      state.min_ = state.values_ == 0 ? value : std::min(state.min_, value);
+      state.max_ = state.values_ == 0 ? value : std::max(state.max_, value);
+      state.values_++;
+    });
+    for (auto &group : groups)
+      callback(group.first, group.second);
+  }
+}
+
+} // namespace cmudb
@@ -0,0 +1,51 @@
+/**
+ * hash_join.cpp
+ */
+
+#include <cstring>
+#include <unordered_map>
+
+#include "execution/hash_join.h"
+
+namespace cmudb {
+
+HashJoin::HashJoin(BufferPoolManager *buffer_pool_manager,
+                   size_t memory_limit)
+    : build_(buffer_pool_manager, memory_limit / 2),
+      probe_(buffer_pool_manager, memory_limit / 2) {}
+
+void HashJoin::AddBuild(const std::string &key, int64_t rowid) {
+  build_.Add(key, reinterpret_cast<const char *>(&rowid), sizeof(rowid));
+}
+
+void HashJoin::AddProbe(const std::string &key, int64_t rowid) {
+  probe_.Add(key, reinterpret_cast<const char *>(&rowid), sizeof(rowid));
+}
+
+void HashJoin::Run(
+    const std::function<void(const std::string &, int64_t, int64_t)>
+        &callback) {
+  std::unordered_multimap<std::string, int64_t> table;
+  for (size_t partition = 0; partition < build_.GetPartitionCount();
+       partition++) {
+    table.clear();
+    build_.Scan(partition, [&](const std::string &key, const char *payload,
+                               uint32_t size) {
+      int64_t rowid;
+      memcpy(&rowid, payload, sizeof(rowid));
+      table.emplace(key, rowid);
+    });
+    if (table.empty())
+      continue;
+    probe_.Scan(partition, [&](const std::string &key, const char *payload,
+                               uint32_t size) {
+      int64_t rowid;
+      memcpy(&rowid, payload, sizeof(rowid));
+      auto range = table.equal_range(key);
+      for (auto it = range.first; it != range.second; ++it)
+        callback(key, it->second, rowid);
+    });
+  }
+}
+
+} // namespace cmudb
@@ -0,0 +1,87 @@
+/**
+ * radix_partitions.cpp
+ */
+
+#include <algorithm>
+
+#include "execution/radix_partitions.h"
+#include "table/table_stats.h"
+
+namespace cmudb {
+
+RadixPartitions::RadixPartitions(BufferPoolManager *buffer_pool_manager,
+                                 size_t memory_limit, uint32_t bits)
+    : buffer_pool_manager_(buffer_pool_manager), memory_limit_(memory_limit),
+      bits_(bits), partitions_(static_cast<size_t>(1) << bits) {}
+
+RadixPartitions::~RadixPartitions() {
+  MemoryTracker::Release(MemoryComponent::EXECUTION, memory_usage_);
+}
+
+uint64_t RadixPartitions::Hash(const std::string &key) {
+  return HyperLogLog::Hash(key.data(), key.size());
+}
+
+/*
+ * The largest partitions are spilled first, until half of the limit is
+ * left for the records still to come
+ */
+void RadixPartitions::Add(const std::string &key, const char *payload,
+                          uint32_t size) {
+  Partition &partition = partitions_[PartitionOf(Hash(key))];
+  uint32_t key_size = static_cast<uint32_t>(key.size());
+  AppendSpillRecord(partition.buffer_, key.data(), key_size, payload, size);
+  memory_usage_ += SPILL_RECORD_HEADER_SIZE + key_size + size;
+  MemoryTracker::Charge(MemoryComponent::EXECUTION,
+                        SPILL_RECORD_HEADER_SIZE + key_size + size);
+
+  size_t memory_limit = GetExecutionMemoryLimit(memory_limit_);
+  if (memory_usage_ <= memory_limit)
+    return;
+  std::vector<Partition *> largest;
+  for (auto &candidate : partitions_)
+    if (!candidate.buffer_.empty())
+      largest.push_back(&candidate);
+  std::sort(largest.begin(), largest.end(),
+            [](const Partition *lhs, const Partition *rhs) {
+              return lhs->buffer_.size() > rhs->buffer_.size();
+            });
+  for (auto candidate : largest) {
+    if (memory_usage_ <= memory_limit / 2)
+      break;
+    Spill(*candidate);
+  }
+}
+
+void RadixPartitions::Spill(Partition &partition) {
+  if (partition.file_ == nullptr)
+    partition.file_.reset(new SpillFile(buffer_pool_manager_));
+  size_t pages = partition.file_->GetPageCount();
+  partition.file_->Append(partition.buffer_.data(), partition.buffer_.size());
+  spilled_pages_ += partition.file_->GetPageCount() - pages;
+  memory_usage_ -= partition.buffer_.size();
+  MemoryTracker::Release(MemoryComponent::EXECUTION, partition.buffer_.size());
+  std::vector<char>().swap(partition.buffer_);
+}
+
+void RadixPartitions::Scan(
+    size_t partition_index,
+    const std::function<void(const std::string &, const char *, uint32_t)>
+        &callback) {
+  Partition &partition = partitions_[partition_index];
+  std::string key;
+  auto scan_record = [&](const char *record) {
+    uint32_t key_size = SpillKeySize(record);
+    key.assign(record + SPILL_RECORD_HEADER_SIZE, key_size);
+    callback(key, record + SPILL_RECORD_HEADER_SIZE + key_size,
+             SpillPayloadSize(record));
+  };
+  if (partition.file_ != nullptr)
+    partition.file_->Scan(scan_record);
+  const std::vector<char> &buffer = partition.buffer_;
+  for (size_t offset = 0; offset < buffer.size();
+       offset += SpillRecordSize(buffer.data() + offset))
+    scan_record(buffer.data() + offset);
+}
+
+} // namespace cmudb
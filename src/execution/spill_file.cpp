@@ -0,0 +1,107 @@
+/**
+ * spill_file.cpp
+ */
+
+#include "execution/spill_file.h"
+#include "common/exception.h"
+
+namespace cmudb {
+
+void AppendSpillRecord(std::vector<char> &buffer, const char *key,
+                       uint32_t key_size, const char *payload,
+                       uint32_t payload_size) {
+  size_t offset = buffer.size();
+  buffer.resize(offset + SPILL_RECORD_HEADER_SIZE + key_size + payload_size);
+  char *record = buffer.data() + offset;
+  memcpy(record, &key_size, sizeof(uint32_t));
+  memcpy(record + 4, &payload_size, sizeof(uint32_t));
+  memcpy(record + SPILL_RECORD_HEADER_SIZE, key, key_size);
+  memcpy(record + SPILL_RECORD_HEADER_SIZE + key_size, payload, payload_size);
+}
+
+SpillFile::~SpillFile() {
+  for (page_id_t page_id : page_ids_)
+    buffer_pool_manager_->DeletePage(page_id);
+}
+
+void SpillFile::Append(const char *records, size_t size) {
+  size_t offset = 0;
+  Page *page = nullptr;
+  uint32_t used = 0;
+  if (!page_ids_.empty()) {
+    page = buffer_pool_manager_->FetchPage(page_ids_.back());
+    if (page == nullptr)
+      throw Exception(EXCEPTION_TYPE_EXECUTOR, "all page are pinned");
+    memcpy(&used, page->GetData() + SPILL_USED_OFFSET, sizeof(uint32_t));
+  }
+  while (offset < size) {
+    uint32_t bytes = SpillRecordSize(records + offset);
+    if (bytes > PAGE_SIZE - SPILL_PAGE_HEADER_SIZE) {
+      if (page != nullptr)
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+      throw Exception(EXCEPTION_TYPE_EXECUTOR, "record too large to spill");
+    }
+    if (page == nullptr || SPILL_PAGE_HEADER_SIZE + used + bytes > PAGE_SIZE) {
+      page_id_t page_id;
+      Page *next = buffer_pool_manager_->NewPage(page_id);
+      if (next == nullptr) {
+        if (page != nullptr)
+          buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+        throw Exception(EXCEPTION_TYPE_EXECUTOR, "out of memory");
+      }
+      if (page != nullptr) {
+        memcpy(page->GetData(), &page_id, sizeof(page_id_t));
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+      }
+      page = next;
+      page_id_t none = INVALID_PAGE_ID;
+      memcpy(page->GetData(), &none, sizeof(page_id_t));
+      used = 0;
+      page_ids_.push_back(page_id);
+    }
+    memcpy(page->GetData() + SPILL_PAGE_HEADER_SIZE + used, records + offset,
+           bytes);
+    used += bytes;
+    memcpy(page->GetData() + SPILL_USED_OFFSET, &used, sizeof(uint32_t));
+    offset += bytes;
+  }
+  if (page != nullptr)
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+}
+
+void SpillFile::Scan(
+    const std::function<void(const char *record)> &callback) const {
+  Reader reader(this);
+  while (reader.Next())
+    callback(reader.GetRecord());
+}
+
+SpillFile::Reader::~Reader() {
+  if (page_ != nullptr)
+    file_->buffer_pool_manager_->UnpinPage(page_->GetPageId(), false);
+}
+
+bool SpillFile::Reader::Next() {
+  if (record_ != nullptr)
+    offset_ += SpillRecordSize(record_);
+  while (page_ == nullptr || offset_ >= used_) {
+    if (page_ != nullptr) {
+      file_->buffer_pool_manager_->UnpinPage(page_->GetPageId(), false);
+      page_ = nullptr;
+      page_index_++;
+    }
+    record_ = nullptr;
+    if (page_index_ >= file_->page_ids_.size())
+      return false;
+    page_ = file_->buffer_pool_manager_->FetchPage(
+        file_->page_ids_[page_index_]);
+    if (page_ == nullptr)
+      throw Exception(EXCEPTION_TYPE_EXECUTOR, "all page are pinned");
+    memcpy(&used_, page_->GetData() + SPILL_USED_OFFSET, sizeof(uint32_t));
+    offset_ = 0;
+  }
+  record_ = page_->GetData() + SPILL_PAGE_HEADER_SIZE + offset_;
+  return true;
+}
+
+} // namespace cmudb
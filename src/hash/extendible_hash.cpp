@@ -1,4 +1,6 @@
+#include <functional>
 #include <list>
+#include <thread>
 
 #include "hash/extendible_hash.h"
 #include "page/page.h"
@@ -10,14 +12,29 @@ namespace cmudb {
  * array_size: fixed array size for each bucket
  */
 template <typename K, typename V>
-ExtendibleHash<K, V>::ExtendibleHash(size_t size) {}
+ExtendibleHash<K, V>::ExtendibleHash(size_t size)
+    : bucket_size_(size), num_buckets_(1) {
+  Directory *directory = new Directory(0);
+  Bucket *bucket = new Bucket(0, 0, bucket_size_);
+  directory->slots_[0].store(bucket);
+  directory_.store(directory);
+  buckets_.push_back(bucket);
+  directories_.push_back(directory);
+}
+
+template <typename K, typename V> ExtendibleHash<K, V>::~ExtendibleHash() {
+  for (auto bucket : buckets_)
+    delete bucket;
+  for (auto directory : directories_)
+    delete directory;
+}
 
 /*
  * helper function to calculate the hashing address of input key
  */
 template <typename K, typename V>
 size_t ExtendibleHash<K, V>::HashKey(const K &key) {
-  return 0;
+  return std::hash<K>()(key);
 }
 
 /*
@@ -26,7 +43,7 @@ size_t ExtendibleHash<K, V>::HashKey(const K &key) {
  */
 template <typename K, typename V>
 int ExtendibleHash<K, V>::GetGlobalDepth() const {
-  return 0;
+  return directory_.load(std::memory_order_acquire)->global_depth_;
 }
 
 /*
@@ -35,7 +52,12 @@ int ExtendibleHash<K, V>::GetGlobalDepth() const {
  */
 template <typename K, typename V>
 int ExtendibleHash<K, V>::GetLocalDepth(int bucket_id) const {
-  return 0;
+  Directory *directory = directory_.load(std::memory_order_acquire);
+  if (bucket_id < 0 || bucket_id >= (1 << directory->global_depth_))
+    return -1;
+  Bucket *bucket = directory->slots_[bucket_id].load(std::memory_order_acquire);
+  std::lock_guard<std::mutex> guard(bucket->latch_);
+  return bucket->local_depth_;
 }
 
 /*
@@ -43,7 +65,7 @@ int ExtendibleHash<K, V>::GetLocalDepth(int bucket_id) const {
  */
 template <typename K, typename V>
 int ExtendibleHash<K, V>::GetNumBuckets() const {
-  return 0;
+  return num_buckets_.load();
 }
 
 /*
@@ -51,7 +73,42 @@ int ExtendibleHash<K, V>::GetNumBuckets() const {
  */
 template <typename K, typename V>
 bool ExtendibleHash<K, V>::Find(const K &key, V &value) {
-  return false;
+  size_t hash = HashKey(key);
+  while (true) {
+    Directory *directory = directory_.load(std::memory_order_acquire);
+    size_t slot = hash & ((static_cast<size_t>(1) << directory->global_depth_) -
+                          1);
+    Bucket *bucket = directory->slots_[slot].load(std::memory_order_acquire);
+    if (!optimistic_) {
+      std::lock_guard<std::mutex> guard(bucket->latch_);
+      if (bucket->Mask(hash) != bucket->pattern_)
+        continue;
+      int index = EntryIndex(bucket, key);
+      if (index < 0)
+        return false;
+      value = bucket->entries_[index].value_;
+      return true;
+    }
+
+    uint64_t version = bucket->version_.load(std::memory_order_acquire);
+    if (version & 1) {
+      // the writer may wait for a core
+      std::this_thread::yield();
+      continue;
+    }
+    bool owner = bucket->Mask(hash) == bucket->pattern_;
+    int index = EntryIndex(bucket, key);
+    V result;
+    if (index >= 0)
+      result = bucket->entries_[index].value_;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (bucket->version_.load(std::memory_order_relaxed) != version || !owner)
+      continue;
+    if (index < 0)
+      return false;
+    value = result;
+    return true;
+  }
 }
 
 /*
@@ -60,7 +117,14 @@ bool ExtendibleHash<K, V>::Find(const K &key, V &value) {
  */
 template <typename K, typename V>
 bool ExtendibleHash<K, V>::Remove(const K &key) {
-  return false;
+  Bucket *bucket = WLatchBucket(HashKey(key));
+  int index = EntryIndex(bucket, key);
+  if (index >= 0) {
+    bucket->size_--;
+    bucket->entries_[index] = bucket->entries_[bucket->size_];
+  }
+  WUnlatchBucket(bucket);
+  return index >= 0;
 }
 
 /*
@@ -69,7 +133,112 @@ bool ExtendibleHash<K, V>::Remove(const K &key) {
  * global depth
  */
 template <typename K, typename V>
-void ExtendibleHash<K, V>::Insert(const K &key, const V &value) {}
+void ExtendibleHash<K, V>::Insert(const K &key, const V &value) {
+  size_t hash = HashKey(key);
+  while (true) {
+    Bucket *bucket = WLatchBucket(hash);
+    int index = EntryIndex(bucket, key);
+    if (index >= 0) {
+      bucket->entries_[index].value_ = value;
+    } else if (bucket->size_ < bucket_size_) {
+      bucket->entries_[bucket->size_].key_ = key;
+      bucket->entries_[bucket->size_].value_ = value;
+      bucket->size_++;
+    } else {
+      Split(bucket);
+      WUnlatchBucket(bucket);
+      // retry, the target bucket may still be full if all keys moved together
+      continue;
+    }
+    WUnlatchBucket(bucket);
+    return;
+  }
+}
+
+/*
+ * latch the bucket the directory points to, start over if a split moved the
+ * keys of hash away before the latch was granted
+ */
+template <typename K, typename V>
+typename ExtendibleHash<K, V>::Bucket *
+ExtendibleHash<K, V>::WLatchBucket(size_t hash) {
+  while (true) {
+    Directory *directory = directory_.load(std::memory_order_acquire);
+    size_t slot = hash & ((static_cast<size_t>(1) << directory->global_depth_) -
+                          1);
+    Bucket *bucket = directory->slots_[slot].load(std::memory_order_acquire);
+    bucket->latch_.lock();
+    if (bucket->Mask(hash) == bucket->pattern_) {
+      bucket->version_.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      return bucket;
+    }
+    bucket->latch_.unlock();
+  }
+}
+
+template <typename K, typename V>
+void ExtendibleHash<K, V>::WUnlatchBucket(Bucket *bucket) {
+  bucket->version_.fetch_add(1, std::memory_order_release);
+  bucket->latch_.unlock();
+}
+
+/*
+ * The image is filled before the directory points to it. Readers of the old
+ * directory land on the split bucket and see that the key is not its own.
+ */
+template <typename K, typename V>
+void ExtendibleHash<K, V>::Split(Bucket *bucket) {
+  std::lock_guard<std::mutex> guard(split_latch_);
+  Directory *directory = directory_.load(std::memory_order_relaxed);
+  if (bucket->local_depth_ == directory->global_depth_) {
+    size_t size = static_cast<size_t>(1) << directory->global_depth_;
+    Directory *doubled = new Directory(directory->global_depth_ + 1);
+    for (size_t i = 0; i < size; ++i) {
+      Bucket *slot = directory->slots_[i].load(std::memory_order_relaxed);
+      doubled->slots_[i].store(slot, std::memory_order_relaxed);
+      doubled->slots_[i + size].store(slot, std::memory_order_relaxed);
+    }
+    directories_.push_back(doubled);
+    directory_.store(doubled, std::memory_order_release);
+    directory = doubled;
+  }
+
+  size_t split_bit = static_cast<size_t>(1) << bucket->local_depth_;
+  Bucket *image = new Bucket(bucket->local_depth_ + 1,
+                             bucket->pattern_ | split_bit, bucket_size_);
+  size_t kept = 0;
+  for (size_t i = 0; i < bucket->size_; ++i) {
+    if (HashKey(bucket->entries_[i].key_) & split_bit)
+      image->entries_[image->size_++] = bucket->entries_[i];
+    else
+      bucket->entries_[kept++] = bucket->entries_[i];
+  }
+  bucket->size_ = kept;
+  bucket->local_depth_++;
+  buckets_.push_back(image);
+  num_buckets_++;
+
+  size_t size = static_cast<size_t>(1) << directory->global_depth_;
+  for (size_t i = split_bit; i < size; ++i) {
+    if ((i & split_bit) &&
+        directory->slots_[i].load(std::memory_order_relaxed) == bucket)
+      directory->slots_[i].store(image, std::memory_order_release);
+  }
+}
+
+/*
+ * optimistic readers may see a size past the end of a torn bucket
+ */
+template <typename K, typename V>
+int ExtendibleHash<K, V>::EntryIndex(const Bucket *bucket, const K &key) {
+  size_t size = bucket->size_;
+  for (size_t i = 0; i < size && i < bucket->capacity_; ++i) {
+    if (bucket->entries_[i].key_ == key)
+      return static_cast<int>(i);
+  }
+  return -1;
+}
 
 template class ExtendibleHash<page_id_t, Page *>;
 template class ExtendibleHash<Page *, std::list<Page *>::iterator>;
@@ -77,4 +246,8 @@ template class ExtendibleHash<Page *, std::list<Page *>::iterator>;
 template class ExtendibleHash<int, std::string>;
 template class ExtendibleHash<int, std::list<int>::iterator>;
 template class ExtendibleHash<int, int>;
+#ifdef WIDE_PAGE_IDS
+// replacers of page ids, page_id_t is int otherwise
+template class ExtendibleHash<page_id_t, std::list<page_id_t>::iterator>;
+#endif
 } // namespace cmudb
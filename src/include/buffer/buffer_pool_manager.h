@@ -4,21 +4,240 @@
  * Functionality: The simplified Buffer Manager interface allows a client to
  * new/delete pages on disk, to read a disk page into the buffer pool and pin
  * it, also to unpin a page in the buffer pool.
+ *
+ * The pool can be split into several partitions. A page id always maps to the
+ * same partition (page_id % num_partitions), and each partition has its own
+ * page table, replacer, free list and latch, so threads working on pages of
+ * different partitions never contend with each other.
+ *
+ * The replacement policy is chosen at construction: LRU, CLOCK which keeps
+ * the hit path cheap and resists sequential scans (see clock_replacer.h), or
+ * LRU-K which keeps pages referenced once behind hot ones (see
+ * lru_k_replacer.h).
+ *
+ * PrefetchPage queues an asynchronous read-ahead served by a background
+ * thread. A frame being filled stays in the page table with the prefetcher's
+ * pin and its page id in the partition's loading set, FetchPage waits for the
+ * read to finish instead of issuing a second one. Reads are asynchronous, the
+ * prefetch thread submits the reads of all pending requests at once and
+ * finishes them as they complete.
+ *
+ * An optional page cleaner thread writes dirty unpinned pages in the
+ * background, so that victims are mostly clean and a foreground fetch does not
+ * pay for a write before its own read. A partition is cleaned once the dirty
+ * share of its unpinned frames exceeds the high water mark, until it drops to
+ * the low water mark. Pages with consecutive ids are written with one gather
+ * write. A page is pinned and read latched while being written, writers wait
+ * for the write to finish but readers and hits are not blocked.
+ *
+ * Descriptors of the frames (Page) sit in one dense array, their data buffers
+ * in a separate huge page backed arena (see frame_arena.h). When numa_aware
+ * is set partition i keeps its buffers on NUMA node i % nodes, use a multiple
+ * of the node count as the number of partitions so that every node serves
+ * its share of the page ids.
+ *
+ * Every partition counts what happens to it (see BufferPoolStats) with relaxed
+ * atomics next to its latch, GetStats sums them up. A latch that is free is
+ * taken without reading the clock, only waits are timed.
+ *
+ * Once a log manager is set, a page is never written before the log records
+ * that changed it: every write back (eviction, flush, page cleaner) first
+ * waits until the log is durable up to the page lsn.
+ *
+ * By default NewPage and FetchPage fail at once when every frame of the
+ * partition is pinned. SetAdmission turns on a blocking mode instead: the
+ * caller waits for a frame to be unpinned, up to a timeout, so a burst
+ * degrades into latency rather than aborts. At most max_waiters_ callers
+ * wait per partition, and a thread holding pin_quota_ pins or more is not
+ * let in either, it could be holding the frames the others wait for. Pins
+ * are counted per thread, a transaction runs on one thread at a time.
+ *
+ * EnableMmap opens the file read only for analytic replicas: a miss points
+ * the frame at the page in a mapping of the file (see DiskManager::EnableMmap)
+ * instead of reading it into the arena, so there is no copy and the page
+ * cache of the OS keeps hot pages. Pin counts, latches and replacement work
+ * as before, but nothing is ever written: an evicted frame is just dropped,
+ * dirty flags are ignored and NewPage and DeletePage fail. Changes made to a
+ * page stay in memory as long as the pool lives, even after eviction.
+ *
+ * EnableSwizzling lets b+ tree lookups skip the page table on their way
+ * down. Next to the frame of an internal page the pool keeps a table of
+ * frames by child slot, filled as lookups fetch children (Swizzle). A later
+ * lookup follows the frame of the slot directly, without latch, page table
+ * or pin, and reads it optimistically: ReadSwizzled takes its version if the
+ * frame still holds the child, the lookup validates it as it does for
+ * pinned pages. Readers of unpinned frames stay inside an epoch (EnterEpoch)
+ * and never wait for the pool there. A frame is unswizzled when it is
+ * evicted or deleted: its version moves on, which fails every reference to
+ * it, and it is not refilled before the readers that may have found it
+ * have left their epoch. References are not cleared, a stale one names a
+ * frame that holds another page and is ignored.
+ *
+ * The frames in use can shrink and grow at run time, up to the pool size
+ * given at construction. Resize sets the frames wanted, and under a memory
+ * budget (see memory_tracker.h) the pool takes no more than the budget
+ * minus what the other components use. A partition above its share evicts
+ * unpinned pages and parks their frames, their buffers go back to the
+ * system, before it takes a frame for a miss. Below its share it takes
+ * parked frames back. Frames are charged as MemoryComponent::BUFFER_POOL.
+ *
+ * StartWarmRestart keeps a restarted pool from starting cold. A background
+ * thread reads the pages listed in a file by the last run, then writes the
+ * list of resident pages into the file every interval and once more when
+ * stopped. The list is hottest first: pinned pages, then as the replacer
+ * would evict them last, partitions taking turns. The warm up reads as many
+ * of the hottest pages as there are frames, a batch at a time with the
+ * reads of a batch sorted by page id and submitted together. It only takes
+ * free frames and leaves the pages of queries alone, which are served
+ * meanwhile. Pages read enter the replacer as read ahead.
  */
 
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <list>
 #include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
+#include "buffer/clock_replacer.h"
+#include "buffer/frame_arena.h"
+#include "buffer/lru_k_replacer.h"
 #include "buffer/lru_replacer.h"
+#include "buffer/page_trace.h"
+#include "common/memory_tracker.h"
 #include "disk/disk_manager.h"
 #include "hash/extendible_hash.h"
+#include "logging/log_manager.h"
 #include "page/page.h"
 
 namespace cmudb {
+
+enum class ReplacerType { LRU, CLOCK, LRU_K };
+
+// tuning of the background page cleaner
+struct PageCleanerConfig {
+  // start cleaning a partition above this fraction of dirty unpinned frames
+  double dirty_high_water_ = 0.3;
+  // and stop once it is down to this fraction
+  double dirty_low_water_ = 0.1;
+  // upper bound of pages written per second, 0 for no limit
+  size_t max_pages_per_second_ = 4096;
+  // pause between two cleaning rounds
+  std::chrono::milliseconds interval_ = std::chrono::milliseconds(10);
+  // longest run of consecutive pages written with one request
+  size_t max_pages_per_write_ = 32;
+};
+
+// admission control of frames, see SetAdmission
+struct AdmissionConfig {
+  // wait for a frame instead of failing when every frame is pinned
+  bool blocking_ = false;
+  // longest wait for a frame of one NewPage or FetchPage call
+  std::chrono::milliseconds timeout_ = std::chrono::milliseconds(100);
+  // callers waiting per partition, more fail at once
+  size_t max_waiters_ = 64;
+  // pins a thread may hold and still wait, 0 for no quota
+  size_t pin_quota_ = 16;
+};
+
+// counters of a buffer pool, a snapshot taken by GetStats
+struct BufferPoolStats {
+  // FetchPage calls, those finding the page resident and those reading it
+  uint64_t fetches_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  // pages evicted from a frame to make room, and pages written back to disk
+  // for any reason (eviction, flush, page cleaner)
+  uint64_t evictions_ = 0;
+  uint64_t writebacks_ = 0;
+  // fetches that waited for a read in progress by the prefetcher
+  uint64_t pin_waits_ = 0;
+  // NewPage and FetchPage calls failing as every frame was pinned
+  uint64_t new_page_failures_ = 0;
+  uint64_t fetch_failures_ = 0;
+  // FetchPage calls failing as the page read failed its checksum
+  uint64_t corrupt_pages_ = 0;
+  // calls that waited for a frame to be unpinned, their total wait, those
+  // failing at the timeout and those not let wait (see AdmissionConfig)
+  uint64_t frame_waits_ = 0;
+  uint64_t frame_wait_ns_ = 0;
+  uint64_t frame_wait_timeouts_ = 0;
+  uint64_t admission_rejects_ = 0;
+  // partition latch acquisitions that had to wait, and their total wait
+  uint64_t latch_waits_ = 0;
+  uint64_t latch_wait_ns_ = 0;
+};
+
+// live counters of one partition
+struct BufferPoolCounters {
+  std::atomic<uint64_t> fetches_{0};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> evictions_{0};
+  std::atomic<uint64_t> writebacks_{0};
+  std::atomic<uint64_t> pin_waits_{0};
+  std::atomic<uint64_t> new_page_failures_{0};
+  std::atomic<uint64_t> fetch_failures_{0};
+  std::atomic<uint64_t> corrupt_pages_{0};
+  std::atomic<uint64_t> frame_waits_{0};
+  std::atomic<uint64_t> frame_wait_ns_{0};
+  std::atomic<uint64_t> frame_wait_timeouts_{0};
+  std::atomic<uint64_t> admission_rejects_{0};
+  std::atomic<uint64_t> latch_waits_{0};
+  std::atomic<uint64_t> latch_wait_ns_{0};
+};
+
+// frames a partition keeps in use however small the budget
+#define BUFFER_POOL_MIN_FRAMES 16
+
+// child slots of an internal page frame that can be swizzled
+#define SWIZZLE_SLOTS (PAGE_SIZE / 8)
+
+// extract the page id following a page in a chain, used by read-ahead
+typedef page_id_t (*NextPageIdFunc)(Page *page);
+
+// one independent slice of the buffer pool
+struct BufferPoolPartition {
+  // frames owned by this partition, a slice of BufferPoolManager::pages_
+  Page *pages_ = nullptr;
+  size_t pool_size_ = 0;
+  // NUMA node holding the data buffers of the frames, -1 if not bound
+  int numa_node_ = -1;
+  // to keep track of page id and its memory location
+  HashTable<page_id_t, Page *> *page_table_ = nullptr;
+  // to collect unpinned pages for replacement
+  Replacer<Page *> *replacer_ = nullptr;
+  // to collect free pages for replacement
+  std::list<Page *> *free_list_ = nullptr;
+  // frames given back by Resize or the memory budget, not in use
+  std::vector<Page *> parked_;
+  // pages being read by the prefetcher
+  std::unordered_set<page_id_t> loading_;
+  // signaled whenever a page leaves loading_ or cleaner writes complete
+  std::condition_variable loaded_cv_;
+  // page cleaner is between high and low water mark
+  bool cleaning_ = false;
+  // pages marked clean whose write by page cleaner has not completed
+  size_t cleaner_inflight_ = 0;
+  // callers waiting for a frame, signaled whenever one is unpinned or freed
+  size_t frame_waiters_ = 0;
+  std::condition_variable frame_cv_;
+  // protect page table, replacer, free list and loading set of this partition
+  std::mutex latch_;
+  BufferPoolCounters counters_;
+};
+
 class BufferPoolManager {
 public:
-  BufferPoolManager(size_t pool_size, const std::string &db_file);
+  BufferPoolManager(size_t pool_size, const std::string &db_file,
+                    size_t num_partitions = 1,
+                    ReplacerType replacer_type = ReplacerType::LRU,
+                    bool direct_io = false, bool numa_aware = false);
 
   ~BufferPoolManager();
 
@@ -30,23 +249,298 @@ public:
 
   void FlushAllPages();
 
-  Page *NewPage(page_id_t &page_id);
+  // a new page in the tablespace given (see disk_manager.h)
+  Page *NewPage(page_id_t &page_id, int tablespace_id = 0);
+  // a new page of extent
+  Page *NewPage(page_id_t &page_id, PageExtent &extent);
 
   bool DeletePage(page_id_t page_id);
 
+  // FetchPage if that reads nothing: nullptr if page_id is not in the pool
+  // or still being read into it. Pages of a mapped file are always resident
+  Page *FetchPageIfResident(page_id_t page_id);
+
+  // asynchronously read page_id and, when next_page_id is given, up to depth
+  // pages following it in its chain. Prefetched pages are left unpinned.
+  void PrefetchPage(page_id_t page_id, size_t depth = 1,
+                    NextPageIdFunc next_page_id = nullptr);
+
+  inline size_t GetPoolSize() const { return pool_size_; }
+
+  // shrink or grow the frames in use to pool_size, between
+  // BUFFER_POOL_MIN_FRAMES per partition and GetPoolSize. Frames of pinned
+  // pages are given back as they are unpinned and needed. The frames in use
+  size_t Resize(size_t pool_size);
+
+  // frames in use, not parked
+  inline size_t GetFrameCount() const {
+    return frames_.load(std::memory_order_relaxed);
+  }
+
+  inline size_t GetPartitionCount() const { return num_partitions_; }
+
+  inline ReplacerType GetReplacerType() const { return replacer_type_; }
+
+  // NUMA node of the buffers of partition i, -1 if not bound to one
+  inline int GetPartitionNode(size_t i) const {
+    return partitions_[i].numa_node_;
+  }
+
+  // frame buffers come from the reserved huge page pool
+  inline bool IsHugeTLB() const { return arena_->IsHugeTLB(); }
+
+  // serve misses from a read-only mapping of the file, before the first
+  // fetch. False if the file can not be mapped
+  bool EnableMmap();
+
+  inline bool IsMapped() const { return disk_manager_.IsMapped(); }
+
+  // swizzled lookups, see above. Before the pool is shared, false for a
+  // mapped file
+  bool EnableSwizzling();
+
+  inline bool IsSwizzling() const { return swizzle_tables_ != nullptr; }
+
+  // frame swizzled at slot of the frame parent, nullptr if none. Inside an
+  // epoch, the frame may hold any page by now
+  inline Page *GetSwizzled(Page *parent, int slot) {
+    if (slot < 0 || slot >= SWIZZLE_SLOTS)
+      return nullptr;
+    std::atomic<Page *> *table =
+        swizzle_tables_[parent - pages_].load(std::memory_order_acquire);
+    return table == nullptr ? nullptr
+                            : table[slot].load(std::memory_order_relaxed);
+  }
+
+  // remember the pinned child as slot of parent
+  void Swizzle(Page *parent, int slot, Page *child);
+
+  // inside an epoch: true with the version of frame if it holds page_id and
+  // is not being changed. Its data may be read until the version is
+  // validated, the frame is not pinned
+  static inline bool ReadSwizzled(Page *frame, page_id_t page_id,
+                                  uint64_t &version) {
+    version = frame->GetVersion();
+    return (version & 1) == 0 && frame->GetPageId() == page_id;
+  }
+
+  // a thread reading frames it has not pinned, nothing in between may wait
+  // for a buffer pool (fetch, unpin, new page)
+  static void EnterEpoch();
+  static void ExitEpoch();
+
+  // start or retune the background page cleaner
+  void StartPageCleaner(const PageCleanerConfig &config = PageCleanerConfig());
+
+  void StopPageCleaner();
+
+  inline size_t GetCleanedPageCount() const { return cleaned_pages_; }
+
+  // number of write requests issued by page cleaner, after coalescing
+  inline size_t GetCleanerWriteCount() const { return cleaner_writes_; }
+
+  // blocking mode of NewPage and FetchPage, before the pool is shared
+  inline void SetAdmission(const AdmissionConfig &config) {
+    admission_ = config;
+  }
+
+  inline const AdmissionConfig &GetAdmission() const { return admission_; }
+
+  // pages the calling thread has pinned through NewPage and FetchPage of any
+  // pool and not unpinned yet
+  static size_t GetThreadPinCount();
+
+  // enforce write ahead logging for log_manager, nullptr to turn it off
+  inline void SetLogManager(LogManager *log_manager) {
+    log_manager_ = log_manager;
+  }
+
+  inline DiskManager *GetDiskManager() { return &disk_manager_; }
+
+  // (page id, rec lsn) of pages whose changes may not be on disk yet
+  void GetDirtyPageTable(std::vector<std::pair<page_id_t, lsn_t>> &dirty_pages);
+
+  // evictions where LRU-K spared a page referenced K times, 0 for other types
+  size_t GetProtectedEvictionCount();
+
+  // record the page accesses into a ring of capacity records in file_name
+  // (see page_trace.h), replacing a trace running. False if the file can not
+  // be mapped
+  bool StartTrace(const std::string &file_name,
+                  size_t capacity = PAGE_TRACE_CAPACITY);
+  // the records are in the file once it returns, the number written
+  uint64_t StopTrace();
+  inline bool IsTracing() const {
+    return trace_.load(std::memory_order_relaxed) != nullptr;
+  }
+
+  // write the ids of the resident pages into file_name, hottest first (see
+  // above). False if the file can not be written
+  bool DumpHotPages(const std::string &file_name);
+
+  // warm up from the pages listed in file_name and keep it up to date, see
+  // above. A restart replaces the file and interval of one running
+  void StartWarmRestart(
+      const std::string &file_name,
+      std::chrono::milliseconds interval = std::chrono::milliseconds(60000));
+  // dump the list a last time, unless the warm up was still running
+  void StopWarmRestart();
+
+  inline bool IsWarming() const {
+    return warming_.load(std::memory_order_relaxed);
+  }
+
+  // pages read by the warm up
+  inline size_t GetWarmedPageCount() const {
+    return warmed_pages_.load(std::memory_order_relaxed);
+  }
+
+  // sum of the counters of all partitions
+  BufferPoolStats GetStats();
+
+  void ResetStats();
+
 private:
+  inline BufferPoolPartition &GetPartition(page_id_t page_id) {
+    return partitions_[static_cast<size_t>(page_id) % num_partitions_];
+  }
+
+  // latch partition, timing the wait if the latch is taken
+  std::unique_lock<std::mutex> LatchPartition(BufferPoolPartition &partition);
+
+  // fit the partition to its share of the frames wanted, then TakeFrame.
+  // With free_only nullptr rather than evict a page
+  Page *GetVictimPage(BufferPoolPartition &partition, bool free_only = false);
+
+  // free list first, then replacer
+  Page *TakeFrame(BufferPoolPartition &partition);
+
+  // frames partition should have in use, by Resize and the memory budget
+  size_t GetPartitionTarget(const BufferPoolPartition &partition);
+
+  // park frames of partition above target or take parked ones back below
+  // it. Caller must hold the partition latch
+  void FitPartition(BufferPoolPartition &partition, size_t target);
+
+  // in blocking mode wait until a frame of partition may be had or deadline
+  // passes, set on the first wait of a call. False if the caller is not let
+  // wait or the wait timed out
+  bool WaitForFrame(BufferPoolPartition &partition,
+                    std::unique_lock<std::mutex> &guard,
+                    std::chrono::steady_clock::time_point &deadline);
+
+  // wake the waiters of partition, a frame was unpinned or freed
+  inline void ReleaseFrame(BufferPoolPartition &partition) {
+    if (partition.frame_waiters_ > 0)
+      partition.frame_cv_.notify_all();
+  }
+
+  // the frame is changing pages, wait for the swizzled readers that may
+  // have found it. Caller must hold the partition latch
+  void Unswizzle(Page *page);
+
+  inline void Trace(PageTraceEvent event, page_id_t page_id, bool dirty) {
+    if (IsTracing())
+      RecordTrace(event, page_id, dirty);
+  }
+  // the trace is read inside an epoch, StopTrace frees it once no thread
+  // records into it
+  void RecordTrace(PageTraceEvent event, page_id_t page_id, bool dirty);
+
+  // frame for the allocated new_page_id, the id is freed if there is none
+  Page *InstallNewPage(page_id_t new_page_id, page_id_t &page_id);
+
+  // write ahead rule, wait until log records up to lsn are durable
+  void FlushLog(lsn_t lsn);
+
+  // advance rec lsn of page after its image with written_lsn reached disk
+  void MarkWritten(Page *page, lsn_t written_lsn);
+
+  struct PrefetchRequest {
+    page_id_t page_id_;
+    size_t depth_;
+    NextPageIdFunc next_page_id_;
+    // frame being filled and result of the read, for completed requests
+    Page *page_;
+    bool success_;
+  };
+
+  // body of prefetch_thread_
+  void PrefetchWorker();
+
+  // walk resident pages of the chain, start reading the first missing one
+  void StartPrefetch(PrefetchRequest request);
+
+  // reserve a frame of partition for the page of request and queue its read,
+  // the prefetch thread finishes it. read_done runs as the read completes.
+  // Caller must hold the partition latch with guard, it is released unless
+  // there is no frame (see GetVictimPage)
+  bool StartRead(BufferPoolPartition &partition,
+                 std::unique_lock<std::mutex> &guard, PrefetchRequest request,
+                 bool free_only,
+                 const std::function<void(bool success)> &read_done = nullptr);
+
+  // release the frame of a completed read, continue along the chain
+  void FinishPrefetch(const PrefetchRequest &request, bool follow_chain);
+
+  // body of cleaner_thread_
+  void CleanerWorker();
+
+  // body of warm_thread_
+  void WarmWorker();
+
+  // read the pages of page_ids into free frames, hottest first
+  void WarmUp(std::vector<page_id_t> page_ids);
+
+  // write at most budget dirty pages of partition, return pages written
+  size_t CleanPartition(BufferPoolPartition &partition, size_t budget,
+                        const PageCleanerConfig &config);
+
   size_t pool_size_;
-  // array of pages
+  // frames wanted by Resize, and those in use
+  std::atomic<size_t> target_size_;
+  std::atomic<size_t> frames_;
+  size_t num_partitions_;
+  ReplacerType replacer_type_;
+  // array of page descriptors
   Page *pages_;
+  // data buffers of pages_
+  FrameArena *arena_;
   DiskManager disk_manager_;
-  // to keep track of page id and its memory location
-  HashTable<page_id_t, Page *> *page_table_;
-  // to collect unpinned pages for replacement
-  Replacer<Page *> *replacer_;
-  // to collect free pages for replacement
-  std::list<Page *> *free_list_;
-  // to protect shared data structure, you may need it for synchronization
-  // between replacer and page table
-  std::mutex latch_;
+  std::atomic<LogManager *> log_manager_;
+  AdmissionConfig admission_;
+  // array of partitions, each owns a consecutive range of pages_
+  BufferPoolPartition *partitions_;
+  // read-ahead requests, bounded so that a burst can not pile up
+  std::deque<PrefetchRequest> prefetch_queue_;
+  // reads completed but not yet finished by the prefetch thread
+  std::deque<PrefetchRequest> prefetch_done_;
+  size_t prefetch_inflight_;
+  std::mutex prefetch_latch_;
+  std::condition_variable prefetch_cv_;
+  bool stop_prefetch_;
+  std::thread prefetch_thread_;
+  // page access trace, nullptr unless started
+  std::atomic<PageTrace *> trace_{nullptr};
+  // page cleaner, not running unless started
+  PageCleanerConfig cleaner_config_;
+  std::mutex cleaner_latch_;
+  std::condition_variable cleaner_cv_;
+  bool stop_cleaner_;
+  std::thread cleaner_thread_;
+  std::atomic<size_t> cleaned_pages_;
+  std::atomic<size_t> cleaner_writes_;
+  // warm restart, not running unless started
+  std::string warm_file_;
+  std::chrono::milliseconds warm_interval_{0};
+  std::mutex warm_latch_;
+  std::condition_variable warm_cv_;
+  bool stop_warm_ = false;
+  std::thread warm_thread_;
+  std::atomic<bool> warming_{false};
+  std::atomic<size_t> warmed_pages_{0};
+  // swizzle table by frame, created by the first Swizzle of the frame and
+  // kept until the pool is destroyed. nullptr unless swizzling
+  std::atomic<std::atomic<Page *> *> *swizzle_tables_ = nullptr;
 };
 } // namespace cmudb
@@ -0,0 +1,70 @@
+/**
+ * clock_replacer.h
+ *
+ * Functionality: CLOCK (generalized second chance) alternative to LRUReplacer.
+ * Every tracked value owns a slot on a circular clock with a small usage
+ * count. Insert bumps the usage count and marks the slot evictable, Erase
+ * only clears the evictable flag, so neither of them reorders anything: the
+ * hit path is a couple of atomic writes under a shared lock. Victim sweeps the
+ * clock hand, decrementing usage counts until it finds an evictable slot whose
+ * count is exhausted.
+ *
+ * Usage counts saturate at kMaxUsageCount. Pages touched once by a sequential
+ * scan enter with a count of 1 and are reclaimed on the first pass of the
+ * hand, while frequently used pages such as B+ tree internal pages reach the
+ * maximum and survive several passes, so a single scan can not flush them.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "buffer/replacer.h"
+
+namespace cmudb {
+
+template <typename T> class ClockReplacer : public Replacer<T> {
+public:
+  ClockReplacer();
+
+  ~ClockReplacer();
+
+  void Insert(const T &value);
+
+  void InsertPrefetched(const T &value);
+
+  bool Victim(T &value);
+
+  bool Erase(const T &value);
+
+  size_t Size();
+  void GetHotValues(std::vector<T> &values);
+
+  static constexpr uint32_t kMaxUsageCount = 5;
+
+private:
+  struct Slot {
+    Slot(const T &value) : value_(value), usage_count_(0), evictable_(false) {}
+    T value_;
+    std::atomic<uint32_t> usage_count_;
+    std::atomic<bool> evictable_;
+  };
+
+  // slots never move once created, deque keeps references stable
+  std::deque<Slot> slots_;
+  // value -> position within slots_
+  std::unordered_map<T, size_t> index_;
+  // position of clock hand within slots_
+  size_t hand_;
+  // number of evictable slots
+  std::atomic<size_t> size_;
+  // shared for Insert/Erase of known values, exclusive for new values and
+  // the clock sweep
+  std::shared_timed_mutex latch_;
+};
+
+} // namespace cmudb
@@ -0,0 +1,55 @@
+/**
+ * frame_arena.h
+ *
+ * Memory of the data buffers of the buffer pool, one anonymous mapping in
+ * huge page (2 MB) units. It is taken from the huge page pool when the system
+ * has one reserved, otherwise transparent huge pages are asked for. Every
+ * data buffer is PAGE_SIZE aligned, so direct I/O needs no bounce buffer.
+ *
+ * The arena is cut into slices, one per buffer pool partition, each starting
+ * on a huge page boundary. A slice can be bound to a NUMA node before it is
+ * touched, its memory is then preferably allocated on that node.
+ *
+ * Release gives the memory of a buffer back to the system, it reads as
+ * zeros when touched again. Memory of the huge page pool is kept.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace cmudb {
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+class FrameArena {
+public:
+  // slice i holds slice_pages[i] data buffers
+  explicit FrameArena(const std::vector<size_t> &slice_pages);
+  ~FrameArena();
+
+  // first data buffer of slice i
+  inline char *GetSlice(size_t i) const { return slices_[i]; }
+
+  // prefer node for the memory of slice i, false if it can not be bound
+  bool BindSlice(size_t i, int node);
+
+  // return the memory of size bytes at data, PAGE_SIZE aligned, to the
+  // system. False if it is kept
+  bool Release(char *data, size_t size);
+
+  // memory comes from the reserved huge page pool
+  inline bool IsHugeTLB() const { return huge_tlb_; }
+
+  // number of configured NUMA nodes, 1 without NUMA support
+  static int GetNodeCount();
+
+private:
+  char *memory_;
+  size_t size_;
+  bool huge_tlb_;
+  std::vector<char *> slices_;
+  std::vector<size_t> slice_sizes_;
+};
+
+} // namespace cmudb
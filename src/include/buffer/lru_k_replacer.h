@@ -0,0 +1,72 @@
+/**
+ * lru_k_replacer.h
+ *
+ * Functionality: LRU-K replacement policy (K = 2 by default). The replacer
+ * remembers the timestamps of the last K references (Insert calls) of every
+ * value and evicts the value whose K-th most recent reference is the oldest.
+ * Values referenced fewer than K times have an infinite backward K-distance
+ * and are always evicted first, oldest first reference first.
+ *
+ * A full table scan touches each heap page once, so those pages never leave
+ * the history queue and are reclaimed before B+ tree pages that point queries
+ * keep referencing. Pages brought in by read-ahead do not count as referenced
+ * until they are really used. Every eviction that spared such a page is counted, see
+ * GetProtectedCount.
+ */
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "buffer/replacer.h"
+
+namespace cmudb {
+
+template <typename T> class LRUKReplacer : public Replacer<T> {
+public:
+  LRUKReplacer(size_t k = 2);
+
+  ~LRUKReplacer();
+
+  void Insert(const T &value);
+
+  void InsertPrefetched(const T &value);
+
+  bool Victim(T &value);
+
+  bool Erase(const T &value);
+
+  size_t Size();
+  void GetHotValues(std::vector<T> &values);
+
+  // number of victims taken from history queue while cache queue was not empty
+  size_t GetProtectedCount();
+
+private:
+  struct Entry {
+    // timestamps of last k references, oldest at front
+    std::deque<uint64_t> history_;
+    bool evictable_ = false;
+    // only referenced by read-ahead, history restarts on first real reference
+    bool prefetched_ = false;
+  };
+
+  // queue an evictable entry is kept in
+  std::map<uint64_t, T> &GetQueue(const Entry &entry);
+
+  size_t k_;
+  // logical clock, one tick per reference
+  uint64_t current_timestamp_;
+  size_t protected_count_;
+  std::unordered_map<T, Entry> entries_;
+  // evictable values with less than k references, keyed by first reference
+  std::map<uint64_t, T> history_queue_;
+  // evictable values with k references, keyed by k-th most recent reference
+  std::map<uint64_t, T> cache_queue_;
+  std::mutex latch_;
+};
+
+} // namespace cmudb
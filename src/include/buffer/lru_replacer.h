@@ -9,6 +9,9 @@
 
 #pragma once
 
+#include <list>
+#include <mutex>
+
 #include "buffer/replacer.h"
 #include "hash/extendible_hash.h"
 
@@ -28,9 +31,14 @@ public:
   bool Erase(const T &value);
 
   size_t Size();
+  void GetHotValues(std::vector<T> &values);
 
 private:
-  // add your member variables here
+  // most recently inserted at front, victims are taken from back
+  std::list<T> lru_list_;
+  // value -> position within lru_list_
+  ExtendibleHash<T, typename std::list<T>::iterator> index_;
+  std::mutex latch_;
 };
 
 } // namespace cmudb
@@ -0,0 +1,109 @@
+/**
+ * page_trace.h
+ *
+ * Trace of the page accesses of a buffer pool, to pick a replacement policy
+ * and pool size offline. Every fetch, unpin, new and deleted page is a 16
+ * byte record (24 with WIDE_PAGE_IDS) in a ring mapped from a file: a
+ * header, then capacity records.
+ * Record n goes to slot n % capacity, a full ring keeps the latest ones.
+ * Writers take their slot with one atomic add and never wait, the file is
+ * written back by the kernel.
+ *
+ * ReplayPageTrace runs a trace against a Replacer over a pool of a given
+ * size, pinning and unpinning as the buffer pool did, and counts the
+ * fetches it would have served from the pool.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "buffer/replacer.h"
+#include "common/config.h"
+
+namespace cmudb {
+
+// records of a trace file unless asked otherwise, 16MB
+#define PAGE_TRACE_CAPACITY (1 << 20)
+// "PGTRACE1" little endian, "PGTRACE2" for wide page ids
+#ifdef WIDE_PAGE_IDS
+#define PAGE_TRACE_MAGIC 0x3245434152544750ULL
+#else
+#define PAGE_TRACE_MAGIC 0x3145434152544750ULL
+#endif
+
+enum class PageTraceEvent : uint8_t { FETCH = 0, UNPIN, NEW, DELETE };
+
+struct PageTraceRecord {
+  // since the trace started
+  uint64_t time_ns_;
+  page_id_t page_id_;
+  uint8_t event_;
+  // an unpin that dirtied the page, a new page
+  uint8_t dirty_;
+  uint16_t reserved_;
+};
+
+static_assert(sizeof(PageTraceRecord) == 8 + 2 * sizeof(page_id_t),
+              "trace records are 16 bytes, 24 with wide page ids");
+
+class PageTrace {
+public:
+  PageTrace() {}
+  ~PageTrace();
+
+  // map a ring of capacity records in file_name, which is truncated. False
+  // if it can not be
+  bool Open(const std::string &file_name, size_t capacity);
+
+  void Record(PageTraceEvent event, page_id_t page_id, bool dirty);
+
+  // records written, the ring holds the last capacity of them
+  inline uint64_t GetRecordCount() const {
+    return header_->count_.load(std::memory_order_relaxed);
+  }
+
+  // the records a trace file holds, oldest first. False if it is no trace
+  static bool Read(const std::string &file_name,
+                   std::vector<PageTraceRecord> &records);
+
+private:
+  struct Header {
+    uint64_t magic_;
+    uint64_t capacity_;
+    std::atomic<uint64_t> count_;
+    uint64_t reserved_;
+  };
+
+  Header *header_ = nullptr;
+  PageTraceRecord *records_ = nullptr;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// what a pool would have done for a trace
+struct ReplaySummary {
+  uint64_t fetches_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t new_pages_ = 0;
+  uint64_t evictions_ = 0;
+  // fetches and new pages finding every frame pinned
+  uint64_t pin_failures_ = 0;
+
+  inline double GetHitRate() const {
+    return fetches_ == 0 ? 0 : static_cast<double>(hits_) / fetches_;
+  }
+};
+
+// replay records over pool_size frames, replacer holds the unpinned pages.
+// Pages pinned before the trace began are not known, their unpins are
+// skipped
+ReplaySummary ReplayPageTrace(const std::vector<PageTraceRecord> &records,
+                              Replacer<page_id_t> &replacer,
+                              size_t pool_size);
+
+} // namespace cmudb
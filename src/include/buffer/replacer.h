@@ -6,6 +6,7 @@
 #pragma once
 
 #include <cstdlib>
+#include <vector>
 
 namespace cmudb {
 
@@ -17,6 +18,10 @@ public:
   virtual bool Victim(T &value) = 0;
   virtual bool Erase(const T &value) = 0;
   virtual size_t Size() = 0;
+  // insert a page brought in by read-ahead, it has not been referenced yet
+  virtual void InsertPrefetched(const T &value) { Insert(value); }
+  // the values that can be evicted, the one Victim would take last first
+  virtual void GetHotValues(std::vector<T> &values) = 0;
 };
 
 } // namespace cmudb
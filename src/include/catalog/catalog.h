@@ -0,0 +1,68 @@
+/**
+ * catalog.h
+ *
+ * Root page ids of the tables and indexes by name. They are kept in the
+ * records of the header page and of the header pages chained behind it, see
+ * page/header_page.h; a database has one chain and one catalog over it.
+ *
+ * The records of the whole chain are read once when the catalog is opened
+ * and looked up in memory after that, so finding a table costs the same
+ * however many the database has. Changes are written through to the page
+ * holding the record, a record that fits no page goes into a new one at the
+ * end of the chain. Header pages are never released, a deleted record leaves
+ * room for a later one.
+ *
+ * Changes are not logged, the page holding a record is written to disk
+ * before the change returns. A page a record names is for its owner to
+ * write first.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+
+namespace cmudb {
+
+class Catalog {
+public:
+  // the header page must exist already
+  explicit Catalog(BufferPoolManager *buffer_pool_manager);
+
+  // false if a record of name exists already
+  bool InsertRecord(const std::string &name, page_id_t root_id);
+  bool DeleteRecord(const std::string &name);
+  bool UpdateRecord(const std::string &name, page_id_t root_id);
+
+  // return root_id if success
+  bool GetRootId(const std::string &name, page_id_t &root_id);
+  // names of the records starting with prefix
+  void GetNames(const std::string &prefix, std::vector<std::string> &names);
+  size_t GetRecordCount();
+
+  // header pages of the chain
+  inline size_t GetPageCount() {
+    std::lock_guard<std::mutex> guard(latch_);
+    return page_ids_.size();
+  }
+
+private:
+  struct Record {
+    page_id_t root_id_;
+    // index into page_ids_ of the page holding it
+    size_t page_;
+  };
+
+  BufferPoolManager *buffer_pool_manager_;
+  std::unordered_map<std::string, Record> records_;
+  // the chain from the header page on, with the records of each page
+  std::vector<page_id_t> page_ids_;
+  std::vector<int> record_counts_;
+  std::mutex latch_;
+};
+
+} // namespace cmudb
@@ -1,5 +1,10 @@
 /**
  * schema.h
+ *
+ * Besides its columns a schema keeps a compact access plan: per column the
+ * offset, width and type the tuple bytes are read with, worked out once
+ * when it is built. Decoding a tuple is a loop over the plan that never
+ * touches the Column objects and their names.
  */
 
 #pragma once
@@ -12,6 +17,16 @@
 
 namespace cmudb {
 
+// how one column is read from the bytes of a tuple
+struct ColumnAccess {
+  // of the value, or of the 32 bit offset of [length][bytes] for a varchar
+  uint32_t offset_;
+  // bytes of the value, of the offset for a varchar
+  uint32_t width_;
+  TypeId type_;
+  bool inlined_;
+};
+
 class Schema {
 public:
   //===--------------------------------------------------------------------===//
@@ -33,11 +48,11 @@ public:
   //===--------------------------------------------------------------------===//
 
   inline int32_t GetOffset(const int column_id) const {
-    return columns[column_id].GetOffset();
+    return access_[column_id].offset_;
   }
 
   inline TypeId GetType(const int column_id) const {
-    return columns[column_id].GetType();
+    return access_[column_id].type_;
   }
 
   // Return appropriate length based on whether column is inlined
@@ -64,13 +79,22 @@ public:
   }
 
   inline bool IsInlined(const int column_id) const {
-    return columns[column_id].IsInlined();
+    return access_[column_id].inlined_;
   }
 
-  inline const Column GetColumn(const int column_id) const {
+  inline const Column &GetColumn(const int column_id) const {
     return columns[column_id];
   }
 
+  inline const ColumnAccess &GetAccess(const int column_id) const {
+    return access_[column_id];
+  }
+
+  // access of every column, in column order
+  inline const std::vector<ColumnAccess> &GetAccessPlan() const {
+    return access_;
+  }
+
   // column id start with 0
   inline int GetColumnID(std::string col_name) const {
     int i;
@@ -111,6 +135,9 @@ private:
   // all inlined and uninlined columns in the tuple
   std::vector<Column> columns;
 
+  // how each of columns is read
+  std::vector<ColumnAccess> access_;
+
   // are all columns inlined
   bool tuple_is_inlined;
 
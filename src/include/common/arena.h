@@ -0,0 +1,60 @@
+/**
+ * arena.h
+ *
+ * Bump allocator for short lived row data. Tuples built for one row of a
+ * statement or for the keys of a cursor are carved out of large chunks and
+ * released together by Reset, instead of a new and a delete each. Reset
+ * keeps the chunks, so a steady workload stops allocating after its first
+ * rows.
+ *
+ * Not thread safe, every statement or cursor has its own.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace cmudb {
+
+#define ARENA_CHUNK_SIZE (32 * 1024)
+// allocations are aligned to this
+#define ARENA_ALIGNMENT 8
+
+class Arena {
+public:
+  explicit Arena(size_t chunk_size = ARENA_CHUNK_SIZE);
+  ~Arena();
+
+  // size bytes valid until the next Reset
+  inline char *Allocate(size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (size > static_cast<size_t>(limit_ - cursor_))
+      return AllocateSlow(size);
+    char *data = cursor_;
+    cursor_ += size;
+    return data;
+  }
+
+  // release every allocation, chunks are kept for the next ones
+  void Reset();
+
+  inline size_t GetChunkCount() const { return chunks_.size(); }
+
+private:
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  // next chunk, or a block of its own for sizes above a quarter chunk
+  char *AllocateSlow(size_t size);
+
+  size_t chunk_size_;
+  std::vector<char *> chunks_;
+  // blocks of large allocations, freed by Reset
+  std::vector<char *> blocks_;
+  // index of the chunk cursor_ is in
+  size_t current_ = 0;
+  char *cursor_ = nullptr;
+  char *limit_ = nullptr;
+};
+
+} // namespace cmudb
@@ -10,11 +10,22 @@ namespace cmudb {
 
 #define INVALID_PAGE_ID -1 // representing an invalid page id
 #define INVALID_TXN_ID -1  // representing an invalid txn id
+#define INVALID_LSN -1     // representing an invalid lsn
 #define HEADER_PAGE_ID 0   // the header page id
-#define PAGE_SIZE 4096     // size of a data page in byte
-#define BUCKET_SIZE 50     // size of extendible hash bucket
+#ifndef PAGE_SIZE
+#define PAGE_SIZE 4096 // size of a data page in byte, set by cmake
+#endif
+#define BUCKET_SIZE 8      // size of extendible hash bucket, scanned linearly
 
+#ifdef WIDE_PAGE_IDS
+typedef int64_t page_id_t; // page id type, set by cmake
+#define PAGE_ID_BITS 47    // bits of a valid page id, a RID keeps 16 for slots
+#else
 typedef int32_t page_id_t; // page id type
+#define PAGE_ID_BITS 31    // bits of a valid page id
+#endif
 typedef int32_t txn_id_t;  // transaction id type
+typedef int32_t lsn_t;     // log sequence number type
+typedef uint64_t timestamp_t; // commit timestamp type
 
 } // namespace cmudb
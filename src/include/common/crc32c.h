@@ -0,0 +1,19 @@
+/**
+ * crc32c.h
+ *
+ * CRC-32C (Castagnoli), the checksum of pages on disk. With SSE4.2 or the
+ * ARMv8 CRC extension it runs on the crc32 instructions, eight bytes at a
+ * time, otherwise on a table of 256 entries a byte at a time.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cmudb {
+
+// of size bytes at data, continuing from the crc of the bytes before them
+uint32_t Crc32c(const char *data, size_t size, uint32_t crc = 0);
+
+} // namespace cmudb
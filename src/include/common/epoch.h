@@ -0,0 +1,30 @@
+/**
+ * epoch.h
+ *
+ * Epoch based reclamation for readers that take no latch. A reader enters
+ * an epoch before it follows a pointer others may unlink and exits once it
+ * no longer uses what it read. A writer unlinks first, then Synchronize
+ * returns once every thread inside an epoch it entered before the call has
+ * left it, whatever was unlinked can be freed or reused then.
+ *
+ * Threads register a slot on their first epoch. The slots are shared by
+ * every user in the process, a reader inside an epoch must not wait for a
+ * thread that may synchronize.
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace cmudb {
+
+class Epoch {
+public:
+  static void Enter();
+  static void Exit();
+
+  // wait for the readers inside from before, not for those entering after.
+  // The calling thread must be outside
+  static void Synchronize();
+};
+
+} // namespace cmudb
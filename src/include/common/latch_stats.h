@@ -0,0 +1,88 @@
+/**
+ * latch_stats.h
+ *
+ * Latch contention profile, off unless enabled at run time. Enabled, every
+ * acquisition of a profiled latch is counted by its class, one that has to
+ * wait also adds its wait time. Contended waits on page latches are sampled,
+ * one in sample_rate per thread, into a table of page ids weighted by the
+ * rate, so the hottest pages are known without a map update on every wait.
+ *
+ * Counters are kept per thread like those of LatencyStats. Disabled, a
+ * latch pays a relaxed load of the enabled flag and nothing else.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "common/config.h"
+
+namespace cmudb {
+
+enum class LatchClass {
+  BUFFER_POOL = 0, // partition latches of the buffer pool manager
+  PAGE,            // rwlatch_ of the pages
+  LOCK_MANAGER,    // partition latches of the lock table
+  NUM_CLASSES
+};
+
+#define LATCH_CLASSES static_cast<int>(LatchClass::NUM_CLASSES)
+// one in this many contended page latch waits of a thread is sampled
+#define LATCH_SAMPLE_RATE 16
+
+// totals of one latch class, a snapshot taken by GetStats
+struct LatchClassStats {
+  uint64_t acquires_ = 0;
+  // acquisitions that found the latch taken
+  uint64_t waits_ = 0;
+  uint64_t wait_ns_ = 0;
+};
+
+// a contended page, estimated from the sampled waits
+struct HotPage {
+  page_id_t page_id_;
+  uint64_t waits_;
+  uint64_t wait_ns_;
+};
+
+class LatchStats {
+public:
+  // turning profiling on clears what was recorded before
+  static void Enable(bool enabled, size_t sample_rate = LATCH_SAMPLE_RATE);
+  static inline bool IsEnabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // record into the counters of the calling thread. A wait on a page latch
+  // names the page
+  static void RecordAcquire(LatchClass latch_class);
+  static void RecordWait(LatchClass latch_class, uint64_t ns,
+                         page_id_t page_id = INVALID_PAGE_ID);
+
+  // latch mutex, counted as latch_class, try_lock first so an uncontended
+  // latch reads no clock
+  static std::unique_lock<std::mutex> Lock(LatchClass latch_class,
+                                           std::mutex &mutex);
+
+  // merged over all threads
+  static LatchClassStats GetStats(LatchClass latch_class);
+
+  // the count pages with the most sampled wait time, most first
+  static std::vector<HotPage> GetHotPages(size_t count);
+
+  static void Reset();
+
+  // e.g. "buffer_pool"
+  static const char *GetName(LatchClass latch_class);
+
+  // counters of every class and the hottest pages through LOG_INFO
+  static void Log();
+
+private:
+  static std::atomic<bool> enabled_;
+};
+
+} // namespace cmudb
@@ -0,0 +1,97 @@
+/**
+ * latency_stats.h
+ *
+ * Latency histograms of hot paths. Buckets are log-linear like HDR
+ * histograms: values below 8 ns have a bucket each, above that every power
+ * of two is split into 8 buckets, so a value is known within 12.5%.
+ *
+ * Every thread records into its own buckets, a plain load and store with no
+ * atomic read-modify-write and no shared cache line. GetHistogram merges the
+ * buckets of all threads on demand, those of exited threads are kept.
+ *
+ * Built without LATENCY_STATS (cmake -DLATENCY_STATS=OFF) LATENCY_TIMER
+ * expands to nothing and the hot paths read no clock.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace cmudb {
+
+enum class LatencyType {
+  DISK_READ = 0,
+  DISK_WRITE,
+  BTREE_INSERT,
+  BTREE_GET_VALUE,
+  BTREE_REMOVE,
+  LOCK_WAIT,
+  NUM_TYPES
+};
+
+#define LATENCY_TYPES static_cast<int>(LatencyType::NUM_TYPES)
+// 8 buckets below 8 ns, then 8 for each power of two up to 2^63
+#define LATENCY_SUB_BUCKETS 8
+#define LATENCY_BUCKETS (LATENCY_SUB_BUCKETS * 62)
+
+class LatencyHistogram {
+public:
+  void Add(uint64_t ns, uint64_t count = 1);
+  void Merge(const LatencyHistogram &other);
+
+  inline uint64_t GetCount() const { return count_; }
+  inline uint64_t GetSum() const { return sum_; }
+  // upper bound of the bucket holding the given fraction of the values
+  uint64_t GetPercentile(double fraction) const;
+  inline uint64_t GetMax() const { return GetPercentile(1.0); }
+
+  static int GetBucket(uint64_t ns);
+  // largest value falling in bucket
+  static uint64_t GetBucketLimit(int bucket);
+
+  uint64_t buckets_[LATENCY_BUCKETS] = {};
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+};
+
+class LatencyStats {
+public:
+  // record into the buckets of the calling thread
+  static void Record(LatencyType type, uint64_t ns);
+
+  // merged over all threads
+  static LatencyHistogram GetHistogram(LatencyType type);
+
+  static void Reset();
+
+  // e.g. "disk_read"
+  static const char *GetName(LatencyType type);
+
+  // count, percentiles and max of every type through LOG_INFO
+  static void Log();
+};
+
+// record the lifetime of the timer
+class LatencyTimer {
+public:
+  explicit LatencyTimer(LatencyType type)
+      : type_(type), start_(std::chrono::steady_clock::now()) {}
+  ~LatencyTimer() {
+    LatencyStats::Record(type_,
+                         std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start_)
+                             .count());
+  }
+
+private:
+  LatencyType type_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+#ifdef LATENCY_STATS
+#define LATENCY_TIMER(type) LatencyTimer latency_timer(type)
+#else
+#define LATENCY_TIMER(type)
+#endif
+
+} // namespace cmudb
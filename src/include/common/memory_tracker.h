@@ -0,0 +1,72 @@
+/**
+ * memory_tracker.h
+ *
+ * Memory accounting of the process by component, against an optional
+ * budget. Components charge the bytes they allocate and release them as
+ * they free them: the frames of the buffer pools, the lock table, the undo
+ * sets of transactions, execution operators and materialized results.
+ *
+ * A charge goes to a counter of the calling thread and is added to the
+ * totals once it exceeds MEMORY_CHARGE_BATCH either way, so the totals are
+ * off by less than that per thread and a small charge costs no shared
+ * write. The process is over budget once the totals exceed it: the buffer
+ * pools give frames back until they fit in what the other components leave
+ * (see BufferPoolManager), operators spill earlier (see radix_partitions.h).
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace cmudb {
+
+enum class MemoryComponent {
+  BUFFER_POOL = 0, // frames of the buffer pools in use
+  PAGE_CACHE,      // compressed pages of disk managers
+  LOCK_TABLE,      // requests and queues of the lock managers
+  TRANSACTION,     // write sets of transactions, tuple images included
+  EXECUTION,       // records operators keep in memory
+  CURSOR,          // results materialized for cursors
+  NUM_COMPONENTS
+};
+
+#define MEMORY_COMPONENTS static_cast<int>(MemoryComponent::NUM_COMPONENTS)
+// bytes a thread charges or releases before they are added to the totals
+#define MEMORY_CHARGE_BATCH (64 * 1024)
+
+class MemoryTracker {
+public:
+  static void Charge(MemoryComponent component, size_t bytes);
+  static void Release(MemoryComponent component, size_t bytes);
+
+  // add what the calling thread charged to the totals now
+  static void Flush();
+
+  static size_t GetUsage(MemoryComponent component);
+  static size_t GetTotalUsage();
+
+  // bytes the process should stay within, 0 for no budget
+  static void SetBudget(size_t bytes);
+  static inline size_t GetBudget() {
+    return budget_.load(std::memory_order_relaxed);
+  }
+
+  // the totals exceed the budget, a relaxed load
+  static inline bool IsOverBudget() {
+    return over_budget_.load(std::memory_order_relaxed);
+  }
+
+  // e.g. "buffer_pool"
+  static const char *GetName(MemoryComponent component);
+
+private:
+  static void Add(MemoryComponent component, int64_t bytes);
+  static void UpdateOverBudget();
+
+  static std::atomic<int64_t> usage_[MEMORY_COMPONENTS];
+  static std::atomic<size_t> budget_;
+  static std::atomic<bool> over_budget_;
+};
+
+} // namespace cmudb
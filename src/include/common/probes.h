@@ -0,0 +1,59 @@
+/**
+ * probes.h
+ *
+ * Static tracepoints (USDT) of the hot paths, for bpftrace, perf or
+ * systemtap to attach to in a running process, e.g.
+ *   bpftrace -e 'usdt:lib/libvtable.so:cmudb:page_miss { @[arg0] = count(); }'
+ * A probe is a nop in the code and a note in the ELF file naming its
+ * arguments, a tracer attached patches the nop. Arguments are evaluated
+ * either way, they are values at hand.
+ *
+ * Built with the USDT_PROBES cmake option when <sys/sdt.h> is found
+ * (systemtap-sdt-dev), otherwise the probes compile to nothing.
+ *
+ * Probes of provider cmudb:
+ *   page_hit(page_id)                  FetchPage found the page resident
+ *   page_miss(page_id)                 FetchPage takes a frame to read it
+ *   page_evict(page_id, dirty)         a victim leaves its frame
+ *   disk_read_start(page_id)
+ *   disk_read_done(page_id, bytes)     bytes read, below 0 on error
+ *   disk_write_start(page_id, pages)   pages written from page_id on
+ *   disk_write_done(page_id, bytes)    bytes written, below 0 on error
+ *   btree_split(page_id, new_page_id)  the upper half went to new_page_id
+ *   btree_merge(page_id, right_page_id) the right page went into page_id
+ *   lock_wait_start(txn_id, page_id, slot, mode)
+ *   lock_wait_done(txn_id, page_id, slot, granted)
+ *   txn_commit_start(txn_id), txn_commit_done(txn_id)
+ *   txn_abort_start(txn_id), txn_abort_done(txn_id)
+ */
+#pragma once
+
+#ifdef USDT_PROBES
+
+#include <sys/sdt.h>
+
+#define CMUDB_PROBE1(name, a) DTRACE_PROBE1(cmudb, name, a)
+#define CMUDB_PROBE2(name, a, b) DTRACE_PROBE2(cmudb, name, a, b)
+#define CMUDB_PROBE4(name, a, b, c, d) DTRACE_PROBE4(cmudb, name, a, b, c, d)
+
+#else
+
+// the arguments are not evaluated, only kept from warnings of unused values
+#define CMUDB_PROBE1(name, a)                                                  \
+  do {                                                                         \
+    (void)sizeof(a);                                                           \
+  } while (0)
+#define CMUDB_PROBE2(name, a, b)                                               \
+  do {                                                                         \
+    (void)sizeof(a);                                                           \
+    (void)sizeof(b);                                                           \
+  } while (0)
+#define CMUDB_PROBE4(name, a, b, c, d)                                         \
+  do {                                                                         \
+    (void)sizeof(a);                                                           \
+    (void)sizeof(b);                                                           \
+    (void)sizeof(c);                                                           \
+    (void)sizeof(d);                                                           \
+  } while (0)
+
+#endif
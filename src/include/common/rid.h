@@ -11,15 +11,36 @@
 
 namespace cmudb {
 
+// low bits of a packed RID holding the slot, the rest hold the page id
+#ifdef WIDE_PAGE_IDS
+#define RID_SLOT_BITS 16
+typedef int16_t rid_slot_t;
+#else
+#define RID_SLOT_BITS 32
+typedef int32_t rid_slot_t;
+#endif
+static_assert(PAGE_ID_BITS + RID_SLOT_BITS < 64, "RID packs into 64 bits");
+static_assert(PAGE_SIZE >> 3 < (1LL << (RID_SLOT_BITS - 1)),
+              "RID packs every slot of a page");
+
 class RID {
 public:
   RID() : page_id_(INVALID_PAGE_ID), slot_num_(-1){}; // invalid rid
   RID(page_id_t page_id, int slot_num)
       : page_id_(page_id), slot_num_(slot_num){};
 
-  RID(int64_t rid) : page_id_(rid >> 32), slot_num_(rid){};
-
-  inline int64_t Get() const { return ((int64_t)page_id_) << 32 | slot_num_; }
+  RID(int64_t rid)
+      : page_id_(rid >> RID_SLOT_BITS),
+        slot_num_(static_cast<rid_slot_t>(rid)){};
+
+  // page id in the high bits, slot in the low RID_SLOT_BITS. The halves of
+  // 32-bit page ids, wide ones leave a slot 16 bits
+  inline int64_t Get() const {
+    return static_cast<int64_t>(
+        static_cast<uint64_t>(page_id_) << RID_SLOT_BITS |
+        (static_cast<uint64_t>(slot_num_) &
+         ((static_cast<uint64_t>(1) << RID_SLOT_BITS) - 1)));
+  }
 
   inline page_id_t GetPageId() const { return page_id_; }
 
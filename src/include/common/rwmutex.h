@@ -2,12 +2,21 @@
  * rwmutex.h
  *
  * Reader-Writer lock
+ *
+ * RWLatch is the compact one of Page: a single 32 bit word holding the
+ * reader count and a writer, a waiting writer and a parked flag. Readers
+ * and writers that find it free take it with one compare and swap. A
+ * contended latch is spun on briefly, then its waiters sleep on the word
+ * with a futex and the unlock that sees the parked flag wakes them all. A
+ * waiting writer keeps new readers out, as RWMutex does.
  */
 
 #pragma once
 
+#include <atomic>
 #include <climits>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
 
 namespace cmudb {
@@ -34,6 +43,15 @@ public:
       writer_.wait(lock);
   }
 
+  // WLock if no one holds or waits for the lock, else false at once
+  bool TryWLock() {
+    std::lock_guard<mutex_t> guard(mutex_);
+    if (writer_entered_ || reader_count_ > 0)
+      return false;
+    writer_entered_ = true;
+    return true;
+  }
+
   void WUnlock() {
     std::lock_guard<mutex_t> guard(mutex_);
     writer_entered_ = false;
@@ -66,4 +84,78 @@ private:
   uint32_t reader_count_;
   bool writer_entered_;
 };
+
+class RWLatch {
+  static const uint32_t writer_ = 1u << 31;
+  static const uint32_t writer_waiting_ = 1u << 30;
+  static const uint32_t parked_ = 1u << 29;
+  static const uint32_t readers_ = parked_ - 1;
+
+public:
+  RWLatch() : state_(0) {}
+
+  RWLatch(const RWLatch &) = delete;
+  RWLatch &operator=(const RWLatch &) = delete;
+
+  inline void WLock() {
+    uint32_t state = 0;
+    if (!state_.compare_exchange_weak(state, writer_,
+                                      std::memory_order_acquire,
+                                      std::memory_order_relaxed))
+      WLockSlow();
+  }
+
+  // WLock if no one holds or waits for the latch, else false at once
+  inline bool TryWLock() {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    return (state & ~parked_) == 0 &&
+           state_.compare_exchange_strong(state, state | writer_,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed);
+  }
+
+  inline void WUnlock() {
+    if (state_.fetch_and(~(writer_ | parked_), std::memory_order_release) &
+        parked_)
+      Wake();
+  }
+
+  inline void RLock() {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    if ((state & (writer_ | writer_waiting_)) != 0 ||
+        (state & readers_) == readers_ ||
+        !state_.compare_exchange_weak(state, state + 1,
+                                      std::memory_order_acquire,
+                                      std::memory_order_relaxed))
+      RLockSlow();
+  }
+
+  // RLock unless that would wait
+  inline bool TryRLock() {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    return (state & (writer_ | writer_waiting_)) == 0 &&
+           (state & readers_) != readers_ &&
+           state_.compare_exchange_strong(state, state + 1,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed);
+  }
+
+  // the last reader out wakes a parked writer
+  inline void RUnlock() {
+    uint32_t state = state_.fetch_sub(1, std::memory_order_release);
+    if ((state & readers_) == 1 && (state & parked_) != 0) {
+      state_.fetch_and(~parked_, std::memory_order_relaxed);
+      Wake();
+    }
+  }
+
+private:
+  void WLockSlow();
+  void RLockSlow();
+  // park until the word is no longer state, which has parked_ set
+  void Park(uint32_t state);
+  void Wake();
+
+  std::atomic<uint32_t> state_;
+};
 } // namespace cmudb
@@ -1,26 +1,92 @@
 /**
  * lock_manager.h
  *
- * Tuple level lock manager, use wait-die to prevent deadlocks
+ * Hierarchical lock manager, use wait-die to prevent deadlocks unless
+ * deadlock detection runs
+ *
+ * A row of a known table is locked under intention locks on its table and
+ * page: IS on both before S, IX before X. A table or page lock a transaction
+ * already holds covers the rows below it, a transaction holding more than
+ * the escalation threshold of row locks on a table trades them for one S or
+ * X lock on the table if that is granted right away. Without a table the
+ * rid is locked alone. Table and page locks are queued in the same table as
+ * rows, under rids of slots no tuple has.
+ *
+ * The lock table is hash partitioned by rid, every partition has its own
+ * latch and map of rids to their request queues, so that transactions
+ * locking different rows rarely share a mutex. A queue lists the requests
+ * on one rid in arrival order with a condition variable its waiters sleep
+ * on. A request is granted once every request ahead of it is compatible
+ * with it, requests of its own transaction aside. A stronger request of a
+ * transaction already holding a lock, an upgrade, queues at the tail and
+ * the lock it upgrades is kept until it is granted.
+ *
+ * Wait-die: a transaction only waits for requests ahead of it that are all
+ * younger (larger id) than itself, otherwise it is aborted. Waits only go
+ * from older to younger transactions and can not form a cycle.
+ *
+ * Deadlock detection: while the detection thread runs, requests wait for any
+ * request ahead. Every interval it builds the waits-for graph of all queues
+ * under every partition latch and wakes the youngest transaction of each
+ * cycle, whose request fails and leaves its queue. Transactions that wait
+ * without a cycle are not aborted.
+ *
+ * Requests and queues are charged as MemoryComponent::LOCK_TABLE, a request
+ * with the entry of its rid in the lock sets of its transaction.
  */
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <list>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
+#include "common/latch_stats.h"
+#include "common/memory_tracker.h"
 #include "common/rid.h"
 #include "concurrency/transaction.h"
 
 namespace cmudb {
 
+// partitions of the lock table, a power of two
+#define LOCK_TABLE_PARTITIONS 64
+// row locks a transaction holds on a table before they are escalated
+#define LOCK_ESCALATION_THRESHOLD 1024
+// slots of the rids table and page locks are queued under
+#define TABLE_LOCK_SLOT 0x7ffffffe
+#define PAGE_LOCK_SLOT 0x7fffffff
+// how often the detection thread looks for deadlocks
+#define DEADLOCK_DETECTION_INTERVAL std::chrono::milliseconds(10)
+
+// transactions aborted by the lock manager, by cause, a snapshot taken by
+// GetStats
+struct LockStats {
+  // requests dying under wait-die
+  uint64_t wait_die_aborts_ = 0;
+  // victims of the cycles found by deadlock detection
+  uint64_t deadlock_aborts_ = 0;
+  // lock requests once the growing phase is over
+  uint64_t state_aborts_ = 0;
+  // unlocks before commit or abort under strict 2PL
+  uint64_t unlock_aborts_ = 0;
+};
+
 class LockManager {
 
 public:
-  LockManager(bool strict_2PL) : strict_2PL_(strict_2PL){};
+  LockManager(bool strict_2PL,
+              size_t escalation_threshold = LOCK_ESCALATION_THRESHOLD)
+      : strict_2PL_(strict_2PL), escalation_threshold_(escalation_threshold),
+        detecting_(false), interval_(DEADLOCK_DETECTION_INTERVAL),
+        stop_thread_(false){};
+
+  ~LockManager() { StopDeadlockDetection(); }
 
   /*** below are APIs need to implement ***/
   // lock:
@@ -28,17 +94,158 @@ public:
   // it should be blocked on waiting and should return true when granted
   // note the behavior of trying to lock locked rids by same txn is undefined
   // it is transaction's job to keep track of its current locks
-  bool LockShared(Transaction *txn, const RID &rid);
-  bool LockExclusive(Transaction *txn, const RID &rid);
-  bool LockUpgrade(Transaction *txn, const RID &rid);
+  // rid is a row of table_id, the first page of its heap, if one is given
+  bool LockShared(Transaction *txn, const RID &rid,
+                  page_id_t table_id = INVALID_PAGE_ID);
+  bool LockExclusive(Transaction *txn, const RID &rid,
+                     page_id_t table_id = INVALID_PAGE_ID);
+  bool LockUpgrade(Transaction *txn, const RID &rid,
+                   page_id_t table_id = INVALID_PAGE_ID);
+  // exclusive lock on rid if no other transaction has a request on it, false
+  // without waiting or aborting txn otherwise. The table and page locks are
+  // taken as for LockExclusive
+  bool TryLockExclusive(Transaction *txn, const RID &rid,
+                        page_id_t table_id = INVALID_PAGE_ID);
+  // the shared lock the same way
+  bool TryLockShared(Transaction *txn, const RID &rid,
+                     page_id_t table_id = INVALID_PAGE_ID);
 
   // unlock:
   // release the lock hold by the txn
   bool Unlock(Transaction *txn, const RID &rid);
   /*** END OF APIs ***/
 
+  // lock a table or a page of it in any mode, the page under the intention
+  // lock its mode needs on the table. Upgrades a lock txn holds already
+  bool LockTable(Transaction *txn, page_id_t table_id, LockMode mode);
+  bool LockPage(Transaction *txn, page_id_t table_id, page_id_t page_id,
+                LockMode mode);
+
+  // release every lock of txn, a partition latch is taken once for all of
+  // its locks in that partition
+  void UnlockAll(Transaction *txn);
+
+  // wait instead of wait-die, and look for deadlocks every interval. A
+  // running thread picks up the new interval with its next round
+  void StartDeadlockDetection(
+      std::chrono::milliseconds interval = DEADLOCK_DETECTION_INTERVAL);
+  // back to wait-die for new requests, with no transaction waiting
+  void StopDeadlockDetection();
+  // one round of the detection thread, the number of victims
+  size_t DetectDeadlocks();
+
+  LockStats GetStats();
+  void ResetStats();
+
+  // whether txn holds an exclusive lock on rid, its page or a table
+  static bool HoldsExclusive(Transaction *txn, const RID &rid);
+
+  // rids with a request queue, for tests
+  size_t GetLockedCount();
+
+  static inline RID TableLockRid(page_id_t table_id) {
+    return RID(table_id, TABLE_LOCK_SLOT);
+  }
+  static inline RID PageLockRid(page_id_t page_id) {
+    return RID(page_id, PAGE_LOCK_SLOT);
+  }
+
 private:
+  struct Request {
+    Request(txn_id_t txn_id, LockMode mode, bool upgrade)
+        : txn_id_(txn_id), mode_(mode), upgrade_(upgrade), aborted_(false) {}
+    txn_id_t txn_id_;
+    LockMode mode_;
+    // a stronger request of a transaction holding a lock ahead
+    bool upgrade_;
+    // a waiting request chosen as a deadlock victim
+    bool aborted_;
+  };
+
+  // waiting transaction -> transactions of requests ahead it waits for
+  typedef std::unordered_map<txn_id_t, std::vector<txn_id_t>> WaitsForGraph;
+
+  struct RequestQueue {
+    std::list<Request> requests_;
+    std::condition_variable cv_;
+  };
+
+  struct Partition {
+    std::mutex latch_;
+    std::unordered_map<RID, RequestQueue> queues_;
+  };
+
+  // bytes charged per request and per queue, with their list and map nodes
+  static constexpr size_t REQUEST_BYTES =
+      sizeof(Request) + sizeof(RID) + 4 * sizeof(void *);
+  static constexpr size_t QUEUE_BYTES =
+      sizeof(RID) + sizeof(RequestQueue) + 2 * sizeof(void *);
+
+  static inline size_t GetPartitionIndex(const RID &rid) {
+    uint64_t hash = static_cast<uint64_t>(rid.Get()) * 0x9E3779B97F4A7C15ULL;
+    return (hash >> 32) & (LOCK_TABLE_PARTITIONS - 1);
+  }
+  inline Partition &GetPartition(const RID &rid) {
+    return partitions_[GetPartitionIndex(rid)];
+  }
+  // latch partition, counted while latch profiling is on
+  inline std::unique_lock<std::mutex> LatchPartition(Partition &partition) {
+    if (LatchStats::IsEnabled())
+      return LatchStats::Lock(LatchClass::LOCK_MANAGER, partition.latch_);
+    return std::unique_lock<std::mutex>(partition.latch_);
+  }
+
+  // lock the row rid under its table and page locks
+  bool LockRow(Transaction *txn, const RID &rid, page_id_t table_id,
+               LockMode mode, bool upgrade, bool wait = true);
+  // take or upgrade the lock of txn on a table or page to cover mode
+  bool LockGranule(Transaction *txn, const RID &lock_rid, page_id_t table_id,
+                   LockMode mode);
+  // queue a request of txn on rid and wait until it is granted, false if
+  // txn dies instead, or at once if it may not wait
+  bool Lock(Transaction *txn, const RID &rid, LockMode mode, bool upgrade,
+            bool wait = true);
+  // trade the row and page locks of txn on a table for a table lock
+  void Escalate(Transaction *txn, page_id_t table_id);
+  // drop the requests of txn on rid, the partition latch is held
+  static bool Release(Partition &partition, txn_id_t txn_id, const RID &rid);
+
+  // whether request, in queue, has nothing incompatible ahead of it
+  static bool IsGrantable(const RequestQueue &queue,
+                          std::list<Request>::const_iterator request);
+  // false if txn is not older than every request it would wait for
+  static bool MayWait(const RequestQueue &queue, txn_id_t txn_id,
+                      LockMode mode);
+  // depth first from txn, the youngest transaction of the first cycle found
+  // on path is the victim
+  static bool FindCycle(const WaitsForGraph &graph, txn_id_t txn,
+                        std::unordered_map<txn_id_t, int> &colors,
+                        std::vector<txn_id_t> &path, txn_id_t &victim);
+  // body of detection_thread_
+  void DetectionWorker();
+
+  static bool IsCompatible(LockMode left, LockMode right);
+  // whether a lock held in mode held makes one in mode needless
+  static bool Covers(LockMode held, LockMode mode);
+  // the weakest mode covering both
+  static LockMode Combine(LockMode held, LockMode mode);
+
   bool strict_2PL_;
+  size_t escalation_threshold_;
+  Partition partitions_[LOCK_TABLE_PARTITIONS];
+
+  // detection thread, not running unless started
+  std::atomic<bool> detecting_;
+  std::chrono::milliseconds interval_;
+  std::mutex thread_latch_;
+  std::condition_variable thread_cv_;
+  bool stop_thread_;
+  std::thread detection_thread_;
+
+  std::atomic<uint64_t> wait_die_aborts_{0};
+  std::atomic<uint64_t> deadlock_aborts_{0};
+  std::atomic<uint64_t> state_aborts_{0};
+  std::atomic<uint64_t> unlock_aborts_{0};
 };
 
 } // namespace cmudb
@@ -5,13 +5,16 @@
 #pragma once
 
 #include <atomic>
+#include <cassert>
 #include <deque>
 #include <memory>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "common/config.h"
 #include "common/logger.h"
+#include "common/memory_tracker.h"
 #include "page/page.h"
 #include "table/tuple.h"
 
@@ -30,7 +33,32 @@ enum class TransactionState { GROWING, SHRINKING, COMMITTED, ABORTED };
 
 enum class WType { INSERT = 0, DELETE, UPDATE };
 
+// intention modes are only taken on tables and pages, rows are locked shared
+// or exclusive
+enum class LockMode {
+  INTENTION_SHARED,
+  INTENTION_EXCLUSIVE,
+  SHARED,
+  SHARED_INTENTION_EXCLUSIVE,
+  EXCLUSIVE
+};
+
+// a table or page lock held by a transaction
+struct GranuleLock {
+  LockMode mode_;
+  // the table of a page, the table itself for a table
+  page_id_t table_id_;
+  // rows locked under a table since its escalation was last tried
+  size_t rows_;
+};
+
+// commit timestamps of versions whose writer did not commit
+#define UNCOMMITTED_TIMESTAMP UINT64_MAX
+#define ABORTED_TIMESTAMP (UINT64_MAX - 1)
+
+class Index;
 class TableHeap;
+class VersionStore;
 
 // write set record
 class WriteRecord {
@@ -44,23 +72,78 @@ public:
   Tuple tuple_;
   // which table
   TableHeap *table_;
+  // half of a tuple moved by TableHeap::MergePages or MoveTuples, the copy
+  // shares the values out of line of the original
+  bool is_move_ = false;
+};
+
+// index write set record, an entry inserted into or deleted from index
+class IndexWriteRecord {
+public:
+  IndexWriteRecord(RID rid, WType wtype, const Tuple &key, Index *index)
+      : rid_(rid), wtype_(wtype), key_(key), index_(index) {}
+
+  RID rid_;
+  WType wtype_;
+  Tuple key_;
+  Index *index_;
 };
 
+// sizes of the write sets of a transaction, what it wrote after them is
+// undone by TransactionManager::RollbackTo
+struct Savepoint {
+  size_t write_set_size_;
+  size_t index_write_set_size_;
+};
+
+/*
+ * A read only transaction neither writes nor locks, e.g. a snapshot: it has
+ * no write, page or lock sets, they are not allocated, and their getters
+ * must not be called
+ */
 class Transaction {
 public:
   Transaction(Transaction const &) = delete;
-  Transaction(txn_id_t txn_id)
+  Transaction(txn_id_t txn_id, bool read_only = false)
       : state_(TransactionState::GROWING),
-        thread_id_(std::this_thread::get_id()),
-        txn_id_(txn_id), shared_lock_set_{new std::unordered_set<RID>},
-        exclusive_lock_set_{new std::unordered_set<RID>} {
+        thread_id_(std::this_thread::get_id()), txn_id_(txn_id),
+        prev_lsn_(INVALID_LSN), read_only_(read_only) {
+    if (read_only)
+      return;
     // initialize sets
     write_set_.reset(new std::deque<WriteRecord>);
+    index_write_set_.reset(new std::deque<IndexWriteRecord>);
     page_set_.reset(new std::deque<Page *>);
     deleted_page_set_.reset(new std::unordered_set<page_id_t>);
+    shared_lock_set_.reset(new std::unordered_set<RID>);
+    exclusive_lock_set_.reset(new std::unordered_set<RID>);
+    granule_lock_set_.reset(new std::unordered_map<RID, GranuleLock>);
   }
 
-  ~Transaction() {}
+  ~Transaction() { ReleaseMemory(); }
+
+  // start over as a new transaction txn_id, the sets keep their memory.
+  // Called by TransactionManager on a transaction it gets back
+  void Reset(txn_id_t txn_id) {
+    state_ = TransactionState::GROWING;
+    thread_id_ = std::this_thread::get_id();
+    txn_id_ = txn_id;
+    prev_lsn_ = INVALID_LSN;
+    version_store_ = nullptr;
+    snapshot_ = false;
+    read_ts_ = 0;
+    commit_ts_.reset();
+    ReleaseMemory();
+    if (read_only_)
+      return;
+    write_set_->clear();
+    index_write_set_->clear();
+    page_set_->clear();
+    deleted_page_set_->clear();
+    shared_lock_set_->clear();
+    exclusive_lock_set_->clear();
+    granule_lock_set_->clear();
+  }
 
   //===--------------------------------------------------------------------===//
   // Mutators and Accessors
@@ -69,15 +152,42 @@ public:
 
   inline txn_id_t GetTransactionId() const { return txn_id_; }
 
+  inline bool IsReadOnly() const { return read_only_; }
+
   inline std::shared_ptr<std::deque<WriteRecord>> GetWriteSet() {
+    assert(!read_only_);
     return write_set_;
   }
 
-  inline std::shared_ptr<std::deque<Page *>> GetPageSet() { return page_set_; }
+  // entries to take out of or put back in indexes on rollback, kept by the
+  // callers changing the index
+  inline std::shared_ptr<std::deque<IndexWriteRecord>> GetIndexWriteSet() {
+    assert(!read_only_);
+    return index_write_set_;
+  }
+
+  // bytes of a record added to the write sets, charged as
+  // MemoryComponent::TRANSACTION until the transaction ends
+  inline void ChargeMemory(size_t bytes) {
+    MemoryTracker::Charge(MemoryComponent::TRANSACTION, bytes);
+    memory_ += bytes;
+  }
+
+  inline Savepoint GetSavepoint() {
+    if (read_only_)
+      return Savepoint{0, 0};
+    return Savepoint{write_set_->size(), index_write_set_->size()};
+  }
+
+  inline std::shared_ptr<std::deque<Page *>> GetPageSet() {
+    assert(!read_only_);
+    return page_set_;
+  }
 
   inline void AddIntoPageSet(Page *page) { page_set_->push_back(page); }
 
   inline std::shared_ptr<std::unordered_set<page_id_t>> GetDeletedPageSet() {
+    assert(!read_only_);
     return deleted_page_set_;
   }
 
@@ -86,25 +196,77 @@ public:
   }
 
   inline std::shared_ptr<std::unordered_set<RID>> GetSharedLockSet() {
+    assert(!read_only_);
     return shared_lock_set_;
   }
 
   inline std::shared_ptr<std::unordered_set<RID>> GetExclusiveLockSet() {
+    assert(!read_only_);
     return exclusive_lock_set_;
   }
 
+  inline std::shared_ptr<std::unordered_map<RID, GranuleLock>>
+  GetGranuleLockSet() {
+    assert(!read_only_);
+    return granule_lock_set_;
+  }
+
   inline TransactionState GetState() { return state_; }
 
   inline void SetState(TransactionState state) { state_ = state; }
 
+  // with its versions in store, set by TransactionManager. Without a store
+  // nothing txn writes is versioned, a read only one only reads it
+  inline VersionStore *GetVersionStore() { return version_store_; }
+  inline void SetVersionStore(VersionStore *store) {
+    version_store_ = store;
+    if (!read_only_)
+      commit_ts_ = std::make_shared<std::atomic<timestamp_t>>(
+          UNCOMMITTED_TIMESTAMP);
+  }
+
+  // a read only transaction reading the snapshot of read_ts without locks
+  inline bool IsSnapshot() const { return snapshot_; }
+  inline timestamp_t GetReadTimestamp() const { return read_ts_; }
+  inline void SetSnapshot(timestamp_t read_ts) {
+    snapshot_ = true;
+    read_ts_ = read_ts;
+  }
+
+  // stamped by TransactionManager on commit or abort
+  inline std::shared_ptr<std::atomic<timestamp_t>> GetCommitTimestamp() {
+    return commit_ts_;
+  }
+
+  inline lsn_t GetPrevLSN() { return prev_lsn_; }
+
+  inline void SetPrevLSN(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
+
 private:
+  inline void ReleaseMemory() {
+    MemoryTracker::Release(MemoryComponent::TRANSACTION, memory_);
+    memory_ = 0;
+  }
+
   TransactionState state_;
   // thread id, single-threaded transactions
   std::thread::id thread_id_;
   // transaction id
   txn_id_t txn_id_;
+  // lsn of the last log record written by this transaction
+  // read by checkpoints while txn runs
+  std::atomic<lsn_t> prev_lsn_;
+  bool read_only_;
+  // multi version concurrency control
+  VersionStore *version_store_ = nullptr;
+  bool snapshot_ = false;
+  timestamp_t read_ts_ = 0;
+  std::shared_ptr<std::atomic<timestamp_t>> commit_ts_;
   // Below are used by transaction, undo set
   std::shared_ptr<std::deque<WriteRecord>> write_set_;
+  std::shared_ptr<std::deque<IndexWriteRecord>> index_write_set_;
+  // bytes charged by ChargeMemory
+  size_t memory_ = 0;
 
   // Below are used by concurrent index
   // this deque contains page pointer that was latche during index operation
@@ -117,5 +279,7 @@ private:
   std::shared_ptr<std::unordered_set<RID>> shared_lock_set_;
   // this set contains rid of exclusive-locked tuples by this transaction
   std::shared_ptr<std::unordered_set<RID>> exclusive_lock_set_;
+  // this map contains the table and page locks, by their lock rids
+  std::shared_ptr<std::unordered_map<RID, GranuleLock>> granule_lock_set_;
 };
 } // namespace cmudb
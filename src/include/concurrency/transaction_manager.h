@@ -1,21 +1,188 @@
 /**
  * transaction_manager.h
  *
+ * When a log manager is given, BEGIN/COMMIT/ABORT records are logged and
+ * Commit does not return before the COMMIT record is durable. Commits waiting
+ * at the same time share one log flush (group commit).
+ *
+ * Logged transactions are kept in the active transaction table until their
+ * COMMIT/ABORT record is written, checkpoints take a snapshot of it.
+ *
+ * Transactions keep versions of what they write in the version store (see
+ * version_store.h). A commit is stamped with the next commit timestamp
+ * before its locks are released, a snapshot transaction reads as of the
+ * last stamped one. Versions are collected as writers commit and as the
+ * oldest snapshot ends.
+ *
+ * The watermark is the oldest read timestamp a snapshot may use, no reader
+ * needs a version committed at or before it. A commit prunes the chains it
+ * wrote right away. Without the collector the end of the oldest snapshot
+ * sweeps every chain in its Commit, with it running that sweep moves to a
+ * background thread, which sweeps every interval once the watermark moved.
+ *
+ * A transaction done with is given back by Release, Begin reuses it with
+ * the next txn id. Ids only grow, what locks and versions keep by id never
+ * mixes up two transactions of one object.
  */
 
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "concurrency/lock_manager.h"
+#include "concurrency/version_store.h"
+#include "logging/log_manager.h"
 
 namespace cmudb {
+
+// transactions kept for reuse once released
+#define TXN_POOL_SIZE 64
+
+// how often the collector looks at the watermark
+#define VERSION_GC_INTERVAL std::chrono::milliseconds(10)
+
+// version garbage collection, a snapshot taken by GetGCStats
+struct GCStats {
+  // sweeps of every chain, by the collector or an ending snapshot
+  uint64_t runs_ = 0;
+  // versions dropped by sweeps
+  uint64_t collected_ = 0;
+  // versions dropped by commits and aborts pruning what they wrote
+  uint64_t pruned_ = 0;
+  // the watermark of the last sweep
+  timestamp_t watermark_ = 0;
+  // commits the watermark trails the last commit timestamp by
+  timestamp_t lag_ = 0;
+  // versions in the store
+  size_t versions_ = 0;
+};
+
 class TransactionManager {
 public:
-  TransactionManager(LockManager *lock_manager) : lock_manager_(lock_manager) {}
+  TransactionManager(LockManager *lock_manager,
+                     LogManager *log_manager = nullptr)
+      : next_txn_id_(0), lock_manager_(lock_manager),
+        log_manager_(log_manager), collecting_(false),
+        gc_interval_(VERSION_GC_INTERVAL), stop_gc_(false) {}
 
+  ~TransactionManager() {
+    StopGarbageCollection();
+    for (auto txn : free_txns_)
+      delete txn;
+    for (auto txn : free_read_only_txns_)
+      delete txn;
+  }
+
+  Transaction *Begin();
+  // a read only transaction seeing what was committed before it began,
+  // it takes no locks and is ended by Commit or Abort. It has no write or
+  // lock sets and logs nothing, beginning and ending it costs a latch
+  Transaction *BeginSnapshot();
+  // continue numbering after the transactions found in the log
+  inline void SetNextTxnId(txn_id_t next_txn_id) {
+    next_txn_id_ = next_txn_id;
+  }
   void Commit(Transaction *txn);
   void Abort(Transaction *txn);
+  // undo what txn wrote after savepoint, it keeps running and its locks
+  void RollbackTo(Transaction *txn, const Savepoint &savepoint);
+  // txn, committed or aborted, is not used by the caller any more
+  void Release(Transaction *txn);
+
+  // (txn id, last lsn) of active logged transactions, min_first_lsn is the
+  // oldest BEGIN record among them or INVALID_LSN
+  void GetActiveTransactions(std::vector<std::pair<txn_id_t, lsn_t>> &txns,
+                             lsn_t &min_first_lsn);
+
+  inline VersionStore *GetVersionStore() { return &version_store_; }
+  inline timestamp_t GetLastCommitTimestamp() const {
+    return last_commit_ts_;
+  }
+
+  // sweep versions in the background every interval. A running thread
+  // picks up the new interval with its next round
+  void StartGarbageCollection(
+      std::chrono::milliseconds interval = VERSION_GC_INTERVAL);
+  // back to sweeping in the Commit of the oldest snapshot
+  void StopGarbageCollection();
+  // one round of the collector, the number of versions dropped. Nothing is
+  // swept unless the watermark moved since the last sweep
+  size_t CollectGarbage();
+  // the oldest read timestamp a snapshot may use
+  timestamp_t GetWatermark();
+
+  GCStats GetGCStats();
 
 private:
+  // logging is on when log manager is given and its flush thread runs
+  inline bool IsLogging() const {
+    return log_manager_ != nullptr && log_manager_->IsRunning();
+  }
+
+  // a pooled transaction reset to the next txn id, or a new one. Read only
+  // ones are pooled apart, they have no sets to reuse
+  Transaction *NewTransaction(bool read_only = false);
+
+  // drop the read timestamp of a snapshot, sweeping if it was the oldest
+  void EndSnapshot(Transaction *txn);
+
+  // undo the write sets of txn down to savepoint, index entries first
+  void Undo(Transaction *txn, const Savepoint &savepoint);
+
+  // append a BEGIN/COMMIT/ABORT record for txn, return its lsn
+  lsn_t WriteLog(Transaction *txn, LogRecordType log_record_type);
+
+  // drop txn from the active transaction table
+  void RemoveActive(Transaction *txn);
+
+  void ReleaseLocks(Transaction *txn);
+
+  // stamp the versions of txn with ts once they are final
+  void StampVersions(Transaction *txn, timestamp_t ts);
+  // prune the chains written by txn, records are (table id, rid)
+  void PruneVersions(const std::vector<std::pair<page_id_t, RID>> &records);
+  // sweep every chain for watermark
+  size_t Sweep(timestamp_t watermark);
+  // body of gc_thread_
+  void GarbageCollectionWorker();
+
+  std::atomic<txn_id_t> next_txn_id_;
+  // released transactions, up to TXN_POOL_SIZE of each kind
+  std::vector<Transaction *> free_txns_;
+  std::vector<Transaction *> free_read_only_txns_;
+  std::mutex pool_latch_;
   LockManager *lock_manager_;
+  LogManager *log_manager_;
+  // txn id -> (transaction, lsn of its BEGIN record)
+  std::unordered_map<txn_id_t, std::pair<Transaction *, lsn_t>> active_txns_;
+  std::mutex active_latch_;
+
+  VersionStore version_store_;
+  // orders commit timestamps and the read timestamps of snapshots
+  std::mutex commit_latch_;
+  std::atomic<timestamp_t> last_commit_ts_{0};
+  // read timestamps of running snapshots, under commit_latch_
+  std::multiset<timestamp_t> snapshots_;
+
+  // collector thread, not running unless started
+  std::atomic<bool> collecting_;
+  std::chrono::milliseconds gc_interval_;
+  std::mutex gc_latch_;
+  std::condition_variable gc_cv_;
+  bool stop_gc_;
+  std::thread gc_thread_;
+
+  std::atomic<uint64_t> gc_runs_{0};
+  std::atomic<uint64_t> gc_collected_{0};
+  std::atomic<uint64_t> gc_pruned_{0};
+  std::atomic<timestamp_t> gc_watermark_{0};
 };
 
 } // namespace cmudb
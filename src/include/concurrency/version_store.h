@@ -0,0 +1,126 @@
+/**
+ * version_store.h
+ *
+ * Older versions of tuples for snapshot reads
+ *
+ * Before a transaction changes a tuple for the first time it pushes the
+ * tuple's current image (none for an insert) on the version chain of its
+ * rid, under the page latch. The version is stamped with the commit
+ * timestamp of its writer once that commits, until then, or for good if
+ * the writer aborts, it is uncommitted. Heap pages always hold the newest
+ * version.
+ *
+ * A snapshot with read timestamp ts sees the page image unless a version of
+ * the rid is uncommitted or committed after ts, then it sees the oldest such
+ * version's image: what the rid held before its first change ts does not
+ * see. Rids without a chain look the same to every snapshot.
+ *
+ * Versions no snapshot can need any more are collected: those committed at
+ * or before the oldest read timestamp in use, with every version older than
+ * them, and those of aborted writers, whose changes are rolled back.
+ *
+ * Chains are kept by table and page, in partitions with a latch each, so
+ * that a scan asks once whether a page has any.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "common/rid.h"
+#include "concurrency/transaction.h"
+#include "table/tuple.h"
+
+namespace cmudb {
+
+// partitions of the version store, a power of two
+#define VERSION_STORE_PARTITIONS 16
+
+class VersionStore {
+public:
+  // keep the image of rid of table_id, the first page of its heap, before
+  // writer changes it, before is nullptr if rid holds no tuple yet. Only the
+  // first change of a writer to a rid pushes a version
+  void Push(page_id_t table_id, const RID &rid, const Tuple *before,
+            Transaction *writer);
+
+  // false if rid has no version newer than read_ts, the page image is
+  // visible then. Otherwise tuple is set to the visible image, if there is
+  // one
+  bool Read(page_id_t table_id, const RID &rid, timestamp_t read_ts,
+            Tuple &tuple, bool &exists);
+
+  // whether the page has versions, scans of pages without any read them as
+  // they are
+  bool HasVersions(page_id_t table_id, page_id_t page_id);
+
+  // append the rids of table_id a snapshot of read_ts reads from a version
+  // instead of the page, those changed since it began, in no order
+  void GetChangedRids(page_id_t table_id, timestamp_t read_ts,
+                      std::vector<RID> &rids);
+
+  // drop the versions of rid no reader from oldest_ts on needs, and those of
+  // aborted writers, the number dropped
+  size_t Prune(page_id_t table_id, const RID &rid, timestamp_t oldest_ts);
+  // prune every chain
+  size_t Collect(timestamp_t oldest_ts);
+
+  size_t GetVersionCount();
+
+private:
+  struct Version {
+    Version(const Tuple *before, Transaction *writer)
+        : exists_(before != nullptr), writer_(writer->GetTransactionId()),
+          commit_ts_(writer->GetCommitTimestamp()) {
+      if (before != nullptr)
+        image_ = *before;
+    }
+    Tuple image_;
+    bool exists_;
+    txn_id_t writer_;
+    // shared by every version of the writer, stamped once at commit
+    std::shared_ptr<std::atomic<timestamp_t>> commit_ts_;
+  };
+
+  struct PageKey {
+    page_id_t table_id_;
+    page_id_t page_id_;
+    bool operator==(const PageKey &other) const {
+      return table_id_ == other.table_id_ && page_id_ == other.page_id_;
+    }
+  };
+
+  struct PageKeyHash {
+    size_t operator()(const PageKey &key) const {
+      uint64_t value = (static_cast<uint64_t>(key.table_id_) << 32) |
+                       static_cast<uint32_t>(key.page_id_);
+      return std::hash<uint64_t>()(value);
+    }
+  };
+
+  // slot -> versions, oldest first
+  typedef std::unordered_map<int, std::vector<Version>> PageVersions;
+
+  struct Partition {
+    std::mutex latch_;
+    std::unordered_map<PageKey, PageVersions, PageKeyHash> pages_;
+  };
+
+  inline Partition &GetPartition(const PageKey &key) {
+    uint64_t hash = PageKeyHash()(key) * 0x9E3779B97F4A7C15ULL;
+    return partitions_[(hash >> 32) & (VERSION_STORE_PARTITIONS - 1)];
+  }
+
+  // drop what oldest_ts does not need from versions, the partition latch is
+  // held
+  static size_t PruneChain(std::vector<Version> &versions,
+                         timestamp_t oldest_ts);
+
+  Partition partitions_[VERSION_STORE_PARTITIONS];
+};
+
+} // namespace cmudb
@@ -0,0 +1,102 @@
+/**
+ * async_io.h
+ *
+ * Asynchronous positional I/O on one file descriptor, built on io_uring
+ * through raw system calls. Read and Write only queue a request in the
+ * submission ring, Submit hands every queued request to the kernel with a
+ * single io_uring_enter, so callers can batch dozens of pages per system call.
+ * A completion thread reaps the completion ring and runs the callbacks.
+ *
+ * The number of requests in flight is bounded by the completion ring size,
+ * Read/Write block while it is exhausted. Callbacks run on the completion
+ * thread and therefore must not issue I/O or wait for latches held around
+ * I/O, hand the work over to another thread instead.
+ *
+ * If io_uring is not available (old kernel, seccomp) requests are served
+ * synchronously with pread/pwrite and callbacks run on the calling thread.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <thread>
+#include <vector>
+
+namespace cmudb {
+
+// result of the request, bytes transferred or -errno
+typedef std::function<void(ssize_t result)> IOCallback;
+
+class AsyncIO {
+public:
+  AsyncIO(int fd, unsigned queue_depth = 64);
+  ~AsyncIO();
+
+  void Read(off_t offset, char *data, size_t size, IOCallback callback);
+  void Write(off_t offset, const char *data, size_t size, IOCallback callback);
+  // gather write of consecutive file ranges, iov is copied
+  void Writev(off_t offset, const struct iovec *iov, int iov_count,
+              IOCallback callback);
+
+  // submit all queued requests with one system call
+  void Submit();
+
+  inline bool IsRingEnabled() const { return ring_fd_ >= 0; }
+
+private:
+  struct Request {
+    IOCallback callback_;
+    // kept alive until completion for vectored requests
+    std::vector<struct iovec> iov_;
+  };
+
+  bool SetupRing(unsigned queue_depth);
+  void TeardownRing();
+  void Enqueue(std::unique_lock<std::mutex> &guard, uint8_t opcode,
+               off_t offset, const void *addr, unsigned len,
+               Request *request);
+  // caller must hold latch_
+  void SubmitLocked();
+  // body of completion_thread_
+  void Complete();
+
+  int fd_;
+  int ring_fd_;
+
+  // submission ring, shared with kernel
+  void *sq_ring_;
+  size_t sq_ring_size_;
+  unsigned *sq_head_;
+  unsigned *sq_tail_;
+  unsigned *sq_mask_;
+  unsigned *sq_array_;
+  unsigned sq_entries_;
+  void *sqes_;
+  size_t sqes_size_;
+
+  // completion ring, shared with kernel
+  void *cq_ring_;
+  size_t cq_ring_size_;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned *cq_mask_;
+  void *cqes_;
+  unsigned cq_entries_;
+
+  // queued but not yet submitted
+  unsigned pending_;
+  // submitted or queued, not yet completed
+  unsigned inflight_;
+  // protect submission ring and counters
+  std::mutex latch_;
+  // signaled when a request completes
+  std::condition_variable completed_cv_;
+  std::thread completion_thread_;
+};
+
+} // namespace cmudb
@@ -5,33 +5,377 @@
  * database. It also performs read and write of pages to and from disk, and
  * provides a logical file layer within the context of a database management
  * system.
+ *
+ * Pages are read and written with pread/pwrite on a raw file descriptor, so
+ * there is no shared file position and any number of buffer pool threads can
+ * do I/O at the same time. With direct_io the file is opened with O_DIRECT and
+ * the buffer pool is the only cache of the data. O_DIRECT needs PAGE_SIZE
+ * aligned memory, unaligned page buffers go through an aligned bounce buffer.
+ *
+ * I/O is asynchronous underneath (see async_io.h): ReadPageAsync and
+ * WritePageAsync queue a request, SubmitIO hands all queued requests to the
+ * kernel at once and the callback runs when the page is done. ReadPage and
+ * WritePage are thin synchronous wrappers that submit and wait.
+ *
+ * The write ahead log lives in a separate file next to the database file
+ * (foo.db -> foo.log). It is only appended to, every WriteLog is followed by
+ * fdatasync, and it is opened on first use. Offsets into the log never change,
+ * a checkpoint truncates the log from the front by recording the offset of the
+ * oldest needed record in the master record (foo.ckpt) and punching a hole
+ * into the log file before it. Offsets into the log and the data files are
+ * off_t throughout, files grow past 2 GB.
+ *
+ * Page allocation state is kept in the superblock, a small versioned file
+ * next to the database file (foo.meta), so opening a database reads neither
+ * the log nor the size of the file. It holds a limit below which every page
+ * id ever handed out lies, raised PAGE_ID_EXTENT ids at a time, the freed
+ * pages that survive a restart and the page size the file was created with.
+ * Page 0 can not hold it, that page belongs to whoever allocates it first.
+ *
+ * Freed pages are handed out again by AllocatePage. The superblock only ever
+ * lists pages that are really free: pages are taken off it in batches before
+ * any of them is reused. Pages freed since the last write of the superblock
+ * are reused first and leak in a crash. A reused page is zeroed on disk, so
+ * it reads like a page that was never written until its new owner writes it.
+ *
+ * Tables and indexes take their pages through a PageExtent, which takes
+ * EXTENT_PAGES consecutive new page ids at once and hands them out in order.
+ * The pages of one table then lie side by side in the file instead of
+ * between those of every other table, and a scan of it reads the file
+ * sequentially. Freed pages still come first, one at a time. The ids an
+ * extent did not hand out go back when it or the disk manager goes away.
+ *
+ * EnablePageCache puts a compressed page cache (see page_cache.h) in front of
+ * the file: pages written or read are kept encoded in memory and reads of
+ * them are served from there. Pages leave and reach the buffer pool decoded.
+ *
+ * EnableMmap maps the files for a read-only database: the buffer pool points
+ * its frames at the pages of the mapping instead of reading them (see
+ * GetMappedPage). The mapping is private, a page changed in memory is never
+ * written to the file, and neither are pages nor the superblock written then.
+ *
+ * Every page written gets a CRC-32C checksum in the checksum file of its
+ * tablespace (bar.db -> bar.sum), and a page read that matches neither of
+ * the last two checksums of the page is rejected and counted. Two are kept
+ * as the checksum is updated before the write is queued: a page whose write
+ * never happened still matches the older one. The checksum file is mapped,
+ * checking a page costs no system call. Files start with checksums on, a
+ * file may be switched either way with SetChecksums and keeps the choice.
+ * Pages from the page cache or the mapping of a read-only database are not
+ * checked, and neither are pages never written with checksums on.
+ *
+ * A database may keep pages in more files than its own, its tablespaces, so
+ * that e.g. indexes live on a fast device and heaps on a large one. The top
+ * TABLESPACE_BITS of a page id name the tablespace, the rest is the number of
+ * the page in its file: the page ids of tablespace 0, the database file, are
+ * the page numbers they always were. Every tablespace has its own superblock
+ * (bar.db -> bar.meta) and its own I/O ring, the files of the others are
+ * listed in foo.spaces and opened with the database.
+ *
+ * Every tablespace also keeps a bitmap of the pages written since the last
+ * backup (bar.db -> bar.chg), one bit per page, mapped like the checksums.
+ * TakeChangedPages reads the pages whose bit is set and clears them, so an
+ * incremental backup (see backup_manager.h) reads only what changed. A file
+ * opened without a bitmap has every page in it marked.
  */
 
 #pragma once
 #include <atomic>
-#include <fstream>
+#include <functional>
+#include <mutex>
+#include <set>
 #include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "disk/async_io.h"
+#include "disk/page_cache.h"
 
 #include "common/config.h"
 
 namespace cmudb {
 
+// pages taken off or added to the free list of the superblock at once
+#define FREE_PAGE_BATCH 64
+// page ids handed out between two writes of the superblock
+#define PAGE_ID_EXTENT 1024
+// consecutive page ids a PageExtent takes at once
+#define EXTENT_PAGES 64
+// checksum and changed page files grow by this many bytes at a time
+#define SIDE_FILE_STEP (64 * 1024)
+// reads of a changed page that fails its checksum, it may be being written
+#define BACKUP_READ_ATTEMPTS 4
+#define SUPERBLOCK_MAGIC 0x42444d43 // "CMDB"
+// 2 added the page size, 3 is 2 with 64-bit page ids (WIDE_PAGE_IDS)
+#define SUPERBLOCK_NARROW_VERSION 2
+#define SUPERBLOCK_WIDE_VERSION 3
+#ifdef WIDE_PAGE_IDS
+#define SUPERBLOCK_VERSION SUPERBLOCK_WIDE_VERSION
+#else
+#define SUPERBLOCK_VERSION SUPERBLOCK_NARROW_VERSION
+#endif
+// bytes of the superblock before its free page numbers
+#define SUPERBLOCK_HEADER_SIZE (16 + sizeof(page_id_t))
+// high bits of a page id naming its tablespace
+#define TABLESPACE_BITS 4
+#define MAX_TABLESPACES (1 << TABLESPACE_BITS)
+#define TABLESPACE_SHIFT (PAGE_ID_BITS - TABLESPACE_BITS)
+// pages of one tablespace, 512 GB of 4 KB pages, 32 PB with WIDE_PAGE_IDS
+#define TABLESPACE_PAGES (static_cast<page_id_t>(1) << TABLESPACE_SHIFT)
+// pages of a tablespace the checksum and changed page files cover, their
+// mappings take address space for all of them. Pages past these are not
+// checked, and every backup takes them
+#define SIDE_FILE_PAGES                                                        \
+  static_cast<size_t>(TABLESPACE_SHIFT < 32 ? TABLESPACE_PAGES                 \
+                                            : static_cast<int64_t>(1) << 32)
+
+inline int GetTablespaceId(page_id_t page_id) {
+  return static_cast<int>(page_id >> TABLESPACE_SHIFT);
+}
+inline page_id_t GetPageNumber(page_id_t page_id) {
+  return page_id & (TABLESPACE_PAGES - 1);
+}
+inline page_id_t MakePageId(int tablespace_id, page_id_t page_number) {
+  return static_cast<page_id_t>(tablespace_id) << TABLESPACE_SHIFT |
+         page_number;
+}
+
+// true if the whole page was transferred
+typedef std::function<void(bool success)> DiskCallback;
+// takes a copy of a page, false to stop
+typedef std::function<bool(page_id_t page_id, const char *page_data)>
+    PageCopyFunc;
+
+class PageExtent;
+
 class DiskManager {
+  friend class PageExtent;
+
 public:
-  DiskManager(const std::string &db_file);
+  // throws if a file was created with another page size
+  DiskManager(const std::string &db_file, bool direct_io = false);
   ~DiskManager();
 
   void WritePage(page_id_t page_id, const char *page_data);
-  void ReadPage(page_id_t page_id, char *page_data);
+  // false if the page is beyond end of file, page_data is left untouched.
+  // Also false with corrupt set if the page fails its checksum
+  bool ReadPage(page_id_t page_id, char *page_data, bool *corrupt = nullptr);
 
-  page_id_t AllocatePage();
+  // page_data must stay valid until callback runs, the callback must not
+  // issue I/O itself. Requests are started by SubmitIO.
+  void WritePageAsync(page_id_t page_id, const char *page_data,
+                      DiskCallback callback);
+  // corrupt is set before callback runs
+  void ReadPageAsync(page_id_t page_id, char *page_data, DiskCallback callback,
+                     bool *corrupt = nullptr);
+  // write count pages starting at first_page_id with one request, two if
+  // they cross into the next tablespace
+  void WritePagesAsync(page_id_t first_page_id, const char *const *pages_data,
+                       size_t count, DiskCallback callback);
+  // start the queued requests of every tablespace
+  void SubmitIO();
+
+  // append size bytes to log file and make them durable
+  void WriteLog(const char *log_data, int size);
+  // read up to size bytes at offset of log file, return bytes read
+  size_t ReadLog(char *log_data, size_t size, off_t offset);
+  off_t GetLogFileSize();
+  // cut off the log after size bytes, e.g. a torn record at its end
+  void TruncateLog(off_t size);
+  // log before offset is no longer needed, durable when this returns
+  void SetLogStart(off_t offset);
+  // offset of the first needed log record, 0 without master record
+  off_t GetLogStart();
+
+  // switch the checksums of a tablespace on or off, for good. Not while
+  // pages of it are read or written. False if there is no such tablespace
+  // or its checksum file can not be had
+  bool SetChecksums(int tablespace_id, bool enabled);
+  bool HasChecksums(int tablespace_id);
+  // pages read that failed their checksum
+  inline size_t GetChecksumFailures() const { return checksum_failures_; }
+
+  // pass every page of the tablespace written since the last call to copy,
+  // in page number order, or every page in the file if all is set, and set
+  // count to the pages passed. False if there is no such tablespace, a page
+  // can not be read or fails its checksum, or copy returns false: the pages
+  // not passed yet stay changed. May run while pages are written
+  bool TakeChangedPages(int tablespace_id, bool all, const PageCopyFunc &copy,
+                        size_t &count);
+  // keep the log from offset on, from the log start if offset is -1, until
+  // released with the offset returned, e.g. for a backup or a replica. The
+  // log start may still move past it
+  off_t HoldLog(off_t offset = -1);
+  void ReleaseLog(off_t offset);
+
+  // id of the tablespace in file_name, created and recorded in foo.spaces
+  // unless the database has it already. Throws if all MAX_TABLESPACES are
+  // taken, the file can not be opened or the database is mapped
+  int AddTablespace(const std::string &file_name);
+  // file of a tablespace, empty if there is none of that id
+  std::string GetTablespaceFile(int tablespace_id);
+
+  // a page of the tablespace, a freed one if there is one. INVALID_PAGE_ID
+  // if there is no such tablespace or it is full
+  page_id_t AllocatePage(int tablespace_id = 0);
   void DeallocatePage(page_id_t page_id);
+  // a freed page with count set to 1 if there is one, else up to count
+  // consecutive new pages of the tablespace. INVALID_PAGE_ID if there is no
+  // such tablespace or it is full
+  page_id_t AllocateExtent(int tablespace_id, int &count);
+  // hand back count pages from first_page_id that were never used
+  void ReturnExtent(page_id_t first_page_id, int count);
+  // make sure AllocatePage hands out neither page ids of the tablespace of
+  // max_page_id up to it nor ids of pages in the file, used when reopening a
+  // database
+  void ReservePageIds(page_id_t max_page_id);
+
+  // false if O_DIRECT was requested but not supported by the file system
+  inline bool IsDirectIO() const { return direct_io_; }
+
+  // keep up to bytes of encoded pages in memory, before the first I/O
+  void EnablePageCache(size_t bytes);
+  // nullptr unless enabled
+  inline PageCache *GetPageCache() { return page_cache_; }
+
+  // map the whole pages of every file, before the first I/O. False if the
+  // database file is empty or can not be mapped
+  bool EnableMmap();
+  inline bool IsMapped() const { return mapped_; }
+  // the page in the mapping, nullptr beyond the end of its mapped file
+  char *GetMappedPage(page_id_t page_id) const;
 
 private:
-  int GetFileSize();
-  std::fstream db_io_;
+  // a file next to a tablespace mapped as words for every page it can have,
+  // those beyond the file read 0
+  struct SideFile {
+    int fd_ = -1;
+    std::string name_;
+    // nullptr unless open
+    std::atomic<uint64_t> *words_ = nullptr;
+    size_t capacity_ = 0;
+    // bytes of the file, grown under latch_
+    std::atomic<size_t> size_{0};
+    std::mutex latch_;
+  };
+
+  // one file of pages, its page numbers start at 0
+  struct Tablespace {
+    int fd_ = -1;
+    AsyncIO *async_io_ = nullptr;
+    std::string file_name_;
+    std::string superblock_name_;
+    // guards the page counter and the free pages
+    std::mutex superblock_latch_;
+    page_id_t next_page_id_ = 0;
+    // recorded in the superblock, no page number at or above was handed out
+    page_id_t page_id_limit_ = 0;
+    // freed page numbers listed in the superblock
+    std::vector<page_id_t> free_pages_;
+    // freed page numbers not in the file, reused first
+    std::vector<page_id_t> spare_pages_;
+    // private mapping of the file, nullptr unless mapped
+    char *mapping_ = nullptr;
+    size_t mapped_pages_ = 0;
+    // two checksums by page number, the latest in the low half and 0 for
+    // none. Not open if checksums are off
+    SideFile checksums_;
+    // a bit per page number, set for pages written since the last backup
+    SideFile changed_pages_;
+  };
+
+  // open or create the file of a tablespace and load its superblock
+  Tablespace *OpenTablespace(const std::string &file_name);
+  static std::string GetSuperblockName(const std::string &file_name);
+  // foo.db -> foo.extension
+  static std::string GetSiblingName(const std::string &file_name,
+                                    const std::string &extension);
+  // open and map file for capacity bytes, create it if asked to
+  static bool OpenSideFile(SideFile &file, size_t capacity, bool create);
+  static void CloseSideFile(SideFile &file);
+  // make the file at least end bytes, false on error
+  static bool GrowSideFile(SideFile &file, size_t end);
+  // record the checksum of a page about to be written
+  static void UpdateChecksum(Tablespace &space, page_id_t page_id,
+                             const char *page_data);
+  // false if the page matches neither checksum it has
+  static bool VerifyChecksum(Tablespace &space, page_id_t page_id,
+                             const char *page_data);
+  static void MarkChanged(Tablespace &space, page_id_t page_id);
+  // write its superblock and close it
+  void CloseTablespace(Tablespace *space);
+  // nullptr if the tablespace of page_id is not open. Wide page ids have
+  // bits above PAGE_ID_BITS that name no tablespace
+  inline Tablespace *GetTablespace(page_id_t page_id) const {
+    if (page_id < 0 || GetTablespaceId(page_id) >= MAX_TABLESPACES)
+      return nullptr;
+    return tablespaces_[GetTablespaceId(page_id)].load();
+  }
+  // record the files of the tablespaces but the first, under
+  // tablespaces_latch_
+  bool WriteTablespaceList();
+  // map the whole pages of the file of space, false if it has none
+  bool MapTablespace(Tablespace *space);
+  static off_t GetFileSize(const Tablespace &space);
+  // aligned copy buffer if page_data can not be used for direct I/O
+  char *AllocateBounceBuffer(const char *page_data);
+  // open log file if not yet done, return false on error
+  bool OpenLog();
+  // GetLogStart, caller holds log_latch_
+  off_t ReadLogStart();
+  // load the superblock, ignored for a new file
+  static bool ReadSuperblock(Tablespace &space);
+  // false if the old superblock is still there, caller holds its latch
+  static bool WriteSuperblock(Tablespace &space);
+  bool direct_io_;
+  std::atomic<size_t> checksum_failures_{0};
+  PageCache *page_cache_;
+  bool mapped_;
   std::string file_name_;
-  std::atomic<page_id_t> next_page_id_;
+  int log_fd_;
+  std::string log_name_;
+  std::string master_name_;
+  std::string spaces_name_;
+  // end of log file, only the log flush thread appends
+  off_t log_offset_;
+  std::mutex log_latch_;
+  // offsets held, the log from the first one on is not punched out. Guarded
+  // by log_latch_
+  std::multiset<off_t> log_holds_;
+  // tablespace 0 is the database file, nullptr for ids not in use
+  std::atomic<Tablespace *> tablespaces_[MAX_TABLESPACES];
+  // guards adding tablespaces
+  std::mutex tablespaces_latch_;
+  // extents still alive, their pages are returned on destruction
+  std::unordered_set<PageExtent *> extents_;
+  std::mutex extents_latch_;
+};
+
+// pages of a table or an index, taken from its tablespace EXTENT_PAGES at a
+// time. Must not outlive the calls made to it, but may outlive the disk
+// manager
+class PageExtent {
+public:
+  PageExtent(DiskManager *disk_manager, int tablespace_id = 0);
+  // returns the pages not handed out
+  ~PageExtent();
+
+  // next page of the extent, a new extent once it is used up.
+  // INVALID_PAGE_ID if the tablespace is full
+  page_id_t AllocatePage();
+
+  inline int GetTablespaceId() const { return tablespace_id_; }
+
+private:
+  friend class DiskManager;
+
+  // nullptr once the disk manager is destroyed
+  DiskManager *disk_manager_;
+  int tablespace_id_;
+  // protects the pages not yet handed out
+  std::mutex latch_;
+  page_id_t next_page_id_ = INVALID_PAGE_ID;
+  int remaining_ = 0;
 };
 
 } // namespace cmudb
@@ -0,0 +1,63 @@
+/**
+ * page_cache.h
+ *
+ * Compressed page cache in front of the database file. It keeps encoded
+ * copies (see page_codec.h) of pages the disk manager wrote or read, up to a
+ * budget of bytes, and serves reads of them without I/O. A page of a table
+ * with long runs takes a few hundred bytes instead of PAGE_SIZE, so the
+ * budget holds many times the pages the same memory would as frames.
+ *
+ * The buffer pool only ever sees decoded pages. Writes still go through to
+ * the file in full, the file is the same with and without the cache. Least
+ * recently used copies are dropped once the budget is exceeded. The copies
+ * are charged as MemoryComponent::PAGE_CACHE.
+ */
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "common/config.h"
+
+namespace cmudb {
+
+class PageCache {
+public:
+  explicit PageCache(size_t capacity);
+  ~PageCache();
+
+  // replace the copy of page_id, or only add one when there is none yet
+  void Put(page_id_t page_id, const char *page_data, bool replace = true);
+  // false if page_id is not cached
+  bool Get(page_id_t page_id, char *page_data);
+  void Erase(page_id_t page_id);
+
+  inline size_t GetCapacity() const { return capacity_; }
+  // bytes of the encoded copies
+  size_t GetSize();
+  size_t GetPageCount();
+  // reads served from the cache
+  size_t GetHits();
+
+private:
+  struct Entry {
+    page_id_t page_id_;
+    std::string data_;
+  };
+  // caller must hold latch_
+  void EraseLocked(std::unordered_map<page_id_t,
+                                      std::list<Entry>::iterator>::iterator it);
+
+  size_t capacity_;
+  size_t size_ = 0;
+  size_t hits_ = 0;
+  // most recently used at front
+  std::list<Entry> lru_list_;
+  std::unordered_map<page_id_t, std::list<Entry>::iterator> index_;
+  std::mutex latch_;
+};
+
+} // namespace cmudb
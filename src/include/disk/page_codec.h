@@ -0,0 +1,60 @@
+/**
+ * page_codec.h
+ *
+ * Lossless encoding of a page image, used for the copies of pages the
+ * compressed page cache keeps in memory. The first byte tells the encoding:
+ *
+ * RAW: the page as it is, for pages that do not compress.
+ * LZ:  the whole page in the LZ4 block format, good for slotted table pages,
+ *      b+ tree pages and the unused space of any page.
+ * PAX: the live entries of every minipage of a PAX table page (see
+ *      table_page.h) encoded by column with the smallest of run length,
+ *      frame of reference bit packing and a dictionary of up to 256 values,
+ *      the rest of the page with LZ.
+ *
+ * Any image decodes to the exact bytes it was made from, a page that only
+ * looks like a PAX page is still restored byte by byte.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "common/config.h"
+
+namespace cmudb {
+
+// bytes an encoded page can take, a raw page and its encoding byte
+#define PAGE_CODEC_MAX_SIZE (PAGE_SIZE + 1)
+
+enum class PageEncoding : uint8_t { RAW = 0, LZ, PAX };
+
+// encoding of the live entries of one minipage
+enum class ColumnEncoding : uint8_t { RAW = 0, RLE, FOR, DICT };
+
+class PageCodec {
+public:
+  // encode page into out of PAGE_CODEC_MAX_SIZE bytes, the smallest encoding
+  // is taken. Return bytes of out used
+  static size_t Encode(const char *page, char *out);
+  // false if in is not an encoded page, page is undefined then
+  static bool Decode(const char *in, size_t size, char *page);
+
+  // LZ4 block of size bytes of src, 0 if it needs more than capacity bytes
+  static size_t CompressLZ(const char *src, size_t size, char *dst,
+                           size_t capacity);
+  // false unless src holds exactly dst_size bytes
+  static bool DecompressLZ(const char *src, size_t size, char *dst,
+                           size_t dst_size);
+
+  // count values of width 1, 2, 4 or 8 bytes at src, return bytes of dst
+  // used, it has room for 1 + count * width bytes
+  static size_t EncodeColumn(const char *src, uint32_t width, uint32_t count,
+                             char *dst);
+  // return bytes of src read, 0 if src does not hold count values
+  static size_t DecodeColumn(const char *src, size_t size, uint32_t width,
+                             uint32_t count, char *dst);
+};
+
+} // namespace cmudb
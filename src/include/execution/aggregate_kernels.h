@@ -0,0 +1,66 @@
+/**
+ * aggregate_kernels.h
+ *
+ * Count, sum, minimum and maximum of a numeric column over the dense arrays
+ * of a RowBatch, without a Value per row. INTEGER, BIGINT and DECIMAL
+ * columns are folded 8 or 4 values at a time with AVX2: the null sentinels
+ * of type/limits.h are compared into a mask, which drops the nulls from the
+ * count and zeroes them for the sum, and replaces them for the minimum and
+ * maximum. Smaller integers, and builds without AVX2, take a scalar loop.
+ *
+ * Integer sums are exact, a sum beyond a BIGINT is for the caller to
+ * report. Decimal sums are added in lanes, in a different order than one
+ * at a time.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "table/row_batch.h"
+
+namespace cmudb {
+
+struct IntegerAggregate {
+  // values that are not null
+  int64_t count_ = 0;
+  __int128 sum_ = 0;
+  // of the values, as initialized while there is none
+  int64_t min_ = std::numeric_limits<int64_t>::max();
+  int64_t max_ = std::numeric_limits<int64_t>::min();
+
+  void Merge(const IntegerAggregate &other);
+};
+
+struct DecimalAggregate {
+  int64_t count_ = 0;
+  double sum_ = 0;
+  double min_ = std::numeric_limits<double>::infinity();
+  double max_ = -std::numeric_limits<double>::infinity();
+
+  void Merge(const DecimalAggregate &other);
+};
+
+// fold count values of a column into aggregate, nulls left out
+void AggregateValues(const int8_t *values, size_t count,
+                     IntegerAggregate &aggregate);
+void AggregateValues(const int16_t *values, size_t count,
+                     IntegerAggregate &aggregate);
+void AggregateValues(const int32_t *values, size_t count,
+                     IntegerAggregate &aggregate);
+void AggregateValues(const int64_t *values, size_t count,
+                     IntegerAggregate &aggregate);
+void AggregateValues(const double *values, size_t count,
+                     DecimalAggregate &aggregate);
+
+// fold column of the selected rows of batch, a TINYINT, SMALLINT, INTEGER
+// or BIGINT column into an IntegerAggregate and a DECIMAL one into a
+// DecimalAggregate. False for a column of another type
+bool AggregateBatch(const RowBatch &batch, int column,
+                    IntegerAggregate &aggregate);
+bool AggregateBatch(const RowBatch &batch, int column,
+                    DecimalAggregate &aggregate);
+
+} // namespace cmudb
@@ -0,0 +1,116 @@
+/**
+ * external_sort.h
+ *
+ * Sort of (key, payload) records larger than memory. Records are gathered
+ * in memory until the memory limit, then sorted into a run that is written
+ * to a spill file, see spill_file.h. The runs are merged a fan-in at a time
+ * until few enough are left to merge them all as the records are read.
+ * Input that fits in memory is never written.
+ *
+ * A run is sorted by up to threads threads, each sorts a slice of it and
+ * the slices are merged in memory. The sort is stable, records of equal
+ * keys come out in the order they were added.
+ *
+ * Records in memory are charged as MemoryComponent::EXECUTION, a run is
+ * spilled early while the process is over its memory budget.
+ *
+ * Keys compare as bytes unless a comparator is given. AppendSortKey encodes
+ * values so that their bytes compare as the values do.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "execution/radix_partitions.h"
+#include "execution/spill_file.h"
+#include "type/value.h"
+
+namespace cmudb {
+
+// runs merged into one at a time at most, fewer for a small buffer pool
+#define EXECUTION_MERGE_FAN_IN 16
+// records of a run each thread sorts at least
+#define EXECUTION_SORT_SLICE 4096
+
+// append the bytes of value that sort as it does, nulls first. A key of
+// several columns is the concatenation of theirs, descending ones have
+// their bytes inverted. Varchars are compared as bytes, as sqlite's BINARY
+void AppendSortKey(std::string &key, const Value &value,
+                   bool descending = false);
+
+class ExternalSort {
+public:
+  // <0, 0 or >0 as key lhs sorts before, with or after key rhs
+  typedef std::function<int(const char *lhs, uint32_t lhs_size,
+                            const char *rhs, uint32_t rhs_size)>
+      Comparator;
+
+  // a null comparator compares the keys as bytes
+  ExternalSort(BufferPoolManager *buffer_pool_manager,
+               const Comparator &comparator = nullptr,
+               size_t memory_limit = EXECUTION_MEMORY_LIMIT,
+               size_t threads = 1);
+  ~ExternalSort();
+
+  // records may be added until Sort, throws if a run can not be spilled
+  void Add(const std::string &key, const char *payload, uint32_t size);
+
+  // done adding, the records are read with Next after
+  void Sort();
+
+  // to the first record on the first call, false past the last one
+  bool Next();
+
+  // of the current record, valid until the next call of Next
+  inline const char *GetKey() const {
+    return record_ + SPILL_RECORD_HEADER_SIZE;
+  }
+  inline uint32_t GetKeySize() const { return SpillKeySize(record_); }
+  inline const char *GetPayload() const {
+    return record_ + SPILL_RECORD_HEADER_SIZE + SpillKeySize(record_);
+  }
+  inline uint32_t GetPayloadSize() const { return SpillPayloadSize(record_); }
+
+  // runs written to spill files and the pages they took, merges included
+  inline size_t GetRunCount() const { return run_count_; }
+  inline size_t GetSpilledPageCount() const { return spilled_pages_; }
+
+private:
+  int Compare(const char *lhs, const char *rhs) const;
+  // sort offsets_ of the records in buffer_, with the threads
+  void SortOffsets();
+  // write the records in memory to a new run
+  void SpillRun();
+  // one run of runs [begin, end), merged
+  std::unique_ptr<SpillFile> MergeRuns(size_t begin, size_t end);
+
+  BufferPoolManager *buffer_pool_manager_;
+  Comparator comparator_;
+  size_t memory_limit_;
+  size_t threads_;
+  size_t fan_in_;
+  // records not spilled, at offsets_ into buffer_
+  std::vector<char> buffer_;
+  std::vector<size_t> offsets_;
+  // bytes of buffer_ and offsets_ charged to the memory tracker
+  size_t charged_ = 0;
+  std::vector<std::unique_ptr<SpillFile>> runs_;
+  size_t run_count_ = 0;
+  size_t spilled_pages_ = 0;
+
+  // reading the records in order: the next of offsets_ if nothing was
+  // spilled, else the readers of the runs merged through a heap of their
+  // indexes, the one of the least record on top
+  size_t next_offset_ = 0;
+  std::vector<std::unique_ptr<SpillFile::Reader>> readers_;
+  std::vector<size_t> heap_;
+  bool started_ = false;
+  const char *record_ = nullptr;
+};
+
+} // namespace cmudb
@@ -0,0 +1,54 @@
+/**
+ * hash_aggregate.h
+ *
+ * Grouping of (key, value) pairs with the count, sum, minimum and maximum
+ * of the values of each group. The pairs are radix partitioned by the hash
+ * of the key as they are added, then each partition is aggregated in a
+ * hash table of its own, so memory holds the groups of one partition at a
+ * time. Partitions that do not fit are spilled to pages of the buffer
+ * pool, see radix_partitions.h.
+ *
+ * Keys are compared as bytes, the caller encodes them so that equal values
+ * have equal bytes, nulls included.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "execution/radix_partitions.h"
+
+namespace cmudb {
+
+struct AggregateState {
+  // rows of the group, and those with a value that is not null
+  int64_t rows_ = 0;
+  int64_t values_ = 0;
+  // of the values, undefined while there is none
+  double sum_ = 0;
+  double min_ = 0;
+  double max_ = 0;
+};
+
+class HashAggregate {
+public:
+  HashAggregate(BufferPoolManager *buffer_pool_manager,
+                size_t memory_limit = EXECUTION_MEMORY_LIMIT);
+
+  // a row of the group of key, value is nullptr for null
+  void Add(const std::string &key, const double *value);
+
+  // callback of every group, grouped by partition
+  void Run(const std::function<void(const std::string &key,
+                                    const AggregateState &state)> &callback);
+
+  inline size_t GetSpilledPageCount() const {
+    return input_.GetSpilledPageCount();
+  }
+
+private:
+  RadixPartitions input_;
+};
+
+} // namespace cmudb
@@ -0,0 +1,48 @@
+/**
+ * hash_join.h
+ *
+ * Equi-join of two inputs of (key, rowid) pairs. Both sides are radix
+ * partitioned by the hash of the key as they are added, then joined one
+ * partition at a time: a hash table is built from the build side's records
+ * of the partition and the probe side's records of the same partition look
+ * their keys up in it. Memory holds one partition's table at a time, the
+ * rest may be spilled to pages of the buffer pool, see radix_partitions.h.
+ *
+ * Keys are compared as bytes, the caller encodes them so that equal values
+ * have equal bytes and leaves nulls out.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "execution/radix_partitions.h"
+
+namespace cmudb {
+
+class HashJoin {
+public:
+  // each side may keep half of memory_limit in memory
+  HashJoin(BufferPoolManager *buffer_pool_manager,
+           size_t memory_limit = EXECUTION_MEMORY_LIMIT);
+
+  // the build side should be the smaller one
+  void AddBuild(const std::string &key, int64_t rowid);
+  void AddProbe(const std::string &key, int64_t rowid);
+
+  // callback of every pair of a build and a probe row of equal keys,
+  // grouped by partition
+  void Run(const std::function<void(const std::string &key, int64_t build,
+                                    int64_t probe)> &callback);
+
+  inline size_t GetSpilledPageCount() const {
+    return build_.GetSpilledPageCount() + probe_.GetSpilledPageCount();
+  }
+
+private:
+  RadixPartitions build_;
+  RadixPartitions probe_;
+};
+
+} // namespace cmudb
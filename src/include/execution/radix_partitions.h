@@ -0,0 +1,95 @@
+/**
+ * radix_partitions.h
+ *
+ * Records of (key, payload) bytes split by the top bits of the hash of
+ * their key, the input of the hash join and hash aggregation. Each
+ * partition fits in memory on its own when the whole input does not, so the
+ * operators build one hash table per partition.
+ *
+ * Records are appended to a byte buffer per partition. Once the buffers
+ * together pass the memory limit the largest ones are spilled: their bytes
+ * are moved to the spill file of the partition, see spill_file.h.
+ *
+ * Records in memory are charged as MemoryComponent::EXECUTION. While the
+ * process is over its memory budget (see memory_tracker.h) operators spill
+ * past EXECUTION_MEMORY_MIN, whatever their own limit.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/memory_tracker.h"
+#include "execution/spill_file.h"
+
+namespace cmudb {
+
+// partitions are the top bits of the hash of a key
+#define EXECUTION_RADIX_BITS 6
+// bytes of records an operator keeps in memory before it spills
+#define EXECUTION_MEMORY_LIMIT (16 * 1024 * 1024)
+// bytes of records an operator keeps while the process is over budget
+#define EXECUTION_MEMORY_MIN (256 * 1024)
+
+// memory_limit of an operator, lowered while the process is over budget
+inline size_t GetExecutionMemoryLimit(size_t memory_limit) {
+  return MemoryTracker::IsOverBudget()
+             ? std::min<size_t>(memory_limit, EXECUTION_MEMORY_MIN)
+             : memory_limit;
+}
+
+class RadixPartitions {
+public:
+  RadixPartitions(BufferPoolManager *buffer_pool_manager, size_t memory_limit,
+                  uint32_t bits = EXECUTION_RADIX_BITS);
+  ~RadixPartitions();
+
+  // partition of a key hashed by Hash
+  inline size_t PartitionOf(uint64_t hash) const {
+    return bits_ == 0 ? 0 : static_cast<size_t>(hash >> (64 - bits_));
+  }
+
+  static uint64_t Hash(const std::string &key);
+
+  // append a record to the partition of its key, spilling if memory is
+  // short. Throws if a spilled record would not fit a page
+  void Add(const std::string &key, const char *payload, uint32_t size);
+
+  inline size_t GetPartitionCount() const { return partitions_.size(); }
+
+  // every record of partition, spilled or not, in no particular order
+  void Scan(size_t partition,
+            const std::function<void(const std::string &key,
+                                     const char *payload, uint32_t size)>
+                &callback);
+
+  // bytes of records held in memory
+  inline size_t GetMemoryUsage() const { return memory_usage_; }
+
+  // pages written by spills
+  inline size_t GetSpilledPageCount() const { return spilled_pages_; }
+
+private:
+  struct Partition {
+    std::vector<char> buffer_;
+    // the spilled records, nullptr until the first spill
+    std::unique_ptr<SpillFile> file_;
+  };
+
+  // move the records of partition in memory to its pages
+  void Spill(Partition &partition);
+
+  BufferPoolManager *buffer_pool_manager_;
+  size_t memory_limit_;
+  uint32_t bits_;
+  std::vector<Partition> partitions_;
+  size_t memory_usage_ = 0;
+  size_t spilled_pages_ = 0;
+};
+
+} // namespace cmudb
@@ -0,0 +1,104 @@
+/**
+ * spill_file.h
+ *
+ * Records an operator moved out of memory, on a chain of pages taken from
+ * the buffer pool. The pages are not logged and are deleted again with the
+ * file, they live as long as the query.
+ *
+ * Record format (size in byte), in memory and on pages alike:
+ *  ---------------------------------------------------------
+ * | KeySize (4) | PayloadSize (4) | Key (KeySize) | Payload |
+ *  ---------------------------------------------------------
+ * Page format: | NextPageId (4) | UsedBytes (4) | Records ... |, the page id
+ * takes 8 bytes with WIDE_PAGE_IDS
+ *
+ * Records are never split across pages, a page is left with a gap at its
+ * end instead.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+
+namespace cmudb {
+
+#define SPILL_RECORD_HEADER_SIZE 8
+// used bytes of a page, after its next page id
+#define SPILL_USED_OFFSET sizeof(page_id_t)
+#define SPILL_PAGE_HEADER_SIZE (SPILL_USED_OFFSET + 4)
+
+// fields of a record in the format above
+static inline uint32_t SpillKeySize(const char *record) {
+  uint32_t size;
+  memcpy(&size, record, sizeof(uint32_t));
+  return size;
+}
+
+static inline uint32_t SpillPayloadSize(const char *record) {
+  uint32_t size;
+  memcpy(&size, record + 4, sizeof(uint32_t));
+  return size;
+}
+
+static inline uint32_t SpillRecordSize(const char *record) {
+  return SPILL_RECORD_HEADER_SIZE + SpillKeySize(record) +
+         SpillPayloadSize(record);
+}
+
+// append a record to buffer
+void AppendSpillRecord(std::vector<char> &buffer, const char *key,
+                       uint32_t key_size, const char *payload,
+                       uint32_t payload_size);
+
+class SpillFile {
+public:
+  explicit SpillFile(BufferPoolManager *buffer_pool_manager)
+      : buffer_pool_manager_(buffer_pool_manager) {}
+
+  // the pages are deleted
+  ~SpillFile();
+
+  // append the records of bytes [records, records + size) behind the
+  // others. Throws if one would not fit a page or no page can be had
+  void Append(const char *records, size_t size);
+
+  inline size_t GetPageCount() const { return page_ids_.size(); }
+
+  // every record in the order they were appended
+  void Scan(const std::function<void(const char *record)> &callback) const;
+
+  // the records one at a time, the page of the current one pinned
+  class Reader {
+  public:
+    explicit Reader(const SpillFile *file) : file_(file) {}
+    ~Reader();
+
+    // to the first record on the first call, false past the last one
+    bool Next();
+
+    // valid until the next call of Next
+    inline const char *GetRecord() const { return record_; }
+
+  private:
+    const SpillFile *file_;
+    // index into the pages of the file of the pinned one
+    size_t page_index_ = 0;
+    Page *page_ = nullptr;
+    uint32_t used_ = 0;
+    uint32_t offset_ = 0;
+    const char *record_ = nullptr;
+  };
+
+private:
+  BufferPoolManager *buffer_pool_manager_;
+  // the chain, the last page is the one being filled
+  std::vector<page_id_t> page_ids_;
+};
+
+} // namespace cmudb
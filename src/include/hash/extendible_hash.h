@@ -5,13 +5,29 @@
  * Functionality: The buffer pool manager must maintain a page table to be able
  * to quickly map a PageId to its corresponding memory location; or alternately
  * report that the PageId does not match any currently-buffered page.
+ *
+ * Concurrency: every bucket has its own latch taken by writers, the directory
+ * is read without latches and only bucket splits serialize on split_latch_.
+ * Find takes no latch when keys and values are trivially copyable: like the
+ * optimistic readers of pages it remembers an even bucket version, copies the
+ * value and retries if a writer changed the bucket meanwhile. Other types
+ * are found under the bucket latch.
+ * The directory points at buckets that it may not own any more, it is only a
+ * hint: a bucket knows the hash bits of its keys and a thread that latched
+ * the wrong bucket starts over. Buckets are never merged, buckets and
+ * replaced directories live as long as the table.
  */
 
 #pragma once
 
+#include <atomic>
 #include <cstdlib>
-#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 #include "hash/hash_table.h"
 
@@ -22,6 +38,7 @@ class ExtendibleHash : public HashTable<K, V> {
 public:
   // constructor
   ExtendibleHash(size_t size);
+  ~ExtendibleHash();
   // helper function to generate hash addressing
   size_t HashKey(const K &key);
   // helper function to get global & local depth
@@ -34,6 +51,62 @@ public:
   void Insert(const K &key, const V &value) override;
 
 private:
-  // add your own member variables here
+  struct Entry {
+    K key_;
+    V value_;
+  };
+
+  // a bucket holds at most bucket_size_ entries whose hash ends in the low
+  // local_depth_ bits of pattern_
+  struct Bucket {
+    Bucket(int depth, size_t pattern, size_t capacity)
+        : local_depth_(depth), pattern_(pattern), size_(0),
+          capacity_(capacity), entries_(new Entry[capacity]) {}
+    ~Bucket() { delete[] entries_; }
+    // the low local_depth_ bits of hash
+    inline size_t Mask(size_t hash) const {
+      return hash & ((static_cast<size_t>(1) << (local_depth_ & 63)) - 1);
+    }
+    int local_depth_;
+    size_t pattern_;
+    size_t size_;
+    const size_t capacity_;
+    Entry *entries_;
+    // writers only, odd version while one changes the bucket
+    std::mutex latch_;
+    std::atomic<uint64_t> version_{0};
+  };
+
+  // 2^global_depth_ slots pointing to (possibly shared) buckets
+  struct Directory {
+    Directory(int depth)
+        : global_depth_(depth),
+          slots_(new std::atomic<Bucket *>[static_cast<size_t>(1) << depth]) {
+    }
+    ~Directory() { delete[] slots_; }
+    int global_depth_;
+    std::atomic<Bucket *> *slots_;
+  };
+
+  // values copied by optimistic readers must survive a torn read
+  static const bool optimistic_ = std::is_trivially_copyable<K>::value &&
+                                  std::is_trivially_copyable<V>::value;
+
+  // write latch the bucket of hash, return with its latch and version odd
+  Bucket *WLatchBucket(size_t hash);
+  void WUnlatchBucket(Bucket *bucket);
+  // split the full write latched bucket, doubling the directory if needed
+  void Split(Bucket *bucket);
+  // index of key in bucket, -1 if missing
+  static int EntryIndex(const Bucket *bucket, const K &key);
+
+  const size_t bucket_size_;
+  std::atomic<Directory *> directory_;
+  std::atomic<int> num_buckets_;
+  // protects the slots of the directory, buckets_ and directories_
+  std::mutex split_latch_;
+  // every bucket and directory, freed with the table
+  std::vector<Bucket *> buckets_;
+  std::vector<Directory *> directories_;
 };
 } // namespace cmudb
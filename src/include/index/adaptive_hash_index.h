@@ -0,0 +1,160 @@
+/**
+ * adaptive_hash_index.h
+ *
+ * Hash from the keys point lookups keep finding to the leaf and slot they
+ * were found in, built as the lookups go so that hot keys skip the descent
+ * from the root. It is only a hint: a lookup through it reads the leaf latch
+ * free and checks that the slot still holds the key (see
+ * BPlusTree::GetValue), otherwise the entry is dropped and the lookup
+ * descends as usual.
+ *
+ * A leaf is hot once AHI_HOT_SEARCHES descents found a key in it, from then
+ * on the keys found in it get an entry. Entries of a page go stale at once
+ * when it splits, merges or is deleted: an entry keeps the generation its
+ * page had, InvalidatePage moves the generation on. Generations and search
+ * counts are kept in tables by page id, pages sharing a slot invalidate
+ * each other. Entries are sharded by key, each shard with its own latch.
+ *
+ * The index watches its hit rate. Once AHI_WINDOW lookups went through it,
+ * a hit rate below AHI_MIN_HIT_RATE turns it off and clears it. The first
+ * window after it comes on is for building and not judged. A thread that
+ * made AHI_RETRY_LOOKUPS lookups while it was off turns it on again.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include "common/config.h"
+
+namespace cmudb {
+
+// shards of the entries
+#define AHI_PARTITIONS 16
+// slots of the generation and search count tables
+#define AHI_PAGE_SLOTS 4096
+// descents a leaf takes before its keys get entries
+#define AHI_HOT_SEARCHES 4
+// entries kept at most, more are not made
+#define AHI_MAX_ENTRIES (1 << 16)
+// lookups between two looks at the hit rate
+#define AHI_WINDOW 4096
+#define AHI_MIN_HIT_RATE 0.2
+// lookups of a thread with the index off before it tries it again
+#define AHI_RETRY_LOOKUPS (1 << 16)
+
+// a snapshot taken by AdaptiveHashIndex::GetStats
+struct AdaptiveHashStats {
+  // lookups through the index and those it answered, in the current window
+  uint64_t lookups_ = 0;
+  uint64_t hits_ = 0;
+  size_t entries_ = 0;
+  // times the index turned itself off for its hit rate
+  uint64_t disables_ = 0;
+  bool enabled_ = false;
+};
+
+template <typename KeyType> class AdaptiveHashIndex {
+public:
+  AdaptiveHashIndex();
+
+  // on by default, turned off it is cleared and stays off
+  void SetAllowed(bool allowed);
+
+  inline bool IsAllowed() const {
+    return allowed_.load(std::memory_order_relaxed);
+  }
+
+  // whether a lookup goes through the index. Off, the lookup counts
+  // towards turning it on again
+  bool Begin();
+
+  // leaf and slot of the entry of key with the generation it was made in,
+  // false if key has none or it is stale
+  bool Find(const KeyType &key, page_id_t &page_id, int &slot,
+            uint32_t &generation);
+
+  // the entry of key did not hold, it is dropped and the lookup a miss
+  void Drop(const KeyType &key);
+
+  // read before the page, with the write latch it is invalidated under
+  inline uint32_t GetGeneration(page_id_t page_id) const {
+    return generations_[Slot(page_id)].load(std::memory_order_acquire);
+  }
+
+  // page_id was not invalidated since generation was read
+  inline bool IsCurrent(page_id_t page_id, uint32_t generation) const {
+    return GetGeneration(page_id) == generation;
+  }
+
+  // a descent found key at slot of the leaf page_id, in the generation read
+  // before the leaf
+  void RecordSearch(const KeyType &key, page_id_t page_id, int slot,
+                    uint32_t generation);
+
+  // the entries of page_id are stale, under its write latch before its keys
+  // move or it is freed
+  void InvalidatePage(page_id_t page_id);
+
+  AdaptiveHashStats GetStats();
+
+private:
+  struct Entry {
+    page_id_t page_id_;
+    int slot_;
+    uint32_t generation_;
+  };
+
+  // 64 bit words of the key mixed like the finalizer of MurmurHash3
+  struct KeyHash {
+    size_t operator()(const KeyType &key) const;
+  };
+
+  // keys are equal on their bytes, a key that compares equal on other bytes
+  // misses and descends
+  struct KeyEqual {
+    inline bool operator()(const KeyType &lhs, const KeyType &rhs) const {
+      return memcmp(&lhs, &rhs, sizeof(KeyType)) == 0;
+    }
+  };
+
+  struct Partition {
+    std::mutex latch_;
+    std::unordered_map<KeyType, Entry, KeyHash, KeyEqual> entries_;
+    // changed under latch_, summed up without it
+    std::atomic<uint64_t> lookups_{0};
+    std::atomic<uint64_t> misses_{0};
+  };
+
+  static inline size_t Slot(page_id_t page_id) {
+    return static_cast<uint32_t>(page_id) % AHI_PAGE_SLOTS;
+  }
+
+  inline Partition &GetPartition(const KeyType &key) {
+    return partitions_[KeyHash()(key) % AHI_PARTITIONS];
+  }
+
+  // judge the hit rate of a full window
+  void CheckHitRate();
+
+  // drop every entry and count, start a window
+  void Clear();
+
+  std::atomic<bool> allowed_;
+  std::atomic<bool> enabled_;
+  // the current window is the first one since the index came on
+  std::atomic<bool> building_;
+  std::atomic<size_t> entry_count_;
+  std::atomic<uint64_t> disables_;
+  // one thread judges a window
+  std::mutex window_latch_;
+  std::atomic<uint32_t> generations_[AHI_PAGE_SLOTS];
+  // descents that found a key in the pages of a slot, up to AHI_HOT_SEARCHES
+  std::atomic<uint8_t> searches_[AHI_PAGE_SLOTS];
+  Partition partitions_[AHI_PARTITIONS];
+};
+
+} // namespace cmudb
@@ -0,0 +1,119 @@
+/**
+ * art_index.h
+ *
+ * In-memory index over an adaptive radix tree, for small tables looked up
+ * often: a point lookup follows a few pointers without a page of the buffer
+ * pool. Nothing is written to disk, the index is filled from the table heap
+ * whenever the table is opened.
+ *
+ * Keys are encoded to bytes that compare as the values do, see EncodeKey.
+ * Inner nodes hold 4, 16, 48 or 256 children and are grown as they fill,
+ * paths of nodes with one child are compressed into the prefix of the next.
+ * The first ART_PREFIX_LENGTH bytes of a prefix are kept in the node, a
+ * lookup skips the rest and compares the whole key at the leaf.
+ *
+ * Synchronization is optimistic lock coupling: every node has a version,
+ * readers validate the versions of the nodes they read instead of latching
+ * them and restart on a change, writers lock the nodes they change. Nodes
+ * and leaves unlinked by a writer are freed once no reader that could still
+ * see them is left, tracked by a global epoch.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "index/index.h"
+
+namespace cmudb {
+
+// prefix bytes an inner node keeps, longer prefixes are read from a leaf
+#define ART_PREFIX_LENGTH 8
+// unlinked nodes kept before the epoch is advanced to free them
+#define ART_RECLAIM_BATCH 64
+
+class ArtIndex : public Index {
+public:
+  explicit ArtIndex(IndexMetadata *metadata);
+
+  ~ArtIndex();
+
+  void InsertEntry(const Tuple &key, RID rid,
+                   Transaction *transaction = nullptr) override;
+
+  void DeleteEntry(const Tuple &key, RID rid,
+                   Transaction *transaction = nullptr) override;
+
+  void ScanKey(const Tuple &key, std::vector<RID> &result,
+               Transaction *transaction = nullptr) override;
+
+  // a range of one key is looked up, others read every leaf in key order.
+  // The planner only looks up points
+  IndexScanIterator *ScanRange(const Tuple *low_key, bool low_inclusive,
+                               const Tuple *high_key, bool high_inclusive,
+                               Transaction *transaction = nullptr) override;
+
+  size_t GetEntryCount(Transaction *transaction = nullptr) override {
+    return entry_count_.load(std::memory_order_relaxed);
+  }
+
+  // key columns of a key or stored tuple to bytes that memcmp in the order
+  // of the values: per column a null byte, then integers big endian with
+  // the sign bit flipped, decimals by the bits of the double made to sort
+  // and varchars up to their first zero byte followed by one
+  void EncodeKey(const Tuple &key, std::string &bytes) const;
+
+  struct Node;
+  struct Leaf;
+
+private:
+  // true with the rid of the entry of bytes, a whole key of the tree
+  bool Lookup(const std::string &bytes, RID &rid);
+
+  // false if the tree has an entry of bytes already
+  bool Insert(const std::string &bytes, RID rid);
+
+  // false if the tree has no entry of bytes
+  bool Remove(const std::string &bytes);
+
+  // leaves whose keys start with prefix, in key order
+  void CollectLeaves(const std::string &prefix, std::vector<Leaf *> &leaves);
+
+  // one attempt of each, false if a version changed and it has to restart
+  bool TryLookup(const std::string &bytes, RID &rid, bool &found);
+  bool TryInsert(const std::string &bytes, RID rid, bool &inserted);
+  bool TryRemove(const std::string &bytes, bool &removed);
+  bool TryCollectLeaves(const std::string &prefix,
+                        std::vector<Leaf *> &leaves);
+
+  // enter and leave the current epoch, nothing unlinked meanwhile is freed
+  // before Exit
+  size_t EnterEpoch();
+  void ExitEpoch(size_t slot);
+
+  // free node or leaf once no reader can reach it
+  void Retire(Node *node);
+  void Retire(Leaf *leaf);
+  // advance the epoch if no reader is two behind, free what is unreachable
+  void Reclaim();
+
+  class EpochGuard;
+
+  // root of the tree, a node of 256 children without prefix never replaced
+  Node *root_;
+  std::atomic<size_t> entry_count_{0};
+
+  std::atomic<uint64_t> epoch_{0};
+  // readers that entered in an even and an odd epoch
+  std::atomic<uint64_t> readers_[2];
+  // unlinked nodes and leaves with the epoch they were unlinked in
+  std::mutex garbage_latch_;
+  std::vector<std::pair<uint64_t, Node *>> garbage_nodes_;
+  std::vector<std::pair<uint64_t, Leaf *>> garbage_leaves_;
+};
+
+} // namespace cmudb
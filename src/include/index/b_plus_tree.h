@@ -7,46 +7,166 @@
  * (2) support insert & remove
  * (3) The structure should shrink and grow dynamically
  * (4) Implement index iterator for range scan
+ *
+ * Concurrency is latch crabbing. root_latch_ guards root_page_id_, readers
+ * descend with read latches and release a parent once its child is latched.
+ *
+ * The root page id lives in memory, a new root only marks it changed. The
+ * owner takes it with GetChangedRootPageId at checkpoints and when it closes
+ * the tree and writes it into the catalog, so root splits do not meet on the
+ * header pages.
+ *
+ * Writers first try the optimistic way: descend like a reader, write latch
+ * only the leaf, and modify it if that can not split or merge it. Otherwise
+ * they restart pessimistically: root_latch_ and every page on the way are write
+ * latched and kept in the page set of the transaction (nullptr stands for
+ * root_latch_) until a node is reached that is safe, i.e. will absorb the
+ * change without splitting or merging; then all of its ancestors are released.
+ * Most writes leave upper levels untouched, so writers only meet on leaves.
+ *
+ * Point lookups take no latches at all (optimistic lock coupling): they
+ * remember the version of each page, read it, and check the version of the
+ * parent again once the child is pinned. A changed version restarts the
+ * lookup, after OPTIMISTIC_READ_RETRIES restarts it crabs with read latches.
+ * In a pool that swizzles they follow the frames of resident children
+ * directly instead of fetching them (see buffer_pool_manager.h), a lookup
+ * through a hot upper tree then never touches the page table.
+ * Batches of lookups interleave their descents the same way, so the stalls
+ * of cache and buffer pool misses of one key overlap the work of others.
+ *
+ * Point lookups of hot keys skip the descent through an adaptive hash index
+ * (see adaptive_hash_index.h): the keys found in hot leaves are hashed to
+ * their leaf and slot, a lookup reads that slot latch free and descends if
+ * it no longer holds the key. Splits and merges invalidate the entries of
+ * their leaves under the write latch, a lookup checks that no invalidation
+ * came between reading the leaf and validating its version. The index turns
+ * itself off while its hit rate is poor, and is not used while the buffer
+ * pool swizzles.
+ *
+ * In buffered mode (SetBufferSize) inserts and removes do not go down the
+ * tree, they leave a message per key in a buffer kept in front of the root.
+ * A full buffer is flushed: its messages are applied in key order, so each
+ * leaf is dirtied once per flush for all of its keys instead of once per
+ * random insert. Lookups read the message of a key over its leaf. Scans,
+ * batched lookups, counts and GetChangedRootPageId flush first, the pages
+ * written at a checkpoint or close hold every change.
  */
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <map>
 #include <queue>
 #include <vector>
 
+#include "common/rwmutex.h"
 #include "concurrency/transaction.h"
+#include "index/adaptive_hash_index.h"
 #include "index/index_iterator.h"
+#include "index/reverse_index_iterator.h"
 #include "page/b_plus_tree_internal_page.h"
 #include "page/b_plus_tree_leaf_page.h"
 
 namespace cmudb {
 
 #define BPLUSTREE_TYPE BPlusTree<KeyType, ValueType, KeyComparator>
+
+// latch free attempts of a point lookup before it takes read latches
+#define OPTIMISTIC_READ_RETRIES 8
+// lookups GetValuesInterleaved keeps in flight at once
+#define INTERLEAVED_LOOKUP_GROUP 16
+// how full BulkLoad packs pages, room is left for later inserts
+#define BULK_LOAD_FILL_FACTOR 0.9
+// messages a buffered tree gathers before it flushes them
+#define BPLUSTREE_BUFFER_SIZE 4096
+
+// what a descent to a leaf is for, decides latch modes and when a node is safe
+enum class Operation { READ = 0, INSERT, DELETE };
+
+// pending change of a key in buffered mode. PUT is a remove followed by an
+// insert, the key holds the value of the message whatever the tree has
+enum class MessageType { INSERT = 0, DELETE, PUT };
+
 // Main class providing the API for the Interactive B+ Tree.
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTree {
 public:
+  // new nodes are taken from tablespace_id
   explicit BPlusTree(const std::string &name,
                            BufferPoolManager *buffer_pool_manager,
                            const KeyComparator &comparator,
-                           page_id_t root_page_id = INVALID_PAGE_ID);
+                           page_id_t root_page_id = INVALID_PAGE_ID,
+                           int tablespace_id = 0);
 
   // Returns true if this B+ tree has no keys and values.
   bool IsEmpty() const;
 
-  // Insert a key-value pair into this B+ tree.
+  // Insert a key-value pair into this B+ tree. In buffered mode false only
+  // if the buffer knows the key, a duplicate of a key in the leaves is
+  // dropped when the message is flushed
   bool Insert(const KeyType &key, const ValueType &value,
               Transaction *transaction = nullptr);
 
   // Remove a key and its value from this B+ tree.
   void Remove(const KeyType &key, Transaction *transaction = nullptr);
 
+  // buffered mode with room for size messages, 0 (the default) turns it off
+  // after a flush. Set before the tree is shared
+  void SetBufferSize(size_t size);
+
+  inline size_t GetBufferSize() const { return buffer_size_; }
+
+  // apply the buffered messages to the leaves
+  void Flush();
+
+  // buffer flushes since the tree was opened
+  inline size_t GetBufferFlushCount() const { return buffer_flushes_; }
+
+  // build an empty tree bottom up from strictly increasing keys, pages are
+  // filled to fill_factor (0.5 to 1) of their max size
+  bool BulkLoad(const std::vector<MappingType> &items,
+                double fill_factor = BULK_LOAD_FILL_FACTOR);
+
+  // BulkLoad of the items next returns one at a time, false once there are
+  // no more. They must come in strictly increasing key order, which is not
+  // checked; false if the tree is not empty
+  bool BulkLoad(const std::function<bool(MappingType &item)> &next,
+                double fill_factor = BULK_LOAD_FILL_FACTOR);
+
   // return the value associated with a given key
   bool GetValue(const KeyType &key, std::vector<ValueType> &result,
                 Transaction *transaction = nullptr);
 
+  // GetValue of keys in ascending order, equal keys allowed. The path down
+  // is shared: internal pages stay pinned and read latched while the batch
+  // has keys below them, each leaf is read once. Returns the keys found,
+  // found gets a flag per key
+  size_t GetValues(const std::vector<KeyType> &keys,
+                   std::vector<ValueType> &result,
+                   std::vector<bool> *found = nullptr);
+
+  // GetValues of keys in any order with up to group latch free descents in
+  // flight: a descent whose next page is not in the pool reads it ahead and
+  // yields to the others instead of waiting. Values are in the order of
+  // their keys
+  size_t GetValuesInterleaved(const std::vector<KeyType> &keys,
+                              std::vector<ValueType> &result,
+                              std::vector<bool> *found = nullptr,
+                              size_t group = INTERLEAVED_LOOKUP_GROUP);
+
   // index iterator
   INDEXITERATOR_TYPE Begin();
   INDEXITERATOR_TYPE Begin(const KeyType &key);
+  // at the greatest key, its next is the end
+  INDEXITERATOR_TYPE Last();
+  // from the greatest key down, or from the greatest key not above key
+  // (below it unless inclusive)
+  REVERSE_INDEXITERATOR_TYPE RBegin();
+  REVERSE_INDEXITERATOR_TYPE RBegin(const KeyType &key, bool inclusive = true);
+
+  // entries in the leaves, counted without decoding them. Exact unless
+  // writers move entries between leaves while it walks them
+  size_t GetEntryCount();
 
   // Print this B+ tree to stdout using a simple command-line
   std::string ToString(bool verbose = false);
@@ -58,22 +178,137 @@ public:
   // read data from file and remove one by one
   void RemoveFromFile(const std::string &file_name,
                       Transaction *transaction = nullptr);
-  // expose for test purpose
+  // expose for test purpose, the leaf is pinned but not latched
   B_PLUS_TREE_LEAF_PAGE_TYPE *FindLeafPage(const KeyType &key,
                                            bool leftMost = false);
 
+  // writers try a read latched descent first, on by default
+  inline void SetOptimisticLatching(bool optimistic) {
+    optimistic_ = optimistic;
+  }
+
+  // optimistic writes that had to restart pessimistically
+  inline size_t GetOptimisticRestartCount() const {
+    return optimistic_restarts_;
+  }
+
+  inline page_id_t GetRootPageId() const { return root_page_id_; }
+
+  // the adaptive hash index is on by default, off it is dropped
+  inline void SetAdaptiveHashIndex(bool enabled) {
+    adaptive_hash_.SetAllowed(enabled);
+  }
+
+  inline AdaptiveHashStats GetAdaptiveHashStats() {
+    return adaptive_hash_.GetStats();
+  }
+
+  // false if the root page id did not change since the last call, else true
+  // with the root page id, INVALID_PAGE_ID for an emptied tree
+  bool GetChangedRootPageId(page_id_t &root_page_id);
+
 private:
+  friend class ReverseIndexIterator<KeyType, ValueType, KeyComparator>;
+
+  // orders the keys of the buffer
+  struct KeyLess {
+    explicit KeyLess(const KeyComparator &comparator)
+        : comparator_(comparator) {}
+    bool operator()(const KeyType &lhs, const KeyType &rhs) const {
+      return comparator_(lhs, rhs) < 0;
+    }
+    KeyComparator comparator_;
+  };
+
+  struct Message {
+    MessageType type_;
+    ValueType value_;
+  };
+
+  // Insert and Remove on the leaves, bypassing the buffer
+  bool TreeInsert(const KeyType &key, const ValueType &value,
+                  Transaction *transaction);
+  void TreeRemove(const KeyType &key, Transaction *transaction);
+
+  // GetValue on the leaves
+  bool TreeGetValue(const KeyType &key, std::vector<ValueType> &result);
+
+  // GetValue through the adaptive hash index, false unless its entry of key
+  // held
+  bool AdaptiveGetValue(const KeyType &key, std::vector<ValueType> &result);
+
+  // add the message of an insert (value) or remove (nullptr) of key to the
+  // buffer, folding it into the one the key has. False for an insert of a
+  // key the buffer holds
+  bool BufferMessage(const KeyType &key, const ValueType *value);
+
+  // apply the messages in key order, buffer_latch_ is write latched
+  void FlushBuffer();
+
   void StartNewTree(const KeyType &key, const ValueType &value);
 
   bool InsertIntoLeaf(const KeyType &key, const ValueType &value,
                       Transaction *transaction = nullptr);
 
+  // latch free point lookup, false means a page changed under it
+  bool OptimisticGetValue(const KeyType &key, std::vector<ValueType> &result,
+                          bool &found);
+
+  // insert or remove with a read latched descent and the leaf write latched.
+  // false if the leaf could split or merge, nothing was changed then
+  bool OptimisticInsert(const KeyType &key, const ValueType &value,
+                        bool &inserted);
+  bool OptimisticRemove(const KeyType &key);
+
+  // descend to the leaf of key, or the left or right most one. Returns it
+  // pinned and latched, nullptr for an empty tree. Pessimistic writers keep
+  // the latched path in the page set of transaction, see above. next_leaves
+  // gets the leaves the parent has after it, for read-ahead
+  Page *FindLeaf(const KeyType &key, bool left_most, Operation op,
+                 Transaction *transaction = nullptr, bool optimistic = false,
+                 bool right_most = false,
+                 std::vector<page_id_t> *next_leaves = nullptr);
+
+  // descend with read latches to the last leaf that may hold a key below
+  // key, or not above it when inclusive; the right most one for nullptr.
+  // Returns it pinned and latched, nullptr for an empty tree. fence gets the
+  // separator the keys of the leaf are not below, has_fence is false for the
+  // left most leaf
+  Page *FindReverseLeaf(const KeyType *key, bool inclusive, KeyType &fence,
+                        bool &has_fence);
+
+  // will node take op on key without splitting or merging
+  bool IsSafe(BPlusTreePage *node, Operation op, const KeyType &key);
+
+  // unlatch and unpin the pages of the page set of a pessimistic writer
+  void ReleasePageSet(Transaction *transaction, bool is_dirty);
+
+  // delete the pages emptied by merges, after their latches are gone
+  void DeletePages(Transaction *transaction);
+
+  Page *FetchPage(page_id_t page_id);
+  // data of a new pinned page
+  char *NewPage(page_id_t &page_id);
+
+  // split count entries into pages of about per_page entries, no page gets
+  // fewer than the others but one
+  static std::vector<int> PageSizes(int count, int per_page);
+
   void InsertIntoParent(BPlusTreePage *old_node, const KeyType &key,
                         BPlusTreePage *new_node,
                         Transaction *transaction = nullptr);
 
   template <typename N> N *Split(N *node);
 
+  // point the leaf page_id back to prev_page_id, at once unless it is
+  // latched, else by LinkDeferredPages
+  void LinkPrevPage(page_id_t page_id, page_id_t prev_page_id);
+  // the links LinkPrevPage deferred, once the writer holds no latch
+  void LinkDeferredPages();
+
+  void SplitLeaf(B_PLUS_TREE_LEAF_PAGE_TYPE *leaf, const KeyType &key,
+                 const ValueType &value, Transaction *transaction);
+
   template <typename N>
   bool CoalesceOrRedistribute(N *node, Transaction *transaction = nullptr);
 
@@ -87,13 +322,32 @@ private:
 
   bool AdjustRoot(BPlusTreePage *node);
 
-  void UpdateRootPageId(int insert_record = false);
+  // root_page_id_ changed, the catalog is behind until the owner takes it
+  inline void UpdateRootPageId() { root_dirty_ = true; }
 
   // member variable
   std::string index_name_;
-  page_id_t root_page_id_;
+  // atomic for the latch free lookups, changed under root_latch_
+  std::atomic<page_id_t> root_page_id_;
   BufferPoolManager *buffer_pool_manager_;
+  // new nodes, in its tablespace
+  PageExtent extent_;
   KeyComparator comparator_;
+  // protect root_page_id_
+  RWMutex root_latch_;
+  bool optimistic_;
+  std::atomic<size_t> optimistic_restarts_;
+  // root_page_id_ changed since the owner last took it
+  std::atomic<bool> root_dirty_;
+  // frame the root was last fetched into, for swizzled lookups
+  std::atomic<Page *> root_frame_;
+  // buffered mode, messages by key. Lookups read latch buffer_latch_ over
+  // the buffer and the leaves, writers and flushes write latch it
+  size_t buffer_size_;
+  std::map<KeyType, Message, KeyLess> buffer_;
+  mutable RWMutex buffer_latch_;
+  std::atomic<size_t> buffer_flushes_;
+  AdaptiveHashIndex<KeyType> adaptive_hash_;
 };
 
 } // namespace cmudb
@@ -4,41 +4,225 @@
 
 #pragma once
 
+#include <atomic>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "common/rwmutex.h"
 #include "index/b_plus_tree.h"
+#include "index/blocked_bloom_filter.h"
 #include "index/index.h"
 
 namespace cmudb {
 
 #define BPLUSTREE_INDEX_TYPE BPlusTreeIndex<KeyType, ValueType, KeyComparator>
+// the build log is applied in rounds while writers go on, the last round,
+// of at most this many changes, holds them off
+#define INDEX_BUILD_LAST_ROUND 1024
+
+// range scan over the leaves, ends early at the high key
+INDEX_TEMPLATE_ARGUMENTS
+class BPlusTreeScanIterator : public IndexScanIterator {
+public:
+  BPlusTreeScanIterator(INDEXITERATOR_TYPE &&iterator,
+                        const KeyComparator &comparator,
+                        const KeyType *high_key, bool high_inclusive)
+      : iterator_(std::move(iterator)), comparator_(comparator),
+        has_high_key_(high_key != nullptr), high_inclusive_(high_inclusive) {
+    if (has_high_key_)
+      high_key_ = *high_key;
+    CheckHighKey();
+  }
+
+  bool isEnd() override { return iterator_.isEnd(); }
+
+  RID GetRid() override { return (*iterator_).second; }
+
+  const char *GetEntry() override { return (*iterator_).first.data; }
+
+  void Next() override {
+    ++iterator_;
+    CheckHighKey();
+  }
+
+private:
+  // past the high key the leaf is let go at once
+  void CheckHighKey() {
+    if (!has_high_key_ || iterator_.isEnd())
+      return;
+    int cmp = comparator_((*iterator_).first, high_key_);
+    if (cmp > 0 || (cmp == 0 && !high_inclusive_))
+      iterator_ = INDEXITERATOR_TYPE();
+  }
+
+  INDEXITERATOR_TYPE iterator_;
+  const KeyComparator &comparator_;
+  bool has_high_key_;
+  KeyType high_key_;
+  bool high_inclusive_;
+};
+
+// range scan over the leaves from the high key down, ends early at the low
+// key
+INDEX_TEMPLATE_ARGUMENTS
+class BPlusTreeReverseScanIterator : public IndexScanIterator {
+public:
+  BPlusTreeReverseScanIterator(REVERSE_INDEXITERATOR_TYPE &&iterator,
+                               const KeyComparator &comparator,
+                               const KeyType *low_key, bool low_inclusive)
+      : iterator_(std::move(iterator)), comparator_(comparator),
+        has_low_key_(low_key != nullptr), low_inclusive_(low_inclusive) {
+    if (has_low_key_)
+      low_key_ = *low_key;
+    CheckLowKey();
+  }
+
+  bool isEnd() override { return iterator_.isEnd(); }
+
+  RID GetRid() override { return (*iterator_).second; }
+
+  const char *GetEntry() override { return (*iterator_).first.data; }
+
+  void Next() override {
+    ++iterator_;
+    CheckLowKey();
+  }
+
+private:
+  void CheckLowKey() {
+    if (!has_low_key_ || iterator_.isEnd())
+      return;
+    int cmp = comparator_((*iterator_).first, low_key_);
+    if (cmp < 0 || (cmp == 0 && !low_inclusive_))
+      iterator_ = REVERSE_INDEXITERATOR_TYPE();
+  }
+
+  REVERSE_INDEXITERATOR_TYPE iterator_;
+  const KeyComparator &comparator_;
+  bool has_low_key_;
+  KeyType low_key_;
+  bool low_inclusive_;
+};
 
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTreeIndex : public Index {
 
 public:
+  // with a bloom filter, the one written at bloom_page_id is read unless it
+  // is not clean, then it is rebuilt from the leaves. New nodes and filter
+  // pages are taken from tablespace_id
   BPlusTreeIndex(IndexMetadata *metadata,
                  BufferPoolManager *buffer_pool_manager,
-                 page_id_t root_page_id = INVALID_PAGE_ID);
+                 page_id_t root_page_id = INVALID_PAGE_ID,
+                 page_id_t bloom_page_id = INVALID_PAGE_ID,
+                 int tablespace_id = 0);
 
   ~BPlusTreeIndex() {}
 
   void InsertEntry(const Tuple &key, RID rid,
                    Transaction *transaction = nullptr) override;
 
-  void DeleteEntry(const Tuple &key,
+  void DeleteEntry(const Tuple &key, RID rid,
                    Transaction *transaction = nullptr) override;
 
   void ScanKey(const Tuple &key, std::vector<RID> &result,
                Transaction *transaction = nullptr) override;
 
+  void ScanKeys(const std::vector<Tuple> &keys, std::vector<RID> &result,
+                Transaction *transaction = nullptr) override;
+
+  IndexScanIterator *ScanRange(const Tuple *low_key, bool low_inclusive,
+                               const Tuple *high_key, bool high_inclusive,
+                               Transaction *transaction = nullptr) override;
+
+  IndexScanIterator *
+  ScanRangeReverse(const Tuple *low_key, bool low_inclusive,
+                   const Tuple *high_key, bool high_inclusive,
+                   Transaction *transaction = nullptr) override;
+
+  IndexScanIterator *ScanLast(Transaction *transaction = nullptr) override;
+
+  size_t GetEntryCount(Transaction *transaction = nullptr) override;
+
+  bool GetChangedRoot(page_id_t &root_id) override {
+    return container_.GetChangedRootPageId(root_id);
+  }
+
+  page_id_t GetRootPageId() override { return container_.GetRootPageId(); }
+
+  void BulkLoad(const std::vector<std::pair<Tuple, RID>> &entries,
+                Transaction *transaction = nullptr) override;
+
+  void InsertEntries(const std::vector<std::pair<Tuple, RID>> &entries,
+                     Transaction *transaction = nullptr) override;
+
+  page_id_t WriteBloomFilter() override;
+
+  bool BeginBuild() override;
+
+  bool IsBuilding() override {
+    return building_.load(std::memory_order_acquire);
+  }
+
+  void
+  FinishBuild(std::vector<std::vector<std::pair<Tuple, RID>>> &runs) override;
+
 protected:
+  // index key of the entry, the rid is only part of it in a non-unique index.
+  // The include columns are taken from a stored tuple, left out otherwise
+  void MakeKey(const Tuple &key, int64_t rid, KeyType &index_key,
+               bool stored = false) const;
+
   // comparator for key
   KeyComparator comparator_;
   // container
   BPlusTree<KeyType, ValueType, KeyComparator> container_;
+  // of the temporary pages of BulkLoad
+  BufferPoolManager *buffer_pool_manager_;
+
+private:
+  // hash of the key columns at the start of key, a zero decimal is hashed
+  // as +0.0 since it equals -0.0
+  uint64_t HashKey(const char *key) const;
+
+  // false if the index has no entry of key, in the format of the key schema
+  bool MayContainKey(const Tuple &key) const;
+
+  // a filter sized for twice the entries of the tree, filled from its
+  // leaves
+  void RebuildBloomFilter();
+
+  // rebuilt once it holds more keys than it was sized for
+  void CheckBloomFilter();
+
+  // InsertEntry and DeleteEntry of an index key, as after the build
+  void InsertKey(const KeyType &index_key, RID rid, Transaction *transaction);
+  void DeleteKey(const KeyType &index_key, RID rid, Transaction *transaction);
+
+  // true if the index is building and the change went to the build log
+  bool LogBuildChange(bool insert, const KeyType &index_key, RID rid);
+
+  // a change made while the index was building
+  struct BuildChange {
+    bool insert_;
+    KeyType key_;
+    RID rid_;
+  };
+
+  // nullptr without one. Writers hold bloom_latch_ shared from adding a key
+  // to inserting it, a rebuild exclusively
+  std::unique_ptr<BlockedBloomFilter> bloom_filter_;
+  mutable RWMutex bloom_latch_;
+  page_id_t bloom_page_id_;
+  int tablespace_id_;
+
+  // set from BeginBuild until the build log is applied, writers append to
+  // build_log_ under build_latch_ while it is
+  std::atomic<bool> building_{false};
+  std::mutex build_latch_;
+  std::vector<BuildChange> build_log_;
 };
 
 } // namespace cmudb
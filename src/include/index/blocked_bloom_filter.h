@@ -0,0 +1,87 @@
+/**
+ * blocked_bloom_filter.h
+ *
+ * Bloom filter of the keys of an index, in blocks of one cache line. A key
+ * sets one bit in each of the eight words of a single block, so a probe
+ * reads one line and its eight tests do not depend on each other: the masks
+ * are computed in a loop the compiler vectorizes. Bits are only ever set, a
+ * removed key stays in the filter until it is rebuilt. Add and MayContain
+ * may run at the same time.
+ *
+ * Between runs of the database the filter is kept in a chain of pages, each
+ * with a header of one block:
+ *  -----------------------------------------------------------------------
+ * | NextPageId (4) | Clean (4) | BlockCount (8) | KeyCount (8) | Unused |
+ *  -----------------------------------------------------------------------
+ * followed by blocks. Only the first page has more than NextPageId set.
+ * With WIDE_PAGE_IDS the page id takes 8 bytes and the counts move up by 8.
+ * Clean is written last and cleared on disk when the filter is read: keys
+ * added after the read are not in the pages, a crash leaves a filter that
+ * is not read again.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "buffer/buffer_pool_manager.h"
+
+namespace cmudb {
+
+#define BLOOM_BLOCK_WORDS 8
+#define BLOOM_BLOCK_SIZE (BLOOM_BLOCK_WORDS * sizeof(uint64_t))
+#define BLOOM_BITS_PER_KEY 10
+// keys a filter has room for at least
+#define BLOOM_MIN_KEYS 1024
+#define BLOOM_PAGE_HEADER_SIZE BLOOM_BLOCK_SIZE
+// block count, then key count, behind NextPageId and Clean
+#define BLOOM_COUNTS_OFFSET ((sizeof(page_id_t) + 4 + 7) / 8 * 8)
+#define BLOOM_BLOCKS_PER_PAGE                                                  \
+  ((PAGE_SIZE - BLOOM_PAGE_HEADER_SIZE) / BLOOM_BLOCK_SIZE)
+
+class BlockedBloomFilter {
+public:
+  // room for keys at BLOOM_BITS_PER_KEY, about 1% false positives
+  explicit BlockedBloomFilter(size_t keys);
+
+  // of the bytes of a key
+  static uint64_t Hash(const char *data, size_t size);
+
+  void Add(uint64_t hash);
+
+  bool MayContain(uint64_t hash) const;
+
+  // keys the filter was sized for
+  inline size_t GetCapacity() const {
+    return block_count_ * BLOOM_BLOCK_SIZE * 8 / BLOOM_BITS_PER_KEY;
+  }
+
+  // keys added, a key added twice counts twice
+  inline size_t GetKeyCount() const { return key_count_; }
+
+  // write to the chain at first_page_id, reused if it has as many pages,
+  // and return its first page id. New pages are taken from tablespace_id.
+  // Throws if no page can be had
+  page_id_t Write(BufferPoolManager *buffer_pool_manager,
+                  page_id_t first_page_id, int tablespace_id = 0);
+
+  // the filter of the chain at first_page_id, nullptr unless it was written
+  // cleanly. The chain is no longer clean after
+  static BlockedBloomFilter *Read(BufferPoolManager *buffer_pool_manager,
+                                  page_id_t first_page_id);
+
+private:
+  // block of hash and the mask of each of its words
+  inline size_t Block(uint64_t hash) const {
+    return static_cast<size_t>(((hash >> 32) * block_count_) >> 32);
+  }
+  static void Masks(uint64_t hash, uint64_t *masks);
+
+  size_t block_count_;
+  std::unique_ptr<std::atomic<uint64_t>[]> words_;
+  std::atomic<size_t> key_count_{0};
+};
+
+} // namespace cmudb
@@ -0,0 +1,104 @@
+/**
+ * extendible_hash_table.h
+ *
+ * Disk resident extendible hash table of (key, rid) entries, the storage of
+ * HashIndex. A directory page maps the low bits of the hash of a key to a
+ * bucket page, a full bucket splits in two and the directory doubles when
+ * the bucket had a slot to itself, like ExtendibleHash does in memory. A
+ * point lookup reads the directory and one bucket page. Keys a full
+ * directory can not tell apart, and entries of a single key, go to overflow
+ * pages of their bucket. Buckets are never merged.
+ *
+ * Readers latch the directory and then the first page of the bucket, the
+ * directory is let go once the bucket is latched. Writers do the same with a
+ * write latch on the bucket; a writer that has to split starts over with the
+ * directory write latched.
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "page/hash_bucket_page.h"
+#include "page/hash_directory_page.h"
+
+namespace cmudb {
+
+#define EXTENDIBLE_HASH_TABLE_TYPE                                             \
+  ExtendibleHashTable<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class ExtendibleHashTable {
+public:
+  // a unique table keeps one entry per key, new pages are taken from
+  // tablespace_id
+  ExtendibleHashTable(const std::string &name,
+                      BufferPoolManager *buffer_pool_manager, bool unique,
+                      page_id_t directory_page_id = INVALID_PAGE_ID,
+                      int tablespace_id = 0);
+
+  bool IsEmpty() const;
+
+  // false if the entry is there already, or any entry of key in a unique
+  // table
+  bool Insert(const KeyType &key, const ValueType &value);
+
+  // remove the entry, or any entry of key if value is nullptr
+  bool Remove(const KeyType &key, const ValueType *value = nullptr);
+
+  bool GetValue(const KeyType &key, std::vector<ValueType> &result);
+
+  // every entry, in no particular order
+  void GetAll(std::vector<MappingType> &result);
+
+  int GetGlobalDepth();
+
+  // false if the directory page id did not change since the last call, else
+  // true with it. It changes once, when the first entry creates the directory
+  bool GetChangedDirectoryPageId(page_id_t &directory_page_id);
+
+  // hash of the bytes of key
+  static uint32_t Hash(const KeyType &key);
+
+private:
+  // outcome of an insert into a latched chain
+  enum class InsertResult { DONE = 0, DUPLICATE, FULL };
+
+  // create the directory and its first bucket
+  void Create();
+
+  // insert into the chain of head, FULL if every page is full and the
+  // bucket may split instead of growing an overflow page
+  InsertResult InsertIntoChain(Page *head, const MappingType &item,
+                               bool can_split);
+
+  // split the bucket of slot, doubling the directory if needed. Both are
+  // write latched, false if the directory is full or every entry has the
+  // hash of the key being inserted
+  bool Split(HashDirectoryPage *directory, uint32_t slot, Page *head,
+             uint32_t hash);
+
+  // entries of the chain of head
+  void ReadChain(Page *head, std::vector<MappingType> &items);
+
+  // replace the entries of the chain of head, overflow pages are added or
+  // deleted as needed
+  void WriteChain(Page *head, const std::vector<MappingType> &items);
+
+  Page *FetchPage(page_id_t page_id);
+  Page *NewPage(page_id_t &page_id);
+
+  std::string index_name_;
+  BufferPoolManager *buffer_pool_manager_;
+  int tablespace_id_;
+  bool unique_;
+  std::atomic<page_id_t> directory_page_id_;
+  // directory_page_id_ changed since the owner last took it
+  std::atomic<bool> directory_dirty_{false};
+  // guards the creation of the directory
+  std::mutex create_latch_;
+};
+
+} // namespace cmudb
@@ -1,97 +1,195 @@
-/**
- * generic_key.h
- *
- * Key used for indexing with opaque data
- *
- * This key type uses an fixed length array to hold data for indexing
- * purposes, the actual size of which is specified and instantiated
- * with a template argument.
- */
-#pragma once
-
-#include <cstring>
-
-#include "table/tuple.h"
-#include "type/value.h"
-
-namespace cmudb {
-template <size_t KeySize> class GenericKey {
-public:
-  inline void SetFromKey(const Tuple &tuple) {
-    // intialize to 0
-    memset(data, 0, KeySize);
-    memcpy(data, tuple.GetData(), tuple.GetLength());
-  }
-
-  // NOTE: for test purpose only
-  inline void SetFromInteger(int64_t key) {
-    memset(data, 0, KeySize);
-    memcpy(data, &key, sizeof(int64_t));
-  }
-
-  inline Value ToValue(Schema *schema, int column_id) const {
-    const char *data_ptr;
-    const TypeId column_type = schema->GetType(column_id);
-    const bool is_inlined = schema->IsInlined(column_id);
-    if (is_inlined) {
-      data_ptr = (data + schema->GetOffset(column_id));
-    } else {
-      int32_t offset = *reinterpret_cast<int32_t *>(
-          const_cast<char *>(data + schema->GetOffset(column_id)));
-      data_ptr = (data + offset);
-    }
-    return Value::DeserializeFrom(data_ptr, column_type);
-  }
-
-  // NOTE: for test purpose only
-  // interpret the first 8 bytes as int64_t from data vector
-  inline int64_t ToString() const {
-    return *reinterpret_cast<int64_t *>(const_cast<char *>(data));
-  }
-
-  // NOTE: for test purpose only
-  // interpret the first 8 bytes as int64_t from data vector
-  friend std::ostream &operator<<(std::ostream &os, const GenericKey &key) {
-    os << key.ToString();
-    return os;
-  }
-
-  // actual location of data, extends past the end.
-  char data[KeySize];
-};
-
-/**
- * Function object returns true if lhs < rhs, used for trees
- */
-template <size_t KeySize> class GenericComparator {
-public:
-  inline int operator()(const GenericKey<KeySize> &lhs,
-                        const GenericKey<KeySize> &rhs) const {
-    int column_count = key_schema_->GetColumnCount();
-
-    for (int i = 0; i < column_count; i++) {
-      Value lhs_value = (lhs.ToValue(key_schema_, i));
-      Value rhs_value = (rhs.ToValue(key_schema_, i));
-
-      if (lhs_value.CompareLessThan(rhs_value) == CMP_TRUE)
-        return -1;
-
-      if (lhs_value.CompareGreaterThan(rhs_value) == CMP_TRUE)
-        return 1;
-    }
-    // equals
-    return 0;
-  }
-
-  GenericComparator(const GenericComparator &other) {
-    this->key_schema_ = other.key_schema_;
-  }
-
-  // constructor
-  GenericComparator(Schema *key_schema) : key_schema_(key_schema) {}
-
-private:
-  Schema *key_schema_;
-};
-
-} // namespace cmudb
+/**
+ * generic_key.h
+ *
+ * Key used for indexing with opaque data
+ *
+ * This key type uses an fixed length array to hold data for indexing
+ * purposes, the actual size of which is specified and instantiated
+ * with a template argument.
+ */
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "table/tuple.h"
+#include "type/type_util.h"
+#include "type/value.h"
+
+namespace cmudb {
+template <size_t KeySize> class GenericKey {
+public:
+  inline void SetFromKey(const Tuple &tuple) {
+    // intialize to 0
+    memset(data, 0, KeySize);
+    memcpy(data, tuple.GetData(), tuple.GetLength());
+  }
+
+  // NOTE: for test purpose only
+  inline void SetFromInteger(int64_t key) {
+    memset(data, 0, KeySize);
+    memcpy(data, &key, sizeof(int64_t));
+  }
+
+  // value of a column, with borrow a varchar reads the key in place and the
+  // value must not outlive it
+  inline Value ToValue(Schema *schema, int column_id,
+                       bool borrow = false) const {
+    const char *data_ptr;
+    const TypeId column_type = schema->GetType(column_id);
+    const bool is_inlined = schema->IsInlined(column_id);
+    if (is_inlined) {
+      data_ptr = (data + schema->GetOffset(column_id));
+    } else {
+      int32_t offset = *reinterpret_cast<int32_t *>(
+          const_cast<char *>(data + schema->GetOffset(column_id)));
+      data_ptr = (data + offset);
+    }
+    if (borrow)
+      return Value::ViewFrom(data_ptr, column_type);
+    return Value::DeserializeFrom(data_ptr, column_type);
+  }
+
+  // NOTE: for test purpose only
+  // interpret the first 8 bytes as int64_t from data vector
+  inline int64_t ToString() const {
+    return *reinterpret_cast<int64_t *>(const_cast<char *>(data));
+  }
+
+  // NOTE: for test purpose only
+  // interpret the first 8 bytes as int64_t from data vector
+  friend std::ostream &operator<<(std::ostream &os, const GenericKey &key) {
+    os << key.ToString();
+    return os;
+  }
+
+  // actual location of data, extends past the end.
+  char data[KeySize];
+};
+
+/**
+ * Function object returns true if lhs < rhs, used for trees. The type and
+ * place of every key column are looked up once, keys are compared on their
+ * bytes without a Value or a virtual call
+ */
+template <size_t KeySize> class GenericComparator {
+public:
+  inline int operator()(const GenericKey<KeySize> &lhs,
+                        const GenericKey<KeySize> &rhs) const {
+    for (auto &column : columns_) {
+      const char *lhs_data = lhs.data + column.offset_;
+      const char *rhs_data = rhs.data + column.offset_;
+      if (!column.inlined_) {
+        lhs_data = lhs.data + *reinterpret_cast<const int32_t *>(lhs_data);
+        rhs_data = rhs.data + *reinterpret_cast<const int32_t *>(rhs_data);
+      }
+      int cmp = TypeUtil::CompareRaw(column.type_, lhs_data, rhs_data);
+      if (cmp != 0)
+        return cmp;
+    }
+    // equals
+    return 0;
+  }
+
+  // constructor
+  GenericComparator(Schema *key_schema) {
+    for (int i = 0; i < key_schema->GetColumnCount(); i++)
+      columns_.push_back(KeyColumn{key_schema->GetType(i),
+                                   key_schema->GetOffset(i),
+                                   key_schema->IsInlined(i)});
+  }
+
+private:
+  struct KeyColumn {
+    TypeId type_;
+    int32_t offset_;
+    bool inlined_;
+  };
+  std::vector<KeyColumn> columns_;
+};
+
+/**
+ * Compares keys of one integer column as integers, NULL (the smallest value
+ * of the type) sorts first
+ */
+template <size_t KeySize, typename IntType> class IntegerComparator {
+public:
+  inline int operator()(const GenericKey<KeySize> &lhs,
+                        const GenericKey<KeySize> &rhs) const {
+    IntType lhs_value, rhs_value;
+    memcpy(&lhs_value, lhs.data, sizeof(IntType));
+    memcpy(&rhs_value, rhs.data, sizeof(IntType));
+    return (lhs_value > rhs_value) - (lhs_value < rhs_value);
+  }
+
+  IntegerComparator(Schema *) {}
+};
+
+/**
+ * Compares keys of inlined integer columns column by column on the bytes of
+ * the key, NULL sorts first
+ */
+template <size_t KeySize> class CompositeIntegerComparator {
+public:
+  inline int operator()(const GenericKey<KeySize> &lhs,
+                        const GenericKey<KeySize> &rhs) const {
+    for (int i = 0; i < column_count_; i++) {
+      int64_t lhs_value = ReadInteger(lhs.data + offsets_[i], sizes_[i]);
+      int64_t rhs_value = ReadInteger(rhs.data + offsets_[i], sizes_[i]);
+      if (lhs_value != rhs_value)
+        return lhs_value < rhs_value ? -1 : 1;
+    }
+    return 0;
+  }
+
+  CompositeIntegerComparator(Schema *key_schema)
+      : column_count_(key_schema->GetColumnCount()) {
+    assert(column_count_ <= static_cast<int>(KeySize));
+    for (int i = 0; i < column_count_; i++) {
+      offsets_[i] = static_cast<int8_t>(key_schema->GetOffset(i));
+      sizes_[i] = static_cast<int8_t>(key_schema->GetLength(i));
+    }
+  }
+
+private:
+  static inline int64_t ReadInteger(const char *data, int size) {
+    switch (size) {
+    case 1:
+      return *reinterpret_cast<const int8_t *>(data);
+    case 2: {
+      int16_t value;
+      memcpy(&value, data, sizeof(value));
+      return value;
+    }
+    case 4: {
+      int32_t value;
+      memcpy(&value, data, sizeof(value));
+      return value;
+    }
+    default: {
+      int64_t value;
+      memcpy(&value, data, sizeof(value));
+      return value;
+    }
+    }
+  }
+
+  int column_count_;
+  // every column takes at least one byte of the key
+  int8_t offsets_[KeySize];
+  int8_t sizes_[KeySize];
+};
+
+// keys of inlined integer columns only can use the integer comparators
+inline bool IsIntegerKey(Schema *key_schema) {
+  for (int i = 0; i < key_schema->GetColumnCount(); i++) {
+    TypeId type = key_schema->GetType(i);
+    if (type != TypeId::TINYINT && type != TypeId::SMALLINT &&
+        type != TypeId::INTEGER && type != TypeId::BIGINT)
+      return false;
+  }
+  return key_schema->GetColumnCount() > 0;
+}
+
+} // namespace cmudb
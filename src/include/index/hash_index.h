@@ -0,0 +1,73 @@
+/**
+ * hash_index.h
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "index/extendible_hash_table.h"
+#include "index/index.h"
+
+namespace cmudb {
+
+#define HASH_INDEX_TYPE HashIndex<KeyType, ValueType, KeyComparator>
+
+// entries collected up front, a hash index keeps no key order
+class VectorScanIterator : public IndexScanIterator {
+public:
+  explicit VectorScanIterator(std::vector<RID> &&rids)
+      : rids_(std::move(rids)), next_(0) {}
+
+  bool isEnd() override { return next_ == rids_.size(); }
+
+  RID GetRid() override { return rids_[next_]; }
+
+  void Next() override { next_++; }
+
+private:
+  std::vector<RID> rids_;
+  size_t next_;
+};
+
+/**
+ * Index over an extendible hash table. Point lookups read one bucket, a
+ * range scan goes through every entry.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+class HashIndex : public Index {
+
+public:
+  // new pages are taken from tablespace_id
+  HashIndex(IndexMetadata *metadata, BufferPoolManager *buffer_pool_manager,
+            page_id_t directory_page_id = INVALID_PAGE_ID,
+            int tablespace_id = 0);
+
+  ~HashIndex() {}
+
+  void InsertEntry(const Tuple &key, RID rid,
+                   Transaction *transaction = nullptr) override;
+
+  void DeleteEntry(const Tuple &key, RID rid,
+                   Transaction *transaction = nullptr) override;
+
+  void ScanKey(const Tuple &key, std::vector<RID> &result,
+               Transaction *transaction = nullptr) override;
+
+  IndexScanIterator *ScanRange(const Tuple *low_key, bool low_inclusive,
+                               const Tuple *high_key, bool high_inclusive,
+                               Transaction *transaction = nullptr) override;
+
+  bool GetChangedRoot(page_id_t &root_id) override {
+    return container_.GetChangedDirectoryPageId(root_id);
+  }
+
+protected:
+  // comparator for key, only range scans need it
+  KeyComparator comparator_;
+  // container
+  ExtendibleHashTable<KeyType, ValueType, KeyComparator> container_;
+};
+
+} // namespace cmudb
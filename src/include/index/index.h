@@ -6,6 +6,7 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "catalog/schema.h"
@@ -23,17 +24,64 @@ namespace cmudb {
  * mapping relation and does the conversion between tuple key and index key
  */
 class Transaction;
+
+// structure of an index
+enum class IndexType { BPLUSTREE = 0, HASH, ART };
+
 class IndexMetadata {
   IndexMetadata() = delete;
 
 public:
   IndexMetadata(std::string index_name, std::string table_name,
-                const Schema *tuple_schema, const std::vector<int> &key_attrs)
-      : name_(index_name), table_name_(table_name), key_attrs_(key_attrs) {
+                const Schema *tuple_schema, const std::vector<int> &key_attrs,
+                bool unique = true, IndexType type = IndexType::BPLUSTREE,
+                const std::vector<int> &include_attrs = {},
+                bool clustered = false, bool buffered = false,
+                bool bloom = false)
+      : name_(index_name), table_name_(table_name), key_attrs_(key_attrs),
+        include_attrs_(include_attrs), unique_(unique), clustered_(clustered),
+        buffered_(buffered), bloom_(bloom), type_(type) {
     key_schema_ = Schema::CopySchema(tuple_schema, key_attrs_);
+    entry_schema_ = key_schema_;
+    if (!unique_) {
+      std::vector<Column> columns = key_schema_->GetColumns();
+      columns.emplace_back(TypeId::BIGINT, sizeof(int64_t), "rid");
+      entry_schema_ = new Schema(columns);
+    }
+    stored_attrs_ = key_attrs_;
+    stored_attrs_.insert(stored_attrs_.end(), include_attrs_.begin(),
+                         include_attrs_.end());
+    stored_schema_ = key_schema_;
+    leaf_schema_ = entry_schema_;
+    if (!include_attrs_.empty()) {
+      stored_schema_ = Schema::CopySchema(tuple_schema, stored_attrs_);
+      std::vector<Column> columns = entry_schema_->GetColumns();
+      for (int attr : include_attrs_)
+        columns.push_back(tuple_schema->GetColumn(attr));
+      leaf_schema_ = new Schema(columns);
+    }
+    // inlined columns are read back from the leaves, a varchar of the key
+    // may be cut to the size of the key
+    leaf_offsets_.assign(tuple_schema->GetColumnCount(), -1);
+    for (size_t i = 0; i < stored_attrs_.size(); i++) {
+      int column = i < key_attrs_.size()
+                       ? static_cast<int>(i)
+                       : entry_schema_->GetColumnCount() +
+                             static_cast<int>(i - key_attrs_.size());
+      if (leaf_schema_->IsInlined(column))
+        leaf_offsets_[stored_attrs_[i]] = leaf_schema_->GetOffset(column);
+    }
   }
 
-  ~IndexMetadata() { delete key_schema_; };
+  ~IndexMetadata() {
+    if (leaf_schema_ != entry_schema_)
+      delete leaf_schema_;
+    if (stored_schema_ != key_schema_)
+      delete stored_schema_;
+    if (entry_schema_ != key_schema_)
+      delete entry_schema_;
+    delete key_schema_;
+  };
 
   inline const std::string &GetName() const { return name_; }
 
@@ -42,6 +90,37 @@ public:
   // Returns a schema object pointer that represents the indexed key
   inline Schema *GetKeySchema() const { return key_schema_; }
 
+  // Returns the schema of the keys stored by the index, a non-unique index
+  // appends the rid to the key columns so that equal keys stay distinct
+  inline Schema *GetEntrySchema() const { return entry_schema_; }
+
+  // Returns the schema of the key columns then the include columns, of the
+  // tuples the index is given to insert
+  inline Schema *GetStoredSchema() const { return stored_schema_; }
+
+  // Returns the schema of the leaf entries, the entry columns then the
+  // include columns. Only the entry columns are compared
+  inline Schema *GetLeafSchema() const { return leaf_schema_; }
+
+  // offset in a leaf entry of column of the table, -1 unless the leaves
+  // keep it inlined
+  inline int32_t GetLeafOffset(int column) const {
+    return leaf_offsets_[column];
+  }
+
+  inline bool IsUnique() const { return unique_; }
+
+  // whether the rows of the table are kept in the order of the index
+  inline bool IsClustered() const { return clustered_; }
+
+  // whether a b+ tree gathers inserts and removes before it applies them
+  inline bool IsBuffered() const { return buffered_; }
+
+  // whether a b+ tree keeps a bloom filter of its keys for point lookups
+  inline bool HasBloomFilter() const { return bloom_; }
+
+  inline IndexType GetType() const { return type_; }
+
   // Return the number of columns inside index key (not in tuple key)
   // Note that this must be defined inside the cpp source file
   // because it uses the member of catalog::Schema which is not known here
@@ -51,13 +130,30 @@ public:
   //  columns
   inline const std::vector<int> &GetKeyAttrs() const { return key_attrs_; }
 
+  // columns of the table the leaves keep besides the key
+  inline const std::vector<int> &GetIncludeAttrs() const {
+    return include_attrs_;
+  }
+
+  // the key attributes then the include attributes
+  inline const std::vector<int> &GetStoredAttrs() const {
+    return stored_attrs_;
+  }
+
   // Get a string representation for debugging
   const std::string ToString() const {
     std::stringstream os;
 
     os << "IndexMetadata["
        << "Name = " << name_ << ", "
-       << "Type = B+Tree, "
+       << "Type = "
+       << (type_ == IndexType::HASH ? "Hash"
+                                    : type_ == IndexType::ART ? "ART" : "B+Tree")
+       << ", "
+       << "Unique = " << unique_ << ", "
+       << "Clustered = " << clustered_ << ", "
+       << "Buffered = " << buffered_ << ", "
+       << "Bloom = " << bloom_ << ", "
        << "Table name = " << table_name_ << "] :: ";
     os << key_schema_->ToString();
 
@@ -69,8 +165,43 @@ private:
   std::string table_name_;
   // The mapping relation between key schema and tuple schema
   const std::vector<int> key_attrs_;
+  const std::vector<int> include_attrs_;
+  std::vector<int> stored_attrs_;
   // schema of the indexed key
   Schema *key_schema_;
+  // whether a key has at most one entry
+  bool unique_;
+  bool clustered_;
+  bool buffered_;
+  bool bloom_;
+  IndexType type_;
+  Schema *entry_schema_;
+  Schema *stored_schema_;
+  Schema *leaf_schema_;
+  std::vector<int32_t> leaf_offsets_;
+};
+
+/**
+ * class IndexScanIterator - Entries of an index scan in key order
+ *
+ * Returned by Index::ScanRange, the caller deletes it. It may hold latches
+ * of the index until it reaches the end or is deleted. A hash index has no
+ * key order and returns its entries in any order.
+ */
+class IndexScanIterator {
+public:
+  virtual ~IndexScanIterator() {}
+
+  virtual bool isEnd() = 0;
+
+  // rid of the current entry
+  virtual RID GetRid() = 0;
+
+  // bytes of the current entry in the format of the leaf schema, valid
+  // until Next. Nullptr if the index does not keep them
+  virtual const char *GetEntry() { return nullptr; }
+
+  virtual void Next() = 0;
 };
 
 /////////////////////////////////////////////////////////////////////
@@ -110,6 +241,12 @@ public:
     return metadata_->GetKeyAttrs();
   }
 
+  Schema *GetStoredSchema() const { return metadata_->GetStoredSchema(); }
+
+  const std::vector<int> &GetStoredAttrs() const {
+    return metadata_->GetStoredAttrs();
+  }
+
   // Get a string representation for debugging
   const std::string ToString() const {
     std::stringstream os;
@@ -122,17 +259,110 @@ public:
   ///////////////////////////////////////////////////////////////////
   // Point Modification
   ///////////////////////////////////////////////////////////////////
-  // designed for secondary indexes.
+  // designed for secondary indexes. key is in the format of the stored
+  // schema, the other methods take key or stored tuples
   virtual void InsertEntry(const Tuple &key, RID rid,
                            Transaction *transaction = nullptr) = 0;
 
-  // delete the index entry linked to given tuple
-  virtual void DeleteEntry(const Tuple &key,
+  // delete the index entry linked to given tuple, a unique index ignores the
+  // rid
+  virtual void DeleteEntry(const Tuple &key, RID rid,
                            Transaction *transaction = nullptr) = 0;
 
   virtual void ScanKey(const Tuple &key, std::vector<RID> &result,
                        Transaction *transaction = nullptr) = 0;
 
+  // ScanKey of every key, in any order. The rids of all keys go into result
+  // in no particular order. Looks them up one by one unless overridden
+  virtual void ScanKeys(const std::vector<Tuple> &keys,
+                        std::vector<RID> &result,
+                        Transaction *transaction = nullptr) {
+    for (auto &key : keys)
+      ScanKey(key, result, transaction);
+  }
+
+  // entries with keys between low_key and high_key, nullptr for no bound
+  virtual IndexScanIterator *ScanRange(const Tuple *low_key, bool low_inclusive,
+                                       const Tuple *high_key,
+                                       bool high_inclusive,
+                                       Transaction *transaction = nullptr) = 0;
+
+  // ScanRange from the greatest key of the range down. Nullptr unless the
+  // index keeps its entries in key order
+  virtual IndexScanIterator *
+  ScanRangeReverse(const Tuple *low_key, bool low_inclusive,
+                   const Tuple *high_key, bool high_inclusive,
+                   Transaction *transaction = nullptr) {
+    return nullptr;
+  }
+
+  // the entry with the greatest key, then the end. Nullptr unless the index
+  // keeps its entries in key order
+  virtual IndexScanIterator *ScanLast(Transaction *transaction = nullptr) {
+    return nullptr;
+  }
+
+  // entries in the index, of every transaction. Scans them one by one unless
+  // overridden
+  virtual size_t GetEntryCount(Transaction *transaction = nullptr) {
+    IndexScanIterator *iterator =
+        ScanRange(nullptr, false, nullptr, false, transaction);
+    size_t count = 0;
+    for (; !iterator->isEnd(); iterator->Next())
+      count++;
+    delete iterator;
+    return count;
+  }
+
+  // false if the root page of the index did not change since the last call,
+  // else true with it for the catalog. INVALID_PAGE_ID for an emptied index
+  virtual bool GetChangedRoot(page_id_t &root_id) { return false; }
+
+  // root page of the index as it is now, INVALID_PAGE_ID if it has none or
+  // is not a tree of pages
+  virtual page_id_t GetRootPageId() { return INVALID_PAGE_ID; }
+
+  // write the bloom filter of the index to pages and return the first one,
+  // INVALID_PAGE_ID if it has none. Called as the index closes
+  virtual page_id_t WriteBloomFilter() { return INVALID_PAGE_ID; }
+
+  // fill an empty index from (key, rid) entries in any order, of equal keys
+  // a unique index keeps the first one. Inserts one by one unless overridden
+  virtual void BulkLoad(const std::vector<std::pair<Tuple, RID>> &entries,
+                        Transaction *transaction = nullptr) {
+    for (auto &entry : entries)
+      InsertEntry(entry.first, entry.second, transaction);
+  }
+
+  // insert (key, rid) entries in any order, as InsertEntry would one by one
+  virtual void InsertEntries(const std::vector<std::pair<Tuple, RID>> &entries,
+                             Transaction *transaction = nullptr) {
+    for (auto &entry : entries)
+      InsertEntry(entry.first, entry.second, transaction);
+  }
+
+  ///////////////////////////////////////////////////////////////////
+  // Online Build
+  ///////////////////////////////////////////////////////////////////
+  // start filling an empty index from a table other writers keep changing,
+  // false if the index can not be built that way. Until FinishBuild its
+  // InsertEntry and DeleteEntry are logged to be applied after the build,
+  // nothing may be read from it
+  virtual bool BeginBuild() { return false; }
+
+  virtual bool IsBuilding() { return false; }
+
+  // fill the index from runs of (key, rid) entries of the table, in any
+  // order and one per scan thread, then apply what was logged since
+  // BeginBuild. Runs may have the same entry more than once, as may the log
+  virtual void
+  FinishBuild(std::vector<std::vector<std::pair<Tuple, RID>>> &runs) {
+    std::vector<std::pair<Tuple, RID>> entries;
+    for (auto &run : runs)
+      entries.insert(entries.end(), run.begin(), run.end());
+    BulkLoad(entries);
+  }
+
 private:
   //===--------------------------------------------------------------------===//
   //  Data members
@@ -1,20 +1,49 @@
 /**
  * index_iterator.h
  * For range scan of b+ tree
+ *
+ * The iterator pins and read latches the leaf it stands on. Moving on to the
+ * next leaf pins it first, then lets go of the current leaf and only then
+ * latches the next one: writers latch siblings right to left when they merge,
+ * so holding two leaves here could deadlock with them.
+ * While no leaf is held entries may move from it into the next one, keys not
+ * greater than the last key of the previous leaf are skipped.
+ *
+ * Leaves are read ahead once the scan crosses into a second one, in a window
+ * that doubles like the one of a table scan (see table_iterator.h). The
+ * parent of the first leaf names the leaves after it, those are requested
+ * one by one so that their reads overlap. Past them the buffer pool follows
+ * the NextPageId chain.
  */
 #pragma once
+#include <vector>
+
 #include "page/b_plus_tree_leaf_page.h"
 
 namespace cmudb {
 
+// leaves requested ahead at the first boundary and at most, the latter also
+// bounds the leaves taken from the parent
+#define LEAF_READ_AHEAD_MIN_DEPTH 2
+#define LEAF_READ_AHEAD_MAX_DEPTH 32
+
 #define INDEXITERATOR_TYPE                                                     \
   IndexIterator<KeyType, ValueType, KeyComparator>
 
 INDEX_TEMPLATE_ARGUMENTS
 class IndexIterator {
 public:
-  // you may define your own constructor based on your member variables
+  // end iterator
   IndexIterator();
+  // leaf is pinned and read latched, the iterator releases it. next_leaves
+  // are the page ids of the leaves after it as far as they are known
+  IndexIterator(Page *page, int index, BufferPoolManager *buffer_pool_manager,
+                const KeyComparator *comparator,
+                std::vector<page_id_t> next_leaves = std::vector<page_id_t>());
+  IndexIterator(IndexIterator &&other);
+  IndexIterator &operator=(IndexIterator &&other);
+  IndexIterator(const IndexIterator &) = delete;
+  IndexIterator &operator=(const IndexIterator &) = delete;
   ~IndexIterator();
 
   bool isEnd();
@@ -24,7 +53,30 @@ public:
   IndexIterator &operator++();
 
 private:
-  // add your own private member variables here
+  // skip to the next leaf while index_ is past the end of the current one
+  void SkipToValid();
+  // unlatch and unpin the current leaf
+  void Release();
+  // top up the read-ahead window, the scan moved on to another leaf
+  void ReadAhead();
+
+  Page *page_;
+  B_PLUS_TREE_LEAF_PAGE_TYPE *leaf_;
+  int index_;
+  BufferPoolManager *buffer_pool_manager_;
+  const KeyComparator *comparator_;
+  // last key of the leaves left behind
+  KeyType last_key_;
+  bool has_last_key_;
+  // entry decoded from the leaf, valid until the iterator moves
+  MappingType item_;
+  // leaves known to follow the first one, and read-ahead state: leaves
+  // moved on to, leaves the next request covers, and those requested beyond
+  // the current one
+  std::vector<page_id_t> next_leaves_;
+  size_t position_;
+  size_t depth_;
+  size_t left_;
 };
 
 } // namespace cmudb
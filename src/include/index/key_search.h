@@ -0,0 +1,82 @@
+/**
+ * key_search.h
+ *
+ * Vectorized search of B+ tree pages with keys of one integer column. Pages
+ * narrow their binary search down to KEY_SEARCH_BLOCK entries, then read the
+ * keys of the block as integers and count the keys less than the search key
+ * with AVX-512 or AVX2 compares instead of branching on every comparison.
+ * Without either instruction set the count is a scalar loop. Other
+ * comparators keep the plain binary search.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "index/generic_key.h"
+
+namespace cmudb {
+
+// entries left to a vectorized probe at the end of a binary search
+#define KEY_SEARCH_BLOCK 16
+
+// comparators that order keys like integers, none by default
+template <typename KeyComparator> struct IntegerKeySearch {
+  static const bool enabled = false;
+
+  template <typename KeyType> static inline int64_t ToInteger(const KeyType &) {
+    return 0;
+  }
+};
+
+template <size_t KeySize, typename IntType>
+struct IntegerKeySearch<IntegerComparator<KeySize, IntType>> {
+  static const bool enabled = true;
+
+  static inline int64_t ToInteger(const GenericKey<KeySize> &key) {
+    IntType value;
+    memcpy(&value, key.data, sizeof(IntType));
+    return value;
+  }
+};
+
+/*
+ * Number of the count keys that are less than key, or less than or equal to
+ * key if or_equal is set. The keys need not be sorted.
+ */
+inline int CountLess(const int64_t *keys, int count, int64_t key,
+                     bool or_equal) {
+  // keys < key are the keys that are not > key - 1
+  if (!or_equal) {
+    if (key == INT64_MIN)
+      return 0;
+    key--;
+  }
+  int greater = 0, i = 0;
+#if defined(__AVX512F__)
+  __m512i needle = _mm512_set1_epi64(key);
+  for (; i + 8 <= count; i += 8) {
+    __m512i block = _mm512_loadu_si512(keys + i);
+    greater += __builtin_popcount(_mm512_cmpgt_epi64_mask(block, needle));
+  }
+#elif defined(__AVX2__)
+  __m256i needle = _mm256_set1_epi64x(key);
+  for (; i + 4 <= count; i += 4) {
+    __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+    int mask = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpgt_epi64(block, needle)));
+    greater += __builtin_popcount(mask);
+  }
+#endif
+  for (; i < count; i++)
+    greater += keys[i] > key;
+  return count - greater;
+}
+
+} // namespace cmudb
@@ -0,0 +1,71 @@
+/**
+ * reverse_index_iterator.h
+ * For range scans of b+ tree from the greatest key down
+ *
+ * The iterator moves to the previous leaf over its PrevPageId. As forwards,
+ * the previous leaf is pinned, the current one unlatched and only then the
+ * previous one latched, the iterator never latches two leaves. The link is a
+ * hint (see page/b_plus_tree_leaf_page.h): the previous leaf is taken only
+ * if it is a leaf with entries whose next page is the one left, and no
+ * writer latched the one left in between. Otherwise
+ * the iterator descends from the root again, to the last leaf with a key
+ * below the last key it returned, crabbing with read latches as a reader
+ * does. Keys not below the last key returned are skipped, entries moved by
+ * writers while no leaf was held are not returned twice.
+ *
+ * A child whose separator is below the key may still hold only greater keys
+ * after removes, then the descent is repeated below that separator. Leaves
+ * are not read ahead.
+ */
+#pragma once
+
+#include "page/b_plus_tree_leaf_page.h"
+
+namespace cmudb {
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class BPlusTree;
+
+#define REVERSE_INDEXITERATOR_TYPE                                             \
+  ReverseIndexIterator<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class ReverseIndexIterator {
+public:
+  // end iterator
+  ReverseIndexIterator();
+  // at the greatest key of tree not above key, below it unless inclusive.
+  // Nullptr starts at the greatest key
+  ReverseIndexIterator(BPlusTree<KeyType, ValueType, KeyComparator> *tree,
+                       const KeyType *key, bool inclusive);
+  ReverseIndexIterator(ReverseIndexIterator &&other);
+  ReverseIndexIterator &operator=(ReverseIndexIterator &&other);
+  ReverseIndexIterator(const ReverseIndexIterator &) = delete;
+  ReverseIndexIterator &operator=(const ReverseIndexIterator &) = delete;
+  ~ReverseIndexIterator();
+
+  bool isEnd();
+
+  const MappingType &operator*();
+
+  ReverseIndexIterator &operator++();
+
+private:
+  // stand on the greatest key below key, or not above it when inclusive
+  void Seek(const KeyType *key, bool inclusive);
+  // move to the leaf before the current one, on its greatest key below key
+  // or at -1 if it has none. False if there is no link or it is stale, Seek
+  // has to find the leaf then
+  bool MovePrev(const KeyType &key);
+  // unlatch and unpin the current leaf
+  void Release();
+
+  BPlusTree<KeyType, ValueType, KeyComparator> *tree_;
+  Page *page_;
+  B_PLUS_TREE_LEAF_PAGE_TYPE *leaf_;
+  int index_;
+  // entry decoded from the leaf, valid until the iterator moves
+  MappingType item_;
+};
+
+} // namespace cmudb
@@ -0,0 +1,65 @@
+/**
+ * backup_manager.h
+ *
+ * Online backups of a database into a directory, with files of the same
+ * names as those of the database and its tablespaces. The first backup into
+ * a directory copies every page, the next ones only the pages written since
+ * the previous backup, read from the changed page bitmaps of the disk
+ * manager: their time grows with what changed, not with the database.
+ *
+ * Pages are read from disk while writes go on, so they are of different
+ * times. The log from the log start to its end is copied after them: the
+ * write-ahead rule put the records of every page copied on disk before the
+ * page, and recovery of the backup redoes the changes a page copied earlier
+ * is missing and undoes the transactions still running, as after a crash
+ * at the end of the backup. The log start is held while the backup runs, a
+ * checkpoint may move it but does not drop the log before it. Without a
+ * running log manager a backup is only consistent while no page is written.
+ *
+ * Every backup of a database must go to the same directory, a page taken
+ * by a backup is not marked for the next one. Freed pages of the database
+ * are not known to the backup, they are leaked once it is restored.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "disk/disk_manager.h"
+
+namespace cmudb {
+
+// bytes of log copied at a time
+#define BACKUP_LOG_CHUNK (1 << 20)
+
+// what the last backup copied
+struct BackupStats {
+  bool incremental_ = false;
+  uint64_t pages_ = 0;
+  uint64_t log_bytes_ = 0;
+};
+
+class BackupManager {
+public:
+  explicit BackupManager(DiskManager *disk_manager)
+      : disk_manager_(disk_manager) {}
+
+  // back up into directory, created if missing. Only the changed pages
+  // unless incremental is false or the directory has no backup yet. False
+  // if a page can not be read or written, the next backup copies the pages
+  // this one did not get to
+  bool Backup(const std::string &directory, bool incremental = true);
+
+  inline const BackupStats &GetStats() const { return stats_; }
+
+private:
+  // file of the same name in directory
+  static std::string GetBackupName(const std::string &directory,
+                                   const std::string &file_name);
+
+  DiskManager *disk_manager_;
+  BackupStats stats_;
+};
+
+} // namespace cmudb
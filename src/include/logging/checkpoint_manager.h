@@ -0,0 +1,98 @@
+/**
+ * checkpoint_manager.h
+ *
+ * Fuzzy checkpoints bound restart time and the size of the log. A checkpoint
+ * appends BEGIN_CHECKPOINT, takes a snapshot of the active transaction table
+ * and the dirty page table (page id, rec lsn) and appends both with
+ * END_CHECKPOINT. Neither transactions nor page traffic are stopped: the
+ * snapshots only hold the latch of one table or one buffer pool partition at
+ * a time, and pages are not latched at all.
+ *
+ * Recovery starts its redo filter from the last complete checkpoint, records
+ * before BEGIN_CHECKPOINT only matter for pages of the dirty page table. The
+ * log before the oldest record still needed (the oldest rec lsn, the oldest
+ * BEGIN of an active transaction and the checkpoint itself) is truncated.
+ * Pages that stayed dirty since the previous checkpoint are written back by
+ * the checkpoint, so a page that is never evicted does not hold the log.
+ *
+ * The checkpoint thread starts a checkpoint every interval, or earlier once
+ * log_bytes were written since the last one.
+ *
+ * The owner of the pages may keep some of their state in memory, e.g. the
+ * root page ids of b+ trees, its flush callback writes that into the pages
+ * as every checkpoint starts.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "buffer/buffer_pool_manager.h"
+#include "concurrency/transaction_manager.h"
+#include "logging/log_manager.h"
+
+namespace cmudb {
+
+// how often the checkpoint thread looks at the size of the log
+#define CHECKPOINT_POLL_INTERVAL std::chrono::milliseconds(10)
+
+// triggers of the checkpoint thread, 0 turns a trigger off
+struct CheckpointConfig {
+  std::chrono::milliseconds interval_ = std::chrono::milliseconds(30000);
+  int64_t log_bytes_ = 64 * LOG_BUFFER_SIZE;
+};
+
+class CheckpointManager {
+public:
+  CheckpointManager(TransactionManager *txn_manager,
+                    BufferPoolManager *buffer_pool_manager,
+                    LogManager *log_manager);
+
+  ~CheckpointManager();
+
+  // start or retune the checkpoint thread
+  void StartCheckpointThread(const CheckpointConfig &config = CheckpointConfig());
+
+  void StopCheckpointThread();
+
+  // take a checkpoint and truncate the log, return the lsn of its
+  // END_CHECKPOINT record or INVALID_LSN if the log manager is not running
+  lsn_t Checkpoint();
+
+  inline size_t GetCheckpointCount() const { return checkpoint_count_; }
+
+  // set before the checkpoint thread starts
+  inline void SetFlushCallback(std::function<void()> flush_callback) {
+    flush_callback_ = std::move(flush_callback);
+  }
+
+private:
+  // body of checkpoint_thread_
+  void CheckpointWorker();
+
+  TransactionManager *txn_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+  LogManager *log_manager_;
+  DiskManager *disk_manager_;
+  // one checkpoint at a time, protects the fields below
+  std::mutex checkpoint_latch_;
+  // BEGIN_CHECKPOINT of the previous checkpoint
+  lsn_t last_begin_lsn_;
+  // offset of the first needed log record
+  off_t log_start_;
+  std::atomic<size_t> checkpoint_count_;
+  std::function<void()> flush_callback_;
+
+  // checkpoint thread, not running unless started
+  CheckpointConfig config_;
+  std::mutex thread_latch_;
+  std::condition_variable thread_cv_;
+  bool stop_thread_;
+  std::thread checkpoint_thread_;
+};
+
+} // namespace cmudb
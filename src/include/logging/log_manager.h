@@ -0,0 +1,99 @@
+/**
+ * log_manager.h
+ * log manager maintain a separate thread that is awaken when the log buffer
+ * is full or time out(every X second) to write log buffer's content into disk
+ * log file.
+ *
+ * Group commit: a committing transaction appends its COMMIT record and then
+ * waits in WaitUntilDurable. It asks the flush thread for an early flush, and
+ * every transaction that commits while that flush is running is made durable
+ * by the next one, so many commits share one fsync.
+ *
+ * Log records go into log_buffer_ under latch_. The flush thread swaps it with
+ * flush_buffer_ and writes the latter without holding the latch, so appending
+ * never waits for disk unless log_buffer_ is full.
+ *
+ * For log truncation the flush thread remembers the first lsn and the file
+ * offset of every flush, so the offset of the oldest record still needed can be
+ * found without reading the log.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "disk/disk_manager.h"
+#include "logging/log_record.h"
+
+namespace cmudb {
+
+#define LOG_BUFFER_SIZE (32 * PAGE_SIZE)        // size of a log buffer in byte
+#define LOG_TIMEOUT std::chrono::milliseconds(50) // flush interval of log
+
+class LogManager {
+public:
+  LogManager(DiskManager *disk_manager);
+
+  ~LogManager();
+
+  // start and stop the flush thread, records are only durable while it runs
+  void RunFlushThread();
+  void StopFlushThread();
+
+  // serialize log_record into log buffer, return its lsn
+  lsn_t AppendLogRecord(LogRecord &log_record);
+
+  // block until every record up to lsn is on disk
+  void WaitUntilDurable(lsn_t lsn);
+
+  // continue numbering after the records of an existing log, only before
+  // the flush thread runs
+  void SetNextLSN(lsn_t next_lsn);
+
+  inline lsn_t GetNextLSN() const { return next_lsn_; }
+  inline lsn_t GetPersistentLSN() const { return persistent_lsn_; }
+  inline bool IsRunning() const { return running_; }
+
+  // log file offset of a flush starting at or before lsn, -1 if lsn is not
+  // durable or was written before this log manager took over
+  off_t GetLogOffset(lsn_t lsn);
+  // forget flushes that start before offset, the log was truncated there
+  void DiscardLogOffsets(off_t offset);
+
+  // number of log flushes (fsync), for group commit statistics
+  inline size_t GetFlushCount() const { return flush_count_; }
+
+private:
+  void FlushThread();
+
+  DiskManager *disk_manager_;
+  // the next lsn to hand out
+  std::atomic<lsn_t> next_lsn_;
+  // every record up to this lsn is durable
+  std::atomic<lsn_t> persistent_lsn_;
+  std::atomic<size_t> flush_count_;
+  // records appended but not yet taken by the flush thread
+  char *log_buffer_;
+  int32_t log_buffer_size_;
+  // records being written by the flush thread
+  char *flush_buffer_;
+  // a waiter asked for an early flush
+  bool flush_requested_;
+  // (first lsn, log file offset) of flushes, oldest first
+  std::deque<std::pair<lsn_t, off_t>> flush_offsets_;
+  std::atomic<bool> running_;
+  std::thread flush_thread_;
+  // protect log_buffer_, log_buffer_size_, flush_requested_ and flush_offsets_
+  std::mutex latch_;
+  // wakes up flush thread
+  std::condition_variable flush_cv_;
+  // signaled after every flush, wakes up committers and appenders
+  std::condition_variable durable_cv_;
+};
+
+} // namespace cmudb
@@ -0,0 +1,224 @@
+/**
+ * log_record.h
+ *
+ * For every write operation on table page, you should write ahead a
+ * corresponding log record.
+ *
+ * For EACH log record, HEADER is like (5 fields in common, 20 bytes in total)
+ *  -------------------------------------------------------------
+ * | size | LSN | transID | prevLSN | LogType |
+ *  -------------------------------------------------------------
+ * For insert type log record
+ *  -------------------------------------------------------------
+ * | HEADER | tuple_rid | tuple_size | tuple_data(char[] array) |
+ *  -------------------------------------------------------------
+ * For delete type (including markdelete, rollbackdelete, applydelete)
+ *  -------------------------------------------------------------
+ * | HEADER | tuple_rid | tuple_size | tuple_data(char[] array) |
+ *  -------------------------------------------------------------
+ * For update type log record
+ *  ------------------------------------------------------------------------
+ * | HEADER | tuple_rid | tuple_size | old_tuple_data | tuple_size |
+ * | new_tuple_data |
+ *  ------------------------------------------------------------------------
+ * For new page type log record, the layout of a PAX page only for one
+ *  ------------------------------------------------------------------------
+ * | HEADER | prev_page_id | page_id | capacity | n | column_width * n |
+ *  ------------------------------------------------------------------------
+ * For unlink page type log record, page_id leaves the chain between them
+ *  -------------------------------------------------------------
+ * | HEADER | prev_page_id | page_id | next_page_id |
+ *  -------------------------------------------------------------
+ * For overflow page type log record, the bytes of a value page_id holds
+ *  -------------------------------------------------------------
+ * | HEADER | page_id | next_page_id | size | bytes(char[] array) |
+ *  -------------------------------------------------------------
+ * For end checkpoint type log record (begin checkpoint is a bare HEADER)
+ *  ------------------------------------------------------------------------
+ * | HEADER | begin_lsn | n | (page_id, rec_lsn) * n | m |
+ * | (txn_id, last_lsn) * m |
+ *  ------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include "page/pax_layout.h"
+
+#include "common/config.h"
+#include "table/tuple.h"
+
+namespace cmudb {
+
+enum class LogRecordType {
+  INVALID = 0,
+  INSERT,
+  MARKDELETE,
+  APPLYDELETE,
+  ROLLBACKDELETE,
+  UPDATE,
+  BEGIN,
+  COMMIT,
+  ABORT,
+  NEWPAGE,
+  BEGIN_CHECKPOINT,
+  END_CHECKPOINT,
+  UNLINKPAGE,
+  OVERFLOWPAGE,
+};
+
+class LogRecord {
+  friend class LogManager;
+
+public:
+  LogRecord()
+      : size_(0), lsn_(INVALID_LSN), txn_id_(INVALID_TXN_ID),
+        prev_lsn_(INVALID_LSN), log_record_type_(LogRecordType::INVALID) {}
+
+  // constructor for transaction type (BEGIN/COMMIT/ABORT)
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type)
+      : size_(HEADER_SIZE), lsn_(INVALID_LSN), txn_id_(txn_id),
+        prev_lsn_(prev_lsn), log_record_type_(log_record_type) {}
+
+  // constructor for INSERT/DELETE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+            const RID &rid, const Tuple &tuple)
+      : lsn_(INVALID_LSN), txn_id_(txn_id), prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type), rid_(rid), tuple_(tuple) {
+    // calculate log record size
+    size_ = HEADER_SIZE + sizeof(RID) + sizeof(int32_t) + tuple.GetLength();
+  }
+
+  // constructor for UPDATE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+            const RID &rid, const Tuple &old_tuple, const Tuple &new_tuple)
+      : lsn_(INVALID_LSN), txn_id_(txn_id), prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type), rid_(rid), tuple_(old_tuple),
+        new_tuple_(new_tuple) {
+    // calculate log record size
+    size_ = HEADER_SIZE + sizeof(RID) + old_tuple.GetLength() +
+            new_tuple.GetLength() + 2 * sizeof(int32_t);
+  }
+
+  // constructor for NEWPAGE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+            page_id_t prev_page_id, page_id_t page_id,
+            const PaxLayout &layout = PaxLayout())
+      : size_(HEADER_SIZE + 2 * sizeof(page_id_t)), lsn_(INVALID_LSN),
+        txn_id_(txn_id), prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type), prev_page_id_(prev_page_id),
+        page_id_(page_id), layout_(layout) {
+    if (layout_.IsPax())
+      size_ += (2 + layout_.widths_.size()) * sizeof(uint32_t);
+  }
+
+  // constructor for UNLINKPAGE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+            page_id_t prev_page_id, page_id_t page_id, page_id_t next_page_id)
+      : size_(HEADER_SIZE + 3 * sizeof(page_id_t)), lsn_(INVALID_LSN),
+        txn_id_(txn_id), prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type), prev_page_id_(prev_page_id),
+        page_id_(page_id), next_page_id_(next_page_id) {}
+
+  // constructor for OVERFLOWPAGE type, bytes are kept as a tuple
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+            page_id_t page_id, page_id_t next_page_id, const Tuple &bytes)
+      : size_(HEADER_SIZE + 2 * sizeof(page_id_t) + sizeof(int32_t) +
+              bytes.GetLength()),
+        lsn_(INVALID_LSN), txn_id_(txn_id), prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type), tuple_(bytes), page_id_(page_id),
+        next_page_id_(next_page_id) {}
+
+  // constructor for END_CHECKPOINT type, dirty page table and active
+  // transaction table taken after the BEGIN_CHECKPOINT record at begin_lsn
+  LogRecord(lsn_t begin_lsn,
+            const std::vector<std::pair<page_id_t, lsn_t>> &dirty_pages,
+            const std::vector<std::pair<txn_id_t, lsn_t>> &active_txns)
+      : lsn_(INVALID_LSN), txn_id_(INVALID_TXN_ID), prev_lsn_(INVALID_LSN),
+        log_record_type_(LogRecordType::END_CHECKPOINT),
+        begin_lsn_(begin_lsn), dirty_pages_(dirty_pages),
+        active_txns_(active_txns) {
+    size_ = HEADER_SIZE + sizeof(lsn_t) + 2 * sizeof(int32_t) +
+            dirty_pages.size() * (sizeof(page_id_t) + sizeof(lsn_t)) +
+            active_txns.size() * (sizeof(txn_id_t) + sizeof(lsn_t));
+  }
+
+  ~LogRecord() {}
+
+  inline int32_t GetSize() const { return size_; }
+
+  inline lsn_t GetLSN() const { return lsn_; }
+
+  inline txn_id_t GetTxnId() const { return txn_id_; }
+
+  inline lsn_t GetPrevLSN() const { return prev_lsn_; }
+
+  inline LogRecordType GetLogRecordType() const { return log_record_type_; }
+
+  inline const RID &GetRID() const { return rid_; }
+
+  // tuple of insert/delete type, old tuple of update type, bytes of
+  // overflow page type
+  inline const Tuple &GetTuple() const { return tuple_; }
+
+  inline const Tuple &GetNewTuple() const { return new_tuple_; }
+
+  inline page_id_t GetPrevPageId() const { return prev_page_id_; }
+
+  inline page_id_t GetPageId() const { return page_id_; }
+  inline page_id_t GetNextPageId() const { return next_page_id_; }
+
+  inline const PaxLayout &GetPaxLayout() const { return layout_; }
+
+  inline lsn_t GetBeginLSN() const { return begin_lsn_; }
+
+  inline const std::vector<std::pair<page_id_t, lsn_t>> &
+  GetDirtyPages() const {
+    return dirty_pages_;
+  }
+
+  inline const std::vector<std::pair<txn_id_t, lsn_t>> &
+  GetActiveTxns() const {
+    return active_txns_;
+  }
+
+  // write size_ bytes into storage
+  void SerializeTo(char *storage) const;
+
+  // read a record from storage, false if the available bytes do not hold a
+  // complete record (e.g. torn tail of the log)
+  bool DeserializeFrom(const char *storage, int32_t available);
+
+  std::string ToString() const;
+
+  static const int HEADER_SIZE = 20;
+
+private:
+  // the length of log record (for serialization, in bytes)
+  int32_t size_;
+  // must have fields
+  lsn_t lsn_;
+  txn_id_t txn_id_;
+  lsn_t prev_lsn_;
+  LogRecordType log_record_type_;
+
+  // case1: for delete/insert, old tuple of update, and overflow page bytes
+  RID rid_;
+  Tuple tuple_;
+  // case2: new tuple of update
+  Tuple new_tuple_;
+  // case3: for new page, unlink page and overflow page
+  page_id_t prev_page_id_ = INVALID_PAGE_ID;
+  page_id_t page_id_ = INVALID_PAGE_ID;
+  PaxLayout layout_;
+  page_id_t next_page_id_ = INVALID_PAGE_ID;
+  // case4: for end checkpoint
+  lsn_t begin_lsn_ = INVALID_LSN;
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages_;
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns_;
+};
+
+} // namespace cmudb
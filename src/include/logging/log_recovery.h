@@ -0,0 +1,113 @@
+/**
+ * log_recovery.h
+ *
+ * Restart recovery in three passes over the write ahead log:
+ *
+ * Analysis reads the log once, from the start kept by the last checkpoint,
+ * and builds the transaction table (transactions without COMMIT/ABORT record
+ * are losers, together with their last lsn) and the list of records to redo
+ * per page. A torn record at the end of the log is cut off. Records before the
+ * last checkpoint are only redone for pages in its dirty page table.
+ *
+ * Redo repeats history page by page. Records are partitioned by page id
+ * across worker threads, each worker applies the records of its pages in lsn
+ * order and skips those already reflected by the page lsn, so pages are never
+ * shared between workers and restart time depends on the number of pages to
+ * repair divided by the worker count instead of the log length.
+ *
+ * Undo rolls back the records of losers in reverse log order. Every undo
+ * step is logged as an ordinary record of the inverse operation and finished
+ * by an ABORT record, so a crash during undo is repaired by the next restart.
+ * An undone APPLYDELETE inserts the tuple again, maybe into another slot.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "logging/log_manager.h"
+#include "logging/log_record.h"
+#include "page/table_page.h"
+
+namespace cmudb {
+
+// outcome and per phase timing of a restart
+struct RecoveryStats {
+  size_t log_records_ = 0;
+  // records applied by redo, the others were already on their pages
+  size_t redo_records_ = 0;
+  size_t redo_pages_ = 0;
+  size_t undo_records_ = 0;
+  size_t loser_txns_ = 0;
+  std::chrono::microseconds analysis_time_{0};
+  std::chrono::microseconds redo_time_{0};
+  std::chrono::microseconds undo_time_{0};
+  std::chrono::microseconds total_time_{0};
+};
+
+class LogRecovery {
+public:
+  // redo_threads 0 picks the number of cores
+  LogRecovery(BufferPoolManager *buffer_pool_manager, size_t redo_threads = 0);
+
+  // run analysis, redo and undo. log_manager must not be running yet, it is
+  // started before undo to log the rollback of losers. Without log_manager
+  // the losers are left as they are, e.g. for a replica that receives the
+  // rest of their records later
+  void Recover(LogManager *log_manager);
+
+  // redo records that follow the log, in lsn order. Returns the records
+  // applied, those already on their pages are skipped
+  size_t Replay(const std::vector<LogRecord> &log_records);
+
+  inline const RecoveryStats &GetStats() const { return stats_; }
+
+  // first transaction id not used by the log
+  inline txn_id_t GetNextTxnId() const { return next_txn_id_; }
+  // first lsn not used by the log
+  inline lsn_t GetNextLSN() const { return next_lsn_; }
+  // loser txn id -> lsn of its last record, empty once undo ran
+  inline const std::unordered_map<txn_id_t, lsn_t> &GetLoserTxns() const {
+    return active_txn_;
+  }
+
+private:
+  void Analysis();
+  // redo log_records, return records applied and count the pages
+  size_t Redo(const std::vector<LogRecord> &log_records, size_t &pages);
+  void Undo(LogManager *log_manager);
+
+  // (page id, record) to redo, a NEWPAGE record also changes the previous page
+  typedef std::pair<page_id_t, const LogRecord *> RedoItem;
+
+  // can the change of page_id at lsn be missing from disk
+  bool NeedsRedo(page_id_t page_id, lsn_t lsn) const;
+  // worker body, redo items sorted by page, lsn order within a page
+  void RedoPartition(const std::vector<RedoItem> &items, size_t &redone,
+                     size_t &pages);
+  // apply the effect of log_record on page
+  void RedoRecord(TablePage *page, const LogRecord &log_record);
+  // roll back one record of a loser, log the inverse operation
+  void UndoRecord(const LogRecord &log_record, LogManager *log_manager);
+
+  BufferPoolManager *buffer_pool_manager_;
+  DiskManager *disk_manager_;
+  size_t redo_threads_;
+  // all records of the log in lsn order
+  std::vector<LogRecord> log_records_;
+  // loser txn id -> lsn of its last record
+  std::unordered_map<txn_id_t, lsn_t> active_txn_;
+  // highest page id created in the log, by tablespace
+  std::vector<page_id_t> max_page_ids_;
+  lsn_t next_lsn_;
+  txn_id_t next_txn_id_;
+  // BEGIN_CHECKPOINT and dirty page table of the last complete checkpoint
+  lsn_t checkpoint_lsn_;
+  std::unordered_map<page_id_t, lsn_t> dirty_pages_;
+  RecoveryStats stats_;
+};
+
+} // namespace cmudb
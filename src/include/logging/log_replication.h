@@ -0,0 +1,180 @@
+/**
+ * log_replication.h
+ *
+ * Read replicas kept up to date by shipping the log. The primary runs a
+ * LogShipper, which listens on a port. A replica starts from a copy of the
+ * database of the primary, e.g. restored from a backup (see
+ * backup_manager.h), and its LogReplica connects to the shipper asking for
+ * the records from the next lsn of its own log on. The shipper sends the
+ * log once it is durable, and the replica applies it through its own buffer
+ * pool as redo does at restart.
+ *
+ * Readers of the replica see transactions whole: records are held back until
+ * no transaction of the stream is running, then appended to the log of the
+ * replica and applied while the readers are held off by GetLatch. A primary
+ * that is never without a running transaction keeps the replica where it
+ * was. The replica acknowledges the records it applied, the shipper holds
+ * the log of the primary from the first record a replica may still ask for.
+ *
+ * Only table heaps are logged, so only they are replicated: indexes, the
+ * header page and vtable_lsm tables stay as they were in the copy.
+ *
+ * Shipper to replica, a frame of whole records (size in byte):
+ *  ------------------------------------------------------------------------
+ * | Size (4) | Unused (4) | Offset (8) | LogEnd (8) | Time (8) | Records |
+ *  ------------------------------------------------------------------------
+ * Offset is where the records are in the log of the primary, LogEnd the end
+ * of its durable log and Time the wall clock of the primary when the frame
+ * was sent, in microseconds. A frame without records is sent every
+ * REPLICATION_HEARTBEAT while there are none. Replica to shipper, the next
+ * lsn of the replica (8) once when it connects, then after every batch it
+ * applied.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/rwmutex.h"
+#include "logging/log_record.h"
+
+namespace cmudb {
+
+#define REPLICATION_FRAME_HEADER_SIZE 32
+// log read and sent at a time, a larger record goes in a frame of its own
+#define REPLICATION_CHUNK (1 << 20)
+// how often the shipper looks for new log and the threads for a stop
+#define REPLICATION_POLL_INTERVAL std::chrono::milliseconds(5)
+#define REPLICATION_HEARTBEAT std::chrono::milliseconds(100)
+// wait of a replica between attempts to reach its shipper
+#define REPLICATION_RETRY_INTERVAL std::chrono::milliseconds(1000)
+// log a replica applies between two flushes of its pages, after which its
+// log before the last record is no longer needed
+#define REPLICATION_CHECKPOINT_BYTES (64 * LOG_BUFFER_SIZE)
+
+class LogShipper {
+public:
+  explicit LogShipper(DiskManager *disk_manager)
+      : disk_manager_(disk_manager) {}
+
+  // stops listening and closes the connections of the replicas
+  ~LogShipper();
+
+  // accept replicas on port, any free one if 0. False if it can not be had
+  bool Listen(int port);
+  // port listened on, 0 before Listen
+  inline int GetPort() const { return port_; }
+
+  void Stop();
+
+  inline size_t GetReplicaCount() const { return replicas_; }
+  // bytes of log sent to every replica
+  inline uint64_t GetShippedBytes() const { return shipped_bytes_; }
+
+private:
+  // a frame sent and not yet acknowledged as applied
+  struct SentFrame {
+    off_t offset_;
+    lsn_t last_lsn_;
+  };
+
+  void AcceptThread();
+  // body of the thread of one replica, until it goes or the shipper stops
+  void ShipThread(int fd);
+  // read the records of the log from offset, no more than the chunk unless
+  // the first record is larger. False if the log holds no whole record there
+  bool ReadRecords(off_t offset, off_t log_end, std::vector<char> &buffer);
+
+  DiskManager *disk_manager_;
+  int listen_fd_ = -1;
+  int port_ = 0;
+  std::atomic<bool> stop_{false};
+  std::thread accept_thread_;
+  // threads of the replicas, under latch_
+  std::vector<std::thread> ship_threads_;
+  std::mutex latch_;
+  std::atomic<size_t> replicas_{0};
+  std::atomic<uint64_t> shipped_bytes_{0};
+};
+
+class LogReplica {
+public:
+  // redo the log of the replica database of buffer_pool_manager, whose
+  // pages must not be written by anyone else. Losers of the log are left
+  // running, the rest of their records comes from the primary
+  explicit LogReplica(BufferPoolManager *buffer_pool_manager);
+
+  // stops applying and flushes the pages applied to
+  ~LogReplica();
+
+  // keep connecting to the shipper on host and port and apply what it
+  // sends, until Stop
+  void Start(const std::string &host, int port);
+  void Stop();
+
+  // readers hold it shared for a consistent state, a batch is applied
+  // under it exclusively
+  inline RWMutex &GetLatch() { return latch_; }
+
+  inline bool IsConnected() const { return connected_; }
+  // the lsn after the last record applied
+  inline lsn_t GetNextLSN() const { return next_lsn_; }
+  inline uint64_t GetAppliedRecords() const { return applied_records_; }
+  // log of the primary not applied yet, and how long ago the oldest frame
+  // of it was sent. The clocks of primary and replica are trusted to agree
+  int64_t GetLagBytes() const;
+  std::chrono::microseconds GetLag() const;
+
+private:
+  void ApplyThread();
+  // receive and apply frames until the connection or the replica stops
+  void Receive(int fd);
+  // apply the records held back up to the last point where no transaction
+  // was running, false if the shipper can not be told
+  bool Apply(int fd);
+
+  BufferPoolManager *buffer_pool_manager_;
+  DiskManager *disk_manager_;
+  std::string host_;
+  int port_ = 0;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> connected_{false};
+  std::thread apply_thread_;
+  RWMutex latch_;
+  std::atomic<lsn_t> next_lsn_;
+  std::atomic<uint64_t> applied_records_{0};
+  // transactions running as of the records applied, and as of the records
+  // received
+  std::unordered_set<txn_id_t> applied_txns_;
+  std::unordered_set<txn_id_t> running_txns_;
+  // records received and held back, their bytes, and how many of them
+  // end where no transaction was running
+  std::vector<LogRecord> records_;
+  std::vector<char> record_bytes_;
+  size_t quiet_records_ = 0;
+  size_t quiet_bytes_ = 0;
+  // where the records applied and the records received end in the log of
+  // the primary, and where its durable log ends
+  std::atomic<off_t> applied_offset_{0};
+  off_t received_offset_ = 0;
+  off_t quiet_offset_ = 0;
+  std::atomic<off_t> primary_end_{0};
+  // (end in the log of the primary, time sent) of frames not applied yet,
+  // under frames_latch_
+  std::deque<std::pair<off_t, int64_t>> frames_;
+  mutable std::mutex frames_latch_;
+  // log appended since the pages were last flushed, and the offset of the
+  // last record in the log of the replica
+  size_t checkpoint_bytes_ = 0;
+  off_t last_record_offset_ = 0;
+};
+
+} // namespace cmudb
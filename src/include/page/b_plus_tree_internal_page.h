@@ -37,6 +37,11 @@ public:
   ValueType ValueAt(int index) const;
 
   ValueType Lookup(const KeyType &key, const KeyComparator &comparator) const;
+  // and the index of the child in index
+  ValueType Lookup(const KeyType &key, const KeyComparator &comparator,
+                   int &index) const;
+  // index of the child Lookup returns
+  int LookupIndex(const KeyType &key, const KeyComparator &comparator) const;
   void PopulateNewRoot(const ValueType &old_value, const KeyType &new_key,
                        const ValueType &new_value);
   int InsertNodeAfter(const ValueType &old_value, const KeyType &new_key,
@@ -44,6 +49,11 @@ public:
   void Remove(int index);
   ValueType RemoveAndReturnOnlyChild();
 
+  // whether the children of both pages fit into one
+  bool CanMergeWith(const BPlusTreeInternalPage *other) const {
+    return GetSize() + other->GetSize() <= GetMaxSize();
+  }
+
   void MoveHalfTo(BPlusTreeInternalPage *recipient,
                   BufferPoolManager *buffer_pool_manager);
   void MoveAllTo(BPlusTreeInternalPage *recipient, int index_in_parent,
@@ -67,6 +77,8 @@ private:
                     BufferPoolManager *buffer_pool_manager);
   void CopyFirstFrom(const MappingType &pair, int parent_index,
                      BufferPoolManager *buffer_pool_manager);
+  void AdoptChild(const ValueType &child,
+                  BufferPoolManager *buffer_pool_manager);
   MappingType array[0];
 };
 } // namespace cmudb
@@ -5,18 +5,35 @@
  * see include/common/rid.h for detailed implementation) together within leaf
  * page. Only support unique key.
 
- * Leaf page format (keys are stored in order):
+ * Keys of one leaf often share their leading bytes (a varchar prefix, the
+ * first columns of a composite key) and their trailing ones (the high bytes
+ * of small integers, zero padding of a short key). The bytes all keys of the
+ * page share are stored once in the header, each entry keeps the rest. The
+ * width of entries changes with the keys of the page, so does the number of
+ * entries that fit. A page narrows the shared bytes when a key does not
+ * share them, and recomputes them when it splits or merges.
+ *
+ * Leaf page format (keys are stored in order, entries are WIDTH + sizeof(RID)
+ * bytes with WIDTH = sizeof(KEY) - PrefixSize - SuffixSize):
  *  ----------------------------------------------------------------------
- * | HEADER | KEY(1) + RID(1) | KEY(2) + RID(2) | ... | KEY(n) + RID(n)
+ * | HEADER | RID(1) + KEY(1) | RID(2) + KEY(2) | ... | RID(n) + KEY(n)
  *  ----------------------------------------------------------------------
  *
- *  Header format (size in byte, 24 bytes in total):
+ *  Header format (size in byte, 40 + sizeof(KEY) bytes in total):
  *  ---------------------------------------------------------------------
  * | PageType (4) | CurrentSize (4) | MaxSize (4) | ParentPageId (4) |
  *  ---------------------------------------------------------------------
- *  ------------------------------
- * | PageId (4) | NextPageId (4)
- *  ------------------------------
+ *  ---------------------------------------------------------------------
+ * | PageId (4) | NextPageId (4) | PrevPageId (4) | PrefixSize (4) |
+ *  ---------------------------------------------------------------------
+ *  ----------------------------------
+ * | SuffixSize (4) | SharedKey (KEY) |
+ *  ----------------------------------
+ * MaxSize is the number of entries that fit with the current width.
+ * PrevPageId is a hint: the tree updates it on the right neighbor at once
+ * if that is not latched by someone else, else once the writer holds no
+ * latch. A reader follows it only if the page it names still has this one
+ * as its next page.
  */
 #pragma once
 #include <utility>
@@ -38,36 +55,79 @@ public:
   // helper methods
   page_id_t GetNextPageId() const;
   void SetNextPageId(page_id_t next_page_id);
+  page_id_t GetPrevPageId() const;
+  void SetPrevPageId(page_id_t prev_page_id);
   KeyType KeyAt(int index) const;
   int KeyIndex(const KeyType &key, const KeyComparator &comparator) const;
-  const MappingType &GetItem(int index);
+  MappingType GetItem(int index) const;
+  // whether one more entry with key fits, filling at most fill_factor of
+  // the page
+  bool HasRoomFor(const KeyType &key, double fill_factor = 1.0) const;
+  // whether all entries of both pages fit into one
+  bool CanMergeWith(const BPlusTreeLeafPage *other) const;
+  // first index to move out on a split so that the part key goes to has
+  // room for it, -1 if key does not fit with either part
+  int SplitIndex(const KeyType &key, int index, bool &key_left) const;
 
   // insert and delete methods
   int Insert(const KeyType &key, const ValueType &value,
              const KeyComparator &comparator);
+  // index gets the slot of key if it is found
   bool Lookup(const KeyType &key, ValueType &value,
-              const KeyComparator &comparator) const;
+              const KeyComparator &comparator, int *index = nullptr) const;
+  // Lookup of key at index only, e.g. the slot an adaptive hash index
+  // remembers. Bounded for readers without a latch
+  bool LookupAt(int index, const KeyType &key, ValueType &value,
+                const KeyComparator &comparator) const;
   int RemoveAndDeleteRecord(const KeyType &key,
                             const KeyComparator &comparator);
   // Split and Merge utility methods
   void MoveHalfTo(BPlusTreeLeafPage *recipient,
                   BufferPoolManager *buffer_pool_manager /* Unused */);
+  // move the entries from index on into the empty recipient, it becomes the
+  // next page
+  void MoveTailTo(BPlusTreeLeafPage *recipient, int index);
   void MoveAllTo(BPlusTreeLeafPage *recipient, int /* Unused */,
                  BufferPoolManager * /* Unused */);
-  void MoveFirstToEndOf(BPlusTreeLeafPage *recipient,
+  // false and nothing moved if the recipient has no room for the entry
+  bool MoveFirstToEndOf(BPlusTreeLeafPage *recipient,
                         BufferPoolManager *buffer_pool_manager);
-  void MoveLastToFrontOf(BPlusTreeLeafPage *recipient, int parentIndex,
+  bool MoveLastToFrontOf(BPlusTreeLeafPage *recipient, int parentIndex,
                          BufferPoolManager *buffer_pool_manager);
   // Debug
   std::string ToString(bool verbose = false) const;
 
 private:
-  void CopyHalfFrom(MappingType *items, int size);
-  void CopyAllFrom(MappingType *items, int size);
+  // offset and number of the stored bytes of a key, bounded for readers
+  // without a latch
+  void Layout(int &prefix, int &width) const;
+  KeyType ReadKey(int index, int prefix, int width) const;
+  // entries of the given width that fit into a page
+  static int Capacity(int width);
+  char *EntryAt(int index, int width);
+  const char *EntryAt(int index, int width) const;
+  // narrow prefix and suffix to the bytes shared by image and key
+  static void Narrow(const KeyType &image, const KeyType &key, int &prefix,
+                     int &suffix);
+  // the shared bytes of the entries from begin to end
+  void SharedBytes(int begin, int end, int &prefix, int &suffix) const;
+  // write all entries again with new shared bytes of image
+  void Reencode(const KeyType &image, int prefix, int suffix);
+  // narrow the shared bytes to the ones of key
+  void MakeRoomFor(const KeyType &key);
+  // recompute the shared bytes from the entries
+  void Compact();
+  void WriteEntry(int index, const KeyType &key, const ValueType &value);
+  // append the entries from begin to end of source
+  void CopyRangeFrom(const BPlusTreeLeafPage *source, int begin, int end);
   void CopyLastFrom(const MappingType &item);
   void CopyFirstFrom(const MappingType &item, int parentIndex,
                      BufferPoolManager *buffer_pool_manager);
   page_id_t next_page_id_;
-  MappingType array[0];
+  page_id_t prev_page_id_;
+  int prefix_size_;
+  int suffix_size_;
+  KeyType shared_key_;
+  char data_[0];
 };
 } // namespace cmudb
@@ -0,0 +1,69 @@
+/**
+ * free_space_map_page.h
+ *
+ * Free space map (FSM) of a table heap. Every heap page owns one entry that
+ * records how many bytes are still free in it, so TableHeap::InsertTuple can go
+ * straight to a page with enough room instead of walking the page chain.
+ * Entries are kept in heap chain order, hence the very last entry of the last
+ * FSM page always describes the last page of the heap. When one FSM page is
+ * full, a new one is chained after it.
+ *
+ * Format (size in byte, page ids take 8 with WIDE_PAGE_IDS):
+ *  ---------------------------------------------------------------------
+ * | PageId (4) | NextPageId (4) | EntryCount (4) | MaxFreeSpace (4) |
+ *  ---------------------------------------------------------------------
+ *  -----------------------------------------------------------------
+ * | HeapPageId_1 (4) | FreeSpace_1 (4) | HeapPageId_2 (4) | ... |
+ *  -----------------------------------------------------------------
+ * MaxFreeSpace is an upper bound of all FreeSpace entries within this page,
+ * which allows a search to skip the whole page without looking at entries.
+ */
+
+#pragma once
+
+#include <functional>
+
+#include "page/page.h"
+
+namespace cmudb {
+
+class FreeSpaceMapPage : public Page {
+public:
+  void Init(page_id_t page_id, page_id_t next_page_id = INVALID_PAGE_ID);
+
+  page_id_t GetPageId();
+  page_id_t GetNextPageId();
+  void SetNextPageId(page_id_t next_page_id);
+
+  int GetEntryCount();
+  bool IsFull();
+
+  /**
+   * Entry related
+   */
+  // append an entry for a newly linked heap page, return false if full
+  bool AppendEntry(page_id_t heap_page_id, int32_t free_space);
+  // update free space of a heap page, return false if not recorded here
+  bool UpdateEntry(page_id_t heap_page_id, int32_t free_space);
+  // drop the entry of a heap page unlinked from the heap, keeping the order
+  // of the others, return false if not recorded here
+  bool RemoveEntry(page_id_t heap_page_id);
+  // find a heap page with at least required bytes free, not one skip is
+  // true for
+  bool FindPage(int32_t required, page_id_t &heap_page_id,
+                const std::function<bool(page_id_t)> &skip = nullptr);
+  // heap page id of the last entry, INVALID_PAGE_ID if there is none
+  page_id_t GetLastHeapPageId();
+  page_id_t GetHeapPageId(int index);
+  int32_t GetFreeSpace(int index);
+
+private:
+  /**
+   * helper functions
+   */
+  void SetEntry(int index, page_id_t heap_page_id, int32_t free_space);
+  void SetEntryCount(int entry_count);
+  int32_t GetMaxFreeSpace();
+  void SetMaxFreeSpace(int32_t max_free_space);
+};
+} // namespace cmudb
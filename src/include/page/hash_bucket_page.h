@@ -0,0 +1,53 @@
+/**
+ * hash_bucket_page.h
+ *
+ * Bucket of a disk extendible hash index, (key, rid) entries in no order.
+ * When a bucket can not split any more its entries go on in overflow pages
+ * chained through NextPageId. The latch of the first page of a chain
+ * protects the whole chain.
+ *
+ * Bucket page format (size in byte):
+ *  ---------------------------------------------------------------------
+ * | NextPageId (4) | Size (4) | KEY(1) + RID(1) | ... | KEY(n) + RID(n) |
+ *  ---------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <utility>
+
+#include "page/b_plus_tree_page.h"
+
+namespace cmudb {
+
+#define HASH_BUCKET_PAGE_TYPE HashBucketPage<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class HashBucketPage {
+public:
+  void Init();
+
+  page_id_t GetNextPageId() const { return next_page_id_; }
+  void SetNextPageId(page_id_t next_page_id) { next_page_id_ = next_page_id; }
+
+  int GetSize() const { return size_; }
+  bool IsFull() const { return size_ >= Capacity(); }
+  static int Capacity() {
+    return (PAGE_SIZE - 2 * sizeof(int32_t)) / sizeof(MappingType);
+  }
+
+  const MappingType &GetItem(int index) const { return array_[index]; }
+  // index of the entry, -1 if missing. A null value matches any entry of key
+  int Find(const KeyType &key, const ValueType *value) const;
+  void Append(const MappingType &item);
+  // the last entry takes the place of the removed one
+  void RemoveAt(int index);
+  void Clear() { size_ = 0; }
+
+private:
+  page_id_t next_page_id_;
+  int32_t size_;
+  MappingType array_[0];
+};
+
+} // namespace cmudb
@@ -0,0 +1,73 @@
+/**
+ * hash_directory_page.h
+ *
+ * Directory of a disk extendible hash index. Slot i points to the bucket
+ * page of the keys whose hash ends in the low GlobalDepth bits of i, slots
+ * that differ only above the local depth of their bucket share it. The
+ * directory never spans more than one page: once it is full, buckets grow
+ * overflow pages instead of splitting.
+ *
+ * Directory page format (size in byte):
+ *  ----------------------------------------------------------------
+ * | PageId (4) | GlobalDepth (4) | BucketPageId(0) (4) | ... (4) |
+ *  ----------------------------------------------------------------
+ *  ----------------------------------------------
+ * | LocalDepth(0) (1) | LocalDepth(1) (1) | ... |
+ *  ----------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "common/config.h"
+
+namespace cmudb {
+
+// slots of the directory, 2^HASH_MAX_GLOBAL_DEPTH
+#ifdef WIDE_PAGE_IDS
+#define HASH_MAX_GLOBAL_DEPTH 8 // 512 wide page ids do not fit a 4 KB page
+#else
+#define HASH_MAX_GLOBAL_DEPTH 9
+#endif
+#define HASH_DIRECTORY_SIZE (1 << HASH_MAX_GLOBAL_DEPTH)
+
+class HashDirectoryPage {
+public:
+  // one bucket for every key
+  void Init(page_id_t page_id, page_id_t bucket_page_id);
+
+  page_id_t GetPageId() const { return page_id_; }
+
+  int GetGlobalDepth() const { return global_depth_; }
+  // slot of a hash under the current global depth
+  uint32_t SlotOf(uint32_t hash) const {
+    return hash & ((1u << global_depth_) - 1);
+  }
+  int Size() const { return 1 << global_depth_; }
+  bool CanGrow() const { return global_depth_ < HASH_MAX_GLOBAL_DEPTH; }
+  // double the directory, the new slots share the buckets of the old ones
+  void Grow();
+
+  page_id_t GetBucketPageId(uint32_t slot) const {
+    return bucket_page_ids_[slot];
+  }
+  void SetBucketPageId(uint32_t slot, page_id_t bucket_page_id) {
+    bucket_page_ids_[slot] = bucket_page_id;
+  }
+  int GetLocalDepth(uint32_t slot) const { return local_depths_[slot]; }
+  void SetLocalDepth(uint32_t slot, int local_depth) {
+    local_depths_[slot] = static_cast<uint8_t>(local_depth);
+  }
+
+private:
+  page_id_t page_id_;
+  int32_t global_depth_;
+  page_id_t bucket_page_ids_[HASH_DIRECTORY_SIZE];
+  uint8_t local_depths_[HASH_DIRECTORY_SIZE];
+};
+
+static_assert(sizeof(HashDirectoryPage) <= PAGE_SIZE,
+              "hash directory does not fit a page");
+
+} // namespace cmudb
@@ -5,10 +5,17 @@
  * our case, we will contain information about table/index name (length less than
  * 32 bytes) and their corresponding root_id
  *
- * Format (size in byte):
+ * Format (size in byte, page ids take 8 with WIDE_PAGE_IDS):
  *  -----------------------------------------------------------------
  * | RecordCount (4) | Entry_1 name (32) | Entry_1 root_id (4) | ... |
  *  -----------------------------------------------------------------
+ *  ... | NextPageId (4) |
+ *  ------------------------
+ *
+ * A page holds HEADER_PAGE_MAX_RECORDS records, when it is full more header
+ * pages are chained behind it. The last page id is the next one, the
+ * header page id for none, which is what a page that never had one holds.
+ * The Catalog keeps the records of the chain by name in memory.
  */
 
 #pragma once
@@ -19,9 +26,19 @@
 
 namespace cmudb {
 
+// name and root id
+#define HEADER_PAGE_RECORD_SIZE static_cast<int>(32 + sizeof(page_id_t))
+// records of one header page, the next page id is kept behind them
+#define HEADER_PAGE_MAX_RECORDS                                                \
+  ((PAGE_SIZE - 4 - static_cast<int>(sizeof(page_id_t))) /                    \
+   HEADER_PAGE_RECORD_SIZE)
+
 class HeaderPage : public Page {
 public:
-  void Init() { SetRecordCount(0); }
+  void Init() {
+    SetRecordCount(0);
+    SetNextPageId(INVALID_PAGE_ID);
+  }
   /**
    * Record related
    */
@@ -33,6 +50,14 @@ public:
   bool GetRootId(const std::string &name, page_id_t &root_id);
   int GetRecordCount();
 
+  // name and root id of the record at index
+  std::string GetName(int index);
+  page_id_t GetRootIdAt(int index);
+
+  // header page chained behind this one, INVALID_PAGE_ID for none
+  page_id_t GetNextPageId();
+  void SetNextPageId(page_id_t next_page_id);
+
 private:
   /**
    * helper functions
@@ -0,0 +1,47 @@
+/**
+ * overflow_page.h
+ *
+ * Page of the chain holding a varchar value kept out of line by its tuple,
+ * filled once before the tuple is inserted and never changed afterwards
+ *
+ * Format (size in byte, page ids take 8 with WIDE_PAGE_IDS):
+ *  --------------------------------------------------------------
+ * | PageId (4) | LSN (4) | NextPageId (4) | Size (4) | Bytes ... |
+ *  --------------------------------------------------------------
+ * PageId and LSN are where a table page keeps them, recovery tells whether
+ * a page is redone the same way for both.
+ */
+
+#pragma once
+
+#include "concurrency/transaction.h"
+#include "logging/log_manager.h"
+#include "page/page.h"
+
+namespace cmudb {
+
+#define OVERFLOW_PAGE_NEXT_OFFSET (sizeof(page_id_t) + 4)
+#define OVERFLOW_PAGE_SIZE_OFFSET                                              \
+  (OVERFLOW_PAGE_NEXT_OFFSET + sizeof(page_id_t))
+#define OVERFLOW_PAGE_HEADER_SIZE                                              \
+  static_cast<int32_t>(OVERFLOW_PAGE_SIZE_OFFSET + 4)
+// bytes of a value one overflow page holds
+#define OVERFLOW_PAGE_CAPACITY (PAGE_SIZE - OVERFLOW_PAGE_HEADER_SIZE)
+
+class OverflowPage : public Page {
+public:
+  // hold size bytes of a value, the ones after them are in next_page_id.
+  // Logged ahead if a running log manager is given
+  void Init(page_id_t page_id, page_id_t next_page_id, const char *bytes,
+            int32_t size, LogManager *log_manager = nullptr,
+            Transaction *txn = nullptr);
+
+  page_id_t GetPageId();
+  page_id_t GetNextPageId();
+  int32_t GetSize();
+  inline const char *GetBytes() {
+    return GetData() + OVERFLOW_PAGE_HEADER_SIZE;
+  }
+};
+
+} // namespace cmudb
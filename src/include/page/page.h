@@ -4,14 +4,24 @@
  * Wrapper around actual data page in main memory and also contains bookkeeping
  * information used by buffer pool manager like pin_count/dirty_flag/page_id.
  * Use page as a basic unit within the database system
+ * The data buffer lives in the frame arena of the buffer pool, apart from
+ * this descriptor, so descriptors stay dense and buffers page aligned. The
+ * latch is a one word RWLatch, a descriptor fits in a cache line. While
+ * latch profiling is on, blocking latches are counted and timed.
+ *
+ * A frame taking another page is odd versioned while it is refilled, like a
+ * write latched page, so a reader that follows a swizzled reference to it
+ * without a pin (see BufferPoolManager::ReadSwizzled) sees the change.
  */
 
 #pragma once
 
+#include <atomic>
 #include <cstring>
 #include <iostream>
 
 #include "common/config.h"
+#include "common/latch_stats.h"
 #include "common/rwmutex.h"
 
 namespace cmudb {
@@ -20,29 +30,90 @@ class Page {
   friend class BufferPoolManager;
 
 public:
-  Page() { ResetMemory(); }
+  Page() {}
   ~Page(){};
   // get actual data page content
   inline char *GetData() { return data_; }
   // get page id
-  inline page_id_t GetPageId() { return page_id_; }
+  inline page_id_t GetPageId() {
+    return page_id_.load(std::memory_order_relaxed);
+  }
   // get page pin count
   inline int GetPinCount() { return pin_count_; }
-  // method use to latch/unlatch page content
-  inline void WUnlatch() { rwlatch_.WUnlock(); }
-  inline void WLatch() { rwlatch_.WLock(); }
+  // lsn of the latest log record applied to this frame, INVALID_LSN if none
+  // since it was read. Buffer pool flushes log up to it before writing page.
+  inline lsn_t GetLSN() { return lsn_; }
+  inline void SetLSN(lsn_t lsn) { lsn_ = lsn; }
+  // no change before lsn is missing from the page on disk. Set before a
+  // change is logged, it is kept until the page is written, checkpoints
+  // collect it for the dirty page table
+  inline lsn_t GetRecLSN() { return rec_lsn_; }
+  inline void SetRecLSN(lsn_t lsn) {
+    lsn_t expected = INVALID_LSN;
+    rec_lsn_.compare_exchange_strong(expected, lsn);
+  }
+  // method use to latch/unlatch page content. The version is odd while the
+  // page is write latched and moves on with every write latch
+  inline void WUnlatch() {
+    version_.fetch_add(1, std::memory_order_release);
+    rwlatch_.WUnlock();
+  }
+  inline void WLatch() {
+    if (LatchStats::IsEnabled())
+      LatchProfiled(true);
+    else
+      rwlatch_.WLock();
+    version_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  // WLatch unless that would wait
+  inline bool TryWLatch() {
+    if (!rwlatch_.TryWLock())
+      return false;
+    version_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+  }
   inline void RUnlatch() { rwlatch_.RUnlock(); }
-  inline void RLatch() { rwlatch_.RLock(); }
+  inline void RLatch() {
+    if (LatchStats::IsEnabled())
+      LatchProfiled(false);
+    else
+      rwlatch_.RLock();
+  }
+  // optimistic readers take no latch: they remember an even version, read
+  // the page and throw away what they read unless the version is unchanged
+  inline uint64_t GetVersion() {
+    return version_.load(std::memory_order_acquire);
+  }
+  inline bool ValidateVersion(uint64_t version) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == version;
+  }
 
 private:
   // method used by buffer pool manager
   inline void ResetMemory() { memset(data_, 0, PAGE_SIZE); }
+  // bracket a change of the page the frame holds, the frame is unpinned
+  inline void BeginReplace() {
+    version_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  inline void EndReplace() { version_.fetch_add(1, std::memory_order_release); }
+  // take the latch, recording the acquisition and any wait
+  void LatchProfiled(bool exclusive);
   // members
-  char data_[PAGE_SIZE]; // actual data
-  page_id_t page_id_ = INVALID_PAGE_ID;
+  char *data_ = nullptr; // actual data, PAGE_SIZE bytes in the frame arena
+  std::atomic<uint64_t> version_{0};
+  // read without the partition latch by swizzled readers
+  std::atomic<page_id_t> page_id_{INVALID_PAGE_ID};
   int pin_count_ = 0;
+  std::atomic<lsn_t> lsn_{INVALID_LSN};
+  std::atomic<lsn_t> rec_lsn_{INVALID_LSN};
+  RWLatch rwlatch_;
   bool is_dirty_ = false;
-  RWMutex rwlatch_;
 };
 
+static_assert(sizeof(Page) <= 64, "a page descriptor fits in a cache line");
+
 } // namespace cmudb
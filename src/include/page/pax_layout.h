@@ -0,0 +1,58 @@
+/**
+ * pax_layout.h
+ *
+ * Column layout of a PAX table page: the widths of the columns of the fixed
+ * size part of the tuples, as they are laid out in a Tuple, and the number
+ * of slots of a page. A default constructed layout means the slotted format.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "catalog/schema.h"
+#include "common/config.h"
+
+namespace cmudb {
+
+// header of a table page up to its slots or PAX fields, see table_page.h
+#define TABLE_PAGE_HEADER_SIZE static_cast<int32_t>(16 + 3 * sizeof(page_id_t))
+// PAX header fields after Format
+#define PAX_CAPACITY_OFFSET TABLE_PAGE_HEADER_SIZE
+#define PAX_COLUMN_COUNT_OFFSET (TABLE_PAGE_HEADER_SIZE + 4)
+#define PAX_SLOTS_OFFSET (TABLE_PAGE_HEADER_SIZE + 8)
+#define PAX_FIXED_LENGTH_OFFSET (TABLE_PAGE_HEADER_SIZE + 12)
+// width and minipage offset of every column, 8 bytes each
+#define PAX_COLUMNS_OFFSET (TABLE_PAGE_HEADER_SIZE + 16)
+
+// page bytes for the header and alignment of a PAX page over columns
+#define PAX_HEADER_SIZE(columns)                                               \
+  ((PAX_COLUMNS_OFFSET + 8 * (columns) + 7) / 8 * 8)
+#define PAX_PADDING(columns) (7 * (columns))
+
+struct PaxLayout {
+  PaxLayout() = default;
+
+  // one minipage per column of schema, with slots for tuples whose varchars
+  // are of their declared length. Slotted if not one of them fits a page
+  explicit PaxLayout(Schema *schema, int32_t page_size = PAGE_SIZE);
+
+  inline bool IsPax() const { return !widths_.empty(); }
+
+  // bytes of the fixed size part of a tuple
+  inline uint32_t GetFixedLength() const {
+    uint32_t length = 0;
+    for (auto width : widths_)
+      length += width;
+    return length;
+  }
+
+  // bytes of the header, slots and minipages of a page
+  uint32_t GetMinipageEnd() const;
+
+  uint32_t capacity_ = 0;
+  std::vector<uint32_t> widths_;
+};
+
+} // namespace cmudb
@@ -8,59 +8,160 @@
  *                                 ^
  *                         free space pointer
  *
- *  Header format (size in byte):
+ *  Header format (size in byte, page ids take 8 with WIDE_PAGE_IDS):
  *  ---------------------------------------------------------------------
- * | PageId (4) | PrevPageId (4) | NextPageId (4) | FreeSpacePointer (4) |
+ * | PageId (4) | LSN (4) | PrevPageId (4) | NextPageId (4) |
  *  ---------------------------------------------------------------------
- *  --------------------------------------------------------------
- * | TupleCount (4) | Tuple_1 offset (4) | Tuple_1 size (4) | ... |
- *  --------------------------------------------------------------
+ *  ---------------------------------------------------------------
+ * | FreeSpacePointer(4) | TupleCount (4) | Format (4) | Tuple_1 offset (4) |
+ *  ---------------------------------------------------------------
+ *  ------------------
+ * | Tuple_1 size (4) | ...
+ *  ------------------
  *
+ * PAX page format, the fixed size part of the tuples is split by column over
+ * minipages of Capacity entries, their varchars are at the end of the page:
+ *  ---------------------------------------------------------------------
+ * | HEADER | SLOTS | MINIPAGE_1 | ... | MINIPAGE_n | FREE SPACES | VARLEN |
+ *  ---------------------------------------------------------------------
+ *
+ *  Header format after Format (size in byte):
+ *  ---------------------------------------------------------------------
+ * | Capacity (4) | ColumnCount (4) | SlotOffset (4) | FixedLength (4) |
+ *  ---------------------------------------------------------------------
+ *  -----------------------------------------------
+ * | Column_1 width (4) | Column_1 minipage offset (4) | ...
+ *  -----------------------------------------------
+ * A slot holds the offset of the varchar payloads and the size of the whole
+ * tuple. Tuples go in and out in their Tuple format either way, so rids,
+ * locks, log records and recovery are the same for both formats.
+ *
+ * Every modification is preceded by a log record when a running log manager is
+ * given, and LSN is set to that record's lsn. Recovery compares it with log
+ * records to decide whether a change already reached the page.
+ *
+ * Recovery replays changes with a null txn, nothing is locked or logged then.
+ * A null lock manager only turns off locking.
+ *
+ * The tuples of a slotted page are kept packed against the end of the page,
+ * a delete or update moves the ones below it, so free space never
+ * fragments. Free slots are reused by inserts, a slot whose rid another
+ * transaction still locks is skipped. Rows are locked under the
+ * table and page locks of table_id, the first page of their heap, if it is
+ * given.
  */
 
 #pragma once
 
 #include <cstring>
+#include <mutex>
 
 #include "common/rid.h"
 #include "concurrency/lock_manager.h"
+#include "concurrency/version_store.h"
+#include "logging/log_manager.h"
 #include "page/page.h"
+#include "page/pax_layout.h"
+#include "table/row_batch.h"
 #include "table/tuple.h"
 
 namespace cmudb {
 
+// header fields up to TABLE_PAGE_HEADER_SIZE
+#define TABLE_PAGE_LSN_OFFSET sizeof(page_id_t)
+#define TABLE_PAGE_PREV_OFFSET (TABLE_PAGE_LSN_OFFSET + 4)
+#define TABLE_PAGE_NEXT_OFFSET (TABLE_PAGE_PREV_OFFSET + sizeof(page_id_t))
+#define TABLE_PAGE_FREE_SPACE_OFFSET                                           \
+  (TABLE_PAGE_NEXT_OFFSET + sizeof(page_id_t))
+#define TABLE_PAGE_TUPLE_COUNT_OFFSET (TABLE_PAGE_FREE_SPACE_OFFSET + 4)
+#define TABLE_PAGE_FORMAT_OFFSET (TABLE_PAGE_TUPLE_COUNT_OFFSET + 4)
+
 class TablePage : public Page {
 public:
   /**
    * Header related
    */
+  // slotted page unless a PAX layout is given
   void Init(page_id_t page_id, size_t page_size,
             page_id_t prev_page_id = INVALID_PAGE_ID,
-            page_id_t next_page_id = INVALID_PAGE_ID);
+            page_id_t next_page_id = INVALID_PAGE_ID,
+            LogManager *log_manager = nullptr, Transaction *txn = nullptr,
+            const PaxLayout &layout = PaxLayout());
   page_id_t GetPageId();
+  lsn_t GetPageLSN();
+  // also stamps lsn into the frame for the write ahead rule
+  void SetPageLSN(lsn_t lsn);
 
   page_id_t GetPrevPageId();
   page_id_t GetNextPageId();
   void SetPrevPageId(page_id_t prev_page_id);
   void SetNextPageId(page_id_t next_page_id);
 
+  // layout the page was initialized with, the default one for slotted
+  inline bool IsPax() { return GetFormat() == PAX_FORMAT; }
+  void GetPaxLayout(PaxLayout &layout);
+
   /**
    * Tuple related
    */
   bool InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn,
-                   LockManager *lock_manager); // return rid if success
-  bool MarkDelete(const RID &rid, Transaction *txn,
-                  LockManager *lock_manager); // delete
+                   LockManager *lock_manager, LogManager *log_manager,
+                   page_id_t table_id = INVALID_PAGE_ID); // return rid
+  // recovery puts a tuple back in the slot of rid if it is free or the next
+  // new one, otherwise in a new slot rid is set to. False if it does not fit
+  bool RestoreTuple(const Tuple &tuple, RID &rid);
+  bool MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_manager,
+                  LogManager *log_manager,
+                  page_id_t table_id = INVALID_PAGE_ID); // delete
   bool UpdateTuple(const Tuple &new_tuple, Tuple &old_tuple, const RID &rid,
-                   Transaction *txn, LockManager *lock_manager);
+                   Transaction *txn, LockManager *lock_manager,
+                   LogManager *log_manager,
+                   page_id_t table_id = INVALID_PAGE_ID);
+  // largest tuple UpdateTuple can put in place of the tuple of rid, 0 if
+  // rid holds none
+  int32_t GetUpdateRoom(const RID &rid);
 
-  // commit time
-  void ApplyDelete(const RID &rid, Transaction *txn);    // when commit success
-  void RollbackDelete(const RID &rid, Transaction *txn); // when commit abort
+  // commit time. The tuple removed is copied to deleted if given
+  void ApplyDelete(const RID &rid, Transaction *txn,
+                   LogManager *log_manager,
+                   Tuple *deleted = nullptr); // when commit success
+  void RollbackDelete(const RID &rid, Transaction *txn,
+                      LogManager *log_manager); // when commit abort
 
   // return tuple (with data pointing to heap) if success
   bool GetTuple(const RID &rid, Tuple &tuple, Transaction *txn,
-                LockManager *lock_manager);
+                LockManager *lock_manager,
+                page_id_t table_id = INVALID_PAGE_ID);
+  // whether the slot of rid holds a tuple, not one marked deleted
+  bool HasTuple(const RID &rid);
+  // the checks and shared lock of GetTuple without the copy, the bytes of the
+  // tuple stay in the page. Read them under the page latch with
+  // GetTupleBytes, the tuple may move within the page between two latches.
+  // Without wait a lock another transaction holds is not waited for, false
+  // with txn still running then
+  bool LockTuple(const RID &rid, Transaction *txn, LockManager *lock_manager,
+                 page_id_t table_id = INVALID_PAGE_ID, bool wait = true);
+  // bytes of the tuple from offset within its Tuple format, enough for the
+  // column or varchar payload starting there
+  inline const char *GetTupleBytes(const RID &rid, int32_t offset) {
+    if (IsPax())
+      return GetPaxBytes(rid.GetSlotNum(), offset);
+    return GetData() + GetTupleOffset(rid.GetSlotNum()) + offset;
+  }
+  // append the tuples from slot on to batch until it is full, each locked as
+  // GetTuple does, tuples that can not be locked are left out. The batch
+  // predicates are evaluated on them before returning. slot is moved past the
+  // last one appended, true once the end of the page is reached. txn_latch
+  // guards the lock sets of a txn shared by several scanning threads. A
+  // snapshot txn locks nothing and gets the versions it sees of the tuples
+  // of table_id it should not see in the page. With blocked given, a tuple
+  // locked by another transaction ends the batch instead and its rid is set
+  // there, the caller waits for the lock without the page latch a rolling
+  // back writer needs
+  bool ScanBatch(int &slot, RowBatch &batch, Transaction *txn,
+                 LockManager *lock_manager, std::mutex *txn_latch = nullptr,
+                 page_id_t table_id = INVALID_PAGE_ID,
+                 RID *blocked = nullptr);
 
   /**
    * Tuple iterator
@@ -68,10 +169,52 @@ public:
   bool GetFirstTupleRid(RID &first_rid);
   bool GetNextTupleRid(const RID &cur_rid, RID &next_rid);
 
+  // for free space calculation, also reported to the free space map. A PAX
+  // page counts the fixed size part and slot of the next tuple as free, none
+  // once its slots are used up and none is free
+  int32_t GetFreeSpaceSize();
+
+  // whether no slot holds a tuple, marked deleted ones included
+  bool IsEmpty();
+  // an empty page about to leave its heap takes no more tuples, its links
+  // are kept for scans still on it
+  void Retire();
+
 private:
+  enum PageFormat { SLOTTED_FORMAT = 0, PAX_FORMAT };
+
   /**
    * helper functions
    */
+  inline int32_t GetFormat() {
+    return *reinterpret_cast<int32_t *>(GetData() + TABLE_PAGE_FORMAT_OFFSET);
+  }
+  inline int32_t GetSlotOffset() {
+    return IsPax() ? *reinterpret_cast<int32_t *>(GetData() + PAX_SLOTS_OFFSET)
+                   : TABLE_PAGE_HEADER_SIZE;
+  }
+  // bytes of the fixed size part of every tuple of a PAX page
+  inline int32_t GetFixedLength() {
+    return *reinterpret_cast<int32_t *>(GetData() + PAX_FIXED_LENGTH_OFFSET);
+  }
+  // bytes a tuple of size takes where the free space pointer is
+  inline int32_t GetStoredSize(int32_t tuple_size) {
+    return IsPax() ? tuple_size - GetFixedLength() : tuple_size;
+  }
+  const char *GetPaxBytes(int slot_num, int32_t offset);
+  // store tuple in a free or the next new slot, room is checked already
+  void PlaceTuple(int slot_num, const Tuple &tuple);
+  // write the tuple data into slot, its offset set already
+  void WriteTuple(int slot_num, const char *data, int32_t size);
+  // copy the size bytes of the tuple of rid out to tuple, allocated
+  void CopyTuple(const RID &rid, int32_t size, Tuple &tuple);
+  // whether a slot can be reused
+  bool HasFreeSlot();
+  // ScanBatch of a snapshot on a page with versions
+  bool ScanVersions(int &slot, RowBatch &batch, Transaction *txn,
+                    VersionStore *versions, page_id_t table_id);
+  // bytes between the slots, minipages for PAX, and the free space pointer
+  int32_t GetFreeHeapSize();
   int32_t GetTupleOffset(int slot_num);
   int32_t GetTupleSize(int slot_num);
   void SetTupleOffset(int slot_num, int32_t offset);
@@ -81,6 +224,8 @@ private:
   int32_t GetTupleCount(); // Note that this tuple count may be larger than # of
                            // actual tuples because some slots may be empty
   void SetTupleCount(int32_t tuple_count);
-  int32_t GetFreeSpaceSize();
+  // append log record for txn, stamp page with its lsn
+  void WriteLog(LogRecord &log_record, Transaction *txn,
+                LogManager *log_manager);
 };
 } // namespace cmudb
@@ -0,0 +1,231 @@
+/**
+ * lsm_tree.h
+ *
+ * Log-structured storage of rows by 64 bit key, for tables that are mostly
+ * appended to. Writes go to the memtable, a sorted map in memory. A full
+ * memtable is frozen and written as an immutable sorted run: its pages are
+ * taken from the disk manager and written in key order with one request per
+ * stretch of consecutive page ids, they do not pass through the buffer pool.
+ * Reads fetch run pages through the pool.
+ *
+ * Each run keeps a bloom filter of its keys and the first key of each of its
+ * pages in memory, a point lookup reads at most one page of a run and only
+ * of runs whose filter passes the key. Newer entries shadow older ones, a
+ * remove leaves a tombstone until a compaction drops it.
+ *
+ * A compaction thread merges the runs into one once there are
+ * LSM_COMPACTION_RUNS of them. The merged run replaces them in the manifest
+ * before their pages are deleted, which waits for the scans reading them.
+ *
+ * Manifest page format (size in byte):
+ *  ------------------------------------------------------------------
+ * | NextKey (8) | RunCount (4) | FirstPageId (4) ... newest run first |
+ *  ------------------------------------------------------------------
+ * Run page format: | NextPageId (4) | Count (4) | Records ... |. Page ids
+ * take 8 bytes with WIDE_PAGE_IDS.
+ * Record format: | Key (8) | Size (4) | Row (Size) |, a tombstone has Size
+ * LSM_TOMBSTONE and no row. Records are never split across pages.
+ *
+ * The filters and page keys of the runs are rebuilt when the tree opens. The
+ * memtable is written at checkpoints and when the tree closes: writes are
+ * not logged, those since the last checkpoint are lost in a crash.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+
+namespace cmudb {
+
+// bytes of rows the memtable holds before it is written as a run
+#define LSM_MEMTABLE_SIZE (1 << 20)
+// runs that start a compaction
+#define LSM_COMPACTION_RUNS 4
+#define LSM_BLOOM_BITS_PER_KEY 10
+// count of a run page, after its next page id
+#define LSM_COUNT_OFFSET sizeof(page_id_t)
+#define LSM_PAGE_HEADER_SIZE (LSM_COUNT_OFFSET + 4)
+#define LSM_RECORD_HEADER_SIZE 12
+#define LSM_MANIFEST_HEADER_SIZE 12
+#define LSM_TOMBSTONE UINT32_MAX
+// runs the manifest page has room for
+#define LSM_MAX_RUNS                                                           \
+  ((PAGE_SIZE - LSM_MANIFEST_HEADER_SIZE) / sizeof(page_id_t))
+// run pages written with one wait for the disk
+#define LSM_WRITE_BATCH 64
+
+// may a key be among those added, no false negatives
+class BloomFilter {
+public:
+  explicit BloomFilter(size_t keys,
+                       size_t bits_per_key = LSM_BLOOM_BITS_PER_KEY);
+
+  void Add(int64_t key);
+
+  bool MayContain(int64_t key) const;
+
+private:
+  std::vector<uint64_t> bits_;
+  uint64_t bit_count_;
+  int probes_;
+};
+
+// a key and its row, or its tombstone
+struct LsmEntry {
+  int64_t key_;
+  bool deleted_;
+  std::string row_;
+};
+
+// an immutable sorted run, its pages are deleted with it once compacted
+struct LsmRun {
+  LsmRun(BufferPoolManager *buffer_pool_manager, size_t keys)
+      : buffer_pool_manager_(buffer_pool_manager), bloom_(keys) {}
+  ~LsmRun();
+
+  BufferPoolManager *buffer_pool_manager_;
+  std::vector<page_id_t> page_ids_;
+  // first key of each page
+  std::vector<int64_t> first_keys_;
+  int64_t max_key_ = INT64_MIN;
+  size_t count_ = 0;
+  BloomFilter bloom_;
+  // merged into another run, no longer in the manifest
+  std::atomic<bool> obsolete_{false};
+};
+
+class LsmTree {
+public:
+  // the tree of a manifest page, a new one if it is invalid. Throws if no
+  // page can be had
+  LsmTree(BufferPoolManager *buffer_pool_manager,
+          page_id_t manifest_page_id = INVALID_PAGE_ID);
+
+  // stops compaction and writes the memtable
+  ~LsmTree();
+
+  inline page_id_t GetManifestPageId() const { return manifest_page_id_; }
+
+  // a key above every key the tree has had
+  int64_t NextKey();
+
+  // replace the row of key. Throws if the row would not fit a page
+  void Put(int64_t key, const char *row, uint32_t size);
+
+  void Remove(int64_t key);
+
+  // the row of key, false if it has none
+  bool Get(int64_t key, std::string &row);
+
+  // write the memtable as a run
+  void Flush();
+
+  // merge every run into one
+  void Compact();
+
+  size_t GetRunCount();
+
+  inline size_t GetCompactionCount() const { return compactions_; }
+
+  // rows in memtable and runs, a key counted once per run it is in
+  size_t GetEntryCount();
+
+  // page of run that would hold key
+  static size_t FindPage(const LsmRun &run, int64_t key);
+
+  // the live rows with keys in [low, high] in key order, as of its
+  // construction. Run pages are read one at a time and not kept pinned
+  class Iterator {
+  public:
+    Iterator(LsmTree *tree, int64_t low, int64_t high);
+
+    inline bool isEnd() const { return end_; }
+    inline int64_t GetKey() const { return entry_.key_; }
+    inline const std::string &GetRow() const { return entry_.row_; }
+    inline bool IsDeleted() const { return entry_.deleted_; }
+
+    void Next();
+
+  private:
+    friend class LsmTree;
+
+    // entries of a memtable, or of the pages of a run read so far
+    struct Source {
+      std::vector<LsmEntry> entries_;
+      size_t position_ = 0;
+      std::shared_ptr<LsmRun> run_;
+      // next page of run_ to read
+      size_t page_ = 0;
+    };
+
+    // over the memtables then the runs given, newest first
+    Iterator(BufferPoolManager *buffer_pool_manager,
+             std::vector<std::vector<LsmEntry>> &&memtables,
+             const std::vector<std::shared_ptr<LsmRun>> &runs, int64_t low,
+             int64_t high, bool tombstones);
+
+    // read pages of a run source until it has an entry or none is left
+    void Fill(Source &source);
+
+    BufferPoolManager *buffer_pool_manager_;
+    std::vector<Source> sources_;
+    int64_t low_;
+    int64_t high_;
+    // tombstones are returned, with deleted_ set
+    bool tombstones_;
+    bool end_ = false;
+    LsmEntry entry_;
+  };
+
+private:
+  typedef std::map<int64_t, LsmEntry> Memtable;
+
+  // entries of memtable with keys in [low, high]
+  static std::vector<LsmEntry> Entries(const Memtable &memtable, int64_t low,
+                                       int64_t high);
+
+  void Write(int64_t key, bool deleted, const char *row, uint32_t size);
+
+  // write the entries as a new run, its filter sized for keys. nullptr if
+  // there are none
+  std::shared_ptr<LsmRun> WriteRun(Iterator &entries, size_t keys);
+
+  // rebuild a run of the manifest from its pages
+  std::shared_ptr<LsmRun> LoadRun(page_id_t first_page_id);
+
+  // write the manifest to disk, under latch_
+  void WriteManifest();
+
+  void CompactionThread();
+
+  BufferPoolManager *buffer_pool_manager_;
+  page_id_t manifest_page_id_;
+  std::atomic<int64_t> next_key_;
+  // guards memtable_, frozen_ and runs_
+  std::mutex latch_;
+  Memtable memtable_;
+  size_t memtable_size_ = 0;
+  // the memtable being written as a run, nullptr if none
+  std::shared_ptr<Memtable> frozen_;
+  // newest first
+  std::vector<std::shared_ptr<LsmRun>> runs_;
+  // one flush and one compaction at a time
+  std::mutex flush_latch_;
+  std::mutex compaction_latch_;
+  std::atomic<size_t> compactions_{0};
+  std::thread compaction_thread_;
+  std::condition_variable compaction_cv_;
+  bool stop_ = false;
+};
+
+} // namespace cmudb
@@ -0,0 +1,118 @@
+/**
+ * parallel_scan.h
+ *
+ * Sequential scan of a table heap by several threads. The heap pages are
+ * listed from the free space map, which keeps them in chain order, and cut
+ * into morsels of consecutive pages that workers take one after another, so
+ * a slow page only holds up the worker on it.
+ *
+ * Every worker fills RowBatches with TablePage::ScanBatch, pages the zone
+ * map of the heap rules out for the batch predicates are not fetched. Run
+ * hands each batch to a callback on the worker thread, to aggregate locally.
+ * Start and Next pass them on to one consumer instead, in no particular
+ * order.
+ *
+ * Workers share the txn, its lock sets are guarded by a latch of the scan;
+ * without a lock manager nothing is shared but the buffer pool.
+ *
+ * The heaps of the partitions of a table are scanned as one: their pages
+ * are listed one heap after the other and every page is read as a page of
+ * its own heap, so the workers spread over the partitions.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "table/row_batch.h"
+#include "table/table_heap.h"
+
+namespace cmudb {
+
+// pages handed out to a worker at a time
+#define PARALLEL_SCAN_MORSEL_PAGES 16
+
+class ParallelTableScan {
+public:
+  // threads 0 picks the number of cores
+  ParallelTableScan(TableHeap *table_heap, Transaction *txn,
+                    size_t threads = 0,
+                    size_t morsel_pages = PARALLEL_SCAN_MORSEL_PAGES);
+  // scan of every heap of table_heaps, which share a buffer pool
+  ParallelTableScan(const std::vector<TableHeap *> &table_heaps,
+                    Transaction *txn, size_t threads = 0,
+                    size_t morsel_pages = PARALLEL_SCAN_MORSEL_PAGES);
+
+  // stops the workers of Start, the batches not consumed are dropped
+  ~ParallelTableScan();
+
+  inline size_t GetPageCount() const { return page_ids_.size(); }
+
+  inline size_t GetThreadCount() const { return threads_; }
+
+  // scan the whole table, worker i filling batches[i], one per thread.
+  // consume(batch, i) is called on the worker thread for every batch with
+  // rows selected
+  void Run(const std::vector<RowBatch *> &batches,
+           const std::function<void(RowBatch &, size_t)> &consume);
+
+  // start the workers in the background, the batches are the pool they
+  // fill, more than one per thread keeps them busy while Next is consumed
+  void Start(const std::vector<RowBatch *> &batches);
+
+  // give back the batch of the previous call, nullptr for none, and wait
+  // for the next one with rows selected. Nullptr once the table is done
+  RowBatch *Next(RowBatch *done);
+
+private:
+  // take the next morsel, false when there is none left or the scan stops.
+  // Its pages the zone map rules out for predicates are not read ahead
+  bool NextMorsel(size_t &begin, size_t &end,
+                  const std::vector<BatchPredicate> &predicates);
+
+  void Worker(size_t worker, RowBatch *batch);
+
+  // heap of the i-th page of page_ids_
+  inline TableHeap *GetHeap(size_t i) const {
+    if (table_heaps_.size() == 1)
+      return table_heaps_[0];
+    return table_heaps_[std::upper_bound(heap_ends_.begin(), heap_ends_.end(),
+                                         i) -
+                        heap_ends_.begin()];
+  }
+
+  // hand a full batch over, return the one to fill next, nullptr to stop
+  RowBatch *Emit(size_t worker, RowBatch *batch);
+
+  std::vector<TableHeap *> table_heaps_;
+  Transaction *txn_;
+  size_t threads_;
+  size_t morsel_pages_;
+  // pages of the heaps in turn, the ones of table_heaps_[i] end before
+  // heap_ends_[i]
+  std::vector<page_id_t> page_ids_;
+  std::vector<size_t> heap_ends_;
+  std::atomic<size_t> next_page_{0};
+  // guards the lock sets of txn_
+  std::mutex txn_latch_;
+
+  // Run calls consume_, Start hands batches over through ready_
+  std::function<void(RowBatch &, size_t)> consume_;
+  std::vector<std::thread> workers_;
+  std::mutex queue_latch_;
+  std::condition_variable ready_cv_;
+  std::condition_variable free_cv_;
+  std::deque<RowBatch *> ready_;
+  std::deque<RowBatch *> free_;
+  size_t running_ = 0;
+  std::atomic<bool> stop_{false};
+};
+
+} // namespace cmudb
@@ -0,0 +1,154 @@
+/**
+ * row_batch.h
+ *
+ * Column oriented batch of rows filled by the batch scan of a table heap.
+ * Every column is a dense array of capacity fixed size values, varchar
+ * columns hold (offset, length) pairs into a string buffer shared by the
+ * batch. Rows are appended straight from the tuple bytes in the page, no
+ * Tuple or Value is built on the way.
+ *
+ * The selection vector lists the rows still alive, predicates narrow it
+ * down one column at a time with the type switch out of the loop. With
+ * predicates set, only their columns are copied on append; the rows of a
+ * page are filtered while it is latched and the other projected columns are
+ * copied for the rows left only.
+ *
+ * Tuples of a PAX page are appended by slot, their columns are copied one
+ * minipage at a time when the page is materialized.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "catalog/schema.h"
+#include "common/rid.h"
+#include "type/value.h"
+
+namespace cmudb {
+
+// rows per batch filled by one call of the batch scan
+#define ROW_BATCH_SIZE 1024
+// projection of every column
+#define ROW_BATCH_ALL_COLUMNS (~static_cast<uint64_t>(0))
+
+enum class CompareType { EQ = 0, NE, LT, LE, GT, GE };
+
+// column <type> constant, a null constant or value never satisfies it
+struct BatchPredicate {
+  BatchPredicate(int column, CompareType type, const Value &value)
+      : column_(column), type_(type), value_(value) {}
+
+  int column_;
+  CompareType type_;
+  Value value_;
+};
+
+class RowBatch {
+public:
+  RowBatch(Schema *schema, uint32_t capacity = ROW_BATCH_SIZE);
+
+  ~RowBatch();
+
+  // drop every row, the column arrays are kept
+  void Reset();
+
+  inline bool IsFull() const { return size_ == capacity_; }
+
+  // rows appended since the last reset
+  inline uint32_t GetSize() const { return size_; }
+
+  inline Schema *GetSchema() const { return schema_; }
+
+  // columns the rows are decoded with, bit i for column i and bit 63 for
+  // every column from 63 on, as sqlite's colUsed. Others are left undefined
+  void SetProjection(uint64_t columns);
+
+  // predicates every selected row satisfies, they are ANDed
+  void SetPredicates(const std::vector<BatchPredicate> &predicates);
+  inline const std::vector<BatchPredicate> &GetPredicates() const {
+    return predicates_;
+  }
+
+  // copy the columns of the tuple bytes in, the batch must not be full. The
+  // bytes must stay valid until the next Materialize
+  void AppendTuple(const char *data, const RID &rid);
+
+  // the tuples appended next by AppendSlot are those of a PAX page, column i
+  // of slot s at minipages[i] + s * its length in the schema. They must stay
+  // valid until the next Materialize
+  inline void SetMinipages(const char *const *minipages) {
+    minipages_ = minipages;
+  }
+
+  // append the tuple in slot of the minipages set, its varchar offsets count
+  // from varlen. Its columns are copied by Materialize
+  void AppendSlot(uint32_t slot, const char *varlen, const RID &rid);
+
+  // evaluate the predicates on the rows appended since the last call, and
+  // copy the other projected columns of the rows that satisfy them
+  void Materialize();
+
+  // drop the selected rows that do not satisfy predicate
+  inline void Filter(const BatchPredicate &predicate) { Filter(predicate, 0); }
+
+  // rows left by the filters, in the order they were appended
+  inline uint32_t GetSelectedCount() const {
+    return static_cast<uint32_t>(selection_.size());
+  }
+
+  // index of the i-th selected row
+  inline uint32_t GetSelected(uint32_t i) const { return selection_[i]; }
+
+  inline const RID &GetRid(uint32_t row) const { return rids_[row]; }
+
+  // bytes of a fixed size column, as they are in the tuple
+  inline const char *GetFixed(int column, uint32_t row) const {
+    return columns_[column] + row * widths_[column];
+  }
+
+  // bytes and length of a varchar column, nullptr for null. For a value out
+  // of line, IsOverflowLength(len), the bytes are the first page of its
+  // chain, read by TableHeap::ReadOutOfLine. Predicates keep such rows
+  const char *GetVarchar(int column, uint32_t row, uint32_t &len) const;
+
+  // deserialized value of column, for callers off the hot path. Not for
+  // values out of line
+  Value GetValue(int column, uint32_t row) const;
+
+private:
+  // Filter over the selection from position from on
+  void Filter(const BatchPredicate &predicate, size_t from);
+  void CopyColumn(int column, uint32_t row);
+  // CopyColumn for the selected rows from position from on, of minipages_
+  void CopyMinipage(int column, size_t from);
+  // which columns are copied on append and which by Materialize
+  void SplitColumns();
+
+  Schema *schema_;
+  uint32_t capacity_;
+  uint32_t size_ = 0;
+  // one array of capacity_ * widths_[i] bytes per column
+  std::vector<char *> columns_;
+  std::vector<uint32_t> widths_;
+  std::vector<RID> rids_;
+  // payload of the varchar columns
+  std::vector<char> varlen_;
+  std::vector<uint32_t> selection_;
+  uint64_t projection_ = ROW_BATCH_ALL_COLUMNS;
+  std::vector<BatchPredicate> predicates_;
+  // columns copied on append and by Materialize, in column order
+  std::vector<int> eager_;
+  std::vector<int> late_;
+  // tuple bytes of the rows appended, until materialized. For the slots of
+  // minipages_, where their varchar offsets count from
+  std::vector<const char *> tuples_;
+  std::vector<uint32_t> slots_;
+  const char *const *minipages_ = nullptr;
+  // position in selection_ of the first row not materialized yet
+  size_t pending_ = 0;
+};
+
+} // namespace cmudb
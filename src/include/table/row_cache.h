@@ -0,0 +1,110 @@
+/**
+ * row_cache.h
+ *
+ * Tuples of a table heap by rid, for hot rows read again and again by point
+ * lookups. A hit copies the tuple without pinning, latching or locking its
+ * page; the heap still locks the row first, the cache only saves the read.
+ *
+ * The rids are spread over shards, each a hash table of chains that readers
+ * walk without a latch inside an epoch. Writers hold the shard latch, an
+ * entry they unlink is freed once the readers that may see it are gone.
+ * A full shard evicts with a clock: a hit sets the referenced bit of the
+ * entry and the hand passes over referenced entries once.
+ *
+ * The heap invalidates the tuple of a rid whenever it changes it. Every
+ * invalidation bumps the generation of the shard, a tuple read from its
+ * page is only put if the generation it read before is still current, so
+ * a fill racing a change is dropped rather than cached stale.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "common/rid.h"
+#include "table/tuple.h"
+
+namespace cmudb {
+
+#define ROW_CACHE_SHARDS 16
+// unlinked entries of a shard are freed in batches of this many
+#define ROW_CACHE_RETIRE_BATCH 64
+
+class RowCache {
+public:
+  // at most about capacity tuples
+  explicit RowCache(size_t capacity);
+  ~RowCache();
+
+  // copy of the tuple cached for rid, false on a miss
+  bool Get(const RID &rid, Tuple &tuple);
+
+  // whether a tuple of rid is cached, without counting a hit or a miss
+  bool Contains(const RID &rid);
+
+  // generation of rid, read before its tuple is read from the page
+  inline uint64_t GetGeneration(const RID &rid) {
+    return GetShard(rid).generation_.load(std::memory_order_acquire);
+  }
+  // cache tuple of rid, read since generation. Dropped if rid may have
+  // changed meanwhile
+  void Put(const RID &rid, const Tuple &tuple, uint64_t generation);
+
+  // the tuple of rid changes, under the latch of its page
+  void Invalidate(const RID &rid);
+
+  uint64_t GetHits();
+  uint64_t GetMisses();
+  size_t GetSize();
+
+private:
+  struct Entry {
+    RID rid_;
+    int32_t size_;
+    char *data_;
+    // next of the bucket chain, read without the latch
+    std::atomic<Entry *> next_;
+    std::atomic<bool> referenced_;
+    // ring of the clock, under the latch
+    Entry *prev_;
+    Entry *ring_next_;
+
+    ~Entry() { delete[] data_; }
+  };
+
+  struct Shard {
+    std::mutex latch_;
+    std::atomic<Entry *> *buckets_;
+    size_t count_ = 0;
+    Entry *hand_ = nullptr;
+    std::atomic<uint64_t> generation_{0};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    // unlinked, freed once the readers of their epoch are gone
+    std::vector<Entry *> retired_;
+  };
+
+  static inline uint64_t Hash(const RID &rid) {
+    return static_cast<uint64_t>(rid.Get()) * 0x9E3779B97F4A7C15ull;
+  }
+  inline Shard &GetShard(const RID &rid) {
+    return shards_[(Hash(rid) >> 60) & (ROW_CACHE_SHARDS - 1)];
+  }
+  inline std::atomic<Entry *> &GetBucket(Shard &shard, const RID &rid) {
+    return shard.buckets_[(Hash(rid) >> 24) & bucket_mask_];
+  }
+
+  // under the latch of shard: unlink entry from its chain and the ring, and
+  // retire it
+  void Remove(Shard &shard, Entry *entry);
+  // free entries retired by a shard, outside its latch
+  static void Reclaim(std::vector<Entry *> &retired);
+
+  Shard shards_[ROW_CACHE_SHARDS];
+  size_t shard_capacity_;
+  size_t bucket_mask_;
+};
+
+} // namespace cmudb
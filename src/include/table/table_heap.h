@@ -6,57 +6,325 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "buffer/buffer_pool_manager.h"
+#include "page/free_space_map_page.h"
+#include "page/overflow_page.h"
 #include "page/table_page.h"
 #include "table/table_iterator.h"
+#include "table/row_cache.h"
 #include "table/tuple.h"
+#include "table/zone_map.h"
 
 namespace cmudb {
 
+// pages with this much free space are merged by MergePages
+#define MERGE_FREE_SPACE (PAGE_SIZE * 3 / 4)
+
+// varchars longer than this are kept out of line once overflow pages are
+// enabled, as are the longest ones of a tuple too large for a page
+#define OVERFLOW_VARCHAR_SIZE (PAGE_SIZE / 4)
+
+// insertion target pages of a heap, threads beyond as many share them
+#define INSERT_TARGETS 16
+
+// a tuple moved from one rid to another
+typedef std::function<void(const RID &from, const RID &to)> MoveCallback;
+
 class TableHeap {
   friend class TableIterator;
+  friend class TableBatchIterator;
+  friend class ParallelTableScan;
+  friend class TableStats;
 
 public:
   ~TableHeap() {
     // when destruct table heap, flush all pages within buffer pool
     buffer_pool_manager_->FlushAllPages();
+    delete zone_map_;
+    delete row_cache_;
   }
 
-  // open/create a table heap, create table if first_page_id is not passed
+  // open/create a table heap, create table if first_page_id is not passed.
+  // the free space map is rebuilt from the page chain if fsm_page_id is not
+  // passed when opening an existing table. Changes are logged ahead when a
+  // running log manager is passed. A new table has PAX pages if a PAX layout
+  // is passed, an existing one keeps the format of its first page. Pages the
+  // table gets from now on are taken from tablespace_id
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager,
-            page_id_t first_page_id = INVALID_PAGE_ID);
+            LogManager *log_manager = nullptr,
+            page_id_t first_page_id = INVALID_PAGE_ID,
+            page_id_t fsm_page_id = INVALID_PAGE_ID,
+            const PaxLayout &layout = PaxLayout(), int tablespace_id = 0);
 
-  // for insert, if tuple is too large (>~page_size), return false
-  bool InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn);
+  // for insert, if tuple is too large (>~page_size) even with its varchars
+  // out of line, return false. A valid near_page_id is tried first, e.g. the
+  // page of the next row in the order the table is kept in
+  bool InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn,
+                   page_id_t near_page_id = INVALID_PAGE_ID);
+  // insert tuples in order, rids is set to their rids. Pages are filled in
+  // turn with as many of them as they take. False on the first one that can
+  // not be inserted, txn is aborted then
+  bool InsertTuples(const std::vector<Tuple> &tuples, std::vector<RID> &rids,
+                    Transaction *txn);
 
   bool MarkDelete(const RID &rid, Transaction *txn);  // for delete
 
   // if the new tuple is too large to fit in the old page, return false (will
-  // delete and insert)
+  // delete and insert). With overflow pages enabled more of its varchars go
+  // out of line first to keep it in place
   bool UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn);
 
-  // commit/abort time
-  void ApplyDelete(const RID &rid,
-                   Transaction *txn); // when commit delete or rollback insert
+  // commit/abort time, and rollback to a savepoint. The tuple removed is
+  // copied to deleted if given and the heap has values out of line
+  void ApplyDelete(const RID &rid, Transaction *txn,
+                   Tuple *deleted = nullptr); // when commit delete or rollback insert
   void RollbackDelete(const RID &rid, Transaction *txn); // when rollback delete
+  // rollback time, rid gets old_tuple back. An aborted txn retires the
+  // chains only the image undone had
+  bool RollbackUpdate(const Tuple &old_tuple, const RID &rid,
+                      Transaction *txn);
+  // the chains image had and the tuple of rid no longer has are reused once
+  // no version of the page of rid is left, a snapshot may read them until
+  // then. A commit retires them once it is durable, before a crash could
+  // bring back a tuple pointing to them
+  void RetireChains(const Tuple &image, const RID &rid, Transaction *txn);
 
   bool GetTuple(const RID &rid, Tuple &tuple, Transaction *txn);
 
+  // pin the page of rid and lock the tuple as GetTuple does, without copying
+  // it. page is the page pinned for the previous call, it is kept if rid is
+  // on it and unpinned otherwise. Nullptr if the tuple can not be read, the
+  // page stays pinned until passed back or to ReleaseTuplePage. Snapshot
+  // transactions read through GetTuple and TableBatchIterator instead
+  TablePage *PinTuple(const RID &rid, TablePage *page, Transaction *txn);
+  // PinTuple of a rid from outside, e.g. a rowid sqlite was given. Nullptr
+  // without aborting txn if it is no tuple of the heap, the page of another
+  // heap is not read
+  TablePage *PinRowid(const RID &rid, Transaction *txn);
+  // GetTuple of a rid from outside as PinRowid takes it, for snapshots
+  bool GetRowid(const RID &rid, Tuple &tuple, Transaction *txn);
+  void ReleaseTuplePage(TablePage *page);
+
+  // lock the tuple at rid as GetTuple does without reading its page, for
+  // rows read from an index that keeps their columns. False if it can not
+  // be locked, a snapshot locks nothing
+  bool LockTuple(const RID &rid, Transaction *txn);
+
+  // keep the image of the locked tuple at rid before txn takes its index
+  // entries out, ahead of the change to its page. Indexes are not
+  // versioned, a snapshot reading one finds the row by its version instead
+  void PushVersion(const RID &rid, Transaction *txn);
+
   bool DeleteTableHeap();
 
+  // each thread inserts into a page of its own while it has room. The next
+  // insert of the calling thread takes the first page with room instead
+  void ResetInsertTarget();
+
+  // online reorganization. MergePages moves the tuples of sparse pages into
+  // a sparse page before them as txn, moved is told of every move so that
+  // indexes can follow, count is set to the moves. False if txn is aborted,
+  // it should be aborted then. Once txn commits the pages it emptied are
+  // dropped from the chain by UnlinkEmptyPages, which returns how many
+  // empty pages it unlinked. Unlinked pages stay allocated
+  bool MergePages(Transaction *txn, const MoveCallback &moved,
+                  size_t &count);
+  // MoveTuples moves the tuples at rids in their order to pages appended to
+  // the heap, as MergePages moves them, to rewrite it in another order
+  bool MoveTuples(const std::vector<RID> &rids, Transaction *txn,
+                  const MoveCallback &moved, size_t &count);
+  size_t UnlinkEmptyPages(Transaction *txn);
+
+  // every heap page in chain order, read from the free space map without
+  // walking the chain. Pages appended meanwhile may be missing
+  void GetPageIds(std::vector<page_id_t> &page_ids);
+
   TableIterator begin(Transaction *txn);
 
   TableIterator end();
 
   inline page_id_t GetFirstPageId() const { return first_page_id_; }
 
+  // first page of the free space map, persisted through header page
+  inline page_id_t GetFreeSpaceMapPageId() const { return fsm_page_id_; }
+
+  inline const PaxLayout &GetPaxLayout() const { return layout_; }
+
+  // keep zone maps of the numeric ones of columns of schema, every numeric
+  // column if none is given, for scans to skip pages. schema must outlive
+  // the heap
+  void EnableZoneMap(Schema *schema, const std::vector<int> &columns = {});
+  // nullptr unless enabled
+  inline ZoneMap *GetZoneMap() { return zone_map_; }
+
+  // keep long varchars of tuples of schema out of line, in chains of
+  // overflow pages. GetTuple and the iterator read them back, batch scans
+  // and PinTuple leave the bytes in the page, whose values out of line are
+  // read by ReadOutOfLine. schema must outlive the heap
+  void EnableOverflow(Schema *schema);
+  // value of a varchar out of line, of stored length len and payload as it
+  // is after the length
+  bool ReadOutOfLine(const char *payload, uint32_t len, std::string &value);
+  // overflow pages taken from the tablespace. Pages of reclaimed chains go
+  // to new chains of the heap, a logged page is redone after a crash and
+  // must not get another owner
+  inline size_t GetOverflowPageCount() const {
+    return overflow_page_count_.load(std::memory_order_relaxed);
+  }
+
+  // keep up to capacity tuples read by GetTuple in a row cache, for hot rows
+  // looked up again and again. Before the heap is shared, not for a heap
+  // whose pages change behind it, e.g. on a replica. A snapshot takes a
+  // cached tuple of a rid without newer versions
+  void EnableRowCache(size_t capacity);
+  // nullptr unless enabled
+  inline RowCache *GetRowCache() { return row_cache_; }
+
+  // whether txn is a snapshot that may see versions older than page_id, the
+  // zone map may not skip the page for it then
+  bool HasSnapshotVersions(page_id_t page_id, Transaction *txn);
+
+  // versions pushed so far, each before its change to a page or an index. A
+  // snapshot that reads the same count before and after reading the index
+  // saw no row of the heap change in between
+  inline uint64_t GetVersionCount() const {
+    return version_count_.load(std::memory_order_acquire);
+  }
+
 private:
+  /**
+   * free space map helpers
+   */
+  void CreateFreeSpaceMap();
+  void LoadFreeSpaceMap();
+  // a page with room that is not the insertion target of another thread
+  bool FindFreePage(int32_t required, page_id_t &page_id);
+  void UpdateFreeSpace(page_id_t page_id, int32_t free_space);
+  void AppendFreeSpace(page_id_t page_id, int32_t free_space);
+  void RemoveFreeSpace(page_id_t page_id);
+  // insert the first of count tuples into one page, the number inserted.
+  // The free space map entry of an insertion target is left as it is while
+  // the page takes every tuple
+  size_t InsertIntoPage(page_id_t page_id, const Tuple *const *tuples,
+                        size_t count, RID *rids, Transaction *txn,
+                        bool is_target = false);
+  size_t InsertIntoNewPage(const Tuple *const *tuples, size_t count,
+                           RID *rids, Transaction *txn);
+  // link prev_page_id to next_page_id around page_id
+  void Unlink(page_id_t prev_page_id, page_id_t page_id,
+              page_id_t next_page_id, Transaction *txn);
+
+  /**
+   * insertion target helpers
+   */
+  // slot of the calling thread in insert_targets_. The slot is the same in
+  // every heap, the page in it is one of this heap
+  static size_t GetInsertTarget();
+  bool IsOtherTarget(page_id_t page_id, size_t target);
+  // page_id leaves the heap, no thread inserts into it any more
+  void ReleaseInsertTarget(page_id_t page_id);
+  // page_id becomes the target in slot target. The inserts into a target do
+  // not update its free space map entry, the page it replaces gets its entry
+  // brought up to date
+  void SetInsertTarget(size_t target, page_id_t page_id);
+  // targets left by threads that exited since they were set are dropped the
+  // same way, other threads no longer skip them
+  void DropLeftTargets();
+  void RefreshFreeSpace(page_id_t page_id);
+
+  // InsertTuple of a tuple with its values out of line already
+  bool InsertStored(const Tuple *row, RID &rid, Transaction *txn,
+                    page_id_t near_page_id);
+
+  // the tuple of rid as its page holds it, nothing is locked. False if the
+  // slot holds none
+  bool GetPageImage(const RID &rid, Tuple &tuple);
+
+  // GetTuple without reading the values out of line
+  bool GetStoredTuple(const RID &rid, Tuple &tuple, Transaction *txn);
+
+  /**
+   * overflow page helpers
+   */
+  // tuple as a page keeps it: itself, or stored if varchars of it go out of
+  // line for it to be at most max_size. Nullptr if their chains can not be
+  // written
+  const Tuple *MoveOutOfLine(const Tuple &tuple, Tuple &stored,
+                             Transaction *txn, int32_t max_size);
+  // put the values out of line of tuple read by GetStoredTuple back in it
+  bool ReadOutOfLine(Tuple &tuple);
+  // chain of new overflow pages holding size bytes, starting at page_id
+  bool WriteOverflowChain(const char *bytes, uint32_t size,
+                          page_id_t &page_id, Transaction *txn);
+  bool ReadOverflowChain(page_id_t page_id, uint32_t size, char *bytes);
+  // the chains image has and kept, if given, does not, are reused at once.
+  // Nobody has seen them
+  void DropChains(const Tuple &image, const Tuple *kept);
+  // reuse the retired chains no version may read any more
+  void ReclaimChains();
+  // pages of the chain starting at page_id to free_overflow_pages_, under
+  // overflow_latch_
+  void FreeChain(page_id_t page_id);
+
+  // keep the image of rid before txn changes it, nullptr for none, under the
+  // page latch. Rollbacks push nothing
+  void PushVersion(const RID &rid, const Tuple *before, Transaction *txn);
+  inline bool IsVersioned(Transaction *txn) {
+    return txn != nullptr && txn->GetVersionStore() != nullptr &&
+           txn->GetState() != TransactionState::ABORTED;
+  }
+
   /**
    * Members
    */
   BufferPoolManager *buffer_pool_manager_;
   LockManager *lock_manager_;
+  LogManager *log_manager_;
   page_id_t first_page_id_;
+  // of new heap, free space map and overflow pages, in its tablespace
+  PageExtent extent_;
+  // of every page, and the largest tuple a page of it holds
+  PaxLayout layout_;
+  int32_t max_tuple_size_;
+  // free space map, heap pages are appended at last_page_id_
+  page_id_t fsm_page_id_;
+  page_id_t fsm_last_page_id_ = INVALID_PAGE_ID;
+  page_id_t last_page_id_ = INVALID_PAGE_ID;
+  // heap page id -> fsm page id holding its entry
+  std::unordered_map<page_id_t, page_id_t> fsm_directory_;
+  // protect fsm_directory_ and the fsm/heap tail pointers above
+  std::mutex fsm_latch_;
+  // serialize heap page appends
+  std::mutex append_latch_;
+  // page each thread inserts into, by GetInsertTarget. Only set to pages of
+  // this heap, cleared for pages it unlinks and when it is deleted
+  std::atomic<page_id_t> insert_targets_[INSERT_TARGETS];
+  // threads that had left each slot when its target was set
+  std::atomic<uint64_t> target_stamps_[INSERT_TARGETS];
+  ZoneMap *zone_map_ = nullptr;
+  // schema of the tuples if long varchars go out of line
+  Schema *overflow_schema_ = nullptr;
+  // chain retired for rid, with the version store of the txn retiring it
+  struct RetiredChain {
+    page_id_t page_id_;
+    RID rid_;
+    VersionStore *versions_;
+  };
+  // protect the retired chains and the free overflow pages
+  std::mutex overflow_latch_;
+  std::vector<RetiredChain> retired_chains_;
+  std::atomic<size_t> retired_count_{0};
+  std::vector<page_id_t> free_overflow_pages_;
+  std::atomic<size_t> overflow_page_count_{0};
+  RowCache *row_cache_ = nullptr;
+  std::atomic<uint64_t> version_count_{0};
 };
 
 } // namespace cmudb
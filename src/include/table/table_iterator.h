@@ -2,18 +2,46 @@
  * table_iterator.h
  *
  * For seq scan of table heap
+ *
+ * Whenever the iterator moves on to another page it asks buffer pool manager
+ * to read ahead along the NextPageId chain. Read-ahead starts shallow and the
+ * depth doubles with every page the scan goes through, so short scans that
+ * stop after a page or two do not drag the rest of the table into the pool.
+ *
+ * TableBatchIterator goes through the same chain a batch of rows at a time,
+ * the tuples are decoded into a RowBatch straight from the pages. With a
+ * zone map (see zone_map.h) it passes over pages none of whose tuples
+ * satisfy the batch predicates without fetching them.
  */
 
 #pragma once
 
 #include <cassert>
 
+#include <vector>
+
 #include "common/rid.h"
+#include "table/row_batch.h"
 #include "table/tuple.h"
 
 namespace cmudb {
 
+class BufferPoolManager;
 class TableHeap;
+class TablePage;
+
+// read-ahead state of a scan along the page chain
+class ReadAheadWindow {
+public:
+  // called after the scan moved on to cur_page
+  void Advance(BufferPoolManager *buffer_pool_manager, TablePage *cur_page);
+
+private:
+  // pages the next read-ahead request covers, 0 before the first boundary
+  size_t depth_ = 0;
+  // pages already requested beyond the current page
+  size_t left_ = 0;
+};
 
 class TableIterator {
   friend class Cursor;
@@ -43,6 +71,27 @@ private:
   TableHeap *table_heap_;
   Tuple *tuple_;
   Transaction *txn_;
+  ReadAheadWindow read_ahead_;
+};
+
+class TableBatchIterator {
+public:
+  TableBatchIterator(TableHeap *table_heap, Transaction *txn);
+
+  // fill batch with the next rows, of which the ones satisfying its
+  // predicates are selected. Batches with nothing selected are skipped, false
+  // once the end of the table is reached
+  bool Next(RowBatch &batch);
+
+private:
+  TableHeap *table_heap_;
+  Transaction *txn_;
+  // where the next batch starts, page_id_ is invalid at the end
+  page_id_t page_id_;
+  int slot_ = 0;
+  ReadAheadWindow read_ahead_;
+  // a page was left out by the zone map
+  bool skipping_ = false;
 };
 
 } // namespace cmudb
\ No newline at end of file
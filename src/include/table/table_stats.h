@@ -0,0 +1,119 @@
+/**
+ * table_stats.h
+ *
+ * Statistics of a table heap for the planner: the row count, and for every
+ * column the number of distinct values, estimated by a HyperLogLog sketch,
+ * the fraction of nulls and, for numeric columns, an equi-depth histogram.
+ *
+ * Analyze builds them from a sample of pages spread evenly over the heap,
+ * the counts of the sample are scaled up by the pages of the table. Between
+ * two analyzes inserts and deletes move the row count, the distributions
+ * stay as they were sampled. They live in memory only.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "catalog/schema.h"
+#include "concurrency/transaction.h"
+
+namespace cmudb {
+
+// pages Analyze reads at most
+#define TABLE_STATS_SAMPLE_PAGES 64
+// 2^precision registers per sketch, about 1.04 / sqrt(2^precision) error
+#define TABLE_STATS_HLL_PRECISION 10
+// buckets of a histogram
+#define TABLE_STATS_BUCKETS 32
+
+class TableHeap;
+
+class HyperLogLog {
+public:
+  explicit HyperLogLog(uint32_t precision = TABLE_STATS_HLL_PRECISION);
+
+  // add the value of a 64 bit hash
+  void Add(uint64_t hash);
+
+  // distinct hashes added, small counts are counted by the empty registers
+  double Estimate() const;
+
+  // 64 bit hash of size bytes for Add
+  static uint64_t Hash(const char *data, size_t size);
+
+private:
+  uint32_t precision_;
+  std::vector<uint8_t> registers_;
+};
+
+// bounds of buckets holding the same number of values each
+class Histogram {
+public:
+  Histogram() = default;
+
+  // histogram of values, which it sorts
+  Histogram(std::vector<double> &values, size_t buckets);
+
+  inline bool IsEmpty() const { return bounds_.empty(); }
+
+  // estimated fraction of the values between low and high, nullptr for no
+  // bound. Values are spread evenly within a bucket
+  double Selectivity(const double *low, const double *high) const;
+
+private:
+  // estimated fraction of the values at most value
+  double Fraction(double value) const;
+
+  // buckets + 1 bounds, the first and last are the minimum and maximum
+  std::vector<double> bounds_;
+};
+
+struct ColumnStats {
+  // estimated for the whole table, 0 if no value was sampled
+  double distinct_ = 0;
+  double null_fraction_ = 0;
+  // of numeric columns
+  Histogram histogram_;
+};
+
+class TableStats {
+public:
+  explicit TableStats(Schema *schema);
+
+  // rebuild the statistics from up to sample_pages pages of table_heap read
+  // as txn. False if a page can not be read, they are kept as they were
+  bool Analyze(TableHeap *table_heap, Transaction *txn,
+               size_t sample_pages = TABLE_STATS_SAMPLE_PAGES);
+
+  inline bool IsAnalyzed() const { return analyzed_; }
+
+  // rows inserted less rows deleted since the last analyze are included
+  inline double GetRowCount() const {
+    return static_cast<double>(std::max<int64_t>(row_count_, 0));
+  }
+  inline void AddRows(int64_t rows) { row_count_ += rows; }
+
+  // distinct values of column, 0 if unknown
+  double GetDistinct(int column) const;
+
+  // estimated fraction of the rows with column between low and high, either
+  // may be nullptr for no bound. default_selectivity per bound without a
+  // histogram
+  double RangeSelectivity(int column, const double *low, const double *high,
+                          double default_selectivity) const;
+
+private:
+  Schema *schema_;
+  std::atomic<int64_t> row_count_{0};
+  std::atomic<bool> analyzed_{false};
+  // replaced by Analyze while planners read it
+  std::vector<ColumnStats> columns_;
+  mutable std::mutex latch_;
+};
+
+} // namespace cmudb
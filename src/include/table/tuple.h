@@ -5,16 +5,28 @@
  *  ------------------------------------------------------------------
  * | FIXED-SIZE or VARIED-SIZED OFFSET | PAYLOAD OF VARIED-SIZED FIELD|
  *  ------------------------------------------------------------------
+ * The payload of a varchar is its length and bytes, a table heap may keep
+ * the bytes out of line in a chain of overflow pages instead. The length
+ * has VARCHAR_OVERFLOW_BIT set then and the 4 bytes after it are the first
+ * page of the chain.
  */
 
 #pragma once
 
 #include "catalog/schema.h"
+#include "common/arena.h"
 #include "common/rid.h"
 #include "type/value.h"
 
 namespace cmudb {
 
+#define VARCHAR_OVERFLOW_BIT 0x80000000u
+
+// whether a stored varchar length is that of a value out of line
+static inline bool IsOverflowLength(uint32_t len) {
+  return len != PELOTON_VALUE_NULL && (len & VARCHAR_OVERFLOW_BIT) != 0;
+}
+
 class Tuple {
   friend class TablePage;
 
@@ -22,16 +34,40 @@ class Tuple {
 
   friend class TableIterator;
 
+  friend class LogRecord;
+
+  friend class VersionStore;
+
+  friend class RowCache;
+
 public:
+  // default constructor (to create a dummy tuple)
+  Tuple() : allocated_(false), rid_(RID()), size_(0), data_(nullptr) {}
+
   // constructor for table heap tuple
-  Tuple(RID rid) : allocated_(false), rid_(rid) {}
+  Tuple(RID rid) : allocated_(false), rid_(rid), size_(0), data_(nullptr) {}
 
-  // constructor for creating a new tuple based on input value
-  Tuple(std::vector<Value> values, Schema *schema);
+  // constructor for creating a new tuple based on input value. Its data is
+  // taken from arena if one is given, and is valid until the arena is reset
+  Tuple(const std::vector<Value> &values, Schema *schema,
+        Arena *arena = nullptr);
 
-  // copy constructor, deep copy
+  // constructor for a tuple of size bytes, serialized by the caller through
+  // GetData. Taken from arena as above if one is given
+  Tuple(int32_t size, Arena *arena);
+
+  // copy constructor, deep copy. A copy of a tuple in an arena owns its data
   Tuple(const Tuple &other);
 
+  // move constructor, takes the data of other
+  Tuple(Tuple &&other);
+
+  // assign operator, deep copy, reusing the data of this tuple if it fits
+  Tuple &operator=(const Tuple &other);
+
+  // move assign operator
+  Tuple &operator=(Tuple &&other);
+
   ~Tuple() {
     if (allocated_)
       delete[] data_;
@@ -50,23 +86,47 @@ public:
   // checks the schema to see how to return the Value.
   Value GetValue(Schema *schema, const int column_id) const;
 
-  // Is the column value null ?
+  // values of every column appended to values, read by the access plan of
+  // schema
+  void GetValues(Schema *schema, std::vector<Value> &values) const;
+  // values of the columns column_ids appended to values, in that order
+  void GetValues(Schema *schema, const std::vector<int> &column_ids,
+                 std::vector<Value> &values) const;
+
+  // Is the column value null ? Its sentinel is checked in place
   inline bool IsNull(Schema *schema, const int column_id) const {
-    Value value = GetValue(schema, column_id);
-    return value.IsNull();
+    return Value::IsNullAt(GetDataPtr(schema, column_id),
+                           schema->GetType(column_id));
   }
   inline bool IsAllocated() { return allocated_; }
 
+  // key tuple of key_schema from the columns key_attrs of this tuple of
+  // schema, its bytes copied without a Value in between
+  Tuple KeyFromTuple(Schema *schema, Schema *key_schema,
+                     const std::vector<int> &key_attrs,
+                     Arena *arena = nullptr) const;
+
   std::string ToString(Schema *schema) const;
 
+  // serialize tuple data (size + payload), used by log records
+  void SerializeTo(char *storage) const;
+
+  // deserialize tuple data (deep copy)
+  void DeserializeFrom(const char *storage);
+
 private:
   // Get the starting storage address of specific column
   const char *GetDataPtr(Schema *schema, const int column_id) const;
 
+  // size bytes of data_, owned, kept if they are enough
+  void Reserve(int32_t size);
+
   bool allocated_; // is allocated?
   RID rid_;        // if pointing to the table heap, the rid is valid
   int32_t size_;
   char *data_;
+  // bytes allocated for data_ if allocated_, may exceed size_
+  int32_t capacity_ = 0;
 };
 
 } // namespace cmudb
@@ -0,0 +1,83 @@
+/**
+ * zone_map.h
+ *
+ * Zone maps of a table heap: the min and max of chosen numeric columns over
+ * every page, so that a scan skips the pages none of whose tuples can
+ * satisfy its predicates without fetching or latching them. The next page
+ * id is kept next to them for scans that follow the page chain.
+ *
+ * Zones only ever widen. Inserts, updates and rolled back deletes add the
+ * tuple to the zone of its page, deletes leave it as it is; a zone may be
+ * wider than its page but never narrower. They live in memory only, a page
+ * gets its zone from its first scan after the table is opened and is read
+ * in full until then.
+ *
+ * Callers hold the latch of the page for Build and Add, write latched to
+ * Add, so a zone is never built from a page that misses a tuple added to it.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "catalog/schema.h"
+#include "common/rid.h"
+#include "table/row_batch.h"
+
+namespace cmudb {
+
+class TablePage;
+
+class ZoneMap {
+public:
+  // zones of the numeric columns among columns, every one if it is empty
+  ZoneMap(Schema *schema, const std::vector<int> &columns = {});
+
+  // start the zone of page from its tuples if it has none yet
+  void Build(TablePage *page);
+  // widen the zone of the page of rid by its tuple, if the page has one
+  void Add(TablePage *page, const RID &rid);
+  // page_id was linked to next_page_id
+  void SetNextPageId(page_id_t page_id, page_id_t next_page_id);
+
+  // true if no tuple of page_id satisfies every predicate, as RowBatch
+  // evaluates them. next_page_id is then the page after it
+  bool CanSkip(page_id_t page_id, const std::vector<BatchPredicate> &predicates,
+               page_id_t &next_page_id);
+
+  // columns with zones
+  inline const std::vector<int> &GetColumns() const { return columns_; }
+  size_t GetZoneCount();
+
+private:
+  // min and max of the non null values of a column on one page, decimals
+  // kept as double and every other type as int64_t
+  struct ColumnZone {
+    bool empty_ = true;
+    union {
+      int64_t integer_;
+      double decimal_;
+    } min_, max_;
+  };
+  struct Zone {
+    page_id_t next_page_id_;
+    std::vector<ColumnZone> columns_;
+  };
+  // widen zone by the tuple of rid, caller must hold latch_
+  void AddLocked(Zone &zone, TablePage *page, const RID &rid);
+  // true if no value of column zone satisfies predicate
+  bool Excludes(int column, const ColumnZone &zone,
+                const BatchPredicate &predicate);
+
+  Schema *schema_;
+  std::vector<int> columns_;
+  // column -> index into Zone::columns_, -1 without zone
+  std::vector<int> zone_index_;
+  std::unordered_map<page_id_t, Zone> zones_;
+  std::mutex latch_;
+};
+
+} // namespace cmudb
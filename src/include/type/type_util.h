@@ -6,6 +6,7 @@
 #include <cassert>
 #include <cstring>
 
+#include "type/limits.h"
 #include "type/type.h"
 
 namespace cmudb {
@@ -34,6 +35,68 @@ public:
     return ret;
   }
 
+  /**
+   * Three way comparison of two stored values of one fixed size type, as
+   * CompareLessThan and CompareGreaterThan of their Values decide it: a null
+   * is neither less nor greater than anything.
+   */
+  template <typename T>
+  static inline int CompareFixedRaw(const char *left, const char *right,
+                                    T null_value) {
+    T lhs, rhs;
+    memcpy(&lhs, left, sizeof(T));
+    memcpy(&rhs, right, sizeof(T));
+    if (lhs == null_value || rhs == null_value)
+      return 0;
+    return (lhs > rhs) - (lhs < rhs);
+  }
+
+  /**
+   * As CompareFixedRaw for two serialized varchars, a length and the bytes
+   * counting the terminating null byte
+   */
+  static inline int CompareVarlenRaw(const char *left, const char *right) {
+    uint32_t len1, len2;
+    memcpy(&len1, left, sizeof(uint32_t));
+    memcpy(&len2, right, sizeof(uint32_t));
+    if (len1 == PELOTON_VALUE_NULL || len2 == PELOTON_VALUE_NULL)
+      return 0;
+    if (len1 == PELOTON_VARCHAR_MAX_LEN || len2 == PELOTON_VARCHAR_MAX_LEN)
+      return (len1 > len2) - (len1 < len2);
+    int ret = CompareStrings(left + sizeof(uint32_t), len1 - 1,
+                             right + sizeof(uint32_t), len2 - 1);
+    return (ret > 0) - (ret < 0);
+  }
+
+  /**
+   * CompareFixedRaw or CompareVarlenRaw by type, the switch is resolved to
+   * a kernel inlined at the call site. Types that can not be compared
+   * stored compare equal
+   */
+  static inline int CompareRaw(TypeId type, const char *left,
+                               const char *right) {
+    switch (type) {
+    case TypeId::BOOLEAN:
+      return CompareFixedRaw<int8_t>(left, right, PELOTON_BOOLEAN_NULL);
+    case TypeId::TINYINT:
+      return CompareFixedRaw<int8_t>(left, right, PELOTON_INT8_NULL);
+    case TypeId::SMALLINT:
+      return CompareFixedRaw<int16_t>(left, right, PELOTON_INT16_NULL);
+    case TypeId::INTEGER:
+      return CompareFixedRaw<int32_t>(left, right, PELOTON_INT32_NULL);
+    case TypeId::BIGINT:
+      return CompareFixedRaw<int64_t>(left, right, PELOTON_INT64_NULL);
+    case TypeId::DECIMAL:
+      return CompareFixedRaw<double>(left, right, PELOTON_DECIMAL_NULL);
+    case TypeId::TIMESTAMP:
+      return CompareFixedRaw<uint64_t>(left, right, PELOTON_TIMESTAMP_NULL);
+    case TypeId::VARCHAR:
+      return CompareVarlenRaw(left, right);
+    default:
+      return 0;
+    }
+  }
+
 //  /**
 //   * Perform CompareEquals directly on raw pointers.
 //   * We assume that the left and right values are the same type.
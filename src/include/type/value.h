@@ -1,189 +1,241 @@
-/**
- * value.h
- */
-#pragma once
-
-#include <cstring>
-
-#include "type/limits.h"
-#include "type/type.h"
-#include <cstring>
-
-namespace cmudb {
-
-class type;
-
-inline CmpBool GetCmpBool(bool boolean) {
-  return boolean ? CMP_TRUE : CMP_FALSE;
-}
-
-// A value is an abstract class that represents a view over SQL data stored in
-// some materialized state. All values have a type and comparison functions, but
-// subclasses implement other type-specific functionality.
-class Value {
-  // Friend Type classes
-  friend class Type;
-  friend class NumericType;
-  friend class IntegerParentType;
-  friend class TinyintType;
-  friend class SmallintType;
-  friend class IntegerType;
-  friend class BigintType;
-  friend class DecimalType;
-  friend class TimestampType;
-  friend class BooleanType;
-  friend class VarlenType;
-
-public:
-  Value(const TypeId type) : manage_data_(false), type_id_(type) {
-    size_.len = PELOTON_VALUE_NULL;
-  }
-  // BOOLEAN and TINYINT
-  Value(TypeId type, int8_t val);
-  // DECIMAL
-  Value(TypeId type, double d);
-  Value(TypeId type, float f);
-  // SMALLINT
-  Value(TypeId type, int16_t i);
-  // INTEGER
-  Value(TypeId type, int32_t i);
-  // BIGINT
-  Value(TypeId type, int64_t i);
-  // TIMESTAMP
-  Value(TypeId type, uint64_t i);
-  // VARCHAR
-  Value(TypeId type, const char *data, uint32_t len, bool manage_data);
-  Value(TypeId type, const std::string &data);
-
-  Value();
-  Value(const Value &other);
-  Value &operator=(Value other);
-  ~Value();
-  // nothrow
-  friend void swap(Value &first, Value &second) {
-    std::swap(first.value_, second.value_);
-    std::swap(first.size_, second.size_);
-    std::swap(first.manage_data_, second.manage_data_);
-    std::swap(first.type_id_, second.type_id_);
-  }
-  // check whether value is integer
-  bool CheckInteger() const;
-  bool CheckComparable(const Value &o) const;
-
-  // Get the type of this value
-  inline TypeId GetTypeId() const { return type_id_; }
-
-  // Get the length of the variable length data
-  inline uint32_t GetLength() const {
-    return Type::GetInstance(type_id_)->GetLength(*this);
-  }
-  // Access the raw variable length data
-  inline const char *GetData() const {
-    return Type::GetInstance(type_id_)->GetData(*this);
-  }
-
-  template <class T> inline T GetAs() const {
-    return *reinterpret_cast<const T *>(&value_);
-  }
-
-  inline Value CastAs(const TypeId type_id) const {
-    return Type::GetInstance(type_id_)->CastAs(*this, type_id);
-  }
-  // Comparison Methods
-  inline CmpBool CompareEquals(const Value &o) const {
-    return Type::GetInstance(type_id_)->CompareEquals(*this, o);
-  }
-  inline CmpBool CompareNotEquals(const Value &o) const {
-    return Type::GetInstance(type_id_)->CompareNotEquals(*this, o);
-  }
-  inline CmpBool CompareLessThan(const Value &o) const {
-    return Type::GetInstance(type_id_)->CompareLessThan(*this, o);
-  }
-  inline CmpBool CompareLessThanEquals(const Value &o) const {
-    return Type::GetInstance(type_id_)->CompareLessThanEquals(*this, o);
-  }
-  inline CmpBool CompareGreaterThan(const Value &o) const {
-    return Type::GetInstance(type_id_)->CompareGreaterThan(*this, o);
-  }
-  inline CmpBool CompareGreaterThanEquals(const Value &o) const {
-    return Type::GetInstance(type_id_)->CompareGreaterThanEquals(*this, o);
-  }
-
-  // Other mathematical functions
-  inline Value Add(const Value &o) const {
-    return Type::GetInstance(type_id_)->Add(*this, o);
-  }
-  inline Value Subtract(const Value &o) const {
-    return Type::GetInstance(type_id_)->Subtract(*this, o);
-  }
-  inline Value Multiply(const Value &o) const {
-    return Type::GetInstance(type_id_)->Multiply(*this, o);
-  }
-  inline Value Divide(const Value &o) const {
-    return Type::GetInstance(type_id_)->Divide(*this, o);
-  }
-  inline Value Modulo(const Value &o) const {
-    return Type::GetInstance(type_id_)->Modulo(*this, o);
-  }
-  inline Value Min(const Value &o) const {
-    return Type::GetInstance(type_id_)->Min(*this, o);
-  }
-  inline Value Max(const Value &o) const {
-    return Type::GetInstance(type_id_)->Max(*this, o);
-  }
-  inline Value Sqrt() const { return Type::GetInstance(type_id_)->Sqrt(*this); }
-
-  inline Value OperateNull(const Value &o) const {
-    return Type::GetInstance(type_id_)->OperateNull(*this, o);
-  }
-  inline bool IsZero() const {
-    return Type::GetInstance(type_id_)->IsZero(*this);
-  }
-  inline bool IsNull() const { return size_.len == PELOTON_VALUE_NULL; }
-
-  // Serialize this value into the given storage space. The inlined parameter
-  // indicates whether we are allowed to inline this value into the storage
-  // space, or whether we must store only a reference to this value. If inlined
-  // is false, we may use the provided data pool to allocate space for this
-  // value, storing a reference into the allocated pool space in the storage.
-  inline void SerializeTo(char *storage) const {
-    Type::GetInstance(type_id_)->SerializeTo(*this, storage);
-  }
-
-  // Deserialize a value of the given type from the given storage space.
-  inline static Value DeserializeFrom(const char *storage,
-                                      const TypeId type_id) {
-    return Type::GetInstance(type_id)->DeserializeFrom(storage);
-  }
-
-  // Return a string version of this value
-  inline std::string ToString() const {
-    return Type::GetInstance(type_id_)->ToString(*this);
-  }
-  // Create a copy of this value
-  inline Value Copy() const { return Type::GetInstance(type_id_)->Copy(*this); }
-
-protected:
-  // The actual value item
-  union Val {
-    int8_t boolean;
-    int8_t tinyint;
-    int16_t smallint;
-    int32_t integer;
-    int64_t bigint;
-    double decimal;
-    uint64_t timestamp;
-    char *varlen;
-    const char *const_varlen;
-  } value_;
-
-  union {
-    uint32_t len;
-    TypeId elem_type_id;
-  } size_;
-
-  bool manage_data_;
-  // The data type
-  TypeId type_id_;
-};
-} // namespace cmudb
+/**
+ * value.h
+ */
+#pragma once
+
+#include <cstring>
+
+#include "type/limits.h"
+#include "type/type.h"
+#include <cstring>
+
+namespace cmudb {
+
+// owned varchars of up to this many bytes, the terminator included, are kept
+// inside the Value instead of on the heap
+#define VALUE_INLINE_SIZE 16
+
+class type;
+
+inline CmpBool GetCmpBool(bool boolean) {
+  return boolean ? CMP_TRUE : CMP_FALSE;
+}
+
+// A value is an abstract class that represents a view over SQL data stored in
+// some materialized state. All values have a type and comparison functions, but
+// subclasses implement other type-specific functionality.
+class Value {
+  // Friend Type classes
+  friend class Type;
+  friend class NumericType;
+  friend class IntegerParentType;
+  friend class TinyintType;
+  friend class SmallintType;
+  friend class IntegerType;
+  friend class BigintType;
+  friend class DecimalType;
+  friend class TimestampType;
+  friend class BooleanType;
+  friend class VarlenType;
+
+public:
+  Value(const TypeId type)
+      : manage_data_(false), inlined_(false), type_id_(type) {
+    size_.len = PELOTON_VALUE_NULL;
+  }
+  // BOOLEAN and TINYINT
+  Value(TypeId type, int8_t val);
+  // DECIMAL
+  Value(TypeId type, double d);
+  Value(TypeId type, float f);
+  // SMALLINT
+  Value(TypeId type, int16_t i);
+  // INTEGER
+  Value(TypeId type, int32_t i);
+  // BIGINT
+  Value(TypeId type, int64_t i);
+  // TIMESTAMP
+  Value(TypeId type, uint64_t i);
+  // VARCHAR, a copy of data if manage_data, else a view that borrows it
+  Value(TypeId type, const char *data, uint32_t len, bool manage_data);
+  Value(TypeId type, const std::string &data);
+
+  Value();
+  Value(const Value &other);
+  // takes the data of other, which is left a null of its type
+  Value(Value &&other) noexcept;
+  Value &operator=(const Value &other);
+  Value &operator=(Value &&other) noexcept;
+  ~Value();
+  // nothrow
+  friend void swap(Value &first, Value &second) {
+    std::swap(first.value_, second.value_);
+    std::swap(first.size_, second.size_);
+    std::swap(first.manage_data_, second.manage_data_);
+    std::swap(first.inlined_, second.inlined_);
+    std::swap(first.type_id_, second.type_id_);
+  }
+  // check whether value is integer
+  bool CheckInteger() const;
+  bool CheckComparable(const Value &o) const;
+
+  // Get the type of this value
+  inline TypeId GetTypeId() const { return type_id_; }
+
+  // Get the length of the variable length data
+  inline uint32_t GetLength() const {
+    return Type::GetInstance(type_id_)->GetLength(*this);
+  }
+  // Access the raw variable length data
+  inline const char *GetData() const {
+    return Type::GetInstance(type_id_)->GetData(*this);
+  }
+
+  template <class T> inline T GetAs() const {
+    return *reinterpret_cast<const T *>(&value_);
+  }
+
+  inline Value CastAs(const TypeId type_id) const {
+    return Type::GetInstance(type_id_)->CastAs(*this, type_id);
+  }
+  // Comparison Methods
+  inline CmpBool CompareEquals(const Value &o) const {
+    return Type::GetInstance(type_id_)->CompareEquals(*this, o);
+  }
+  inline CmpBool CompareNotEquals(const Value &o) const {
+    return Type::GetInstance(type_id_)->CompareNotEquals(*this, o);
+  }
+  inline CmpBool CompareLessThan(const Value &o) const {
+    return Type::GetInstance(type_id_)->CompareLessThan(*this, o);
+  }
+  inline CmpBool CompareLessThanEquals(const Value &o) const {
+    return Type::GetInstance(type_id_)->CompareLessThanEquals(*this, o);
+  }
+  inline CmpBool CompareGreaterThan(const Value &o) const {
+    return Type::GetInstance(type_id_)->CompareGreaterThan(*this, o);
+  }
+  inline CmpBool CompareGreaterThanEquals(const Value &o) const {
+    return Type::GetInstance(type_id_)->CompareGreaterThanEquals(*this, o);
+  }
+
+  // Other mathematical functions
+  inline Value Add(const Value &o) const {
+    return Type::GetInstance(type_id_)->Add(*this, o);
+  }
+  inline Value Subtract(const Value &o) const {
+    return Type::GetInstance(type_id_)->Subtract(*this, o);
+  }
+  inline Value Multiply(const Value &o) const {
+    return Type::GetInstance(type_id_)->Multiply(*this, o);
+  }
+  inline Value Divide(const Value &o) const {
+    return Type::GetInstance(type_id_)->Divide(*this, o);
+  }
+  inline Value Modulo(const Value &o) const {
+    return Type::GetInstance(type_id_)->Modulo(*this, o);
+  }
+  inline Value Min(const Value &o) const {
+    return Type::GetInstance(type_id_)->Min(*this, o);
+  }
+  inline Value Max(const Value &o) const {
+    return Type::GetInstance(type_id_)->Max(*this, o);
+  }
+  inline Value Sqrt() const { return Type::GetInstance(type_id_)->Sqrt(*this); }
+
+  inline Value OperateNull(const Value &o) const {
+    return Type::GetInstance(type_id_)->OperateNull(*this, o);
+  }
+  inline bool IsZero() const {
+    return Type::GetInstance(type_id_)->IsZero(*this);
+  }
+  inline bool IsNull() const { return size_.len == PELOTON_VALUE_NULL; }
+
+  // Serialize this value into the given storage space. The inlined parameter
+  // indicates whether we are allowed to inline this value into the storage
+  // space, or whether we must store only a reference to this value. If inlined
+  // is false, we may use the provided data pool to allocate space for this
+  // value, storing a reference into the allocated pool space in the storage.
+  inline void SerializeTo(char *storage) const {
+    Type::GetInstance(type_id_)->SerializeTo(*this, storage);
+  }
+
+  // Deserialize a value of the given type from the given storage space.
+  inline static Value DeserializeFrom(const char *storage,
+                                      const TypeId type_id) {
+    return Type::GetInstance(type_id)->DeserializeFrom(storage);
+  }
+
+  // Whether the value of the given type stored at storage is null, by its
+  // sentinel or null length, without deserializing it
+  inline static bool IsNullAt(const char *storage, const TypeId type_id) {
+    switch (type_id) {
+    case TypeId::BOOLEAN:
+    case TypeId::TINYINT:
+      return *reinterpret_cast<const int8_t *>(storage) == PELOTON_INT8_NULL;
+    case TypeId::SMALLINT:
+      return *reinterpret_cast<const int16_t *>(storage) == PELOTON_INT16_NULL;
+    case TypeId::INTEGER:
+      return *reinterpret_cast<const int32_t *>(storage) == PELOTON_INT32_NULL;
+    case TypeId::BIGINT:
+      return *reinterpret_cast<const int64_t *>(storage) == PELOTON_INT64_NULL;
+    case TypeId::DECIMAL:
+      return *reinterpret_cast<const double *>(storage) == PELOTON_DECIMAL_NULL;
+    case TypeId::TIMESTAMP:
+      return *reinterpret_cast<const uint64_t *>(storage) ==
+             PELOTON_TIMESTAMP_NULL;
+    case TypeId::VARCHAR:
+      return *reinterpret_cast<const uint32_t *>(storage) == PELOTON_VALUE_NULL;
+    default:
+      return true;
+    }
+  }
+
+  // As DeserializeFrom, but a varchar borrows its bytes from storage, which
+  // must outlive the value. For comparisons on stored data
+  inline static Value ViewFrom(const char *storage, const TypeId type_id) {
+    if (type_id != TypeId::VARCHAR)
+      return DeserializeFrom(storage, type_id);
+    uint32_t len = *reinterpret_cast<const uint32_t *>(storage);
+    return Value(type_id, len == PELOTON_VALUE_NULL ? nullptr : storage + 4,
+                 len, false);
+  }
+
+  // Return a string version of this value
+  inline std::string ToString() const {
+    return Type::GetInstance(type_id_)->ToString(*this);
+  }
+  // Create a copy of this value
+  inline Value Copy() const { return Type::GetInstance(type_id_)->Copy(*this); }
+
+protected:
+  // owned copy of the len bytes of a varchar at data
+  void SetVarlen(const char *data, uint32_t len);
+
+  // The actual value item
+  union Val {
+    int8_t boolean;
+    int8_t tinyint;
+    int16_t smallint;
+    int32_t integer;
+    int64_t bigint;
+    double decimal;
+    uint64_t timestamp;
+    char *varlen;
+    const char *const_varlen;
+    // an owned varchar of up to VALUE_INLINE_SIZE bytes if inlined_
+    char inlined[VALUE_INLINE_SIZE];
+  } value_;
+
+  union {
+    uint32_t len;
+    TypeId elem_type_id;
+  } size_;
+
+  // owns value_.varlen, to be deleted
+  bool manage_data_;
+  // the varchar is in value_.inlined
+  bool inlined_;
+  // The data type
+  TypeId type_id_;
+};
+} // namespace cmudb
@@ -4,29 +4,168 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include "buffer/lru_replacer.h"
+#include "catalog/catalog.h"
 #include "catalog/schema.h"
 #include "concurrency/transaction_manager.h"
+#include "execution/external_sort.h"
+#include "execution/hash_aggregate.h"
+#include "index/art_index.h"
 #include "index/b_plus_tree_index.h"
+#include "index/hash_index.h"
+#include "logging/checkpoint_manager.h"
+#include "logging/log_replication.h"
 #include "sqlite/sqlite3ext.h"
+#include "table/lsm_tree.h"
+#include "table/parallel_scan.h"
 #include "table/table_heap.h"
+#include "table/table_stats.h"
 #include "table/tuple.h"
 #include "type/value.h"
 
 namespace cmudb {
+// idxNum of VtabBestIndex, the scan VtabFilter starts in the low bits and
+// the number of the index it scans above VTAB_INDEX_SHIFT
+#define VTAB_POINT_SCAN 1
+#define VTAB_LOW_BOUND 2
+#define VTAB_HIGH_BOUND 4
+#define VTAB_LOW_INCLUSIVE 8
+#define VTAB_HIGH_INCLUSIVE 16
+// the columns sqlite reads are all in the leaves of the index
+#define VTAB_COVERING 32
+// the rids of the index are read first and their rows fetched page by page
+#define VTAB_BY_PAGE 64
+// the rows go to sqlite in key order, which its ORDER BY takes. Without
+// bounds the whole index is scanned
+#define VTAB_KEY_ORDER 128
+#define VTAB_INDEX_SHIFT 8
+// above the index number, the rows of the scan are sorted for the ORDER BY
+// before the first one goes to sqlite. The order follows a '|' in idxStr
+#define VTAB_SORTED (1 << 30)
+// with VTAB_KEY_ORDER, the ORDER BY is descending and the index is scanned
+// from the high end of the range down
+#define VTAB_KEY_ORDER_DESC (1 << 29)
+// no index is read, the row of the rowid argument is fetched from its page
+#define VTAB_ROWID_SCAN (1 << 28)
+
+// indexes of a table at most, an update tracks them as the bits of a mask
+#define VTAB_MAX_INDEXES 64
+#define VTAB_ALL_INDEXES (~0ULL)
+
+// frames of the buffer pool, the vtable_pool_size parameter of the database
+// uri overrides it
+#define VTAB_POOL_SIZE 1024
+// enough frames for the pages one operation pins at a time
+#define VTAB_MIN_POOL_SIZE 16
+
+// threads of a sequential scan, the vtable_scan_threads parameter of the
+// database uri overrides it
+#define VTAB_SCAN_THREADS 1
+
+// bytes of the compressed page cache, none unless the vtable_page_cache
+// parameter of the database uri sets it
+#define VTAB_PAGE_CACHE 0
+
+// milliseconds NewPage and FetchPage wait for a frame when every frame is
+// pinned, instead of failing at once (see AdmissionConfig). Off unless the
+// vtable_pin_wait_ms parameter of the database uri sets it
+#define VTAB_PIN_WAIT_MS 0
+
+// tuples the row cache of each table holds (see row_cache.h), none unless
+// the vtable_row_cache parameter of the database uri sets it. Not on a
+// replica, whose pages change under the log it applies
+#define VTAB_ROW_CACHE 0
+
+// bytes the process should stay within (see memory_tracker.h), no budget
+// unless the vtable_memory_budget parameter of the database uri sets it. The
+// buffer pool gives frames back to keep the process within it
+#define VTAB_MEMORY_BUDGET 0
+
+// database file of the tables, the vtable_file parameter of the database
+// uri overrides it. Connections naming the same file share one engine
+#define VTAB_FILE "vtable.db"
+
+// port the engine ships its log to replicas on, none unless the
+// vtable_ship_port parameter of the database uri sets it. The
+// vtable_replica_of parameter, host:port of such a primary, opens the
+// engine as a read-only replica of it instead (see log_replication.h)
+#define VTAB_SHIP_PORT 0
+
+// rows an insert buffer holds before they are written
+#define VTAB_INSERT_BUFFER_ROWS 1024
+
+// closed cursors a table keeps for the next statements
+#define VTAB_CURSOR_POOL_SIZE 4
+
+// fraction of the rows one range bound keeps, unless a histogram tells
+#define VTAB_RANGE_SELECTIVITY 0.25
+// rows of one key of a non-unique index before its columns are analyzed
+#define VTAB_KEY_ROWS 10.0
+// cost of a row an index scan fetches at random, relative to a row a
+// sequential scan reads in page order
+#define VTAB_INDEX_ROW_COST 2.0
+// cost of a row a covering index scan reads from the leaves
+#define VTAB_COVERING_ROW_COST 1.0
+// cost of a row a clustered index scan fetches, next to the one before
+#define VTAB_CLUSTERED_ROW_COST 1.0
+// cost of a key looked up in an in-memory art index, which reads no page
+#define VTAB_ART_LOOKUP_COST 0.25
+// rows an index scan is expected to return before they are fetched in page
+// order rather than key order
+#define VTAB_BY_PAGE_ROWS 16
+
 /* Helpers */
 Schema *ParseCreateStatement(const std::string &sql);
 
+// schema of the column definitions sql, parsed once and shared by every
+// table declared the same way while one of them is open. Never modified
+std::shared_ptr<Schema> GetSharedSchema(const std::string &sql);
+
+// name_suffix follows the index name, see partitions of VirtualTable
 IndexMetadata *ParseIndexStatement(std::string &sql,
                                    const std::string &table_name,
-                                   Schema *schema);
+                                   Schema *schema,
+                                   const std::string &name_suffix = "");
 
-Tuple ConstructTuple(Schema *schema, sqlite3_value **argv);
+// tuple of the sqlite values argv, in arena if one is given
+Tuple ConstructTuple(Schema *schema, sqlite3_value **argv,
+                     Arena *arena = nullptr);
 
+bool ConstructBound(Schema *key_schema, sqlite3_value *arg, Tuple &key,
+                    bool &inclusive, Arena *arena = nullptr);
+
+// the bloom filter of a b+ tree index that has one is read from the pages
+// at bloom_page_id
 Index *ConstructIndex(IndexMetadata *metadata,
                       BufferPoolManager *buffer_pool_manager,
-                      page_id_t root_id = INVALID_PAGE_ID);
-Transaction *GetTransaction();
+                      page_id_t root_id = INVALID_PAGE_ID,
+                      page_id_t bloom_page_id = INVALID_PAGE_ID,
+                      int tablespace_id = 0);
+
+// header page records derived from a table or an index are named with a
+// leading '@', which the names of tables and indexes can not have
+bool IsReservedName(const std::string &name);
+
+// header page record name of a table's free space map
+std::string GetFreeSpaceMapName(const std::string &table_name);
+
+// header page record name of the bloom filter of an index
+std::string GetBloomFilterName(const std::string &index_name);
+
+// header page record name of the mark of a table closed cleanly, the pages
+// of its indexes and free space map were written with their roots when it
+// was last closed
+std::string GetCleanCloseName(const std::string &table_name);
 
 /* API declaration */
 int VtabCreate(sqlite3 *db, void *pAux, int argc, const char *const *argv,
@@ -54,76 +193,426 @@ int VtabColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i);
 
 int VtabRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid);
 
+int VtabSync(sqlite3_vtab *pVTab);
+
 int VtabCommit(sqlite3_vtab *pVTab);
 
 int VtabBegin(sqlite3_vtab *pVTab);
 
-// global parameters
-struct GlobalParameters {
+int VtabRollback(sqlite3_vtab *pVTab);
+
+int VtabSavepoint(sqlite3_vtab *pVTab, int iSavepoint);
+
+int VtabRelease(sqlite3_vtab *pVTab, int iSavepoint);
+
+int VtabRollbackTo(sqlite3_vtab *pVTab, int iSavepoint);
+
+void VtabPoolSize(sqlite3_context *context, int argc, sqlite3_value **argv);
+
+void VtabAnalyze(sqlite3_context *context, int argc, sqlite3_value **argv);
+
+void VtabCluster(sqlite3_context *context, int argc, sqlite3_value **argv);
+
+void VtabMin(sqlite3_context *context, int argc, sqlite3_value **argv);
+
+void VtabMax(sqlite3_context *context, int argc, sqlite3_value **argv);
+
+void VtabCount(sqlite3_context *context, int argc, sqlite3_value **argv);
+
+void VtabAggregate(sqlite3_context *context, int argc, sqlite3_value **argv);
+
+void VtabLatchProfile(sqlite3_context *context, int argc,
+                      sqlite3_value **argv);
+
+void VtabHotPages(sqlite3_context *context, int argc, sqlite3_value **argv);
+
+void VtabPageTrace(sqlite3_context *context, int argc, sqlite3_value **argv);
+
+void VtabMemoryBudget(sqlite3_context *context, int argc,
+                      sqlite3_value **argv);
+
+/* vtable_stats, eponymous table of (name, value) counters of the engine */
+int StatsConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+                 sqlite3_vtab **ppVtab, char **pzErr);
+
+int StatsBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo);
+
+int StatsDisconnect(sqlite3_vtab *pVtab);
+
+int StatsOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor);
+
+int StatsClose(sqlite3_vtab_cursor *cur);
+
+int StatsFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                const char *idxStr, int argc, sqlite3_value **argv);
+
+int StatsNext(sqlite3_vtab_cursor *cur);
+
+int StatsEof(sqlite3_vtab_cursor *cur);
+
+int StatsColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i);
+
+int StatsRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid);
+
+/*
+ * vtable_hash_join and vtable_hash_group, eponymous table-valued functions
+ * of the operators in execution/. SELECT * FROM
+ * vtable_hash_join('foo', 'a', 'bar', 'b') is the key and the rowids of
+ * every pair of rows of open tables foo and bar with foo.a = bar.b, and
+ * SELECT * FROM vtable_hash_group('foo', 'a', 'b') the count of rows and
+ * the sum, min and max of b of each value of a in open table foo
+ */
+int HashJoinConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+                    sqlite3_vtab **ppVtab, char **pzErr);
+
+int HashGroupConnect(sqlite3 *db, void *pAux, int argc,
+                     const char *const *argv, sqlite3_vtab **ppVtab,
+                     char **pzErr);
+
+int ExecutionBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo);
+
+int ExecutionDisconnect(sqlite3_vtab *pVtab);
+
+int ExecutionOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor);
+
+int ExecutionClose(sqlite3_vtab_cursor *cur);
+
+int HashJoinFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                   const char *idxStr, int argc, sqlite3_value **argv);
+
+int HashGroupFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                    const char *idxStr, int argc, sqlite3_value **argv);
+
+int ExecutionNext(sqlite3_vtab_cursor *cur);
+
+int ExecutionEof(sqlite3_vtab_cursor *cur);
+
+int HashJoinColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i);
+
+int HashGroupColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i);
+
+int ExecutionRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid);
+
+/*
+ * vtable_lsm, tables kept in an LsmTree by rowid for loads that are mostly
+ * inserts, e.g. CREATE VIRTUAL TABLE foo USING vtable_lsm('a INT, b varchar').
+ * They have no indexes, the rowid is the only key scans are bounded by
+ */
+int LsmCreate(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+              sqlite3_vtab **ppVtab, char **pzErr);
+
+int LsmConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+               sqlite3_vtab **ppVtab, char **pzErr);
+
+int LsmBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo);
+
+int LsmDisconnect(sqlite3_vtab *pVtab);
+
+int LsmOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor);
+
+int LsmClose(sqlite3_vtab_cursor *cur);
+
+int LsmFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum, const char *idxStr,
+              int argc, sqlite3_value **argv);
+
+int LsmNext(sqlite3_vtab_cursor *cur);
+
+int LsmEof(sqlite3_vtab_cursor *cur);
+
+int LsmColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i);
+
+int LsmRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid);
+
+int LsmUpdate(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
+              sqlite_int64 *pRowid);
+
+int LsmBegin(sqlite3_vtab *pVTab);
+
+int LsmCommit(sqlite3_vtab *pVTab);
+
+int LsmRollback(sqlite3_vtab *pVTab);
+
+class VirtualTable;
+class Cursor;
+
+/*
+ * How the rows of a partitioned table are spread, by the value of its
+ * integer column column_: its hash modulo count_, or with bounds_ the range
+ * it is in, partition i holding the values below bounds_[i] and at or above
+ * the bound before. Nulls go to partition 0
+ */
+struct PartitionScheme {
+  int column_ = -1;
+  size_t count_ = 1;
+  std::vector<int64_t> bounds_;
+
+  inline bool IsPartitioned() const { return column_ >= 0; }
+  size_t GetPartition(int64_t value) const;
+};
+
+// heap and indexes of a table, shared by the VirtualTables of every
+// connection to its engine
+struct TableData {
+  // of the heap in the catalog, that of the partition. Empty for a table
+  // the catalog does not have
+  std::string name_;
+  // of shared_schema_
+  Schema *schema_;
+  std::shared_ptr<Schema> shared_schema_;
+  TableHeap *table_heap_;
+  std::vector<Index *> indexes_;
+  // the first clustered index, nullptr if the rows are in no order
+  Index *cluster_index_;
+  TableStats *stats_;
+  // of a partitioned table this is partition 0, partitions_ are the heaps
+  // and indexes of the others. Partition i is in tablespace tablespaces_[i]
+  // of its own, the rid of a row tells its partition
+  PartitionScheme partition_scheme_;
+  std::vector<TableData *> partitions_;
+  std::vector<int> tablespaces_;
+  // indexes OpenTableData began to build over the rows already in the heap,
+  // left to the connection that opened the table, see BuildIndexesOnline
+  std::vector<Index *> building_;
+  // VirtualTables using it, the last one to disconnect deletes it
+  size_t refs_;
+};
+
+// tree of a vtable_lsm table, shared as TableData is
+struct LsmTableData {
+  // of shared_schema_
+  Schema *schema_;
+  std::shared_ptr<Schema> shared_schema_;
+  LsmTree *tree_;
+  size_t refs_;
+};
+
+// the storage of one database file, shared by the connections naming it
+struct Engine {
+  std::string file_name_;
   BufferPoolManager *buffer_pool_manager_;
   LockManager *lock_manager_;
+  LogManager *log_manager_;
   TransactionManager *transaction_manager_;
-  // global transaction, sqlite does not support concurrent transaction
-  Transaction *transaction_;
+  CheckpointManager *checkpoint_manager_;
+  // ships the log to replicas, nullptr unless asked for
+  LogShipper *log_shipper_ = nullptr;
+  // applies the log of the primary, nullptr unless a replica. A replica
+  // takes no writes and has neither log manager thread nor checkpoints, its
+  // scans hold the latch of the replica while a cursor is open
+  LogReplica *log_replica_ = nullptr;
+  // root page ids of the tables and indexes by name
+  Catalog *catalog_;
+  size_t scan_threads_;
+  // tuples of the row cache of each table heap, 0 for none
+  size_t row_cache_ = 0;
+  // connections using the engine, the last one to close shuts it down
+  size_t connections_;
+  // open tables by name, under tables_latch_
+  std::unordered_map<std::string, TableData *> tables_;
+  std::unordered_map<std::string, LsmTableData *> lsm_tables_;
+  std::mutex tables_latch_;
 };
 
-GlobalParameters *global_parameters;
+// engine of file_name, started by the first connection with the
+// parameters given, nullptr with pzErrMsg set if it can not be. A replica
+// of primary ("host:port") unless it is empty, else the log is shipped on
+// ship_port unless it is 0. Frames are waited for pin_wait_ms unless it is 0,
+// index lookups follow swizzled references if swizzle is set. Table heaps
+// cache row_cache tuples each unless it is 0
+Engine *OpenEngine(const std::string &file_name, size_t pool_size,
+                   size_t scan_threads, size_t page_cache,
+                   size_t pin_wait_ms, const std::string &primary,
+                   int ship_port, char **pzErrMsg, bool swizzle = false,
+                   size_t row_cache = 0);
+void CloseEngine(Engine *engine);
+
+// the open table name of engine, built by build unless a connection has
+// it open already. build runs under the latch of the open tables
+TableData *OpenTable(Engine *engine, const std::string &name,
+                     const std::function<TableData *()> &build);
+void CloseTable(Engine *engine, const std::string &name, TableData *table);
+
+// state of one sqlite connection, the pAux of its modules. sqlite uses a
+// connection from one thread at a time
+struct Connection {
+  Engine *engine_;
+  // transaction of the connection, sqlite has one at a time
+  Transaction *transaction_ = nullptr;
+  // the transaction is a snapshot begun by a cursor of a read, it commits
+  // with the last cursor closing
+  bool read_transaction_ = false;
+  // snapshots whose cursors were still open when sqlite began a write,
+  // they commit with the last cursor closing
+  std::vector<Transaction *> snapshots_;
+  size_t open_cursors_ = 0;
+  // where the transaction was at each sqlite savepoint level
+  std::vector<Savepoint> savepoints_;
+  // tables with rows of the transaction in their insert buffers
+  std::vector<VirtualTable *> buffered_tables_;
+};
 
 class VirtualTable {
   friend class Cursor;
 
 public:
-  VirtualTable(Schema *schema, BufferPoolManager *buffer_pool_manager,
-               LockManager *lock_manager, Index *index,
-               page_id_t first_page_id = INVALID_PAGE_ID)
-      : schema_(schema), index_(index) {
-    table_heap_ =
-        new TableHeap(buffer_pool_manager, lock_manager, first_page_id);
+  VirtualTable(Connection *connection, const std::string &name,
+               TableData *data, bool is_partition = false)
+      : schema_(data->schema_), table_heap_(data->table_heap_),
+        indexes_(data->indexes_), cluster_index_(data->cluster_index_),
+        stats_(data->stats_),
+        connection_(connection), name_(name), data_(data),
+        is_partition_(is_partition) {
+    for (auto partition : data->partitions_)
+      partitions_.emplace_back(
+          new VirtualTable(connection, name, partition, true));
   }
 
-  ~VirtualTable() {
-    delete schema_;
-    delete table_heap_;
-    delete index_;
-  }
+  // the partitions are closed with the table
+  ~VirtualTable();
+
+  // a cursor of a closed statement if one is kept, a new one otherwise.
+  // Its scan starts in VtabFilter, as the plan chose it
+  Cursor *OpenCursor();
+  // the scan of cursor ends, the cursor is kept for the next statement
+  // unless the pool is full. Its batches and arena keep their memory
+  void CloseCursor(Cursor *cursor);
+
+  // the transaction of the connection the table was opened by
+  inline Transaction *GetTransaction() { return connection_->transaction_; }
 
-  // insert into table heap
+  inline Connection *GetConnection() { return connection_; }
+
+  // insert into table heap, next to the row after it in the clustered index
+  // if there is room
   inline bool InsertTuple(const Tuple &tuple, RID &rid) {
-    return table_heap_->InsertTuple(tuple, rid, GetTransaction());
+    if (!table_heap_->InsertTuple(tuple, rid, GetTransaction(),
+                                  GetClusterPage(tuple)))
+      return false;
+    stats_->AddRows(1);
+    return true;
   }
 
-  // insert into index
-  inline void InsertEntry(const Tuple &tuple, const RID &rid) {
-    if (index_ == nullptr)
-      return;
-    // construct indexed key tuple
-    std::vector<Value> key_values;
+  // insert into the indexes of mask, a rollback takes the entries out
+  // again
+  inline void InsertEntry(const Tuple &tuple, const RID &rid,
+                          uint64_t mask = VTAB_ALL_INDEXES) {
+    for (size_t i = 0; i < indexes_.size(); i++) {
+      if ((mask & (1ULL << i)) == 0)
+        continue;
+      Tuple key = GetKey(tuple, indexes_[i], nullptr);
+      indexes_[i]->InsertEntry(key, rid, GetTransaction());
+      GetTransaction()->GetIndexWriteSet()->emplace_back(rid, WType::INSERT,
+                                                         key, indexes_[i]);
+      GetTransaction()->ChargeMemory(sizeof(IndexWriteRecord) +
+                                     key.GetLength());
+    }
+  }
+
+  // keep a row inserted by the global transaction to write it with the
+  // rows inserted after it, a copy of the tuple is kept. The buffer is
+  // written once it is full, before the table is read or changed
+  // otherwise, and when the transaction commits
+  inline void BufferInsert(const Tuple &tuple) {
+    if (insert_buffer_.empty())
+      connection_->buffered_tables_.push_back(this);
+    insert_buffer_.push_back(tuple);
+    if (insert_buffer_.size() >= VTAB_INSERT_BUFFER_ROWS)
+      FlushInserts();
+  }
+
+  // write the buffered rows, heap pages are filled with as many as they
+  // take in turn and index entries inserted in key order. False if a row
+  // can not be inserted, the transaction is aborted then. The rows of every
+  // partition are written
+  inline bool FlushInserts() {
+    for (auto &partition : partitions_)
+      if (!partition->FlushInserts())
+        return false;
+    if (insert_buffer_.empty())
+      return true;
+    auto &tables = connection_->buffered_tables_;
+    tables.erase(std::remove(tables.begin(), tables.end(), this),
+                 tables.end());
+    if (cluster_index_ != nullptr)
+      SortByCluster(insert_buffer_);
+    std::vector<RID> rids;
+    bool is_inserted =
+        table_heap_->InsertTuples(insert_buffer_, rids, GetTransaction());
+    if (is_inserted)
+      stats_->AddRows(rids.size());
+    std::vector<std::pair<Tuple, RID>> entries;
+    for (auto index : indexes_) {
+      if (!is_inserted)
+        break;
+      entries.clear();
+      entries.reserve(rids.size());
+      for (size_t i = 0; i < rids.size(); i++)
+        entries.emplace_back(GetKey(insert_buffer_[i], index, nullptr),
+                             rids[i]);
+      index->InsertEntries(entries, GetTransaction());
+      auto index_write_set = GetTransaction()->GetIndexWriteSet();
+      for (auto &entry : entries)
+        index_write_set->emplace_back(entry.second, WType::INSERT,
+                                      entry.first, index);
+    }
+    insert_buffer_.clear();
+    return is_inserted;
+  }
 
-    for (auto &i : index_->GetKeyAttrs())
-      key_values.push_back(tuple.GetValue(schema_, i));
-    Tuple key(key_values, index_->GetKeySchema());
-    index_->InsertEntry(key, rid, GetTransaction());
+  // drop the buffered rows of a transaction rolling back
+  inline void DiscardInserts() {
+    auto &tables = connection_->buffered_tables_;
+    tables.erase(std::remove(tables.begin(), tables.end(), this),
+                 tables.end());
+    insert_buffer_.clear();
   }
 
   // delete from table heap
   // TODO: call makrdelete method from heaptable
   inline bool DeleteTuple(const RID &rid) {
-    return table_heap_->MarkDelete(rid, GetTransaction());
+    if (!table_heap_->MarkDelete(rid, GetTransaction()))
+      return false;
+    stats_->AddRows(-1);
+    return true;
   }
 
-  // delete from index
-  inline void DeleteEntry(const RID &rid) {
-    if (index_ == nullptr)
+  // delete the row at rid from the indexes of mask, a rollback puts the
+  // entries back
+  inline void DeleteEntry(const RID &rid, uint64_t mask = VTAB_ALL_INDEXES) {
+    if (indexes_.empty() || mask == 0)
+      return;
+    if (!table_heap_->GetTuple(rid, deleted_tuple_, GetTransaction()))
       return;
-    Tuple deleted_tuple(rid);
-    table_heap_->GetTuple(rid, deleted_tuple, GetTransaction());
-    // construct indexed key tuple
-    std::vector<Value> key_values;
+    table_heap_->PushVersion(rid, GetTransaction());
+    for (size_t i = 0; i < indexes_.size(); i++) {
+      if ((mask & (1ULL << i)) == 0)
+        continue;
+      Tuple key = GetKey(deleted_tuple_, indexes_[i], nullptr);
+      indexes_[i]->DeleteEntry(key, rid, GetTransaction());
+      GetTransaction()->GetIndexWriteSet()->emplace_back(rid, WType::DELETE,
+                                                         key, indexes_[i]);
+      GetTransaction()->ChargeMemory(sizeof(IndexWriteRecord) +
+                                     key.GetLength());
+    }
+  }
 
-    for (auto &i : index_->GetKeyAttrs())
-      key_values.push_back(deleted_tuple.GetValue(schema_, i));
-    Tuple key(key_values, index_->GetKeySchema());
-    index_->DeleteEntry(key, GetTransaction());
+  // mask of the indexes tuple has another key in than the row at rid, all
+  // of them if the row can not be read
+  inline uint64_t GetChangedIndexes(const Tuple &tuple, const RID &rid) {
+    if (indexes_.empty())
+      return 0;
+    if (!table_heap_->GetTuple(rid, deleted_tuple_, GetTransaction()))
+      return VTAB_ALL_INDEXES;
+    uint64_t mask = 0;
+    for (size_t i = 0; i < indexes_.size(); i++) {
+      Tuple old_key = GetKey(deleted_tuple_, indexes_[i], &arena_);
+      Tuple new_key = GetKey(tuple, indexes_[i], &arena_);
+      if (old_key.GetLength() != new_key.GetLength() ||
+          memcmp(old_key.GetData(), new_key.GetData(), old_key.GetLength()) !=
+              0)
+        mask |= 1ULL << i;
+    }
+    return mask;
   }
 
   // update table heap tuple
@@ -138,90 +627,451 @@ public:
 
   inline Schema *GetSchema() { return schema_; }
 
-  inline Index *GetIndex() { return index_; }
+  inline const std::vector<Index *> &GetIndexes() { return indexes_; }
+
+  inline Index *GetClusterIndex() { return cluster_index_; }
+
+  // the i-th index of the table, in the order of the create arguments
+  inline Index *GetIndex(size_t i) { return indexes_[i]; }
 
   inline TableHeap *GetTableHeap() { return table_heap_; }
 
+  // heap and indexes shared with the other connections
+  inline TableData *GetTableData() { return data_; }
+
+  // row counts follow the writes of every connection, rolled back ones
+  // included, until the next analyze
+  inline TableStats *GetStats() { return stats_; }
+
+  // tuples and keys of the row an update is at, reset after every row
+  inline Arena *GetArena() { return &arena_; }
+
   inline page_id_t GetFirstPageId() { return table_heap_->GetFirstPageId(); }
 
+  inline page_id_t GetFreeSpaceMapPageId() {
+    return table_heap_->GetFreeSpaceMapPageId();
+  }
+
+  inline bool IsPartitioned() { return !partitions_.empty(); }
+
+  inline const PartitionScheme &GetPartitionScheme() {
+    return data_->partition_scheme_;
+  }
+
+  inline size_t GetPartitionCount() { return partitions_.size() + 1; }
+
+  // the table of partition i, this one is partition 0
+  inline VirtualTable *GetPartition(size_t i) {
+    return i == 0 ? this : partitions_[i - 1].get();
+  }
+
+  // partition the row at rid is in, and the one tuple goes to
+  VirtualTable *GetPartitionOf(const RID &rid);
+  VirtualTable *GetPartitionOf(const Tuple &tuple);
+
+  // heap of the row at rid
+  inline TableHeap *GetHeapOf(const RID &rid) {
+    return IsPartitioned() ? GetPartitionOf(rid)->table_heap_ : table_heap_;
+  }
+
 private:
+  // construct the key tuple of index with its include columns, in arena if
+  // one is given
+  inline Tuple GetKey(const Tuple &tuple, Index *index, Arena *arena) {
+    return tuple.KeyFromTuple(schema_, index->GetStoredSchema(),
+                              index->GetStoredAttrs(), arena);
+  }
+
+  // page of the first row at or after the key of tuple in the clustered
+  // index, INVALID_PAGE_ID if there is none
+  page_id_t GetClusterPage(const Tuple &tuple);
+
+  // stable sort of tuples by the key of the clustered index
+  void SortByCluster(std::vector<Tuple> &tuples);
+
   sqlite3_vtab base_;
   // virtual table schema
   Schema *schema_;
   // to read/write actual data in table
   TableHeap *table_heap_;
-  // to insert/delete index entry
-  Index *index_ = nullptr;
+  // to insert/delete index entries, every one is kept up to date
+  std::vector<Index *> indexes_;
+  Index *cluster_index_;
+  TableStats *stats_;
+  Connection *connection_;
+  // the five before connection_, shared with the other connections
+  std::string name_;
+  TableData *data_;
+  Arena arena_;
+  // tuple an index entry is deleted by, its buffer kept for the next one
+  Tuple deleted_tuple_;
+  // rows inserted and not written yet, in insert order
+  std::vector<Tuple> insert_buffer_;
+  // the tables of partitions 1 on, sharing the connection. They are not
+  // closed themselves, partition 0 closes them
+  std::vector<std::unique_ptr<VirtualTable>> partitions_;
+  bool is_partition_;
+  // closed cursors, at most VTAB_CURSOR_POOL_SIZE
+  std::vector<Cursor *> cursor_pool_;
 };
 
 class Cursor {
 public:
-  Cursor(VirtualTable *virtual_table)
-      : table_iterator_(virtual_table->begin()), virtual_table_(virtual_table) {
-  }
+  Cursor(VirtualTable *virtual_table) : virtual_table_(virtual_table) {}
 
-  inline void SetScanFlag(bool is_index_scan) {
-    is_index_scan_ = is_index_scan;
+  ~Cursor() {
+    delete sort_;
+    delete index_iterator_;
+    delete batch_iterator_;
+    delete parallel_scan_;
+    for (auto batch : batches_)
+      delete batch;
+    virtual_table_->table_heap_->ReleaseTuplePage(row_page_);
   }
 
-  inline bool IsIndexScan() { return is_index_scan_; }
+  inline bool IsIndexScan() { return index_scan_; }
 
   inline VirtualTable *GetVirtualTable() { return virtual_table_; }
 
-  inline Schema *GetKeySchema() {
-    return virtual_table_->index_->GetKeySchema();
-  }
+  // the snapshot the statement of the cursor reads, nullptr if it reads in
+  // the transaction of the connection. Set as the cursor opens, it is
+  // read by every scan of the cursor even once a write of the connection
+  // began
+  inline void SetSnapshot(Transaction *snapshot) { snapshot_ = snapshot; }
+  inline bool IsSnapshot() { return snapshot_ != nullptr; }
+
+  // end the scan, the leaf and page it holds are let go. The cursor can
+  // start another one
+  void EndScan();
+
+  // keys of the scan, released when it starts over or the cursor closes
+  inline Arena *GetArena() { return &arena_; }
   // return rid at which cursor is currently pointed
   inline int64_t GetCurrentRid() {
-    if (is_index_scan_)
-      return results[offset_].Get();
+    if (IsIndexScan())
+      return GetIndexRid().Get();
     else
-      return (*table_iterator_).GetRid().Get();
-  }
-
-  // return tuple at which cursor is currently pointed
-  inline Value GetCurrentValue(Schema *schema, int column) {
-    if (is_index_scan_) {
-      RID rid = results[offset_];
-      Tuple tuple(rid);
-      virtual_table_->table_heap_->GetTuple(rid, tuple, GetTransaction());
-      return tuple.GetValue(schema, column);
-    } else {
-      return table_iterator_->GetValue(schema, column);
+      return batch_->GetRid(GetBatchRow()).Get();
+  }
+
+  // for sequential scan, the row of the batch cursor is pointed at
+  inline const RowBatch &GetBatch() { return *batch_; }
+  inline uint32_t GetBatchRow() { return batch_->GetSelected(batch_row_); }
+
+  // for index scan, read latch the page of the tuple at which cursor is
+  // currently pointed, false if it can not be read. Its bytes are read in
+  // place with GetCurrentBytes until UnlatchCurrentData, the page stays
+  // pinned while the scan is on it. With a row cache or a snapshot the
+  // bytes are a copy of the tuple instead, nothing is latched
+  inline bool LatchCurrentData() {
+    if (!row_loaded_)
+      LoadCurrentRow();
+    if (row_cached_)
+      return true;
+    if (row_page_ == nullptr)
+      return false;
+    row_page_->RLatch();
+    return true;
+  }
+
+  // bytes of the current tuple from offset within its Tuple format
+  inline const char *GetCurrentBytes(int32_t offset) {
+    return row_cached_ ? row_tuple_.GetData() + offset
+                       : row_page_->GetTupleBytes(GetIndexRid(), offset);
+  }
+
+  inline void UnlatchCurrentData() {
+    if (!row_cached_ && row_page_ != nullptr)
+      row_page_->RUnlatch();
+  }
+
+  // for covering index scan, the leaf entry of the current row in the
+  // format of the leaf schema of GetCoveringIndex, nullptr for other scans
+  inline const char *GetCurrentEntry() {
+    return covering_index_ != nullptr ? index_iterator_->GetEntry() : nullptr;
+  }
+  inline Index *GetCoveringIndex() { return covering_index_; }
+
+  // for covering index scan, lock the current row as LatchCurrentData does
+  // without reading its page, false if it can not be locked
+  inline bool LockCurrentRow() {
+    if (!row_loaded_) {
+      RID rid = GetIndexRid();
+      row_locked_ =
+          virtual_table_->GetHeapOf(rid)->LockTuple(rid, GetTransaction());
+      row_loaded_ = true;
     }
+    return row_locked_;
   }
 
   // move cursor up to next
   Cursor &operator++() {
-    if (is_index_scan_)
-      ++offset_;
-    else
-      ++table_iterator_;
+    if (IsIndexScan()) {
+      if (sort_ != nullptr)
+        sorted_row_ = sort_->Next();
+      else if (index_iterator_ != nullptr)
+        index_iterator_->Next();
+      else
+        rid_index_++;
+      row_loaded_ = false;
+      if (IsSnapshot() && sort_ == nullptr && index_iterator_ != nullptr)
+        CheckSnapshot();
+      else if (IsSnapshot() && sort_ == nullptr && !stable_)
+        SkipInvisible();
+    } else if (++batch_row_ == batch_->GetSelectedCount()) {
+      if (parallel_scan_ != nullptr)
+        batch_ = parallel_scan_->Next(batch_);
+      else
+        NextBatch();
+      batch_row_ = 0;
+    }
     return *this;
   }
   // is end of cursor(no more tuple)
   inline bool isEof() {
-    if (is_index_scan_)
-      return offset_ == static_cast<int>(results.size());
+    if (sort_ != nullptr)
+      return !sorted_row_;
+    if (IsIndexScan())
+      return index_iterator_ != nullptr ? index_iterator_->isEnd()
+                                        : rid_index_ >= rids_.size();
     else
-      return table_iterator_ == virtual_table_->end();
+      return batch_ == nullptr || batch_row_ >= batch_->GetSelectedCount();
+  }
+
+  // start over a sequential scan, the rows are read a batch at a time. Only
+  // the rows satisfying predicates are returned, with the columns of the
+  // projection (a RowBatch one) decoded. Tables large enough are scanned by
+  // threads workers, rows then come in no particular order. Of a
+  // partitioned table the partitions given are scanned, by a worker each at
+  // least
+  void ScanTable(uint64_t columns = ROW_BATCH_ALL_COLUMNS,
+                 const std::vector<BatchPredicate> &predicates = {},
+                 size_t threads = 1,
+                 const std::vector<size_t> &partitions = {0});
+
+  // wrapper around point scan methods
+  inline void ScanKey(Index *index, const Tuple &key, bool covering = false,
+                      bool by_page = false) {
+    ScanRange(index, &key, true, &key, true, covering, by_page);
   }
 
-  // wrapper around poit scan methods
-  inline void ScanKey(const Tuple &key) {
-    virtual_table_->index_->ScanKey(key, results);
+  // wrapper around range scan methods of index, nullptr for no bound. A
+  // covering scan answers the columns from the leaves of the index. by_page
+  // reads every rid of the range before the first row and returns the rows
+  // in page order, a page is fetched once for all its rows. A descending
+  // scan returns the rows from the high key down. A snapshot reads its rows
+  // from the heap, see BeginSnapshotScan
+  inline void ScanRange(Index *index, const Tuple *low_key, bool low_inclusive,
+                        const Tuple *high_key, bool high_inclusive,
+                        bool covering = false, bool by_page = false,
+                        bool descending = false) {
+    delete sort_;
+    sort_ = nullptr;
+    delete index_iterator_;
+    index_iterator_ =
+        descending ? index->ScanRangeReverse(low_key, low_inclusive, high_key,
+                                             high_inclusive, GetTransaction())
+                   : index->ScanRange(low_key, low_inclusive, high_key,
+                                      high_inclusive, GetTransaction());
+    index_scan_ = true;
+    bool stable = !IsSnapshot() || stable_;
+    covering_index_ = covering && stable ? index : nullptr;
+    row_loaded_ = false;
+    if (!stable || (by_page && !covering))
+      ReadRids(by_page);
+    if (IsSnapshot() && stable_)
+      CheckSnapshot();
   }
 
+  // range scan of the same index of several partitions, by page: every rid
+  // of the ranges is read before the first row
+  void ScanRanges(const std::vector<Index *> &indexes, const Tuple *low_key,
+                  bool low_inclusive, const Tuple *high_key,
+                  bool high_inclusive);
+
+  // the row whose rid is rowid, as an index scan of one row returns it.
+  // None if rowid is no row of the table
+  void ScanRowid(int64_t rowid);
+
+  // before a snapshot scans index, in key order if key_order, descending or
+  // not. The index has the keys rows have now, those changed since the
+  // snapshot began may be under other keys or none. Without such rows the
+  // index is read as it goes, its leaves answer a covering scan. Otherwise
+  // every rid of the scan is read first and those of the changed rows are
+  // added by AddChangedRows, the rows are read from the heap
+  void BeginSnapshotScan(Index *index, bool key_order, bool descending);
+  // whether the rids read miss the rows changed since the snapshot began
+  inline bool HasChangedRows() { return changed_; }
+  // add the rids of the rows changed since the snapshot began, read from
+  // the versions of every partition. sqlite checks the constraints on the
+  // rows the snapshot sees. The rows stay in page order if by_page, or go
+  // in key order if the scan was begun so
+  void AddChangedRows(bool by_page);
+
+  // read the rest of the scan started and sort its rows by the columns of
+  // order, descending where the flag is set. The rows are then returned in
+  // that order, fetched by rid as an index scan does
+  void SortScan(const std::vector<std::pair<int, bool>> &order);
+
 private:
+  // the transaction the scans read in
+  inline Transaction *GetTransaction() {
+    return snapshot_ != nullptr ? snapshot_ : virtual_table_->GetTransaction();
+  }
+
+  // rid of the current row of index scan
+  inline RID GetIndexRid() {
+    if (sort_ != nullptr) {
+      RID rid;
+      memcpy(&rid, sort_->GetPayload(), sizeof(RID));
+      return rid;
+    }
+    return index_iterator_ != nullptr ? index_iterator_->GetRid()
+                                      : rids_[rid_index_];
+  }
+
+  // read the rest of the index scan into rids_, in page order if by_page
+  void ReadRids(bool by_page);
+
+  // lock the current row of index scan and pin its page, or copy its tuple
+  // to row_tuple_ through the row cache of its heap. A snapshot copies the
+  // image it sees, if any
+  void LoadCurrentRow();
+  // for a snapshot scan of rids_, move on to the first row from the current
+  // one the snapshot sees and load it
+  void SkipInvisible();
+  // versions pushed to the heaps of the table so far
+  uint64_t GetVersionCount();
+  // rids of the rows of the table changed since the snapshot began
+  void GetChangedRids(std::vector<RID> &rids);
+  // for a snapshot reading the index as it goes, before each row: it goes
+  // on unless a row of the table changed meanwhile
+  void CheckSnapshot();
+  // the rest of a snapshot scan that was reading the index as it goes, a
+  // row having changed, is read as one of rids
+  void ReadChangedRows();
+  void AddChangedRows(bool by_page, std::unordered_set<RID> &scanned);
+  // copy the row at rid of the page pinned to row_tuple_ and cache it
+  void CacheCurrentRow(RowCache *row_cache, const RID &rid);
+
+  // fill batch_ with the next rows of the heaps scanned without workers,
+  // from the next heap once one is done
+  void NextBatch();
+
   sqlite3_vtab_cursor base_; /* Base class - must be first */
-  // for index scan
-  std::vector<RID> results;
-  int offset_ = 0;
-  // for sequential scan
-  TableIterator table_iterator_;
-  // flag to indicate which scan method is currently used
-  bool is_index_scan_ = false;
+  bool index_scan_ = false;
+  // for index scan, rids are read from the leaves as sqlite asks for rows.
+  // It holds one leaf of the index until it is done or the cursor closes
+  IndexScanIterator *index_iterator_ = nullptr;
+  // for index scan by page, the rids of the scan sorted and the one of the
+  // current row, the iterator is done with then
+  std::vector<RID> rids_;
+  size_t rid_index_ = 0;
+  // for a sorted scan, the rids of the rows behind their sort keys and
+  // whether it is on a row
+  ExternalSort *sort_ = nullptr;
+  bool sorted_row_ = false;
+  // page of the current row of index scan, kept pinned for the next rows on
+  // it. row_loaded_ is false until the current row is locked
+  TablePage *row_page_ = nullptr;
+  bool row_loaded_ = false;
+  // whether the current row was read through the row cache into row_tuple_,
+  // as a snapshot reads every row
+  bool row_cached_ = false;
+  Tuple row_tuple_;
+  // for covering index scan, the index whose leaves hold the columns and
+  // whether the current row is locked, its page is not read
+  Index *covering_index_ = nullptr;
+  bool row_locked_ = false;
+  // for sequential scan, batch_row_ indexes the selected rows of batch_, one
+  // of batches_. Either batch_iterator_ or parallel_scan_ fills them
+  TableBatchIterator *batch_iterator_ = nullptr;
+  ParallelTableScan *parallel_scan_ = nullptr;
+  // heaps of the sequential scan and the one batch_iterator_ reads
+  std::vector<TableHeap *> scan_heaps_;
+  size_t scan_heap_ = 0;
+  std::vector<RowBatch *> batches_;
+  RowBatch *batch_ = nullptr;
+  uint32_t batch_row_ = 0;
+  Arena arena_;
   VirtualTable *virtual_table_;
+  Transaction *snapshot_ = nullptr;
+  // for a snapshot index scan without rows changed since the snapshot
+  // began, the index is read as it goes while the version count of the
+  // table stays versions_. rids_ keeps the rows returned meanwhile
+  bool stable_ = false;
+  uint64_t versions_ = 0;
+  // the rids read miss the rows changed since the snapshot began
+  bool changed_ = false;
+  // index of the snapshot scan and whether its rows go in key order
+  Index *snapshot_index_ = nullptr;
+  bool key_order_ = false;
+  bool descending_ = false;
 }; // namespace cmudb
 
+// vtable_stats of a connection
+struct StatsTable {
+  sqlite3_vtab base_; /* Base class - must be first */
+  Connection *connection_;
+};
+
+// cursor of vtable_stats, the counters are read when the scan starts
+struct StatsCursor {
+  sqlite3_vtab_cursor base_; /* Base class - must be first */
+  std::vector<std::pair<std::string, int64_t>> rows_;
+  size_t row_ = 0;
+};
+
+// vtable_hash_join or vtable_hash_group of a connection, its arguments are
+// the hidden columns from first_argument_ on
+struct ExecutionTable {
+  sqlite3_vtab base_; /* Base class - must be first */
+  Connection *connection_;
+  int first_argument_;
+  int argument_count_;
+};
+
+// cursor of an operator, the whole result is computed when the scan starts.
+// keys_ has the key of each row, encoded with a tag of its type
+struct ExecutionCursor {
+  sqlite3_vtab_cursor base_; /* Base class - must be first */
+  std::vector<std::string> keys_;
+  // of vtable_hash_join, the left and right rowid of each row
+  std::vector<std::pair<int64_t, int64_t>> rowids_;
+  // of vtable_hash_group, the aggregates of each row
+  std::vector<AggregateState> groups_;
+  size_t row_ = 0;
+  // bytes of the result charged as MemoryComponent::CURSOR
+  size_t memory_ = 0;
+};
+
+// a row as it was before a write of the transaction, to put back
+struct LsmUndo {
+  int64_t key_;
+  bool existed_;
+  std::string row_;
+};
+
+// vtable_lsm table of a connection. Its writes are seen by the others as
+// they are made, a rollback undoes them
+struct LsmTable {
+  sqlite3_vtab base_; /* Base class - must be first */
+  Connection *connection_;
+  std::string name_;
+  LsmTableData *data_;
+  // writes of the transaction, oldest first
+  std::vector<LsmUndo> undo_;
+  Arena arena_;
+};
+
+// cursor of vtable_lsm, over the rows of an LsmTree::Iterator or the one of
+// a point lookup
+struct LsmCursor {
+  sqlite3_vtab_cursor base_; /* Base class - must be first */
+  std::unique_ptr<LsmTree::Iterator> iterator_;
+  int64_t key_ = 0;
+  std::string row_;
+  bool eof_ = true;
+};
+
 } // namespace cmudb
@@ -0,0 +1,203 @@
+/**
+ * adaptive_hash_index.cpp
+ */
+#include <algorithm>
+
+#include "index/adaptive_hash_index.h"
+#include "index/generic_key.h"
+
+namespace cmudb {
+
+// lookups of a shard between two looks at the totals of the window
+#define AHI_CHECK_INTERVAL 64
+
+template <typename KeyType>
+AdaptiveHashIndex<KeyType>::AdaptiveHashIndex()
+    : allowed_(true), enabled_(true), building_(true), entry_count_(0),
+      disables_(0) {
+  for (size_t i = 0; i < AHI_PAGE_SLOTS; ++i) {
+    generations_[i].store(0, std::memory_order_relaxed);
+    searches_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+template <typename KeyType>
+size_t AdaptiveHashIndex<KeyType>::KeyHash::
+operator()(const KeyType &key) const {
+  const char *data = reinterpret_cast<const char *>(&key);
+  uint64_t hash = sizeof(KeyType);
+  for (size_t offset = 0; offset < sizeof(KeyType); offset += 8) {
+    uint64_t word = 0;
+    memcpy(&word, data + offset, std::min<size_t>(8, sizeof(KeyType) - offset));
+    hash ^= word * 0x9e3779b97f4a7c15ULL;
+    hash = (hash << 31 | hash >> 33) * 0xc2b2ae3d27d4eb4fULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+template <typename KeyType>
+void AdaptiveHashIndex<KeyType>::SetAllowed(bool allowed) {
+  allowed_ = allowed;
+  enabled_ = allowed;
+  Clear();
+  building_ = true;
+}
+
+template <typename KeyType> bool AdaptiveHashIndex<KeyType>::Begin() {
+  if (enabled_.load(std::memory_order_relaxed))
+    return true;
+  if (!allowed_.load(std::memory_order_relaxed))
+    return false;
+  static thread_local uint32_t skipped = 0;
+  if (++skipped < AHI_RETRY_LOOKUPS)
+    return false;
+  skipped = 0;
+  std::lock_guard<std::mutex> guard(window_latch_);
+  if (!enabled_) {
+    Clear();
+    building_ = true;
+    enabled_ = true;
+  }
+  return true;
+}
+
+/*
+ * A stale entry is dropped on the way
+ */
+template <typename KeyType>
+bool AdaptiveHashIndex<KeyType>::Find(const KeyType &key, page_id_t &page_id,
+                                      int &slot, uint32_t &generation) {
+  Partition &partition = GetPartition(key);
+  bool found;
+  uint64_t lookups;
+  {
+    std::lock_guard<std::mutex> guard(partition.latch_);
+    lookups = partition.lookups_.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto it = partition.entries_.find(key);
+    found = it != partition.entries_.end();
+    if (found && !IsCurrent(it->second.page_id_, it->second.generation_)) {
+      partition.entries_.erase(it);
+      entry_count_.fetch_sub(1, std::memory_order_relaxed);
+      found = false;
+    }
+    if (found) {
+      page_id = it->second.page_id_;
+      slot = it->second.slot_;
+      generation = it->second.generation_;
+    } else {
+      partition.misses_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  if (lookups % AHI_CHECK_INTERVAL == 0)
+    CheckHitRate();
+  return found;
+}
+
+template <typename KeyType>
+void AdaptiveHashIndex<KeyType>::Drop(const KeyType &key) {
+  Partition &partition = GetPartition(key);
+  std::lock_guard<std::mutex> guard(partition.latch_);
+  if (partition.entries_.erase(key) != 0)
+    entry_count_.fetch_sub(1, std::memory_order_relaxed);
+  partition.misses_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+ * generation was read before the leaf, a page invalidated since is not
+ * given an entry that looks current
+ */
+template <typename KeyType>
+void AdaptiveHashIndex<KeyType>::RecordSearch(const KeyType &key,
+                                              page_id_t page_id, int slot,
+                                              uint32_t generation) {
+  if (!enabled_.load(std::memory_order_relaxed))
+    return;
+  std::atomic<uint8_t> &searches = searches_[Slot(page_id)];
+  if (searches.load(std::memory_order_relaxed) < AHI_HOT_SEARCHES) {
+    searches.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (entry_count_.load(std::memory_order_relaxed) >= AHI_MAX_ENTRIES)
+    return;
+  Partition &partition = GetPartition(key);
+  std::lock_guard<std::mutex> guard(partition.latch_);
+  auto result =
+      partition.entries_.emplace(key, Entry{page_id, slot, generation});
+  if (result.second)
+    entry_count_.fetch_add(1, std::memory_order_relaxed);
+  else
+    result.first->second = Entry{page_id, slot, generation};
+}
+
+template <typename KeyType>
+void AdaptiveHashIndex<KeyType>::InvalidatePage(page_id_t page_id) {
+  generations_[Slot(page_id)].fetch_add(1, std::memory_order_release);
+}
+
+template <typename KeyType>
+AdaptiveHashStats AdaptiveHashIndex<KeyType>::GetStats() {
+  AdaptiveHashStats stats;
+  for (auto &partition : partitions_) {
+    uint64_t lookups = partition.lookups_.load(std::memory_order_relaxed);
+    uint64_t misses = partition.misses_.load(std::memory_order_relaxed);
+    stats.lookups_ += lookups;
+    stats.hits_ += lookups > misses ? lookups - misses : 0;
+  }
+  stats.entries_ = entry_count_.load(std::memory_order_relaxed);
+  stats.disables_ = disables_.load(std::memory_order_relaxed);
+  stats.enabled_ = enabled_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+/*
+ * The counts of the shards are read and reset without their latches, a
+ * lookup counted meanwhile may be lost. That only shifts a window
+ */
+template <typename KeyType> void AdaptiveHashIndex<KeyType>::CheckHitRate() {
+  std::unique_lock<std::mutex> guard(window_latch_, std::try_to_lock);
+  if (!guard.owns_lock())
+    return;
+  uint64_t lookups = 0;
+  uint64_t misses = 0;
+  for (auto &partition : partitions_) {
+    lookups += partition.lookups_.load(std::memory_order_relaxed);
+    misses += partition.misses_.load(std::memory_order_relaxed);
+  }
+  if (lookups < AHI_WINDOW)
+    return;
+  for (auto &partition : partitions_) {
+    partition.lookups_.store(0, std::memory_order_relaxed);
+    partition.misses_.store(0, std::memory_order_relaxed);
+  }
+  if (building_.exchange(false))
+    return;
+  if (lookups - std::min(misses, lookups) < AHI_MIN_HIT_RATE * lookups) {
+    enabled_ = false;
+    disables_.fetch_add(1, std::memory_order_relaxed);
+    Clear();
+  }
+}
+
+template <typename KeyType> void AdaptiveHashIndex<KeyType>::Clear() {
+  for (auto &partition : partitions_) {
+    std::lock_guard<std::mutex> guard(partition.latch_);
+    entry_count_.fetch_sub(partition.entries_.size(),
+                           std::memory_order_relaxed);
+    partition.entries_.clear();
+    partition.lookups_.store(0, std::memory_order_relaxed);
+    partition.misses_.store(0, std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < AHI_PAGE_SLOTS; ++i)
+    searches_[i].store(0, std::memory_order_relaxed);
+}
+
+template class AdaptiveHashIndex<GenericKey<4>>;
+template class AdaptiveHashIndex<GenericKey<8>>;
+template class AdaptiveHashIndex<GenericKey<16>>;
+template class AdaptiveHashIndex<GenericKey<32>>;
+template class AdaptiveHashIndex<GenericKey<64>>;
+
+} // namespace cmudb
@@ -0,0 +1,1000 @@
+/**
+ * art_index.cpp
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <thread>
+
+#include "index/art_index.h"
+#include "index/hash_index.h"
+
+namespace cmudb {
+
+// bits of a node version, the rest counts the changes
+#define ART_OBSOLETE 1
+#define ART_LOCKED 2
+
+enum ArtNodeType : uint8_t { ART_NODE4, ART_NODE16, ART_NODE48, ART_NODE256 };
+
+// a leaf owns its whole key, it never changes and is replaced instead
+struct ArtIndex::Leaf {
+  Leaf(const std::string &key, RID rid) : key_(key), rid_(rid) {}
+
+  std::string key_;
+  RID rid_;
+};
+
+struct ArtIndex::Node {
+  explicit Node(uint8_t type) : type_(type) {}
+
+  std::atomic<uint64_t> version_{0};
+  uint8_t type_;
+  uint16_t count_ = 0;
+  // bytes of the keys below that every child shares, the first
+  // ART_PREFIX_LENGTH of them in prefix_
+  uint32_t prefix_length_ = 0;
+  uint8_t prefix_[ART_PREFIX_LENGTH];
+};
+
+namespace {
+
+using Node = ArtIndex::Node;
+using Leaf = ArtIndex::Leaf;
+
+// keys and children sorted by key
+struct Node4 : Node {
+  Node4() : Node(ART_NODE4) {}
+  uint8_t keys_[4];
+  Node *children_[4];
+};
+
+struct Node16 : Node {
+  Node16() : Node(ART_NODE16) {}
+  uint8_t keys_[16];
+  Node *children_[16];
+};
+
+// child_index_ of a key byte is its slot in children_ plus one, 0 for none
+struct Node48 : Node {
+  Node48() : Node(ART_NODE48) {
+    memset(child_index_, 0, sizeof(child_index_));
+    memset(children_, 0, sizeof(children_));
+  }
+  uint8_t child_index_[256];
+  Node *children_[48];
+};
+
+struct Node256 : Node {
+  Node256() : Node(ART_NODE256) { memset(children_, 0, sizeof(children_)); }
+  Node *children_[256];
+};
+
+/*
+ * A child is a node or a leaf, a leaf pointer has its lowest bit set
+ */
+inline bool IsLeaf(const Node *child) {
+  return (reinterpret_cast<uintptr_t>(child) & 1) != 0;
+}
+
+inline Leaf *AsLeaf(Node *child) {
+  return reinterpret_cast<Leaf *>(reinterpret_cast<uintptr_t>(child) &
+                                  ~static_cast<uintptr_t>(1));
+}
+
+inline Node *LeafChild(Leaf *leaf) {
+  return reinterpret_cast<Node *>(reinterpret_cast<uintptr_t>(leaf) | 1);
+}
+
+inline uint8_t KeyByte(const std::string &key, size_t i) {
+  return static_cast<uint8_t>(key[i]);
+}
+
+/*
+ * Versions: a reader takes the version of a node, waiting while it is
+ * locked, and validates it after reading. A writer locks by bumping an
+ * unchanged version, unlocking bumps it again
+ */
+inline bool ReadLock(Node *node, uint64_t &version) {
+  version = node->version_.load(std::memory_order_acquire);
+  while ((version & ART_LOCKED) != 0) {
+    std::this_thread::yield();
+    version = node->version_.load(std::memory_order_acquire);
+  }
+  return (version & ART_OBSOLETE) == 0;
+}
+
+inline bool Validate(Node *node, uint64_t version) {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return node->version_.load(std::memory_order_relaxed) == version;
+}
+
+inline bool Upgrade(Node *node, uint64_t version) {
+  return node->version_.compare_exchange_strong(version, version + ART_LOCKED,
+                                                std::memory_order_acquire);
+}
+
+inline bool WriteLock(Node *node) {
+  uint64_t version;
+  do {
+    if (!ReadLock(node, version))
+      return false;
+  } while (!Upgrade(node, version));
+  return true;
+}
+
+inline void WriteUnlock(Node *node) {
+  node->version_.fetch_add(ART_LOCKED, std::memory_order_release);
+}
+
+// unlinked, whoever reads it restarts
+inline void WriteUnlockObsolete(Node *node) {
+  node->version_.fetch_add(ART_LOCKED + ART_OBSOLETE,
+                           std::memory_order_release);
+}
+
+inline void SetPrefix(Node *node, const uint8_t *prefix, uint32_t length) {
+  node->prefix_length_ = length;
+  memcpy(node->prefix_, prefix,
+         std::min<uint32_t>(length, ART_PREFIX_LENGTH));
+}
+
+inline bool IsFull(const Node *node) {
+  switch (node->type_) {
+  case ART_NODE4:
+    return node->count_ == 4;
+  case ART_NODE16:
+    return node->count_ == 16;
+  case ART_NODE48:
+    return node->count_ == 48;
+  default:
+    return false;
+  }
+}
+
+// a node being changed may be read, counts are kept in bounds
+template <typename SortedNode, int capacity>
+inline Node *FindSorted(SortedNode *node, uint8_t byte) {
+  int count = std::min<int>(node->count_, capacity);
+  for (int i = 0; i < count; i++)
+    if (node->keys_[i] == byte)
+      return node->children_[i];
+  return nullptr;
+}
+
+Node *FindChild(Node *node, uint8_t byte) {
+  switch (node->type_) {
+  case ART_NODE4:
+    return FindSorted<Node4, 4>(static_cast<Node4 *>(node), byte);
+  case ART_NODE16:
+    return FindSorted<Node16, 16>(static_cast<Node16 *>(node), byte);
+  case ART_NODE48: {
+    auto node48 = static_cast<Node48 *>(node);
+    uint8_t index = node48->child_index_[byte];
+    return index == 0 ? nullptr : node48->children_[index - 1];
+  }
+  default:
+    return static_cast<Node256 *>(node)->children_[byte];
+  }
+}
+
+template <typename SortedNode>
+inline void AddSorted(SortedNode *node, uint8_t byte, Node *child) {
+  int i = 0;
+  while (i < node->count_ && node->keys_[i] < byte)
+    i++;
+  memmove(node->keys_ + i + 1, node->keys_ + i, node->count_ - i);
+  memmove(node->children_ + i + 1, node->children_ + i,
+          (node->count_ - i) * sizeof(Node *));
+  node->keys_[i] = byte;
+  node->children_[i] = child;
+  node->count_++;
+}
+
+// the node is locked and not full
+void AddChild(Node *node, uint8_t byte, Node *child) {
+  switch (node->type_) {
+  case ART_NODE4:
+    AddSorted(static_cast<Node4 *>(node), byte, child);
+    break;
+  case ART_NODE16:
+    AddSorted(static_cast<Node16 *>(node), byte, child);
+    break;
+  case ART_NODE48: {
+    auto node48 = static_cast<Node48 *>(node);
+    int slot = 0;
+    while (node48->children_[slot] != nullptr)
+      slot++;
+    node48->children_[slot] = child;
+    node48->child_index_[byte] = static_cast<uint8_t>(slot + 1);
+    node->count_++;
+    break;
+  }
+  default:
+    static_cast<Node256 *>(node)->children_[byte] = child;
+    node->count_++;
+  }
+}
+
+template <typename SortedNode>
+inline Node **FindSortedSlot(SortedNode *node, uint8_t byte) {
+  for (int i = 0; i < node->count_; i++)
+    if (node->keys_[i] == byte)
+      return &node->children_[i];
+  return nullptr;
+}
+
+// the child of byte, which the locked node has, becomes child
+void ReplaceChild(Node *node, uint8_t byte, Node *child) {
+  Node **slot;
+  switch (node->type_) {
+  case ART_NODE4:
+    slot = FindSortedSlot(static_cast<Node4 *>(node), byte);
+    break;
+  case ART_NODE16:
+    slot = FindSortedSlot(static_cast<Node16 *>(node), byte);
+    break;
+  case ART_NODE48: {
+    auto node48 = static_cast<Node48 *>(node);
+    slot = &node48->children_[node48->child_index_[byte] - 1];
+    break;
+  }
+  default:
+    slot = &static_cast<Node256 *>(node)->children_[byte];
+  }
+  assert(slot != nullptr);
+  *slot = child;
+}
+
+template <typename SortedNode>
+inline void RemoveSorted(SortedNode *node, uint8_t byte) {
+  int i = 0;
+  while (node->keys_[i] != byte)
+    i++;
+  memmove(node->keys_ + i, node->keys_ + i + 1, node->count_ - i - 1);
+  memmove(node->children_ + i, node->children_ + i + 1,
+          (node->count_ - i - 1) * sizeof(Node *));
+  node->count_--;
+}
+
+// the locked node has a child of byte
+void RemoveChild(Node *node, uint8_t byte) {
+  switch (node->type_) {
+  case ART_NODE4:
+    RemoveSorted(static_cast<Node4 *>(node), byte);
+    break;
+  case ART_NODE16:
+    RemoveSorted(static_cast<Node16 *>(node), byte);
+    break;
+  case ART_NODE48: {
+    auto node48 = static_cast<Node48 *>(node);
+    node48->children_[node48->child_index_[byte] - 1] = nullptr;
+    node48->child_index_[byte] = 0;
+    node->count_--;
+    break;
+  }
+  default:
+    static_cast<Node256 *>(node)->children_[byte] = nullptr;
+    node->count_--;
+  }
+}
+
+// children of the node with their key bytes in key order
+template <typename Function> void ForEachChild(Node *node, Function function) {
+  switch (node->type_) {
+  case ART_NODE4:
+  case ART_NODE16: {
+    bool small = node->type_ == ART_NODE4;
+    int count = std::min<int>(node->count_, small ? 4 : 16);
+    const uint8_t *keys = small ? static_cast<Node4 *>(node)->keys_
+                                : static_cast<Node16 *>(node)->keys_;
+    Node *const *children = small ? static_cast<Node4 *>(node)->children_
+                                  : static_cast<Node16 *>(node)->children_;
+    for (int i = 0; i < count; i++)
+      function(keys[i], children[i]);
+    break;
+  }
+  case ART_NODE48: {
+    auto node48 = static_cast<Node48 *>(node);
+    for (int byte = 0; byte < 256; byte++) {
+      uint8_t index = node48->child_index_[byte];
+      if (index != 0 && node48->children_[index - 1] != nullptr)
+        function(static_cast<uint8_t>(byte), node48->children_[index - 1]);
+    }
+    break;
+  }
+  default: {
+    auto node256 = static_cast<Node256 *>(node);
+    for (int byte = 0; byte < 256; byte++)
+      if (node256->children_[byte] != nullptr)
+        function(static_cast<uint8_t>(byte), node256->children_[byte]);
+  }
+  }
+}
+
+// a copy of the full node with room for one more child
+Node *Grow(Node *node) {
+  Node *grown;
+  switch (node->type_) {
+  case ART_NODE4: {
+    auto node4 = static_cast<Node4 *>(node);
+    auto node16 = new Node16;
+    memcpy(node16->keys_, node4->keys_, 4);
+    memcpy(node16->children_, node4->children_, 4 * sizeof(Node *));
+    grown = node16;
+    break;
+  }
+  case ART_NODE16: {
+    auto node16 = static_cast<Node16 *>(node);
+    auto node48 = new Node48;
+    for (int i = 0; i < 16; i++) {
+      node48->child_index_[node16->keys_[i]] = static_cast<uint8_t>(i + 1);
+      node48->children_[i] = node16->children_[i];
+    }
+    grown = node48;
+    break;
+  }
+  default: {
+    auto node256 = new Node256;
+    ForEachChild(node, [&](uint8_t byte, Node *child) {
+      node256->children_[byte] = child;
+    });
+    grown = node256;
+  }
+  }
+  grown->count_ = node->count_;
+  SetPrefix(grown, node->prefix_, node->prefix_length_);
+  return grown;
+}
+
+// the child of a node with two children that is not of byte
+Node *OtherChild(Node *node, uint8_t byte, uint8_t &other_byte) {
+  Node *other = nullptr;
+  ForEachChild(node, [&](uint8_t child_byte, Node *child) {
+    if (child_byte != byte) {
+      other_byte = child_byte;
+      other = child;
+    }
+  });
+  return other;
+}
+
+// some leaf below the node, read without latches. Nullptr if the node is
+// changing, its version tells
+Leaf *AnyLeaf(Node *node) {
+  for (;;) {
+    Node *first = nullptr;
+    ForEachChild(node, [&](uint8_t, Node *child) {
+      if (first == nullptr)
+        first = child;
+    });
+    if (first == nullptr)
+      return nullptr;
+    if (IsLeaf(first))
+      return AsLeaf(first);
+    node = first;
+  }
+}
+
+/*
+ * The whole prefix of the node, which starts at depth of the keys below.
+ * Bytes past those the node keeps are read from one of its leaves. False if
+ * the node changed meanwhile
+ */
+bool LoadPrefix(Node *node, size_t depth, uint64_t version,
+                std::string &prefix) {
+  uint32_t length = node->prefix_length_;
+  if (length <= ART_PREFIX_LENGTH) {
+    prefix.assign(reinterpret_cast<const char *>(node->prefix_), length);
+  } else {
+    Leaf *leaf = AnyLeaf(node);
+    if (leaf == nullptr || leaf->key_.size() < depth + length)
+      return false;
+    prefix.assign(leaf->key_, depth, length);
+  }
+  return Validate(node, version);
+}
+
+/*
+ * Compare the prefix bytes the node keeps with key at depth and move depth
+ * past the whole prefix. The rest is skipped, the leaf is compared whole
+ */
+inline bool MatchPrefix(const Node *node, const std::string &key,
+                        size_t &depth) {
+  uint32_t length = node->prefix_length_;
+  uint32_t kept = std::min<uint32_t>(length, ART_PREFIX_LENGTH);
+  for (uint32_t i = 0; i < kept; i++)
+    if (depth + i >= key.size() || node->prefix_[i] != KeyByte(key, depth + i))
+      return false;
+  depth += length;
+  return true;
+}
+
+void FreeNode(Node *node) {
+  switch (node->type_) {
+  case ART_NODE4:
+    delete static_cast<Node4 *>(node);
+    break;
+  case ART_NODE16:
+    delete static_cast<Node16 *>(node);
+    break;
+  case ART_NODE48:
+    delete static_cast<Node48 *>(node);
+    break;
+  default:
+    delete static_cast<Node256 *>(node);
+  }
+}
+
+void FreeTree(Node *node) {
+  ForEachChild(node, [](uint8_t, Node *child) {
+    if (IsLeaf(child))
+      delete AsLeaf(child);
+    else
+      FreeTree(child);
+  });
+  FreeNode(node);
+}
+
+// the lowest bytes of value, most significant first
+inline void AppendBigEndian(std::string &bytes, uint64_t value, int size) {
+  for (int shift = (size - 1) * 8; shift >= 0; shift -= 8)
+    bytes.push_back(static_cast<char>(value >> shift));
+}
+
+// collect the leaves below a node read at version, in key order
+bool CollectSubtree(Node *node, uint64_t version, std::vector<Leaf *> &leaves) {
+  std::vector<Node *> children;
+  ForEachChild(node, [&](uint8_t, Node *child) { children.push_back(child); });
+  if (!Validate(node, version))
+    return false;
+  for (Node *child : children) {
+    if (IsLeaf(child)) {
+      leaves.push_back(AsLeaf(child));
+      continue;
+    }
+    uint64_t child_version;
+    if (!ReadLock(child, child_version) ||
+        !CollectSubtree(child, child_version, leaves))
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+// readers and writers stay in the epoch they entered while it lives
+class ArtIndex::EpochGuard {
+public:
+  explicit EpochGuard(ArtIndex *index)
+      : index_(index), slot_(index->EnterEpoch()) {}
+  ~EpochGuard() { index_->ExitEpoch(slot_); }
+
+private:
+  ArtIndex *index_;
+  size_t slot_;
+};
+
+ArtIndex::ArtIndex(IndexMetadata *metadata)
+    : Index(metadata), root_(new Node256) {
+  readers_[0] = 0;
+  readers_[1] = 0;
+}
+
+ArtIndex::~ArtIndex() {
+  FreeTree(root_);
+  for (auto &garbage : garbage_nodes_)
+    FreeNode(garbage.second);
+  for (auto &garbage : garbage_leaves_)
+    delete garbage.second;
+}
+
+/*
+ * A unique index has one entry per key, a non-unique one makes the key
+ * whole with the rid, big endian so the entries of a key are in rid order
+ */
+void ArtIndex::InsertEntry(const Tuple &key, RID rid, Transaction *) {
+  std::string bytes;
+  EncodeKey(key, bytes);
+  if (!GetMetadata()->IsUnique())
+    AppendBigEndian(bytes, static_cast<uint64_t>(rid.Get()), sizeof(int64_t));
+  if (Insert(bytes, rid))
+    entry_count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+// a unique index ignores the rid
+void ArtIndex::DeleteEntry(const Tuple &key, RID rid, Transaction *) {
+  std::string bytes;
+  EncodeKey(key, bytes);
+  if (!GetMetadata()->IsUnique())
+    AppendBigEndian(bytes, static_cast<uint64_t>(rid.Get()), sizeof(int64_t));
+  if (Remove(bytes))
+    entry_count_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ArtIndex::ScanKey(const Tuple &key, std::vector<RID> &result,
+                       Transaction *) {
+  std::string bytes;
+  EncodeKey(key, bytes);
+  if (GetMetadata()->IsUnique()) {
+    RID rid;
+    if (Lookup(bytes, rid))
+      result.push_back(rid);
+    return;
+  }
+  // the encoded key ends in a byte no longer key starts with there, its
+  // leaves are those of the whole keys that start with it
+  EpochGuard guard(this);
+  std::vector<Leaf *> leaves;
+  CollectLeaves(bytes, leaves);
+  for (Leaf *leaf : leaves)
+    result.push_back(leaf->rid_);
+}
+
+IndexScanIterator *ArtIndex::ScanRange(const Tuple *low_key,
+                                       bool low_inclusive,
+                                       const Tuple *high_key,
+                                       bool high_inclusive, Transaction *) {
+  std::string low, high;
+  if (low_key != nullptr)
+    EncodeKey(*low_key, low);
+  if (high_key != nullptr)
+    EncodeKey(*high_key, high);
+  // a range of one key is a point lookup, as the cursor scans keys
+  if (low_key != nullptr && high_key != nullptr && low_inclusive &&
+      high_inclusive && low == high) {
+    std::vector<RID> rids;
+    ScanKey(*low_key, rids);
+    return new VectorScanIterator(std::move(rids));
+  }
+  size_t suffix = GetMetadata()->IsUnique() ? 0 : sizeof(int64_t);
+  std::vector<RID> rids;
+  {
+    EpochGuard guard(this);
+    std::vector<Leaf *> leaves;
+    CollectLeaves("", leaves);
+    for (Leaf *leaf : leaves) {
+      size_t length = leaf->key_.size() - suffix;
+      if (low_key != nullptr) {
+        int compare = leaf->key_.compare(0, length, low);
+        if (compare < 0 || (compare == 0 && !low_inclusive))
+          continue;
+      }
+      if (high_key != nullptr) {
+        int compare = leaf->key_.compare(0, length, high);
+        if (compare > 0 || (compare == 0 && !high_inclusive))
+          break;
+      }
+      rids.push_back(leaf->rid_);
+    }
+  }
+  return new VectorScanIterator(std::move(rids));
+}
+
+void ArtIndex::EncodeKey(const Tuple &key, std::string &bytes) const {
+  Schema *schema = GetKeySchema();
+  bytes.clear();
+  for (int i = 0; i < schema->GetColumnCount(); i++) {
+    Value value = key.GetValue(schema, i);
+    if (value.IsNull()) {
+      bytes.push_back(0);
+      continue;
+    }
+    bytes.push_back(1);
+    switch (schema->GetType(i)) {
+    case TypeId::BOOLEAN:
+    case TypeId::TINYINT:
+      AppendBigEndian(bytes, static_cast<uint8_t>(value.GetAs<int8_t>()) ^ 0x80,
+                      1);
+      break;
+    case TypeId::SMALLINT:
+      AppendBigEndian(
+          bytes, static_cast<uint16_t>(value.GetAs<int16_t>()) ^ 0x8000, 2);
+      break;
+    case TypeId::INTEGER:
+      AppendBigEndian(
+          bytes, static_cast<uint32_t>(value.GetAs<int32_t>()) ^ 0x80000000u,
+          4);
+      break;
+    case TypeId::BIGINT:
+      AppendBigEndian(bytes,
+                      static_cast<uint64_t>(value.GetAs<int64_t>()) ^
+                          (1ULL << 63),
+                      8);
+      break;
+    case TypeId::TIMESTAMP:
+      AppendBigEndian(bytes, value.GetAs<uint64_t>(), 8);
+      break;
+    case TypeId::DECIMAL: {
+      // -0.0 equals 0.0, negatives sort by their inverted bits
+      double decimal = value.GetAs<double>();
+      if (decimal == 0)
+        decimal = 0.0;
+      uint64_t bits;
+      memcpy(&bits, &decimal, sizeof(bits));
+      bits = (bits >> 63) != 0 ? ~bits : bits | (1ULL << 63);
+      AppendBigEndian(bytes, bits, 8);
+      break;
+    }
+    default: {
+      const char *data = value.GetData();
+      bytes.append(data, strnlen(data, value.GetLength()));
+      bytes.push_back(0);
+    }
+    }
+  }
+}
+
+bool ArtIndex::Lookup(const std::string &bytes, RID &rid) {
+  EpochGuard guard(this);
+  bool found;
+  while (!TryLookup(bytes, rid, found)) {
+  }
+  return found;
+}
+
+bool ArtIndex::Insert(const std::string &bytes, RID rid) {
+  EpochGuard guard(this);
+  bool inserted;
+  while (!TryInsert(bytes, rid, inserted)) {
+  }
+  return inserted;
+}
+
+bool ArtIndex::Remove(const std::string &bytes) {
+  EpochGuard guard(this);
+  bool removed;
+  while (!TryRemove(bytes, removed)) {
+  }
+  return removed;
+}
+
+// in an epoch already, the leaves stay valid while it lasts
+void ArtIndex::CollectLeaves(const std::string &prefix,
+                             std::vector<Leaf *> &leaves) {
+  while (!TryCollectLeaves(prefix, leaves)) {
+  }
+}
+
+/*
+ * Optimistic lock coupling: a child is only followed once its parent is
+ * known to be unchanged, a leaf once the node it is in is
+ */
+bool ArtIndex::TryLookup(const std::string &bytes, RID &rid, bool &found) {
+  found = false;
+  Node *node = root_;
+  uint64_t version;
+  ReadLock(node, version);
+  size_t depth = 0;
+  for (;;) {
+    if (!MatchPrefix(node, bytes, depth) || depth >= bytes.size())
+      return Validate(node, version);
+    Node *child = FindChild(node, KeyByte(bytes, depth));
+    if (!Validate(node, version))
+      return false;
+    if (child == nullptr)
+      return true;
+    if (IsLeaf(child)) {
+      Leaf *leaf = AsLeaf(child);
+      found = leaf->key_ == bytes;
+      if (found)
+        rid = leaf->rid_;
+      return true;
+    }
+    uint64_t child_version;
+    if (!ReadLock(child, child_version) || !Validate(node, version))
+      return false;
+    node = child;
+    version = child_version;
+    depth++;
+  }
+}
+
+/*
+ * Only the nodes changed are locked: the node a leaf goes into, with its
+ * parent if it is replaced by a grown copy or split at its prefix
+ */
+bool ArtIndex::TryInsert(const std::string &bytes, RID rid, bool &inserted) {
+  inserted = false;
+  Node *parent = nullptr;
+  uint64_t parent_version = 0;
+  uint8_t parent_byte = 0;
+  Node *node = root_;
+  uint64_t version;
+  ReadLock(node, version);
+  size_t depth = 0;
+  for (;;) {
+    if (node->prefix_length_ > 0) {
+      std::string prefix;
+      if (!LoadPrefix(node, depth, version, prefix))
+        return false;
+      size_t match = 0;
+      while (match < prefix.size() && depth + match < bytes.size() &&
+             prefix[match] == bytes[depth + match])
+        match++;
+      if (match < prefix.size()) {
+        // keys are prefix free, the key leaves the prefix before it ends
+        assert(depth + match < bytes.size());
+        // a new node takes the shared part of the prefix
+        if (!Upgrade(parent, parent_version))
+          return false;
+        if (!Upgrade(node, version)) {
+          WriteUnlock(parent);
+          return false;
+        }
+        auto split = new Node4;
+        SetPrefix(split, reinterpret_cast<const uint8_t *>(prefix.data()),
+                  match);
+        AddChild(split, static_cast<uint8_t>(prefix[match]), node);
+        AddChild(split, KeyByte(bytes, depth + match),
+                 LeafChild(new Leaf(bytes, rid)));
+        SetPrefix(node,
+                  reinterpret_cast<const uint8_t *>(prefix.data()) + match + 1,
+                  prefix.size() - match - 1);
+        ReplaceChild(parent, parent_byte, split);
+        WriteUnlock(node);
+        WriteUnlock(parent);
+        inserted = true;
+        return true;
+      }
+      depth += prefix.size();
+    }
+    assert(depth < bytes.size());
+    uint8_t byte = KeyByte(bytes, depth);
+    Node *child = FindChild(node, byte);
+    if (!Validate(node, version))
+      return false;
+
+    if (child == nullptr) {
+      if (!IsFull(node)) {
+        if (!Upgrade(node, version))
+          return false;
+        AddChild(node, byte, LeafChild(new Leaf(bytes, rid)));
+        WriteUnlock(node);
+        inserted = true;
+        return true;
+      }
+      // the root never fills, a full node has a parent to take its copy
+      if (!Upgrade(parent, parent_version))
+        return false;
+      if (!Upgrade(node, version)) {
+        WriteUnlock(parent);
+        return false;
+      }
+      Node *grown = Grow(node);
+      AddChild(grown, byte, LeafChild(new Leaf(bytes, rid)));
+      ReplaceChild(parent, parent_byte, grown);
+      WriteUnlockObsolete(node);
+      WriteUnlock(parent);
+      Retire(node);
+      inserted = true;
+      return true;
+    }
+
+    if (IsLeaf(child)) {
+      Leaf *leaf = AsLeaf(child);
+      if (leaf->key_ == bytes)
+        return true;
+      // a new node takes the bytes both keys share past this one
+      if (!Upgrade(node, version))
+        return false;
+      const std::string &other = leaf->key_;
+      size_t match = 0;
+      while (depth + 1 + match < bytes.size() &&
+             depth + 1 + match < other.size() &&
+             bytes[depth + 1 + match] == other[depth + 1 + match])
+        match++;
+      assert(depth + 1 + match < bytes.size() &&
+             depth + 1 + match < other.size());
+      auto split = new Node4;
+      SetPrefix(split, reinterpret_cast<const uint8_t *>(bytes.data()) +
+                           depth + 1,
+                match);
+      AddChild(split, KeyByte(other, depth + 1 + match), child);
+      AddChild(split, KeyByte(bytes, depth + 1 + match),
+               LeafChild(new Leaf(bytes, rid)));
+      ReplaceChild(node, byte, split);
+      WriteUnlock(node);
+      inserted = true;
+      return true;
+    }
+
+    uint64_t child_version;
+    if (!ReadLock(child, child_version) || !Validate(node, version))
+      return false;
+    parent = node;
+    parent_version = version;
+    parent_byte = byte;
+    node = child;
+    version = child_version;
+    depth++;
+  }
+}
+
+/*
+ * Every node but the root keeps two children at least: one left with a
+ * single child is replaced by it in its parent, the child taking its
+ * prefix and key byte in front of its own prefix. Nodes are not shrunk
+ */
+bool ArtIndex::TryRemove(const std::string &bytes, bool &removed) {
+  removed = false;
+  Node *parent = nullptr;
+  uint64_t parent_version = 0;
+  uint8_t parent_byte = 0;
+  Node *node = root_;
+  uint64_t version;
+  ReadLock(node, version);
+  size_t depth = 0;
+  for (;;) {
+    size_t prefix_depth = depth;
+    if (!MatchPrefix(node, bytes, depth) || depth >= bytes.size())
+      return Validate(node, version);
+    uint8_t byte = KeyByte(bytes, depth);
+    Node *child = FindChild(node, byte);
+    if (!Validate(node, version))
+      return false;
+    if (child == nullptr)
+      return true;
+
+    if (IsLeaf(child)) {
+      Leaf *leaf = AsLeaf(child);
+      if (leaf->key_ != bytes)
+        return true;
+      if (node == root_ || node->count_ > 2) {
+        if (!Upgrade(node, version))
+          return false;
+        RemoveChild(node, byte);
+        WriteUnlock(node);
+      } else {
+        if (!Upgrade(parent, parent_version))
+          return false;
+        if (!Upgrade(node, version)) {
+          WriteUnlock(parent);
+          return false;
+        }
+        uint8_t other_byte = 0;
+        Node *other = OtherChild(node, byte, other_byte);
+        if (!IsLeaf(other)) {
+          if (!WriteLock(other)) {
+            WriteUnlock(node);
+            WriteUnlock(parent);
+            return false;
+          }
+          // the prefix of the node is that of the key removed
+          std::string prefix = bytes.substr(prefix_depth, node->prefix_length_);
+          prefix.push_back(static_cast<char>(other_byte));
+          prefix.append(reinterpret_cast<const char *>(other->prefix_),
+                        std::min<uint32_t>(other->prefix_length_,
+                                           ART_PREFIX_LENGTH));
+          SetPrefix(other, reinterpret_cast<const uint8_t *>(prefix.data()),
+                    node->prefix_length_ + 1 + other->prefix_length_);
+          WriteUnlock(other);
+        }
+        ReplaceChild(parent, parent_byte, other);
+        WriteUnlockObsolete(node);
+        WriteUnlock(parent);
+        Retire(node);
+      }
+      Retire(leaf);
+      removed = true;
+      return true;
+    }
+
+    uint64_t child_version;
+    if (!ReadLock(child, child_version) || !Validate(node, version))
+      return false;
+    parent = node;
+    parent_version = version;
+    parent_byte = byte;
+    node = child;
+    version = child_version;
+    depth++;
+  }
+}
+
+/*
+ * Descend while the prefix has bytes, then take every leaf below. Prefix
+ * bytes a node does not keep are skipped, the leaves are checked whole
+ */
+bool ArtIndex::TryCollectLeaves(const std::string &prefix,
+                                std::vector<Leaf *> &leaves) {
+  leaves.clear();
+  Node *node = root_;
+  uint64_t version;
+  ReadLock(node, version);
+  size_t depth = 0;
+  while (depth < prefix.size()) {
+    uint32_t kept = std::min<uint32_t>(node->prefix_length_, ART_PREFIX_LENGTH);
+    for (uint32_t i = 0; i < kept && depth + i < prefix.size(); i++)
+      if (node->prefix_[i] != KeyByte(prefix, depth + i))
+        return Validate(node, version);
+    depth += node->prefix_length_;
+    if (depth >= prefix.size())
+      break;
+    Node *child = FindChild(node, KeyByte(prefix, depth));
+    if (!Validate(node, version))
+      return false;
+    if (child == nullptr)
+      return true;
+    if (IsLeaf(child)) {
+      leaves.push_back(AsLeaf(child));
+      break;
+    }
+    uint64_t child_version;
+    if (!ReadLock(child, child_version) || !Validate(node, version))
+      return false;
+    node = child;
+    version = child_version;
+    depth++;
+  }
+  if (leaves.empty() && !CollectSubtree(node, version, leaves))
+    return false;
+  size_t kept = 0;
+  for (Leaf *leaf : leaves)
+    if (leaf->key_.compare(0, prefix.size(), prefix) == 0)
+      leaves[kept++] = leaf;
+  leaves.resize(kept);
+  return true;
+}
+
+/*
+ * Epochs: a reader counts itself in the parity of the epoch it entered.
+ * What is unlinked in epoch e can only be reached by readers of e or
+ * before, the epoch moves from e to e + 1 once none of e - 1 is left, so it
+ * is freed at e + 2
+ */
+size_t ArtIndex::EnterEpoch() {
+  for (;;) {
+    uint64_t epoch = epoch_.load();
+    size_t slot = epoch & 1;
+    readers_[slot].fetch_add(1);
+    if (epoch_.load() == epoch)
+      return slot;
+    readers_[slot].fetch_sub(1);
+  }
+}
+
+void ArtIndex::ExitEpoch(size_t slot) { readers_[slot].fetch_sub(1); }
+
+void ArtIndex::Retire(Node *node) {
+  uint64_t epoch = epoch_.load();
+  std::lock_guard<std::mutex> guard(garbage_latch_);
+  garbage_nodes_.emplace_back(epoch, node);
+  if (garbage_nodes_.size() + garbage_leaves_.size() >= ART_RECLAIM_BATCH)
+    Reclaim();
+}
+
+void ArtIndex::Retire(Leaf *leaf) {
+  uint64_t epoch = epoch_.load();
+  std::lock_guard<std::mutex> guard(garbage_latch_);
+  garbage_leaves_.emplace_back(epoch, leaf);
+  if (garbage_nodes_.size() + garbage_leaves_.size() >= ART_RECLAIM_BATCH)
+    Reclaim();
+}
+
+// under garbage_latch_
+void ArtIndex::Reclaim() {
+  uint64_t epoch = epoch_.load();
+  if (readers_[(epoch + 1) & 1].load() == 0 &&
+      epoch_.compare_exchange_strong(epoch, epoch + 1))
+    epoch++;
+  size_t kept = 0;
+  for (auto &garbage : garbage_nodes_) {
+    if (garbage.first + 2 <= epoch)
+      FreeNode(garbage.second);
+    else
+      garbage_nodes_[kept++] = garbage;
+  }
+  garbage_nodes_.resize(kept);
+  kept = 0;
+  for (auto &garbage : garbage_leaves_) {
+    if (garbage.first + 2 <= epoch)
+      delete garbage.second;
+    else
+      garbage_leaves_[kept++] = garbage;
+  }
+  garbage_leaves_.resize(kept);
+}
+
+} // namespace cmudb
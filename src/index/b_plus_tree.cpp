@@ -1,30 +1,59 @@
 /**
  * b_plus_tree.cpp
  */
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "common/exception.h"
+#include "common/latency_stats.h"
 #include "common/logger.h"
+#include "common/probes.h"
 #include "common/rid.h"
 #include "index/b_plus_tree.h"
-#include "page/header_page.h"
 
 namespace cmudb {
 
+namespace {
+
+// leaf and previous leaf of the links a writer could not make under its
+// latches, made before it returns
+thread_local std::vector<std::pair<page_id_t, page_id_t>> deferred_links;
+
+} // namespace
+
 INDEX_TEMPLATE_ARGUMENTS
 BPLUSTREE_TYPE::BPlusTree(const std::string &name,
                                 BufferPoolManager *buffer_pool_manager,
                                 const KeyComparator &comparator,
-                                page_id_t root_page_id)
+                                page_id_t root_page_id, int tablespace_id)
     : index_name_(name), root_page_id_(root_page_id),
-      buffer_pool_manager_(buffer_pool_manager), comparator_(comparator) {}
+      buffer_pool_manager_(buffer_pool_manager),
+      extent_(buffer_pool_manager->GetDiskManager(), tablespace_id),
+      comparator_(comparator),
+      optimistic_(true), optimistic_restarts_(0), root_dirty_(false),
+      root_frame_(nullptr), buffer_size_(0), buffer_(KeyLess(comparator)),
+      buffer_flushes_(0) {}
 
 /*
- * Helper function to decide whether current b+tree is empty
+ * Helper function to decide whether current b+tree is empty, a buffered
+ * message counts as an entry
  */
 INDEX_TEMPLATE_ARGUMENTS
-bool BPLUSTREE_TYPE::IsEmpty() const { return true; }
+bool BPLUSTREE_TYPE::IsEmpty() const {
+  if (root_page_id_ != INVALID_PAGE_ID)
+    return false;
+  if (buffer_size_ == 0)
+    return true;
+  buffer_latch_.RLock();
+  bool empty = buffer_.empty();
+  buffer_latch_.RUnlock();
+  return empty;
+}
 /*****************************************************************************
  * SEARCH
  *****************************************************************************/
@@ -37,7 +66,435 @@ INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::GetValue(const KeyType &key,
                               std::vector<ValueType> &result,
                               Transaction *transaction) {
-  return false;
+  LATENCY_TIMER(LatencyType::BTREE_GET_VALUE);
+  if (buffer_size_ == 0)
+    return TreeGetValue(key, result);
+  // the buffer is held until the leaf is read, a flush can not move the
+  // message of key between the two
+  buffer_latch_.RLock();
+  bool found;
+  auto it = buffer_.find(key);
+  if (it == buffer_.end()) {
+    found = TreeGetValue(key, result);
+  } else if (it->second.type_ == MessageType::DELETE) {
+    found = false;
+  } else if (it->second.type_ == MessageType::PUT) {
+    result.push_back(it->second.value_);
+    found = true;
+  } else {
+    // an insert leaves a key in the leaves as it is
+    if (!TreeGetValue(key, result))
+      result.push_back(it->second.value_);
+    found = true;
+  }
+  buffer_latch_.RUnlock();
+  return found;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::TreeGetValue(const KeyType &key,
+                                  std::vector<ValueType> &result) {
+  // a swizzled descent pins nothing, cheaper than a fetch of the leaf
+  if (!buffer_pool_manager_->IsSwizzling() && adaptive_hash_.Begin() &&
+      AdaptiveGetValue(key, result))
+    return true;
+  bool found;
+  for (int i = 0; i < OPTIMISTIC_READ_RETRIES; ++i) {
+    if (OptimisticGetValue(key, result, found))
+      return found;
+  }
+  Page *page = FindLeaf(key, false, Operation::READ);
+  if (page == nullptr)
+    return false;
+  auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
+  ValueType value;
+  found = leaf->Lookup(key, value, comparator_);
+  if (found)
+    result.push_back(value);
+  page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+  return found;
+}
+
+/*
+ * The leaf is only used if it is resident, a hot one is. Read latch free like
+ * a descent, and the generation of the entry must still be current once the
+ * version is validated: the leaf was not split, merged or freed before it
+ * was read
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::AdaptiveGetValue(const KeyType &key,
+                                      std::vector<ValueType> &result) {
+  page_id_t page_id;
+  int slot;
+  uint32_t generation;
+  if (!adaptive_hash_.Find(key, page_id, slot, generation))
+    return false;
+  Page *page = buffer_pool_manager_->FetchPageIfResident(page_id);
+  bool hit = false;
+  ValueType value;
+  if (page != nullptr) {
+    uint64_t version = page->GetVersion();
+    auto node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+    hit = (version & 1) == 0 && node->IsLeafPage() &&
+          reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(node)->LookupAt(
+              slot, key, value, comparator_) &&
+          page->ValidateVersion(version) &&
+          adaptive_hash_.IsCurrent(page_id, generation);
+    buffer_pool_manager_->UnpinPage(page_id, false);
+  }
+  if (!hit) {
+    adaptive_hash_.Drop(key);
+    return false;
+  }
+  result.push_back(value);
+  return true;
+}
+
+/*
+ * The path to the leaf of the current key stays read latched, each page
+ * with the separator its keys are below. The next key climbs only as far
+ * as the first page whose range holds it and descends from there, so a
+ * page is visited once for all the keys in it
+ */
+INDEX_TEMPLATE_ARGUMENTS
+size_t BPLUSTREE_TYPE::GetValues(const std::vector<KeyType> &keys,
+                                 std::vector<ValueType> &result,
+                                 std::vector<bool> *found) {
+  LATENCY_TIMER(LatencyType::BTREE_GET_VALUE);
+  Flush();
+  if (found != nullptr)
+    found->assign(keys.size(), false);
+  if (keys.empty())
+    return 0;
+  root_latch_.RLock();
+  if (root_page_id_ == INVALID_PAGE_ID) {
+    root_latch_.RUnlock();
+    return 0;
+  }
+  struct PathPage {
+    Page *page_;
+    KeyType high_key_;
+    bool has_high_key_;
+  };
+  std::vector<PathPage> path;
+  Page *root = FetchPage(root_page_id_);
+  root->RLatch();
+  root_latch_.RUnlock();
+  path.push_back({root, KeyType(), false});
+
+  size_t count = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    const KeyType &key = keys[i];
+    while (path.size() > 1 && path.back().has_high_key_ &&
+           comparator_(key, path.back().high_key_) >= 0) {
+      path.back().page_->RUnlatch();
+      buffer_pool_manager_->UnpinPage(path.back().page_->GetPageId(), false);
+      path.pop_back();
+    }
+    auto node = reinterpret_cast<BPlusTreePage *>(path.back().page_->GetData());
+    while (!node->IsLeafPage()) {
+      auto internal = reinterpret_cast<
+          BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
+      int index = internal->LookupIndex(key, comparator_);
+      PathPage child{FetchPage(internal->ValueAt(index)),
+                     path.back().high_key_, path.back().has_high_key_};
+      if (index + 1 < internal->GetSize()) {
+        child.high_key_ = internal->KeyAt(index + 1);
+        child.has_high_key_ = true;
+      }
+      child.page_->RLatch();
+      path.push_back(child);
+      node = reinterpret_cast<BPlusTreePage *>(child.page_->GetData());
+    }
+    auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(node);
+    ValueType value;
+    if (leaf->Lookup(key, value, comparator_)) {
+      result.push_back(value);
+      count++;
+      if (found != nullptr)
+        (*found)[i] = true;
+    }
+  }
+  for (auto &path_page : path) {
+    path_page.page_->RUnlatch();
+    buffer_pool_manager_->UnpinPage(path_page.page_->GetPageId(), false);
+  }
+  return count;
+}
+
+/*
+ * A hand made coroutine per key: the lookups of a group take turns, a turn
+ * moves one a page down. Pinning a child ends a turn, the child is
+ * prefetched into the cache and read on the next one, and a child not in
+ * the pool is read ahead, its lookup tries it again on later turns. Nothing
+ * is latched across turns, a lookup keeps its parent pinned until the child
+ * is and validates versions as OptimisticGetValue does. Once a whole round
+ * of turns pins nothing, every lookup waits for a read, the first one waits
+ * for its page. A lookup restarting too often takes TreeGetValue
+ */
+INDEX_TEMPLATE_ARGUMENTS
+size_t BPLUSTREE_TYPE::GetValuesInterleaved(const std::vector<KeyType> &keys,
+                                            std::vector<ValueType> &result,
+                                            std::vector<bool> *found,
+                                            size_t group) {
+  LATENCY_TIMER(LatencyType::BTREE_GET_VALUE);
+  Flush();
+  std::vector<bool> hits(keys.size(), false);
+  std::vector<ValueType> values(keys.size());
+  struct Lookup {
+    size_t key_;
+    // pinned, read on the next turn unless child_id_ is set
+    Page *page_;
+    uint64_t version_;
+    page_id_t child_id_;
+    bool read_ahead_;
+    int restarts_;
+  };
+  // start over from the root, false once the lookup is done
+  auto restart = [&](Lookup &lookup) {
+    if (lookup.page_ != nullptr)
+      buffer_pool_manager_->UnpinPage(lookup.page_->GetPageId(), false);
+    lookup.page_ = nullptr;
+    lookup.read_ahead_ = false;
+    lookup.child_id_ = root_page_id_;
+    if (++lookup.restarts_ > OPTIMISTIC_READ_RETRIES) {
+      std::vector<ValueType> value;
+      hits[lookup.key_] = TreeGetValue(keys[lookup.key_], value);
+      if (hits[lookup.key_])
+        values[lookup.key_] = value[0];
+      return false;
+    }
+    return lookup.child_id_ != INVALID_PAGE_ID;
+  };
+  // one turn of lookup, false once it is done. progress is set if it pinned
+  // or read a page
+  auto step = [&](Lookup &lookup, bool wait, bool &progress) {
+    if (lookup.child_id_ != INVALID_PAGE_ID) {
+      Page *child =
+          wait ? FetchPage(lookup.child_id_)
+               : buffer_pool_manager_->FetchPageIfResident(lookup.child_id_);
+      if (child == nullptr) {
+        if (!lookup.read_ahead_)
+          buffer_pool_manager_->PrefetchPage(lookup.child_id_);
+        lookup.read_ahead_ = true;
+        return true;
+      }
+      progress = true;
+      uint64_t version = child->GetVersion();
+      // the parent still pointed to the child, the root is still the root
+      bool valid = (version & 1) == 0 &&
+                   (lookup.page_ == nullptr
+                        ? root_page_id_ == lookup.child_id_
+                        : lookup.page_->ValidateVersion(lookup.version_));
+      if (lookup.page_ != nullptr)
+        buffer_pool_manager_->UnpinPage(lookup.page_->GetPageId(), false);
+      lookup.page_ = child;
+      lookup.version_ = version;
+      lookup.child_id_ = INVALID_PAGE_ID;
+      lookup.read_ahead_ = false;
+      if (!valid)
+        return restart(lookup);
+      // the header and the first probe of the binary search
+      __builtin_prefetch(child->GetData());
+      __builtin_prefetch(child->GetData() + PAGE_SIZE / 2);
+      return true;
+    }
+
+    progress = true;
+    const KeyType &key = keys[lookup.key_];
+    auto node = reinterpret_cast<BPlusTreePage *>(lookup.page_->GetData());
+    if (!node->IsLeafPage()) {
+      auto internal = reinterpret_cast<
+          BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
+      page_id_t child_id = internal->Lookup(key, comparator_);
+      if (!lookup.page_->ValidateVersion(lookup.version_))
+        return restart(lookup);
+      lookup.child_id_ = child_id;
+      return true;
+    }
+    auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(node);
+    ValueType value;
+    bool leaf_found = leaf->Lookup(key, value, comparator_);
+    if (!lookup.page_->ValidateVersion(lookup.version_))
+      return restart(lookup);
+    buffer_pool_manager_->UnpinPage(lookup.page_->GetPageId(), false);
+    lookup.page_ = nullptr;
+    hits[lookup.key_] = leaf_found;
+    if (leaf_found)
+      values[lookup.key_] = value;
+    return false;
+  };
+
+  std::vector<Lookup> lookups;
+  size_t next_key = 0;
+  group = std::max<size_t>(group, 1);
+  while (next_key < keys.size() || !lookups.empty()) {
+    while (lookups.size() < group && next_key < keys.size()) {
+      Lookup lookup{next_key++, nullptr, 0, root_page_id_, false, 0};
+      if (lookup.child_id_ != INVALID_PAGE_ID)
+        lookups.push_back(lookup);
+    }
+    bool progress = false;
+    for (size_t i = 0; i < lookups.size();) {
+      if (step(lookups[i], false, progress)) {
+        ++i;
+      } else {
+        lookups[i] = lookups.back();
+        lookups.pop_back();
+      }
+    }
+    if (!progress && !lookups.empty() && !step(lookups[0], true, progress)) {
+      lookups[0] = lookups.back();
+      lookups.pop_back();
+    }
+  }
+
+  size_t count = 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (hits[i]) {
+      result.push_back(values[i]);
+      ++count;
+    }
+  }
+  if (found != nullptr)
+    *found = std::move(hits);
+  return count;
+}
+
+/*
+ * Optimistic lock coupling: nothing read from a page is used before its
+ * version is validated, a child id is only followed once the parent is known
+ * to be unchanged. As long as a page is pinned its type does not change and
+ * its size stays in bounds, so what is read from a changing page is wrong at
+ * worst, never out of the page. A page reached through a swizzled reference
+ * is not pinned but read inside an epoch, its frame is not refilled then.
+ * @return : false means a version changed and the lookup has to restart
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::OptimisticGetValue(const KeyType &key,
+                                        std::vector<ValueType> &result,
+                                        bool &found) {
+  found = false;
+  page_id_t page_id = root_page_id_;
+  if (page_id == INVALID_PAGE_ID)
+    return true;
+  bool swizzling = buffer_pool_manager_->IsSwizzling();
+  // the page is pinned unless it was reached through a swizzled reference,
+  // it is read inside an epoch then
+  bool pinned = false;
+  bool in_epoch = false;
+  // a pinned parent left while inside, unpinned once outside
+  page_id_t unpin_id = INVALID_PAGE_ID;
+  auto exit_epoch = [&] {
+    if (in_epoch) {
+      BufferPoolManager::ExitEpoch();
+      in_epoch = false;
+    }
+    if (unpin_id != INVALID_PAGE_ID) {
+      buffer_pool_manager_->UnpinPage(unpin_id, false);
+      unpin_id = INVALID_PAGE_ID;
+    }
+  };
+  Page *page = nullptr;
+  uint64_t version = 0;
+  if (swizzling) {
+    BufferPoolManager::EnterEpoch();
+    in_epoch = true;
+    page = root_frame_.load(std::memory_order_relaxed);
+    if (page != nullptr &&
+        !BufferPoolManager::ReadSwizzled(page, page_id, version))
+      page = nullptr;
+  }
+  if (page == nullptr) {
+    exit_epoch();
+    page = FetchPage(page_id);
+    pinned = true;
+    version = page->GetVersion();
+    if (swizzling)
+      root_frame_.store(page, std::memory_order_relaxed);
+  }
+  // changing the root latches the old one, its version tells
+  if ((version & 1) != 0 || root_page_id_ != page_id) {
+    exit_epoch();
+    if (pinned)
+      buffer_pool_manager_->UnpinPage(page_id, false);
+    return false;
+  }
+
+  auto node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+  while (!node->IsLeafPage()) {
+    auto internal = reinterpret_cast<
+        BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
+    int index;
+    page_id_t child_id = internal->Lookup(key, comparator_, index);
+    if (!page->ValidateVersion(version)) {
+      exit_epoch();
+      if (pinned)
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+      return false;
+    }
+    Page *child_page = nullptr;
+    uint64_t child_version = 0;
+    if (swizzling) {
+      if (!in_epoch) {
+        BufferPoolManager::EnterEpoch();
+        in_epoch = true;
+      }
+      child_page = buffer_pool_manager_->GetSwizzled(page, index);
+      if (child_page != nullptr &&
+          !BufferPoolManager::ReadSwizzled(child_page, child_id,
+                                           child_version))
+        child_page = nullptr;
+    }
+    bool child_pinned = child_page == nullptr;
+    if (child_pinned) {
+      // the parent is only validated from here on, which reads no data
+      exit_epoch();
+      child_page = FetchPage(child_id);
+      child_version = child_page->GetVersion();
+    }
+    // the parent still pointed to the child when its version was read
+    bool valid = (child_version & 1) == 0 && page->ValidateVersion(version);
+    if (valid && swizzling && child_pinned)
+      buffer_pool_manager_->Swizzle(page, index, child_page);
+    if (pinned) {
+      if (in_epoch)
+        unpin_id = page->GetPageId();
+      else
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    }
+    if (!valid) {
+      exit_epoch();
+      if (child_pinned)
+        buffer_pool_manager_->UnpinPage(child_id, false);
+      return false;
+    }
+    page = child_page;
+    pinned = child_pinned;
+    version = child_version;
+    node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+  }
+
+  auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(node);
+  page_id = page->GetPageId();
+  uint32_t generation = adaptive_hash_.GetGeneration(page_id);
+  ValueType value;
+  int slot;
+  bool leaf_found = leaf->Lookup(key, value, comparator_, &slot);
+  bool valid = page->ValidateVersion(version);
+  exit_epoch();
+  if (pinned)
+    buffer_pool_manager_->UnpinPage(page_id, false);
+  if (!valid)
+    return false;
+  if (leaf_found) {
+    result.push_back(value);
+    if (!buffer_pool_manager_->IsSwizzling())
+      adaptive_hash_.RecordSearch(key, page_id, slot, generation);
+  }
+  found = leaf_found;
+  return true;
 }
 
 /*****************************************************************************
@@ -53,7 +510,54 @@ bool BPLUSTREE_TYPE::GetValue(const KeyType &key,
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value,
                             Transaction *transaction) {
-  return false;
+  LATENCY_TIMER(LatencyType::BTREE_INSERT);
+  if (buffer_size_ > 0)
+    return BufferMessage(key, &value);
+  return TreeInsert(key, value, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::TreeInsert(const KeyType &key, const ValueType &value,
+                                Transaction *transaction) {
+  if (optimistic_) {
+    bool inserted;
+    if (OptimisticInsert(key, value, inserted))
+      return inserted;
+    ++optimistic_restarts_;
+  }
+  Transaction local_transaction(INVALID_TXN_ID);
+  if (transaction == nullptr)
+    transaction = &local_transaction;
+  return InsertIntoLeaf(key, value, transaction);
+}
+
+/*
+ * Insert if the leaf has room for one more entry. Duplicate keys are found
+ * here as well.
+ * @return: false means the tree was empty or the leaf full, the insert has to
+ * be done pessimistically
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::OptimisticInsert(const KeyType &key,
+                                      const ValueType &value, bool &inserted) {
+  Page *page = FindLeaf(key, false, Operation::INSERT, nullptr, true);
+  if (page == nullptr)
+    return false;
+  auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
+  bool done = true;
+  inserted = false;
+  ValueType old_value;
+  if (leaf->Lookup(key, old_value, comparator_)) {
+    // duplicate
+  } else if (leaf->HasRoomFor(key)) {
+    leaf->Insert(key, value, comparator_);
+    inserted = true;
+  } else {
+    done = false;
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page->GetPageId(), inserted);
+  return done;
 }
 /*
  * Insert constant key & value pair into an empty tree
@@ -62,7 +566,15 @@ bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value,
  * tree's root page id and insert entry directly into leaf page.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value) {}
+void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value) {
+  page_id_t page_id;
+  auto root = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(NewPage(page_id));
+  root->Init(page_id);
+  root->Insert(key, value, comparator_);
+  root_page_id_ = page_id;
+  UpdateRootPageId();
+  buffer_pool_manager_->UnpinPage(page_id, true);
+}
 
 /*
  * Insert constant key & value pair into leaf page
@@ -75,7 +587,141 @@ void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value) {}
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::InsertIntoLeaf(const KeyType &key, const ValueType &value,
                                     Transaction *transaction) {
-  return false;
+  Page *page = FindLeaf(key, false, Operation::INSERT, transaction);
+  if (page == nullptr) {
+    // root_latch_ is held
+    StartNewTree(key, value);
+    ReleasePageSet(transaction, true);
+    return true;
+  }
+  auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
+  ValueType old_value;
+  if (leaf->Lookup(key, old_value, comparator_)) {
+    ReleasePageSet(transaction, false);
+    return false;
+  }
+  if (leaf->HasRoomFor(key)) {
+    leaf->Insert(key, value, comparator_);
+    ReleasePageSet(transaction, true);
+    return true;
+  }
+  deferred_links.clear();
+  SplitLeaf(leaf, key, value, transaction);
+  ReleasePageSet(transaction, true);
+  LinkDeferredPages();
+  return true;
+}
+
+/*
+ * Split a leaf that has no room for key and insert key & value. A key that
+ * does not share the bytes of the other keys widens all entries of its page,
+ * so the leaf is split in the middle only if the half key goes to has room for
+ * it, else right before key. If key fits with neither part it gets a leaf of
+ * its own between them: two entries go into the parent, IsSafe keeps room for
+ * them.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::SplitLeaf(B_PLUS_TREE_LEAF_PAGE_TYPE *leaf,
+                               const KeyType &key, const ValueType &value,
+                               Transaction *transaction) {
+  int index = leaf->KeyIndex(key, comparator_);
+  bool key_left;
+  int split = leaf->SplitIndex(key, index, key_left);
+  page_id_t page_id;
+  adaptive_hash_.InvalidatePage(leaf->GetPageId());
+  // not reachable by other threads before its parent points to it
+  auto new_leaf =
+      reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(NewPage(page_id));
+  new_leaf->Init(page_id, leaf->GetParentPageId());
+  CMUDB_PROBE2(btree_split, leaf->GetPageId(), page_id);
+  leaf->MoveTailTo(new_leaf, split == -1 ? index : split);
+  LinkPrevPage(new_leaf->GetNextPageId(), page_id);
+  if (split != -1)
+    (key_left ? leaf : new_leaf)->Insert(key, value, comparator_);
+  InsertIntoParent(leaf, new_leaf->KeyAt(0), new_leaf, transaction);
+  buffer_pool_manager_->UnpinPage(page_id, true);
+  if (split != -1)
+    return;
+
+  auto key_leaf =
+      reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(NewPage(page_id));
+  key_leaf->Init(page_id, leaf->GetParentPageId());
+  CMUDB_PROBE2(btree_split, leaf->GetPageId(), page_id);
+  leaf->MoveTailTo(key_leaf, leaf->GetSize());
+  LinkPrevPage(key_leaf->GetNextPageId(), page_id);
+  key_leaf->Insert(key, value, comparator_);
+  InsertIntoParent(leaf, key, key_leaf, transaction);
+  buffer_pool_manager_->UnpinPage(page_id, true);
+}
+
+/*
+ * The page is only try latched: it is the right neighbor of leaves the
+ * writer holds, latching it could wait for a writer going right to left
+ * (a merge holds its leaf and latches the left neighbor, then the parents).
+ * A link left stale meanwhile is not followed by readers, see
+ * page/b_plus_tree_leaf_page.h
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LinkPrevPage(page_id_t page_id, page_id_t prev_page_id) {
+  if (page_id == INVALID_PAGE_ID)
+    return;
+  Page *page = buffer_pool_manager_->FetchPage(page_id);
+  if (page == nullptr)
+    return;
+  bool latched = page->TryWLatch();
+  if (latched) {
+    reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData())
+        ->SetPrevPageId(prev_page_id);
+    page->WUnlatch();
+  } else {
+    deferred_links.emplace_back(page_id, prev_page_id);
+  }
+  buffer_pool_manager_->UnpinPage(page_id, latched);
+}
+
+/*
+ * The previous leaf is read latched and unlatched before the leaf is write
+ * latched, no latch is waited for while another is held. The link is made
+ * once no writer latched the previous leaf in between, its next page is
+ * still the leaf then. It is read again until then, a writer that moved its
+ * next page made its own link
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LinkDeferredPages() {
+  for (auto &link : deferred_links) {
+    page_id_t page_id = link.first;
+    page_id_t prev_page_id = link.second;
+    Page *prev_page = buffer_pool_manager_->FetchPage(prev_page_id);
+    if (prev_page == nullptr)
+      continue;
+    auto prev_leaf =
+        reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(prev_page->GetData());
+    Page *page = nullptr;
+    bool linked = false;
+    while (!linked) {
+      prev_page->RLatch();
+      bool is_next =
+          prev_leaf->IsLeafPage() && prev_leaf->GetNextPageId() == page_id;
+      uint64_t version = prev_page->GetVersion();
+      prev_page->RUnlatch();
+      if (!is_next)
+        break;
+      if (page == nullptr)
+        page = buffer_pool_manager_->FetchPage(page_id);
+      if (page == nullptr)
+        break;
+      page->WLatch();
+      linked = prev_page->ValidateVersion(version);
+      if (linked)
+        reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData())
+            ->SetPrevPageId(prev_page_id);
+      page->WUnlatch();
+    }
+    if (page != nullptr)
+      buffer_pool_manager_->UnpinPage(page_id, linked);
+    buffer_pool_manager_->UnpinPage(prev_page_id, false);
+  }
+  deferred_links.clear();
 }
 
 /*
@@ -86,7 +732,15 @@ bool BPLUSTREE_TYPE::InsertIntoLeaf(const KeyType &key, const ValueType &value,
  * of key & value pairs from input page to newly created page
  */
 INDEX_TEMPLATE_ARGUMENTS
-template <typename N> N *BPLUSTREE_TYPE::Split(N *node) { return nullptr; }
+template <typename N> N *BPLUSTREE_TYPE::Split(N *node) {
+  page_id_t page_id;
+  // not reachable by other threads before its parent points to it
+  N *new_node = reinterpret_cast<N *>(NewPage(page_id));
+  new_node->Init(page_id, node->GetParentPageId());
+  CMUDB_PROBE2(btree_split, node->GetPageId(), page_id);
+  node->MoveHalfTo(new_node, buffer_pool_manager_);
+  return new_node;
+}
 
 /*
  * Insert key & value pair into internal page after split
@@ -101,7 +755,157 @@ INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node,
                                       const KeyType &key,
                                       BPlusTreePage *new_node,
-                                      Transaction *transaction) {}
+                                      Transaction *transaction) {
+  if (old_node->IsRootPage()) {
+    // a full root is unsafe, root_latch_ is held
+    page_id_t page_id;
+    auto root = reinterpret_cast<
+        BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(
+        NewPage(page_id));
+    root->Init(page_id);
+    root->PopulateNewRoot(old_node->GetPageId(), key, new_node->GetPageId());
+    old_node->SetParentPageId(page_id);
+    new_node->SetParentPageId(page_id);
+    root_page_id_ = page_id;
+    UpdateRootPageId();
+    buffer_pool_manager_->UnpinPage(page_id, true);
+    return;
+  }
+
+  // the parent is write latched in the page set
+  Page *page = FetchPage(old_node->GetParentPageId());
+  auto parent =
+      reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator>
+                           *>(page->GetData());
+  parent->InsertNodeAfter(old_node->GetPageId(), key, new_node->GetPageId());
+  if (parent->GetSize() > parent->GetMaxSize()) {
+    auto new_parent = Split(parent);
+    InsertIntoParent(parent, new_parent->KeyAt(0), new_parent, transaction);
+    buffer_pool_manager_->UnpinPage(new_parent->GetPageId(), true);
+  }
+  buffer_pool_manager_->UnpinPage(parent->GetPageId(), true);
+}
+
+/*
+ * Build the tree bottom up: leaves are filled left to right and linked, then
+ * each internal level is built over the first keys of the level below, until
+ * one page is left for the root. Every page is written once, with no descent
+ * and no split.
+ * @return: false if the tree is not empty or the keys are not strictly
+ * increasing
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::BulkLoad(const std::vector<MappingType> &items,
+                              double fill_factor) {
+  for (size_t i = 1; i < items.size(); ++i) {
+    if (comparator_(items[i - 1].first, items[i].first) >= 0)
+      return false;
+  }
+  size_t next_item = 0;
+  return BulkLoad(
+      [&](MappingType &item) {
+        if (next_item == items.size())
+          return false;
+        item = items[next_item++];
+        return true;
+      },
+      fill_factor);
+}
+
+/*
+ * Only the leaf being filled and the first keys of the level are held, the
+ * items need not be in memory all at once
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::BulkLoad(const std::function<bool(MappingType &)> &next,
+                              double fill_factor) {
+  fill_factor = std::min(1.0, std::max(0.5, fill_factor));
+  root_latch_.WLock();
+  MappingType item;
+  bool has_item = IsEmpty() && next(item);
+  if (!has_item) {
+    bool empty = IsEmpty();
+    root_latch_.WUnlock();
+    return empty;
+  }
+
+  // (first key, page id) of the pages of the level just built
+  std::vector<std::pair<KeyType, page_id_t>> level;
+  std::vector<int> sizes;
+  B_PLUS_TREE_LEAF_PAGE_TYPE *prev_leaf = nullptr;
+  while (has_item) {
+    page_id_t page_id;
+    auto leaf =
+        reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(NewPage(page_id));
+    leaf->Init(page_id);
+    if (prev_leaf != nullptr) {
+      prev_leaf->SetNextPageId(page_id);
+      leaf->SetPrevPageId(prev_leaf->GetPageId());
+      buffer_pool_manager_->UnpinPage(prev_leaf->GetPageId(), true);
+    }
+    level.emplace_back(item.first, page_id);
+    // how many entries fit depends on the bytes their keys share
+    do {
+      leaf->Insert(item.first, item.second, comparator_);
+      has_item = next(item);
+    } while (has_item && leaf->HasRoomFor(item.first, fill_factor));
+    prev_leaf = leaf;
+  }
+  buffer_pool_manager_->UnpinPage(prev_leaf->GetPageId(), true);
+
+  while (level.size() > 1) {
+    std::vector<std::pair<KeyType, page_id_t>> parent_level;
+    sizes.clear();
+    size_t next_child = 0;
+    while (next_child < level.size()) {
+      page_id_t page_id;
+      auto internal = reinterpret_cast<
+          BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(
+          NewPage(page_id));
+      internal->Init(page_id);
+      if (sizes.empty())
+        sizes = PageSizes(
+            level.size(),
+            static_cast<int>(internal->GetMaxSize() * fill_factor));
+      int size = sizes[parent_level.size()];
+      assert(size >= 2);
+      parent_level.emplace_back(level[next_child].first, page_id);
+      internal->PopulateNewRoot(level[next_child].second,
+                                level[next_child + 1].first,
+                                level[next_child + 1].second);
+      for (int i = 2; i < size; ++i)
+        internal->InsertNodeAfter(level[next_child + i - 1].second,
+                                  level[next_child + i].first,
+                                  level[next_child + i].second);
+      for (int i = 0; i < size; ++i) {
+        Page *child = FetchPage(level[next_child + i].second);
+        reinterpret_cast<BPlusTreePage *>(child->GetData())
+            ->SetParentPageId(page_id);
+        buffer_pool_manager_->UnpinPage(child->GetPageId(), true);
+      }
+      next_child += size;
+      buffer_pool_manager_->UnpinPage(page_id, true);
+    }
+    level.swap(parent_level);
+  }
+
+  root_page_id_ = level[0].second;
+  UpdateRootPageId();
+  root_latch_.WUnlock();
+  return true;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+std::vector<int> BPLUSTREE_TYPE::PageSizes(int count, int per_page) {
+  // internal pages need two children
+  per_page = std::max(per_page, 2);
+  int pages = (count + per_page - 1) / per_page;
+  pages = std::max(1, std::min(pages, count / 2));
+  std::vector<int> sizes(pages, count / pages);
+  for (int i = 0; i < count % pages; ++i)
+    ++sizes[i];
+  return sizes;
+}
 
 /*****************************************************************************
  * REMOVE
@@ -114,7 +918,72 @@ void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node,
  * necessary.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction) {}
+void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction) {
+  LATENCY_TIMER(LatencyType::BTREE_REMOVE);
+  if (buffer_size_ > 0) {
+    BufferMessage(key, nullptr);
+    return;
+  }
+  TreeRemove(key, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::TreeRemove(const KeyType &key, Transaction *transaction) {
+  if (optimistic_) {
+    if (OptimisticRemove(key))
+      return;
+    ++optimistic_restarts_;
+  }
+  Transaction local_transaction(INVALID_TXN_ID);
+  if (transaction == nullptr)
+    transaction = &local_transaction;
+  Page *page = FindLeaf(key, false, Operation::DELETE, transaction);
+  if (page == nullptr) {
+    ReleasePageSet(transaction, false);
+    return;
+  }
+  auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
+  int size = leaf->GetSize();
+  if (leaf->RemoveAndDeleteRecord(key, comparator_) == size) {
+    ReleasePageSet(transaction, false);
+    return;
+  }
+  deferred_links.clear();
+  if (leaf->GetSize() < leaf->GetMinSize() &&
+      CoalesceOrRedistribute(leaf, transaction))
+    transaction->AddIntoDeletedPageSet(leaf->GetPageId());
+  ReleasePageSet(transaction, true);
+  LinkDeferredPages();
+  DeletePages(transaction);
+}
+
+/*
+ * Remove if the leaf stays at least half full. Missing keys are found here as
+ * well.
+ * @return: false means the leaf would underflow, the remove has to be done
+ * pessimistically
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::OptimisticRemove(const KeyType &key) {
+  Page *page = FindLeaf(key, false, Operation::DELETE, nullptr, true);
+  if (page == nullptr)
+    return true;
+  auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
+  bool done = true;
+  bool removed = false;
+  ValueType value;
+  if (!leaf->Lookup(key, value, comparator_)) {
+    // nothing to remove
+  } else if (leaf->GetSize() > leaf->GetMinSize()) {
+    leaf->RemoveAndDeleteRecord(key, comparator_);
+    removed = true;
+  } else {
+    done = false;
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page->GetPageId(), removed);
+  return done;
+}
 
 /*
  * User needs to first find the sibling of input page. If sibling's size + input
@@ -126,7 +995,44 @@ void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction) {}
 INDEX_TEMPLATE_ARGUMENTS
 template <typename N>
 bool BPLUSTREE_TYPE::CoalesceOrRedistribute(N *node, Transaction *transaction) {
-  return false;
+  if (node->IsRootPage())
+    return AdjustRoot(node);
+
+  // node is unsafe, its parent is write latched in the page set
+  Page *parent_page = FetchPage(node->GetParentPageId());
+  auto parent =
+      reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator>
+                           *>(parent_page->GetData());
+  int index = parent->ValueIndex(node->GetPageId());
+  assert(index >= 0);
+  Page *neighbor_page =
+      FetchPage(parent->ValueAt(index == 0 ? 1 : index - 1));
+  neighbor_page->WLatch();
+  N *neighbor_node = reinterpret_cast<N *>(neighbor_page->GetData());
+
+  bool node_deleted = false;
+  if (node->CanMergeWith(neighbor_node)) {
+    // always merge the right one into the left one
+    N *left = neighbor_node;
+    N *right = node;
+    int right_index = index;
+    if (index == 0) {
+      std::swap(left, right);
+      right_index = 1;
+    }
+    if (Coalesce(left, right, parent, right_index, transaction))
+      transaction->AddIntoDeletedPageSet(parent->GetPageId());
+    if (right == node)
+      node_deleted = true;
+    else
+      transaction->AddIntoDeletedPageSet(neighbor_node->GetPageId());
+  } else {
+    Redistribute(neighbor_node, node, index);
+  }
+  neighbor_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(neighbor_page->GetPageId(), true);
+  buffer_pool_manager_->UnpinPage(parent_page->GetPageId(), true);
+  return node_deleted;
 }
 
 /*
@@ -147,6 +1053,20 @@ bool BPLUSTREE_TYPE::Coalesce(
     N *&neighbor_node, N *&node,
     BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *&parent,
     int index, Transaction *transaction) {
+  // here neighbor_node is the left sibling and index the one of node
+  CMUDB_PROBE2(btree_merge, neighbor_node->GetPageId(), node->GetPageId());
+  if (node->IsLeafPage()) {
+    adaptive_hash_.InvalidatePage(neighbor_node->GetPageId());
+    adaptive_hash_.InvalidatePage(node->GetPageId());
+  }
+  node->MoveAllTo(neighbor_node, index, buffer_pool_manager_);
+  if (node->IsLeafPage()) {
+    auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(neighbor_node);
+    LinkPrevPage(leaf->GetNextPageId(), leaf->GetPageId());
+  }
+  parent->Remove(index);
+  if (parent->GetSize() < parent->GetMinSize())
+    return CoalesceOrRedistribute(parent, transaction);
   return false;
 }
 
@@ -154,14 +1074,19 @@ bool BPLUSTREE_TYPE::Coalesce(
  * Redistribute key & value pairs from one page to its sibling page. If index ==
  * 0, move sibling page's first key & value pair into end of input "node",
  * otherwise move sibling page's last key & value pair into head of input
- * "node".
+ * "node". A leaf without room for the pair stays below its min size.
  * Using template N to represent either internal page or leaf page.
  * @param   neighbor_node      sibling page of input "node"
  * @param   node               input from method coalesceOrRedistribute()
  */
 INDEX_TEMPLATE_ARGUMENTS
 template <typename N>
-void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, int index) {}
+void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, int index) {
+  if (index == 0)
+    neighbor_node->MoveFirstToEndOf(node, buffer_pool_manager_);
+  else
+    neighbor_node->MoveLastToFrontOf(node, index, buffer_pool_manager_);
+}
 /*
  * Update root page if necessary
  * NOTE: size of root page can be less than min size and this method is only
@@ -174,7 +1099,28 @@ void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, int index) {}
  */
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) {
-  return false;
+  // an unsafe root, root_latch_ is held
+  if (old_root_node->IsLeafPage()) {
+    if (old_root_node->GetSize() > 0)
+      return false;
+    adaptive_hash_.InvalidatePage(old_root_node->GetPageId());
+    root_page_id_ = INVALID_PAGE_ID;
+    UpdateRootPageId();
+    return true;
+  }
+  if (old_root_node->GetSize() > 1)
+    return false;
+  auto old_root =
+      reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator>
+                           *>(old_root_node);
+  // the only child is the one just merged into, write latched by us
+  root_page_id_ = old_root->RemoveAndReturnOnlyChild();
+  UpdateRootPageId();
+  Page *page = FetchPage(root_page_id_);
+  reinterpret_cast<BPlusTreePage *>(page->GetData())
+      ->SetParentPageId(INVALID_PAGE_ID);
+  buffer_pool_manager_->UnpinPage(root_page_id_, true);
+  return true;
 }
 
 /*****************************************************************************
@@ -186,7 +1132,14 @@ bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) {
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() { return INDEXITERATOR_TYPE(); }
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() {
+  Flush();
+  std::vector<page_id_t> next_leaves;
+  Page *page = FindLeaf(KeyType(), true, Operation::READ, nullptr, false,
+                        false, &next_leaves);
+  return INDEXITERATOR_TYPE(page, 0, buffer_pool_manager_, &comparator_,
+                            std::move(next_leaves));
+}
 
 /*
  * Input parameter is low key, find the leaf page that contains the input key
@@ -195,7 +1148,139 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() { return INDEXITERATOR_TYPE(); }
  */
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key) {
-  return INDEXITERATOR_TYPE();
+  Flush();
+  std::vector<page_id_t> next_leaves;
+  Page *page = FindLeaf(key, false, Operation::READ, nullptr, false, false,
+                        &next_leaves);
+  if (page == nullptr)
+    return INDEXITERATOR_TYPE();
+  auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
+  return INDEXITERATOR_TYPE(page, leaf->KeyIndex(key, comparator_),
+                            buffer_pool_manager_, &comparator_,
+                            std::move(next_leaves));
+}
+
+/*
+ * Descend along the last child of every internal page, the iterator stands on
+ * the last entry of the right most leaf
+ */
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::Last() {
+  Flush();
+  Page *page = FindLeaf(KeyType(), false, Operation::READ, nullptr, false,
+                        true);
+  if (page == nullptr)
+    return INDEXITERATOR_TYPE();
+  auto leaf = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
+  return INDEXITERATOR_TYPE(page, std::max(leaf->GetSize() - 1, 0),
+                            buffer_pool_manager_, &comparator_);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+REVERSE_INDEXITERATOR_TYPE BPLUSTREE_TYPE::RBegin() {
+  Flush();
+  return REVERSE_INDEXITERATOR_TYPE(this, nullptr, false);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+REVERSE_INDEXITERATOR_TYPE BPLUSTREE_TYPE::RBegin(const KeyType &key,
+                                                  bool inclusive) {
+  Flush();
+  return REVERSE_INDEXITERATOR_TYPE(this, &key, inclusive);
+}
+
+/*
+ * The sizes of the leaves from the left most one, each is let go before the
+ * next one is latched as the iterator does
+ */
+INDEX_TEMPLATE_ARGUMENTS
+size_t BPLUSTREE_TYPE::GetEntryCount() {
+  Flush();
+  Page *page = FindLeaf(KeyType(), true, Operation::READ);
+  size_t count = 0;
+  while (page != nullptr) {
+    auto leaf =
+        reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
+    count += leaf->GetSize();
+    page_id_t next_page_id = leaf->GetNextPageId();
+    Page *next_page =
+        next_page_id == INVALID_PAGE_ID ? nullptr : FetchPage(next_page_id);
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    if (next_page != nullptr)
+      next_page->RLatch();
+    page = next_page;
+  }
+  return count;
+}
+
+/*****************************************************************************
+ * BUFFERED MODE
+ *****************************************************************************/
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::SetBufferSize(size_t size) {
+  buffer_latch_.WLock();
+  if (size == 0)
+    FlushBuffer();
+  buffer_size_ = size;
+  buffer_latch_.WUnlock();
+}
+
+/*
+ * A message folds into the one its key has: a remove replaces anything, an
+ * insert after a remove becomes a put, and an insert after an insert or put
+ * finds the key present
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::BufferMessage(const KeyType &key,
+                                   const ValueType *value) {
+  buffer_latch_.WLock();
+  bool done = true;
+  auto it = buffer_.find(key);
+  if (value == nullptr) {
+    if (it == buffer_.end())
+      buffer_.emplace(key, Message{MessageType::DELETE, ValueType()});
+    else
+      it->second.type_ = MessageType::DELETE;
+  } else if (it == buffer_.end()) {
+    buffer_.emplace(key, Message{MessageType::INSERT, *value});
+  } else if (it->second.type_ == MessageType::DELETE) {
+    it->second = Message{MessageType::PUT, *value};
+  } else {
+    done = false;
+  }
+  if (buffer_.size() >= buffer_size_)
+    FlushBuffer();
+  buffer_latch_.WUnlock();
+  return done;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::Flush() {
+  if (buffer_size_ == 0)
+    return;
+  buffer_latch_.WLock();
+  FlushBuffer();
+  buffer_latch_.WUnlock();
+}
+
+/*
+ * Neighbouring messages go to the same leaf, it stays in the pool between
+ * them and is written back once for all of them
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::FlushBuffer() {
+  if (buffer_.empty())
+    return;
+  Transaction transaction(INVALID_TXN_ID);
+  for (auto &message : buffer_) {
+    if (message.second.type_ != MessageType::INSERT)
+      TreeRemove(message.first, &transaction);
+    if (message.second.type_ != MessageType::DELETE)
+      TreeInsert(message.first, message.second.value_, &transaction);
+  }
+  buffer_.clear();
+  ++buffer_flushes_;
 }
 
 /*****************************************************************************
@@ -208,28 +1293,205 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key) {
 INDEX_TEMPLATE_ARGUMENTS
 B_PLUS_TREE_LEAF_PAGE_TYPE *BPLUSTREE_TYPE::FindLeafPage(const KeyType &key,
                                                          bool leftMost) {
-  return nullptr;
+  Page *page = FindLeaf(key, leftMost, Operation::READ);
+  if (page == nullptr)
+    return nullptr;
+  page->RUnlatch();
+  return reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
 }
 
 /*
- * Update/Insert root page id in header page(where page_id = 0, header_page is
- * defined under include/page/header_page.h)
- * Call this method everytime root page id is changed.
- * @parameter: insert_record      defualt value is false. When set to true,
- * insert a record <index_name, root_page_id> into header page instead of
- * updating it.
+ * Readers and optimistic writers crab down with read latches, the leaf of an
+ * optimistic writer is write latched. root_latch_ is only held until the root
+ * page is latched: a new root or a collapsing root needs the old one write
+ * latched.
+ * Pessimistic writers write latch root_latch_ and every page on the way into
+ * the page set, dropping the ancestors whenever a page is safe.
+ * The type of a pinned page is read before latching it, it never changes as
+ * long as the page is in the tree.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::UpdateRootPageId(int insert_record) {
-  HeaderPage *header_page = static_cast<HeaderPage *>(
-      buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
-  if (insert_record)
-    // create a new record<index_name + root_page_id> in header_page
-    header_page->InsertRecord(index_name_, root_page_id_);
-  else
-    // update root_page_id in header_page
-    header_page->UpdateRecord(index_name_, root_page_id_);
-  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+Page *BPLUSTREE_TYPE::FindLeaf(const KeyType &key, bool left_most,
+                               Operation op, Transaction *transaction,
+                               bool optimistic, bool right_most,
+                               std::vector<page_id_t> *next_leaves) {
+  bool exclusive = op != Operation::READ && !optimistic;
+  if (exclusive) {
+    root_latch_.WLock();
+    transaction->AddIntoPageSet(nullptr);
+  } else {
+    root_latch_.RLock();
+  }
+  if (root_page_id_ == INVALID_PAGE_ID) {
+    if (!exclusive)
+      root_latch_.RUnlock();
+    return nullptr;
+  }
+
+  Page *page = FetchPage(root_page_id_);
+  auto node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+  if (exclusive) {
+    page->WLatch();
+  } else {
+    if (optimistic && node->IsLeafPage())
+      page->WLatch();
+    else
+      page->RLatch();
+    root_latch_.RUnlock();
+  }
+
+  while (true) {
+    if (exclusive) {
+      if (IsSafe(node, op, key))
+        ReleasePageSet(transaction, false);
+      transaction->AddIntoPageSet(page);
+    }
+    if (node->IsLeafPage())
+      return page;
+
+    auto internal = reinterpret_cast<
+        BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
+    page_id_t child_id =
+        left_most    ? internal->ValueAt(0)
+        : right_most ? internal->ValueAt(internal->GetSize() - 1)
+                     : internal->Lookup(key, comparator_);
+    Page *child_page = FetchPage(child_id);
+    auto child = reinterpret_cast<BPlusTreePage *>(child_page->GetData());
+    if (exclusive || (optimistic && child->IsLeafPage()))
+      child_page->WLatch();
+    else
+      child_page->RLatch();
+    if (next_leaves != nullptr && child->IsLeafPage()) {
+      for (int i = internal->ValueIndex(child_id) + 1;
+           i < internal->GetSize() &&
+           next_leaves->size() < LEAF_READ_AHEAD_MAX_DEPTH;
+           i++)
+        next_leaves->push_back(internal->ValueAt(i));
+    }
+    if (!exclusive) {
+      page->RUnlatch();
+      buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    }
+    page = child_page;
+    node = child;
+  }
+}
+
+/*
+ * Every internal page is left through the last child whose separator is
+ * below key, the first child has none. The separator of the child taken
+ * last bounds the keys of the leaf from below
+ */
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::FindReverseLeaf(const KeyType *key, bool inclusive,
+                                      KeyType &fence, bool &has_fence) {
+  has_fence = false;
+  root_latch_.RLock();
+  if (root_page_id_ == INVALID_PAGE_ID) {
+    root_latch_.RUnlock();
+    return nullptr;
+  }
+  Page *page = FetchPage(root_page_id_);
+  page->RLatch();
+  root_latch_.RUnlock();
+  auto node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+
+  while (!node->IsLeafPage()) {
+    auto internal = reinterpret_cast<
+        BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
+    int low = 1, high = internal->GetSize();
+    if (key != nullptr) {
+      // first index whose separator is not below key
+      while (low < high) {
+        int mid = low + (high - low) / 2;
+        int cmp = comparator_(internal->KeyAt(mid), *key);
+        if (cmp < 0 || (cmp == 0 && inclusive))
+          low = mid + 1;
+        else
+          high = mid;
+      }
+    }
+    int index = high - 1;
+    if (index > 0) {
+      fence = internal->KeyAt(index);
+      has_fence = true;
+    }
+    Page *child_page = FetchPage(internal->ValueAt(index));
+    child_page->RLatch();
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    page = child_page;
+    node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+  }
+  return page;
+}
+
+/*
+ * Safe nodes do not split on an insert below them and do not merge or borrow
+ * on a remove below them. A leaf split may insert twice into its parent.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::IsSafe(BPlusTreePage *node, Operation op,
+                            const KeyType &key) {
+  if (op == Operation::INSERT && node->IsLeafPage())
+    return reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(node)->HasRoomFor(
+        key);
+  if (op == Operation::INSERT)
+    return node->GetSize() < node->GetMaxSize() - 1;
+  if (op == Operation::DELETE)
+    return node->GetSize() > node->GetMinSize();
+  return true;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::ReleasePageSet(Transaction *transaction, bool is_dirty) {
+  auto page_set = transaction->GetPageSet();
+  for (Page *page : *page_set) {
+    if (page == nullptr) {
+      root_latch_.WUnlock();
+    } else {
+      page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(page->GetPageId(), is_dirty);
+    }
+  }
+  page_set->clear();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::DeletePages(Transaction *transaction) {
+  auto deleted_page_set = transaction->GetDeletedPageSet();
+  for (page_id_t page_id : *deleted_page_set)
+    buffer_pool_manager_->DeletePage(page_id);
+  deleted_page_set->clear();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+char *BPLUSTREE_TYPE::NewPage(page_id_t &page_id) {
+  Page *page = buffer_pool_manager_->NewPage(page_id, extent_);
+  if (page == nullptr)
+    throw Exception(EXCEPTION_TYPE_INDEX, "out of memory");
+  return page->GetData();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::FetchPage(page_id_t page_id) {
+  Page *page = buffer_pool_manager_->FetchPage(page_id);
+  if (page == nullptr)
+    throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned");
+  return page;
+}
+
+/*
+ * The flag is cleared before the root is read, a root changing meanwhile is
+ * taken by the next call
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::GetChangedRootPageId(page_id_t &root_page_id) {
+  Flush();
+  if (!root_dirty_.exchange(false))
+    return false;
+  root_page_id = root_page_id_;
+  return true;
 }
 
 /*
@@ -237,7 +1499,38 @@ void BPLUSTREE_TYPE::UpdateRootPageId(int insert_record) {
  * print out whole b+tree sturcture, rank by rank
  */
 INDEX_TEMPLATE_ARGUMENTS
-std::string BPLUSTREE_TYPE::ToString(bool verbose) { return "Empty tree"; }
+std::string BPLUSTREE_TYPE::ToString(bool verbose) {
+  if (IsEmpty())
+    return "Empty tree";
+  std::ostringstream os;
+  std::queue<BPlusTreePage *> level;
+  level.push(reinterpret_cast<BPlusTreePage *>(
+      FetchPage(root_page_id_)->GetData()));
+  while (!level.empty()) {
+    std::queue<BPlusTreePage *> next_level;
+    bool first = true;
+    while (!level.empty()) {
+      BPlusTreePage *node = level.front();
+      level.pop();
+      if (!first)
+        os << " | ";
+      first = false;
+      if (node->IsLeafPage()) {
+        os << reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(node)->ToString(
+            verbose);
+      } else {
+        auto internal = reinterpret_cast<
+            BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(node);
+        os << internal->ToString(verbose);
+        internal->QueueUpChildren(&next_level, buffer_pool_manager_);
+      }
+      buffer_pool_manager_->UnpinPage(node->GetPageId(), false);
+    }
+    os << '\n';
+    level.swap(next_level);
+  }
+  return os.str();
+}
 
 /*
  * This method is used for test only
@@ -279,5 +1572,12 @@ template class BPlusTree<GenericKey<8>, RID, GenericComparator<8>>;
 template class BPlusTree<GenericKey<16>, RID, GenericComparator<16>>;
 template class BPlusTree<GenericKey<32>, RID, GenericComparator<32>>;
 template class BPlusTree<GenericKey<64>, RID, GenericComparator<64>>;
+template class BPlusTree<GenericKey<4>, RID, IntegerComparator<4, int32_t>>;
+template class BPlusTree<GenericKey<8>, RID, IntegerComparator<8, int64_t>>;
+template class BPlusTree<GenericKey<4>, RID, CompositeIntegerComparator<4>>;
+template class BPlusTree<GenericKey<8>, RID, CompositeIntegerComparator<8>>;
+template class BPlusTree<GenericKey<16>, RID, CompositeIntegerComparator<16>>;
+template class BPlusTree<GenericKey<32>, RID, CompositeIntegerComparator<32>>;
+template class BPlusTree<GenericKey<64>, RID, CompositeIntegerComparator<64>>;
 
 } // namespace cmudb
@@ -2,6 +2,14 @@
  * b_plus_tree_index.cpp
  */
 
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <queue>
+#include <thread>
+
+#include "execution/external_sort.h"
 #include "index/b_plus_tree_index.h"
 
 namespace cmudb {
@@ -11,44 +19,502 @@ namespace cmudb {
 INDEX_TEMPLATE_ARGUMENTS
 BPLUSTREE_INDEX_TYPE::BPlusTreeIndex(IndexMetadata *metadata,
                                      BufferPoolManager *buffer_pool_manager,
-                                     page_id_t root_page_id)
-    : Index(metadata), comparator_(metadata->GetKeySchema()),
+                                     page_id_t root_page_id,
+                                     page_id_t bloom_page_id,
+                                     int tablespace_id)
+    : Index(metadata), comparator_(metadata->GetEntrySchema()),
       container_(metadata->GetName(), buffer_pool_manager, comparator_,
-                 root_page_id) {}
+                 root_page_id, tablespace_id),
+      buffer_pool_manager_(buffer_pool_manager),
+      bloom_page_id_(bloom_page_id), tablespace_id_(tablespace_id) {
+  if (metadata->IsBuffered())
+    container_.SetBufferSize(BPLUSTREE_BUFFER_SIZE);
+  if (!metadata->HasBloomFilter())
+    return;
+  if (bloom_page_id != INVALID_PAGE_ID)
+    bloom_filter_.reset(
+        BlockedBloomFilter::Read(buffer_pool_manager, bloom_page_id));
+  if (bloom_filter_ == nullptr)
+    RebuildBloomFilter();
+}
+
+/*
+ * The key columns are inlined, see ParseIndexStatement, and at the same
+ * offsets in a key, a stored tuple and a leaf entry
+ */
+INDEX_TEMPLATE_ARGUMENTS
+uint64_t BPLUSTREE_INDEX_TYPE::HashKey(const char *key) const {
+  Schema *key_schema = GetKeySchema();
+  char bytes[sizeof(KeyType)];
+  size_t size = std::min<size_t>(key_schema->GetLength(), sizeof(KeyType));
+  memcpy(bytes, key, size);
+  for (int i = 0; i < key_schema->GetColumnCount(); i++) {
+    if (key_schema->GetType(i) != TypeId::DECIMAL)
+      continue;
+    double *value = reinterpret_cast<double *>(bytes + key_schema->GetOffset(i));
+    if (*value == 0)
+      *value = 0.0;
+  }
+  return BlockedBloomFilter::Hash(bytes, size);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::MayContainKey(const Tuple &key) const {
+  if (!GetMetadata()->HasBloomFilter())
+    return true;
+  uint64_t hash = HashKey(key.GetData());
+  bloom_latch_.RLock();
+  bool may_contain = bloom_filter_->MayContain(hash);
+  bloom_latch_.RUnlock();
+  return may_contain;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::RebuildBloomFilter() {
+  bloom_latch_.WLock();
+  std::unique_ptr<BlockedBloomFilter> filter(
+      new BlockedBloomFilter(container_.GetEntryCount() * 2));
+  for (auto iterator = container_.Begin(); !iterator.isEnd(); ++iterator)
+    filter->Add(HashKey((*iterator).first.data));
+  bloom_filter_ = std::move(filter);
+  bloom_latch_.WUnlock();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::CheckBloomFilter() {
+  bloom_latch_.RLock();
+  bool full = bloom_filter_->GetKeyCount() > bloom_filter_->GetCapacity();
+  bloom_latch_.RUnlock();
+  if (full)
+    RebuildBloomFilter();
+}
+
+/*
+ * The filter is only written as the index closes, Read marked the pages it
+ * came from as not clean
+ */
+INDEX_TEMPLATE_ARGUMENTS
+page_id_t BPLUSTREE_INDEX_TYPE::WriteBloomFilter() {
+  if (bloom_filter_ == nullptr)
+    return INVALID_PAGE_ID;
+  bloom_page_id_ = bloom_filter_->Write(buffer_pool_manager_, bloom_page_id_,
+                                       tablespace_id_);
+  return bloom_page_id_;
+}
+
+/*
+ * A non-unique index orders equal keys by rid, -1 sorts before and INT64_MAX
+ * after the entries of a key. A unique index stores the tuple as it is, in
+ * both the include columns follow the key columns
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::MakeKey(const Tuple &key, int64_t rid,
+                                   KeyType &index_key, bool stored) const {
+  IndexMetadata *metadata = GetMetadata();
+  if (metadata->IsUnique()) {
+    index_key.SetFromKey(key);
+    return;
+  }
+  Schema *key_schema = metadata->GetKeySchema();
+  Schema *stored_schema = metadata->GetStoredSchema();
+  std::vector<Value> values;
+  key.GetValues(key_schema, values);
+  values.emplace_back(TypeId::BIGINT, rid);
+  // only the entry columns of a bound are compared
+  if (!stored || stored_schema == key_schema) {
+    index_key.SetFromKey(Tuple(values, metadata->GetEntrySchema()));
+    return;
+  }
+  for (int i = key_schema->GetColumnCount();
+       i < stored_schema->GetColumnCount(); i++)
+    values.push_back(key.GetValue(stored_schema, i));
+  index_key.SetFromKey(Tuple(values, metadata->GetLeafSchema()));
+}
 
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid,
                                        Transaction *transaction) {
   // construct insert index key
   KeyType index_key;
-  index_key.SetFromKey(key);
+  MakeKey(key, rid.Get(), index_key, true);
 
+  if (!LogBuildChange(true, index_key, rid))
+    InsertKey(index_key, rid, transaction);
+}
+
+/*
+ * The key columns are at the same offsets in the index key as in the stored
+ * tuple, the filter hashes them from either
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::InsertKey(const KeyType &index_key, RID rid,
+                                     Transaction *transaction) {
+  if (!GetMetadata()->HasBloomFilter()) {
+    container_.Insert(index_key, rid, transaction);
+    return;
+  }
+  // a rebuild reads the leaves after the key is in them
+  bloom_latch_.RLock();
+  bloom_filter_->Add(HashKey(index_key.data));
   container_.Insert(index_key, rid, transaction);
+  bloom_latch_.RUnlock();
+  CheckBloomFilter();
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_INDEX_TYPE::DeleteEntry(const Tuple &key,
+void BPLUSTREE_INDEX_TYPE::DeleteEntry(const Tuple &key, RID rid,
                                        Transaction *transaction) {
   // construct delete index key
   KeyType index_key;
-  index_key.SetFromKey(key);
+  MakeKey(key, rid.Get(), index_key);
 
-  container_.Remove(index_key, transaction);
+  if (!LogBuildChange(false, index_key, rid))
+    container_.Remove(index_key, transaction);
+}
+
+/*
+ * Checked again under the latch, FinishBuild clears the flag under it once
+ * the log is applied
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::LogBuildChange(bool insert,
+                                          const KeyType &index_key, RID rid) {
+  if (!building_.load(std::memory_order_acquire))
+    return false;
+  std::lock_guard<std::mutex> guard(build_latch_);
+  if (!building_.load(std::memory_order_relaxed))
+    return false;
+  build_log_.push_back({insert, index_key, rid});
+  return true;
 }
 
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_INDEX_TYPE::ScanKey(const Tuple &key, std::vector<RID> &result,
                                    Transaction *transaction) {
+  if (!MayContainKey(key))
+    return;
+  if (!GetMetadata()->IsUnique()) {
+    // the entries of the key are next to each other in the leaves
+    IndexScanIterator *iterator =
+        ScanRange(&key, true, &key, true, transaction);
+    for (; !iterator->isEnd(); iterator->Next())
+      result.push_back(iterator->GetRid());
+    delete iterator;
+    return;
+  }
   // construct scan index key
   KeyType index_key;
   index_key.SetFromKey(key);
 
   container_.GetValue(index_key, result, transaction);
 }
+
+/*
+ * The keys of a unique index are sorted and looked up together, their
+ * descents interleaved so that page misses overlap. Those of a non-unique
+ * index are ranges, scanned one by one
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::ScanKeys(const std::vector<Tuple> &keys,
+                                    std::vector<RID> &result,
+                                    Transaction *transaction) {
+  if (!GetMetadata()->IsUnique()) {
+    Index::ScanKeys(keys, result, transaction);
+    return;
+  }
+  std::vector<KeyType> index_keys;
+  index_keys.reserve(keys.size());
+  for (auto &key : keys) {
+    if (!MayContainKey(key))
+      continue;
+    index_keys.emplace_back();
+    index_keys.back().SetFromKey(key);
+  }
+  std::sort(index_keys.begin(), index_keys.end(),
+            [this](const KeyType &lhs, const KeyType &rhs) {
+              return comparator_(lhs, rhs) < 0;
+            });
+  container_.GetValuesInterleaved(index_keys, result);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+IndexScanIterator *BPLUSTREE_INDEX_TYPE::ScanRange(const Tuple *low_key,
+                                                   bool low_inclusive,
+                                                   const Tuple *high_key,
+                                                   bool high_inclusive,
+                                                   Transaction *transaction) {
+  KeyType index_key;
+  INDEXITERATOR_TYPE iterator;
+  // a range of one key is a point lookup, the filter may tell it is empty
+  if (low_key != nullptr && high_key != nullptr && low_inclusive &&
+      high_inclusive &&
+      (low_key == high_key ||
+       (low_key->GetLength() == high_key->GetLength() &&
+        memcmp(low_key->GetData(), high_key->GetData(),
+               low_key->GetLength()) == 0)) &&
+      !MayContainKey(*low_key))
+    return new BPlusTreeScanIterator<KeyType, ValueType, KeyComparator>(
+        std::move(iterator), comparator_, nullptr, false);
+  if (low_key == nullptr) {
+    iterator = container_.Begin();
+  } else {
+    MakeKey(*low_key, low_inclusive ? -1 : INT64_MAX, index_key);
+    iterator = container_.Begin(index_key);
+    // at most one equal key to skip, no entry equals the bounds of a
+    // non-unique index
+    if (!low_inclusive && !iterator.isEnd() &&
+        comparator_((*iterator).first, index_key) == 0)
+      ++iterator;
+  }
+  if (high_key != nullptr)
+    MakeKey(*high_key, high_inclusive ? INT64_MAX : -1, index_key);
+  return new BPlusTreeScanIterator<KeyType, ValueType, KeyComparator>(
+      std::move(iterator), comparator_,
+      high_key == nullptr ? nullptr : &index_key, high_inclusive);
+}
+
+// the bounds are keys as for ScanRange, the rids of a non-unique index
+// put them before or after every entry of their value
+INDEX_TEMPLATE_ARGUMENTS
+IndexScanIterator *BPLUSTREE_INDEX_TYPE::ScanRangeReverse(
+    const Tuple *low_key, bool low_inclusive, const Tuple *high_key,
+    bool high_inclusive, Transaction *transaction) {
+  KeyType index_key;
+  REVERSE_INDEXITERATOR_TYPE iterator;
+  if (high_key == nullptr) {
+    iterator = container_.RBegin();
+  } else {
+    MakeKey(*high_key, high_inclusive ? INT64_MAX : -1, index_key);
+    iterator = container_.RBegin(index_key, high_inclusive);
+  }
+  if (low_key != nullptr)
+    MakeKey(*low_key, low_inclusive ? -1 : INT64_MAX, index_key);
+  return new BPlusTreeReverseScanIterator<KeyType, ValueType, KeyComparator>(
+      std::move(iterator), comparator_,
+      low_key == nullptr ? nullptr : &index_key, low_inclusive);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+IndexScanIterator *BPLUSTREE_INDEX_TYPE::ScanLast(Transaction *transaction) {
+  return new BPlusTreeScanIterator<KeyType, ValueType, KeyComparator>(
+      container_.Last(), comparator_, nullptr, false);
+}
+
+// the leaves know their sizes, no entry is decoded
+INDEX_TEMPLATE_ARGUMENTS
+size_t BPLUSTREE_INDEX_TYPE::GetEntryCount(Transaction *transaction) {
+  return container_.GetEntryCount();
+}
+
+/*
+ * Sort the entries with an external sort and build the tree bottom up from
+ * its output, the sorted keys need not fit in memory. An index that already
+ * has entries gets them inserted one by one
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::BulkLoad(
+    const std::vector<std::pair<Tuple, RID>> &entries,
+    Transaction *transaction) {
+  if (!container_.IsEmpty()) {
+    InsertEntries(entries, transaction);
+    return;
+  }
+  ExternalSort sort(buffer_pool_manager_,
+                    [this](const char *lhs, uint32_t, const char *rhs,
+                           uint32_t) {
+                      return comparator_(
+                          *reinterpret_cast<const KeyType *>(lhs),
+                          *reinterpret_cast<const KeyType *>(rhs));
+                    });
+  std::string key_bytes;
+  for (auto &entry : entries) {
+    KeyType index_key;
+    MakeKey(entry.first, entry.second.Get(), index_key, true);
+    key_bytes.assign(reinterpret_cast<const char *>(&index_key),
+                     sizeof(KeyType));
+    sort.Add(key_bytes, reinterpret_cast<const char *>(&entry.second),
+             sizeof(ValueType));
+  }
+  sort.Sort();
+  // the sort is stable, of equal keys the first one is kept
+  bool has_last = false;
+  KeyType last_key;
+  container_.BulkLoad([&](MappingType &item) {
+    while (sort.Next()) {
+      memcpy(&item.first, sort.GetKey(), sizeof(KeyType));
+      memcpy(&item.second, sort.GetPayload(), sizeof(ValueType));
+      if (has_last && comparator_(last_key, item.first) == 0)
+        continue;
+      last_key = item.first;
+      has_last = true;
+      return true;
+    }
+    return false;
+  });
+  if (GetMetadata()->HasBloomFilter())
+    RebuildBloomFilter();
+}
+
+/*
+ * Insert in key order, consecutive entries mostly go to the leaf the one
+ * before went to, which is still in the buffer pool
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::InsertEntries(
+    const std::vector<std::pair<Tuple, RID>> &entries,
+    Transaction *transaction) {
+  if (IsBuilding()) {
+    Index::InsertEntries(entries, transaction);
+    return;
+  }
+  std::vector<MappingType> items;
+  items.reserve(entries.size());
+  for (auto &entry : entries) {
+    KeyType index_key;
+    MakeKey(entry.first, entry.second.Get(), index_key, true);
+    items.emplace_back(index_key, entry.second);
+  }
+  // stable, of equal keys of a unique index the first one wins
+  std::stable_sort(items.begin(), items.end(),
+                   [this](const MappingType &lhs, const MappingType &rhs) {
+                     return comparator_(lhs.first, rhs.first) < 0;
+                   });
+  bool bloom = GetMetadata()->HasBloomFilter();
+  if (bloom)
+    bloom_latch_.RLock();
+  for (auto &item : items) {
+    if (bloom)
+      bloom_filter_->Add(HashKey(item.first.data));
+    container_.Insert(item.first, item.second, transaction);
+  }
+  if (bloom) {
+    bloom_latch_.RUnlock();
+    CheckBloomFilter();
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::BeginBuild() {
+  if (!container_.IsEmpty())
+    return false;
+  building_.store(true, std::memory_order_release);
+  return true;
+}
+
+/*
+ * Each run is keyed and sorted on a thread of its own, then the runs are
+ * merged into the bottom up load of the tree. Of equal keys the one of the
+ * first run is kept, so an entry scanned twice goes in once. The log is
+ * applied in rounds while writers append to it, the last round under
+ * build_latch_.
+ * A logged delete from a unique index is applied only if the key still has
+ * the rid, a rolled back insert of a duplicate key logs one that is not
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::FinishBuild(
+    std::vector<std::vector<std::pair<Tuple, RID>>> &runs) {
+  assert(IsBuilding());
+  std::vector<std::vector<MappingType>> sorted(runs.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < runs.size(); i++)
+    threads.emplace_back([&, i] {
+      std::vector<MappingType> &items = sorted[i];
+      items.reserve(runs[i].size());
+      for (auto &entry : runs[i]) {
+        KeyType index_key;
+        MakeKey(entry.first, entry.second.Get(), index_key, true);
+        items.emplace_back(index_key, entry.second);
+      }
+      std::vector<std::pair<Tuple, RID>>().swap(runs[i]);
+      std::stable_sort(items.begin(), items.end(),
+                       [this](const MappingType &lhs, const MappingType &rhs) {
+                         return comparator_(lhs.first, rhs.first) < 0;
+                       });
+    });
+  for (auto &thread : threads)
+    thread.join();
+
+  // runs by their next item, the first run first of equal keys
+  std::vector<size_t> next(sorted.size(), 0);
+  auto after = [&](size_t lhs, size_t rhs) {
+    int compare =
+        comparator_(sorted[lhs][next[lhs]].first, sorted[rhs][next[rhs]].first);
+    return compare != 0 ? compare > 0 : lhs > rhs;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heads(
+      after);
+  for (size_t i = 0; i < sorted.size(); i++)
+    if (!sorted[i].empty())
+      heads.push(i);
+  bool has_last = false;
+  KeyType last_key;
+  container_.BulkLoad([&](MappingType &item) {
+    while (!heads.empty()) {
+      size_t run = heads.top();
+      heads.pop();
+      item = sorted[run][next[run]++];
+      if (next[run] < sorted[run].size())
+        heads.push(run);
+      if (has_last && comparator_(last_key, item.first) == 0)
+        continue;
+      last_key = item.first;
+      has_last = true;
+      return true;
+    }
+    return false;
+  });
+  sorted.clear();
+  if (GetMetadata()->HasBloomFilter())
+    RebuildBloomFilter();
+
+  bool unique = GetMetadata()->IsUnique();
+  auto apply = [&](const std::vector<BuildChange> &log) {
+    for (auto &change : log) {
+      if (change.insert_) {
+        InsertKey(change.key_, change.rid_, nullptr);
+        continue;
+      }
+      if (unique) {
+        std::vector<RID> rids;
+        container_.GetValue(change.key_, rids);
+        if (rids.empty() || !(rids[0] == change.rid_))
+          continue;
+      }
+      container_.Remove(change.key_);
+    }
+  };
+  for (;;) {
+    std::vector<BuildChange> log;
+    std::unique_lock<std::mutex> guard(build_latch_);
+    log.swap(build_log_);
+    if (log.size() <= INDEX_BUILD_LAST_ROUND) {
+      apply(log);
+      building_.store(false, std::memory_order_release);
+      return;
+    }
+    guard.unlock();
+    apply(log);
+  }
+}
+
 template class BPlusTreeIndex<GenericKey<4>, RID, GenericComparator<4>>;
 template class BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>;
 template class BPlusTreeIndex<GenericKey<16>, RID, GenericComparator<16>>;
 template class BPlusTreeIndex<GenericKey<32>, RID, GenericComparator<32>>;
 template class BPlusTreeIndex<GenericKey<64>, RID, GenericComparator<64>>;
+template class BPlusTreeIndex<GenericKey<4>, RID,
+                              IntegerComparator<4, int32_t>>;
+template class BPlusTreeIndex<GenericKey<8>, RID,
+                              IntegerComparator<8, int64_t>>;
+template class BPlusTreeIndex<GenericKey<4>, RID,
+                              CompositeIntegerComparator<4>>;
+template class BPlusTreeIndex<GenericKey<8>, RID,
+                              CompositeIntegerComparator<8>>;
+template class BPlusTreeIndex<GenericKey<16>, RID,
+                              CompositeIntegerComparator<16>>;
+template class BPlusTreeIndex<GenericKey<32>, RID,
+                              CompositeIntegerComparator<32>>;
+template class BPlusTreeIndex<GenericKey<64>, RID,
+                              CompositeIntegerComparator<64>>;
 
 } // namespace cmudb
@@ -0,0 +1,170 @@
+/**
+ * blocked_bloom_filter.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "common/exception.h"
+#include "index/blocked_bloom_filter.h"
+#include "table/table_stats.h"
+
+namespace cmudb {
+
+BlockedBloomFilter::BlockedBloomFilter(size_t keys)
+    : block_count_(
+          (std::max<size_t>(keys, BLOOM_MIN_KEYS) * BLOOM_BITS_PER_KEY +
+           BLOOM_BLOCK_SIZE * 8 - 1) /
+          (BLOOM_BLOCK_SIZE * 8)),
+      words_(new std::atomic<uint64_t>[block_count_ * BLOOM_BLOCK_WORDS]) {
+  for (size_t i = 0; i < block_count_ * BLOOM_BLOCK_WORDS; i++)
+    words_[i].store(0, std::memory_order_relaxed);
+}
+
+uint64_t BlockedBloomFilter::Hash(const char *data, size_t size) {
+  return HyperLogLog::Hash(data, size);
+}
+
+/*
+ * The low half of the hash times an odd constant per word, its top six bits
+ * pick the bit of the word. The high half picked the block
+ */
+void BlockedBloomFilter::Masks(uint64_t hash, uint64_t *masks) {
+  static const uint32_t salts[BLOOM_BLOCK_WORDS] = {
+      0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+      0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+  uint32_t key = static_cast<uint32_t>(hash);
+  for (int i = 0; i < BLOOM_BLOCK_WORDS; i++)
+    masks[i] = 1ULL << ((key * salts[i]) >> 26);
+}
+
+void BlockedBloomFilter::Add(uint64_t hash) {
+  uint64_t masks[BLOOM_BLOCK_WORDS];
+  Masks(hash, masks);
+  std::atomic<uint64_t> *block = &words_[Block(hash) * BLOOM_BLOCK_WORDS];
+  for (int i = 0; i < BLOOM_BLOCK_WORDS; i++)
+    block[i].fetch_or(masks[i], std::memory_order_relaxed);
+  key_count_++;
+}
+
+bool BlockedBloomFilter::MayContain(uint64_t hash) const {
+  uint64_t masks[BLOOM_BLOCK_WORDS];
+  Masks(hash, masks);
+  const std::atomic<uint64_t> *block =
+      &words_[Block(hash) * BLOOM_BLOCK_WORDS];
+  uint64_t missing = 0;
+  for (int i = 0; i < BLOOM_BLOCK_WORDS; i++)
+    missing |= ~block[i].load(std::memory_order_relaxed) & masks[i];
+  return missing == 0;
+}
+
+/*
+ * The blocks are flushed before Clean is set on the first page and it is
+ * flushed again, a crash in between leaves the chain unclean
+ */
+page_id_t BlockedBloomFilter::Write(BufferPoolManager *buffer_pool_manager,
+                                    page_id_t first_page_id,
+                                    int tablespace_id) {
+  size_t page_count =
+      (block_count_ + BLOOM_BLOCKS_PER_PAGE - 1) / BLOOM_BLOCKS_PER_PAGE;
+  std::vector<page_id_t> page_ids;
+  for (page_id_t page_id = first_page_id; page_id != INVALID_PAGE_ID;) {
+    Page *page = buffer_pool_manager->FetchPage(page_id);
+    if (page == nullptr)
+      throw Exception(EXCEPTION_TYPE_INDEX, "can't read bloom filter");
+    page_ids.push_back(page_id);
+    page_id = *reinterpret_cast<page_id_t *>(page->GetData());
+    buffer_pool_manager->UnpinPage(page_ids.back(), false);
+  }
+  if (page_ids.size() != page_count) {
+    for (page_id_t page_id : page_ids)
+      buffer_pool_manager->DeletePage(page_id);
+    page_ids.clear();
+  }
+
+  while (page_ids.size() < page_count) {
+    page_id_t page_id;
+    Page *page = buffer_pool_manager->NewPage(page_id, tablespace_id);
+    if (page == nullptr)
+      throw Exception(EXCEPTION_TYPE_INDEX, "can't write bloom filter");
+    buffer_pool_manager->UnpinPage(page_id, true);
+    page_ids.push_back(page_id);
+  }
+  for (size_t i = 0; i < page_count; i++) {
+    Page *page = buffer_pool_manager->FetchPage(page_ids[i]);
+    if (page == nullptr)
+      throw Exception(EXCEPTION_TYPE_INDEX, "can't write bloom filter");
+    char *data = page->GetData();
+    memset(data, 0, BLOOM_PAGE_HEADER_SIZE);
+    *reinterpret_cast<page_id_t *>(data) =
+        i + 1 < page_count ? page_ids[i + 1] : INVALID_PAGE_ID;
+    if (i == 0) {
+      *reinterpret_cast<uint64_t *>(data + BLOOM_COUNTS_OFFSET) = block_count_;
+      *reinterpret_cast<uint64_t *>(data + BLOOM_COUNTS_OFFSET + 8) =
+          key_count_;
+    }
+    size_t first_block = i * BLOOM_BLOCKS_PER_PAGE;
+    size_t blocks =
+        std::min<size_t>(BLOOM_BLOCKS_PER_PAGE, block_count_ - first_block);
+    auto words = reinterpret_cast<uint64_t *>(data + BLOOM_PAGE_HEADER_SIZE);
+    for (size_t j = 0; j < blocks * BLOOM_BLOCK_WORDS; j++)
+      words[j] = words_[first_block * BLOOM_BLOCK_WORDS + j].load(
+          std::memory_order_relaxed);
+    buffer_pool_manager->UnpinPage(page_ids[i], true);
+    buffer_pool_manager->FlushPage(page_ids[i]);
+  }
+  Page *page = buffer_pool_manager->FetchPage(page_ids[0]);
+  *reinterpret_cast<uint32_t *>(page->GetData() + sizeof(page_id_t)) = 1;
+  buffer_pool_manager->UnpinPage(page_ids[0], true);
+  buffer_pool_manager->FlushPage(page_ids[0]);
+  return page_ids[0];
+}
+
+BlockedBloomFilter *
+BlockedBloomFilter::Read(BufferPoolManager *buffer_pool_manager,
+                         page_id_t first_page_id) {
+  Page *page = buffer_pool_manager->FetchPage(first_page_id);
+  if (page == nullptr)
+    return nullptr;
+  char *data = page->GetData();
+  auto clean = reinterpret_cast<uint32_t *>(data + sizeof(page_id_t));
+  if (*clean == 0) {
+    buffer_pool_manager->UnpinPage(first_page_id, false);
+    return nullptr;
+  }
+  *clean = 0;
+  size_t block_count =
+      *reinterpret_cast<uint64_t *>(data + BLOOM_COUNTS_OFFSET);
+  size_t key_count =
+      *reinterpret_cast<uint64_t *>(data + BLOOM_COUNTS_OFFSET + 8);
+  buffer_pool_manager->UnpinPage(first_page_id, true);
+  buffer_pool_manager->FlushPage(first_page_id);
+
+  std::unique_ptr<BlockedBloomFilter> filter(new BlockedBloomFilter(0));
+  filter->block_count_ = block_count;
+  filter->words_.reset(
+      new std::atomic<uint64_t>[block_count * BLOOM_BLOCK_WORDS]);
+  filter->key_count_ = key_count;
+  size_t first_block = 0;
+  for (page_id_t page_id = first_page_id; first_block < block_count;) {
+    if (page_id == INVALID_PAGE_ID ||
+        (page = buffer_pool_manager->FetchPage(page_id)) == nullptr)
+      return nullptr;
+    data = page->GetData();
+    size_t blocks =
+        std::min<size_t>(BLOOM_BLOCKS_PER_PAGE, block_count - first_block);
+    auto words =
+        reinterpret_cast<const uint64_t *>(data + BLOOM_PAGE_HEADER_SIZE);
+    for (size_t j = 0; j < blocks * BLOOM_BLOCK_WORDS; j++)
+      filter->words_[first_block * BLOOM_BLOCK_WORDS + j].store(
+          words[j], std::memory_order_relaxed);
+    first_block += blocks;
+    page_id_t next_page_id = *reinterpret_cast<page_id_t *>(data);
+    buffer_pool_manager->UnpinPage(page_id, false);
+    page_id = next_page_id;
+  }
+  return filter.release();
+}
+
+} // namespace cmudb
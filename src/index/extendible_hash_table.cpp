@@ -0,0 +1,423 @@
+/**
+ * extendible_hash_table.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/exception.h"
+#include "common/rid.h"
+#include "index/extendible_hash_table.h"
+
+namespace cmudb {
+
+INDEX_TEMPLATE_ARGUMENTS
+EXTENDIBLE_HASH_TABLE_TYPE::ExtendibleHashTable(
+    const std::string &name, BufferPoolManager *buffer_pool_manager,
+    bool unique, page_id_t directory_page_id, int tablespace_id)
+    : index_name_(name), buffer_pool_manager_(buffer_pool_manager),
+      tablespace_id_(tablespace_id), unique_(unique),
+      directory_page_id_(directory_page_id) {}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::IsEmpty() const {
+  return directory_page_id_ == INVALID_PAGE_ID;
+}
+
+/*
+ * 64 bit words of the key mixed like the finalizer of MurmurHash3
+ */
+INDEX_TEMPLATE_ARGUMENTS
+uint32_t EXTENDIBLE_HASH_TABLE_TYPE::Hash(const KeyType &key) {
+  const char *data = reinterpret_cast<const char *>(&key);
+  uint64_t hash = sizeof(KeyType);
+  for (size_t offset = 0; offset < sizeof(KeyType); offset += 8) {
+    uint64_t word = 0;
+    memcpy(&word, data + offset,
+           std::min(sizeof(word), sizeof(KeyType) - offset));
+    hash ^= word * 0x9e3779b97f4a7c15ULL;
+    hash = (hash << 31 | hash >> 33) * 0xc2b2ae3d27d4eb4fULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return static_cast<uint32_t>(hash);
+}
+
+/*****************************************************************************
+ * SEARCH
+ *****************************************************************************/
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::GetValue(const KeyType &key,
+                                          std::vector<ValueType> &result) {
+  page_id_t directory_page_id = directory_page_id_;
+  if (directory_page_id == INVALID_PAGE_ID)
+    return false;
+  Page *directory_page = FetchPage(directory_page_id);
+  directory_page->RLatch();
+  auto directory =
+      reinterpret_cast<HashDirectoryPage *>(directory_page->GetData());
+  Page *head =
+      FetchPage(directory->GetBucketPageId(directory->SlotOf(Hash(key))));
+  head->RLatch();
+  directory_page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(directory_page_id, false);
+
+  size_t found = result.size();
+  std::vector<MappingType> items;
+  ReadChain(head, items);
+  for (auto &item : items) {
+    if (memcmp(&item.first, &key, sizeof(KeyType)) == 0)
+      result.push_back(item.second);
+  }
+  head->RUnlatch();
+  buffer_pool_manager_->UnpinPage(head->GetPageId(), false);
+  return result.size() > found;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void EXTENDIBLE_HASH_TABLE_TYPE::GetAll(std::vector<MappingType> &result) {
+  page_id_t directory_page_id = directory_page_id_;
+  if (directory_page_id == INVALID_PAGE_ID)
+    return;
+  Page *directory_page = FetchPage(directory_page_id);
+  directory_page->RLatch();
+  auto directory =
+      reinterpret_cast<HashDirectoryPage *>(directory_page->GetData());
+  for (int slot = 0; slot < directory->Size(); slot++) {
+    // a bucket first shows up at the slot below 2^local depth
+    if (slot >= (1 << directory->GetLocalDepth(slot)))
+      continue;
+    Page *head = FetchPage(directory->GetBucketPageId(slot));
+    head->RLatch();
+    ReadChain(head, result);
+    head->RUnlatch();
+    buffer_pool_manager_->UnpinPage(head->GetPageId(), false);
+  }
+  directory_page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(directory_page_id, false);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int EXTENDIBLE_HASH_TABLE_TYPE::GetGlobalDepth() {
+  page_id_t directory_page_id = directory_page_id_;
+  if (directory_page_id == INVALID_PAGE_ID)
+    return 0;
+  Page *directory_page = FetchPage(directory_page_id);
+  directory_page->RLatch();
+  int global_depth =
+      reinterpret_cast<HashDirectoryPage *>(directory_page->GetData())
+          ->GetGlobalDepth();
+  directory_page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(directory_page_id, false);
+  return global_depth;
+}
+
+/*****************************************************************************
+ * INSERTION
+ *****************************************************************************/
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::Insert(const KeyType &key,
+                                        const ValueType &value) {
+  if (directory_page_id_ == INVALID_PAGE_ID) {
+    std::lock_guard<std::mutex> guard(create_latch_);
+    if (directory_page_id_ == INVALID_PAGE_ID)
+      Create();
+  }
+  page_id_t directory_page_id = directory_page_id_;
+  MappingType item(key, value);
+  uint32_t hash = Hash(key);
+  // a read latched directory first, write latched for a split
+  bool exclusive = false;
+  while (true) {
+    Page *directory_page = FetchPage(directory_page_id);
+    if (exclusive)
+      directory_page->WLatch();
+    else
+      directory_page->RLatch();
+    auto directory =
+        reinterpret_cast<HashDirectoryPage *>(directory_page->GetData());
+    uint32_t slot = directory->SlotOf(hash);
+    Page *head = FetchPage(directory->GetBucketPageId(slot));
+    head->WLatch();
+    bool can_split =
+        directory->GetLocalDepth(slot) < directory->GetGlobalDepth() ||
+        directory->CanGrow();
+    InsertResult result = InsertIntoChain(head, item, can_split);
+    bool split = false;
+    if (result == InsertResult::FULL && exclusive) {
+      split = Split(directory, slot, head, hash);
+      if (!split)
+        result = InsertIntoChain(head, item, false);
+    }
+    head->WUnlatch();
+    buffer_pool_manager_->UnpinPage(head->GetPageId(),
+                                    result == InsertResult::DONE || split);
+    if (exclusive)
+      directory_page->WUnlatch();
+    else
+      directory_page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(directory_page_id, split);
+    if (result != InsertResult::FULL)
+      return result == InsertResult::DONE;
+    exclusive = true;
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void EXTENDIBLE_HASH_TABLE_TYPE::Create() {
+  page_id_t directory_page_id, bucket_page_id;
+  Page *bucket_page = NewPage(bucket_page_id);
+  reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(bucket_page->GetData())->Init();
+  buffer_pool_manager_->UnpinPage(bucket_page_id, true);
+  Page *directory_page = NewPage(directory_page_id);
+  reinterpret_cast<HashDirectoryPage *>(directory_page->GetData())
+      ->Init(directory_page_id, bucket_page_id);
+  buffer_pool_manager_->UnpinPage(directory_page_id, true);
+  directory_page_id_ = directory_page_id;
+  directory_dirty_ = true;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+typename EXTENDIBLE_HASH_TABLE_TYPE::InsertResult
+EXTENDIBLE_HASH_TABLE_TYPE::InsertIntoChain(Page *head,
+                                            const MappingType &item,
+                                            bool can_split) {
+  Page *page = head;
+  Page *room = nullptr;
+  while (true) {
+    auto bucket = reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(page->GetData());
+    if (bucket->Find(item.first, unique_ ? nullptr : &item.second) != -1) {
+      if (room != nullptr && room != head && room != page)
+        buffer_pool_manager_->UnpinPage(room->GetPageId(), false);
+      if (page != head)
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+      return InsertResult::DUPLICATE;
+    }
+    if (room == nullptr && !bucket->IsFull())
+      room = page;
+    page_id_t next_page_id = bucket->GetNextPageId();
+    if (next_page_id == INVALID_PAGE_ID)
+      break;
+    if (page != head && page != room)
+      buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    page = FetchPage(next_page_id);
+  }
+
+  if (room == nullptr) {
+    if (can_split) {
+      if (page != head)
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+      return InsertResult::FULL;
+    }
+    // the directory is full, the bucket grows an overflow page
+    page_id_t overflow_page_id;
+    room = NewPage(overflow_page_id);
+    reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(room->GetData())->Init();
+    reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(page->GetData())
+        ->SetNextPageId(overflow_page_id);
+    if (page != head)
+      buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+  } else if (page != head && page != room) {
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+  }
+  reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(room->GetData())->Append(item);
+  if (room != head)
+    buffer_pool_manager_->UnpinPage(room->GetPageId(), true);
+  return InsertResult::DONE;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::Split(HashDirectoryPage *directory,
+                                       uint32_t slot, Page *head,
+                                       uint32_t hash) {
+  std::vector<MappingType> items, kept, moved;
+  ReadChain(head, items);
+  // entries of one hash never split apart
+  if (std::all_of(items.begin(), items.end(), [hash](const MappingType &item) {
+        return Hash(item.first) == hash;
+      }))
+    return false;
+  int local_depth = directory->GetLocalDepth(slot);
+  if (local_depth == directory->GetGlobalDepth()) {
+    if (!directory->CanGrow())
+      return false;
+    directory->Grow();
+  }
+  uint32_t split_bit = 1u << local_depth;
+  for (auto &item : items) {
+    if (Hash(item.first) & split_bit)
+      moved.push_back(item);
+    else
+      kept.push_back(item);
+  }
+  page_id_t image_page_id;
+  Page *image = NewPage(image_page_id);
+  reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(image->GetData())->Init();
+  WriteChain(head, kept);
+  WriteChain(image, moved);
+  buffer_pool_manager_->UnpinPage(image_page_id, true);
+
+  for (int i = 0; i < directory->Size(); i++) {
+    if (directory->GetBucketPageId(i) != head->GetPageId())
+      continue;
+    directory->SetLocalDepth(i, local_depth + 1);
+    if (i & split_bit)
+      directory->SetBucketPageId(i, image_page_id);
+  }
+  return true;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void EXTENDIBLE_HASH_TABLE_TYPE::ReadChain(Page *head,
+                                           std::vector<MappingType> &items) {
+  Page *page = head;
+  while (true) {
+    auto bucket = reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(page->GetData());
+    for (int i = 0; i < bucket->GetSize(); i++)
+      items.push_back(bucket->GetItem(i));
+    page_id_t next_page_id = bucket->GetNextPageId();
+    if (page != head)
+      buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    if (next_page_id == INVALID_PAGE_ID)
+      return;
+    page = FetchPage(next_page_id);
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void EXTENDIBLE_HASH_TABLE_TYPE::WriteChain(
+    Page *head, const std::vector<MappingType> &items) {
+  Page *page = head;
+  size_t next = 0;
+  while (true) {
+    auto bucket = reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(page->GetData());
+    bucket->Clear();
+    while (next < items.size() && !bucket->IsFull())
+      bucket->Append(items[next++]);
+    page_id_t next_page_id = bucket->GetNextPageId();
+    if (next == items.size()) {
+      // the rest of the chain is not needed any more
+      bucket->SetNextPageId(INVALID_PAGE_ID);
+      if (page != head)
+        buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+      while (next_page_id != INVALID_PAGE_ID) {
+        page_id_t page_id = next_page_id;
+        Page *overflow = FetchPage(page_id);
+        next_page_id =
+            reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(overflow->GetData())
+                ->GetNextPageId();
+        buffer_pool_manager_->UnpinPage(page_id, false);
+        buffer_pool_manager_->DeletePage(page_id);
+      }
+      return;
+    }
+    Page *overflow;
+    if (next_page_id == INVALID_PAGE_ID) {
+      overflow = NewPage(next_page_id);
+      reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(overflow->GetData())->Init();
+      bucket->SetNextPageId(next_page_id);
+    } else {
+      overflow = FetchPage(next_page_id);
+    }
+    if (page != head)
+      buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+    page = overflow;
+  }
+}
+
+/*****************************************************************************
+ * REMOVE
+ *****************************************************************************/
+/*
+ * An emptied overflow page is unlinked from its chain and deleted
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::Remove(const KeyType &key,
+                                        const ValueType *value) {
+  page_id_t directory_page_id = directory_page_id_;
+  if (directory_page_id == INVALID_PAGE_ID)
+    return false;
+  Page *directory_page = FetchPage(directory_page_id);
+  directory_page->RLatch();
+  auto directory =
+      reinterpret_cast<HashDirectoryPage *>(directory_page->GetData());
+  Page *head =
+      FetchPage(directory->GetBucketPageId(directory->SlotOf(Hash(key))));
+  head->WLatch();
+  directory_page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(directory_page_id, false);
+
+  Page *prev = nullptr, *page = head;
+  bool removed = false, prev_dirty = false;
+  while (true) {
+    auto bucket = reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(page->GetData());
+    int index = bucket->Find(key, value);
+    if (index != -1) {
+      bucket->RemoveAt(index);
+      removed = true;
+      if (page != head && bucket->GetSize() == 0) {
+        reinterpret_cast<HASH_BUCKET_PAGE_TYPE *>(prev->GetData())
+            ->SetNextPageId(bucket->GetNextPageId());
+        prev_dirty = true;
+        page_id_t page_id = page->GetPageId();
+        buffer_pool_manager_->UnpinPage(page_id, false);
+        buffer_pool_manager_->DeletePage(page_id);
+        page = nullptr;
+      }
+      break;
+    }
+    page_id_t next_page_id = bucket->GetNextPageId();
+    if (next_page_id == INVALID_PAGE_ID)
+      break;
+    if (prev != nullptr && prev != head)
+      buffer_pool_manager_->UnpinPage(prev->GetPageId(), false);
+    prev = page;
+    page = FetchPage(next_page_id);
+  }
+  if (page != nullptr && page != head)
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), removed);
+  if (prev != nullptr && prev != head)
+    buffer_pool_manager_->UnpinPage(prev->GetPageId(), prev_dirty);
+  head->WUnlatch();
+  buffer_pool_manager_->UnpinPage(
+      head->GetPageId(),
+      (page == head && removed) || (prev == head && prev_dirty));
+  return removed;
+}
+
+/*****************************************************************************
+ * UTILITIES AND DEBUG
+ *****************************************************************************/
+INDEX_TEMPLATE_ARGUMENTS
+Page *EXTENDIBLE_HASH_TABLE_TYPE::FetchPage(page_id_t page_id) {
+  Page *page = buffer_pool_manager_->FetchPage(page_id);
+  if (page == nullptr)
+    throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned");
+  return page;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+Page *EXTENDIBLE_HASH_TABLE_TYPE::NewPage(page_id_t &page_id) {
+  Page *page = buffer_pool_manager_->NewPage(page_id, tablespace_id_);
+  if (page == nullptr)
+    throw Exception(EXCEPTION_TYPE_INDEX, "out of memory");
+  return page;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::GetChangedDirectoryPageId(
+    page_id_t &directory_page_id) {
+  if (!directory_dirty_.exchange(false))
+    return false;
+  directory_page_id = directory_page_id_;
+  return true;
+}
+
+template class ExtendibleHashTable<GenericKey<4>, RID, GenericComparator<4>>;
+template class ExtendibleHashTable<GenericKey<8>, RID, GenericComparator<8>>;
+template class ExtendibleHashTable<GenericKey<16>, RID, GenericComparator<16>>;
+template class ExtendibleHashTable<GenericKey<32>, RID, GenericComparator<32>>;
+template class ExtendibleHashTable<GenericKey<64>, RID, GenericComparator<64>>;
+
+} // namespace cmudb
@@ -0,0 +1,92 @@
+/**
+ * hash_index.cpp
+ */
+
+#include "index/hash_index.h"
+
+namespace cmudb {
+/*
+ * Constructor
+ */
+INDEX_TEMPLATE_ARGUMENTS
+HASH_INDEX_TYPE::HashIndex(IndexMetadata *metadata,
+                           BufferPoolManager *buffer_pool_manager,
+                           page_id_t directory_page_id, int tablespace_id)
+    : Index(metadata), comparator_(metadata->GetKeySchema()),
+      container_(metadata->GetName(), buffer_pool_manager,
+                 metadata->IsUnique(), directory_page_id, tablespace_id) {}
+
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid, Transaction *) {
+  // construct insert index key
+  KeyType index_key;
+  index_key.SetFromKey(key);
+
+  container_.Insert(index_key, rid);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_INDEX_TYPE::DeleteEntry(const Tuple &key, RID rid, Transaction *) {
+  // construct delete index key
+  KeyType index_key;
+  index_key.SetFromKey(key);
+
+  container_.Remove(index_key, GetMetadata()->IsUnique() ? nullptr : &rid);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_INDEX_TYPE::ScanKey(const Tuple &key, std::vector<RID> &result,
+                              Transaction *) {
+  // construct scan index key
+  KeyType index_key;
+  index_key.SetFromKey(key);
+
+  container_.GetValue(index_key, result);
+}
+
+/*
+ * A point range reads one bucket, any other range filters every entry
+ */
+INDEX_TEMPLATE_ARGUMENTS
+IndexScanIterator *HASH_INDEX_TYPE::ScanRange(const Tuple *low_key,
+                                              bool low_inclusive,
+                                              const Tuple *high_key,
+                                              bool high_inclusive,
+                                              Transaction *transaction) {
+  std::vector<RID> rids;
+  KeyType low_index_key, high_index_key;
+  if (low_key != nullptr)
+    low_index_key.SetFromKey(*low_key);
+  if (high_key != nullptr)
+    high_index_key.SetFromKey(*high_key);
+  if (low_key != nullptr && high_key != nullptr && low_inclusive &&
+      high_inclusive && comparator_(low_index_key, high_index_key) == 0) {
+    ScanKey(*low_key, rids, transaction);
+    return new VectorScanIterator(std::move(rids));
+  }
+
+  std::vector<MappingType> items;
+  container_.GetAll(items);
+  for (auto &item : items) {
+    if (low_key != nullptr) {
+      int cmp = comparator_(item.first, low_index_key);
+      if (cmp < 0 || (cmp == 0 && !low_inclusive))
+        continue;
+    }
+    if (high_key != nullptr) {
+      int cmp = comparator_(item.first, high_index_key);
+      if (cmp > 0 || (cmp == 0 && !high_inclusive))
+        continue;
+    }
+    rids.push_back(item.second);
+  }
+  return new VectorScanIterator(std::move(rids));
+}
+
+template class HashIndex<GenericKey<4>, RID, GenericComparator<4>>;
+template class HashIndex<GenericKey<8>, RID, GenericComparator<8>>;
+template class HashIndex<GenericKey<16>, RID, GenericComparator<16>>;
+template class HashIndex<GenericKey<32>, RID, GenericComparator<32>>;
+template class HashIndex<GenericKey<64>, RID, GenericComparator<64>>;
+
+} // namespace cmudb
@@ -3,24 +3,173 @@
  */
 #include <cassert>
 
+#include "buffer/buffer_pool_manager.h"
 #include "index/index_iterator.h"
 
 namespace cmudb {
 
+INDEX_TEMPLATE_ARGUMENTS
+static page_id_t LeafNextPageId(Page *page) {
+  return reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData())
+      ->GetNextPageId();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE::IndexIterator()
+    : page_(nullptr), leaf_(nullptr), index_(0),
+      buffer_pool_manager_(nullptr), comparator_(nullptr),
+      has_last_key_(false), position_(0), depth_(0), left_(0) {}
+
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE::IndexIterator(Page *page, int index,
+                                  BufferPoolManager *buffer_pool_manager,
+                                  const KeyComparator *comparator,
+                                  std::vector<page_id_t> next_leaves)
+    : page_(page), leaf_(nullptr), index_(index),
+      buffer_pool_manager_(buffer_pool_manager), comparator_(comparator),
+      has_last_key_(false), next_leaves_(std::move(next_leaves)),
+      position_(0), depth_(0), left_(0) {
+  if (page_ != nullptr) {
+    leaf_ = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page_->GetData());
+    SkipToValid();
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE::IndexIterator(IndexIterator &&other)
+    : page_(other.page_), leaf_(other.leaf_), index_(other.index_),
+      buffer_pool_manager_(other.buffer_pool_manager_),
+      comparator_(other.comparator_), last_key_(other.last_key_),
+      has_last_key_(other.has_last_key_), item_(other.item_),
+      next_leaves_(std::move(other.next_leaves_)), position_(other.position_),
+      depth_(other.depth_), left_(other.left_) {
+  other.page_ = nullptr;
+  other.leaf_ = nullptr;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE &INDEXITERATOR_TYPE::operator=(IndexIterator &&other) {
+  if (this != &other) {
+    Release();
+    page_ = other.page_;
+    leaf_ = other.leaf_;
+    index_ = other.index_;
+    buffer_pool_manager_ = other.buffer_pool_manager_;
+    comparator_ = other.comparator_;
+    last_key_ = other.last_key_;
+    has_last_key_ = other.has_last_key_;
+    item_ = other.item_;
+    next_leaves_ = std::move(other.next_leaves_);
+    position_ = other.position_;
+    depth_ = other.depth_;
+    left_ = other.left_;
+    other.page_ = nullptr;
+    other.leaf_ = nullptr;
+  }
+  return *this;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE::~IndexIterator() { Release(); }
+
+INDEX_TEMPLATE_ARGUMENTS
+bool INDEXITERATOR_TYPE::isEnd() { return leaf_ == nullptr; }
+
+INDEX_TEMPLATE_ARGUMENTS
+const MappingType &INDEXITERATOR_TYPE::operator*() {
+  assert(!isEnd());
+  item_ = leaf_->GetItem(index_);
+  return item_;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE &INDEXITERATOR_TYPE::operator++() {
+  assert(!isEnd());
+  ++index_;
+  SkipToValid();
+  return *this;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void INDEXITERATOR_TYPE::SkipToValid() {
+  while (leaf_ != nullptr && index_ >= leaf_->GetSize()) {
+    if (leaf_->GetSize() > 0) {
+      last_key_ = leaf_->KeyAt(leaf_->GetSize() - 1);
+      has_last_key_ = true;
+    }
+    page_id_t next_page_id = leaf_->GetNextPageId();
+    Page *next_page = next_page_id == INVALID_PAGE_ID
+                          ? nullptr
+                          : buffer_pool_manager_->FetchPage(next_page_id);
+    Release();
+    if (next_page == nullptr)
+      return;
+    next_page->RLatch();
+    page_ = next_page;
+    leaf_ = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page_->GetData());
+    index_ = 0;
+    while (has_last_key_ && index_ < leaf_->GetSize() &&
+           (*comparator_)(leaf_->KeyAt(index_), last_key_) <= 0)
+      ++index_;
+    ReadAhead();
+  }
+}
+
 /*
- * NOTE: you can change the destructor/constructor method here
- * set your own input parameters
+ * Leaves named by the parent are requested as long as they reach to the end
+ * of the window, after them the chain is followed from the current leaf.
+ * The window stays within a quarter of the pool, as for a table scan
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE::IndexIterator() {}
+void INDEXITERATOR_TYPE::ReadAhead() {
+  ++position_;
+  if (left_ > 0)
+    --left_;
+  if (left_ > depth_ / 2)
+    return;
+  size_t max_depth = std::min<size_t>(LEAF_READ_AHEAD_MAX_DEPTH,
+                                      buffer_pool_manager_->GetPoolSize() / 4);
+  depth_ = std::min(max_depth,
+                    depth_ == 0 ? LEAF_READ_AHEAD_MIN_DEPTH : depth_ * 2);
+  if (depth_ == 0)
+    return;
+  // the parent names the first leaf, then next_leaves_[0] at position 1
+  size_t end = position_ + depth_;
+  if (end <= next_leaves_.size()) {
+    for (size_t i = position_ + left_; i < end; i++)
+      buffer_pool_manager_->PrefetchPage(next_leaves_[i]);
+  } else if (leaf_->GetNextPageId() != INVALID_PAGE_ID) {
+    buffer_pool_manager_->PrefetchPage(leaf_->GetNextPageId(), depth_,
+                                       LeafNextPageId<KeyType, ValueType,
+                                                      KeyComparator>);
+  }
+  left_ = depth_;
+}
 
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE::~IndexIterator() {}
+void INDEXITERATOR_TYPE::Release() {
+  if (page_ == nullptr)
+    return;
+  page_->RUnlatch();
+  buffer_pool_manager_->UnpinPage(page_->GetPageId(), false);
+  page_ = nullptr;
+  leaf_ = nullptr;
+}
 
 template class IndexIterator<GenericKey<4>, RID, GenericComparator<4>>;
 template class IndexIterator<GenericKey<8>, RID, GenericComparator<8>>;
 template class IndexIterator<GenericKey<16>, RID, GenericComparator<16>>;
 template class IndexIterator<GenericKey<32>, RID, GenericComparator<32>>;
 template class IndexIterator<GenericKey<64>, RID, GenericComparator<64>>;
+template class IndexIterator<GenericKey<4>, RID, IntegerComparator<4, int32_t>>;
+template class IndexIterator<GenericKey<8>, RID, IntegerComparator<8, int64_t>>;
+template class IndexIterator<GenericKey<4>, RID, CompositeIntegerComparator<4>>;
+template class IndexIterator<GenericKey<8>, RID, CompositeIntegerComparator<8>>;
+template class IndexIterator<GenericKey<16>, RID,
+                             CompositeIntegerComparator<16>>;
+template class IndexIterator<GenericKey<32>, RID,
+                             CompositeIntegerComparator<32>>;
+template class IndexIterator<GenericKey<64>, RID,
+                             CompositeIntegerComparator<64>>;
 
 } // namespace cmudb
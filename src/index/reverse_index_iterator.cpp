@@ -0,0 +1,186 @@
+/**
+ * reverse_index_iterator.cpp
+ */
+#include <cassert>
+
+#include "buffer/buffer_pool_manager.h"
+#include "index/b_plus_tree.h"
+#include "index/reverse_index_iterator.h"
+
+namespace cmudb {
+
+INDEX_TEMPLATE_ARGUMENTS
+REVERSE_INDEXITERATOR_TYPE::ReverseIndexIterator()
+    : tree_(nullptr), page_(nullptr), leaf_(nullptr), index_(0) {}
+
+INDEX_TEMPLATE_ARGUMENTS
+REVERSE_INDEXITERATOR_TYPE::ReverseIndexIterator(
+    BPlusTree<KeyType, ValueType, KeyComparator> *tree, const KeyType *key,
+    bool inclusive)
+    : tree_(tree), page_(nullptr), leaf_(nullptr), index_(0) {
+  Seek(key, inclusive);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+REVERSE_INDEXITERATOR_TYPE::ReverseIndexIterator(ReverseIndexIterator &&other)
+    : tree_(other.tree_), page_(other.page_), leaf_(other.leaf_),
+      index_(other.index_), item_(other.item_) {
+  other.page_ = nullptr;
+  other.leaf_ = nullptr;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+REVERSE_INDEXITERATOR_TYPE &
+REVERSE_INDEXITERATOR_TYPE::operator=(ReverseIndexIterator &&other) {
+  if (this != &other) {
+    Release();
+    tree_ = other.tree_;
+    page_ = other.page_;
+    leaf_ = other.leaf_;
+    index_ = other.index_;
+    item_ = other.item_;
+    other.page_ = nullptr;
+    other.leaf_ = nullptr;
+  }
+  return *this;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+REVERSE_INDEXITERATOR_TYPE::~ReverseIndexIterator() { Release(); }
+
+INDEX_TEMPLATE_ARGUMENTS
+bool REVERSE_INDEXITERATOR_TYPE::isEnd() { return leaf_ == nullptr; }
+
+INDEX_TEMPLATE_ARGUMENTS
+const MappingType &REVERSE_INDEXITERATOR_TYPE::operator*() {
+  assert(!isEnd());
+  item_ = leaf_->GetItem(index_);
+  return item_;
+}
+
+/*
+ * The leaf is latched while the iterator is on it, its first key is the
+ * last one returned when the iterator leaves it
+ */
+INDEX_TEMPLATE_ARGUMENTS
+REVERSE_INDEXITERATOR_TYPE &REVERSE_INDEXITERATOR_TYPE::operator++() {
+  assert(!isEnd());
+  if (--index_ < 0) {
+    KeyType last_key = leaf_->KeyAt(0);
+    while (MovePrev(last_key) && index_ < 0)
+      ;
+    if (index_ < 0)
+      Seek(&last_key, false);
+  }
+  return *this;
+}
+
+/*
+ * The pinned page may have left the tree before it was latched, it is only
+ * trusted as a leaf with entries linked to the current one. The current
+ * leaf stays pinned until then: had a writer latched it meanwhile, it may
+ * have taken entries from the previous one, which only a descent finds
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool REVERSE_INDEXITERATOR_TYPE::MovePrev(const KeyType &key) {
+  Page *page = page_;
+  page_id_t page_id = page->GetPageId();
+  page_id_t prev_page_id = leaf_->GetPrevPageId();
+  if (prev_page_id == INVALID_PAGE_ID)
+    return false;
+  BufferPoolManager *buffer_pool_manager = tree_->buffer_pool_manager_;
+  Page *prev_page = buffer_pool_manager->FetchPage(prev_page_id);
+  if (prev_page == nullptr)
+    return false;
+  uint64_t version = page->GetVersion();
+  page->RUnlatch();
+  page_ = nullptr;
+  leaf_ = nullptr;
+  prev_page->RLatch();
+  auto prev_leaf =
+      reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(prev_page->GetData());
+  bool linked = prev_leaf->IsLeafPage() && prev_leaf->GetSize() > 0 &&
+                prev_leaf->GetNextPageId() == page_id &&
+                page->ValidateVersion(version);
+  buffer_pool_manager->UnpinPage(page_id, false);
+  if (!linked) {
+    prev_page->RUnlatch();
+    buffer_pool_manager->UnpinPage(prev_page_id, false);
+    return false;
+  }
+  page_ = prev_page;
+  leaf_ = prev_leaf;
+  index_ = leaf_->KeyIndex(key, tree_->comparator_) - 1;
+  return true;
+}
+
+/*
+ * A leaf without a key in range sends the search below its fence, the
+ * fences fall with every try and the left most leaf has none
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void REVERSE_INDEXITERATOR_TYPE::Seek(const KeyType *key, bool inclusive) {
+  Release();
+  KeyType bound;
+  if (key != nullptr)
+    bound = *key;
+  while (true) {
+    KeyType fence;
+    bool has_fence;
+    page_ = tree_->FindReverseLeaf(key != nullptr ? &bound : nullptr,
+                                   inclusive, fence, has_fence);
+    if (page_ == nullptr)
+      return;
+    leaf_ = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page_->GetData());
+    index_ = leaf_->GetSize() - 1;
+    if (key != nullptr) {
+      index_ = leaf_->KeyIndex(bound, tree_->comparator_);
+      if (!inclusive || index_ >= leaf_->GetSize() ||
+          tree_->comparator_(leaf_->KeyAt(index_), bound) != 0)
+        --index_;
+    }
+    if (index_ >= 0)
+      return;
+    Release();
+    if (!has_fence)
+      return;
+    bound = fence;
+    key = &bound;
+    inclusive = false;
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void REVERSE_INDEXITERATOR_TYPE::Release() {
+  if (page_ == nullptr)
+    return;
+  page_->RUnlatch();
+  tree_->buffer_pool_manager_->UnpinPage(page_->GetPageId(), false);
+  page_ = nullptr;
+  leaf_ = nullptr;
+}
+
+template class ReverseIndexIterator<GenericKey<4>, RID, GenericComparator<4>>;
+template class ReverseIndexIterator<GenericKey<8>, RID, GenericComparator<8>>;
+template class ReverseIndexIterator<GenericKey<16>, RID,
+                                    GenericComparator<16>>;
+template class ReverseIndexIterator<GenericKey<32>, RID,
+                                    GenericComparator<32>>;
+template class ReverseIndexIterator<GenericKey<64>, RID,
+                                    GenericComparator<64>>;
+template class ReverseIndexIterator<GenericKey<4>, RID,
+                                    IntegerComparator<4, int32_t>>;
+template class ReverseIndexIterator<GenericKey<8>, RID,
+                                    IntegerComparator<8, int64_t>>;
+template class ReverseIndexIterator<GenericKey<4>, RID,
+                                    CompositeIntegerComparator<4>>;
+template class ReverseIndexIterator<GenericKey<8>, RID,
+                                    CompositeIntegerComparator<8>>;
+template class ReverseIndexIterator<GenericKey<16>, RID,
+                                    CompositeIntegerComparator<16>>;
+template class ReverseIndexIterator<GenericKey<32>, RID,
+                                    CompositeIntegerComparator<32>>;
+template class ReverseIndexIterator<GenericKey<64>, RID,
+                                    CompositeIntegerComparator<64>>;
+
+} // namespace cmudb
@@ -0,0 +1,105 @@
+/**
+ * backup_manager.cpp
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <sys/stat.h>
+#include <vector>
+
+#include "common/exception.h"
+#include "common/logger.h"
+#include "logging/backup_manager.h"
+
+namespace cmudb {
+
+std::string BackupManager::GetBackupName(const std::string &directory,
+                                         const std::string &file_name) {
+  std::string::size_type n = file_name.rfind('/');
+  return directory + "/" +
+         (n == std::string::npos ? file_name : file_name.substr(n + 1));
+}
+
+/*
+ * The log is held from its start, which stays on disk until the hold is
+ * released. Pages are copied before the log, see above
+ */
+bool BackupManager::Backup(const std::string &directory, bool incremental) {
+  stats_ = BackupStats();
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    LOG_DEBUG("can not create %s", directory.c_str());
+    return false;
+  }
+  off_t log_start = disk_manager_->HoldLog();
+  bool success = true;
+  std::vector<bool> has_backup(MAX_TABLESPACES, false);
+  for (int i = 0; i < MAX_TABLESPACES; i++) {
+    std::string file_name = disk_manager_->GetTablespaceFile(i);
+    struct stat stat_buf;
+    has_backup[i] = !file_name.empty() &&
+                    stat(GetBackupName(directory, file_name).c_str(),
+                         &stat_buf) == 0 &&
+                    stat_buf.st_size > 0;
+  }
+  try {
+    DiskManager backup(
+        GetBackupName(directory, disk_manager_->GetTablespaceFile(0)));
+    std::vector<page_id_t> max_page_ids(MAX_TABLESPACES, INVALID_PAGE_ID);
+    PageCopyFunc copy = [&backup, &max_page_ids](page_id_t page_id,
+                                                 const char *page_data) {
+      backup.WritePage(page_id, page_data);
+      int tablespace_id = GetTablespaceId(page_id);
+      max_page_ids[tablespace_id] =
+          std::max(max_page_ids[tablespace_id], page_id);
+      return true;
+    };
+    for (int i = 0; i < MAX_TABLESPACES && success; i++) {
+      std::string file_name = disk_manager_->GetTablespaceFile(i);
+      if (file_name.empty())
+        continue;
+      if (i > 0 &&
+          backup.AddTablespace(GetBackupName(directory, file_name)) != i) {
+        LOG_DEBUG("backup in %s has other tablespaces", directory.c_str());
+        success = false;
+        break;
+      }
+      // a tablespace backed up for the first time gets every page
+      bool all = !incremental || !has_backup[i];
+      stats_.incremental_ = stats_.incremental_ || !all;
+      size_t count = 0;
+      success = disk_manager_->TakeChangedPages(i, all, copy, count);
+      stats_.pages_ += count;
+      if (max_page_ids[i] != INVALID_PAGE_ID)
+        backup.ReservePageIds(max_page_ids[i]);
+    }
+
+    // relocated to the start of the log of the backup
+    off_t log_end = disk_manager_->GetLogFileSize();
+    backup.TruncateLog(0);
+    std::unique_ptr<char[]> buffer(new char[BACKUP_LOG_CHUNK]);
+    for (off_t offset = log_start; success && offset < log_end;) {
+      size_t size = disk_manager_->ReadLog(
+          buffer.get(), std::min<off_t>(BACKUP_LOG_CHUNK, log_end - offset),
+          offset);
+      if (size == 0) {
+        LOG_DEBUG("can not read log to back up");
+        success = false;
+        break;
+      }
+      backup.WriteLog(buffer.get(), size);
+      offset += size;
+      stats_.log_bytes_ += size;
+    }
+  } catch (Exception &) {
+    LOG_DEBUG("can not open backup in %s", directory.c_str());
+    success = false;
+  }
+  disk_manager_->ReleaseLog(log_start);
+  LOG_INFO("backup to %s: %llu pages, %llu bytes of log", directory.c_str(),
+           static_cast<unsigned long long>(stats_.pages_),
+           static_cast<unsigned long long>(stats_.log_bytes_));
+  return success;
+}
+
+} // namespace cmudb
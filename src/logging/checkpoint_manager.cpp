@@ -0,0 +1,147 @@
+/**
+ * checkpoint_manager.cpp
+ */
+
+#include <algorithm>
+
+#include "common/logger.h"
+#include "logging/checkpoint_manager.h"
+
+namespace cmudb {
+
+CheckpointManager::CheckpointManager(TransactionManager *txn_manager,
+                                     BufferPoolManager *buffer_pool_manager,
+                                     LogManager *log_manager)
+    : txn_manager_(txn_manager), buffer_pool_manager_(buffer_pool_manager),
+      log_manager_(log_manager),
+      disk_manager_(buffer_pool_manager->GetDiskManager()),
+      last_begin_lsn_(INVALID_LSN), checkpoint_count_(0), stop_thread_(false) {
+  log_start_ = disk_manager_->GetLogStart();
+}
+
+CheckpointManager::~CheckpointManager() { StopCheckpointThread(); }
+
+/*
+ * A running thread picks up the new config with its next round
+ */
+void CheckpointManager::StartCheckpointThread(const CheckpointConfig &config) {
+  std::lock_guard<std::mutex> guard(thread_latch_);
+  config_ = config;
+  if (!checkpoint_thread_.joinable()) {
+    stop_thread_ = false;
+    checkpoint_thread_ =
+        std::thread(&CheckpointManager::CheckpointWorker, this);
+  }
+}
+
+void CheckpointManager::StopCheckpointThread() {
+  {
+    std::lock_guard<std::mutex> guard(thread_latch_);
+    if (!checkpoint_thread_.joinable())
+      return;
+    stop_thread_ = true;
+  }
+  thread_cv_.notify_one();
+  checkpoint_thread_.join();
+}
+
+/*
+ * BEGIN_CHECKPOINT is appended before the snapshots: a transaction missing
+ * from the table begins after it, a change missing from the dirty page table
+ * reached disk before the snapshot. The checkpoint is complete once
+ * END_CHECKPOINT is durable, only then the log may be truncated.
+ */
+lsn_t CheckpointManager::Checkpoint() {
+  std::lock_guard<std::mutex> guard(checkpoint_latch_);
+  if (flush_callback_)
+    flush_callback_();
+  if (!log_manager_->IsRunning())
+    return INVALID_LSN;
+  LogRecord begin_record(INVALID_TXN_ID, INVALID_LSN,
+                         LogRecordType::BEGIN_CHECKPOINT);
+  lsn_t begin_lsn = log_manager_->AppendLogRecord(begin_record);
+
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns;
+  lsn_t min_first_lsn;
+  txn_manager_->GetActiveTransactions(active_txns, min_first_lsn);
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages;
+  buffer_pool_manager_->GetDirtyPageTable(dirty_pages);
+
+  LogRecord end_record(begin_lsn, dirty_pages, active_txns);
+  if (end_record.GetSize() > LOG_BUFFER_SIZE) {
+    // too many dirty pages for one record, redo has to start at the oldest
+    lsn_t min_rec_lsn = begin_lsn;
+    for (auto &dirty_page : dirty_pages)
+      min_rec_lsn = std::min(min_rec_lsn, dirty_page.second);
+    end_record = LogRecord(
+        begin_lsn, {std::make_pair(INVALID_PAGE_ID, min_rec_lsn)}, {});
+  }
+  lsn_t end_lsn = log_manager_->AppendLogRecord(end_record);
+  log_manager_->WaitUntilDurable(end_lsn);
+  ++checkpoint_count_;
+
+  // pages dirty for a whole checkpoint interval are written back now
+  bool flushed = false;
+  for (auto &dirty_page : dirty_pages) {
+    if (last_begin_lsn_ != INVALID_LSN && dirty_page.second < last_begin_lsn_) {
+      buffer_pool_manager_->FlushPage(dirty_page.first);
+      flushed = true;
+    }
+  }
+  last_begin_lsn_ = begin_lsn;
+  if (flushed)
+    buffer_pool_manager_->GetDirtyPageTable(dirty_pages);
+
+  lsn_t keep_lsn = begin_lsn;
+  if (min_first_lsn != INVALID_LSN)
+    keep_lsn = std::min(keep_lsn, min_first_lsn);
+  for (auto &dirty_page : dirty_pages)
+    keep_lsn = std::min(keep_lsn, dirty_page.second);
+  off_t offset = log_manager_->GetLogOffset(keep_lsn);
+  if (offset > log_start_) {
+    disk_manager_->SetLogStart(offset);
+    log_manager_->DiscardLogOffsets(offset);
+    log_start_ = offset;
+    LOG_DEBUG("checkpoint %d truncated log before offset %lld", end_lsn,
+              static_cast<long long>(offset));
+  }
+  return end_lsn;
+}
+
+/*
+ * The size of the log is checked every CHECKPOINT_POLL_INTERVAL, or once per
+ * interval if the log bytes trigger is off. With both triggers off the thread
+ * idles.
+ */
+void CheckpointManager::CheckpointWorker() {
+  auto last_time = std::chrono::steady_clock::now();
+  off_t last_log_size = disk_manager_->GetLogFileSize();
+  std::unique_lock<std::mutex> guard(thread_latch_);
+  while (!stop_thread_) {
+    CheckpointConfig config = config_;
+    auto wait = CHECKPOINT_POLL_INTERVAL;
+    if (config.interval_.count() > 0)
+      wait = config.log_bytes_ > 0 ? std::min(wait, config.interval_)
+                                   : config.interval_;
+    thread_cv_.wait_for(guard, wait, [this] { return stop_thread_; });
+    if (stop_thread_)
+      break;
+    guard.unlock();
+
+    auto now = std::chrono::steady_clock::now();
+    off_t log_size = disk_manager_->GetLogFileSize();
+    bool due = (config.interval_.count() > 0 &&
+                now - last_time >= config.interval_) ||
+               (config.log_bytes_ > 0 &&
+                log_size - last_log_size >= config.log_bytes_);
+    if (due) {
+      Checkpoint();
+      last_time = now;
+      last_log_size = disk_manager_->GetLogFileSize();
+    }
+
+    guard.lock();
+  }
+}
+
+} // namespace cmudb
@@ -0,0 +1,142 @@
+/**
+ * log_manager.cpp
+ */
+
+#include <algorithm>
+
+#include "logging/log_manager.h"
+
+namespace cmudb {
+
+LogManager::LogManager(DiskManager *disk_manager)
+    : disk_manager_(disk_manager), next_lsn_(0), persistent_lsn_(INVALID_LSN),
+      flush_count_(0), log_buffer_size_(0), flush_requested_(false),
+      running_(false) {
+  log_buffer_ = new char[LOG_BUFFER_SIZE];
+  flush_buffer_ = new char[LOG_BUFFER_SIZE];
+}
+
+LogManager::~LogManager() {
+  StopFlushThread();
+  delete[] log_buffer_;
+  delete[] flush_buffer_;
+}
+
+void LogManager::RunFlushThread() {
+  std::lock_guard<std::mutex> guard(latch_);
+  if (running_)
+    return;
+  running_ = true;
+  flush_thread_ = std::thread(&LogManager::FlushThread, this);
+}
+
+/*
+ * Flush thread writes whatever is left before it exits
+ */
+void LogManager::StopFlushThread() {
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    if (!running_)
+      return;
+    running_ = false;
+  }
+  flush_cv_.notify_one();
+  flush_thread_.join();
+}
+
+void LogManager::SetNextLSN(lsn_t next_lsn) {
+  std::lock_guard<std::mutex> guard(latch_);
+  assert(!running_ && log_buffer_size_ == 0);
+  next_lsn_ = next_lsn;
+  persistent_lsn_ = next_lsn - 1;
+}
+
+/*
+ * append a log record into log buffer
+ * you MUST set the log record's lsn within this method
+ * @return: lsn that is assigned to this log record
+ * If the buffer is full, wait for the flush thread to swap buffers.
+ */
+lsn_t LogManager::AppendLogRecord(LogRecord &log_record) {
+  assert(log_record.GetSize() <= LOG_BUFFER_SIZE);
+  std::unique_lock<std::mutex> guard(latch_);
+  while (log_buffer_size_ + log_record.GetSize() > LOG_BUFFER_SIZE) {
+    flush_requested_ = true;
+    flush_cv_.notify_one();
+    durable_cv_.wait(guard);
+  }
+  log_record.lsn_ = next_lsn_++;
+  log_record.SerializeTo(log_buffer_ + log_buffer_size_);
+  log_buffer_size_ += log_record.GetSize();
+  return log_record.lsn_;
+}
+
+void LogManager::WaitUntilDurable(lsn_t lsn) {
+  std::unique_lock<std::mutex> guard(latch_);
+  assert(running_);
+  while (persistent_lsn_ < lsn) {
+    flush_requested_ = true;
+    flush_cv_.notify_one();
+    durable_cv_.wait(guard);
+  }
+}
+
+off_t LogManager::GetLogOffset(lsn_t lsn) {
+  std::lock_guard<std::mutex> guard(latch_);
+  if (lsn > persistent_lsn_ || flush_offsets_.empty() ||
+      lsn < flush_offsets_.front().first)
+    return -1;
+  auto it = std::upper_bound(
+      flush_offsets_.begin(), flush_offsets_.end(), lsn,
+      [](lsn_t lsn, const std::pair<lsn_t, off_t> &flush) {
+        return lsn < flush.first;
+      });
+  return std::prev(it)->second;
+}
+
+void LogManager::DiscardLogOffsets(off_t offset) {
+  std::lock_guard<std::mutex> guard(latch_);
+  // keep the flush containing offset
+  while (flush_offsets_.size() > 1 && flush_offsets_[1].second <= offset)
+    flush_offsets_.pop_front();
+}
+
+/*
+ * Wake up on timeout or request, swap buffers and write the flush buffer
+ * outside of the latch. Appends and commits arriving meanwhile are collected
+ * in the other buffer and go out with the next flush.
+ */
+void LogManager::FlushThread() {
+  std::unique_lock<std::mutex> guard(latch_);
+  while (true) {
+    flush_cv_.wait_for(guard, LOG_TIMEOUT,
+                       [this] { return flush_requested_ || !running_; });
+    bool stop = !running_;
+    if (log_buffer_size_ > 0) {
+      std::swap(log_buffer_, flush_buffer_);
+      int32_t flush_size = log_buffer_size_;
+      lsn_t flush_lsn = next_lsn_ - 1;
+      lsn_t first_lsn = persistent_lsn_ + 1;
+      log_buffer_size_ = 0;
+      flush_requested_ = false;
+      guard.unlock();
+
+      // only this thread appends, the offset can not move meanwhile
+      off_t offset = disk_manager_->GetLogFileSize();
+      disk_manager_->WriteLog(flush_buffer_, flush_size);
+      ++flush_count_;
+
+      guard.lock();
+      flush_offsets_.emplace_back(first_lsn, offset);
+      persistent_lsn_ = flush_lsn;
+    } else {
+      // requests made during a write are served by the next round
+      flush_requested_ = false;
+    }
+    durable_cv_.notify_all();
+    if (stop)
+      return;
+  }
+}
+
+} // namespace cmudb
@@ -0,0 +1,224 @@
+/**
+ * log_record.cpp
+ */
+
+#include <sstream>
+
+#include "logging/log_record.h"
+
+namespace cmudb {
+
+// does a serialized tuple at pos fit into a record of size bytes
+static bool TupleFits(const char *storage, int pos, int32_t size) {
+  if (pos + static_cast<int>(sizeof(int32_t)) > size)
+    return false;
+  int32_t tuple_size = *reinterpret_cast<const int32_t *>(storage + pos);
+  return tuple_size >= 0 &&
+         pos + static_cast<int>(sizeof(int32_t)) + tuple_size <= size;
+}
+
+// write a counted array of pairs at pos, return the position after it
+template <typename K>
+static int SerializePairs(char *storage, int pos,
+                          const std::vector<std::pair<K, lsn_t>> &pairs) {
+  int32_t count = static_cast<int32_t>(pairs.size());
+  memcpy(storage + pos, &count, sizeof(int32_t));
+  pos += sizeof(int32_t);
+  for (auto &pair : pairs) {
+    memcpy(storage + pos, &pair.first, sizeof(K));
+    memcpy(storage + pos + sizeof(K), &pair.second, sizeof(lsn_t));
+    pos += sizeof(K) + sizeof(lsn_t);
+  }
+  return pos;
+}
+
+// read a counted array of pairs at pos, -1 if it exceeds a record of size
+template <typename K>
+static int DeserializePairs(const char *storage, int pos, int32_t size,
+                            std::vector<std::pair<K, lsn_t>> &pairs) {
+  pairs.clear();
+  if (pos + static_cast<int>(sizeof(int32_t)) > size)
+    return -1;
+  int32_t count = *reinterpret_cast<const int32_t *>(storage + pos);
+  pos += sizeof(int32_t);
+  if (count < 0 ||
+      count > (size - pos) / static_cast<int>(sizeof(K) + sizeof(lsn_t)))
+    return -1;
+  pairs.resize(count);
+  for (auto &pair : pairs) {
+    memcpy(&pair.first, storage + pos, sizeof(K));
+    memcpy(&pair.second, storage + pos + sizeof(K), sizeof(lsn_t));
+    pos += sizeof(K) + sizeof(lsn_t);
+  }
+  return pos;
+}
+
+void LogRecord::SerializeTo(char *storage) const {
+  memcpy(storage, &size_, 4);
+  memcpy(storage + 4, &lsn_, 4);
+  memcpy(storage + 8, &txn_id_, 4);
+  memcpy(storage + 12, &prev_lsn_, 4);
+  memcpy(storage + 16, &log_record_type_, 4);
+  int pos = HEADER_SIZE;
+
+  switch (log_record_type_) {
+  case LogRecordType::INSERT:
+  case LogRecordType::MARKDELETE:
+  case LogRecordType::APPLYDELETE:
+  case LogRecordType::ROLLBACKDELETE:
+    memcpy(storage + pos, &rid_, sizeof(RID));
+    pos += sizeof(RID);
+    tuple_.SerializeTo(storage + pos);
+    break;
+  case LogRecordType::UPDATE:
+    memcpy(storage + pos, &rid_, sizeof(RID));
+    pos += sizeof(RID);
+    tuple_.SerializeTo(storage + pos);
+    pos += sizeof(int32_t) + tuple_.GetLength();
+    new_tuple_.SerializeTo(storage + pos);
+    break;
+  case LogRecordType::NEWPAGE: {
+    memcpy(storage + pos, &prev_page_id_, sizeof(page_id_t));
+    memcpy(storage + pos + sizeof(page_id_t), &page_id_, sizeof(page_id_t));
+    if (!layout_.IsPax())
+      break;
+    pos += 2 * sizeof(page_id_t);
+    uint32_t count = layout_.widths_.size();
+    memcpy(storage + pos, &layout_.capacity_, sizeof(uint32_t));
+    memcpy(storage + pos + sizeof(uint32_t), &count, sizeof(uint32_t));
+    memcpy(storage + pos + 2 * sizeof(uint32_t), layout_.widths_.data(),
+           count * sizeof(uint32_t));
+    break;
+  }
+  case LogRecordType::UNLINKPAGE:
+    memcpy(storage + pos, &prev_page_id_, sizeof(page_id_t));
+    memcpy(storage + pos + sizeof(page_id_t), &page_id_, sizeof(page_id_t));
+    memcpy(storage + pos + 2 * sizeof(page_id_t), &next_page_id_,
+           sizeof(page_id_t));
+    break;
+  case LogRecordType::OVERFLOWPAGE:
+    memcpy(storage + pos, &page_id_, sizeof(page_id_t));
+    memcpy(storage + pos + sizeof(page_id_t), &next_page_id_,
+           sizeof(page_id_t));
+    tuple_.SerializeTo(storage + pos + 2 * sizeof(page_id_t));
+    break;
+  case LogRecordType::END_CHECKPOINT:
+    memcpy(storage + pos, &begin_lsn_, sizeof(lsn_t));
+    pos += sizeof(lsn_t);
+    pos = SerializePairs(storage, pos, dirty_pages_);
+    SerializePairs(storage, pos, active_txns_);
+    break;
+  default:
+    break;
+  }
+}
+
+bool LogRecord::DeserializeFrom(const char *storage, int32_t available) {
+  if (available < HEADER_SIZE)
+    return false;
+  int32_t size = *reinterpret_cast<const int32_t *>(storage);
+  int32_t type = *reinterpret_cast<const int32_t *>(storage + 16);
+  if (size < HEADER_SIZE || size > available ||
+      type <= static_cast<int32_t>(LogRecordType::INVALID) ||
+      type > static_cast<int32_t>(LogRecordType::OVERFLOWPAGE))
+    return false;
+  size_ = size;
+  lsn_ = *reinterpret_cast<const lsn_t *>(storage + 4);
+  txn_id_ = *reinterpret_cast<const txn_id_t *>(storage + 8);
+  prev_lsn_ = *reinterpret_cast<const lsn_t *>(storage + 12);
+  log_record_type_ = static_cast<LogRecordType>(type);
+  int pos = HEADER_SIZE;
+
+  switch (log_record_type_) {
+  case LogRecordType::INSERT:
+  case LogRecordType::MARKDELETE:
+  case LogRecordType::APPLYDELETE:
+  case LogRecordType::ROLLBACKDELETE:
+    memcpy(&rid_, storage + pos, sizeof(RID));
+    pos += sizeof(RID);
+    if (!TupleFits(storage, pos, size_))
+      return false;
+    tuple_.DeserializeFrom(storage + pos);
+    tuple_.rid_ = rid_;
+    break;
+  case LogRecordType::UPDATE:
+    memcpy(&rid_, storage + pos, sizeof(RID));
+    pos += sizeof(RID);
+    if (!TupleFits(storage, pos, size_))
+      return false;
+    tuple_.DeserializeFrom(storage + pos);
+    pos += sizeof(int32_t) + tuple_.GetLength();
+    if (!TupleFits(storage, pos, size_))
+      return false;
+    new_tuple_.DeserializeFrom(storage + pos);
+    tuple_.rid_ = new_tuple_.rid_ = rid_;
+    break;
+  case LogRecordType::NEWPAGE:
+    if (pos + static_cast<int>(2 * sizeof(page_id_t)) > size_)
+      return false;
+    memcpy(&prev_page_id_, storage + pos, sizeof(page_id_t));
+    memcpy(&page_id_, storage + pos + sizeof(page_id_t), sizeof(page_id_t));
+    pos += 2 * sizeof(page_id_t);
+    layout_ = PaxLayout();
+    if (pos < size_) {
+      uint32_t count;
+      if (pos + static_cast<int>(2 * sizeof(uint32_t)) > size_)
+        return false;
+      memcpy(&layout_.capacity_, storage + pos, sizeof(uint32_t));
+      memcpy(&count, storage + pos + sizeof(uint32_t), sizeof(uint32_t));
+      pos += 2 * sizeof(uint32_t);
+      if (count == 0 || count > static_cast<uint32_t>(size_ - pos) /
+                                    sizeof(uint32_t))
+        return false;
+      layout_.widths_.resize(count);
+      memcpy(layout_.widths_.data(), storage + pos, count * sizeof(uint32_t));
+    }
+    break;
+  case LogRecordType::UNLINKPAGE:
+    if (pos + static_cast<int>(3 * sizeof(page_id_t)) > size_)
+      return false;
+    memcpy(&prev_page_id_, storage + pos, sizeof(page_id_t));
+    memcpy(&page_id_, storage + pos + sizeof(page_id_t), sizeof(page_id_t));
+    memcpy(&next_page_id_, storage + pos + 2 * sizeof(page_id_t),
+           sizeof(page_id_t));
+    break;
+  case LogRecordType::OVERFLOWPAGE:
+    if (pos + static_cast<int>(2 * sizeof(page_id_t)) > size_)
+      return false;
+    memcpy(&page_id_, storage + pos, sizeof(page_id_t));
+    memcpy(&next_page_id_, storage + pos + sizeof(page_id_t),
+           sizeof(page_id_t));
+    pos += 2 * sizeof(page_id_t);
+    if (!TupleFits(storage, pos, size_))
+      return false;
+    tuple_.DeserializeFrom(storage + pos);
+    break;
+  case LogRecordType::END_CHECKPOINT:
+    if (pos + static_cast<int>(sizeof(lsn_t)) > size_)
+      return false;
+    memcpy(&begin_lsn_, storage + pos, sizeof(lsn_t));
+    pos += sizeof(lsn_t);
+    pos = DeserializePairs(storage, pos, size_, dirty_pages_);
+    if (pos < 0)
+      return false;
+    if (DeserializePairs(storage, pos, size_, active_txns_) < 0)
+      return false;
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
+std::string LogRecord::ToString() const {
+  std::ostringstream os;
+  os << "Log["
+     << "size:" << size_ << ", "
+     << "LSN:" << lsn_ << ", "
+     << "transID:" << txn_id_ << ", "
+     << "prevLSN:" << prev_lsn_ << ", "
+     << "LogType:" << static_cast<int>(log_record_type_) << "]";
+  return os.str();
+}
+
+} // namespace cmudb
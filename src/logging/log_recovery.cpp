@@ -0,0 +1,426 @@
+/**
+ * log_recovery.cpp
+ */
+
+#include <algorithm>
+#include <thread>
+
+#include "common/logger.h"
+#include "logging/log_recovery.h"
+#include "page/overflow_page.h"
+
+namespace cmudb {
+
+LogRecovery::LogRecovery(BufferPoolManager *buffer_pool_manager,
+                         size_t redo_threads)
+    : buffer_pool_manager_(buffer_pool_manager),
+      disk_manager_(buffer_pool_manager->GetDiskManager()),
+      redo_threads_(redo_threads),
+      max_page_ids_(MAX_TABLESPACES, INVALID_PAGE_ID), next_lsn_(0),
+      next_txn_id_(0), checkpoint_lsn_(INVALID_LSN) {
+  if (redo_threads_ == 0)
+    redo_threads_ = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void LogRecovery::Recover(LogManager *log_manager) {
+  auto start = std::chrono::steady_clock::now();
+  Analysis();
+  auto analysis_end = std::chrono::steady_clock::now();
+  stats_.redo_records_ = Redo(log_records_, stats_.redo_pages_);
+  auto redo_end = std::chrono::steady_clock::now();
+  if (log_manager != nullptr) {
+    // new records continue after the existing ones
+    log_manager->SetNextLSN(next_lsn_);
+    log_manager->RunFlushThread();
+    Undo(log_manager);
+  }
+  auto undo_end = std::chrono::steady_clock::now();
+
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  stats_.analysis_time_ = duration_cast<microseconds>(analysis_end - start);
+  stats_.redo_time_ = duration_cast<microseconds>(redo_end - analysis_end);
+  stats_.undo_time_ = duration_cast<microseconds>(undo_end - redo_end);
+  stats_.total_time_ = duration_cast<microseconds>(undo_end - start);
+  LOG_INFO("recovery: %zu log records, redo %zu records on %zu pages with %zu "
+           "threads, undo %zu records of %zu losers",
+           stats_.log_records_, stats_.redo_records_, stats_.redo_pages_,
+           redo_threads_, stats_.undo_records_, stats_.loser_txns_);
+  LOG_INFO("recovery: analysis %lld us, redo %lld us, undo %lld us, total "
+           "%lld us",
+           static_cast<long long>(stats_.analysis_time_.count()),
+           static_cast<long long>(stats_.redo_time_.count()),
+           static_cast<long long>(stats_.undo_time_.count()),
+           static_cast<long long>(stats_.total_time_.count()));
+}
+
+/*
+ * Scan the log from the start kept by the last checkpoint. Stops at the first record that can not be read, which
+ * is the tail torn by the crash, and cuts the log there so that new records
+ * are appended right after the last complete one.
+ */
+void LogRecovery::Analysis() {
+  log_records_.clear();
+  active_txn_.clear();
+  checkpoint_lsn_ = INVALID_LSN;
+  dirty_pages_.clear();
+  off_t log_start = disk_manager_->GetLogStart();
+  size_t log_size = disk_manager_->GetLogFileSize() - log_start;
+  std::vector<char> buffer(log_size);
+  log_size = disk_manager_->ReadLog(buffer.data(), log_size, log_start);
+  size_t offset = 0;
+  LogRecord log_record;
+  while (offset < log_size &&
+         log_record.DeserializeFrom(
+             buffer.data() + offset,
+             std::min<size_t>(log_size - offset, INT32_MAX))) {
+    offset += log_record.GetSize();
+    next_lsn_ = std::max(next_lsn_, log_record.GetLSN() + 1);
+    next_txn_id_ = std::max(next_txn_id_, log_record.GetTxnId() + 1);
+    switch (log_record.GetLogRecordType()) {
+    case LogRecordType::COMMIT:
+    case LogRecordType::ABORT:
+      active_txn_.erase(log_record.GetTxnId());
+      break;
+    case LogRecordType::NEWPAGE:
+    case LogRecordType::OVERFLOWPAGE:
+      if (log_record.GetPageId() != INVALID_PAGE_ID) {
+        page_id_t &max_page_id =
+            max_page_ids_[GetTablespaceId(log_record.GetPageId())];
+        max_page_id = std::max(max_page_id, log_record.GetPageId());
+      }
+      active_txn_[log_record.GetTxnId()] = log_record.GetLSN();
+      break;
+    case LogRecordType::BEGIN_CHECKPOINT:
+      break;
+    case LogRecordType::END_CHECKPOINT:
+      // the last complete checkpoint wins. Its transaction table adds nothing,
+      // the log still holds every record of the transactions in it
+      checkpoint_lsn_ = log_record.GetBeginLSN();
+      dirty_pages_.clear();
+      for (auto &dirty_page : log_record.GetDirtyPages())
+        dirty_pages_[dirty_page.first] = dirty_page.second;
+      for (auto &active_txn : log_record.GetActiveTxns())
+        next_txn_id_ = std::max(next_txn_id_, active_txn.first + 1);
+      break;
+    default:
+      active_txn_[log_record.GetTxnId()] = log_record.GetLSN();
+      break;
+    }
+    log_records_.push_back(log_record);
+  }
+  if (offset < log_size) {
+    LOG_DEBUG("log torn at offset %lld, truncated",
+              static_cast<long long>(log_start + offset));
+    disk_manager_->TruncateLog(log_start + offset);
+  }
+  // pages created before the crash may not have reached the file yet
+  for (page_id_t max_page_id : max_page_ids_)
+    if (max_page_id != INVALID_PAGE_ID)
+      disk_manager_->ReservePageIds(max_page_id);
+  stats_.log_records_ = log_records_.size();
+  stats_.loser_txns_ = active_txn_.size();
+}
+
+/*
+ * The checkpoint read by analysis is older than the records, every one of
+ * them may be missing from its page
+ */
+size_t LogRecovery::Replay(const std::vector<LogRecord> &log_records) {
+  for (const LogRecord &log_record : log_records)
+    next_lsn_ = std::max(next_lsn_, log_record.GetLSN() + 1);
+  size_t pages = 0;
+  return Redo(log_records, pages);
+}
+
+/*
+ * Hand every page to one worker, page_id % redo_threads_
+ */
+size_t LogRecovery::Redo(const std::vector<LogRecord> &log_records,
+                         size_t &pages) {
+  std::vector<std::vector<RedoItem>> partitions(redo_threads_);
+  for (const LogRecord &log_record : log_records) {
+    switch (log_record.GetLogRecordType()) {
+    case LogRecordType::INSERT:
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+    case LogRecordType::UPDATE: {
+      page_id_t page_id = log_record.GetRID().GetPageId();
+      if (NeedsRedo(page_id, log_record.GetLSN()))
+        partitions[page_id % redo_threads_].emplace_back(page_id, &log_record);
+      break;
+    }
+    case LogRecordType::OVERFLOWPAGE: {
+      page_id_t page_id = log_record.GetPageId();
+      if (NeedsRedo(page_id, log_record.GetLSN()))
+        partitions[page_id % redo_threads_].emplace_back(page_id, &log_record);
+      break;
+    }
+    case LogRecordType::NEWPAGE: {
+      page_id_t page_id = log_record.GetPageId();
+      if (NeedsRedo(page_id, log_record.GetLSN()))
+        partitions[page_id % redo_threads_].emplace_back(page_id, &log_record);
+      page_id_t prev_page_id = log_record.GetPrevPageId();
+      if (prev_page_id != INVALID_PAGE_ID)
+        partitions[prev_page_id % redo_threads_].emplace_back(prev_page_id,
+                                                              &log_record);
+      break;
+    }
+    case LogRecordType::UNLINKPAGE: {
+      // only the links around the page change
+      page_id_t prev_page_id = log_record.GetPrevPageId();
+      page_id_t next_page_id = log_record.GetNextPageId();
+      partitions[prev_page_id % redo_threads_].emplace_back(prev_page_id,
+                                                            &log_record);
+      partitions[next_page_id % redo_threads_].emplace_back(next_page_id,
+                                                            &log_record);
+      break;
+    }
+    default:
+      break;
+    }
+  }
+
+  std::vector<size_t> redone(redo_threads_, 0);
+  std::vector<size_t> partition_pages(redo_threads_, 0);
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < redo_threads_; ++i) {
+    if (partitions[i].empty())
+      continue;
+    workers.emplace_back(&LogRecovery::RedoPartition, this,
+                         std::cref(partitions[i]), std::ref(redone[i]),
+                         std::ref(partition_pages[i]));
+  }
+  RedoPartition(partitions[0], redone[0], partition_pages[0]);
+  for (auto &worker : workers)
+    worker.join();
+  size_t applied = 0;
+  for (size_t i = 0; i < redo_threads_; ++i) {
+    applied += redone[i];
+    pages += partition_pages[i];
+  }
+  return applied;
+}
+
+/*
+ * Before the last checkpoint only changes of pages in its dirty page table
+ * from their rec lsn on can be missing from disk. An entry without page id
+ * stands for a dirty page table too large for the checkpoint record.
+ */
+bool LogRecovery::NeedsRedo(page_id_t page_id, lsn_t lsn) const {
+  if (checkpoint_lsn_ == INVALID_LSN || lsn >= checkpoint_lsn_)
+    return true;
+  auto it = dirty_pages_.find(page_id);
+  if (it != dirty_pages_.end() && lsn >= it->second)
+    return true;
+  it = dirty_pages_.find(INVALID_PAGE_ID);
+  return it != dirty_pages_.end() && lsn >= it->second;
+}
+
+/*
+ * Each page is fetched once and gets all its records in lsn order, a record
+ * is only applied if it is newer than the page
+ */
+void LogRecovery::RedoPartition(const std::vector<RedoItem> &items,
+                                size_t &redone, size_t &pages) {
+  std::vector<RedoItem> sorted(items);
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const RedoItem &a, const RedoItem &b) {
+                     return a.first < b.first;
+                   });
+  for (size_t start = 0; start < sorted.size();) {
+    page_id_t page_id = sorted[start].first;
+    size_t end = start;
+    while (end < sorted.size() && sorted[end].first == page_id)
+      ++end;
+    auto page =
+        static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+    if (page == nullptr) {
+      LOG_DEBUG("redo can not fetch page %lld",
+                static_cast<long long>(page_id));
+      start = end;
+      continue;
+    }
+    page->WLatch();
+    size_t applied = 0;
+    bool is_dirty = false;
+    for (size_t i = start; i < end; ++i) {
+      const LogRecord &log_record = *sorted[i].second;
+      if (log_record.GetLogRecordType() == LogRecordType::NEWPAGE &&
+          log_record.GetPageId() != page_id) {
+        // link from the previous page, it does not carry the record lsn.
+        // Every page has one successor, so setting it again is harmless
+        if (page->GetNextPageId() != log_record.GetPageId()) {
+          page->SetNextPageId(log_record.GetPageId());
+          is_dirty = true;
+        }
+        continue;
+      }
+      if (log_record.GetLogRecordType() == LogRecordType::UNLINKPAGE) {
+        // relink the neighbours, later links of a page come later in the log
+        if (page_id == log_record.GetPrevPageId() &&
+            page->GetNextPageId() != log_record.GetNextPageId()) {
+          page->SetNextPageId(log_record.GetNextPageId());
+          is_dirty = true;
+        }
+        if (page_id == log_record.GetNextPageId() &&
+            page->GetPrevPageId() != log_record.GetPrevPageId()) {
+          page->SetPrevPageId(log_record.GetPrevPageId());
+          is_dirty = true;
+        }
+        continue;
+      }
+      // a page never written reads as zeros, its lsn means nothing then
+      bool is_empty = page->GetPageId() != page_id;
+      if (!is_empty && page->GetPageLSN() >= log_record.GetLSN())
+        continue;
+      // the next checkpoint has to keep the record until the page is written
+      page->SetRecLSN(log_record.GetLSN());
+      RedoRecord(page, log_record);
+      page->SetPageLSN(log_record.GetLSN());
+      ++applied;
+    }
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, is_dirty || applied > 0);
+    redone += applied;
+    if (applied > 0)
+      ++pages;
+    start = end;
+  }
+}
+
+void LogRecovery::RedoRecord(TablePage *page, const LogRecord &log_record) {
+  RID rid = log_record.GetRID();
+  switch (log_record.GetLogRecordType()) {
+  case LogRecordType::INSERT: {
+    RID new_rid = rid;
+    page->RestoreTuple(log_record.GetTuple(), new_rid);
+    assert(new_rid == rid);
+    break;
+  }
+  case LogRecordType::MARKDELETE:
+    page->MarkDelete(rid, nullptr, nullptr, nullptr);
+    break;
+  case LogRecordType::APPLYDELETE:
+    page->ApplyDelete(rid, nullptr, nullptr);
+    break;
+  case LogRecordType::ROLLBACKDELETE:
+    page->RollbackDelete(rid, nullptr, nullptr);
+    break;
+  case LogRecordType::UPDATE: {
+    Tuple old_tuple;
+    page->UpdateTuple(log_record.GetNewTuple(), old_tuple, rid, nullptr,
+                      nullptr, nullptr);
+    break;
+  }
+  case LogRecordType::NEWPAGE:
+    page->Init(log_record.GetPageId(), PAGE_SIZE, log_record.GetPrevPageId(),
+               INVALID_PAGE_ID, nullptr, nullptr, log_record.GetPaxLayout());
+    break;
+  case LogRecordType::OVERFLOWPAGE: {
+    // the page id and lsn of an overflow page are where a table page has them
+    const Tuple &bytes = log_record.GetTuple();
+    reinterpret_cast<OverflowPage *>(page)->Init(
+        log_record.GetPageId(), log_record.GetNextPageId(), bytes.GetData(),
+        bytes.GetLength());
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+/*
+ * Roll back losers in reverse log order, then end each of them with ABORT
+ */
+void LogRecovery::Undo(LogManager *log_manager) {
+  if (active_txn_.empty())
+    return;
+  for (auto it = log_records_.rbegin(); it != log_records_.rend(); ++it) {
+    if (active_txn_.count(it->GetTxnId()) != 0)
+      UndoRecord(*it, log_manager);
+  }
+  lsn_t lsn = INVALID_LSN;
+  for (auto &txn : active_txn_) {
+    LogRecord log_record(txn.first, txn.second, LogRecordType::ABORT);
+    lsn = log_manager->AppendLogRecord(log_record);
+  }
+  log_manager->WaitUntilDurable(lsn);
+  active_txn_.clear();
+}
+
+void LogRecovery::UndoRecord(const LogRecord &log_record,
+                             LogManager *log_manager) {
+  LogRecordType type = log_record.GetLogRecordType();
+  if (type != LogRecordType::INSERT && type != LogRecordType::MARKDELETE &&
+      type != LogRecordType::APPLYDELETE &&
+      type != LogRecordType::ROLLBACKDELETE && type != LogRecordType::UPDATE)
+    return;
+
+  RID rid = log_record.GetRID();
+  auto page = static_cast<TablePage *>(
+      buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  if (page == nullptr) {
+    LOG_DEBUG("undo can not fetch page %lld",
+              static_cast<long long>(rid.GetPageId()));
+    return;
+  }
+  txn_id_t txn_id = log_record.GetTxnId();
+  lsn_t prev_lsn = active_txn_[txn_id];
+  Tuple dummy_tuple;
+  LogRecord undo_record;
+  page->WLatch();
+  switch (type) {
+  case LogRecordType::INSERT:
+    page->ApplyDelete(rid, nullptr, nullptr);
+    undo_record = LogRecord(txn_id, prev_lsn, LogRecordType::APPLYDELETE, rid,
+                            log_record.GetTuple());
+    break;
+  case LogRecordType::MARKDELETE:
+    page->RollbackDelete(rid, nullptr, nullptr);
+    undo_record = LogRecord(txn_id, prev_lsn, LogRecordType::ROLLBACKDELETE,
+                            rid, dummy_tuple);
+    break;
+  case LogRecordType::ROLLBACKDELETE:
+    page->MarkDelete(rid, nullptr, nullptr, nullptr);
+    undo_record = LogRecord(txn_id, prev_lsn, LogRecordType::MARKDELETE, rid,
+                            dummy_tuple);
+    break;
+  case LogRecordType::APPLYDELETE: {
+    // back in its slot unless another transaction took it meanwhile
+    RID new_rid = rid;
+    if (!page->RestoreTuple(log_record.GetTuple(), new_rid)) {
+      LOG_DEBUG("undo can not insert tuple again");
+      page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+      return;
+    }
+    undo_record = LogRecord(txn_id, prev_lsn, LogRecordType::INSERT, new_rid,
+                            log_record.GetTuple());
+    break;
+  }
+  default: {
+    Tuple new_tuple;
+    if (!page->UpdateTuple(log_record.GetTuple(), new_tuple, rid, nullptr,
+                           nullptr, nullptr)) {
+      LOG_DEBUG("undo can not restore updated tuple");
+      page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+      return;
+    }
+    undo_record = LogRecord(txn_id, prev_lsn, LogRecordType::UPDATE, rid,
+                            new_tuple, log_record.GetTuple());
+    break;
+  }
+  }
+  page->SetRecLSN(log_manager->GetNextLSN());
+  lsn_t lsn = log_manager->AppendLogRecord(undo_record);
+  page->SetPageLSN(lsn);
+  active_txn_[txn_id] = lsn;
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(rid.GetPageId(), true);
+  ++stats_.undo_records_;
+}
+
+} // namespace cmudb
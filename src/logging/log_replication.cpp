@@ -0,0 +1,461 @@
+/**
+ * log_replication.cpp
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "common/logger.h"
+#include "logging/log_recovery.h"
+#include "logging/log_replication.h"
+
+namespace cmudb {
+
+// size bytes from fd, false if it closed or stop was set meanwhile
+static bool ReceiveAll(int fd, char *data, size_t size,
+                       const std::atomic<bool> &stop) {
+  while (size > 0) {
+    struct pollfd poll_fd = {fd, POLLIN, 0};
+    int rc = poll(&poll_fd, 1, REPLICATION_POLL_INTERVAL.count());
+    if (stop)
+      return false;
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0)
+      continue;
+    ssize_t received = recv(fd, data, size, 0);
+    if (received < 0 && errno == EINTR)
+      continue;
+    if (received <= 0)
+      return false;
+    data += received;
+    size -= received;
+  }
+  return true;
+}
+
+static bool SendAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+      return false;
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+static int64_t WallClockMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// size and lsn of the record at data, a header's first two fields
+static void ReadRecordHeader(const char *data, int32_t &size, lsn_t &lsn) {
+  memcpy(&size, data, sizeof(size));
+  memcpy(&lsn, data + sizeof(int32_t), sizeof(lsn));
+}
+
+/*
+ * LogShipper
+ */
+LogShipper::~LogShipper() { Stop(); }
+
+bool LogShipper::Listen(int port) {
+  if (listen_fd_ >= 0)
+    return false;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return false;
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  socklen_t length = sizeof(address);
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&address), length) != 0 ||
+      listen(fd, SOMAXCONN) != 0 ||
+      getsockname(fd, reinterpret_cast<struct sockaddr *>(&address),
+                  &length) != 0) {
+    LOG_DEBUG("can not listen on port %d", port);
+    close(fd);
+    return false;
+  }
+  listen_fd_ = fd;
+  port_ = ntohs(address.sin_port);
+  stop_ = false;
+  accept_thread_ = std::thread(&LogShipper::AcceptThread, this);
+  return true;
+}
+
+void LogShipper::Stop() {
+  stop_ = true;
+  if (accept_thread_.joinable())
+    accept_thread_.join();
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    threads.swap(ship_threads_);
+  }
+  for (auto &thread : threads)
+    thread.join();
+  if (listen_fd_ >= 0)
+    close(listen_fd_);
+  listen_fd_ = -1;
+}
+
+void LogShipper::AcceptThread() {
+  while (!stop_) {
+    struct pollfd poll_fd = {listen_fd_, POLLIN, 0};
+    if (poll(&poll_fd, 1, REPLICATION_POLL_INTERVAL.count()) <= 0)
+      continue;
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    std::lock_guard<std::mutex> guard(latch_);
+    ship_threads_.emplace_back(&LogShipper::ShipThread, this, fd);
+  }
+}
+
+/*
+ * Records are only read whole, the durable log ends after a whole record
+ */
+bool LogShipper::ReadRecords(off_t offset, off_t log_end,
+                             std::vector<char> &buffer) {
+  size_t size = std::min<off_t>(REPLICATION_CHUNK, log_end - offset);
+  buffer.resize(size);
+  size = disk_manager_->ReadLog(buffer.data(), size, offset);
+  size_t whole = 0;
+  while (whole + LogRecord::HEADER_SIZE <= size) {
+    int32_t record_size;
+    lsn_t lsn;
+    ReadRecordHeader(buffer.data() + whole, record_size, lsn);
+    if (record_size < LogRecord::HEADER_SIZE)
+      break;
+    if (whole + record_size > size) {
+      // a record larger than the chunk is read on its own
+      if (whole == 0 && offset + record_size <= log_end) {
+        buffer.resize(record_size);
+        if (disk_manager_->ReadLog(buffer.data(), record_size, offset) ==
+            static_cast<size_t>(record_size))
+          whole = record_size;
+      }
+      break;
+    }
+    whole += record_size;
+  }
+  buffer.resize(whole);
+  return whole > 0;
+}
+
+/*
+ * The log is held from the first frame the replica has not acknowledged,
+ * from the log start until the records it asked for are found
+ */
+void LogShipper::ShipThread(int fd) {
+  replicas_++;
+  int64_t next_lsn;
+  off_t offset = disk_manager_->HoldLog();
+  off_t held = offset;
+  bool found = false;
+  std::deque<SentFrame> sent;
+  std::vector<char> buffer;
+  auto last_send = std::chrono::steady_clock::now();
+  bool connected = ReceiveAll(fd, reinterpret_cast<char *>(&next_lsn),
+                              sizeof(next_lsn), stop_);
+  while (connected && !stop_) {
+    off_t log_end = disk_manager_->GetLogFileSize();
+    size_t skipped = 0;
+    bool has_records =
+        offset < log_end && ReadRecords(offset, log_end, buffer);
+    if (has_records && !found) {
+      // skip what the replica has, it is too far behind if the log of the
+      // primary starts after its next record
+      int32_t size;
+      lsn_t lsn;
+      ReadRecordHeader(buffer.data(), size, lsn);
+      if (lsn > next_lsn) {
+        LOG_WARN("replica asks for lsn %lld, the log starts at lsn %d",
+                 static_cast<long long>(next_lsn), lsn);
+        break;
+      }
+      while (skipped < buffer.size()) {
+        ReadRecordHeader(buffer.data() + skipped, size, lsn);
+        if (lsn >= next_lsn) {
+          found = true;
+          break;
+        }
+        skipped += size;
+      }
+    }
+    auto now = std::chrono::steady_clock::now();
+    if ((has_records && skipped < buffer.size()) ||
+        now - last_send >= REPLICATION_HEARTBEAT) {
+      size_t size = has_records ? buffer.size() - skipped : 0;
+      char header[REPLICATION_FRAME_HEADER_SIZE] = {0};
+      int32_t frame_size = size;
+      int64_t frame_offset = offset + skipped;
+      int64_t frame_end = log_end;
+      int64_t time = WallClockMicros();
+      memcpy(header, &frame_size, sizeof(frame_size));
+      memcpy(header + 8, &frame_offset, sizeof(frame_offset));
+      memcpy(header + 16, &frame_end, sizeof(frame_end));
+      memcpy(header + 24, &time, sizeof(time));
+      if (!SendAll(fd, header, sizeof(header)) ||
+          !SendAll(fd, buffer.data() + skipped, size))
+        break;
+      if (size > 0) {
+        // the lsn of the last record, found by walking the frame
+        int32_t record_size;
+        lsn_t lsn = INVALID_LSN;
+        for (size_t position = skipped; position < buffer.size();
+             position += record_size)
+          ReadRecordHeader(buffer.data() + position, record_size, lsn);
+        sent.push_back({frame_offset, lsn});
+        shipped_bytes_ += size;
+      }
+      last_send = now;
+    }
+    if (has_records)
+      offset += buffer.size();
+
+    // acknowledgements, waiting for them a while if there was nothing to send
+    struct pollfd poll_fd = {fd, POLLIN, 0};
+    int timeout = has_records ? 0 : REPLICATION_POLL_INTERVAL.count();
+    while (connected && poll(&poll_fd, 1, timeout) > 0) {
+      int64_t applied_lsn;
+      connected = ReceiveAll(fd, reinterpret_cast<char *>(&applied_lsn),
+                             sizeof(applied_lsn), stop_);
+      while (connected && !sent.empty() &&
+             sent.front().last_lsn_ < applied_lsn)
+        sent.pop_front();
+      timeout = 0;
+    }
+    off_t hold = sent.empty() ? (found ? offset : held) : sent.front().offset_;
+    if (hold != held) {
+      disk_manager_->HoldLog(hold);
+      disk_manager_->ReleaseLog(held);
+      held = hold;
+    }
+  }
+  disk_manager_->ReleaseLog(held);
+  close(fd);
+  replicas_--;
+}
+
+/*
+ * LogReplica
+ */
+LogReplica::LogReplica(BufferPoolManager *buffer_pool_manager)
+    : buffer_pool_manager_(buffer_pool_manager),
+      disk_manager_(buffer_pool_manager->GetDiskManager()) {
+  LogRecovery log_recovery(buffer_pool_manager);
+  log_recovery.Recover(nullptr);
+  next_lsn_ = log_recovery.GetNextLSN();
+  for (auto &txn : log_recovery.GetLoserTxns())
+    applied_txns_.insert(txn.first);
+  last_record_offset_ = disk_manager_->GetLogStart();
+}
+
+LogReplica::~LogReplica() {
+  Stop();
+  buffer_pool_manager_->FlushAllPages();
+}
+
+void LogReplica::Start(const std::string &host, int port) {
+  if (apply_thread_.joinable())
+    return;
+  host_ = host;
+  port_ = port;
+  stop_ = false;
+  apply_thread_ = std::thread(&LogReplica::ApplyThread, this);
+}
+
+void LogReplica::Stop() {
+  stop_ = true;
+  if (apply_thread_.joinable())
+    apply_thread_.join();
+}
+
+int64_t LogReplica::GetLagBytes() const {
+  return std::max<int64_t>(primary_end_ - applied_offset_, 0);
+}
+
+std::chrono::microseconds LogReplica::GetLag() const {
+  std::lock_guard<std::mutex> guard(frames_latch_);
+  if (frames_.empty())
+    return std::chrono::microseconds(0);
+  return std::chrono::microseconds(
+      std::max<int64_t>(WallClockMicros() - frames_.front().second, 0));
+}
+
+void LogReplica::ApplyThread() {
+  while (!stop_) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addresses = nullptr;
+    int fd = -1;
+    if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints,
+                    &addresses) == 0) {
+      for (auto address = addresses; address != nullptr && fd < 0;
+           address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype,
+                    address->ai_protocol);
+        if (fd >= 0 &&
+            connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+          close(fd);
+          fd = -1;
+        }
+      }
+      freeaddrinfo(addresses);
+    }
+    if (fd >= 0) {
+      int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      connected_ = true;
+      Receive(fd);
+      connected_ = false;
+      close(fd);
+      LOG_DEBUG("replica lost %s:%d", host_.c_str(), port_);
+    }
+    // what was held back is asked for again
+    running_txns_ = applied_txns_;
+    records_.clear();
+    record_bytes_.clear();
+    quiet_records_ = quiet_bytes_ = 0;
+    {
+      std::lock_guard<std::mutex> guard(frames_latch_);
+      frames_.clear();
+    }
+    for (auto waited = std::chrono::milliseconds(0);
+         !stop_ && waited < REPLICATION_RETRY_INTERVAL;
+         waited += REPLICATION_POLL_INTERVAL)
+      std::this_thread::sleep_for(REPLICATION_POLL_INTERVAL);
+  }
+}
+
+void LogReplica::Receive(int fd) {
+  int64_t next_lsn = next_lsn_;
+  if (!SendAll(fd, reinterpret_cast<char *>(&next_lsn), sizeof(next_lsn)))
+    return;
+  char header[REPLICATION_FRAME_HEADER_SIZE];
+  while (ReceiveAll(fd, header, sizeof(header), stop_)) {
+    int32_t size;
+    int64_t offset, log_end, time;
+    memcpy(&size, header, sizeof(size));
+    memcpy(&offset, header + 8, sizeof(offset));
+    memcpy(&log_end, header + 16, sizeof(log_end));
+    memcpy(&time, header + 24, sizeof(time));
+    if (records_.empty())
+      applied_offset_ = quiet_offset_ = offset;
+    primary_end_ = log_end;
+    if (size <= 0)
+      continue;
+    size_t first_byte = record_bytes_.size();
+    record_bytes_.resize(first_byte + size);
+    if (!ReceiveAll(fd, record_bytes_.data() + first_byte, size, stop_))
+      return;
+    received_offset_ = offset + size;
+    {
+      std::lock_guard<std::mutex> guard(frames_latch_);
+      frames_.emplace_back(received_offset_, time);
+    }
+    for (size_t position = first_byte; position < record_bytes_.size();) {
+      LogRecord log_record;
+      if (!log_record.DeserializeFrom(
+              record_bytes_.data() + position,
+              std::min<size_t>(record_bytes_.size() - position, INT32_MAX))) {
+        LOG_WARN("replica received a record it can not read");
+        return;
+      }
+      position += log_record.GetSize();
+      switch (log_record.GetLogRecordType()) {
+      case LogRecordType::COMMIT:
+      case LogRecordType::ABORT:
+        running_txns_.erase(log_record.GetTxnId());
+        break;
+      case LogRecordType::BEGIN_CHECKPOINT:
+      case LogRecordType::END_CHECKPOINT:
+        break;
+      default:
+        running_txns_.insert(log_record.GetTxnId());
+        break;
+      }
+      records_.push_back(std::move(log_record));
+      if (running_txns_.empty()) {
+        quiet_records_ = records_.size();
+        quiet_bytes_ = position;
+        quiet_offset_ = offset + (position - first_byte);
+      }
+    }
+    if (quiet_records_ > 0 && !Apply(fd))
+      return;
+  }
+}
+
+/*
+ * The records reach the log of the replica before its pages, a restart of
+ * the replica redoes them. A checkpoint of the replica flushes every page,
+ * the log before its last record is not needed then, that record only
+ * keeps the next lsn
+ */
+bool LogReplica::Apply(int fd) {
+  std::vector<LogRecord> batch(
+      std::make_move_iterator(records_.begin()),
+      std::make_move_iterator(records_.begin() + quiet_records_));
+  records_.erase(records_.begin(), records_.begin() + quiet_records_);
+  off_t log_end = disk_manager_->GetLogFileSize();
+  for (size_t written = 0; written < quiet_bytes_;) {
+    int size = std::min<size_t>(quiet_bytes_ - written, INT32_MAX);
+    disk_manager_->WriteLog(record_bytes_.data() + written, size);
+    written += size;
+  }
+  last_record_offset_ = log_end + quiet_bytes_ - batch.back().GetSize();
+  record_bytes_.erase(record_bytes_.begin(),
+                      record_bytes_.begin() + quiet_bytes_);
+  checkpoint_bytes_ += quiet_bytes_;
+  quiet_records_ = quiet_bytes_ = 0;
+
+  latch_.WLock();
+  // a batch is about what committed since the last one, a thread does it
+  LogRecovery log_recovery(buffer_pool_manager_, 1);
+  log_recovery.Replay(batch);
+  if (checkpoint_bytes_ >= REPLICATION_CHECKPOINT_BYTES) {
+    buffer_pool_manager_->FlushAllPages();
+    disk_manager_->SetLogStart(last_record_offset_);
+    checkpoint_bytes_ = 0;
+  }
+  latch_.WUnlock();
+
+  // no transaction was running where the batch ends
+  applied_txns_.clear();
+  next_lsn_ = batch.back().GetLSN() + 1;
+  applied_records_ += batch.size();
+  applied_offset_ = quiet_offset_;
+  {
+    std::lock_guard<std::mutex> guard(frames_latch_);
+    while (!frames_.empty() && frames_.front().first <= applied_offset_)
+      frames_.pop_front();
+  }
+  int64_t next_lsn = next_lsn_;
+  return SendAll(fd, reinterpret_cast<char *>(&next_lsn), sizeof(next_lsn));
+}
+
+} // namespace cmudb
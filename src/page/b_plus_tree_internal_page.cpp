@@ -1,10 +1,12 @@
 /**
  * b_plus_tree_internal_page.cpp
  */
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
 #include "common/exception.h"
+#include "index/key_search.h"
 #include "page/b_plus_tree_internal_page.h"
 
 namespace cmudb {
@@ -18,20 +20,30 @@ namespace cmudb {
  */
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Init(page_id_t page_id,
-                                          page_id_t parent_id) {}
+                                          page_id_t parent_id) {
+  SetPageType(IndexPageType::INTERNAL_PAGE);
+  SetSize(0);
+  SetPageId(page_id);
+  SetParentPageId(parent_id);
+  // one slot stays free, a full page takes one more child before it splits
+  SetMaxSize((PAGE_SIZE - sizeof(BPlusTreeInternalPage)) / sizeof(MappingType) -
+             1);
+}
 /*
  * Helper method to get/set the key associated with input "index"(a.k.a
  * array offset)
  */
 INDEX_TEMPLATE_ARGUMENTS
 KeyType B_PLUS_TREE_INTERNAL_PAGE_TYPE::KeyAt(int index) const {
-  // replace with your own code
-  KeyType key;
-  return key;
+  assert(index >= 0 && index < GetSize());
+  return array[index].first;
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetKeyAt(int index, const KeyType &key) {}
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetKeyAt(int index, const KeyType &key) {
+  assert(index >= 0 && index < GetSize());
+  array[index].first = key;
+}
 
 /*
  * Helper method to find and return array index(or offset), so that its value
@@ -39,7 +51,11 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetKeyAt(int index, const KeyType &key) {}
  */
 INDEX_TEMPLATE_ARGUMENTS
 int B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueIndex(const ValueType &value) const {
-  return 0;
+  for (int i = 0; i < GetSize(); ++i) {
+    if (array[i].second == value)
+      return i;
+  }
+  return -1;
 }
 
 /*
@@ -47,7 +63,10 @@ int B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueIndex(const ValueType &value) const {
  * offset)
  */
 INDEX_TEMPLATE_ARGUMENTS
-ValueType B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueAt(int index) const { return 0; }
+ValueType B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueAt(int index) const {
+  assert(index >= 0 && index < GetSize());
+  return array[index].second;
+}
 
 /*****************************************************************************
  * LOOKUP
@@ -61,7 +80,40 @@ INDEX_TEMPLATE_ARGUMENTS
 ValueType
 B_PLUS_TREE_INTERNAL_PAGE_TYPE::Lookup(const KeyType &key,
                                        const KeyComparator &comparator) const {
-  return INVALID_PAGE_ID;
+  return array[LookupIndex(key, comparator)].second;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+ValueType
+B_PLUS_TREE_INTERNAL_PAGE_TYPE::Lookup(const KeyType &key,
+                                       const KeyComparator &comparator,
+                                       int &index) const {
+  index = LookupIndex(key, comparator);
+  return array[index].second;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int B_PLUS_TREE_INTERNAL_PAGE_TYPE::LookupIndex(
+    const KeyType &key, const KeyComparator &comparator) const {
+  // size is read once, optimistic readers call this on a changing page
+  int size = GetSize();
+  // last index whose key is <= key
+  int low = 1, high = std::max(size, 1);
+  typedef IntegerKeySearch<KeyComparator> Search;
+  while (high - low > (Search::enabled ? KEY_SEARCH_BLOCK : 0)) {
+    int mid = low + (high - low) / 2;
+    if (comparator(array[mid].first, key) <= 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if (Search::enabled && low < high) {
+    int64_t keys[KEY_SEARCH_BLOCK];
+    for (int i = low; i < high; i++)
+      keys[i - low] = Search::ToInteger(array[i].first);
+    low += CountLess(keys, high - low, Search::ToInteger(key), true);
+  }
+  return low - 1;
 }
 
 /*****************************************************************************
@@ -76,7 +128,11 @@ B_PLUS_TREE_INTERNAL_PAGE_TYPE::Lookup(const KeyType &key,
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::PopulateNewRoot(
     const ValueType &old_value, const KeyType &new_key,
-    const ValueType &new_value) {}
+    const ValueType &new_value) {
+  array[0].second = old_value;
+  array[1] = std::make_pair(new_key, new_value);
+  SetSize(2);
+}
 /*
  * Insert new_key & new_value pair right after the pair with its value ==
  * old_value
@@ -86,7 +142,12 @@ INDEX_TEMPLATE_ARGUMENTS
 int B_PLUS_TREE_INTERNAL_PAGE_TYPE::InsertNodeAfter(
     const ValueType &old_value, const KeyType &new_key,
     const ValueType &new_value) {
-  return 0;
+  int index = ValueIndex(old_value) + 1;
+  assert(index > 0);
+  std::copy_backward(array + index, array + GetSize(), array + GetSize() + 1);
+  array[index] = std::make_pair(new_key, new_value);
+  IncreaseSize(1);
+  return GetSize();
 }
 
 /*****************************************************************************
@@ -98,11 +159,23 @@ int B_PLUS_TREE_INTERNAL_PAGE_TYPE::InsertNodeAfter(
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveHalfTo(
     BPlusTreeInternalPage *recipient,
-    BufferPoolManager *buffer_pool_manager) {}
+    BufferPoolManager *buffer_pool_manager) {
+  // the first key moved is pushed up to the parent by the caller, it stays in
+  // the invalid slot 0 of recipient
+  int keep = (GetSize() + 1) / 2;
+  recipient->CopyHalfFrom(array + keep, GetSize() - keep, buffer_pool_manager);
+  SetSize(keep);
+}
 
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyHalfFrom(
-    MappingType *items, int size, BufferPoolManager *buffer_pool_manager) {}
+    MappingType *items, int size, BufferPoolManager *buffer_pool_manager) {
+  assert(GetSize() == 0);
+  std::copy(items, items + size, array);
+  SetSize(size);
+  for (int i = 0; i < size; ++i)
+    AdoptChild(array[i].second, buffer_pool_manager);
+}
 
 /*****************************************************************************
  * REMOVE
@@ -113,7 +186,11 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyHalfFrom(
  * NOTE: store key&value pair continuously after deletion
  */
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Remove(int index) {}
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Remove(int index) {
+  assert(index >= 0 && index < GetSize());
+  std::copy(array + index + 1, array + GetSize(), array + index);
+  IncreaseSize(-1);
+}
 
 /*
  * Remove the only key & value pair in internal page and return the value
@@ -121,7 +198,9 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Remove(int index) {}
  */
 INDEX_TEMPLATE_ARGUMENTS
 ValueType B_PLUS_TREE_INTERNAL_PAGE_TYPE::RemoveAndReturnOnlyChild() {
-  return INVALID_PAGE_ID;
+  assert(GetSize() == 1);
+  SetSize(0);
+  return array[0].second;
 }
 /*****************************************************************************
  * MERGE
@@ -129,15 +208,30 @@ ValueType B_PLUS_TREE_INTERNAL_PAGE_TYPE::RemoveAndReturnOnlyChild() {
 /*
  * Remove all of key & value pairs from this page to "recipient" page, then
  * update relavent key & value pair in its parent page.
+ * recipient is the left neighbor, the separator at index_in_parent comes down
+ * as key of the first child moved. The caller removes it from the parent.
  */
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveAllTo(
     BPlusTreeInternalPage *recipient, int index_in_parent,
-    BufferPoolManager *buffer_pool_manager) {}
+    BufferPoolManager *buffer_pool_manager) {
+  auto page = buffer_pool_manager->FetchPage(GetParentPageId());
+  assert(page != nullptr);
+  auto parent = reinterpret_cast<BPlusTreeInternalPage *>(page->GetData());
+  array[0].first = parent->KeyAt(index_in_parent);
+  buffer_pool_manager->UnpinPage(GetParentPageId(), false);
+  recipient->CopyAllFrom(array, GetSize(), buffer_pool_manager);
+  SetSize(0);
+}
 
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyAllFrom(
-    MappingType *items, int size, BufferPoolManager *buffer_pool_manager) {}
+    MappingType *items, int size, BufferPoolManager *buffer_pool_manager) {
+  std::copy(items, items + size, array + GetSize());
+  IncreaseSize(size);
+  for (int i = 0; i < size; ++i)
+    AdoptChild(items[i].second, buffer_pool_manager);
+}
 
 /*****************************************************************************
  * REDISTRIBUTE
@@ -149,11 +243,26 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyAllFrom(
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveFirstToEndOf(
     BPlusTreeInternalPage *recipient,
-    BufferPoolManager *buffer_pool_manager) {}
+    BufferPoolManager *buffer_pool_manager) {
+  auto page = buffer_pool_manager->FetchPage(GetParentPageId());
+  assert(page != nullptr);
+  auto parent = reinterpret_cast<BPlusTreeInternalPage *>(page->GetData());
+  int index = parent->ValueIndex(GetPageId());
+  // the separator comes down to recipient, the next key goes up
+  MappingType pair(parent->KeyAt(index), array[0].second);
+  parent->SetKeyAt(index, array[1].first);
+  buffer_pool_manager->UnpinPage(GetParentPageId(), true);
+  Remove(0);
+  recipient->CopyLastFrom(pair, buffer_pool_manager);
+}
 
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyLastFrom(
-    const MappingType &pair, BufferPoolManager *buffer_pool_manager) {}
+    const MappingType &pair, BufferPoolManager *buffer_pool_manager) {
+  array[GetSize()] = pair;
+  IncreaseSize(1);
+  AdoptChild(pair.second, buffer_pool_manager);
+}
 
 /*
  * Remove the last key & value pair from this page to head of "recipient"
@@ -162,12 +271,45 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyLastFrom(
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveLastToFrontOf(
     BPlusTreeInternalPage *recipient, int parent_index,
-    BufferPoolManager *buffer_pool_manager) {}
+    BufferPoolManager *buffer_pool_manager) {
+  IncreaseSize(-1);
+  recipient->CopyFirstFrom(array[GetSize()], parent_index,
+                           buffer_pool_manager);
+}
 
+/*
+ * parent_index is the index of this page in its parent. The separator comes
+ * down as key of the old first child, the key of pair goes up.
+ */
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyFirstFrom(
     const MappingType &pair, int parent_index,
-    BufferPoolManager *buffer_pool_manager) {}
+    BufferPoolManager *buffer_pool_manager) {
+  auto page = buffer_pool_manager->FetchPage(GetParentPageId());
+  assert(page != nullptr);
+  auto parent = reinterpret_cast<BPlusTreeInternalPage *>(page->GetData());
+  std::copy_backward(array, array + GetSize(), array + GetSize() + 1);
+  IncreaseSize(1);
+  array[1].first = parent->KeyAt(parent_index);
+  array[0].second = pair.second;
+  parent->SetKeyAt(parent_index, pair.first);
+  buffer_pool_manager->UnpinPage(GetParentPageId(), true);
+  AdoptChild(pair.second, buffer_pool_manager);
+}
+
+/*
+ * Point the parent page id of child at this page
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::AdoptChild(
+    const ValueType &child, BufferPoolManager *buffer_pool_manager) {
+  auto page = buffer_pool_manager->FetchPage(child);
+  if (page == nullptr)
+    throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned while moving");
+  auto node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+  node->SetParentPageId(GetPageId());
+  buffer_pool_manager->UnpinPage(child, true);
+}
 
 /*****************************************************************************
  * DEBUG
@@ -227,4 +369,18 @@ template class BPlusTreeInternalPage<GenericKey<32>, page_id_t,
                                            GenericComparator<32>>;
 template class BPlusTreeInternalPage<GenericKey<64>, page_id_t,
                                            GenericComparator<64>>;
+template class BPlusTreeInternalPage<GenericKey<4>, page_id_t,
+                                     IntegerComparator<4, int32_t>>;
+template class BPlusTreeInternalPage<GenericKey<8>, page_id_t,
+                                     IntegerComparator<8, int64_t>>;
+template class BPlusTreeInternalPage<GenericKey<4>, page_id_t,
+                                     CompositeIntegerComparator<4>>;
+template class BPlusTreeInternalPage<GenericKey<8>, page_id_t,
+                                     CompositeIntegerComparator<8>>;
+template class BPlusTreeInternalPage<GenericKey<16>, page_id_t,
+                                     CompositeIntegerComparator<16>>;
+template class BPlusTreeInternalPage<GenericKey<32>, page_id_t,
+                                     CompositeIntegerComparator<32>>;
+template class BPlusTreeInternalPage<GenericKey<64>, page_id_t,
+                                     CompositeIntegerComparator<64>>;
 } // namespace cmudb
@@ -2,10 +2,14 @@
  * b_plus_tree_leaf_page.cpp
  */
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 
 #include "common/exception.h"
 #include "common/rid.h"
+#include "index/key_search.h"
+#include "page/b_plus_tree_internal_page.h"
 #include "page/b_plus_tree_leaf_page.h"
 
 namespace cmudb {
@@ -18,64 +22,311 @@ namespace cmudb {
  * Init method after creating a new leaf page
  * Including set page type, set current size to zero, set page id/parent id, set
  * next page id and set max size
+ * An empty page shares all bytes, the first key inserted becomes the image.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::Init(page_id_t page_id, page_id_t parent_id) {}
+void B_PLUS_TREE_LEAF_PAGE_TYPE::Init(page_id_t page_id, page_id_t parent_id) {
+  SetPageType(IndexPageType::LEAF_PAGE);
+  SetSize(0);
+  SetPageId(page_id);
+  SetParentPageId(parent_id);
+  SetNextPageId(INVALID_PAGE_ID);
+  SetPrevPageId(INVALID_PAGE_ID);
+  prefix_size_ = suffix_size_ = sizeof(KeyType);
+  SetMaxSize(Capacity(0));
+}
 
 /**
- * Helper methods to set/get next page id
+ * Helper methods to set/get next and previous page id
  */
 INDEX_TEMPLATE_ARGUMENTS
 page_id_t B_PLUS_TREE_LEAF_PAGE_TYPE::GetNextPageId() const {
-  return INVALID_PAGE_ID;
+  return next_page_id_;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::SetNextPageId(page_id_t next_page_id) {
+  next_page_id_ = next_page_id;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+page_id_t B_PLUS_TREE_LEAF_PAGE_TYPE::GetPrevPageId() const {
+  return prev_page_id_;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::SetPrevPageId(page_id_t prev_page_id) {
+  prev_page_id_ = prev_page_id;
+}
+
+/*
+ * Shared bytes may overlap while at most one key is stored
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::Layout(int &prefix, int &width) const {
+  const int key_size = sizeof(KeyType);
+  prefix = std::min(std::max(prefix_size_, 0), key_size);
+  int suffix = std::min(std::max(suffix_size_, 0), key_size);
+  width = std::max(key_size - prefix - suffix, 0);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int B_PLUS_TREE_LEAF_PAGE_TYPE::Capacity(int width) {
+  return (PAGE_SIZE - sizeof(BPlusTreeLeafPage)) /
+         (width + sizeof(ValueType));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+char *B_PLUS_TREE_LEAF_PAGE_TYPE::EntryAt(int index, int width) {
+  return data_ + index * (width + sizeof(ValueType));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+const char *B_PLUS_TREE_LEAF_PAGE_TYPE::EntryAt(int index, int width) const {
+  return data_ + index * (width + sizeof(ValueType));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+KeyType B_PLUS_TREE_LEAF_PAGE_TYPE::ReadKey(int index, int prefix,
+                                            int width) const {
+  KeyType key = shared_key_;
+  memcpy(reinterpret_cast<char *>(&key) + prefix,
+         EntryAt(index, width) + sizeof(ValueType), width);
+  return key;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::WriteEntry(int index, const KeyType &key,
+                                            const ValueType &value) {
+  int prefix, width;
+  Layout(prefix, width);
+  char *entry = EntryAt(index, width);
+  memcpy(entry, &value, sizeof(ValueType));
+  memcpy(entry + sizeof(ValueType),
+         reinterpret_cast<const char *>(&key) + prefix, width);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::Narrow(const KeyType &image,
+                                        const KeyType &key, int &prefix,
+                                        int &suffix) {
+  const int key_size = sizeof(KeyType);
+  auto a = reinterpret_cast<const char *>(&image);
+  auto b = reinterpret_cast<const char *>(&key);
+  int shared = 0;
+  while (shared < prefix && a[shared] == b[shared])
+    ++shared;
+  prefix = shared;
+  shared = 0;
+  while (shared < suffix &&
+         a[key_size - 1 - shared] == b[key_size - 1 - shared])
+    ++shared;
+  suffix = shared;
+}
+
+/*
+ * Relative to the key at begin as image
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::SharedBytes(int begin, int end, int &prefix,
+                                             int &suffix) const {
+  prefix = suffix = sizeof(KeyType);
+  if (begin >= end)
+    return;
+  int old_prefix, width;
+  Layout(old_prefix, width);
+  KeyType image = ReadKey(begin, old_prefix, width);
+  for (int i = begin + 1; i < end; ++i)
+    Narrow(image, ReadKey(i, old_prefix, width), prefix, suffix);
+}
+
+/*
+ * Entries move right when they widen and left when they shrink, each one is
+ * read before it is overwritten
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::Reencode(const KeyType &image, int prefix,
+                                          int suffix) {
+  int old_prefix, old_width;
+  Layout(old_prefix, old_width);
+  KeyType old_image = shared_key_;
+  shared_key_ = image;
+  prefix_size_ = prefix;
+  suffix_size_ = suffix;
+  int new_prefix, width;
+  Layout(new_prefix, width);
+  SetMaxSize(Capacity(width));
+  int size = GetSize();
+  assert(size <= GetMaxSize());
+  for (int n = 0; n < size; ++n) {
+    int i = width > old_width ? size - 1 - n : n;
+    const char *entry = EntryAt(i, old_width);
+    KeyType key = old_image;
+    memcpy(reinterpret_cast<char *>(&key) + old_prefix,
+           entry + sizeof(ValueType), old_width);
+    ValueType value;
+    memcpy(&value, entry, sizeof(ValueType));
+    WriteEntry(i, key, value);
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::MakeRoomFor(const KeyType &key) {
+  if (GetSize() == 0) {
+    shared_key_ = key;
+    prefix_size_ = suffix_size_ = sizeof(KeyType);
+    SetMaxSize(Capacity(0));
+    return;
+  }
+  int prefix = prefix_size_, suffix = suffix_size_;
+  Narrow(shared_key_, key, prefix, suffix);
+  if (prefix != prefix_size_ || suffix != suffix_size_)
+    Reencode(shared_key_, prefix, suffix);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::Compact() {
+  if (GetSize() == 0) {
+    prefix_size_ = suffix_size_ = sizeof(KeyType);
+    SetMaxSize(Capacity(0));
+    return;
+  }
+  int prefix, suffix;
+  SharedBytes(0, GetSize(), prefix, suffix);
+  Reencode(KeyAt(0), prefix, suffix);
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::SetNextPageId(page_id_t next_page_id) {}
+bool B_PLUS_TREE_LEAF_PAGE_TYPE::HasRoomFor(const KeyType &key,
+                                            double fill_factor) const {
+  if (GetSize() == 0)
+    return true;
+  int prefix = prefix_size_, suffix = suffix_size_;
+  Narrow(shared_key_, key, prefix, suffix);
+  int width = std::max<int>(sizeof(KeyType) - prefix - suffix, 0);
+  return (GetSize() + 1) * (width + sizeof(ValueType)) <=
+         fill_factor * (PAGE_SIZE - sizeof(BPlusTreeLeafPage));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_LEAF_PAGE_TYPE::CanMergeWith(
+    const BPlusTreeLeafPage *other) const {
+  if (GetSize() == 0 || other->GetSize() == 0)
+    return true;
+  int prefix = std::min(prefix_size_, other->prefix_size_);
+  int suffix = std::min(suffix_size_, other->suffix_size_);
+  Narrow(shared_key_, other->shared_key_, prefix, suffix);
+  int width = std::max<int>(sizeof(KeyType) - prefix - suffix, 0);
+  return GetSize() + other->GetSize() <= Capacity(width);
+}
+
+/*
+ * Split in the middle if possible, else right before key with key on the
+ * side it fits on
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int B_PLUS_TREE_LEAF_PAGE_TYPE::SplitIndex(const KeyType &key, int index,
+                                           bool &key_left) const {
+  auto fits = [&](int begin, int end) {
+    if (begin >= end)
+      return true;
+    int prefix, suffix;
+    SharedBytes(begin, end, prefix, suffix);
+    Narrow(KeyAt(begin), key, prefix, suffix);
+    int width = std::max<int>(sizeof(KeyType) - prefix - suffix, 0);
+    return end - begin + 1 <= Capacity(width);
+  };
+  int size = GetSize();
+  int middle = (size + 1) / 2;
+  key_left = index < middle;
+  if (key_left ? fits(0, middle) : fits(middle, size))
+    return middle;
+  key_left = true;
+  if (fits(0, index))
+    return index;
+  key_left = false;
+  if (fits(index, size))
+    return index;
+  return -1;
+}
 
 /**
- * Helper method to find the first index i so that array[i].first >= key
+ * Helper method to find the first index i so that KeyAt(i) >= key
  * NOTE: This method is only used when generating index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
 int B_PLUS_TREE_LEAF_PAGE_TYPE::KeyIndex(
     const KeyType &key, const KeyComparator &comparator) const {
-  return 0;
+  int prefix, width;
+  Layout(prefix, width);
+  int low = 0, high = std::max(std::min(GetSize(), Capacity(width)), 0);
+  typedef IntegerKeySearch<KeyComparator> Search;
+  while (high - low > (Search::enabled ? KEY_SEARCH_BLOCK : 0)) {
+    int mid = low + (high - low) / 2;
+    if (comparator(ReadKey(mid, prefix, width), key) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if (Search::enabled && low < high) {
+    int64_t keys[KEY_SEARCH_BLOCK];
+    for (int i = low; i < high; i++)
+      keys[i - low] = Search::ToInteger(ReadKey(i, prefix, width));
+    low += CountLess(keys, high - low, Search::ToInteger(key), false);
+  }
+  return low;
 }
 
 /*
  * Helper method to find and return the key associated with input "index"(a.k.a
- * array offset)
+ * entry offset)
  */
 INDEX_TEMPLATE_ARGUMENTS
 KeyType B_PLUS_TREE_LEAF_PAGE_TYPE::KeyAt(int index) const {
-  // replace with your own code
-  KeyType key;
-  return key;
+  assert(index >= 0 && index < GetSize());
+  int prefix, width;
+  Layout(prefix, width);
+  return ReadKey(index, prefix, width);
 }
 
 /*
  * Helper method to find and return the key & value pair associated with input
- * "index"(a.k.a array offset)
+ * "index"(a.k.a entry offset)
  */
 INDEX_TEMPLATE_ARGUMENTS
-const MappingType &B_PLUS_TREE_LEAF_PAGE_TYPE::GetItem(int index) {
-  // replace with your own code
-  return array[0];
+MappingType B_PLUS_TREE_LEAF_PAGE_TYPE::GetItem(int index) const {
+  assert(index >= 0 && index < GetSize());
+  int prefix, width;
+  Layout(prefix, width);
+  MappingType item;
+  item.first = ReadKey(index, prefix, width);
+  memcpy(&item.second, EntryAt(index, width), sizeof(ValueType));
+  return item;
 }
 
 /*****************************************************************************
  * INSERTION
  *****************************************************************************/
 /*
- * Insert key & value pair into leaf page ordered by key
+ * Insert key & value pair into leaf page ordered by key, the page must have
+ * room for key
  * @return  page size after insertion
  */
 INDEX_TEMPLATE_ARGUMENTS
 int B_PLUS_TREE_LEAF_PAGE_TYPE::Insert(const KeyType &key,
                                        const ValueType &value,
                                        const KeyComparator &comparator) {
-  return 0;
+  assert(HasRoomFor(key));
+  int index = KeyIndex(key, comparator);
+  // duplicates are rejected by the tree before
+  MakeRoomFor(key);
+  int prefix, width;
+  Layout(prefix, width);
+  memmove(EntryAt(index + 1, width), EntryAt(index, width),
+          (GetSize() - index) * (width + sizeof(ValueType)));
+  WriteEntry(index, key, value);
+  IncreaseSize(1);
+  return GetSize();
 }
 
 /*****************************************************************************
@@ -87,10 +338,49 @@ int B_PLUS_TREE_LEAF_PAGE_TYPE::Insert(const KeyType &key,
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveHalfTo(
     BPlusTreeLeafPage *recipient,
-    __attribute__((unused)) BufferPoolManager *buffer_pool_manager) {}
+    __attribute__((unused)) BufferPoolManager *buffer_pool_manager) {
+  MoveTailTo(recipient, (GetSize() + 1) / 2);
+}
+
+/*
+ * Both pages get the shared bytes of their own entries
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveTailTo(BPlusTreeLeafPage *recipient,
+                                            int index) {
+  assert(recipient->GetSize() == 0);
+  recipient->CopyRangeFrom(this, index, GetSize());
+  SetSize(index);
+  Compact();
+  // recipient becomes the right neighbor in the leaf chain, the tree links
+  // the page after it back to it
+  recipient->SetNextPageId(GetNextPageId());
+  recipient->SetPrevPageId(GetPageId());
+  SetNextPageId(recipient->GetPageId());
+}
 
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyHalfFrom(MappingType *items, int size) {}
+void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyRangeFrom(const BPlusTreeLeafPage *source,
+                                               int begin, int end) {
+  if (begin >= end)
+    return;
+  int prefix, suffix;
+  source->SharedBytes(begin, end, prefix, suffix);
+  KeyType image = source->KeyAt(begin);
+  if (GetSize() > 0) {
+    prefix = std::min(prefix, prefix_size_);
+    suffix = std::min(suffix, suffix_size_);
+    Narrow(shared_key_, image, prefix, suffix);
+    image = shared_key_;
+  }
+  Reencode(image, prefix, suffix);
+  assert(GetSize() + end - begin <= GetMaxSize());
+  for (int i = begin; i < end; ++i) {
+    MappingType item = source->GetItem(i);
+    WriteEntry(GetSize(), item.first, item.second);
+    IncreaseSize(1);
+  }
+}
 
 /*****************************************************************************
  * LOOKUP
@@ -102,8 +392,28 @@ void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyHalfFrom(MappingType *items, int size) {}
  */
 INDEX_TEMPLATE_ARGUMENTS
 bool B_PLUS_TREE_LEAF_PAGE_TYPE::Lookup(const KeyType &key, ValueType &value,
-                                        const KeyComparator &comparator) const {
-  return false;
+                                        const KeyComparator &comparator,
+                                        int *index) const {
+  int key_index = KeyIndex(key, comparator);
+  if (!LookupAt(key_index, key, value, comparator))
+    return false;
+  if (index != nullptr)
+    *index = key_index;
+  return true;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_LEAF_PAGE_TYPE::LookupAt(
+    int index, const KeyType &key, ValueType &value,
+    const KeyComparator &comparator) const {
+  int prefix, width;
+  Layout(prefix, width);
+  // bounded again for optimistic readers, the page may change under them
+  if (index < 0 || index >= std::min(GetSize(), Capacity(width)) ||
+      comparator(ReadKey(index, prefix, width), key) != 0)
+    return false;
+  memcpy(&value, EntryAt(index, width), sizeof(ValueType));
+  return true;
 }
 
 /*****************************************************************************
@@ -118,7 +428,17 @@ bool B_PLUS_TREE_LEAF_PAGE_TYPE::Lookup(const KeyType &key, ValueType &value,
 INDEX_TEMPLATE_ARGUMENTS
 int B_PLUS_TREE_LEAF_PAGE_TYPE::RemoveAndDeleteRecord(
     const KeyType &key, const KeyComparator &comparator) {
-  return 0;
+  int index = KeyIndex(key, comparator);
+  if (index == GetSize() || comparator(KeyAt(index), key) != 0)
+    return GetSize();
+  int prefix, width;
+  Layout(prefix, width);
+  memmove(EntryAt(index, width), EntryAt(index + 1, width),
+          (GetSize() - index - 1) * (width + sizeof(ValueType)));
+  IncreaseSize(-1);
+  if (GetSize() == 0)
+    Compact();
+  return GetSize();
 }
 
 /*****************************************************************************
@@ -127,12 +447,17 @@ int B_PLUS_TREE_LEAF_PAGE_TYPE::RemoveAndDeleteRecord(
 /*
  * Remove all of key & value pairs from this page to "recipient" page, then
  * update next page id
+ * recipient is the left neighbor. This page keeps its next page id, an
+ * iterator that still reaches it walks on over an empty page.
  */
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveAllTo(BPlusTreeLeafPage *recipient,
-                                           int, BufferPoolManager *) {}
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyAllFrom(MappingType *items, int size) {}
+                                           int, BufferPoolManager *) {
+  assert(recipient->CanMergeWith(this));
+  recipient->CopyRangeFrom(this, 0, GetSize());
+  recipient->SetNextPageId(GetNextPageId());
+  SetSize(0);
+}
 
 /*****************************************************************************
  * REDISTRIBUTE
@@ -142,25 +467,71 @@ void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyAllFrom(MappingType *items, int size) {}
  * update relavent key & value pair in its parent page.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveFirstToEndOf(
+bool B_PLUS_TREE_LEAF_PAGE_TYPE::MoveFirstToEndOf(
     BPlusTreeLeafPage *recipient,
-    BufferPoolManager *buffer_pool_manager) {}
+    BufferPoolManager *buffer_pool_manager) {
+  MappingType item = GetItem(0);
+  if (!recipient->HasRoomFor(item.first))
+    return false;
+  int prefix, width;
+  Layout(prefix, width);
+  memmove(EntryAt(0, width), EntryAt(1, width),
+          (GetSize() - 1) * (width + sizeof(ValueType)));
+  IncreaseSize(-1);
+  recipient->CopyLastFrom(item);
+  // the separator of this page is its new first key
+  auto page = buffer_pool_manager->FetchPage(GetParentPageId());
+  assert(page != nullptr);
+  auto parent = reinterpret_cast<
+      BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(
+      page->GetData());
+  parent->SetKeyAt(parent->ValueIndex(GetPageId()), KeyAt(0));
+  buffer_pool_manager->UnpinPage(GetParentPageId(), true);
+  return true;
+}
 
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyLastFrom(const MappingType &item) {}
+void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyLastFrom(const MappingType &item) {
+  MakeRoomFor(item.first);
+  WriteEntry(GetSize(), item.first, item.second);
+  IncreaseSize(1);
+}
 /*
  * Remove the last key & value pair from this page to "recipient" page, then
  * update relavent key & value pair in its parent page.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveLastToFrontOf(
+bool B_PLUS_TREE_LEAF_PAGE_TYPE::MoveLastToFrontOf(
     BPlusTreeLeafPage *recipient, int parentIndex,
-    BufferPoolManager *buffer_pool_manager) {}
+    BufferPoolManager *buffer_pool_manager) {
+  MappingType item = GetItem(GetSize() - 1);
+  if (!recipient->HasRoomFor(item.first))
+    return false;
+  IncreaseSize(-1);
+  recipient->CopyFirstFrom(item, parentIndex, buffer_pool_manager);
+  return true;
+}
 
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyFirstFrom(
     const MappingType &item, int parentIndex,
-    BufferPoolManager *buffer_pool_manager) {}
+    BufferPoolManager *buffer_pool_manager) {
+  MakeRoomFor(item.first);
+  int prefix, width;
+  Layout(prefix, width);
+  memmove(EntryAt(1, width), EntryAt(0, width),
+          GetSize() * (width + sizeof(ValueType)));
+  WriteEntry(0, item.first, item.second);
+  IncreaseSize(1);
+  // the separator of this page is its new first key
+  auto page = buffer_pool_manager->FetchPage(GetParentPageId());
+  assert(page != nullptr);
+  auto parent = reinterpret_cast<
+      BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(
+      page->GetData());
+  parent->SetKeyAt(parentIndex, item.first);
+  buffer_pool_manager->UnpinPage(GetParentPageId(), true);
+}
 
 /*****************************************************************************
  * DEBUG
@@ -185,9 +556,10 @@ std::string B_PLUS_TREE_LEAF_PAGE_TYPE::ToString(bool verbose) const {
     } else {
       stream << " ";
     }
-    stream << std::dec << array[entry].first;
+    MappingType item = GetItem(entry);
+    stream << std::dec << item.first;
     if (verbose) {
-      stream << "(" << array[entry].second << ")";
+      stream << "(" << item.second << ")";
     }
     ++entry;
   }
@@ -204,4 +576,18 @@ template class BPlusTreeLeafPage<GenericKey<32>, RID,
                                        GenericComparator<32>>;
 template class BPlusTreeLeafPage<GenericKey<64>, RID,
                                        GenericComparator<64>>;
+template class BPlusTreeLeafPage<GenericKey<4>, RID,
+                                 IntegerComparator<4, int32_t>>;
+template class BPlusTreeLeafPage<GenericKey<8>, RID,
+                                 IntegerComparator<8, int64_t>>;
+template class BPlusTreeLeafPage<GenericKey<4>, RID,
+                                 CompositeIntegerComparator<4>>;
+template class BPlusTreeLeafPage<GenericKey<8>, RID,
+                                 CompositeIntegerComparator<8>>;
+template class BPlusTreeLeafPage<GenericKey<16>, RID,
+                                 CompositeIntegerComparator<16>>;
+template class BPlusTreeLeafPage<GenericKey<32>, RID,
+                                 CompositeIntegerComparator<32>>;
+template class BPlusTreeLeafPage<GenericKey<64>, RID,
+                                 CompositeIntegerComparator<64>>;
 } // namespace cmudb
@@ -0,0 +1,149 @@
+/**
+ * free_space_map_page.cpp
+ */
+
+#include <algorithm>
+#include <cassert>
+
+#include "page/free_space_map_page.h"
+
+namespace cmudb {
+
+#define FSM_ENTRY_COUNT_OFFSET static_cast<int>(2 * sizeof(page_id_t))
+#define FSM_MAX_FREE_SPACE_OFFSET (FSM_ENTRY_COUNT_OFFSET + 4)
+#define FSM_HEADER_SIZE (FSM_MAX_FREE_SPACE_OFFSET + 4)
+#define FSM_ENTRY_SIZE static_cast<int>(sizeof(page_id_t) + 4)
+#define FSM_MAX_ENTRY ((PAGE_SIZE - FSM_HEADER_SIZE) / FSM_ENTRY_SIZE)
+
+/**
+ * Header related
+ */
+void FreeSpaceMapPage::Init(page_id_t page_id, page_id_t next_page_id) {
+  memcpy(GetData(), &page_id, sizeof(page_id_t)); // set page_id
+  SetNextPageId(next_page_id);
+  SetEntryCount(0);
+  SetMaxFreeSpace(0);
+}
+
+page_id_t FreeSpaceMapPage::GetPageId() {
+  return *reinterpret_cast<page_id_t *>(GetData());
+}
+
+page_id_t FreeSpaceMapPage::GetNextPageId() {
+  return *reinterpret_cast<page_id_t *>(GetData() + sizeof(page_id_t));
+}
+
+void FreeSpaceMapPage::SetNextPageId(page_id_t next_page_id) {
+  memcpy(GetData() + sizeof(page_id_t), &next_page_id, sizeof(page_id_t));
+}
+
+int FreeSpaceMapPage::GetEntryCount() {
+  return *reinterpret_cast<int *>(GetData() + FSM_ENTRY_COUNT_OFFSET);
+}
+
+bool FreeSpaceMapPage::IsFull() { return GetEntryCount() >= FSM_MAX_ENTRY; }
+
+/**
+ * Entry related
+ */
+bool FreeSpaceMapPage::AppendEntry(page_id_t heap_page_id,
+                                   int32_t free_space) {
+  int entry_count = GetEntryCount();
+  if (entry_count >= FSM_MAX_ENTRY)
+    return false;
+  SetEntry(entry_count, heap_page_id, free_space);
+  SetEntryCount(entry_count + 1);
+  SetMaxFreeSpace(std::max(GetMaxFreeSpace(), free_space));
+  return true;
+}
+
+bool FreeSpaceMapPage::UpdateEntry(page_id_t heap_page_id,
+                                   int32_t free_space) {
+  // scan backwards, recently appended pages are the most frequently updated
+  for (int i = GetEntryCount() - 1; i >= 0; --i) {
+    if (GetHeapPageId(i) == heap_page_id) {
+      SetEntry(i, heap_page_id, free_space);
+      // max free space is only an upper bound, FindPage tightens it
+      SetMaxFreeSpace(std::max(GetMaxFreeSpace(), free_space));
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FreeSpaceMapPage::RemoveEntry(page_id_t heap_page_id) {
+  int entry_count = GetEntryCount();
+  for (int i = 0; i < entry_count; ++i) {
+    if (GetHeapPageId(i) == heap_page_id) {
+      char *entry = GetData() + FSM_HEADER_SIZE + FSM_ENTRY_SIZE * i;
+      memmove(entry, entry + FSM_ENTRY_SIZE,
+              FSM_ENTRY_SIZE * (entry_count - i - 1));
+      SetEntryCount(entry_count - 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FreeSpaceMapPage::FindPage(int32_t required, page_id_t &heap_page_id,
+                                const std::function<bool(page_id_t)> &skip) {
+  if (GetMaxFreeSpace() < required)
+    return false;
+  int32_t max_free_space = 0;
+  for (int i = 0; i < GetEntryCount(); ++i) {
+    int32_t free_space = GetFreeSpace(i);
+    if (free_space >= required && (!skip || !skip(GetHeapPageId(i)))) {
+      heap_page_id = GetHeapPageId(i);
+      return true;
+    }
+    max_free_space = std::max(max_free_space, free_space);
+  }
+  // nothing fits, remember the exact bound so that next search is O(1)
+  SetMaxFreeSpace(max_free_space);
+  return false;
+}
+
+page_id_t FreeSpaceMapPage::GetLastHeapPageId() {
+  int entry_count = GetEntryCount();
+  if (entry_count == 0)
+    return INVALID_PAGE_ID;
+  return GetHeapPageId(entry_count - 1);
+}
+
+/**
+ * helper functions
+ */
+page_id_t FreeSpaceMapPage::GetHeapPageId(int index) {
+  assert(index < GetEntryCount());
+  page_id_t heap_page_id;
+  memcpy(&heap_page_id, GetData() + FSM_HEADER_SIZE + FSM_ENTRY_SIZE * index,
+         sizeof(page_id_t));
+  return heap_page_id;
+}
+
+int32_t FreeSpaceMapPage::GetFreeSpace(int index) {
+  assert(index < GetEntryCount());
+  return *reinterpret_cast<int32_t *>(GetData() + FSM_HEADER_SIZE +
+                                      FSM_ENTRY_SIZE * index +
+                                      sizeof(page_id_t));
+}
+
+void FreeSpaceMapPage::SetEntry(int index, page_id_t heap_page_id,
+                                int32_t free_space) {
+  char *entry = GetData() + FSM_HEADER_SIZE + FSM_ENTRY_SIZE * index;
+  memcpy(entry, &heap_page_id, sizeof(page_id_t));
+  memcpy(entry + sizeof(page_id_t), &free_space, 4);
+}
+
+void FreeSpaceMapPage::SetEntryCount(int entry_count) {
+  memcpy(GetData() + FSM_ENTRY_COUNT_OFFSET, &entry_count, 4);
+}
+
+int32_t FreeSpaceMapPage::GetMaxFreeSpace() {
+  return *reinterpret_cast<int32_t *>(GetData() + FSM_MAX_FREE_SPACE_OFFSET);
+}
+
+void FreeSpaceMapPage::SetMaxFreeSpace(int32_t max_free_space) {
+  memcpy(GetData() + FSM_MAX_FREE_SPACE_OFFSET, &max_free_space, 4);
+}
+} // namespace cmudb
@@ -0,0 +1,50 @@
+/**
+ * hash_bucket_page.cpp
+ */
+
+#include <cstring>
+
+#include "common/rid.h"
+#include "page/hash_bucket_page.h"
+
+namespace cmudb {
+
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_BUCKET_PAGE_TYPE::Init() {
+  next_page_id_ = INVALID_PAGE_ID;
+  size_ = 0;
+}
+
+/*
+ * Keys are equal when their bytes are, the hash of a key is taken over its
+ * bytes as well
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int HASH_BUCKET_PAGE_TYPE::Find(const KeyType &key,
+                                const ValueType *value) const {
+  for (int i = 0; i < size_; i++) {
+    if (memcmp(&array_[i].first, &key, sizeof(KeyType)) == 0 &&
+        (value == nullptr || array_[i].second == *value))
+      return i;
+  }
+  return -1;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_BUCKET_PAGE_TYPE::Append(const MappingType &item) {
+  assert(!IsFull());
+  array_[size_++] = item;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_BUCKET_PAGE_TYPE::RemoveAt(int index) {
+  assert(index >= 0 && index < size_);
+  array_[index] = array_[--size_];
+}
+
+template class HashBucketPage<GenericKey<4>, RID, GenericComparator<4>>;
+template class HashBucketPage<GenericKey<8>, RID, GenericComparator<8>>;
+template class HashBucketPage<GenericKey<16>, RID, GenericComparator<16>>;
+template class HashBucketPage<GenericKey<32>, RID, GenericComparator<32>>;
+template class HashBucketPage<GenericKey<64>, RID, GenericComparator<64>>;
+} // namespace cmudb
@@ -0,0 +1,25 @@
+/**
+ * hash_directory_page.cpp
+ */
+
+#include <cstring>
+
+#include "page/hash_directory_page.h"
+
+namespace cmudb {
+
+void HashDirectoryPage::Init(page_id_t page_id, page_id_t bucket_page_id) {
+  page_id_ = page_id;
+  global_depth_ = 0;
+  bucket_page_ids_[0] = bucket_page_id;
+  local_depths_[0] = 0;
+}
+
+void HashDirectoryPage::Grow() {
+  int size = Size();
+  memcpy(bucket_page_ids_ + size, bucket_page_ids_, size * sizeof(page_id_t));
+  memcpy(local_depths_ + size, local_depths_, size * sizeof(uint8_t));
+  global_depth_++;
+}
+
+} // namespace cmudb
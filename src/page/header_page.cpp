@@ -17,13 +17,13 @@ bool HeaderPage::InsertRecord(const std::string &name,
   assert(root_id > INVALID_PAGE_ID);
 
   int record_num = GetRecordCount();
-  int offset = 4 + record_num * 36;
-  // check for duplicate name
-  if (FindRecord(name) != -1)
+  int offset = 4 + record_num * HEADER_PAGE_RECORD_SIZE;
+  // check for duplicate name and room
+  if (FindRecord(name) != -1 || record_num >= HEADER_PAGE_MAX_RECORDS)
     return false;
   // copy record content
   memcpy(GetData() + offset, name.c_str(), (name.length() + 1));
-  memcpy((GetData() + offset + 32), &root_id, 4);
+  memcpy((GetData() + offset + 32), &root_id, sizeof(page_id_t));
 
   SetRecordCount(record_num + 1);
   return true;
@@ -37,9 +37,9 @@ bool HeaderPage::DeleteRecord(const std::string &name) {
   // record does not exsit
   if (index == -1)
     return false;
-  int offset = index * 36 + 4;
-  memmove(GetData() + offset, GetData() + offset + 36,
-          (record_num - index - 1) * 36);
+  int offset = index * HEADER_PAGE_RECORD_SIZE + 4;
+  memmove(GetData() + offset, GetData() + offset + HEADER_PAGE_RECORD_SIZE,
+          (record_num - index - 1) * HEADER_PAGE_RECORD_SIZE);
 
   SetRecordCount(record_num - 1);
   return true;
@@ -53,9 +53,9 @@ bool HeaderPage::UpdateRecord(const std::string &name,
   // record does not exsit
   if (index == -1)
     return false;
-  int offset = index * 36 + 4;
+  int offset = index * HEADER_PAGE_RECORD_SIZE + 4;
   // update record content, only root_id
-  memcpy((GetData() + offset + 32), &root_id, 4);
+  memcpy((GetData() + offset + 32), &root_id, sizeof(page_id_t));
 
   return true;
 }
@@ -67,12 +67,38 @@ bool HeaderPage::GetRootId(const std::string &name, page_id_t &root_id) {
   // record does not exsit
   if (index == -1)
     return false;
-  int offset = (index + 1) * 36;
-  root_id = *reinterpret_cast<page_id_t *>(GetData() + offset);
+  int offset = index * HEADER_PAGE_RECORD_SIZE + 4 + 32;
+  memcpy(&root_id, GetData() + offset, sizeof(page_id_t));
 
   return true;
 }
 
+std::string HeaderPage::GetName(int index) {
+  return std::string(GetData() + 4 + index * HEADER_PAGE_RECORD_SIZE);
+}
+
+page_id_t HeaderPage::GetRootIdAt(int index) {
+  page_id_t root_id;
+  memcpy(&root_id, GetData() + index * HEADER_PAGE_RECORD_SIZE + 4 + 32,
+         sizeof(page_id_t));
+  return root_id;
+}
+
+// the header page itself can not follow another, it stands for none
+page_id_t HeaderPage::GetNextPageId() {
+  page_id_t next_page_id;
+  memcpy(&next_page_id, GetData() + PAGE_SIZE - sizeof(page_id_t),
+         sizeof(page_id_t));
+  return next_page_id == HEADER_PAGE_ID ? INVALID_PAGE_ID : next_page_id;
+}
+
+void HeaderPage::SetNextPageId(page_id_t next_page_id) {
+  if (next_page_id == INVALID_PAGE_ID)
+    next_page_id = HEADER_PAGE_ID;
+  memcpy(GetData() + PAGE_SIZE - sizeof(page_id_t), &next_page_id,
+         sizeof(page_id_t));
+}
+
 /**
  * helper functions
  */
@@ -87,7 +113,8 @@ int HeaderPage::FindRecord(const std::string &name) {
   int record_num = GetRecordCount();
 
   for (int i = 0; i < record_num; i++) {
-    char *raw_name = reinterpret_cast<char *>(GetData() + (4 + i * 36));
+    char *raw_name = reinterpret_cast<char *>(
+        GetData() + (4 + i * HEADER_PAGE_RECORD_SIZE));
     if (strcmp(raw_name, name.c_str()) == 0)
       return i;
   }
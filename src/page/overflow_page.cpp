@@ -0,0 +1,51 @@
+/**
+ * overflow_page.cpp
+ */
+
+#include <cassert>
+#include <cstring>
+
+#include "page/overflow_page.h"
+
+namespace cmudb {
+
+void OverflowPage::Init(page_id_t page_id, page_id_t next_page_id,
+                        const char *bytes, int32_t size,
+                        LogManager *log_manager, Transaction *txn) {
+  assert(size >= 0 && size <= OVERFLOW_PAGE_CAPACITY);
+  lsn_t lsn = INVALID_LSN;
+  if (txn != nullptr && log_manager != nullptr && log_manager->IsRunning()) {
+    Tuple value(size, nullptr);
+    memcpy(value.GetData(), bytes, size);
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::OVERFLOWPAGE, page_id, next_page_id,
+                         value);
+    SetRecLSN(log_manager->GetNextLSN());
+    lsn = log_manager->AppendLogRecord(log_record);
+    txn->SetPrevLSN(lsn);
+  }
+  memcpy(GetData(), &page_id, sizeof(page_id_t));
+  memcpy(GetData() + sizeof(page_id_t), &lsn, 4);
+  SetLSN(lsn);
+  memcpy(GetData() + OVERFLOW_PAGE_NEXT_OFFSET, &next_page_id,
+         sizeof(page_id_t));
+  memcpy(GetData() + OVERFLOW_PAGE_SIZE_OFFSET, &size, 4);
+  memcpy(GetData() + OVERFLOW_PAGE_HEADER_SIZE, bytes, size);
+}
+
+page_id_t OverflowPage::GetPageId() {
+  return *reinterpret_cast<page_id_t *>(GetData());
+}
+
+page_id_t OverflowPage::GetNextPageId() {
+  page_id_t next_page_id;
+  memcpy(&next_page_id, GetData() + OVERFLOW_PAGE_NEXT_OFFSET,
+         sizeof(page_id_t));
+  return next_page_id;
+}
+
+int32_t OverflowPage::GetSize() {
+  return *reinterpret_cast<int32_t *>(GetData() + OVERFLOW_PAGE_SIZE_OFFSET);
+}
+
+} // namespace cmudb
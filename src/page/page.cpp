@@ -0,0 +1,29 @@
+/**
+ * page.cpp
+ */
+
+#include "page/page.h"
+
+namespace cmudb {
+
+/*
+ * Try first, so an uncontended latch reads no clock
+ */
+void Page::LatchProfiled(bool exclusive) {
+  LatchStats::RecordAcquire(LatchClass::PAGE);
+  if (exclusive ? rwlatch_.TryWLock() : rwlatch_.TryRLock())
+    return;
+  auto start = std::chrono::steady_clock::now();
+  if (exclusive)
+    rwlatch_.WLock();
+  else
+    rwlatch_.RLock();
+  LatchStats::RecordWait(
+      LatchClass::PAGE,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count(),
+      page_id_);
+}
+
+} // namespace cmudb
@@ -0,0 +1,32 @@
+/**
+ * pax_layout.cpp
+ */
+
+#include "page/pax_layout.h"
+
+namespace cmudb {
+
+PaxLayout::PaxLayout(Schema *schema, int32_t page_size) {
+  int32_t columns = schema->GetColumnCount();
+  // every slot takes (offset, size) plus its fixed size part in minipages,
+  // and its varchars at the end of the page
+  int32_t tuple_size = schema->GetLength() + 8;
+  for (auto i : schema->GetUnlinedColumns())
+    tuple_size += sizeof(uint32_t) + schema->GetVariableLength(i);
+  int32_t available =
+      page_size - PAX_HEADER_SIZE(columns) - PAX_PADDING(columns);
+  if (columns == 0 || available < tuple_size)
+    return;
+  capacity_ = available / tuple_size;
+  for (int i = 0; i < columns; i++)
+    widths_.push_back(schema->GetLength(i));
+}
+
+uint32_t PaxLayout::GetMinipageEnd() const {
+  uint32_t end = PAX_HEADER_SIZE(widths_.size()) + 8 * capacity_;
+  for (auto width : widths_)
+    end += (capacity_ * width + 7) / 8 * 8;
+  return end;
+}
+
+} // namespace cmudb
@@ -1,8 +1,10 @@
 /**
- * header_page.cpp
+ * table_page.cpp
  */
 
 #include <cassert>
+#include <deque>
+#include <vector>
 
 #include "page/table_page.h"
 
@@ -11,101 +13,197 @@ namespace cmudb {
  * Header related
  */
 void TablePage::Init(page_id_t page_id, size_t page_size,
-                     page_id_t prev_page_id, page_id_t next_page_id) {
-  memcpy(GetData(), &page_id, 4); // set page_id
+                     page_id_t prev_page_id, page_id_t next_page_id,
+                     LogManager *log_manager, Transaction *txn,
+                     const PaxLayout &layout) {
+  memcpy(GetData(), &page_id, sizeof(page_id_t)); // set page_id
+  SetPageLSN(INVALID_LSN);
+  if (txn != nullptr && log_manager != nullptr && log_manager->IsRunning()) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::NEWPAGE, prev_page_id, page_id,
+                         layout);
+    WriteLog(log_record, txn, log_manager);
+  }
   SetPrevPageId(prev_page_id);
   SetNextPageId(next_page_id);
   SetFreeSpacePointer(page_size);
   SetTupleCount(0);
+  int32_t format = layout.IsPax() ? PAX_FORMAT : SLOTTED_FORMAT;
+  memcpy(GetData() + TABLE_PAGE_FORMAT_OFFSET, &format, 4);
+  if (!layout.IsPax())
+    return;
+
+  // slots, then one minipage per column, each 8 byte aligned
+  int32_t capacity = layout.capacity_;
+  int32_t column_count = layout.widths_.size();
+  int32_t fixed_length = layout.GetFixedLength();
+  int32_t offset = PAX_HEADER_SIZE(column_count);
+  memcpy(GetData() + PAX_CAPACITY_OFFSET, &capacity, 4);
+  memcpy(GetData() + PAX_COLUMN_COUNT_OFFSET, &column_count, 4);
+  memcpy(GetData() + PAX_SLOTS_OFFSET, &offset, 4);
+  memcpy(GetData() + PAX_FIXED_LENGTH_OFFSET, &fixed_length, 4);
+  offset += 8 * capacity;
+  for (int i = 0; i < column_count; ++i) {
+    int32_t width = layout.widths_[i];
+    memcpy(GetData() + PAX_COLUMNS_OFFSET + 8 * i, &width, 4);
+    memcpy(GetData() + PAX_COLUMNS_OFFSET + 4 + 8 * i, &offset, 4);
+    offset += (capacity * width + 7) / 8 * 8;
+  }
+  assert(offset <= static_cast<int32_t>(page_size));
 }
 
 page_id_t TablePage::GetPageId() {
   return *reinterpret_cast<page_id_t *>(GetData());
 }
 
+lsn_t TablePage::GetPageLSN() {
+  return *reinterpret_cast<lsn_t *>(GetData() + TABLE_PAGE_LSN_OFFSET);
+}
+
+void TablePage::SetPageLSN(lsn_t lsn) {
+  memcpy(GetData() + TABLE_PAGE_LSN_OFFSET, &lsn, 4);
+  SetLSN(lsn);
+}
+
 page_id_t TablePage::GetPrevPageId() {
-  return *reinterpret_cast<page_id_t *>(GetData() + 4);
+  page_id_t prev_page_id;
+  memcpy(&prev_page_id, GetData() + TABLE_PAGE_PREV_OFFSET, sizeof(page_id_t));
+  return prev_page_id;
 }
 
 page_id_t TablePage::GetNextPageId() {
-  return *reinterpret_cast<page_id_t *>(GetData() + 8);
+  page_id_t next_page_id;
+  memcpy(&next_page_id, GetData() + TABLE_PAGE_NEXT_OFFSET, sizeof(page_id_t));
+  return next_page_id;
 }
 
 void TablePage::SetPrevPageId(page_id_t prev_page_id) {
-  memcpy(GetData() + 4, &prev_page_id, 4);
+  memcpy(GetData() + TABLE_PAGE_PREV_OFFSET, &prev_page_id, sizeof(page_id_t));
 }
 
 void TablePage::SetNextPageId(page_id_t next_page_id) {
-  memcpy(GetData() + 8, &next_page_id, 4);
+  memcpy(GetData() + TABLE_PAGE_NEXT_OFFSET, &next_page_id, sizeof(page_id_t));
+}
+
+void TablePage::GetPaxLayout(PaxLayout &layout) {
+  layout = PaxLayout();
+  if (!IsPax())
+    return;
+  layout.capacity_ =
+      *reinterpret_cast<int32_t *>(GetData() + PAX_CAPACITY_OFFSET);
+  int32_t column_count =
+      *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMN_COUNT_OFFSET);
+  for (int i = 0; i < column_count; ++i)
+    layout.widths_.push_back(
+        *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMNS_OFFSET + 8 * i));
 }
 
 /**
  * Tuple related
  */
 bool TablePage::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn,
-                            LockManager *lock_manager) {
+                            LockManager *lock_manager,
+                            LogManager *log_manager, page_id_t table_id) {
   assert(tuple.size_ > 0);
-  if (GetFreeSpaceSize() < tuple.size_) {
+  if (GetFreeHeapSize() < GetStoredSize(tuple.size_)) {
     return false; // not enough space
   }
 
-  // try to reuse a free slot first
+  // reuse the first free slot no other transaction still locks
   int i;
   for (i = 0; i < GetTupleCount(); ++i) {
+    if (GetTupleSize(i) != 0)
+      continue;
     rid.Set(GetPageId(), i);
-    if (GetTupleSize(i) == 0) { // empty slot
-      // acquire exclusive lock
-      assert(txn->GetSharedLockSet()->find(rid) ==
-                 txn->GetSharedLockSet()->end() &&
-             txn->GetExclusiveLockSet()->find(rid) ==
-                 txn->GetExclusiveLockSet()->end());
-      assert(lock_manager->LockExclusive(txn, rid));
-    }
+    if (lock_manager == nullptr ||
+        lock_manager->TryLockExclusive(txn, rid, table_id))
+      break;
+    // died waiting for the table or page lock
+    if (txn->GetState() == TransactionState::ABORTED)
+      return false;
   }
 
   // no free slot left
-  if (i == GetTupleCount() && GetFreeSpaceSize() < tuple.size_ + 8) {
-    return false; // not enough space
-  }
-
-  SetFreeSpacePointer(GetFreeSpacePointer() -
-                      tuple.size_); // update free space pointer first
-  memcpy(GetData() + GetFreeSpacePointer(), tuple.data_, tuple.size_);
-  SetTupleOffset(i, GetFreeSpacePointer());
-  SetTupleSize(i, tuple.size_);
   if (i == GetTupleCount()) {
+    if (GetFreeSpaceSize() < tuple.size_ + 8 ||
+        (IsPax() &&
+         i == *reinterpret_cast<int32_t *>(GetData() + PAX_CAPACITY_OFFSET)))
+      return false; // not enough space
     rid.Set(GetPageId(), i);
-    assert(lock_manager->LockExclusive(txn, rid.Get()));
-    SetTupleCount(GetTupleCount() + 1);
+    if (lock_manager != nullptr &&
+        !lock_manager->LockExclusive(txn, rid, table_id))
+      return false;
+  }
+  rid.Set(GetPageId(), i);
+
+  // write ahead
+  if (log_manager != nullptr && log_manager->IsRunning()) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::INSERT, rid, tuple);
+    WriteLog(log_record, txn, log_manager);
+  }
+
+  PlaceTuple(i, tuple);
+  return true;
+}
+
+bool TablePage::RestoreTuple(const Tuple &tuple, RID &rid) {
+  int slot_num = rid.GetSlotNum();
+  if (slot_num < 0 || slot_num > GetTupleCount() ||
+      (slot_num < GetTupleCount() && GetTupleSize(slot_num) != 0))
+    slot_num = GetTupleCount();
+  if (slot_num == GetTupleCount()) {
+    if (GetFreeSpaceSize() < tuple.size_ + 8 ||
+        (IsPax() && slot_num == *reinterpret_cast<int32_t *>(
+                                    GetData() + PAX_CAPACITY_OFFSET)))
+      return false;
+  } else if (GetFreeHeapSize() < GetStoredSize(tuple.size_)) {
+    return false;
   }
+  rid.Set(GetPageId(), slot_num);
+  PlaceTuple(slot_num, tuple);
   return true;
 }
 
 bool TablePage::MarkDelete(const RID &rid, Transaction *txn,
-                           LockManager *lock_manager) {
+                           LockManager *lock_manager,
+                           LogManager *log_manager, page_id_t table_id) {
   int slot_num = rid.GetSlotNum();
   if (slot_num >= GetTupleCount()) {
-    txn->SetState(TransactionState::ABORTED);
+    if (txn != nullptr)
+      txn->SetState(TransactionState::ABORTED);
     return false;
   }
 
   int32_t tuple_size = GetTupleSize(slot_num);
   if (tuple_size < 0) {
-    txn->SetState(TransactionState::ABORTED);
+    if (txn != nullptr)
+      txn->SetState(TransactionState::ABORTED);
     return false;
   }
 
   // acquire exclusive lock
   // if has shared lock
-  if (txn->GetSharedLockSet()->find(rid) != txn->GetSharedLockSet()->end()) {
-    if (!lock_manager->LockUpgrade(txn, rid))
+  if (lock_manager == nullptr) {
+    // not locking
+  } else if (txn->GetSharedLockSet()->find(rid) !=
+             txn->GetSharedLockSet()->end()) {
+    if (!lock_manager->LockUpgrade(txn, rid, table_id))
       return false;
   } else if (txn->GetExclusiveLockSet()->find(rid) ==
                  txn->GetExclusiveLockSet()->end() &&
-             !lock_manager->LockExclusive(txn, rid)) { // no shared lock
+             !lock_manager->LockExclusive(txn, rid, table_id)) { // no shared
     return false;
   }
 
+  // write ahead, no undo information needed
+  if (log_manager != nullptr && log_manager->IsRunning()) {
+    Tuple dummy_tuple;
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::MARKDELETE, rid, dummy_tuple);
+    WriteLog(log_record, txn, log_manager);
+  }
+
   // flip size
   SetTupleSize(slot_num, -tuple_size);
   return true;
@@ -113,66 +211,94 @@ bool TablePage::MarkDelete(const RID &rid, Transaction *txn,
 
 bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple &old_tuple,
                             const RID &rid, Transaction *txn,
-                            LockManager *lock_manager) {
+                            LockManager *lock_manager,
+                            LogManager *log_manager, page_id_t table_id) {
   int slot_num = rid.GetSlotNum();
   if (slot_num >= GetTupleCount()) {
-    txn->SetState(TransactionState::ABORTED);
+    if (txn != nullptr)
+      txn->SetState(TransactionState::ABORTED);
     return false;
   }
   int32_t tuple_size = GetTupleSize(slot_num); // old tuple size
   if (tuple_size <= 0) {
-    txn->SetState(TransactionState::ABORTED);
+    if (txn != nullptr)
+      txn->SetState(TransactionState::ABORTED);
     return false;
   }
-  if (GetFreeSpaceSize() < new_tuple.size_ - tuple_size) {
+  if (GetFreeHeapSize() < new_tuple.size_ - tuple_size) {
     // should delete/insert because not enough space
     return false;
   }
 
   // acquire exclusive lock
   // if has shared lock
-  if (txn->GetSharedLockSet()->find(rid) != txn->GetSharedLockSet()->end()) {
-    if (!lock_manager->LockUpgrade(txn, rid))
+  if (lock_manager == nullptr) {
+    // not locking
+  } else if (txn->GetSharedLockSet()->find(rid) !=
+             txn->GetSharedLockSet()->end()) {
+    if (!lock_manager->LockUpgrade(txn, rid, table_id))
       return false;
   } else if (txn->GetExclusiveLockSet()->find(rid) ==
                  txn->GetExclusiveLockSet()->end() &&
-             !lock_manager->LockExclusive(txn, rid)) { // no shared lock
+             !lock_manager->LockExclusive(txn, rid, table_id)) { // no shared
     return false;
   }
 
   // copy out old value
   int32_t tuple_offset =
       GetTupleOffset(slot_num); // the tuple offset of the old tuple
-  old_tuple.size_ = tuple_size;
-  if (old_tuple.allocated_)
-    delete[] old_tuple.data_;
-  old_tuple.data_ = new char[old_tuple.size_];
-  memcpy(old_tuple.data_, GetData() + tuple_offset, old_tuple.size_);
-  old_tuple.rid_ = rid;
-  old_tuple.allocated_ = true;
+  CopyTuple(rid, tuple_size, old_tuple);
+
+  // write ahead
+  if (log_manager != nullptr && log_manager->IsRunning()) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::UPDATE, rid, old_tuple, new_tuple);
+    WriteLog(log_record, txn, log_manager);
+  }
 
   // update
+  int32_t stored_size = GetStoredSize(tuple_size);
+  int32_t shift = stored_size - GetStoredSize(new_tuple.size_);
   int32_t free_space_pointer =
       GetFreeSpacePointer(); // old pointer to the free space
   assert(tuple_offset >= free_space_pointer);
-  memmove(GetData() + free_space_pointer + tuple_size - new_tuple.size_,
+  memmove(GetData() + free_space_pointer + shift,
           GetData() + free_space_pointer, tuple_offset - free_space_pointer);
-  SetFreeSpacePointer(free_space_pointer + tuple_size - new_tuple.size_);
-  memcpy(GetData() + tuple_offset + tuple_size - new_tuple.size_,
-         new_tuple.data_,
-         new_tuple.size_);                 // copy new tuple
-  SetTupleSize(slot_num, new_tuple.size_); // update tuple size in slot
+  SetFreeSpacePointer(free_space_pointer + shift);
   for (int i = 0; i < GetTupleCount();
-       ++i) { // update tuple offsets (including the updated one)
+       ++i) { // update tuple offsets, marked deleted ones too
     int32_t tuple_offset_i = GetTupleOffset(i);
-    if (GetTupleSize(i) > 0 && tuple_offset_i < tuple_offset + tuple_size) {
-      SetTupleOffset(i, tuple_offset_i + tuple_size - new_tuple.size_);
+    if (i != slot_num && GetTupleSize(i) != 0 &&
+        tuple_offset_i < tuple_offset + stored_size) {
+      SetTupleOffset(i, tuple_offset_i + shift);
     }
   }
+  SetTupleOffset(slot_num, tuple_offset + shift);
+  SetTupleSize(slot_num, new_tuple.size_); // update tuple size in slot
+  WriteTuple(slot_num, new_tuple.data_, new_tuple.size_); // copy new tuple
   return true;
 }
 
-void TablePage::ApplyDelete(const RID &rid, Transaction *txn) {
+int32_t TablePage::GetUpdateRoom(const RID &rid) {
+  int slot_num = rid.GetSlotNum();
+  if (slot_num >= GetTupleCount())
+    return 0;
+  int32_t tuple_size = GetTupleSize(slot_num);
+  return tuple_size <= 0 ? 0 : GetFreeHeapSize() + tuple_size;
+}
+
+void TablePage::PlaceTuple(int slot_num, const Tuple &tuple) {
+  // update free space pointer first
+  SetFreeSpacePointer(GetFreeSpacePointer() - GetStoredSize(tuple.size_));
+  SetTupleOffset(slot_num, GetFreeSpacePointer());
+  SetTupleSize(slot_num, tuple.size_);
+  WriteTuple(slot_num, tuple.data_, tuple.size_);
+  if (slot_num == GetTupleCount())
+    SetTupleCount(GetTupleCount() + 1);
+}
+
+void TablePage::ApplyDelete(const RID &rid, Transaction *txn,
+                            LogManager *log_manager, Tuple *deleted) {
   int slot_num = rid.GetSlotNum();
   assert(slot_num < GetTupleCount());
   int32_t tuple_size = GetTupleSize(slot_num);
@@ -180,75 +306,196 @@ void TablePage::ApplyDelete(const RID &rid, Transaction *txn) {
     tuple_size = -tuple_size;
   } // else: rollback insert op
 
-  assert(txn->GetExclusiveLockSet()->find(rid) !=
-         txn->GetExclusiveLockSet()->end());
+  assert(txn == nullptr || LockManager::HoldsExclusive(txn, rid));
 
   int32_t tuple_offset =
       GetTupleOffset(slot_num); // the tuple offset of the deleted tuple
+  if (deleted != nullptr)
+    CopyTuple(rid, tuple_size, *deleted);
+
+  // write ahead, with tuple data to undo
+  if (log_manager != nullptr && log_manager->IsRunning()) {
+    Tuple delete_tuple(rid);
+    CopyTuple(rid, tuple_size, delete_tuple);
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::APPLYDELETE, rid, delete_tuple);
+    WriteLog(log_record, txn, log_manager);
+  }
+
+  int32_t stored_size = GetStoredSize(tuple_size);
   int32_t free_space_pointer =
       GetFreeSpacePointer(); // old pointer to the free space
   assert(tuple_offset >= free_space_pointer);
-  memmove(GetData() + free_space_pointer + tuple_size,
+  memmove(GetData() + free_space_pointer + stored_size,
           GetData() + free_space_pointer, tuple_offset - free_space_pointer);
-  SetFreeSpacePointer(free_space_pointer + tuple_size);
+  SetFreeSpacePointer(free_space_pointer + stored_size);
   SetTupleSize(slot_num, 0);
   SetTupleOffset(slot_num, 0); // invalid offset
+  // PAX tuples without varchars take no bytes, they may share the offset
   for (int i = 0; i < GetTupleCount(); ++i) {
     int32_t tuple_offset_i = GetTupleOffset(i);
-    if (GetTupleSize(i) != 0 && tuple_offset_i < tuple_offset) {
-      SetTupleOffset(i, tuple_offset_i + tuple_size);
+    if (GetTupleSize(i) != 0 && tuple_offset_i <= tuple_offset) {
+      SetTupleOffset(i, tuple_offset_i + stored_size);
     }
   }
 }
 
-void TablePage::RollbackDelete(const RID &rid, Transaction *txn) {
+void TablePage::RollbackDelete(const RID &rid, Transaction *txn,
+                               LogManager *log_manager) {
   int slot_num = rid.GetSlotNum();
   assert(slot_num < GetTupleCount());
   int32_t tuple_size = GetTupleSize(slot_num);
   assert(tuple_size < 0); // marked delete
 
-  assert(txn->GetExclusiveLockSet()->find(rid) !=
-         txn->GetExclusiveLockSet()->end());
+  assert(txn == nullptr || LockManager::HoldsExclusive(txn, rid));
+
+  // write ahead
+  if (log_manager != nullptr && log_manager->IsRunning()) {
+    Tuple dummy_tuple;
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::ROLLBACKDELETE, rid, dummy_tuple);
+    WriteLog(log_record, txn, log_manager);
+  }
 
   // flip size
   SetTupleSize(slot_num, -tuple_size);
 }
 
 bool TablePage::GetTuple(const RID &rid, Tuple &tuple, Transaction *txn,
-                         LockManager *lock_manager) {
+                         LockManager *lock_manager, page_id_t table_id) {
+  if (!LockTuple(rid, txn, lock_manager, table_id))
+    return false;
+
+  CopyTuple(rid, GetTupleSize(rid.GetSlotNum()), tuple);
+  return true;
+}
+
+bool TablePage::HasTuple(const RID &rid) {
   int slot_num = rid.GetSlotNum();
-  if (slot_num >= GetTupleCount()) {
-    txn->SetState(TransactionState::ABORTED);
+  return slot_num >= 0 && slot_num < GetTupleCount() &&
+         GetTupleSize(slot_num) > 0;
+}
+
+bool TablePage::LockTuple(const RID &rid, Transaction *txn,
+                          LockManager *lock_manager, page_id_t table_id,
+                          bool wait) {
+  int slot_num = rid.GetSlotNum();
+  if (slot_num < 0 || slot_num >= GetTupleCount()) {
+    if (txn != nullptr)
+      txn->SetState(TransactionState::ABORTED);
     return false;
   }
   int32_t tuple_size = GetTupleSize(slot_num);
   if (tuple_size <= 0) {
-    txn->SetState(TransactionState::ABORTED);
+    if (txn != nullptr)
+      txn->SetState(TransactionState::ABORTED);
     return false;
   }
 
   // acquire shared lock
-  if (txn->GetExclusiveLockSet()->find(rid) ==
+  if (lock_manager != nullptr &&
+      txn->GetExclusiveLockSet()->find(rid) ==
           txn->GetExclusiveLockSet()->end() &&
       txn->GetSharedLockSet()->find(rid) == txn->GetSharedLockSet()->end() &&
-      !lock_manager->LockShared(txn, rid)) {
+      !(wait ? lock_manager->LockShared(txn, rid, table_id)
+             : lock_manager->TryLockShared(txn, rid, table_id))) {
     return false;
   }
-
-  int32_t tuple_offset = GetTupleOffset(slot_num);
-  tuple.size_ = tuple_size;
-  if (tuple.allocated_)
-    delete[] tuple.data_;
-  tuple.data_ = new char[tuple.size_];
-  memcpy(tuple.data_, GetData() + tuple_offset, tuple.size_);
-  tuple.rid_ = rid;
-  tuple.allocated_ = true;
   return true;
 }
 
 /**
  * Tuple iterator
  */
+bool TablePage::ScanBatch(int &slot, RowBatch &batch, Transaction *txn,
+                          LockManager *lock_manager, std::mutex *txn_latch,
+                          page_id_t table_id, RID *blocked) {
+  VersionStore *versions = nullptr;
+  if (txn != nullptr && txn->IsSnapshot()) {
+    lock_manager = nullptr;
+    if (txn->GetVersionStore()->HasVersions(table_id, GetPageId()))
+      versions = txn->GetVersionStore();
+  }
+  if (versions != nullptr)
+    return ScanVersions(slot, batch, txn, versions, table_id);
+  // the columns of a PAX page are copied from their minipages
+  std::vector<const char *> minipages;
+  int32_t fixed_length = 0;
+  if (IsPax()) {
+    int32_t column_count =
+        *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMN_COUNT_OFFSET);
+    for (int i = 0; i < column_count; ++i)
+      minipages.push_back(
+          GetData() + *reinterpret_cast<int32_t *>(GetData() +
+                                                   PAX_COLUMNS_OFFSET + 4 +
+                                                   8 * i));
+    fixed_length = GetFixedLength();
+    batch.SetMinipages(minipages.data());
+  }
+  for (; slot < GetTupleCount() && !batch.IsFull(); ++slot) {
+    if (GetTupleSize(slot) <= 0)
+      continue;
+    RID rid(GetPageId(), slot);
+    bool locked;
+    if (txn_latch != nullptr && lock_manager != nullptr) {
+      std::lock_guard<std::mutex> guard(*txn_latch);
+      locked = LockTuple(rid, txn, lock_manager, table_id, blocked == nullptr);
+    } else {
+      locked = LockTuple(rid, txn, lock_manager, table_id, blocked == nullptr);
+    }
+    if (!locked && blocked != nullptr &&
+        txn->GetState() != TransactionState::ABORTED) {
+      *blocked = rid;
+      break;
+    }
+    if (!locked)
+      continue;
+    if (minipages.empty())
+      batch.AppendTuple(GetData() + GetTupleOffset(slot), rid);
+    else
+      batch.AppendSlot(slot, GetData() + GetTupleOffset(slot) - fixed_length,
+                       rid);
+  }
+  // filtered while the tuples are still in place
+  batch.Materialize();
+  return slot == GetTupleCount();
+}
+
+/*
+ * Tuples of a page with versions are appended in their Tuple format, those
+ * of a PAX page copied out of the minipages first. The copies live until
+ * the batch is materialized
+ */
+bool TablePage::ScanVersions(int &slot, RowBatch &batch, Transaction *txn,
+                             VersionStore *versions, page_id_t table_id) {
+  std::deque<Tuple> images;
+  for (; slot < GetTupleCount() && !batch.IsFull(); ++slot) {
+    RID rid(GetPageId(), slot);
+    Tuple image;
+    bool exists;
+    if (versions->Read(table_id, rid, txn->GetReadTimestamp(), image,
+                       exists)) {
+      if (exists) {
+        images.push_back(std::move(image));
+        batch.AppendTuple(images.back().GetData(), rid);
+      }
+      continue;
+    }
+    int32_t tuple_size = GetTupleSize(slot);
+    if (tuple_size <= 0)
+      continue;
+    if (IsPax()) {
+      images.emplace_back();
+      CopyTuple(rid, tuple_size, images.back());
+      batch.AppendTuple(images.back().GetData(), rid);
+    } else {
+      batch.AppendTuple(GetData() + GetTupleOffset(slot), rid);
+    }
+  }
+  batch.Materialize();
+  return slot == GetTupleCount();
+}
+
 bool TablePage::GetFirstTupleRid(RID &first_rid) {
   for (int i = 0; i < GetTupleCount(); ++i) {
     if (GetTupleSize(i) > 0) { // valid tuple
@@ -278,41 +525,166 @@ bool TablePage::GetNextTupleRid(const RID &cur_rid, RID &next_rid) {
 
 // tuple slots
 int32_t TablePage::GetTupleOffset(int slot_num) {
-  return *reinterpret_cast<int32_t *>(GetData() + 20 + 8 * slot_num);
+  return *reinterpret_cast<int32_t *>(GetData() + GetSlotOffset() +
+                                      8 * slot_num);
 }
 
 int32_t TablePage::GetTupleSize(int slot_num) {
-  return *reinterpret_cast<int32_t *>(GetData() + 24 + 8 * slot_num);
+  return *reinterpret_cast<int32_t *>(GetData() + GetSlotOffset() + 4 +
+                                      8 * slot_num);
 }
 
 void TablePage::SetTupleOffset(int slot_num, int32_t offset) {
-  memcpy(GetData() + 20 + 8 * slot_num, &offset, 4);
+  memcpy(GetData() + GetSlotOffset() + 8 * slot_num, &offset, 4);
 }
 
 void TablePage::SetTupleSize(int slot_num, int32_t offset) {
-  memcpy(GetData() + 24 + 8 * slot_num, &offset, 4);
+  memcpy(GetData() + GetSlotOffset() + 4 + 8 * slot_num, &offset, 4);
+}
+
+// tuple bytes
+const char *TablePage::GetPaxBytes(int slot_num, int32_t offset) {
+  int32_t fixed_length = GetFixedLength();
+  if (offset >= fixed_length)
+    return GetData() + GetTupleOffset(slot_num) + offset - fixed_length;
+  // the column offset falls in
+  const char *column = GetData() + PAX_COLUMNS_OFFSET;
+  int32_t width = *reinterpret_cast<const int32_t *>(column);
+  while (offset >= width) {
+    offset -= width;
+    column += 8;
+    width = *reinterpret_cast<const int32_t *>(column);
+  }
+  return GetData() + *reinterpret_cast<const int32_t *>(column + 4) +
+         slot_num * width + offset;
+}
+
+void TablePage::WriteTuple(int slot_num, const char *data, int32_t size) {
+  char *dst = GetData() + GetTupleOffset(slot_num);
+  if (!IsPax()) {
+    memcpy(dst, data, size);
+    return;
+  }
+  int32_t fixed_length = GetFixedLength();
+  memcpy(dst, data + fixed_length, size - fixed_length);
+  int32_t column_count =
+      *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMN_COUNT_OFFSET);
+  for (int i = 0; i < column_count; ++i) {
+    int32_t width =
+        *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMNS_OFFSET + 8 * i);
+    int32_t minipage =
+        *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMNS_OFFSET + 4 +
+                                     8 * i);
+    memcpy(GetData() + minipage + slot_num * width, data, width);
+    data += width;
+  }
+}
+
+void TablePage::CopyTuple(const RID &rid, int32_t size, Tuple &tuple) {
+  int slot_num = rid.GetSlotNum();
+  // a tuple read again and again, as by an iterator, keeps its buffer
+  tuple.Reserve(size);
+  tuple.size_ = size;
+  tuple.rid_ = rid;
+  const char *src = GetData() + GetTupleOffset(slot_num);
+  if (!IsPax()) {
+    memcpy(tuple.data_, src, size);
+    return;
+  }
+  int32_t fixed_length = GetFixedLength();
+  memcpy(tuple.data_ + fixed_length, src, size - fixed_length);
+  char *dst = tuple.data_;
+  int32_t column_count =
+      *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMN_COUNT_OFFSET);
+  for (int i = 0; i < column_count; ++i) {
+    int32_t width =
+        *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMNS_OFFSET + 8 * i);
+    int32_t minipage =
+        *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMNS_OFFSET + 4 +
+                                     8 * i);
+    memcpy(dst, GetData() + minipage + slot_num * width, width);
+    dst += width;
+  }
 }
 
 // free space
 int32_t TablePage::GetFreeSpacePointer() {
-  return *reinterpret_cast<int32_t *>(GetData() + 12);
+  return *reinterpret_cast<int32_t *>(GetData() + TABLE_PAGE_FREE_SPACE_OFFSET);
 }
 
 void TablePage::SetFreeSpacePointer(int32_t free_space_pointer) {
-  memcpy(GetData() + 12, &free_space_pointer, 4);
+  memcpy(GetData() + TABLE_PAGE_FREE_SPACE_OFFSET, &free_space_pointer, 4);
 }
 
 // tuple count
 int32_t TablePage::GetTupleCount() {
-  return *reinterpret_cast<int32_t *>(GetData() + 16);
+  return
+      *reinterpret_cast<int32_t *>(GetData() + TABLE_PAGE_TUPLE_COUNT_OFFSET);
 }
 
 void TablePage::SetTupleCount(int32_t tuple_count) {
-  memcpy(GetData() + 16, &tuple_count, 4);
+  memcpy(GetData() + TABLE_PAGE_TUPLE_COUNT_OFFSET, &tuple_count, 4);
 }
 
 // for free space calculation
 int32_t TablePage::GetFreeSpaceSize() {
-  return GetFreeSpacePointer() - 20 - GetTupleCount() * 8;
+  if (!IsPax())
+    return GetFreeHeapSize();
+  // once the slots are used up only a free one takes a tuple
+  if (GetTupleCount() ==
+          *reinterpret_cast<int32_t *>(GetData() + PAX_CAPACITY_OFFSET) &&
+      !HasFreeSlot())
+    return 0;
+  return GetFreeHeapSize() + GetFixedLength() + 8;
+}
+
+bool TablePage::IsEmpty() {
+  for (int i = 0; i < GetTupleCount(); ++i) {
+    if (GetTupleSize(i) != 0)
+      return false;
+  }
+  return true;
+}
+
+// no room is left above the header, every insert fails the space check
+void TablePage::Retire() {
+  assert(IsEmpty());
+  SetFreeSpacePointer(0);
+}
+
+bool TablePage::HasFreeSlot() {
+  for (int i = 0; i < GetTupleCount(); ++i) {
+    if (GetTupleSize(i) == 0)
+      return true;
+  }
+  return false;
+}
+
+int32_t TablePage::GetFreeHeapSize() {
+  if (!IsPax())
+    return GetFreeSpacePointer() - TABLE_PAGE_HEADER_SIZE -
+           GetTupleCount() * 8;
+  // minipages end where the last one does
+  int32_t capacity =
+      *reinterpret_cast<int32_t *>(GetData() + PAX_CAPACITY_OFFSET);
+  int32_t last =
+      *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMN_COUNT_OFFSET) - 1;
+  int32_t width =
+      *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMNS_OFFSET + 8 * last);
+  int32_t minipage =
+      *reinterpret_cast<int32_t *>(GetData() + PAX_COLUMNS_OFFSET + 4 +
+                                   8 * last);
+  return GetFreeSpacePointer() - minipage - (capacity * width + 7) / 8 * 8;
+}
+
+// logging
+void TablePage::WriteLog(LogRecord &log_record, Transaction *txn,
+                         LogManager *log_manager) {
+  // a lower bound of the lsn about to be assigned, before a checkpoint can
+  // miss the change
+  SetRecLSN(log_manager->GetNextLSN());
+  lsn_t lsn = log_manager->AppendLogRecord(log_record);
+  txn->SetPrevLSN(lsn);
+  SetPageLSN(lsn);
 }
 } // namespace cmudb
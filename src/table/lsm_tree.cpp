@@ -0,0 +1,572 @@
+/**
+ * lsm_tree.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/exception.h"
+#include "common/logger.h"
+#include "table/lsm_tree.h"
+#include "table/table_stats.h"
+
+namespace cmudb {
+
+/*
+ * About ln 2 * bits per key probes, each from the hash of the key and a
+ * second one derived from it
+ */
+BloomFilter::BloomFilter(size_t keys, size_t bits_per_key)
+    : bit_count_(std::max<uint64_t>(64, keys * bits_per_key)),
+      probes_(std::max<int>(1, static_cast<int>(bits_per_key * 69 / 100))) {
+  bits_.resize((bit_count_ + 63) / 64);
+}
+
+void BloomFilter::Add(int64_t key) {
+  uint64_t hash = HyperLogLog::Hash(reinterpret_cast<const char *>(&key),
+                                    sizeof(key));
+  uint64_t delta = (hash >> 33) | 1;
+  for (int i = 0; i < probes_; i++, hash += delta) {
+    uint64_t bit = hash % bit_count_;
+    bits_[bit / 64] |= 1ULL << (bit % 64);
+  }
+}
+
+bool BloomFilter::MayContain(int64_t key) const {
+  uint64_t hash = HyperLogLog::Hash(reinterpret_cast<const char *>(&key),
+                                    sizeof(key));
+  uint64_t delta = (hash >> 33) | 1;
+  for (int i = 0; i < probes_; i++, hash += delta) {
+    uint64_t bit = hash % bit_count_;
+    if ((bits_[bit / 64] & (1ULL << (bit % 64))) == 0)
+      return false;
+  }
+  return true;
+}
+
+LsmRun::~LsmRun() {
+  if (!obsolete_)
+    return;
+  for (page_id_t page_id : page_ids_)
+    buffer_pool_manager_->DeletePage(page_id);
+}
+
+/*****************************************************************************
+ * OPEN AND CLOSE
+ *****************************************************************************/
+LsmTree::LsmTree(BufferPoolManager *buffer_pool_manager,
+                 page_id_t manifest_page_id)
+    : buffer_pool_manager_(buffer_pool_manager),
+      manifest_page_id_(manifest_page_id), next_key_(1) {
+  if (manifest_page_id_ == INVALID_PAGE_ID) {
+    Page *page = buffer_pool_manager_->NewPage(manifest_page_id_);
+    if (page == nullptr)
+      throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned");
+    buffer_pool_manager_->UnpinPage(manifest_page_id_, true);
+    std::lock_guard<std::mutex> guard(latch_);
+    WriteManifest();
+  } else {
+    Page *page = buffer_pool_manager_->FetchPage(manifest_page_id_);
+    if (page == nullptr)
+      throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned");
+    int64_t next_key;
+    uint32_t run_count;
+    memcpy(&next_key, page->GetData(), sizeof(int64_t));
+    memcpy(&run_count, page->GetData() + 8, sizeof(uint32_t));
+    std::vector<page_id_t> first_page_ids(run_count);
+    memcpy(first_page_ids.data(), page->GetData() + LSM_MANIFEST_HEADER_SIZE,
+           run_count * sizeof(page_id_t));
+    buffer_pool_manager_->UnpinPage(manifest_page_id_, false);
+    for (page_id_t first_page_id : first_page_ids) {
+      runs_.push_back(LoadRun(first_page_id));
+      next_key = std::max(next_key, runs_.back()->max_key_ + 1);
+    }
+    next_key_ = next_key;
+  }
+  compaction_thread_ = std::thread(&LsmTree::CompactionThread, this);
+}
+
+LsmTree::~LsmTree() {
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    stop_ = true;
+  }
+  compaction_cv_.notify_all();
+  compaction_thread_.join();
+  Flush();
+}
+
+std::shared_ptr<LsmRun> LsmTree::LoadRun(page_id_t first_page_id) {
+  std::vector<int64_t> keys;
+  std::vector<page_id_t> page_ids;
+  std::vector<int64_t> first_keys;
+  page_id_t page_id = first_page_id;
+  while (page_id != INVALID_PAGE_ID) {
+    Page *page = buffer_pool_manager_->FetchPage(page_id);
+    if (page == nullptr)
+      throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned");
+    const char *data = page->GetData();
+    page_id_t next_page_id;
+    uint32_t count;
+    memcpy(&next_page_id, data, sizeof(page_id_t));
+    memcpy(&count, data + LSM_COUNT_OFFSET, sizeof(uint32_t));
+    const char *record = data + LSM_PAGE_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+      int64_t key;
+      uint32_t size;
+      memcpy(&key, record, sizeof(int64_t));
+      memcpy(&size, record + 8, sizeof(uint32_t));
+      if (i == 0) {
+        page_ids.push_back(page_id);
+        first_keys.push_back(key);
+      }
+      keys.push_back(key);
+      record += LSM_RECORD_HEADER_SIZE + (size == LSM_TOMBSTONE ? 0 : size);
+    }
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    page_id = next_page_id;
+  }
+  auto run = std::make_shared<LsmRun>(buffer_pool_manager_, keys.size());
+  run->page_ids_ = std::move(page_ids);
+  run->first_keys_ = std::move(first_keys);
+  run->count_ = keys.size();
+  for (int64_t key : keys)
+    run->bloom_.Add(key);
+  if (!keys.empty())
+    run->max_key_ = keys.back();
+  return run;
+}
+
+/*
+ * The runs are on disk when it is written, and it is on disk before the
+ * pages of runs it no longer lists are deleted
+ */
+void LsmTree::WriteManifest() {
+  Page *page = buffer_pool_manager_->FetchPage(manifest_page_id_);
+  if (page == nullptr)
+    throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned");
+  char *data = page->GetData();
+  int64_t next_key = next_key_;
+  uint32_t run_count = static_cast<uint32_t>(runs_.size());
+  memcpy(data, &next_key, sizeof(int64_t));
+  memcpy(data + 8, &run_count, sizeof(uint32_t));
+  for (uint32_t i = 0; i < run_count; i++) {
+    page_id_t first_page_id = runs_[i]->page_ids_[0];
+    memcpy(data + LSM_MANIFEST_HEADER_SIZE + i * sizeof(page_id_t),
+           &first_page_id, sizeof(page_id_t));
+  }
+  buffer_pool_manager_->UnpinPage(manifest_page_id_, true);
+  buffer_pool_manager_->FlushPage(manifest_page_id_);
+}
+
+/*****************************************************************************
+ * READ AND WRITE
+ *****************************************************************************/
+int64_t LsmTree::NextKey() { return next_key_++; }
+
+void LsmTree::Put(int64_t key, const char *row, uint32_t size) {
+  if (size > PAGE_SIZE - LSM_PAGE_HEADER_SIZE - LSM_RECORD_HEADER_SIZE)
+    throw Exception(EXCEPTION_TYPE_OBJECT_SIZE, "row too large for a page");
+  Write(key, false, row, size);
+}
+
+void LsmTree::Remove(int64_t key) { Write(key, true, nullptr, 0); }
+
+void LsmTree::Write(int64_t key, bool deleted, const char *row,
+                    uint32_t size) {
+  bool full;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    LsmEntry &entry = memtable_[key];
+    entry.key_ = key;
+    entry.deleted_ = deleted;
+    if (deleted)
+      entry.row_.clear();
+    else
+      entry.row_.assign(row, size);
+    memtable_size_ += LSM_RECORD_HEADER_SIZE + size;
+    full = memtable_size_ >= LSM_MEMTABLE_SIZE;
+  }
+  int64_t next_key = next_key_;
+  while (key >= next_key &&
+         !next_key_.compare_exchange_weak(next_key, key + 1))
+    ;
+  if (full)
+    Flush();
+}
+
+/*
+ * The memtables first, then the runs from the newest, each probed only if
+ * its keys span key and its filter passes it
+ */
+bool LsmTree::Get(int64_t key, std::string &row) {
+  std::vector<std::shared_ptr<LsmRun>> runs;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    for (const Memtable *memtable : {&memtable_, frozen_.get()}) {
+      if (memtable == nullptr)
+        continue;
+      auto it = memtable->find(key);
+      if (it == memtable->end())
+        continue;
+      if (it->second.deleted_)
+        return false;
+      row = it->second.row_;
+      return true;
+    }
+    runs = runs_;
+  }
+  for (auto &run : runs) {
+    if (key > run->max_key_ || key < run->first_keys_[0] ||
+        !run->bloom_.MayContain(key))
+      continue;
+    page_id_t page_id = run->page_ids_[FindPage(*run, key)];
+    Page *page = buffer_pool_manager_->FetchPage(page_id);
+    if (page == nullptr)
+      throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned");
+    const char *data = page->GetData();
+    uint32_t count;
+    memcpy(&count, data + LSM_COUNT_OFFSET, sizeof(uint32_t));
+    const char *record = data + LSM_PAGE_HEADER_SIZE;
+    bool found = false, deleted = false;
+    for (uint32_t i = 0; i < count; i++) {
+      int64_t record_key;
+      uint32_t size;
+      memcpy(&record_key, record, sizeof(int64_t));
+      memcpy(&size, record + 8, sizeof(uint32_t));
+      if (record_key >= key) {
+        found = record_key == key;
+        deleted = size == LSM_TOMBSTONE;
+        if (found && !deleted)
+          row.assign(record + LSM_RECORD_HEADER_SIZE, size);
+        break;
+      }
+      record += LSM_RECORD_HEADER_SIZE + (size == LSM_TOMBSTONE ? 0 : size);
+    }
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    if (found)
+      return !deleted;
+  }
+  return false;
+}
+
+size_t LsmTree::FindPage(const LsmRun &run, int64_t key) {
+  auto it = std::upper_bound(run.first_keys_.begin(), run.first_keys_.end(),
+                             key);
+  return it == run.first_keys_.begin() ? 0 : it - run.first_keys_.begin() - 1;
+}
+
+size_t LsmTree::GetRunCount() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return runs_.size();
+}
+
+size_t LsmTree::GetEntryCount() {
+  std::lock_guard<std::mutex> guard(latch_);
+  size_t count = memtable_.size() + (frozen_ ? frozen_->size() : 0);
+  for (auto &run : runs_)
+    count += run->count_;
+  return count;
+}
+
+std::vector<LsmEntry> LsmTree::Entries(const Memtable &memtable, int64_t low,
+                                       int64_t high) {
+  std::vector<LsmEntry> entries;
+  for (auto it = memtable.lower_bound(low);
+       it != memtable.end() && it->first <= high; ++it)
+    entries.push_back(it->second);
+  return entries;
+}
+
+/*****************************************************************************
+ * FLUSH AND COMPACTION
+ *****************************************************************************/
+/*
+ * Writers go on with a new memtable while the frozen one is written, reads
+ * find its entries until the run replaces it
+ */
+void LsmTree::Flush() {
+  std::lock_guard<std::mutex> flush_guard(flush_latch_);
+  // the manifest has room for one more run
+  if (GetRunCount() + 1 >= LSM_MAX_RUNS)
+    Compact();
+  std::vector<std::vector<LsmEntry>> memtables(1);
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    if (memtable_.empty())
+      return;
+    frozen_ = std::make_shared<Memtable>();
+    frozen_->swap(memtable_);
+    memtable_size_ = 0;
+    memtables[0] = Entries(*frozen_, INT64_MIN, INT64_MAX);
+  }
+  Iterator entries(buffer_pool_manager_, std::move(memtables), {}, INT64_MIN,
+                   INT64_MAX, true);
+  std::shared_ptr<LsmRun> run = WriteRun(entries, frozen_->size());
+  bool compact;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    runs_.insert(runs_.begin(), run);
+    frozen_ = nullptr;
+    WriteManifest();
+    compact = runs_.size() >= LSM_COMPACTION_RUNS;
+  }
+  if (compact)
+    compaction_cv_.notify_one();
+}
+
+/*
+ * Only compactions take runs away and flushes add them in front, the runs
+ * merged are still the oldest ones when the merged run replaces them. With
+ * the oldest run merged nothing is left for a tombstone to hide, they are
+ * dropped
+ */
+void LsmTree::Compact() {
+  std::lock_guard<std::mutex> compaction_guard(compaction_latch_);
+  std::vector<std::shared_ptr<LsmRun>> runs;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    runs = runs_;
+  }
+  if (runs.size() < 2)
+    return;
+  size_t keys = 0;
+  for (auto &run : runs)
+    keys += run->count_;
+  Iterator entries(buffer_pool_manager_, {}, runs, INT64_MIN, INT64_MAX,
+                   false);
+  std::shared_ptr<LsmRun> merged = WriteRun(entries, keys);
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    runs_.resize(runs_.size() - runs.size());
+    if (merged != nullptr)
+      runs_.push_back(merged);
+    WriteManifest();
+  }
+  for (auto &run : runs)
+    run->obsolete_ = true;
+  ++compactions_;
+}
+
+void LsmTree::CompactionThread() {
+  std::unique_lock<std::mutex> lock(latch_);
+  while (true) {
+    compaction_cv_.wait(
+        lock, [this] { return stop_ || runs_.size() >= LSM_COMPACTION_RUNS; });
+    if (stop_)
+      return;
+    lock.unlock();
+    try {
+      Compact();
+    } catch (Exception &e) {
+      // the runs are left as they are, flushes compact once the manifest
+      // is full
+      LOG_WARN("lsm compaction failed: %s", e.what());
+      return;
+    }
+    lock.lock();
+  }
+}
+
+/*
+ * Pages are filled in memory and written LSM_WRITE_BATCH at a time, each
+ * stretch of consecutive page ids with one request. A page gets the id of
+ * the next one before it is written
+ */
+std::shared_ptr<LsmRun> LsmTree::WriteRun(Iterator &entries, size_t keys) {
+  DiskManager *disk_manager = buffer_pool_manager_->GetDiskManager();
+  auto run = std::make_shared<LsmRun>(buffer_pool_manager_, keys);
+  std::vector<std::unique_ptr<char[]>> pages;
+  std::vector<page_id_t> page_ids;
+  auto write_pages = [&]() {
+    std::mutex remaining_latch;
+    std::condition_variable remaining_cv;
+    size_t remaining = 0;
+    bool success = true;
+    for (size_t start = 0; start < pages.size();) {
+      size_t end = start + 1;
+      while (end < pages.size() && page_ids[end] == page_ids[end - 1] + 1)
+        ++end;
+      std::vector<const char *> pages_data;
+      for (size_t i = start; i < end; i++)
+        pages_data.push_back(pages[i].get());
+      {
+        std::lock_guard<std::mutex> remaining_guard(remaining_latch);
+        ++remaining;
+      }
+      disk_manager->WritePagesAsync(
+          page_ids[start], pages_data.data(), end - start, [&](bool result) {
+            std::lock_guard<std::mutex> remaining_guard(remaining_latch);
+            success = success && result;
+            --remaining;
+            remaining_cv.notify_one();
+          });
+      start = end;
+    }
+    disk_manager->SubmitIO();
+    {
+      std::unique_lock<std::mutex> remaining_guard(remaining_latch);
+      remaining_cv.wait(remaining_guard, [&] { return remaining == 0; });
+    }
+    if (!success)
+      throw Exception(EXCEPTION_TYPE_INDEX, "can't write lsm run");
+    pages.clear();
+    page_ids.clear();
+  };
+
+  char *page = nullptr;
+  uint32_t used = 0, count = 0;
+  for (; !entries.isEnd(); entries.Next()) {
+    const LsmEntry &entry = entries.entry_;
+    uint32_t size =
+        entry.deleted_ ? 0 : static_cast<uint32_t>(entry.row_.size());
+    if (page == nullptr || used + LSM_RECORD_HEADER_SIZE + size > PAGE_SIZE) {
+      page_id_t page_id = disk_manager->AllocatePage();
+      if (page != nullptr) {
+        memcpy(page, &page_id, sizeof(page_id_t));
+        memcpy(page + LSM_COUNT_OFFSET, &count, sizeof(uint32_t));
+        if (pages.size() == LSM_WRITE_BATCH)
+          write_pages();
+      }
+      pages.emplace_back(new char[PAGE_SIZE]());
+      page_ids.push_back(page_id);
+      page = pages.back().get();
+      run->page_ids_.push_back(page_id);
+      run->first_keys_.push_back(entry.key_);
+      used = LSM_PAGE_HEADER_SIZE;
+      count = 0;
+    }
+    uint32_t stored_size = entry.deleted_ ? LSM_TOMBSTONE : size;
+    memcpy(page + used, &entry.key_, sizeof(int64_t));
+    memcpy(page + used + 8, &stored_size, sizeof(uint32_t));
+    memcpy(page + used + LSM_RECORD_HEADER_SIZE, entry.row_.data(), size);
+    used += LSM_RECORD_HEADER_SIZE + size;
+    ++count;
+    ++run->count_;
+    run->max_key_ = entry.key_;
+    run->bloom_.Add(entry.key_);
+  }
+  if (page == nullptr)
+    return nullptr;
+  page_id_t next_page_id = INVALID_PAGE_ID;
+  memcpy(page, &next_page_id, sizeof(page_id_t));
+  memcpy(page + LSM_COUNT_OFFSET, &count, sizeof(uint32_t));
+  write_pages();
+  return run;
+}
+
+/*****************************************************************************
+ * ITERATOR
+ *****************************************************************************/
+LsmTree::Iterator::Iterator(LsmTree *tree, int64_t low, int64_t high)
+    : buffer_pool_manager_(tree->buffer_pool_manager_), low_(low),
+      high_(high), tombstones_(false) {
+  std::vector<std::shared_ptr<LsmRun>> runs;
+  {
+    std::lock_guard<std::mutex> guard(tree->latch_);
+    sources_.emplace_back();
+    sources_.back().entries_ = Entries(tree->memtable_, low, high);
+    if (tree->frozen_ != nullptr) {
+      sources_.emplace_back();
+      sources_.back().entries_ = Entries(*tree->frozen_, low, high);
+    }
+    runs = tree->runs_;
+  }
+  for (auto &run : runs) {
+    sources_.emplace_back();
+    sources_.back().run_ = run;
+    sources_.back().page_ = FindPage(*run, low);
+  }
+  Next();
+}
+
+LsmTree::Iterator::Iterator(BufferPoolManager *buffer_pool_manager,
+                            std::vector<std::vector<LsmEntry>> &&memtables,
+                            const std::vector<std::shared_ptr<LsmRun>> &runs,
+                            int64_t low, int64_t high, bool tombstones)
+    : buffer_pool_manager_(buffer_pool_manager), low_(low), high_(high),
+      tombstones_(tombstones) {
+  for (auto &memtable : memtables) {
+    sources_.emplace_back();
+    sources_.back().entries_ = std::move(memtable);
+  }
+  for (auto &run : runs) {
+    sources_.emplace_back();
+    sources_.back().run_ = run;
+    sources_.back().page_ = FindPage(*run, low);
+  }
+  Next();
+}
+
+/*
+ * A run is read from the page the low key is on, pages past the high key
+ * are not read
+ */
+void LsmTree::Iterator::Fill(Source &source) {
+  LsmRun *run = source.run_.get();
+  if (run == nullptr)
+    return;
+  while (source.position_ >= source.entries_.size() &&
+         source.page_ < run->page_ids_.size() &&
+         run->first_keys_[source.page_] <= high_) {
+    page_id_t page_id = run->page_ids_[source.page_++];
+    Page *page = buffer_pool_manager_->FetchPage(page_id);
+    if (page == nullptr)
+      throw Exception(EXCEPTION_TYPE_INDEX, "all page are pinned");
+    const char *data = page->GetData();
+    uint32_t count;
+    memcpy(&count, data + LSM_COUNT_OFFSET, sizeof(uint32_t));
+    source.entries_.clear();
+    source.position_ = 0;
+    const char *record = data + LSM_PAGE_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+      LsmEntry entry;
+      uint32_t size;
+      memcpy(&entry.key_, record, sizeof(int64_t));
+      memcpy(&size, record + 8, sizeof(uint32_t));
+      entry.deleted_ = size == LSM_TOMBSTONE;
+      if (entry.deleted_)
+        size = 0;
+      if (entry.key_ >= low_ && entry.key_ <= high_) {
+        entry.row_.assign(record + LSM_RECORD_HEADER_SIZE, size);
+        source.entries_.push_back(std::move(entry));
+      }
+      record += LSM_RECORD_HEADER_SIZE + size;
+    }
+    buffer_pool_manager_->UnpinPage(page_id, false);
+  }
+}
+
+/*
+ * The smallest key of the sources, the entry of the newest source having it
+ * shadows the others
+ */
+void LsmTree::Iterator::Next() {
+  while (true) {
+    Source *newest = nullptr;
+    int64_t key = 0;
+    for (auto &source : sources_) {
+      Fill(source);
+      if (source.position_ >= source.entries_.size())
+        continue;
+      int64_t source_key = source.entries_[source.position_].key_;
+      if (newest == nullptr || source_key < key) {
+        newest = &source;
+        key = source_key;
+      }
+    }
+    if (newest == nullptr) {
+      end_ = true;
+      return;
+    }
+    entry_ = std::move(newest->entries_[newest->position_]);
+    for (auto &source : sources_)
+      if (source.position_ < source.entries_.size() &&
+          source.entries_[source.position_].key_ == key)
+        ++source.position_;
+    if (tombstones_ || !entry_.deleted_)
+      return;
+  }
+}
+
+} // namespace cmudb
@@ -0,0 +1,196 @@
+/**
+ * parallel_scan.cpp
+ */
+
+#include <algorithm>
+#include <cassert>
+
+#include "table/parallel_scan.h"
+
+namespace cmudb {
+
+ParallelTableScan::ParallelTableScan(TableHeap *table_heap, Transaction *txn,
+                                     size_t threads, size_t morsel_pages)
+    : ParallelTableScan(std::vector<TableHeap *>{table_heap}, txn, threads,
+                        morsel_pages) {}
+
+ParallelTableScan::ParallelTableScan(
+    const std::vector<TableHeap *> &table_heaps, Transaction *txn,
+    size_t threads, size_t morsel_pages)
+    : table_heaps_(table_heaps), txn_(txn), threads_(threads),
+      morsel_pages_(std::max<size_t>(morsel_pages, 1)) {
+  assert(!table_heaps_.empty());
+  if (threads_ == 0)
+    threads_ = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<page_id_t> page_ids;
+  for (auto table_heap : table_heaps_) {
+    page_ids.clear();
+    table_heap->GetPageIds(page_ids);
+    page_ids_.insert(page_ids_.end(), page_ids.begin(), page_ids.end());
+    heap_ends_.push_back(page_ids_.size());
+  }
+}
+
+ParallelTableScan::~ParallelTableScan() {
+  {
+    std::lock_guard<std::mutex> guard(queue_latch_);
+    stop_ = true;
+  }
+  free_cv_.notify_all();
+  for (auto &worker : workers_)
+    worker.join();
+}
+
+void ParallelTableScan::Run(
+    const std::vector<RowBatch *> &batches,
+    const std::function<void(RowBatch &, size_t)> &consume) {
+  assert(batches.size() >= threads_ && workers_.empty());
+  consume_ = consume;
+  for (size_t i = 1; i < threads_; ++i)
+    workers_.emplace_back(&ParallelTableScan::Worker, this, i, batches[i]);
+  Worker(0, batches[0]);
+  for (auto &worker : workers_)
+    worker.join();
+  workers_.clear();
+  consume_ = nullptr;
+}
+
+void ParallelTableScan::Start(const std::vector<RowBatch *> &batches) {
+  assert(batches.size() >= threads_ && workers_.empty());
+  running_ = threads_;
+  free_.assign(batches.begin() + threads_, batches.end());
+  for (size_t i = 0; i < threads_; ++i)
+    workers_.emplace_back(&ParallelTableScan::Worker, this, i, batches[i]);
+}
+
+RowBatch *ParallelTableScan::Next(RowBatch *done) {
+  std::unique_lock<std::mutex> lock(queue_latch_);
+  if (done != nullptr) {
+    free_.push_back(done);
+    free_cv_.notify_one();
+  }
+  ready_cv_.wait(lock, [this] { return !ready_.empty() || running_ == 0; });
+  if (ready_.empty())
+    return nullptr;
+  RowBatch *batch = ready_.front();
+  ready_.pop_front();
+  return batch;
+}
+
+/*
+ * Morsels are read ahead as a whole when the morsels of every worker fit in
+ * a quarter of the pool
+ */
+bool ParallelTableScan::NextMorsel(
+    size_t &begin, size_t &end, const std::vector<BatchPredicate> &predicates) {
+  if (stop_)
+    return false;
+  begin = next_page_.fetch_add(morsel_pages_);
+  if (begin >= page_ids_.size())
+    return false;
+  end = std::min(begin + morsel_pages_, page_ids_.size());
+  BufferPoolManager *buffer_pool_manager =
+      table_heaps_[0]->buffer_pool_manager_;
+  page_id_t next_page_id;
+  if (morsel_pages_ * threads_ <= buffer_pool_manager->GetPoolSize() / 4)
+    for (size_t i = begin + 1; i < end; ++i) {
+      ZoneMap *zone_map = GetHeap(i)->zone_map_;
+      if (zone_map == nullptr ||
+          !zone_map->CanSkip(page_ids_[i], predicates, next_page_id))
+        buffer_pool_manager->PrefetchPage(page_ids_[i]);
+    }
+  return true;
+}
+
+void ParallelTableScan::Worker(size_t worker, RowBatch *batch) {
+  BufferPoolManager *buffer_pool_manager =
+      table_heaps_[0]->buffer_pool_manager_;
+  batch->Reset();
+  // the same in every batch of the scan
+  std::vector<BatchPredicate> predicates(batch->GetPredicates());
+  size_t begin, end;
+  page_id_t next_page_id;
+  while (batch != nullptr && NextMorsel(begin, end, predicates)) {
+    for (size_t i = begin; i < end && batch != nullptr; ++i) {
+      TableHeap *table_heap = GetHeap(i);
+      ZoneMap *zone_map = table_heap->zone_map_;
+      if (zone_map != nullptr &&
+          !table_heap->HasSnapshotVersions(page_ids_[i], txn_) &&
+          zone_map->CanSkip(page_ids_[i], predicates, next_page_id))
+        continue;
+      int slot = 0;
+      bool done = false;
+      while (!done && batch != nullptr) {
+        auto page = static_cast<TablePage *>(
+            buffer_pool_manager->FetchPage(page_ids_[i]));
+        if (page == nullptr) {
+          // the rest of the table can not be read, give up the whole scan
+          {
+            std::lock_guard<std::mutex> guard(txn_latch_);
+            if (txn_ != nullptr)
+              txn_->SetState(TransactionState::ABORTED);
+          }
+          {
+            std::lock_guard<std::mutex> guard(queue_latch_);
+            stop_ = true;
+          }
+          free_cv_.notify_all();
+          break;
+        }
+        page->RLatch();
+        if (slot == 0 && zone_map != nullptr)
+          zone_map->Build(page);
+        RID blocked;
+        done = page->ScanBatch(slot, *batch, txn_, table_heap->lock_manager_,
+                               &txn_latch_, table_heap->GetFirstPageId(),
+                               &blocked);
+        page->RUnlatch();
+        buffer_pool_manager->UnpinPage(page_ids_[i], false);
+        if (blocked.GetPageId() != INVALID_PAGE_ID) {
+          std::lock_guard<std::mutex> guard(txn_latch_);
+          table_heap->LockTuple(blocked, txn_);
+        }
+        if (batch->IsFull())
+          batch = Emit(worker, batch);
+      }
+    }
+  }
+  if (batch != nullptr && batch->GetSelectedCount() > 0 && !stop_) {
+    if (consume_ != nullptr) {
+      consume_(*batch, worker);
+    } else {
+      std::lock_guard<std::mutex> guard(queue_latch_);
+      ready_.push_back(batch);
+      batch = nullptr;
+    }
+  }
+  if (consume_ == nullptr) {
+    std::lock_guard<std::mutex> guard(queue_latch_);
+    if (batch != nullptr)
+      free_.push_back(batch);
+    --running_;
+    ready_cv_.notify_all();
+  }
+}
+
+RowBatch *ParallelTableScan::Emit(size_t worker, RowBatch *batch) {
+  if (batch->GetSelectedCount() == 0 || consume_ != nullptr) {
+    if (batch->GetSelectedCount() > 0)
+      consume_(*batch, worker);
+    batch->Reset();
+    return batch;
+  }
+  std::unique_lock<std::mutex> lock(queue_latch_);
+  ready_.push_back(batch);
+  ready_cv_.notify_one();
+  free_cv_.wait(lock, [this] { return stop_ || !free_.empty(); });
+  if (stop_)
+    return nullptr;
+  batch = free_.front();
+  free_.pop_front();
+  lock.unlock();
+  batch->Reset();
+  return batch;
+}
+
+} // namespace cmudb
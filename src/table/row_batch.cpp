@@ -0,0 +1,371 @@
+/**
+ * row_batch.cpp
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <functional>
+
+#include "table/row_batch.h"
+#include "table/tuple.h"
+#include "type/limits.h"
+
+namespace cmudb {
+
+// a varchar column holds offset and length into varlen_
+#define VARLEN_ENTRY_SIZE (2 * sizeof(uint32_t))
+
+RowBatch::RowBatch(Schema *schema, uint32_t capacity)
+    : schema_(schema), capacity_(capacity), rids_(capacity),
+      tuples_(capacity), slots_(capacity) {
+  for (int i = 0; i < schema->GetColumnCount(); i++) {
+    uint32_t width = schema->IsInlined(i)
+                         ? Type::GetTypeSize(schema->GetType(i))
+                         : VARLEN_ENTRY_SIZE;
+    widths_.push_back(width);
+    columns_.push_back(new char[capacity * width]);
+  }
+  selection_.reserve(capacity);
+  SplitColumns();
+}
+
+RowBatch::~RowBatch() {
+  for (auto column : columns_)
+    delete[] column;
+}
+
+void RowBatch::Reset() {
+  size_ = 0;
+  varlen_.clear();
+  selection_.clear();
+  pending_ = 0;
+}
+
+void RowBatch::SetProjection(uint64_t columns) {
+  projection_ = columns;
+  SplitColumns();
+}
+
+void RowBatch::SetPredicates(const std::vector<BatchPredicate> &predicates) {
+  predicates_ = predicates;
+  SplitColumns();
+}
+
+/*
+ * Without predicates every projected column is copied on append, there is
+ * nothing to filter first
+ */
+void RowBatch::SplitColumns() {
+  int count = schema_->GetColumnCount();
+  std::vector<bool> eager(count, false);
+  for (auto &predicate : predicates_)
+    eager[predicate.column_] = true;
+  eager_.clear();
+  late_.clear();
+  for (int i = 0; i < count; i++) {
+    uint64_t bit = static_cast<uint64_t>(1) << std::min(i, 63);
+    bool projected = projection_ & bit;
+    if (eager[i] || (projected && predicates_.empty()))
+      eager_.push_back(i);
+    else if (projected)
+      late_.push_back(i);
+  }
+}
+
+void RowBatch::CopyColumn(int column, uint32_t row) {
+  const ColumnAccess &access = schema_->GetAccess(column);
+  const char *data = tuples_[row];
+  const char *src = minipages_ == nullptr
+                        ? data + access.offset_
+                        : minipages_[column] + slots_[row] * access.width_;
+  char *dst = columns_[column] + row * widths_[column];
+  if (access.inlined_) {
+    memcpy(dst, src, widths_[column]);
+    return;
+  }
+  // the column holds the offset of [length][bytes] within the tuple
+  const char *varlen = data + *reinterpret_cast<const int32_t *>(src);
+  uint32_t len = *reinterpret_cast<const uint32_t *>(varlen);
+  uint32_t offset = varlen_.size();
+  // a value out of line is copied as the page its chain starts at
+  uint32_t bytes = IsOverflowLength(len) ? sizeof(page_id_t) : len;
+  if (len != PELOTON_VALUE_NULL)
+    varlen_.insert(varlen_.end(), varlen + sizeof(uint32_t),
+                   varlen + sizeof(uint32_t) + bytes);
+  memcpy(dst, &offset, sizeof(uint32_t));
+  memcpy(dst + sizeof(uint32_t), &len, sizeof(uint32_t));
+}
+
+void RowBatch::AppendTuple(const char *data, const RID &rid) {
+  assert(!IsFull() && minipages_ == nullptr);
+  tuples_[size_] = data;
+  for (int column : eager_)
+    CopyColumn(column, size_);
+  rids_[size_] = rid;
+  selection_.push_back(size_++);
+}
+
+// the columns are copied by Materialize, one minipage at a time
+void RowBatch::AppendSlot(uint32_t slot, const char *varlen, const RID &rid) {
+  assert(!IsFull() && minipages_ != nullptr);
+  tuples_[size_] = varlen;
+  slots_[size_] = slot;
+  rids_[size_] = rid;
+  selection_.push_back(size_++);
+}
+
+template <typename T>
+static void GatherColumn(char *column, const char *minipage,
+                         const std::vector<uint32_t> &slots,
+                         const std::vector<uint32_t> &rows, size_t from) {
+  T *dst = reinterpret_cast<T *>(column);
+  const T *src = reinterpret_cast<const T *>(minipage);
+  for (size_t i = from; i < rows.size(); i++)
+    dst[rows[i]] = src[slots[rows[i]]];
+}
+
+void RowBatch::CopyMinipage(int column, size_t from) {
+  if (!schema_->GetAccess(column).inlined_) {
+    for (size_t i = from; i < selection_.size(); i++)
+      CopyColumn(column, selection_[i]);
+    return;
+  }
+  switch (widths_[column]) {
+  case 1:
+    GatherColumn<int8_t>(columns_[column], minipages_[column], slots_,
+                         selection_, from);
+    break;
+  case 2:
+    GatherColumn<int16_t>(columns_[column], minipages_[column], slots_,
+                          selection_, from);
+    break;
+  case 4:
+    GatherColumn<int32_t>(columns_[column], minipages_[column], slots_,
+                          selection_, from);
+    break;
+  case 8:
+    GatherColumn<int64_t>(columns_[column], minipages_[column], slots_,
+                          selection_, from);
+    break;
+  default:
+    for (size_t i = from; i < selection_.size(); i++)
+      CopyColumn(column, selection_[i]);
+  }
+}
+
+void RowBatch::Materialize() {
+  if (minipages_ != nullptr)
+    for (int column : eager_)
+      CopyMinipage(column, pending_);
+  for (auto &predicate : predicates_)
+    Filter(predicate, pending_);
+  if (minipages_ != nullptr) {
+    for (int column : late_)
+      CopyMinipage(column, pending_);
+  } else {
+    for (size_t i = pending_; i < selection_.size(); i++) {
+      uint32_t row = selection_[i];
+      for (int column : late_)
+        CopyColumn(column, row);
+    }
+  }
+  pending_ = selection_.size();
+  minipages_ = nullptr;
+}
+
+const char *RowBatch::GetVarchar(int column, uint32_t row,
+                                 uint32_t &len) const {
+  const char *entry = GetFixed(column, row);
+  len = *reinterpret_cast<const uint32_t *>(entry + sizeof(uint32_t));
+  if (len == PELOTON_VALUE_NULL)
+    return nullptr;
+  return varlen_.data() + *reinterpret_cast<const uint32_t *>(entry);
+}
+
+Value RowBatch::GetValue(int column, uint32_t row) const {
+  TypeId type = schema_->GetType(column);
+  if (schema_->IsInlined(column))
+    return Value::DeserializeFrom(GetFixed(column, row), type);
+  uint32_t len;
+  const char *data = GetVarchar(column, row, len);
+  if (data == nullptr)
+    return Value(type, nullptr, PELOTON_VALUE_NULL, false);
+  assert(!IsOverflowLength(len));
+  return Value(type, data, len, true);
+}
+
+/*
+ * Keep the selected rows of a fixed size column whose value v, widened to
+ * the type of the constant, has compare(v, constant). Nulls never match.
+ */
+template <typename T, typename C, typename Compare>
+static void FilterWith(const char *column, T null_value, C constant,
+                       Compare compare, std::vector<uint32_t> &selection,
+                       size_t from) {
+  const T *values = reinterpret_cast<const T *>(column);
+  size_t kept = from;
+  for (size_t i = from; i < selection.size(); i++) {
+    uint32_t row = selection[i];
+    T value = values[row];
+    if (value != null_value && compare(static_cast<C>(value), constant))
+      selection[kept++] = row;
+  }
+  selection.resize(kept);
+}
+
+template <typename T, typename C>
+static void FilterFixed(const char *column, T null_value, C constant,
+                        CompareType type, std::vector<uint32_t> &selection,
+                        size_t from) {
+  switch (type) {
+  case CompareType::EQ:
+    FilterWith(column, null_value, constant, std::equal_to<C>(), selection,
+               from);
+    break;
+  case CompareType::NE:
+    FilterWith(column, null_value, constant, std::not_equal_to<C>(),
+               selection, from);
+    break;
+  case CompareType::LT:
+    FilterWith(column, null_value, constant, std::less<C>(), selection,
+               from);
+    break;
+  case CompareType::LE:
+    FilterWith(column, null_value, constant, std::less_equal<C>(),
+               selection, from);
+    break;
+  case CompareType::GT:
+    FilterWith(column, null_value, constant, std::greater<C>(), selection,
+               from);
+    break;
+  case CompareType::GE:
+    FilterWith(column, null_value, constant, std::greater_equal<C>(),
+               selection, from);
+    break;
+  }
+}
+
+// the constant is compared as a double if either side is a decimal
+template <typename T>
+static void FilterNumeric(const char *column, T null_value, bool is_decimal,
+                          const Value &value, CompareType type,
+                          std::vector<uint32_t> &selection, size_t from) {
+  int64_t integer = 0;
+  double decimal = 0;
+  switch (value.GetTypeId()) {
+  case TypeId::BOOLEAN:
+  case TypeId::TINYINT:
+    integer = value.GetAs<int8_t>();
+    break;
+  case TypeId::SMALLINT:
+    integer = value.GetAs<int16_t>();
+    break;
+  case TypeId::INTEGER:
+    integer = value.GetAs<int32_t>();
+    break;
+  case TypeId::BIGINT:
+    integer = value.GetAs<int64_t>();
+    break;
+  case TypeId::DECIMAL:
+    is_decimal = true;
+    decimal = value.GetAs<double>();
+    break;
+  default:
+    return;
+  }
+  if (!is_decimal)
+    FilterFixed(column, null_value, integer, type, selection, from);
+  else
+    FilterFixed(column, null_value,
+                value.GetTypeId() == TypeId::DECIMAL
+                    ? decimal
+                    : static_cast<double>(integer),
+                type, selection, from);
+}
+
+static bool CompareVarchar(const char *data, uint32_t len,
+                           const std::string &constant, CompareType type) {
+  // the stored length counts the terminating null byte
+  len = strnlen(data, len);
+  int cmp =
+      memcmp(data, constant.data(), std::min<size_t>(len, constant.size()));
+  if (cmp == 0)
+    cmp = (len > constant.size()) - (len < constant.size());
+  switch (type) {
+  case CompareType::EQ:
+    return cmp == 0;
+  case CompareType::NE:
+    return cmp != 0;
+  case CompareType::LT:
+    return cmp < 0;
+  case CompareType::LE:
+    return cmp <= 0;
+  case CompareType::GT:
+    return cmp > 0;
+  case CompareType::GE:
+    return cmp >= 0;
+  }
+  return false;
+}
+
+/*
+ * Predicates between a varchar and a number are not evaluated here, every
+ * row is kept and left to the caller.
+ */
+void RowBatch::Filter(const BatchPredicate &predicate, size_t from) {
+  int column = predicate.column_;
+  const char *data = columns_[column];
+  const Value &value = predicate.value_;
+  if (value.IsNull()) {
+    selection_.resize(from);
+    return;
+  }
+
+  switch (schema_->GetType(column)) {
+  case TypeId::BOOLEAN:
+  case TypeId::TINYINT:
+    FilterNumeric(data, PELOTON_INT8_NULL, false, value, predicate.type_,
+                  selection_, from);
+    break;
+  case TypeId::SMALLINT:
+    FilterNumeric(data, PELOTON_INT16_NULL, false, value, predicate.type_,
+                  selection_, from);
+    break;
+  case TypeId::INTEGER:
+    FilterNumeric(data, PELOTON_INT32_NULL, false, value, predicate.type_,
+                  selection_, from);
+    break;
+  case TypeId::BIGINT:
+    FilterNumeric(data, PELOTON_INT64_NULL, false, value, predicate.type_,
+                  selection_, from);
+    break;
+  case TypeId::DECIMAL:
+    FilterNumeric(data, PELOTON_DECIMAL_NULL, true, value, predicate.type_,
+                  selection_, from);
+    break;
+  case TypeId::VARCHAR: {
+    if (value.GetTypeId() != TypeId::VARCHAR)
+      break;
+    std::string constant(value.GetData(),
+                         strnlen(value.GetData(), value.GetLength()));
+    size_t kept = from;
+    for (size_t i = from; i < selection_.size(); i++) {
+      uint32_t row = selection_[i];
+      uint32_t len;
+      const char *str = GetVarchar(column, row, len);
+      // a value out of line is not read here, the caller checks it again
+      if (str != nullptr &&
+          (IsOverflowLength(len) ||
+           CompareVarchar(str, len, constant, predicate.type_)))
+        selection_[kept++] = row;
+    }
+    selection_.resize(kept);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+} // namespace cmudb
@@ -0,0 +1,202 @@
+/**
+ * row_cache.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/epoch.h"
+#include "table/row_cache.h"
+
+namespace cmudb {
+
+RowCache::RowCache(size_t capacity) {
+  shard_capacity_ =
+      std::max<size_t>((capacity + ROW_CACHE_SHARDS - 1) / ROW_CACHE_SHARDS, 1);
+  size_t buckets = 1;
+  while (buckets < shard_capacity_)
+    buckets <<= 1;
+  bucket_mask_ = buckets - 1;
+  for (Shard &shard : shards_) {
+    shard.buckets_ = new std::atomic<Entry *>[buckets];
+    for (size_t i = 0; i < buckets; ++i)
+      shard.buckets_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+RowCache::~RowCache() {
+  for (Shard &shard : shards_) {
+    while (shard.hand_ != nullptr) {
+      Entry *entry = shard.hand_;
+      shard.hand_ = entry->ring_next_ == entry ? nullptr : entry->ring_next_;
+      entry->prev_->ring_next_ = entry->ring_next_;
+      entry->ring_next_->prev_ = entry->prev_;
+      delete entry;
+    }
+    for (Entry *entry : shard.retired_)
+      delete entry;
+    delete[] shard.buckets_;
+  }
+}
+
+/*
+ * The entry found stays allocated until the epoch is left, the caller holds
+ * the lock of rid so it is not invalidated meanwhile
+ */
+bool RowCache::Get(const RID &rid, Tuple &tuple) {
+  Shard &shard = GetShard(rid);
+  Epoch::Enter();
+  Entry *entry = GetBucket(shard, rid).load(std::memory_order_acquire);
+  while (entry != nullptr && !(entry->rid_ == rid))
+    entry = entry->next_.load(std::memory_order_acquire);
+  if (entry != nullptr) {
+    if (!entry->referenced_.load(std::memory_order_relaxed))
+      entry->referenced_.store(true, std::memory_order_relaxed);
+    tuple.Reserve(entry->size_);
+    memcpy(tuple.data_, entry->data_, entry->size_);
+    tuple.size_ = entry->size_;
+    tuple.rid_ = rid;
+  }
+  Epoch::Exit();
+  if (entry == nullptr) {
+    shard.misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  shard.hits_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool RowCache::Contains(const RID &rid) {
+  Shard &shard = GetShard(rid);
+  Epoch::Enter();
+  Entry *entry = GetBucket(shard, rid).load(std::memory_order_acquire);
+  while (entry != nullptr && !(entry->rid_ == rid))
+    entry = entry->next_.load(std::memory_order_acquire);
+  Epoch::Exit();
+  return entry != nullptr;
+}
+
+/*
+ * The entry is filled before it is published at the head of its chain. A
+ * full shard first evicts the entry at the hand not referenced since the
+ * hand last passed it
+ */
+void RowCache::Put(const RID &rid, const Tuple &tuple, uint64_t generation) {
+  Shard &shard = GetShard(rid);
+  std::vector<Entry *> retired;
+  {
+    std::lock_guard<std::mutex> guard(shard.latch_);
+    if (shard.generation_.load(std::memory_order_relaxed) != generation)
+      return;
+    std::atomic<Entry *> &bucket = GetBucket(shard, rid);
+    for (Entry *entry = bucket.load(std::memory_order_relaxed);
+         entry != nullptr; entry = entry->next_.load(std::memory_order_relaxed))
+      if (entry->rid_ == rid)
+        return;
+    while (shard.count_ >= shard_capacity_) {
+      Entry *victim = shard.hand_;
+      shard.hand_ = victim->ring_next_;
+      if (victim->referenced_.load(std::memory_order_relaxed))
+        victim->referenced_.store(false, std::memory_order_relaxed);
+      else
+        Remove(shard, victim);
+    }
+    Entry *entry = new Entry;
+    entry->rid_ = rid;
+    entry->size_ = tuple.GetLength();
+    entry->data_ = new char[entry->size_];
+    memcpy(entry->data_, tuple.GetData(), entry->size_);
+    entry->referenced_.store(false, std::memory_order_relaxed);
+    // behind the hand, the last one it reaches
+    if (shard.hand_ == nullptr) {
+      entry->prev_ = entry->ring_next_ = entry;
+      shard.hand_ = entry;
+    } else {
+      entry->ring_next_ = shard.hand_;
+      entry->prev_ = shard.hand_->prev_;
+      entry->prev_->ring_next_ = entry;
+      shard.hand_->prev_ = entry;
+    }
+    entry->next_.store(bucket.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+    bucket.store(entry, std::memory_order_release);
+    ++shard.count_;
+    if (shard.retired_.size() >= ROW_CACHE_RETIRE_BATCH)
+      retired.swap(shard.retired_);
+  }
+  Reclaim(retired);
+}
+
+void RowCache::Invalidate(const RID &rid) {
+  Shard &shard = GetShard(rid);
+  std::vector<Entry *> retired;
+  {
+    std::lock_guard<std::mutex> guard(shard.latch_);
+    shard.generation_.fetch_add(1, std::memory_order_release);
+    for (Entry *entry = GetBucket(shard, rid).load(std::memory_order_relaxed);
+         entry != nullptr;
+         entry = entry->next_.load(std::memory_order_relaxed)) {
+      if (entry->rid_ == rid) {
+        Remove(shard, entry);
+        break;
+      }
+    }
+    if (shard.retired_.size() >= ROW_CACHE_RETIRE_BATCH)
+      retired.swap(shard.retired_);
+  }
+  Reclaim(retired);
+}
+
+/*
+ * A reader on the entry still finds the rest of the chain through its next
+ */
+void RowCache::Remove(Shard &shard, Entry *entry) {
+  std::atomic<Entry *> *link = &GetBucket(shard, entry->rid_);
+  while (link->load(std::memory_order_relaxed) != entry)
+    link = &link->load(std::memory_order_relaxed)->next_;
+  link->store(entry->next_.load(std::memory_order_relaxed),
+              std::memory_order_release);
+  if (entry->ring_next_ == entry) {
+    shard.hand_ = nullptr;
+  } else {
+    if (shard.hand_ == entry)
+      shard.hand_ = entry->ring_next_;
+    entry->prev_->ring_next_ = entry->ring_next_;
+    entry->ring_next_->prev_ = entry->prev_;
+  }
+  --shard.count_;
+  shard.retired_.push_back(entry);
+}
+
+void RowCache::Reclaim(std::vector<Entry *> &retired) {
+  if (retired.empty())
+    return;
+  Epoch::Synchronize();
+  for (Entry *entry : retired)
+    delete entry;
+}
+
+uint64_t RowCache::GetHits() {
+  uint64_t hits = 0;
+  for (Shard &shard : shards_)
+    hits += shard.hits_.load(std::memory_order_relaxed);
+  return hits;
+}
+
+uint64_t RowCache::GetMisses() {
+  uint64_t misses = 0;
+  for (Shard &shard : shards_)
+    misses += shard.misses_.load(std::memory_order_relaxed);
+  return misses;
+}
+
+size_t RowCache::GetSize() {
+  size_t size = 0;
+  for (Shard &shard : shards_) {
+    std::lock_guard<std::mutex> guard(shard.latch_);
+    size += shard.count_;
+  }
+  return size;
+}
+
+} // namespace cmudb
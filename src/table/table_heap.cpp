@@ -2,77 +2,180 @@
  * table_heap.cpp
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 #include "common/logger.h"
 #include "table/table_heap.h"
 
 namespace cmudb {
 
+namespace {
+
+// threads take insert target slots in turn as they first insert
+std::atomic<size_t> next_target(0);
+// threads that exited so far, by slot
+std::atomic<uint64_t> target_leaves[INSERT_TARGETS];
+
+// counts the thread out of its slot as it exits
+struct InsertTargetHolder {
+  size_t target_;
+
+  InsertTargetHolder()
+      : target_(next_target.fetch_add(1, std::memory_order_relaxed) %
+                INSERT_TARGETS) {}
+
+  ~InsertTargetHolder() {
+    target_leaves[target_].fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+} // namespace
+
 TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager,
-                     LockManager *lock_manager, page_id_t first_page_id)
+                     LockManager *lock_manager, LogManager *log_manager,
+                     page_id_t first_page_id, page_id_t fsm_page_id,
+                     const PaxLayout &layout, int tablespace_id)
     : buffer_pool_manager_(buffer_pool_manager), lock_manager_(lock_manager),
-      first_page_id_(first_page_id) {
+      log_manager_(log_manager), first_page_id_(first_page_id),
+      extent_(buffer_pool_manager->GetDiskManager(), tablespace_id),
+      layout_(layout), fsm_page_id_(fsm_page_id) {
+  for (auto &target : insert_targets_)
+    target.store(INVALID_PAGE_ID, std::memory_order_relaxed);
+  for (auto &stamp : target_stamps_)
+    stamp.store(0, std::memory_order_relaxed);
   if (first_page_id_ == INVALID_PAGE_ID) {
-    auto first_page =
-        static_cast<TablePage *>(buffer_pool_manager_->NewPage(first_page_id_));
+    auto first_page = static_cast<TablePage *>(
+        buffer_pool_manager_->NewPage(first_page_id_, extent_));
     assert(first_page != nullptr); // todo: abort table creation?
     first_page->WLatch();
-    LOG_DEBUG("new table page created %d", first_page_id_);
+    LOG_DEBUG("new table page created %lld",
+              static_cast<long long>(first_page_id_));
 
-    first_page->Init(first_page_id_, PAGE_SIZE);
+    first_page->Init(first_page_id_, PAGE_SIZE, INVALID_PAGE_ID,
+                     INVALID_PAGE_ID, nullptr, nullptr, layout_);
     first_page->WUnlatch();
     buffer_pool_manager_->UnpinPage(first_page_id_, true);
+    fsm_page_id_ = INVALID_PAGE_ID;
+  } else {
+    auto first_page = static_cast<TablePage *>(
+        buffer_pool_manager_->FetchPage(first_page_id_));
+    assert(first_page != nullptr);
+    first_page->RLatch();
+    first_page->GetPaxLayout(layout_);
+    first_page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(first_page_id_, false);
   }
+  // header and one slot, or the varchar space of a PAX page
+  if (layout_.IsPax())
+    max_tuple_size_ =
+        PAGE_SIZE - layout_.GetMinipageEnd() + layout_.GetFixedLength();
+  else
+    max_tuple_size_ = PAGE_SIZE - TABLE_PAGE_HEADER_SIZE - 8;
+  if (fsm_page_id_ == INVALID_PAGE_ID)
+    CreateFreeSpaceMap();
+  else
+    LoadFreeSpaceMap();
 }
 
-bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
-  if (tuple.size_ + 28 > PAGE_SIZE) { // larger than one page size
+bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn,
+                            page_id_t near_page_id) {
+  Tuple stored;
+  const Tuple *row = MoveOutOfLine(tuple, stored, txn, max_tuple_size_);
+  if (row == nullptr || row->size_ > max_tuple_size_) { // larger than a page
+    if (row != nullptr)
+      DropChains(*row, &tuple);
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
+  if (InsertStored(row, rid, txn, near_page_id))
+    return true;
+  DropChains(*row, &tuple);
+  return false;
+}
 
-  auto cur_page =
-      static_cast<TablePage *>(buffer_pool_manager_->FetchPage(first_page_id_));
-  if (cur_page == nullptr) {
+bool TableHeap::InsertStored(const Tuple *row, RID &rid, Transaction *txn,
+                             page_id_t near_page_id) {
+  if (near_page_id != INVALID_PAGE_ID) {
+    if (InsertIntoPage(near_page_id, &row, 1, &rid, txn) == 1)
+      return true;
+    if (txn->GetState() == TransactionState::ABORTED)
+      return false;
+  }
+
+  // the insertion target of this thread first, concurrent inserts go to
+  // pages of their own instead of meeting on the first one with room
+  size_t target = GetInsertTarget();
+  page_id_t page_id = insert_targets_[target].load(std::memory_order_relaxed);
+  if (page_id != INVALID_PAGE_ID) {
+    if (InsertIntoPage(page_id, &row, 1, &rid, txn, true) == 1)
+      return true;
+    if (txn->GetState() == TransactionState::ABORTED)
+      return false;
+  }
+
+  // tuple data plus one new slot
+  int32_t required = row->size_ + 8;
+  // go straight to a page the free space map says has room, an entry can be
+  // stale if a concurrent insert got there first, then correct it and retry
+  while (FindFreePage(required, page_id)) {
+    if (InsertIntoPage(page_id, &row, 1, &rid, txn) == 1) {
+      SetInsertTarget(target, page_id);
+      return true;
+    }
+    if (txn->GetState() == TransactionState::ABORTED)
+      return false;
+  }
+
+  // no page has enough space, append a new page to the heap
+  if (InsertIntoNewPage(&row, 1, &rid, txn) == 0) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
+  SetInsertTarget(target, rid.GetPageId());
+  return true;
+}
 
-  cur_page->WLatch();
-  while (!cur_page->InsertTuple(
-      tuple, rid, txn,
-      lock_manager_)) { // fail to insert due to not enough space
-    auto next_page_id = cur_page->GetNextPageId();
-    if (next_page_id != INVALID_PAGE_ID) { // valid next page
-      cur_page->WUnlatch();
-      buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), false);
-      cur_page = static_cast<TablePage *>(
-          buffer_pool_manager_->FetchPage(next_page_id));
-      cur_page->WLatch();
-    } else { // create new page
-      auto new_page =
-          static_cast<TablePage *>(buffer_pool_manager_->NewPage(next_page_id));
-      if (new_page == nullptr) {
-        cur_page->WUnlatch();
-        buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), false);
-        txn->SetState(TransactionState::ABORTED);
-        return false;
-      }
-      new_page->WLatch();
-      // std::cout << "new table page " << next_page_id << " created" <<
-      // std::endl;
-      cur_page->SetNextPageId(next_page_id);
-      new_page->Init(next_page_id, PAGE_SIZE, cur_page->GetPageId(),
-                     INVALID_PAGE_ID);
-      cur_page->WUnlatch();
-      buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), true);
-      cur_page = new_page;
+/*
+ * Every page found is filled with as many of the tuples left as it takes,
+ * under one latch and with one free space map update
+ */
+bool TableHeap::InsertTuples(const std::vector<Tuple> &tuples,
+                             std::vector<RID> &rids, Transaction *txn) {
+  std::vector<Tuple> stored(tuples.size());
+  std::vector<const Tuple *> rows(tuples.size());
+  // the chains of the rows not inserted go back on a failure
+  size_t done = 0;
+  auto fail = [&](size_t end) {
+    for (size_t i = done; i < end; i++)
+      if (rows[i] != nullptr)
+        DropChains(*rows[i], &tuples[i]);
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  };
+  for (size_t i = 0; i < tuples.size(); i++) {
+    rows[i] = MoveOutOfLine(tuples[i], stored[i], txn, max_tuple_size_);
+    if (rows[i] == nullptr || rows[i]->size_ > max_tuple_size_)
+      return fail(i + 1);
+  }
+
+  rids.resize(tuples.size());
+  while (done < rows.size()) {
+    page_id_t page_id;
+    size_t count = rows.size() - done;
+    if (FindFreePage(rows[done]->size_ + 8, page_id)) {
+      // a stale entry is corrected and the next page tried
+      done += InsertIntoPage(page_id, &rows[done], count, &rids[done], txn);
+      if (txn->GetState() == TransactionState::ABORTED)
+        return fail(rows.size());
+      continue;
     }
+    size_t inserted = InsertIntoNewPage(&rows[done], count, &rids[done], txn);
+    if (inserted == 0)
+      return fail(rows.size());
+    done += inserted;
   }
-  cur_page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), true);
-  txn->GetWriteSet()->emplace_back(rid, WType::INSERT, Tuple{RID()}, this);
   return true;
 }
 
@@ -85,55 +188,228 @@ bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
     return false;
   }
   page->WLatch();
-  page->MarkDelete(rid, txn, lock_manager_);
+  Tuple before;
+  bool versioned =
+      IsVersioned(txn) && page->GetTuple(rid, before, nullptr, nullptr);
+  if (page->MarkDelete(rid, txn, lock_manager_, log_manager_,
+                       first_page_id_) &&
+      versioned)
+    PushVersion(rid, &before, txn);
+  if (row_cache_ != nullptr)
+    row_cache_->Invalidate(rid);
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
   txn->GetWriteSet()->emplace_back(rid, WType::DELETE, Tuple{RID()}, this);
+  txn->ChargeMemory(sizeof(WriteRecord));
   return true;
 }
 
 bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid,
                             Transaction *txn) {
+  Tuple stored;
+  const Tuple *row = MoveOutOfLine(tuple, stored, txn, max_tuple_size_);
+  if (row == nullptr) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
   auto page = reinterpret_cast<TablePage *>(
       buffer_pool_manager_->FetchPage(rid.GetPageId()));
   if (page == nullptr) {
+    DropChains(*row, &tuple);
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
   Tuple old_tuple{RID()};
   page->WLatch();
-  bool is_updated =
-      page->UpdateTuple(tuple, old_tuple, rid, txn, lock_manager_);
+  bool is_updated = page->UpdateTuple(*row, old_tuple, rid, txn,
+                                      lock_manager_, log_manager_,
+                                      first_page_id_);
+  // a tuple outgrowing its page keeps its rid with more varchars out of line
+  Tuple smaller;
+  int32_t room = page->GetUpdateRoom(rid);
+  if (!is_updated && overflow_schema_ != nullptr && room > 0 &&
+      row->size_ > room && txn->GetState() != TransactionState::ABORTED) {
+    const Tuple *first = row;
+    row = MoveOutOfLine(*first, smaller, txn, room);
+    if (row != nullptr && row->size_ <= room)
+      is_updated = page->UpdateTuple(*row, old_tuple, rid, txn,
+                                     lock_manager_, log_manager_,
+                                     first_page_id_);
+    else if (row != nullptr)
+      DropChains(*row, first);
+    row = first;
+  }
+  if (is_updated) {
+    PushVersion(rid, &old_tuple, txn);
+    UpdateFreeSpace(rid.GetPageId(), page->GetFreeSpaceSize());
+  }
+  // the zone keeps the old values, a rollback puts them back
+  if (is_updated && zone_map_ != nullptr)
+    zone_map_->Add(page, rid);
+  if (is_updated && row_cache_ != nullptr)
+    row_cache_->Invalidate(rid);
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetPageId(), is_updated);
-  if (is_updated)
+  if (!is_updated)
+    DropChains(*row, &tuple);
+  // a rollback puts back the image of a record it is undoing
+  if (is_updated && txn->GetState() != TransactionState::ABORTED) {
     txn->GetWriteSet()->emplace_back(rid, WType::UPDATE, old_tuple, this);
+    txn->ChargeMemory(sizeof(WriteRecord) + old_tuple.GetLength());
+  }
   return is_updated;
 }
 
-void TableHeap::ApplyDelete(const RID &rid, Transaction *txn) {
+void TableHeap::ApplyDelete(const RID &rid, Transaction *txn,
+                            Tuple *deleted) {
   auto page = reinterpret_cast<TablePage *>(
       buffer_pool_manager_->FetchPage(rid.GetPageId()));
   assert(page != nullptr);
   page->WLatch();
-  page->ApplyDelete(rid, txn);
-  lock_manager_->Unlock(txn, rid);
+  page->ApplyDelete(rid, txn, log_manager_,
+                    overflow_schema_ != nullptr ? deleted : nullptr);
+  if (row_cache_ != nullptr)
+    row_cache_->Invalidate(rid);
+  // rolled back to a savepoint txn keeps running, its locks go when it ends
+  if (txn->GetState() == TransactionState::COMMITTED ||
+      txn->GetState() == TransactionState::ABORTED)
+    lock_manager_->Unlock(txn, rid);
+  // mark delete keeps the bytes reserved, they are only freed here
+  UpdateFreeSpace(rid.GetPageId(), page->GetFreeSpaceSize());
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
 }
 
+bool TableHeap::RollbackUpdate(const Tuple &old_tuple, const RID &rid,
+                               Transaction *txn) {
+  // a running txn records the update putting old_tuple back, the image undone
+  // is its before image and keeps its chains
+  Tuple undone;
+  bool has_chains = overflow_schema_ != nullptr &&
+                    txn->GetState() == TransactionState::ABORTED &&
+                    GetPageImage(rid, undone);
+  if (!UpdateTuple(old_tuple, rid, txn))
+    return false;
+  if (has_chains)
+    RetireChains(undone, rid, txn);
+  return true;
+}
+
 void TableHeap::RollbackDelete(const RID &rid, Transaction *txn) {
   auto page = reinterpret_cast<TablePage *>(
       buffer_pool_manager_->FetchPage(rid.GetPageId()));
   assert(page != nullptr);
   page->WLatch();
-  page->RollbackDelete(rid, txn);
+  page->RollbackDelete(rid, txn, log_manager_);
+  if (row_cache_ != nullptr)
+    row_cache_->Invalidate(rid);
+  // a zone built while the tuple was marked deleted misses it
+  if (zone_map_ != nullptr)
+    zone_map_->Add(page, rid);
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
 }
 
 // called by tuple iterator
+TablePage *TableHeap::PinTuple(const RID &rid, TablePage *page,
+                               Transaction *txn) {
+  assert(txn == nullptr || !txn->IsSnapshot());
+  if (page == nullptr || page->GetPageId() != rid.GetPageId()) {
+    ReleaseTuplePage(page);
+    page = static_cast<TablePage *>(
+        buffer_pool_manager_->FetchPage(rid.GetPageId()));
+    if (page == nullptr) {
+      txn->SetState(TransactionState::ABORTED);
+      return nullptr;
+    }
+  }
+  page->RLatch();
+  bool res = page->LockTuple(rid, txn, lock_manager_, first_page_id_);
+  page->RUnlatch();
+  if (!res) {
+    ReleaseTuplePage(page);
+    return nullptr;
+  }
+  return page;
+}
+
+TablePage *TableHeap::PinRowid(const RID &rid, Transaction *txn) {
+  {
+    std::lock_guard<std::mutex> guard(fsm_latch_);
+    if (fsm_directory_.count(rid.GetPageId()) == 0)
+      return nullptr;
+  }
+  auto page = static_cast<TablePage *>(
+      buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  if (page == nullptr) {
+    txn->SetState(TransactionState::ABORTED);
+    return nullptr;
+  }
+  page->RLatch();
+  bool res = page->HasTuple(rid) &&
+             page->LockTuple(rid, txn, lock_manager_, first_page_id_);
+  page->RUnlatch();
+  if (!res) {
+    ReleaseTuplePage(page);
+    return nullptr;
+  }
+  return page;
+}
+
+bool TableHeap::GetRowid(const RID &rid, Tuple &tuple, Transaction *txn) {
+  {
+    std::lock_guard<std::mutex> guard(fsm_latch_);
+    if (fsm_directory_.count(rid.GetPageId()) == 0)
+      return false;
+  }
+  return GetTuple(rid, tuple, txn);
+}
+
+void TableHeap::ReleaseTuplePage(TablePage *page) {
+  if (page != nullptr)
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+}
+
+bool TableHeap::LockTuple(const RID &rid, Transaction *txn) {
+  if (lock_manager_ == nullptr || txn == nullptr || txn->IsSnapshot())
+    return true;
+  if (txn->GetExclusiveLockSet()->count(rid) != 0 ||
+      txn->GetSharedLockSet()->count(rid) != 0)
+    return true;
+  return lock_manager_->LockShared(txn, rid, first_page_id_);
+}
+
 bool TableHeap::GetTuple(const RID &rid, Tuple &tuple, Transaction *txn) {
+  return GetStoredTuple(rid, tuple, txn) && ReadOutOfLine(tuple);
+}
+
+/*
+ * A cached tuple is read once its row is locked, a writer invalidates it
+ * before the row can be locked for another. A snapshot locks nothing, the
+ * writer pushes a version before it invalidates the tuple, one without
+ * newer versions after the tuple was read saw it as the snapshot does. A
+ * tuple read from the page is cached unless the row changed since the
+ * generation read before the page
+ */
+bool TableHeap::GetStoredTuple(const RID &rid, Tuple &tuple,
+                               Transaction *txn) {
+  bool snapshot = txn != nullptr && txn->IsSnapshot();
+  bool cached = row_cache_ != nullptr;
+  uint64_t generation = 0;
+  bool exists;
+  if (cached) {
+    if (!LockTuple(rid, txn))
+      return false;
+    if (row_cache_->Get(rid, tuple)) {
+      if (!snapshot)
+        return true;
+      if (txn->GetVersionStore()->Read(first_page_id_, rid,
+                                       txn->GetReadTimestamp(), tuple, exists))
+        return exists;
+      return true;
+    }
+    generation = row_cache_->GetGeneration(rid);
+  }
   auto page = static_cast<TablePage *>(
       buffer_pool_manager_->FetchPage(rid.GetPageId()));
   if (page == nullptr) {
@@ -141,17 +417,213 @@ bool TableHeap::GetTuple(const RID &rid, Tuple &tuple, Transaction *txn) {
     return false;
   }
   page->RLatch();
-  bool res = page->GetTuple(rid, tuple, txn, lock_manager_);
+  bool res;
+  if (!snapshot) {
+    res = page->GetTuple(rid, tuple, txn, lock_manager_, first_page_id_);
+  } else if (txn->GetVersionStore()->Read(first_page_id_, rid,
+                                          txn->GetReadTimestamp(), tuple,
+                                          exists)) {
+    // a version is no image to cache
+    res = exists;
+    cached = false;
+  } else { // the page image, nothing to lock
+    res = page->GetTuple(rid, tuple, nullptr, nullptr);
+  }
   page->RUnlatch();
   buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+  if (cached && res)
+    row_cache_->Put(rid, tuple, generation);
   return res;
 }
 
 bool TableHeap::DeleteTableHeap() {
   // todo: real delete
+  for (auto &target : insert_targets_)
+    target.store(INVALID_PAGE_ID, std::memory_order_relaxed);
   return true;
 }
 
+// the last write of txn is half of a move, the chains of the tuple are
+// shared by its copy
+static inline void SetMoved(Transaction *txn) {
+  txn->GetWriteSet()->back().is_move_ = true;
+}
+
+/*
+ * The first sparse page after a page takes the tuples of the sparse pages
+ * following it as long as they fit. Moves are a delete and an insert of
+ * txn, the pages are emptied once it commits
+ */
+bool TableHeap::MergePages(Transaction *txn, const MoveCallback &moved,
+                           size_t &count) {
+  count = 0;
+  page_id_t target_page_id = INVALID_PAGE_ID;
+  page_id_t page_id = first_page_id_;
+  while (page_id != INVALID_PAGE_ID) {
+    auto page =
+        static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+    if (page == nullptr) {
+      txn->SetState(TransactionState::ABORTED);
+      return false;
+    }
+    page->RLatch();
+    bool is_sparse = page->GetFreeSpaceSize() >= MERGE_FREE_SPACE;
+    bool is_merged = is_sparse && target_page_id != INVALID_PAGE_ID;
+    std::vector<RID> rids;
+    RID rid;
+    if (is_merged && page->GetFirstTupleRid(rid)) {
+      do
+        rids.push_back(rid);
+      while (page->GetNextTupleRid(rid, rid));
+    }
+    page_id_t next_page_id = page->GetNextPageId();
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, false);
+
+    size_t merged = 0;
+    for (auto &from : rids) {
+      Tuple tuple;
+      RID to;
+      // deleted meanwhile, or txn died waiting for it. Values out of line
+      // stay where they are
+      if (!GetStoredTuple(from, tuple, txn)) {
+        if (txn->GetState() == TransactionState::ABORTED)
+          return false;
+        continue;
+      }
+      const Tuple *row = &tuple;
+      if (InsertIntoPage(target_page_id, &row, 1, &to, txn) == 0)
+        break;
+      SetMoved(txn);
+      if (!MarkDelete(from, txn) ||
+          txn->GetState() == TransactionState::ABORTED)
+        return false;
+      SetMoved(txn);
+      if (moved)
+        moved(from, to);
+      ++merged;
+    }
+    if (txn->GetState() == TransactionState::ABORTED)
+      return false;
+    count += merged;
+    // a page keeping tuples takes the ones of the sparse pages after it
+    if (!is_merged || merged < rids.size())
+      target_page_id = is_sparse ? page_id : INVALID_PAGE_ID;
+    page_id = next_page_id;
+  }
+  return true;
+}
+
+/*
+ * The tuples fill new pages one after the other, the pages they leave are
+ * emptied once txn commits
+ */
+bool TableHeap::MoveTuples(const std::vector<RID> &rids, Transaction *txn,
+                           const MoveCallback &moved, size_t &count) {
+  count = 0;
+  page_id_t target_page_id = INVALID_PAGE_ID;
+  for (auto &from : rids) {
+    Tuple tuple;
+    RID to;
+    // values out of line stay where they are
+    if (!GetStoredTuple(from, tuple, txn)) {
+      if (txn->GetState() == TransactionState::ABORTED)
+        return false;
+      continue;
+    }
+    const Tuple *row = &tuple;
+    if (target_page_id == INVALID_PAGE_ID ||
+        InsertIntoPage(target_page_id, &row, 1, &to, txn) == 0) {
+      if (txn->GetState() == TransactionState::ABORTED)
+        return false;
+      if (InsertIntoNewPage(&row, 1, &to, txn) == 0) {
+        txn->SetState(TransactionState::ABORTED);
+        return false;
+      }
+      target_page_id = to.GetPageId();
+    }
+    SetMoved(txn);
+    if (!MarkDelete(from, txn) ||
+        txn->GetState() == TransactionState::ABORTED)
+      return false;
+    SetMoved(txn);
+    if (moved)
+      moved(from, to);
+    ++count;
+  }
+  return true;
+}
+
+/*
+ * A page is retired under its latch so that no insert finds room in it any
+ * more, then leaves the free space map and the chain. A scan already on it
+ * goes on to the page after it. Pages with versions are kept for the
+ * snapshots reading them, and the first and last page always stay
+ */
+size_t TableHeap::UnlinkEmptyPages(Transaction *txn) {
+  std::lock_guard<std::mutex> guard(append_latch_);
+  page_id_t last_page_id;
+  {
+    std::lock_guard<std::mutex> fsm_guard(fsm_latch_);
+    last_page_id = last_page_id_;
+  }
+  VersionStore *versions = txn->GetVersionStore();
+  size_t unlinked = 0;
+  page_id_t prev_page_id = INVALID_PAGE_ID;
+  page_id_t page_id = first_page_id_;
+  while (page_id != INVALID_PAGE_ID) {
+    auto page =
+        static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+    if (page == nullptr)
+      break;
+    page->WLatch();
+    page_id_t next_page_id = page->GetNextPageId();
+    bool is_unlinked =
+        page_id != first_page_id_ && page_id != last_page_id &&
+        page->IsEmpty() &&
+        (versions == nullptr ||
+         !versions->HasVersions(first_page_id_, page_id));
+    if (is_unlinked)
+      page->Retire();
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, is_unlinked);
+    if (is_unlinked) {
+      RemoveFreeSpace(page_id);
+      Unlink(prev_page_id, page_id, next_page_id, txn);
+      ++unlinked;
+    } else {
+      prev_page_id = page_id;
+    }
+    page_id = next_page_id;
+  }
+  return unlinked;
+}
+
+void TableHeap::EnableZoneMap(Schema *schema,
+                              const std::vector<int> &columns) {
+  assert(zone_map_ == nullptr);
+  zone_map_ = new ZoneMap(schema, columns);
+}
+
+void TableHeap::EnableOverflow(Schema *schema) {
+  assert(overflow_schema_ == nullptr);
+  overflow_schema_ = schema;
+}
+
+void TableHeap::EnableRowCache(size_t capacity) {
+  assert(row_cache_ == nullptr);
+  row_cache_ = new RowCache(capacity);
+}
+
+bool TableHeap::ReadOutOfLine(const char *payload, uint32_t len,
+                              std::string &value) {
+  assert(IsOverflowLength(len));
+  page_id_t page_id;
+  memcpy(&page_id, payload, sizeof(page_id_t));
+  value.resize(len & ~VARCHAR_OVERFLOW_BIT);
+  return ReadOverflowChain(page_id, value.size(), &value[0]);
+}
+
 TableIterator TableHeap::begin(Transaction *txn) {
   auto page =
       static_cast<TablePage *>(buffer_pool_manager_->FetchPage(first_page_id_));
@@ -169,4 +641,767 @@ TableIterator TableHeap::end() {
   return TableIterator(this, RID(INVALID_PAGE_ID, -1), nullptr);
 }
 
+/**
+ * free space map helpers
+ */
+
+/*
+ * Build a free space map for the current page chain. Used for new tables and
+ * for tables whose free space map was never persisted.
+ */
+void TableHeap::CreateFreeSpaceMap() {
+  auto fsm_page = static_cast<FreeSpaceMapPage *>(
+      buffer_pool_manager_->NewPage(fsm_page_id_, extent_));
+  assert(fsm_page != nullptr); // todo: abort table creation?
+  fsm_page->WLatch();
+  fsm_page->Init(fsm_page_id_);
+  fsm_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(fsm_page_id_, true);
+  fsm_last_page_id_ = fsm_page_id_;
+
+  page_id_t page_id = first_page_id_;
+  while (page_id != INVALID_PAGE_ID) {
+    auto page =
+        static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+    assert(page != nullptr);
+    page->RLatch();
+    int32_t free_space = page->GetFreeSpaceSize();
+    page_id_t next_page_id = page->GetNextPageId();
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    AppendFreeSpace(page_id, free_space);
+    page_id = next_page_id;
+  }
+}
+
+void TableHeap::GetPageIds(std::vector<page_id_t> &page_ids) {
+  page_id_t fsm_page_id = fsm_page_id_;
+  while (fsm_page_id != INVALID_PAGE_ID) {
+    auto fsm_page = static_cast<FreeSpaceMapPage *>(
+        buffer_pool_manager_->FetchPage(fsm_page_id));
+    if (fsm_page == nullptr)
+      return;
+    fsm_page->RLatch();
+    for (int i = 0; i < fsm_page->GetEntryCount(); ++i)
+      page_ids.push_back(fsm_page->GetHeapPageId(i));
+    page_id_t next_page_id = fsm_page->GetNextPageId();
+    fsm_page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(fsm_page_id, false);
+    fsm_page_id = next_page_id;
+  }
+}
+
+/*
+ * Read a persisted free space map, only the fsm pages are touched
+ */
+void TableHeap::LoadFreeSpaceMap() {
+  page_id_t fsm_page_id = fsm_page_id_;
+  while (fsm_page_id != INVALID_PAGE_ID) {
+    auto fsm_page = static_cast<FreeSpaceMapPage *>(
+        buffer_pool_manager_->FetchPage(fsm_page_id));
+    assert(fsm_page != nullptr);
+    fsm_page->RLatch();
+    for (int i = 0; i < fsm_page->GetEntryCount(); ++i)
+      fsm_directory_[fsm_page->GetHeapPageId(i)] = fsm_page_id;
+    if (fsm_page->GetEntryCount() > 0)
+      last_page_id_ = fsm_page->GetLastHeapPageId();
+    fsm_last_page_id_ = fsm_page_id;
+    page_id_t next_page_id = fsm_page->GetNextPageId();
+    fsm_page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(fsm_page_id, false);
+    fsm_page_id = next_page_id;
+  }
+}
+
+/*
+ * Find a heap page with at least "required" bytes free
+ * @return: false if no page in the heap has enough space
+ */
+bool TableHeap::FindFreePage(int32_t required, page_id_t &page_id) {
+  DropLeftTargets();
+  size_t target = GetInsertTarget();
+  auto skip = [&](page_id_t heap_page_id) {
+    return IsOtherTarget(heap_page_id, target);
+  };
+  page_id_t fsm_page_id = fsm_page_id_;
+  while (fsm_page_id != INVALID_PAGE_ID) {
+    auto fsm_page = static_cast<FreeSpaceMapPage *>(
+        buffer_pool_manager_->FetchPage(fsm_page_id));
+    if (fsm_page == nullptr)
+      return false;
+    // FindPage tightens the cached max free space, so it needs write latch
+    fsm_page->WLatch();
+    bool is_found = fsm_page->FindPage(required, page_id, skip);
+    page_id_t next_page_id = fsm_page->GetNextPageId();
+    fsm_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(fsm_page_id, true);
+    if (is_found)
+      return true;
+    fsm_page_id = next_page_id;
+  }
+  return false;
+}
+
+/*
+ * Record the current free space of a heap page. Callers hold the heap page
+ * latch, so entries never go backwards in time for the same page.
+ */
+void TableHeap::UpdateFreeSpace(page_id_t page_id, int32_t free_space) {
+  page_id_t fsm_page_id;
+  {
+    std::lock_guard<std::mutex> guard(fsm_latch_);
+    auto it = fsm_directory_.find(page_id);
+    if (it == fsm_directory_.end())
+      return;
+    fsm_page_id = it->second;
+  }
+  auto fsm_page = static_cast<FreeSpaceMapPage *>(
+      buffer_pool_manager_->FetchPage(fsm_page_id));
+  if (fsm_page == nullptr)
+    return; // entry stays stale, inserts will correct it
+  fsm_page->WLatch();
+  fsm_page->UpdateEntry(page_id, free_space);
+  fsm_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(fsm_page_id, true);
+}
+
+void TableHeap::RemoveFreeSpace(page_id_t page_id) {
+  std::lock_guard<std::mutex> guard(fsm_latch_);
+  auto it = fsm_directory_.find(page_id);
+  if (it == fsm_directory_.end())
+    return;
+  auto fsm_page = static_cast<FreeSpaceMapPage *>(
+      buffer_pool_manager_->FetchPage(it->second));
+  assert(fsm_page != nullptr);
+  fsm_page->WLatch();
+  fsm_page->RemoveEntry(page_id);
+  fsm_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(it->second, true);
+  fsm_directory_.erase(it);
+  ReleaseInsertTarget(page_id);
+}
+
+/*
+ * Add an entry for a page just linked at the end of the heap, chain a new fsm
+ * page if the last one is full
+ */
+void TableHeap::AppendFreeSpace(page_id_t page_id, int32_t free_space) {
+  std::lock_guard<std::mutex> guard(fsm_latch_);
+  auto fsm_page = static_cast<FreeSpaceMapPage *>(
+      buffer_pool_manager_->FetchPage(fsm_last_page_id_));
+  assert(fsm_page != nullptr);
+  fsm_page->WLatch();
+  if (fsm_page->IsFull()) {
+    page_id_t new_fsm_page_id;
+    auto new_fsm_page = static_cast<FreeSpaceMapPage *>(
+        buffer_pool_manager_->NewPage(new_fsm_page_id, extent_));
+    assert(new_fsm_page != nullptr);
+    new_fsm_page->WLatch();
+    new_fsm_page->Init(new_fsm_page_id);
+    fsm_page->SetNextPageId(new_fsm_page_id);
+    fsm_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(fsm_last_page_id_, true);
+    fsm_last_page_id_ = new_fsm_page_id;
+    fsm_page = new_fsm_page;
+  }
+  fsm_page->AppendEntry(page_id, free_space);
+  fsm_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(fsm_last_page_id_, true);
+  fsm_directory_[page_id] = fsm_last_page_id_;
+  last_page_id_ = page_id;
+}
+
+/*
+ * Threads take slots in turn as they first insert, into any heap
+ */
+size_t TableHeap::GetInsertTarget() {
+  static thread_local InsertTargetHolder holder;
+  return holder.target_;
+}
+
+void TableHeap::ResetInsertTarget() {
+  SetInsertTarget(GetInsertTarget(), INVALID_PAGE_ID);
+}
+
+/*
+ * The stamp is set before the page, a thread leaving in between only makes
+ * the next DropLeftTargets drop a target still in use, which costs it the
+ * page and the entry a refresh
+ */
+void TableHeap::SetInsertTarget(size_t target, page_id_t page_id) {
+  target_stamps_[target].store(
+      target_leaves[target].load(std::memory_order_relaxed),
+      std::memory_order_relaxed);
+  page_id_t old_page_id =
+      insert_targets_[target].exchange(page_id, std::memory_order_relaxed);
+  if (old_page_id != INVALID_PAGE_ID && old_page_id != page_id)
+    RefreshFreeSpace(old_page_id);
+}
+
+/*
+ * A slot shared by more threads than one is dropped when any of them exits
+ */
+void TableHeap::DropLeftTargets() {
+  for (size_t i = 0; i < INSERT_TARGETS; ++i) {
+    auto &target = insert_targets_[i];
+    if (target.load(std::memory_order_relaxed) == INVALID_PAGE_ID ||
+        target_stamps_[i].load(std::memory_order_relaxed) ==
+            target_leaves[i].load(std::memory_order_relaxed))
+      continue;
+    page_id_t page_id =
+        target.exchange(INVALID_PAGE_ID, std::memory_order_relaxed);
+    if (page_id != INVALID_PAGE_ID)
+      RefreshFreeSpace(page_id);
+  }
+}
+
+/*
+ * A page no longer in the heap has no entry, UpdateFreeSpace leaves it
+ */
+void TableHeap::RefreshFreeSpace(page_id_t page_id) {
+  auto page =
+      static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  if (page == nullptr)
+    return; // entry stays stale, inserts will correct it
+  page->RLatch();
+  UpdateFreeSpace(page_id, page->GetFreeSpaceSize());
+  page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, false);
+}
+
+bool TableHeap::IsOtherTarget(page_id_t page_id, size_t target) {
+  for (size_t i = 0; i < INSERT_TARGETS; ++i)
+    if (i != target &&
+        insert_targets_[i].load(std::memory_order_relaxed) == page_id)
+      return true;
+  return false;
+}
+
+/*
+ * A thread that read the page as its target before is turned down by the
+ * page, it is retired before it is unlinked
+ */
+void TableHeap::ReleaseInsertTarget(page_id_t page_id) {
+  for (auto &target : insert_targets_) {
+    page_id_t expected = page_id;
+    target.compare_exchange_strong(expected, INVALID_PAGE_ID,
+                                   std::memory_order_relaxed);
+  }
+}
+
+/*
+ * Insert tuples into one heap page in order until one does not fit, the
+ * number inserted. Its free space map entry is corrected either way
+ */
+size_t TableHeap::InsertIntoPage(page_id_t page_id, const Tuple *const *tuples,
+                                 size_t count, RID *rids, Transaction *txn,
+                                 bool is_target) {
+  auto cur_page =
+      static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  if (cur_page == nullptr) {
+    txn->SetState(TransactionState::ABORTED);
+    return 0;
+  }
+  cur_page->WLatch();
+  size_t inserted = 0;
+  while (inserted < count &&
+         cur_page->InsertTuple(*tuples[inserted], rids[inserted], txn,
+                               lock_manager_, log_manager_, first_page_id_)) {
+    PushVersion(rids[inserted], nullptr, txn);
+    if (zone_map_ != nullptr)
+      zone_map_->Add(cur_page, rids[inserted]);
+    inserted++;
+  }
+  int32_t free_space = cur_page->GetFreeSpaceSize();
+  // a page turning the first tuple down, as when its free slots are locked,
+  // is not offered it again
+  if (inserted == 0)
+    free_space = std::min(free_space, tuples[0]->size_ + 7);
+  // other threads skip a target, its entry left too high is corrected once
+  // the page stops being one. The fsm latch is not taken per insert
+  if (!is_target || inserted < count)
+    UpdateFreeSpace(page_id, free_space);
+  cur_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, inserted != 0);
+  for (size_t i = 0; i < inserted; i++)
+    txn->GetWriteSet()->emplace_back(rids[i], WType::INSERT, Tuple{RID()},
+                                     this);
+  txn->ChargeMemory(inserted * sizeof(WriteRecord));
+  return inserted;
+}
+
+/*
+ * Create a new page holding the first tuples, as many as fit, and link it
+ * at the end of the heap. The number inserted, 0 if the page can not be
+ * created
+ */
+size_t TableHeap::InsertIntoNewPage(const Tuple *const *tuples, size_t count,
+                                    RID *rids, Transaction *txn) {
+  std::lock_guard<std::mutex> guard(append_latch_);
+  page_id_t prev_page_id = last_page_id_;
+  page_id_t new_page_id;
+  auto new_page = static_cast<TablePage *>(
+      buffer_pool_manager_->NewPage(new_page_id, extent_));
+  if (new_page == nullptr)
+    return 0;
+  // fill the page before it becomes reachable from the page chain
+  new_page->WLatch();
+  new_page->Init(new_page_id, PAGE_SIZE, prev_page_id, INVALID_PAGE_ID,
+                 log_manager_, txn, layout_);
+  size_t inserted = 0;
+  while (inserted < count &&
+         new_page->InsertTuple(*tuples[inserted], rids[inserted], txn,
+                               lock_manager_, log_manager_, first_page_id_)) {
+    PushVersion(rids[inserted], nullptr, txn);
+    inserted++;
+  }
+  if (inserted == 0) {
+    // the lock of the first slot died, as under wait-die against a table lock
+    lsn_t new_page_lsn = new_page->GetLSN();
+    new_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(new_page_id, true);
+    if (new_page_lsn == INVALID_LSN)
+      buffer_pool_manager_->DeletePage(new_page_id);
+    return 0;
+  }
+  if (zone_map_ != nullptr)
+    zone_map_->Build(new_page);
+  int32_t free_space = new_page->GetFreeSpaceSize();
+  lsn_t new_page_lsn = new_page->GetLSN();
+  new_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(new_page_id, true);
+
+  auto prev_page =
+      static_cast<TablePage *>(buffer_pool_manager_->FetchPage(prev_page_id));
+  if (prev_page == nullptr) {
+    // a logged page is redone after a crash, it must not get a new owner
+    if (new_page_lsn == INVALID_LSN)
+      buffer_pool_manager_->DeletePage(new_page_id);
+    return 0;
+  }
+  prev_page->WLatch();
+  prev_page->SetNextPageId(new_page_id);
+  if (zone_map_ != nullptr)
+    zone_map_->SetNextPageId(prev_page_id, new_page_id);
+  // the link must not reach disk before the new page is logged
+  if (new_page_lsn > prev_page->GetLSN())
+    prev_page->SetLSN(new_page_lsn);
+  if (new_page_lsn != INVALID_LSN)
+    prev_page->SetRecLSN(new_page_lsn);
+  prev_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(prev_page_id, true);
+
+  AppendFreeSpace(new_page_id, free_space);
+  for (size_t i = 0; i < inserted; i++)
+    txn->GetWriteSet()->emplace_back(rids[i], WType::INSERT, Tuple{RID()},
+                                     this);
+  txn->ChargeMemory(inserted * sizeof(WriteRecord));
+  return inserted;
+}
+
+/*
+ * Logged ahead like a new page, the neighbours may not reach disk before the
+ * record. The page keeps its own links
+ */
+void TableHeap::Unlink(page_id_t prev_page_id, page_id_t page_id,
+                       page_id_t next_page_id, Transaction *txn) {
+  lsn_t lsn = INVALID_LSN;
+  if (log_manager_ != nullptr && log_manager_->IsRunning()) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::UNLINKPAGE, prev_page_id, page_id,
+                         next_page_id);
+    lsn = log_manager_->AppendLogRecord(log_record);
+    txn->SetPrevLSN(lsn);
+  }
+  for (page_id_t neighbour_id : {prev_page_id, next_page_id}) {
+    auto neighbour = static_cast<TablePage *>(
+        buffer_pool_manager_->FetchPage(neighbour_id));
+    assert(neighbour != nullptr);
+    neighbour->WLatch();
+    if (neighbour_id == prev_page_id) {
+      neighbour->SetNextPageId(next_page_id);
+      if (zone_map_ != nullptr)
+        zone_map_->SetNextPageId(prev_page_id, next_page_id);
+    } else {
+      neighbour->SetPrevPageId(prev_page_id);
+    }
+    if (lsn != INVALID_LSN) {
+      if (lsn > neighbour->GetLSN())
+        neighbour->SetLSN(lsn);
+      neighbour->SetRecLSN(lsn);
+    }
+    neighbour->WUnlatch();
+    buffer_pool_manager_->UnpinPage(neighbour_id, true);
+  }
+}
+
+/**
+ * overflow page helpers
+ */
+
+// bytes of a stored varchar payload after its length
+static inline uint32_t StoredBytes(uint32_t len) {
+  if (len == PELOTON_VALUE_NULL)
+    return 0;
+  return IsOverflowLength(len) ? sizeof(page_id_t) : len;
+}
+
+// [length][bytes] of the varchar column of the tuple at data
+static inline const char *GetPayload(const char *data, Schema *schema,
+                                     int column) {
+  return data + *reinterpret_cast<const int32_t *>(data +
+                                                   schema->GetOffset(column));
+}
+
+/*
+ * Varchars longer than OVERFLOW_VARCHAR_SIZE go out of line, then the
+ * longest of the others until the tuple is small enough. Their chains are
+ * written before the tuple, a tuple that has its values out of line already
+ * is kept as it is. Chains written for a tuple that is not stored after all
+ * are for the caller to drop
+ */
+const Tuple *TableHeap::MoveOutOfLine(const Tuple &tuple, Tuple &stored,
+                                      Transaction *txn, int32_t max_size) {
+  if (overflow_schema_ == nullptr)
+    return &tuple;
+  ReclaimChains();
+  Schema *schema = overflow_schema_;
+  const std::vector<int> &columns = schema->GetUnlinedColumns();
+  std::vector<const char *> payloads(columns.size());
+  std::vector<bool> moved(columns.size(), false);
+  int32_t size = tuple.size_;
+  auto move_out = [&](size_t i) {
+    uint32_t len = *reinterpret_cast<const uint32_t *>(payloads[i]);
+    moved[i] = true;
+    size -= len - sizeof(page_id_t);
+  };
+  auto is_movable = [&](size_t i, uint32_t min_len) {
+    uint32_t len = *reinterpret_cast<const uint32_t *>(payloads[i]);
+    return !moved[i] && StoredBytes(len) == len && len > min_len;
+  };
+  for (size_t i = 0; i < columns.size(); ++i) {
+    payloads[i] = GetPayload(tuple.data_, schema, columns[i]);
+    if (is_movable(i, OVERFLOW_VARCHAR_SIZE))
+      move_out(i);
+  }
+  while (size > max_size) {
+    size_t longest = columns.size();
+    for (size_t i = 0; i < columns.size(); ++i) {
+      if (is_movable(i, sizeof(page_id_t)) &&
+          (longest == columns.size() ||
+           *reinterpret_cast<const uint32_t *>(payloads[i]) >
+               *reinterpret_cast<const uint32_t *>(payloads[longest])))
+        longest = i;
+    }
+    if (longest == columns.size())
+      break;
+    move_out(longest);
+  }
+  // too large either way, nothing is written
+  if (size > max_size ||
+      std::find(moved.begin(), moved.end(), true) == moved.end())
+    return &tuple;
+
+  stored.Reserve(size);
+  stored.size_ = size;
+  stored.rid_ = tuple.rid_;
+  memcpy(stored.data_, tuple.data_, schema->GetLength());
+  int32_t offset = schema->GetLength();
+  for (size_t i = 0; i < columns.size(); ++i) {
+    memcpy(stored.data_ + schema->GetOffset(columns[i]), &offset,
+           sizeof(int32_t));
+    uint32_t len = *reinterpret_cast<const uint32_t *>(payloads[i]);
+    if (!moved[i]) {
+      uint32_t bytes = sizeof(uint32_t) + StoredBytes(len);
+      memcpy(stored.data_ + offset, payloads[i], bytes);
+      offset += bytes;
+      continue;
+    }
+    assert(len < VARCHAR_OVERFLOW_BIT);
+    page_id_t page_id;
+    if (!WriteOverflowChain(payloads[i] + sizeof(uint32_t), len, page_id,
+                            txn)) {
+      // the chains written so far go back
+      std::lock_guard<std::mutex> guard(overflow_latch_);
+      for (size_t j = 0; j < i; ++j) {
+        if (!moved[j])
+          continue;
+        memcpy(&page_id,
+               stored.data_ +
+                   *reinterpret_cast<int32_t *>(
+                       stored.data_ + schema->GetOffset(columns[j])) +
+                   sizeof(uint32_t),
+               sizeof(page_id_t));
+        FreeChain(page_id);
+      }
+      return nullptr;
+    }
+    len |= VARCHAR_OVERFLOW_BIT;
+    memcpy(stored.data_ + offset, &len, sizeof(uint32_t));
+    memcpy(stored.data_ + offset + sizeof(uint32_t), &page_id,
+           sizeof(page_id_t));
+    offset += sizeof(uint32_t) + sizeof(page_id_t);
+  }
+  assert(offset == size);
+  return &stored;
+}
+
+bool TableHeap::ReadOutOfLine(Tuple &tuple) {
+  if (overflow_schema_ == nullptr)
+    return true;
+  Schema *schema = overflow_schema_;
+  const std::vector<int> &columns = schema->GetUnlinedColumns();
+  std::vector<const char *> payloads(columns.size());
+  int32_t size = schema->GetLength();
+  bool is_stored = true;
+  for (size_t i = 0; i < columns.size(); ++i) {
+    payloads[i] = GetPayload(tuple.data_, schema, columns[i]);
+    uint32_t len = *reinterpret_cast<const uint32_t *>(payloads[i]);
+    if (IsOverflowLength(len)) {
+      is_stored = false;
+      len &= ~VARCHAR_OVERFLOW_BIT;
+    } else {
+      len = StoredBytes(len);
+    }
+    size += sizeof(uint32_t) + len;
+  }
+  if (is_stored)
+    return true;
+
+  Tuple expanded;
+  expanded.Reserve(size);
+  expanded.size_ = size;
+  expanded.rid_ = tuple.rid_;
+  memcpy(expanded.data_, tuple.data_, schema->GetLength());
+  int32_t offset = schema->GetLength();
+  for (size_t i = 0; i < columns.size(); ++i) {
+    memcpy(expanded.data_ + schema->GetOffset(columns[i]), &offset,
+           sizeof(int32_t));
+    uint32_t len = *reinterpret_cast<const uint32_t *>(payloads[i]);
+    if (!IsOverflowLength(len)) {
+      uint32_t bytes = sizeof(uint32_t) + StoredBytes(len);
+      memcpy(expanded.data_ + offset, payloads[i], bytes);
+      offset += bytes;
+      continue;
+    }
+    page_id_t page_id;
+    memcpy(&page_id, payloads[i] + sizeof(uint32_t), sizeof(page_id_t));
+    len &= ~VARCHAR_OVERFLOW_BIT;
+    memcpy(expanded.data_ + offset, &len, sizeof(uint32_t));
+    if (!ReadOverflowChain(page_id, len,
+                           expanded.data_ + offset + sizeof(uint32_t)))
+      return false;
+    offset += sizeof(uint32_t) + len;
+  }
+  tuple = std::move(expanded);
+  return true;
+}
+
+/*
+ * Pages are written from the last one back, each knows its successor before
+ * it is logged. Nobody reads the chain before its tuple is in a page
+ */
+bool TableHeap::WriteOverflowChain(const char *bytes, uint32_t size,
+                                   page_id_t &page_id, Transaction *txn) {
+  page_id_t next_page_id = INVALID_PAGE_ID;
+  uint32_t count =
+      (size + OVERFLOW_PAGE_CAPACITY - 1) / OVERFLOW_PAGE_CAPACITY;
+  for (uint32_t i = count; i > 0; --i) {
+    uint32_t begin = (i - 1) * OVERFLOW_PAGE_CAPACITY;
+    uint32_t end = std::min<uint32_t>(size, begin + OVERFLOW_PAGE_CAPACITY);
+    // a page of a reclaimed chain of the heap first
+    OverflowPage *page = nullptr;
+    {
+      std::lock_guard<std::mutex> guard(overflow_latch_);
+      if (!free_overflow_pages_.empty()) {
+        page_id = free_overflow_pages_.back();
+        page = static_cast<OverflowPage *>(
+            buffer_pool_manager_->FetchPage(page_id));
+        if (page != nullptr)
+          free_overflow_pages_.pop_back();
+      }
+    }
+    if (page == nullptr) {
+      page = static_cast<OverflowPage *>(
+          buffer_pool_manager_->NewPage(page_id, extent_));
+      if (page != nullptr)
+        overflow_page_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (page == nullptr) {
+      std::lock_guard<std::mutex> guard(overflow_latch_);
+      FreeChain(next_page_id);
+      return false;
+    }
+    page->WLatch();
+    page->Init(page_id, next_page_id, bytes + begin, end - begin,
+               log_manager_, txn);
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, true);
+    next_page_id = page_id;
+  }
+  page_id = next_page_id;
+  return true;
+}
+
+bool TableHeap::ReadOverflowChain(page_id_t page_id, uint32_t size,
+                                  char *bytes) {
+  uint32_t offset = 0;
+  while (offset < size && page_id != INVALID_PAGE_ID) {
+    auto page = static_cast<OverflowPage *>(
+        buffer_pool_manager_->FetchPage(page_id));
+    if (page == nullptr)
+      return false;
+    uint32_t chunk = std::min<uint32_t>(size - offset, page->GetSize());
+    memcpy(bytes + offset, page->GetBytes(), chunk);
+    offset += chunk;
+    page_id_t next_page_id = page->GetNextPageId();
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    page_id = next_page_id;
+  }
+  return offset == size;
+}
+
+// heads of the chains of image that kept, if given, does not point to
+static void GetChains(Schema *schema, const Tuple &image, const Tuple *kept,
+                      std::vector<page_id_t> &chains) {
+  if (image.GetLength() == 0)
+    return;
+  for (int column : schema->GetUnlinedColumns()) {
+    const char *payload = GetPayload(image.GetData(), schema, column);
+    uint32_t len = *reinterpret_cast<const uint32_t *>(payload);
+    if (!IsOverflowLength(len))
+      continue;
+    page_id_t page_id;
+    memcpy(&page_id, payload + sizeof(uint32_t), sizeof(page_id_t));
+    bool is_kept = false;
+    if (kept != nullptr && kept->GetLength() != 0) {
+      for (int other : schema->GetUnlinedColumns()) {
+        const char *kept_payload = GetPayload(kept->GetData(), schema, other);
+        page_id_t kept_page_id;
+        memcpy(&kept_page_id, kept_payload + sizeof(uint32_t),
+               sizeof(page_id_t));
+        if (IsOverflowLength(
+                *reinterpret_cast<const uint32_t *>(kept_payload)) &&
+            kept_page_id == page_id)
+          is_kept = true;
+      }
+    }
+    if (!is_kept)
+      chains.push_back(page_id);
+  }
+}
+
+void TableHeap::DropChains(const Tuple &image, const Tuple *kept) {
+  if (overflow_schema_ == nullptr)
+    return;
+  std::vector<page_id_t> chains;
+  GetChains(overflow_schema_, image, kept, chains);
+  std::lock_guard<std::mutex> guard(overflow_latch_);
+  for (page_id_t page_id : chains)
+    FreeChain(page_id);
+}
+
+void TableHeap::RetireChains(const Tuple &image, const RID &rid,
+                             Transaction *txn) {
+  if (overflow_schema_ == nullptr || image.GetLength() == 0)
+    return;
+  Tuple current;
+  bool exists = GetPageImage(rid, current);
+  std::vector<page_id_t> chains;
+  GetChains(overflow_schema_, image, exists ? &current : nullptr, chains);
+  if (!chains.empty()) {
+    VersionStore *versions =
+        txn != nullptr ? txn->GetVersionStore() : nullptr;
+    std::lock_guard<std::mutex> guard(overflow_latch_);
+    for (page_id_t page_id : chains) {
+      auto same = [page_id](const RetiredChain &retired) {
+        return retired.page_id_ == page_id;
+      };
+      if (std::find_if(retired_chains_.begin(), retired_chains_.end(),
+                       same) == retired_chains_.end())
+        retired_chains_.push_back({page_id, rid, versions});
+    }
+    retired_count_.store(retired_chains_.size(), std::memory_order_relaxed);
+  }
+  ReclaimChains();
+}
+
+void TableHeap::ReclaimChains() {
+  if (retired_count_.load(std::memory_order_relaxed) == 0)
+    return;
+  std::lock_guard<std::mutex> guard(overflow_latch_);
+  size_t kept = 0;
+  for (auto &retired : retired_chains_) {
+    if (retired.versions_ != nullptr &&
+        retired.versions_->HasVersions(first_page_id_,
+                                       retired.rid_.GetPageId()))
+      retired_chains_[kept++] = retired;
+    else
+      FreeChain(retired.page_id_);
+  }
+  retired_chains_.resize(kept);
+  retired_count_.store(kept, std::memory_order_relaxed);
+}
+
+void TableHeap::FreeChain(page_id_t page_id) {
+  if (std::find(free_overflow_pages_.begin(), free_overflow_pages_.end(),
+                page_id) != free_overflow_pages_.end())
+    return;
+  while (page_id != INVALID_PAGE_ID) {
+    auto page = static_cast<OverflowPage *>(
+        buffer_pool_manager_->FetchPage(page_id));
+    // a page not fetched is lost to the heap, never given to another
+    if (page == nullptr)
+      return;
+    page_id_t next_page_id = page->GetNextPageId();
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    free_overflow_pages_.push_back(page_id);
+    page_id = next_page_id;
+  }
+}
+
+bool TableHeap::GetPageImage(const RID &rid, Tuple &tuple) {
+  auto page = static_cast<TablePage *>(
+      buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  if (page == nullptr)
+    return false;
+  page->RLatch();
+  bool exists = page->GetTuple(rid, tuple, nullptr, nullptr);
+  page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+  return exists;
+}
+
+void TableHeap::PushVersion(const RID &rid, const Tuple *before,
+                            Transaction *txn) {
+  if (!IsVersioned(txn))
+    return;
+  version_count_.fetch_add(1, std::memory_order_acq_rel);
+  txn->GetVersionStore()->Push(first_page_id_, rid, before, txn);
+}
+
+/*
+ * The page is not changed yet, a snapshot reading it meanwhile finds the
+ * image of the version in it all the same
+ */
+void TableHeap::PushVersion(const RID &rid, Transaction *txn) {
+  if (!IsVersioned(txn))
+    return;
+  auto page = static_cast<TablePage *>(
+      buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  if (page == nullptr)
+    return;
+  page->WLatch();
+  Tuple before;
+  if (page->GetTuple(rid, before, nullptr, nullptr))
+    PushVersion(rid, &before, txn);
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+}
+
+bool TableHeap::HasSnapshotVersions(page_id_t page_id, Transaction *txn) {
+  return txn != nullptr && txn->IsSnapshot() &&
+         txn->GetVersionStore()->HasVersions(first_page_id_, page_id);
+}
+
 } // namespace cmudb
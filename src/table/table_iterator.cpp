@@ -2,12 +2,21 @@
  * table_iterator.cpp
  */
 
+#include <algorithm>
 #include <cassert>
 
 #include "table/table_heap.h"
 
 namespace cmudb {
 
+// first and largest read-ahead depth, in pages
+#define READ_AHEAD_MIN_DEPTH 2
+#define READ_AHEAD_MAX_DEPTH 32
+
+static page_id_t TablePageNextPageId(Page *page) {
+  return static_cast<TablePage *>(page)->GetNextPageId();
+}
+
 TableIterator::TableIterator(TableHeap *table_heap, RID rid, Transaction *txn)
     : table_heap_(table_heap), tuple_(new Tuple(rid)), txn_(txn) {
   if (rid.GetPageId() != INVALID_PAGE_ID) {
@@ -42,6 +51,7 @@ TableIterator &TableIterator::operator++() {
       buffer_pool_manager->UnpinPage(cur_page->GetPageId(), false);
       cur_page = next_page;
       cur_page->RLatch();
+      read_ahead_.Advance(buffer_pool_manager, cur_page);
       if (cur_page->GetFirstTupleRid(next_tuple_rid))
         break;
     }
@@ -57,10 +67,82 @@ TableIterator &TableIterator::operator++() {
   return *this;
 }
 
+/*
+ * Top up the window of pages requested ahead of the scan once half of it is
+ * consumed. The depth doubles up to a quarter of the pool, prefetched pages
+ * must not evict each other before the scan gets to them.
+ */
+void ReadAheadWindow::Advance(BufferPoolManager *buffer_pool_manager,
+                              TablePage *cur_page) {
+  size_t max_depth = std::min<size_t>(READ_AHEAD_MAX_DEPTH,
+                                      buffer_pool_manager->GetPoolSize() / 4);
+  if (left_ > 0)
+    --left_;
+  if (left_ > depth_ / 2)
+    return;
+  depth_ = std::min(max_depth, depth_ == 0 ? READ_AHEAD_MIN_DEPTH : depth_ * 2);
+  if (depth_ == 0 || cur_page->GetNextPageId() == INVALID_PAGE_ID)
+    return;
+  buffer_pool_manager->PrefetchPage(cur_page->GetNextPageId(), depth_,
+                                    TablePageNextPageId);
+  left_ = depth_;
+}
+
 TableIterator TableIterator::operator++(int) {
   TableIterator clone(*this);
   ++(*this);
   return clone;
 }
 
+TableBatchIterator::TableBatchIterator(TableHeap *table_heap, Transaction *txn)
+    : table_heap_(table_heap), txn_(txn),
+      page_id_(table_heap->GetFirstPageId()) {}
+
+/*
+ * Pages are read latched only while their tuples are copied into the batch,
+ * a batch may end in the middle of a page and the next one goes on from there.
+ * Pages the zone map rules out are not fetched at all, and once one is
+ * skipped reading ahead stops, it would fetch the skipped ones
+ */
+bool TableBatchIterator::Next(RowBatch &batch) {
+  BufferPoolManager *buffer_pool_manager = table_heap_->buffer_pool_manager_;
+  ZoneMap *zone_map = table_heap_->zone_map_;
+  do {
+    batch.Reset();
+    while (page_id_ != INVALID_PAGE_ID && !batch.IsFull()) {
+      if (slot_ == 0 && zone_map != nullptr &&
+          !table_heap_->HasSnapshotVersions(page_id_, txn_) &&
+          zone_map->CanSkip(page_id_, batch.GetPredicates(), page_id_)) {
+        skipping_ = true;
+        continue;
+      }
+      auto page =
+          static_cast<TablePage *>(buffer_pool_manager->FetchPage(page_id_));
+      if (page == nullptr) {
+        if (txn_ != nullptr)
+          txn_->SetState(TransactionState::ABORTED);
+        page_id_ = INVALID_PAGE_ID;
+        break;
+      }
+      page->RLatch();
+      if (slot_ == 0 && zone_map != nullptr)
+        zone_map->Build(page);
+      if (slot_ == 0 && !skipping_)
+        read_ahead_.Advance(buffer_pool_manager, page);
+      RID blocked;
+      if (page->ScanBatch(slot_, batch, txn_, table_heap_->lock_manager_,
+                          nullptr, table_heap_->GetFirstPageId(), &blocked)) {
+        page_id_ = page->GetNextPageId();
+        slot_ = 0;
+      }
+      page->RUnlatch();
+      buffer_pool_manager->UnpinPage(page->GetPageId(), false);
+      // the tuple is read once its lock is granted, or left out if txn dies
+      if (blocked.GetPageId() != INVALID_PAGE_ID)
+        table_heap_->LockTuple(blocked, txn_);
+    }
+  } while (batch.GetSelectedCount() == 0 && page_id_ != INVALID_PAGE_ID);
+  return batch.GetSelectedCount() > 0;
+}
+
 } // namespace cmudb
@@ -0,0 +1,261 @@
+/**
+ * table_stats.cpp
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include "page/table_page.h"
+#include "table/row_batch.h"
+#include "table/table_heap.h"
+#include "table/table_stats.h"
+#include "type/limits.h"
+
+namespace cmudb {
+
+namespace {
+
+// value of a numeric column at data as a double, false for null
+bool ReadNumber(TypeId type, const char *data, double &value) {
+  switch (type) {
+  case TypeId::BOOLEAN:
+  case TypeId::TINYINT: {
+    int8_t v;
+    memcpy(&v, data, sizeof(v));
+    value = v;
+    return v != PELOTON_INT8_NULL;
+  }
+  case TypeId::SMALLINT: {
+    int16_t v;
+    memcpy(&v, data, sizeof(v));
+    value = v;
+    return v != PELOTON_INT16_NULL;
+  }
+  case TypeId::INTEGER: {
+    int32_t v;
+    memcpy(&v, data, sizeof(v));
+    value = v;
+    return v != PELOTON_INT32_NULL;
+  }
+  case TypeId::BIGINT: {
+    int64_t v;
+    memcpy(&v, data, sizeof(v));
+    value = static_cast<double>(v);
+    return v != PELOTON_INT64_NULL;
+  }
+  case TypeId::DECIMAL:
+    memcpy(&value, data, sizeof(value));
+    return value != PELOTON_DECIMAL_NULL;
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+/*
+ * HyperLogLog
+ */
+HyperLogLog::HyperLogLog(uint32_t precision)
+    : precision_(precision), registers_(1u << precision, 0) {}
+
+/*
+ * The first precision bits pick the register, it keeps the longest run of
+ * leading zeros of the other bits plus one
+ */
+void HyperLogLog::Add(uint64_t hash) {
+  uint64_t index = hash >> (64 - precision_);
+  uint64_t rest = hash << precision_;
+  uint8_t rank = rest == 0 ? 64 - precision_ + 1 : __builtin_clzll(rest) + 1;
+  if (rank > registers_[index])
+    registers_[index] = rank;
+}
+
+double HyperLogLog::Estimate() const {
+  double m = registers_.size();
+  double sum = 0;
+  size_t zeros = 0;
+  for (uint8_t rank : registers_) {
+    sum += std::ldexp(1.0, -rank);
+    if (rank == 0)
+      zeros++;
+  }
+  double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+  // linear counting is closer while registers are still empty
+  if (estimate <= 2.5 * m && zeros > 0)
+    estimate = m * std::log(m / zeros);
+  return estimate;
+}
+
+/*
+ * 64 bit words mixed like the finalizer of MurmurHash3
+ */
+uint64_t HyperLogLog::Hash(const char *data, size_t size) {
+  uint64_t hash = size;
+  for (size_t offset = 0; offset < size; offset += 8) {
+    uint64_t word = 0;
+    memcpy(&word, data + offset, std::min(sizeof(word), size - offset));
+    hash ^= word * 0x9e3779b97f4a7c15ULL;
+    hash = (hash << 31 | hash >> 33) * 0xc2b2ae3d27d4eb4fULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/*
+ * Histogram
+ */
+Histogram::Histogram(std::vector<double> &values, size_t buckets) {
+  if (values.empty() || buckets == 0)
+    return;
+  std::sort(values.begin(), values.end());
+  for (size_t i = 0; i <= buckets; i++)
+    bounds_.push_back(values[i * (values.size() - 1) / buckets]);
+}
+
+/*
+ * A value shared by several buckets counts with all of them
+ */
+double Histogram::Fraction(double value) const {
+  if (value < bounds_.front())
+    return 0;
+  if (value >= bounds_.back())
+    return 1;
+  size_t bucket =
+      std::upper_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin() -
+      1;
+  double width = bounds_[bucket + 1] - bounds_[bucket];
+  double within = width > 0 ? (value - bounds_[bucket]) / width : 1;
+  return (bucket + within) / (bounds_.size() - 1);
+}
+
+double Histogram::Selectivity(const double *low, const double *high) const {
+  if (IsEmpty())
+    return 1;
+  double high_fraction = high != nullptr ? Fraction(*high) : 1;
+  double low_fraction = 0;
+  // values equal to the low bound are in the range
+  if (low != nullptr && *low > bounds_.front())
+    low_fraction = Fraction(std::nextafter(*low, -INFINITY));
+  return std::max(high_fraction - low_fraction, 0.0);
+}
+
+/*
+ * TableStats
+ */
+TableStats::TableStats(Schema *schema)
+    : schema_(schema), columns_(schema->GetColumnCount()) {}
+
+/*
+ * The pages are read a batch at a time as a sequential scan reads them,
+ * tuples that can not be locked are left out of the sample. A column whose
+ * sampled values are nearly all distinct is taken to be unique-ish and its
+ * distinct count scaled up with the rows, others are taken to have shown
+ * all their values
+ */
+bool TableStats::Analyze(TableHeap *table_heap, Transaction *txn,
+                         size_t sample_pages) {
+  BufferPoolManager *buffer_pool_manager = table_heap->buffer_pool_manager_;
+  std::vector<page_id_t> page_ids;
+  table_heap->GetPageIds(page_ids);
+  sample_pages = std::max<size_t>(sample_pages, 1);
+  size_t step = (page_ids.size() + sample_pages - 1) / sample_pages;
+  step = std::max<size_t>(step, 1);
+
+  int column_count = schema_->GetColumnCount();
+  std::vector<HyperLogLog> sketches(column_count);
+  std::vector<std::vector<double>> values(column_count);
+  std::vector<size_t> nulls(column_count, 0);
+  size_t rows = 0, pages = 0;
+  RowBatch batch(schema_);
+  for (size_t i = 0; i < page_ids.size(); i += step, pages++) {
+    int slot = 0;
+    bool done = false;
+    while (!done) {
+      auto page = static_cast<TablePage *>(
+          buffer_pool_manager->FetchPage(page_ids[i]));
+      if (page == nullptr)
+        return false;
+      batch.Reset();
+      page->RLatch();
+      done = page->ScanBatch(slot, batch, txn, table_heap->lock_manager_,
+                             nullptr, table_heap->GetFirstPageId());
+      page->RUnlatch();
+      buffer_pool_manager->UnpinPage(page_ids[i], false);
+
+      for (uint32_t j = 0; j < batch.GetSelectedCount(); j++) {
+        uint32_t row = batch.GetSelected(j);
+        for (int column = 0; column < column_count; column++) {
+          TypeId type = schema_->GetType(column);
+          if (type == TypeId::VARCHAR) {
+            uint32_t len;
+            const char *str = batch.GetVarchar(column, row, len);
+            if (str == nullptr)
+              nulls[column]++;
+            else if (IsOverflowLength(len))
+              // every value out of line has a chain of its own
+              sketches[column].Add(HyperLogLog::Hash(str, sizeof(page_id_t)));
+            else
+              sketches[column].Add(HyperLogLog::Hash(str, strnlen(str, len)));
+            continue;
+          }
+          double value;
+          if (!ReadNumber(type, batch.GetFixed(column, row), value)) {
+            nulls[column]++;
+            continue;
+          }
+          sketches[column].Add(HyperLogLog::Hash(
+              reinterpret_cast<const char *>(&value), sizeof(value)));
+          values[column].push_back(value);
+        }
+      }
+      rows += batch.GetSelectedCount();
+    }
+  }
+
+  // rows of the table per sampled row
+  double scale = pages > 0 ? static_cast<double>(page_ids.size()) / pages : 0;
+  std::vector<ColumnStats> columns(column_count);
+  for (int column = 0; column < column_count; column++) {
+    ColumnStats &stats = columns[column];
+    double sampled = rows - nulls[column];
+    if (rows > 0)
+      stats.null_fraction_ = static_cast<double>(nulls[column]) / rows;
+    if (sampled > 0) {
+      double distinct = std::min(sketches[column].Estimate(), sampled);
+      if (distinct > 0.9 * sampled)
+        distinct *= scale;
+      stats.distinct_ = std::max(distinct, 1.0);
+    }
+    if (!values[column].empty())
+      stats.histogram_ = Histogram(values[column], TABLE_STATS_BUCKETS);
+  }
+
+  std::lock_guard<std::mutex> guard(latch_);
+  columns_.swap(columns);
+  row_count_ = static_cast<int64_t>(std::llround(rows * scale));
+  analyzed_ = true;
+  return true;
+}
+
+double TableStats::GetDistinct(int column) const {
+  std::lock_guard<std::mutex> guard(latch_);
+  return columns_[column].distinct_;
+}
+
+double TableStats::RangeSelectivity(int column, const double *low,
+                                    const double *high,
+                                    double default_selectivity) const {
+  std::lock_guard<std::mutex> guard(latch_);
+  const ColumnStats &stats = columns_[column];
+  if (stats.histogram_.IsEmpty())
+    return (low != nullptr ? default_selectivity : 1) *
+           (high != nullptr ? default_selectivity : 1);
+  return stats.histogram_.Selectivity(low, high) * (1 - stats.null_fraction_);
+}
+
+} // namespace cmudb
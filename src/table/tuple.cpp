@@ -11,16 +11,49 @@
 
 namespace cmudb {
 
-Tuple::Tuple(std::vector<Value> values, Schema *schema) : allocated_(true) {
+// bytes of a varchar after its length, none for null
+static inline uint32_t PayloadLength(const Value &value) {
+  return value.IsNull() ? 0 : value.GetLength();
+}
+
+// value of the column read as access says from the tuple bytes data, the
+// type switched on here instead of a virtual call per column
+static inline Value DecodeColumn(const ColumnAccess &access,
+                                 const char *data) {
+  const char *ptr = data + access.offset_;
+  switch (access.type_) {
+  case TypeId::BOOLEAN:
+  case TypeId::TINYINT:
+    return Value(access.type_, *reinterpret_cast<const int8_t *>(ptr));
+  case TypeId::SMALLINT:
+    return Value(access.type_, *reinterpret_cast<const int16_t *>(ptr));
+  case TypeId::INTEGER:
+    return Value(access.type_, *reinterpret_cast<const int32_t *>(ptr));
+  case TypeId::BIGINT:
+    return Value(access.type_, *reinterpret_cast<const int64_t *>(ptr));
+  case TypeId::DECIMAL:
+    return Value(access.type_, *reinterpret_cast<const double *>(ptr));
+  case TypeId::VARCHAR:
+    return Value::DeserializeFrom(
+        data + *reinterpret_cast<const int32_t *>(ptr), access.type_);
+  default:
+    return Value::DeserializeFrom(ptr, access.type_);
+  }
+}
+
+Tuple::Tuple(const std::vector<Value> &values, Schema *schema, Arena *arena)
+    : allocated_(arena == nullptr) {
   assert((int)values.size() == schema->GetColumnCount());
 
   // step1: calculate size of the tuple
   int32_t tuple_size = schema->GetLength();
   for (auto &i : schema->GetUnlinedColumns())
-    tuple_size += (values[i].GetLength() + sizeof(uint32_t));
-  // allocate memory using new, allocated_ flag set as true
+    tuple_size += (PayloadLength(values[i]) + sizeof(uint32_t));
+  // allocate memory using new, allocated_ flag set as true, unless the
+  // arena owns it
   size_ = tuple_size;
-  data_ = new char[size_];
+  data_ = arena ? arena->Allocate(size_) : new char[size_];
+  capacity_ = arena ? 0 : size_;
 
   // step2: Serialize each column(attribute) based on input value
   int column_count = schema->GetColumnCount();
@@ -31,51 +64,158 @@ Tuple::Tuple(std::vector<Value> values, Schema *schema) : allocated_(true) {
       *reinterpret_cast<int32_t *>(data_ + schema->GetOffset(i)) = offset;
       // Serialize varchar value, in place(size+data)
       values[i].SerializeTo(data_ + offset);
-      offset += (values[i].GetLength() + sizeof(uint32_t));
+      offset += (PayloadLength(values[i]) + sizeof(uint32_t));
     } else {
       values[i].SerializeTo(data_ + schema->GetOffset(i));
     }
   }
 }
 
+Tuple::Tuple(int32_t size, Arena *arena)
+    : allocated_(false), size_(size), data_(nullptr) {
+  if (arena == nullptr)
+    Reserve(size_);
+  else
+    data_ = arena->Allocate(size_);
+}
+
 // Copy constructor
 Tuple::Tuple(const Tuple &other)
-    : allocated_(other.allocated_), rid_(other.rid_), size_(other.size_) {
-  // deep copy
-  if (allocated_ == true) {
+    : allocated_(other.data_ != nullptr), rid_(other.rid_), size_(other.size_),
+      data_(nullptr) {
+  // deep copy, of tuples in an arena as well
+  if (allocated_) {
     // LOG_DEBUG("tuple deep copy");
-    data_ = new char[size_];
+    Reserve(size_);
+    memcpy(data_, other.data_, size_);
+  }
+}
+
+Tuple::Tuple(Tuple &&other)
+    : allocated_(other.allocated_), rid_(other.rid_), size_(other.size_),
+      data_(other.data_), capacity_(other.capacity_) {
+  other.allocated_ = false;
+  other.size_ = 0;
+  other.data_ = nullptr;
+  other.capacity_ = 0;
+}
+
+Tuple &Tuple::operator=(const Tuple &other) {
+  if (this == &other)
+    return *this;
+  rid_ = other.rid_;
+  size_ = other.size_;
+  if (other.data_ != nullptr) {
+    Reserve(size_);
     memcpy(data_, other.data_, size_);
   } else {
-    // LOG_DEBUG("tuple shallow copy");
-    data_ = other.data_;
+    if (allocated_)
+      delete[] data_;
+    allocated_ = false;
+    data_ = nullptr;
+    capacity_ = 0;
   }
+  return *this;
+}
+
+Tuple &Tuple::operator=(Tuple &&other) {
+  if (this == &other)
+    return *this;
+  if (allocated_)
+    delete[] data_;
+  allocated_ = other.allocated_;
+  rid_ = other.rid_;
+  size_ = other.size_;
+  data_ = other.data_;
+  capacity_ = other.capacity_;
+  other.allocated_ = false;
+  other.size_ = 0;
+  other.data_ = nullptr;
+  other.capacity_ = 0;
+  return *this;
+}
+
+void Tuple::Reserve(int32_t size) {
+  if (allocated_ && capacity_ >= size)
+    return;
+  if (allocated_)
+    delete[] data_;
+  data_ = new char[size];
+  capacity_ = size;
+  allocated_ = true;
+}
+
+/*
+ * Inlined columns are copied at their width, varchars with their length
+ * and payload. A null varchar has the null length and no payload
+ */
+Tuple Tuple::KeyFromTuple(Schema *schema, Schema *key_schema,
+                          const std::vector<int> &key_attrs,
+                          Arena *arena) const {
+  assert(data_);
+  assert((int)key_attrs.size() == key_schema->GetColumnCount());
+  int32_t key_size = key_schema->GetLength();
+  for (size_t i = 0; i < key_attrs.size(); i++) {
+    if (key_schema->IsInlined(i))
+      continue;
+    uint32_t len =
+        *reinterpret_cast<const uint32_t *>(GetDataPtr(schema, key_attrs[i]));
+    key_size += sizeof(uint32_t) + (len == PELOTON_VALUE_NULL ? 0 : len);
+  }
+  Tuple key(key_size, arena);
+  int32_t offset = key_schema->GetLength();
+  for (size_t i = 0; i < key_attrs.size(); i++) {
+    char *dst = key.data_ + key_schema->GetOffset(i);
+    if (key_schema->IsInlined(i)) {
+      memcpy(dst, data_ + schema->GetOffset(key_attrs[i]),
+             key_schema->GetLength(i));
+      continue;
+    }
+    const char *src = GetDataPtr(schema, key_attrs[i]);
+    uint32_t len = *reinterpret_cast<const uint32_t *>(src);
+    uint32_t bytes = sizeof(uint32_t) + (len == PELOTON_VALUE_NULL ? 0 : len);
+    *reinterpret_cast<int32_t *>(dst) = offset;
+    memcpy(key.data_ + offset, src, bytes);
+    offset += bytes;
+  }
+  return key;
 }
 
 // Get the value of a specified column (const)
 Value Tuple::GetValue(Schema *schema, const int column_id) const {
   assert(schema);
   assert(data_);
-  const TypeId column_type = schema->GetType(column_id);
-  const char *data_ptr = GetDataPtr(schema, column_id);
-  // the third parameter "is_inlined" is unused
-  return Value::DeserializeFrom(data_ptr, column_type);
+  return DecodeColumn(schema->GetAccess(column_id), data_);
+}
+
+void Tuple::GetValues(Schema *schema, std::vector<Value> &values) const {
+  assert(schema);
+  assert(data_);
+  const std::vector<ColumnAccess> &plan = schema->GetAccessPlan();
+  values.reserve(values.size() + plan.size());
+  for (const ColumnAccess &access : plan)
+    values.push_back(DecodeColumn(access, data_));
+}
+
+void Tuple::GetValues(Schema *schema, const std::vector<int> &column_ids,
+                      std::vector<Value> &values) const {
+  assert(schema);
+  assert(data_);
+  const std::vector<ColumnAccess> &plan = schema->GetAccessPlan();
+  values.reserve(values.size() + column_ids.size());
+  for (int column_id : column_ids)
+    values.push_back(DecodeColumn(plan[column_id], data_));
 }
 
 const char *Tuple::GetDataPtr(Schema *schema, const int column_id) const {
   assert(schema);
   assert(data_);
-  bool is_inlined = schema->IsInlined(column_id);
+  const ColumnAccess &access = schema->GetAccess(column_id);
   // for inline type, data are stored where they are
-  if (is_inlined)
-    return (data_ + schema->GetOffset(column_id));
-  else {
-    // step1: read relative offset from tuple data
-    int32_t offset =
-        *reinterpret_cast<int32_t *>(data_ + schema->GetOffset(column_id));
-    // step 2: return beginning address of the real data for VARCHAR type
-    return (data_ + offset);
-  }
+  if (access.inlined_)
+    return data_ + access.offset_;
+  // the column holds the offset of the real data for VARCHAR type
+  return data_ + *reinterpret_cast<const int32_t *>(data_ + access.offset_);
 }
 
 std::string Tuple::ToString(Schema *schema) const {
@@ -103,4 +243,16 @@ std::string Tuple::ToString(Schema *schema) const {
   return os.str();
 }
 
+void Tuple::SerializeTo(char *storage) const {
+  memcpy(storage, &size_, sizeof(int32_t));
+  memcpy(storage + sizeof(int32_t), data_, size_);
+}
+
+void Tuple::DeserializeFrom(const char *storage) {
+  int32_t size = *reinterpret_cast<const int32_t *>(storage);
+  size_ = size;
+  Reserve(size_);
+  memcpy(data_, storage + sizeof(int32_t), size_);
+}
+
 } // namespace cmudb
@@ -0,0 +1,218 @@
+/**
+ * zone_map.cpp
+ */
+
+#include <cstring>
+
+#include "page/table_page.h"
+#include "table/zone_map.h"
+#include "type/limits.h"
+
+namespace cmudb {
+
+namespace {
+
+// widened value of column at data, false for null
+bool ReadInteger(TypeId type, const char *data, int64_t &value) {
+  switch (type) {
+  case TypeId::BOOLEAN:
+  case TypeId::TINYINT: {
+    int8_t v;
+    memcpy(&v, data, sizeof(v));
+    value = v;
+    return v != PELOTON_INT8_NULL;
+  }
+  case TypeId::SMALLINT: {
+    int16_t v;
+    memcpy(&v, data, sizeof(v));
+    value = v;
+    return v != PELOTON_INT16_NULL;
+  }
+  case TypeId::INTEGER: {
+    int32_t v;
+    memcpy(&v, data, sizeof(v));
+    value = v;
+    return v != PELOTON_INT32_NULL;
+  }
+  case TypeId::BIGINT:
+    memcpy(&value, data, sizeof(value));
+    return value != PELOTON_INT64_NULL;
+  default:
+    return false;
+  }
+}
+
+// whether a value in [low, high] may satisfy value <type> constant
+template <typename C>
+bool MayMatch(C low, C high, CompareType type, C constant) {
+  switch (type) {
+  case CompareType::EQ:
+    return low <= constant && constant <= high;
+  case CompareType::NE:
+    return low != constant || high != constant;
+  case CompareType::LT:
+    return low < constant;
+  case CompareType::LE:
+    return low <= constant;
+  case CompareType::GT:
+    return high > constant;
+  case CompareType::GE:
+    return high >= constant;
+  }
+  return true;
+}
+
+} // namespace
+
+ZoneMap::ZoneMap(Schema *schema, const std::vector<int> &columns)
+    : schema_(schema), zone_index_(schema->GetColumnCount(), -1) {
+  std::vector<int> candidates(columns);
+  if (candidates.empty())
+    for (int i = 0; i < schema->GetColumnCount(); i++)
+      candidates.push_back(i);
+  for (auto column : candidates) {
+    switch (schema->GetType(column)) {
+    case TypeId::BOOLEAN:
+    case TypeId::TINYINT:
+    case TypeId::SMALLINT:
+    case TypeId::INTEGER:
+    case TypeId::BIGINT:
+    case TypeId::DECIMAL:
+      if (zone_index_[column] < 0) {
+        zone_index_[column] = columns_.size();
+        columns_.push_back(column);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+void ZoneMap::Build(TablePage *page) {
+  std::lock_guard<std::mutex> guard(latch_);
+  auto inserted = zones_.emplace(page->GetPageId(), Zone());
+  if (!inserted.second)
+    return;
+  Zone &zone = inserted.first->second;
+  zone.next_page_id_ = page->GetNextPageId();
+  zone.columns_.resize(columns_.size());
+  RID rid;
+  for (bool found = page->GetFirstTupleRid(rid); found;
+       found = page->GetNextTupleRid(rid, rid))
+    AddLocked(zone, page, rid);
+}
+
+void ZoneMap::Add(TablePage *page, const RID &rid) {
+  std::lock_guard<std::mutex> guard(latch_);
+  auto it = zones_.find(rid.GetPageId());
+  if (it != zones_.end())
+    AddLocked(it->second, page, rid);
+}
+
+void ZoneMap::SetNextPageId(page_id_t page_id, page_id_t next_page_id) {
+  std::lock_guard<std::mutex> guard(latch_);
+  auto it = zones_.find(page_id);
+  if (it != zones_.end())
+    it->second.next_page_id_ = next_page_id;
+}
+
+bool ZoneMap::CanSkip(page_id_t page_id,
+                      const std::vector<BatchPredicate> &predicates,
+                      page_id_t &next_page_id) {
+  if (predicates.empty())
+    return false;
+  std::lock_guard<std::mutex> guard(latch_);
+  auto it = zones_.find(page_id);
+  if (it == zones_.end())
+    return false;
+  for (auto &predicate : predicates) {
+    int index = zone_index_[predicate.column_];
+    if (index >= 0 &&
+        Excludes(predicate.column_, it->second.columns_[index], predicate)) {
+      next_page_id = it->second.next_page_id_;
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t ZoneMap::GetZoneCount() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return zones_.size();
+}
+
+void ZoneMap::AddLocked(Zone &zone, TablePage *page, const RID &rid) {
+  for (size_t i = 0; i < columns_.size(); i++) {
+    int column = columns_[i];
+    const char *data = page->GetTupleBytes(rid, schema_->GetOffset(column));
+    ColumnZone &column_zone = zone.columns_[i];
+    if (schema_->GetType(column) == TypeId::DECIMAL) {
+      double value;
+      memcpy(&value, data, sizeof(value));
+      if (value == PELOTON_DECIMAL_NULL)
+        continue;
+      if (column_zone.empty_ || value < column_zone.min_.decimal_)
+        column_zone.min_.decimal_ = value;
+      if (column_zone.empty_ || value > column_zone.max_.decimal_)
+        column_zone.max_.decimal_ = value;
+    } else {
+      int64_t value;
+      if (!ReadInteger(schema_->GetType(column), data, value))
+        continue;
+      if (column_zone.empty_ || value < column_zone.min_.integer_)
+        column_zone.min_.integer_ = value;
+      if (column_zone.empty_ || value > column_zone.max_.integer_)
+        column_zone.max_.integer_ = value;
+    }
+    column_zone.empty_ = false;
+  }
+}
+
+/*
+ * The constant is widened as RowBatch::Filter does, a double if either side
+ * is a decimal. Constants Filter does not evaluate exclude nothing
+ */
+bool ZoneMap::Excludes(int column, const ColumnZone &zone,
+                       const BatchPredicate &predicate) {
+  const Value &value = predicate.value_;
+  if (value.IsNull())
+    return true;
+  int64_t integer;
+  switch (value.GetTypeId()) {
+  case TypeId::BOOLEAN:
+  case TypeId::TINYINT:
+    integer = value.GetAs<int8_t>();
+    break;
+  case TypeId::SMALLINT:
+    integer = value.GetAs<int16_t>();
+    break;
+  case TypeId::INTEGER:
+    integer = value.GetAs<int32_t>();
+    break;
+  case TypeId::BIGINT:
+    integer = value.GetAs<int64_t>();
+    break;
+  case TypeId::DECIMAL:
+    integer = 0;
+    break;
+  default:
+    return false;
+  }
+  if (zone.empty_)
+    return true;
+  bool is_decimal = schema_->GetType(column) == TypeId::DECIMAL;
+  if (!is_decimal && value.GetTypeId() != TypeId::DECIMAL)
+    return !MayMatch(zone.min_.integer_, zone.max_.integer_, predicate.type_,
+                     integer);
+  double constant = value.GetTypeId() == TypeId::DECIMAL
+                        ? value.GetAs<double>()
+                        : static_cast<double>(integer);
+  double low = is_decimal ? zone.min_.decimal_
+                          : static_cast<double>(zone.min_.integer_);
+  double high = is_decimal ? zone.max_.decimal_
+                           : static_cast<double>(zone.max_.integer_);
+  return !MayMatch(low, high, predicate.type_, constant);
+}
+
+} // namespace cmudb
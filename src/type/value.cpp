@@ -11,26 +11,41 @@ Value::Value(const Value &other) {
   type_id_ = other.type_id_;
   size_ = other.size_;
   manage_data_ = other.manage_data_;
+  inlined_ = other.inlined_;
   value_ = other.value_;
   switch (type_id_) {
   case TypeId::VARCHAR:
     if (size_.len == PELOTON_VALUE_NULL) {
       value_.varlen = nullptr;
-    } else {
-      if (manage_data_) {
-        value_.varlen = new char[size_.len];
-        memcpy(value_.varlen, other.value_.varlen, size_.len);
-      } else {
-        value_ = other.value_;
-      }
+    } else if (manage_data_) {
+      value_.varlen = new char[size_.len];
+      memcpy(value_.varlen, other.value_.varlen, size_.len);
     }
     break;
   default:
-    value_ = other.value_;
+    break;
   }
 }
 
-Value &Value::operator=(Value other) {
+Value::Value(Value &&other) noexcept
+    : value_(other.value_), size_(other.size_),
+      manage_data_(other.manage_data_), inlined_(other.inlined_),
+      type_id_(other.type_id_) {
+  other.manage_data_ = false;
+  other.inlined_ = false;
+  other.value_.varlen = nullptr;
+  other.size_.len = PELOTON_VALUE_NULL;
+}
+
+Value &Value::operator=(const Value &other) {
+  if (this != &other) {
+    Value copy(other);
+    swap(*this, copy);
+  }
+  return *this;
+}
+
+Value &Value::operator=(Value &&other) noexcept {
   swap(*this, other);
   return *this;
 }
@@ -235,17 +250,13 @@ Value::Value(TypeId type, const char *data, uint32_t len, bool manage_data)
       value_.varlen = nullptr;
       size_.len = PELOTON_VALUE_NULL;
     } else {
-      manage_data_ = manage_data;
-      if (manage_data_) {
+      size_.len = len;
+      if (manage_data) {
         assert(len < PELOTON_VARCHAR_MAX_LEN);
-        value_.varlen = new char[len];
-        assert(value_.varlen != nullptr);
-        size_.len = len;
-        memcpy(value_.varlen, data, len);
+        SetVarlen(data, len);
       } else {
         // FUCK YOU GCC I do what I want.
         value_.const_varlen = data;
-        size_.len = len;
       }
     }
     break;
@@ -258,13 +269,10 @@ Value::Value(TypeId type, const char *data, uint32_t len, bool manage_data)
 Value::Value(TypeId type, const std::string &data) : Value(type) {
   switch (type) {
   case TypeId::VARCHAR: {
-    manage_data_ = true;
     // TODO: How to represent a null string here?
     uint32_t len = data.length() + 1;
-    value_.varlen = new char[len];
-    assert(value_.varlen != nullptr);
     size_.len = len;
-    memcpy(value_.varlen, data.c_str(), len);
+    SetVarlen(data.c_str(), len);
     break;
   }
   default:
@@ -273,6 +281,17 @@ Value::Value(TypeId type, const std::string &data) : Value(type) {
   }
 }
 
+void Value::SetVarlen(const char *data, uint32_t len) {
+  if (len <= VALUE_INLINE_SIZE) {
+    inlined_ = true;
+    memcpy(value_.inlined, data, len);
+    return;
+  }
+  manage_data_ = true;
+  value_.varlen = new char[len];
+  memcpy(value_.varlen, data, len);
+}
+
 // delete allocated char array space
 Value::~Value() {
   switch (type_id_) {
@@ -30,7 +30,7 @@ VarlenType::~VarlenType() {}
 
 // Access the raw variable length data
 const char *VarlenType::GetData(const Value &val) const {
-  return val.value_.varlen;
+  return val.inlined_ ? val.value_.inlined : val.value_.const_varlen;
 }
 
 // Get the length of the variable length data (including the length field)
@@ -151,7 +151,7 @@ void VarlenType::SerializeTo(const Value &val, char *storage) const {
     return;
   } else {
     memcpy(storage, &len, sizeof(uint32_t));
-    memcpy(storage + sizeof(uint32_t), val.value_.varlen, len);
+    memcpy(storage + sizeof(uint32_t), GetData(val), len);
   }
 }
 
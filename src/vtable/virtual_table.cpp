@@ -2,55 +2,683 @@
  * virtual_table.cpp
  */
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <sys/stat.h>
+#include <unordered_set>
 #include <vector>
 
 #include "common/exception.h"
+#include "common/latch_stats.h"
+#include "common/latency_stats.h"
 #include "common/logger.h"
+#include "common/memory_tracker.h"
 #include "common/string_utility.h"
+#include "execution/aggregate_kernels.h"
+#include "execution/hash_join.h"
+#include "logging/log_recovery.h"
 #include "page/header_page.h"
+#include "type/limits.h"
 #include "vtable/virtual_table.h"
 
 namespace cmudb {
 
 SQLITE_EXTENSION_INIT1
 
+/*
+ * Arguments after the schema: any number of indexes, 'pax' for the columnar
+ * page format of a new table, 'tablespace=file' and
+ * 'index_tablespace=file' for the files the pages of the heap and of the
+ * indexes go to, and 'partition=hash(column,count)' or
+ * 'partition=range(column,bound,...)' for a partitioned table, in any
+ * order. The indexes are returned without their quotes
+ */
+static bool IsTablespaceArgument(const char *argument) {
+  return strncmp(argument, "'tablespace=", 12) == 0 ||
+         strncmp(argument, "'index_tablespace=", 18) == 0;
+}
+
+static bool IsPartitionArgument(const char *argument) {
+  return strncmp(argument, "'partition=", 11) == 0;
+}
+
+static std::vector<std::string> GetIndexArguments(int argc,
+                                                  const char *const *argv) {
+  std::vector<std::string> indexes;
+  for (int i = 4; i < argc; i++) {
+    if (strcmp(argv[i], "'pax'") == 0 || IsTablespaceArgument(argv[i]) ||
+        IsPartitionArgument(argv[i]))
+      continue;
+    std::string index_string(argv[i]);
+    indexes.push_back(index_string.substr(1, (index_string.size() - 2)));
+  }
+  return indexes;
+}
+
+static bool HasPaxArgument(int argc, const char *const *argv) {
+  for (int i = 4; i < argc; i++)
+    if (strcmp(argv[i], "'pax'") == 0)
+      return true;
+  return false;
+}
+
+/*
+ * Tablespace of the argument 'key=file', added to the database if it is new,
+ * 0 without such argument. False with pzErr set if it can not be added
+ */
+static bool GetTablespaceArgument(Engine *engine, int argc,
+                                  const char *const *argv,
+                                  const std::string &key, int &tablespace_id,
+                                  char **pzErr) {
+  tablespace_id = 0;
+  std::string prefix = "'" + key + "=";
+  for (int i = 4; i < argc; i++) {
+    std::string argument(argv[i]);
+    if (argument.compare(0, prefix.size(), prefix) != 0)
+      continue;
+    std::string file =
+        argument.substr(prefix.size(), argument.size() - prefix.size() - 1);
+    try {
+      tablespace_id = engine->buffer_pool_manager_->GetDiskManager()
+                          ->AddTablespace(file);
+    } catch (Exception &e) {
+      *pzErr = sqlite3_mprintf("%s", e.what());
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Partition scheme of the 'partition=' argument over an integer column of
+ * schema, one of a single partition without it. False with pzErr set if it
+ * is malformed
+ */
+static bool GetPartitionArgument(Schema *schema, int argc,
+                                 const char *const *argv,
+                                 PartitionScheme &scheme, char **pzErr) {
+  scheme = PartitionScheme();
+  for (int i = 4; i < argc; i++) {
+    if (!IsPartitionArgument(argv[i]))
+      continue;
+    std::string argument(argv[i]);
+    argument = argument.substr(11, argument.size() - 12);
+    std::string::size_type open = argument.find('(');
+    std::vector<std::string> values;
+    if (open != std::string::npos && argument.back() == ')')
+      values = StringUtility::Split(
+          argument.substr(open + 1, argument.size() - open - 2), ',');
+    std::string method =
+        open == std::string::npos ? argument : argument.substr(0, open);
+    int column = values.empty() ? -1 : schema->GetColumnID(values[0]);
+    TypeId type = column < 0 ? TypeId::INVALID : schema->GetType(column);
+    if ((method != "hash" && method != "range") || values.size() < 2) {
+      *pzErr = sqlite3_mprintf("partition is hash(column,count) or "
+                               "range(column,bound,...)");
+      return false;
+    }
+    if (type != TypeId::TINYINT && type != TypeId::SMALLINT &&
+        type != TypeId::INTEGER && type != TypeId::BIGINT) {
+      *pzErr = sqlite3_mprintf("partition column is no integer column");
+      return false;
+    }
+    scheme.column_ = column;
+    if (method == "hash") {
+      scheme.count_ = strtoull(values[1].c_str(), nullptr, 10);
+    } else {
+      for (size_t j = 1; j < values.size(); j++) {
+        scheme.bounds_.push_back(strtoll(values[j].c_str(), nullptr, 10));
+        if (j > 1 && scheme.bounds_[j - 1] <= scheme.bounds_[j - 2]) {
+          *pzErr = sqlite3_mprintf("partition bounds are not ascending");
+          return false;
+        }
+      }
+      scheme.count_ = scheme.bounds_.size() + 1;
+    }
+    if (scheme.count_ < 2 || scheme.count_ >= MAX_TABLESPACES) {
+      *pzErr = sqlite3_mprintf("a table has 2 to %d partitions",
+                               MAX_TABLESPACES - 1);
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Tablespaces of the partitions of table name, each in a file named after
+ * the database, the table and the partition, e.g. vtable_foo_p1.db. False
+ * with pzErr set if they can not be added
+ */
+static bool GetPartitionTablespaces(Engine *engine, const std::string &name,
+                                    const PartitionScheme &scheme,
+                                    std::vector<int> &tablespaces,
+                                    char **pzErr) {
+  const std::string &file_name = engine->file_name_;
+  std::string::size_type n = file_name.rfind('.');
+  std::string prefix =
+      (n == std::string::npos ? file_name : file_name.substr(0, n)) + "_" +
+      name + "_p";
+  tablespaces.clear();
+  try {
+    for (size_t i = 0; i < scheme.count_; i++)
+      tablespaces.push_back(
+          engine->buffer_pool_manager_->GetDiskManager()->AddTablespace(
+              prefix + std::to_string(i) + ".db"));
+  } catch (Exception &e) {
+    *pzErr = sqlite3_mprintf("%s", e.what());
+    return false;
+  }
+  return true;
+}
+
+// the integer of value, false for null or another type
+static bool GetInteger(const Value &value, int64_t &integer) {
+  if (value.IsNull())
+    return false;
+  switch (value.GetTypeId()) {
+  case TypeId::TINYINT:
+    integer = value.GetAs<int8_t>();
+    return true;
+  case TypeId::SMALLINT:
+    integer = value.GetAs<int16_t>();
+    return true;
+  case TypeId::INTEGER:
+    integer = value.GetAs<int32_t>();
+    return true;
+  case TypeId::BIGINT:
+    integer = value.GetAs<int64_t>();
+    return true;
+  default:
+    return false;
+  }
+}
+
+size_t PartitionScheme::GetPartition(int64_t value) const {
+  if (bounds_.empty())
+    return HyperLogLog::Hash(reinterpret_cast<const char *>(&value),
+                            sizeof(value)) %
+           count_;
+  return std::upper_bound(bounds_.begin(), bounds_.end(), value) -
+         bounds_.begin();
+}
+
+VirtualTable *VirtualTable::GetPartitionOf(const RID &rid) {
+  int tablespace_id = GetTablespaceId(rid.GetPageId());
+  const std::vector<int> &tablespaces = data_->tablespaces_;
+  for (size_t i = 0; i < tablespaces.size(); i++)
+    if (tablespaces[i] == tablespace_id)
+      return GetPartition(i);
+  return this;
+}
+
+VirtualTable *VirtualTable::GetPartitionOf(const Tuple &tuple) {
+  const PartitionScheme &scheme = GetPartitionScheme();
+  int64_t value;
+  if (!IsPartitioned() ||
+      !GetInteger(tuple.GetValue(schema_, scheme.column_), value))
+    return this;
+  return GetPartition(scheme.GetPartition(value));
+}
+
+/*
+ * Partitions of a table that may hold rows satisfying predicates, those on
+ * the partition column bound its values. A hash partitioned table is pruned
+ * by equality only
+ */
+static std::vector<size_t>
+PrunePartitions(VirtualTable *table,
+                const std::vector<BatchPredicate> &predicates) {
+  const PartitionScheme &scheme = table->GetPartitionScheme();
+  int64_t low = std::numeric_limits<int64_t>::min();
+  int64_t high = std::numeric_limits<int64_t>::max();
+  bool bounded = false;
+  for (auto &predicate : predicates) {
+    int64_t value;
+    if (predicate.column_ != scheme.column_ ||
+        !GetInteger(predicate.value_, value))
+      continue;
+    switch (predicate.type_) {
+    case CompareType::EQ:
+      low = std::max(low, value);
+      high = std::min(high, value);
+      break;
+    case CompareType::GT:
+      if (value == std::numeric_limits<int64_t>::max())
+        continue;
+      low = std::max(low, value + 1);
+      break;
+    case CompareType::GE:
+      low = std::max(low, value);
+      break;
+    case CompareType::LT:
+      if (value == std::numeric_limits<int64_t>::min())
+        continue;
+      high = std::min(high, value - 1);
+      break;
+    case CompareType::LE:
+      high = std::min(high, value);
+      break;
+    default:
+      continue;
+    }
+    bounded = true;
+  }
+  std::vector<size_t> partitions;
+  if (bounded && low > high)
+    return partitions;
+  if (bounded && scheme.bounds_.empty() && low == high) {
+    partitions.push_back(scheme.GetPartition(low));
+    return partitions;
+  }
+  for (size_t i = 0; i < table->GetPartitionCount(); i++) {
+    // the values of a range partition are [bounds_[i - 1], bounds_[i])
+    if (bounded && !scheme.bounds_.empty() &&
+        ((i > 0 && high < scheme.bounds_[i - 1]) ||
+         (i < scheme.bounds_.size() && low >= scheme.bounds_[i])))
+      continue;
+    partitions.push_back(i);
+  }
+  return partitions;
+}
+
+// sample the statistics of a table in a transaction of its own
+// sampled from a snapshot, without locks
+static void AnalyzeTable(Engine *engine, TableData *data) {
+  auto transaction_manager = engine->transaction_manager_;
+  Transaction *transaction = transaction_manager->BeginSnapshot();
+  data->stats_->Analyze(data->table_heap_, transaction);
+  transaction_manager->Commit(transaction);
+  transaction_manager->Release(transaction);
+}
+
+// heap and indexes of a table, over the pages given unless they are invalid.
+// New heap pages come from tablespace_id. Its statistics are sampled as it
+// opens
+static TableData *NewTableData(Engine *engine,
+                               const std::shared_ptr<Schema> &shared_schema,
+                               const std::vector<Index *> &indexes,
+                               page_id_t first_page_id = INVALID_PAGE_ID,
+                               page_id_t fsm_page_id = INVALID_PAGE_ID,
+                               const PaxLayout &layout = PaxLayout(),
+                               int tablespace_id = 0) {
+  Schema *schema = shared_schema.get();
+  TableData *data = new TableData;
+  data->schema_ = schema;
+  data->shared_schema_ = shared_schema;
+  data->indexes_ = indexes;
+  data->cluster_index_ = nullptr;
+  for (auto index : indexes)
+    if (index->GetMetadata()->IsClustered() && data->cluster_index_ == nullptr)
+      data->cluster_index_ = index;
+  data->table_heap_ = new TableHeap(
+      engine->buffer_pool_manager_, engine->lock_manager_,
+      engine->log_manager_, first_page_id, fsm_page_id, layout,
+      tablespace_id);
+  // pushed down range predicates skip pages. Not on a replica, the log it
+  // applies does not keep the zone map
+  if (engine->log_replica_ == nullptr)
+    data->table_heap_->EnableZoneMap(schema);
+  // long varchars are only read when a column asks for them
+  data->table_heap_->EnableOverflow(schema);
+  if (engine->row_cache_ > 0)
+    data->table_heap_->EnableRowCache(engine->row_cache_);
+  data->stats_ = new TableStats(schema);
+  AnalyzeTable(engine, data);
+  data->refs_ = 0;
+  return data;
+}
+
+// fill an empty index from the tuples already in the table
+static void BuildIndex(TableData *data, Index *index, Transaction *txn) {
+  std::vector<std::pair<Tuple, RID>> entries;
+  for (auto iterator = data->table_heap_->begin(txn);
+       iterator != data->table_heap_->end(); ++iterator)
+    entries.emplace_back(iterator->KeyFromTuple(data->schema_,
+                                                index->GetStoredSchema(),
+                                                index->GetStoredAttrs(),
+                                                nullptr),
+                         iterator->GetRid());
+  index->BulkLoad(entries, txn);
+}
+
+/*
+ * Fill indexes that began to build from the tuples of the heap, read by a
+ * parallel scan whose workers each keep a run of entries per index. The
+ * runs are sorted and merged into the trees by FinishBuild, which then
+ * applies the changes writers made meanwhile, so other connections keep
+ * writing to the table while it builds
+ */
+static void BuildIndexesOnline(Engine *engine, TableData *data,
+                               const std::vector<Index *> &indexes) {
+  auto transaction_manager = engine->transaction_manager_;
+  Transaction *transaction = transaction_manager->Begin();
+  ParallelTableScan scan(data->table_heap_, transaction,
+                         engine->scan_threads_);
+  size_t threads = scan.GetThreadCount();
+  uint64_t columns = 0;
+  for (auto index : indexes)
+    for (int column : index->GetStoredAttrs())
+      columns |= 1ull << std::min(column, 63);
+  std::vector<std::unique_ptr<RowBatch>> batches;
+  for (size_t i = 0; i < threads; i++) {
+    batches.emplace_back(new RowBatch(data->schema_));
+    batches.back()->SetProjection(columns);
+  }
+  std::vector<RowBatch *> batch_pointers;
+  for (auto &batch : batches)
+    batch_pointers.push_back(batch.get());
+  // runs[i][worker] for indexes[i]
+  std::vector<std::vector<std::vector<std::pair<Tuple, RID>>>> runs(
+      indexes.size(),
+      std::vector<std::vector<std::pair<Tuple, RID>>>(threads));
+  TableHeap *table_heap = data->table_heap_;
+  scan.Run(batch_pointers, [&](RowBatch &batch, size_t worker) {
+    std::vector<Value> values;
+    std::string varchar;
+    for (uint32_t i = 0; i < batch.GetSelectedCount(); i++) {
+      uint32_t row = batch.GetSelected(i);
+      for (size_t j = 0; j < indexes.size(); j++) {
+        values.clear();
+        for (int column : indexes[j]->GetStoredAttrs()) {
+          uint32_t len;
+          const char *str = data->schema_->GetType(column) == TypeId::VARCHAR
+                                ? batch.GetVarchar(column, row, len)
+                                : nullptr;
+          if (str != nullptr && IsOverflowLength(len)) {
+            varchar.clear();
+            if (!table_heap->ReadOutOfLine(str, len, varchar))
+              throw Exception(EXCEPTION_TYPE_EXECUTOR, "can not read varchar");
+            values.emplace_back(TypeId::VARCHAR, varchar);
+          } else {
+            values.push_back(batch.GetValue(column, row));
+          }
+        }
+        runs[j][worker].emplace_back(
+            Tuple(values, indexes[j]->GetStoredSchema()), batch.GetRid(row));
+      }
+    }
+  });
+  transaction_manager->Commit(transaction);
+  transaction_manager->Release(transaction);
+  for (size_t j = 0; j < indexes.size(); j++)
+    indexes[j]->FinishBuild(runs[j]);
+}
+
+/*
+ * The record of name in the catalog names page_id, which is written to disk
+ * first: neither the first pages of a heap nor the catalog are logged, a
+ * table created is there after a crash with them. The record of a table
+ * replaces that of a dropped table of the same name, a record derived from
+ * a table is new: one found is another object's, and an exception is thrown
+ */
+static void PutDurableRecord(Engine *engine, const std::string &name,
+                             page_id_t page_id) {
+  if (page_id != INVALID_PAGE_ID)
+    engine->buffer_pool_manager_->FlushPage(page_id);
+  if (!IsReservedName(name)) {
+    if (!engine->catalog_->UpdateRecord(name, page_id))
+      engine->catalog_->InsertRecord(name, page_id);
+  } else if (!engine->catalog_->InsertRecord(name, page_id)) {
+    throw Exception(EXCEPTION_TYPE_CATALOG,
+                    "catalog record " + name + " exists");
+  }
+}
+
+/*
+ * Heap and indexes of a new table name, whose pages come from the
+ * tablespaces given, with records in the catalog. index_suffix follows the
+ * names of the indexes, those of partition i of a table are the names of
+ * its indexes and the table with "#i"
+ */
+static TableData *CreateTableData(Engine *engine, const std::string &name,
+                                  const std::shared_ptr<Schema> &schema,
+                                  std::vector<std::string> index_strings,
+                                  const PaxLayout &layout, int tablespace_id,
+                                  int index_tablespace_id,
+                                  const std::string &index_suffix) {
+  // parse arg[4..](strings that define table indexes)
+  std::vector<Index *> indexes;
+  for (auto &index_string : index_strings) {
+    // create index object, allocate memory space
+    IndexMetadata *index_metadata =
+        ParseIndexStatement(index_string, name, schema.get(), index_suffix);
+    indexes.push_back(ConstructIndex(index_metadata,
+                                     engine->buffer_pool_manager_,
+                                     INVALID_PAGE_ID, INVALID_PAGE_ID,
+                                     index_tablespace_id));
+  }
+  // create table object, allocate memory space
+  TableData *table_data =
+      NewTableData(engine, schema, indexes, INVALID_PAGE_ID, INVALID_PAGE_ID,
+                   layout, tablespace_id);
+  table_data->name_ = name;
+
+  // insert table root page info into the catalog, the roots of the indexes
+  // and the records derived from a dropped table of the same name are no
+  // longer theirs
+  Catalog *catalog = engine->catalog_;
+  for (auto index : indexes) {
+    catalog->DeleteRecord(index->GetName());
+    catalog->DeleteRecord(GetBloomFilterName(index->GetName()));
+  }
+  catalog->DeleteRecord(GetCleanCloseName(name));
+  catalog->DeleteRecord(GetFreeSpaceMapName(name));
+  PutDurableRecord(engine, name, table_data->table_heap_->GetFirstPageId());
+  PutDurableRecord(engine, GetFreeSpaceMapName(name),
+                   table_data->table_heap_->GetFreeSpaceMapPageId());
+  return table_data;
+}
+
+/*
+ * Heap and indexes of an existing table name from the records of the
+ * catalog, as CreateTableData made them
+ */
+static TableData *OpenTableData(Engine *engine, const std::string &name,
+                                const std::shared_ptr<Schema> &schema,
+                                std::vector<std::string> index_strings,
+                                int tablespace_id, int index_tablespace_id,
+                                const std::string &index_suffix) {
+  // Retrieve table root page info from the catalog
+  Catalog *catalog = engine->catalog_;
+  page_id_t table_root_id = INVALID_PAGE_ID;
+  if (!catalog->GetRootId(name, table_root_id) ||
+      table_root_id == INVALID_PAGE_ID)
+    throw Exception(EXCEPTION_TYPE_CATALOG,
+                    "no heap of table " + name + " in the catalog");
+  // a table left open by a crash has indexes and a free space map older
+  // than its heap or never written, neither is logged. Both are built again
+  // from the heap, and the table is not clean again until it is closed
+  page_id_t clean_id;
+  bool is_clean = catalog->GetRootId(GetCleanCloseName(name), clean_id);
+  bool is_rebuilt = !is_clean && engine->log_replica_ == nullptr;
+  if (is_clean && engine->log_replica_ == nullptr)
+    catalog->DeleteRecord(GetCleanCloseName(name));
+  if (is_rebuilt) {
+    LOG_WARN("table %s was not closed cleanly, its indexes are rebuilt",
+             name.c_str());
+    catalog->DeleteRecord(GetFreeSpaceMapName(name));
+  }
+  // tables created before free space maps existed get one built on open
+  page_id_t fsm_page_id = INVALID_PAGE_ID;
+  bool has_fsm = catalog->GetRootId(GetFreeSpaceMapName(name), fsm_page_id);
+  // parse arg[4..](strings that define table indexes)
+  std::vector<Index *> indexes;
+  std::vector<Index *> unbuilt_indexes;
+  for (auto &index_string : index_strings) {
+    // create index object, allocate memory space
+    IndexMetadata *index_metadata =
+        ParseIndexStatement(index_string, name, schema.get(), index_suffix);
+    // Retrieve index root page info from the catalog, an index that
+    // never had an entry has none
+    const std::string &index_name = index_metadata->GetName();
+    if (is_rebuilt) {
+      catalog->DeleteRecord(index_name);
+      catalog->DeleteRecord(GetBloomFilterName(index_name));
+    }
+    page_id_t index_root_id = INVALID_PAGE_ID;
+    bool has_index_root = catalog->GetRootId(index_name, index_root_id);
+    page_id_t bloom_page_id = INVALID_PAGE_ID;
+    catalog->GetRootId(GetBloomFilterName(index_name), bloom_page_id);
+    indexes.push_back(ConstructIndex(index_metadata,
+                                     engine->buffer_pool_manager_,
+                                     index_root_id, bloom_page_id,
+                                     index_tablespace_id));
+    if (!has_index_root)
+      unbuilt_indexes.push_back(indexes.back());
+  }
+  TableData *table_data =
+      NewTableData(engine, schema, indexes, table_root_id, fsm_page_id,
+                   PaxLayout(), tablespace_id);
+  table_data->name_ = name;
+  if (!has_fsm)
+    PutDurableRecord(engine, GetFreeSpaceMapName(name),
+                     table_data->table_heap_->GetFreeSpaceMapPageId());
+  // an index declared over existing rows is built bottom up, online by the
+  // connection that opened the table unless the index can only be built
+  // here. A replica does not read its indexes
+  if (engine->log_replica_ != nullptr)
+    return table_data;
+  std::vector<Index *> offline_indexes;
+  for (auto index : unbuilt_indexes) {
+    if (index->BeginBuild())
+      table_data->building_.push_back(index);
+    else
+      offline_indexes.push_back(index);
+  }
+  if (!offline_indexes.empty()) {
+    auto transaction_manager = engine->transaction_manager_;
+    Transaction *transaction = transaction_manager->Begin();
+    for (auto index : offline_indexes)
+      BuildIndex(table_data, index, transaction);
+    transaction_manager->Commit(transaction);
+    transaction_manager->Release(transaction);
+  }
+  return table_data;
+}
+
+/*
+ * Heap and indexes of table name, of each of its partitions if it is
+ * partitioned: build(name, tablespace, index tablespace, index suffix) of
+ * every partition
+ */
+static TableData *BuildPartitions(
+    const std::string &name, const PartitionScheme &scheme,
+    const std::vector<int> &tablespaces,
+    const std::function<TableData *(const std::string &, int,
+                                    const std::string &)> &build) {
+  TableData *table_data = build(name, tablespaces[0], "");
+  for (size_t i = 1; i < scheme.count_; i++) {
+    std::string suffix = "#" + std::to_string(i);
+    table_data->partitions_.push_back(
+        build(name + suffix, tablespaces[i], suffix));
+  }
+  table_data->partition_scheme_ = scheme;
+  if (scheme.IsPartitioned())
+    table_data->tablespaces_ = tablespaces;
+  return table_data;
+}
+
+/*
+ * Tablespaces of the heap and indexes of each partition of a table from its
+ * arguments, the same for both unless the table is partitioned. False with
+ * pzErr set if they can not be had
+ */
+static bool GetTableTablespaces(Engine *engine, const std::string &name,
+                                int argc, const char *const *argv,
+                                const PartitionScheme &scheme,
+                                std::vector<int> &tablespaces,
+                                int &index_tablespace_id, char **pzErr) {
+  int tablespace_id;
+  if (!GetTablespaceArgument(engine, argc, argv, "tablespace", tablespace_id,
+                             pzErr) ||
+      !GetTablespaceArgument(engine, argc, argv, "index_tablespace",
+                             index_tablespace_id, pzErr))
+    return false;
+  if (!scheme.IsPartitioned()) {
+    tablespaces.assign(1, tablespace_id);
+    return true;
+  }
+  if (tablespace_id != 0 || index_tablespace_id != 0) {
+    *pzErr = sqlite3_mprintf("partitions have tablespaces of their own");
+    return false;
+  }
+  return GetPartitionTablespaces(engine, name, scheme, tablespaces, pzErr);
+}
+
 /* API implementation */
 int VtabCreate(sqlite3 *db, void *pAux, int argc, const char *const *argv,
                sqlite3_vtab **ppVtab, char **pzErr) {
-  BufferPoolManager *buffer_pool_manager =
-      global_parameters->buffer_pool_manager_;
-  LockManager *lock_manager = global_parameters->lock_manager_;
-  // fetch header page from buffer pool
-  HeaderPage *header_page =
-      static_cast<HeaderPage *>(buffer_pool_manager->FetchPage(HEADER_PAGE_ID));
+  Connection *connection = static_cast<Connection *>(pAux);
+  Engine *engine = connection->engine_;
+  if (engine->log_replica_ != nullptr) {
+    *pzErr = sqlite3_mprintf("vtable replicas are read-only");
+    return SQLITE_READONLY;
+  }
 
   // the first three parameter:(1) module name (2) database name (3)table name
   assert(argc >= 4);
+  std::string table_name(argv[2]);
   // parse arg[3](string that defines table schema)
   std::string schema_string(argv[3]);
   schema_string = schema_string.substr(1, (schema_string.size() - 2));
-  Schema *schema = ParseCreateStatement(schema_string);
-
-  // parse arg[4](string that defines table index)
-  Index *index = nullptr;
-  if (argc > 4) {
-    std::string index_string(argv[4]);
-    index_string = index_string.substr(1, (index_string.size() - 2));
-    // create index object, allocate memory space
-    IndexMetadata *index_metadata =
-        ParseIndexStatement(index_string, std::string(argv[2]), schema);
-    index = ConstructIndex(index_metadata, buffer_pool_manager);
+  std::vector<std::string> index_strings = GetIndexArguments(argc, argv);
+  if (index_strings.size() > VTAB_MAX_INDEXES) {
+    *pzErr = sqlite3_mprintf("a table has at most %d indexes",
+                             VTAB_MAX_INDEXES);
+    return SQLITE_ERROR;
   }
-  // create table object, allocate memory space
-  VirtualTable *table =
-      new VirtualTable(schema, buffer_pool_manager, lock_manager, index);
+  std::shared_ptr<Schema> schema = GetSharedSchema(schema_string);
+  // the catalog records derived from the table and its indexes are named
+  // apart from anything created
+  try {
+    bool is_reserved = IsReservedName(table_name);
+    for (auto index_string : index_strings) {
+      std::unique_ptr<IndexMetadata> index_metadata(
+          ParseIndexStatement(index_string, table_name, schema.get()));
+      is_reserved = is_reserved || IsReservedName(index_metadata->GetName());
+    }
+    if (is_reserved) {
+      *pzErr = sqlite3_mprintf("names starting with '@' are reserved");
+      return SQLITE_ERROR;
+    }
+  } catch (Exception &e) {
+    *pzErr = sqlite3_mprintf("%s", e.what());
+    return SQLITE_ERROR;
+  }
+  PartitionScheme scheme;
+  std::vector<int> tablespaces;
+  int index_tablespace_id;
+  if (!GetPartitionArgument(schema.get(), argc, argv, scheme, pzErr) ||
+      !GetTableTablespaces(engine, table_name, argc, argv, scheme,
+                           tablespaces, index_tablespace_id, pzErr))
+    return SQLITE_ERROR;
 
-  // insert table root page info into header page
-  header_page->InsertRecord(std::string(argv[2]), table->GetFirstPageId());
-  buffer_pool_manager->UnpinPage(HEADER_PAGE_ID, true);
+  TableData *data;
+  try {
+    data = OpenTable(engine, table_name, [&]() {
+      PaxLayout layout;
+      if (HasPaxArgument(argc, argv))
+        layout = PaxLayout(schema.get());
+      return BuildPartitions(
+          table_name, scheme, tablespaces,
+          [&](const std::string &name, int tablespace_id,
+              const std::string &suffix) {
+            return CreateTableData(
+                engine, name, schema, index_strings, layout, tablespace_id,
+                scheme.IsPartitioned() ? tablespace_id : index_tablespace_id,
+                suffix);
+          });
+    });
+  } catch (Exception &e) {
+    // e.g. a record derived from the table is another one's
+    *pzErr = sqlite3_mprintf("%s", e.what());
+    return SQLITE_ERROR;
+  }
+  VirtualTable *table = new VirtualTable(connection, table_name, data);
 
   // register virtual table within sqlite system
   schema_string = "CREATE TABLE X(" + schema_string + ");";
@@ -60,104 +688,521 @@ int VtabCreate(sqlite3 *db, void *pAux, int argc, const char *const *argv,
   return SQLITE_OK;
 }
 
+/*
+ * The first connection to open a table builds its heap and index, the
+ * others share them
+ */
 int VtabConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
                 sqlite3_vtab **ppVtab, char **pzErr) {
+  Connection *connection = static_cast<Connection *>(pAux);
+  Engine *engine = connection->engine_;
+
   assert(argc >= 4);
+  std::string table_name(argv[2]);
   std::string schema_string(argv[3]);
   // remove the very first and last character
   schema_string = schema_string.substr(1, (schema_string.size() - 2));
   // new virtual table object, allocate memory space
-  Schema *schema = ParseCreateStatement(schema_string);
+  std::shared_ptr<Schema> schema = GetSharedSchema(schema_string);
+  PartitionScheme scheme;
+  std::vector<int> tablespaces;
+  int index_tablespace_id;
+  if (!GetPartitionArgument(schema.get(), argc, argv, scheme, pzErr) ||
+      !GetTableTablespaces(engine, table_name, argc, argv, scheme,
+                           tablespaces, index_tablespace_id, pzErr))
+    return SQLITE_ERROR;
 
-  BufferPoolManager *buffer_pool_manager =
-      global_parameters->buffer_pool_manager_;
-  LockManager *lock_manager = global_parameters->lock_manager_;
-
-  // Retrieve table root page info from header page
-  HeaderPage *header_page =
-      static_cast<HeaderPage *>(buffer_pool_manager->FetchPage(HEADER_PAGE_ID));
-  page_id_t table_root_id;
-  header_page->GetRootId(std::string(argv[2]), table_root_id);
-  // parse arg[4](string that defines table index)
-  Index *index = nullptr;
-  if (argc > 4) {
-    std::string index_string(argv[4]);
-    index_string = index_string.substr(1, (index_string.size() - 2));
-    // create index object, allocate memory space
-    IndexMetadata *index_metadata =
-        ParseIndexStatement(index_string, std::string(argv[2]), schema);
-    // Retrieve index root page info from header page
-    page_id_t index_root_id;
-    header_page->GetRootId(index_metadata->GetName(), index_root_id);
-    index = ConstructIndex(index_metadata, buffer_pool_manager, index_root_id);
+  // a replica applies no log while the table is read, unless the cursors of
+  // the connection hold it off already
+  LogReplica *log_replica = engine->log_replica_;
+  bool latch_replica = log_replica != nullptr && connection->open_cursors_ == 0;
+  if (latch_replica)
+    log_replica->GetLatch().RLock();
+  TableData *data;
+  try {
+    data = OpenTable(engine, table_name, [&]() {
+      // every partition has its heap before any is opened
+      for (size_t i = 0; i < scheme.count_; i++) {
+        std::string name =
+            i == 0 ? table_name : table_name + "#" + std::to_string(i);
+        page_id_t root_id = INVALID_PAGE_ID;
+        if (!engine->catalog_->GetRootId(name, root_id) ||
+            root_id == INVALID_PAGE_ID)
+          throw Exception(EXCEPTION_TYPE_CATALOG,
+                          "no heap of table " + name + " in the catalog");
+      }
+      return BuildPartitions(
+          table_name, scheme, tablespaces,
+          [&](const std::string &name, int tablespace_id,
+              const std::string &suffix) {
+            return OpenTableData(
+                engine, name, schema, GetIndexArguments(argc, argv),
+                tablespace_id,
+                scheme.IsPartitioned() ? tablespace_id : index_tablespace_id,
+                suffix);
+          });
+    });
+  } catch (Exception &e) {
+    if (latch_replica)
+      log_replica->GetLatch().RUnlock();
+    *pzErr = sqlite3_mprintf("%s", e.what());
+    return SQLITE_CORRUPT;
   }
-  VirtualTable *table = new VirtualTable(schema, buffer_pool_manager,
-                                         lock_manager, index, table_root_id);
+  if (latch_replica)
+    log_replica->GetLatch().RUnlock();
+  // outside tables_latch_, other connections open the table meanwhile
+  for (size_t i = 0; i < data->partitions_.size() + 1; i++) {
+    TableData *partition = i == 0 ? data : data->partitions_[i - 1];
+    std::vector<Index *> building;
+    {
+      std::lock_guard<std::mutex> guard(engine->tables_latch_);
+      building.swap(partition->building_);
+    }
+    if (!building.empty())
+      BuildIndexesOnline(engine, partition, building);
+  }
+  VirtualTable *table = new VirtualTable(connection, table_name, data);
 
   // register virtual table within sqlite system
   schema_string = "CREATE TABLE X(" + schema_string + ");";
   assert(sqlite3_declare_vtab(db, schema_string.c_str()) == SQLITE_OK);
 
   *ppVtab = reinterpret_cast<sqlite3_vtab *>(table);
-  buffer_pool_manager->UnpinPage(HEADER_PAGE_ID, false);
   return SQLITE_OK;
 }
 
 /*
- * we only support
- * (1) equlity check. e.g select * from foo where a = 1
- * (2) indexed column == predicated column
+ * we support, on any of the indexes of the table
+ * (1) point scan, equality on every indexed column.
+ *     e.g select * from foo where a = 1 and b = 2; indexed column {a,b}
+ * (2) range scan of a single column b+ tree index, at most one lower and one
+ *     upper bound. e.g select * from foo where a > 1 and a <= 10
+ * sqlite still checks every constraint on the rows returned, so bounds may
+ * be loosened by VtabFilter. Costs come from the statistics of the table: a
+ * sequential scan reads every row once, an index scan descends the index and
+ * fetches its rows at VTAB_INDEX_ROW_COST each.
+ * SQLITE_INDEX_SCAN_UNIQUE is never set: it lets sqlite update rows while the
+ * cursor still latches the leaf of the index.
+ * (3) otherwise a sequential scan, see PushDownConstraints
+ * Equality on the rowid, the packed rid of VtabRowid, goes before any of
+ * them: the row is fetched from the page the rid names.
+ * A replica only scans sequentially, its indexes are not replicated.
+ */
+
+/*
+ * Comparisons of a numeric column with a constant are passed to the
+ * sequential scan, which filters the rows before they reach sqlite, and the
+ * columns sqlite reads (colUsed) are the only ones decoded. idxStr holds
+ * colUsed in hex then "<op><column>" for each argument of VtabFilter, e.g.
+ * "5 >=0 =2". Text columns are left to sqlite, a COLLATE in the query is not
+ * visible here. sqlite still checks every constraint.
+ */
+static void PushDownConstraints(VirtualTable *table,
+                                sqlite3_index_info *pIdxInfo) {
+  Schema *schema = table->GetSchema();
+  std::stringstream str;
+  str << std::hex << pIdxInfo->colUsed << std::dec;
+  int argc = 0;
+  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+    auto &constraint = pIdxInfo->aConstraint[i];
+    if (constraint.usable == 0 || constraint.iColumn < 0 ||
+        schema->GetType(constraint.iColumn) == TypeId::VARCHAR)
+      continue;
+    const char *op;
+    switch (constraint.op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+      op = "=";
+      break;
+    case SQLITE_INDEX_CONSTRAINT_GT:
+      op = ">";
+      break;
+    case SQLITE_INDEX_CONSTRAINT_GE:
+      op = ">=";
+      break;
+    case SQLITE_INDEX_CONSTRAINT_LT:
+      op = "<";
+      break;
+    case SQLITE_INDEX_CONSTRAINT_LE:
+      op = "<=";
+      break;
+    default:
+      continue;
+    }
+    pIdxInfo->aConstraintUsage[i].argvIndex = ++argc;
+    str << " " << op << constraint.iColumn;
+  }
+  pIdxInfo->idxStr = sqlite3_mprintf("%s", str.str().c_str());
+  pIdxInfo->needToFreeIdxStr = 1;
+}
+
+// predicates and projection of a sequential scan from PushDownConstraints
+static uint64_t ParsePushedDown(const char *idxStr, sqlite3_value **argv,
+                                std::vector<BatchPredicate> &predicates) {
+  if (idxStr == nullptr)
+    return ROW_BATCH_ALL_COLUMNS;
+  char *end;
+  uint64_t columns = strtoull(idxStr, &end, 16);
+  for (const char *p = end; *p == ' '; argv++) {
+    CompareType type;
+    p++;
+    if (p[0] == '=') {
+      type = CompareType::EQ;
+      p += 1;
+    } else if (p[1] == '=') {
+      type = p[0] == '<' ? CompareType::LE : CompareType::GE;
+      p += 2;
+    } else {
+      type = p[0] == '<' ? CompareType::LT : CompareType::GT;
+      p += 1;
+    }
+    int column = static_cast<int>(strtol(p, &end, 10));
+    p = end;
+    // text is compared with sqlite's affinity rules, left to sqlite
+    switch (sqlite3_value_type(*argv)) {
+    case SQLITE_INTEGER:
+      predicates.emplace_back(
+          column, type,
+          Value(TypeId::BIGINT, (int64_t)sqlite3_value_int64(*argv)));
+      break;
+    case SQLITE_FLOAT:
+      predicates.emplace_back(
+          column, type, Value(TypeId::DECIMAL, sqlite3_value_double(*argv)));
+      break;
+    case SQLITE_NULL:
+      predicates.emplace_back(column, type,
+                              Value(TypeId::BIGINT, PELOTON_INT64_NULL));
+      break;
+    default:
+      break;
+    }
+  }
+  return columns;
+}
+
+// scan of one index for the constraints of VtabBestIndex
+struct IndexPlan {
+  // idxNum without the index number
+  int scan_ = 0;
+  // constraints passed to VtabFilter, in the order of its arguments
+  std::vector<int> arguments_;
+  // rows are read from the leaves of the index, not the heap
+  bool covering_ = false;
+  double cost_ = 0;
+  double rows_ = 0;
+};
+
+// whether the leaves of index keep every column of schema in columns, a
+// colUsed of sqlite whose last bit stands for the columns past it
+static bool IsCovering(Index *index, Schema *schema, uint64_t columns) {
+  IndexMetadata *metadata = index->GetMetadata();
+  if (metadata->GetType() != IndexType::BPLUSTREE)
+    return false;
+  for (int i = 0; i < schema->GetColumnCount(); i++)
+    if ((columns & (1ULL << std::min(i, 63))) != 0 &&
+        metadata->GetLeafOffset(i) < 0)
+      return false;
+  return true;
+}
+
+// whether the ORDER BY of sqlite is the order scan of index returns its
+// rows in, columns of the key from the first, all ascending or all
+// descending. A point scan has one key, the rows of a range are in order of
+// the single key column, a whole b+ tree in order of all of them. A b+ tree
+// is read backwards for a descending order, a hash index has only points
+static bool IsKeyOrder(Index *index, sqlite3_index_info *pIdxInfo) {
+  const std::vector<int> &key_attrs = index->GetKeyAttrs();
+  if (pIdxInfo->nOrderBy == 0 ||
+      pIdxInfo->nOrderBy > static_cast<int>(key_attrs.size()))
+    return false;
+  for (int i = 0; i < pIdxInfo->nOrderBy; i++)
+    if (pIdxInfo->aOrderBy[i].desc != pIdxInfo->aOrderBy[0].desc ||
+        pIdxInfo->aOrderBy[i].iColumn != key_attrs[i])
+      return false;
+  return true;
+}
+
+/*
+ * A point scan needs equality on every column of the key, a range scan a
+ * single column b+ tree. A key has the rows of the table over the distinct
+ * values of its columns, one if the index is unique. Reading a key costs a
+ * descent of the tree or one bucket of a hash index. The bounds of a range
+ * are not known here, each keeps VTAB_RANGE_SELECTIVITY of the rows. A scan
+ * covering the columns sqlite reads does not fetch the rows, the rows of a
+ * clustered index are next to each other. False if index can not serve the
+ * constraints. Without bounds a b+ tree is only read whole for an ORDER BY
+ * it returns the rows in
+ */
+static bool PlanIndexScan(Index *index, Schema *schema, TableStats *stats,
+                          sqlite3_index_info *pIdxInfo, double rows,
+                          IndexPlan &plan) {
+  const std::vector<int> &key_attrs = index->GetKeyAttrs();
+  plan.covering_ = IsCovering(index, schema, pIdxInfo->colUsed);
+  double row_cost = VTAB_INDEX_ROW_COST;
+  if (plan.covering_)
+    row_cost = VTAB_COVERING_ROW_COST;
+  else if (index->GetMetadata()->IsClustered())
+    row_cost = VTAB_CLUSTERED_ROW_COST;
+
+  // constraint used for each indexed column, -1 for none
+  std::vector<int> equal(key_attrs.size(), -1);
+  int low = -1, high = -1;
+  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+    auto &constraint = pIdxInfo->aConstraint[i];
+    if (constraint.usable == 0)
+      continue;
+    auto item = std::find(key_attrs.begin(), key_attrs.end(),
+                          constraint.iColumn);
+    if (item == key_attrs.end())
+      continue;
+    switch (constraint.op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+      equal[item - key_attrs.begin()] = i;
+      break;
+    case SQLITE_INDEX_CONSTRAINT_GT:
+    case SQLITE_INDEX_CONSTRAINT_GE:
+      low = i;
+      break;
+    case SQLITE_INDEX_CONSTRAINT_LT:
+    case SQLITE_INDEX_CONSTRAINT_LE:
+      high = i;
+      break;
+    default:
+      break;
+    }
+  }
+
+  // a hash index reads one bucket for a key and has no ranges, nor is an
+  // art index, which is in memory, planned for them
+  IndexType type = index->GetMetadata()->GetType();
+  bool hash = type != IndexType::BPLUSTREE;
+  double cost = type == IndexType::ART
+                    ? VTAB_ART_LOOKUP_COST
+                    : type == IndexType::HASH ? 1 : std::log2(rows);
+  if (std::find(equal.begin(), equal.end(), -1) == equal.end()) {
+    // arguments of VtabFilter follow the order of the key
+    plan.arguments_ = equal;
+    plan.scan_ = VTAB_POINT_SCAN;
+    if (index->GetMetadata()->IsUnique()) {
+      plan.rows_ = 1;
+    } else {
+      double keys = 1;
+      for (int column : key_attrs)
+        keys *= stats->GetDistinct(column);
+      plan.rows_ = keys > 0 ? std::max(rows / std::min(keys, rows), 1.0)
+                            : std::min(VTAB_KEY_ROWS, rows);
+    }
+    plan.cost_ = cost + plan.rows_ * row_cost;
+    return true;
+  }
+  if (hash)
+    return false;
+  if (key_attrs.size() != 1 || (low == -1 && high == -1)) {
+    // the whole tree is read for the order of its keys, sqlite stops at the
+    // first row of a min() of the first key column
+    if (!IsKeyOrder(index, pIdxInfo))
+      return false;
+    plan.rows_ = rows;
+    plan.cost_ = cost + rows * row_cost;
+    return true;
+  }
+  if (low != -1) {
+    plan.arguments_.push_back(low);
+    plan.scan_ |= VTAB_LOW_BOUND;
+    if (pIdxInfo->aConstraint[low].op == SQLITE_INDEX_CONSTRAINT_GE)
+      plan.scan_ |= VTAB_LOW_INCLUSIVE;
+    rows *= VTAB_RANGE_SELECTIVITY;
+  }
+  if (high != -1) {
+    plan.arguments_.push_back(high);
+    plan.scan_ |= VTAB_HIGH_BOUND;
+    if (pIdxInfo->aConstraint[high].op == SQLITE_INDEX_CONSTRAINT_LE)
+      plan.scan_ |= VTAB_HIGH_INCLUSIVE;
+    rows *= VTAB_RANGE_SELECTIVITY;
+  }
+  plan.rows_ = std::max(rows, 1.0);
+  plan.cost_ = cost + plan.rows_ * row_cost;
+  return true;
+}
+
+// what sqlite spends sorting rows for the ORDER BY, nothing without one
+static double SortCost(sqlite3_index_info *pIdxInfo, double rows) {
+  return pIdxInfo->nOrderBy > 0 ? rows * std::log2(std::max(rows, 2.0)) : 0;
+}
+
+/*
+ * An ORDER BY of columns of the table is taken by a sorted scan, one of
+ * the rowid is left to sqlite. The order is appended to idxStr as "|" and
+ * a "+" or "-" and the column for each term, e.g. "|+0 -2"
+ */
+static bool IsSortable(Schema *schema, sqlite3_index_info *pIdxInfo) {
+  if (pIdxInfo->nOrderBy == 0)
+    return false;
+  for (int i = 0; i < pIdxInfo->nOrderBy; i++)
+    if (pIdxInfo->aOrderBy[i].iColumn < 0 ||
+        pIdxInfo->aOrderBy[i].iColumn >= schema->GetColumnCount())
+      return false;
+  return true;
+}
+
+static std::string OrderString(sqlite3_index_info *pIdxInfo) {
+  std::stringstream str;
+  str << "|";
+  for (int i = 0; i < pIdxInfo->nOrderBy; i++)
+    str << (i > 0 ? " " : "") << (pIdxInfo->aOrderBy[i].desc ? "-" : "+")
+        << pIdxInfo->aOrderBy[i].iColumn;
+  return str.str();
+}
+
+// the order of OrderString in idxStr
+static std::vector<std::pair<int, bool>> ParseOrder(const char *idxStr) {
+  std::vector<std::pair<int, bool>> order;
+  const char *p = idxStr == nullptr ? nullptr : strchr(idxStr, '|');
+  if (p == nullptr)
+    return order;
+  for (p++; *p == '+' || *p == '-';) {
+    bool descending = *p == '-';
+    char *end;
+    order.emplace_back(static_cast<int>(strtol(p + 1, &end, 10)), descending);
+    p = *end == ' ' ? end + 1 : end;
+  }
+  return order;
+}
+
+/*
+ * Every index is planned and the cheapest one scanned, unless reading the
+ * whole table costs less. idxStr names the index for EXPLAIN QUERY PLAN.
+ * Rows an ORDER BY takes in key order are returned in it, the plans are
+ * compared with the sort the others need. That sort is done by the scan
+ * itself, see Cursor::SortScan. Other scans of many rows fetch them page by
+ * page
  */
 int VtabBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo) {
   // LOG_DEBUG("VtabBestIndex");
   VirtualTable *table = reinterpret_cast<VirtualTable *>(tab);
-  if (table->GetIndex() == nullptr)
-    return SQLITE_OK;
-  const std::vector<int> key_attrs = table->GetIndex()->GetKeyAttrs();
-  // make sure indexed column == predicate column
-  // e.g select * from foo where a = 1 and b =2; indexed column must be {a,b}
-  if (pIdxInfo->nConstraint != (int)(key_attrs.size()))
+  bool replica = table->GetConnection()->engine_->log_replica_ != nullptr;
+  // equality on the rowid, e.g. IN (rowids) read before, fetches each row
+  // from its page. sqlite still checks the constraint, a value that is no
+  // integer reads some other rid
+  for (int i = 0; i < pIdxInfo->nConstraint && !replica; i++) {
+    auto &constraint = pIdxInfo->aConstraint[i];
+    if (constraint.usable == 0 || constraint.iColumn != -1 ||
+        constraint.op != SQLITE_INDEX_CONSTRAINT_EQ)
+      continue;
+    pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+    pIdxInfo->idxNum = VTAB_ROWID_SCAN;
+    pIdxInfo->idxStr = const_cast<char *>("rowid");
+    pIdxInfo->estimatedCost = VTAB_INDEX_ROW_COST;
+    pIdxInfo->estimatedRows = 1;
+    pIdxInfo->orderByConsumed = 1;
     return SQLITE_OK;
-
-  int counter = 0;
-  bool is_index_scan = true;
-  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
-    if (pIdxInfo->aConstraint[i].usable == 0)
+  }
+  double rows = 0;
+  for (size_t i = 0; i < table->GetPartitionCount(); i++)
+    rows += table->GetPartition(i)->GetStats()->GetRowCount();
+  rows = std::max(rows, 1.0);
+  // the index of each partition has its own order, a scan of several
+  // neither returns rows in key order nor answers from the leaves
+  bool partitioned = table->IsPartitioned();
+  auto key_order = [&](Index *index) {
+    return !partitioned && IsKeyOrder(index, pIdxInfo);
+  };
+  const std::vector<Index *> &indexes = table->GetIndexes();
+  IndexPlan best;
+  best.cost_ = rows;
+  double best_total = rows + SortCost(pIdxInfo, rows);
+  size_t best_index = indexes.size();
+  // an index still building in any partition can not be read yet
+  auto building = [&](size_t i) {
+    for (size_t j = 0; j < table->GetPartitionCount(); j++)
+      if (table->GetPartition(j)->GetIndexes()[i]->IsBuilding())
+        return true;
+    return false;
+  };
+  for (size_t i = 0; i < indexes.size() && !replica; i++) {
+    IndexPlan plan;
+    if (building(i) ||
+        !PlanIndexScan(indexes[i], table->GetSchema(), table->GetStats(),
+                       pIdxInfo, rows, plan) ||
+        (partitioned && plan.scan_ == 0))
       continue;
-    int item = pIdxInfo->aConstraint[i].iColumn;
-    // if predicate column is part of indexed column
-    if (std::find(key_attrs.begin(), key_attrs.end(), item) !=
-        key_attrs.end()) {
-      // equlity check
-      if (pIdxInfo->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ) {
-        is_index_scan = false;
-        break;
-      }
-      pIdxInfo->aConstraintUsage[i].argvIndex = (i + 1);
-      counter++;
+    double total = plan.cost_;
+    if (!key_order(indexes[i]))
+      total += SortCost(pIdxInfo, plan.rows_);
+    if (total < best_total) {
+      best = plan;
+      best_total = total;
+      best_index = i;
     }
   }
-
-  if (counter == (int)key_attrs.size() && is_index_scan) {
-    pIdxInfo->idxNum = 1;
+  pIdxInfo->estimatedCost = best.cost_;
+  bool sorted = IsSortable(table->GetSchema(), pIdxInfo) &&
+                (best_index == indexes.size() ||
+                 !key_order(indexes[best_index]));
+  if (sorted) {
+    pIdxInfo->estimatedCost = best_total;
+    pIdxInfo->idxNum |= VTAB_SORTED;
+    pIdxInfo->orderByConsumed = 1;
+  }
+  if (best_index == indexes.size()) {
+    pIdxInfo->estimatedRows = static_cast<sqlite3_int64>(rows);
+    PushDownConstraints(table, pIdxInfo);
+    if (sorted) {
+      char *idx_str = sqlite3_mprintf("%s%s", pIdxInfo->idxStr,
+                                      OrderString(pIdxInfo).c_str());
+      sqlite3_free(pIdxInfo->idxStr);
+      pIdxInfo->idxStr = idx_str;
+    }
+    return SQLITE_OK;
   }
+  for (size_t i = 0; i < best.arguments_.size(); i++)
+    pIdxInfo->aConstraintUsage[best.arguments_[i]].argvIndex = i + 1;
+  pIdxInfo->idxNum |= best.scan_ | (best_index << VTAB_INDEX_SHIFT);
+  // a sorted scan fetches the rows by rid once they are in order
+  if (best.covering_ && !sorted && !partitioned)
+    pIdxInfo->idxNum |= VTAB_COVERING;
+  if (key_order(indexes[best_index])) {
+    pIdxInfo->idxNum |= VTAB_KEY_ORDER;
+    if (pIdxInfo->aOrderBy[0].desc)
+      pIdxInfo->idxNum |= VTAB_KEY_ORDER_DESC;
+    pIdxInfo->orderByConsumed = 1;
+  } else if (!sorted && (!best.covering_ || partitioned) &&
+             best.rows_ >= VTAB_BY_PAGE_ROWS &&
+             !indexes[best_index]->GetMetadata()->IsClustered()) {
+    pIdxInfo->idxNum |= VTAB_BY_PAGE;
+  }
+  pIdxInfo->idxStr = sqlite3_mprintf(
+      "%s%s", indexes[best_index]->GetMetadata()->GetName().c_str(),
+      sorted ? OrderString(pIdxInfo).c_str() : "");
+  pIdxInfo->needToFreeIdxStr = 1;
+  pIdxInfo->estimatedRows = static_cast<sqlite3_int64>(best.rows_);
   return SQLITE_OK;
 }
 
 int VtabDisconnect(sqlite3_vtab *pVtab) {
   VirtualTable *virtual_table = reinterpret_cast<VirtualTable *>(pVtab);
+  virtual_table->FlushInserts();
   delete virtual_table;
   return SQLITE_OK;
 }
 
 int VtabOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
   // LOG_DEBUG("VtabOpen");
-  // if read operation, begin transaction here
-  if (global_parameters->transaction_ == nullptr) {
-    VtabBegin(pVtab);
-  }
   VirtualTable *virtual_table = reinterpret_cast<VirtualTable *>(pVtab);
-  Cursor *cursor = new Cursor(virtual_table);
+  Connection *connection = virtual_table->GetConnection();
+  // a read begins a snapshot here, it takes no locks. sqlite begins the
+  // transaction of a write in VtabBegin before its cursors open
+  if (connection->transaction_ == nullptr) {
+    connection->transaction_ =
+        connection->engine_->transaction_manager_->BeginSnapshot();
+    connection->read_transaction_ = true;
+  }
+  // the first cursor of a replica holds off the log until the last closes
+  if (connection->open_cursors_++ == 0 &&
+      connection->engine_->log_replica_ != nullptr)
+    connection->engine_->log_replica_->GetLatch().RLock();
+  Cursor *cursor = virtual_table->OpenCursor();
+  Transaction *transaction = connection->transaction_;
+  cursor->SetSnapshot(transaction->IsSnapshot() ? transaction : nullptr);
   *ppCursor = reinterpret_cast<sqlite3_vtab_cursor *>(cursor);
 
   return SQLITE_OK;
@@ -166,195 +1211,2807 @@ int VtabOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
 int VtabClose(sqlite3_vtab_cursor *cur) {
   // LOG_DEBUG("VtabClose");
   Cursor *cursor = reinterpret_cast<Cursor *>(cur);
-  // if read operation, commit transaction here
-  VtabCommit(nullptr);
-  delete cursor;
+  VirtualTable *virtual_table = cursor->GetVirtualTable();
+  Connection *connection = virtual_table->GetConnection();
+  // a scan stopped early, e.g. by LIMIT, lets go of its leaf here
+  virtual_table->CloseCursor(cursor);
+  // if read operation, commit transaction here, once the other cursors of
+  // a join are done with it
+  if (--connection->open_cursors_ > 0)
+    return SQLITE_OK;
+  if (connection->read_transaction_)
+    VtabCommit(reinterpret_cast<sqlite3_vtab *>(virtual_table));
+  auto transaction_manager = connection->engine_->transaction_manager_;
+  for (auto snapshot : connection->snapshots_) {
+    transaction_manager->Commit(snapshot);
+    transaction_manager->Release(snapshot);
+  }
+  connection->snapshots_.clear();
+  if (connection->engine_->log_replica_ != nullptr)
+    connection->engine_->log_replica_->GetLatch().RUnlock();
   return SQLITE_OK;
 }
 
 /*
-** This method is called to "rewind" the cursor object back
-** to the first row of output. This method is always called at least
-** once prior to any call to VtabColumn() or VtabRowid() or
-** VtabEof().
-*/
-int VtabFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum, const char *idxStr,
-               int argc, sqlite3_value **argv) {
-  // LOG_DEBUG("VtabFilter");
-  Cursor *cursor = reinterpret_cast<Cursor *>(pVtabCursor);
-  Schema *key_schema;
-  // if indexed scan
-  if (idxNum == 1) {
-    cursor->SetScanFlag(true);
-    // Construct the tuple for point query
-    key_schema = cursor->GetKeySchema();
-    Tuple scan_tuple = ConstructTuple(key_schema, argv);
-    cursor->ScanKey(scan_tuple);
-  }
-  return SQLITE_OK;
+ * Whether the histogram of the column of a range scan puts so many rows in
+ * the range that fetching them at random costs more than reading the table
+ * in page order, predicates is set to the bounds for the sequential scan
+ * then. xBestIndex does not see the bounds, sqlite of this version passes
+ * them to xFilter only
+ */
+static bool IsWideRange(VirtualTable *table, Index *index, int scan,
+                        sqlite3_value **argv,
+                        std::vector<BatchPredicate> &predicates) {
+  int column = index->GetKeyAttrs()[0];
+  if (table->GetSchema()->GetType(column) == TypeId::VARCHAR)
+    return false;
+  double bounds[2];
+  const double *low = nullptr, *high = nullptr;
+  for (int bound = 0; bound < 2; bound++) {
+    if ((scan & (bound == 0 ? VTAB_LOW_BOUND : VTAB_HIGH_BOUND)) == 0)
+      continue;
+    sqlite3_value *arg = *argv++;
+    bool inclusive =
+        scan & (bound == 0 ? VTAB_LOW_INCLUSIVE : VTAB_HIGH_INCLUSIVE);
+    CompareType type = bound == 0 ? (inclusive ? CompareType::GE
+                                               : CompareType::GT)
+                                  : (inclusive ? CompareType::LE
+                                               : CompareType::LT);
+    switch (sqlite3_value_type(arg)) {
+    case SQLITE_INTEGER:
+      predicates.emplace_back(
+          column, type,
+          Value(TypeId::BIGINT, (int64_t)sqlite3_value_int64(arg)));
+      break;
+    case SQLITE_FLOAT:
+      predicates.emplace_back(column, type,
+                              Value(TypeId::DECIMAL, sqlite3_value_double(arg)));
+      break;
+    default:
+      return false;
+    }
+    bounds[bound] = sqlite3_value_double(arg);
+    (bound == 0 ? low : high) = &bounds[bound];
+  }
+  double selectivity = table->GetStats()->RangeSelectivity(
+      column, low, high, VTAB_RANGE_SELECTIVITY);
+  return selectivity * VTAB_INDEX_ROW_COST > 1;
+}
+
+/*
+ * Indexes of the partitions an index scan has to read, the partitions whose
+ * values of the partition column may be within the bounds of the scan when
+ * it is the first key column of index
+ */
+static std::vector<Index *> GetPartitionIndexes(VirtualTable *table,
+                                                size_t index_id, int scan,
+                                                sqlite3_value **argv) {
+  Index *index = table->GetIndex(index_id);
+  int column = index->GetKeyAttrs()[0];
+  std::vector<BatchPredicate> predicates;
+  if (column == table->GetPartitionScheme().column_) {
+    for (int bound = 0; bound < 2; bound++) {
+      int flag = bound == 0 ? VTAB_LOW_BOUND : VTAB_HIGH_BOUND;
+      if (scan != VTAB_POINT_SCAN && (scan & flag) == 0)
+        continue;
+      sqlite3_value *arg = *argv;
+      if (scan != VTAB_POINT_SCAN)
+        argv++;
+      bool inclusive = scan == VTAB_POINT_SCAN ||
+                       (scan & (bound == 0 ? VTAB_LOW_INCLUSIVE
+                                           : VTAB_HIGH_INCLUSIVE));
+      CompareType type = bound == 0 ? (inclusive ? CompareType::GE
+                                                 : CompareType::GT)
+                                    : (inclusive ? CompareType::LE
+                                                 : CompareType::LT);
+      if (sqlite3_value_type(arg) == SQLITE_INTEGER)
+        predicates.emplace_back(
+            column, type,
+            Value(TypeId::BIGINT, (int64_t)sqlite3_value_int64(arg)));
+    }
+  }
+  std::vector<Index *> indexes;
+  for (size_t partition : PrunePartitions(table, predicates))
+    indexes.push_back(table->GetPartition(partition)->GetIndex(index_id));
+  return indexes;
+}
+
+/*
+** This method is called to "rewind" the cursor object back
+** to the first row of output. This method is always called at least
+** once prior to any call to VtabColumn() or VtabRowid() or
+** VtabEof().
+*/
+int VtabFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum, const char *idxStr,
+               int argc, sqlite3_value **argv) {
+  // LOG_DEBUG("VtabFilter");
+  Cursor *cursor = reinterpret_cast<Cursor *>(pVtabCursor);
+  VirtualTable *table = cursor->GetVirtualTable();
+  // the scan sees the rows inserted before it
+  table->FlushInserts();
+  if (idxNum & VTAB_ROWID_SCAN) {
+    cursor->ScanRowid(sqlite3_value_int64(argv[0]));
+    return SQLITE_OK;
+  }
+  bool sorted = idxNum & VTAB_SORTED;
+  bool descending = idxNum & VTAB_KEY_ORDER_DESC;
+  idxNum &= ~(VTAB_SORTED | VTAB_KEY_ORDER_DESC);
+  int scan = idxNum & ((1 << VTAB_INDEX_SHIFT) - 1) &
+             ~(VTAB_COVERING | VTAB_BY_PAGE | VTAB_KEY_ORDER);
+  bool covering = idxNum & VTAB_COVERING;
+  bool by_page = idxNum & VTAB_BY_PAGE;
+  // key order without bounds reads the whole index
+  Index *index = scan != 0 || (idxNum & VTAB_KEY_ORDER)
+                     ? table->GetIndex(idxNum >> VTAB_INDEX_SHIFT)
+                     : nullptr;
+  if (index != nullptr && cursor->IsSnapshot())
+    cursor->BeginSnapshotScan(index, (idxNum & VTAB_KEY_ORDER) && !sorted,
+                              descending);
+  Schema *key_schema;
+  // the index of every partition not pruned is read, its rows by page
+  if (index != nullptr && table->IsPartitioned()) {
+    size_t index_id = idxNum >> VTAB_INDEX_SHIFT;
+    std::vector<Index *> indexes =
+        GetPartitionIndexes(table, index_id, scan, argv);
+    key_schema = index->GetKeySchema();
+    Arena *arena = cursor->GetArena();
+    arena->Reset();
+    Tuple low_key, high_key;
+    bool has_low, has_high;
+    bool low_inclusive = true, high_inclusive = true;
+    if (scan == VTAB_POINT_SCAN) {
+      low_key = ConstructTuple(key_schema, argv, arena);
+      high_key = low_key;
+      has_low = has_high = true;
+    } else {
+      low_inclusive = idxNum & VTAB_LOW_INCLUSIVE;
+      high_inclusive = idxNum & VTAB_HIGH_INCLUSIVE;
+      has_low =
+          (idxNum & VTAB_LOW_BOUND) &&
+          ConstructBound(key_schema, *argv++, low_key, low_inclusive, arena);
+      has_high =
+          (idxNum & VTAB_HIGH_BOUND) &&
+          ConstructBound(key_schema, *argv, high_key, high_inclusive, arena);
+    }
+    cursor->ScanRanges(indexes, has_low ? &low_key : nullptr, low_inclusive,
+                       has_high ? &high_key : nullptr, high_inclusive);
+  } else if (scan == VTAB_POINT_SCAN) {
+    // Construct the tuple for point query
+    key_schema = index->GetKeySchema();
+    cursor->GetArena()->Reset();
+    Tuple scan_tuple = ConstructTuple(key_schema, argv, cursor->GetArena());
+    cursor->ScanKey(index, scan_tuple, covering, by_page);
+  } else if (index != nullptr) {
+    std::vector<BatchPredicate> predicates;
+    if (!covering && (idxNum & VTAB_KEY_ORDER) == 0 &&
+        !index->GetMetadata()->IsClustered() &&
+        IsWideRange(table, index, scan, argv, predicates)) {
+      // most of the table is in the range, it is read in page order. A
+      // covering scan reads the leaves in order anyway, as a clustered one
+      // reads the pages
+      cursor->ScanTable(ROW_BATCH_ALL_COLUMNS, predicates,
+                        table->GetConnection()->engine_->scan_threads_);
+    } else {
+      key_schema = index->GetKeySchema();
+      Arena *arena = cursor->GetArena();
+      arena->Reset();
+      Tuple low_key, high_key;
+      bool low_inclusive = idxNum & VTAB_LOW_INCLUSIVE;
+      bool high_inclusive = idxNum & VTAB_HIGH_INCLUSIVE;
+      bool has_low =
+          (idxNum & VTAB_LOW_BOUND) &&
+          ConstructBound(key_schema, *argv++, low_key, low_inclusive, arena);
+      bool has_high =
+          (idxNum & VTAB_HIGH_BOUND) &&
+          ConstructBound(key_schema, *argv, high_key, high_inclusive, arena);
+      cursor->ScanRange(index, has_low ? &low_key : nullptr, low_inclusive,
+                        has_high ? &high_key : nullptr, high_inclusive,
+                        covering, by_page, descending);
+    }
+  } else {
+    std::vector<BatchPredicate> predicates;
+    uint64_t columns = ParsePushedDown(idxStr, argv, predicates);
+    cursor->ScanTable(columns, predicates,
+                      table->GetConnection()->engine_->scan_threads_,
+                      PrunePartitions(table, predicates));
+  }
+  if (cursor->IsIndexScan() && cursor->HasChangedRows())
+    cursor->AddChangedRows(by_page || table->IsPartitioned());
+  if (sorted) {
+    try {
+      cursor->SortScan(ParseOrder(idxStr));
+    } catch (Exception &e) {
+      sqlite3_free(pVtabCursor->pVtab->zErrMsg);
+      pVtabCursor->pVtab->zErrMsg = sqlite3_mprintf("%s", e.what());
+      return SQLITE_ERROR;
+    }
+  }
+  return SQLITE_OK;
+}
+
+void Cursor::EndScan() {
+  delete sort_;
+  sort_ = nullptr;
+  sorted_row_ = false;
+  delete index_iterator_;
+  index_iterator_ = nullptr;
+  index_scan_ = false;
+  rids_.clear();
+  rid_index_ = 0;
+  stable_ = false;
+  changed_ = false;
+  covering_index_ = nullptr;
+  virtual_table_->table_heap_->ReleaseTuplePage(row_page_);
+  row_page_ = nullptr;
+  row_loaded_ = false;
+  row_cached_ = false;
+  delete parallel_scan_;
+  parallel_scan_ = nullptr;
+  delete batch_iterator_;
+  batch_iterator_ = nullptr;
+  scan_heaps_.clear();
+  batch_ = nullptr;
+  batch_row_ = 0;
+  arena_.Reset();
+}
+
+/*
+ * A rid the row cache holds is a row of the heap, it is locked as PinRowid
+ * locks it and read from the cache
+ */
+void Cursor::ScanRowid(int64_t rowid) {
+  EndScan();
+  index_scan_ = true;
+  RID rid(rowid);
+  TableHeap *table_heap = virtual_table_->GetHeapOf(rid);
+  Transaction *txn = GetTransaction();
+  RowCache *row_cache = table_heap->GetRowCache();
+  if (IsSnapshot()) {
+    row_cached_ = table_heap->GetRowid(rid, row_tuple_, txn);
+  } else if (row_cache != nullptr && row_cache->Contains(rid) &&
+             table_heap->LockTuple(rid, txn) &&
+             row_cache->Get(rid, row_tuple_)) {
+    row_cached_ = true;
+  } else {
+    row_page_ = table_heap->PinRowid(rid, txn);
+    if (row_cache != nullptr && row_page_ != nullptr)
+      CacheCurrentRow(row_cache, rid);
+  }
+  row_loaded_ = true;
+  if (row_cached_ || row_page_ != nullptr)
+    rids_.push_back(rid);
+}
+
+void Cursor::LoadCurrentRow() {
+  RID rid = GetIndexRid();
+  TableHeap *table_heap = virtual_table_->GetHeapOf(rid);
+  Transaction *txn = GetTransaction();
+  RowCache *row_cache = table_heap->GetRowCache();
+  row_loaded_ = true;
+  row_cached_ = false;
+  if (IsSnapshot()) {
+    row_cached_ = table_heap->GetTuple(rid, row_tuple_, txn);
+    return;
+  }
+  if (row_cache == nullptr) {
+    row_page_ = table_heap->PinTuple(rid, row_page_, txn);
+    return;
+  }
+  if (!table_heap->LockTuple(rid, txn)) {
+    table_heap->ReleaseTuplePage(row_page_);
+    row_page_ = nullptr;
+    return;
+  }
+  if (row_cache->Get(rid, row_tuple_)) {
+    row_cached_ = true;
+    return;
+  }
+  row_page_ = table_heap->PinTuple(rid, row_page_, txn);
+  if (row_page_ != nullptr)
+    CacheCurrentRow(row_cache, rid);
+}
+
+/*
+ * The row is locked, the generation read before the page only tells a
+ * change of a heap that does not lock
+ */
+void Cursor::CacheCurrentRow(RowCache *row_cache, const RID &rid) {
+  uint64_t generation = row_cache->GetGeneration(rid);
+  row_page_->RLatch();
+  row_page_->GetTuple(rid, row_tuple_, nullptr, nullptr);
+  row_page_->RUnlatch();
+  row_cache->Put(rid, row_tuple_, generation);
+  row_cached_ = true;
+}
+
+/*
+ * A parallel scan needs a couple of morsels per worker to pay off, smaller
+ * tables are read by the calling thread
+ */
+void Cursor::ScanTable(uint64_t columns,
+                       const std::vector<BatchPredicate> &predicates,
+                       size_t threads, const std::vector<size_t> &partitions) {
+  delete sort_;
+  sort_ = nullptr;
+  delete index_iterator_;
+  index_iterator_ = nullptr;
+  index_scan_ = false;
+  rids_.clear();
+  covering_index_ = nullptr;
+  virtual_table_->table_heap_->ReleaseTuplePage(row_page_);
+  row_page_ = nullptr;
+  delete parallel_scan_;
+  parallel_scan_ = nullptr;
+  delete batch_iterator_;
+  batch_iterator_ = nullptr;
+  scan_heaps_.clear();
+  for (size_t partition : partitions)
+    scan_heaps_.push_back(virtual_table_->GetPartition(partition)->table_heap_);
+  if (scan_heaps_.size() > 1)
+    threads = std::max(threads, scan_heaps_.size());
+
+  if (threads > 1 && !scan_heaps_.empty()) {
+    parallel_scan_ =
+        new ParallelTableScan(scan_heaps_, GetTransaction(), threads);
+    if (parallel_scan_->GetPageCount() <
+        2 * threads * PARALLEL_SCAN_MORSEL_PAGES) {
+      delete parallel_scan_;
+      parallel_scan_ = nullptr;
+    }
+  }
+  // two batches per worker, one filled while the other is consumed
+  size_t batch_count = parallel_scan_ != nullptr ? 2 * threads : 1;
+  while (batches_.size() < batch_count)
+    batches_.push_back(new RowBatch(virtual_table_->schema_));
+  for (auto batch : batches_) {
+    batch->SetProjection(columns);
+    batch->SetPredicates(predicates);
+  }
+
+  batch_row_ = 0;
+  if (parallel_scan_ != nullptr) {
+    parallel_scan_->Start(std::vector<RowBatch *>(
+        batches_.begin(), batches_.begin() + batch_count));
+    batch_ = parallel_scan_->Next(nullptr);
+  } else if (!scan_heaps_.empty()) {
+    batch_ = batches_[0];
+    scan_heap_ = 0;
+    NextBatch();
+  } else {
+    // every partition was pruned
+    batch_ = nullptr;
+  }
+}
+
+void Cursor::NextBatch() {
+  while (scan_heap_ < scan_heaps_.size()) {
+    if (batch_iterator_ == nullptr)
+      batch_iterator_ =
+          new TableBatchIterator(scan_heaps_[scan_heap_], GetTransaction());
+    if (batch_iterator_->Next(*batch_))
+      return;
+    delete batch_iterator_;
+    batch_iterator_ = nullptr;
+    scan_heap_++;
+  }
+}
+
+VirtualTable::~VirtualTable() {
+  for (auto cursor : cursor_pool_)
+    delete cursor;
+  if (!is_partition_)
+    CloseTable(connection_->engine_, name_, data_);
+}
+
+Cursor *VirtualTable::OpenCursor() {
+  if (cursor_pool_.empty())
+    return new Cursor(this);
+  Cursor *cursor = cursor_pool_.back();
+  cursor_pool_.pop_back();
+  return cursor;
+}
+
+void VirtualTable::CloseCursor(Cursor *cursor) {
+  if (cursor_pool_.size() >= VTAB_CURSOR_POOL_SIZE) {
+    delete cursor;
+    return;
+  }
+  cursor->EndScan();
+  cursor_pool_.push_back(cursor);
+}
+
+/*
+ * The row after the new one in key order is the first entry of a scan from
+ * its key. Its page is full once the table grows past it, the row goes
+ * wherever there is room then and vtable_cluster puts it back in order
+ */
+page_id_t VirtualTable::GetClusterPage(const Tuple &tuple) {
+  if (cluster_index_ == nullptr)
+    return INVALID_PAGE_ID;
+  Tuple key = GetKey(tuple, cluster_index_, nullptr);
+  IndexScanIterator *iterator = cluster_index_->ScanRange(
+      &key, true, nullptr, false, GetTransaction());
+  page_id_t page_id =
+      iterator->isEnd() ? INVALID_PAGE_ID : iterator->GetRid().GetPageId();
+  delete iterator;
+  return page_id;
+}
+
+// nulls first, as the index keeps them
+void VirtualTable::SortByCluster(std::vector<Tuple> &tuples) {
+  const std::vector<int> &key_attrs = cluster_index_->GetKeyAttrs();
+  std::stable_sort(
+      tuples.begin(), tuples.end(), [&](const Tuple &lhs, const Tuple &rhs) {
+        for (int column : key_attrs) {
+          Value lhs_value = lhs.GetValue(schema_, column);
+          Value rhs_value = rhs.GetValue(schema_, column);
+          if (lhs_value.IsNull() || rhs_value.IsNull()) {
+            if (lhs_value.IsNull() != rhs_value.IsNull())
+              return lhs_value.IsNull();
+            continue;
+          }
+          if (lhs_value.CompareLessThan(rhs_value) == CMP_TRUE)
+            return true;
+          if (rhs_value.CompareLessThan(lhs_value) == CMP_TRUE)
+            return false;
+        }
+        return false;
+      });
+}
+
+void Cursor::ScanRanges(const std::vector<Index *> &indexes,
+                        const Tuple *low_key, bool low_inclusive,
+                        const Tuple *high_key, bool high_inclusive) {
+  delete sort_;
+  sort_ = nullptr;
+  delete index_iterator_;
+  index_iterator_ = nullptr;
+  index_scan_ = true;
+  covering_index_ = nullptr;
+  row_loaded_ = false;
+  std::vector<RID> rids;
+  for (auto index : indexes) {
+    ScanRange(index, low_key, low_inclusive, high_key, high_inclusive, false,
+              true);
+    rids.insert(rids.end(), rids_.begin(), rids_.end());
+  }
+  std::sort(rids.begin(), rids.end(), [](const RID &lhs, const RID &rhs) {
+    return lhs.Get() < rhs.Get();
+  });
+  rids_.swap(rids);
+  rid_index_ = 0;
+}
+
+/*
+ * The leaves are let go before the first row. By page, rows of a page are
+ * fetched one after the other and the page stays pinned between them
+ */
+void Cursor::ReadRids(bool by_page) {
+  rids_.clear();
+  for (; !index_iterator_->isEnd(); index_iterator_->Next())
+    rids_.push_back(index_iterator_->GetRid());
+  delete index_iterator_;
+  index_iterator_ = nullptr;
+  if (by_page)
+    std::sort(rids_.begin(), rids_.end(), [](const RID &lhs, const RID &rhs) {
+      return lhs.Get() < rhs.Get();
+    });
+  rid_index_ = 0;
+}
+
+void Cursor::SkipInvisible() {
+  for (; rid_index_ < rids_.size(); rid_index_++) {
+    LoadCurrentRow();
+    if (row_cached_)
+      return;
+  }
+}
+
+/*
+ * A scan that reads the index as it goes counts on every row it meets being
+ * as the snapshot sees it. That holds once no version of the table is newer
+ * than the snapshot, and until a writer pushes one
+ */
+void Cursor::BeginSnapshotScan(Index *index, bool key_order,
+                               bool descending) {
+  snapshot_index_ = index;
+  key_order_ = key_order;
+  descending_ = descending;
+  rids_.clear();
+  rid_index_ = 0;
+  versions_ = GetVersionCount();
+  std::vector<RID> changed;
+  GetChangedRids(changed);
+  changed_ = !changed.empty();
+  stable_ = !changed_;
+}
+
+void Cursor::AddChangedRows(bool by_page) {
+  std::unordered_set<RID> scanned(rids_.begin(), rids_.end());
+  AddChangedRows(by_page, scanned);
+}
+
+/*
+ * The index entries a writer takes out are versioned first, see
+ * TableHeap::PushVersion, so a row missing from the rids read is in the
+ * versions read after them
+ */
+void Cursor::AddChangedRows(bool by_page, std::unordered_set<RID> &scanned) {
+  size_t count = rids_.size();
+  std::vector<RID> changed;
+  GetChangedRids(changed);
+  for (auto &rid : changed)
+    if (scanned.insert(rid).second)
+      rids_.push_back(rid);
+  changed_ = false;
+  if (rids_.size() > count && by_page)
+    std::sort(rids_.begin(), rids_.end(), [](const RID &lhs, const RID &rhs) {
+      return lhs.Get() < rhs.Get();
+    });
+  if (rids_.size() > count && key_order_) {
+    std::vector<std::pair<int, bool>> order;
+    for (int column : snapshot_index_->GetKeyAttrs())
+      order.emplace_back(column, descending_);
+    SortScan(order);
+    return;
+  }
+  row_loaded_ = false;
+  SkipInvisible();
+}
+
+uint64_t Cursor::GetVersionCount() {
+  uint64_t count = 0;
+  for (size_t i = 0; i < virtual_table_->GetPartitionCount(); i++)
+    count += virtual_table_->GetPartition(i)->table_heap_->GetVersionCount();
+  return count;
+}
+
+void Cursor::GetChangedRids(std::vector<RID> &rids) {
+  Transaction *txn = GetTransaction();
+  for (size_t i = 0; i < virtual_table_->GetPartitionCount(); i++)
+    txn->GetVersionStore()->GetChangedRids(
+        virtual_table_->GetPartition(i)->table_heap_->GetFirstPageId(),
+        txn->GetReadTimestamp(), rids);
+}
+
+/*
+ * A writer pushes the version of a row before it changes the row or takes
+ * out its entries, the entries met while the count stays the same are
+ * those of the snapshot. Rids read before the count changed miss rows, an
+ * iterator goes on as ReadChangedRows
+ */
+void Cursor::CheckSnapshot() {
+  if (GetVersionCount() == versions_) {
+    if (index_iterator_ != nullptr && !index_iterator_->isEnd())
+      rids_.push_back(index_iterator_->GetRid());
+    return;
+  }
+  stable_ = false;
+  if (index_iterator_ == nullptr)
+    changed_ = true;
+  else
+    ReadChangedRows();
+}
+
+/*
+ * A row not returned yet whose entry is gone had it after the last row
+ * returned, its key in the snapshot sorts after that one's. The rows left
+ * in the index and those changed go in key order then
+ */
+void Cursor::ReadChangedRows() {
+  std::unordered_set<RID> scanned(rids_.begin(), rids_.end());
+  rids_.clear();
+  for (; !index_iterator_->isEnd(); index_iterator_->Next())
+    if (scanned.insert(index_iterator_->GetRid()).second)
+      rids_.push_back(index_iterator_->GetRid());
+  delete index_iterator_;
+  index_iterator_ = nullptr;
+  covering_index_ = nullptr;
+  rid_index_ = 0;
+  AddChangedRows(false, scanned);
+}
+
+/*
+ * The sort keys are read from the batch of a sequential scan and from the
+ * tuple of an index scan, a row that can not be read is left out. The external sort spills to temporary pages when
+ * the keys of the scan do not fit its memory
+ */
+void Cursor::SortScan(const std::vector<std::pair<int, bool>> &order) {
+  TableHeap *table_heap = virtual_table_->table_heap_;
+  Schema *schema = virtual_table_->schema_;
+  Transaction *txn = GetTransaction();
+  Engine *engine = virtual_table_->connection_->engine_;
+  ExternalSort *sort =
+      new ExternalSort(engine->buffer_pool_manager_, nullptr,
+                       EXECUTION_MEMORY_LIMIT, engine->scan_threads_);
+  std::string key;
+  Tuple tuple;
+  std::string varchar;
+  for (; !isEof(); ++(*this)) {
+    key.clear();
+    RID rid;
+    if (IsIndexScan()) {
+      rid = GetIndexRid();
+      if (!virtual_table_->GetHeapOf(rid)->GetTuple(rid, tuple, txn))
+        continue;
+      for (auto &column : order)
+        AppendSortKey(key, tuple.GetValue(schema, column.first),
+                      column.second);
+    } else {
+      uint32_t row = GetBatchRow();
+      rid = batch_->GetRid(row);
+      for (auto &column : order) {
+        uint32_t len;
+        const char *str = schema->GetType(column.first) == TypeId::VARCHAR
+                              ? batch_->GetVarchar(column.first, row, len)
+                              : nullptr;
+        if (str != nullptr && IsOverflowLength(len)) {
+          varchar.clear();
+          table_heap->ReadOutOfLine(str, len, varchar);
+          AppendSortKey(key, Value(TypeId::VARCHAR, varchar), column.second);
+        } else {
+          AppendSortKey(key, batch_->GetValue(column.first, row),
+                        column.second);
+        }
+      }
+    }
+    sort->Add(key, reinterpret_cast<const char *>(&rid), sizeof(RID));
+  }
+  sort->Sort();
+
+  delete index_iterator_;
+  index_iterator_ = nullptr;
+  rids_.clear();
+  covering_index_ = nullptr;
+  index_scan_ = true;
+  row_loaded_ = false;
+  sort_ = sort;
+  sorted_row_ = sort_->Next();
+}
+
+int VtabNext(sqlite3_vtab_cursor *cur) {
+  // LOG_DEBUG("VtabNext");
+  Cursor *cursor = reinterpret_cast<Cursor *>(cur);
+  ++(*cursor);
+  return SQLITE_OK;
+}
+
+int VtabEof(sqlite3_vtab_cursor *cur) {
+  // LOG_DEBUG("VtabEof");
+  Cursor *cursor = reinterpret_cast<Cursor *>(cur);
+  return cursor->isEof();
+}
+
+/*
+ * Column values are handed to sqlite from their bytes, without building a
+ * Value. Text is copied by sqlite, the bytes are not valid past the call.
+ * The null sentinel of a type is sqlite's NULL, for IS NULL and aggregates
+ */
+static int ResultFixed(sqlite3_context *ctx, TypeId type, const char *ptr) {
+  if (type != TypeId::VARCHAR && Value::IsNullAt(ptr, type)) {
+    sqlite3_result_null(ctx);
+    return SQLITE_OK;
+  }
+  switch (type) {
+  case TypeId::TINYINT:
+  case TypeId::BOOLEAN:
+    sqlite3_result_int(ctx, (int)*reinterpret_cast<const int8_t *>(ptr));
+    break;
+  case TypeId::SMALLINT:
+    sqlite3_result_int(ctx, (int)*reinterpret_cast<const int16_t *>(ptr));
+    break;
+  case TypeId::INTEGER:
+    sqlite3_result_int(ctx, (int)*reinterpret_cast<const int32_t *>(ptr));
+    break;
+  case TypeId::BIGINT:
+    sqlite3_result_int64(
+        ctx, (sqlite3_int64)*reinterpret_cast<const int64_t *>(ptr));
+    break;
+  case TypeId::DECIMAL:
+    sqlite3_result_double(ctx, *reinterpret_cast<const double *>(ptr));
+    break;
+  default:
+    return SQLITE_ERROR;
+  } // End of switch
+  return SQLITE_OK;
+}
+
+// len counts the terminating null byte, nullptr for null
+static void ResultVarchar(sqlite3_context *ctx, const char *str, uint32_t len) {
+  if (str == nullptr)
+    sqlite3_result_null(ctx);
+  else
+    sqlite3_result_text(ctx, str, strnlen(str, len), SQLITE_TRANSIENT);
+}
+
+// a varchar out of line, read from its overflow pages
+static int ResultOutOfLine(sqlite3_context *ctx, Cursor *cursor,
+                           const char *payload, uint32_t len) {
+  std::string value;
+  TableHeap *table_heap = cursor->GetVirtualTable()->GetTableHeap();
+  if (!table_heap->ReadOutOfLine(payload, len, value))
+    return SQLITE_IOERR;
+  ResultVarchar(ctx, value.data(), value.size());
+  return SQLITE_OK;
+}
+
+int VtabColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) {
+  Cursor *cursor = reinterpret_cast<Cursor *>(cur);
+  Schema *schema = cursor->GetVirtualTable()->GetSchema();
+  TypeId type = schema->GetType(i);
+  // sequential scan reads the rows decoded in the batch
+  if (!cursor->IsIndexScan()) {
+    const RowBatch &batch = cursor->GetBatch();
+    uint32_t row = cursor->GetBatchRow();
+    if (type != TypeId::VARCHAR)
+      return ResultFixed(ctx, type, batch.GetFixed(i, row));
+    uint32_t len;
+    const char *str = batch.GetVarchar(i, row, len);
+    if (str != nullptr && IsOverflowLength(len))
+      return ResultOutOfLine(ctx, cursor, str, len);
+    ResultVarchar(ctx, str, len);
+    return SQLITE_OK;
+  }
+
+  // covering index scan reads the column from the leaf entry, the row is
+  // locked all the same
+  const char *entry = cursor->GetCurrentEntry();
+  if (entry != nullptr) {
+    if (!cursor->LockCurrentRow()) {
+      sqlite3_result_null(ctx);
+      return SQLITE_OK;
+    }
+    return ResultFixed(ctx, type,
+                       entry + cursor->GetCoveringIndex()
+                                   ->GetMetadata()
+                                   ->GetLeafOffset(i));
+  }
+
+  // index scan reads the tuple bytes in the page, under its latch
+  if (!cursor->LatchCurrentData()) {
+    sqlite3_result_null(ctx);
+    return SQLITE_OK;
+  }
+  const char *ptr = cursor->GetCurrentBytes(schema->GetOffset(i));
+  int rc = SQLITE_OK;
+  if (type != TypeId::VARCHAR) {
+    rc = ResultFixed(ctx, type, ptr);
+  } else {
+    // the column holds the offset of [length][bytes] within the tuple
+    const char *varlen =
+        cursor->GetCurrentBytes(*reinterpret_cast<const int32_t *>(ptr));
+    uint32_t len = *reinterpret_cast<const uint32_t *>(varlen);
+    if (IsOverflowLength(len))
+      rc = ResultOutOfLine(ctx, cursor, varlen + sizeof(uint32_t), len);
+    else
+      ResultVarchar(ctx,
+                    len == PELOTON_VALUE_NULL ? nullptr
+                                              : varlen + sizeof(uint32_t),
+                    len);
+  }
+  cursor->UnlatchCurrentData();
+  return rc;
+}
+
+int VtabRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid) {
+  // LOG_DEBUG("VtabRowid");
+  Cursor *cursor = reinterpret_cast<Cursor *>(cur);
+  // return rid of the tuple that cursor currently points at
+  *pRowid = cursor->GetCurrentRid();
+  return SQLITE_OK;
+}
+
+int VtabUpdate(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
+               sqlite_int64 *pRowid) {
+  // LOG_DEBUG("VtabUpdate");
+  VirtualTable *table = reinterpret_cast<VirtualTable *>(pVTab);
+  if (table->GetConnection()->engine_->log_replica_ != nullptr)
+    return SQLITE_READONLY;
+  // rows are only buffered by inserts in a row, a delete or update may be
+  // of one of them
+  if (argc == 1 || sqlite3_value_type(argv[0]) != SQLITE_NULL)
+    table->FlushInserts();
+  // The single row with rowid equal to argv[0] is deleted
+  if (argc == 1) {
+    const RID rid(sqlite3_value_int64(argv[0]));
+    // the partition of the row is told by its rid
+    VirtualTable *partition = table->GetPartitionOf(rid);
+    // delete entry from index
+    partition->DeleteEntry(rid);
+    // delete tuple from table heap
+    partition->DeleteTuple(rid);
+  }
+  // A new row is inserted with a rowid argv[1] and column values in argv[2] and
+  // following. If argv[1] is an SQL NULL, the a new unique rowid is generated
+  // automatically.
+  else if (argc > 1 && sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+    Schema *schema = table->GetSchema();
+    Tuple tuple = ConstructTuple(schema, (argv + 2), table->GetArena());
+    // written with the rows inserted after it into table heap and index of
+    // the partition of its key
+    table->GetPartitionOf(tuple)->BufferInsert(tuple);
+  }
+  // The row with rowid argv[0] is updated with new values in argv[2] and
+  // following parameters.
+  else if (argc > 1 && sqlite3_value_type(argv[0]) != SQLITE_NULL) {
+    Schema *schema = table->GetSchema();
+    Tuple tuple = ConstructTuple(schema, (argv + 2), table->GetArena());
+    RID rid(sqlite3_value_int64(argv[0]));
+    // a row whose partition key moves it to another partition is deleted
+    // from its own and inserted into the other
+    VirtualTable *partition = table->GetPartitionOf(rid);
+    VirtualTable *new_partition = table->GetPartitionOf(tuple);
+    // an index only changes with its key or the rid
+    uint64_t changed = partition == new_partition
+                           ? partition->GetChangedIndexes(tuple, rid)
+                           : VTAB_ALL_INDEXES;
+    partition->DeleteEntry(rid, changed);
+    // if true, then update succeed, rid keep the same
+    // else, delete & insert
+    if (partition != new_partition ||
+        partition->UpdateTuple(tuple, rid) == false) {
+      partition->DeleteEntry(rid, ~changed);
+      partition->DeleteTuple(rid);
+      // rid should be different
+      new_partition->InsertTuple(tuple, rid);
+      changed = VTAB_ALL_INDEXES;
+    }
+    new_partition->InsertEntry(tuple, rid, changed);
+    if (partition != table)
+      partition->GetArena()->Reset();
+  }
+  // the tuple and keys of this row are done with
+  table->GetArena()->Reset();
+  // e.g. the victim of a deadlock with another connection, sqlite rolls
+  // the transaction back
+  if (table->GetTransaction()->GetState() == TransactionState::ABORTED)
+    return SQLITE_ABORT;
+  return SQLITE_OK;
+}
+
+int VtabBegin(sqlite3_vtab *pVTab) {
+  // LOG_DEBUG("VtabBegin");
+  Connection *connection =
+      reinterpret_cast<VirtualTable *>(pVTab)->GetConnection();
+  // create new transaction(write operation will call this method). Every
+  // table written in one sqlite transaction shares it, its locks would be
+  // held forever if it was replaced. The snapshot of reads whose cursors
+  // are still open is kept for them, it can not write
+  Transaction *transaction = connection->transaction_;
+  if (transaction != nullptr && !transaction->IsSnapshot())
+    return SQLITE_OK;
+  if (transaction != nullptr) {
+    connection->snapshots_.push_back(transaction);
+    connection->read_transaction_ = false;
+  }
+  connection->transaction_ = connection->engine_->transaction_manager_->Begin();
+  return SQLITE_OK;
+}
+
+// the transaction of connection is over, it goes back to the transaction
+// manager
+static void EndTransaction(Connection *connection) {
+  connection->engine_->transaction_manager_->Release(connection->transaction_);
+  connection->transaction_ = nullptr;
+  connection->read_transaction_ = false;
+  connection->savepoints_.clear();
+}
+
+/*
+ * The buffered rows are written before the commit, sqlite ignores what
+ * xCommit returns but rolls back when they can not be, e.g. when the lock of
+ * a row dies under wait-die
+ */
+int VtabSync(sqlite3_vtab *pVTab) {
+  Connection *connection =
+      reinterpret_cast<VirtualTable *>(pVTab)->GetConnection();
+  auto transaction = connection->transaction_;
+  if (transaction == nullptr)
+    return SQLITE_OK;
+  auto tables = connection->buffered_tables_;
+  for (auto table : tables)
+    table->FlushInserts();
+  if (transaction->GetState() == TransactionState::ABORTED)
+    return SQLITE_ABORT;
+  return SQLITE_OK;
+}
+
+/*
+ * A transaction aborted on its way, e.g. as the victim of a deadlock with
+ * another connection, is rolled back instead
+ */
+int VtabCommit(sqlite3_vtab *pVTab) {
+  // LOG_DEBUG("VtabCommit");
+  Connection *connection =
+      reinterpret_cast<VirtualTable *>(pVTab)->GetConnection();
+  auto transaction = connection->transaction_;
+  if (transaction == nullptr)
+    return SQLITE_OK;
+  if (transaction->GetState() == TransactionState::ABORTED) {
+    VtabRollback(pVTab);
+    return SQLITE_ABORT;
+  }
+  // the buffered rows are written by the transaction
+  auto tables = connection->buffered_tables_;
+  for (auto table : tables)
+    table->FlushInserts();
+  // get txn manager of the engine
+  auto transaction_manager = connection->engine_->transaction_manager_;
+  // invoke transaction manager to delete
+  transaction_manager->Commit(transaction);
+  EndTransaction(connection);
+  return SQLITE_OK;
+}
+
+int VtabRollback(sqlite3_vtab *pVTab) {
+  // LOG_DEBUG("VtabRollback");
+  Connection *connection =
+      reinterpret_cast<VirtualTable *>(pVTab)->GetConnection();
+  auto transaction = connection->transaction_;
+  if (transaction == nullptr)
+    return SQLITE_OK;
+  // rows still buffered were never written
+  auto tables = connection->buffered_tables_;
+  for (auto table : tables)
+    table->DiscardInserts();
+  // undo the heap and index writes, then release the locks
+  connection->engine_->transaction_manager_->Abort(transaction);
+  EndTransaction(connection);
+  return SQLITE_OK;
+}
+
+/*
+ * Savepoint levels are shared by every table of the sqlite transaction, as
+ * the transaction of the connection is, each table is told of them and the
+ * first one sets where a level is. Buffered rows are written at a
+ * savepoint, what the transaction wrote before it is then in its write sets
+ */
+int VtabSavepoint(sqlite3_vtab *pVTab, int iSavepoint) {
+  // LOG_DEBUG("VtabSavepoint");
+  Connection *connection =
+      reinterpret_cast<VirtualTable *>(pVTab)->GetConnection();
+  auto transaction = connection->transaction_;
+  if (transaction == nullptr)
+    return SQLITE_OK;
+  auto &savepoints = connection->savepoints_;
+  if (savepoints.size() > static_cast<size_t>(iSavepoint))
+    return SQLITE_OK;
+  auto tables = connection->buffered_tables_;
+  for (auto table : tables)
+    table->FlushInserts();
+  savepoints.resize(iSavepoint + 1, transaction->GetSavepoint());
+  return SQLITE_OK;
+}
+
+int VtabRelease(sqlite3_vtab *pVTab, int iSavepoint) {
+  // LOG_DEBUG("VtabRelease");
+  // the writes after the released levels belong to the level below
+  auto &savepoints =
+      reinterpret_cast<VirtualTable *>(pVTab)->GetConnection()->savepoints_;
+  if (savepoints.size() > static_cast<size_t>(iSavepoint))
+    savepoints.resize(iSavepoint);
+  return SQLITE_OK;
+}
+
+int VtabRollbackTo(sqlite3_vtab *pVTab, int iSavepoint) {
+  // LOG_DEBUG("VtabRollbackTo");
+  Connection *connection =
+      reinterpret_cast<VirtualTable *>(pVTab)->GetConnection();
+  auto transaction = connection->transaction_;
+  auto &savepoints = connection->savepoints_;
+  if (transaction == nullptr ||
+      savepoints.size() <= static_cast<size_t>(iSavepoint))
+    return SQLITE_OK;
+  // rows buffered since the savepoint were never written
+  auto tables = connection->buffered_tables_;
+  for (auto table : tables)
+    table->DiscardInserts();
+  // the level stays, the ones above it are gone
+  savepoints.resize(iSavepoint + 1);
+  connection->engine_->transaction_manager_->RollbackTo(transaction,
+                                                        savepoints.back());
+  return SQLITE_OK;
+}
+
+sqlite3_module VtableModule = {
+    2,              /* iVersion */
+    VtabCreate,     /* xCreate */
+    VtabConnect,    /* xConnect */
+    VtabBestIndex,  /* xBestIndex */
+    VtabDisconnect, /* xDisconnect */
+    VtabDisconnect, /* xDestroy */
+    VtabOpen,       /* xOpen - open a cursor */
+    VtabClose,      /* xClose - close a cursor */
+    VtabFilter,     /* xFilter - configure scan constraints */
+    VtabNext,       /* xNext - advance a cursor */
+    VtabEof,        /* xEof - check for end of scan */
+    VtabColumn,     /* xColumn - read data */
+    VtabRowid,      /* xRowid - read data */
+    VtabUpdate,     /* xUpdate */
+    VtabBegin,      /* xBegin */
+    VtabSync,       /* xSync */
+    VtabCommit,     /* xCommit */
+    VtabRollback,   /* xRollback */
+    0,              /* xFindMethod */
+    0,              /* xRename */
+    VtabSavepoint,  /* xSavepoint */
+    VtabRelease,    /* xRelease */
+    VtabRollbackTo, /* xRollbackTo */
+};
+
+/*
+ * vtable_stats has no xCreate, sqlite connects it on first use as
+ * SELECT * FROM vtable_stats
+ */
+int StatsConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+                 sqlite3_vtab **ppVtab, char **pzErr) {
+  int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(name TEXT, value INTEGER)");
+  if (rc != SQLITE_OK)
+    return rc;
+  StatsTable *table =
+      static_cast<StatsTable *>(sqlite3_malloc(sizeof(StatsTable)));
+  if (table == nullptr)
+    return SQLITE_NOMEM;
+  memset(table, 0, sizeof(StatsTable));
+  table->connection_ = static_cast<Connection *>(pAux);
+  *ppVtab = reinterpret_cast<sqlite3_vtab *>(table);
+  return SQLITE_OK;
+}
+
+int StatsBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo) {
+  pIdxInfo->estimatedCost = 10;
+  pIdxInfo->estimatedRows = 10;
+  return SQLITE_OK;
+}
+
+int StatsDisconnect(sqlite3_vtab *pVtab) {
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+int StatsOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+  StatsCursor *cursor = new StatsCursor;
+  *ppCursor = reinterpret_cast<sqlite3_vtab_cursor *>(cursor);
+  return SQLITE_OK;
+}
+
+int StatsClose(sqlite3_vtab_cursor *cur) {
+  delete reinterpret_cast<StatsCursor *>(cur);
+  return SQLITE_OK;
+}
+
+int StatsFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                const char *idxStr, int argc, sqlite3_value **argv) {
+  StatsCursor *cursor = reinterpret_cast<StatsCursor *>(pVtabCursor);
+  StatsTable *table = reinterpret_cast<StatsTable *>(pVtabCursor->pVtab);
+  BufferPoolManager *buffer_pool_manager =
+      table->connection_->engine_->buffer_pool_manager_;
+  BufferPoolStats stats = buffer_pool_manager->GetStats();
+  cursor->rows_ = {
+      {"pool_size", buffer_pool_manager->GetPoolSize()},
+      {"pool_frames", buffer_pool_manager->GetFrameCount()},
+      {"fetches", stats.fetches_},
+      {"hits", stats.hits_},
+      {"misses", stats.misses_},
+      {"evictions", stats.evictions_},
+      {"writebacks", stats.writebacks_},
+      {"pin_waits", stats.pin_waits_},
+      {"new_page_failures", stats.new_page_failures_},
+      {"fetch_failures", stats.fetch_failures_},
+      {"frame_waits", stats.frame_waits_},
+      {"frame_wait_ns", stats.frame_wait_ns_},
+      {"frame_wait_timeouts", stats.frame_wait_timeouts_},
+      {"admission_rejects", stats.admission_rejects_},
+      {"latch_waits", stats.latch_waits_},
+      {"latch_wait_ns", stats.latch_wait_ns_},
+      {"cleaned_pages", buffer_pool_manager->GetCleanedPageCount()},
+  };
+  PageCache *page_cache = buffer_pool_manager->GetDiskManager()->GetPageCache();
+  if (page_cache != nullptr) {
+    cursor->rows_.emplace_back("page_cache_hits", page_cache->GetHits());
+    cursor->rows_.emplace_back("page_cache_pages", page_cache->GetPageCount());
+    cursor->rows_.emplace_back("page_cache_bytes", page_cache->GetSize());
+  }
+  Engine *engine = table->connection_->engine_;
+  // summed over the open tables, a closed table takes its counts along
+  if (engine->row_cache_ > 0) {
+    uint64_t hits = 0, misses = 0, rows = 0;
+    {
+      std::lock_guard<std::mutex> guard(engine->tables_latch_);
+      for (auto &open_table : engine->tables_) {
+        std::vector<TableData *> heaps{open_table.second};
+        heaps.insert(heaps.end(), open_table.second->partitions_.begin(),
+                     open_table.second->partitions_.end());
+        for (TableData *data : heaps) {
+          RowCache *row_cache = data->table_heap_->GetRowCache();
+          if (row_cache == nullptr)
+            continue;
+          hits += row_cache->GetHits();
+          misses += row_cache->GetMisses();
+          rows += row_cache->GetSize();
+        }
+      }
+    }
+    cursor->rows_.emplace_back("row_cache_hits", hits);
+    cursor->rows_.emplace_back("row_cache_misses", misses);
+    cursor->rows_.emplace_back("row_cache_rows", rows);
+    cursor->rows_.emplace_back(
+        "row_cache_hit_pct", hits + misses == 0 ? 0 : hits * 100 / (hits + misses));
+  }
+  // of the process, every engine included
+  cursor->rows_.emplace_back("memory_budget", MemoryTracker::GetBudget());
+  for (int i = 0; i < MEMORY_COMPONENTS; ++i) {
+    MemoryComponent component = static_cast<MemoryComponent>(i);
+    cursor->rows_.emplace_back(
+        std::string("memory_") + MemoryTracker::GetName(component),
+        MemoryTracker::GetUsage(component));
+  }
+  if (engine->log_shipper_ != nullptr) {
+    cursor->rows_.emplace_back("replication_replicas",
+                               engine->log_shipper_->GetReplicaCount());
+    cursor->rows_.emplace_back("replication_shipped_bytes",
+                               engine->log_shipper_->GetShippedBytes());
+  }
+  if (engine->log_replica_ != nullptr) {
+    LogReplica *log_replica = engine->log_replica_;
+    cursor->rows_.emplace_back("replication_connected",
+                               log_replica->IsConnected());
+    cursor->rows_.emplace_back("replication_applied_records",
+                               log_replica->GetAppliedRecords());
+    cursor->rows_.emplace_back("replication_lag_bytes",
+                               log_replica->GetLagBytes());
+    cursor->rows_.emplace_back("replication_lag_us",
+                               log_replica->GetLag().count());
+  }
+  // e.g. disk_read_count, disk_read_p99_ns
+  for (int i = 0; i < LATENCY_TYPES; ++i) {
+    LatencyType type = static_cast<LatencyType>(i);
+    LatencyHistogram histogram = LatencyStats::GetHistogram(type);
+    std::string name = LatencyStats::GetName(type);
+    cursor->rows_.emplace_back(name + "_count", histogram.GetCount());
+    cursor->rows_.emplace_back(name + "_p50_ns", histogram.GetPercentile(0.5));
+    cursor->rows_.emplace_back(name + "_p99_ns",
+                               histogram.GetPercentile(0.99));
+    cursor->rows_.emplace_back(name + "_p999_ns",
+                               histogram.GetPercentile(0.999));
+    cursor->rows_.emplace_back(name + "_max_ns", histogram.GetMax());
+  }
+  // e.g. page_latch_acquires, page_latch_wait_ns, zero unless profiling
+  for (int i = 0; i < LATCH_CLASSES; ++i) {
+    LatchClass latch_class = static_cast<LatchClass>(i);
+    LatchClassStats latch_stats = LatchStats::GetStats(latch_class);
+    std::string name = std::string(LatchStats::GetName(latch_class)) + "_latch";
+    cursor->rows_.emplace_back(name + "_acquires", latch_stats.acquires_);
+    cursor->rows_.emplace_back(name + "_waits", latch_stats.waits_);
+    cursor->rows_.emplace_back(name + "_wait_ns", latch_stats.wait_ns_);
+  }
+  cursor->row_ = 0;
+  return SQLITE_OK;
+}
+
+int StatsNext(sqlite3_vtab_cursor *cur) {
+  ++reinterpret_cast<StatsCursor *>(cur)->row_;
+  return SQLITE_OK;
+}
+
+int StatsEof(sqlite3_vtab_cursor *cur) {
+  StatsCursor *cursor = reinterpret_cast<StatsCursor *>(cur);
+  return cursor->row_ >= cursor->rows_.size();
+}
+
+int StatsColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) {
+  StatsCursor *cursor = reinterpret_cast<StatsCursor *>(cur);
+  auto &row = cursor->rows_[cursor->row_];
+  if (i == 0)
+    sqlite3_result_text(ctx, row.first.c_str(), -1, SQLITE_TRANSIENT);
+  else
+    sqlite3_result_int64(ctx, row.second);
+  return SQLITE_OK;
+}
+
+int StatsRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid) {
+  *pRowid = reinterpret_cast<StatsCursor *>(cur)->row_;
+  return SQLITE_OK;
+}
+
+sqlite3_module StatsModule = {
+    0,               /* iVersion */
+    0,               /* xCreate - eponymous only */
+    StatsConnect,    /* xConnect */
+    StatsBestIndex,  /* xBestIndex */
+    StatsDisconnect, /* xDisconnect */
+    0,               /* xDestroy */
+    StatsOpen,       /* xOpen - open a cursor */
+    StatsClose,      /* xClose - close a cursor */
+    StatsFilter,     /* xFilter - configure scan constraints */
+    StatsNext,       /* xNext - advance a cursor */
+    StatsEof,        /* xEof - check for end of scan */
+    StatsColumn,     /* xColumn - read data */
+    StatsRowid,      /* xRowid - read data */
+    0,               /* xUpdate */
+    0,               /* xBegin */
+    0,               /* xSync */
+    0,               /* xCommit */
+    0,               /* xRollback */
+    0,               /* xFindMethod */
+    0,               /* xRename */
+    0,               /* xSavepoint */
+    0,               /* xRelease */
+    0,               /* xRollbackTo */
+};
+
+/*
+ * The first connection to open a vtable_lsm table opens its tree, the others
+ * share it. build runs under the latch of the open tables, what it throws
+ * is passed on
+ */
+static LsmTableData *
+OpenLsmTable(Engine *engine, const std::string &name,
+             const std::function<LsmTableData *()> &build) {
+  std::lock_guard<std::mutex> guard(engine->tables_latch_);
+  LsmTableData *&table = engine->lsm_tables_[name];
+  if (table == nullptr) {
+    try {
+      table = build();
+    } catch (Exception &e) {
+      engine->lsm_tables_.erase(name);
+      throw;
+    }
+  }
+  table->refs_++;
+  return table;
+}
+
+// the last connection writes the memtable of the tree as it closes it
+static void CloseLsmTable(Engine *engine, const std::string &name,
+                          LsmTableData *table) {
+  std::lock_guard<std::mutex> guard(engine->tables_latch_);
+  if (--table->refs_ > 0)
+    return;
+  auto it = engine->lsm_tables_.find(name);
+  if (it != engine->lsm_tables_.end() && it->second == table)
+    engine->lsm_tables_.erase(it);
+  delete table->tree_;
+  delete table;
+}
+
+/*
+ * The tree of a new table is recorded in the catalog by its manifest page,
+ * an existing one is found there. Nothing else is, the schema is sqlite's
+ */
+static int LsmInit(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+                   sqlite3_vtab **ppVtab, char **pzErr, bool create) {
+  Connection *connection = static_cast<Connection *>(pAux);
+  Engine *engine = connection->engine_;
+  if (argc != 4) {
+    *pzErr = sqlite3_mprintf("vtable_lsm takes the schema only");
+    return SQLITE_ERROR;
+  }
+  if (engine->log_replica_ != nullptr) {
+    *pzErr = sqlite3_mprintf("vtable_lsm tables are not replicated");
+    return SQLITE_ERROR;
+  }
+  std::string table_name(argv[2]);
+  if (create && IsReservedName(table_name)) {
+    *pzErr = sqlite3_mprintf("names starting with '@' are reserved");
+    return SQLITE_ERROR;
+  }
+  std::string schema_string(argv[3]);
+  schema_string = schema_string.substr(1, (schema_string.size() - 2));
+
+  LsmTableData *data;
+  try {
+    data = OpenLsmTable(engine, table_name, [&]() {
+      Catalog *catalog = engine->catalog_;
+      page_id_t manifest_page_id = INVALID_PAGE_ID;
+      if (!create)
+        catalog->GetRootId(table_name, manifest_page_id);
+      std::unique_ptr<LsmTree> tree(
+          new LsmTree(engine->buffer_pool_manager_, manifest_page_id));
+      if (create)
+        PutDurableRecord(engine, table_name, tree->GetManifestPageId());
+      LsmTableData *table_data = new LsmTableData;
+      table_data->shared_schema_ = GetSharedSchema(schema_string);
+      table_data->schema_ = table_data->shared_schema_.get();
+      table_data->tree_ = tree.release();
+      table_data->refs_ = 0;
+      return table_data;
+    });
+  } catch (Exception &e) {
+    // e.g. no page left for the manifest
+    *pzErr = sqlite3_mprintf("%s", e.what());
+    return SQLITE_ERROR;
+  }
+  LsmTable *table = new LsmTable;
+  memset(&table->base_, 0, sizeof(sqlite3_vtab));
+  table->connection_ = connection;
+  table->name_ = table_name;
+  table->data_ = data;
+
+  schema_string = "CREATE TABLE X(" + schema_string + ");";
+  assert(sqlite3_declare_vtab(db, schema_string.c_str()) == SQLITE_OK);
+
+  *ppVtab = reinterpret_cast<sqlite3_vtab *>(table);
+  return SQLITE_OK;
+}
+
+int LsmCreate(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+              sqlite3_vtab **ppVtab, char **pzErr) {
+  return LsmInit(db, pAux, argc, argv, ppVtab, pzErr, true);
+}
+
+int LsmConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+               sqlite3_vtab **ppVtab, char **pzErr) {
+  return LsmInit(db, pAux, argc, argv, ppVtab, pzErr, false);
+}
+
+/*
+ * Equality on the rowid is a point lookup, which the bloom filters of the
+ * runs answer mostly without reading them. Otherwise the tree is merged
+ * between the bounds on the rowid, in rowid order
+ */
+int LsmBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo) {
+  LsmTable *table = reinterpret_cast<LsmTable *>(tab);
+  double rows =
+      std::max(static_cast<double>(table->data_->tree_->GetEntryCount()), 1.0);
+  int point = -1, low = -1, high = -1;
+  int scan = 0;
+  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+    auto &constraint = pIdxInfo->aConstraint[i];
+    if (!constraint.usable || constraint.iColumn != -1)
+      continue;
+    switch (constraint.op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+      point = i;
+      break;
+    case SQLITE_INDEX_CONSTRAINT_GT:
+    case SQLITE_INDEX_CONSTRAINT_GE:
+      low = i;
+      break;
+    case SQLITE_INDEX_CONSTRAINT_LT:
+    case SQLITE_INDEX_CONSTRAINT_LE:
+      high = i;
+      break;
+    default:
+      break;
+    }
+  }
+  if (point >= 0) {
+    pIdxInfo->aConstraintUsage[point].argvIndex = 1;
+    pIdxInfo->aConstraintUsage[point].omit = 1;
+    pIdxInfo->idxNum = VTAB_POINT_SCAN;
+    pIdxInfo->estimatedCost = 1;
+    pIdxInfo->estimatedRows = 1;
+    pIdxInfo->orderByConsumed = 1;
+    return SQLITE_OK;
+  }
+  int argument = 0;
+  if (low >= 0) {
+    pIdxInfo->aConstraintUsage[low].argvIndex = ++argument;
+    scan |= VTAB_LOW_BOUND;
+    if (pIdxInfo->aConstraint[low].op == SQLITE_INDEX_CONSTRAINT_GE)
+      scan |= VTAB_LOW_INCLUSIVE;
+    rows *= VTAB_RANGE_SELECTIVITY * 2;
+  }
+  if (high >= 0) {
+    pIdxInfo->aConstraintUsage[high].argvIndex = ++argument;
+    scan |= VTAB_HIGH_BOUND;
+    if (pIdxInfo->aConstraint[high].op == SQLITE_INDEX_CONSTRAINT_LE)
+      scan |= VTAB_HIGH_INCLUSIVE;
+    rows *= VTAB_RANGE_SELECTIVITY * 2;
+  }
+  pIdxInfo->idxNum = scan;
+  pIdxInfo->estimatedCost = rows;
+  pIdxInfo->estimatedRows = static_cast<sqlite3_int64>(rows);
+  if (pIdxInfo->nOrderBy == 1 && pIdxInfo->aOrderBy[0].iColumn == -1 &&
+      !pIdxInfo->aOrderBy[0].desc)
+    pIdxInfo->orderByConsumed = 1;
+  return SQLITE_OK;
+}
+
+int LsmDisconnect(sqlite3_vtab *pVtab) {
+  LsmTable *table = reinterpret_cast<LsmTable *>(pVtab);
+  CloseLsmTable(table->connection_->engine_, table->name_, table->data_);
+  delete table;
+  return SQLITE_OK;
+}
+
+int LsmOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+  LsmCursor *cursor = new LsmCursor;
+  *ppCursor = reinterpret_cast<sqlite3_vtab_cursor *>(cursor);
+  return SQLITE_OK;
+}
+
+int LsmClose(sqlite3_vtab_cursor *cur) {
+  delete reinterpret_cast<LsmCursor *>(cur);
+  return SQLITE_OK;
+}
+
+/*
+ * Rowid bound of a constraint value, loosened to an integer as sqlite checks
+ * the rows again. False if no rowid can satisfy it, e.g. rowid = NULL or a
+ * low bound of text, which sorts above every number
+ */
+static bool LsmBound(sqlite3_value *value, bool low, bool inclusive,
+                     int64_t &bound) {
+  switch (sqlite3_value_numeric_type(value)) {
+  case SQLITE_INTEGER:
+    bound = sqlite3_value_int64(value);
+    if (inclusive)
+      return true;
+    if (low ? bound == INT64_MAX : bound == INT64_MIN)
+      return false;
+    bound += low ? 1 : -1;
+    return true;
+  case SQLITE_FLOAT: {
+    double number = sqlite3_value_double(value);
+    if (std::isnan(number))
+      return false;
+    number = low ? std::floor(number) : std::ceil(number);
+    if (number >= 9223372036854775807.0)
+      bound = INT64_MAX;
+    else if (number <= -9223372036854775808.0)
+      bound = INT64_MIN;
+    else
+      bound = static_cast<int64_t>(number);
+    return true;
+  }
+  case SQLITE_NULL:
+    return false;
+  default:
+    bound = INT64_MAX;
+    return !low;
+  }
+}
+
+static void LsmLoad(LsmCursor *cursor) {
+  auto &iterator = cursor->iterator_;
+  cursor->eof_ = iterator->isEnd();
+  if (!cursor->eof_) {
+    cursor->key_ = iterator->GetKey();
+    cursor->row_ = iterator->GetRow();
+  }
+}
+
+int LsmFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum, const char *idxStr,
+              int argc, sqlite3_value **argv) {
+  LsmCursor *cursor = reinterpret_cast<LsmCursor *>(pVtabCursor);
+  LsmTree *tree =
+      reinterpret_cast<LsmTable *>(pVtabCursor->pVtab)->data_->tree_;
+  cursor->iterator_.reset();
+  cursor->eof_ = true;
+  if (idxNum & VTAB_POINT_SCAN) {
+    // a number with a fraction has no rowid equal to it
+    int64_t low, high;
+    if (LsmBound(argv[0], true, true, low) &&
+        LsmBound(argv[0], false, true, high) && low == high &&
+        tree->Get(low, cursor->row_)) {
+      cursor->key_ = low;
+      cursor->eof_ = false;
+    }
+    return SQLITE_OK;
+  }
+  int64_t low = INT64_MIN, high = INT64_MAX;
+  int argument = 0;
+  if ((idxNum & VTAB_LOW_BOUND) &&
+      !LsmBound(argv[argument++], true, idxNum & VTAB_LOW_INCLUSIVE, low))
+    return SQLITE_OK;
+  if ((idxNum & VTAB_HIGH_BOUND) &&
+      !LsmBound(argv[argument++], false, idxNum & VTAB_HIGH_INCLUSIVE, high))
+    return SQLITE_OK;
+  if (low > high)
+    return SQLITE_OK;
+  cursor->iterator_.reset(new LsmTree::Iterator(tree, low, high));
+  LsmLoad(cursor);
+  return SQLITE_OK;
+}
+
+int LsmNext(sqlite3_vtab_cursor *cur) {
+  LsmCursor *cursor = reinterpret_cast<LsmCursor *>(cur);
+  if (cursor->iterator_ == nullptr) {
+    cursor->eof_ = true;
+    return SQLITE_OK;
+  }
+  cursor->iterator_->Next();
+  LsmLoad(cursor);
+  return SQLITE_OK;
+}
+
+int LsmEof(sqlite3_vtab_cursor *cur) {
+  return reinterpret_cast<LsmCursor *>(cur)->eof_;
+}
+
+// the row is the bytes of a tuple, read as an index scan reads them
+int LsmColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) {
+  LsmCursor *cursor = reinterpret_cast<LsmCursor *>(cur);
+  Schema *schema = reinterpret_cast<LsmTable *>(cur->pVtab)->data_->schema_;
+  TypeId type = schema->GetType(i);
+  const char *data = cursor->row_.data();
+  const char *ptr = data + schema->GetOffset(i);
+  if (type != TypeId::VARCHAR)
+    return ResultFixed(ctx, type, ptr);
+  const char *varlen = data + *reinterpret_cast<const int32_t *>(ptr);
+  uint32_t len = *reinterpret_cast<const uint32_t *>(varlen);
+  ResultVarchar(ctx,
+                len == PELOTON_VALUE_NULL ? nullptr : varlen + sizeof(uint32_t),
+                len);
+  return SQLITE_OK;
+}
+
+int LsmRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid) {
+  *pRowid = reinterpret_cast<LsmCursor *>(cur)->key_;
+  return SQLITE_OK;
+}
+
+// the row of key is replaced by row, or removed if it is nullptr. Its old
+// row is kept for a rollback
+static void LsmWrite(LsmTable *table, int64_t key, const Tuple *row) {
+  LsmTree *tree = table->data_->tree_;
+  LsmUndo undo;
+  undo.key_ = key;
+  undo.existed_ = tree->Get(key, undo.row_);
+  if (row != nullptr)
+    tree->Put(key, row->GetData(), row->GetLength());
+  else
+    tree->Remove(key);
+  table->undo_.push_back(std::move(undo));
+}
+
+/*
+ * A new row takes the next rowid unless it names one. A rowid already taken
+ * fails the statement, before anything of the row is written
+ */
+int LsmUpdate(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
+              sqlite_int64 *pRowid) {
+  LsmTable *table = reinterpret_cast<LsmTable *>(pVTab);
+  LsmTree *tree = table->data_->tree_;
+  int rc = SQLITE_OK;
+  try {
+    if (argc == 1) {
+      LsmWrite(table, sqlite3_value_int64(argv[0]), nullptr);
+    } else {
+      bool insert = sqlite3_value_type(argv[0]) == SQLITE_NULL;
+      int64_t key = sqlite3_value_type(argv[1]) == SQLITE_NULL
+                        ? tree->NextKey()
+                        : sqlite3_value_int64(argv[1]);
+      bool moved = !insert && sqlite3_value_int64(argv[0]) != key;
+      std::string row;
+      if ((insert || moved) && tree->Get(key, row)) {
+        sqlite3_free(pVTab->zErrMsg);
+        pVTab->zErrMsg =
+            sqlite3_mprintf("rowid %lld is taken", static_cast<long long>(key));
+        rc = SQLITE_CONSTRAINT;
+      } else {
+        Tuple tuple = ConstructTuple(table->data_->schema_, (argv + 2),
+                                     &table->arena_);
+        if (moved)
+          LsmWrite(table, sqlite3_value_int64(argv[0]), nullptr);
+        LsmWrite(table, key, &tuple);
+        *pRowid = key;
+      }
+    }
+  } catch (Exception &e) {
+    // a row too large for a page
+    sqlite3_free(pVTab->zErrMsg);
+    pVTab->zErrMsg = sqlite3_mprintf("%s", e.what());
+    rc = SQLITE_ERROR;
+  }
+  table->arena_.Reset();
+  return rc;
+}
+
+int LsmBegin(sqlite3_vtab *pVTab) {
+  reinterpret_cast<LsmTable *>(pVTab)->undo_.clear();
+  return SQLITE_OK;
+}
+
+int LsmCommit(sqlite3_vtab *pVTab) {
+  reinterpret_cast<LsmTable *>(pVTab)->undo_.clear();
+  return SQLITE_OK;
+}
+
+// the old rows are put back newest write first
+int LsmRollback(sqlite3_vtab *pVTab) {
+  LsmTable *table = reinterpret_cast<LsmTable *>(pVTab);
+  LsmTree *tree = table->data_->tree_;
+  for (auto it = table->undo_.rbegin(); it != table->undo_.rend(); ++it) {
+    if (it->existed_)
+      tree->Put(it->key_, it->row_.data(), it->row_.size());
+    else
+      tree->Remove(it->key_);
+  }
+  table->undo_.clear();
+  return SQLITE_OK;
+}
+
+sqlite3_module LsmModule = {
+    1,             /* iVersion */
+    LsmCreate,     /* xCreate */
+    LsmConnect,    /* xConnect */
+    LsmBestIndex,  /* xBestIndex */
+    LsmDisconnect, /* xDisconnect */
+    LsmDisconnect, /* xDestroy */
+    LsmOpen,       /* xOpen - open a cursor */
+    LsmClose,      /* xClose - close a cursor */
+    LsmFilter,     /* xFilter - configure scan constraints */
+    LsmNext,       /* xNext - advance a cursor */
+    LsmEof,        /* xEof - check for end of scan */
+    LsmColumn,     /* xColumn - read data */
+    LsmRowid,      /* xRowid - read data */
+    LsmUpdate,     /* xUpdate */
+    LsmBegin,      /* xBegin */
+    0,             /* xSync */
+    LsmCommit,     /* xCommit */
+    LsmRollback,   /* xRollback */
+    0,             /* xFindMethod */
+    0,             /* xRename */
+    0,             /* xSavepoint */
+    0,             /* xRelease */
+    0,             /* xRollbackTo */
+};
+
+/*
+ * Open table name with a reference taken, CloseTable lets go of it. The rows
+ * connection buffers for it are written first. Nullptr if no connection has
+ * it open
+ */
+static TableData *FindTable(Connection *connection, const std::string &name) {
+  Engine *engine = connection->engine_;
+  TableData *data = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(engine->tables_latch_);
+    auto it = engine->tables_.find(name);
+    if (it != engine->tables_.end()) {
+      data = it->second;
+      data->refs_++;
+    }
+  }
+  if (data == nullptr)
+    return nullptr;
+  auto tables = connection->buffered_tables_;
+  for (auto table : tables)
+    if (table->GetTableData() == data)
+      table->FlushInserts();
+  return data;
+}
+
+/*
+ * Keys of the operators are the bytes of a value behind a tag of its kind,
+ * so equal values have equal keys and the key can be read back. Integers
+ * are widened to 8 bytes, or made doubles when as_double is set to compare
+ * with a decimal column. False for null, the key is left empty
+ */
+#define KEY_TAG_INTEGER 'i'
+#define KEY_TAG_DECIMAL 'd'
+#define KEY_TAG_VARCHAR 't'
+#define KEY_TAG_NULL 'n'
+
+static bool EncodeKey(TableHeap *table_heap, const RowBatch &batch,
+                      int column, uint32_t row, bool as_double,
+                      std::string &key) {
+  key.clear();
+  TypeId type = batch.GetSchema()->GetType(column);
+  if (type == TypeId::VARCHAR) {
+    uint32_t len;
+    const char *str = batch.GetVarchar(column, row, len);
+    if (str == nullptr)
+      return false;
+    key.push_back(KEY_TAG_VARCHAR);
+    if (IsOverflowLength(len)) {
+      std::string value;
+      if (!table_heap->ReadOutOfLine(str, len, value))
+        throw Exception(EXCEPTION_TYPE_EXECUTOR, "can not read varchar");
+      key.append(value.data(), strnlen(value.data(), value.size()));
+    } else {
+      key.append(str, strnlen(str, len));
+    }
+    return true;
+  }
+  const char *ptr = batch.GetFixed(column, row);
+  if (Value::IsNullAt(ptr, type))
+    return false;
+  int64_t integer = 0;
+  double decimal = 0;
+  switch (type) {
+  case TypeId::TINYINT:
+  case TypeId::BOOLEAN:
+    integer = *reinterpret_cast<const int8_t *>(ptr);
+    break;
+  case TypeId::SMALLINT:
+    integer = *reinterpret_cast<const int16_t *>(ptr);
+    break;
+  case TypeId::INTEGER:
+    integer = *reinterpret_cast<const int32_t *>(ptr);
+    break;
+  case TypeId::BIGINT:
+    integer = *reinterpret_cast<const int64_t *>(ptr);
+    break;
+  case TypeId::DECIMAL:
+    decimal = *reinterpret_cast<const double *>(ptr);
+    as_double = true;
+    break;
+  default:
+    throw Exception(EXCEPTION_TYPE_EXECUTOR, "unsupported key type");
+  }
+  if (as_double) {
+    if (type != TypeId::DECIMAL)
+      decimal = static_cast<double>(integer);
+    // -0.0 and 0.0 are one key
+    if (decimal == 0)
+      decimal = 0;
+    key.push_back(KEY_TAG_DECIMAL);
+    key.append(reinterpret_cast<const char *>(&decimal), sizeof(double));
+  } else {
+    key.push_back(KEY_TAG_INTEGER);
+    key.append(reinterpret_cast<const char *>(&integer), sizeof(int64_t));
+  }
+  return true;
+}
+
+static void ResultKey(sqlite3_context *ctx, const std::string &key) {
+  if (key.empty() || key[0] == KEY_TAG_NULL) {
+    sqlite3_result_null(ctx);
+  } else if (key[0] == KEY_TAG_VARCHAR) {
+    sqlite3_result_text(ctx, key.data() + 1, key.size() - 1, SQLITE_TRANSIENT);
+  } else if (key[0] == KEY_TAG_DECIMAL) {
+    double decimal;
+    memcpy(&decimal, key.data() + 1, sizeof(double));
+    sqlite3_result_double(ctx, decimal);
+  } else {
+    int64_t integer;
+    memcpy(&integer, key.data() + 1, sizeof(int64_t));
+    sqlite3_result_int64(ctx, integer);
+  }
+}
+
+/*
+ * Value of a numeric column as a double for the aggregates, false for null
+ * and for varchars, which are counted but not summed
+ */
+static bool DecodeNumber(const RowBatch &batch, int column, uint32_t row,
+                         double &number) {
+  TypeId type = batch.GetSchema()->GetType(column);
+  if (type == TypeId::VARCHAR)
+    return false;
+  const char *ptr = batch.GetFixed(column, row);
+  if (Value::IsNullAt(ptr, type))
+    return false;
+  switch (type) {
+  case TypeId::TINYINT:
+  case TypeId::BOOLEAN:
+    number = *reinterpret_cast<const int8_t *>(ptr);
+    break;
+  case TypeId::SMALLINT:
+    number = *reinterpret_cast<const int16_t *>(ptr);
+    break;
+  case TypeId::INTEGER:
+    number = *reinterpret_cast<const int32_t *>(ptr);
+    break;
+  case TypeId::BIGINT:
+    number = static_cast<double>(*reinterpret_cast<const int64_t *>(ptr));
+    break;
+  case TypeId::DECIMAL:
+    number = *reinterpret_cast<const double *>(ptr);
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Sequential scan of the columns of table for an operator, callback of
+ * every row. It reads in the transaction of the connection, or in a
+ * snapshot of its own that commits at the end if the connection has none.
+ * False if the transaction was aborted on the way
+ */
+static bool ScanForOperator(
+    Connection *connection, TableData *data, const std::vector<int> &columns,
+    const std::function<void(const RowBatch &, uint32_t)> &callback) {
+  auto transaction_manager = connection->engine_->transaction_manager_;
+  Transaction *transaction = connection->transaction_;
+  bool own_transaction = transaction == nullptr;
+  if (own_transaction)
+    transaction = transaction_manager->BeginSnapshot();
+  uint64_t projection = 0;
+  for (int column : columns)
+    projection |= 1ULL << std::min(column, 63);
+  RowBatch batch(data->schema_);
+  batch.SetProjection(projection);
+  TableBatchIterator iterator(data->table_heap_, transaction);
+  while (iterator.Next(batch))
+    for (uint32_t i = 0; i < batch.GetSelectedCount(); i++)
+      callback(batch, batch.GetSelected(i));
+  bool is_aborted = transaction->GetState() == TransactionState::ABORTED;
+  if (own_transaction) {
+    if (is_aborted)
+      transaction_manager->Abort(transaction);
+    else
+      transaction_manager->Commit(transaction);
+    transaction_manager->Release(transaction);
+  }
+  return !is_aborted;
+}
+
+/*
+ * vtable_hash_join and vtable_hash_group have no xCreate either, they are
+ * called as table-valued functions with their hidden columns as arguments
+ */
+static int ExecutionConnect(sqlite3 *db, void *pAux, const char *sql,
+                            int first_argument, int argument_count,
+                            sqlite3_vtab **ppVtab) {
+  int rc = sqlite3_declare_vtab(db, sql);
+  if (rc != SQLITE_OK)
+    return rc;
+  ExecutionTable *table =
+      static_cast<ExecutionTable *>(sqlite3_malloc(sizeof(ExecutionTable)));
+  if (table == nullptr)
+    return SQLITE_NOMEM;
+  memset(table, 0, sizeof(ExecutionTable));
+  table->connection_ = static_cast<Connection *>(pAux);
+  table->first_argument_ = first_argument;
+  table->argument_count_ = argument_count;
+  *ppVtab = reinterpret_cast<sqlite3_vtab *>(table);
+  return SQLITE_OK;
+}
+
+int HashJoinConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+                    sqlite3_vtab **ppVtab, char **pzErr) {
+  return ExecutionConnect(db, pAux,
+                          "CREATE TABLE x(key, left_rowid INTEGER, "
+                          "right_rowid INTEGER, left_table HIDDEN, "
+                          "left_column HIDDEN, right_table HIDDEN, "
+                          "right_column HIDDEN)",
+                          3, 4, ppVtab);
+}
+
+int HashGroupConnect(sqlite3 *db, void *pAux, int argc,
+                     const char *const *argv, sqlite3_vtab **ppVtab,
+                     char **pzErr) {
+  return ExecutionConnect(db, pAux,
+                          "CREATE TABLE x(key, count INTEGER, sum REAL, "
+                          "min REAL, max REAL, tbl HIDDEN, "
+                          "group_column HIDDEN, value_column HIDDEN)",
+                          5, 3, ppVtab);
+}
+
+/*
+ * The arguments are equality constraints on the hidden columns, handed to
+ * xFilter in column order. idxNum has bit i for argument i. A plan missing
+ * an argument costs so much sqlite picks another one if it can, xFilter
+ * fails it otherwise
+ */
+int ExecutionBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo) {
+  ExecutionTable *table = reinterpret_cast<ExecutionTable *>(tab);
+  int arguments[32];
+  for (int i = 0; i < table->argument_count_; i++)
+    arguments[i] = -1;
+  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+    auto &constraint = pIdxInfo->aConstraint[i];
+    int argument = constraint.iColumn - table->first_argument_;
+    if (!constraint.usable || constraint.op != SQLITE_INDEX_CONSTRAINT_EQ ||
+        argument < 0 || argument >= table->argument_count_)
+      continue;
+    arguments[argument] = i;
+  }
+  int idx_num = 0;
+  int argv_index = 0;
+  for (int i = 0; i < table->argument_count_; i++) {
+    if (arguments[i] < 0)
+      continue;
+    idx_num |= 1 << i;
+    pIdxInfo->aConstraintUsage[arguments[i]].argvIndex = ++argv_index;
+    pIdxInfo->aConstraintUsage[arguments[i]].omit = 1;
+  }
+  pIdxInfo->idxNum = idx_num;
+  pIdxInfo->estimatedCost = idx_num == (1 << table->argument_count_) - 1
+                                ? 1000000
+                                : std::numeric_limits<double>::max();
+  return SQLITE_OK;
+}
+
+int ExecutionDisconnect(sqlite3_vtab *pVtab) {
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+int ExecutionOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+  ExecutionCursor *cursor = new ExecutionCursor;
+  *ppCursor = reinterpret_cast<sqlite3_vtab_cursor *>(cursor);
+  return SQLITE_OK;
+}
+
+int ExecutionClose(sqlite3_vtab_cursor *cur) {
+  ExecutionCursor *cursor = reinterpret_cast<ExecutionCursor *>(cur);
+  MemoryTracker::Release(MemoryComponent::CURSOR, cursor->memory_);
+  delete cursor;
+  return SQLITE_OK;
+}
+
+// charge the result of cursor in place of the one before
+static void ChargeResult(ExecutionCursor *cursor) {
+  size_t memory = cursor->keys_.capacity() * sizeof(std::string) +
+                  cursor->rowids_.capacity() * sizeof(cursor->rowids_[0]) +
+                  cursor->groups_.capacity() * sizeof(AggregateState);
+  for (const std::string &key : cursor->keys_)
+    memory += key.size();
+  MemoryTracker::Release(MemoryComponent::CURSOR, cursor->memory_);
+  MemoryTracker::Charge(MemoryComponent::CURSOR, memory);
+  cursor->memory_ = memory;
+}
+
+int ExecutionNext(sqlite3_vtab_cursor *cur) {
+  ++reinterpret_cast<ExecutionCursor *>(cur)->row_;
+  return SQLITE_OK;
+}
+
+int ExecutionEof(sqlite3_vtab_cursor *cur) {
+  ExecutionCursor *cursor = reinterpret_cast<ExecutionCursor *>(cur);
+  return cursor->row_ >= cursor->keys_.size();
+}
+
+int ExecutionRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid) {
+  *pRowid = reinterpret_cast<ExecutionCursor *>(cur)->row_;
+  return SQLITE_OK;
+}
+
+// the error message of the vtable of cursor, for xFilter to return
+static int ExecutionError(sqlite3_vtab_cursor *cursor, const char *message) {
+  sqlite3_free(cursor->pVtab->zErrMsg);
+  cursor->pVtab->zErrMsg = sqlite3_mprintf("%s", message);
+  return SQLITE_ERROR;
+}
+
+static std::string ArgumentText(sqlite3_value *value) {
+  auto text = reinterpret_cast<const char *>(sqlite3_value_text(value));
+  return text == nullptr ? "" : text;
+}
+
+/*
+ * The smaller table by its statistics is the build side. The result is
+ * materialized here, sqlite reads it from the cursor after
+ */
+int HashJoinFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                   const char *idxStr, int argc, sqlite3_value **argv) {
+  ExecutionCursor *cursor = reinterpret_cast<ExecutionCursor *>(pVtabCursor);
+  ExecutionTable *table =
+      reinterpret_cast<ExecutionTable *>(pVtabCursor->pVtab);
+  Connection *connection = table->connection_;
+  Engine *engine = connection->engine_;
+  cursor->keys_.clear();
+  cursor->rowids_.clear();
+  cursor->row_ = 0;
+  if (argc != 4)
+    return ExecutionError(pVtabCursor, "vtable_hash_join takes left_table, "
+                                       "left_column, right_table and "
+                                       "right_column");
+
+  std::string names[2] = {ArgumentText(argv[0]), ArgumentText(argv[2])};
+  TableData *data[2] = {nullptr, nullptr};
+  int columns[2];
+  std::string error;
+  for (int side = 0; side < 2 && error.empty(); side++) {
+    data[side] = FindTable(connection, names[side]);
+    if (data[side] == nullptr) {
+      error = "no such vtable table open";
+      break;
+    }
+    columns[side] = data[side]->schema_->GetColumnID(
+        ArgumentText(argv[2 * side + 1]));
+    if (columns[side] < 0)
+      error = "no such column";
+  }
+  if (error.empty()) {
+    bool as_double =
+        data[0]->schema_->GetType(columns[0]) == TypeId::DECIMAL ||
+        data[1]->schema_->GetType(columns[1]) == TypeId::DECIMAL;
+    int build = data[1]->stats_->GetRowCount() < data[0]->stats_->GetRowCount()
+                    ? 1
+                    : 0;
+    HashJoin join(engine->buffer_pool_manager_);
+    std::string key;
+    try {
+      for (int side = 0; side < 2 && error.empty(); side++) {
+        bool is_build = side == build;
+        TableHeap *table_heap = data[side]->table_heap_;
+        int column = columns[side];
+        if (!ScanForOperator(
+                connection, data[side], {column},
+                [&](const RowBatch &batch, uint32_t row) {
+                  if (!EncodeKey(table_heap, batch, column, row, as_double,
+                                 key))
+                    return;
+                  int64_t rowid = batch.GetRid(row).Get();
+                  if (is_build)
+                    join.AddBuild(key, rowid);
+                  else
+                    join.AddProbe(key, rowid);
+                }))
+          error = "transaction aborted";
+      }
+      if (error.empty())
+        join.Run([&](const std::string &key, int64_t build_rowid,
+                     int64_t probe_rowid) {
+          cursor->keys_.push_back(key);
+          if (build == 0)
+            cursor->rowids_.emplace_back(build_rowid, probe_rowid);
+          else
+            cursor->rowids_.emplace_back(probe_rowid, build_rowid);
+        });
+    } catch (Exception &e) {
+      cursor->keys_.clear();
+      cursor->rowids_.clear();
+      error = e.what();
+    }
+  }
+  for (int side = 0; side < 2; side++)
+    if (data[side] != nullptr)
+      CloseTable(engine, names[side], data[side]);
+  ChargeResult(cursor);
+  return error.empty() ? SQLITE_OK
+                       : ExecutionError(pVtabCursor, error.c_str());
+}
+
+int HashJoinColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) {
+  ExecutionCursor *cursor = reinterpret_cast<ExecutionCursor *>(cur);
+  auto &rowids = cursor->rowids_[cursor->row_];
+  if (i == 0)
+    ResultKey(ctx, cursor->keys_[cursor->row_]);
+  else if (i == 1)
+    sqlite3_result_int64(ctx, rowids.first);
+  else if (i == 2)
+    sqlite3_result_int64(ctx, rowids.second);
+  else
+    sqlite3_result_null(ctx);
+  return SQLITE_OK;
+}
+
+/*
+ * Rows with a null group key form one group, as GROUP BY has it. Without a
+ * value column the groups are only counted
+ */
+int HashGroupFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                    const char *idxStr, int argc, sqlite3_value **argv) {
+  ExecutionCursor *cursor = reinterpret_cast<ExecutionCursor *>(pVtabCursor);
+  ExecutionTable *table =
+      reinterpret_cast<ExecutionTable *>(pVtabCursor->pVtab);
+  Connection *connection = table->connection_;
+  Engine *engine = connection->engine_;
+  cursor->keys_.clear();
+  cursor->groups_.clear();
+  cursor->row_ = 0;
+  // value_column is the last argument and may be left out
+  if ((idxNum & 3) != 3)
+    return ExecutionError(pVtabCursor, "vtable_hash_group takes tbl, "
+                                       "group_column and value_column");
+
+  std::string name = ArgumentText(argv[0]);
+  TableData *data = FindTable(connection, name);
+  if (data == nullptr)
+    return ExecutionError(pVtabCursor, "no such vtable table open");
+  int group_column = data->schema_->GetColumnID(ArgumentText(argv[1]));
+  int value_column = -1;
+  if (argc > 2)
+    value_column = data->schema_->GetColumnID(ArgumentText(argv[2]));
+  std::string error;
+  if (group_column < 0 || (argc > 2 && value_column < 0))
+    error = "no such column";
+
+  if (error.empty()) {
+    HashAggregate aggregate(engine->buffer_pool_manager_);
+    std::vector<int> columns = {group_column};
+    if (value_column >= 0)
+      columns.push_back(value_column);
+    TableHeap *table_heap = data->table_heap_;
+    std::string key;
+    try {
+      if (!ScanForOperator(connection, data, columns,
+                           [&](const RowBatch &batch, uint32_t row) {
+                             if (!EncodeKey(table_heap, batch, group_column,
+                                            row, false, key))
+                               key.assign(1, KEY_TAG_NULL);
+                             double number;
+                             bool has_value =
+                                 value_column >= 0 &&
+                                 DecodeNumber(batch, value_column, row,
+                                              number);
+                             aggregate.Add(key,
+                                           has_value ? &number : nullptr);
+                           }))
+        error = "transaction aborted";
+      if (error.empty())
+        aggregate.Run(
+            [&](const std::string &key, const AggregateState &state) {
+              cursor->keys_.push_back(key);
+              cursor->groups_.push_back(state);
+            });
+    } catch (Exception &e) {
+      cursor->keys_.clear();
+      cursor->groups_.clear();
+      error = e.what();
+    }
+  }
+  CloseTable(engine, name, data);
+  ChargeResult(cursor);
+  return error.empty() ? SQLITE_OK
+                       : ExecutionError(pVtabCursor, error.c_str());
+}
+
+// sum, min and max are null for a group without values, as in sqlite
+int HashGroupColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) {
+  ExecutionCursor *cursor = reinterpret_cast<ExecutionCursor *>(cur);
+  const AggregateState &state = cursor->groups_[cursor->row_];
+  if (i == 0)
+    ResultKey(ctx, cursor->keys_[cursor->row_]);
+  else if (i == 1)
+    sqlite3_result_int64(ctx, state.rows_);
+  else if (i > 4 || state.values_ == 0)
+    sqlite3_result_null(ctx);
+  else
+    sqlite3_result_double(ctx, i == 2 ? state.sum_
+                                      : i == 3 ? state.min_ : state.max_);
+  return SQLITE_OK;
+}
+
+sqlite3_module HashJoinModule = {
+    0,                   /* iVersion */
+    0,                   /* xCreate - eponymous only */
+    HashJoinConnect,     /* xConnect */
+    ExecutionBestIndex,  /* xBestIndex */
+    ExecutionDisconnect, /* xDisconnect */
+    0,                   /* xDestroy */
+    ExecutionOpen,       /* xOpen - open a cursor */
+    ExecutionClose,      /* xClose - close a cursor */
+    HashJoinFilter,      /* xFilter - configure scan constraints */
+    ExecutionNext,       /* xNext - advance a cursor */
+    ExecutionEof,        /* xEof - check for end of scan */
+    HashJoinColumn,      /* xColumn - read data */
+    ExecutionRowid,      /* xRowid - read data */
+    0,                   /* xUpdate */
+    0,                   /* xBegin */
+    0,                   /* xSync */
+    0,                   /* xCommit */
+    0,                   /* xRollback */
+    0,                   /* xFindMethod */
+    0,                   /* xRename */
+    0,                   /* xSavepoint */
+    0,                   /* xRelease */
+    0,                   /* xRollbackTo */
+};
+
+sqlite3_module HashGroupModule = {
+    0,                   /* iVersion */
+    0,                   /* xCreate - eponymous only */
+    HashGroupConnect,    /* xConnect */
+    ExecutionBestIndex,  /* xBestIndex */
+    ExecutionDisconnect, /* xDisconnect */
+    0,                   /* xDestroy */
+    ExecutionOpen,       /* xOpen - open a cursor */
+    ExecutionClose,      /* xClose - close a cursor */
+    HashGroupFilter,     /* xFilter - configure scan constraints */
+    ExecutionNext,       /* xNext - advance a cursor */
+    ExecutionEof,        /* xEof - check for end of scan */
+    HashGroupColumn,     /* xColumn - read data */
+    ExecutionRowid,      /* xRowid - read data */
+    0,                   /* xUpdate */
+    0,                   /* xBegin */
+    0,                   /* xSync */
+    0,                   /* xCommit */
+    0,                   /* xRollback */
+    0,                   /* xFindMethod */
+    0,                   /* xRename */
+    0,                   /* xSavepoint */
+    0,                   /* xRelease */
+    0,                   /* xRollbackTo */
+};
+
+/*
+ * SELECT vtable_pool_size(), frames of the buffer pool of the engine
+ */
+void VtabPoolSize(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  Connection *connection =
+      static_cast<Connection *>(sqlite3_user_data(context));
+  sqlite3_result_int64(
+      context, connection->engine_->buffer_pool_manager_->GetPoolSize());
+}
+
+/*
+ * SELECT vtable_analyze('foo') samples the statistics of table foo again and
+ * returns its rows, SELECT vtable_analyze() those of every table open in the
+ * engine and returns how many there are. A table is open once a statement
+ * of some connection used it
+ */
+void VtabAnalyze(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  Engine *engine =
+      static_cast<Connection *>(sqlite3_user_data(context))->engine_;
+  std::vector<std::pair<std::string, TableData *>> tables;
+  {
+    // the tables stay open while they are sampled, outside the latch
+    std::lock_guard<std::mutex> guard(engine->tables_latch_);
+    for (auto &table : engine->tables_) {
+      if (argc > 0 &&
+          table.first != reinterpret_cast<const char *>(
+                             sqlite3_value_text(argv[0])))
+        continue;
+      table.second->refs_++;
+      tables.push_back(table);
+    }
+  }
+  if (argc > 0 && tables.empty()) {
+    sqlite3_result_error(context, "no such vtable table open", -1);
+    return;
+  }
+  for (auto &table : tables)
+    AnalyzeTable(engine, table.second);
+  if (argc > 0)
+    sqlite3_result_int64(context,
+                         static_cast<sqlite3_int64>(
+                             tables[0].second->stats_->GetRowCount()));
+  else
+    sqlite3_result_int64(context, tables.size());
+  for (auto &table : tables)
+    CloseTable(engine, table.first, table.second);
+}
+
+/*
+ * FindTable for a function of context, with the error set on context if no
+ * connection has the table open
+ */
+static TableData *FindOpenTable(sqlite3_context *context,
+                                const std::string &name) {
+  TableData *data = FindTable(
+      static_cast<Connection *>(sqlite3_user_data(context)), name);
+  if (data == nullptr)
+    sqlite3_result_error(context, "no such vtable table open", -1);
+  return data;
+}
+
+// FindOpenTable for a function of the indexes, which are not up to date on
+// a replica
+static TableData *FindIndexedTable(sqlite3_context *context,
+                                   const std::string &name) {
+  Connection *connection =
+      static_cast<Connection *>(sqlite3_user_data(context));
+  if (connection->engine_->log_replica_ != nullptr) {
+    sqlite3_result_error(context, "vtable replicas have no indexes", -1);
+    return nullptr;
+  }
+  return FindOpenTable(context, name);
+}
+
+/*
+ * The rows are moved in the order of the clustered index to new pages at the
+ * end of the heap as one transaction, every index follows them. The pages
+ * they leave are dropped from the heap once it commits. False if the
+ * transaction is aborted, e.g. by a row another one holds
+ */
+static bool ClusterTable(Engine *engine, TableData *data, size_t &count) {
+  auto transaction_manager = engine->transaction_manager_;
+  Transaction *transaction = transaction_manager->Begin();
+  std::vector<RID> rids;
+  IndexScanIterator *iterator = data->cluster_index_->ScanRange(
+      nullptr, false, nullptr, false, transaction);
+  for (; !iterator->isEnd(); iterator->Next())
+    rids.push_back(iterator->GetRid());
+  delete iterator;
+
+  TableHeap *table_heap = data->table_heap_;
+  auto index_write_set = transaction->GetIndexWriteSet();
+  Tuple tuple;
+  bool is_moved = table_heap->MoveTuples(
+      rids, transaction,
+      [&](const RID &from, const RID &to) {
+        if (!table_heap->GetTuple(to, tuple, transaction))
+          return;
+        for (auto index : data->indexes_) {
+          Tuple key = tuple.KeyFromTuple(data->schema_,
+                                         index->GetStoredSchema(),
+                                         index->GetStoredAttrs(), nullptr);
+          index->DeleteEntry(key, from, transaction);
+          index_write_set->emplace_back(from, WType::DELETE, key, index);
+          index->InsertEntry(key, to, transaction);
+          index_write_set->emplace_back(to, WType::INSERT, key, index);
+        }
+      },
+      count);
+  if (!is_moved || transaction->GetState() == TransactionState::ABORTED) {
+    transaction_manager->Abort(transaction);
+    transaction_manager->Release(transaction);
+    return false;
+  }
+  transaction_manager->Commit(transaction);
+  transaction_manager->Release(transaction);
+
+  transaction = transaction_manager->Begin();
+  table_heap->UnlinkEmptyPages(transaction);
+  transaction_manager->Commit(transaction);
+  transaction_manager->Release(transaction);
+  return true;
+}
+
+/*
+ * SELECT vtable_cluster('foo') rewrites open table foo in the order of its
+ * clustered index and returns the rows moved. Rows inserted since are put
+ * next to their neighbors while their pages have room
+ */
+void VtabCluster(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  Engine *engine =
+      static_cast<Connection *>(sqlite3_user_data(context))->engine_;
+  auto text = reinterpret_cast<const char *>(sqlite3_value_text(argv[0]));
+  std::string name(text == nullptr ? "" : text);
+  TableData *data = FindIndexedTable(context, name);
+  if (data == nullptr)
+    return;
+  size_t count;
+  if (data->cluster_index_ == nullptr)
+    sqlite3_result_error(context, "vtable table has no clustered index", -1);
+  else if (!ClusterTable(engine, data, count))
+    sqlite3_result_error(context, "vtable table can not be clustered now", -1);
+  else
+    sqlite3_result_int64(context, static_cast<sqlite3_int64>(count));
+  CloseTable(engine, name, data);
+}
+
+/*
+ * Least or greatest value of a column read from one end of a b+ tree index
+ * whose key starts with it and whose leaves keep it inlined. Nulls come
+ * first in the index, the least value skips them
+ */
+static void IndexBound(sqlite3_context *context, sqlite3_value **argv,
+                       bool last) {
+  Engine *engine =
+      static_cast<Connection *>(sqlite3_user_data(context))->engine_;
+  auto text = reinterpret_cast<const char *>(sqlite3_value_text(argv[0]));
+  std::string name(text == nullptr ? "" : text);
+  TableData *data = FindIndexedTable(context, name);
+  if (data == nullptr)
+    return;
+  text = reinterpret_cast<const char *>(sqlite3_value_text(argv[1]));
+  int column = data->schema_->GetColumnID(text == nullptr ? "" : text);
+  Index *index = nullptr;
+  for (auto candidate : data->indexes_) {
+    IndexMetadata *metadata = candidate->GetMetadata();
+    if (column >= 0 && metadata->GetType() == IndexType::BPLUSTREE &&
+        candidate->GetKeyAttrs()[0] == column &&
+        metadata->GetLeafOffset(column) >= 0) {
+      index = candidate;
+      break;
+    }
+  }
+  if (index == nullptr) {
+    sqlite3_result_error(context, "vtable table has no index on the column",
+                         -1);
+    CloseTable(engine, name, data);
+    return;
+  }
+
+  TypeId type = data->schema_->GetType(column);
+  int offset = index->GetMetadata()->GetLeafOffset(column);
+  IndexScanIterator *iterator =
+      last ? index->ScanLast()
+           : index->ScanRange(nullptr, false, nullptr, false);
+  bool is_null = true;
+  for (; !iterator->isEnd(); iterator->Next()) {
+    const char *ptr = iterator->GetEntry() + offset;
+    is_null = Value::IsNullAt(ptr, type);
+    if (!is_null)
+      ResultFixed(context, type, ptr);
+    // the greatest value is only null if every one is
+    if (!is_null || last)
+      break;
+  }
+  if (is_null)
+    sqlite3_result_null(context);
+  delete iterator;
+  CloseTable(engine, name, data);
+}
+
+/*
+ * SELECT vtable_min('foo', 'a') and vtable_max('foo', 'a') answer min(a)
+ * and max(a) of open table foo from the first and last leaf of an index on
+ * a, null for no value. They read the entries as they are, the rows other
+ * transactions have not committed included
+ */
+void VtabMin(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  IndexBound(context, argv, false);
+}
+
+void VtabMax(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  IndexBound(context, argv, true);
+}
+
+/*
+ * SELECT vtable_count('foo') counts the rows of open table foo by the
+ * entries of an index that has one per row, a non-unique one: a unique
+ * index keeps one row of equal keys. A b+ tree adds up the sizes of its
+ * leaves. Like vtable_min the rows of every transaction are counted
+ */
+void VtabCount(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  Engine *engine =
+      static_cast<Connection *>(sqlite3_user_data(context))->engine_;
+  auto text = reinterpret_cast<const char *>(sqlite3_value_text(argv[0]));
+  std::string name(text == nullptr ? "" : text);
+  TableData *data = FindIndexedTable(context, name);
+  if (data == nullptr)
+    return;
+  Index *index = nullptr;
+  for (auto candidate : data->indexes_) {
+    IndexMetadata *metadata = candidate->GetMetadata();
+    if (metadata->IsUnique())
+      continue;
+    if (index == nullptr || metadata->GetType() == IndexType::BPLUSTREE)
+      index = candidate;
+    if (metadata->GetType() == IndexType::BPLUSTREE)
+      break;
+  }
+  if (index == nullptr)
+    sqlite3_result_error(context, "vtable table has no non-unique index", -1);
+  else
+    sqlite3_result_int64(
+        context, static_cast<sqlite3_int64>(index->GetEntryCount()));
+  CloseTable(engine, name, data);
+}
+
+/*
+ * Aggregate of column over the rows of the table and its partitions, by a
+ * parallel scan of the column alone in a snapshot. Every worker folds its
+ * batches into an aggregate of its own, they are merged at the end
+ */
+template <typename Aggregate>
+static Aggregate ScanAggregate(Engine *engine, TableData *data, int column) {
+  std::vector<TableHeap *> table_heaps{data->table_heap_};
+  for (auto partition : data->partitions_)
+    table_heaps.push_back(partition->table_heap_);
+  auto transaction_manager = engine->transaction_manager_;
+  Transaction *transaction = transaction_manager->BeginSnapshot();
+  ParallelTableScan scan(table_heaps, transaction, engine->scan_threads_);
+  size_t threads = scan.GetThreadCount();
+  std::vector<std::unique_ptr<RowBatch>> batches;
+  std::vector<RowBatch *> batch_pointers;
+  for (size_t i = 0; i < threads; i++) {
+    batches.emplace_back(new RowBatch(data->schema_));
+    batches.back()->SetProjection(1ull << std::min(column, 63));
+    batch_pointers.push_back(batches.back().get());
+  }
+  std::vector<Aggregate> aggregates(threads);
+  scan.Run(batch_pointers, [&](RowBatch &batch, size_t worker) {
+    AggregateBatch(batch, column, aggregates[worker]);
+  });
+  transaction_manager->Commit(transaction);
+  transaction_manager->Release(transaction);
+  for (size_t i = 1; i < threads; i++)
+    aggregates[0].Merge(aggregates[i]);
+  return aggregates[0];
+}
+
+// values of an aggregate, an integer sum may not fit a BIGINT
+static void ResultAggregateValue(sqlite3_context *context, __int128 value) {
+  if (value > std::numeric_limits<int64_t>::max() ||
+      value < std::numeric_limits<int64_t>::min())
+    sqlite3_result_error(context, "integer overflow", -1);
+  else
+    sqlite3_result_int64(context, static_cast<sqlite3_int64>(value));
+}
+
+static void ResultAggregateValue(sqlite3_context *context, int64_t value) {
+  sqlite3_result_int64(context, static_cast<sqlite3_int64>(value));
+}
+
+static void ResultAggregateValue(sqlite3_context *context, double value) {
+  sqlite3_result_double(context, value);
+}
+
+// the result of function of an aggregate, null for no value but a count
+template <typename Aggregate>
+static void ResultAggregate(sqlite3_context *context,
+                            const std::string &function,
+                            const Aggregate &aggregate) {
+  if (function == "count")
+    sqlite3_result_int64(context,
+                         static_cast<sqlite3_int64>(aggregate.count_));
+  else if (aggregate.count_ == 0)
+    sqlite3_result_null(context);
+  else if (function == "sum")
+    ResultAggregateValue(context, aggregate.sum_);
+  else if (function == "avg")
+    sqlite3_result_double(context, static_cast<double>(aggregate.sum_) /
+                                       aggregate.count_);
+  else
+    ResultAggregateValue(context, function == "min" ? aggregate.min_
+                                                    : aggregate.max_);
+}
+
+/*
+ * SELECT vtable_aggregate('foo', 'a', 'sum') answers sum(a) over open table
+ * foo by folding whole batches of column a with SIMD kernels instead of a
+ * value at a time through sqlite, see execution/aggregate_kernels.h. The
+ * functions are count, sum, avg, min and max, of an integer or DECIMAL
+ * column. Nulls are left out as in sqlite, and a sum beyond a BIGINT is an
+ * error. The rows are those committed before it began
+ */
+void VtabAggregate(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  Engine *engine =
+      static_cast<Connection *>(sqlite3_user_data(context))->engine_;
+  auto text = reinterpret_cast<const char *>(sqlite3_value_text(argv[0]));
+  std::string name(text == nullptr ? "" : text);
+  TableData *data = FindOpenTable(context, name);
+  if (data == nullptr)
+    return;
+  text = reinterpret_cast<const char *>(sqlite3_value_text(argv[1]));
+  int column = data->schema_->GetColumnID(text == nullptr ? "" : text);
+  text = reinterpret_cast<const char *>(sqlite3_value_text(argv[2]));
+  std::string function(text == nullptr ? "" : text);
+  TypeId type =
+      column >= 0 ? data->schema_->GetType(column) : TypeId::INVALID;
+  if (function != "count" && function != "sum" && function != "avg" &&
+      function != "min" && function != "max")
+    sqlite3_result_error(context, "unknown vtable aggregate", -1);
+  else if (type == TypeId::TINYINT || type == TypeId::SMALLINT ||
+           type == TypeId::INTEGER || type == TypeId::BIGINT)
+    ResultAggregate(context, function,
+                    ScanAggregate<IntegerAggregate>(engine, data, column));
+  else if (type == TypeId::DECIMAL)
+    ResultAggregate(context, function,
+                    ScanAggregate<DecimalAggregate>(engine, data, column));
+  else
+    sqlite3_result_error(context, "vtable column is not numeric", -1);
+  CloseTable(engine, name, data);
 }
 
-int VtabNext(sqlite3_vtab_cursor *cur) {
-  // LOG_DEBUG("VtabNext");
-  Cursor *cursor = reinterpret_cast<Cursor *>(cur);
-  ++(*cursor);
-  return SQLITE_OK;
+/*
+ * SELECT vtable_latch_profile(1) turns latch profiling on, clearing what it
+ * recorded before, vtable_latch_profile(0) off. A second argument is the
+ * sample rate of page waits. Returns whether it was on. The profile is of
+ * the process, every engine shares it
+ */
+void VtabLatchProfile(sqlite3_context *context, int argc,
+                      sqlite3_value **argv) {
+  if (argc < 1) {
+    sqlite3_result_error(context, "vtable_latch_profile takes 1 or 2 arguments",
+                         -1);
+    return;
+  }
+  bool enabled = LatchStats::IsEnabled();
+  sqlite3_int64 sample_rate =
+      argc > 1 ? sqlite3_value_int64(argv[1]) : LATCH_SAMPLE_RATE;
+  LatchStats::Enable(sqlite3_value_int64(argv[0]) != 0,
+                     std::max<sqlite3_int64>(sample_rate, 1));
+  sqlite3_result_int64(context, enabled);
 }
 
-int VtabEof(sqlite3_vtab_cursor *cur) {
-  // LOG_DEBUG("VtabEof");
-  Cursor *cursor = reinterpret_cast<Cursor *>(cur);
-  return cursor->isEof();
+/*
+ * The b+ tree page page_id is in, by its parents up to the root: true with
+ * the root and whether page_id is a leaf. Every page on the way must know
+ * its own id, so a page of another kind is rarely taken for one
+ */
+static bool FindTreeRoot(BufferPoolManager *buffer_pool_manager,
+                         page_id_t page_id, page_id_t &root_id, bool &leaf) {
+  for (int depth = 0; depth < 16 && page_id >= 0; ++depth) {
+    Page *page = buffer_pool_manager->FetchPage(page_id);
+    if (page == nullptr)
+      return false;
+    page->RLatch();
+    auto tree_page = reinterpret_cast<BPlusTreePage *>(page->GetData());
+    bool valid = tree_page->GetPageId() == page_id &&
+                 tree_page->GetSize() >= 0 &&
+                 tree_page->GetSize() <= tree_page->GetMaxSize();
+    if (depth == 0)
+      leaf = tree_page->IsLeafPage();
+    page_id_t parent_id = tree_page->GetParentPageId();
+    page->RUnlatch();
+    buffer_pool_manager->UnpinPage(page_id, false);
+    if (!valid)
+      return false;
+    if (parent_id == INVALID_PAGE_ID) {
+      root_id = page_id;
+      return true;
+    }
+    page_id = parent_id;
+  }
+  return false;
 }
 
-int VtabColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) {
-  Cursor *cursor = reinterpret_cast<Cursor *>(cur);
-  Schema *schema = cursor->GetVirtualTable()->GetSchema();
-  // get column type and value
-  TypeId type = schema->GetType(i);
-  Value v = cursor->GetCurrentValue(schema, i);
-
-  switch (type) {
-  case TypeId::TINYINT:
-  case TypeId::BOOLEAN:
-    sqlite3_result_int(ctx, (int)v.GetAs<int8_t>());
-    break;
-  case TypeId::SMALLINT:
-    sqlite3_result_int(ctx, (int)v.GetAs<int16_t>());
-    break;
-  case TypeId::INTEGER:
-    sqlite3_result_int(ctx, (int)v.GetAs<int32_t>());
-    break;
-  case TypeId::BIGINT:
-    sqlite3_result_int64(ctx, (sqlite3_int64)v.GetAs<int64_t>());
-    break;
-  case TypeId::DECIMAL:
-    sqlite3_result_double(ctx, v.GetAs<double>());
-    break;
-  case TypeId::VARCHAR:
-    sqlite3_result_text(ctx, v.GetData(), -1, SQLITE_TRANSIENT);
-    break;
-  default:
-    return SQLITE_ERROR;
-  } // End of switch
-  return SQLITE_OK;
+/*
+ * SELECT vtable_page_trace('pages.trace') records the page accesses of the
+ * buffer pool into a trace file (see page_trace.h), a second argument is
+ * the number of records the ring keeps. vtable_page_trace() stops it and
+ * returns the records written, the start returns 1, 0 if the file can not
+ * be mapped. Replay it with page_trace_replay
+ */
+void VtabPageTrace(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  BufferPoolManager *buffer_pool_manager =
+      static_cast<Connection *>(sqlite3_user_data(context))
+          ->engine_->buffer_pool_manager_;
+  if (argc == 0) {
+    sqlite3_result_int64(
+        context,
+        static_cast<sqlite3_int64>(buffer_pool_manager->StopTrace()));
+    return;
+  }
+  const char *file_name =
+      reinterpret_cast<const char *>(sqlite3_value_text(argv[0]));
+  sqlite3_int64 capacity =
+      argc > 1 ? sqlite3_value_int64(argv[1]) : PAGE_TRACE_CAPACITY;
+  sqlite3_result_int64(
+      context, file_name != nullptr && capacity > 0 &&
+                   buffer_pool_manager->StartTrace(file_name, capacity));
 }
 
-int VtabRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid) {
-  // LOG_DEBUG("VtabRowid");
-  Cursor *cursor = reinterpret_cast<Cursor *>(cur);
-  // return rid of the tuple that cursor currently points at
-  *pRowid = cursor->GetCurrentRid();
-  return SQLITE_OK;
+/*
+ * SELECT vtable_memory_budget(1 << 30) sets the memory budget of the
+ * process (see memory_tracker.h), 0 for none, and returns the one before.
+ * The buffer pool fits in what is left of it right away.
+ * vtable_memory_budget() returns the budget
+ */
+void VtabMemoryBudget(sqlite3_context *context, int argc,
+                      sqlite3_value **argv) {
+  size_t budget = MemoryTracker::GetBudget();
+  if (argc > 0) {
+    BufferPoolManager *buffer_pool_manager =
+        static_cast<Connection *>(sqlite3_user_data(context))
+            ->engine_->buffer_pool_manager_;
+    MemoryTracker::SetBudget(
+        std::max<sqlite3_int64>(sqlite3_value_int64(argv[0]), 0));
+    buffer_pool_manager->Resize(buffer_pool_manager->GetPoolSize());
+  }
+  sqlite3_result_int64(context, static_cast<sqlite3_int64>(budget));
 }
 
-int VtabUpdate(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
-               sqlite_int64 *pRowid) {
-  // LOG_DEBUG("VtabUpdate");
-  VirtualTable *table = reinterpret_cast<VirtualTable *>(pVTab);
-  // The single row with rowid equal to argv[0] is deleted
-  if (argc == 1) {
-    const RID rid(sqlite3_value_int64(argv[0]));
-    // delete entry from index
-    table->DeleteEntry(rid);
-    // delete tuple from table heap
-    table->DeleteTuple(rid);
+/*
+ * SELECT vtable_hot_pages(10), the pages with the most latch wait time
+ * sampled while profiling, a line each of page id, owner, estimated waits
+ * and wait time. The owner is the heap of an open table or an index of one,
+ * by the root the page leads up to, e.g.
+ *   42 index foo_a leaf waits 128 wait_ns 901344
+ */
+void VtabHotPages(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  Engine *engine =
+      static_cast<Connection *>(sqlite3_user_data(context))->engine_;
+  size_t count = argc > 0 ? std::max<sqlite3_int64>(
+                                sqlite3_value_int64(argv[0]), 0)
+                          : 10;
+  std::vector<std::pair<std::string, TableData *>> tables;
+  {
+    std::lock_guard<std::mutex> guard(engine->tables_latch_);
+    for (auto &table : engine->tables_) {
+      table.second->refs_++;
+      tables.push_back(table);
+    }
   }
-  // A new row is inserted with a rowid argv[1] and column values in argv[2] and
-  // following. If argv[1] is an SQL NULL, the a new unique rowid is generated
-  // automatically.
-  else if (argc > 1 && sqlite3_value_type(argv[0]) == SQLITE_NULL) {
-    Schema *schema = table->GetSchema();
-    Tuple tuple = ConstructTuple(schema, (argv + 2));
-    // insert into table heap
-    RID rid;
-    table->InsertTuple(tuple, rid);
-    // insert into index
-    table->InsertEntry(tuple, rid);
+  // owners of heap pages and index roots, the roots as the indexes have
+  // them now, the catalog is behind until a checkpoint
+  BufferPoolManager *buffer_pool_manager = engine->buffer_pool_manager_;
+  std::unordered_map<page_id_t, std::string> heap_pages;
+  std::unordered_map<page_id_t, std::string> index_roots;
+  for (auto &table : tables) {
+    std::vector<TableData *> parts{table.second};
+    parts.insert(parts.end(), table.second->partitions_.begin(),
+                 table.second->partitions_.end());
+    for (TableData *part : parts) {
+      std::vector<page_id_t> page_ids;
+      part->table_heap_->GetPageIds(page_ids);
+      for (page_id_t page_id : page_ids)
+        heap_pages[page_id] = table.first;
+      for (Index *index : part->indexes_)
+        index_roots[index->GetRootPageId()] = index->GetName();
+    }
   }
-  // The row with rowid argv[0] is updated with new values in argv[2] and
-  // following parameters.
-  else if (argc > 1 && sqlite3_value_type(argv[0]) != SQLITE_NULL) {
-    Schema *schema = table->GetSchema();
-    Tuple tuple = ConstructTuple(schema, (argv + 2));
-    RID rid(sqlite3_value_int64(argv[0]));
-    // for update, index always delete and insert
-    // because you have no clue key has been updated or not
-    table->DeleteEntry(rid);
-    // if true, then update succeed, rid keep the same
-    // else, delete & insert
-    if (table->UpdateTuple(tuple, rid) == false) {
-      table->DeleteTuple(rid);
-      // rid should be different
-      table->InsertTuple(tuple, rid);
+  for (auto &table : tables)
+    CloseTable(engine, table.first, table.second);
+
+  std::ostringstream report;
+  for (const HotPage &hot_page : LatchStats::GetHotPages(count)) {
+    report << hot_page.page_id_ << " ";
+    page_id_t root_id;
+    bool leaf = false;
+    auto heap = heap_pages.find(hot_page.page_id_);
+    if (heap != heap_pages.end()) {
+      report << "table " << heap->second;
+    } else if (FindTreeRoot(buffer_pool_manager, hot_page.page_id_, root_id,
+                            leaf)) {
+      auto root = index_roots.find(root_id);
+      report << "index "
+             << (root == index_roots.end() ? std::string("?") : root->second)
+             << (leaf ? " leaf" : " internal");
+    } else {
+      report << "unknown";
     }
-    table->InsertEntry(tuple, rid);
+    report << " waits " << hot_page.waits_ << " wait_ns " << hot_page.wait_ns_
+           << "\n";
   }
-  return SQLITE_OK;
+  std::string text = report.str();
+  sqlite3_result_text(context, text.c_str(), -1, SQLITE_TRANSIENT);
 }
 
-int VtabBegin(sqlite3_vtab *pVTab) {
-  // LOG_DEBUG("VtabBegin");
-  // create new transaction(write operation will call this method)
-  global_parameters->transaction_ = new Transaction(0);
-  return SQLITE_OK;
+/*
+ * An index keeps its root in memory while it changes, the catalog gets it
+ * here. An index emptied before its root was ever written needs no record
+ */
+static void WriteIndexRoot(Catalog *catalog, Index *index) {
+  page_id_t root_id;
+  if (!index->GetChangedRoot(root_id))
+    return;
+  const std::string &name = index->GetName();
+  if (!catalog->UpdateRecord(name, root_id) && root_id != INVALID_PAGE_ID)
+    catalog->InsertRecord(name, root_id);
 }
 
-int VtabCommit(sqlite3_vtab *pVTab) {
-  // LOG_DEBUG("VtabCommit");
-  auto transaction = GetTransaction();
-  if (transaction == nullptr)
-    return SQLITE_OK;
-  // get global txn manager
-  auto transaction_manager = global_parameters->transaction_manager_;
-  // invoke transaction manager to delete
-  transaction_manager->Commit(transaction);
-  // when commit, delete transaction pointer and set to null
-  delete transaction;
-  global_parameters->transaction_ = nullptr;
-
-  return SQLITE_OK;
+// the bloom filter of a closing index, kept for the next time it opens
+static void WriteBloomFilter(Catalog *catalog, Index *index) {
+  page_id_t page_id;
+  try {
+    page_id = index->WriteBloomFilter();
+  } catch (Exception &e) {
+    // it is rebuilt then
+    LOG_WARN("%s", e.what());
+    return;
+  }
+  if (page_id == INVALID_PAGE_ID)
+    return;
+  const std::string name = GetBloomFilterName(index->GetName());
+  if (!catalog->UpdateRecord(name, page_id))
+    catalog->InsertRecord(name, page_id);
 }
 
-sqlite3_module VtableModule = {
-    0,              /* iVersion */
-    VtabCreate,     /* xCreate */
-    VtabConnect,    /* xConnect */
-    VtabBestIndex,  /* xBestIndex */
-    VtabDisconnect, /* xDisconnect */
-    VtabDisconnect, /* xDestroy */
-    VtabOpen,       /* xOpen - open a cursor */
-    VtabClose,      /* xClose - close a cursor */
-    VtabFilter,     /* xFilter - configure scan constraints */
-    VtabNext,       /* xNext - advance a cursor */
-    VtabEof,        /* xEof - check for end of scan */
-    VtabColumn,     /* xColumn - read data */
-    VtabRowid,      /* xRowid - read data */
-    VtabUpdate,     /* xUpdate */
-    VtabBegin,      /* xBegin */
-    0,              /* xSync */
-    VtabCommit,     /* xCommit */
-    0,              /* xRollback */
-    0,              /* xFindMethod */
-    0,              /* xRename */
-    0,              /* xSavepoint */
-    0,              /* xRelease */
-    0,              /* xRollbackTo */
-};
+/*
+ * Engines by database file. An engine is started by the first connection
+ * naming its file and shut down when the last one closes, the pages and the
+ * log are on disk then
+ */
+static std::unordered_map<std::string, Engine *> engines;
+static std::mutex engines_latch;
 
-#ifdef _WIN32
-__declspec(dllexport)
-#endif
-    extern "C" int sqlite3_vtable_init(sqlite3 *db, char **pzErrMsg,
-                                       const sqlite3_api_routines *pApi) {
-  std::string file_name = "vtable.db";
+Engine *OpenEngine(const std::string &file_name, size_t pool_size,
+                   size_t scan_threads, size_t page_cache,
+                   size_t pin_wait_ms, const std::string &primary,
+                   int ship_port, char **pzErrMsg, bool swizzle,
+                   size_t row_cache) {
+  std::lock_guard<std::mutex> guard(engines_latch);
+  auto it = engines.find(file_name);
+  if (it != engines.end()) {
+    it->second->connections_++;
+    return it->second;
+  }
   // to check whether file exist or not
   struct stat buffer;
   bool is_file_exist = (stat(file_name.c_str(), &buffer) == 0);
-  // BufferPoolManager is a global object share by all the virtual tables
-  BufferPoolManager *buffer_pool_manager =
-      new BufferPoolManager(100, file_name);
-  SQLITE_EXTENSION_INIT2(pApi);
+  // a replica starts from a copy of its primary, e.g. a restored backup
+  std::string::size_type colon = primary.rfind(':');
+  int primary_port = 0;
+  if (!primary.empty()) {
+    if (colon != std::string::npos)
+      primary_port = atoi(primary.c_str() + colon + 1);
+    if (primary_port <= 0) {
+      *pzErrMsg = sqlite3_mprintf("vtable_replica_of is not host:port");
+      return nullptr;
+    }
+    if (!is_file_exist) {
+      *pzErrMsg = sqlite3_mprintf("vtable replica %s is no copy of a primary",
+                                  file_name.c_str());
+      return nullptr;
+    }
+  }
+  // BufferPoolManager is shared by all the virtual tables of the engine
+  // LRU-K keeps index pages in the pool while cursors scan whole tables
+  BufferPoolManager *buffer_pool_manager;
+  try {
+    buffer_pool_manager =
+        new BufferPoolManager(pool_size, file_name, 1, ReplacerType::LRU_K);
+  } catch (Exception &e) {
+    // e.g. a database file of another page size
+    *pzErrMsg = sqlite3_mprintf("%s", e.what());
+    return nullptr;
+  }
+  if (page_cache > 0)
+    buffer_pool_manager->GetDiskManager()->EnablePageCache(page_cache);
+  if (pin_wait_ms > 0) {
+    AdmissionConfig admission;
+    admission.blocking_ = true;
+    admission.timeout_ = std::chrono::milliseconds(pin_wait_ms);
+    buffer_pool_manager->SetAdmission(admission);
+  }
+  if (swizzle)
+    buffer_pool_manager->EnableSwizzling();
   // create header page from BufferPoolManager if necessary
   page_id_t header_page_id;
   HeaderPage *header_page;
@@ -366,16 +4023,265 @@ __declspec(dllexport)
 
   (void)header_page;
   buffer_pool_manager->UnpinPage(HEADER_PAGE_ID, true);
-  // construct global parameters, for now we have buffer_pool_manager and
-  // lock_manager and transaction_manager_
-  global_parameters = new GlobalParameters;
-  global_parameters->buffer_pool_manager_ = buffer_pool_manager;
-  global_parameters->lock_manager_ = new LockManager(true);
-  global_parameters->transaction_manager_ =
-      new TransactionManager(global_parameters->lock_manager_);
-  global_parameters->transaction_ = nullptr;
-
-  int rc = sqlite3_create_module(db, "vtable", &VtableModule, nullptr);
+  // the header page is not logged, a file without one can not be opened
+  if (is_file_exist == false)
+    buffer_pool_manager->FlushPage(HEADER_PAGE_ID);
+  // construct the engine, for now we have buffer_pool_manager,
+  // lock_manager, log_manager and transaction_manager_
+  Engine *engine = new Engine;
+  engine->file_name_ = file_name;
+  engine->buffer_pool_manager_ = buffer_pool_manager;
+  if (primary.empty())
+    engine->row_cache_ = row_cache;
+  engine->lock_manager_ = new LockManager(true);
+  // log is written next to the database file, pages are only written after
+  // the log records that changed them
+  engine->log_manager_ = new LogManager(buffer_pool_manager->GetDiskManager());
+  engine->checkpoint_manager_ = nullptr;
+  if (!primary.empty()) {
+    // the log of a replica is the one of its primary, appended before the
+    // pages it changes are. Its log manager never runs, nothing is logged
+    engine->log_replica_ = new LogReplica(buffer_pool_manager);
+    engine->transaction_manager_ =
+        new TransactionManager(engine->lock_manager_, engine->log_manager_);
+    engine->catalog_ = new Catalog(buffer_pool_manager);
+    engine->log_replica_->Start(primary.substr(0, colon), primary_port);
+    engine->scan_threads_ = std::max<size_t>(scan_threads, 1);
+    engine->connections_ = 1;
+    engines[file_name] = engine;
+    return engine;
+  }
+  buffer_pool_manager->SetLogManager(engine->log_manager_);
+  // replay the log left by a crash, this also starts the log flush thread
+  LogRecovery log_recovery(buffer_pool_manager);
+  log_recovery.Recover(engine->log_manager_);
+  engine->transaction_manager_ =
+      new TransactionManager(engine->lock_manager_, engine->log_manager_);
+  engine->transaction_manager_->SetNextTxnId(log_recovery.GetNextTxnId());
+  engine->catalog_ = new Catalog(buffer_pool_manager);
+  // nothing of an index is logged, it is built again from the heap recovery
+  // leaves. Tables closed cleanly before the crash too, their marks go
+  const RecoveryStats &stats = log_recovery.GetStats();
+  if (stats.redo_records_ > 0 || stats.undo_records_ > 0) {
+    std::vector<std::string> marks;
+    engine->catalog_->GetNames(GetCleanCloseName(""), marks);
+    for (auto &mark : marks)
+      engine->catalog_->DeleteRecord(mark);
+  }
+  // checkpoints bound the log and the work of the next restart
+  engine->checkpoint_manager_ =
+      new CheckpointManager(engine->transaction_manager_, buffer_pool_manager,
+                            engine->log_manager_);
+  // the roots of the indexes are written to the catalog with them, and the
+  // memtables of the vtable_lsm tables as runs
+  engine->checkpoint_manager_->SetFlushCallback([engine]() {
+    std::lock_guard<std::mutex> guard(engine->tables_latch_);
+    for (auto &table : engine->tables_)
+      for (auto index : table.second->indexes_)
+        WriteIndexRoot(engine->catalog_, index);
+    for (auto &table : engine->lsm_tables_)
+      table.second->tree_->Flush();
+  });
+  engine->checkpoint_manager_->StartCheckpointThread();
+  // replicas are served once the log is recovered
+  if (ship_port > 0) {
+    engine->log_shipper_ =
+        new LogShipper(buffer_pool_manager->GetDiskManager());
+    if (!engine->log_shipper_->Listen(ship_port)) {
+      LOG_WARN("can not ship the log on port %d", ship_port);
+    }
+  }
+  engine->scan_threads_ = std::max<size_t>(scan_threads, 1);
+  engine->connections_ = 1;
+  engines[file_name] = engine;
+  return engine;
+}
+
+/*
+ * The pages are written while the log still flushes, they may have to wait
+ * for their records
+ */
+void CloseEngine(Engine *engine) {
+  std::lock_guard<std::mutex> guard(engines_latch);
+  if (--engine->connections_ > 0)
+    return;
+  engines.erase(engine->file_name_);
+  delete engine->log_shipper_;
+  delete engine->log_replica_;
+  delete engine->checkpoint_manager_;
+  delete engine->transaction_manager_;
+  delete engine->catalog_;
+  engine->buffer_pool_manager_->FlushAllPages();
+  engine->buffer_pool_manager_->SetLogManager(nullptr);
+  delete engine->log_manager_;
+  delete engine->buffer_pool_manager_;
+  delete engine->lock_manager_;
+  delete engine;
+}
+
+// heap and indexes of the table and of its partitions
+static void DeleteTableData(Engine *engine, TableData *table) {
+  for (auto partition : table->partitions_)
+    DeleteTableData(engine, partition);
+  delete table->table_heap_;
+  for (auto index : table->indexes_) {
+    WriteIndexRoot(engine->catalog_, index);
+    WriteBloomFilter(engine->catalog_, index);
+  }
+  // the table is marked clean once the pages of its indexes and free space
+  // map are on disk with their roots, not while an index is being built
+  bool is_clean = engine->log_replica_ == nullptr && !table->name_.empty();
+  for (auto index : table->indexes_)
+    is_clean = is_clean && !index->IsBuilding();
+  if (is_clean) {
+    engine->buffer_pool_manager_->FlushAllPages();
+    // the mark names the header page, no record of a heap or index does
+    const std::string name = GetCleanCloseName(table->name_);
+    if (!engine->catalog_->UpdateRecord(name, HEADER_PAGE_ID))
+      engine->catalog_->InsertRecord(name, HEADER_PAGE_ID);
+  }
+  for (auto index : table->indexes_)
+    delete index;
+  delete table->stats_;
+  delete table;
+}
+
+TableData *OpenTable(Engine *engine, const std::string &name,
+                     const std::function<TableData *()> &build) {
+  std::lock_guard<std::mutex> guard(engine->tables_latch_);
+  TableData *&table = engine->tables_[name];
+  if (table == nullptr) {
+    try {
+      table = build();
+    } catch (Exception &e) {
+      engine->tables_.erase(name);
+      throw;
+    }
+  }
+  table->refs_++;
+  return table;
+}
+
+void CloseTable(Engine *engine, const std::string &name, TableData *table) {
+  std::lock_guard<std::mutex> guard(engine->tables_latch_);
+  if (--table->refs_ > 0)
+    return;
+  auto it = engine->tables_.find(name);
+  if (it != engine->tables_.end() && it->second == table)
+    engine->tables_.erase(it);
+  DeleteTableData(engine, table);
+}
+
+// sqlite closed the connection, its tables are disconnected already
+static void CloseConnection(void *pAux) {
+  Connection *connection = static_cast<Connection *>(pAux);
+  CloseEngine(connection->engine_);
+  delete connection;
+}
+
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+    extern "C" int sqlite3_vtable_init(sqlite3 *db, char **pzErrMsg,
+                                       const sqlite3_api_routines *pApi) {
+  SQLITE_EXTENSION_INIT2(pApi);
+  // the database was opened as e.g. "file:sqlite.db?vtable_pool_size=4096",
+  // the parameters of the first connection to a file start its engine
+  std::string file_name = VTAB_FILE;
+  sqlite3_int64 pool_size = VTAB_POOL_SIZE;
+  sqlite3_int64 scan_threads = VTAB_SCAN_THREADS;
+  sqlite3_int64 page_cache = VTAB_PAGE_CACHE;
+  sqlite3_int64 pin_wait_ms = VTAB_PIN_WAIT_MS;
+  std::string primary;
+  sqlite3_int64 ship_port = VTAB_SHIP_PORT;
+  bool swizzle = false;
+  sqlite3_int64 row_cache = VTAB_ROW_CACHE;
+  sqlite3_int64 memory_budget = VTAB_MEMORY_BUDGET;
+  const char *db_name = sqlite3_db_filename(db, "main");
+  if (db_name != nullptr) {
+    const char *vtable_file = sqlite3_uri_parameter(db_name, "vtable_file");
+    if (vtable_file != nullptr)
+      file_name = vtable_file;
+    pool_size = sqlite3_uri_int64(db_name, "vtable_pool_size", pool_size);
+    scan_threads =
+        sqlite3_uri_int64(db_name, "vtable_scan_threads", scan_threads);
+    page_cache = sqlite3_uri_int64(db_name, "vtable_page_cache", page_cache);
+    pin_wait_ms =
+        sqlite3_uri_int64(db_name, "vtable_pin_wait_ms", pin_wait_ms);
+    const char *replica_of =
+        sqlite3_uri_parameter(db_name, "vtable_replica_of");
+    if (replica_of != nullptr)
+      primary = replica_of;
+    ship_port = sqlite3_uri_int64(db_name, "vtable_ship_port", ship_port);
+    swizzle = sqlite3_uri_boolean(db_name, "vtable_swizzle", swizzle);
+    row_cache = sqlite3_uri_int64(db_name, "vtable_row_cache", row_cache);
+    memory_budget =
+        sqlite3_uri_int64(db_name, "vtable_memory_budget", memory_budget);
+  }
+  // the budget is of the process, a connection not naming one keeps it
+  if (memory_budget > 0)
+    MemoryTracker::SetBudget(memory_budget);
+  pool_size = std::max<sqlite3_int64>(pool_size, VTAB_MIN_POOL_SIZE);
+  Engine *engine = OpenEngine(file_name, pool_size,
+                              std::max<sqlite3_int64>(scan_threads, 1),
+                              std::max<sqlite3_int64>(page_cache, 0),
+                              std::max<sqlite3_int64>(pin_wait_ms, 0),
+                              primary, static_cast<int>(ship_port), pzErrMsg,
+                              swizzle, std::max<sqlite3_int64>(row_cache, 0));
+  if (engine == nullptr)
+    return SQLITE_ERROR;
+  Connection *connection = new Connection;
+  connection->engine_ = engine;
+
+  // sqlite calls CloseConnection when the database closes, or right away if
+  // the module can not be registered
+  int rc = sqlite3_create_module_v2(db, "vtable", &VtableModule, connection,
+                                    CloseConnection);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_pool_size", 0, SQLITE_UTF8,
+                                 connection, VtabPoolSize, nullptr, nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_analyze", -1, SQLITE_UTF8,
+                                 connection, VtabAnalyze, nullptr, nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_cluster", 1, SQLITE_UTF8,
+                                 connection, VtabCluster, nullptr, nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_min", 2, SQLITE_UTF8, connection,
+                                 VtabMin, nullptr, nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_max", 2, SQLITE_UTF8, connection,
+                                 VtabMax, nullptr, nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_count", 1, SQLITE_UTF8,
+                                 connection, VtabCount, nullptr, nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_aggregate", 3, SQLITE_UTF8,
+                                 connection, VtabAggregate, nullptr, nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_latch_profile", -1, SQLITE_UTF8,
+                                 connection, VtabLatchProfile, nullptr,
+                                 nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_hot_pages", -1, SQLITE_UTF8,
+                                 connection, VtabHotPages, nullptr, nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_page_trace", -1, SQLITE_UTF8,
+                                 connection, VtabPageTrace, nullptr, nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_memory_budget", -1, SQLITE_UTF8,
+                                 connection, VtabMemoryBudget, nullptr,
+                                 nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_module(db, "vtable_stats", &StatsModule, connection);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_module(db, "vtable_lsm", &LsmModule, connection);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_module(db, "vtable_hash_join", &HashJoinModule,
+                               connection);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_module(db, "vtable_hash_group", &HashGroupModule,
+                               connection);
   return rc;
 }
 
@@ -440,9 +4346,27 @@ Schema *ParseCreateStatement(const std::string &sql_base) {
   return schema;
 }
 
+/*
+ * Tables of the same columns share one schema, the cache only holds it while
+ * a table does. Its column offsets are worked out again after that
+ */
+std::shared_ptr<Schema> GetSharedSchema(const std::string &sql) {
+  static std::unordered_map<std::string, std::weak_ptr<Schema>> schemas;
+  static std::mutex schemas_latch;
+  std::lock_guard<std::mutex> guard(schemas_latch);
+  std::weak_ptr<Schema> &cached = schemas[sql];
+  std::shared_ptr<Schema> schema = cached.lock();
+  if (schema == nullptr) {
+    schema.reset(ParseCreateStatement(sql));
+    cached = schema;
+  }
+  return schema;
+}
+
 IndexMetadata *ParseIndexStatement(std::string &sql,
                                    const std::string &table_name,
-                                   Schema *schema) {
+                                   Schema *schema,
+                                   const std::string &name_suffix) {
   std::string::size_type n;
   std::string index_name;
   std::vector<int> key_attrs;
@@ -454,6 +4378,68 @@ IndexMetadata *ParseIndexStatement(std::string &sql,
   assert(n != std::string::npos);
   index_name = sql.substr(0, n);
   sql = sql.substr(n + 1);
+  // "unique name a, b" declares an index that keeps one entry per key,
+  // "clustered name a" one whose order the rows of the table are kept in,
+  // "buffered name a" a b+ tree that applies its writes in batches, "bloom
+  // name a" one that keeps a bloom filter of its keys for point lookups
+  bool unique = false, clustered = false, buffered = false, bloom = false;
+  while (index_name == "unique" || index_name == "clustered" ||
+         index_name == "buffered" || index_name == "bloom") {
+    (index_name == "unique"
+         ? unique
+         : index_name == "clustered"
+               ? clustered
+               : index_name == "buffered" ? buffered : bloom) = true;
+    n = sql.find_first_of(' ');
+    assert(n != std::string::npos);
+    index_name = sql.substr(0, n);
+    sql = sql.substr(n + 1);
+  }
+
+  // "name a, b using hash" declares a hash index, "using art" an adaptive
+  // radix tree kept in memory only, b+ tree is the default
+  IndexType type = IndexType::BPLUSTREE;
+  n = sql.rfind(" using ");
+  if (n != std::string::npos) {
+    std::string method = sql.substr(n + 7);
+    StringUtility::Trim(method);
+    if (method == "hash")
+      type = IndexType::HASH;
+    else if (method == "art")
+      type = IndexType::ART;
+    else if (method != "btree")
+      throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, format error");
+    sql = sql.substr(0, n);
+  }
+  std::string method = type == IndexType::HASH ? "hash" : "art";
+  if (clustered && type != IndexType::BPLUSTREE)
+    throw Exception(EXCEPTION_TYPE_INDEX,
+                    "can't create index, " + method + " index is not clustered");
+  if (buffered && type != IndexType::BPLUSTREE)
+    throw Exception(EXCEPTION_TYPE_INDEX,
+                    "can't create index, " + method + " index is not buffered");
+  if (bloom && type != IndexType::BPLUSTREE)
+    throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, " + method +
+                                              " index has no bloom filter");
+
+  // "name a include b, c" keeps b and c in the leaves of a b+ tree, for
+  // scans that read no other column. Only inlined columns can be read back
+  std::vector<int> include_attrs;
+  n = sql.find(" include ");
+  if (n != std::string::npos) {
+    if (type != IndexType::BPLUSTREE)
+      throw Exception(EXCEPTION_TYPE_INDEX,
+                      "can't create index, " + method + " index has no include");
+    for (std::string &t : StringUtility::Split(sql.substr(n + 9), ',')) {
+      StringUtility::Trim(t);
+      column_id = schema->GetColumnID(t);
+      if (column_id == -1 || !schema->IsInlined(column_id))
+        throw Exception(EXCEPTION_TYPE_INDEX,
+                        "can't create index, include column " + t);
+      include_attrs.emplace_back(column_id);
+    }
+    sql = sql.substr(0, n);
+  }
 
   std::vector<std::string> tok = StringUtility::Split(sql, ',');
   // iterate through returned result
@@ -465,77 +4451,287 @@ IndexMetadata *ParseIndexStatement(std::string &sql,
   }
   if ((int)key_attrs.size() > schema->GetColumnCount())
     throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, format error");
+  // the filter hashes the key bytes, a varchar key may be cut in the leaves
+  if (bloom)
+    for (int attr : key_attrs)
+      if (!schema->IsInlined(attr))
+        throw Exception(EXCEPTION_TYPE_INDEX,
+                        "can't create index, bloom filter of a varchar key");
 
   IndexMetadata *metadata =
-      new IndexMetadata(index_name, table_name, schema, key_attrs);
+      new IndexMetadata(index_name + name_suffix, table_name, schema,
+                        key_attrs, unique, type, include_attrs, clustered,
+                        buffered, bloom);
 
   LOG_DEBUG("%s", metadata->ToString().c_str());
   return metadata;
 }
 
-Tuple ConstructTuple(Schema *schema, sqlite3_value **argv) {
+/*
+ * Serialized from the sqlite values in place, in the format of
+ * Tuple(values, schema) without a Value per column. A null text is a null
+ * varchar
+ */
+Tuple ConstructTuple(Schema *schema, sqlite3_value **argv, Arena *arena) {
   int column_count = schema->GetColumnCount();
-  Value v(TypeId::INVALID);
-  std::vector<Value> values;
-  // iterate through schema, generate column value to insert
+  int32_t size = schema->GetLength();
+  for (auto &i : schema->GetUnlinedColumns()) {
+    auto text = reinterpret_cast<const char *>(sqlite3_value_text(argv[i]));
+    size += sizeof(uint32_t) + (text == nullptr ? 0 : strlen(text) + 1);
+  }
+  Tuple tuple(size, arena);
+  char *data = tuple.GetData();
+  int32_t offset = schema->GetLength();
+  // iterate through schema, serialize each column value to insert
   for (int i = 0; i < column_count; i++) {
-    TypeId type = schema->GetType(i);
-
-    switch (type) {
+    char *column = data + schema->GetOffset(i);
+    // a null is stored as the sentinel of its type
+    bool null = sqlite3_value_type(argv[i]) == SQLITE_NULL;
+    switch (schema->GetType(i)) {
     case TypeId::BOOLEAN:
-    case TypeId::INTEGER:
-    case TypeId::SMALLINT:
     case TypeId::TINYINT:
-      v = Value(type, (int32_t)sqlite3_value_int(argv[i]));
+      *reinterpret_cast<int8_t *>(column) =
+          null ? PELOTON_INT8_NULL : sqlite3_value_int(argv[i]);
+      break;
+    case TypeId::SMALLINT:
+      *reinterpret_cast<int16_t *>(column) =
+          null ? PELOTON_INT16_NULL : sqlite3_value_int(argv[i]);
+      break;
+    case TypeId::INTEGER:
+      *reinterpret_cast<int32_t *>(column) =
+          null ? PELOTON_INT32_NULL : sqlite3_value_int(argv[i]);
       break;
     case TypeId::BIGINT:
-      v = Value(type, (int64_t)sqlite3_value_int64(argv[i]));
+      *reinterpret_cast<int64_t *>(column) =
+          null ? PELOTON_INT64_NULL : sqlite3_value_int64(argv[i]);
       break;
     case TypeId::DECIMAL:
-      v = Value(type, sqlite3_value_double(argv[i]));
+      *reinterpret_cast<double *>(column) =
+          null ? PELOTON_DECIMAL_NULL : sqlite3_value_double(argv[i]);
       break;
-    case TypeId::VARCHAR:
-      v = Value(type, std::string(reinterpret_cast<const char *>(
-                          sqlite3_value_text(argv[i]))));
+    case TypeId::VARCHAR: {
+      *reinterpret_cast<int32_t *>(column) = offset;
+      auto text = reinterpret_cast<const char *>(sqlite3_value_text(argv[i]));
+      uint32_t len = text == nullptr ? PELOTON_VALUE_NULL : strlen(text) + 1;
+      memcpy(data + offset, &len, sizeof(uint32_t));
+      offset += sizeof(uint32_t);
+      if (text != nullptr) {
+        memcpy(data + offset, text, len);
+        offset += len;
+      }
       break;
+    }
     default:
+      memset(column, 0, schema->GetLength(i));
       break;
     } // End of switch
-    values.emplace_back(v);
   }
-  Tuple tuple(values, schema);
-
   return tuple;
 }
 
-// serve the functionality of index factory
-Index *ConstructIndex(IndexMetadata *metadata,
-                      BufferPoolManager *buffer_pool_manager,
-                      page_id_t root_id) {
+/*
+ * Key of a range bound. The bound may only get looser, sqlite checks the
+ * rows again: a fraction on an integer column is cut towards zero and the
+ * bound made inclusive, a bound that can not be compared with the column
+ * (null, text against numbers, out of range) is dropped and false returned.
+ * Varchar keys may be cut to the key size, their bounds are inclusive.
+ */
+bool ConstructBound(Schema *key_schema, sqlite3_value *arg, Tuple &key,
+                    bool &inclusive, Arena *arena) {
+  TypeId type = key_schema->GetType(0);
+  int64_t min = 0, max = 0;
+  switch (type) {
+  case TypeId::BOOLEAN:
+    min = PELOTON_BOOLEAN_MIN, max = PELOTON_BOOLEAN_MAX;
+    break;
+  case TypeId::TINYINT:
+    min = PELOTON_INT8_MIN, max = PELOTON_INT8_MAX;
+    break;
+  case TypeId::SMALLINT:
+    min = PELOTON_INT16_MIN, max = PELOTON_INT16_MAX;
+    break;
+  case TypeId::INTEGER:
+    min = PELOTON_INT32_MIN, max = PELOTON_INT32_MAX;
+    break;
+  case TypeId::BIGINT:
+    min = PELOTON_INT64_MIN, max = PELOTON_INT64_MAX;
+    break;
+  default:
+    break;
+  }
+
+  Value v(TypeId::INVALID);
+  // numeric columns compare with text that looks like a number
+  int arg_type = type == TypeId::VARCHAR ? sqlite3_value_type(arg)
+                                         : sqlite3_value_numeric_type(arg);
+  if (min != max) {
+    if (arg_type == SQLITE_INTEGER) {
+      int64_t value = sqlite3_value_int64(arg);
+      if (value < min || value > max)
+        return false;
+      v = type == TypeId::BIGINT ? Value(type, value)
+                                 : Value(type, static_cast<int32_t>(value));
+    } else if (arg_type == SQLITE_FLOAT) {
+      double value = std::trunc(sqlite3_value_double(arg));
+      if (std::isnan(value) || value < min || value > max)
+        return false;
+      v = type == TypeId::BIGINT
+              ? Value(type, static_cast<int64_t>(value))
+              : Value(type, static_cast<int32_t>(value));
+      inclusive = true;
+    } else {
+      return false;
+    }
+  } else if (type == TypeId::DECIMAL) {
+    if (arg_type != SQLITE_INTEGER && arg_type != SQLITE_FLOAT)
+      return false;
+    v = Value(type, sqlite3_value_double(arg));
+    inclusive = true;
+  } else if (type == TypeId::VARCHAR) {
+    if (arg_type != SQLITE_TEXT)
+      return false;
+    auto text = reinterpret_cast<const char *>(sqlite3_value_text(arg));
+    v = Value(type, std::string(text));
+    inclusive = true;
+  } else {
+    return false;
+  }
+  std::vector<Value> values;
+  values.push_back(v);
+  key = Tuple(values, key_schema, arena);
+  return true;
+}
+
+/*
+ * A hash index stores the rid next to the key, only the key is hashed
+ */
+static Index *ConstructHashIndex(IndexMetadata *metadata,
+                                 BufferPoolManager *buffer_pool_manager,
+                                 page_id_t directory_id, int tablespace_id) {
   // The size of the key in bytes
   Schema *key_schema = metadata->GetKeySchema();
   int key_size = key_schema->GetLength();
   // for each varchar attribute, we assume the largest size is 16 bytes
   key_size += 16 * key_schema->GetUnlinedColumnCount();
 
+  if (key_size <= 4) {
+    return new HashIndex<GenericKey<4>, RID, GenericComparator<4>>(
+        metadata, buffer_pool_manager, directory_id, tablespace_id);
+  } else if (key_size <= 8) {
+    return new HashIndex<GenericKey<8>, RID, GenericComparator<8>>(
+        metadata, buffer_pool_manager, directory_id, tablespace_id);
+  } else if (key_size <= 16) {
+    return new HashIndex<GenericKey<16>, RID, GenericComparator<16>>(
+        metadata, buffer_pool_manager, directory_id, tablespace_id);
+  } else if (key_size <= 32) {
+    return new HashIndex<GenericKey<32>, RID, GenericComparator<32>>(
+        metadata, buffer_pool_manager, directory_id, tablespace_id);
+  } else {
+    return new HashIndex<GenericKey<64>, RID, GenericComparator<64>>(
+        metadata, buffer_pool_manager, directory_id, tablespace_id);
+  }
+}
+
+// serve the functionality of index factory
+Index *ConstructIndex(IndexMetadata *metadata,
+                      BufferPoolManager *buffer_pool_manager,
+                      page_id_t root_id, page_id_t bloom_page_id,
+                      int tablespace_id) {
+  if (metadata->GetType() == IndexType::HASH)
+    return ConstructHashIndex(metadata, buffer_pool_manager, root_id,
+                              tablespace_id);
+  // kept in memory, filled from the table as it is opened
+  if (metadata->GetType() == IndexType::ART)
+    return new ArtIndex(metadata);
+
+  // The size of the key in bytes, the leaves keep the include columns too
+  Schema *key_schema = metadata->GetEntrySchema();
+  Schema *leaf_schema = metadata->GetLeafSchema();
+  int key_size = leaf_schema->GetLength();
+  // for each varchar attribute, we assume the largest size is 16 bytes
+  key_size += 16 * leaf_schema->GetUnlinedColumnCount();
+
+  // integer keys are compared without deserializing into values
+  if (IsIntegerKey(key_schema)) {
+    TypeId type = key_schema->GetType(0);
+    if (key_schema->GetColumnCount() == 1 && type == TypeId::INTEGER &&
+        key_size <= 4) {
+      return new BPlusTreeIndex<GenericKey<4>, RID,
+                                IntegerComparator<4, int32_t>>(
+          metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
+    } else if (key_schema->GetColumnCount() == 1 && type == TypeId::BIGINT &&
+               key_size <= 8) {
+      return new BPlusTreeIndex<GenericKey<8>, RID,
+                                IntegerComparator<8, int64_t>>(
+          metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
+    } else if (key_size <= 4) {
+      return new BPlusTreeIndex<GenericKey<4>, RID,
+                                CompositeIntegerComparator<4>>(
+          metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
+    } else if (key_size <= 8) {
+      return new BPlusTreeIndex<GenericKey<8>, RID,
+                                CompositeIntegerComparator<8>>(
+          metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
+    } else if (key_size <= 16) {
+      return new BPlusTreeIndex<GenericKey<16>, RID,
+                                CompositeIntegerComparator<16>>(
+          metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
+    } else if (key_size <= 32) {
+      return new BPlusTreeIndex<GenericKey<32>, RID,
+                                CompositeIntegerComparator<32>>(
+          metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
+    } else if (key_size <= 64) {
+      return new BPlusTreeIndex<GenericKey<64>, RID,
+                                CompositeIntegerComparator<64>>(
+          metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
+    }
+  }
+
   if (key_size <= 4) {
     return new BPlusTreeIndex<GenericKey<4>, RID, GenericComparator<4>>(
-        metadata, buffer_pool_manager, root_id);
+        metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
   } else if (key_size <= 8) {
     return new BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>(
-        metadata, buffer_pool_manager, root_id);
+        metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
   } else if (key_size <= 16) {
     return new BPlusTreeIndex<GenericKey<16>, RID, GenericComparator<16>>(
-        metadata, buffer_pool_manager, root_id);
+        metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
   } else if (key_size <= 32) {
     return new BPlusTreeIndex<GenericKey<32>, RID, GenericComparator<32>>(
-        metadata, buffer_pool_manager, root_id);
+        metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
   } else {
     return new BPlusTreeIndex<GenericKey<64>, RID, GenericComparator<64>>(
-        metadata, buffer_pool_manager, root_id);
+        metadata, buffer_pool_manager, root_id, bloom_page_id,
+          tablespace_id);
   }
 }
 
-Transaction *GetTransaction() { return global_parameters->transaction_; }
+
+bool IsReservedName(const std::string &name) {
+  return !name.empty() && name[0] == '@';
+}
+
+std::string GetFreeSpaceMapName(const std::string &table_name) {
+  return "@fsm:" + table_name;
+}
+
+std::string GetBloomFilterName(const std::string &index_name) {
+  return "@bloom:" + index_name;
+}
+
+std::string GetCleanCloseName(const std::string &table_name) {
+  return "@clean:" + table_name;
+}
 
 } // namespace cmudb
@@ -2,7 +2,13 @@
  * buffer_pool_manager_test.cpp
  */
 
+#include <chrono>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
 #include "gtest/gtest.h"
@@ -46,4 +52,459 @@ TEST(BufferPoolManagerTest, SampleTest) {
   remove("test.db");
 }
 
+TEST(BufferPoolManagerTest, PartitionTest) {
+  const int num_partitions = 4;
+  const int num_pages = 64;
+  const int num_threads = 4;
+  page_id_t temp_page_id;
+  BufferPoolManager bpm(16, "test.db", num_partitions);
+  EXPECT_EQ(num_partitions, bpm.GetPartitionCount());
+
+  // each partition owns 4 frames, page i lives in partition i % 4
+  for (int i = 0; i < 4 * num_partitions; ++i) {
+    EXPECT_NE(nullptr, bpm.NewPage(temp_page_id));
+    EXPECT_EQ(i, temp_page_id);
+  }
+  // partition 0 is full of pinned pages, so is every other partition
+  EXPECT_EQ(nullptr, bpm.NewPage(temp_page_id));
+  for (int i = 0; i < 4 * num_partitions; ++i) {
+    EXPECT_TRUE(bpm.UnpinPage(i, true));
+  }
+
+  // create more pages than frames, tag each page with its id
+  std::vector<page_id_t> page_ids;
+  while (static_cast<int>(page_ids.size()) < num_pages) {
+    auto page = bpm.NewPage(temp_page_id);
+    if (page == nullptr)
+      continue;
+    snprintf(page->GetData(), PAGE_SIZE, "page %lld",
+             static_cast<long long>(temp_page_id));
+    page_ids.push_back(temp_page_id);
+    EXPECT_TRUE(bpm.UnpinPage(temp_page_id, true));
+  }
+
+  // concurrent readers hit all partitions, evicting each other's pages
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; ++tid) {
+    threads.push_back(std::thread([tid, &bpm, &page_ids]() {
+      char expected[PAGE_SIZE];
+      for (int round = 0; round < 10; ++round) {
+        for (size_t i = tid; i < page_ids.size(); i += num_threads) {
+          auto page = bpm.FetchPage(page_ids[i]);
+          if (page == nullptr)
+            continue;
+          snprintf(expected, PAGE_SIZE, "page %lld",
+                   static_cast<long long>(page_ids[i]));
+          EXPECT_EQ(0, strcmp(page->GetData(), expected));
+          EXPECT_TRUE(bpm.UnpinPage(page_ids[i], false));
+        }
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  remove("test.db");
+}
+
+// chain layout used by PrefetchTest: next page id first, then the text
+static page_id_t ChainNextPageId(Page *page) {
+  return *reinterpret_cast<page_id_t *>(page->GetData());
+}
+
+TEST(BufferPoolManagerTest, PrefetchTest) {
+  const int num_pages = 40;
+  page_id_t temp_page_id;
+  BufferPoolManager bpm(16, "test.db", 2, ReplacerType::LRU_K);
+
+  // build a chain of pages, much larger than the pool
+  std::vector<page_id_t> page_ids;
+  for (int i = 0; i < num_pages; ++i) {
+    auto page = bpm.NewPage(temp_page_id);
+    EXPECT_NE(nullptr, page);
+    page_id_t next_page_id = (i + 1 < num_pages) ? temp_page_id + 1
+                                                 : INVALID_PAGE_ID;
+    memcpy(page->GetData(), &next_page_id, sizeof(page_id_t));
+    snprintf(page->GetData() + sizeof(page_id_t),
+             PAGE_SIZE - sizeof(page_id_t), "page %lld",
+             static_cast<long long>(temp_page_id));
+    page_ids.push_back(temp_page_id);
+    EXPECT_TRUE(bpm.UnpinPage(temp_page_id, true));
+  }
+
+  // scan the chain while read-ahead runs in front of it
+  char expected[PAGE_SIZE];
+  for (int i = 0; i < num_pages; ++i) {
+    if (i % 4 == 0)
+      bpm.PrefetchPage(page_ids[i], 8, ChainNextPageId);
+    auto page = bpm.FetchPage(page_ids[i]);
+    EXPECT_NE(nullptr, page);
+    snprintf(expected, PAGE_SIZE, "page %lld",
+             static_cast<long long>(page_ids[i]));
+    EXPECT_EQ(0, strcmp(page->GetData() + sizeof(page_id_t), expected));
+    EXPECT_TRUE(bpm.UnpinPage(page_ids[i], false));
+  }
+
+  // a page being prefetched can still be deleted
+  bpm.PrefetchPage(page_ids[0]);
+  EXPECT_TRUE(bpm.DeletePage(page_ids[0]));
+
+  remove("test.db");
+}
+
+TEST(BufferPoolManagerTest, PageCleanerTest) {
+  const int num_pages = 64;
+  page_id_t temp_page_id;
+  BufferPoolManager bpm(32, "test.db");
+
+  PageCleanerConfig config;
+  config.dirty_high_water_ = 0.5;
+  config.dirty_low_water_ = 0;
+  config.interval_ = std::chrono::milliseconds(1);
+  bpm.StartPageCleaner(config);
+
+  // every new page is dirty, the cleaner writes them behind our back
+  std::vector<page_id_t> page_ids;
+  for (int i = 0; i < num_pages; ++i) {
+    auto page = bpm.NewPage(temp_page_id);
+    EXPECT_NE(nullptr, page);
+    snprintf(page->GetData(), PAGE_SIZE, "page %lld",
+             static_cast<long long>(temp_page_id));
+    page_ids.push_back(temp_page_id);
+    EXPECT_TRUE(bpm.UnpinPage(temp_page_id, true));
+  }
+  for (int i = 0; i < 1000 && bpm.GetCleanedPageCount() == 0; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_LT(0, bpm.GetCleanedPageCount());
+  // consecutive page ids are coalesced
+  EXPECT_GE(bpm.GetCleanedPageCount(), bpm.GetCleanerWriteCount());
+
+  // evicted pages read back what was written
+  char expected[PAGE_SIZE];
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < num_pages; ++i) {
+      auto page = bpm.FetchPage(page_ids[i]);
+      EXPECT_NE(nullptr, page);
+      snprintf(expected, PAGE_SIZE, "page %lld",
+               static_cast<long long>(page_ids[i]));
+      EXPECT_EQ(0, strcmp(page->GetData(), expected));
+      EXPECT_TRUE(bpm.UnpinPage(page_ids[i], round == 0));
+    }
+  }
+  bpm.StopPageCleaner();
+
+  remove("test.db");
+}
+
+TEST(BufferPoolManagerTest, FrameArenaTest) {
+  const int num_partitions = 2;
+  const int pool_size = 10;
+  page_id_t temp_page_id;
+  BufferPoolManager bpm(pool_size, "test.db", num_partitions,
+                        ReplacerType::LRU, false, true);
+  for (int i = 0; i < num_partitions; ++i)
+    EXPECT_EQ(i % FrameArena::GetNodeCount(), bpm.GetPartitionNode(i));
+
+  // every frame has its own page aligned, zeroed buffer
+  std::vector<char *> buffers;
+  for (int i = 0; i < pool_size; ++i) {
+    auto page = bpm.NewPage(temp_page_id);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(page->GetData()) % PAGE_SIZE);
+    EXPECT_EQ(0, page->GetData()[PAGE_SIZE - 1]);
+    memset(page->GetData(), i + 1, PAGE_SIZE);
+    buffers.push_back(page->GetData());
+  }
+  for (int i = 0; i < pool_size; ++i) {
+    EXPECT_EQ(i + 1, buffers[i][0]);
+    EXPECT_EQ(i + 1, buffers[i][PAGE_SIZE - 1]);
+    for (int j = 0; j < i; ++j)
+      EXPECT_NE(buffers[i], buffers[j]);
+  }
+
+  remove("test.db");
+}
+
+TEST(BufferPoolManagerTest, StatsTest) {
+  page_id_t temp_page_id;
+  BufferPoolManager bpm(4, "test.db");
+
+  for (int i = 0; i < 4; ++i)
+    EXPECT_NE(nullptr, bpm.NewPage(temp_page_id));
+  // every frame is pinned
+  EXPECT_EQ(nullptr, bpm.NewPage(temp_page_id));
+  for (int i = 0; i < 4; ++i)
+    EXPECT_TRUE(bpm.UnpinPage(i, true));
+
+  // two hits, page 4 evicts dirty page 0, page 0 evicts dirty page 1
+  for (page_id_t page_id : {2, 3, 4, 0}) {
+    EXPECT_NE(nullptr, bpm.FetchPage(page_id));
+    EXPECT_TRUE(bpm.UnpinPage(page_id, false));
+  }
+  BufferPoolStats stats = bpm.GetStats();
+  EXPECT_EQ(4, stats.fetches_);
+  EXPECT_EQ(2, stats.hits_);
+  EXPECT_EQ(2, stats.misses_);
+  EXPECT_EQ(2, stats.evictions_);
+  EXPECT_EQ(2, stats.writebacks_);
+  EXPECT_EQ(1, stats.new_page_failures_);
+  EXPECT_EQ(0, stats.fetch_failures_);
+  EXPECT_EQ(0, stats.pin_waits_);
+
+  bpm.ResetStats();
+  EXPECT_EQ(0, bpm.GetStats().fetches_);
+
+  remove("test.db");
+}
+
+TEST(BufferPoolManagerTest, MmapTest) {
+  remove("test.db");
+  remove("test.meta");
+  page_id_t temp_page_id;
+  {
+    BufferPoolManager bpm(10, "test.db");
+    for (int i = 0; i < 8; ++i) {
+      auto page = bpm.NewPage(temp_page_id);
+      ASSERT_NE(nullptr, page);
+      snprintf(page->GetData(), PAGE_SIZE, "page %d", i);
+      bpm.UnpinPage(temp_page_id, true);
+    }
+  }
+
+  BufferPoolManager bpm(2, "test.db");
+  ASSERT_TRUE(bpm.EnableMmap());
+  // frames point into the mapping, two frames serve every page
+  for (int round = 0; round < 2; ++round) {
+    for (page_id_t page_id = 0; page_id < 8; ++page_id) {
+      auto page = bpm.FetchPage(page_id);
+      ASSERT_NE(nullptr, page);
+      EXPECT_EQ(bpm.GetDiskManager()->GetMappedPage(page_id), page->GetData());
+      EXPECT_EQ("page " + std::to_string(page_id), page->GetData());
+      EXPECT_TRUE(bpm.UnpinPage(page_id, false));
+    }
+  }
+  BufferPoolStats stats = bpm.GetStats();
+  EXPECT_EQ(16, stats.misses_);
+  EXPECT_EQ(14, stats.evictions_);
+  EXPECT_EQ(0, stats.writebacks_);
+  EXPECT_EQ(nullptr, bpm.FetchPage(8));
+
+  // nothing reaches the file
+  EXPECT_EQ(nullptr, bpm.NewPage(temp_page_id));
+  EXPECT_FALSE(bpm.DeletePage(0));
+  auto page = bpm.FetchPage(0);
+  ASSERT_NE(nullptr, page);
+  strcpy(page->GetData(), "changed");
+  EXPECT_TRUE(bpm.UnpinPage(0, true));
+  EXPECT_TRUE(bpm.FlushPage(0));
+  bpm.FlushAllPages();
+  EXPECT_EQ(0, bpm.GetStats().writebacks_);
+  char data[PAGE_SIZE];
+  ASSERT_TRUE(bpm.GetDiskManager()->ReadPage(0, data));
+  EXPECT_STREQ("page 0", data);
+
+  remove("test.db");
+  remove("test.meta");
+}
+
+TEST(BufferPoolManagerTest, ChecksumTest) {
+  remove("test.db");
+  remove("test.meta");
+  remove("test.sum");
+  {
+    BufferPoolManager bpm(10, "test.db");
+    page_id_t page_id;
+    auto page = bpm.NewPage(page_id);
+    ASSERT_NE(nullptr, page);
+    strcpy(page->GetData(), "checked");
+    bpm.UnpinPage(page_id, true);
+  }
+  FILE *file = fopen("test.db", "r+b");
+  ASSERT_NE(nullptr, file);
+  fputc('C', file);
+  fclose(file);
+
+  // a corrupt page is not handed out, the frame stays free
+  BufferPoolManager bpm(1, "test.db");
+  EXPECT_EQ(nullptr, bpm.FetchPage(0));
+  EXPECT_EQ(1u, bpm.GetStats().corrupt_pages_);
+  page_id_t page_id;
+  EXPECT_NE(nullptr, bpm.NewPage(page_id));
+  bpm.UnpinPage(page_id, false);
+
+  remove("test.db");
+  remove("test.meta");
+  remove("test.sum");
+}
+
+TEST(BufferPoolManagerTest, AdmissionTest) {
+  remove("test.db");
+  remove("test.meta");
+  BufferPoolManager bpm(4, "test.db");
+  AdmissionConfig admission;
+  admission.blocking_ = true;
+  admission.timeout_ = std::chrono::milliseconds(50);
+  admission.pin_quota_ = 2;
+  bpm.SetAdmission(admission);
+  size_t pins = BufferPoolManager::GetThreadPinCount();
+  page_id_t page_ids[4];
+  for (int i = 0; i < 4; ++i)
+    ASSERT_NE(nullptr, bpm.NewPage(page_ids[i]));
+  EXPECT_EQ(pins + 4, BufferPoolManager::GetThreadPinCount());
+
+  // a thread over its quota fails at once instead of waiting
+  page_id_t page_id;
+  EXPECT_EQ(nullptr, bpm.NewPage(page_id));
+  EXPECT_EQ(1u, bpm.GetStats().admission_rejects_);
+  EXPECT_EQ(0u, bpm.GetStats().frame_waits_);
+
+  // another one waits until the timeout
+  std::thread([&] {
+    page_id_t page_id;
+    EXPECT_EQ(nullptr, bpm.NewPage(page_id));
+  }).join();
+  EXPECT_EQ(1u, bpm.GetStats().frame_wait_timeouts_);
+
+  // or until a frame is unpinned, and reads the page then
+  strcpy(bpm.FetchPage(page_ids[0])->GetData(), "evicted");
+  bpm.UnpinPage(page_ids[0], true);
+  bpm.UnpinPage(page_ids[0], true);
+  ASSERT_NE(nullptr, bpm.NewPage(page_id));
+  std::thread waiter([&] {
+    Page *page = bpm.FetchPage(page_ids[0]);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ(0, strcmp(page->GetData(), "evicted"));
+    EXPECT_EQ(1u, BufferPoolManager::GetThreadPinCount());
+    bpm.UnpinPage(page_ids[0], false);
+    EXPECT_EQ(0u, BufferPoolManager::GetThreadPinCount());
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  bpm.UnpinPage(page_ids[1], false);
+  waiter.join();
+  BufferPoolStats stats = bpm.GetStats();
+  EXPECT_LE(2u, stats.frame_waits_);
+  EXPECT_EQ(1u, stats.frame_wait_timeouts_);
+  EXPECT_LT(0u, stats.frame_wait_ns_);
+  EXPECT_EQ(2u, stats.new_page_failures_);
+
+  remove("test.db");
+  remove("test.meta");
+}
+
+TEST(BufferPoolManagerTest, ResizeTest) {
+  remove("test.db");
+  remove("test.meta");
+  BufferPoolManager bpm(64, "test.db", 2);
+  std::vector<page_id_t> page_ids(64);
+  for (size_t i = 0; i < page_ids.size(); ++i) {
+    Page *page = bpm.NewPage(page_ids[i]);
+    ASSERT_NE(nullptr, page);
+    snprintf(page->GetData(), PAGE_SIZE, "page %zu", i);
+    EXPECT_TRUE(bpm.UnpinPage(page_ids[i], true));
+  }
+  EXPECT_EQ(64u, bpm.GetFrameCount());
+
+  // pinned pages keep their frames, the rest is evicted and written back
+  for (size_t i = 0; i < 4; ++i)
+    ASSERT_NE(nullptr, bpm.FetchPage(page_ids[i]));
+  EXPECT_EQ(48u, bpm.Resize(48));
+  EXPECT_EQ(2 * BUFFER_POOL_MIN_FRAMES, bpm.Resize(0));
+  for (size_t i = 0; i < 4; ++i)
+    EXPECT_TRUE(bpm.UnpinPage(page_ids[i], false));
+  for (size_t i = 0; i < page_ids.size(); ++i) {
+    Page *page = bpm.FetchPage(page_ids[i]);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ("page " + std::to_string(i), std::string(page->GetData()));
+    EXPECT_TRUE(bpm.UnpinPage(page_ids[i], false));
+  }
+  EXPECT_EQ(2 * BUFFER_POOL_MIN_FRAMES, bpm.GetFrameCount());
+  EXPECT_EQ(64u, bpm.Resize(100));
+
+  // under a budget the pool takes what the others leave
+  MemoryTracker::Flush();
+  size_t others = MemoryTracker::GetTotalUsage() - 64 * PAGE_SIZE;
+  MemoryTracker::SetBudget(others + 48 * PAGE_SIZE);
+  EXPECT_EQ(48u, bpm.Resize(64));
+  EXPECT_FALSE(MemoryTracker::IsOverBudget());
+  // a partition fits in what is left once a miss needs a frame
+  MemoryTracker::Charge(MemoryComponent::EXECUTION, 16 * PAGE_SIZE);
+  MemoryTracker::Flush();
+  EXPECT_TRUE(MemoryTracker::IsOverBudget());
+  page_id_t page_id;
+  ASSERT_NE(nullptr, bpm.NewPage(page_id));
+  EXPECT_TRUE(bpm.UnpinPage(page_id, true));
+  EXPECT_EQ(40u, bpm.GetFrameCount());
+  MemoryTracker::Release(MemoryComponent::EXECUTION, 16 * PAGE_SIZE);
+  MemoryTracker::SetBudget(0);
+  EXPECT_EQ(64u, bpm.Resize(64));
+  remove("test.db");
+  remove("test.meta");
+}
+
+/*
+ * The list is hottest first, partitions taking turns. A smaller pool reads
+ * the hottest pages of it while starting, they are hits when fetched
+ */
+TEST(BufferPoolManagerTest, WarmRestartTest) {
+  const int num_pages = 24;
+  page_id_t temp_page_id;
+  remove("test.db");
+  remove("test.warm");
+  {
+    BufferPoolManager bpm(32, "test.db", 2);
+    for (int i = 0; i < num_pages; ++i) {
+      auto page = bpm.NewPage(temp_page_id);
+      EXPECT_NE(nullptr, page);
+      snprintf(page->GetData(), PAGE_SIZE, "page %lld",
+               static_cast<long long>(temp_page_id));
+      EXPECT_TRUE(bpm.UnpinPage(temp_page_id, true));
+    }
+    EXPECT_NE(nullptr, bpm.FetchPage(0));
+    EXPECT_TRUE(bpm.DumpHotPages("test.warm"));
+    std::ifstream list("test.warm");
+    std::vector<page_id_t> page_ids;
+    for (page_id_t page_id; list >> page_id;)
+      page_ids.push_back(page_id);
+    EXPECT_EQ(num_pages, page_ids.size());
+    EXPECT_EQ(0, page_ids[0]);
+    EXPECT_EQ(23, page_ids[1]);
+    EXPECT_EQ(22, page_ids[2]);
+    EXPECT_EQ(1, page_ids.back());
+
+    // all resident, the list is written again at shutdown
+    bpm.StartWarmRestart("test.warm", std::chrono::hours(1));
+    for (int i = 0; i < 1000 && bpm.IsWarming(); ++i)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(0, bpm.GetWarmedPageCount());
+    EXPECT_TRUE(bpm.UnpinPage(0, false));
+  }
+
+  BufferPoolManager bpm(16, "test.db", 2);
+  bpm.StartWarmRestart("test.warm", std::chrono::hours(1));
+  for (int i = 0; i < 1000 && bpm.IsWarming(); ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_FALSE(bpm.IsWarming());
+  EXPECT_EQ(16, bpm.GetWarmedPageCount());
+  bpm.ResetStats();
+  char expected[PAGE_SIZE];
+  for (page_id_t page_id = 9; page_id <= num_pages; ++page_id) {
+    page_id_t hot_page_id = page_id == num_pages ? 0 : page_id;
+    auto page = bpm.FetchPage(hot_page_id);
+    EXPECT_NE(nullptr, page);
+    snprintf(expected, PAGE_SIZE, "page %lld",
+             static_cast<long long>(hot_page_id));
+    EXPECT_EQ(0, strcmp(page->GetData(), expected));
+    EXPECT_TRUE(bpm.UnpinPage(hot_page_id, false));
+  }
+  EXPECT_EQ(0, bpm.GetStats().misses_);
+  EXPECT_NE(nullptr, bpm.FetchPage(1));
+  EXPECT_EQ(1, bpm.GetStats().misses_);
+  EXPECT_TRUE(bpm.UnpinPage(1, false));
+  bpm.StopWarmRestart();
+
+  remove("test.db");
+  remove("test.warm");
+}
+
 } // namespace cmudb
@@ -0,0 +1,91 @@
+/**
+ * clock_replacer_test.cpp
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "buffer/clock_replacer.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(ClockReplacerTest, SampleTest) {
+  ClockReplacer<int> clock_replacer;
+
+  // push element into replacer
+  clock_replacer.Insert(1);
+  clock_replacer.Insert(2);
+  clock_replacer.Insert(3);
+  clock_replacer.Insert(4);
+  clock_replacer.Insert(5);
+  clock_replacer.Insert(6);
+  clock_replacer.Insert(1);
+  EXPECT_EQ(6, clock_replacer.Size());
+
+  // pop element from replacer, 1 was referenced twice
+  int value;
+  clock_replacer.Victim(value);
+  EXPECT_EQ(2, value);
+  clock_replacer.Victim(value);
+  EXPECT_EQ(3, value);
+  clock_replacer.Victim(value);
+  EXPECT_EQ(4, value);
+
+  // remove element from replacer
+  EXPECT_EQ(false, clock_replacer.Erase(4));
+  EXPECT_EQ(true, clock_replacer.Erase(6));
+  EXPECT_EQ(2, clock_replacer.Size());
+
+  // pop element from replacer after removal
+  clock_replacer.Victim(value);
+  EXPECT_EQ(5, value);
+  clock_replacer.Victim(value);
+  EXPECT_EQ(1, value);
+  EXPECT_EQ(false, clock_replacer.Victim(value));
+}
+
+TEST(ClockReplacerTest, ScanResistanceTest) {
+  ClockReplacer<int> clock_replacer;
+
+  // hot values 0..3, referenced many times
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < 4; ++i)
+      clock_replacer.Insert(i);
+  }
+  // a sequential scan touches every other value once, evicting as it goes
+  int value;
+  for (int i = 100; i < 104; ++i)
+    clock_replacer.Insert(i);
+  for (int i = 104; i < 112; ++i) {
+    EXPECT_EQ(true, clock_replacer.Victim(value));
+    EXPECT_GE(value, 100);
+    clock_replacer.Insert(i);
+  }
+  EXPECT_EQ(8, clock_replacer.Size());
+}
+
+// the values from the hottest, the reverse of the victims to come
+TEST(ClockReplacerTest, HotValuesTest) {
+  ClockReplacer<int> replacer;
+  for (int i = 1; i <= 6; ++i)
+    replacer.Insert(i);
+  replacer.Insert(2);
+  replacer.Insert(2);
+  replacer.Insert(5);
+  replacer.Erase(3);
+  int victim;
+  replacer.Victim(victim);
+  replacer.InsertPrefetched(7);
+
+  std::vector<int> hot_values;
+  replacer.GetHotValues(hot_values);
+  EXPECT_EQ(replacer.Size(), hot_values.size());
+  std::vector<int> victims;
+  int value;
+  while (replacer.Victim(value))
+    victims.insert(victims.begin(), value);
+  EXPECT_EQ(victims, hot_values);
+}
+
+} // namespace cmudb
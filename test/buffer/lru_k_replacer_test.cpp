@@ -0,0 +1,92 @@
+/**
+ * lru_k_replacer_test.cpp
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "buffer/lru_k_replacer.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(LRUKReplacerTest, SampleTest) {
+  LRUKReplacer<int> lru_k_replacer(2);
+
+  // push element into replacer, 1 and 2 are referenced twice
+  lru_k_replacer.Insert(1);
+  lru_k_replacer.Insert(2);
+  lru_k_replacer.Insert(3);
+  lru_k_replacer.Insert(4);
+  lru_k_replacer.Insert(2);
+  lru_k_replacer.Insert(1);
+  EXPECT_EQ(4, lru_k_replacer.Size());
+
+  // values referenced once go first, oldest first
+  int value;
+  lru_k_replacer.Victim(value);
+  EXPECT_EQ(3, value);
+  lru_k_replacer.Victim(value);
+  EXPECT_EQ(4, value);
+  EXPECT_EQ(2, lru_k_replacer.GetProtectedCount());
+  // then by second most recent reference, 1 < 2
+  lru_k_replacer.Victim(value);
+  EXPECT_EQ(1, value);
+
+  // remove element from replacer
+  EXPECT_EQ(false, lru_k_replacer.Erase(1));
+  EXPECT_EQ(true, lru_k_replacer.Erase(2));
+  EXPECT_EQ(0, lru_k_replacer.Size());
+  EXPECT_EQ(false, lru_k_replacer.Victim(value));
+
+  // history survives erase, 2 is back in cache queue
+  lru_k_replacer.Insert(5);
+  lru_k_replacer.Insert(2);
+  lru_k_replacer.Victim(value);
+  EXPECT_EQ(5, value);
+  lru_k_replacer.Victim(value);
+  EXPECT_EQ(2, value);
+  EXPECT_EQ(3, lru_k_replacer.GetProtectedCount());
+}
+
+TEST(LRUKReplacerTest, ScanResistanceTest) {
+  LRUKReplacer<int> lru_k_replacer(2);
+
+  // hot values 0..3, e.g. B+ tree internal pages
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 4; ++i)
+      lru_k_replacer.Insert(i);
+  }
+  // a sequential scan evicting one value per new page
+  int value;
+  lru_k_replacer.Insert(100);
+  for (int i = 101; i < 200; ++i) {
+    EXPECT_EQ(true, lru_k_replacer.Victim(value));
+    EXPECT_EQ(i - 1, value);
+    lru_k_replacer.Insert(i);
+  }
+  EXPECT_EQ(99, lru_k_replacer.GetProtectedCount());
+  EXPECT_EQ(5, lru_k_replacer.Size());
+}
+
+// the values from the hottest, the reverse of the victims to come
+TEST(LRUKReplacerTest, HotValuesTest) {
+  LRUKReplacer<int> replacer;
+  for (int i = 1; i <= 6; ++i)
+    replacer.Insert(i);
+  replacer.Insert(4);
+  replacer.Insert(2);
+  replacer.Erase(3);
+  replacer.InsertPrefetched(7);
+
+  std::vector<int> hot_values;
+  replacer.GetHotValues(hot_values);
+  EXPECT_EQ(replacer.Size(), hot_values.size());
+  std::vector<int> victims;
+  int value;
+  while (replacer.Victim(value))
+    victims.insert(victims.begin(), value);
+  EXPECT_EQ(victims, hot_values);
+}
+
+} // namespace cmudb
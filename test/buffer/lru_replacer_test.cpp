@@ -3,6 +3,7 @@
  */
 
 #include <cstdio>
+#include <vector>
 
 #include "buffer/lru_replacer.h"
 #include "gtest/gtest.h"
@@ -43,4 +44,24 @@ TEST(LRUReplacerTest, SampleTest) {
   EXPECT_EQ(1, value);
 }
 
+// the values from the hottest, the reverse of the victims to come
+TEST(LRUReplacerTest, HotValuesTest) {
+  LRUReplacer<int> replacer;
+  replacer.Insert(1);
+  replacer.Insert(2);
+  replacer.Insert(3);
+  replacer.Insert(1);
+  replacer.Insert(4);
+  replacer.Erase(2);
+
+  std::vector<int> hot_values;
+  replacer.GetHotValues(hot_values);
+  EXPECT_EQ(replacer.Size(), hot_values.size());
+  std::vector<int> victims;
+  int value;
+  while (replacer.Victim(value))
+    victims.insert(victims.begin(), value);
+  EXPECT_EQ(victims, hot_values);
+}
+
 } // namespace cmudb
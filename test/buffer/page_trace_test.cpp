@@ -0,0 +1,120 @@
+/**
+ * page_trace_test.cpp
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "buffer/page_trace.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static PageTraceRecord MakeRecord(PageTraceEvent event, page_id_t page_id) {
+  PageTraceRecord record;
+  memset(&record, 0, sizeof(record));
+  record.page_id_ = page_id;
+  record.event_ = static_cast<uint8_t>(event);
+  return record;
+}
+
+TEST(PageTraceTest, RecordTest) {
+  remove("test.db");
+  remove("test.trace");
+  BufferPoolManager bpm(10, "test.db");
+  page_id_t page_id;
+  ASSERT_NE(nullptr, bpm.NewPage(page_id));
+  EXPECT_TRUE(bpm.UnpinPage(page_id, true));
+
+  // what happened before the start is not recorded
+  EXPECT_FALSE(bpm.IsTracing());
+  EXPECT_TRUE(bpm.StartTrace("test.trace", 64));
+  EXPECT_TRUE(bpm.IsTracing());
+  page_id_t new_page_id;
+  ASSERT_NE(nullptr, bpm.NewPage(new_page_id));
+  EXPECT_TRUE(bpm.UnpinPage(new_page_id, false));
+  ASSERT_NE(nullptr, bpm.FetchPage(page_id));
+  EXPECT_TRUE(bpm.UnpinPage(page_id, true));
+  EXPECT_TRUE(bpm.DeletePage(new_page_id));
+  EXPECT_EQ(5u, bpm.StopTrace());
+  EXPECT_FALSE(bpm.IsTracing());
+  ASSERT_NE(nullptr, bpm.FetchPage(page_id));
+  EXPECT_TRUE(bpm.UnpinPage(page_id, false));
+
+  std::vector<PageTraceRecord> records;
+  ASSERT_TRUE(PageTrace::Read("test.trace", records));
+  ASSERT_EQ(5u, records.size());
+  std::vector<PageTraceEvent> events{
+      PageTraceEvent::NEW, PageTraceEvent::UNPIN, PageTraceEvent::FETCH,
+      PageTraceEvent::UNPIN, PageTraceEvent::DELETE};
+  std::vector<page_id_t> page_ids{new_page_id, new_page_id, page_id, page_id,
+                                  new_page_id};
+  for (size_t i = 0; i < records.size(); ++i) {
+    EXPECT_EQ(static_cast<uint8_t>(events[i]), records[i].event_);
+    EXPECT_EQ(page_ids[i], records[i].page_id_);
+    if (i > 0) {
+      EXPECT_LE(records[i - 1].time_ns_, records[i].time_ns_);
+    }
+  }
+  EXPECT_EQ(0, records[1].dirty_);
+  EXPECT_EQ(1, records[3].dirty_);
+
+  // a full ring keeps the latest records, oldest first
+  EXPECT_TRUE(bpm.StartTrace("test.trace", 4));
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_NE(nullptr, bpm.FetchPage(page_id));
+    EXPECT_TRUE(bpm.UnpinPage(page_id, false));
+  }
+  EXPECT_EQ(10u, bpm.StopTrace());
+  ASSERT_TRUE(PageTrace::Read("test.trace", records));
+  ASSERT_EQ(4u, records.size());
+  for (size_t i = 0; i < records.size(); ++i)
+    EXPECT_EQ(static_cast<uint8_t>(i % 2 == 0 ? PageTraceEvent::FETCH
+                                              : PageTraceEvent::UNPIN),
+              records[i].event_);
+  EXPECT_FALSE(PageTrace::Read("test.db", records));
+  remove("test.db");
+  remove("test.trace");
+}
+
+TEST(PageTraceTest, ReplayTest) {
+  // a loop over 8 pages, a page unpinned before the next one is fetched
+  std::vector<PageTraceRecord> records;
+  for (int round = 0; round < 10; ++round)
+    for (page_id_t page_id = 0; page_id < 8; ++page_id) {
+      records.push_back(MakeRecord(PageTraceEvent::FETCH, page_id));
+      records.push_back(MakeRecord(PageTraceEvent::UNPIN, page_id));
+    }
+  // every page fits, only the first round misses
+  LRUReplacer<page_id_t> lru;
+  ReplaySummary summary = ReplayPageTrace(records, lru, 8);
+  EXPECT_EQ(80u, summary.fetches_);
+  EXPECT_EQ(72u, summary.hits_);
+  EXPECT_EQ(0u, summary.evictions_);
+  // a loop one page larger than the pool defeats LRU, CLOCK the same
+  LRUReplacer<page_id_t> small_lru;
+  summary = ReplayPageTrace(records, small_lru, 7);
+  EXPECT_EQ(0u, summary.hits_);
+  EXPECT_EQ(73u, summary.evictions_);
+  ClockReplacer<page_id_t> clock;
+  EXPECT_EQ(0u, ReplayPageTrace(records, clock, 7).hits_);
+
+  // pinned pages are not evicted, a pool they fill fails the next fetch
+  records.clear();
+  for (page_id_t page_id = 0; page_id < 3; ++page_id)
+    records.push_back(MakeRecord(PageTraceEvent::FETCH, page_id));
+  records.push_back(MakeRecord(PageTraceEvent::UNPIN, 0));
+  records.push_back(MakeRecord(PageTraceEvent::FETCH, 3));
+  records.push_back(MakeRecord(PageTraceEvent::FETCH, 1));
+  records.push_back(MakeRecord(PageTraceEvent::FETCH, 0));
+  LRUKReplacer<page_id_t> lru_k;
+  summary = ReplayPageTrace(records, lru_k, 3);
+  EXPECT_EQ(6u, summary.fetches_);
+  EXPECT_EQ(1u, summary.hits_);
+  EXPECT_EQ(1u, summary.evictions_);
+  EXPECT_EQ(1u, summary.pin_failures_);
+}
+
+} // namespace cmudb
@@ -0,0 +1,44 @@
+/**
+ * arena_test.cpp
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+
+#include "common/arena.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(ArenaTest, AllocateTest) {
+  Arena arena(1024);
+  EXPECT_EQ(0u, arena.GetChunkCount());
+  std::set<char *> first;
+  // aligned and disjoint allocations, chunks added as they fill
+  char *last = nullptr;
+  for (int i = 1; i <= 100; i++) {
+    char *data = arena.Allocate(i % 20 + 1);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(data) % ARENA_ALIGNMENT);
+    memset(data, i, i % 20 + 1);
+    if (last != nullptr && data > last) {
+      EXPECT_LE(last + 1, data);
+    }
+    EXPECT_TRUE(first.insert(data).second);
+    last = data;
+  }
+  size_t chunks = arena.GetChunkCount();
+  EXPECT_LT(1u, chunks);
+  // a large allocation gets a block of its own
+  char *large = arena.Allocate(4000);
+  memset(large, 0, 4000);
+  EXPECT_EQ(chunks, arena.GetChunkCount());
+
+  // the same chunks serve the same allocations after a reset
+  arena.Reset();
+  for (int i = 1; i <= 100; i++)
+    EXPECT_EQ(1u, first.count(arena.Allocate(i % 20 + 1)));
+  EXPECT_EQ(chunks, arena.GetChunkCount());
+}
+
+} // namespace cmudb
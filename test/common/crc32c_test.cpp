@@ -0,0 +1,52 @@
+/**
+ * crc32c_test.cpp
+ */
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/crc32c.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// a bit at a time, the definition
+static uint32_t ReferenceCrc32c(const char *data, size_t size) {
+  uint32_t crc = ~0U;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= static_cast<uint8_t>(data[i]);
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0);
+  }
+  return ~crc;
+}
+
+TEST(Crc32cTest, KnownValuesTest) {
+  EXPECT_EQ(0u, Crc32c("", 0));
+  EXPECT_EQ(0xe3069283u, Crc32c("123456789", 9));
+  std::string zeros(32, '\0');
+  EXPECT_EQ(0x8a9136aau, Crc32c(zeros.data(), zeros.size()));
+  std::string ones(32, '\xff');
+  EXPECT_EQ(0x62a8ab43u, Crc32c(ones.data(), ones.size()));
+}
+
+TEST(Crc32cTest, ReferenceTest) {
+  std::mt19937 random(42);
+  std::vector<char> data(4096 + 7);
+  for (char &c : data)
+    c = static_cast<char>(random());
+  // every tail length and alignment of the eight byte steps
+  for (size_t offset = 0; offset < 8; offset++)
+    for (size_t size : {0, 1, 7, 8, 9, 63, 4096}) {
+      uint32_t expected = ReferenceCrc32c(data.data() + offset, size);
+      EXPECT_EQ(expected, Crc32c(data.data() + offset, size));
+      // in two pieces
+      uint32_t crc = Crc32c(data.data() + offset, size / 3);
+      EXPECT_EQ(expected, Crc32c(data.data() + offset + size / 3,
+                                 size - size / 3, crc));
+    }
+}
+
+} // namespace cmudb
@@ -0,0 +1,111 @@
+/**
+ * latch_stats_test.cpp
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/latch_stats.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(LatchStatsTest, CounterTest) {
+  const int num_threads = 4;
+  LatchStats::Enable(true, 4);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([] {
+      for (int j = 0; j < 100; ++j) {
+        LatchStats::RecordAcquire(LatchClass::PAGE);
+        // page 7 waits longest, page 3 most often
+        LatchStats::RecordWait(LatchClass::PAGE, 100, j % 2 == 0 ? 3 : 5);
+        if (j % 4 == 0)
+          LatchStats::RecordWait(LatchClass::PAGE, 1000, 7);
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+  LatchClassStats stats = LatchStats::GetStats(LatchClass::PAGE);
+  EXPECT_EQ(num_threads * 100, stats.acquires_);
+  EXPECT_EQ(num_threads * 125, stats.waits_);
+  EXPECT_EQ(num_threads * (100 * 100 + 25 * 1000), stats.wait_ns_);
+  EXPECT_EQ(0, LatchStats::GetStats(LatchClass::LOCK_MANAGER).acquires_);
+
+  // one in 4 waits is sampled and weighted by 4, the estimate is close
+  std::vector<HotPage> pages = LatchStats::GetHotPages(10);
+  ASSERT_EQ(3, pages.size());
+  EXPECT_EQ(7, pages[0].page_id_);
+  uint64_t waits = 0;
+  for (auto &page : pages)
+    waits += page.waits_;
+  EXPECT_NEAR(num_threads * 125, waits, num_threads * 4);
+  EXPECT_EQ(1, LatchStats::GetHotPages(1).size());
+
+  // mutexes are counted, and timed if taken
+  std::mutex mutex;
+  std::unique_lock<std::mutex> guard(mutex);
+  std::thread waiter([&] {
+    auto waiter_guard = LatchStats::Lock(LatchClass::LOCK_MANAGER, mutex);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  guard.unlock();
+  waiter.join();
+  stats = LatchStats::GetStats(LatchClass::LOCK_MANAGER);
+  EXPECT_EQ(1, stats.acquires_);
+  EXPECT_EQ(1, stats.waits_);
+  EXPECT_LE(5000000, stats.wait_ns_);
+
+  // enabling again starts over
+  LatchStats::Enable(false);
+  LatchStats::Enable(true);
+  EXPECT_EQ(0, LatchStats::GetStats(LatchClass::PAGE).acquires_);
+  EXPECT_EQ(0, LatchStats::GetHotPages(10).size());
+  LatchStats::Enable(false);
+}
+
+TEST(LatchStatsTest, PageTest) {
+  BufferPoolManager bpm(10, "test.db");
+  page_id_t page_id;
+  Page *page = bpm.NewPage(page_id);
+  ASSERT_NE(nullptr, page);
+  LatchStats::Enable(true, 1);
+
+  // a reader waits for the writer
+  page->WLatch();
+  std::thread reader([&] {
+    page->RLatch();
+    page->RUnlatch();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  page->WUnlatch();
+  reader.join();
+  page->RLatch();
+  page->RUnlatch();
+
+  LatchClassStats stats = LatchStats::GetStats(LatchClass::PAGE);
+  EXPECT_EQ(3, stats.acquires_);
+  EXPECT_EQ(1, stats.waits_);
+  EXPECT_LE(5000000, stats.wait_ns_);
+  std::vector<HotPage> pages = LatchStats::GetHotPages(10);
+  ASSERT_EQ(1, pages.size());
+  EXPECT_EQ(page_id, pages[0].page_id_);
+  EXPECT_EQ(stats.wait_ns_, pages[0].wait_ns_);
+  // the partition latch of the buffer pool is counted too
+  EXPECT_TRUE(bpm.UnpinPage(page_id, false));
+  EXPECT_EQ(1, LatchStats::GetStats(LatchClass::BUFFER_POOL).acquires_);
+
+  LatchStats::Enable(false);
+  page = bpm.FetchPage(page_id);
+  page->WLatch();
+  page->WUnlatch();
+  EXPECT_EQ(3, LatchStats::GetStats(LatchClass::PAGE).acquires_);
+  EXPECT_TRUE(bpm.UnpinPage(page_id, false));
+  remove("test.db");
+}
+
+} // namespace cmudb
@@ -0,0 +1,65 @@
+/**
+ * latency_stats_test.cpp
+ */
+
+#include <thread>
+#include <vector>
+
+#include "common/latency_stats.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(LatencyStatsTest, BucketTest) {
+  // every value falls in a bucket whose limit is within 12.5% above it
+  for (uint64_t ns : {0ULL, 1ULL, 7ULL, 8ULL, 9ULL, 15ULL, 16ULL, 1000ULL,
+                      123456789ULL, 1ULL << 40, ~0ULL}) {
+    int bucket = LatencyHistogram::GetBucket(ns);
+    EXPECT_LE(0, bucket);
+    EXPECT_GT(LATENCY_BUCKETS, bucket);
+    uint64_t limit = LatencyHistogram::GetBucketLimit(bucket);
+    EXPECT_LE(ns, limit);
+    EXPECT_LE(limit - ns, ns / 8);
+    if (bucket > 0) {
+      EXPECT_LT(LatencyHistogram::GetBucketLimit(bucket - 1), ns);
+    }
+  }
+
+  LatencyHistogram histogram;
+  for (uint64_t ns = 1; ns <= 1000; ++ns)
+    histogram.Add(ns);
+  EXPECT_EQ(1000, histogram.GetCount());
+  EXPECT_EQ(500500, histogram.GetSum());
+  EXPECT_NEAR(500, histogram.GetPercentile(0.5), 500 / 8);
+  EXPECT_NEAR(990, histogram.GetPercentile(0.99), 990 / 8);
+  EXPECT_LE(1000, histogram.GetMax());
+  EXPECT_EQ(0, LatencyHistogram().GetPercentile(0.5));
+}
+
+TEST(LatencyStatsTest, ThreadTest) {
+  const int num_threads = 4;
+  const int num_values = 1000;
+  LatencyStats::Reset();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([i] {
+      for (int j = 0; j < num_values; ++j)
+        LatencyStats::Record(LatencyType::DISK_READ, 100 * (i + 1));
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+  // live threads and exited ones are merged
+  LatencyStats::Record(LatencyType::DISK_READ, 100);
+  LatencyHistogram histogram =
+      LatencyStats::GetHistogram(LatencyType::DISK_READ);
+  EXPECT_EQ(num_threads * num_values + 1, histogram.GetCount());
+  EXPECT_LE(400, histogram.GetMax());
+  EXPECT_NEAR(100, histogram.GetPercentile(0.25), 100 / 8);
+  EXPECT_EQ(0, LatencyStats::GetHistogram(LatencyType::LOCK_WAIT).GetCount());
+
+  LatencyStats::Reset();
+  EXPECT_EQ(0, LatencyStats::GetHistogram(LatencyType::DISK_READ).GetCount());
+}
+
+} // namespace cmudb
@@ -0,0 +1,59 @@
+/**
+ * memory_tracker_test.cpp
+ */
+
+#include <thread>
+
+#include "common/memory_tracker.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(MemoryTrackerTest, ChargeTest) {
+  MemoryTracker::Flush();
+  size_t usage = MemoryTracker::GetUsage(MemoryComponent::EXECUTION);
+  // a small charge stays with the thread until its batch is full
+  MemoryTracker::Charge(MemoryComponent::EXECUTION, 100);
+  EXPECT_EQ(usage, MemoryTracker::GetUsage(MemoryComponent::EXECUTION));
+  MemoryTracker::Flush();
+  EXPECT_EQ(usage + 100,
+            MemoryTracker::GetUsage(MemoryComponent::EXECUTION));
+  MemoryTracker::Charge(MemoryComponent::EXECUTION, MEMORY_CHARGE_BATCH);
+  EXPECT_EQ(usage + 100 + MEMORY_CHARGE_BATCH,
+            MemoryTracker::GetUsage(MemoryComponent::EXECUTION));
+  MemoryTracker::Release(MemoryComponent::EXECUTION,
+                         MEMORY_CHARGE_BATCH + 100);
+  EXPECT_EQ(usage, MemoryTracker::GetUsage(MemoryComponent::EXECUTION));
+
+  // a thread hands over what it charged when it exits
+  size_t cursor = MemoryTracker::GetUsage(MemoryComponent::CURSOR);
+  std::thread([] {
+    MemoryTracker::Charge(MemoryComponent::CURSOR, 10);
+  }).join();
+  EXPECT_EQ(cursor + 10, MemoryTracker::GetUsage(MemoryComponent::CURSOR));
+  MemoryTracker::Release(MemoryComponent::CURSOR, 10);
+  MemoryTracker::Flush();
+  EXPECT_EQ(cursor, MemoryTracker::GetUsage(MemoryComponent::CURSOR));
+  EXPECT_STREQ("lock_table",
+               MemoryTracker::GetName(MemoryComponent::LOCK_TABLE));
+}
+
+TEST(MemoryTrackerTest, BudgetTest) {
+  MemoryTracker::Flush();
+  EXPECT_EQ(0u, MemoryTracker::GetBudget());
+  EXPECT_FALSE(MemoryTracker::IsOverBudget());
+  size_t usage = MemoryTracker::GetTotalUsage();
+  MemoryTracker::SetBudget(usage + 1024 * 1024);
+  EXPECT_FALSE(MemoryTracker::IsOverBudget());
+  MemoryTracker::Charge(MemoryComponent::EXECUTION, 2 * 1024 * 1024);
+  EXPECT_TRUE(MemoryTracker::IsOverBudget());
+  MemoryTracker::Release(MemoryComponent::EXECUTION, 2 * 1024 * 1024);
+  EXPECT_FALSE(MemoryTracker::IsOverBudget());
+  // over a budget lowered below the usage at once
+  MemoryTracker::SetBudget(1);
+  EXPECT_EQ(usage > 1, MemoryTracker::IsOverBudget());
+  MemoryTracker::SetBudget(0);
+  EXPECT_FALSE(MemoryTracker::IsOverBudget());
+}
+
+} // namespace cmudb
@@ -2,14 +2,18 @@
  * rwmutex_test.cpp
  */
 
+#include <atomic>
+#include <chrono>
 #include <thread>
+#include <vector>
 
 #include "common/rwmutex.h"
+#include "page/page.h"
 #include "gtest/gtest.h"
 
 namespace cmudb {
 
-class Counter {
+template <typename Latch> class Counter {
 public:
   Counter() : count_(0), mutex{} {}
   void Add(int num) {
@@ -26,12 +30,12 @@ public:
   }
 private:
   int count_;
-  RWMutex mutex;
+  Latch mutex;
 };
 
-TEST(RWMutexTest, BasicTest) {
+template <typename Latch> static void CountTest() {
   int num_threads = 100;
-  Counter counter{};
+  Counter<Latch> counter{};
   counter.Add(5);
   std::vector<std::thread> threads;
   for (int tid = 0; tid < num_threads; tid++) {
@@ -50,4 +54,55 @@ TEST(RWMutexTest, BasicTest) {
   }
   EXPECT_EQ(counter.Read(), 55);
 }
+
+TEST(RWMutexTest, BasicTest) { CountTest<RWMutex>(); }
+
+TEST(RWMutexTest, LatchBasicTest) { CountTest<RWLatch>(); }
+
+TEST(RWMutexTest, LatchTryTest) {
+  RWLatch latch;
+  EXPECT_TRUE(latch.TryWLock());
+  EXPECT_FALSE(latch.TryWLock());
+  latch.WUnlock();
+  latch.RLock();
+  latch.RLock();
+  EXPECT_FALSE(latch.TryWLock());
+  latch.RUnlock();
+  latch.RUnlock();
+  EXPECT_TRUE(latch.TryWLock());
+  latch.WUnlock();
+  EXPECT_GE(64u, sizeof(Page));
+}
+
+// held long enough for the waiters to park, no update is lost and readers
+// never see one half done
+TEST(RWMutexTest, LatchParkTest) {
+  RWLatch latch;
+  int64_t a = 0, b = 0;
+  std::atomic<bool> torn{false};
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < 16; tid++) {
+    threads.push_back(std::thread([&, tid]() {
+      for (int i = 0; i < 200; i++) {
+        if (tid % 4 == 0) {
+          latch.WLock();
+          a++;
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+          b++;
+          latch.WUnlock();
+        } else {
+          latch.RLock();
+          if (a != b)
+            torn = true;
+          latch.RUnlock();
+        }
+      }
+    }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+  EXPECT_FALSE(torn);
+  EXPECT_EQ(800, a);
+  EXPECT_EQ(800, b);
+}
 }
@@ -2,7 +2,10 @@
  * lock_manager_test.cpp
  */
 
+#include <atomic>
+#include <chrono>
 #include <thread>
+#include <vector>
 
 #include "concurrency/transaction_manager.h"
 #include "gtest/gtest.h"
@@ -40,4 +43,239 @@ TEST(LockManagerTest, BasicTest) {
   t0.join();
   t1.join();
 }
+
+TEST(LockManagerTest, WaitDieTest) {
+  LockManager lock_mgr{true};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid{0, 0};
+  Transaction old_txn(0), middle_txn(1), young_txn(2);
+
+  EXPECT_TRUE(lock_mgr.LockExclusive(&middle_txn, rid));
+  EXPECT_EQ(1u, middle_txn.GetExclusiveLockSet()->count(rid));
+  // the younger transaction dies
+  EXPECT_FALSE(lock_mgr.LockShared(&young_txn, rid));
+  EXPECT_EQ(TransactionState::ABORTED, young_txn.GetState());
+  // the older one waits until the lock is released
+  std::atomic<bool> granted(false);
+  std::thread waiter([&] {
+    EXPECT_TRUE(lock_mgr.LockShared(&old_txn, rid));
+    granted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(granted);
+  // strict 2PL releases at commit only
+  EXPECT_FALSE(lock_mgr.Unlock(&young_txn, rid));
+  txn_mgr.Commit(&middle_txn);
+  waiter.join();
+  EXPECT_TRUE(granted);
+  EXPECT_EQ(1u, old_txn.GetSharedLockSet()->count(rid));
+  Transaction early_txn(3);
+  EXPECT_TRUE(lock_mgr.LockShared(&early_txn, rid));
+  EXPECT_FALSE(lock_mgr.Unlock(&early_txn, rid));
+  EXPECT_EQ(TransactionState::ABORTED, early_txn.GetState());
+  txn_mgr.Abort(&early_txn);
+  txn_mgr.Commit(&old_txn);
+  EXPECT_EQ(0u, lock_mgr.GetLockedCount());
+}
+
+TEST(LockManagerTest, UpgradeTest) {
+  LockManager lock_mgr{false};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid{1, 2};
+  Transaction old_txn(0), young_txn(1);
+  EXPECT_TRUE(lock_mgr.LockShared(&old_txn, rid));
+  EXPECT_TRUE(lock_mgr.LockShared(&young_txn, rid));
+  // the younger one can not wait for the shared lock of the older one
+  EXPECT_FALSE(lock_mgr.LockUpgrade(&young_txn, rid));
+  txn_mgr.Abort(&young_txn);
+
+  Transaction other_txn(2);
+  EXPECT_TRUE(lock_mgr.LockShared(&other_txn, rid));
+  std::atomic<bool> granted(false);
+  std::thread upgrader([&] {
+    EXPECT_TRUE(lock_mgr.LockUpgrade(&old_txn, rid));
+    granted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(granted);
+  // the pending upgrade is ahead of new shared requests
+  Transaction late_txn(3);
+  EXPECT_FALSE(lock_mgr.LockShared(&late_txn, rid));
+  txn_mgr.Commit(&other_txn);
+  upgrader.join();
+  EXPECT_EQ(0u, old_txn.GetSharedLockSet()->count(rid));
+  EXPECT_EQ(1u, old_txn.GetExclusiveLockSet()->count(rid));
+
+  // 2PL: no lock after the first unlock
+  EXPECT_TRUE(lock_mgr.Unlock(&old_txn, rid));
+  EXPECT_EQ(TransactionState::SHRINKING, old_txn.GetState());
+  EXPECT_FALSE(lock_mgr.LockShared(&old_txn, RID(1, 3)));
+  EXPECT_EQ(TransactionState::ABORTED, old_txn.GetState());
+  EXPECT_EQ(0u, lock_mgr.GetLockedCount());
+}
+
+/*
+ * Transactions taking exclusive locks on a few shared rows, those that die
+ * retry with a new id. Every increment is done under its lock
+ */
+static void IncrementSharedRows(LockManager &lock_mgr) {
+  TransactionManager txn_mgr{&lock_mgr};
+  const int threads = 8, rounds = 300, rows = 4;
+  std::vector<int> counters(rows, 0);
+  std::atomic<txn_id_t> next_txn_id(0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      for (int i = 0; i < rounds; i++) {
+        while (true) {
+          Transaction txn(next_txn_id++);
+          int first = (t + i) % rows, second = (t + i + 1) % rows;
+          if (lock_mgr.LockExclusive(&txn, RID(0, first)) &&
+              lock_mgr.LockExclusive(&txn, RID(0, second))) {
+            counters[first]++;
+            counters[second]++;
+            txn_mgr.Commit(&txn);
+            break;
+          }
+          txn_mgr.Abort(&txn);
+        }
+      }
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+  int sum = 0;
+  for (int counter : counters)
+    sum += counter;
+  EXPECT_EQ(2 * threads * rounds, sum);
+  EXPECT_EQ(0u, lock_mgr.GetLockedCount());
+}
+
+TEST(LockManagerTest, ConcurrentTest) {
+  LockManager lock_mgr{true};
+  IncrementSharedRows(lock_mgr);
+  EXPECT_EQ(0u, lock_mgr.GetStats().deadlock_aborts_);
+}
+
+TEST(LockManagerTest, DeadlockTest) {
+  LockManager lock_mgr{true};
+  TransactionManager txn_mgr{&lock_mgr};
+  lock_mgr.StartDeadlockDetection(std::chrono::milliseconds(5));
+  RID first{0, 0}, second{0, 1};
+  Transaction old_txn(0), young_txn(1);
+  EXPECT_TRUE(lock_mgr.LockExclusive(&old_txn, first));
+  EXPECT_TRUE(lock_mgr.LockExclusive(&young_txn, second));
+  // the older one waiting for the younger one is no deadlock
+  std::atomic<bool> granted(false);
+  std::thread waiter([&] {
+    EXPECT_TRUE(lock_mgr.LockExclusive(&old_txn, second));
+    granted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(granted);
+  EXPECT_EQ(TransactionState::GROWING, young_txn.GetState());
+  // the younger one closes the cycle and is its victim
+  EXPECT_FALSE(lock_mgr.LockExclusive(&young_txn, first));
+  EXPECT_EQ(TransactionState::ABORTED, young_txn.GetState());
+  txn_mgr.Abort(&young_txn);
+  waiter.join();
+  EXPECT_TRUE(granted);
+  txn_mgr.Commit(&old_txn);
+  LockStats stats = lock_mgr.GetStats();
+  EXPECT_EQ(1u, stats.deadlock_aborts_);
+  EXPECT_EQ(0u, stats.wait_die_aborts_);
+  EXPECT_EQ(0u, lock_mgr.DetectDeadlocks());
+
+  // shared rows locked in both orders finish with detection as well
+  lock_mgr.ResetStats();
+  IncrementSharedRows(lock_mgr);
+  EXPECT_EQ(0u, lock_mgr.GetStats().wait_die_aborts_);
+  lock_mgr.StopDeadlockDetection();
+}
+
+TEST(LockManagerTest, HierarchyTest) {
+  LockManager lock_mgr{true};
+  TransactionManager txn_mgr{&lock_mgr};
+  page_id_t table_id = 5;
+  Transaction reader(0), writer(1), young_txn(2);
+  // rows of a table are locked under intention locks on table and page
+  EXPECT_TRUE(lock_mgr.LockShared(&reader, RID(5, 0), table_id));
+  auto granules = reader.GetGranuleLockSet();
+  EXPECT_EQ(LockMode::INTENTION_SHARED,
+            granules->at(LockManager::TableLockRid(table_id)).mode_);
+  EXPECT_EQ(LockMode::INTENTION_SHARED,
+            granules->at(LockManager::PageLockRid(5)).mode_);
+  EXPECT_EQ(3u, lock_mgr.GetLockedCount());
+  // writers of other rows share the table and page
+  EXPECT_TRUE(lock_mgr.LockExclusive(&writer, RID(5, 1), table_id));
+  EXPECT_EQ(LockMode::INTENTION_EXCLUSIVE,
+            writer.GetGranuleLockSet()->at(LockManager::PageLockRid(5)).mode_);
+  // a table lock conflicting with them is not granted
+  EXPECT_FALSE(lock_mgr.LockTable(&young_txn, table_id, LockMode::SHARED));
+  txn_mgr.Abort(&young_txn);
+  txn_mgr.Commit(&writer);
+
+  // a shared table lock covers its rows, a write under it needs SIX
+  EXPECT_TRUE(lock_mgr.LockTable(&reader, table_id, LockMode::SHARED));
+  EXPECT_EQ(LockMode::SHARED,
+            granules->at(LockManager::TableLockRid(table_id)).mode_);
+  EXPECT_TRUE(lock_mgr.LockShared(&reader, RID(6, 0), table_id));
+  EXPECT_EQ(0u, reader.GetSharedLockSet()->count(RID(6, 0)));
+  EXPECT_TRUE(lock_mgr.LockExclusive(&reader, RID(6, 1), table_id));
+  EXPECT_EQ(LockMode::SHARED_INTENTION_EXCLUSIVE,
+            granules->at(LockManager::TableLockRid(table_id)).mode_);
+  EXPECT_TRUE(LockManager::HoldsExclusive(&reader, RID(6, 1)));
+  EXPECT_FALSE(LockManager::HoldsExclusive(&reader, RID(6, 2)));
+  // a page lock under it
+  EXPECT_TRUE(lock_mgr.LockPage(&reader, table_id, 7, LockMode::EXCLUSIVE));
+  EXPECT_TRUE(LockManager::HoldsExclusive(&reader, RID(7, 3)));
+  EXPECT_TRUE(lock_mgr.LockExclusive(&reader, RID(7, 3), table_id));
+  EXPECT_EQ(0u, reader.GetExclusiveLockSet()->count(RID(7, 3)));
+  txn_mgr.Commit(&reader);
+  EXPECT_TRUE(granules->empty());
+  EXPECT_EQ(0u, lock_mgr.GetLockedCount());
+}
+
+TEST(LockManagerTest, EscalationTest) {
+  LockManager lock_mgr{true, 4};
+  TransactionManager txn_mgr{&lock_mgr};
+  page_id_t table_id = 0;
+  Transaction txn(0);
+  for (int i = 0; i < 4; i++)
+    EXPECT_TRUE(lock_mgr.LockShared(&txn, RID(i % 2, i), table_id));
+  // a table lock, two page locks and four row locks
+  EXPECT_EQ(7u, lock_mgr.GetLockedCount());
+  EXPECT_TRUE(lock_mgr.LockShared(&txn, RID(2, 0), table_id));
+  // the fifth row lock is traded for a shared table lock
+  EXPECT_EQ(1u, lock_mgr.GetLockedCount());
+  EXPECT_TRUE(txn.GetSharedLockSet()->empty());
+  EXPECT_EQ(1u, txn.GetGranuleLockSet()->size());
+  EXPECT_EQ(LockMode::SHARED,
+            txn.GetGranuleLockSet()->at(LockManager::TableLockRid(0)).mode_);
+
+  // a younger writer dies on the table lock
+  Transaction young_txn(1);
+  EXPECT_FALSE(lock_mgr.LockExclusive(&young_txn, RID(3, 0), table_id));
+  txn_mgr.Abort(&young_txn);
+  // writes escalate to an exclusive table lock
+  for (int i = 0; i < 5; i++)
+    EXPECT_TRUE(lock_mgr.LockExclusive(&txn, RID(3, i), table_id));
+  EXPECT_EQ(LockMode::EXCLUSIVE,
+            txn.GetGranuleLockSet()->at(LockManager::TableLockRid(0)).mode_);
+  EXPECT_TRUE(txn.GetExclusiveLockSet()->empty());
+  EXPECT_TRUE(LockManager::HoldsExclusive(&txn, RID(3, 4)));
+  txn_mgr.Commit(&txn);
+  EXPECT_EQ(0u, lock_mgr.GetLockedCount());
+
+  // escalation does not wait for a table lock of another transaction
+  Transaction other_txn(2), scanner(3);
+  EXPECT_TRUE(lock_mgr.LockExclusive(&other_txn, RID(0, 0), table_id));
+  for (int i = 1; i <= 5; i++)
+    EXPECT_TRUE(lock_mgr.LockShared(&scanner, RID(0, i), table_id));
+  EXPECT_EQ(TransactionState::GROWING, scanner.GetState());
+  EXPECT_EQ(5u, scanner.GetSharedLockSet()->size());
+  txn_mgr.Commit(&other_txn);
+  txn_mgr.Commit(&scanner);
+  EXPECT_EQ(0u, lock_mgr.GetLockedCount());
+}
 } // namespace cmudb
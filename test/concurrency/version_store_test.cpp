@@ -0,0 +1,243 @@
+/**
+ * version_store_test.cpp
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "concurrency/transaction_manager.h"
+#include "table/table_heap.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static Tuple MakeTuple(Schema *schema, int32_t key, int32_t value) {
+  std::vector<Value> values{Value(TypeId::INTEGER, key),
+                            Value(TypeId::INTEGER, value),
+                            Value(TypeId::VARCHAR, std::string("abc"))};
+  return Tuple(values, schema);
+}
+
+// value of the row of key txn reads by rid, -1 if it sees none
+static int32_t ReadValue(TableHeap *table, Schema *schema, const RID &rid,
+                         Transaction *txn) {
+  Tuple tuple;
+  if (!table->GetTuple(rid, tuple, txn))
+    return -1;
+  return tuple.GetValue(schema, 1).GetAs<int32_t>();
+}
+
+// sum of the values of the rows a batch scan of txn sees, count is set to
+// their number
+static int32_t ScanValues(TableHeap *table, Schema *schema, Transaction *txn,
+                          int &count) {
+  RowBatch batch(schema);
+  TableBatchIterator iterator(table, txn);
+  int32_t sum = 0;
+  count = 0;
+  while (iterator.Next(batch)) {
+    for (uint32_t i = 0; i < batch.GetSelectedCount(); i++) {
+      sum += *reinterpret_cast<const int32_t *>(
+          batch.GetFixed(1, batch.GetSelected(i)));
+      count++;
+    }
+  }
+  return sum;
+}
+
+/*
+ * A snapshot sees the rows committed before it began, whatever writers do
+ * meanwhile, and waits for none of their locks
+ */
+static void SnapshotRead(bool pax) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("k int, v int, s varchar(8)");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  LockManager lock_manager(true);
+  TransactionManager txn_manager(&lock_manager);
+  TableHeap *table =
+      new TableHeap(bpm, &lock_manager, nullptr, INVALID_PAGE_ID,
+                    INVALID_PAGE_ID, pax ? PaxLayout(schema) : PaxLayout());
+  std::vector<RID> rids(4);
+  Transaction *loader = txn_manager.Begin();
+  for (int i = 0; i < 3; i++)
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, 10 * i), rids[i],
+                                   loader));
+  txn_manager.Commit(loader);
+  delete loader;
+  // nobody can read the versions of the load
+  VersionStore *versions = txn_manager.GetVersionStore();
+  EXPECT_EQ(0u, versions->GetVersionCount());
+
+  Transaction *before = txn_manager.BeginSnapshot();
+  Transaction *writer = txn_manager.Begin();
+  EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, 0, 5), rids[0], writer));
+  EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, 0, 7), rids[0], writer));
+  EXPECT_TRUE(table->MarkDelete(rids[1], writer));
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 3, 100), rids[3], writer));
+  // one version per row and writer
+  EXPECT_EQ(3u, versions->GetVersionCount());
+  size_t locked = lock_manager.GetLockedCount();
+  EXPECT_EQ(0, ReadValue(table, schema, rids[0], before));
+  EXPECT_EQ(10, ReadValue(table, schema, rids[1], before));
+  EXPECT_EQ(-1, ReadValue(table, schema, rids[3], before));
+  int count;
+  EXPECT_EQ(30, ScanValues(table, schema, before, count));
+  EXPECT_EQ(3, count);
+  EXPECT_EQ(locked, lock_manager.GetLockedCount());
+  EXPECT_EQ(TransactionState::GROWING, before->GetState());
+
+  txn_manager.Commit(writer);
+  delete writer;
+  // the old rows are kept for the running snapshot
+  EXPECT_EQ(3u, versions->GetVersionCount());
+  EXPECT_EQ(30, ScanValues(table, schema, before, count));
+  EXPECT_EQ(3, count);
+  Transaction *after = txn_manager.BeginSnapshot();
+  EXPECT_EQ(7, ReadValue(table, schema, rids[0], after));
+  EXPECT_EQ(-1, ReadValue(table, schema, rids[1], after));
+  EXPECT_EQ(127, ScanValues(table, schema, after, count));
+  EXPECT_EQ(3, count);
+
+  // an aborted write is never seen
+  Transaction *aborted = txn_manager.Begin();
+  EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, 2, 1), rids[2], aborted));
+  EXPECT_EQ(20, ReadValue(table, schema, rids[2], after));
+  txn_manager.Abort(aborted);
+  delete aborted;
+  EXPECT_EQ(20, ReadValue(table, schema, rids[2], after));
+
+  // the versions go with the oldest snapshot
+  txn_manager.Commit(before);
+  delete before;
+  EXPECT_EQ(0u, versions->GetVersionCount());
+  EXPECT_EQ(127, ScanValues(table, schema, after, count));
+  txn_manager.Commit(after);
+  delete after;
+
+  delete table;
+  delete bpm;
+  delete schema;
+  remove("test.db");
+}
+
+TEST(VersionStoreTest, SnapshotTest) { SnapshotRead(false); }
+
+TEST(VersionStoreTest, PaxSnapshotTest) { SnapshotRead(true); }
+
+/*
+ * The collector sweeps the versions a snapshot held on to after it ends,
+ * commits prune theirs while no snapshot runs
+ */
+TEST(VersionStoreTest, GarbageCollectionTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("k int, v int, s varchar(8)");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  LockManager lock_manager(true);
+  TransactionManager txn_manager(&lock_manager);
+  TableHeap *table = new TableHeap(bpm, &lock_manager, nullptr);
+  VersionStore *versions = txn_manager.GetVersionStore();
+  txn_manager.StartGarbageCollection(std::chrono::milliseconds(1));
+  std::vector<RID> rids(8);
+  Transaction *loader = txn_manager.Begin();
+  for (int i = 0; i < 8; i++)
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, i), rids[i], loader));
+  txn_manager.Commit(loader);
+  delete loader;
+  EXPECT_EQ(0u, versions->GetVersionCount());
+  EXPECT_EQ(8u, txn_manager.GetGCStats().pruned_);
+
+  Transaction *snapshot = txn_manager.BeginSnapshot();
+  for (int round = 1; round <= 3; round++) {
+    Transaction *writer = txn_manager.Begin();
+    for (int i = 0; i < 8; i++)
+      EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, i, i + 10 * round),
+                                     rids[i], writer));
+    txn_manager.Commit(writer);
+    delete writer;
+  }
+  EXPECT_EQ(1u, txn_manager.GetWatermark());
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  GCStats stats = txn_manager.GetGCStats();
+  EXPECT_EQ(24u, stats.versions_);
+  EXPECT_EQ(3u, stats.lag_);
+  EXPECT_EQ(0u, stats.collected_);
+  EXPECT_EQ(0, ReadValue(table, schema, rids[0], snapshot));
+
+  txn_manager.Commit(snapshot);
+  delete snapshot;
+  for (int i = 0; i < 1000 && versions->GetVersionCount() != 0; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  stats = txn_manager.GetGCStats();
+  EXPECT_EQ(0u, stats.versions_);
+  EXPECT_EQ(24u, stats.collected_);
+  EXPECT_EQ(4u, stats.watermark_);
+  EXPECT_EQ(0u, stats.lag_);
+  // an unmoved watermark is not swept again
+  EXPECT_EQ(0u, txn_manager.CollectGarbage());
+  EXPECT_EQ(stats.runs_, txn_manager.GetGCStats().runs_);
+  txn_manager.StopGarbageCollection();
+
+  delete table;
+  delete bpm;
+  delete schema;
+  remove("test.db");
+}
+
+/*
+ * A snapshot has no write or lock sets and is pooled apart from the
+ * transactions that have them. An aborted one ends as a committed one does
+ */
+TEST(VersionStoreTest, ReadOnlyTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("k int, v int, s varchar(8)");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  LockManager lock_manager(true);
+  TransactionManager txn_manager(&lock_manager);
+  TableHeap *table = new TableHeap(bpm, &lock_manager, nullptr);
+  RID rid;
+  Transaction *loader = txn_manager.Begin();
+  EXPECT_FALSE(loader->IsReadOnly());
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 0, 10), rid, loader));
+  txn_manager.Commit(loader);
+  txn_manager.Release(loader);
+
+  Transaction *snapshot = txn_manager.BeginSnapshot();
+  EXPECT_TRUE(snapshot->IsReadOnly());
+  EXPECT_NE(loader, snapshot);
+  EXPECT_EQ(nullptr, snapshot->GetCommitTimestamp());
+  EXPECT_EQ(0u, snapshot->GetSavepoint().write_set_size_);
+  EXPECT_EQ(10, ReadValue(table, schema, rid, snapshot));
+  int count;
+  EXPECT_EQ(10, ScanValues(table, schema, snapshot, count));
+  EXPECT_EQ(0u, lock_manager.GetLockedCount());
+  Transaction *writer = txn_manager.Begin();
+  EXPECT_EQ(loader, writer);
+  EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, 0, 20), rid, writer));
+  txn_manager.Commit(writer);
+  txn_manager.Release(writer);
+  EXPECT_EQ(1u, txn_manager.GetVersionStore()->GetVersionCount());
+
+  // the versions it held on to go with it
+  txn_manager.Abort(snapshot);
+  EXPECT_EQ(TransactionState::ABORTED, snapshot->GetState());
+  EXPECT_EQ(0u, txn_manager.GetVersionStore()->GetVersionCount());
+  EXPECT_EQ(txn_manager.GetLastCommitTimestamp(), txn_manager.GetWatermark());
+  txn_manager.Release(snapshot);
+  Transaction *next = txn_manager.BeginSnapshot();
+  EXPECT_EQ(snapshot, next);
+  EXPECT_EQ(TransactionState::GROWING, next->GetState());
+  EXPECT_EQ(20, ReadValue(table, schema, rid, next));
+  txn_manager.Commit(next);
+  txn_manager.Release(next);
+
+  delete table;
+  delete bpm;
+  delete schema;
+  remove("test.db");
+}
+
+} // namespace cmudb
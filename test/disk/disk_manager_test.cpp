@@ -0,0 +1,475 @@
+/**
+ * disk_manager_test.cpp
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "common/exception.h"
+#include "disk/disk_manager.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(DiskManagerTest, ReadWriteTest) {
+  char buffer[PAGE_SIZE];
+  char data[PAGE_SIZE];
+  DiskManager disk_manager("test.db");
+
+  // reading beyond end of file leaves buffer untouched
+  memset(buffer, 'x', PAGE_SIZE);
+  disk_manager.ReadPage(5, buffer);
+  EXPECT_EQ('x', buffer[0]);
+
+  memset(data, 0, PAGE_SIZE);
+  strcpy(data, "A test string.");
+  disk_manager.WritePage(0, data);
+  disk_manager.WritePage(5, data);
+  disk_manager.ReadPage(0, buffer);
+  EXPECT_EQ(0, memcmp(buffer, data, PAGE_SIZE));
+  disk_manager.ReadPage(5, buffer);
+  EXPECT_EQ(0, memcmp(buffer, data, PAGE_SIZE));
+
+  remove("test.db");
+}
+
+TEST(DiskManagerTest, ConcurrentDirectIOTest) {
+  const int num_threads = 4;
+  const int num_pages = 64;
+  DiskManager disk_manager("test.db", true);
+
+  // each thread owns its pages, no file position is shared
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; ++tid) {
+    threads.push_back(std::thread([tid, &disk_manager]() {
+      // deliberately unaligned in direct mode
+      char data[PAGE_SIZE + 1];
+      char buffer[PAGE_SIZE + 1];
+      for (int i = tid; i < num_pages; i += num_threads) {
+        memset(data + 1, 0, PAGE_SIZE);
+        snprintf(data + 1, PAGE_SIZE, "page %d", i);
+        disk_manager.WritePage(i, data + 1);
+      }
+      for (int i = tid; i < num_pages; i += num_threads) {
+        disk_manager.ReadPage(i, buffer + 1);
+        snprintf(data + 1, PAGE_SIZE, "page %d", i);
+        EXPECT_EQ(0, strcmp(buffer + 1, data + 1));
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  remove("test.db");
+}
+
+TEST(DiskManagerTest, BatchAsyncTest) {
+  const int num_pages = 32;
+  DiskManager disk_manager("test.db");
+  std::vector<std::vector<char>> pages(num_pages, std::vector<char>(PAGE_SIZE));
+  std::atomic<int> completed(0);
+
+  // queue every write, then one submit
+  for (int i = 0; i < num_pages; ++i) {
+    snprintf(pages[i].data(), PAGE_SIZE, "page %d", i);
+    disk_manager.WritePageAsync(i, pages[i].data(), [&completed](bool success) {
+      EXPECT_TRUE(success);
+      ++completed;
+    });
+  }
+  disk_manager.SubmitIO();
+  while (completed != num_pages)
+    std::this_thread::yield();
+
+  completed = 0;
+  for (int i = 0; i < num_pages; ++i) {
+    memset(pages[i].data(), 0, PAGE_SIZE);
+    disk_manager.ReadPageAsync(i, pages[i].data(), [&completed](bool success) {
+      EXPECT_TRUE(success);
+      ++completed;
+    });
+  }
+  disk_manager.SubmitIO();
+  while (completed != num_pages)
+    std::this_thread::yield();
+
+  char expected[PAGE_SIZE];
+  for (int i = 0; i < num_pages; ++i) {
+    snprintf(expected, PAGE_SIZE, "page %d", i);
+    EXPECT_EQ(0, strcmp(pages[i].data(), expected));
+  }
+
+  remove("test.db");
+}
+
+
+TEST(DiskManagerTest, PageReuseTest) {
+  remove("test.db");
+  remove("test.meta");
+  char data[PAGE_SIZE];
+  char buffer[PAGE_SIZE];
+  memset(data, 'x', PAGE_SIZE);
+  int num_pages = 3 * FREE_PAGE_BATCH;
+  {
+    DiskManager disk_manager("test.db");
+    for (int i = 0; i < num_pages; ++i) {
+      EXPECT_EQ(i, disk_manager.AllocatePage());
+      disk_manager.WritePage(i, data);
+    }
+    disk_manager.DeallocatePage(3);
+    disk_manager.DeallocatePage(7);
+    // freed pages come back zeroed, before any new page id
+    EXPECT_EQ(7, disk_manager.AllocatePage());
+    disk_manager.ReadPage(7, buffer);
+    EXPECT_EQ(0, buffer[0]);
+    EXPECT_EQ(0, buffer[PAGE_SIZE - 1]);
+    EXPECT_EQ(3, disk_manager.AllocatePage());
+    EXPECT_EQ(num_pages, disk_manager.AllocatePage());
+
+    // more than a batch goes to the superblock right away
+    for (int i = 0; i < 2 * FREE_PAGE_BATCH; ++i)
+      disk_manager.DeallocatePage(FREE_PAGE_BATCH + i);
+    disk_manager.DeallocatePage(5);
+  }
+
+  // counter and free pages survive a restart
+  {
+    DiskManager disk_manager("test.db");
+    std::vector<page_id_t> page_ids;
+    for (int i = 0; i < 2 * FREE_PAGE_BATCH + 1; ++i)
+      page_ids.push_back(disk_manager.AllocatePage());
+    std::sort(page_ids.begin(), page_ids.end());
+    EXPECT_EQ(5, page_ids[0]);
+    EXPECT_EQ(FREE_PAGE_BATCH, page_ids[1]);
+    EXPECT_EQ(num_pages - 1, page_ids.back());
+    EXPECT_EQ(num_pages + 1, disk_manager.AllocatePage());
+  }
+
+  // a new database file does not pick up the superblock of an old one
+  remove("test.db");
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_EQ(0, disk_manager.AllocatePage());
+  }
+
+  remove("test.db");
+  remove("test.meta");
+}
+
+TEST(DiskManagerTest, ExtentTest) {
+  remove("test.db");
+  remove("test.meta");
+  {
+    DiskManager disk_manager("test.db");
+    PageExtent table(&disk_manager);
+    PageExtent index(&disk_manager);
+    // each keeps its pages together
+    EXPECT_EQ(0, table.AllocatePage());
+    EXPECT_EQ(EXTENT_PAGES, index.AllocatePage());
+    EXPECT_EQ(1, table.AllocatePage());
+    EXPECT_EQ(EXTENT_PAGES + 1, index.AllocatePage());
+    for (int i = 2; i < EXTENT_PAGES; i++)
+      EXPECT_EQ(i, table.AllocatePage());
+    EXPECT_EQ(2 * EXTENT_PAGES, table.AllocatePage());
+
+    // a freed page comes first
+    disk_manager.DeallocatePage(5);
+    {
+      PageExtent other(&disk_manager);
+      EXPECT_EQ(5, other.AllocatePage());
+      EXPECT_EQ(3 * EXTENT_PAGES, other.AllocatePage());
+    }
+    // the last extent winds the counter back, others free their pages
+    EXPECT_EQ(3 * EXTENT_PAGES + 1, disk_manager.AllocatePage());
+  }
+
+  // an extent may outlive its disk manager
+  DiskManager *disk_manager = new DiskManager("test.db");
+  PageExtent extent(disk_manager);
+  EXPECT_NE(INVALID_PAGE_ID, extent.AllocatePage());
+  delete disk_manager;
+  EXPECT_EQ(INVALID_PAGE_ID, extent.AllocatePage());
+
+  remove("test.db");
+  remove("test.meta");
+}
+
+TEST(DiskManagerTest, ChecksumTest) {
+  remove("test.db");
+  remove("test.meta");
+  remove("test.sum");
+  char buffer[PAGE_SIZE];
+  char first[PAGE_SIZE];
+  char second[PAGE_SIZE];
+  memset(first, 'a', PAGE_SIZE);
+  memset(second, 'b', PAGE_SIZE);
+  auto damage = [](page_id_t page_id, const char *data) {
+    FILE *file = fopen("test.db", "r+b");
+    ASSERT_NE(nullptr, file);
+    fseek(file, static_cast<long>(page_id) * PAGE_SIZE, SEEK_SET);
+    fwrite(data, PAGE_SIZE, 1, file);
+    fclose(file);
+  };
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_TRUE(disk_manager.HasChecksums(0));
+    disk_manager.WritePage(0, first);
+    disk_manager.WritePage(1, first);
+    disk_manager.WritePage(1, second);
+    bool corrupt = true;
+    EXPECT_TRUE(disk_manager.ReadPage(1, buffer, &corrupt));
+    EXPECT_FALSE(corrupt);
+  }
+  {
+    DiskManager disk_manager("test.db");
+    // a write that never happened leaves the previous image, which passes
+    damage(1, first);
+    EXPECT_TRUE(disk_manager.ReadPage(1, buffer));
+    // a flipped bit does not
+    first[100] ^= 1;
+    damage(0, first);
+    bool corrupt = false;
+    EXPECT_FALSE(disk_manager.ReadPage(0, buffer, &corrupt));
+    EXPECT_TRUE(corrupt);
+    EXPECT_EQ(1u, disk_manager.GetChecksumFailures());
+    // past the end of the file is not corrupt
+    EXPECT_FALSE(disk_manager.ReadPage(5, buffer, &corrupt));
+    EXPECT_FALSE(corrupt);
+
+    // off for this file, for good
+    EXPECT_TRUE(disk_manager.SetChecksums(0, false));
+    EXPECT_TRUE(disk_manager.ReadPage(0, buffer));
+    EXPECT_FALSE(disk_manager.SetChecksums(1, false));
+  }
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_FALSE(disk_manager.HasChecksums(0));
+    // pages written without checksums are not checked once they are on
+    EXPECT_TRUE(disk_manager.SetChecksums(0, true));
+    EXPECT_TRUE(disk_manager.ReadPage(0, buffer));
+    disk_manager.WritePage(0, second);
+    damage(0, first);
+    EXPECT_FALSE(disk_manager.ReadPage(0, buffer));
+  }
+
+  remove("test.db");
+  remove("test.meta");
+  remove("test.sum");
+}
+
+TEST(DiskManagerTest, SuperblockTest) {
+  remove("test.db");
+  remove("test.meta");
+  char data[PAGE_SIZE];
+  memset(data, 'x', PAGE_SIZE);
+  {
+    DiskManager disk_manager("test.db");
+    for (int i = 0; i < 10; ++i)
+      disk_manager.AllocatePage();
+    // only a few pages reach the file
+    disk_manager.WritePage(2, data);
+  }
+  // the counter comes from the superblock, not the size of the file
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_EQ(10, disk_manager.AllocatePage());
+  }
+
+  // without a clean shutdown the ids up to the recorded limit are skipped
+  remove("test.db");
+  remove("test.meta");
+  {
+    DiskManager disk_manager("test.db");
+    disk_manager.AllocatePage();
+    disk_manager.WritePage(0, data);
+    rename("test.meta", "crashed.meta");
+  }
+  rename("crashed.meta", "test.meta");
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_EQ(PAGE_ID_EXTENT, disk_manager.AllocatePage());
+  }
+
+  // a file older than the superblock goes by its size
+  remove("test.meta");
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_EQ(1, disk_manager.AllocatePage());
+  }
+
+  // the page size is fixed when the file is created
+  FILE *superblock = fopen("test.meta", "r+b");
+  ASSERT_NE(nullptr, superblock);
+  int32_t page_size = 2 * PAGE_SIZE;
+  fseek(superblock, 2 * sizeof(int32_t), SEEK_SET);
+  fwrite(&page_size, sizeof(page_size), 1, superblock);
+  fclose(superblock);
+  EXPECT_THROW(DiskManager("test.db"), Exception);
+
+  remove("test.db");
+  remove("test.meta");
+}
+
+TEST(DiskManagerTest, LargeFileTest) {
+  remove("test.db");
+  remove("test.meta");
+  remove("test.log");
+  remove("test.ckpt");
+  char buffer[PAGE_SIZE];
+  char data[PAGE_SIZE];
+  memset(data, 'x', PAGE_SIZE);
+  // 5 GB into a sparse file, past both 2^31 and 2^32 bytes
+  page_id_t page_id = static_cast<page_id_t>((5LL << 30) / PAGE_SIZE);
+  {
+    DiskManager disk_manager("test.db");
+    disk_manager.WritePage(page_id, data);
+    memset(buffer, 0, PAGE_SIZE);
+    EXPECT_TRUE(disk_manager.ReadPage(page_id, buffer));
+    EXPECT_EQ(0, memcmp(buffer, data, PAGE_SIZE));
+  }
+  remove("test.meta");
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_EQ(page_id + 1, disk_manager.AllocatePage());
+  }
+
+  // a master record of 4 bytes is still read
+  {
+    DiskManager disk_manager("test.db");
+    disk_manager.WriteLog(data, 100);
+    disk_manager.SetLogStart(60);
+    EXPECT_EQ(60, disk_manager.GetLogStart());
+  }
+  FILE *master = fopen("test.ckpt", "wb");
+  ASSERT_NE(nullptr, master);
+  int32_t old_start = 40;
+  fwrite(&old_start, sizeof(old_start), 1, master);
+  fclose(master);
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_EQ(40, disk_manager.GetLogStart());
+  }
+
+  remove("test.db");
+  remove("test.meta");
+  remove("test.log");
+  remove("test.ckpt");
+}
+
+TEST(DiskManagerTest, TablespaceTest) {
+  for (const char *file : {"test.db", "test.meta", "test.spaces", "ts.db",
+                           "ts.meta"})
+    remove(file);
+  char buffer[PAGE_SIZE];
+  char data[PAGE_SIZE];
+  memset(data, 0, PAGE_SIZE);
+  page_id_t page_id;
+  {
+    DiskManager disk_manager("test.db");
+    disk_manager.WritePage(disk_manager.AllocatePage(), data);
+    EXPECT_EQ(1, disk_manager.AddTablespace("ts.db"));
+    EXPECT_EQ(1, disk_manager.AddTablespace("ts.db"));
+    EXPECT_EQ("ts.db", disk_manager.GetTablespaceFile(1));
+    EXPECT_EQ(INVALID_PAGE_ID, disk_manager.AllocatePage(2));
+
+    // page numbers of a tablespace start at 0 in its own file
+    page_id = disk_manager.AllocatePage(1);
+    EXPECT_EQ(MakePageId(1, 0), page_id);
+    EXPECT_EQ(1, GetTablespaceId(page_id));
+    strcpy(data, "in the tablespace");
+    disk_manager.WritePage(page_id, data);
+    disk_manager.WritePage(page_id + 1, data);
+    EXPECT_EQ(1, disk_manager.AllocatePage());
+  }
+  FILE *file = fopen("ts.db", "rb");
+  ASSERT_NE(nullptr, file);
+  fseek(file, 0, SEEK_END);
+  EXPECT_EQ(2 * PAGE_SIZE, ftell(file));
+  fclose(file);
+
+  // the tablespace is opened with the database, its counter kept apart
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_EQ("ts.db", disk_manager.GetTablespaceFile(1));
+    ASSERT_TRUE(disk_manager.ReadPage(page_id, buffer));
+    EXPECT_STREQ("in the tablespace", buffer);
+    EXPECT_EQ(MakePageId(1, 1), disk_manager.AllocatePage(1));
+    EXPECT_EQ(2, disk_manager.AllocatePage());
+    disk_manager.DeallocatePage(page_id);
+    EXPECT_EQ(page_id, disk_manager.AllocatePage(1));
+    EXPECT_EQ(2, disk_manager.AddTablespace("ts2.db"));
+    EXPECT_THROW(disk_manager.AddTablespace("ts.dat"), Exception);
+  }
+
+  for (const char *file : {"test.db", "test.meta", "test.spaces", "ts.db",
+                           "ts.meta", "ts2.db", "ts2.meta"})
+    remove(file);
+}
+
+TEST(DiskManagerTest, PageCacheTest) {
+  remove("test.db");
+  remove("test.meta");
+  char data[PAGE_SIZE];
+  char buffer[PAGE_SIZE];
+  const int num_pages = 100;
+  {
+    DiskManager disk_manager("test.db");
+    // room for a few hundred mostly empty pages, not for noise
+    disk_manager.EnablePageCache(PAGE_SIZE * 3);
+    PageCache *page_cache = disk_manager.GetPageCache();
+    for (int i = 0; i < num_pages; ++i) {
+      memset(data, 0, PAGE_SIZE);
+      snprintf(data, PAGE_SIZE, "page %d", i);
+      disk_manager.WritePage(disk_manager.AllocatePage(), data);
+    }
+    EXPECT_EQ(static_cast<size_t>(num_pages), page_cache->GetPageCount());
+    EXPECT_GE(page_cache->GetCapacity(), page_cache->GetSize());
+    for (int i = 0; i < num_pages; ++i) {
+      memset(buffer, 'x', PAGE_SIZE);
+      EXPECT_TRUE(disk_manager.ReadPage(i, buffer));
+      snprintf(data, PAGE_SIZE, "page %d", i);
+      EXPECT_EQ(0, strcmp(buffer, data));
+      EXPECT_EQ(0, buffer[PAGE_SIZE - 1]);
+    }
+    EXPECT_EQ(static_cast<size_t>(num_pages), page_cache->GetHits());
+
+    // freed pages leave the cache, noise pushes out the oldest pages
+    disk_manager.DeallocatePage(0);
+    EXPECT_EQ(static_cast<size_t>(num_pages - 1), page_cache->GetPageCount());
+    srand(11);
+    for (auto &c : data)
+      c = static_cast<char>(rand());
+    disk_manager.WritePage(1, data);
+    disk_manager.WritePage(2, data);
+    disk_manager.WritePage(3, data);
+    EXPECT_GE(page_cache->GetCapacity(), page_cache->GetSize());
+    EXPECT_GT(static_cast<size_t>(num_pages - 1), page_cache->GetPageCount());
+    EXPECT_TRUE(disk_manager.ReadPage(3, buffer));
+    EXPECT_EQ(0, memcmp(buffer, data, PAGE_SIZE));
+    // a miss is read from the file and cached again
+    size_t hits = page_cache->GetHits();
+    EXPECT_TRUE(disk_manager.ReadPage(4, buffer));
+    EXPECT_EQ(0, strcmp(buffer, "page 4"));
+    EXPECT_EQ(hits, page_cache->GetHits());
+    EXPECT_TRUE(disk_manager.ReadPage(4, buffer));
+    EXPECT_EQ(hits + 1, page_cache->GetHits());
+  }
+
+  // the file is the same without the cache
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_TRUE(disk_manager.ReadPage(num_pages - 1, buffer));
+    snprintf(data, PAGE_SIZE, "page %d", num_pages - 1);
+    EXPECT_EQ(0, strcmp(buffer, data));
+  }
+
+  remove("test.db");
+  remove("test.meta");
+}
+
+} // namespace cmudb
@@ -0,0 +1,131 @@
+/**
+ * page_codec_test.cpp
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "disk/page_codec.h"
+#include "page/pax_layout.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static void ExpectRoundTrip(const char *page, size_t max_size) {
+  char encoded[PAGE_CODEC_MAX_SIZE];
+  size_t size = PageCodec::Encode(page, encoded);
+  EXPECT_GE(max_size, size);
+  char decoded[PAGE_SIZE];
+  memset(decoded, 'x', PAGE_SIZE);
+  ASSERT_TRUE(PageCodec::Decode(encoded, size, decoded));
+  EXPECT_EQ(0, memcmp(page, decoded, PAGE_SIZE));
+  // a cut off image is refused
+  EXPECT_FALSE(PageCodec::Decode(encoded, size - 1, decoded));
+}
+
+TEST(PageCodecTest, LZTest) {
+  std::vector<char> page(PAGE_SIZE, 0);
+  ExpectRoundTrip(page.data(), 64);
+
+  // repeated text, as in a slotted page of low cardinality varchars
+  const char *words[] = {"red", "green", "blue"};
+  for (size_t i = 0, offset = 0; offset + 6 < PAGE_SIZE; i = i * 7 + 3) {
+    strcpy(page.data() + offset, words[i % 3]);
+    offset += strlen(words[i % 3]) + 1;
+  }
+  ExpectRoundTrip(page.data(), PAGE_SIZE / 2);
+
+  // noise does not compress, it is kept raw
+  srand(7);
+  for (auto &c : page)
+    c = static_cast<char>(rand());
+  ExpectRoundTrip(page.data(), PAGE_CODEC_MAX_SIZE);
+  char encoded[PAGE_CODEC_MAX_SIZE];
+  EXPECT_EQ(PAGE_CODEC_MAX_SIZE, PageCodec::Encode(page.data(), encoded));
+  EXPECT_EQ(static_cast<char>(PageEncoding::RAW), encoded[0]);
+
+  // long literals and matches, and overlapping copies
+  for (size_t i = 0; i < PAGE_SIZE; i++)
+    page[i] = i < 1000 ? static_cast<char>(rand()) : i % 3;
+  ExpectRoundTrip(page.data(), 1200);
+}
+
+TEST(PageCodecTest, ColumnTest) {
+  const uint32_t count = 300;
+  std::vector<char> column(count * 8), encoded(1 + count * 8),
+      decoded(count * 8);
+  auto check = [&](uint32_t width, ColumnEncoding encoding, size_t max_size) {
+    size_t size =
+        PageCodec::EncodeColumn(column.data(), width, count, encoded.data());
+    EXPECT_EQ(static_cast<char>(encoding), encoded[0]);
+    EXPECT_GE(max_size, size);
+    EXPECT_EQ(size, PageCodec::DecodeColumn(encoded.data(), size, width, count,
+                                            decoded.data()));
+    EXPECT_EQ(0, memcmp(column.data(), decoded.data(), count * width));
+    EXPECT_EQ(0u, PageCodec::DecodeColumn(encoded.data(), size - 1, width,
+                                          count, decoded.data()));
+  };
+
+  // long runs
+  for (uint32_t i = 0; i < count; i++)
+    reinterpret_cast<int32_t *>(column.data())[i] = i / 100;
+  check(4, ColumnEncoding::RLE, 1 + 2 + 3 * 6);
+  // a narrow range
+  for (uint32_t i = 0; i < count; i++)
+    reinterpret_cast<int64_t *>(column.data())[i] = 1000000 + i * 7 % 1000;
+  check(8, ColumnEncoding::FOR, 1 + 8 + 1 + count * 10 / 8 + 1);
+  // few distinct values far apart
+  for (uint32_t i = 0; i < count; i++)
+    reinterpret_cast<int64_t *>(column.data())[i] =
+        static_cast<int64_t>(i * 13 % 5) << 40;
+  check(8, ColumnEncoding::DICT, 1 + 1 + 5 * 8 + count * 3 / 8 + 1);
+  for (uint32_t i = 0; i < count; i++)
+    column[i] = static_cast<char>(i * 31 % 256);
+  check(1, ColumnEncoding::RAW, 1 + count);
+}
+
+/*
+ * Header and minipages laid out as in table_page.h
+ */
+static void MakePaxPage(char *page, uint32_t capacity, uint32_t count) {
+  memset(page, 0, PAGE_SIZE);
+  uint32_t slots = PAX_HEADER_SIZE(2);
+  uint32_t header[] = {1, capacity, 2, slots, 12};
+  memcpy(page + TABLE_PAGE_HEADER_SIZE - 8, &count, 4);
+  memcpy(page + TABLE_PAGE_HEADER_SIZE - 4, header, sizeof(header));
+  uint32_t columns[] = {4, slots + 8 * capacity, 8, slots + 12 * capacity};
+  memcpy(page + PAX_COLUMNS_OFFSET, columns, sizeof(columns));
+  for (uint32_t i = 0; i < count; i++) {
+    int32_t a = i / 50;
+    int64_t b = 5000 + i;
+    memcpy(page + columns[1] + 4 * i, &a, 4);
+    memcpy(page + columns[3] + 8 * i, &b, 8);
+  }
+}
+
+TEST(PageCodecTest, PaxTest) {
+  std::vector<char> page(PAGE_SIZE);
+  MakePaxPage(page.data(), 200, 180);
+  char encoded[PAGE_CODEC_MAX_SIZE];
+  size_t size = PageCodec::Encode(page.data(), encoded);
+  EXPECT_EQ(static_cast<char>(PageEncoding::PAX), encoded[0]);
+  // runs of the first column, 8 bits for the second one
+  ExpectRoundTrip(page.data(), 400);
+  EXPECT_GE(400u, size);
+
+  // a page that only looks like PAX is restored all the same
+  memset(page.data() + PAX_HEADER_SIZE(2) + 8 * 200, 'z', 100);
+  page[5] = 'q';
+  ExpectRoundTrip(page.data(), PAGE_SIZE);
+  uint32_t bad_width = 3;
+  memcpy(page.data() + PAX_COLUMNS_OFFSET, &bad_width, 4);
+  ExpectRoundTrip(page.data(), PAGE_SIZE);
+  uint32_t overlap = 1700;
+  MakePaxPage(page.data(), 200, 180);
+  memcpy(page.data() + PAX_COLUMNS_OFFSET + 12, &overlap, 4);
+  ExpectRoundTrip(page.data(), PAGE_SIZE);
+}
+
+} // namespace cmudb
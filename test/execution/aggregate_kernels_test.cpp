@@ -0,0 +1,121 @@
+/**
+ * aggregate_kernels_test.cpp
+ */
+
+#include <cstdlib>
+#include <vector>
+
+#include "execution/aggregate_kernels.h"
+#include "type/limits.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// count, sum, min and max one value at a time
+template <typename T, typename Aggregate>
+static Aggregate Reference(const std::vector<T> &values, T null) {
+  Aggregate aggregate;
+  for (T value : values) {
+    if (value == null)
+      continue;
+    ++aggregate.count_;
+    aggregate.sum_ += value;
+    aggregate.min_ = std::min<decltype(aggregate.min_)>(aggregate.min_, value);
+    aggregate.max_ = std::max<decltype(aggregate.max_)>(aggregate.max_, value);
+  }
+  return aggregate;
+}
+
+TEST(AggregateKernelsTest, IntegerTest) {
+  srand(7);
+  // lengths around the vector width, the tails are left to the scalar loop
+  for (size_t count : {0, 3, 8, 13, 1000, 1027}) {
+    std::vector<int32_t> values;
+    std::vector<int64_t> big_values;
+    for (size_t i = 0; i < count; ++i) {
+      bool null = rand() % 5 == 0;
+      values.push_back(null ? PELOTON_INT32_NULL : rand() - RAND_MAX / 2);
+      big_values.push_back(null ? PELOTON_INT64_NULL
+                                : static_cast<int64_t>(rand()) * rand());
+    }
+    IntegerAggregate aggregate;
+    AggregateValues(values.data(), values.size(), aggregate);
+    auto expected =
+        Reference<int32_t, IntegerAggregate>(values, PELOTON_INT32_NULL);
+    EXPECT_EQ(expected.count_, aggregate.count_);
+    EXPECT_TRUE(expected.sum_ == aggregate.sum_);
+    EXPECT_EQ(expected.min_, aggregate.min_);
+    EXPECT_EQ(expected.max_, aggregate.max_);
+
+    IntegerAggregate big_aggregate;
+    AggregateValues(big_values.data(), big_values.size(), big_aggregate);
+    expected =
+        Reference<int64_t, IntegerAggregate>(big_values, PELOTON_INT64_NULL);
+    EXPECT_EQ(expected.count_, big_aggregate.count_);
+    EXPECT_TRUE(expected.sum_ == big_aggregate.sum_);
+    EXPECT_EQ(expected.min_, big_aggregate.min_);
+    EXPECT_EQ(expected.max_, big_aggregate.max_);
+  }
+
+  // a sum beyond 64 bit is kept exact, nulls only leave the count at 0
+  std::vector<int64_t> values(16, INT64_MAX);
+  IntegerAggregate aggregate;
+  AggregateValues(values.data(), values.size(), aggregate);
+  EXPECT_TRUE(static_cast<__int128>(INT64_MAX) * 16 == aggregate.sum_);
+  std::vector<int32_t> nulls(9, PELOTON_INT32_NULL);
+  IntegerAggregate empty;
+  AggregateValues(nulls.data(), nulls.size(), empty);
+  EXPECT_EQ(0, empty.count_);
+  EXPECT_TRUE(0 == empty.sum_);
+}
+
+TEST(AggregateKernelsTest, DecimalTest) {
+  std::vector<double> values;
+  for (int i = 0; i < 1001; ++i)
+    values.push_back(i % 7 == 0 ? PELOTON_DECIMAL_NULL : i * 0.5 - 100);
+  DecimalAggregate aggregate;
+  AggregateValues(values.data(), values.size(), aggregate);
+  auto expected =
+      Reference<double, DecimalAggregate>(values, PELOTON_DECIMAL_NULL);
+  EXPECT_EQ(expected.count_, aggregate.count_);
+  EXPECT_DOUBLE_EQ(expected.sum_, aggregate.sum_);
+  EXPECT_EQ(-99.5, aggregate.min_);
+  EXPECT_EQ(400, aggregate.max_);
+}
+
+TEST(AggregateKernelsTest, BatchTest) {
+  Schema *schema = ParseCreateStatement("a int, b double, c varchar");
+  RowBatch batch(schema);
+  for (int i = 0; i < 100; ++i) {
+    std::vector<Value> values{
+        i % 10 == 0 ? Value(TypeId::INTEGER, PELOTON_INT32_NULL)
+                    : Value(TypeId::INTEGER, (int32_t)i),
+        Value(TypeId::DECIMAL, i * 1.0),
+        Value(TypeId::VARCHAR, std::string("x"))};
+    Tuple tuple(values, schema);
+    batch.AppendTuple(tuple.GetData(), RID(0, i));
+  }
+  batch.Materialize();
+  IntegerAggregate aggregate;
+  EXPECT_TRUE(AggregateBatch(batch, 0, aggregate));
+  EXPECT_EQ(90, aggregate.count_);
+  EXPECT_TRUE(4500 == aggregate.sum_);
+  EXPECT_EQ(1, aggregate.min_);
+  EXPECT_EQ(99, aggregate.max_);
+  EXPECT_FALSE(AggregateBatch(batch, 1, aggregate));
+  EXPECT_FALSE(AggregateBatch(batch, 2, aggregate));
+
+  // the rows a filter left are gathered
+  batch.Filter(
+      BatchPredicate(1, CompareType::GE, Value(TypeId::DECIMAL, 50.0)));
+  DecimalAggregate decimal;
+  EXPECT_TRUE(AggregateBatch(batch, 1, decimal));
+  EXPECT_EQ(50, decimal.count_);
+  EXPECT_EQ(3725, decimal.sum_);
+  EXPECT_EQ(50, decimal.min_);
+  EXPECT_EQ(99, decimal.max_);
+  delete schema;
+}
+
+} // namespace cmudb
@@ -0,0 +1,136 @@
+/**
+ * external_sort_test.cpp
+ */
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "execution/external_sort.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// add count records of keys in [0, keys) in random order with their
+// position as payload, sort them and check they come out ordered and stable
+static void SortAndCheck(ExternalSort &sort, int count, int keys) {
+  std::mt19937 random(7);
+  std::string key;
+  for (int i = 0; i < count; i++) {
+    key.clear();
+    AppendSortKey(key, Value(TypeId::INTEGER, (int32_t)(random() % keys) -
+                                                  keys / 2));
+    sort.Add(key, reinterpret_cast<const char *>(&i), sizeof(i));
+  }
+  sort.Sort();
+  std::string last_key;
+  int last_position = -1;
+  int records = 0;
+  while (sort.Next()) {
+    std::string current(sort.GetKey(), sort.GetKeySize());
+    int position;
+    ASSERT_EQ(sizeof(position), sort.GetPayloadSize());
+    memcpy(&position, sort.GetPayload(), sizeof(position));
+    if (records > 0) {
+      ASSERT_LE(last_key, current);
+      if (last_key == current) {
+        ASSERT_LT(last_position, position);
+      }
+    }
+    last_key = current;
+    last_position = position;
+    records++;
+  }
+  EXPECT_EQ(count, records);
+  EXPECT_FALSE(sort.Next());
+}
+
+TEST(ExternalSortTest, SortKeyTest) {
+  auto encode = [](const Value &value, bool descending = false) {
+    std::string key;
+    AppendSortKey(key, value, descending);
+    return key;
+  };
+  Value null_int(TypeId::INTEGER, PELOTON_INT32_NULL);
+  EXPECT_LT(encode(null_int), encode(Value(TypeId::INTEGER, -1000)));
+  EXPECT_LT(encode(Value(TypeId::INTEGER, -1000)),
+            encode(Value(TypeId::INTEGER, -1)));
+  EXPECT_LT(encode(Value(TypeId::INTEGER, -1)),
+            encode(Value(TypeId::INTEGER, 0)));
+  EXPECT_LT(encode(Value(TypeId::INTEGER, 0)),
+            encode(Value(TypeId::INTEGER, 70000)));
+  EXPECT_LT(encode(Value(TypeId::BIGINT, (int64_t)-5)),
+            encode(Value(TypeId::BIGINT, (int64_t)1 << 40)));
+  EXPECT_LT(encode(Value(TypeId::DECIMAL, -2.5)),
+            encode(Value(TypeId::DECIMAL, -0.5)));
+  EXPECT_EQ(encode(Value(TypeId::DECIMAL, -0.0)),
+            encode(Value(TypeId::DECIMAL, 0.0)));
+  EXPECT_LT(encode(Value(TypeId::DECIMAL, 0.25)),
+            encode(Value(TypeId::DECIMAL, 1e10)));
+  EXPECT_LT(encode(Value(TypeId::VARCHAR, std::string("ab"))),
+            encode(Value(TypeId::VARCHAR, std::string("abc"))));
+  EXPECT_LT(encode(Value(TypeId::VARCHAR, std::string("abc"))),
+            encode(Value(TypeId::VARCHAR, std::string("b"))));
+  // descending inverts the order, nulls go last
+  EXPECT_GT(encode(Value(TypeId::VARCHAR, std::string("ab")), true),
+            encode(Value(TypeId::VARCHAR, std::string("abc")), true));
+  EXPECT_GT(encode(null_int, true),
+            encode(Value(TypeId::INTEGER, 5), true));
+  // the first column decides before the second
+  std::string lhs = encode(Value(TypeId::INTEGER, 1));
+  AppendSortKey(lhs, Value(TypeId::VARCHAR, std::string("z")));
+  std::string rhs = encode(Value(TypeId::INTEGER, 2));
+  AppendSortKey(rhs, Value(TypeId::VARCHAR, std::string("a")));
+  EXPECT_LT(lhs, rhs);
+}
+
+TEST(ExternalSortTest, InMemoryTest) {
+  remove("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  {
+    // slices sorted by four threads and merged
+    ExternalSort sort(bpm, nullptr, EXECUTION_MEMORY_LIMIT, 4);
+    SortAndCheck(sort, 50000, 1000);
+    EXPECT_EQ(0, sort.GetRunCount());
+    EXPECT_EQ(0, sort.GetSpilledPageCount());
+  }
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(ExternalSortTest, SpillTest) {
+  remove("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  {
+    // about fifty runs, more than one merge pass
+    ExternalSort sort(bpm, nullptr, 64 * 1024, 2);
+    SortAndCheck(sort, 100000, 5000);
+    EXPECT_LT(EXECUTION_MERGE_FAN_IN, sort.GetRunCount());
+    EXPECT_LT(0, sort.GetSpilledPageCount());
+  }
+  {
+    // the comparator orders the keys, here backwards
+    ExternalSort sort(bpm,
+                      [](const char *lhs, uint32_t lhs_size, const char *rhs,
+                         uint32_t rhs_size) {
+                        return -std::string(lhs, lhs_size).compare(
+                            std::string(rhs, rhs_size));
+                      },
+                      4 * 1024);
+    for (int i = 0; i < 2000; i++)
+      sort.Add(std::to_string(10000 + i), "", 0);
+    sort.Sort();
+    int expected = 11999;
+    while (sort.Next())
+      EXPECT_EQ(std::to_string(expected--),
+                std::string(sort.GetKey(), sort.GetKeySize()));
+    EXPECT_EQ(9999, expected);
+    EXPECT_LT(1, sort.GetRunCount());
+  }
+  delete bpm;
+  remove("test.db");
+}
+
+} // namespace cmudb
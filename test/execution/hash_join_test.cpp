@@ -0,0 +1,109 @@
+/**
+ * hash_join_test.cpp
+ */
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "buffer/buffer_pool_manager.h"
+#include "execution/hash_aggregate.h"
+#include "execution/hash_join.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// small enough for the inputs below to be spilled
+#define TEST_MEMORY_LIMIT (64 * 1024)
+
+static std::string MakeKey(int i) { return "key" + std::to_string(i); }
+
+TEST(HashJoinTest, SpillTest) {
+  remove("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  {
+    HashJoin join(bpm, TEST_MEMORY_LIMIT);
+    // keys 0..9999 once on the build side, the even ones twice on the
+    // probe side and keys with no match on either
+    for (int i = 0; i < 10000; i++)
+      join.AddBuild(MakeKey(i), i);
+    join.AddBuild(MakeKey(-1), -1);
+    for (int i = 0; i < 10000; i += 2) {
+      join.AddProbe(MakeKey(i), 100000 + i);
+      join.AddProbe(MakeKey(i), 200000 + i);
+    }
+    join.AddProbe(MakeKey(20000), 0);
+    EXPECT_LT(0, join.GetSpilledPageCount());
+
+    std::map<int64_t, int> matches;
+    size_t count = 0;
+    join.Run([&](const std::string &key, int64_t build, int64_t probe) {
+      EXPECT_EQ(MakeKey(build), key);
+      EXPECT_EQ(build, probe % 100000);
+      matches[build]++;
+      count++;
+    });
+    EXPECT_EQ(10000, count);
+    EXPECT_EQ(5000, matches.size());
+    for (auto &match : matches) {
+      EXPECT_EQ(0, match.first % 2);
+      EXPECT_EQ(2, match.second);
+    }
+  }
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(HashJoinTest, AggregateSpillTest) {
+  remove("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  {
+    HashAggregate aggregate(bpm, TEST_MEMORY_LIMIT);
+    // group i % 1000 gets the values i, every tenth row is null
+    for (int i = 0; i < 20000; i++) {
+      double value = i;
+      aggregate.Add(MakeKey(i % 1000), i % 10 == 0 ? nullptr : &value);
+    }
+    EXPECT_LT(0, aggregate.GetSpilledPageCount());
+
+    size_t groups = 0;
+    aggregate.Run([&](const std::string &key, const AggregateState &state) {
+      int group = std::stoi(key.substr(3));
+      EXPECT_EQ(20, state.rows_);
+      // the nulls fall in the groups divisible by 10
+      int values = group % 10 == 0 ? 0 : 20;
+      EXPECT_EQ(values, state.values_);
+      if (values > 0) {
+        EXPECT_EQ(group, state.min_);
+        EXPECT_EQ(group + 19000, state.max_);
+        EXPECT_EQ(20 * group + 1000 * 190, state.sum_);
+      }
+      groups++;
+    });
+    EXPECT_EQ(1000, groups);
+  }
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(HashJoinTest, InMemoryTest) {
+  remove("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(10, "test.db");
+  HashJoin join(bpm);
+  join.AddBuild("a", 1);
+  join.AddBuild("a", 2);
+  join.AddProbe("a", 3);
+  join.AddProbe("b", 4);
+  size_t count = 0;
+  join.Run([&](const std::string &key, int64_t build, int64_t probe) {
+    EXPECT_EQ("a", key);
+    EXPECT_EQ(3, probe);
+    count++;
+  });
+  EXPECT_EQ(2, count);
+  EXPECT_EQ(0, join.GetSpilledPageCount());
+  delete bpm;
+  remove("test.db");
+}
+
+} // namespace cmudb
@@ -2,13 +2,22 @@
  * extendible_hash_test.cpp
  */
 
+#include <atomic>
+#include <chrono>
+#include <map>
 #include <thread>
 
+#include "common/config.h"
+#include "common/logger.h"
 #include "hash/extendible_hash.h"
 #include "gtest/gtest.h"
 
 namespace cmudb {
 
+
+
+
+
 TEST(ExtendibleHashTest, SampleTest) {
   // set leaf size as 2
   ExtendibleHash<int, std::string> *test =
@@ -102,4 +111,141 @@ TEST(ExtendibleHashTest, ConcurrentRemoveTest) {
   }
 }
 
+TEST(ExtendibleHashTest, ConcurrentFindTest) {
+  // readers never miss a key that stays while writers split buckets
+  const int num_keys = 20000;
+  ExtendibleHash<int, int> test(4);
+  for (int i = 0; i < num_keys; i += 2)
+    test.Insert(i, i);
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < 4; tid++) {
+    threads.push_back(std::thread([tid, &test, &done]() {
+      int val;
+      for (unsigned round = 0; !done; round++) {
+        int key = (round * 7919 + tid * 2) % num_keys & ~1;
+        EXPECT_TRUE(test.Find(key, val));
+        EXPECT_EQ(key, val);
+      }
+    }));
+  }
+  for (int i = 1; i < num_keys; i += 2)
+    test.Insert(i, i);
+  for (int i = 1; i < num_keys; i += 4)
+    EXPECT_TRUE(test.Remove(i));
+  done = true;
+  for (auto &thread : threads)
+    thread.join();
+  int val;
+  for (int i = 0; i < num_keys; i++)
+    EXPECT_EQ(i % 4 != 1, test.Find(i, val));
+}
+
+// the page table before buckets had latches of their own: one latch for
+// the directory and std::map buckets
+template <typename K, typename V> class GlobalLatchHash {
+public:
+  GlobalLatchHash(size_t size) : bucket_size_(size), global_depth_(0) {
+    directory_.push_back(std::make_shared<Bucket>(0));
+  }
+  bool Find(const K &key, V &value) {
+    std::lock_guard<std::mutex> guard(latch_);
+    auto &bucket = directory_[BucketIndex(key)];
+    auto it = bucket->items_.find(key);
+    if (it == bucket->items_.end())
+      return false;
+    value = it->second;
+    return true;
+  }
+  void Insert(const K &key, const V &value) {
+    std::lock_guard<std::mutex> guard(latch_);
+    while (true) {
+      std::shared_ptr<Bucket> bucket = directory_[BucketIndex(key)];
+      auto it = bucket->items_.find(key);
+      if (it != bucket->items_.end()) {
+        it->second = value;
+        return;
+      }
+      if (bucket->items_.size() < bucket_size_) {
+        bucket->items_.emplace(key, value);
+        return;
+      }
+      if (bucket->local_depth_ == global_depth_) {
+        size_t size = directory_.size();
+        for (size_t i = 0; i < size; ++i)
+          directory_.push_back(directory_[i]);
+        global_depth_++;
+      }
+      size_t split_bit = static_cast<size_t>(1) << bucket->local_depth_;
+      auto image = std::make_shared<Bucket>(++bucket->local_depth_);
+      for (auto item = bucket->items_.begin(); item != bucket->items_.end();) {
+        if (std::hash<K>()(item->first) & split_bit) {
+          image->items_.emplace(item->first, item->second);
+          item = bucket->items_.erase(item);
+        } else {
+          ++item;
+        }
+      }
+      for (size_t i = 0; i < directory_.size(); ++i) {
+        if (directory_[i] == bucket && (i & split_bit))
+          directory_[i] = image;
+      }
+    }
+  }
+
+private:
+  struct Bucket {
+    Bucket(int depth) : local_depth_(depth) {}
+    int local_depth_;
+    std::map<K, V> items_;
+  };
+  size_t BucketIndex(const K &key) {
+    return std::hash<K>()(key) &
+           ((static_cast<size_t>(1) << global_depth_) - 1);
+  }
+  const size_t bucket_size_;
+  int global_depth_;
+  std::vector<std::shared_ptr<Bucket>> directory_;
+  std::mutex latch_;
+};
+
+// lookups per second of num_threads threads, one in eight is an update
+template <typename Table> static double RunLookups(Table &table,
+                                                   int num_threads) {
+  const int num_keys = 4096;
+  const int num_ops = 200000;
+  for (int i = 0; i < num_keys; i++)
+    table.Insert(i, i);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.push_back(std::thread([tid, &table]() {
+      int val;
+      for (int i = 0; i < num_ops; i++) {
+        int key = (i * 2654435761u + tid) % num_keys;
+        if (i % 8 == 0)
+          table.Insert(key, key);
+        else
+          EXPECT_TRUE(table.Find(key, val));
+      }
+    }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return num_threads * num_ops / elapsed.count();
+}
+
+TEST(ExtendibleHashTest, BenchmarkTest) {
+  for (int num_threads : {1, 4, 8}) {
+    GlobalLatchHash<int, int> global_latch(BUCKET_SIZE);
+    ExtendibleHash<int, int> extendible_hash(BUCKET_SIZE);
+    double before = RunLookups(global_latch, num_threads);
+    double after = RunLookups(extendible_hash, num_threads);
+    LOG_INFO("%d threads: global latch %.0f ops/s, bucket latches %.0f ops/s",
+             num_threads, before, after);
+  }
+}
+
 } // namespace cmudb
@@ -0,0 +1,187 @@
+/**
+ * art_index_test.cpp
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+#include "index/art_index.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// rids of the entries of a range, in the order they are returned
+static std::vector<RID> ScanAll(Index *index, const Tuple *low,
+                                bool low_inclusive, const Tuple *high,
+                                bool high_inclusive) {
+  std::vector<RID> rids;
+  IndexScanIterator *iterator =
+      index->ScanRange(low, low_inclusive, high, high_inclusive);
+  for (; !iterator->isEnd(); iterator->Next())
+    rids.push_back(iterator->GetRid());
+  delete iterator;
+  return rids;
+}
+
+TEST(ArtIndexTest, UniqueTest) {
+  Schema *schema = ParseCreateStatement("a bigint, b int");
+  std::string sql = "unique foo_pk a using art";
+  IndexMetadata *metadata = ParseIndexStatement(sql, "foo", schema);
+  EXPECT_EQ(IndexType::ART, metadata->GetType());
+  Index *index = ConstructIndex(metadata, nullptr);
+  auto make_tuple = [&](int64_t key) {
+    return Tuple({Value(TypeId::BIGINT, key)}, index->GetKeySchema());
+  };
+
+  // negative and positive keys, spread wide and packed close
+  std::vector<int64_t> keys;
+  for (int64_t i = -5000; i < 5000; i++)
+    keys.push_back(i % 2 == 0 ? i : i * 1000003);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(7));
+  for (size_t i = 0; i < keys.size(); i++)
+    index->InsertEntry(make_tuple(keys[i]), RID(static_cast<int32_t>(i), 0));
+  EXPECT_EQ(keys.size(), index->GetEntryCount());
+  // a second entry of a key is refused
+  index->InsertEntry(make_tuple(keys[3]), RID(99999, 0));
+  EXPECT_EQ(keys.size(), index->GetEntryCount());
+
+  std::vector<RID> rids;
+  for (size_t i = 0; i < keys.size(); i++) {
+    rids.clear();
+    index->ScanKey(make_tuple(keys[i]), rids);
+    ASSERT_EQ(1u, rids.size());
+    EXPECT_EQ(RID(static_cast<int32_t>(i), 0), rids[0]);
+  }
+  rids.clear();
+  index->ScanKey(make_tuple(7), rids);
+  EXPECT_TRUE(rids.empty());
+
+  // ranges come in key order
+  Tuple low = make_tuple(-100), high = make_tuple(100);
+  EXPECT_EQ(101u, ScanAll(index, &low, true, &high, true).size());
+  EXPECT_EQ(99u, ScanAll(index, &low, false, &high, false).size());
+  std::vector<RID> all = ScanAll(index, nullptr, false, nullptr, false);
+  ASSERT_EQ(keys.size(), all.size());
+  for (size_t i = 1; i < all.size(); i++)
+    EXPECT_LT(keys[all[i - 1].GetPageId()], keys[all[i].GetPageId()]);
+
+  // every other key goes, a unique index ignores the rid
+  for (size_t i = 0; i < keys.size(); i += 2)
+    index->DeleteEntry(make_tuple(keys[i]), RID());
+  EXPECT_EQ(keys.size() / 2, index->GetEntryCount());
+  for (size_t i = 0; i < keys.size(); i++) {
+    rids.clear();
+    index->ScanKey(make_tuple(keys[i]), rids);
+    EXPECT_EQ(i % 2, rids.size());
+  }
+
+  delete index;
+  delete schema;
+}
+
+TEST(ArtIndexTest, NonUniqueTest) {
+  Schema *schema = ParseCreateStatement("a varchar, b double");
+  std::string sql = "foo_ab a, b using art";
+  IndexMetadata *metadata = ParseIndexStatement(sql, "foo", schema);
+  Index *index = ConstructIndex(metadata, nullptr);
+  // keys sharing prefixes longer than a node keeps
+  std::string prefix(40, 'p');
+  auto make_tuple = [&](int key, double value) {
+    return Tuple({Value(TypeId::VARCHAR, prefix + std::to_string(key)),
+                  Value(TypeId::DECIMAL, value)},
+                 index->GetKeySchema());
+  };
+
+  // 100 keys with 30 entries each
+  for (int i = 0; i < 3000; i++)
+    index->InsertEntry(make_tuple(i % 100, i % 100 - 50.5), RID(i, 1));
+  EXPECT_EQ(3000u, index->GetEntryCount());
+  std::vector<RID> rids;
+  index->ScanKey(make_tuple(7, -43.5), rids);
+  ASSERT_EQ(30u, rids.size());
+  for (size_t i = 0; i < rids.size(); i++)
+    EXPECT_EQ(RID(static_cast<int32_t>(7 + 100 * i), 1), rids[i]);
+  rids.clear();
+  index->ScanKey(make_tuple(7, 7), rids);
+  EXPECT_TRUE(rids.empty());
+  rids.clear();
+  index->ScanKey(make_tuple(1, -49.5), rids);
+  EXPECT_EQ(30u, rids.size());
+
+  // only the entry of the rid goes, emptied paths are compressed away
+  for (int i = 0; i < 3000; i++)
+    if (i % 100 != 7 || i < 1500)
+      index->DeleteEntry(make_tuple(i % 100, i % 100 - 50.5), RID(i, 1));
+  EXPECT_EQ(15u, index->GetEntryCount());
+  rids.clear();
+  index->ScanKey(make_tuple(7, -43.5), rids);
+  ASSERT_EQ(15u, rids.size());
+  EXPECT_EQ(RID(1507, 1), rids[0]);
+  EXPECT_EQ(15u, ScanAll(index, nullptr, false, nullptr, false).size());
+  // and come back
+  for (int i = 0; i < 3000; i++)
+    if (i % 100 != 7 || i < 1500)
+      index->InsertEntry(make_tuple(i % 100, i % 100 - 50.5), RID(i, 1));
+  EXPECT_EQ(3000u, index->GetEntryCount());
+  rids.clear();
+  index->ScanKey(make_tuple(99, 48.5), rids);
+  EXPECT_EQ(30u, rids.size());
+
+  delete index;
+  delete schema;
+}
+
+TEST(ArtIndexTest, ConcurrentTest) {
+  Schema *schema = ParseCreateStatement("a int");
+  std::string sql = "unique foo_pk a using art";
+  IndexMetadata *metadata = ParseIndexStatement(sql, "foo", schema);
+  Index *index = ConstructIndex(metadata, nullptr);
+  auto make_tuple = [&](int32_t key) {
+    return Tuple({Value(TypeId::INTEGER, key)}, index->GetKeySchema());
+  };
+  for (int32_t key = 0; key < 20000; key += 2)
+    index->InsertEntry(make_tuple(key), RID(key, 0));
+
+  // writers insert the odd keys and delete the even ones in turns, readers
+  // always find the even keys above 10000, which nobody changes
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < 4; t++) {
+    threads.emplace_back([&, t] {
+      for (int round = 0; round < 3; round++) {
+        for (int32_t key = 2 * t + 1; key < 20000; key += 8)
+          index->InsertEntry(make_tuple(key), RID(key, 0));
+        for (int32_t key = 2 * t; key < 10000; key += 8)
+          index->DeleteEntry(make_tuple(key), RID(key, 0));
+        for (int32_t key = 2 * t; key < 10000; key += 8)
+          index->InsertEntry(make_tuple(key), RID(key, 0));
+        for (int32_t key = 2 * t + 1; key < 20000; key += 8)
+          index->DeleteEntry(make_tuple(key), RID(key, 0));
+      }
+    });
+    threads.emplace_back([&, t] {
+      std::vector<RID> rids;
+      for (int32_t key = 10000 + 2 * t; key < 20000; key += 8) {
+        rids.clear();
+        index->ScanKey(make_tuple(key), rids);
+        ASSERT_EQ(1u, rids.size());
+        EXPECT_EQ(RID(key, 0), rids[0]);
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  EXPECT_EQ(10000u, index->GetEntryCount());
+  std::vector<RID> all = ScanAll(index, nullptr, false, nullptr, false);
+  ASSERT_EQ(10000u, all.size());
+  for (size_t i = 0; i < all.size(); i++)
+    EXPECT_EQ(RID(static_cast<int32_t>(2 * i), 0), all[i]);
+
+  delete index;
+  delete schema;
+}
+
+} // namespace cmudb
@@ -3,10 +3,12 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <functional>
 #include <iostream>
+#include <random>
 #include <thread>
 
 #include "buffer/buffer_pool_manager.h"
@@ -326,4 +328,342 @@ TEST(BPlusTreeConcurrentTest, MixTest) {
   remove("test.db");
 }
 
+// writers on many threads, optimistic and pessimistic latching
+TEST(BPlusTreeConcurrentTest, ManyThreadMixTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  const int num_threads = 16;
+  const int64_t scale_factor = 20000;
+  std::vector<int64_t> keys;
+  std::vector<int64_t> remove_keys;
+  for (int64_t key = 1; key <= scale_factor; key++) {
+    keys.push_back(key);
+    if (key % 2 == 1)
+      remove_keys.push_back(key);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::default_random_engine(0));
+
+  for (bool optimistic : {true, false}) {
+    BufferPoolManager *bpm = new BufferPoolManager(200, "test.db");
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                             comparator);
+    tree.SetOptimisticLatching(optimistic);
+    page_id_t page_id;
+    auto header_page = bpm->NewPage(page_id);
+    (void)header_page;
+
+    LaunchParallelTest(num_threads, InsertHelperSplit, std::ref(tree), keys,
+                       num_threads);
+    LaunchParallelTest(num_threads, DeleteHelperSplit, std::ref(tree),
+                       remove_keys, num_threads);
+    // most writes only touched their leaf
+    if (optimistic) {
+      EXPECT_LT(tree.GetOptimisticRestartCount(),
+                static_cast<size_t>(scale_factor / 10));
+    } else {
+      EXPECT_EQ(0u, tree.GetOptimisticRestartCount());
+    }
+
+    std::vector<RID> rids;
+    GenericKey<8> index_key;
+    for (int64_t key = 1; key <= scale_factor; key++) {
+      rids.clear();
+      index_key.SetFromInteger(key);
+      EXPECT_EQ(key % 2 == 0, tree.GetValue(index_key, rids));
+    }
+    int64_t current_key = 2;
+    index_key.SetFromInteger(current_key);
+    for (auto iterator = tree.Begin(index_key); iterator.isEnd() == false;
+         ++iterator) {
+      EXPECT_EQ(current_key, (*iterator).second.GetSlotNum());
+      current_key += 2;
+    }
+    EXPECT_EQ(scale_factor + 2, current_key);
+
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    delete bpm;
+    remove("test.db");
+  }
+}
+
+// latch free lookups never miss a key while the tree splits and merges
+TEST(BPlusTreeConcurrentTest, OptimisticReadTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  BufferPoolManager *bpm = new BufferPoolManager(200, "test.db");
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  // even keys stay, odd keys come and go
+  const int num_threads = 8;
+  const int64_t scale_factor = 20000;
+  std::vector<int64_t> keys;
+  std::vector<int64_t> odd_keys;
+  for (int64_t key = 2; key <= scale_factor; key += 2) {
+    keys.push_back(key);
+    odd_keys.push_back(key + 1);
+  }
+  InsertHelper(tree, keys);
+
+  std::atomic<bool> done(false);
+  std::atomic<int64_t> misses(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < num_threads / 2; i++) {
+    readers.emplace_back([&] {
+      std::vector<RID> rids;
+      GenericKey<8> index_key;
+      while (!done) {
+        for (auto key : keys) {
+          rids.clear();
+          index_key.SetFromInteger(key);
+          if (!tree.GetValue(index_key, rids) || rids.size() != 1 ||
+              rids[0].GetSlotNum() != key)
+            ++misses;
+        }
+      }
+    });
+  }
+  // batched lookups hold their path while writers split and merge below it
+  readers.emplace_back([&] {
+    std::vector<GenericKey<8>> index_keys(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+      index_keys[i].SetFromInteger(keys[i]);
+    std::vector<RID> rids;
+    while (!done) {
+      rids.clear();
+      if (tree.GetValues(index_keys, rids) != keys.size())
+        ++misses;
+      for (size_t i = 0; i < rids.size(); i++)
+        if (rids[i].GetSlotNum() != keys[i])
+          ++misses;
+    }
+  });
+  for (int round = 0; round < 3; round++) {
+    LaunchParallelTest(num_threads / 2, InsertHelperSplit, std::ref(tree),
+                       odd_keys, num_threads / 2);
+    LaunchParallelTest(num_threads / 2, DeleteHelperSplit, std::ref(tree),
+                       odd_keys, num_threads / 2);
+  }
+  done = true;
+  for (auto &reader : readers)
+    reader.join();
+  EXPECT_EQ(0, misses);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeConcurrentTest, SwizzledReadTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  // too few frames for the tree, lookups race with evictions
+  BufferPoolManager *bpm = new BufferPoolManager(64, "test.db");
+  EXPECT_TRUE(bpm->EnableSwizzling());
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  std::vector<int64_t> keys;
+  std::vector<int64_t> odd_keys;
+  for (int64_t key = 2; key <= 40000; key += 2) {
+    keys.push_back(key);
+    odd_keys.push_back(key + 1);
+  }
+  InsertHelper(tree, keys);
+
+  // once a path is swizzled a lookup of its keys fetches nothing
+  std::vector<RID> rids;
+  GenericKey<8> index_key;
+  std::vector<int64_t> hot_keys(keys.begin(), keys.begin() + 500);
+  for (int round = 0; round < 2; round++) {
+    bpm->ResetStats();
+    for (auto key : hot_keys) {
+      rids.clear();
+      index_key.SetFromInteger(key);
+      EXPECT_TRUE(tree.GetValue(index_key, rids));
+      ASSERT_EQ(1u, rids.size());
+      EXPECT_EQ(key, rids[0].GetSlotNum());
+    }
+  }
+  EXPECT_EQ(0u, bpm->GetStats().fetches_);
+
+  std::atomic<bool> done(false);
+  std::atomic<int64_t> misses(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; i++) {
+    readers.emplace_back([&, i] {
+      std::vector<RID> rids;
+      GenericKey<8> index_key;
+      while (!done) {
+        for (size_t j = i; j < keys.size(); j += 3) {
+          rids.clear();
+          index_key.SetFromInteger(keys[j]);
+          if (!tree.GetValue(index_key, rids) || rids.size() != 1 ||
+              rids[0].GetSlotNum() != keys[j])
+            ++misses;
+        }
+      }
+    });
+  }
+  for (int round = 0; round < 2; round++) {
+    LaunchParallelTest(2, InsertHelperSplit, std::ref(tree), odd_keys, 2);
+    LaunchParallelTest(2, DeleteHelperSplit, std::ref(tree), odd_keys, 2);
+  }
+  done = true;
+  for (auto &reader : readers)
+    reader.join();
+  EXPECT_EQ(0, misses);
+  EXPECT_GT(bpm->GetStats().evictions_, 0u);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeConcurrentTest, ReverseScanTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  BufferPoolManager *bpm = new BufferPoolManager(200, "test.db");
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  // even keys stay, odd keys split and merge the leaves under the scans
+  const int num_threads = 8;
+  const int64_t scale_factor = 20000;
+  std::vector<int64_t> keys;
+  std::vector<int64_t> odd_keys;
+  for (int64_t key = 2; key <= scale_factor; key += 2) {
+    keys.push_back(key);
+    odd_keys.push_back(key + 1);
+  }
+  InsertHelper(tree, keys);
+
+  std::atomic<bool> done(false);
+  std::atomic<int64_t> misses(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < num_threads / 2; i++) {
+    readers.emplace_back([&] {
+      while (!done) {
+        int64_t last = scale_factor + 2, even = scale_factor;
+        for (auto iterator = tree.RBegin(); !iterator.isEnd(); ++iterator) {
+          int64_t key = (*iterator).second.GetSlotNum();
+          if (key >= last)
+            ++misses;
+          last = key;
+          if (key % 2 == 0) {
+            if (key != even)
+              ++misses;
+            even -= 2;
+          }
+        }
+        if (even != 0)
+          ++misses;
+      }
+    });
+  }
+  for (int round = 0; round < 3; round++) {
+    LaunchParallelTest(num_threads / 2, InsertHelperSplit, std::ref(tree),
+                       odd_keys, num_threads / 2);
+    LaunchParallelTest(num_threads / 2, DeleteHelperSplit, std::ref(tree),
+                       odd_keys, num_threads / 2);
+  }
+  done = true;
+  for (auto &reader : readers)
+    reader.join();
+  EXPECT_EQ(0, misses);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+/*
+ * Leaves split while reverse scans hold them. Once the writers are done
+ * every leaf links back to the one before it, also those whose link could
+ * not be set while a scan held them
+ */
+TEST(BPlusTreeConcurrentTest, ReverseScanSplitTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  BufferPoolManager *bpm = new BufferPoolManager(200, "test.db");
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  const int num_threads = 8;
+  const int64_t scale_factor = 40000;
+  std::vector<int64_t> keys;
+  std::vector<int64_t> new_keys;
+  for (int64_t key = 4; key <= scale_factor; key += 4) {
+    keys.push_back(key);
+    new_keys.push_back(key + 1);
+    new_keys.push_back(key + 2);
+    new_keys.push_back(key + 3);
+  }
+  InsertHelper(tree, keys);
+
+  std::atomic<bool> done(false);
+  std::atomic<int64_t> misses(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < num_threads / 2; i++) {
+    readers.emplace_back([&] {
+      while (!done) {
+        int64_t last = scale_factor + 4, kept = scale_factor;
+        for (auto iterator = tree.RBegin(); !iterator.isEnd(); ++iterator) {
+          int64_t key = (*iterator).second.GetSlotNum();
+          if (key >= last)
+            ++misses;
+          last = key;
+          if (key % 4 == 0) {
+            if (key != kept)
+              ++misses;
+            kept -= 4;
+          }
+        }
+        if (kept != 0)
+          ++misses;
+      }
+    });
+  }
+  LaunchParallelTest(num_threads / 2, InsertHelperSplit, std::ref(tree),
+                     new_keys, num_threads / 2);
+  done = true;
+  for (auto &reader : readers)
+    reader.join();
+  EXPECT_EQ(0, misses);
+
+  auto leaf = tree.FindLeafPage(GenericKey<8>(), true);
+  page_id_t prev_page_id = INVALID_PAGE_ID;
+  int64_t count = 0;
+  while (leaf != nullptr) {
+    EXPECT_EQ(prev_page_id, leaf->GetPrevPageId());
+    count += leaf->GetSize();
+    prev_page_id = leaf->GetPageId();
+    page_id_t next_page_id = leaf->GetNextPageId();
+    bpm->UnpinPage(prev_page_id, false);
+    leaf = next_page_id == INVALID_PAGE_ID
+               ? nullptr
+               : reinterpret_cast<BPlusTreeLeafPage<GenericKey<8>, RID,
+                                                    GenericComparator<8>> *>(
+                     bpm->FetchPage(next_page_id)->GetData());
+  }
+  EXPECT_EQ(scale_factor, count);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  delete key_schema;
+  remove("test.db");
+}
+
 } // namespace cmudb
@@ -5,11 +5,15 @@
 #include <algorithm>
 #include <cstdio>
 #include <iostream>
+#include <random>
 #include <sstream>
+#include <thread>
 
 #include "buffer/buffer_pool_manager.h"
 #include "common/logger.h"
 #include "index/b_plus_tree.h"
+#include "index/b_plus_tree_index.h"
+#include "index/key_search.h"
 #include "vtable/virtual_table.h"
 #include "gtest/gtest.h"
 
@@ -370,4 +374,992 @@ TEST(BPlusTreeTests, ScaleTest) {
   delete transaction;
   remove("test.db");
 }
+// every leaf links back to the one before it
+static void CheckPrevLinks(
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> &tree,
+    BufferPoolManager *bpm) {
+  auto leaf = tree.FindLeafPage(GenericKey<8>(), true);
+  page_id_t prev_page_id = INVALID_PAGE_ID;
+  while (leaf != nullptr) {
+    EXPECT_EQ(prev_page_id, leaf->GetPrevPageId());
+    prev_page_id = leaf->GetPageId();
+    page_id_t next_page_id = leaf->GetNextPageId();
+    bpm->UnpinPage(prev_page_id, false);
+    leaf = next_page_id == INVALID_PAGE_ID
+               ? nullptr
+               : reinterpret_cast<BPlusTreeLeafPage<GenericKey<8>, RID,
+                                                    GenericComparator<8>> *>(
+                     bpm->FetchPage(next_page_id)->GetData());
+  }
+}
+
+TEST(BPlusTreeTests, BulkLoadTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  GenericKey<8> index_key;
+  RID rid;
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  // even keys, enough for three levels
+  int64_t scale = 100000;
+  std::vector<std::pair<GenericKey<8>, RID>> items;
+  for (int64_t key = 2; key <= scale; key += 2) {
+    index_key.SetFromInteger(key);
+    rid.Set(0, key);
+    items.emplace_back(index_key, rid);
+  }
+  EXPECT_TRUE(tree.Last().isEnd());
+  EXPECT_EQ(0, tree.GetEntryCount());
+  std::vector<std::pair<GenericKey<8>, RID>> unsorted = {items[1], items[0]};
+  EXPECT_FALSE(tree.BulkLoad(unsorted));
+  EXPECT_TRUE(tree.BulkLoad(items));
+  EXPECT_FALSE(tree.IsEmpty());
+  EXPECT_FALSE(tree.BulkLoad(items));
+
+  std::vector<RID> rids;
+  for (int64_t key = 1; key <= scale; key++) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_EQ(key % 2 == 0, tree.GetValue(index_key, rids));
+  }
+  int64_t current_key = 2;
+  for (auto iterator = tree.Begin(); iterator.isEnd() == false; ++iterator) {
+    EXPECT_EQ(current_key, (*iterator).second.GetSlotNum());
+    current_key += 2;
+  }
+  EXPECT_EQ(scale + 2, current_key);
+  EXPECT_EQ(scale / 2, tree.GetEntryCount());
+  CheckPrevLinks(tree, bpm);
+  auto last = tree.Last();
+  EXPECT_EQ(scale, (*last).second.GetSlotNum());
+  EXPECT_TRUE((++last).isEnd());
+
+  // the packed tree takes inserts and removes
+  for (int64_t key = 1; key <= scale; key += 2) {
+    index_key.SetFromInteger(key);
+    rid.Set(0, key);
+    EXPECT_TRUE(tree.Insert(index_key, rid));
+  }
+  for (int64_t key = 2; key <= scale; key += 4) {
+    index_key.SetFromInteger(key);
+    tree.Remove(index_key);
+  }
+  int64_t size = 0;
+  for (auto iterator = tree.Begin(); iterator.isEnd() == false; ++iterator) {
+    EXPECT_NE(2, (*iterator).second.GetSlotNum() % 4);
+    size++;
+  }
+  EXPECT_EQ(scale - scale / 4, size);
+  EXPECT_EQ(size, tree.GetEntryCount());
+  CheckPrevLinks(tree, bpm);
+  EXPECT_EQ(scale, (*tree.Last()).second.GetSlotNum());
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeTests, ReverseIteratorTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  GenericKey<8> index_key;
+  RID rid;
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+  EXPECT_TRUE(tree.RBegin().isEnd());
+
+  int64_t scale = 20000;
+  for (int64_t key = 1; key <= scale; key++) {
+    index_key.SetFromInteger(key);
+    rid.Set(0, key);
+    tree.Insert(index_key, rid);
+  }
+  CheckPrevLinks(tree, bpm);
+  // leaves emptied in the middle leave separators above their keys
+  for (int64_t key = 5000; key < 15000; key++) {
+    if (key % 1000 == 0)
+      continue;
+    index_key.SetFromInteger(key);
+    tree.Remove(index_key);
+  }
+  CheckPrevLinks(tree, bpm);
+  auto expected = [&](int64_t key) {
+    return key < 5000 || key >= 15000 || key % 1000 == 0;
+  };
+
+  int64_t current_key = scale;
+  for (auto iterator = tree.RBegin(); !iterator.isEnd(); ++iterator) {
+    while (!expected(current_key))
+      current_key--;
+    EXPECT_EQ(current_key, (*iterator).second.GetSlotNum());
+    current_key--;
+  }
+  EXPECT_EQ(0, current_key);
+
+  // from a key, or below it
+  index_key.SetFromInteger(14500);
+  {
+    auto iterator = tree.RBegin(index_key);
+    EXPECT_EQ(14000, (*iterator).second.GetSlotNum());
+    EXPECT_EQ(13000, (*++iterator).second.GetSlotNum());
+  }
+  index_key.SetFromInteger(15000);
+  EXPECT_EQ(15000, (*tree.RBegin(index_key)).second.GetSlotNum());
+  EXPECT_EQ(14000, (*tree.RBegin(index_key, false)).second.GetSlotNum());
+  index_key.SetFromInteger(1);
+  EXPECT_TRUE(tree.RBegin(index_key, false).isEnd());
+  index_key.SetFromInteger(scale + 10);
+  EXPECT_EQ(scale, (*tree.RBegin(index_key)).second.GetSlotNum());
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeTests, ReadAheadTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  GenericKey<8> index_key;
+  RID rid;
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  // hundreds of leaves, the pool keeps the last ones
+  int64_t scale = 100000;
+  std::vector<std::pair<GenericKey<8>, RID>> items;
+  for (int64_t key = 1; key <= scale; key++) {
+    index_key.SetFromInteger(key);
+    rid.Set(0, key);
+    items.emplace_back(index_key, rid);
+  }
+  EXPECT_TRUE(tree.BulkLoad(items));
+  bpm->FlushAllPages();
+
+  // the leaves are mostly read before the scan gets to them
+  bpm->ResetStats();
+  int64_t current_key = 1;
+  for (auto iterator = tree.Begin(); iterator.isEnd() == false; ++iterator)
+    EXPECT_EQ(current_key++, (*iterator).second.GetSlotNum());
+  EXPECT_EQ(scale + 1, current_key);
+  BufferPoolStats stats = bpm->GetStats();
+  EXPECT_LT(stats.misses_ * 2, stats.fetches_);
+
+  // a range from the middle, and one stopped within a leaf
+  index_key.SetFromInteger(scale / 2);
+  current_key = scale / 2;
+  for (auto iterator = tree.Begin(index_key);
+       iterator.isEnd() == false && current_key < scale / 2 + 10000;
+       ++iterator)
+    EXPECT_EQ(current_key++, (*iterator).second.GetSlotNum());
+  EXPECT_EQ(scale / 2 + 10000, current_key);
+  index_key.SetFromInteger(10);
+  EXPECT_EQ(10, (*tree.Begin(index_key)).second.GetSlotNum());
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeTests, RootPageIdTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  GenericKey<8> index_key;
+  RID rid;
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  // root splits are taken once
+  page_id_t root_page_id;
+  EXPECT_FALSE(tree.GetChangedRootPageId(root_page_id));
+  for (int64_t key = 1; key <= 10000; key++) {
+    index_key.SetFromInteger(key);
+    rid.Set(0, key);
+    EXPECT_TRUE(tree.Insert(index_key, rid));
+  }
+  EXPECT_TRUE(tree.GetChangedRootPageId(root_page_id));
+  EXPECT_FALSE(tree.GetChangedRootPageId(root_page_id));
+
+  // a tree opened at the root found
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> reopened(
+      "foo_pk", bpm, comparator, root_page_id);
+  std::vector<RID> rids;
+  index_key.SetFromInteger(5000);
+  EXPECT_TRUE(reopened.GetValue(index_key, rids));
+  EXPECT_EQ(5000, rids[0].GetSlotNum());
+
+  // an emptied tree has an invalid root
+  for (int64_t key = 1; key <= 10000; key++) {
+    index_key.SetFromInteger(key);
+    tree.Remove(index_key);
+  }
+  EXPECT_TRUE(tree.IsEmpty());
+  EXPECT_TRUE(tree.GetChangedRootPageId(root_page_id));
+  EXPECT_EQ(INVALID_PAGE_ID, root_page_id);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeTests, CompressedLeafTest) {
+  Schema *key_schema = ParseCreateStatement("a varchar(64)");
+  GenericComparator<64> comparator(key_schema);
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  BPlusTree<GenericKey<64>, RID, GenericComparator<64>> tree("foo_pk", bpm,
+                                                             comparator);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  auto make_key = [&](const std::string &value) {
+    GenericKey<64> index_key;
+    index_key.SetFromKey(Tuple({Value(TypeId::VARCHAR, value)}, key_schema));
+    return index_key;
+  };
+  char buffer[16];
+  std::vector<std::string> keys;
+  for (int i = 0; i < 4000; i++) {
+    snprintf(buffer, sizeof(buffer), "key%05d", i);
+    keys.push_back(buffer);
+  }
+  for (size_t i = 0; i < keys.size(); i++)
+    EXPECT_TRUE(tree.Insert(make_key(keys[i]), RID(0, i)));
+  // short keys share most of their 64 bytes, uncompressed 55 fit a leaf and
+  // the tree would not fit the one extent it took after the header page
+  static_assert(EXTENT_PAGES < 4000 / 55, "extent holds the whole tree");
+  bpm->UnpinPage(bpm->NewPage(page_id)->GetPageId(), false);
+  EXPECT_EQ(1 + EXTENT_PAGES, page_id);
+
+  // long keys between the short ones widen crowded leaves
+  std::string tail(40, 'z');
+  for (size_t i = 0; i < 4000; i += 50) {
+    keys.push_back(keys[i] + tail);
+    EXPECT_TRUE(tree.Insert(make_key(keys.back()), RID(0, keys.size() - 1)));
+  }
+  EXPECT_FALSE(tree.Insert(make_key(keys[10]), RID(0, 10)));
+  std::vector<RID> rids;
+  for (size_t i = 0; i < keys.size(); i++) {
+    rids.clear();
+    EXPECT_TRUE(tree.GetValue(make_key(keys[i]), rids));
+    ASSERT_EQ(1u, rids.size());
+    EXPECT_EQ(static_cast<int>(i), rids[0].GetSlotNum());
+  }
+  std::vector<std::string> sorted = keys;
+  std::sort(sorted.begin(), sorted.end());
+  size_t count = 0;
+  for (auto iterator = tree.Begin(); !iterator.isEnd(); ++iterator, ++count)
+    EXPECT_EQ(sorted[count], keys[(*iterator).second.GetSlotNum()]);
+  EXPECT_EQ(keys.size(), count);
+
+  // merges and borrows between leaves of different widths
+  for (size_t i = 0; i < keys.size(); i += 2)
+    tree.Remove(make_key(keys[i]));
+  count = 0;
+  for (auto iterator = tree.Begin(); !iterator.isEnd(); ++iterator, ++count)
+    EXPECT_EQ(1, (*iterator).second.GetSlotNum() % 2);
+  EXPECT_EQ(keys.size() / 2, count);
+  for (size_t i = 1; i < keys.size(); i += 2)
+    tree.Remove(make_key(keys[i]));
+  EXPECT_TRUE(tree.IsEmpty());
+
+  delete key_schema;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+// keys of a range scan of the index, from the high key down if descending
+static std::vector<int64_t> ScanRange(Index *index, Schema *key_schema,
+                                      int64_t *low, bool low_inclusive,
+                                      int64_t *high, bool high_inclusive,
+                                      bool descending = false) {
+  Tuple low_key, high_key;
+  if (low != nullptr)
+    low_key = Tuple({Value(TypeId::BIGINT, *low)}, key_schema);
+  if (high != nullptr)
+    high_key = Tuple({Value(TypeId::BIGINT, *high)}, key_schema);
+  IndexScanIterator *iterator =
+      descending
+          ? index->ScanRangeReverse(low == nullptr ? nullptr : &low_key,
+                                    low_inclusive,
+                                    high == nullptr ? nullptr : &high_key,
+                                    high_inclusive)
+          : index->ScanRange(low == nullptr ? nullptr : &low_key,
+                             low_inclusive,
+                             high == nullptr ? nullptr : &high_key,
+                             high_inclusive);
+  std::vector<int64_t> keys;
+  for (; !iterator->isEnd(); iterator->Next())
+    keys.push_back(iterator->GetRid().GetSlotNum());
+  delete iterator;
+  return keys;
+}
+
+TEST(BPlusTreeTests, ScanRangeTest) {
+  Schema *schema = ParseCreateStatement("a bigint");
+  IndexMetadata *metadata = new IndexMetadata("foo_pk", "foo", schema, {0});
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+  auto index = new BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>(
+      metadata, bpm);
+  Schema *key_schema = index->GetKeySchema();
+
+  // even keys 0 to 1998, the rid holds the key
+  for (int64_t key = 0; key < 2000; key += 2) {
+    Tuple tuple({Value(TypeId::BIGINT, key)}, key_schema);
+    index->InsertEntry(tuple, RID(0, key));
+  }
+
+  int64_t low = 10, high = 20;
+  std::vector<int64_t> keys = {10, 12, 14, 16, 18, 20};
+  EXPECT_EQ(keys, ScanRange(index, key_schema, &low, true, &high, true));
+  keys = {12, 14, 16, 18};
+  EXPECT_EQ(keys, ScanRange(index, key_schema, &low, false, &high, false));
+  // bounds between keys
+  low = 11, high = 17;
+  keys = {12, 14, 16};
+  EXPECT_EQ(keys, ScanRange(index, key_schema, &low, false, &high, true));
+  high = 4;
+  keys = {0, 2};
+  EXPECT_EQ(keys, ScanRange(index, key_schema, nullptr, true, &high, false));
+  low = 1994;
+  keys = {1996, 1998};
+  EXPECT_EQ(keys, ScanRange(index, key_schema, &low, false, nullptr, true));
+  EXPECT_EQ(1000u,
+            ScanRange(index, key_schema, nullptr, true, nullptr, true).size());
+  // empty ranges
+  low = 1998;
+  EXPECT_TRUE(ScanRange(index, key_schema, &low, false, nullptr, true).empty());
+  low = 20, high = 10;
+  EXPECT_TRUE(ScanRange(index, key_schema, &low, true, &high, true).empty());
+  low = 10;
+  EXPECT_TRUE(ScanRange(index, key_schema, &low, true, &low, false).empty());
+
+  // the same ranges backwards
+  low = 10, high = 20;
+  keys = {20, 18, 16, 14, 12, 10};
+  EXPECT_EQ(keys,
+            ScanRange(index, key_schema, &low, true, &high, true, true));
+  keys = {18, 16, 14, 12};
+  EXPECT_EQ(keys,
+            ScanRange(index, key_schema, &low, false, &high, false, true));
+  low = 11, high = 17;
+  keys = {16, 14, 12};
+  EXPECT_EQ(keys,
+            ScanRange(index, key_schema, &low, false, &high, true, true));
+  low = 1994;
+  keys = {1998, 1996};
+  EXPECT_EQ(keys,
+            ScanRange(index, key_schema, &low, false, nullptr, true, true));
+  high = 4;
+  keys = {2, 0};
+  EXPECT_EQ(keys,
+            ScanRange(index, key_schema, nullptr, true, &high, false, true));
+  keys = ScanRange(index, key_schema, nullptr, true, nullptr, true, true);
+  EXPECT_EQ(1000u, keys.size());
+  EXPECT_TRUE(std::is_sorted(keys.rbegin(), keys.rend()));
+  low = 20, high = 10;
+  EXPECT_TRUE(
+      ScanRange(index, key_schema, &low, true, &high, true, true).empty());
+
+  delete index;
+  delete schema;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeTests, GetValuesTest) {
+  Schema *schema = ParseCreateStatement("a bigint");
+  IndexMetadata *metadata =
+      new IndexMetadata("foo_pk", "foo", schema, {0}, true);
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+  GenericComparator<8> comparator(schema);
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  std::vector<GenericKey<8>> keys;
+  std::vector<RID> rids;
+  std::vector<bool> found;
+  GenericKey<8> index_key;
+  index_key.SetFromInteger(1);
+  keys.push_back(index_key);
+  EXPECT_EQ(0u, tree.GetValues(keys, rids, &found));
+  EXPECT_FALSE(found[0]);
+
+  // even keys 0 to 19998, enough for three levels
+  for (int64_t key = 0; key < 20000; key += 2) {
+    index_key.SetFromInteger(key);
+    tree.Insert(index_key, RID(0, key));
+  }
+  // every third key, and a run of equal ones
+  keys.clear();
+  for (int64_t key = -3; key < 20010; key += 3) {
+    index_key.SetFromInteger(key);
+    keys.push_back(index_key);
+    if (key == 6000) {
+      keys.push_back(index_key);
+      keys.push_back(index_key);
+    }
+  }
+  EXPECT_EQ(3336u, tree.GetValues(keys, rids, &found));
+  ASSERT_EQ(keys.size(), found.size());
+  size_t next = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    int64_t key = keys[i].ToString();
+    bool expected = key >= 0 && key < 20000 && key % 2 == 0;
+    EXPECT_EQ(expected, found[i]);
+    if (expected) {
+      EXPECT_EQ(key, rids[next++].GetSlotNum());
+    }
+  }
+  EXPECT_EQ(next, rids.size());
+
+  // the index sorts the keys first
+  auto index = new BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>(
+      metadata, bpm);
+  for (int64_t key = 0; key < 1000; key++)
+    index->InsertEntry(Tuple({Value(TypeId::BIGINT, key)}, schema),
+                       RID(0, key));
+  std::vector<Tuple> tuples;
+  for (int64_t key : {900, 5, 2000, 17, 400})
+    tuples.emplace_back(std::vector<Value>{Value(TypeId::BIGINT, key)},
+                        schema);
+  rids.clear();
+  index->ScanKeys(tuples, rids);
+  std::vector<int64_t> slots;
+  for (auto &rid : rids)
+    slots.push_back(rid.GetSlotNum());
+  EXPECT_EQ(std::vector<int64_t>({5, 17, 400, 900}), slots);
+
+  delete index;
+  delete schema;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeTests, GetValuesInterleavedTest) {
+  Schema *schema = ParseCreateStatement("a bigint");
+  // the tree does not fit, descents miss and read ahead
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+  GenericComparator<8> comparator(schema);
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  std::vector<GenericKey<8>> keys;
+  std::vector<RID> rids;
+  std::vector<bool> found;
+  GenericKey<8> index_key;
+  index_key.SetFromInteger(1);
+  keys.push_back(index_key);
+  EXPECT_EQ(0u, tree.GetValuesInterleaved(keys, rids, &found));
+  EXPECT_FALSE(found[0]);
+
+  for (int64_t key = 0; key < 40000; key += 2) {
+    index_key.SetFromInteger(key);
+    tree.Insert(index_key, RID(0, key));
+  }
+  // keys in no order, some missing, some repeated
+  keys.clear();
+  std::mt19937 random(42);
+  for (int i = 0; i < 5000; i++) {
+    index_key.SetFromInteger(static_cast<int64_t>(random() % 41000) - 500);
+    keys.push_back(index_key);
+  }
+  size_t pins = BufferPoolManager::GetThreadPinCount();
+  for (size_t group : {1, 4, 16, 64}) {
+    rids.clear();
+    size_t count = tree.GetValuesInterleaved(keys, rids, &found, group);
+    ASSERT_EQ(keys.size(), found.size());
+    EXPECT_EQ(count, rids.size());
+    size_t next = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+      int64_t key = keys[i].ToString();
+      bool expected = key >= 0 && key < 40000 && key % 2 == 0;
+      EXPECT_EQ(expected, found[i]);
+      if (expected && next < rids.size()) {
+        EXPECT_EQ(key, rids[next++].GetSlotNum());
+      }
+    }
+    EXPECT_EQ(next, rids.size());
+    // no page is left pinned
+    EXPECT_EQ(pins, BufferPoolManager::GetThreadPinCount());
+  }
+
+  delete schema;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeTests, BufferedTest) {
+  Schema *schema = ParseCreateStatement("a bigint");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+  GenericComparator<8> comparator(schema);
+  {
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                             comparator);
+    tree.SetBufferSize(64);
+    GenericKey<8> index_key;
+    std::vector<RID> rids;
+    for (int64_t key = 0; key < 40; key++) {
+      index_key.SetFromInteger(key);
+      EXPECT_TRUE(tree.Insert(index_key, RID(0, key)));
+    }
+    EXPECT_EQ(0u, tree.GetBufferFlushCount());
+    EXPECT_FALSE(tree.IsEmpty());
+    // lookups read the messages
+    index_key.SetFromInteger(7);
+    EXPECT_FALSE(tree.Insert(index_key, RID(1, 7)));
+    EXPECT_TRUE(tree.GetValue(index_key, rids));
+    EXPECT_EQ(7, rids[0].GetSlotNum());
+    tree.Remove(index_key);
+    rids.clear();
+    EXPECT_FALSE(tree.GetValue(index_key, rids));
+    EXPECT_TRUE(tree.Insert(index_key, RID(2, 7)));
+    EXPECT_TRUE(tree.GetValue(index_key, rids));
+    EXPECT_EQ(2, rids[0].GetPageId());
+
+    // a duplicate of a key in the leaves is only found by the flush
+    tree.Flush();
+    EXPECT_EQ(1u, tree.GetBufferFlushCount());
+    index_key.SetFromInteger(8);
+    EXPECT_TRUE(tree.Insert(index_key, RID(3, 8)));
+    rids.clear();
+    EXPECT_TRUE(tree.GetValue(index_key, rids));
+    EXPECT_EQ(0, rids[0].GetPageId());
+    index_key.SetFromInteger(9);
+    tree.Remove(index_key);
+    index_key.SetFromInteger(100);
+    tree.Remove(index_key);
+
+    // scans flush first
+    std::vector<int64_t> keys;
+    for (auto iterator = tree.Begin(); !iterator.isEnd(); ++iterator)
+      keys.push_back((*iterator).second.GetSlotNum());
+    EXPECT_EQ(2u, tree.GetBufferFlushCount());
+    ASSERT_EQ(39u, keys.size());
+    EXPECT_EQ(10, keys[9]);
+    rids.clear();
+    index_key.SetFromInteger(8);
+    EXPECT_TRUE(tree.GetValue(index_key, rids));
+    EXPECT_EQ(0, rids[0].GetPageId());
+    index_key.SetFromInteger(7);
+    EXPECT_TRUE(tree.GetValue(index_key, rids));
+    EXPECT_EQ(2, rids[1].GetPageId());
+
+    // a full buffer flushes on its own
+    for (int64_t key = 1000; key < 1200; key++) {
+      index_key.SetFromInteger(key);
+      tree.Insert(index_key, RID(0, key));
+    }
+    EXPECT_EQ(5u, tree.GetBufferFlushCount());
+    EXPECT_EQ(239u, tree.GetEntryCount());
+    tree.SetBufferSize(0);
+    index_key.SetFromInteger(1199);
+    rids.clear();
+    EXPECT_TRUE(tree.GetValue(index_key, rids));
+  }
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+
+  // random inserts into a small pool: unbuffered each dirties a leaf that
+  // is soon evicted, buffered a leaf is written once per flush
+  std::vector<int64_t> keys;
+  for (int64_t key = 0; key < 20000; key++)
+    keys.push_back(key);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+  size_t writebacks[2];
+  for (int buffered = 0; buffered < 2; buffered++) {
+    bpm = new BufferPoolManager(32, "test.db");
+    header_page = bpm->NewPage(page_id);
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                             comparator);
+    if (buffered)
+      tree.SetBufferSize(BPLUSTREE_BUFFER_SIZE);
+    GenericKey<8> index_key;
+    for (int64_t key : keys) {
+      index_key.SetFromInteger(key);
+      tree.Insert(index_key, RID(0, key));
+    }
+    EXPECT_EQ(keys.size(), tree.GetEntryCount());
+    bpm->UnpinPage(HEADER_PAGE_ID, true);
+    bpm->FlushAllPages();
+    writebacks[buffered] = bpm->GetStats().writebacks_;
+    delete bpm;
+    remove("test.db");
+  }
+  EXPECT_LT(writebacks[1] * 10, writebacks[0]);
+  delete schema;
+}
+
+TEST(BPlusTreeTests, BloomFilterTest) {
+  BlockedBloomFilter filter(10000);
+  for (int64_t key = 0; key < 20000; key += 2)
+    filter.Add(BlockedBloomFilter::Hash(reinterpret_cast<const char *>(&key),
+                                        sizeof(key)));
+  size_t false_positives = 0;
+  for (int64_t key = 1; key < 20000; key += 2)
+    if (filter.MayContain(BlockedBloomFilter::Hash(
+            reinterpret_cast<const char *>(&key), sizeof(key))))
+      false_positives++;
+  // about 1% with 10 bits per key
+  EXPECT_GT(300u, false_positives);
+
+  Schema *schema = ParseCreateStatement("a bigint");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+  auto new_index = [&](page_id_t root_id, page_id_t bloom_page_id) {
+    IndexMetadata *metadata =
+        new IndexMetadata("foo_pk", "foo", schema, {0}, true,
+                          IndexType::BPLUSTREE, {}, false, false, true);
+    return new BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>(
+        metadata, bpm, root_id, bloom_page_id);
+  };
+  // misses of a three level tree read at most a page each for the false
+  // positives, hits are all found
+  auto check = [&](Index *index) {
+    std::vector<RID> rids;
+    bpm->ResetStats();
+    for (int64_t key = 1; key < 20000; key += 20)
+      index->ScanKey(Tuple({Value(TypeId::BIGINT, key)}, schema), rids);
+    EXPECT_TRUE(rids.empty());
+    EXPECT_GT(50u, bpm->GetStats().fetches_);
+    for (int64_t key = 0; key < 20000; key += 20)
+      index->ScanKey(Tuple({Value(TypeId::BIGINT, key)}, schema), rids);
+    EXPECT_EQ(1000u, rids.size());
+  };
+
+  // even keys 0 to 19998, the filter grows with them
+  auto index = new_index(INVALID_PAGE_ID, INVALID_PAGE_ID);
+  for (int64_t key = 0; key < 20000; key += 2)
+    index->InsertEntry(Tuple({Value(TypeId::BIGINT, key)}, schema),
+                       RID(0, key));
+  check(index);
+  page_id_t root_id;
+  EXPECT_TRUE(index->GetChangedRoot(root_id));
+  page_id_t bloom_page_id = index->WriteBloomFilter();
+  EXPECT_NE(INVALID_PAGE_ID, bloom_page_id);
+  delete index;
+
+  // read back, then rebuilt once the pages are no longer clean
+  for (int i = 0; i < 2; i++) {
+    index = new_index(root_id, bloom_page_id);
+    check(index);
+    delete index;
+  }
+  EXPECT_EQ(nullptr, BlockedBloomFilter::Read(bpm, bloom_page_id));
+
+  delete schema;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeTests, IntegerComparatorTest) {
+  // the integer comparators order keys like the generic one
+  Schema *key_schema =
+      ParseCreateStatement("a integer, b smallint, c bigint, d tinyint");
+  GenericComparator<16> generic_comparator(key_schema);
+  CompositeIntegerComparator<16> composite_comparator(key_schema);
+  EXPECT_TRUE(IsIntegerKey(key_schema));
+  std::vector<GenericKey<16>> keys;
+  for (int i = 0; i < 200; i++) {
+    int value = i * 7919 % 11 - 5;
+    Tuple tuple({Value(TypeId::INTEGER, value % 3),
+                 Value(TypeId::SMALLINT, static_cast<int16_t>(value * 100)),
+                 Value(TypeId::BIGINT, static_cast<int64_t>(value) << 40),
+                 Value(TypeId::TINYINT, static_cast<int8_t>(i % 5 - 2))},
+                key_schema);
+    GenericKey<16> index_key;
+    index_key.SetFromKey(tuple);
+    keys.push_back(index_key);
+  }
+  for (auto &lhs : keys)
+    for (auto &rhs : keys)
+      EXPECT_EQ(generic_comparator(lhs, rhs), composite_comparator(lhs, rhs));
+  delete key_schema;
+
+  key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  IntegerComparator<8, int64_t> integer_comparator(key_schema);
+  GenericKey<8> lhs, rhs;
+  for (int64_t i = -3; i <= 3; i++) {
+    for (int64_t j = -3; j <= 3; j++) {
+      lhs.SetFromInteger(i << 33);
+      rhs.SetFromInteger(j);
+      EXPECT_EQ(comparator(lhs, rhs), integer_comparator(lhs, rhs));
+    }
+  }
+
+  // a tree of negative and positive keys scans in order
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  BPlusTree<GenericKey<8>, RID, IntegerComparator<8, int64_t>> tree(
+      "foo_pk", bpm, integer_comparator);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+  for (int64_t key = 999; key >= -1000; key--) {
+    lhs.SetFromInteger(key);
+    EXPECT_TRUE(tree.Insert(lhs, RID(0, static_cast<int32_t>(key))));
+  }
+  int64_t current_key = -1000;
+  for (auto iterator = tree.Begin(); !iterator.isEnd(); ++iterator)
+    EXPECT_EQ(current_key++, (*iterator).first.ToString());
+  EXPECT_EQ(1000, current_key);
+  std::vector<RID> rids;
+  lhs.SetFromInteger(-7);
+  EXPECT_TRUE(tree.GetValue(lhs, rids));
+  ASSERT_EQ(1u, rids.size());
+  EXPECT_EQ(-7, rids[0].GetSlotNum());
+
+  delete key_schema;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeTests, KeySearchTest) {
+  int64_t keys[KEY_SEARCH_BLOCK];
+  for (int i = 0; i < KEY_SEARCH_BLOCK; i++)
+    keys[i] = (i - 8) * (static_cast<int64_t>(1) << 40);
+  keys[0] = INT64_MIN;
+  keys[KEY_SEARCH_BLOCK - 1] = INT64_MAX;
+  std::vector<int64_t> needles = {INT64_MIN, INT64_MAX, 0, -1, 1};
+  for (int i = 0; i < KEY_SEARCH_BLOCK; i++)
+    needles.push_back(keys[i]);
+  for (int count = 0; count <= KEY_SEARCH_BLOCK; count++) {
+    for (int64_t needle : needles) {
+      int less = 0, less_or_equal = 0;
+      for (int i = 0; i < count; i++) {
+        less += keys[i] < needle;
+        less_or_equal += keys[i] <= needle;
+      }
+      EXPECT_EQ(less, CountLess(keys, count, needle, false));
+      EXPECT_EQ(less_or_equal, CountLess(keys, count, needle, true));
+    }
+  }
+}
+
+TEST(BPlusTreeTests, DuplicateKeyTest) {
+  Schema *schema = ParseCreateStatement("a bigint");
+  IndexMetadata *metadata =
+      new IndexMetadata("foo_a", "foo", schema, {0}, false);
+  EXPECT_EQ(2, metadata->GetEntrySchema()->GetColumnCount());
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+  auto index = new BPlusTreeIndex<GenericKey<16>, RID, GenericComparator<16>>(
+      metadata, bpm);
+  Schema *key_schema = index->GetKeySchema();
+  auto make_tuple = [&](int64_t key) {
+    return Tuple({Value(TypeId::BIGINT, key)}, key_schema);
+  };
+
+  // ten keys with 300 entries each, the slot holds the key
+  for (int i = 0; i < 3000; i++)
+    index->InsertEntry(make_tuple(i % 10), RID(i / 10, i % 10));
+  std::vector<RID> rids;
+  index->ScanKey(make_tuple(3), rids);
+  ASSERT_EQ(300u, rids.size());
+  for (size_t i = 0; i < rids.size(); i++)
+    EXPECT_EQ(RID(i, 3), rids[i]);
+  rids.clear();
+  index->ScanKey(make_tuple(10), rids);
+  EXPECT_TRUE(rids.empty());
+
+  int64_t low = 3, high = 5;
+  EXPECT_EQ(900u,
+            ScanRange(index, key_schema, &low, true, &high, true).size());
+  EXPECT_EQ(300u,
+            ScanRange(index, key_schema, &low, false, &high, false).size());
+  EXPECT_EQ(1200u,
+            ScanRange(index, key_schema, nullptr, true, &low, true).size());
+
+  // only the entry of the rid goes
+  for (int page = 0; page < 300; page += 2)
+    index->DeleteEntry(make_tuple(3), RID(page, 3));
+  rids.clear();
+  index->ScanKey(make_tuple(3), rids);
+  ASSERT_EQ(150u, rids.size());
+  EXPECT_EQ(RID(1, 3), rids[0]);
+  rids.clear();
+  index->ScanKey(make_tuple(4), rids);
+  EXPECT_EQ(300u, rids.size());
+
+  delete index;
+  delete schema;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(BPlusTreeTests, OnlineBuildTest) {
+  Schema *schema = ParseCreateStatement("a bigint");
+  IndexMetadata *metadata =
+      new IndexMetadata("foo_pk", "foo", schema, {0}, true);
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+  auto index = new BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>(
+      metadata, bpm);
+  Schema *key_schema = index->GetKeySchema();
+  auto make_tuple = [&](int64_t key) {
+    return Tuple({Value(TypeId::BIGINT, key)}, key_schema);
+  };
+
+  // 4000 rows scanned by four workers, the last one saw 100 of them twice
+  std::vector<std::vector<std::pair<Tuple, RID>>> runs(4);
+  for (int64_t key = 0; key < 4000; key++)
+    runs[key % 4].emplace_back(make_tuple(key), RID(key, 0));
+  for (int64_t key = 0; key < 100; key++)
+    runs[3].emplace_back(make_tuple(key), RID(key, 0));
+
+  ASSERT_TRUE(index->BeginBuild());
+  EXPECT_TRUE(index->IsBuilding());
+  // writers go on while the runs are loaded: 2000 rows inserted, the even
+  // ones of the first 2000 deleted, and a delete of a rid the key does not
+  // have, as a rolled back duplicate insert makes
+  std::thread inserter([&] {
+    for (int64_t key = 4000; key < 6000; key++)
+      index->InsertEntry(make_tuple(key), RID(key, 0));
+  });
+  std::thread deleter([&] {
+    for (int64_t key = 0; key < 2000; key += 2)
+      index->DeleteEntry(make_tuple(key), RID(key, 0));
+    index->DeleteEntry(make_tuple(3001), RID(1, 1));
+  });
+  index->FinishBuild(runs);
+  inserter.join();
+  deleter.join();
+  EXPECT_FALSE(index->IsBuilding());
+
+  EXPECT_EQ(5000u, index->GetEntryCount());
+  for (int64_t key = 0; key < 6000; key++) {
+    std::vector<RID> rids;
+    index->ScanKey(make_tuple(key), rids);
+    if (key < 2000 && key % 2 == 0) {
+      EXPECT_TRUE(rids.empty()) << key;
+    } else {
+      ASSERT_EQ(1u, rids.size()) << key;
+      EXPECT_EQ(RID(key, 0), rids[0]);
+    }
+  }
+  // built once, the entries are in
+  EXPECT_FALSE(index->BeginBuild());
+
+  delete index;
+  delete schema;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
+
+/*
+ * Lookups of hot keys go through the hash once their leaves are hot, and
+ * stay right as the leaves split and merge under them. Lookups that keep
+ * missing turn it off until a thread made enough lookups without it
+ */
+TEST(BPlusTreeTests, AdaptiveHashTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+  GenericKey<8> index_key;
+  auto lookup = [&](int64_t key) -> int64_t {
+    std::vector<RID> rids;
+    index_key.SetFromInteger(key);
+    if (!tree.GetValue(index_key, rids))
+      return -1;
+    return rids[0].GetSlotNum();
+  };
+  for (int64_t key = 0; key < 5000; key += 2) {
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(tree.Insert(index_key, RID(0, key)));
+  }
+
+  for (int round = 0; round < 20; round++)
+    for (int64_t key = 1000; key < 1100; key += 2)
+      EXPECT_EQ(key, lookup(key));
+  AdaptiveHashStats stats = tree.GetAdaptiveHashStats();
+  EXPECT_TRUE(stats.enabled_);
+  EXPECT_GT(stats.entries_, 40u);
+  EXPECT_LE(stats.entries_, 50u);
+  EXPECT_GT(stats.hits_, 900u);
+
+  // the slots move as leaves split, then merge
+  for (int64_t key = 1; key < 5000; key += 2) {
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(tree.Insert(index_key, RID(0, key)));
+  }
+  for (int round = 0; round < 3; round++)
+    for (int64_t key = 1000; key < 1100; key++)
+      EXPECT_EQ(key, lookup(key));
+  for (int64_t key = 0; key < 5000; key++) {
+    if (key % 4 == 0)
+      continue;
+    index_key.SetFromInteger(key);
+    tree.Remove(index_key);
+  }
+  for (int round = 0; round < 3; round++)
+    for (int64_t key = 1000; key < 1100; key++)
+      EXPECT_EQ(key % 4 == 0 ? key : -1, lookup(key));
+
+  for (int64_t key = 5000; key < 5000 + 3 * AHI_WINDOW; key++)
+    EXPECT_EQ(-1, lookup(key));
+  stats = tree.GetAdaptiveHashStats();
+  EXPECT_FALSE(stats.enabled_);
+  EXPECT_EQ(1u, stats.disables_);
+  EXPECT_EQ(0u, stats.entries_);
+  for (int i = 0; i < AHI_RETRY_LOOKUPS; i++)
+    EXPECT_EQ(1000, lookup(1000));
+  EXPECT_TRUE(tree.GetAdaptiveHashStats().enabled_);
+
+  // not even tried again once turned off
+  tree.SetAdaptiveHashIndex(false);
+  for (int i = 0; i < AHI_RETRY_LOOKUPS; i++)
+    EXPECT_EQ(1000, lookup(1000));
+  EXPECT_FALSE(tree.GetAdaptiveHashStats().enabled_);
+
+  delete key_schema;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+}
 } // namespace cmudb
@@ -0,0 +1,173 @@
+/**
+ * hash_index_test.cpp
+ */
+
+#include <algorithm>
+#include <cstdio>
+
+#include "buffer/buffer_pool_manager.h"
+#include "index/extendible_hash_table.h"
+#include "index/hash_index.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+typedef ExtendibleHashTable<GenericKey<8>, RID, GenericComparator<8>>
+    DiskHashTable;
+
+TEST(HashIndexTest, SplitTest) {
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  page_id_t page_id;
+  bpm->NewPage(page_id);
+  DiskHashTable table("foo_pk", bpm, true);
+  EXPECT_TRUE(table.IsEmpty());
+
+  GenericKey<8> index_key;
+  RID rid;
+  // more entries than a bucket page holds many times over
+  int64_t count =
+      40 * HashBucketPage<GenericKey<8>, RID, GenericComparator<8>>::Capacity();
+  for (int64_t key = 0; key < count; key++) {
+    index_key.SetFromInteger(key);
+    rid.Set(0, static_cast<int32_t>(key));
+    EXPECT_TRUE(table.Insert(index_key, rid));
+  }
+  EXPECT_FALSE(table.IsEmpty());
+  EXPECT_GE(table.GetGlobalDepth(), 5);
+
+  // unique, a second entry of a key is refused
+  index_key.SetFromInteger(7);
+  rid.Set(1, 1);
+  EXPECT_FALSE(table.Insert(index_key, rid));
+
+  std::vector<RID> rids;
+  for (int64_t key = 0; key < count; key++) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.GetValue(index_key, rids));
+    EXPECT_EQ(1, rids.size());
+    EXPECT_EQ(key, rids[0].GetSlotNum());
+  }
+  index_key.SetFromInteger(count);
+  EXPECT_FALSE(table.GetValue(index_key, rids));
+
+  for (int64_t key = 0; key < count; key += 2) {
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.Remove(index_key));
+  }
+  index_key.SetFromInteger(0);
+  EXPECT_FALSE(table.Remove(index_key));
+
+  std::vector<std::pair<GenericKey<8>, RID>> items;
+  table.GetAll(items);
+  EXPECT_EQ(count / 2, items.size());
+  for (auto &item : items)
+    EXPECT_EQ(1, item.second.GetSlotNum() % 2);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(HashIndexTest, OverflowTest) {
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  page_id_t page_id;
+  bpm->NewPage(page_id);
+  DiskHashTable table("foo_b", bpm, false);
+
+  // entries of one key never split apart, they fill overflow pages
+  GenericKey<8> index_key;
+  index_key.SetFromInteger(42);
+  RID rid;
+  int count = 2000;
+  for (int i = 0; i < count; i++) {
+    rid.Set(0, i);
+    EXPECT_TRUE(table.Insert(index_key, rid));
+  }
+  rid.Set(0, 3);
+  EXPECT_FALSE(table.Insert(index_key, rid));
+  EXPECT_EQ(0, table.GetGlobalDepth());
+
+  std::vector<RID> rids;
+  EXPECT_TRUE(table.GetValue(index_key, rids));
+  EXPECT_EQ(count, rids.size());
+
+  // emptied overflow pages are unlinked
+  for (int i = 0; i < count - 1; i++) {
+    rid.Set(0, i);
+    EXPECT_TRUE(table.Remove(index_key, &rid));
+  }
+  EXPECT_FALSE(table.Remove(index_key, &rid));
+  rids.clear();
+  EXPECT_TRUE(table.GetValue(index_key, rids));
+  EXPECT_EQ(1, rids.size());
+  EXPECT_EQ(count - 1, rids[0].GetSlotNum());
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(HashIndexTest, ReopenTest) {
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  page_id_t page_id;
+  bpm->NewPage(page_id);
+  Schema *schema = ParseCreateStatement("a int, b varchar");
+  std::string sql = "foo_b b using hash";
+  IndexMetadata *metadata = ParseIndexStatement(sql, "foo", schema);
+  EXPECT_EQ(IndexType::HASH, metadata->GetType());
+  EXPECT_FALSE(metadata->IsUnique());
+  Index *index = ConstructIndex(metadata, bpm);
+
+  std::vector<std::pair<Tuple, RID>> entries;
+  for (int i = 0; i < 3000; i++) {
+    std::vector<Value> values;
+    values.emplace_back(TypeId::VARCHAR, "key" + std::to_string(i % 1000));
+    entries.emplace_back(Tuple(values, metadata->GetKeySchema()),
+                         RID(0, i));
+    index->InsertEntry(entries.back().first, entries.back().second);
+  }
+  index->DeleteEntry(entries[5].first, entries[5].second);
+  // the directory page id is taken for the catalog once
+  page_id_t directory_page_id;
+  EXPECT_TRUE(index->GetChangedRoot(directory_page_id));
+  EXPECT_FALSE(index->GetChangedRoot(directory_page_id));
+  delete index;
+
+  sql = "foo_b b using hash";
+  metadata = ParseIndexStatement(sql, "foo", schema);
+  index = ConstructIndex(metadata, bpm, directory_page_id);
+
+  std::vector<RID> rids;
+  index->ScanKey(entries[5].first, rids);
+  EXPECT_EQ(2, rids.size());
+  rids.clear();
+  index->ScanKey(entries[6].first, rids);
+  std::sort(rids.begin(), rids.end(), [](const RID &lhs, const RID &rhs) {
+    return lhs.GetSlotNum() < rhs.GetSlotNum();
+  });
+  EXPECT_EQ(3, rids.size());
+  EXPECT_EQ(1006, rids[1].GetSlotNum());
+
+  // a range goes through every entry
+  IndexScanIterator *iterator =
+      index->ScanRange(&entries[998].first, true, nullptr, false);
+  int found = 0;
+  for (; !iterator->isEnd(); iterator->Next())
+    found++;
+  delete iterator;
+  // key998 and key999
+  EXPECT_EQ(6, found);
+
+  delete index;
+  delete schema;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
+
+} // namespace cmudb
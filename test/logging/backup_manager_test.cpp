@@ -0,0 +1,181 @@
+/**
+ * backup_manager_test.cpp
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+
+#include "disk/disk_manager.h"
+#include "logging/backup_manager.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static void RemoveFiles(const std::string &prefix) {
+  for (const char *extension : {".db", ".meta", ".sum", ".chg", ".log",
+                                ".ckpt", ".spaces"})
+    remove((prefix + extension).c_str());
+}
+
+static void MakePage(char *data, page_id_t page_id, int version) {
+  memset(data, 0, PAGE_SIZE);
+  snprintf(data, PAGE_SIZE, "page %lld version %d",
+           static_cast<long long>(page_id), version);
+}
+
+// the page of the backup is that version of it
+static void ExpectPage(DiskManager &backup, page_id_t page_id, int version) {
+  char expected[PAGE_SIZE];
+  char data[PAGE_SIZE];
+  MakePage(expected, page_id, version);
+  ASSERT_TRUE(backup.ReadPage(page_id, data));
+  EXPECT_EQ(0, memcmp(expected, data, PAGE_SIZE)) << page_id;
+}
+
+TEST(BackupManagerTest, IncrementalTest) {
+  RemoveFiles("test");
+  RemoveFiles("test_index");
+  RemoveFiles("backup/test");
+  RemoveFiles("backup/test_index");
+  mkdir("backup", 0755);
+  char data[PAGE_SIZE];
+  page_id_t index_page_id = MakePageId(1, 0);
+  std::string log = "log before the log start|log after it";
+  std::string more_log = "|log of the last backup";
+  size_t log_start = log.find('|') + 1;
+  {
+    DiskManager disk_manager("test.db");
+    EXPECT_EQ(1, disk_manager.AddTablespace("test_index.db"));
+    for (page_id_t page_id = 0; page_id < 100; page_id++) {
+      MakePage(data, page_id, 0);
+      disk_manager.WritePage(page_id, data);
+    }
+    MakePage(data, index_page_id, 0);
+    disk_manager.WritePage(index_page_id, data);
+    disk_manager.WriteLog(log.data(), log.size());
+    disk_manager.SetLogStart(log_start);
+
+    // the first backup copies every page
+    BackupManager backup_manager(&disk_manager);
+    EXPECT_TRUE(backup_manager.Backup("backup"));
+    EXPECT_FALSE(backup_manager.GetStats().incremental_);
+    EXPECT_EQ(101u, backup_manager.GetStats().pages_);
+    EXPECT_EQ(log.size() - log_start, backup_manager.GetStats().log_bytes_);
+
+    // the next only those written since
+    for (page_id_t page_id : {5, 50, 5}) {
+      MakePage(data, page_id, 1);
+      disk_manager.WritePage(page_id, data);
+    }
+    EXPECT_TRUE(backup_manager.Backup("backup"));
+    EXPECT_TRUE(backup_manager.GetStats().incremental_);
+    EXPECT_EQ(2u, backup_manager.GetStats().pages_);
+    EXPECT_TRUE(backup_manager.Backup("backup"));
+    EXPECT_EQ(0u, backup_manager.GetStats().pages_);
+
+    // no log before a new start is dropped while the log is held
+    off_t held = disk_manager.HoldLog();
+    EXPECT_EQ(static_cast<off_t>(log_start), held);
+    disk_manager.SetLogStart(log.size());
+    disk_manager.ReleaseLog(held);
+    std::string held_log(log.size() - log_start, '\0');
+    disk_manager.ReadLog(&held_log[0], held_log.size(), log_start);
+    EXPECT_EQ(log.substr(log_start), held_log);
+  }
+  {
+    // the changed pages are known across restarts
+    DiskManager disk_manager("test.db");
+    MakePage(data, 7, 1);
+    disk_manager.WritePage(7, data);
+    MakePage(data, index_page_id, 1);
+    disk_manager.WritePage(index_page_id, data);
+    disk_manager.WriteLog(more_log.data(), more_log.size());
+    BackupManager backup_manager(&disk_manager);
+    EXPECT_TRUE(backup_manager.Backup("backup"));
+    EXPECT_EQ(2u, backup_manager.GetStats().pages_);
+    EXPECT_EQ(more_log.size(), backup_manager.GetStats().log_bytes_);
+  }
+  {
+    DiskManager backup("backup/test.db");
+    EXPECT_EQ("backup/test_index.db", backup.GetTablespaceFile(1));
+    for (page_id_t page_id = 0; page_id < 100; page_id++)
+      ExpectPage(backup, page_id, page_id == 5 || page_id == 7 ||
+                                          page_id == 50
+                                      ? 1
+                                      : 0);
+    ExpectPage(backup, index_page_id, 1);
+    // no page id of the database is handed out again
+    EXPECT_EQ(100, backup.AllocatePage());
+    // the log from the start of the last backup, moved to the front
+    EXPECT_EQ(0, backup.GetLogStart());
+    std::string backup_log(log.size(), '\0');
+    size_t size = backup.ReadLog(&backup_log[0], backup_log.size(), 0);
+    EXPECT_EQ(more_log, backup_log.substr(0, size));
+  }
+
+  RemoveFiles("test");
+  RemoveFiles("test_index");
+  RemoveFiles("backup/test");
+  RemoveFiles("backup/test_index");
+  rmdir("backup");
+}
+
+TEST(BackupManagerTest, FullTest) {
+  RemoveFiles("test");
+  RemoveFiles("backup/test");
+  char data[PAGE_SIZE];
+  {
+    // a database opened without a bitmap has every page marked
+    DiskManager disk_manager("test.db");
+    for (page_id_t page_id = 0; page_id < 10; page_id++) {
+      MakePage(data, page_id, 0);
+      disk_manager.WritePage(page_id, data);
+    }
+  }
+  remove("test.chg");
+  {
+    DiskManager disk_manager("test.db");
+    size_t count = 0;
+    EXPECT_TRUE(disk_manager.TakeChangedPages(
+        0, false, [](page_id_t, const char *) { return true; }, count));
+    EXPECT_EQ(10u, count);
+    EXPECT_TRUE(disk_manager.TakeChangedPages(
+        0, false, [](page_id_t, const char *) { return true; }, count));
+    EXPECT_EQ(0u, count);
+
+    // a copy that fails leaves the pages it did not take marked
+    MakePage(data, 3, 1);
+    disk_manager.WritePage(3, data);
+    MakePage(data, 4, 1);
+    disk_manager.WritePage(4, data);
+    EXPECT_FALSE(disk_manager.TakeChangedPages(
+        0, false, [](page_id_t, const char *) { return false; }, count));
+    EXPECT_EQ(0u, count);
+    EXPECT_TRUE(disk_manager.TakeChangedPages(
+        0, false, [](page_id_t, const char *) { return true; }, count));
+    EXPECT_EQ(2u, count);
+    EXPECT_FALSE(disk_manager.TakeChangedPages(
+        1, false, [](page_id_t, const char *) { return true; }, count));
+
+    // a backup that is not incremental copies every page
+    BackupManager backup_manager(&disk_manager);
+    EXPECT_TRUE(backup_manager.Backup("backup", false));
+    EXPECT_EQ(10u, backup_manager.GetStats().pages_);
+    EXPECT_TRUE(backup_manager.Backup("backup", false));
+    EXPECT_EQ(10u, backup_manager.GetStats().pages_);
+    EXPECT_FALSE(backup_manager.GetStats().incremental_);
+  }
+  {
+    DiskManager backup("backup/test.db");
+    ExpectPage(backup, 3, 1);
+    ExpectPage(backup, 9, 0);
+  }
+
+  RemoveFiles("test");
+  RemoveFiles("backup/test");
+  rmdir("backup");
+}
+
+} // namespace cmudb
@@ -0,0 +1,212 @@
+/**
+ * checkpoint_manager_test.cpp
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "catalog/schema.h"
+#include "logging/checkpoint_manager.h"
+#include "logging/log_recovery.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static void RemoveFiles() {
+  remove("test.db");
+  remove("test.log");
+  remove("test.ckpt");
+}
+
+static Tuple MakeTuple(int32_t value, Schema *schema) {
+  std::vector<Value> values;
+  values.emplace_back(TypeId::INTEGER, value);
+  return Tuple(values, schema);
+}
+
+static int32_t ReadValue(TablePage *page, const RID &rid, Schema *schema) {
+  Tuple tuple;
+  if (!page->GetTuple(rid, tuple, nullptr, nullptr))
+    return -1;
+  return tuple.GetValue(schema, 0).GetAs<int32_t>();
+}
+
+// last END_CHECKPOINT record in the log
+static bool ReadCheckpoint(DiskManager *disk_manager, LogRecord &checkpoint) {
+  off_t log_start = disk_manager->GetLogStart();
+  size_t log_size = disk_manager->GetLogFileSize() - log_start;
+  std::vector<char> buffer(log_size);
+  log_size = disk_manager->ReadLog(buffer.data(), log_size, log_start);
+  bool found = false;
+  LogRecord log_record;
+  for (size_t offset = 0;
+       offset < log_size && log_record.DeserializeFrom(buffer.data() + offset,
+                                                       log_size - offset);
+       offset += log_record.GetSize()) {
+    if (log_record.GetLogRecordType() == LogRecordType::END_CHECKPOINT) {
+      checkpoint = log_record;
+      found = true;
+    }
+  }
+  return found;
+}
+
+TEST(CheckpointManagerTest, SerializeTest) {
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages = {{3, 10}, {7, 12}};
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns = {{1, 15}};
+  LogRecord end_record(9, dirty_pages, active_txns);
+  std::vector<char> buffer(end_record.GetSize());
+  end_record.SerializeTo(buffer.data());
+
+  LogRecord log_record;
+  EXPECT_FALSE(log_record.DeserializeFrom(buffer.data(), buffer.size() - 1));
+  EXPECT_TRUE(log_record.DeserializeFrom(buffer.data(), buffer.size()));
+  EXPECT_EQ(LogRecordType::END_CHECKPOINT, log_record.GetLogRecordType());
+  EXPECT_EQ(9, log_record.GetBeginLSN());
+  EXPECT_EQ(dirty_pages, log_record.GetDirtyPages());
+  EXPECT_EQ(active_txns, log_record.GetActiveTxns());
+}
+
+TEST(CheckpointManagerTest, TruncateTest) {
+  RemoveFiles();
+  std::vector<Column> columns;
+  columns.emplace_back(TypeId::INTEGER, 4, "a");
+  Schema schema(columns);
+  const int num_pages = 4;
+  const int tuples_per_page = 10;
+  std::vector<page_id_t> page_ids;
+  off_t log_start;
+
+  {
+    auto bpm = new BufferPoolManager(50, "test.db");
+    auto log_manager = new LogManager(bpm->GetDiskManager());
+    log_manager->RunFlushThread();
+    bpm->SetLogManager(log_manager);
+    TransactionManager txn_manager(nullptr, log_manager);
+    CheckpointManager checkpoint_manager(&txn_manager, bpm, log_manager);
+
+    Transaction *txn1 = txn_manager.Begin();
+    RID rid;
+    for (int i = 0; i < num_pages; ++i) {
+      page_id_t page_id;
+      auto page = static_cast<TablePage *>(bpm->NewPage(page_id));
+      ASSERT_NE(nullptr, page);
+      page->WLatch();
+      page->Init(page_id, PAGE_SIZE, INVALID_PAGE_ID, INVALID_PAGE_ID,
+                 log_manager, txn1);
+      for (int j = 0; j < tuples_per_page; ++j) {
+        EXPECT_TRUE(page->InsertTuple(MakeTuple(i * tuples_per_page + j,
+                                                &schema),
+                                      rid, txn1, nullptr, log_manager));
+      }
+      page->WUnlatch();
+      bpm->UnpinPage(page_id, true);
+      page_ids.push_back(page_id);
+    }
+
+    // the dirty pages and the running transaction hold the whole log
+    EXPECT_NE(INVALID_LSN, checkpoint_manager.Checkpoint());
+    LogRecord checkpoint;
+    ASSERT_TRUE(ReadCheckpoint(bpm->GetDiskManager(), checkpoint));
+    EXPECT_EQ(static_cast<size_t>(num_pages),
+              checkpoint.GetDirtyPages().size());
+    ASSERT_EQ(1u, checkpoint.GetActiveTxns().size());
+    EXPECT_EQ(txn1->GetTransactionId(),
+              checkpoint.GetActiveTxns()[0].first);
+    EXPECT_EQ(0, bpm->GetDiskManager()->GetLogStart());
+    txn_manager.Commit(txn1);
+
+    // once pages are written and nothing runs the log can go
+    bpm->FlushAllPages();
+    checkpoint_manager.Checkpoint();
+    log_start = bpm->GetDiskManager()->GetLogStart();
+    EXPECT_GT(log_start, 0);
+    ASSERT_TRUE(ReadCheckpoint(bpm->GetDiskManager(), checkpoint));
+    EXPECT_TRUE(checkpoint.GetDirtyPages().empty());
+    EXPECT_TRUE(checkpoint.GetActiveTxns().empty());
+
+    // a loser after the checkpoint
+    Transaction *txn2 = txn_manager.Begin();
+    auto page = static_cast<TablePage *>(bpm->FetchPage(page_ids[1]));
+    page->WLatch();
+    EXPECT_TRUE(page->InsertTuple(MakeTuple(999, &schema), rid, txn2, nullptr,
+                                  log_manager));
+    page->WUnlatch();
+    bpm->UnpinPage(page_ids[1], true);
+    log_manager->WaitUntilDurable(txn2->GetPrevLSN());
+
+    // crash: the buffer pool is abandoned without writing its pages
+    log_manager->StopFlushThread();
+    delete txn1;
+    delete txn2;
+  }
+
+  {
+    BufferPoolManager bpm(50, "test.db");
+    LogManager log_manager(bpm.GetDiskManager());
+    bpm.SetLogManager(&log_manager);
+    EXPECT_EQ(log_start, bpm.GetDiskManager()->GetLogStart());
+    LogRecovery log_recovery(&bpm, 2);
+    log_recovery.Recover(&log_manager);
+    const RecoveryStats &stats = log_recovery.GetStats();
+    // the checkpoint, BEGIN and the insert of the loser, maybe a few more of
+    // the same log flush
+    EXPECT_GE(stats.log_records_, 4u);
+    EXPECT_LT(stats.log_records_,
+              static_cast<size_t>(num_pages * tuples_per_page));
+    // only the page of the loser changed after the checkpoint
+    EXPECT_EQ(1u, stats.redo_pages_);
+    EXPECT_EQ(1u, stats.loser_txns_);
+    EXPECT_EQ(2, log_recovery.GetNextTxnId());
+
+    for (int i = 0; i < num_pages; ++i) {
+      auto page = static_cast<TablePage *>(bpm.FetchPage(page_ids[i]));
+      ASSERT_NE(nullptr, page);
+      for (int j = 0; j < tuples_per_page; ++j)
+        EXPECT_EQ(i * tuples_per_page + j,
+                  ReadValue(page, RID(page_ids[i], j), &schema));
+      EXPECT_EQ(-1, ReadValue(page, RID(page_ids[i], tuples_per_page),
+                              &schema));
+      bpm.UnpinPage(page_ids[i], false);
+    }
+    log_manager.StopFlushThread();
+    bpm.SetLogManager(nullptr);
+  }
+
+  RemoveFiles();
+}
+
+TEST(CheckpointManagerTest, LogBytesTriggerTest) {
+  RemoveFiles();
+  BufferPoolManager bpm(10, "test.db");
+  LogManager log_manager(bpm.GetDiskManager());
+  log_manager.RunFlushThread();
+  bpm.SetLogManager(&log_manager);
+  TransactionManager txn_manager(nullptr, &log_manager);
+  CheckpointManager checkpoint_manager(&txn_manager, &bpm, &log_manager);
+  CheckpointConfig config;
+  config.interval_ = std::chrono::milliseconds(0);
+  config.log_bytes_ = 50 * LogRecord::HEADER_SIZE;
+  checkpoint_manager.StartCheckpointThread(config);
+
+  // committed transactions without pages leave nothing to keep
+  for (int i = 0; i < 1000 && checkpoint_manager.GetCheckpointCount() < 2;
+       ++i) {
+    Transaction *txn = txn_manager.Begin();
+    txn_manager.Commit(txn);
+    delete txn;
+    if (i % 50 == 0)
+      std::this_thread::sleep_for(CHECKPOINT_POLL_INTERVAL);
+  }
+  checkpoint_manager.StopCheckpointThread();
+  EXPECT_GE(checkpoint_manager.GetCheckpointCount(), 2u);
+  EXPECT_GT(bpm.GetDiskManager()->GetLogStart(), 0);
+
+  bpm.SetLogManager(nullptr);
+  log_manager.StopFlushThread();
+  RemoveFiles();
+}
+
+} // namespace cmudb
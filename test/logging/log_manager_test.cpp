@@ -0,0 +1,160 @@
+/**
+ * log_manager_test.cpp
+ */
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "catalog/schema.h"
+#include "logging/log_manager.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(LogManagerTest, SerializeTest) {
+  remove("test.db");
+  remove("test.log");
+  std::vector<Column> columns;
+  columns.emplace_back(TypeId::INTEGER, 4, "a");
+  columns.emplace_back(TypeId::VARCHAR, 16, "b");
+  Schema schema(columns);
+  std::vector<Value> values;
+  values.emplace_back(TypeId::INTEGER, (int32_t)42);
+  values.emplace_back(TypeId::VARCHAR, "log record", 11, true);
+  Tuple tuple(values, &schema);
+  values[0] = Value(TypeId::INTEGER, (int32_t)43);
+  Tuple new_tuple(values, &schema);
+
+  DiskManager disk_manager("test.db");
+  LogManager log_manager(&disk_manager);
+  log_manager.RunFlushThread();
+  LogRecord begin_record(0, INVALID_LSN, LogRecordType::BEGIN);
+  lsn_t begin_lsn = log_manager.AppendLogRecord(begin_record);
+  LogRecord insert_record(0, begin_lsn, LogRecordType::INSERT, RID(1, 2),
+                          tuple);
+  lsn_t insert_lsn = log_manager.AppendLogRecord(insert_record);
+  LogRecord update_record(0, insert_lsn, LogRecordType::UPDATE, RID(1, 2),
+                          tuple, new_tuple);
+  lsn_t update_lsn = log_manager.AppendLogRecord(update_record);
+  LogRecord new_page_record(0, update_lsn, LogRecordType::NEWPAGE, 1, 2);
+  lsn_t new_page_lsn = log_manager.AppendLogRecord(new_page_record);
+  EXPECT_EQ(begin_lsn + 1, insert_lsn);
+  EXPECT_EQ(new_page_lsn, update_lsn + 1);
+  log_manager.WaitUntilDurable(new_page_lsn);
+  EXPECT_GE(log_manager.GetPersistentLSN(), new_page_lsn);
+  log_manager.StopFlushThread();
+
+  // read the records back in order
+  size_t log_size = disk_manager.GetLogFileSize();
+  EXPECT_EQ(static_cast<size_t>(begin_record.GetSize() +
+                                insert_record.GetSize() +
+                                update_record.GetSize() +
+                                new_page_record.GetSize()),
+            log_size);
+  std::vector<char> buffer(log_size);
+  EXPECT_EQ(log_size, disk_manager.ReadLog(buffer.data(), log_size, 0));
+  LogRecord record;
+  int32_t offset = 0;
+  EXPECT_TRUE(record.DeserializeFrom(buffer.data() + offset, log_size));
+  EXPECT_EQ(LogRecordType::BEGIN, record.GetLogRecordType());
+  EXPECT_EQ(begin_lsn, record.GetLSN());
+  offset += record.GetSize();
+
+  EXPECT_TRUE(
+      record.DeserializeFrom(buffer.data() + offset, log_size - offset));
+  EXPECT_EQ(LogRecordType::INSERT, record.GetLogRecordType());
+  EXPECT_EQ(begin_lsn, record.GetPrevLSN());
+  EXPECT_EQ(RID(1, 2), record.GetRID());
+  EXPECT_EQ(42, record.GetTuple().GetValue(&schema, 0).GetAs<int32_t>());
+  offset += record.GetSize();
+
+  EXPECT_TRUE(
+      record.DeserializeFrom(buffer.data() + offset, log_size - offset));
+  EXPECT_EQ(LogRecordType::UPDATE, record.GetLogRecordType());
+  EXPECT_EQ(42, record.GetTuple().GetValue(&schema, 0).GetAs<int32_t>());
+  EXPECT_EQ(43, record.GetNewTuple().GetValue(&schema, 0).GetAs<int32_t>());
+  offset += record.GetSize();
+
+  // a torn record is rejected
+  EXPECT_FALSE(
+      record.DeserializeFrom(buffer.data() + offset, log_size - offset - 1));
+  EXPECT_TRUE(
+      record.DeserializeFrom(buffer.data() + offset, log_size - offset));
+  EXPECT_EQ(LogRecordType::NEWPAGE, record.GetLogRecordType());
+  EXPECT_EQ(1, record.GetPrevPageId());
+  EXPECT_EQ(2, record.GetPageId());
+
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(LogManagerTest, GroupCommitTest) {
+  remove("test.db");
+  remove("test.log");
+  const int num_threads = 8;
+  const int num_commits = 50;
+  DiskManager disk_manager("test.db");
+  LogManager log_manager(&disk_manager);
+  log_manager.RunFlushThread();
+
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; ++tid) {
+    threads.push_back(std::thread([tid, &log_manager]() {
+      lsn_t prev_lsn = INVALID_LSN;
+      for (int i = 0; i < num_commits; ++i) {
+        LogRecord commit_record(tid, prev_lsn, LogRecordType::COMMIT);
+        prev_lsn = log_manager.AppendLogRecord(commit_record);
+        log_manager.WaitUntilDurable(prev_lsn);
+        EXPECT_GE(log_manager.GetPersistentLSN(), prev_lsn);
+      }
+    }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  // committers waiting together share a flush
+  EXPECT_EQ(num_threads * num_commits, log_manager.GetNextLSN());
+  EXPECT_LT(log_manager.GetFlushCount(),
+            static_cast<size_t>(num_threads * num_commits));
+  log_manager.StopFlushThread();
+  EXPECT_EQ(num_threads * num_commits * LogRecord::HEADER_SIZE,
+            disk_manager.GetLogFileSize());
+
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(LogManagerTest, WriteAheadTest) {
+  remove("test.db");
+  remove("test.log");
+  BufferPoolManager bpm(2, "test.db");
+  LogManager log_manager(bpm.GetDiskManager());
+  log_manager.RunFlushThread();
+  bpm.SetLogManager(&log_manager);
+
+  page_id_t page_id;
+  Page *page = bpm.NewPage(page_id);
+  ASSERT_NE(nullptr, page);
+  LogRecord log_record(0, INVALID_LSN, LogRecordType::NEWPAGE, INVALID_PAGE_ID,
+                       page_id);
+  lsn_t lsn = log_manager.AppendLogRecord(log_record);
+  page->SetLSN(lsn);
+  bpm.UnpinPage(page_id, true);
+
+  // evicting the dirty page forces its log record out first
+  page_id_t other_page_id;
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_NE(nullptr, bpm.NewPage(other_page_id));
+    bpm.UnpinPage(other_page_id, false);
+  }
+  EXPECT_GE(log_manager.GetPersistentLSN(), lsn);
+
+  bpm.SetLogManager(nullptr);
+  log_manager.StopFlushThread();
+  remove("test.db");
+  remove("test.log");
+}
+
+} // namespace cmudb
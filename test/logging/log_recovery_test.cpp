@@ -0,0 +1,259 @@
+/**
+ * log_recovery_test.cpp
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "catalog/schema.h"
+#include "concurrency/transaction_manager.h"
+#include "logging/log_recovery.h"
+#include "table/table_heap.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static Tuple MakeTuple(int32_t value, Schema *schema) {
+  std::vector<Value> values;
+  values.emplace_back(TypeId::INTEGER, value);
+  return Tuple(values, schema);
+}
+
+static int32_t ReadValue(TablePage *page, const RID &rid, Schema *schema) {
+  Tuple tuple;
+  if (!page->GetTuple(rid, tuple, nullptr, nullptr))
+    return -1;
+  return tuple.GetValue(schema, 0).GetAs<int32_t>();
+}
+
+TEST(LogRecoveryTest, RedoUndoTest) {
+  remove("test.db");
+  remove("test.log");
+  std::vector<Column> columns;
+  columns.emplace_back(TypeId::INTEGER, 4, "a");
+  Schema schema(columns);
+  const int num_pages = 8;
+  const int tuples_per_page = 10;
+  std::vector<page_id_t> page_ids;
+
+  {
+    auto bpm = new BufferPoolManager(50, "test.db");
+    auto log_manager = new LogManager(bpm->GetDiskManager());
+    log_manager->RunFlushThread();
+    bpm->SetLogManager(log_manager);
+    TransactionManager txn_manager(nullptr, log_manager);
+
+    // a committed transaction fills a chain of pages
+    Transaction *txn1 = txn_manager.Begin();
+    RID rid;
+    for (int i = 0; i < num_pages; ++i) {
+      page_id_t page_id;
+      auto page = static_cast<TablePage *>(bpm->NewPage(page_id));
+      ASSERT_NE(nullptr, page);
+      page_id_t prev_page_id = page_ids.empty() ? INVALID_PAGE_ID
+                                                : page_ids.back();
+      page->WLatch();
+      page->Init(page_id, PAGE_SIZE, prev_page_id, INVALID_PAGE_ID,
+                 log_manager, txn1);
+      for (int j = 0; j < tuples_per_page; ++j) {
+        EXPECT_TRUE(page->InsertTuple(MakeTuple(i * tuples_per_page + j,
+                                                &schema),
+                                      rid, txn1, nullptr, log_manager));
+      }
+      page->WUnlatch();
+      bpm->UnpinPage(page_id, true);
+      if (prev_page_id != INVALID_PAGE_ID) {
+        auto prev_page = static_cast<TablePage *>(bpm->FetchPage(prev_page_id));
+        prev_page->SetNextPageId(page_id);
+        bpm->UnpinPage(prev_page_id, true);
+      }
+      page_ids.push_back(page_id);
+    }
+    // one page reaches disk, redo has to skip its records
+    EXPECT_TRUE(bpm->FlushPage(page_ids[0]));
+    txn_manager.Commit(txn1);
+
+    // a loser inserts, deletes and updates
+    Transaction *txn2 = txn_manager.Begin();
+    auto page = static_cast<TablePage *>(bpm->FetchPage(page_ids[1]));
+    EXPECT_TRUE(page->InsertTuple(MakeTuple(999, &schema), rid, txn2, nullptr,
+                                  log_manager));
+    bpm->UnpinPage(page_ids[1], true);
+    page = static_cast<TablePage *>(bpm->FetchPage(page_ids[2]));
+    EXPECT_TRUE(
+        page->MarkDelete(RID(page_ids[2], 0), txn2, nullptr, log_manager));
+    bpm->UnpinPage(page_ids[2], true);
+    page = static_cast<TablePage *>(bpm->FetchPage(page_ids[3]));
+    Tuple old_tuple;
+    EXPECT_TRUE(page->UpdateTuple(MakeTuple(555, &schema), old_tuple,
+                                  RID(page_ids[3], 0), txn2, nullptr,
+                                  log_manager));
+    bpm->UnpinPage(page_ids[3], true);
+    log_manager->WaitUntilDurable(txn2->GetPrevLSN());
+
+    // crash: the buffer pool is abandoned without writing its pages
+    log_manager->StopFlushThread();
+    delete txn1;
+    delete txn2;
+  }
+
+  {
+    BufferPoolManager bpm(50, "test.db");
+    LogManager log_manager(bpm.GetDiskManager());
+    bpm.SetLogManager(&log_manager);
+    LogRecovery log_recovery(&bpm, 4);
+    log_recovery.Recover(&log_manager);
+    const RecoveryStats &stats = log_recovery.GetStats();
+    EXPECT_EQ(1u, stats.loser_txns_);
+    EXPECT_EQ(3u, stats.undo_records_);
+    // the flushed page is up to date
+    EXPECT_EQ(static_cast<size_t>(num_pages - 1), stats.redo_pages_);
+    EXPECT_EQ(2, log_recovery.GetNextTxnId());
+
+    for (int i = 0; i < num_pages; ++i) {
+      auto page = static_cast<TablePage *>(bpm.FetchPage(page_ids[i]));
+      ASSERT_NE(nullptr, page);
+      EXPECT_EQ(i + 1 < num_pages ? page_ids[i + 1] : INVALID_PAGE_ID,
+                page->GetNextPageId());
+      for (int j = 0; j < tuples_per_page; ++j)
+        EXPECT_EQ(i * tuples_per_page + j,
+                  ReadValue(page, RID(page_ids[i], j), &schema));
+      // the insert of the loser is gone
+      EXPECT_EQ(-1, ReadValue(page, RID(page_ids[i], tuples_per_page),
+                              &schema));
+      bpm.UnpinPage(page_ids[i], false);
+    }
+    log_manager.StopFlushThread();
+    bpm.SetLogManager(nullptr);
+  }
+
+  // the rollback was logged, nothing is left to do after a clean shutdown
+  {
+    BufferPoolManager bpm(50, "test.db");
+    LogManager log_manager(bpm.GetDiskManager());
+    bpm.SetLogManager(&log_manager);
+    LogRecovery log_recovery(&bpm, 4);
+    log_recovery.Recover(&log_manager);
+    EXPECT_EQ(0u, log_recovery.GetStats().loser_txns_);
+    EXPECT_EQ(0u, log_recovery.GetStats().redo_records_);
+    log_manager.StopFlushThread();
+    bpm.SetLogManager(nullptr);
+  }
+
+  remove("test.db");
+  remove("test.log");
+}
+
+// PAX pages come back with their layout from the NEWPAGE records
+TEST(LogRecoveryTest, PaxRedoTest) {
+  remove("test.db");
+  remove("test.log");
+  std::vector<Column> columns;
+  columns.emplace_back(TypeId::INTEGER, 4, "a");
+  Schema schema(columns);
+  PaxLayout layout(&schema);
+  page_id_t page_id;
+
+  {
+    auto bpm = new BufferPoolManager(50, "test.db");
+    auto log_manager = new LogManager(bpm->GetDiskManager());
+    log_manager->RunFlushThread();
+    bpm->SetLogManager(log_manager);
+    TransactionManager txn_manager(nullptr, log_manager);
+    Transaction *txn = txn_manager.Begin();
+    auto page = static_cast<TablePage *>(bpm->NewPage(page_id));
+    ASSERT_NE(nullptr, page);
+    page->Init(page_id, PAGE_SIZE, INVALID_PAGE_ID, INVALID_PAGE_ID,
+               log_manager, txn, layout);
+    RID rid;
+    for (int i = 0; i < 20; ++i)
+      EXPECT_TRUE(page->InsertTuple(MakeTuple(i, &schema), rid, txn, nullptr,
+                                    log_manager));
+    Tuple old_tuple;
+    EXPECT_TRUE(page->UpdateTuple(MakeTuple(100, &schema), old_tuple,
+                                  RID(page_id, 3), txn, nullptr,
+                                  log_manager));
+    bpm->UnpinPage(page_id, true);
+    txn_manager.Commit(txn);
+    // crash before the page is written
+    log_manager->StopFlushThread();
+    delete txn;
+  }
+
+  BufferPoolManager bpm(50, "test.db");
+  LogManager log_manager(bpm.GetDiskManager());
+  bpm.SetLogManager(&log_manager);
+  LogRecovery log_recovery(&bpm, 1);
+  log_recovery.Recover(&log_manager);
+  auto page = static_cast<TablePage *>(bpm.FetchPage(page_id));
+  ASSERT_NE(nullptr, page);
+  EXPECT_TRUE(page->IsPax());
+  PaxLayout read;
+  page->GetPaxLayout(read);
+  EXPECT_EQ(layout.capacity_, read.capacity_);
+  for (int i = 0; i < 20; ++i)
+    EXPECT_EQ(i == 3 ? 100 : i, ReadValue(page, RID(page_id, i), &schema));
+  bpm.UnpinPage(page_id, false);
+  log_manager.StopFlushThread();
+  bpm.SetLogManager(nullptr);
+
+  remove("test.db");
+  remove("test.log");
+}
+
+// a value out of line comes back from the OVERFLOWPAGE records
+TEST(LogRecoveryTest, OverflowRedoTest) {
+  remove("test.db");
+  remove("test.log");
+  std::vector<Column> columns;
+  columns.emplace_back(TypeId::INTEGER, 4, "a");
+  columns.emplace_back(TypeId::VARCHAR, 8, "b");
+  Schema schema(columns);
+  std::string value(2 * PAGE_SIZE + 100, 'x');
+  page_id_t first_page_id;
+  RID rid;
+
+  {
+    auto bpm = new BufferPoolManager(50, "test.db");
+    auto log_manager = new LogManager(bpm->GetDiskManager());
+    log_manager->RunFlushThread();
+    bpm->SetLogManager(log_manager);
+    LockManager lock_manager(true);
+    TransactionManager txn_manager(&lock_manager, log_manager);
+    auto table = new TableHeap(bpm, &lock_manager, log_manager);
+    table->EnableOverflow(&schema);
+    first_page_id = table->GetFirstPageId();
+    // the first page is not logged
+    EXPECT_TRUE(bpm->FlushPage(first_page_id));
+    Transaction *txn = txn_manager.Begin();
+    std::vector<Value> values{Value(TypeId::INTEGER, 7),
+                              Value(TypeId::VARCHAR, value)};
+    EXPECT_TRUE(table->InsertTuple(Tuple(values, &schema), rid, txn));
+    txn_manager.Commit(txn);
+    // crash before any page is written
+    log_manager->StopFlushThread();
+    delete txn;
+  }
+
+  BufferPoolManager bpm(50, "test.db");
+  LogManager log_manager(bpm.GetDiskManager());
+  bpm.SetLogManager(&log_manager);
+  LogRecovery log_recovery(&bpm, 2);
+  log_recovery.Recover(&log_manager);
+  EXPECT_EQ(4u, log_recovery.GetStats().redo_records_);
+  {
+    TableHeap table(&bpm, nullptr, nullptr, first_page_id);
+    table.EnableOverflow(&schema);
+    Tuple tuple;
+    EXPECT_TRUE(table.GetTuple(rid, tuple, nullptr));
+    EXPECT_EQ(7, tuple.GetValue(&schema, 0).GetAs<int32_t>());
+    EXPECT_TRUE(value == tuple.GetValue(&schema, 1).ToString());
+  }
+  log_manager.StopFlushThread();
+  bpm.SetLogManager(nullptr);
+
+  remove("test.db");
+  remove("test.log");
+}
+
+} // namespace cmudb
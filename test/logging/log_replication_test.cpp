@@ -0,0 +1,142 @@
+/**
+ * log_replication_test.cpp
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+#include "catalog/schema.h"
+#include "concurrency/transaction_manager.h"
+#include "logging/backup_manager.h"
+#include "logging/log_replication.h"
+#include "page/table_page.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static void RemoveFiles(const std::string &prefix) {
+  for (const char *extension : {".db", ".meta", ".sum", ".chg", ".log",
+                                ".ckpt", ".spaces"})
+    remove((prefix + extension).c_str());
+}
+
+static Tuple MakeTuple(int32_t value, Schema *schema) {
+  std::vector<Value> values;
+  values.emplace_back(TypeId::INTEGER, value);
+  return Tuple(values, schema);
+}
+
+// value of the tuple in slot of the page on the replica, -1 if none
+static int32_t ReadReplica(LogReplica &replica, BufferPoolManager &bpm,
+                           page_id_t page_id, int slot, Schema *schema) {
+  replica.GetLatch().RLock();
+  auto page = static_cast<TablePage *>(bpm.FetchPage(page_id));
+  int32_t value = -1;
+  Tuple tuple;
+  if (page != nullptr) {
+    if (page->GetTuple(RID(page_id, slot), tuple, nullptr, nullptr))
+      value = tuple.GetValue(schema, 0).GetAs<int32_t>();
+    bpm.UnpinPage(page_id, false);
+  }
+  replica.GetLatch().RUnlock();
+  return value;
+}
+
+// wait for what the replica shows to be true, false after some seconds
+template <typename Condition> static bool WaitFor(Condition condition) {
+  for (int i = 0; i < 1000; i++) {
+    if (condition())
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return false;
+}
+
+TEST(LogReplicationTest, ReplicaTest) {
+  RemoveFiles("test");
+  RemoveFiles("backup/test");
+  std::vector<Column> columns;
+  columns.emplace_back(TypeId::INTEGER, 4, "a");
+  Schema schema(columns);
+
+  BufferPoolManager bpm(50, "test.db");
+  LogManager log_manager(bpm.GetDiskManager());
+  log_manager.RunFlushThread();
+  bpm.SetLogManager(&log_manager);
+  TransactionManager txn_manager(nullptr, &log_manager);
+
+  // the replica starts from a backup with a page of ten tuples
+  Transaction *txn = txn_manager.Begin();
+  page_id_t page_id;
+  auto page = static_cast<TablePage *>(bpm.NewPage(page_id));
+  ASSERT_NE(nullptr, page);
+  RID rid;
+  page->WLatch();
+  page->Init(page_id, PAGE_SIZE, INVALID_PAGE_ID, INVALID_PAGE_ID,
+             &log_manager, txn);
+  for (int i = 0; i < 10; i++)
+    EXPECT_TRUE(page->InsertTuple(MakeTuple(i, &schema), rid, txn, nullptr,
+                                  &log_manager));
+  page->WUnlatch();
+  bpm.UnpinPage(page_id, true);
+  txn_manager.Commit(txn);
+  txn_manager.Release(txn);
+  BackupManager backup_manager(bpm.GetDiskManager());
+  ASSERT_TRUE(backup_manager.Backup("backup"));
+
+  LogShipper shipper(bpm.GetDiskManager());
+  ASSERT_TRUE(shipper.Listen(0));
+  BufferPoolManager replica_bpm(50, "backup/test.db");
+  LogReplica replica(&replica_bpm);
+  EXPECT_EQ(9, ReadReplica(replica, replica_bpm, page_id, 9, &schema));
+  replica.Start("127.0.0.1", shipper.GetPort());
+
+  // a committed transaction shows, a running one is held back
+  txn = txn_manager.Begin();
+  page = static_cast<TablePage *>(bpm.FetchPage(page_id));
+  page->WLatch();
+  for (int i = 10; i < 15; i++)
+    EXPECT_TRUE(page->InsertTuple(MakeTuple(i, &schema), rid, txn, nullptr,
+                                  &log_manager));
+  page->WUnlatch();
+  bpm.UnpinPage(page_id, true);
+  txn_manager.Commit(txn);
+  txn_manager.Release(txn);
+  Transaction *running = txn_manager.Begin();
+  page = static_cast<TablePage *>(bpm.FetchPage(page_id));
+  page->WLatch();
+  EXPECT_TRUE(page->InsertTuple(MakeTuple(15, &schema), rid, running,
+                                nullptr, &log_manager));
+  page->WUnlatch();
+  bpm.UnpinPage(page_id, true);
+  log_manager.WaitUntilDurable(running->GetPrevLSN());
+  EXPECT_TRUE(WaitFor([&]() {
+    return ReadReplica(replica, replica_bpm, page_id, 14, &schema) == 14 &&
+           replica.GetLagBytes() > 0;
+  }));
+  EXPECT_TRUE(replica.IsConnected());
+  EXPECT_EQ(-1, ReadReplica(replica, replica_bpm, page_id, 15, &schema));
+
+  txn_manager.Commit(running);
+  txn_manager.Release(running);
+  EXPECT_TRUE(WaitFor([&]() {
+    return ReadReplica(replica, replica_bpm, page_id, 15, &schema) == 15 &&
+           replica.GetLagBytes() == 0;
+  }));
+  EXPECT_EQ(log_manager.GetNextLSN(), replica.GetNextLSN());
+  EXPECT_EQ(1u, shipper.GetReplicaCount());
+  EXPECT_LT(0u, shipper.GetShippedBytes());
+
+  replica.Stop();
+  shipper.Stop();
+  log_manager.StopFlushThread();
+  bpm.SetLogManager(nullptr);
+  RemoveFiles("test");
+  RemoveFiles("backup/test");
+  rmdir("backup");
+}
+
+} // namespace cmudb
@@ -1,7 +1,11 @@
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
+#include "catalog/catalog.h"
 #include "page/header_page.h"
 #include "gtest/gtest.h"
 
@@ -50,4 +54,51 @@ TEST(HeaderPageTest, UnitTest) {
 
   delete buffer_pool_manager;
 }
+
+TEST(HeaderPageTest, CatalogTest) {
+  remove("test.db");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(20, "test.db");
+  page_id_t header_page_id;
+  auto page =
+      static_cast<HeaderPage *>(buffer_pool_manager->NewPage(header_page_id));
+  page->Init();
+  buffer_pool_manager->UnpinPage(header_page_id, true);
+
+  // thousands of records span a chain of header pages
+  Catalog *catalog = new Catalog(buffer_pool_manager);
+  EXPECT_EQ(1, catalog->GetPageCount());
+  for (int i = 1; i <= 3000; i++)
+    EXPECT_TRUE(catalog->InsertRecord("table_" + std::to_string(i), i));
+  EXPECT_FALSE(catalog->InsertRecord("table_1", 1));
+  EXPECT_EQ(3000, catalog->GetRecordCount());
+  EXPECT_EQ((3000 + HEADER_PAGE_MAX_RECORDS - 1) / HEADER_PAGE_MAX_RECORDS,
+            catalog->GetPageCount());
+  EXPECT_TRUE(catalog->UpdateRecord("table_2999", 5));
+  EXPECT_TRUE(catalog->DeleteRecord("table_7"));
+  EXPECT_FALSE(catalog->DeleteRecord("table_7"));
+  EXPECT_FALSE(catalog->UpdateRecord("table_7", 7));
+  delete catalog;
+
+  // a catalog opened again reads them from the pages
+  catalog = new Catalog(buffer_pool_manager);
+  EXPECT_EQ(2999, catalog->GetRecordCount());
+  page_id_t root_id;
+  EXPECT_TRUE(catalog->GetRootId("table_1500", root_id));
+  EXPECT_EQ(1500, root_id);
+  EXPECT_TRUE(catalog->GetRootId("table_2999", root_id));
+  EXPECT_EQ(5, root_id);
+  EXPECT_FALSE(catalog->GetRootId("table_7", root_id));
+  std::vector<std::string> names;
+  catalog->GetNames("table_300", names);
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ(std::vector<std::string>({"table_300", "table_3000"}), names);
+  // the room of a deleted record is taken before a new page
+  size_t page_count = catalog->GetPageCount();
+  EXPECT_TRUE(catalog->InsertRecord("table_7", 7));
+  EXPECT_EQ(page_count, catalog->GetPageCount());
+  delete catalog;
+
+  delete buffer_pool_manager;
+  remove("test.db");
+}
 } // namespace cmudb
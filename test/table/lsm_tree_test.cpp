@@ -0,0 +1,176 @@
+/**
+ * lsm_tree_test.cpp
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "table/lsm_tree.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// rows of about 100 bytes, a few memtables full
+#define TEST_ROWS 30000
+
+static std::string MakeRow(int64_t key, int version = 0) {
+  std::string row = std::to_string(key) + ":" + std::to_string(version);
+  row.resize(100, 'x');
+  return row;
+}
+
+// keys of the live rows in [low, high]
+static std::vector<int64_t> ScanKeys(LsmTree &tree, int64_t low,
+                                     int64_t high) {
+  std::vector<int64_t> keys;
+  for (LsmTree::Iterator iterator(&tree, low, high); !iterator.isEnd();
+       iterator.Next())
+    keys.push_back(iterator.GetKey());
+  return keys;
+}
+
+TEST(LsmTreeTest, BloomFilterTest) {
+  BloomFilter filter(10000);
+  for (int64_t key = 0; key < 20000; key += 2)
+    filter.Add(key);
+  size_t false_positives = 0;
+  for (int64_t key = 0; key < 20000; key++) {
+    if (key % 2 == 0) {
+      EXPECT_TRUE(filter.MayContain(key));
+    } else if (filter.MayContain(key)) {
+      false_positives++;
+    }
+  }
+  // about 1% with 10 bits per key
+  EXPECT_GT(300u, false_positives);
+}
+
+TEST(LsmTreeTest, PutGetTest) {
+  remove("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(100, "test.db");
+  page_id_t manifest_page_id;
+  {
+    LsmTree tree(bpm);
+    manifest_page_id = tree.GetManifestPageId();
+    for (int64_t i = 0; i < TEST_ROWS; i++) {
+      int64_t key = tree.NextKey();
+      EXPECT_EQ(i + 1, key);
+      std::string row = MakeRow(key);
+      tree.Put(key, row.data(), row.size());
+    }
+    // the memtables written so far are runs
+    EXPECT_LT(0u, tree.GetRunCount());
+    std::string row;
+    EXPECT_TRUE(tree.Get(1, row));
+    EXPECT_EQ(MakeRow(1), row);
+    EXPECT_TRUE(tree.Get(TEST_ROWS, row));
+    EXPECT_FALSE(tree.Get(0, row));
+    EXPECT_FALSE(tree.Get(TEST_ROWS + 1, row));
+
+    // newer entries shadow older ones in runs
+    for (int64_t key = 1; key <= TEST_ROWS; key += 10)
+      tree.Remove(key);
+    for (int64_t key = 2; key <= TEST_ROWS; key += 10) {
+      row = MakeRow(key, 1);
+      tree.Put(key, row.data(), row.size());
+    }
+    EXPECT_FALSE(tree.Get(11, row));
+    EXPECT_TRUE(tree.Get(12, row));
+    EXPECT_EQ(MakeRow(12, 1), row);
+    std::vector<int64_t> keys = ScanKeys(tree, INT64_MIN, INT64_MAX);
+    EXPECT_EQ(TEST_ROWS / 10 * 9, static_cast<int>(keys.size()));
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    EXPECT_EQ(std::vector<int64_t>({2, 3, 4, 5, 6, 7, 8, 9, 10, 12}),
+              ScanKeys(tree, 0, 12));
+    EXPECT_EQ(std::vector<int64_t>({29998, 29999, 30000}),
+              ScanKeys(tree, 29998, 40000));
+
+    EXPECT_EQ(TEST_ROWS + 1, tree.NextKey());
+
+    // a missing key reads no page of the runs whose filter rules it out
+    for (int64_t key = 100001; key < 100001 + 2 * TEST_ROWS; key += 2) {
+      row = MakeRow(key);
+      tree.Put(key, row.data(), row.size());
+    }
+    tree.Flush();
+    bpm->ResetStats();
+    for (int64_t key = 100002; key < 102002; key += 2)
+      EXPECT_FALSE(tree.Get(key, row));
+    EXPECT_GT(100u, bpm->GetStats().fetches_);
+  }
+
+  // the runs are found again from the manifest
+  {
+    LsmTree tree(bpm, manifest_page_id);
+    std::string row;
+    EXPECT_TRUE(tree.Get(12, row));
+    EXPECT_EQ(MakeRow(12, 1), row);
+    EXPECT_FALSE(tree.Get(21, row));
+    EXPECT_EQ(TEST_ROWS / 10 * 9 + TEST_ROWS,
+              static_cast<int>(ScanKeys(tree, INT64_MIN, INT64_MAX).size()));
+    EXPECT_EQ(100000 + 2 * TEST_ROWS, tree.NextKey());
+  }
+  delete bpm;
+  remove("test.db");
+}
+
+TEST(LsmTreeTest, CompactionTest) {
+  remove("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(100, "test.db");
+  page_id_t manifest_page_id;
+  {
+    LsmTree tree(bpm);
+    manifest_page_id = tree.GetManifestPageId();
+    // a run per round, each updating a key in ten and removing another
+    for (int round = 0; round < LSM_COMPACTION_RUNS - 1; round++) {
+      for (int64_t key = round; key < TEST_ROWS; key += 10) {
+        std::string row = MakeRow(key, round);
+        tree.Put(key, row.data(), row.size());
+        tree.Remove(key + 5);
+      }
+      tree.Flush();
+    }
+    EXPECT_EQ(static_cast<size_t>(LSM_COMPACTION_RUNS - 1),
+              tree.GetRunCount());
+    tree.Compact();
+    EXPECT_EQ(1u, tree.GetRunCount());
+    EXPECT_EQ(1u, tree.GetCompactionCount());
+    // the tombstones are gone with the oldest run merged
+    EXPECT_EQ(static_cast<size_t>(TEST_ROWS / 10 * (LSM_COMPACTION_RUNS - 1)),
+              tree.GetEntryCount());
+    std::string row;
+    EXPECT_TRUE(tree.Get(LSM_COMPACTION_RUNS - 2, row));
+    EXPECT_EQ(MakeRow(LSM_COMPACTION_RUNS - 2, LSM_COMPACTION_RUNS - 2), row);
+    EXPECT_FALSE(tree.Get(1005, row));
+
+    // enough runs start the compaction thread
+    for (int round = 0; round < LSM_COMPACTION_RUNS; round++) {
+      for (int64_t key = 0; key < 1000; key++) {
+        std::string row = MakeRow(key, round);
+        tree.Put(key, row.data(), row.size());
+      }
+      tree.Flush();
+    }
+    for (int i = 0; i < 1000 && tree.GetCompactionCount() < 2; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(2u, tree.GetCompactionCount());
+    EXPECT_TRUE(tree.Get(999, row));
+    EXPECT_EQ(MakeRow(999, LSM_COMPACTION_RUNS - 1), row);
+  }
+  {
+    LsmTree tree(bpm, manifest_page_id);
+    std::string row;
+    EXPECT_TRUE(tree.Get(999, row));
+    EXPECT_EQ(MakeRow(999, LSM_COMPACTION_RUNS - 1), row);
+    EXPECT_FALSE(tree.Get(1005, row));
+  }
+  delete bpm;
+  remove("test.db");
+}
+
+} // namespace cmudb
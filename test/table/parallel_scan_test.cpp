@@ -0,0 +1,167 @@
+/**
+ * parallel_scan_test.cpp
+ */
+
+#include <cstdio>
+#include <set>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "table/parallel_scan.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// tuples of the scanned table, about a hundred pages
+#define TEST_TUPLES 20000
+
+static TableHeap *MakeTable(BufferPoolManager *buffer_pool_manager,
+                            Schema *schema, Transaction *txn,
+                            std::vector<RID> &rids) {
+  TableHeap *table = new TableHeap(buffer_pool_manager, nullptr);
+  RID rid;
+  for (int i = 0; i < TEST_TUPLES; i++) {
+    std::vector<Value> values{Value(TypeId::INTEGER, (int32_t)i),
+                              Value(TypeId::BIGINT, (int64_t)i % 100)};
+    EXPECT_TRUE(table->InsertTuple(Tuple(values, schema), rid, txn));
+    rids.push_back(rid);
+  }
+  return table;
+}
+
+TEST(ParallelScanTest, RunTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b bigint");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(50, "test.db");
+  Transaction *transaction = new Transaction(0);
+  std::vector<RID> rids;
+  TableHeap *table = MakeTable(buffer_pool_manager, schema, transaction, rids);
+
+  std::vector<page_id_t> page_ids;
+  table->GetPageIds(page_ids);
+  EXPECT_LT(50u, page_ids.size());
+  EXPECT_EQ(table->GetFirstPageId(), page_ids[0]);
+
+  for (size_t threads : {1, 4}) {
+    ParallelTableScan scan(table, transaction, threads, 4);
+    EXPECT_EQ(page_ids.size(), scan.GetPageCount());
+    // aggregated by every worker, merged once they are done
+    std::vector<RowBatch *> batches;
+    std::vector<int64_t> counts(threads, 0), sums(threads, 0);
+    std::vector<BatchPredicate> predicates{
+        BatchPredicate(1, CompareType::EQ, Value(TypeId::BIGINT, (int64_t)7))};
+    for (size_t i = 0; i < threads; i++) {
+      batches.push_back(new RowBatch(schema, 128));
+      batches.back()->SetPredicates(predicates);
+    }
+    scan.Run(batches, [&](RowBatch &batch, size_t worker) {
+      for (uint32_t i = 0; i < batch.GetSelectedCount(); i++) {
+        uint32_t row = batch.GetSelected(i);
+        counts[worker]++;
+        sums[worker] +=
+            *reinterpret_cast<const int32_t *>(batch.GetFixed(0, row));
+      }
+    });
+    int64_t count = 0, sum = 0;
+    for (size_t i = 0; i < threads; i++) {
+      count += counts[i];
+      sum += sums[i];
+      delete batches[i];
+    }
+    EXPECT_EQ(TEST_TUPLES / 100, count);
+    // 7 + 107 + ... + 19907
+    EXPECT_EQ(7 * 200 + 100 * 199 * 200 / 2, sum);
+  }
+
+  delete transaction;
+  delete table;
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+
+TEST(ParallelScanTest, StartTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b bigint");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(50, "test.db");
+  Transaction *transaction = new Transaction(0);
+  std::vector<RID> rids;
+  TableHeap *table = MakeTable(buffer_pool_manager, schema, transaction, rids);
+
+  std::vector<RowBatch *> batches;
+  for (int i = 0; i < 6; i++)
+    batches.push_back(new RowBatch(schema, 256));
+  // every row once, in whatever order the workers hand them over
+  {
+    ParallelTableScan scan(table, transaction, 3, 2);
+    scan.Start(batches);
+    std::set<int64_t> seen;
+    RowBatch *batch = nullptr;
+    while ((batch = scan.Next(batch)) != nullptr) {
+      EXPECT_GT(batch->GetSelectedCount(), 0u);
+      for (uint32_t i = 0; i < batch->GetSelectedCount(); i++) {
+        uint32_t row = batch->GetSelected(i);
+        int a = *reinterpret_cast<const int32_t *>(batch->GetFixed(0, row));
+        EXPECT_EQ(rids[a].Get(), batch->GetRid(row).Get());
+        EXPECT_TRUE(seen.insert(batch->GetRid(row).Get()).second);
+      }
+    }
+    EXPECT_EQ(static_cast<size_t>(TEST_TUPLES), seen.size());
+  }
+  // a scan stopped early lets its workers go
+  {
+    ParallelTableScan scan(table, transaction, 3, 2);
+    scan.Start(batches);
+    EXPECT_NE(nullptr, scan.Next(nullptr));
+  }
+  for (auto batch : batches)
+    delete batch;
+
+  delete transaction;
+  delete table;
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+
+TEST(ParallelScanTest, HeapsTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b bigint");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(50, "test.db");
+  Transaction *transaction = new Transaction(0);
+  std::vector<RID> rids;
+  // partitions of a table, each a heap of its own in the same pool
+  TableHeap *first = MakeTable(buffer_pool_manager, schema, transaction, rids);
+  TableHeap *second =
+      MakeTable(buffer_pool_manager, schema, transaction, rids);
+
+  std::vector<RowBatch *> batches;
+  for (int i = 0; i < 4; i++)
+    batches.push_back(new RowBatch(schema, 256));
+  ParallelTableScan scan(std::vector<TableHeap *>{first, second}, transaction,
+                         4, 2);
+  std::vector<page_id_t> page_ids;
+  first->GetPageIds(page_ids);
+  second->GetPageIds(page_ids);
+  EXPECT_EQ(page_ids.size(), scan.GetPageCount());
+  scan.Start(batches);
+  std::set<int64_t> seen;
+  RowBatch *batch = nullptr;
+  while ((batch = scan.Next(batch)) != nullptr)
+    for (uint32_t i = 0; i < batch->GetSelectedCount(); i++)
+      EXPECT_TRUE(seen.insert(batch->GetRid(batch->GetSelected(i)).Get())
+                      .second);
+  EXPECT_EQ(rids.size(), seen.size());
+  for (auto batch : batches)
+    delete batch;
+
+  delete transaction;
+  delete first;
+  delete second;
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+
+} // namespace cmudb
@@ -0,0 +1,130 @@
+/**
+ * row_batch_test.cpp
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "table/row_batch.h"
+#include "table/table_heap.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static Tuple MakeTuple(Schema *schema, int i) {
+  std::vector<Value> values;
+  values.emplace_back(TypeId::INTEGER, (int32_t)i);
+  values.emplace_back(TypeId::VARCHAR, std::string(i % 10, 'a' + i % 26));
+  values.emplace_back(TypeId::BIGINT, (int64_t)i * 1000);
+  values.emplace_back(TypeId::DECIMAL, i + 0.5);
+  return Tuple(values, schema);
+}
+
+TEST(RowBatchTest, BatchScanTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar, c bigint, d double");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(50, "test.db");
+  TableHeap *table = new TableHeap(buffer_pool_manager, nullptr);
+  Transaction *transaction = new Transaction(0);
+
+  RID rid;
+  std::vector<RID> rids;
+  for (int i = 0; i < 3000; i++) {
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i), rid, transaction));
+    rids.push_back(rid);
+  }
+  // deleted slots are skipped
+  for (int i = 0; i < 3000; i += 3)
+    EXPECT_TRUE(table->MarkDelete(rids[i], transaction));
+
+  // every row comes back in page order, split over batches
+  RowBatch batch(schema, 256);
+  TableBatchIterator iterator(table, transaction);
+  int count = 0;
+  int batches = 0;
+  while (iterator.Next(batch)) {
+    EXPECT_LE(batch.GetSize(), 256u);
+    batches++;
+    for (uint32_t i = 0; i < batch.GetSelectedCount(); i++) {
+      uint32_t row = batch.GetSelected(i);
+      int a = *reinterpret_cast<const int32_t *>(batch.GetFixed(0, row));
+      EXPECT_NE(0, a % 3);
+      EXPECT_EQ(rids[a].Get(), batch.GetRid(row).Get());
+      uint32_t len;
+      const char *b = batch.GetVarchar(1, row, len);
+      EXPECT_EQ(std::string(a % 10, 'a' + a % 26), std::string(b));
+      EXPECT_EQ(a * 1000, batch.GetValue(2, row).GetAs<int64_t>());
+      EXPECT_EQ(a + 0.5, batch.GetValue(3, row).GetAs<double>());
+      count++;
+    }
+  }
+  EXPECT_EQ(2000, count);
+  EXPECT_EQ(8, batches);
+
+  // predicates on every column type, ANDed together
+  std::vector<BatchPredicate> predicates;
+  predicates.emplace_back(0, CompareType::GE, Value(TypeId::INTEGER, 1000));
+  predicates.emplace_back(2, CompareType::LT,
+                          Value(TypeId::BIGINT, (int64_t)2000000));
+  predicates.emplace_back(3, CompareType::NE, Value(TypeId::DECIMAL, 1500.5));
+  predicates.emplace_back(1, CompareType::EQ,
+                          Value(TypeId::VARCHAR, std::string("eeee")));
+  batch.SetPredicates(predicates);
+  TableBatchIterator filtered(table, transaction);
+  std::vector<int> matches;
+  while (filtered.Next(batch)) {
+    EXPECT_GT(batch.GetSelectedCount(), 0u);
+    for (uint32_t i = 0; i < batch.GetSelectedCount(); i++)
+      matches.push_back(batch.GetValue(0, batch.GetSelected(i)).GetAs<int>());
+  }
+  // a % 10 == 4 and a % 26 == 4, not a multiple of 3
+  std::vector<int> expected;
+  for (int a = 1000; a < 2000; a++)
+    if (a % 10 == 4 && a % 26 == 4 && a % 3 != 0 && a != 1500)
+      expected.push_back(a);
+  EXPECT_EQ(expected, matches);
+
+  // integer column against a decimal constant, and a null constant
+  predicates.clear();
+  predicates.emplace_back(0, CompareType::LE, Value(TypeId::DECIMAL, 10.5));
+  batch.SetPredicates(predicates);
+  TableBatchIterator decimal(table, transaction);
+  EXPECT_TRUE(decimal.Next(batch));
+  EXPECT_EQ(7u, batch.GetSelectedCount());
+  EXPECT_FALSE(decimal.Next(batch));
+  predicates.clear();
+  predicates.emplace_back(0, CompareType::EQ,
+                          Value(TypeId::INTEGER, PELOTON_INT32_NULL));
+  batch.SetPredicates(predicates);
+  TableBatchIterator null(table, transaction);
+  EXPECT_FALSE(null.Next(batch));
+
+  // only the projected and predicate columns are decoded
+  predicates.clear();
+  predicates.emplace_back(2, CompareType::GT,
+                          Value(TypeId::BIGINT, (int64_t)2990000));
+  batch.SetPredicates(predicates);
+  batch.SetProjection(1 << 1);
+  TableBatchIterator projected(table, transaction);
+  EXPECT_TRUE(projected.Next(batch));
+  EXPECT_EQ(6u, batch.GetSelectedCount());
+  for (uint32_t i = 0; i < batch.GetSelectedCount(); i++) {
+    uint32_t row = batch.GetSelected(i);
+    int64_t c = batch.GetValue(2, row).GetAs<int64_t>();
+    int a = static_cast<int>(c / 1000);
+    EXPECT_EQ(std::string(a % 10, 'a' + a % 26),
+              batch.GetValue(1, row).ToString());
+  }
+  EXPECT_FALSE(projected.Next(batch));
+
+  delete transaction;
+  delete table;
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+
+} // namespace cmudb
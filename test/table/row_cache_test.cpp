@@ -0,0 +1,155 @@
+/**
+ * row_cache_test.cpp
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "table/row_cache.h"
+#include "table/table_heap.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static Tuple MakeTuple(Schema *schema, int32_t a, int64_t b) {
+  std::vector<Value> values{Value(TypeId::INTEGER, a),
+                            Value(TypeId::BIGINT, b)};
+  return Tuple(values, schema);
+}
+
+TEST(RowCacheTest, PutGetTest) {
+  Schema *schema = ParseCreateStatement("a int, b bigint");
+  RowCache cache(64);
+  Tuple tuple;
+  RID rid(3, 7);
+  EXPECT_FALSE(cache.Get(rid, tuple));
+  cache.Put(rid, MakeTuple(schema, 1, 10), cache.GetGeneration(rid));
+  EXPECT_TRUE(cache.Contains(rid));
+  EXPECT_TRUE(cache.Get(rid, tuple));
+  EXPECT_EQ(rid, tuple.GetRid());
+  EXPECT_EQ(10, tuple.GetValue(schema, 1).GetAs<int64_t>());
+  EXPECT_FALSE(cache.Get(RID(3, 8), tuple));
+  EXPECT_EQ(1u, cache.GetHits());
+  EXPECT_EQ(2u, cache.GetMisses());
+
+  // a fill that read the page before the row changed is dropped
+  uint64_t generation = cache.GetGeneration(rid);
+  cache.Invalidate(rid);
+  EXPECT_FALSE(cache.Contains(rid));
+  cache.Put(rid, MakeTuple(schema, 1, 10), generation);
+  EXPECT_FALSE(cache.Contains(rid));
+  cache.Put(rid, MakeTuple(schema, 1, 11), cache.GetGeneration(rid));
+  EXPECT_TRUE(cache.Get(rid, tuple));
+  EXPECT_EQ(11, tuple.GetValue(schema, 1).GetAs<int64_t>());
+  EXPECT_EQ(1u, cache.GetSize());
+  delete schema;
+}
+
+TEST(RowCacheTest, EvictionTest) {
+  Schema *schema = ParseCreateStatement("a int, b bigint");
+  RowCache cache(ROW_CACHE_SHARDS * 4);
+  Tuple tuple;
+  // the hot row is read between the fills, the clock passes over it
+  RID hot(1, 0);
+  cache.Put(hot, MakeTuple(schema, 0, 0), cache.GetGeneration(hot));
+  for (int i = 1; i < 2000; i++) {
+    RID rid(1 + i / 100, i % 100);
+    cache.Put(rid, MakeTuple(schema, i, i), cache.GetGeneration(rid));
+    EXPECT_TRUE(cache.Get(hot, tuple));
+  }
+  EXPECT_GE(static_cast<size_t>(ROW_CACHE_SHARDS * 4), cache.GetSize());
+  EXPECT_EQ(0, tuple.GetValue(schema, 1).GetAs<int64_t>());
+  delete schema;
+}
+
+// readers copy rows while writers replace them, every copy is a whole one
+TEST(RowCacheTest, ConcurrentTest) {
+  Schema *schema = ParseCreateStatement("a int, b bigint");
+  RowCache cache(256);
+  std::atomic<bool> stop{false};
+  std::atomic<int> torn{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++)
+    threads.emplace_back([&, t] {
+      Tuple tuple;
+      for (int i = 0; !stop; i++) {
+        RID rid(1, (i * 7 + t) % 512);
+        if (cache.Get(rid, tuple) &&
+            tuple.GetValue(schema, 0).GetAs<int32_t>() !=
+                tuple.GetValue(schema, 1).GetAs<int64_t>())
+          torn++;
+      }
+    });
+  for (int i = 0; i < 50000; i++) {
+    RID rid(1, i % 512);
+    if (i % 3 == 0)
+      cache.Invalidate(rid);
+    else
+      cache.Put(rid, MakeTuple(schema, i, i), cache.GetGeneration(rid));
+  }
+  stop = true;
+  for (auto &thread : threads)
+    thread.join();
+  EXPECT_EQ(0, torn.load());
+  EXPECT_LT(0u, cache.GetHits());
+  delete schema;
+}
+
+TEST(RowCacheTest, TableHeapTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b bigint");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  LockManager lock_manager(true);
+  TableHeap *table = new TableHeap(bpm, &lock_manager);
+  table->EnableRowCache(128);
+  Transaction *txn = new Transaction(0);
+  RID rid;
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 1, 10), rid, txn));
+  txn->SetState(TransactionState::COMMITTED);
+  lock_manager.UnlockAll(txn);
+  delete txn;
+
+  // the second read is a hit, the row is locked all the same
+  txn = new Transaction(1);
+  Tuple tuple;
+  EXPECT_TRUE(table->GetTuple(rid, tuple, txn));
+  EXPECT_TRUE(table->GetTuple(rid, tuple, txn));
+  EXPECT_EQ(10, tuple.GetValue(schema, 1).GetAs<int64_t>());
+  EXPECT_EQ(1u, table->GetRowCache()->GetHits());
+  EXPECT_EQ(1u, txn->GetSharedLockSet()->count(rid));
+  txn->SetState(TransactionState::COMMITTED);
+  lock_manager.UnlockAll(txn);
+  delete txn;
+
+  // an update invalidates the row, its rollback too
+  txn = new Transaction(2);
+  EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, 1, 20), rid, txn));
+  EXPECT_FALSE(table->GetRowCache()->Contains(rid));
+  EXPECT_TRUE(table->GetTuple(rid, tuple, txn));
+  EXPECT_EQ(20, tuple.GetValue(schema, 1).GetAs<int64_t>());
+  EXPECT_TRUE(table->GetRowCache()->Contains(rid));
+  Tuple before = txn->GetWriteSet()->back().tuple_;
+  EXPECT_TRUE(table->UpdateTuple(before, rid, txn));
+  EXPECT_TRUE(table->GetTuple(rid, tuple, txn));
+  EXPECT_EQ(10, tuple.GetValue(schema, 1).GetAs<int64_t>());
+
+  // a deleted row is not read from the cache
+  EXPECT_TRUE(table->MarkDelete(rid, txn));
+  EXPECT_FALSE(table->GetRowCache()->Contains(rid));
+  EXPECT_FALSE(table->GetTuple(rid, tuple, txn));
+  txn->SetState(TransactionState::COMMITTED);
+  lock_manager.UnlockAll(txn);
+  delete txn;
+
+  delete table;
+  delete bpm;
+  delete schema;
+  remove("test.db");
+}
+
+} // namespace cmudb
@@ -0,0 +1,708 @@
+/**
+ * table_page_test.cpp
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "concurrency/transaction_manager.h"
+#include "disk/page_codec.h"
+#include "logging/log_record.h"
+#include "page/table_page.h"
+#include "table/table_heap.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static Tuple MakeTuple(Schema *schema, int i, size_t len) {
+  std::vector<Value> values;
+  values.emplace_back(TypeId::INTEGER, (int32_t)i);
+  values.emplace_back(TypeId::VARCHAR, std::string(len, 'a' + i % 26));
+  values.emplace_back(TypeId::BIGINT, (int64_t)i * 10);
+  return Tuple(values, schema);
+}
+
+static void ExpectTuple(Schema *schema, const Tuple &tuple, int i,
+                        size_t len) {
+  EXPECT_EQ(i, tuple.GetValue(schema, 0).GetAs<int32_t>());
+  EXPECT_EQ(std::string(len, 'a' + i % 26),
+            tuple.GetValue(schema, 1).ToString());
+  EXPECT_EQ(i * 10, tuple.GetValue(schema, 2).GetAs<int64_t>());
+}
+
+TEST(TablePageTest, PaxPageTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar(8), c bigint");
+  PaxLayout layout(schema);
+  EXPECT_TRUE(layout.IsPax());
+  EXPECT_EQ((std::vector<uint32_t>{4, 4, 8}), layout.widths_);
+  EXPECT_EQ(16u, layout.GetFixedLength());
+  EXPECT_LE(layout.GetMinipageEnd(), static_cast<uint32_t>(PAGE_SIZE));
+  // too wide for a page, slotted then
+  Schema *wide = ParseCreateStatement("a varchar(8192)");
+  EXPECT_FALSE(PaxLayout(wide).IsPax());
+  delete wide;
+
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(10, "test.db");
+  page_id_t page_id;
+  auto page = static_cast<TablePage *>(buffer_pool_manager->NewPage(page_id));
+  page->Init(page_id, PAGE_SIZE, INVALID_PAGE_ID, INVALID_PAGE_ID, nullptr,
+             nullptr, layout);
+  EXPECT_TRUE(page->IsPax());
+  PaxLayout read;
+  page->GetPaxLayout(read);
+  EXPECT_EQ(layout.capacity_, read.capacity_);
+  EXPECT_EQ(layout.widths_, read.widths_);
+
+  // varchars shorter than declared, the slots run out first
+  RID rid;
+  std::vector<RID> rids;
+  while (page->InsertTuple(MakeTuple(schema, rids.size(), 3), rid, nullptr,
+                           nullptr, nullptr))
+    rids.push_back(rid);
+  EXPECT_EQ(layout.capacity_, rids.size());
+  EXPECT_EQ(0, page->GetFreeSpaceSize());
+  for (size_t i = 0; i < rids.size(); i++) {
+    Tuple tuple;
+    EXPECT_TRUE(page->GetTuple(rids[i], tuple, nullptr, nullptr));
+    ExpectTuple(schema, tuple, i, 3);
+    // read in place, from the minipages and the varchar space
+    EXPECT_EQ(static_cast<int64_t>(i) * 10,
+              *reinterpret_cast<const int64_t *>(
+                  page->GetTupleBytes(rids[i], schema->GetOffset(2))));
+    int32_t varlen = *reinterpret_cast<const int32_t *>(
+        page->GetTupleBytes(rids[i], schema->GetOffset(1)));
+    EXPECT_EQ(4u, *reinterpret_cast<const uint32_t *>(
+                      page->GetTupleBytes(rids[i], varlen)));
+  }
+
+  // varchars grow and shrink, deletes free their bytes, the rest stays
+  Tuple old_tuple;
+  EXPECT_TRUE(page->UpdateTuple(MakeTuple(schema, 5, 7), old_tuple, rids[5],
+                                nullptr, nullptr, nullptr));
+  ExpectTuple(schema, old_tuple, 5, 3);
+  EXPECT_TRUE(page->UpdateTuple(MakeTuple(schema, 9, 1), old_tuple, rids[9],
+                                nullptr, nullptr, nullptr));
+  EXPECT_TRUE(page->MarkDelete(rids[2], nullptr, nullptr, nullptr));
+  page->ApplyDelete(rids[2], nullptr, nullptr);
+  EXPECT_TRUE(page->MarkDelete(rids[7], nullptr, nullptr, nullptr));
+  EXPECT_TRUE(page->UpdateTuple(MakeTuple(schema, 0, 8), old_tuple, rids[0],
+                                nullptr, nullptr, nullptr));
+  page->RollbackDelete(rids[7], nullptr, nullptr);
+  for (size_t i = 0; i < rids.size(); i++) {
+    Tuple tuple;
+    EXPECT_EQ(i != 2, page->GetTuple(rids[i], tuple, nullptr, nullptr));
+    if (i != 2)
+      ExpectTuple(schema, tuple, i, i == 0 ? 8 : i == 5 ? 7 : i == 9 ? 1 : 3);
+  }
+
+  // the batch scan reads the columns out of the minipages
+  RowBatch batch(schema);
+  std::vector<BatchPredicate> predicates{
+      BatchPredicate(2, CompareType::LT, Value(TypeId::BIGINT, (int64_t)100))};
+  batch.SetPredicates(predicates);
+  int slot = 0;
+  EXPECT_TRUE(page->ScanBatch(slot, batch, nullptr, nullptr));
+  EXPECT_EQ(rids.size() - 1, batch.GetSize());
+  EXPECT_EQ(9u, batch.GetSelectedCount());
+  for (uint32_t i = 0; i < batch.GetSelectedCount(); i++) {
+    uint32_t row = batch.GetSelected(i);
+    int a = batch.GetValue(0, row).GetAs<int32_t>();
+    EXPECT_NE(2, a);
+    EXPECT_EQ(rids[a].Get(), batch.GetRid(row).Get());
+    EXPECT_EQ(a * 10, batch.GetValue(2, row).GetAs<int64_t>());
+    size_t len = a == 0 ? 8 : a == 5 ? 7 : a == 9 ? 1 : 3;
+    EXPECT_EQ(std::string(len, 'a' + a % 26),
+              batch.GetValue(1, row).ToString());
+  }
+
+  buffer_pool_manager->UnpinPage(page_id, true);
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+
+TEST(TablePageTest, PaxTableHeapTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar(8), c bigint");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(50, "test.db");
+  Transaction *transaction = new Transaction(0);
+  TableHeap *table = new TableHeap(buffer_pool_manager, nullptr, nullptr,
+                                   INVALID_PAGE_ID, INVALID_PAGE_ID,
+                                   PaxLayout(schema));
+  RID rid;
+  for (int i = 0; i < 2000; i++)
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, i % 12), rid,
+                                   transaction));
+
+  int i = 0;
+  for (auto it = table->begin(transaction); it != table->end(); ++it, ++i)
+    ExpectTuple(schema, *it, i, i % 12);
+  EXPECT_EQ(2000, i);
+  RowBatch batch(schema);
+  TableBatchIterator iterator(table, transaction);
+  i = 0;
+  while (iterator.Next(batch))
+    for (uint32_t j = 0; j < batch.GetSelectedCount(); j++, i++)
+      EXPECT_EQ(i, batch.GetValue(0, batch.GetSelected(j)).GetAs<int32_t>());
+  EXPECT_EQ(2000, i);
+
+  // opened again, new pages keep the format of the first one
+  page_id_t first_page_id = table->GetFirstPageId();
+  page_id_t fsm_page_id = table->GetFreeSpaceMapPageId();
+  delete table;
+  table = new TableHeap(buffer_pool_manager, nullptr, nullptr, first_page_id,
+                        fsm_page_id);
+  EXPECT_TRUE(table->GetPaxLayout().IsPax());
+  for (int i = 2000; i < 3000; i++)
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, i % 12), rid,
+                                   transaction));
+  std::vector<page_id_t> page_ids;
+  table->GetPageIds(page_ids);
+  for (auto page_id : page_ids) {
+    auto page =
+        static_cast<TablePage *>(buffer_pool_manager->FetchPage(page_id));
+    EXPECT_TRUE(page->IsPax());
+    buffer_pool_manager->UnpinPage(page_id, false);
+  }
+  i = 0;
+  for (auto it = table->begin(transaction); it != table->end(); ++it, ++i)
+    ExpectTuple(schema, *it, i, i % 12);
+  EXPECT_EQ(3000, i);
+  // no page holds the varchar
+  EXPECT_FALSE(table->InsertTuple(MakeTuple(schema, 0, PAGE_SIZE), rid,
+                                  transaction));
+
+  delete transaction;
+  delete table;
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+
+/*
+ * A batch fills the pages in turn as rows inserted one by one would
+ */
+static void InsertBatch(bool pax) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar(8), c bigint");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(50, "test.db");
+  Transaction *transaction = new Transaction(0);
+  PaxLayout layout = pax ? PaxLayout(schema) : PaxLayout();
+  TableHeap *single = new TableHeap(buffer_pool_manager, nullptr, nullptr,
+                                    INVALID_PAGE_ID, INVALID_PAGE_ID, layout);
+  TableHeap *batched = new TableHeap(buffer_pool_manager, nullptr, nullptr,
+                                     INVALID_PAGE_ID, INVALID_PAGE_ID, layout);
+  std::vector<Tuple> tuples;
+  std::vector<RID> single_rids(1000);
+  for (int i = 0; i < 1000; i++) {
+    tuples.push_back(MakeTuple(schema, i, i % 8));
+    EXPECT_TRUE(
+        single->InsertTuple(tuples.back(), single_rids[i], transaction));
+  }
+  transaction->GetWriteSet()->clear();
+  std::vector<RID> rids;
+  EXPECT_TRUE(batched->InsertTuples(tuples, rids, transaction));
+  EXPECT_EQ(1000u, rids.size());
+  EXPECT_EQ(1000u, transaction->GetWriteSet()->size());
+
+  std::vector<page_id_t> single_ids, batched_ids;
+  single->GetPageIds(single_ids);
+  batched->GetPageIds(batched_ids);
+  EXPECT_EQ(single_ids.size(), batched_ids.size());
+  // a small row may go back to a page a larger one did not fit in
+  auto position = [](const std::vector<page_id_t> &page_ids, const RID &rid) {
+    return std::find(page_ids.begin(), page_ids.end(), rid.GetPageId()) -
+           page_ids.begin();
+  };
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(position(single_ids, single_rids[i]),
+              position(batched_ids, rids[i]));
+    EXPECT_EQ(single_rids[i].GetSlotNum(), rids[i].GetSlotNum());
+  }
+  int i = 0;
+  for (auto it = batched->begin(transaction); it != batched->end();
+       ++it, ++i) {
+    int value = it->GetValue(schema, 0).GetAs<int32_t>();
+    ASSERT_TRUE(value >= 0 && value < 1000);
+    ExpectTuple(schema, *it, value, value % 8);
+    EXPECT_EQ(rids[value].Get(), it->GetRid().Get());
+  }
+  EXPECT_EQ(1000, i);
+
+  // a row no page holds stops the batch
+  tuples.resize(2);
+  tuples.push_back(MakeTuple(schema, 2, PAGE_SIZE));
+  EXPECT_FALSE(batched->InsertTuples(tuples, rids, transaction));
+  EXPECT_EQ(TransactionState::ABORTED, transaction->GetState());
+
+  delete transaction;
+  delete single;
+  delete batched;
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+
+TEST(TablePageTest, InsertTuplesTest) { InsertBatch(false); }
+
+TEST(TablePageTest, PaxInsertTuplesTest) { InsertBatch(true); }
+
+TEST(TablePageTest, PaxCompressionTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar(8), c bigint");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(50, "test.db");
+  Transaction *transaction = new Transaction(0);
+  RID rid;
+  // runs, three distinct varchars and a narrow range, in both formats
+  size_t sizes[2] = {0, 0};
+  for (int pax = 0; pax < 2; pax++) {
+    PaxLayout layout;
+    if (pax == 1)
+      layout = PaxLayout(schema);
+    TableHeap table(buffer_pool_manager, nullptr, nullptr, INVALID_PAGE_ID,
+                    INVALID_PAGE_ID, layout);
+    for (int i = 0; i < 2000; i++) {
+      std::vector<Value> values;
+      values.emplace_back(TypeId::INTEGER, (int32_t)(i / 100));
+      values.emplace_back(TypeId::VARCHAR, std::string(i % 3 + 1, 'v'));
+      values.emplace_back(TypeId::BIGINT, (int64_t)i);
+      EXPECT_TRUE(table.InsertTuple(Tuple(values, schema), rid, transaction));
+    }
+    std::vector<page_id_t> page_ids;
+    table.GetPageIds(page_ids);
+    for (auto page_id : page_ids) {
+      auto page = buffer_pool_manager->FetchPage(page_id);
+      char encoded[PAGE_CODEC_MAX_SIZE], decoded[PAGE_SIZE];
+      size_t size = PageCodec::Encode(page->GetData(), encoded);
+      EXPECT_EQ(static_cast<char>(pax == 1 ? PageEncoding::PAX
+                                           : PageEncoding::LZ),
+                encoded[0]);
+      EXPECT_TRUE(PageCodec::Decode(encoded, size, decoded));
+      EXPECT_EQ(0, memcmp(page->GetData(), decoded, PAGE_SIZE));
+      sizes[pax] += size;
+      buffer_pool_manager->UnpinPage(page_id, false);
+    }
+    EXPECT_GT(page_ids.size() * PAGE_SIZE / (pax == 1 ? 4 : 2), sizes[pax]);
+  }
+  // columns compress better than rows
+  EXPECT_GT(sizes[0], sizes[1]);
+
+  delete transaction;
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+
+TEST(TablePageTest, PaxLogRecordTest) {
+  PaxLayout layout;
+  layout.capacity_ = 100;
+  layout.widths_ = {4, 8, 4};
+  LogRecord new_page_record(0, INVALID_LSN, LogRecordType::NEWPAGE, 1, 2,
+                            layout);
+  std::vector<char> buffer(new_page_record.GetSize());
+  new_page_record.SerializeTo(buffer.data());
+  LogRecord record;
+  EXPECT_FALSE(record.DeserializeFrom(buffer.data(), buffer.size() - 1));
+  EXPECT_TRUE(record.DeserializeFrom(buffer.data(), buffer.size()));
+  EXPECT_EQ(2, record.GetPageId());
+  EXPECT_EQ(100u, record.GetPaxLayout().capacity_);
+  EXPECT_EQ(layout.widths_, record.GetPaxLayout().widths_);
+}
+
+/*
+ * Deletes leave two tuples per page, an insert takes a free slot, the sparse
+ * pages are merged into one and unlinked once the merge commits
+ */
+TEST(TablePageTest, ReorganizeTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar(128), c bigint");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(50, "test.db");
+  LockManager lock_manager(true);
+  TransactionManager txn_manager(&lock_manager);
+  TableHeap *table = new TableHeap(buffer_pool_manager, &lock_manager);
+  Transaction *txn = txn_manager.Begin();
+  std::vector<RID> rids(300);
+  for (int i = 0; i < 300; i++)
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, 100), rids[i], txn));
+  txn_manager.Commit(txn);
+  delete txn;
+  std::vector<page_id_t> page_ids;
+  table->GetPageIds(page_ids);
+  size_t pages = page_ids.size();
+  ASSERT_GE(pages, 5u);
+
+  // the first page stays full
+  txn = txn_manager.Begin();
+  std::vector<bool> kept(300, true);
+  for (int i = 0; i < 300; i++) {
+    if (rids[i].GetPageId() != page_ids[0] && rids[i].GetSlotNum() >= 2) {
+      EXPECT_TRUE(table->MarkDelete(rids[i], txn));
+      kept[i] = false;
+    }
+  }
+  txn_manager.Commit(txn);
+  delete txn;
+
+  // the thread keeps inserting into the last page while it has room, once
+  // reset it takes the first page with room
+  txn = txn_manager.Begin();
+  RID rid;
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 300, 100), rid, txn));
+  EXPECT_EQ(page_ids.back(), rid.GetPageId());
+  EXPECT_TRUE(table->MarkDelete(rid, txn));
+  txn_manager.Commit(txn);
+  delete txn;
+  table->ResetInsertTarget();
+  txn = txn_manager.Begin();
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 300, 100), rid, txn));
+  EXPECT_EQ(RID(page_ids[1], 2), rid);
+  txn_manager.Commit(txn);
+  delete txn;
+  kept.push_back(true);
+
+  txn = txn_manager.Begin();
+  size_t count;
+  size_t moves = 0;
+  EXPECT_TRUE(table->MergePages(
+      txn,
+      [&](const RID &from, const RID &to) {
+        EXPECT_NE(page_ids[1], from.GetPageId());
+        EXPECT_EQ(page_ids[1], to.GetPageId());
+        moves++;
+      },
+      count));
+  EXPECT_EQ(2 * (pages - 2), count);
+  EXPECT_EQ(count, moves);
+  // only the pages emptied by a commit go
+  EXPECT_EQ(0u, table->UnlinkEmptyPages(txn));
+  txn_manager.Commit(txn);
+  delete txn;
+
+  txn = txn_manager.Begin();
+  EXPECT_EQ(pages - 3, table->UnlinkEmptyPages(txn));
+  EXPECT_EQ(0u, table->UnlinkEmptyPages(txn));
+  txn_manager.Commit(txn);
+  delete txn;
+  page_ids.clear();
+  table->GetPageIds(page_ids);
+  EXPECT_EQ(3u, page_ids.size());
+
+  // the chain holds every kept tuple, once
+  txn = txn_manager.Begin();
+  std::vector<int> seen(301, 0);
+  size_t chain = 0;
+  for (auto it = table->begin(txn); it != table->end(); ++it) {
+    int i = it->GetValue(schema, 0).GetAs<int32_t>();
+    ExpectTuple(schema, *it, i, 100);
+    seen[i]++;
+  }
+  for (int i = 0; i <= 300; i++)
+    EXPECT_EQ(kept[i] ? 1 : 0, seen[i]);
+  for (page_id_t page_id = table->GetFirstPageId();
+       page_id != INVALID_PAGE_ID; chain++) {
+    auto page =
+        static_cast<TablePage *>(buffer_pool_manager->FetchPage(page_id));
+    EXPECT_EQ(chain < 2 ? page_ids[chain] : page_ids.back(),
+              page->GetPageId());
+    page_id_t next_page_id = page->GetNextPageId();
+    if (next_page_id != INVALID_PAGE_ID) {
+      auto next = static_cast<TablePage *>(
+          buffer_pool_manager->FetchPage(next_page_id));
+      EXPECT_EQ(page_id, next->GetPrevPageId());
+      buffer_pool_manager->UnpinPage(next_page_id, false);
+    }
+    buffer_pool_manager->UnpinPage(page_id, false);
+    page_id = next_page_id;
+  }
+  EXPECT_EQ(3u, chain);
+  txn_manager.Commit(txn);
+  delete txn;
+
+  LogRecord unlink_record(0, INVALID_LSN, LogRecordType::UNLINKPAGE, 1, 2, 3);
+  std::vector<char> buffer(unlink_record.GetSize());
+  unlink_record.SerializeTo(buffer.data());
+  LogRecord record;
+  EXPECT_FALSE(record.DeserializeFrom(buffer.data(), buffer.size() - 1));
+  EXPECT_TRUE(record.DeserializeFrom(buffer.data(), buffer.size()));
+  EXPECT_EQ(1, record.GetPrevPageId());
+  EXPECT_EQ(2, record.GetPageId());
+  EXPECT_EQ(3, record.GetNextPageId());
+
+  delete table;
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+
+/*
+ * Long varchars go to overflow pages, a tuple larger than a page is stored
+ * and read back whole. Batch scans leave the values out of line
+ */
+TEST(TablePageTest, OverflowTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar(8), c bigint");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  LockManager lock_manager(true);
+  TransactionManager txn_manager(&lock_manager);
+  TableHeap *plain = new TableHeap(bpm, &lock_manager, nullptr);
+  Transaction *txn = txn_manager.Begin();
+  RID rid;
+  EXPECT_FALSE(plain->InsertTuple(MakeTuple(schema, 0, PAGE_SIZE), rid, txn));
+  txn_manager.Abort(txn);
+  delete txn;
+
+  TableHeap *table = new TableHeap(bpm, &lock_manager, nullptr);
+  table->EnableOverflow(schema);
+  std::vector<size_t> lens{10, OVERFLOW_VARCHAR_SIZE + 1, 3 * PAGE_SIZE + 5,
+                           20};
+  std::vector<RID> rids(lens.size());
+  txn = txn_manager.Begin();
+  for (size_t i = 0; i < lens.size(); i++)
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, lens[i]), rids[i],
+                                   txn));
+  // every tuple fits the first page, the long values are out of line
+  for (size_t i = 0; i < lens.size(); i++)
+    EXPECT_EQ(rids[0].GetPageId(), rids[i].GetPageId());
+  Tuple tuple;
+  for (size_t i = 0; i < lens.size(); i++) {
+    EXPECT_TRUE(table->GetTuple(rids[i], tuple, txn));
+    ExpectTuple(schema, tuple, i, lens[i]);
+  }
+  size_t count = 0;
+  for (auto iterator = table->begin(txn); iterator != table->end();
+       ++iterator, ++count)
+    ExpectTuple(schema, *iterator, count, lens[count]);
+  EXPECT_EQ(lens.size(), count);
+
+  // a predicate keeps the rows it can not read, their columns are read
+  // from the overflow pages when asked for
+  RowBatch batch(schema);
+  batch.SetPredicates({BatchPredicate(1, CompareType::EQ,
+                                      Value(TypeId::VARCHAR, "none"))});
+  TableBatchIterator batch_iterator(table, txn);
+  EXPECT_TRUE(batch_iterator.Next(batch));
+  ASSERT_EQ(2u, batch.GetSelectedCount());
+  for (uint32_t i = 0; i < batch.GetSelectedCount(); i++) {
+    uint32_t row = batch.GetSelected(i), len;
+    const char *payload = batch.GetVarchar(1, row, len);
+    EXPECT_TRUE(IsOverflowLength(len));
+    std::string value;
+    EXPECT_TRUE(table->ReadOutOfLine(payload, len, value));
+    EXPECT_TRUE(std::string(lens[row], 'a' + row % 26) == value.c_str());
+  }
+
+  // an update takes the value out of line, and a rollback puts the old
+  // one back
+  EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, 0, 2 * PAGE_SIZE),
+                                 rids[0], txn));
+  EXPECT_TRUE(table->GetTuple(rids[0], tuple, txn));
+  ExpectTuple(schema, tuple, 0, 2 * PAGE_SIZE);
+  txn_manager.Commit(txn);
+  delete txn;
+  txn = txn_manager.Begin();
+  EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, 0, 5), rids[0], txn));
+  txn_manager.Abort(txn);
+  delete txn;
+  txn = txn_manager.Begin();
+  EXPECT_TRUE(table->GetTuple(rids[0], tuple, txn));
+  ExpectTuple(schema, tuple, 0, 2 * PAGE_SIZE);
+  txn_manager.Commit(txn);
+  delete txn;
+
+  // the bytes of an overflow page are logged for redo
+  Tuple bytes(3, nullptr);
+  memcpy(bytes.GetData(), "xyz", 3);
+  LogRecord overflow_record(0, INVALID_LSN, LogRecordType::OVERFLOWPAGE, 7,
+                            8, bytes);
+  std::vector<char> buffer(overflow_record.GetSize());
+  overflow_record.SerializeTo(buffer.data());
+  LogRecord record;
+  EXPECT_FALSE(record.DeserializeFrom(buffer.data(), buffer.size() - 1));
+  EXPECT_TRUE(record.DeserializeFrom(buffer.data(), buffer.size()));
+  EXPECT_EQ(7, record.GetPageId());
+  EXPECT_EQ(8, record.GetNextPageId());
+  EXPECT_EQ("xyz", std::string(record.GetTuple().GetData(), 3));
+
+  delete table;
+  delete plain;
+  delete bpm;
+  delete schema;
+  remove("test.db");
+}
+
+/*
+ * The chains of deleted, updated and rolled back tuples go to new chains,
+ * the heap takes no more overflow pages however often a row comes and goes
+ */
+TEST(TablePageTest, OverflowReuseTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar(8), c bigint");
+  BufferPoolManager *bpm = new BufferPoolManager(50, "test.db");
+  LockManager lock_manager(true);
+  TransactionManager txn_manager(&lock_manager);
+  TableHeap *table = new TableHeap(bpm, &lock_manager, nullptr);
+  table->EnableOverflow(schema);
+
+  size_t page_count = 0;
+  for (int i = 0; i < 10; i++) {
+    RID rid;
+    Transaction *txn = txn_manager.Begin();
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, 3 * PAGE_SIZE), rid,
+                                   txn));
+    txn_manager.Commit(txn);
+    delete txn;
+
+    txn = txn_manager.Begin();
+    EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, i, 2 * PAGE_SIZE), rid,
+                                   txn));
+    txn_manager.Commit(txn);
+    delete txn;
+
+    txn = txn_manager.Begin();
+    EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, i, 4 * PAGE_SIZE), rid,
+                                   txn));
+    txn_manager.Abort(txn);
+    delete txn;
+
+    txn = txn_manager.Begin();
+    RID aborted;
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, 3 * PAGE_SIZE),
+                                   aborted, txn));
+    txn_manager.Abort(txn);
+    delete txn;
+
+    txn = txn_manager.Begin();
+    Tuple tuple;
+    EXPECT_TRUE(table->GetTuple(rid, tuple, txn));
+    ExpectTuple(schema, tuple, i, 2 * PAGE_SIZE);
+    EXPECT_TRUE(table->MarkDelete(rid, txn));
+    txn_manager.Commit(txn);
+    delete txn;
+
+    if (i == 0)
+      page_count = table->GetOverflowPageCount();
+    EXPECT_EQ(page_count, table->GetOverflowPageCount());
+  }
+  EXPECT_LT(0u, page_count);
+
+  delete table;
+  delete bpm;
+  delete schema;
+  remove("test.db");
+}
+
+/*
+ * Threads inserting at once fill pages of their own, a page left partly
+ * full is the insertion target of one of them
+ */
+TEST(TablePageTest, ConcurrentInsertTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar(64), c bigint");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(50, "test.db");
+  TableHeap *table = new TableHeap(buffer_pool_manager, nullptr);
+  const int threads = 4;
+  const int per_thread = 2000;
+  std::vector<RID> rids(threads * per_thread);
+  std::vector<Transaction *> transactions;
+  std::vector<std::thread> writers;
+  for (int t = 0; t < threads; t++) {
+    transactions.push_back(new Transaction(t));
+    writers.emplace_back([&, t] {
+      for (int i = t * per_thread; i < (t + 1) * per_thread; i++)
+        EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, 64), rids[i],
+                                       transactions[t]));
+    });
+  }
+  for (auto &writer : writers)
+    writer.join();
+
+  Tuple tuple;
+  for (int i = 0; i < threads * per_thread; i++) {
+    EXPECT_TRUE(table->GetTuple(rids[i], tuple, transactions[0]));
+    ExpectTuple(schema, tuple, i, 64);
+  }
+  int count = 0;
+  for (auto it = table->begin(transactions[0]); it != table->end(); ++it)
+    count++;
+  EXPECT_EQ(threads * per_thread, count);
+
+  // as many pages as one thread fills, and the ones left partly full
+  TableHeap *serial = new TableHeap(buffer_pool_manager, nullptr);
+  RID rid;
+  for (int i = 0; i < threads * per_thread; i++)
+    EXPECT_TRUE(serial->InsertTuple(MakeTuple(schema, i, 64), rid,
+                                    transactions[0]));
+  std::vector<page_id_t> page_ids, serial_page_ids;
+  table->GetPageIds(page_ids);
+  serial->GetPageIds(serial_page_ids);
+  EXPECT_LE(page_ids.size(), serial_page_ids.size() + threads);
+
+  // the target of a thread in one heap is not used in another
+  EXPECT_TRUE(
+      table->InsertTuple(MakeTuple(schema, 0, 64), rid, transactions[0]));
+  page_ids.clear();
+  table->GetPageIds(page_ids);
+  EXPECT_NE(page_ids.end(),
+            std::find(page_ids.begin(), page_ids.end(), rid.GetPageId()));
+  EXPECT_EQ(serial_page_ids.end(), std::find(serial_page_ids.begin(),
+                                             serial_page_ids.end(),
+                                             rid.GetPageId()));
+
+  for (auto transaction : transactions)
+    delete transaction;
+  delete serial;
+  delete table;
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+
+/*
+ * The target of a thread that exited is no longer skipped, and its free
+ * space map entry, which the inserts into it left behind, is brought up to
+ * date before another thread looks for a page
+ */
+TEST(TablePageTest, LeftTargetTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a int, b varchar(64), c bigint");
+  BufferPoolManager *buffer_pool_manager = new BufferPoolManager(50, "test.db");
+  TableHeap *table = new TableHeap(buffer_pool_manager, nullptr);
+  Transaction txn(0);
+  RID rid;
+  std::thread writer([&] {
+    for (int i = 0; i < 10; i++)
+      EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, 64), rid, &txn));
+  });
+  writer.join();
+  page_id_t first_page_id = table->GetFirstPageId();
+  EXPECT_EQ(first_page_id, rid.GetPageId());
+
+  auto fsm_page = static_cast<FreeSpaceMapPage *>(
+      buffer_pool_manager->FetchPage(table->GetFreeSpaceMapPageId()));
+  auto page = static_cast<TablePage *>(
+      buffer_pool_manager->FetchPage(first_page_id));
+  int32_t free_space = page->GetFreeSpaceSize();
+  EXPECT_LT(free_space, fsm_page->GetFreeSpace(0));
+  // an insert too large for the page finds the entry right and takes a new
+  // one, the next goes to the page left by the writer
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 10, free_space), rid, &txn));
+  EXPECT_NE(first_page_id, rid.GetPageId());
+  EXPECT_EQ(free_space, fsm_page->GetFreeSpace(0));
+  table->ResetInsertTarget();
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 11, 64), rid, &txn));
+  EXPECT_EQ(first_page_id, rid.GetPageId());
+  buffer_pool_manager->UnpinPage(first_page_id, false);
+  buffer_pool_manager->UnpinPage(table->GetFreeSpaceMapPageId(), false);
+
+  delete table;
+  delete buffer_pool_manager;
+  delete schema;
+  remove("test.db");
+}
+} // namespace cmudb
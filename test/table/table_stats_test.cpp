@@ -0,0 +1,121 @@
+/**
+ * table_stats_test.cpp
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "table/table_heap.h"
+#include "table/table_stats.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// tuples of the table, about a hundred pages
+#define TEST_TUPLES 20000
+
+TEST(TableStatsTest, HyperLogLogTest) {
+  HyperLogLog sketch;
+  EXPECT_EQ(0, sketch.Estimate());
+  for (int64_t i = 0; i < 100; i++)
+    sketch.Add(HyperLogLog::Hash(reinterpret_cast<const char *>(&i),
+                                 sizeof(i)));
+  EXPECT_NEAR(100, sketch.Estimate(), 5);
+  // values seen again count once
+  for (int64_t i = 0; i < 100000; i++) {
+    int64_t value = i % 50000;
+    sketch.Add(HyperLogLog::Hash(reinterpret_cast<const char *>(&value),
+                                 sizeof(value)));
+  }
+  EXPECT_NEAR(50000, sketch.Estimate(), 5000);
+}
+
+TEST(TableStatsTest, HistogramTest) {
+  Histogram empty;
+  EXPECT_TRUE(empty.IsEmpty());
+  double bound = 10;
+  EXPECT_EQ(1, empty.Selectivity(&bound, nullptr));
+
+  // 0..999, and 1000 more rows of 500
+  std::vector<double> values;
+  for (int i = 0; i < 1000; i++)
+    values.push_back(i);
+  values.insert(values.end(), 1000, 500);
+  Histogram histogram(values, 32);
+  EXPECT_FALSE(histogram.IsEmpty());
+  double low = 100, high = 199;
+  EXPECT_NEAR(0.05, histogram.Selectivity(&low, &high), 0.02);
+  EXPECT_NEAR(0.95, histogram.Selectivity(&low, nullptr), 0.02);
+  EXPECT_NEAR(0.1, histogram.Selectivity(nullptr, &high), 0.02);
+  // the frequent value takes half of the rows
+  low = 500, high = 500;
+  EXPECT_NEAR(0.5, histogram.Selectivity(&low, &high), 0.05);
+  low = 2000;
+  EXPECT_EQ(0, histogram.Selectivity(&low, nullptr));
+  EXPECT_EQ(1, histogram.Selectivity(nullptr, &low));
+}
+
+TEST(TableStatsTest, AnalyzeTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("a bigint, b int, c varchar(8)");
+  BufferPoolManager *bpm = new BufferPoolManager(200, "test.db");
+  Transaction *transaction = new Transaction(0);
+  TableHeap *table = new TableHeap(bpm, nullptr);
+  TableStats stats(schema);
+  EXPECT_FALSE(stats.IsAnalyzed());
+  EXPECT_TRUE(stats.Analyze(table, transaction));
+  EXPECT_TRUE(stats.IsAnalyzed());
+  EXPECT_EQ(0, stats.GetRowCount());
+  EXPECT_EQ(0, stats.GetDistinct(0));
+
+  // a unique, b of ten values and null in every fourth row, c of a hundred
+  RID rid;
+  for (int i = 0; i < TEST_TUPLES; i++) {
+    std::vector<Value> values{
+        Value(TypeId::BIGINT, (int64_t)i),
+        Value(TypeId::INTEGER, i % 4 == 0 ? PELOTON_INT32_NULL : i % 10),
+        Value(TypeId::VARCHAR, "c" + std::to_string(i % 100))};
+    EXPECT_TRUE(table->InsertTuple(Tuple(values, schema), rid, transaction));
+  }
+  std::vector<page_id_t> page_ids;
+  table->GetPageIds(page_ids);
+  EXPECT_LT(TABLE_STATS_SAMPLE_PAGES, page_ids.size());
+
+  // every page read
+  EXPECT_TRUE(stats.Analyze(table, transaction, page_ids.size()));
+  EXPECT_EQ(TEST_TUPLES, stats.GetRowCount());
+  EXPECT_NEAR(TEST_TUPLES, stats.GetDistinct(0), TEST_TUPLES / 10);
+  EXPECT_NEAR(10, stats.GetDistinct(1), 0.5);
+  EXPECT_NEAR(100, stats.GetDistinct(2), 5);
+
+  // a sample of the pages, scaled up
+  EXPECT_TRUE(stats.Analyze(table, transaction));
+  EXPECT_NEAR(TEST_TUPLES, stats.GetRowCount(), TEST_TUPLES / 10);
+  EXPECT_NEAR(TEST_TUPLES, stats.GetDistinct(0), TEST_TUPLES / 5);
+  EXPECT_NEAR(10, stats.GetDistinct(1), 0.5);
+  EXPECT_NEAR(100, stats.GetDistinct(2), 5);
+  double low = 5000, high = 9999;
+  EXPECT_NEAR(0.25, stats.RangeSelectivity(0, &low, &high, 0.5), 0.05);
+  // nulls are in no range
+  low = 0;
+  EXPECT_NEAR(0.75, stats.RangeSelectivity(1, &low, nullptr, 0.5), 0.05);
+  // text has no histogram
+  EXPECT_EQ(0.25, stats.RangeSelectivity(2, &low, &high, 0.5));
+
+  // writes move the row count until the next analyze
+  stats.AddRows(-TEST_TUPLES * 2);
+  EXPECT_EQ(0, stats.GetRowCount());
+  EXPECT_TRUE(stats.Analyze(table, transaction, page_ids.size()));
+  EXPECT_EQ(TEST_TUPLES, stats.GetRowCount());
+
+  delete transaction;
+  delete table;
+  delete bpm;
+  delete schema;
+  remove("test.db");
+}
+
+} // namespace cmudb
@@ -85,4 +85,95 @@ TEST(TupleTest, TableHeapTest) {
   delete buffer_pool_manager;
 }
 
+TEST(TupleTest, ArenaTest) {
+  Schema *schema = ParseCreateStatement("a varchar, b bigint, c varchar");
+  Schema *key_schema = ParseCreateStatement("c varchar, b bigint");
+  std::vector<Value> values{Value(TypeId::VARCHAR, std::string("hello")),
+                            Value(TypeId::BIGINT, (int64_t)42),
+                            Value(TypeId::VARCHAR, nullptr, 0, false)};
+  Tuple tuple(values, schema);
+  Arena arena;
+  Tuple arena_tuple(values, schema, &arena);
+  EXPECT_FALSE(arena_tuple.IsAllocated());
+  ASSERT_EQ(tuple.GetLength(), arena_tuple.GetLength());
+  EXPECT_EQ(0, memcmp(tuple.GetData(), arena_tuple.GetData(),
+                      tuple.GetLength()));
+
+  // a copy owns its data, a move takes it
+  Tuple copy(arena_tuple);
+  EXPECT_TRUE(copy.IsAllocated());
+  Tuple moved(std::move(copy));
+  EXPECT_TRUE(moved.IsAllocated());
+  EXPECT_EQ(nullptr, copy.GetData());
+  Tuple assigned;
+  assigned = arena_tuple;
+  EXPECT_TRUE(assigned.IsAllocated());
+
+  // keys by their bytes are those built from values
+  Tuple key = tuple.KeyFromTuple(schema, key_schema, {2, 1}, &arena);
+  std::vector<Value> key_values{tuple.GetValue(schema, 2),
+                                tuple.GetValue(schema, 1)};
+  Tuple value_key(key_values, key_schema);
+  ASSERT_EQ(value_key.GetLength(), key.GetLength());
+  EXPECT_EQ(0, memcmp(value_key.GetData(), key.GetData(), key.GetLength()));
+  EXPECT_TRUE(key.IsNull(key_schema, 0));
+  Tuple first = tuple.KeyFromTuple(schema, key_schema, {0, 1});
+  EXPECT_TRUE(first.IsAllocated());
+  EXPECT_EQ("hello", first.GetValue(key_schema, 0).ToString());
+
+  // a reused tuple keeps a buffer large enough
+  char *data = assigned.GetData();
+  assigned = tuple;
+  EXPECT_EQ(data, assigned.GetData());
+  arena.Reset();
+  EXPECT_EQ(tuple.ToString(schema), moved.ToString(schema));
+  delete key_schema;
+  delete schema;
+}
+
+TEST(TupleTest, GetValuesTest) {
+  Schema *schema =
+      ParseCreateStatement("a bool, b smallint, c varchar(16), d bigint, "
+                           "e double, f int");
+  std::vector<Value> values{
+      Value(TypeId::BOOLEAN, static_cast<int8_t>(1)),
+      Value(TypeId::SMALLINT, static_cast<int16_t>(-7)),
+      Value(TypeId::VARCHAR, "hello"),
+      Value(TypeId::BIGINT, static_cast<int64_t>(1) << 40),
+      Value(TypeId::DECIMAL, 2.5),
+      Value(TypeId::INTEGER, PELOTON_INT32_NULL)};
+  Tuple tuple(values, schema);
+
+  // the whole row by the access plan
+  std::vector<Value> decoded;
+  tuple.GetValues(schema, decoded);
+  ASSERT_EQ(values.size(), decoded.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    EXPECT_EQ(values[i].GetTypeId(), decoded[i].GetTypeId());
+    EXPECT_EQ(values[i].ToString(), decoded[i].ToString());
+    EXPECT_EQ(values[i].ToString(), tuple.GetValue(schema, i).ToString());
+  }
+  EXPECT_TRUE(decoded[5].IsNull());
+
+  // selected columns are appended in the order asked for
+  decoded.clear();
+  tuple.GetValues(schema, {3, 2}, decoded);
+  ASSERT_EQ(2, decoded.size());
+  EXPECT_EQ(values[3].ToString(), decoded[0].ToString());
+  EXPECT_EQ("hello", decoded[1].ToString());
+  delete schema;
+}
+
+TEST(TupleTest, SharedSchemaTest) {
+  // tables of the same columns share a schema while one of them holds it
+  std::shared_ptr<Schema> schema = GetSharedSchema("a INT, b VARCHAR(16)");
+  EXPECT_EQ(schema, GetSharedSchema("a INT, b VARCHAR(16)"));
+  EXPECT_NE(schema, GetSharedSchema("a INT, b VARCHAR(17)"));
+  EXPECT_EQ(2, schema->GetColumnCount());
+  // parsed again once every table let it go
+  schema.reset();
+  schema = GetSharedSchema("a INT, b VARCHAR(16)");
+  EXPECT_EQ(2, schema->GetColumnCount());
+}
+
 } // namespace cmudb
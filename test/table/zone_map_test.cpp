@@ -0,0 +1,133 @@
+/**
+ * zone_map_test.cpp
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "table/parallel_scan.h"
+#include "table/zone_map.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// tuples of the table, about a hundred pages
+#define TEST_TUPLES 20000
+
+static Tuple MakeTuple(Schema *schema, int64_t time, int32_t value) {
+  std::vector<Value> values{Value(TypeId::BIGINT, time),
+                            Value(TypeId::INTEGER, value),
+                            Value(TypeId::VARCHAR, std::string("ab"))};
+  return Tuple(values, schema);
+}
+
+// rows a batch scan selects, and the pages it fetched
+static size_t CountRows(TableHeap *table, BufferPoolManager *bpm,
+                        Schema *schema, Transaction *txn,
+                        const std::vector<BatchPredicate> &predicates,
+                        uint64_t &fetches) {
+  RowBatch batch(schema);
+  batch.SetPredicates(predicates);
+  bpm->ResetStats();
+  size_t count = 0;
+  TableBatchIterator iterator(table, txn);
+  while (iterator.Next(batch))
+    count += batch.GetSelectedCount();
+  fetches = bpm->GetStats().fetches_;
+  return count;
+}
+
+TEST(ZoneMapTest, ScanTest) {
+  remove("test.db");
+  Schema *schema = ParseCreateStatement("t bigint, v int, s varchar(4)");
+  BufferPoolManager *bpm = new BufferPoolManager(200, "test.db");
+  Transaction *transaction = new Transaction(0);
+  TableHeap *table = new TableHeap(bpm, nullptr);
+  table->EnableZoneMap(schema);
+  EXPECT_EQ((std::vector<int>{0, 1}), table->GetZoneMap()->GetColumns());
+  RID rid;
+  std::vector<RID> rids;
+  for (int i = 0; i < TEST_TUPLES; i++) {
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, i % 10), rid,
+                                   transaction));
+    rids.push_back(rid);
+  }
+  std::vector<page_id_t> page_ids;
+  table->GetPageIds(page_ids);
+  EXPECT_LT(50u, page_ids.size());
+  // every page but the first one got its zone when it was appended
+  EXPECT_EQ(page_ids.size() - 1, table->GetZoneMap()->GetZoneCount());
+
+  // a range of time touches a few pages only
+  uint64_t fetches;
+  std::vector<BatchPredicate> range{
+      BatchPredicate(0, CompareType::GE, Value(TypeId::BIGINT, (int64_t)5000)),
+      BatchPredicate(0, CompareType::LT, Value(TypeId::BIGINT, (int64_t)5200))};
+  EXPECT_EQ(200u, CountRows(table, bpm, schema, transaction, range, fetches));
+  EXPECT_GT(5u, fetches);
+  // the first scan built the zone of the first page
+  EXPECT_EQ(page_ids.size(), table->GetZoneMap()->GetZoneCount());
+  // predicates the zones can not rule out read every page
+  std::vector<BatchPredicate> values{
+      BatchPredicate(1, CompareType::EQ, Value(TypeId::INTEGER, 3))};
+  EXPECT_EQ(TEST_TUPLES / 10u,
+            CountRows(table, bpm, schema, transaction, values, fetches));
+  EXPECT_LE(page_ids.size(), fetches);
+
+  // an update on an early page widens its zone
+  EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, 100000, 3), rids[10],
+                                 transaction));
+  std::vector<BatchPredicate> late{BatchPredicate(
+      0, CompareType::GT, Value(TypeId::BIGINT, (int64_t)TEST_TUPLES))};
+  EXPECT_EQ(1u, CountRows(table, bpm, schema, transaction, late, fetches));
+  EXPECT_GT(3u, fetches);
+  // deleted tuples are skipped by the zone built next, their rollback adds
+  // them back
+  TableHeap *other = new TableHeap(bpm, nullptr, nullptr,
+                                   table->GetFirstPageId(),
+                                   table->GetFreeSpaceMapPageId());
+  other->EnableZoneMap(schema);
+  EXPECT_TRUE(other->MarkDelete(rids[0], transaction));
+  std::vector<BatchPredicate> first{
+      BatchPredicate(0, CompareType::EQ, Value(TypeId::BIGINT, (int64_t)0))};
+  EXPECT_EQ(0u, CountRows(other, bpm, schema, transaction, first, fetches));
+  EXPECT_EQ(0u, CountRows(other, bpm, schema, transaction, first, fetches));
+  EXPECT_EQ(0u, fetches);
+  other->RollbackDelete(rids[0], nullptr);
+  EXPECT_EQ(1u, CountRows(other, bpm, schema, transaction, first, fetches));
+  // a decimal constant against an integer column, a null one matches nothing
+  std::vector<BatchPredicate> decimal{
+      BatchPredicate(0, CompareType::LE, Value(TypeId::DECIMAL, 0.5))};
+  EXPECT_EQ(1u, CountRows(table, bpm, schema, transaction, decimal, fetches));
+  EXPECT_GT(3u, fetches);
+  std::vector<BatchPredicate> null{BatchPredicate(
+      1, CompareType::NE, Value(TypeId::INTEGER, PELOTON_INT32_NULL))};
+  EXPECT_EQ(0u, CountRows(table, bpm, schema, transaction, null, fetches));
+  EXPECT_EQ(0u, fetches);
+
+  // the parallel scan skips the same pages
+  ParallelTableScan scan(table, transaction, 2, 4);
+  std::vector<RowBatch *> batches{new RowBatch(schema), new RowBatch(schema)};
+  for (auto batch : batches)
+    batch->SetPredicates(range);
+  size_t counts[2] = {0, 0};
+  bpm->ResetStats();
+  scan.Run(batches, [&](RowBatch &batch, size_t worker) {
+    counts[worker] += batch.GetSelectedCount();
+  });
+  EXPECT_EQ(200u, counts[0] + counts[1]);
+  EXPECT_GT(5u, bpm->GetStats().fetches_);
+  for (auto batch : batches)
+    delete batch;
+
+  delete other;
+  delete transaction;
+  delete table;
+  delete bpm;
+  delete schema;
+  remove("test.db");
+}
+
+} // namespace cmudb
@@ -2,6 +2,7 @@
  * type_test.cpp
  */
 #include "common/exception.h"
+#include "type/type_util.h"
 #include "type/value.h"
 #include "gtest/gtest.h"
 
@@ -76,4 +77,78 @@ TEST(TypeTests, TemplateTest) {
   BPlusTreePage<Value, Value> node;
   node.GetInfo(val1, val2);
 }
+
+TEST(TypeTests, VarcharStorageTest) {
+  std::string short_text = "hello";
+  std::string long_text(100, 'x');
+  Value short_value(TypeId::VARCHAR, short_text);
+  Value long_value(TypeId::VARCHAR, long_text);
+  // a short varchar lives in the value
+  const char *begin = reinterpret_cast<const char *>(&short_value);
+  EXPECT_LE(begin, short_value.GetData());
+  EXPECT_GT(begin + sizeof(Value), short_value.GetData());
+  EXPECT_EQ(short_text, short_value.ToString());
+
+  // copies are deep and moves steal, the moved from value is null
+  Value copy(short_value);
+  EXPECT_NE(short_value.GetData(), copy.GetData());
+  EXPECT_EQ(CMP_TRUE, copy.CompareEquals(short_value));
+  const char *data = long_value.GetData();
+  Value moved(std::move(long_value));
+  EXPECT_EQ(data, moved.GetData());
+  EXPECT_TRUE(long_value.IsNull());
+  copy = moved;
+  EXPECT_EQ(long_text, copy.ToString());
+  copy = std::move(short_value);
+  EXPECT_EQ(short_text, copy.ToString());
+
+  // a view borrows the stored bytes, compares as the deserialized value
+  char storage[sizeof(uint32_t) + 101];
+  moved.SerializeTo(storage);
+  Value view = Value::ViewFrom(storage, TypeId::VARCHAR);
+  EXPECT_EQ(storage + sizeof(uint32_t), view.GetData());
+  Value deserialized = Value::DeserializeFrom(storage, TypeId::VARCHAR);
+  EXPECT_NE(storage + sizeof(uint32_t), deserialized.GetData());
+  EXPECT_EQ(CMP_TRUE, view.CompareEquals(deserialized));
+  EXPECT_EQ(CMP_TRUE, view.CompareGreaterThan(copy));
+  Value(TypeId::VARCHAR, nullptr, 0, false).SerializeTo(storage);
+  EXPECT_TRUE(Value::ViewFrom(storage, TypeId::VARCHAR).IsNull());
+}
+
+TEST(TypeTests, CompareRawTest) {
+  // values of each type in order, the last one null
+  std::vector<std::vector<Value>> columns{
+      {Value(TypeId::BOOLEAN, (int8_t)0), Value(TypeId::BOOLEAN, (int8_t)1),
+       Value(TypeId::BOOLEAN, (int8_t)PELOTON_BOOLEAN_NULL)},
+      {Value(TypeId::TINYINT, (int8_t)-5), Value(TypeId::TINYINT, (int8_t)7),
+       Value(TypeId::TINYINT, (int8_t)PELOTON_INT8_NULL)},
+      {Value(TypeId::SMALLINT, (int16_t)-300),
+       Value(TypeId::SMALLINT, (int16_t)300),
+       Value(TypeId::SMALLINT, (int16_t)PELOTON_INT16_NULL)},
+      {Value(TypeId::INTEGER, -70000), Value(TypeId::INTEGER, 70000),
+       Value(TypeId::INTEGER, PELOTON_INT32_NULL)},
+      {Value(TypeId::BIGINT, -((int64_t)1 << 40)),
+       Value(TypeId::BIGINT, (int64_t)1 << 40),
+       Value(TypeId::BIGINT, (int64_t)PELOTON_INT64_NULL)},
+      {Value(TypeId::DECIMAL, -0.5), Value(TypeId::DECIMAL, 2.25),
+       Value(TypeId::DECIMAL, PELOTON_DECIMAL_NULL)},
+      {Value(TypeId::VARCHAR, std::string("ab")),
+       Value(TypeId::VARCHAR, std::string("abc")),
+       Value(TypeId::VARCHAR, nullptr, 0, false)}};
+  // the kernels agree with the comparisons of Values
+  char left[64], right[64];
+  for (auto &column : columns) {
+    for (auto &lhs : column) {
+      for (auto &rhs : column) {
+        lhs.SerializeTo(left);
+        rhs.SerializeTo(right);
+        int expected = lhs.CompareLessThan(rhs) == CMP_TRUE
+                           ? -1
+                           : lhs.CompareGreaterThan(rhs) == CMP_TRUE;
+        EXPECT_EQ(expected, TypeUtil::CompareRaw(lhs.GetTypeId(), left, right))
+            << lhs.ToString() << " " << rhs.ToString();
+      }
+    }
+  }
+}
 } // namespace cmudb
@@ -1,6 +1,17 @@
 /**
  * virtual_table_test.cpp
  */
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "buffer/page_trace.h"
+#include "catalog/catalog.h"
+#include "common/latch_stats.h"
 #include "vtable/testing_vtable_util.h"
 
 namespace cmudb {
@@ -12,6 +23,7 @@ TEST(VtableTest, CreateTest) {
   std::string db_file = "sqlite.db";
   remove(db_file.c_str());
   remove("vtable.db");
+  remove("vtable.log");
   sqlite3 *db;
   int rc;
   rc = sqlite3_open(db_file.c_str(), &db);
@@ -42,6 +54,2360 @@ TEST(VtableTest, CreateTest) {
 
   remove(db_file.c_str());
   remove("vtable.db");
+  remove("vtable.log");
   return;
 }
+
+// first column of the first row, -1 if there is none
+static int64_t QueryInt(sqlite3 *db, const std::string &sql) {
+  sqlite3_stmt *stmt;
+  int64_t result = -1;
+  EXPECT_EQ(SQLITE_OK, sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0));
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    result = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+  return result;
+}
+
+// first column of the first row as text, empty if there is none
+static std::string QueryText(sqlite3 *db, const std::string &sql) {
+  sqlite3_stmt *stmt;
+  std::string result;
+  EXPECT_EQ(SQLITE_OK, sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0));
+  if (sqlite3_step(stmt) == SQLITE_ROW &&
+      sqlite3_column_text(stmt, 0) != nullptr)
+    result = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+  sqlite3_finalize(stmt);
+  return result;
+}
+
+// detail of the plan, e.g. "SCAN TABLE foo VIRTUAL TABLE INDEX 6:"
+static std::string QueryPlan(sqlite3 *db, const std::string &sql) {
+  sqlite3_stmt *stmt;
+  std::string plan;
+  std::string explain = "EXPLAIN QUERY PLAN " + sql;
+  EXPECT_EQ(SQLITE_OK, sqlite3_prepare_v2(db, explain.c_str(), -1, &stmt, 0));
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    plan = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+  sqlite3_finalize(stmt);
+  return plan;
+}
+
+TEST(VtableTest, RangeScanTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b bigint', 'foo_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                std::to_string(i * 2) + ", " +
+                                std::to_string(i) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE a > 10 AND a <= 20")
+                .find("INDEX 86:"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE a = 10").find("INDEX 1:"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b > 10").find("INDEX 0:"));
+
+  EXPECT_EQ(5, QueryInt(db, "SELECT count(*) FROM foo WHERE a > 10 AND "
+                            "a <= 20"));
+  EXPECT_EQ(6, QueryInt(db, "SELECT count(*) FROM foo WHERE a >= 10 AND "
+                            "a < 21"));
+  EXPECT_EQ(5, QueryInt(db, "SELECT count(*) FROM foo WHERE a < 10"));
+  EXPECT_EQ(995, QueryInt(db, "SELECT count(*) FROM foo WHERE a > 9"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a > 1998"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a > 30 AND "
+                            "a < 20"));
+  // loosened bounds, sqlite drops the extra rows
+  EXPECT_EQ(3, QueryInt(db, "SELECT count(*) FROM foo WHERE a > 9.5 AND "
+                            "a < 14.5"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo WHERE "
+                               "a > -5000000000"));
+  // in key order
+  EXPECT_EQ(100, QueryInt(db, "SELECT a FROM foo WHERE a >= 99"));
+  EXPECT_EQ(50, QueryInt(db, "SELECT b FROM foo WHERE a >= 99"));
+
+  EXPECT_EQ(20, QueryInt(db, "SELECT b FROM foo WHERE a = 40"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 41"));
+  // a scan cut short gives back its leaf, the insert would wait for it
+  EXPECT_EQ(14, QueryInt(db, "SELECT max(a) FROM (SELECT a FROM foo WHERE "
+                             "a >= 10 LIMIT 3)"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(11, 11)"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a = 11"));
+
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a >= 100 AND a < 200"));
+  EXPECT_EQ(950, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(200, QueryInt(db, "SELECT a FROM foo WHERE a > 98"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, ColumnTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b varchar, c smallint, d bigint, "
+                          "e double', 'foo_pk a')"));
+  // keys in reverse order of insertion, index scans hop between pages
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 500; i++) {
+    int a = 499 - i;
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(a) +
+                                ", '" + std::string(a % 50, 'x') + "', " +
+                                std::to_string(a % 7) + ", " +
+                                std::to_string(a * 10000000000LL) + ", " +
+                                std::to_string(a) + ".5)"));
+  }
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  for (std::string where : {"", " WHERE a >= 0"}) {
+    EXPECT_EQ(500, QueryInt(db, "SELECT count(*) FROM foo" + where));
+    EXPECT_EQ(12250, QueryInt(db, "SELECT sum(length(b)) FROM foo" + where));
+    EXPECT_EQ(1494, QueryInt(db, "SELECT sum(c) FROM foo" + where));
+    EXPECT_EQ(124750, QueryInt(db, "SELECT sum(d / 10000000000) FROM foo" +
+                                       where));
+    EXPECT_EQ(125000, QueryInt(db, "SELECT sum(e) FROM foo" + where));
+  }
+  EXPECT_EQ(17, QueryInt(db, "SELECT length(b) FROM foo WHERE a = 117"));
+  EXPECT_EQ(117, QueryInt(db, "SELECT a FROM foo WHERE b = '" +
+                                  std::string(17, 'x') +
+                                  "' AND a > 100 ORDER BY a"));
+  // the text outlives the row it was read from
+  EXPECT_EQ(49, QueryInt(db, "SELECT length(max(b)) FROM foo WHERE a < 60"));
+  // the inner sequential scan starts over for every outer row
+  EXPECT_EQ(216, QueryInt(db, "SELECT count(*) FROM foo x, foo y WHERE "
+                              "x.a < 3 AND y.c = x.c"));
+  // a null text is stored as a null varchar
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(500, NULL, 0, 0, 0)"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT count(*) FROM foo WHERE b IS NULL"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT b IS NULL FROM foo WHERE a = 500"));
+  // a text larger than a page is kept out of line, and read when asked for
+  std::string text(3 * PAGE_SIZE, 'y');
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(501, '" + text +
+                              "', 0, 0, 0)"));
+  EXPECT_EQ(3 * PAGE_SIZE,
+            QueryInt(db, "SELECT length(b) FROM foo WHERE a = 501"));
+  EXPECT_EQ(3 * PAGE_SIZE,
+            QueryInt(db, "SELECT max(length(b)) FROM foo WHERE c = 0"));
+  EXPECT_EQ(501, QueryInt(db, "SELECT a FROM foo WHERE b = '" + text + "'"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'y'"));
+  // an update outgrowing the page keeps the rid, and the index entry unless
+  // the key changes
+  EXPECT_TRUE(ExecSQL(db, "CREATE TEMP TABLE r AS SELECT rowid AS id FROM "
+                          "foo WHERE a = 117"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = '" +
+                              std::string(1000, 'z') + "' WHERE a = 117"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT length(b) FROM foo WHERE a = 117 AND "
+                               "rowid IN (SELECT id FROM r)"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET a = 1117 WHERE a = 117"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT length(b) FROM foo WHERE a = 117"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT length(b) FROM foo WHERE a = 1117"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, PushDownTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b varchar, c bigint, d double', "
+                          "'foo_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 2000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", 'b" + std::to_string(i % 10) + "', " +
+                                std::to_string(i % 100) + ", " +
+                                std::to_string(i) + ".25)"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // colUsed, then the constraints on non-indexed numeric columns
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT a FROM foo WHERE c = 5 AND d < 100")
+                .find("INDEX 0:d =2 <3"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT a FROM foo WHERE b = 'b1'")
+                .find("INDEX 0:3"));
+
+  EXPECT_EQ(20, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 5"));
+  EXPECT_EQ(2, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 5 AND "
+                            "d < 200"));
+  EXPECT_EQ(110, QueryInt(db, "SELECT sum(a) FROM foo WHERE c = 5 AND "
+                              "d < 200"));
+  EXPECT_EQ(600, QueryInt(db, "SELECT count(*) FROM foo WHERE c >= 10 AND "
+                              "c < 40"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT count(*) FROM foo WHERE d > 1998.25"));
+  EXPECT_EQ(2, QueryInt(db, "SELECT count(*) FROM foo WHERE d >= 1998.25"));
+  EXPECT_EQ(20, QueryInt(db, "SELECT count(*) FROM foo WHERE c <= 4.5 AND "
+                             "c > 3.5"));
+  // text and null constants are left to sqlite
+  EXPECT_EQ(20, QueryInt(db, "SELECT count(*) FROM foo WHERE c = '5'"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE c = NULL"));
+  EXPECT_EQ(200, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b3'"));
+  EXPECT_EQ(20, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b3' AND "
+                             "c = 13"));
+  // constraints of a join, the constant changes for every outer row
+  EXPECT_EQ(60, QueryInt(db, "SELECT count(*) FROM foo x, foo y WHERE "
+                             "x.a < 3 AND y.c = x.a"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE c = 7"));
+  EXPECT_EQ(1980, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 7"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, MultiIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT, c varchar', 'unique foo_pk a', "
+                          "'foo_b b', 'foo_c c using hash')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i % 100) + ", 'c" +
+                                std::to_string(i % 10) + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // each query scans the index of its column, the unique one if several fit
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE a = 7").find("1:foo_pk"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b = 7").find("257:foo_b"));
+  EXPECT_NE(std::string::npos, QueryPlan(db, "SELECT * FROM foo WHERE b > 97")
+                                   .find("322:foo_b"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE c = 'c7'").find(":foo_c"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b = 7 AND a = 7")
+                .find(":foo_pk"));
+  EXPECT_EQ(7, QueryInt(db, "SELECT b FROM foo WHERE a = 107"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(20, QueryInt(db, "SELECT count(*) FROM foo WHERE b > 97"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 'c7'"));
+
+  // every index follows updates and deletes
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 1000 WHERE a < 10"));
+  EXPECT_EQ(9, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 1000"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET c = 'x' WHERE b = 1000"));
+  EXPECT_EQ(99, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 'c7'"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 'x'"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET a = a + 2000 WHERE c = 'x'"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT b FROM foo WHERE a = 2005"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 5"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE b = 1000"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 'x'"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 2005"));
+  // a rollback puts back the entries of each index
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 5000, c = 'y' WHERE a = 17"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a = 18"));
+  EXPECT_TRUE(ExecSQL(db, "ROLLBACK"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 5000"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 17"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 18"));
+  EXPECT_EQ(99, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 'c7'"));
+
+  // the indexes are found again by the next connection
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_EQ(17, QueryInt(db, "SELECT b FROM foo WHERE a = 117"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 17"));
+  EXPECT_EQ(99, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 'c3'"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, CoveringTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b bigint, c varchar', "
+                          "'foo_a a include b')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                std::to_string(i % 100) + ", " +
+                                std::to_string(i) + ", 'row')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // b is read from the leaves, c from the heap
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT b FROM foo WHERE a = 5").find("INDEX 33:"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT c FROM foo WHERE a = 5").find("INDEX 1:"));
+  auto fetches = [&]() {
+    return QueryInt(db, "SELECT value FROM vtable_stats WHERE name = "
+                        "'fetches'");
+  };
+  int64_t before = fetches();
+  EXPECT_EQ(4550, QueryInt(db, "SELECT sum(b) FROM foo WHERE a = 5"));
+  int64_t covering = fetches() - before;
+  before = fetches();
+  EXPECT_EQ(30, QueryInt(db, "SELECT sum(length(c)) FROM foo WHERE a = 5"));
+  EXPECT_LT(covering, fetches() - before);
+  // a covering range is read from the leaves however wide
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT sum(b) FROM foo WHERE a >= 10")
+                .find("INDEX 42:"));
+  EXPECT_EQ(54450, QueryInt(db, "SELECT sum(b) FROM foo WHERE a >= 90"));
+
+  // the leaves follow the include column
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = b + 1 WHERE a = 5"));
+  EXPECT_EQ(4560, QueryInt(db, "SELECT sum(b) FROM foo WHERE a = 5"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 0 WHERE a = 5"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT sum(b) FROM foo WHERE a = 5"));
+  EXPECT_TRUE(ExecSQL(db, "ROLLBACK"));
+  EXPECT_EQ(4560, QueryInt(db, "SELECT sum(b) FROM foo WHERE a = 5"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE b = 6"));
+  EXPECT_EQ(4554, QueryInt(db, "SELECT sum(b) FROM foo WHERE a = 5"));
+
+  // and are read back after a restart
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_EQ(4554, QueryInt(db, "SELECT sum(b) FROM foo WHERE a = 5"));
+  EXPECT_EQ(9, QueryInt(db, "SELECT count(*) FROM foo WHERE a = 5"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, ByPageTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b varchar', 'foo_pk a')"));
+  // keys scattered over the pages
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  std::string padding(100, 'x');
+  for (int i = 0; i < 2000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                std::to_string(i * 7919 % 2000) + ", '" +
+                                padding + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  std::string range = "FROM foo WHERE a >= 500 AND a < 1000";
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT b " + range).find("INDEX 78:"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT b " + range + " ORDER BY a")
+                .find("INDEX 142:"));
+  auto fetches = [&]() {
+    return QueryInt(db, "SELECT value FROM vtable_stats WHERE name = "
+                        "'fetches'");
+  };
+  int64_t before = fetches();
+  EXPECT_EQ(50000, QueryInt(db, "SELECT sum(length(b)) " + range));
+  int64_t by_page = fetches() - before;
+  before = fetches();
+  EXPECT_EQ(500, QueryInt(db, "SELECT a + length(b) - 100 " + range +
+                                  " ORDER BY a"));
+  EXPECT_EQ(50000, QueryInt(db, "SELECT sum(length(b)) FROM (SELECT b " +
+                                    range + " ORDER BY a)"));
+  EXPECT_LT(by_page, fetches() - before);
+  EXPECT_EQ(999, QueryInt(db, "SELECT a + length(b) - 100 " + range +
+                                  " ORDER BY a DESC"));
+  // a delete reads its rows page by page too
+  EXPECT_TRUE(ExecSQL(db, "DELETE " + range));
+  EXPECT_EQ(1500, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, ClusterTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b varchar, c INT', "
+                          "'unique clustered foo_pk a', 'foo_c c')"));
+  // a buffer of rows is written in key order
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  std::string padding(100, 'x');
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                std::to_string(i * 7919 % 1000) + ", '" +
+                                padding + "', " + std::to_string(i % 10) +
+                                ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  // rows of consecutive keys a sequential scan reads backwards
+  auto out_of_order = [&]() {
+    EXPECT_TRUE(ExecSQL(db, "DROP TABLE IF EXISTS t"));
+    EXPECT_TRUE(ExecSQL(db, "CREATE TEMP TABLE t AS SELECT a FROM foo"));
+    return QueryInt(db, "SELECT count(*) FROM t x, t y WHERE y.a = x.a + 1 "
+                        "AND y.rowid < x.rowid");
+  };
+  EXPECT_EQ(0, out_of_order());
+
+  // a clustered range is read in key order, it is in page order too
+  std::string range = "FROM foo WHERE a >= 250 AND a < 750";
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT b " + range).find("INDEX 14:"));
+  EXPECT_EQ(50000, QueryInt(db, "SELECT sum(length(b)) " + range));
+
+  // rows inserted one at a time go next to their neighbors while there is
+  // room, vtable_cluster puts the others back in order
+  for (int i = 0; i < 100; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                std::to_string(1099 - i) + ", '" + padding +
+                                "', 0)"));
+  EXPECT_LT(0, out_of_order());
+  EXPECT_EQ(1100, QueryInt(db, "SELECT vtable_cluster('foo')"));
+  EXPECT_EQ(0, out_of_order());
+  EXPECT_EQ(1100, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(200, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 0"));
+  EXPECT_EQ(7, QueryInt(db, "SELECT c FROM foo WHERE a = 533"));
+  EXPECT_FALSE(ExecSQL(db, "SELECT vtable_cluster('bar')"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_EQ(1100, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(0, out_of_order());
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 7"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, MinMaxTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b varchar, c INT', 'foo_a a', "
+                          "'unique foo_c c')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  std::string padding(100, 'x');
+  for (int i = 0; i < 2000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                std::to_string(i * 7919 % 2000) + ", '" +
+                                padding + "', " + std::to_string(i) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // min() reads the first entry of the index, an ORDER BY of its key the
+  // whole index in order
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT min(a) FROM foo").find("INDEX 160:"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT b FROM foo ORDER BY a").find("INDEX 128:"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT min(a) FROM foo"));
+  EXPECT_EQ(1999, QueryInt(db, "SELECT max(a) FROM foo"));
+  EXPECT_EQ(3, QueryInt(db, "SELECT sum(a) FROM (SELECT a FROM foo "
+                            "ORDER BY a LIMIT 3)"));
+  // a descending ORDER BY reads the index backwards, of a range too
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT b FROM foo ORDER BY a DESC")
+                .find("INDEX 536871040:"));
+  EXPECT_EQ("1999,1998,1997",
+            QueryText(db, "SELECT group_concat(a) FROM (SELECT a FROM foo "
+                          "ORDER BY a DESC LIMIT 3)"));
+  EXPECT_EQ("20,19,18,17,16,15,14,13,12,11",
+            QueryText(db, "SELECT group_concat(a) FROM (SELECT a FROM foo "
+                          "WHERE a > 10 AND a <= 20 ORDER BY a DESC)"));
+  // the first rows in either order touch a handful of pages
+  auto fetches = [&]() {
+    return QueryInt(db, "SELECT value FROM vtable_stats WHERE name = "
+                        "'fetches'");
+  };
+  for (const char *order : {"", " DESC"}) {
+    int64_t before = fetches();
+    EXPECT_EQ(10, QueryInt(db, std::string("SELECT count(*) FROM (SELECT a "
+                                           "FROM foo ORDER BY a") +
+                                   order + " LIMIT 10)"));
+    EXPECT_GT(8, fetches() - before);
+  }
+
+  // the functions read the ends of the index and the sizes of its leaves
+  EXPECT_EQ(0, QueryInt(db, "SELECT vtable_min('foo', 'a')"));
+  EXPECT_EQ(1999, QueryInt(db, "SELECT vtable_max('foo', 'a')"));
+  EXPECT_EQ(2000, QueryInt(db, "SELECT vtable_count('foo')"));
+  EXPECT_FALSE(ExecSQL(db, "SELECT vtable_min('foo', 'b')"));
+  EXPECT_FALSE(ExecSQL(db, "SELECT vtable_count('bar')"));
+  // nulls are first in the index, the least value skips them
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(NULL, 'null', 2000)"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT vtable_min('foo', 'a')"));
+  EXPECT_EQ(2001, QueryInt(db, "SELECT vtable_count('foo')"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE c = 2000"));
+
+  // rows buffered by the transaction are counted, deleted ones are not
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(5000, 'y', 5000)"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a < 10"));
+  EXPECT_EQ(1991, QueryInt(db, "SELECT vtable_count('foo')"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT vtable_min('foo', 'a')"));
+  EXPECT_EQ(5000, QueryInt(db, "SELECT vtable_max('foo', 'a')"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT min(a) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "ROLLBACK"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT vtable_min('foo', 'a')"));
+  EXPECT_EQ(2000, QueryInt(db, "SELECT vtable_count('foo')"));
+
+  // an empty index has no value
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT vtable_count('foo')"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT vtable_min('foo', 'a') IS NULL"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT vtable_max('foo', 'a') IS NULL"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT min(a) IS NULL FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, NullTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b BIGINT, c DOUBLE, d SMALLINT, "
+                          "e varchar', 'foo_a a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  // every third row is null in all its columns
+  for (int i = 0; i < 300; i++)
+    EXPECT_TRUE(ExecSQL(
+        db, i % 3 == 0
+                ? "INSERT INTO foo VALUES(NULL, NULL, NULL, NULL, NULL)"
+                : "INSERT INTO foo VALUES(" + std::to_string(i) + ", " +
+                      std::to_string(i) + ", 0.5, 1, 'x')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // nulls read back as sqlite's NULL, in scans of the heap and the index
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo WHERE b IS NULL"));
+  EXPECT_EQ(200, QueryInt(db, "SELECT count(*) FROM foo WHERE c IS NOT NULL"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo WHERE d IS NULL AND "
+                              "e IS NULL"));
+  EXPECT_EQ(200, QueryInt(db, "SELECT count(a) FROM foo"));
+  EXPECT_EQ(200, QueryInt(db, "SELECT sum(d) FROM foo"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a < 1"));
+  EXPECT_EQ(2, QueryInt(db, "SELECT count(*) FROM foo WHERE a < 3"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT vtable_min('foo', 'a')"));
+  // a null written by an update
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = NULL WHERE a = 1"));
+  EXPECT_EQ(101, QueryInt(db, "SELECT count(*) FROM foo WHERE b IS NULL"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, HashOperatorTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b DOUBLE, c varchar', 'foo_a a')"));
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE bar USING vtable "
+                          "('x BIGINT, y varchar', 'bar_x x')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  // a is i % 100 with a null every 50 rows, x is 0..199
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                (i % 50 == 49 ? std::string("NULL")
+                                              : std::to_string(i % 100)) +
+                                ", " + std::to_string(i) + ".5, 'k" +
+                                std::to_string(i % 7) + "')"));
+  for (int i = 0; i < 200; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO bar VALUES(" + std::to_string(i) +
+                                ", 'k" + std::to_string(i % 7) + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // the same pairs as sqlite's join, null keys match nothing
+  int joined = QueryInt(db, "SELECT count(*) FROM foo, bar WHERE a = x");
+  EXPECT_EQ(980, joined);
+  EXPECT_EQ(joined, QueryInt(db, "SELECT count(*) FROM "
+                                 "vtable_hash_join('foo', 'a', 'bar', 'x')"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM "
+                            "vtable_hash_join('foo', 'a', 'bar', 'x') "
+                            "WHERE key < 0 OR key > 98 OR key = 49"));
+  EXPECT_EQ(joined, QueryInt(db, "SELECT count(*) FROM "
+                                 "vtable_hash_join('bar', 'x', 'foo', 'a') "
+                                 "j, foo WHERE foo.rowid = j.right_rowid AND "
+                                 "foo.a = j.key"));
+  EXPECT_EQ(QueryInt(db, "SELECT count(*) FROM foo, bar WHERE c = y"),
+            QueryInt(db, "SELECT count(*) FROM "
+                         "vtable_hash_join('foo', 'c', 'bar', 'y')"));
+
+  // the groups of GROUP BY, the null keys in one
+  EXPECT_EQ(QueryInt(db, "SELECT count(DISTINCT a) + 1 FROM foo"),
+            QueryInt(db, "SELECT count(*) FROM "
+                         "vtable_hash_group('foo', 'a', 'b')"));
+  EXPECT_EQ(20, QueryInt(db, "SELECT count FROM "
+                             "vtable_hash_group('foo', 'a', 'b') "
+                             "WHERE key IS NULL"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM "
+                            "vtable_hash_group('foo', 'a', 'b') g, (SELECT "
+                            "a, count(*) n, sum(b) s, min(b) lo, max(b) hi "
+                            "FROM foo GROUP BY a) f WHERE g.key = f.a AND "
+                            "(g.count <> f.n OR g.sum <> f.s OR g.min <> "
+                            "f.lo OR g.max <> f.hi)"));
+  EXPECT_EQ(7, QueryInt(db, "SELECT count(*) FROM "
+                            "vtable_hash_group('bar', 'y')"));
+  EXPECT_EQ(200, QueryInt(db, "SELECT sum(count) FROM "
+                              "vtable_hash_group('bar', 'y') WHERE sum "
+                              "IS NULL"));
+
+  // the arguments are checked
+  EXPECT_FALSE(ExecSQL(db, "SELECT * FROM vtable_hash_join('foo', 'a')"));
+  EXPECT_FALSE(ExecSQL(db, "SELECT * FROM "
+                           "vtable_hash_join('foo', 'z', 'bar', 'x')"));
+  EXPECT_FALSE(ExecSQL(db, "SELECT * FROM vtable_hash_group('baz', 'a')"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE bar"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, SortTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b varchar, c DOUBLE', 'foo_a a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  // c repeats and is null every 13 rows, b has a few long values
+  for (int i = 0; i < 3000; i++)
+    EXPECT_TRUE(ExecSQL(
+        db, "INSERT INTO foo VALUES(" + std::to_string(i * 7919 % 3000) +
+                ", '" + std::string(i % 97 == 0 ? 3000 : 1 + i % 5, 'a' + i % 3) +
+                "', " +
+                (i % 13 == 0 ? std::string("NULL")
+                             : std::to_string((i % 50) - 25) + ".5") +
+                ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  EXPECT_TRUE(ExecSQL(db, "CREATE TABLE bar AS SELECT * FROM foo"));
+
+  // the scans sort the rows themselves, as sqlite would
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo ORDER BY c DESC, b")
+                .find("|-2 +1"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE a < 100 ORDER BY b")
+                .find(":foo_a|+1"));
+  EXPECT_EQ(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo ORDER BY a").find("|"));
+  for (std::string order : {"c DESC, a", "c, b DESC, a", "b, a DESC",
+                            "a DESC"})
+    for (std::string where : {"", " WHERE a < 100", " WHERE c > 0"}) {
+      std::string rows = "SELECT group_concat(a) FROM (SELECT a FROM ";
+      std::string expected = QueryText(db, rows + "bar" + where +
+                                               " ORDER BY " + order + ")");
+      EXPECT_FALSE(expected.empty());
+      EXPECT_EQ(expected, QueryText(db, rows + "foo" + where + " ORDER BY " +
+                                            order + ")"));
+    }
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE bar"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, AnalyzeTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  // b has two values
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'unique foo_pk a', 'foo_b b')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 2000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i % 2) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  // the values of b are not known yet, a key is taken to have a few rows
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b = 1").find(":foo_b"));
+
+  EXPECT_EQ(2000, QueryInt(db, "SELECT vtable_analyze('foo')"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT vtable_analyze()"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT vtable_analyze('bar')"));
+  // half of the table is cheaper to read in page order
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b = 1").find("INDEX 0:"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 1"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE a = 1").find(":foo_pk"));
+  // a range too wide for the histogram is scanned in page order as well
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE a > 100").find(":foo_pk"));
+  EXPECT_EQ(1899, QueryInt(db, "SELECT count(*) FROM foo WHERE a > 100"));
+  EXPECT_EQ(1900, QueryInt(db, "SELECT count(*) FROM foo WHERE a >= 99.5"));
+  EXPECT_EQ(1001, QueryInt(db, "SELECT count(*) FROM foo WHERE a >= 100 AND "
+                               "a <= 1100"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE a > 100 AND "
+                             "a <= 110"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a > 100 AND "
+                            "a < 50"));
+  EXPECT_EQ(500, QueryInt(db, "SELECT count(*) FROM foo WHERE a < 1000 AND "
+                              "b = 0"));
+
+  // the row count follows the writes, the statistics are sampled again by
+  // the next connection
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a >= 1000"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b = 1").find("INDEX 0:"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT vtable_analyze('foo')"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, DuplicateKeyTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  // ten rows per value of b
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'foo_b b')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 500; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i % 50) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b = 7").find("INDEX 1:"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(457, QueryInt(db, "SELECT max(a) FROM foo WHERE b = 7"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 50"));
+  EXPECT_EQ(30, QueryInt(db, "SELECT count(*) FROM foo WHERE b > 46"));
+
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE b = 7 AND a < 200"));
+  EXPECT_EQ(6, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 7 WHERE b = 8"));
+  EXPECT_EQ(16, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 8"));
+  EXPECT_EQ(496, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  // a unique index keeps one entry per key
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE bar USING vtable "
+                          "('a INT, b INT', 'unique bar_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO bar VALUES(1, 2)"));
+  EXPECT_EQ(2, QueryInt(db, "SELECT b FROM bar WHERE a = 1"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE bar"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+/*
+ * Inserted rows are buffered and written a buffer at a time, reads and
+ * changes of the table see them
+ */
+TEST(VtableTest, InsertBufferTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  // keys in descending order, more rows than a buffer holds
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'unique foo_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 2499; i >= 0; i--)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i * 2) + ")"));
+  EXPECT_EQ(2500, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  EXPECT_EQ(2468, QueryInt(db, "SELECT b FROM foo WHERE a = 1234"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT b FROM foo WHERE a = 0"));
+  EXPECT_EQ(499, QueryInt(db, "SELECT count(*) FROM foo WHERE a > 2000"));
+
+  // rows of one statement read from another table
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE bar USING vtable "
+                          "('a INT, b INT', 'bar_b b')"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO bar SELECT a, b % 10 FROM foo"));
+  EXPECT_EQ(2500, QueryInt(db, "SELECT count(*) FROM bar"));
+  EXPECT_EQ(500, QueryInt(db, "SELECT count(*) FROM bar WHERE b = 4"));
+  // a buffered row is deleted and updated
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO bar VALUES(5000, 7)"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE bar SET b = 9 WHERE a = 5000"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT count(*) FROM bar WHERE b = 9"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM bar WHERE b = 9"));
+  EXPECT_EQ(2500, QueryInt(db, "SELECT count(*) FROM bar"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE bar"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, RollbackTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'unique foo_pk a')"));
+  for (int i = 0; i < 100; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i) + ")"));
+
+  // inserts, buffered and written, an update and a delete are undone
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 100; i < 1200; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 0 WHERE a = 5"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET a = 1500 WHERE a = 6"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a = 7"));
+  EXPECT_EQ(1199, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "ROLLBACK"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 150"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 1500"));
+  EXPECT_EQ(5, QueryInt(db, "SELECT b FROM foo WHERE a = 5"));
+  EXPECT_EQ(6, QueryInt(db, "SELECT b FROM foo WHERE a = 6"));
+  EXPECT_EQ(7, QueryInt(db, "SELECT b FROM foo WHERE a = 7"));
+
+  // only what came after the savepoint is undone
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(200, 200)"));
+  EXPECT_TRUE(ExecSQL(db, "SAVEPOINT sp"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(201, 201)"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 0 WHERE a = 200"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a = 8"));
+  EXPECT_TRUE(ExecSQL(db, "ROLLBACK TO sp"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(202, 202)"));
+  EXPECT_TRUE(ExecSQL(db, "RELEASE sp"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  EXPECT_EQ(102, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(200, QueryInt(db, "SELECT b FROM foo WHERE a = 200"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 201"));
+  EXPECT_EQ(202, QueryInt(db, "SELECT b FROM foo WHERE a = 202"));
+  EXPECT_EQ(8, QueryInt(db, "SELECT b FROM foo WHERE a = 8"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+// the extension loaded into a new connection to db_file
+static sqlite3 *OpenConnection(const std::string &db_file) {
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK,
+            sqlite3_open_v2(db_file.c_str(), &db,
+                            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                                SQLITE_OPEN_URI,
+                            nullptr));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  return db;
+}
+
+TEST(VtableTest, ConnectionTest) {
+  remove("sqlite.db");
+  remove("sqlite2.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  remove("other.db");
+  remove("other.log");
+  // connections to one file share its engine, the first one sizes the pool
+  sqlite3 *db = OpenConnection("file:sqlite.db?vtable_pool_size=300");
+  sqlite3 *db2 = OpenConnection("sqlite.db");
+  sqlite3 *other = OpenConnection("file:sqlite2.db?vtable_file=other.db");
+  EXPECT_EQ(300, QueryInt(db2, "SELECT vtable_pool_size()"));
+  EXPECT_EQ(1024, QueryInt(other, "SELECT vtable_pool_size()"));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'unique foo_pk a')"));
+  for (int i = 0; i < 100; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i) + ")"));
+  // the other connection reads the rows through the same heap and index
+  EXPECT_EQ(100, QueryInt(db2, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(42, QueryInt(db2, "SELECT b FROM foo WHERE a = 42"));
+  EXPECT_TRUE(ExecSQL(db2, "UPDATE foo SET b = 0 WHERE a = 42"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT b FROM foo WHERE a = 42"));
+  // each connection has its own transaction
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(100, 100)"));
+  EXPECT_TRUE(ExecSQL(db, "ROLLBACK"));
+  EXPECT_EQ(100, QueryInt(db2, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db2));
+
+  // connections of several threads write to the engine at once
+  const int threads = 4;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++)
+    workers.emplace_back([t] {
+      std::string name = "bar" + std::to_string(t);
+      sqlite3 *db = OpenConnection("file:" + name + ".db");
+      EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE " + name +
+                                  " USING vtable ('a INT, b INT', '" + name +
+                                  "_pk a')"));
+      EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+      for (int i = 0; i < 500; i++)
+        EXPECT_TRUE(ExecSQL(db, "INSERT INTO " + name + " VALUES(" +
+                                    std::to_string(i) + ", " +
+                                    std::to_string(t) + ")"));
+      EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+      EXPECT_EQ(500 * t, QueryInt(db, "SELECT sum(b) FROM " + name));
+      EXPECT_EQ(t, QueryInt(db, "SELECT b FROM " + name + " WHERE a = 250"));
+      EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+      remove((name + ".db").c_str());
+    });
+  for (auto &worker : workers)
+    worker.join();
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(other));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("sqlite2.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  remove("other.db");
+  remove("other.log");
+}
+
+/*
+ * A table the catalog has no heap of fails to connect instead of opening a
+ * heap on a page id never set
+ */
+TEST(VtableTest, MissingHeapTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db = OpenConnection("sqlite.db");
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'foo_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(1, 2)"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+
+  BufferPoolManager *bpm = new BufferPoolManager(50, "vtable.db");
+  Catalog *catalog = new Catalog(bpm);
+  EXPECT_TRUE(catalog->DeleteRecord("foo"));
+  delete catalog;
+  bpm->FlushAllPages();
+  delete bpm;
+
+  db = OpenConnection("sqlite.db");
+  // sqlite reports the failed connect as an error of the statement
+  sqlite3_stmt *stmt;
+  EXPECT_NE(SQLITE_OK,
+            sqlite3_prepare_v2(db, "SELECT * FROM foo", -1, &stmt, 0));
+  EXPECT_NE(nullptr, strstr(sqlite3_errmsg(db), "no heap of table foo"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+/*
+ * The catalog records derived from a table or an index are named apart
+ * from the tables and indexes a user creates, even ones named after them
+ */
+TEST(VtableTest, ReservedNameTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db = OpenConnection("sqlite.db");
+  EXPECT_FALSE(ExecSQL(db, "CREATE VIRTUAL TABLE \"@fsm:foo\" USING vtable "
+                           "('a INT, b INT')"));
+  EXPECT_FALSE(ExecSQL(db, "CREATE VIRTUAL TABLE bar USING vtable "
+                           "('a INT, b INT', '@bar_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo_fsm USING vtable "
+                          "('a INT, b INT', 'foo_fsm_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE bar USING vtable "
+                          "('a INT', 'foo_pk_bloom a')"));
+  EXPECT_TRUE(
+      ExecSQL(db, "CREATE VIRTUAL TABLE foo_clean USING vtable ('a INT')"));
+  for (int i = 0; i < 500; i++) {
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo_fsm VALUES(" +
+                                std::to_string(i) + ", " +
+                                std::to_string(i * 2) + ")"));
+    EXPECT_TRUE(
+        ExecSQL(db, "INSERT INTO bar VALUES(" + std::to_string(i) + ")"));
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo_clean VALUES(" +
+                                std::to_string(i) + ")"));
+  }
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+
+  db = OpenConnection("sqlite.db");
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'bloom foo_pk a')"));
+  for (int i = 0; i < 100; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i) + ")"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+
+  db = OpenConnection("sqlite.db");
+  EXPECT_EQ(500, QueryInt(db, "SELECT count(*) FROM foo_fsm"));
+  EXPECT_EQ(499 * 500, QueryInt(db, "SELECT sum(b) FROM foo_fsm"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(50, QueryInt(db, "SELECT b FROM foo WHERE a = 50"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT count(*) FROM bar WHERE a = 250"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM bar WHERE a < 100"));
+  EXPECT_EQ(500, QueryInt(db, "SELECT count(*) FROM foo_clean"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo_fsm VALUES(500, 1000)"));
+  EXPECT_EQ(501, QueryInt(db, "SELECT count(*) FROM foo_fsm"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+/*
+ * A process exits without closing its connection, nothing but the log and
+ * the pages written on the way is on disk. The tables it created and the
+ * rows it committed are there when the file is opened again, and the index
+ * left open is built again from them
+ */
+TEST(VtableTest, CrashTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    sqlite3 *db = OpenConnection("sqlite.db");
+    bool done = ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                            "('a INT, b INT', 'foo_pk a')") &&
+                ExecSQL(db, "BEGIN");
+    for (int i = 0; i < 1000; i++)
+      done = done && ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                     std::to_string(i) + ", " +
+                                     std::to_string(i * 2) + ")");
+    done = done && ExecSQL(db, "COMMIT");
+    _exit(done ? 0 : 1);
+  }
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(0, WEXITSTATUS(status));
+
+  sqlite3 *db = OpenConnection("sqlite.db");
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(999 * 1000, QueryInt(db, "SELECT sum(b) FROM foo"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT b FROM foo WHERE a = 500").find("INDEX 1:"));
+  for (int i = 0; i < 1000; i += 7)
+    EXPECT_EQ(i * 2, QueryInt(db, "SELECT b FROM foo WHERE a = " +
+                                      std::to_string(i)));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo WHERE a >= 900"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+
+  // closed cleanly this time, the index is opened as it was left
+  db = OpenConnection("sqlite.db");
+  EXPECT_EQ(998, QueryInt(db, "SELECT b FROM foo WHERE a = 499"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo WHERE a < 100"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+/*
+ * A transaction running at the crash inserted, deleted and updated rows,
+ * recovery undoes it in the heap. The index is built again from that heap
+ * and finds neither its rows nor lacks the ones it deleted
+ */
+TEST(VtableTest, CrashUndoTest) {
+  remove("sqlite.db");
+  remove("sqlite2.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    sqlite3 *db = OpenConnection("sqlite.db");
+    bool done = ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                            "('a INT, b INT', 'foo_pk a')") &&
+                ExecSQL(db, "BEGIN");
+    for (int i = 0; i < 1000; i++)
+      done = done && ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                     std::to_string(i) + ", " +
+                                     std::to_string(i * 2) + ")");
+    done = done && ExecSQL(db, "COMMIT") && ExecSQL(db, "BEGIN");
+    for (int i = 1000; i < 1100; i++)
+      done = done && ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                     std::to_string(i) + ", 0)");
+    done = done && ExecSQL(db, "DELETE FROM foo WHERE a < 100") &&
+           ExecSQL(db, "UPDATE foo SET b = -1 WHERE a >= 500");
+    // the commit of another connection to the engine makes the records of
+    // the running transaction durable with its own
+    sqlite3 *other = OpenConnection("file:sqlite2.db?vtable_file=vtable.db");
+    done = done && ExecSQL(other, "CREATE VIRTUAL TABLE bar USING vtable "
+                                  "('a INT')") &&
+           ExecSQL(other, "INSERT INTO bar VALUES(1)");
+    _exit(done ? 0 : 1);
+  }
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(0, WEXITSTATUS(status));
+
+  sqlite3 *db = OpenConnection("sqlite.db");
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a >= 1000"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 1050"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo WHERE a < 100"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT b FROM foo WHERE a = 50"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT b FROM foo WHERE a = 500"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a >= 500 AND "
+                            "b = -1"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("sqlite2.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, CursorReuseTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db = OpenConnection("sqlite.db");
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'unique foo_pk a', 'foo_b b')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 2000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i % 10) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // the cursors closed by a statement start the scans of the next ones,
+  // whatever plan those have
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 2000; i += 97)
+      EXPECT_EQ(i % 10, QueryInt(db, "SELECT b FROM foo WHERE a = " +
+                                         std::to_string(i)));
+    EXPECT_EQ(2000, QueryInt(db, "SELECT count(*) FROM foo"));
+    EXPECT_EQ(200, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 3"));
+    EXPECT_EQ(99, QueryInt(db, "SELECT count(*) FROM foo WHERE a > 1900"));
+    // a scan stopped early by LIMIT holds its leaf until the cursor closes
+    EXPECT_EQ(7, QueryInt(db, "SELECT b FROM foo WHERE b > 5 AND a > 1000 "
+                              "LIMIT 1 OFFSET 1"));
+    // more cursors open at once than a table keeps
+    EXPECT_EQ(2000, QueryInt(db, "SELECT count(*) FROM foo f1, foo f2, "
+                                 "foo f3, foo f4, foo f5, foo f6 WHERE "
+                                 "f2.a = f1.a AND f3.a = f2.a AND f4.a = "
+                                 "f3.a AND f5.a = f4.a AND f6.a = f5.a"));
+  }
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = b + 10 WHERE a < 100"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 13"));
+  EXPECT_EQ(13, QueryInt(db, "SELECT b FROM foo WHERE a = 3"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, RowidTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db = OpenConnection("sqlite.db");
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'unique foo_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE bar USING vtable "
+                          "('a INT, b INT', 'unique bar_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i * 3) + ")"));
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO bar VALUES(" + std::to_string(i) +
+                                ", 0)"));
+  }
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // the row is fetched from the page of its rid, no index is read
+  int64_t rowid = QueryInt(db, "SELECT rowid FROM foo WHERE a = 777");
+  std::string where = " WHERE rowid = " + std::to_string(rowid);
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT b FROM foo" + where).find(":rowid"));
+  EXPECT_EQ(2331, QueryInt(db, "SELECT b FROM foo" + where));
+  std::string rowids =
+      QueryText(db, "SELECT group_concat(rowid) FROM foo WHERE a > 990");
+  EXPECT_EQ(9, QueryInt(db, "SELECT count(*) FROM foo WHERE rowid IN (" +
+                                rowids + ")"));
+  EXPECT_EQ(26865, QueryInt(db, "SELECT sum(b) FROM foo WHERE rowid IN (" +
+                                   rowids + ")"));
+
+  // a rowid of no row, or of a row of another table, finds nothing
+  int64_t bar_rowid = QueryInt(db, "SELECT rowid FROM bar WHERE a = 5");
+  for (int64_t missing : std::vector<int64_t>{-1, 0, rowid + 100000,
+                                              (rowid | 0xffff) - 1,
+                                              bar_rowid})
+    EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE rowid = " +
+                                   std::to_string(missing)));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE rowid = 'x'"));
+
+  // updates and deletes find their rows by rowid
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = -1" + where));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 777"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE rowid IN (" + rowids + ")"));
+  EXPECT_EQ(991, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE rowid IN (" +
+                                rowids + ")"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE bar"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, RowCacheTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db = OpenConnection("file:sqlite.db?vtable_row_cache=256");
+  auto stat = [&](const std::string &name) {
+    return QueryInt(db, "SELECT value FROM vtable_stats WHERE name = '" +
+                            name + "'");
+  };
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT, c VARCHAR(16)', 'unique foo_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i * 3) + ", 'v" +
+                                std::to_string(i) + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  EXPECT_EQ(0, stat("row_cache_hits"));
+
+  // the first lookup fills the cache, the others hit
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(2331, QueryInt(db, "SELECT b FROM foo WHERE a = 777"));
+    EXPECT_EQ("v777", QueryText(db, "SELECT c FROM foo WHERE a = 777"));
+  }
+  EXPECT_EQ(1, stat("row_cache_misses"));
+  EXPECT_EQ(19, stat("row_cache_hits"));
+  EXPECT_EQ(1, stat("row_cache_rows"));
+  EXPECT_EQ(95, stat("row_cache_hit_pct"));
+  int64_t rowid = QueryInt(db, "SELECT rowid FROM foo WHERE a = 777");
+  std::string where = " WHERE rowid = " + std::to_string(rowid);
+  EXPECT_EQ(2331, QueryInt(db, "SELECT b FROM foo" + where));
+  EXPECT_EQ(20, stat("row_cache_hits"));
+
+  // changes are read back, rolled back ones too
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = -1 WHERE a = 777"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 777"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo" + where));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 5 WHERE a = 777"));
+  EXPECT_EQ(5, QueryInt(db, "SELECT b FROM foo WHERE a = 777"));
+  EXPECT_TRUE(ExecSQL(db, "ROLLBACK"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 777"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a = 777"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a = 777"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo" + where));
+  EXPECT_EQ(999, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, PageTraceTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  remove("vtable.trace");
+  sqlite3 *db = OpenConnection("sqlite.db");
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'foo_a a')"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT vtable_page_trace('vtable.trace')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 500; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", 0)"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  EXPECT_EQ(500, QueryInt(db, "SELECT count(*) FROM foo"));
+  int64_t count = QueryInt(db, "SELECT vtable_page_trace()");
+  EXPECT_LT(0, count);
+  EXPECT_EQ(0, QueryInt(db, "SELECT vtable_page_trace()"));
+
+  // every fetch of the trace is unpinned again
+  std::vector<PageTraceRecord> records;
+  ASSERT_TRUE(PageTrace::Read("vtable.trace", records));
+  EXPECT_EQ(static_cast<size_t>(count), records.size());
+  int64_t pins = 0;
+  for (const PageTraceRecord &record : records)
+    pins += record.event_ == static_cast<uint8_t>(PageTraceEvent::UNPIN) ? -1
+            : record.event_ == static_cast<uint8_t>(PageTraceEvent::DELETE)
+                ? 0
+                : 1;
+  EXPECT_EQ(0, pins);
+  EXPECT_EQ(0, QueryInt(db, "SELECT vtable_page_trace('/no/such/dir/t')"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, MemoryBudgetTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db = OpenConnection("sqlite.db");
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'foo_a a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 2000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i % 10) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  int64_t pool_size = QueryInt(db, "SELECT vtable_pool_size()");
+  EXPECT_EQ(pool_size, QueryInt(db, "SELECT value FROM vtable_stats WHERE "
+                                    "name = 'pool_frames'"));
+  EXPECT_EQ(pool_size * PAGE_SIZE,
+            QueryInt(db, "SELECT value FROM vtable_stats WHERE "
+                         "name = 'memory_buffer_pool'"));
+
+  // the pool gives back what the budget takes away, at once
+  int64_t usage = QueryInt(db, "SELECT sum(value) FROM vtable_stats WHERE "
+                               "name LIKE 'memory_%' AND "
+                               "name != 'memory_budget'");
+  int64_t budget = usage - pool_size / 2 * PAGE_SIZE;
+  EXPECT_EQ(0, QueryInt(db, "SELECT vtable_memory_budget(" +
+                                std::to_string(budget) + ")"));
+  EXPECT_EQ(budget, QueryInt(db, "SELECT vtable_memory_budget()"));
+  int64_t frames = QueryInt(db, "SELECT value FROM vtable_stats WHERE "
+                                "name = 'pool_frames'");
+  EXPECT_GE(pool_size / 2 + 16, frames);
+  EXPECT_LE(pool_size / 2 - 16, frames);
+  EXPECT_EQ(2000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM vtable_hash_group "
+                             "WHERE tbl = 'foo' AND group_column = 'b'"));
+  EXPECT_EQ(1999, QueryInt(db, "SELECT a FROM foo WHERE a = 1999"));
+
+  EXPECT_EQ(budget, QueryInt(db, "SELECT vtable_memory_budget(0)"));
+  EXPECT_EQ(pool_size, QueryInt(db, "SELECT value FROM vtable_stats WHERE "
+                                    "name = 'pool_frames'"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, AggregateTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db = OpenConnection("sqlite.db");
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b BIGINT, c DOUBLE, d varchar', "
+                          "'foo_a a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 5000; i++)
+    EXPECT_TRUE(ExecSQL(
+        db, "INSERT INTO foo VALUES(" +
+                (i % 100 == 0 ? std::string("NULL") : std::to_string(i)) +
+                ", " + std::to_string(i * 1000000000ll) + ", " +
+                std::to_string(i) + ".5, 'x')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // the same answers as sqlite's aggregates, nulls left out
+  for (const char *function : {"count", "sum", "max"})
+    for (const char *column : {"a", "b"})
+      EXPECT_EQ(QueryInt(db, std::string("SELECT ") + function + "(" +
+                                 column + ") FROM foo"),
+                QueryInt(db, std::string("SELECT vtable_aggregate('foo', '") +
+                                 column + "', '" + function + "')"));
+  EXPECT_EQ(QueryText(db, "SELECT sum(c) FROM foo"),
+            QueryText(db, "SELECT vtable_aggregate('foo', 'c', 'sum')"));
+  EXPECT_EQ(QueryText(db, "SELECT avg(a) FROM foo"),
+            QueryText(db, "SELECT vtable_aggregate('foo', 'a', 'avg')"));
+  EXPECT_EQ("4999.5",
+            QueryText(db, "SELECT vtable_aggregate('foo', 'c', 'max')"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT vtable_aggregate('foo', 'a', 'min')"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT vtable_aggregate('foo', 'b', 'min')"));
+  EXPECT_FALSE(ExecSQL(db, "SELECT vtable_aggregate('foo', 'd', 'sum')"));
+  EXPECT_FALSE(ExecSQL(db, "SELECT vtable_aggregate('foo', 'a', 'median')"));
+  EXPECT_FALSE(ExecSQL(db, "SELECT vtable_aggregate('bar', 'a', 'sum')"));
+
+  // a sum beyond a BIGINT fails as sqlite's does
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(1, 9223372036854775807, "
+                          "0, 'y')"));
+  EXPECT_FALSE(ExecSQL(db, "SELECT vtable_aggregate('foo', 'b', 'sum')"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT vtable_aggregate('foo', 'a', 'count')"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT vtable_aggregate('foo', 'a', 'sum') IS "
+                            "NULL"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, HashIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'foo_b b using hash')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 500; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i % 50) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // only equality uses the index
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b = 7").find("INDEX 1:"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b > 7").find("INDEX 0:"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(457, QueryInt(db, "SELECT max(a) FROM foo WHERE b = 7"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 50"));
+  EXPECT_EQ(30, QueryInt(db, "SELECT count(*) FROM foo WHERE b > 46"));
+
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE b = 7 AND a < 200"));
+  EXPECT_EQ(6, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 7 WHERE b = 8"));
+  EXPECT_EQ(16, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 8"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, ArtIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b VARCHAR', 'foo_b b using art')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 500; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", 'b" + std::to_string(i % 50) + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // only equality uses the index
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b = 'b7'").find("INDEX 1:"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b > 'b7'").find("INDEX 0:"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b7'"));
+  EXPECT_EQ(457, QueryInt(db, "SELECT max(a) FROM foo WHERE b = 'b7'"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b50'"));
+
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE b = 'b7' AND a < 200"));
+  EXPECT_EQ(6, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b7'"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 'b7' WHERE b = 'b8'"));
+  EXPECT_EQ(16, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b7'"));
+  // a rollback takes the entries back out
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 'b8' WHERE b = 'b7'"));
+  EXPECT_TRUE(ExecSQL(db, "ROLLBACK"));
+  EXPECT_EQ(16, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b7'"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b8'"));
+
+  // nothing of the index is on disk, it is filled again from the heap
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b = 'b7'").find("INDEX 1:"));
+  EXPECT_EQ(16, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b7'"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b9'"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, BufferedIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'buffered unique foo_pk a', "
+                          "'buffered foo_b b')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 5000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                std::to_string(i * 7919 % 5000) + ", " +
+                                std::to_string(i % 50) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // lookups see the buffered entries, scans flush them
+  EXPECT_EQ(27, QueryInt(db, "SELECT b FROM foo WHERE a = 4963"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(4999, QueryInt(db, "SELECT max(a) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a < 1000"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 7 WHERE b = 8"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a = 500"));
+  EXPECT_EQ(160, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+
+  // the entries are applied before the index is closed
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_EQ(4000, QueryInt(db, "SELECT count(*) FROM foo WHERE a >= 0"));
+  EXPECT_EQ(160, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(27, QueryInt(db, "SELECT b FROM foo WHERE a = 4963"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, BloomFilterIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'bloom unique foo_pk a', "
+                          "'bloom foo_b b')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 5000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" +
+                                std::to_string(i * 2) + ", " +
+                                std::to_string(i % 50) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // lookups of keys the index does not have mostly read no page
+  auto misses = [&]() {
+    int64_t fetches =
+        QueryInt(db, "SELECT value FROM vtable_stats WHERE name = 'fetches'");
+    for (int i = 1; i < 2000; i += 20)
+      EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a = " +
+                                    std::to_string(i)));
+    EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 77"));
+    return QueryInt(db,
+                    "SELECT value FROM vtable_stats WHERE name = 'fetches'") -
+           fetches;
+  };
+  EXPECT_GT(20, misses());
+  EXPECT_EQ(7, QueryInt(db, "SELECT b FROM foo WHERE a = 1914"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+
+  // the filters are written as the table closes and read back
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_EQ(7, QueryInt(db, "SELECT b FROM foo WHERE a = 1914"));
+  EXPECT_GT(20, misses());
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(1, 77)"));
+  EXPECT_EQ(77, QueryInt(db, "SELECT b FROM foo WHERE a = 1"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 77"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, TablespaceTest) {
+  std::string db_file = "sqlite.db";
+  for (const char *file : {"sqlite.db", "vtable.db", "vtable.log",
+                           "vtable.spaces", "heap.db", "heap.meta",
+                           "index.db", "index.meta"})
+    remove(file);
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  // the heap in one file, the index in another
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b VARCHAR(20)', 'foo_pk a', "
+                          "'tablespace=heap.db', 'index_tablespace=index.db')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 2000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", 'row " + std::to_string(i) + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+
+  auto file_size = [](const char *name) {
+    struct stat buffer;
+    return stat(name, &buffer) == 0 ? static_cast<int64_t>(buffer.st_size)
+                                    : -1;
+  };
+  EXPECT_LT(10 * PAGE_SIZE, file_size("heap.db"));
+  EXPECT_LT(2 * PAGE_SIZE, file_size("index.db"));
+  // the database file only has the catalog
+  EXPECT_GT(4 * PAGE_SIZE, file_size("vtable.db"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_EQ(2000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(1234, QueryInt(db, "SELECT a FROM foo WHERE a = 1234"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  for (const char *file : {"sqlite.db", "vtable.db", "vtable.log",
+                           "vtable.spaces", "heap.db", "heap.meta",
+                           "index.db", "index.meta"})
+    remove(file);
+}
+
+TEST(VtableTest, PartitionTest) {
+  std::string db_file = "sqlite.db";
+  const char *files[] = {"sqlite.db",        "vtable.db",
+                         "vtable.log",       "vtable.spaces",
+                         "vtable_foo_p0.db", "vtable_foo_p0.meta",
+                         "vtable_foo_p1.db", "vtable_foo_p1.meta",
+                         "vtable_foo_p2.db", "vtable_foo_p2.meta",
+                         "vtable_bar_p0.db", "vtable_bar_p0.meta",
+                         "vtable_bar_p1.db", "vtable_bar_p1.meta",
+                         "vtable_bar_p2.db", "vtable_bar_p2.meta",
+                         "vtable_bar_p3.db", "vtable_bar_p3.meta"};
+  for (const char *file : files)
+    remove(file);
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  // rows of a below 1000 in the first partition, up to 3000 in the second
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'foo_pk a', 'foo_b b', "
+                          "'partition=range(a,1000,3000)')"));
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE bar USING vtable "
+                          "('a INT, b INT', 'bar_pk a', "
+                          "'partition=hash(a,4)')"));
+  EXPECT_FALSE(ExecSQL(db, "CREATE VIRTUAL TABLE baz USING vtable "
+                           "('a INT, b VARCHAR(8)', 'partition=hash(b,4)')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 4000; i++) {
+    std::string row =
+        std::to_string(i) + ", " + std::to_string(i % 10) + ")";
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + row));
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO bar VALUES(" + row));
+  }
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  auto check = [&]() {
+    EXPECT_EQ(4000, QueryInt(db, "SELECT count(*) FROM foo"));
+    EXPECT_EQ(7998000, QueryInt(db, "SELECT sum(a) FROM bar"));
+    // pruned by the range of a
+    EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo WHERE a >= 3000"));
+    EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo "
+                                "WHERE a >= 950 AND a < 1050"));
+    EXPECT_EQ(2500, QueryInt(db, "SELECT a FROM foo WHERE a = 2500"));
+    EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a < 0"));
+    // the index of every partition is read for other columns
+    EXPECT_EQ(400, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+    EXPECT_EQ(1234, QueryInt(db, "SELECT a FROM bar WHERE a = 1234"));
+    EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM bar "
+                               "WHERE a > 100 AND a <= 110"));
+  };
+  check();
+
+  // an update of the key moves the row to another partition
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET a = 5000 WHERE a = 10"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE bar SET a = -1 WHERE a = 10"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT count(*) FROM foo WHERE a = 5000"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT count(*) FROM foo WHERE a = 10"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT count(*) FROM bar WHERE a = -1"));
+  EXPECT_EQ(1001, QueryInt(db, "SELECT count(*) FROM foo WHERE a >= 3000"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET a = 10 WHERE a = 5000"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE bar SET a = 10 WHERE a = -1"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a >= 3990"));
+  EXPECT_EQ(3990, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo SELECT a, b FROM bar "
+                          "WHERE a >= 3990"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+
+  // the partitions are found again on reopen
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  check();
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE bar"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  for (const char *file : files)
+    remove(file);
+}
+
+TEST(VtableTest, LsmTableTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable_lsm "
+                          "('a INT, b varchar')"));
+  // enough rows for memtables to be written as runs
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 20000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", 'row " + std::to_string(i) + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  EXPECT_EQ(20000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(4999, QueryInt(db, "SELECT a FROM foo WHERE rowid = 5000"));
+  EXPECT_EQ("row 4999",
+            QueryText(db, "SELECT b FROM foo WHERE rowid = 5000"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo "
+                              "WHERE rowid > 100 AND rowid <= 200"));
+  EXPECT_EQ(19999, QueryInt(db, "SELECT a FROM foo ORDER BY rowid DESC"));
+
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = NULL WHERE rowid = 7"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT count(*) FROM foo WHERE b IS NULL"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a >= 1000"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo"));
+  // a rowid taken fails the insert
+  EXPECT_FALSE(ExecSQL(db, "INSERT INTO foo(rowid, a) VALUES(10, 0)"));
+  // the writes of a transaction are undone by its rollback
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE rowid <= 500"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET a = -1"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(1, 'new')"));
+  EXPECT_TRUE(ExecSQL(db, "ROLLBACK"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(499500, QueryInt(db, "SELECT sum(a) FROM foo"));
+
+  // the memtable is written as the table closes
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT count(*) FROM foo WHERE b IS NULL"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(20000, 'last')"));
+  // the rowid of the insert rolled back is not given again
+  EXPECT_EQ(20002, QueryInt(db, "SELECT max(rowid) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, PoolSizeTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  // the buffer pool is sized by a parameter of the database uri
+  EXPECT_EQ(SQLITE_OK,
+            sqlite3_open_v2(("file:" + db_file + "?vtable_pool_size=300")
+                                .c_str(),
+                            &db,
+                            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                                SQLITE_OPEN_URI,
+                            nullptr));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_EQ(300, QueryInt(db, "SELECT vtable_pool_size()"));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b varchar', 'unique foo_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 2000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", 'row " + std::to_string(i) + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  EXPECT_EQ(2000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, PaxTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  // the page format goes before or after the index
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b varchar(16), c bigint', 'foo_pk a', "
+                          "'pax')"));
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE bar USING vtable "
+                          "('a INT, b varchar(16)', 'pax')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", 'b" + std::to_string(i % 10) + "', " +
+                                std::to_string(i % 100) + ")"));
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO bar VALUES(" + std::to_string(i) +
+                                ", 'b" + std::to_string(i) + "')"));
+  }
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 'b3'"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 42"));
+  // index scan reads the columns in place
+  EXPECT_EQ(42, QueryInt(db, "SELECT c FROM foo WHERE a = 942"));
+  EXPECT_EQ(2, QueryInt(db, "SELECT length(b) FROM foo WHERE a = 942"));
+  EXPECT_EQ(1, QueryInt(db, "SELECT count(*) FROM bar WHERE b = 'b999'"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo x, bar y WHERE "
+                               "x.a = y.a"));
+  // varchars grow in place
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET b = 'longer value' WHERE c = 5"));
+  EXPECT_EQ(10, QueryInt(db, "SELECT count(*) FROM foo WHERE "
+                             "b = 'longer value'"));
+  EXPECT_EQ(5, QueryInt(db, "SELECT c FROM foo WHERE a = 705"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE c < 50"));
+  EXPECT_EQ(500, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(37250, QueryInt(db, "SELECT sum(c) FROM foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE bar"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, ScanThreadsTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  // sequential scans of large tables are split over two threads
+  EXPECT_EQ(SQLITE_OK,
+            sqlite3_open_v2(("file:" + db_file + "?vtable_scan_threads=2")
+                                .c_str(),
+                            &db,
+                            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                                SQLITE_OPEN_URI,
+                            nullptr));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b bigint, c varchar', 'foo_pk a')"));
+  std::string padding(60, 'x');
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 5000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i % 10) + ", '" +
+                                padding + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  EXPECT_EQ(5000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(12497500, QueryInt(db, "SELECT sum(a) FROM foo"));
+  EXPECT_EQ(500, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 3"));
+  EXPECT_EQ(3000, QueryInt(db, "SELECT count(*) FROM foo WHERE "
+                               "length(c) = 60 AND b >= 4"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo x, foo y WHERE "
+                               "x.a < 2 AND y.b = x.a"));
+  // a scan stopped early lets its workers go
+  EXPECT_EQ(3, QueryInt(db, "SELECT count(*) FROM (SELECT b FROM foo "
+                            "LIMIT 3)"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, StatsTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK,
+            sqlite3_open_v2(("file:" + db_file + "?vtable_pool_size=16")
+                                .c_str(),
+                            &db,
+                            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                                SQLITE_OPEN_URI,
+                            nullptr));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  EXPECT_EQ(16, QueryInt(db, "SELECT value FROM vtable_stats "
+                             "WHERE name = 'pool_size'"));
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b varchar', 'unique foo_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  std::string padding(100, 'x');
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", '" + padding + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo"));
+
+  // a pool of 16 frames can not hold the table
+  auto stat = [&](const std::string &name) {
+    return QueryInt(db, "SELECT value FROM vtable_stats WHERE name = '" +
+                            name + "'");
+  };
+  EXPECT_LT(0, stat("fetches"));
+  EXPECT_LT(0, stat("hits"));
+  EXPECT_LT(0, stat("misses"));
+  EXPECT_LT(0, stat("evictions"));
+  EXPECT_LT(0, stat("writebacks"));
+  EXPECT_EQ(0, stat("new_page_failures"));
+  EXPECT_EQ(stat("fetches"), stat("hits") + stat("misses"));
+  // latency histograms are listed next to the counters
+  EXPECT_LE(1000, stat("btree_insert_count"));
+  EXPECT_LT(0, stat("disk_write_count"));
+  EXPECT_LE(stat("disk_write_p50_ns"), stat("disk_write_max_ns"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, LatchProfileTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db;
+  EXPECT_EQ(SQLITE_OK, sqlite3_open(db_file.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_enable_load_extension(db, 1));
+  char *zErrMsg = 0;
+  EXPECT_EQ(SQLITE_OK, sqlite3_load_extension(db, "libvtable", 0, &zErrMsg));
+  auto stat = [&](const std::string &name) {
+    return QueryInt(db, "SELECT value FROM vtable_stats WHERE name = '" +
+                            name + "'");
+  };
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b varchar', 'foo_pk a')"));
+  EXPECT_EQ(0, QueryInt(db, "SELECT vtable_latch_profile(1, 1)"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  std::string padding(100, 'x');
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", '" + padding + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo WHERE a >= 0"));
+  EXPECT_LT(0, stat("buffer_pool_latch_acquires"));
+  EXPECT_LT(0, stat("page_latch_acquires"));
+  EXPECT_LE(0, stat("page_latch_wait_ns"));
+
+  // one connection does not contend with itself, waits on every page are
+  // made up so that the report names the owners of heap and index pages
+  for (page_id_t page_id = 1; page_id < 80; ++page_id)
+    LatchStats::RecordWait(LatchClass::PAGE, 1000 + page_id, page_id);
+  std::string report = QueryText(db, "SELECT vtable_hot_pages(80)");
+  EXPECT_EQ(0u, report.find("79 "));
+  EXPECT_NE(std::string::npos, report.find(" table foo waits 1 wait_ns "));
+  EXPECT_NE(std::string::npos, report.find(" index foo_pk leaf waits 1 "));
+  EXPECT_EQ("", QueryText(db, "SELECT vtable_hot_pages(0)"));
+
+  // off, nothing more is counted
+  EXPECT_EQ(1, QueryInt(db, "SELECT vtable_latch_profile(0)"));
+  int64_t acquires = stat("page_latch_acquires");
+  EXPECT_EQ(1000, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(acquires, stat("page_latch_acquires"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove(db_file.c_str());
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+TEST(VtableTest, OnlineIndexTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db = OpenConnection("sqlite.db");
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT, c varchar', 'unique foo_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 5000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i % 100) + ", 'c" +
+                                std::to_string(i % 10) + "')"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  // indexes declared over the rows, as CREATE INDEX would
+  EXPECT_TRUE(ExecSQL(db, "PRAGMA writable_schema = ON"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE sqlite_master SET sql = replace(sql, "
+                          "'''unique foo_pk a''', '''unique foo_pk a'', "
+                          "''foo_b b'', ''foo_c c''') WHERE name = 'foo'"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+
+  // the first connection to open the table builds them on four threads,
+  // the other keeps writing meanwhile
+  db = OpenConnection("file:sqlite.db?vtable_scan_threads=4");
+  sqlite3 *db2 = OpenConnection("sqlite.db");
+  // the sqlite file is locked while the other connection reads its schema
+  sqlite3_busy_timeout(db2, 1000);
+  std::thread writer([&] {
+    // a write dies under wait-die while the older scan locks the table
+    auto exec = [&](const std::string &sql) {
+      for (int attempt = 0; attempt < 1000; attempt++) {
+        if (ExecSQL(db2, sql))
+          return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      return false;
+    };
+    for (int i = 5000; i < 6000; i++)
+      EXPECT_TRUE(exec("INSERT INTO foo VALUES(" + std::to_string(i) + ", " +
+                       std::to_string(i % 100) + ", 'c" +
+                       std::to_string(i % 10) + "')"));
+    EXPECT_TRUE(exec("DELETE FROM foo WHERE a < 100"));
+  });
+  EXPECT_LE(4900, QueryInt(db, "SELECT count(*) FROM foo"));
+  writer.join();
+
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE b = 7").find(":foo_b"));
+  EXPECT_NE(std::string::npos,
+            QueryPlan(db, "SELECT * FROM foo WHERE c = 'c7'").find(":foo_c"));
+  EXPECT_EQ(59, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(590, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 'c7'"));
+  EXPECT_EQ(59, QueryInt(db2, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 7"));
+  EXPECT_EQ(7, QueryInt(db, "SELECT b FROM foo WHERE a = 5907"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db2));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+
+  // built once, the next connection finds their roots
+  db = OpenConnection("sqlite.db");
+  EXPECT_EQ(59, QueryInt(db, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(590, QueryInt(db, "SELECT count(*) FROM foo WHERE c = 'c7'"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
+/*
+ * A statement outside a write reads a snapshot, the rows another connection
+ * changes and has not committed are read as they were, by the heap and by
+ * either index, without waiting for its locks
+ */
+TEST(VtableTest, SnapshotTest) {
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+  sqlite3 *db = OpenConnection("sqlite.db");
+  sqlite3 *db2 = OpenConnection("sqlite.db");
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo USING vtable "
+                          "('a INT, b INT', 'unique foo_pk a', 'foo_b b')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 100; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(" + std::to_string(i) +
+                                ", " + std::to_string(i % 10) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  // the key of a = 1 moves, a = 2 is gone and a = 1000 is new
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo SET a = 500, b = 7 WHERE a = 1"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo WHERE a = 2"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo VALUES(1000, 1)"));
+  EXPECT_EQ(100, QueryInt(db, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(-1, QueryInt(db, "SELECT b FROM foo WHERE a = 1"));
+
+  EXPECT_EQ(100, QueryInt(db2, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(4950, QueryInt(db2, "SELECT sum(a) FROM foo"));
+  EXPECT_EQ(1, QueryInt(db2, "SELECT b FROM foo WHERE a = 1"));
+  EXPECT_EQ(2, QueryInt(db2, "SELECT b FROM foo WHERE a = 2"));
+  EXPECT_EQ(-1, QueryInt(db2, "SELECT b FROM foo WHERE a = 500"));
+  EXPECT_EQ(-1, QueryInt(db2, "SELECT b FROM foo WHERE a = 1000"));
+  EXPECT_EQ(3, QueryInt(db2, "SELECT count(*) FROM foo WHERE a < 3"));
+  EXPECT_EQ(0, QueryInt(db2, "SELECT count(*) FROM foo WHERE a >= 100"));
+  EXPECT_EQ(10, QueryInt(db2, "SELECT count(*) FROM foo WHERE b = 1"));
+  EXPECT_EQ(10, QueryInt(db2, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(0, QueryInt(db2, "SELECT a FROM foo ORDER BY a LIMIT 1"));
+  EXPECT_EQ(1, QueryInt(db2, "SELECT a FROM foo ORDER BY a LIMIT 1 OFFSET 1"));
+  EXPECT_EQ(99, QueryInt(db2, "SELECT a FROM foo ORDER BY a DESC LIMIT 1"));
+
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  EXPECT_EQ(100, QueryInt(db2, "SELECT count(*) FROM foo"));
+  EXPECT_EQ(-1, QueryInt(db2, "SELECT b FROM foo WHERE a = 1"));
+  EXPECT_EQ(7, QueryInt(db2, "SELECT b FROM foo WHERE a = 500"));
+  EXPECT_EQ(1, QueryInt(db2, "SELECT count(*) FROM foo WHERE a < 3"));
+  EXPECT_EQ(11, QueryInt(db2, "SELECT count(*) FROM foo WHERE b = 7"));
+  EXPECT_EQ(1000, QueryInt(db2, "SELECT a FROM foo ORDER BY a DESC LIMIT 1"));
+
+  // rows changing while a scan reads the index, from its leaves or not, are
+  // read as the snapshot sees them and in key order. The scan holds the
+  // first leaf, the rows changed are on others. The writer commits once the
+  // scan let go of the sqlite file
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE bar USING vtable "
+                          "('a INT, b INT', 'unique bar_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int i = 0; i < 2000; i++)
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO bar VALUES(" + std::to_string(i * 2) +
+                                ", " + std::to_string(i) + ")"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+  int key = 3000;
+  for (const char *sql :
+       {"SELECT a FROM bar ORDER BY a", "SELECT a, b FROM bar ORDER BY a"}) {
+    std::string before = QueryText(
+        db2, "SELECT group_concat(a) FROM (SELECT a FROM bar ORDER BY a)");
+    sqlite3_stmt *stmt;
+    EXPECT_EQ(SQLITE_OK, sqlite3_prepare_v2(db2, sql, -1, &stmt, nullptr));
+    std::string rows;
+    for (int i = 0; i < 10 && sqlite3_step(stmt) == SQLITE_ROW; i++)
+      rows += (rows.empty() ? "" : ",") +
+              std::to_string(sqlite3_column_int(stmt, 0));
+    key += 2;
+    EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+    EXPECT_TRUE(ExecSQL(db, "UPDATE bar SET a = " + std::to_string(key - 999) +
+                                " WHERE a = " + std::to_string(key)));
+    EXPECT_TRUE(ExecSQL(db, "UPDATE bar SET a = a + 6000 WHERE a = " +
+                                std::to_string(key + 500)));
+    EXPECT_TRUE(ExecSQL(db, "DELETE FROM bar WHERE a = " +
+                                std::to_string(key + 200)));
+    EXPECT_TRUE(ExecSQL(db, "INSERT INTO bar VALUES(" +
+                                std::to_string(key - 499) + ", 0)"));
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+      rows += "," + std::to_string(sqlite3_column_int(stmt, 0));
+    EXPECT_EQ(SQLITE_OK, sqlite3_finalize(stmt));
+    EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+    EXPECT_EQ(before, rows);
+  }
+  EXPECT_EQ(2000, QueryInt(db2, "SELECT count(*) FROM bar"));
+  EXPECT_EQ(2005, QueryInt(db2, "SELECT a FROM bar WHERE b = 1502"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE bar"));
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo"));
+
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db2));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  remove("sqlite.db");
+  remove("vtable.db");
+  remove("vtable.log");
+}
+
 } // namespace cmudb